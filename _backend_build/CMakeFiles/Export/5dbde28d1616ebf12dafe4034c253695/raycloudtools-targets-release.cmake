@@ -0,0 +1,19 @@
+#----------------------------------------------------------------
+# Generated CMake target import file for configuration "Release".
+#----------------------------------------------------------------
+
+# Commands may need to know the format version.
+set(CMAKE_IMPORT_FILE_VERSION 1)
+
+# Import target "raycloud::raylib" for configuration "Release"
+set_property(TARGET raycloud::raylib APPEND PROPERTY IMPORTED_CONFIGURATIONS RELEASE)
+set_target_properties(raycloud::raylib PROPERTIES
+  IMPORTED_LOCATION_RELEASE "${_IMPORT_PREFIX}/lib/libraylib.so.0.0.1"
+  IMPORTED_SONAME_RELEASE "libraylib.so.0.0.1"
+  )
+
+list(APPEND _cmake_import_check_targets raycloud::raylib )
+list(APPEND _cmake_import_check_files_for_raycloud::raylib "${_IMPORT_PREFIX}/lib/libraylib.so.0.0.1" )
+
+# Commands beyond this point should not need to know the version.
+set(CMAKE_IMPORT_FILE_VERSION)
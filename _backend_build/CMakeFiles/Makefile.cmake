@@ -0,0 +1,257 @@
+# CMAKE generated file: DO NOT EDIT!
+# Generated by "Unix Makefiles" Generator, CMake Version 3.25
+
+# The generator used is:
+set(CMAKE_DEPENDS_GENERATOR "Unix Makefiles")
+
+# The top level Makefile was generated from the following files:
+set(CMAKE_MAKEFILE_DEPENDS
+  "CMakeCache.txt"
+  "/root/miniconda/lib/cmake/GTest/GTestConfig.cmake"
+  "/root/miniconda/lib/cmake/GTest/GTestConfigVersion.cmake"
+  "/root/miniconda/lib/cmake/GTest/GTestTargets-release.cmake"
+  "/root/miniconda/lib/cmake/GTest/GTestTargets.cmake"
+  "/root/repo/3rd-party/CMakeLists.txt"
+  "/root/repo/3rd-party/simple_fft/CMakeLists.txt"
+  "/root/repo/CMakeLists.txt"
+  "CMakeFiles/3.25.1/CMakeCCompiler.cmake"
+  "CMakeFiles/3.25.1/CMakeCXXCompiler.cmake"
+  "CMakeFiles/3.25.1/CMakeSystem.cmake"
+  "/root/repo/cmake/Config.in.cmake"
+  "/root/repo/cmake/RasAddExecutable.cmake"
+  "/root/repo/cmake/RasAddLibrary.cmake"
+  "/root/repo/cmake/RasAddTest.cmake"
+  "/root/repo/cmake/RasClangTidy.cmake"
+  "/root/repo/cmake/RasCompilerSetup.cmake"
+  "/root/repo/cmake/RasProjectSetup.cmake"
+  "/root/repo/cmake/RasSourceGroupExtensions.cmake"
+  "/root/repo/cmake/RasUtil.cmake"
+  "/root/repo/raycloudtools/CMakeLists.txt"
+  "/root/repo/raycloudtools/ray/CMakeLists.txt"
+  "/root/repo/raycloudtools/rayalign/CMakeLists.txt"
+  "/root/repo/raycloudtools/raychain/CMakeLists.txt"
+  "/root/repo/raycloudtools/raycolour/CMakeLists.txt"
+  "/root/repo/raycloudtools/raycombine/CMakeLists.txt"
+  "/root/repo/raycloudtools/raycreate/CMakeLists.txt"
+  "/root/repo/raycloudtools/raydecimate/CMakeLists.txt"
+  "/root/repo/raycloudtools/raydenoise/CMakeLists.txt"
+  "/root/repo/raycloudtools/raydensity/CMakeLists.txt"
+  "/root/repo/raycloudtools/rayexport/CMakeLists.txt"
+  "/root/repo/raycloudtools/rayextract/CMakeLists.txt"
+  "/root/repo/raycloudtools/rayimport/CMakeLists.txt"
+  "/root/repo/raycloudtools/raylod/CMakeLists.txt"
+  "/root/repo/raycloudtools/rayrender/CMakeLists.txt"
+  "/root/repo/raycloudtools/rayrestore/CMakeLists.txt"
+  "/root/repo/raycloudtools/rayrotate/CMakeLists.txt"
+  "/root/repo/raycloudtools/rayserve/CMakeLists.txt"
+  "/root/repo/raycloudtools/raysmooth/CMakeLists.txt"
+  "/root/repo/raycloudtools/raysplit/CMakeLists.txt"
+  "/root/repo/raycloudtools/raytransients/CMakeLists.txt"
+  "/root/repo/raycloudtools/raytranslate/CMakeLists.txt"
+  "/root/repo/raycloudtools/raytreeconvert/CMakeLists.txt"
+  "/root/repo/raycloudtools/raywrap/CMakeLists.txt"
+  "/root/repo/raylib/CMakeLists.txt"
+  "/root/repo/raylib/raylibconfig.in.h"
+  "/root/repo/tests/CMakeLists.txt"
+  "/root/repo/tests/raytest/CMakeLists.txt"
+  "/tmp/nabo-prefix/share/libnabo/cmake/libnaboConfig.cmake"
+  "/usr/share/cmake-3.25/Modules/BasicConfigVersion-SameMajorVersion.cmake.in"
+  "/usr/share/cmake-3.25/Modules/CMakeCCompiler.cmake.in"
+  "/usr/share/cmake-3.25/Modules/CMakeCCompilerABI.c"
+  "/usr/share/cmake-3.25/Modules/CMakeCInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeCXXCompiler.cmake.in"
+  "/usr/share/cmake-3.25/Modules/CMakeCXXCompilerABI.cpp"
+  "/usr/share/cmake-3.25/Modules/CMakeCXXInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeCheckCompilerFlagCommonPatterns.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeCommonLanguageInclude.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeCompilerIdDetection.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeDetermineCCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeDetermineCXXCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeDetermineCompileFeatures.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeDetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeDetermineCompilerABI.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeDetermineCompilerId.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeDetermineSystem.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeFindBinUtils.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeFindDependencyMacro.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeGenericSystem.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeInitializeConfigs.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeLanguageInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakePackageConfigHelpers.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeParseArguments.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeParseImplicitIncludeInfo.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeParseImplicitLinkInfo.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeParseLibraryArchitecture.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeSystem.cmake.in"
+  "/usr/share/cmake-3.25/Modules/CMakeSystemSpecificInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeSystemSpecificInitialize.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeTestCCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeTestCXXCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeTestCompilerCommon.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeUnixFindMake.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckCCompilerFlag.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckCSourceCompiles.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckCXXCompilerFlag.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckCXXSourceCompiles.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckIncludeFile.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckLibraryExists.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/ADSP-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/ARMCC-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/ARMClang-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/AppleClang-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/Borland-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/Bruce-C-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/CMakeCommonCompilerMacros.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/Clang-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/Clang-DetermineCompilerInternal.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/Comeau-CXX-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/Compaq-C-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/Compaq-CXX-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/Cray-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/Embarcadero-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/Fujitsu-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/FujitsuClang-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GHS-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU-C-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU-C.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU-CXX-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU-CXX.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU-FindBinUtils.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/HP-C-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/HP-CXX-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/IAR-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/IBMCPP-C-DetermineVersionInternal.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/IBMCPP-CXX-DetermineVersionInternal.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/IBMClang-C-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/IBMClang-CXX-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/Intel-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/IntelLLVM-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/LCC-C-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/LCC-CXX-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/MSVC-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/NVHPC-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/NVIDIA-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/OpenWatcom-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/PGI-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/PathScale-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/SCO-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/SDCC-C-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/SunPro-C-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/SunPro-CXX-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/TI-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/Tasking-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/TinyCC-C-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/VisualAge-C-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/VisualAge-CXX-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/Watcom-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/XL-C-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/XL-CXX-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/XLClang-C-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/XLClang-CXX-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/zOS-C-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/zOS-CXX-DetermineCompiler.cmake"
+  "/usr/share/cmake-3.25/Modules/FindCURL.cmake"
+  "/usr/share/cmake-3.25/Modules/FindGTest.cmake"
+  "/usr/share/cmake-3.25/Modules/FindOpenMP.cmake"
+  "/usr/share/cmake-3.25/Modules/FindPackageHandleStandardArgs.cmake"
+  "/usr/share/cmake-3.25/Modules/FindPackageMessage.cmake"
+  "/usr/share/cmake-3.25/Modules/FindPkgConfig.cmake"
+  "/usr/share/cmake-3.25/Modules/FindThreads.cmake"
+  "/usr/share/cmake-3.25/Modules/GenerateExportHeader.cmake"
+  "/usr/share/cmake-3.25/Modules/GoogleTest.cmake"
+  "/usr/share/cmake-3.25/Modules/InstallRequiredSystemLibraries.cmake"
+  "/usr/share/cmake-3.25/Modules/Internal/CheckCompilerFlag.cmake"
+  "/usr/share/cmake-3.25/Modules/Internal/CheckFlagCommonConfig.cmake"
+  "/usr/share/cmake-3.25/Modules/Internal/CheckSourceCompiles.cmake"
+  "/usr/share/cmake-3.25/Modules/Internal/FeatureTesting.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux-Determine-CXX.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux-GNU-C.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux-GNU-CXX.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux-GNU.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/UnixPaths.cmake"
+  "/usr/share/cmake-3.25/Modules/WriteBasicConfigVersionFile.cmake"
+  "/usr/share/cmake-3.25/Modules/exportheader.cmake.in"
+  "/usr/share/eigen3/cmake/Eigen3Config.cmake"
+  "/usr/share/eigen3/cmake/Eigen3ConfigVersion.cmake"
+  "/usr/share/eigen3/cmake/Eigen3Targets.cmake"
+  )
+
+# The corresponding makefile is:
+set(CMAKE_MAKEFILE_OUTPUTS
+  "Makefile"
+  "CMakeFiles/cmake.check_cache"
+  )
+
+# Byproducts of CMake generate step:
+set(CMAKE_MAKEFILE_PRODUCTS
+  "CMakeFiles/3.25.1/CMakeSystem.cmake"
+  "CMakeFiles/3.25.1/CMakeCCompiler.cmake"
+  "CMakeFiles/3.25.1/CMakeCXXCompiler.cmake"
+  "CMakeFiles/3.25.1/CMakeCCompiler.cmake"
+  "CMakeFiles/3.25.1/CMakeCXXCompiler.cmake"
+  "raycloudtools-version.cmake"
+  "raycloudtools-config.cmake"
+  "CMakeFiles/CMakeDirectoryInformation.cmake"
+  "3rd-party/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "3rd-party/simple_fft/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raylib/raylibconfig.h"
+  "raylib/raylib_export.h"
+  "raylib/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/rayalign/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/raychain/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/raycolour/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/raycombine/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/raycreate/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/raydecimate/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/raydenoise/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/raydensity/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/rayexport/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/rayextract/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/rayimport/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/raylod/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/rayrotate/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/raysmooth/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/raysplit/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/raytransients/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/raytranslate/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/raytreeconvert/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/rayrender/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/rayrestore/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/rayserve/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/raywrap/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "raycloudtools/ray/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "tests/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "tests/raytest/CMakeFiles/CMakeDirectoryInformation.cmake"
+  )
+
+# Dependency information for all targets:
+set(CMAKE_DEPEND_INFO_FILES
+  "raylib/CMakeFiles/raylib.dir/DependInfo.cmake"
+  "raycloudtools/rayalign/CMakeFiles/rayalign.dir/DependInfo.cmake"
+  "raycloudtools/raychain/CMakeFiles/raychain.dir/DependInfo.cmake"
+  "raycloudtools/raycolour/CMakeFiles/raycolour.dir/DependInfo.cmake"
+  "raycloudtools/raycombine/CMakeFiles/raycombine.dir/DependInfo.cmake"
+  "raycloudtools/raycreate/CMakeFiles/raycreate.dir/DependInfo.cmake"
+  "raycloudtools/raydecimate/CMakeFiles/raydecimate.dir/DependInfo.cmake"
+  "raycloudtools/raydenoise/CMakeFiles/raydenoise.dir/DependInfo.cmake"
+  "raycloudtools/raydensity/CMakeFiles/raydensity.dir/DependInfo.cmake"
+  "raycloudtools/rayexport/CMakeFiles/rayexport.dir/DependInfo.cmake"
+  "raycloudtools/rayextract/CMakeFiles/rayextract.dir/DependInfo.cmake"
+  "raycloudtools/rayimport/CMakeFiles/rayimport.dir/DependInfo.cmake"
+  "raycloudtools/raylod/CMakeFiles/raylod.dir/DependInfo.cmake"
+  "raycloudtools/rayrotate/CMakeFiles/rayrotate.dir/DependInfo.cmake"
+  "raycloudtools/raysmooth/CMakeFiles/raysmooth.dir/DependInfo.cmake"
+  "raycloudtools/raysplit/CMakeFiles/raysplit.dir/DependInfo.cmake"
+  "raycloudtools/raytransients/CMakeFiles/raytransients.dir/DependInfo.cmake"
+  "raycloudtools/raytranslate/CMakeFiles/raytranslate.dir/DependInfo.cmake"
+  "raycloudtools/raytreeconvert/CMakeFiles/raytreeconvert.dir/DependInfo.cmake"
+  "raycloudtools/rayrender/CMakeFiles/rayrender.dir/DependInfo.cmake"
+  "raycloudtools/rayrestore/CMakeFiles/rayrestore.dir/DependInfo.cmake"
+  "raycloudtools/rayserve/CMakeFiles/rayserve.dir/DependInfo.cmake"
+  "raycloudtools/raywrap/CMakeFiles/raywrap.dir/DependInfo.cmake"
+  "raycloudtools/ray/CMakeFiles/ray.dir/DependInfo.cmake"
+  "tests/raytest/CMakeFiles/raytest.dir/DependInfo.cmake"
+  )
@@ -0,0 +1,72 @@
+# Install script for directory: /root/repo/raycloudtools
+
+# Set the install prefix
+if(NOT DEFINED CMAKE_INSTALL_PREFIX)
+  set(CMAKE_INSTALL_PREFIX "/usr/local")
+endif()
+string(REGEX REPLACE "/$" "" CMAKE_INSTALL_PREFIX "${CMAKE_INSTALL_PREFIX}")
+
+# Set the install configuration name.
+if(NOT DEFINED CMAKE_INSTALL_CONFIG_NAME)
+  if(BUILD_TYPE)
+    string(REGEX REPLACE "^[^A-Za-z0-9_]+" ""
+           CMAKE_INSTALL_CONFIG_NAME "${BUILD_TYPE}")
+  else()
+    set(CMAKE_INSTALL_CONFIG_NAME "Release")
+  endif()
+  message(STATUS "Install configuration: \"${CMAKE_INSTALL_CONFIG_NAME}\"")
+endif()
+
+# Set the component getting installed.
+if(NOT CMAKE_INSTALL_COMPONENT)
+  if(COMPONENT)
+    message(STATUS "Install component: \"${COMPONENT}\"")
+    set(CMAKE_INSTALL_COMPONENT "${COMPONENT}")
+  else()
+    set(CMAKE_INSTALL_COMPONENT)
+  endif()
+endif()
+
+# Install shared libraries without execute permission?
+if(NOT DEFINED CMAKE_INSTALL_SO_NO_EXE)
+  set(CMAKE_INSTALL_SO_NO_EXE "1")
+endif()
+
+# Is this installation the result of a crosscompile?
+if(NOT DEFINED CMAKE_CROSSCOMPILING)
+  set(CMAKE_CROSSCOMPILING "FALSE")
+endif()
+
+# Set default install directory permissions.
+if(NOT DEFINED CMAKE_OBJDUMP)
+  set(CMAKE_OBJDUMP "/usr/bin/objdump")
+endif()
+
+if(NOT CMAKE_INSTALL_LOCAL_ONLY)
+  # Include the install script for each subdirectory.
+  include("/root/repo/_backend_build/raycloudtools/rayalign/cmake_install.cmake")
+  include("/root/repo/_backend_build/raycloudtools/raychain/cmake_install.cmake")
+  include("/root/repo/_backend_build/raycloudtools/raycolour/cmake_install.cmake")
+  include("/root/repo/_backend_build/raycloudtools/raycombine/cmake_install.cmake")
+  include("/root/repo/_backend_build/raycloudtools/raycreate/cmake_install.cmake")
+  include("/root/repo/_backend_build/raycloudtools/raydecimate/cmake_install.cmake")
+  include("/root/repo/_backend_build/raycloudtools/raydenoise/cmake_install.cmake")
+  include("/root/repo/_backend_build/raycloudtools/raydensity/cmake_install.cmake")
+  include("/root/repo/_backend_build/raycloudtools/rayexport/cmake_install.cmake")
+  include("/root/repo/_backend_build/raycloudtools/rayextract/cmake_install.cmake")
+  include("/root/repo/_backend_build/raycloudtools/rayimport/cmake_install.cmake")
+  include("/root/repo/_backend_build/raycloudtools/raylod/cmake_install.cmake")
+  include("/root/repo/_backend_build/raycloudtools/rayrotate/cmake_install.cmake")
+  include("/root/repo/_backend_build/raycloudtools/raysmooth/cmake_install.cmake")
+  include("/root/repo/_backend_build/raycloudtools/raysplit/cmake_install.cmake")
+  include("/root/repo/_backend_build/raycloudtools/raytransients/cmake_install.cmake")
+  include("/root/repo/_backend_build/raycloudtools/raytranslate/cmake_install.cmake")
+  include("/root/repo/_backend_build/raycloudtools/raytreeconvert/cmake_install.cmake")
+  include("/root/repo/_backend_build/raycloudtools/rayrender/cmake_install.cmake")
+  include("/root/repo/_backend_build/raycloudtools/rayrestore/cmake_install.cmake")
+  include("/root/repo/_backend_build/raycloudtools/rayserve/cmake_install.cmake")
+  include("/root/repo/_backend_build/raycloudtools/raywrap/cmake_install.cmake")
+  include("/root/repo/_backend_build/raycloudtools/ray/cmake_install.cmake")
+
+endif()
+
@@ -0,0 +1,41 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/raycloudtools/rayalign/rayalign.cpp" "raycloudtools/ray/CMakeFiles/ray.dir/__/rayalign/rayalign.cpp.o" "gcc" "raycloudtools/ray/CMakeFiles/ray.dir/__/rayalign/rayalign.cpp.o.d"
+  "/root/repo/raycloudtools/raychain/raychain.cpp" "raycloudtools/ray/CMakeFiles/ray.dir/__/raychain/raychain.cpp.o" "gcc" "raycloudtools/ray/CMakeFiles/ray.dir/__/raychain/raychain.cpp.o.d"
+  "/root/repo/raycloudtools/raycolour/raycolour.cpp" "raycloudtools/ray/CMakeFiles/ray.dir/__/raycolour/raycolour.cpp.o" "gcc" "raycloudtools/ray/CMakeFiles/ray.dir/__/raycolour/raycolour.cpp.o.d"
+  "/root/repo/raycloudtools/raycombine/raycombine.cpp" "raycloudtools/ray/CMakeFiles/ray.dir/__/raycombine/raycombine.cpp.o" "gcc" "raycloudtools/ray/CMakeFiles/ray.dir/__/raycombine/raycombine.cpp.o.d"
+  "/root/repo/raycloudtools/raycreate/raycreate.cpp" "raycloudtools/ray/CMakeFiles/ray.dir/__/raycreate/raycreate.cpp.o" "gcc" "raycloudtools/ray/CMakeFiles/ray.dir/__/raycreate/raycreate.cpp.o.d"
+  "/root/repo/raycloudtools/raydecimate/raydecimate.cpp" "raycloudtools/ray/CMakeFiles/ray.dir/__/raydecimate/raydecimate.cpp.o" "gcc" "raycloudtools/ray/CMakeFiles/ray.dir/__/raydecimate/raydecimate.cpp.o.d"
+  "/root/repo/raycloudtools/raydenoise/raydenoise.cpp" "raycloudtools/ray/CMakeFiles/ray.dir/__/raydenoise/raydenoise.cpp.o" "gcc" "raycloudtools/ray/CMakeFiles/ray.dir/__/raydenoise/raydenoise.cpp.o.d"
+  "/root/repo/raycloudtools/raydensity/raydensity.cpp" "raycloudtools/ray/CMakeFiles/ray.dir/__/raydensity/raydensity.cpp.o" "gcc" "raycloudtools/ray/CMakeFiles/ray.dir/__/raydensity/raydensity.cpp.o.d"
+  "/root/repo/raycloudtools/rayexport/rayexport.cpp" "raycloudtools/ray/CMakeFiles/ray.dir/__/rayexport/rayexport.cpp.o" "gcc" "raycloudtools/ray/CMakeFiles/ray.dir/__/rayexport/rayexport.cpp.o.d"
+  "/root/repo/raycloudtools/rayextract/rayextract.cpp" "raycloudtools/ray/CMakeFiles/ray.dir/__/rayextract/rayextract.cpp.o" "gcc" "raycloudtools/ray/CMakeFiles/ray.dir/__/rayextract/rayextract.cpp.o.d"
+  "/root/repo/raycloudtools/rayimport/rayimport.cpp" "raycloudtools/ray/CMakeFiles/ray.dir/__/rayimport/rayimport.cpp.o" "gcc" "raycloudtools/ray/CMakeFiles/ray.dir/__/rayimport/rayimport.cpp.o.d"
+  "/root/repo/raycloudtools/raylod/raylod.cpp" "raycloudtools/ray/CMakeFiles/ray.dir/__/raylod/raylod.cpp.o" "gcc" "raycloudtools/ray/CMakeFiles/ray.dir/__/raylod/raylod.cpp.o.d"
+  "/root/repo/raycloudtools/rayrender/rayrender.cpp" "raycloudtools/ray/CMakeFiles/ray.dir/__/rayrender/rayrender.cpp.o" "gcc" "raycloudtools/ray/CMakeFiles/ray.dir/__/rayrender/rayrender.cpp.o.d"
+  "/root/repo/raycloudtools/rayrestore/rayrestore.cpp" "raycloudtools/ray/CMakeFiles/ray.dir/__/rayrestore/rayrestore.cpp.o" "gcc" "raycloudtools/ray/CMakeFiles/ray.dir/__/rayrestore/rayrestore.cpp.o.d"
+  "/root/repo/raycloudtools/rayrotate/rayrotate.cpp" "raycloudtools/ray/CMakeFiles/ray.dir/__/rayrotate/rayrotate.cpp.o" "gcc" "raycloudtools/ray/CMakeFiles/ray.dir/__/rayrotate/rayrotate.cpp.o.d"
+  "/root/repo/raycloudtools/raysmooth/raysmooth.cpp" "raycloudtools/ray/CMakeFiles/ray.dir/__/raysmooth/raysmooth.cpp.o" "gcc" "raycloudtools/ray/CMakeFiles/ray.dir/__/raysmooth/raysmooth.cpp.o.d"
+  "/root/repo/raycloudtools/raysplit/raysplit.cpp" "raycloudtools/ray/CMakeFiles/ray.dir/__/raysplit/raysplit.cpp.o" "gcc" "raycloudtools/ray/CMakeFiles/ray.dir/__/raysplit/raysplit.cpp.o.d"
+  "/root/repo/raycloudtools/raytransients/raytransients.cpp" "raycloudtools/ray/CMakeFiles/ray.dir/__/raytransients/raytransients.cpp.o" "gcc" "raycloudtools/ray/CMakeFiles/ray.dir/__/raytransients/raytransients.cpp.o.d"
+  "/root/repo/raycloudtools/raytranslate/raytranslate.cpp" "raycloudtools/ray/CMakeFiles/ray.dir/__/raytranslate/raytranslate.cpp.o" "gcc" "raycloudtools/ray/CMakeFiles/ray.dir/__/raytranslate/raytranslate.cpp.o.d"
+  "/root/repo/raycloudtools/raytreeconvert/raytreeconvert.cpp" "raycloudtools/ray/CMakeFiles/ray.dir/__/raytreeconvert/raytreeconvert.cpp.o" "gcc" "raycloudtools/ray/CMakeFiles/ray.dir/__/raytreeconvert/raytreeconvert.cpp.o.d"
+  "/root/repo/raycloudtools/raywrap/raywrap.cpp" "raycloudtools/ray/CMakeFiles/ray.dir/__/raywrap/raywrap.cpp.o" "gcc" "raycloudtools/ray/CMakeFiles/ray.dir/__/raywrap/raywrap.cpp.o.d"
+  "/root/repo/raycloudtools/ray/ray.cpp" "raycloudtools/ray/CMakeFiles/ray.dir/ray.cpp.o" "gcc" "raycloudtools/ray/CMakeFiles/ray.dir/ray.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  "/root/repo/_backend_build/raylib/CMakeFiles/raylib.dir/DependInfo.cmake"
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
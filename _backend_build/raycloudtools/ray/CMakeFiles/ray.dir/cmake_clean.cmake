@@ -0,0 +1,54 @@
+file(REMOVE_RECURSE
+  "../../bin/ray"
+  "../../bin/ray-0.0.1"
+  "../../bin/ray.pdb"
+  "CMakeFiles/ray.dir/__/rayalign/rayalign.cpp.o"
+  "CMakeFiles/ray.dir/__/rayalign/rayalign.cpp.o.d"
+  "CMakeFiles/ray.dir/__/raychain/raychain.cpp.o"
+  "CMakeFiles/ray.dir/__/raychain/raychain.cpp.o.d"
+  "CMakeFiles/ray.dir/__/raycolour/raycolour.cpp.o"
+  "CMakeFiles/ray.dir/__/raycolour/raycolour.cpp.o.d"
+  "CMakeFiles/ray.dir/__/raycombine/raycombine.cpp.o"
+  "CMakeFiles/ray.dir/__/raycombine/raycombine.cpp.o.d"
+  "CMakeFiles/ray.dir/__/raycreate/raycreate.cpp.o"
+  "CMakeFiles/ray.dir/__/raycreate/raycreate.cpp.o.d"
+  "CMakeFiles/ray.dir/__/raydecimate/raydecimate.cpp.o"
+  "CMakeFiles/ray.dir/__/raydecimate/raydecimate.cpp.o.d"
+  "CMakeFiles/ray.dir/__/raydenoise/raydenoise.cpp.o"
+  "CMakeFiles/ray.dir/__/raydenoise/raydenoise.cpp.o.d"
+  "CMakeFiles/ray.dir/__/raydensity/raydensity.cpp.o"
+  "CMakeFiles/ray.dir/__/raydensity/raydensity.cpp.o.d"
+  "CMakeFiles/ray.dir/__/rayexport/rayexport.cpp.o"
+  "CMakeFiles/ray.dir/__/rayexport/rayexport.cpp.o.d"
+  "CMakeFiles/ray.dir/__/rayextract/rayextract.cpp.o"
+  "CMakeFiles/ray.dir/__/rayextract/rayextract.cpp.o.d"
+  "CMakeFiles/ray.dir/__/rayimport/rayimport.cpp.o"
+  "CMakeFiles/ray.dir/__/rayimport/rayimport.cpp.o.d"
+  "CMakeFiles/ray.dir/__/raylod/raylod.cpp.o"
+  "CMakeFiles/ray.dir/__/raylod/raylod.cpp.o.d"
+  "CMakeFiles/ray.dir/__/rayrender/rayrender.cpp.o"
+  "CMakeFiles/ray.dir/__/rayrender/rayrender.cpp.o.d"
+  "CMakeFiles/ray.dir/__/rayrestore/rayrestore.cpp.o"
+  "CMakeFiles/ray.dir/__/rayrestore/rayrestore.cpp.o.d"
+  "CMakeFiles/ray.dir/__/rayrotate/rayrotate.cpp.o"
+  "CMakeFiles/ray.dir/__/rayrotate/rayrotate.cpp.o.d"
+  "CMakeFiles/ray.dir/__/raysmooth/raysmooth.cpp.o"
+  "CMakeFiles/ray.dir/__/raysmooth/raysmooth.cpp.o.d"
+  "CMakeFiles/ray.dir/__/raysplit/raysplit.cpp.o"
+  "CMakeFiles/ray.dir/__/raysplit/raysplit.cpp.o.d"
+  "CMakeFiles/ray.dir/__/raytransients/raytransients.cpp.o"
+  "CMakeFiles/ray.dir/__/raytransients/raytransients.cpp.o.d"
+  "CMakeFiles/ray.dir/__/raytranslate/raytranslate.cpp.o"
+  "CMakeFiles/ray.dir/__/raytranslate/raytranslate.cpp.o.d"
+  "CMakeFiles/ray.dir/__/raytreeconvert/raytreeconvert.cpp.o"
+  "CMakeFiles/ray.dir/__/raytreeconvert/raytreeconvert.cpp.o.d"
+  "CMakeFiles/ray.dir/__/raywrap/raywrap.cpp.o"
+  "CMakeFiles/ray.dir/__/raywrap/raywrap.cpp.o.d"
+  "CMakeFiles/ray.dir/ray.cpp.o"
+  "CMakeFiles/ray.dir/ray.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/ray.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,12 @@
+file(REMOVE_RECURSE
+  "../../bin/rayalign"
+  "../../bin/rayalign-0.0.1"
+  "../../bin/rayalign.pdb"
+  "CMakeFiles/rayalign.dir/rayalign.cpp.o"
+  "CMakeFiles/rayalign.dir/rayalign.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/rayalign.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,12 @@
+file(REMOVE_RECURSE
+  "../../bin/raychain"
+  "../../bin/raychain-0.0.1"
+  "../../bin/raychain.pdb"
+  "CMakeFiles/raychain.dir/raychain.cpp.o"
+  "CMakeFiles/raychain.dir/raychain.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/raychain.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,12 @@
+file(REMOVE_RECURSE
+  "../../bin/raycolour"
+  "../../bin/raycolour-0.0.1"
+  "../../bin/raycolour.pdb"
+  "CMakeFiles/raycolour.dir/raycolour.cpp.o"
+  "CMakeFiles/raycolour.dir/raycolour.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/raycolour.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
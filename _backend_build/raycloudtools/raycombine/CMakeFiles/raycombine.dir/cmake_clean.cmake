@@ -0,0 +1,12 @@
+file(REMOVE_RECURSE
+  "../../bin/raycombine"
+  "../../bin/raycombine-0.0.1"
+  "../../bin/raycombine.pdb"
+  "CMakeFiles/raycombine.dir/raycombine.cpp.o"
+  "CMakeFiles/raycombine.dir/raycombine.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/raycombine.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
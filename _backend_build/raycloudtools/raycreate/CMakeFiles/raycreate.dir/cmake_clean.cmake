@@ -0,0 +1,12 @@
+file(REMOVE_RECURSE
+  "../../bin/raycreate"
+  "../../bin/raycreate-0.0.1"
+  "../../bin/raycreate.pdb"
+  "CMakeFiles/raycreate.dir/raycreate.cpp.o"
+  "CMakeFiles/raycreate.dir/raycreate.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/raycreate.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
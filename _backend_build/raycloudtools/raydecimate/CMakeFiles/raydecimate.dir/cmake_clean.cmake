@@ -0,0 +1,12 @@
+file(REMOVE_RECURSE
+  "../../bin/raydecimate"
+  "../../bin/raydecimate-0.0.1"
+  "../../bin/raydecimate.pdb"
+  "CMakeFiles/raydecimate.dir/raydecimate.cpp.o"
+  "CMakeFiles/raydecimate.dir/raydecimate.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/raydecimate.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
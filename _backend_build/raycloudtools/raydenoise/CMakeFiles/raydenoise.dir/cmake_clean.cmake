@@ -0,0 +1,12 @@
+file(REMOVE_RECURSE
+  "../../bin/raydenoise"
+  "../../bin/raydenoise-0.0.1"
+  "../../bin/raydenoise.pdb"
+  "CMakeFiles/raydenoise.dir/raydenoise.cpp.o"
+  "CMakeFiles/raydenoise.dir/raydenoise.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/raydenoise.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,12 @@
+file(REMOVE_RECURSE
+  "../../bin/raydensity"
+  "../../bin/raydensity-0.0.1"
+  "../../bin/raydensity.pdb"
+  "CMakeFiles/raydensity.dir/raydensity.cpp.o"
+  "CMakeFiles/raydensity.dir/raydensity.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/raydensity.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
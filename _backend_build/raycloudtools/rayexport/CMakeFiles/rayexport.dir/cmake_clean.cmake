@@ -0,0 +1,12 @@
+file(REMOVE_RECURSE
+  "../../bin/rayexport"
+  "../../bin/rayexport-0.0.1"
+  "../../bin/rayexport.pdb"
+  "CMakeFiles/rayexport.dir/rayexport.cpp.o"
+  "CMakeFiles/rayexport.dir/rayexport.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/rayexport.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,12 @@
+file(REMOVE_RECURSE
+  "../../bin/rayextract"
+  "../../bin/rayextract-0.0.1"
+  "../../bin/rayextract.pdb"
+  "CMakeFiles/rayextract.dir/rayextract.cpp.o"
+  "CMakeFiles/rayextract.dir/rayextract.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/rayextract.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,12 @@
+file(REMOVE_RECURSE
+  "../../bin/rayimport"
+  "../../bin/rayimport-0.0.1"
+  "../../bin/rayimport.pdb"
+  "CMakeFiles/rayimport.dir/rayimport.cpp.o"
+  "CMakeFiles/rayimport.dir/rayimport.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/rayimport.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,12 @@
+file(REMOVE_RECURSE
+  "../../bin/raylod"
+  "../../bin/raylod-0.0.1"
+  "../../bin/raylod.pdb"
+  "CMakeFiles/raylod.dir/raylod.cpp.o"
+  "CMakeFiles/raylod.dir/raylod.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/raylod.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,12 @@
+file(REMOVE_RECURSE
+  "../../bin/rayrender"
+  "../../bin/rayrender-0.0.1"
+  "../../bin/rayrender.pdb"
+  "CMakeFiles/rayrender.dir/rayrender.cpp.o"
+  "CMakeFiles/rayrender.dir/rayrender.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/rayrender.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
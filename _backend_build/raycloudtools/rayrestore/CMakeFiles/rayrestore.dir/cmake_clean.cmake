@@ -0,0 +1,12 @@
+file(REMOVE_RECURSE
+  "../../bin/rayrestore"
+  "../../bin/rayrestore-0.0.1"
+  "../../bin/rayrestore.pdb"
+  "CMakeFiles/rayrestore.dir/rayrestore.cpp.o"
+  "CMakeFiles/rayrestore.dir/rayrestore.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/rayrestore.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
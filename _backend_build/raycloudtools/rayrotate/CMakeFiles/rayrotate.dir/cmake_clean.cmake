@@ -0,0 +1,12 @@
+file(REMOVE_RECURSE
+  "../../bin/rayrotate"
+  "../../bin/rayrotate-0.0.1"
+  "../../bin/rayrotate.pdb"
+  "CMakeFiles/rayrotate.dir/rayrotate.cpp.o"
+  "CMakeFiles/rayrotate.dir/rayrotate.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/rayrotate.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,12 @@
+file(REMOVE_RECURSE
+  "../../bin/rayserve"
+  "../../bin/rayserve-0.0.1"
+  "../../bin/rayserve.pdb"
+  "CMakeFiles/rayserve.dir/rayserve.cpp.o"
+  "CMakeFiles/rayserve.dir/rayserve.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/rayserve.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
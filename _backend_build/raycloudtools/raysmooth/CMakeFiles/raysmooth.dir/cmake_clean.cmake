@@ -0,0 +1,12 @@
+file(REMOVE_RECURSE
+  "../../bin/raysmooth"
+  "../../bin/raysmooth-0.0.1"
+  "../../bin/raysmooth.pdb"
+  "CMakeFiles/raysmooth.dir/raysmooth.cpp.o"
+  "CMakeFiles/raysmooth.dir/raysmooth.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/raysmooth.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
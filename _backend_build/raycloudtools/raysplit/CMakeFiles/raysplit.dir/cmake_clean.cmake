@@ -0,0 +1,12 @@
+file(REMOVE_RECURSE
+  "../../bin/raysplit"
+  "../../bin/raysplit-0.0.1"
+  "../../bin/raysplit.pdb"
+  "CMakeFiles/raysplit.dir/raysplit.cpp.o"
+  "CMakeFiles/raysplit.dir/raysplit.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/raysplit.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,12 @@
+file(REMOVE_RECURSE
+  "../../bin/raytransients"
+  "../../bin/raytransients-0.0.1"
+  "../../bin/raytransients.pdb"
+  "CMakeFiles/raytransients.dir/raytransients.cpp.o"
+  "CMakeFiles/raytransients.dir/raytransients.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/raytransients.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,12 @@
+file(REMOVE_RECURSE
+  "../../bin/raytranslate"
+  "../../bin/raytranslate-0.0.1"
+  "../../bin/raytranslate.pdb"
+  "CMakeFiles/raytranslate.dir/raytranslate.cpp.o"
+  "CMakeFiles/raytranslate.dir/raytranslate.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/raytranslate.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,12 @@
+file(REMOVE_RECURSE
+  "../../bin/raytreeconvert"
+  "../../bin/raytreeconvert-0.0.1"
+  "../../bin/raytreeconvert.pdb"
+  "CMakeFiles/raytreeconvert.dir/raytreeconvert.cpp.o"
+  "CMakeFiles/raytreeconvert.dir/raytreeconvert.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/raytreeconvert.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
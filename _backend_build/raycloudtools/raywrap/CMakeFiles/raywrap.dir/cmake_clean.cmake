@@ -0,0 +1,12 @@
+file(REMOVE_RECURSE
+  "../../bin/raywrap"
+  "../../bin/raywrap-0.0.1"
+  "../../bin/raywrap.pdb"
+  "CMakeFiles/raywrap.dir/raywrap.cpp.o"
+  "CMakeFiles/raywrap.dir/raywrap.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/raywrap.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
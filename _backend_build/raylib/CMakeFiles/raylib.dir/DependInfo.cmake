@@ -0,0 +1,103 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/raylib/extraction/rayclusters.cpp" "raylib/CMakeFiles/raylib.dir/extraction/rayclusters.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/extraction/rayclusters.cpp.o.d"
+  "/root/repo/raylib/extraction/rayforest.cpp" "raylib/CMakeFiles/raylib.dir/extraction/rayforest.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/extraction/rayforest.cpp.o.d"
+  "/root/repo/raylib/extraction/rayforest_draw.cpp" "raylib/CMakeFiles/raylib.dir/extraction/rayforest_draw.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/extraction/rayforest_draw.cpp.o.d"
+  "/root/repo/raylib/extraction/rayforest_watershed.cpp" "raylib/CMakeFiles/raylib.dir/extraction/rayforest_watershed.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/extraction/rayforest_watershed.cpp.o.d"
+  "/root/repo/raylib/extraction/raygrid2d.cpp" "raylib/CMakeFiles/raylib.dir/extraction/raygrid2d.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/extraction/raygrid2d.cpp.o.d"
+  "/root/repo/raylib/extraction/raysegment.cpp" "raylib/CMakeFiles/raylib.dir/extraction/raysegment.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/extraction/raysegment.cpp.o.d"
+  "/root/repo/raylib/extraction/rayshortestpath.cpp" "raylib/CMakeFiles/raylib.dir/extraction/rayshortestpath.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/extraction/rayshortestpath.cpp.o.d"
+  "/root/repo/raylib/extraction/rayterrain.cpp" "raylib/CMakeFiles/raylib.dir/extraction/rayterrain.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/extraction/rayterrain.cpp.o.d"
+  "/root/repo/raylib/extraction/raytrees.cpp" "raylib/CMakeFiles/raylib.dir/extraction/raytrees.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/extraction/raytrees.cpp.o.d"
+  "/root/repo/raylib/extraction/raytrunk.cpp" "raylib/CMakeFiles/raylib.dir/extraction/raytrunk.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/extraction/raytrunk.cpp.o.d"
+  "/root/repo/raylib/extraction/raytrunks.cpp" "raylib/CMakeFiles/raylib.dir/extraction/raytrunks.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/extraction/raytrunks.cpp.o.d"
+  "/root/repo/raylib/rayalignment.cpp" "raylib/CMakeFiles/raylib.dir/rayalignment.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayalignment.cpp.o.d"
+  "/root/repo/raylib/rayallocprofile.cpp" "raylib/CMakeFiles/raylib.dir/rayallocprofile.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayallocprofile.cpp.o.d"
+  "/root/repo/raylib/rayasyncreader_uring.cpp" "raylib/CMakeFiles/raylib.dir/rayasyncreader_uring.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayasyncreader_uring.cpp.o.d"
+  "/root/repo/raylib/rayaxisalign.cpp" "raylib/CMakeFiles/raylib.dir/rayaxisalign.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayaxisalign.cpp.o.d"
+  "/root/repo/raylib/raybuildinggen.cpp" "raylib/CMakeFiles/raylib.dir/raybuildinggen.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raybuildinggen.cpp.o.d"
+  "/root/repo/raylib/raychain.cpp" "raylib/CMakeFiles/raylib.dir/raychain.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raychain.cpp.o.d"
+  "/root/repo/raylib/raychange.cpp" "raylib/CMakeFiles/raylib.dir/raychange.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raychange.cpp.o.d"
+  "/root/repo/raylib/raycheckpoint.cpp" "raylib/CMakeFiles/raylib.dir/raycheckpoint.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raycheckpoint.cpp.o.d"
+  "/root/repo/raylib/raychunksizer.cpp" "raylib/CMakeFiles/raylib.dir/raychunksizer.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raychunksizer.cpp.o.d"
+  "/root/repo/raylib/raycloud.cpp" "raylib/CMakeFiles/raylib.dir/raycloud.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raycloud.cpp.o.d"
+  "/root/repo/raylib/raycloudserver.cpp" "raylib/CMakeFiles/raylib.dir/raycloudserver.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raycloudserver.cpp.o.d"
+  "/root/repo/raylib/raycloudwriter.cpp" "raylib/CMakeFiles/raylib.dir/raycloudwriter.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raycloudwriter.cpp.o.d"
+  "/root/repo/raylib/raycompactcloud.cpp" "raylib/CMakeFiles/raylib.dir/raycompactcloud.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raycompactcloud.cpp.o.d"
+  "/root/repo/raylib/rayconcavehull.cpp" "raylib/CMakeFiles/raylib.dir/rayconcavehull.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayconcavehull.cpp.o.d"
+  "/root/repo/raylib/rayconvexhull.cpp" "raylib/CMakeFiles/raylib.dir/rayconvexhull.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayconvexhull.cpp.o.d"
+  "/root/repo/raylib/raycuboid.cpp" "raylib/CMakeFiles/raylib.dir/raycuboid.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raycuboid.cpp.o.d"
+  "/root/repo/raylib/raydebugdraw_none.cpp" "raylib/CMakeFiles/raylib.dir/raydebugdraw_none.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raydebugdraw_none.cpp.o.d"
+  "/root/repo/raylib/raydebugdrawqueue.cpp" "raylib/CMakeFiles/raylib.dir/raydebugdrawqueue.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raydebugdrawqueue.cpp.o.d"
+  "/root/repo/raylib/raydecimation.cpp" "raylib/CMakeFiles/raylib.dir/raydecimation.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raydecimation.cpp.o.d"
+  "/root/repo/raylib/raydelaunay.cpp" "raylib/CMakeFiles/raylib.dir/raydelaunay.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raydelaunay.cpp.o.d"
+  "/root/repo/raylib/raydenoise.cpp" "raylib/CMakeFiles/raylib.dir/raydenoise.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raydenoise.cpp.o.d"
+  "/root/repo/raylib/rayellipsoid.cpp" "raylib/CMakeFiles/raylib.dir/rayellipsoid.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayellipsoid.cpp.o.d"
+  "/root/repo/raylib/rayfinealignment.cpp" "raylib/CMakeFiles/raylib.dir/rayfinealignment.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayfinealignment.cpp.o.d"
+  "/root/repo/raylib/rayforestgen.cpp" "raylib/CMakeFiles/raylib.dir/rayforestgen.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayforestgen.cpp.o.d"
+  "/root/repo/raylib/rayforeststructure.cpp" "raylib/CMakeFiles/raylib.dir/rayforeststructure.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayforeststructure.cpp.o.d"
+  "/root/repo/raylib/raygpu_none.cpp" "raylib/CMakeFiles/raylib.dir/raygpu_none.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raygpu_none.cpp.o.d"
+  "/root/repo/raylib/rayheightfieldwrap.cpp" "raylib/CMakeFiles/raylib.dir/rayheightfieldwrap.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayheightfieldwrap.cpp.o.d"
+  "/root/repo/raylib/rayingest.cpp" "raylib/CMakeFiles/raylib.dir/rayingest.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayingest.cpp.o.d"
+  "/root/repo/raylib/raykernels.cpp" "raylib/CMakeFiles/raylib.dir/raykernels.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raykernels.cpp.o.d"
+  "/root/repo/raylib/raylaz.cpp" "raylib/CMakeFiles/raylib.dir/raylaz.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raylaz.cpp.o.d"
+  "/root/repo/raylib/raylod.cpp" "raylib/CMakeFiles/raylib.dir/raylod.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raylod.cpp.o.d"
+  "/root/repo/raylib/raymappedfile.cpp" "raylib/CMakeFiles/raylib.dir/raymappedfile.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raymappedfile.cpp.o.d"
+  "/root/repo/raylib/raymemory.cpp" "raylib/CMakeFiles/raylib.dir/raymemory.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raymemory.cpp.o.d"
+  "/root/repo/raylib/raymerger.cpp" "raylib/CMakeFiles/raylib.dir/raymerger.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raymerger.cpp.o.d"
+  "/root/repo/raylib/raymesh.cpp" "raylib/CMakeFiles/raylib.dir/raymesh.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raymesh.cpp.o.d"
+  "/root/repo/raylib/raymorton.cpp" "raylib/CMakeFiles/raylib.dir/raymorton.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raymorton.cpp.o.d"
+  "/root/repo/raylib/rayneighbours.cpp" "raylib/CMakeFiles/raylib.dir/rayneighbours.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayneighbours.cpp.o.d"
+  "/root/repo/raylib/raynodes.cpp" "raylib/CMakeFiles/raylib.dir/raynodes.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raynodes.cpp.o.d"
+  "/root/repo/raylib/raynuma.cpp" "raylib/CMakeFiles/raylib.dir/raynuma.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raynuma.cpp.o.d"
+  "/root/repo/raylib/rayparse.cpp" "raylib/CMakeFiles/raylib.dir/rayparse.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayparse.cpp.o.d"
+  "/root/repo/raylib/rayperfcounters.cpp" "raylib/CMakeFiles/raylib.dir/rayperfcounters.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayperfcounters.cpp.o.d"
+  "/root/repo/raylib/rayply.cpp" "raylib/CMakeFiles/raylib.dir/rayply.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayply.cpp.o.d"
+  "/root/repo/raylib/rayplyindex.cpp" "raylib/CMakeFiles/raylib.dir/rayplyindex.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayplyindex.cpp.o.d"
+  "/root/repo/raylib/rayprofile.cpp" "raylib/CMakeFiles/raylib.dir/rayprofile.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayprofile.cpp.o.d"
+  "/root/repo/raylib/rayprogressthread.cpp" "raylib/CMakeFiles/raylib.dir/rayprogressthread.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayprogressthread.cpp.o.d"
+  "/root/repo/raylib/rayquickhull.cpp" "raylib/CMakeFiles/raylib.dir/rayquickhull.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayquickhull.cpp.o.d"
+  "/root/repo/raylib/rayrandom.cpp" "raylib/CMakeFiles/raylib.dir/rayrandom.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayrandom.cpp.o.d"
+  "/root/repo/raylib/rayrcb.cpp" "raylib/CMakeFiles/raylib.dir/rayrcb.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayrcb.cpp.o.d"
+  "/root/repo/raylib/rayregistration.cpp" "raylib/CMakeFiles/raylib.dir/rayregistration.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayregistration.cpp.o.d"
+  "/root/repo/raylib/rayremotefile.cpp" "raylib/CMakeFiles/raylib.dir/rayremotefile.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayremotefile.cpp.o.d"
+  "/root/repo/raylib/rayremotefile_curl.cpp" "raylib/CMakeFiles/raylib.dir/rayremotefile_curl.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayremotefile_curl.cpp.o.d"
+  "/root/repo/raylib/rayrenderer.cpp" "raylib/CMakeFiles/raylib.dir/rayrenderer.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayrenderer.cpp.o.d"
+  "/root/repo/raylib/rayroomgen.cpp" "raylib/CMakeFiles/raylib.dir/rayroomgen.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayroomgen.cpp.o.d"
+  "/root/repo/raylib/rayscenegen.cpp" "raylib/CMakeFiles/raylib.dir/rayscenegen.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayscenegen.cpp.o.d"
+  "/root/repo/raylib/raysmooth.cpp" "raylib/CMakeFiles/raylib.dir/raysmooth.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raysmooth.cpp.o.d"
+  "/root/repo/raylib/raysort.cpp" "raylib/CMakeFiles/raylib.dir/raysort.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raysort.cpp.o.d"
+  "/root/repo/raylib/raysplitter.cpp" "raylib/CMakeFiles/raylib.dir/raysplitter.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raysplitter.cpp.o.d"
+  "/root/repo/raylib/raysurfelcache.cpp" "raylib/CMakeFiles/raylib.dir/raysurfelcache.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raysurfelcache.cpp.o.d"
+  "/root/repo/raylib/rayterraingen.cpp" "raylib/CMakeFiles/raylib.dir/rayterraingen.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayterraingen.cpp.o.d"
+  "/root/repo/raylib/raythreads.cpp" "raylib/CMakeFiles/raylib.dir/raythreads.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raythreads.cpp.o.d"
+  "/root/repo/raylib/raytilecache.cpp" "raylib/CMakeFiles/raylib.dir/raytilecache.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raytilecache.cpp.o.d"
+  "/root/repo/raylib/raytiles.cpp" "raylib/CMakeFiles/raylib.dir/raytiles.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raytiles.cpp.o.d"
+  "/root/repo/raylib/raytool.cpp" "raylib/CMakeFiles/raylib.dir/raytool.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raytool.cpp.o.d"
+  "/root/repo/raylib/raytrajectory.cpp" "raylib/CMakeFiles/raylib.dir/raytrajectory.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raytrajectory.cpp.o.d"
+  "/root/repo/raylib/raytransientgrid.cpp" "raylib/CMakeFiles/raylib.dir/raytransientgrid.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raytransientgrid.cpp.o.d"
+  "/root/repo/raylib/raytreegen.cpp" "raylib/CMakeFiles/raylib.dir/raytreegen.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raytreegen.cpp.o.d"
+  "/root/repo/raylib/raytreestructure.cpp" "raylib/CMakeFiles/raylib.dir/raytreestructure.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/raytreestructure.cpp.o.d"
+  "/root/repo/raylib/rayvoxelset.cpp" "raylib/CMakeFiles/raylib.dir/rayvoxelset.cpp.o" "gcc" "raylib/CMakeFiles/raylib.dir/rayvoxelset.cpp.o.d"
+  )
+
+# Pairs of files generated by the same build rule.
+set(CMAKE_MULTIPLE_OUTPUT_PAIRS
+  "/root/repo/_backend_build/raylib/libraylib.so" "/root/repo/_backend_build/raylib/libraylib.so.0.0.1"
+  )
+
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
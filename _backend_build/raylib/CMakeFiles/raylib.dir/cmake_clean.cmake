@@ -0,0 +1,168 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/raylib.dir/extraction/rayclusters.cpp.o"
+  "CMakeFiles/raylib.dir/extraction/rayclusters.cpp.o.d"
+  "CMakeFiles/raylib.dir/extraction/rayforest.cpp.o"
+  "CMakeFiles/raylib.dir/extraction/rayforest.cpp.o.d"
+  "CMakeFiles/raylib.dir/extraction/rayforest_draw.cpp.o"
+  "CMakeFiles/raylib.dir/extraction/rayforest_draw.cpp.o.d"
+  "CMakeFiles/raylib.dir/extraction/rayforest_watershed.cpp.o"
+  "CMakeFiles/raylib.dir/extraction/rayforest_watershed.cpp.o.d"
+  "CMakeFiles/raylib.dir/extraction/raygrid2d.cpp.o"
+  "CMakeFiles/raylib.dir/extraction/raygrid2d.cpp.o.d"
+  "CMakeFiles/raylib.dir/extraction/raysegment.cpp.o"
+  "CMakeFiles/raylib.dir/extraction/raysegment.cpp.o.d"
+  "CMakeFiles/raylib.dir/extraction/rayshortestpath.cpp.o"
+  "CMakeFiles/raylib.dir/extraction/rayshortestpath.cpp.o.d"
+  "CMakeFiles/raylib.dir/extraction/rayterrain.cpp.o"
+  "CMakeFiles/raylib.dir/extraction/rayterrain.cpp.o.d"
+  "CMakeFiles/raylib.dir/extraction/raytrees.cpp.o"
+  "CMakeFiles/raylib.dir/extraction/raytrees.cpp.o.d"
+  "CMakeFiles/raylib.dir/extraction/raytrunk.cpp.o"
+  "CMakeFiles/raylib.dir/extraction/raytrunk.cpp.o.d"
+  "CMakeFiles/raylib.dir/extraction/raytrunks.cpp.o"
+  "CMakeFiles/raylib.dir/extraction/raytrunks.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayalignment.cpp.o"
+  "CMakeFiles/raylib.dir/rayalignment.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayallocprofile.cpp.o"
+  "CMakeFiles/raylib.dir/rayallocprofile.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayasyncreader_uring.cpp.o"
+  "CMakeFiles/raylib.dir/rayasyncreader_uring.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayaxisalign.cpp.o"
+  "CMakeFiles/raylib.dir/rayaxisalign.cpp.o.d"
+  "CMakeFiles/raylib.dir/raybuildinggen.cpp.o"
+  "CMakeFiles/raylib.dir/raybuildinggen.cpp.o.d"
+  "CMakeFiles/raylib.dir/raychain.cpp.o"
+  "CMakeFiles/raylib.dir/raychain.cpp.o.d"
+  "CMakeFiles/raylib.dir/raychange.cpp.o"
+  "CMakeFiles/raylib.dir/raychange.cpp.o.d"
+  "CMakeFiles/raylib.dir/raycheckpoint.cpp.o"
+  "CMakeFiles/raylib.dir/raycheckpoint.cpp.o.d"
+  "CMakeFiles/raylib.dir/raychunksizer.cpp.o"
+  "CMakeFiles/raylib.dir/raychunksizer.cpp.o.d"
+  "CMakeFiles/raylib.dir/raycloud.cpp.o"
+  "CMakeFiles/raylib.dir/raycloud.cpp.o.d"
+  "CMakeFiles/raylib.dir/raycloudserver.cpp.o"
+  "CMakeFiles/raylib.dir/raycloudserver.cpp.o.d"
+  "CMakeFiles/raylib.dir/raycloudwriter.cpp.o"
+  "CMakeFiles/raylib.dir/raycloudwriter.cpp.o.d"
+  "CMakeFiles/raylib.dir/raycompactcloud.cpp.o"
+  "CMakeFiles/raylib.dir/raycompactcloud.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayconcavehull.cpp.o"
+  "CMakeFiles/raylib.dir/rayconcavehull.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayconvexhull.cpp.o"
+  "CMakeFiles/raylib.dir/rayconvexhull.cpp.o.d"
+  "CMakeFiles/raylib.dir/raycuboid.cpp.o"
+  "CMakeFiles/raylib.dir/raycuboid.cpp.o.d"
+  "CMakeFiles/raylib.dir/raydebugdraw_none.cpp.o"
+  "CMakeFiles/raylib.dir/raydebugdraw_none.cpp.o.d"
+  "CMakeFiles/raylib.dir/raydebugdrawqueue.cpp.o"
+  "CMakeFiles/raylib.dir/raydebugdrawqueue.cpp.o.d"
+  "CMakeFiles/raylib.dir/raydecimation.cpp.o"
+  "CMakeFiles/raylib.dir/raydecimation.cpp.o.d"
+  "CMakeFiles/raylib.dir/raydelaunay.cpp.o"
+  "CMakeFiles/raylib.dir/raydelaunay.cpp.o.d"
+  "CMakeFiles/raylib.dir/raydenoise.cpp.o"
+  "CMakeFiles/raylib.dir/raydenoise.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayellipsoid.cpp.o"
+  "CMakeFiles/raylib.dir/rayellipsoid.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayfinealignment.cpp.o"
+  "CMakeFiles/raylib.dir/rayfinealignment.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayforestgen.cpp.o"
+  "CMakeFiles/raylib.dir/rayforestgen.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayforeststructure.cpp.o"
+  "CMakeFiles/raylib.dir/rayforeststructure.cpp.o.d"
+  "CMakeFiles/raylib.dir/raygpu_none.cpp.o"
+  "CMakeFiles/raylib.dir/raygpu_none.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayheightfieldwrap.cpp.o"
+  "CMakeFiles/raylib.dir/rayheightfieldwrap.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayingest.cpp.o"
+  "CMakeFiles/raylib.dir/rayingest.cpp.o.d"
+  "CMakeFiles/raylib.dir/raykernels.cpp.o"
+  "CMakeFiles/raylib.dir/raykernels.cpp.o.d"
+  "CMakeFiles/raylib.dir/raylaz.cpp.o"
+  "CMakeFiles/raylib.dir/raylaz.cpp.o.d"
+  "CMakeFiles/raylib.dir/raylod.cpp.o"
+  "CMakeFiles/raylib.dir/raylod.cpp.o.d"
+  "CMakeFiles/raylib.dir/raymappedfile.cpp.o"
+  "CMakeFiles/raylib.dir/raymappedfile.cpp.o.d"
+  "CMakeFiles/raylib.dir/raymemory.cpp.o"
+  "CMakeFiles/raylib.dir/raymemory.cpp.o.d"
+  "CMakeFiles/raylib.dir/raymerger.cpp.o"
+  "CMakeFiles/raylib.dir/raymerger.cpp.o.d"
+  "CMakeFiles/raylib.dir/raymesh.cpp.o"
+  "CMakeFiles/raylib.dir/raymesh.cpp.o.d"
+  "CMakeFiles/raylib.dir/raymorton.cpp.o"
+  "CMakeFiles/raylib.dir/raymorton.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayneighbours.cpp.o"
+  "CMakeFiles/raylib.dir/rayneighbours.cpp.o.d"
+  "CMakeFiles/raylib.dir/raynodes.cpp.o"
+  "CMakeFiles/raylib.dir/raynodes.cpp.o.d"
+  "CMakeFiles/raylib.dir/raynuma.cpp.o"
+  "CMakeFiles/raylib.dir/raynuma.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayparse.cpp.o"
+  "CMakeFiles/raylib.dir/rayparse.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayperfcounters.cpp.o"
+  "CMakeFiles/raylib.dir/rayperfcounters.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayply.cpp.o"
+  "CMakeFiles/raylib.dir/rayply.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayplyindex.cpp.o"
+  "CMakeFiles/raylib.dir/rayplyindex.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayprofile.cpp.o"
+  "CMakeFiles/raylib.dir/rayprofile.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayprogressthread.cpp.o"
+  "CMakeFiles/raylib.dir/rayprogressthread.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayquickhull.cpp.o"
+  "CMakeFiles/raylib.dir/rayquickhull.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayrandom.cpp.o"
+  "CMakeFiles/raylib.dir/rayrandom.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayrcb.cpp.o"
+  "CMakeFiles/raylib.dir/rayrcb.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayregistration.cpp.o"
+  "CMakeFiles/raylib.dir/rayregistration.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayremotefile.cpp.o"
+  "CMakeFiles/raylib.dir/rayremotefile.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayremotefile_curl.cpp.o"
+  "CMakeFiles/raylib.dir/rayremotefile_curl.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayrenderer.cpp.o"
+  "CMakeFiles/raylib.dir/rayrenderer.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayroomgen.cpp.o"
+  "CMakeFiles/raylib.dir/rayroomgen.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayscenegen.cpp.o"
+  "CMakeFiles/raylib.dir/rayscenegen.cpp.o.d"
+  "CMakeFiles/raylib.dir/raysmooth.cpp.o"
+  "CMakeFiles/raylib.dir/raysmooth.cpp.o.d"
+  "CMakeFiles/raylib.dir/raysort.cpp.o"
+  "CMakeFiles/raylib.dir/raysort.cpp.o.d"
+  "CMakeFiles/raylib.dir/raysplitter.cpp.o"
+  "CMakeFiles/raylib.dir/raysplitter.cpp.o.d"
+  "CMakeFiles/raylib.dir/raysurfelcache.cpp.o"
+  "CMakeFiles/raylib.dir/raysurfelcache.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayterraingen.cpp.o"
+  "CMakeFiles/raylib.dir/rayterraingen.cpp.o.d"
+  "CMakeFiles/raylib.dir/raythreads.cpp.o"
+  "CMakeFiles/raylib.dir/raythreads.cpp.o.d"
+  "CMakeFiles/raylib.dir/raytilecache.cpp.o"
+  "CMakeFiles/raylib.dir/raytilecache.cpp.o.d"
+  "CMakeFiles/raylib.dir/raytiles.cpp.o"
+  "CMakeFiles/raylib.dir/raytiles.cpp.o.d"
+  "CMakeFiles/raylib.dir/raytool.cpp.o"
+  "CMakeFiles/raylib.dir/raytool.cpp.o.d"
+  "CMakeFiles/raylib.dir/raytrajectory.cpp.o"
+  "CMakeFiles/raylib.dir/raytrajectory.cpp.o.d"
+  "CMakeFiles/raylib.dir/raytransientgrid.cpp.o"
+  "CMakeFiles/raylib.dir/raytransientgrid.cpp.o.d"
+  "CMakeFiles/raylib.dir/raytreegen.cpp.o"
+  "CMakeFiles/raylib.dir/raytreegen.cpp.o.d"
+  "CMakeFiles/raylib.dir/raytreestructure.cpp.o"
+  "CMakeFiles/raylib.dir/raytreestructure.cpp.o.d"
+  "CMakeFiles/raylib.dir/rayvoxelset.cpp.o"
+  "CMakeFiles/raylib.dir/rayvoxelset.cpp.o.d"
+  "libraylib.pdb"
+  "libraylib.so"
+  "libraylib.so.0.0.1"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/raylib.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,42 @@
+
+#ifndef RAYLIB_EXPORT_H
+#define RAYLIB_EXPORT_H
+
+#ifdef RAYLIB_STATIC_DEFINE
+#  define RAYLIB_EXPORT
+#  define RAYLIB_NO_EXPORT
+#else
+#  ifndef RAYLIB_EXPORT
+#    ifdef raylib_EXPORTS
+        /* We are building this library */
+#      define RAYLIB_EXPORT __attribute__((visibility("default")))
+#    else
+        /* We are using this library */
+#      define RAYLIB_EXPORT __attribute__((visibility("default")))
+#    endif
+#  endif
+
+#  ifndef RAYLIB_NO_EXPORT
+#    define RAYLIB_NO_EXPORT __attribute__((visibility("hidden")))
+#  endif
+#endif
+
+#ifndef RAYLIB_DEPRECATED
+#  define RAYLIB_DEPRECATED __attribute__ ((__deprecated__))
+#endif
+
+#ifndef RAYLIB_DEPRECATED_EXPORT
+#  define RAYLIB_DEPRECATED_EXPORT RAYLIB_EXPORT RAYLIB_DEPRECATED
+#endif
+
+#ifndef RAYLIB_DEPRECATED_NO_EXPORT
+#  define RAYLIB_DEPRECATED_NO_EXPORT RAYLIB_NO_EXPORT RAYLIB_DEPRECATED
+#endif
+
+#if 0 /* DEFINE_NO_DEPRECATED */
+#  ifndef RAYLIB_NO_DEPRECATED
+#    define RAYLIB_NO_DEPRECATED
+#  endif
+#endif
+
+#endif /* RAYLIB_EXPORT_H */
@@ -0,0 +1,21 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/tests/raytest/raytests.cpp" "tests/raytest/CMakeFiles/raytest.dir/raytests.cpp.o" "gcc" "tests/raytest/CMakeFiles/raytest.dir/raytests.cpp.o.d"
+  "/root/repo/tests/raytest/testmain.cpp" "tests/raytest/CMakeFiles/raytest.dir/testmain.cpp.o" "gcc" "tests/raytest/CMakeFiles/raytest.dir/testmain.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  "/root/repo/_backend_build/raylib/CMakeFiles/raylib.dir/DependInfo.cmake"
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
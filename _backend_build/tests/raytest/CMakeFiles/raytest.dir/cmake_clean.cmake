@@ -0,0 +1,13 @@
+file(REMOVE_RECURSE
+  "../../bin/raytest"
+  "../../bin/raytest.pdb"
+  "CMakeFiles/raytest.dir/raytests.cpp.o"
+  "CMakeFiles/raytest.dir/raytests.cpp.o.d"
+  "CMakeFiles/raytest.dir/testmain.cpp.o"
+  "CMakeFiles/raytest.dir/testmain.cpp.o.d"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/raytest.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
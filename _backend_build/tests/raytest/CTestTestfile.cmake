@@ -0,0 +1,8 @@
+# CMake generated Testfile for 
+# Source directory: /root/repo/tests/raytest
+# Build directory: /root/repo/_backend_build/tests/raytest
+# 
+# This file includes the relevant testing commands required for 
+# testing this directory and lists subdirectories to be tested as well.
+add_test(raytest "/root/repo/_backend_build/bin/raytest" "--gtest_output=xml:test-reports/")
+set_tests_properties(raytest PROPERTIES  WORKING_DIRECTORY "/root/repo/_backend_build/bin" _BACKTRACE_TRIPLES "/root/repo/tests/raytest/CMakeLists.txt;36;add_test;/root/repo/tests/raytest/CMakeLists.txt;0;")
@@ -0,0 +1,22 @@
+# This module searches the double precision FFTW3 library, with its threads library, and defines
+# FFTW3_LIBRARIES - link libraries
+# FFTW3_FOUND, if false, do not try to link
+# FFTW3_INCLUDE_DIR, FFTW3_INCLUDE_DIRS, where to find the headers
+#
+# $FFTW3_ROOT is an environment variable that would correspond to the install prefix of FFTW3
+
+find_path(FFTW3_INCLUDE_DIR fftw3.h HINTS ENV FFTW3_ROOT PATH_SUFFIXES include)
+set(FFTW3_INCLUDE_DIRS ${FFTW3_INCLUDE_DIR})
+
+find_library(FFTW3_LIBRARY NAMES fftw3 libfftw3-3 HINTS ENV FFTW3_ROOT PATH_SUFFIXES lib)
+find_library(FFTW3_THREADS_LIBRARY NAMES fftw3_threads HINTS ENV FFTW3_ROOT PATH_SUFFIXES lib)
+
+# the threads library must precede the core library when linking statically
+set(FFTW3_LIBRARIES ${FFTW3_THREADS_LIBRARY} ${FFTW3_LIBRARY})
+
+# handle the QUIETLY and REQUIRED arguments and set FFTW3_FOUND to TRUE if
+# all listed variables are TRUE
+include(FindPackageHandleStandardArgs)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(FFTW3 REQUIRED_VARS FFTW3_LIBRARY FFTW3_THREADS_LIBRARY FFTW3_INCLUDE_DIR)
+
+mark_as_advanced(FFTW3_INCLUDE_DIR FFTW3_LIBRARY FFTW3_THREADS_LIBRARY)
@@ -6,16 +6,16 @@
 
 # Configure compiler warnings depending on the current compiler.
 
-# Configure warnings for gcc.
+# Configure warnings for gcc. These are for C++ only, as the CUDA compiler of WITH_CUDA does not take them.
 macro(ras_warnings_gcc)
   add_compile_options(
-    "-pedantic"
-    "-Wall"
-    "-Wextra"
-    "-Wconversion"
-    "-Werror=pedantic"
-    "-Werror=vla"
-    "-fdiagnostics-color=always"
+    "$<$<COMPILE_LANGUAGE:CXX>:-pedantic>"
+    "$<$<COMPILE_LANGUAGE:CXX>:-Wall>"
+    "$<$<COMPILE_LANGUAGE:CXX>:-Wextra>"
+    "$<$<COMPILE_LANGUAGE:CXX>:-Wconversion>"
+    "$<$<COMPILE_LANGUAGE:CXX>:-Werror=pedantic>"
+    "$<$<COMPILE_LANGUAGE:CXX>:-Werror=vla>"
+    "$<$<COMPILE_LANGUAGE:CXX>:-fdiagnostics-color=always>"
   )
 endmacro(ras_warnings_gcc)
 
@@ -0,0 +1,249 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raylib/extraction/rayterrain.h"
+#include "raylib/extraction/raytrees.h"
+#include "raylib/raycloud.h"
+#include "raylib/raycuboid.h"
+#include "raylib/raymerger.h"
+#include "raylib/raymesh.h"
+#include "raylib/rayrenderer.h"
+
+#include <pybind11/eigen.h>
+#include <pybind11/functional.h>
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include <memory>
+
+namespace py = pybind11;
+
+namespace
+{
+// the views below rely on the ray cloud's per-ray types being densely packed
+static_assert(sizeof(Eigen::Vector3d) == 3 * sizeof(double), "Eigen::Vector3d is not three packed doubles");
+static_assert(sizeof(Eigen::Vector3i) == 3 * sizeof(int), "Eigen::Vector3i is not three packed ints");
+static_assert(sizeof(ray::RGBA) == 4 * sizeof(uint8_t), "RGBA is not four packed bytes");
+
+/// The views share the memory of the vectors, without copying. @c base is the Python object that owns the vectors,
+/// which the view keeps alive. A view is invalid once its vector is resized.
+py::array vectorView(std::vector<Eigen::Vector3d> &vecs, py::handle base)
+{
+  return py::array_t<double>({ static_cast<py::ssize_t>(vecs.size()), py::ssize_t(3) },
+                             { static_cast<py::ssize_t>(sizeof(Eigen::Vector3d)), py::ssize_t(sizeof(double)) },
+                             vecs.empty() ? nullptr : vecs[0].data(), base);
+}
+
+py::array indexView(std::vector<Eigen::Vector3i> &indices, py::handle base)
+{
+  return py::array_t<int>({ static_cast<py::ssize_t>(indices.size()), py::ssize_t(3) },
+                          { static_cast<py::ssize_t>(sizeof(Eigen::Vector3i)), py::ssize_t(sizeof(int)) },
+                          indices.empty() ? nullptr : indices[0].data(), base);
+}
+
+py::array timesView(std::vector<double> &times, py::handle base)
+{
+  return py::array_t<double>({ static_cast<py::ssize_t>(times.size()) }, { py::ssize_t(sizeof(double)) },
+                             times.data(), base);
+}
+
+/// colours are (n,4) arrays of red, green, blue and alpha bytes
+py::array coloursView(std::vector<ray::RGBA> &colours, py::handle base)
+{
+  return py::array_t<uint8_t>({ static_cast<py::ssize_t>(colours.size()), py::ssize_t(4) },
+                              { py::ssize_t(sizeof(ray::RGBA)), py::ssize_t(sizeof(uint8_t)) },
+                              colours.empty() ? nullptr : &colours[0].red, base);
+}
+
+/// the bounds given from Python, or the bounds of the bounded ray ends in @c info if they are None
+ray::Cuboid renderBounds(const py::object &min_bound, const py::object &max_bound, const ray::Cloud::Info &info)
+{
+  if (min_bound.is_none() || max_bound.is_none())
+    return info.ends_bound;
+  return ray::Cuboid(min_bound.cast<Eigen::Vector3d>(), max_bound.cast<Eigen::Vector3d>());
+}
+
+/// reads @c file_name a chunk at a time, calling the Python @c callback with views of each chunk. The file is read
+/// without the GIL, which is only held while the callback runs. An exception raised by the callback ends the calls,
+/// and is raised once the read finishes
+bool readChunks(const std::string &file_name, const py::function &callback, const ray::Cuboid *bounds)
+{
+  std::unique_ptr<py::error_already_set> error;
+  auto apply = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                   std::vector<double> &times, std::vector<ray::RGBA> &colours) {
+    py::gil_scoped_acquire acquire;
+    if (error)
+      return;
+    // the chunk's vectors belong to the reader, so the views have an owner that frees nothing
+    py::capsule base(ends.data(), [](void *) {});
+    try
+    {
+      callback(vectorView(starts, base), vectorView(ends, base), timesView(times, base), coloursView(colours, base));
+    }
+    catch (py::error_already_set &e)
+    {
+      error.reset(new py::error_already_set(std::move(e)));
+    }
+  };
+  bool success;
+  {
+    py::gil_scoped_release release;
+    success = bounds ? ray::Cloud::read(file_name, apply, *bounds) : ray::Cloud::read(file_name, apply);
+  }
+  if (error)
+    throw std::move(*error);
+  return success;
+}
+}  // namespace
+
+PYBIND11_MODULE(raycloud, m)
+{
+  m.doc() = "Python bindings for raylib. The per-ray arrays are NumPy views of the ray cloud's memory, not copies";
+  using release_gil = py::call_guard<py::gil_scoped_release>;
+
+  py::class_<ray::Cloud>(m, "Cloud",
+                         "A ray cloud. The starts, ends, times and colours properties are writable NumPy views of its "
+                         "memory, which are invalid once the cloud is resized or reloaded")
+    .def(py::init<>())
+    .def(
+      "load", [](ray::Cloud &cloud, const std::string &file_name) { return cloud.load(file_name); },
+      py::arg("file_name"), release_gil())
+    .def("save", &ray::Cloud::save, py::arg("file_name"), release_gil())
+    .def("resize", &ray::Cloud::resize, py::arg("size"))
+    .def("ray_count", &ray::Cloud::rayCount)
+    .def("__len__", &ray::Cloud::rayCount)
+    .def_property_readonly("starts",
+                           [](py::object self) { return vectorView(self.cast<ray::Cloud &>().starts, self); })
+    .def_property_readonly("ends", [](py::object self) { return vectorView(self.cast<ray::Cloud &>().ends, self); })
+    .def_property_readonly("times", [](py::object self) { return timesView(self.cast<ray::Cloud &>().times, self); })
+    .def_property_readonly("colours",
+                           [](py::object self) { return coloursView(self.cast<ray::Cloud &>().colours, self); });
+
+  m.def(
+    "read",
+    [](const std::string &file_name, const py::function &callback, const py::object &min_bound,
+       const py::object &max_bound) {
+      if (min_bound.is_none() || max_bound.is_none())
+        return readChunks(file_name, callback, nullptr);
+      const ray::Cuboid bounds(min_bound.cast<Eigen::Vector3d>(), max_bound.cast<Eigen::Vector3d>());
+      return readChunks(file_name, callback, &bounds);
+    },
+    "Read a ray cloud file a chunk at a time, calling callback(starts, ends, times, colours) with views of each chunk, "
+    "which are valid only during the call. With bounds, parts of the file that cannot overlap them are skipped",
+    py::arg("file_name"), py::arg("callback"), py::arg("min_bound") = py::none(), py::arg("max_bound") = py::none());
+
+  // the transients filter
+  py::enum_<ray::MergeType>(m, "MergeType")
+    .value("Oldest", ray::MergeType::Oldest)
+    .value("Newest", ray::MergeType::Newest)
+    .value("Minimum", ray::MergeType::Mininum)
+    .value("Maximum", ray::MergeType::Maximum)
+    .value("Order", ray::MergeType::Order)
+    .value("All", ray::MergeType::All);
+
+  py::class_<ray::MergerConfig>(m, "MergerConfig")
+    .def(py::init<>())
+    .def_readwrite("voxel_size", &ray::MergerConfig::voxel_size)
+    .def_readwrite("num_rays_filter_threshold", &ray::MergerConfig::num_rays_filter_threshold)
+    .def_readwrite("merge_type", &ray::MergerConfig::merge_type)
+    .def_readwrite("colour_cloud", &ray::MergerConfig::colour_cloud);
+
+  py::class_<ray::Merger>(m, "Merger")
+    .def(py::init<const ray::MergerConfig &>(), py::arg("config"))
+    .def(
+      "filter", [](ray::Merger &merger, const ray::Cloud &cloud) { return merger.filter(cloud); }, py::arg("cloud"),
+      release_gil())
+    .def_property_readonly("fixed_cloud", &ray::Merger::fixedCloud, py::return_value_policy::reference_internal)
+    .def_property_readonly("difference_cloud", &ray::Merger::differenceCloud,
+                           py::return_value_policy::reference_internal);
+
+  // terrain and tree extraction
+  py::class_<ray::Mesh>(m, "Mesh")
+    .def(py::init<>())
+    .def_property_readonly("vertices",
+                           [](py::object self) { return vectorView(self.cast<ray::Mesh &>().vertices(), self); })
+    .def_property_readonly("index_list",
+                           [](py::object self) { return indexView(self.cast<ray::Mesh &>().indexList(), self); });
+
+  py::class_<ray::Terrain>(m, "Terrain")
+    .def(py::init<>())
+    .def("extract", &ray::Terrain::extract, py::arg("cloud"), py::arg("file_prefix"), py::arg("gradient") = 1.0,
+         py::arg("verbose") = false, release_gil())
+    .def_property_readonly(
+      "mesh", [](ray::Terrain &terrain) -> ray::Mesh & { return terrain.mesh(); },
+      py::return_value_policy::reference_internal);
+
+  py::class_<ray::TreesParams>(m, "TreesParams")
+    .def(py::init<>())
+    .def_readwrite("max_diameter", &ray::TreesParams::max_diameter)
+    .def_readwrite("min_diameter", &ray::TreesParams::min_diameter)
+    .def_readwrite("distance_limit", &ray::TreesParams::distance_limit)
+    .def_readwrite("height_min", &ray::TreesParams::height_min)
+    .def_readwrite("length_to_radius", &ray::TreesParams::length_to_radius)
+    .def_readwrite("cylinder_length_to_width", &ray::TreesParams::cylinder_length_to_width)
+    .def_readwrite("gap_ratio", &ray::TreesParams::gap_ratio)
+    .def_readwrite("span_ratio", &ray::TreesParams::span_ratio)
+    .def_readwrite("gravity_factor", &ray::TreesParams::gravity_factor)
+    .def_readwrite("radius_exponent", &ray::TreesParams::radius_exponent)
+    .def_readwrite("linear_range", &ray::TreesParams::linear_range)
+    .def_readwrite("grid_width", &ray::TreesParams::grid_width)
+    .def_readwrite("segment_branches", &ray::TreesParams::segment_branches);
+
+  py::class_<ray::Trees>(m, "Trees", "The trees reconstructed from a ray cloud, which colours the cloud by segment")
+    .def(py::init<ray::Cloud &, const ray::Mesh &, const ray::TreesParams &, bool>(), py::arg("cloud"),
+         py::arg("mesh"), py::arg("params"), py::arg("verbose") = false, release_gil())
+    .def("save", &ray::Trees::save, py::arg("file_name"), release_gil());
+
+  // rendering
+  py::enum_<ray::ViewDirection>(m, "ViewDirection")
+    .value("Top", ray::ViewDirection::Top)
+    .value("Left", ray::ViewDirection::Left)
+    .value("Right", ray::ViewDirection::Right)
+    .value("Front", ray::ViewDirection::Front)
+    .value("Back", ray::ViewDirection::Back);
+
+  py::enum_<ray::RenderStyle>(m, "RenderStyle")
+    .value("Ends", ray::RenderStyle::Ends)
+    .value("Mean", ray::RenderStyle::Mean)
+    .value("Sum", ray::RenderStyle::Sum)
+    .value("Starts", ray::RenderStyle::Starts)
+    .value("Rays", ray::RenderStyle::Rays)
+    .value("Height", ray::RenderStyle::Height)
+    .value("Density", ray::RenderStyle::Density)
+    .value("Density_rgb", ray::RenderStyle::Density_rgb);
+
+  m.def(
+    "render_cloud",
+    [](const ray::Cloud &cloud, ray::ViewDirection view, ray::RenderStyle style, double pix_width,
+       const std::string &image_file, const py::object &min_bound, const py::object &max_bound) {
+      ray::Cloud::Info info;
+      if (min_bound.is_none() || max_bound.is_none())
+      {
+        info.reset();
+        info.expand(cloud.starts, cloud.ends, cloud.times, cloud.colours);
+        info.finish();
+      }
+      const ray::Cuboid bounds = renderBounds(min_bound, max_bound, info);
+      py::gil_scoped_release release;
+      return ray::renderCloud(cloud, bounds, view, style, pix_width, image_file, "", false);
+    },
+    "Render an in-memory ray cloud to an image, as rayrender. Without bounds, those of the bounded ray ends are used",
+    py::arg("cloud"), py::arg("view"), py::arg("style"), py::arg("pix_width"), py::arg("image_file"),
+    py::arg("min_bound") = py::none(), py::arg("max_bound") = py::none());
+  m.def(
+    "render_cloud",
+    [](const std::string &cloud_file, ray::ViewDirection view, ray::RenderStyle style, double pix_width,
+       const std::string &image_file, const py::object &min_bound, const py::object &max_bound) {
+      ray::Cloud::Info info;
+      if ((min_bound.is_none() || max_bound.is_none()) && !ray::Cloud::getInfo(cloud_file, info))
+        return false;
+      const ray::Cuboid bounds = renderBounds(min_bound, max_bound, info);
+      py::gil_scoped_release release;
+      return ray::renderCloud(cloud_file, bounds, view, style, pix_width, image_file, "", false);
+    },
+    "Render a ray cloud file to an image, as rayrender", py::arg("cloud_file"), py::arg("view"), py::arg("style"),
+    py::arg("pix_width"), py::arg("image_file"), py::arg("min_bound") = py::none(), py::arg("max_bound") = py::none());
+}
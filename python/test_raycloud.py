@@ -0,0 +1,74 @@
+# Copyright (c) 2026
+# Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+# ABN 41 687 119 230
+#
+# Author: Thomas Lowe
+"""Tests of the raycloud module. CTest runs these from the build's bin directory, with the module on PYTHONPATH."""
+import os
+import unittest
+
+import numpy as np
+import raycloud
+
+
+def make_cloud(num_rays):
+    """a cloud of rays from the origin to random ends, with increasing times"""
+    cloud = raycloud.Cloud()
+    cloud.resize(num_rays)
+    cloud.starts[:] = 0.0
+    cloud.ends[:] = np.random.default_rng(1).uniform(-5.0, 5.0, (num_rays, 3))
+    cloud.times[:] = np.arange(num_rays, dtype=float)
+    cloud.colours[:] = 255
+    return cloud
+
+
+class CloudTest(unittest.TestCase):
+    def test_views_share_memory(self):
+        cloud = raycloud.Cloud()
+        cloud.resize(3)
+        self.assertEqual(len(cloud), 3)
+        self.assertEqual(cloud.ends.shape, (3, 3))
+        self.assertEqual(cloud.colours.shape, (3, 4))
+        self.assertEqual(cloud.colours.dtype, np.uint8)
+        # a write through one view is seen by the next, as both are the cloud's memory
+        cloud.ends[1] = [4.0, 5.0, 6.0]
+        np.testing.assert_array_equal(cloud.ends[1], [4.0, 5.0, 6.0])
+
+    def test_save_load_and_read(self):
+        cloud = make_cloud(100)
+        cloud.save("python_cloud.ply")
+        loaded = raycloud.Cloud()
+        self.assertTrue(loaded.load("python_cloud.ply"))
+        self.assertEqual(loaded.ray_count(), 100)
+        np.testing.assert_allclose(loaded.ends, cloud.ends, atol=1e-5)  # the ends may be stored as floats
+        np.testing.assert_allclose(loaded.starts, cloud.starts, atol=1e-5)
+        np.testing.assert_array_equal(loaded.times, cloud.times)
+
+        chunk_sizes = []
+
+        def count(starts, ends, times, colours):
+            chunk_sizes.append(len(ends))
+
+        self.assertTrue(raycloud.read("python_cloud.ply", count))
+        self.assertEqual(sum(chunk_sizes), 100)
+
+    def test_read_raises_callback_errors(self):
+        make_cloud(10).save("python_cloud_error.ply")
+
+        def fail(starts, ends, times, colours):
+            raise ValueError("stop")
+
+        with self.assertRaises(ValueError):
+            raycloud.read("python_cloud_error.ply", fail)
+
+    def test_render_cloud(self):
+        cloud = make_cloud(100)
+        if os.path.exists("python_cloud.png"):
+            os.remove("python_cloud.png")
+        self.assertTrue(raycloud.render_cloud(cloud, raycloud.ViewDirection.Top, raycloud.RenderStyle.Ends, 0.5,
+                                              "python_cloud.png"))
+        self.assertTrue(os.path.exists("python_cloud.png"))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,269 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raylib/raytool.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int rayalignMain(int argc, char *argv[]);
+int raychainMain(int argc, char *argv[]);
+int raycolourMain(int argc, char *argv[]);
+int raycombineMain(int argc, char *argv[]);
+int raycreateMain(int argc, char *argv[]);
+int raydecimateMain(int argc, char *argv[]);
+int raydenoiseMain(int argc, char *argv[]);
+int raydensityMain(int argc, char *argv[]);
+int rayexportMain(int argc, char *argv[]);
+int rayextractMain(int argc, char *argv[]);
+int rayimportMain(int argc, char *argv[]);
+int raylodMain(int argc, char *argv[]);
+int rayrenderMain(int argc, char *argv[]);
+int rayrestoreMain(int argc, char *argv[]);
+int rayrotateMain(int argc, char *argv[]);
+int raysmoothMain(int argc, char *argv[]);
+int raysplitMain(int argc, char *argv[]);
+int raytransientsMain(int argc, char *argv[]);
+int raytranslateMain(int argc, char *argv[]);
+int raytreeconvertMain(int argc, char *argv[]);
+int raywrapMain(int argc, char *argv[]);
+
+namespace
+{
+struct ToolEntry
+{
+  const char *name;
+  ray::Tool::Function function;
+};
+
+/// the tools, by their names without the ray prefix
+const ToolEntry kTools[] = {
+  { "align", rayalignMain },
+  { "chain", raychainMain },
+  { "colour", raycolourMain },
+  { "combine", raycombineMain },
+  { "create", raycreateMain },
+  { "decimate", raydecimateMain },
+  { "denoise", raydenoiseMain },
+  { "density", raydensityMain },
+  { "export", rayexportMain },
+  { "extract", rayextractMain },
+  { "import", rayimportMain },
+  { "lod", raylodMain },
+  { "render", rayrenderMain },
+  { "restore", rayrestoreMain },
+  { "rotate", rayrotateMain },
+  { "smooth", raysmoothMain },
+  { "split", raysplitMain },
+  { "transients", raytransientsMain },
+  { "translate", raytranslateMain },
+  { "treeconvert", raytreeconvertMain },
+  { "wrap", raywrapMain },
+};
+
+void usage(int exit_code = 1)
+{
+  // clang-format off
+  std::cout << "Run the raycloudtools from one executable, alone or as a batch of commands in one process." << std::endl;
+  std::cout << "usage:" << std::endl;
+  std::cout << "ray decimate room.ply 3 cm   - runs a tool as raydecimate room.ply 3 cm would. Also ray raydecimate ..." << std::endl;
+  std::cout << "ray --batch jobs.txt         - runs the commands of jobs.txt in order, one per line, e.g. decimate room.ply 3 cm" << std::endl;
+  std::cout << "                               Blank lines and lines starting with # are skipped. Arguments with spaces may be" << std::endl;
+  std::cout << "                               quoted. A failed command is reported and the batch continues. The commands share" << std::endl;
+  std::cout << "                               the thread pool while their thread counts agree. The other common options, such" << std::endl;
+  std::cout << "                               as --pin_threads, --profile and the memory budget, apply to their own command" << std::endl;
+  std::cout << "                               only, so each --profile file holds the phases of its own command." << std::endl;
+  std::cout << "A link to ray named after a tool, e.g. raydecimate, runs that tool." << std::endl;
+  std::cout << "The tools:";
+  for (const auto &tool : kTools) std::cout << " " << tool.name;
+  std::cout << std::endl;
+  // clang-format on
+  exit(exit_code);
+}
+
+/// the tool of @c name , with or without its ray prefix, or nullptr if there is none
+const ToolEntry *findTool(std::string name)
+{
+  if (name.compare(0, 3, "ray") == 0)
+  {
+    name = name.substr(3);
+  }
+  for (const auto &tool : kTools)
+  {
+    if (name == tool.name)
+    {
+      return &tool;
+    }
+  }
+  return nullptr;
+}
+
+/// run @c tool with the arguments @c args , which follow the tool name
+int runTool(const ToolEntry &tool, const std::vector<std::string> &args)
+{
+  // the tools take a mutable argv, so are given their own copy of the arguments
+  std::vector<std::string> storage;
+  storage.reserve(args.size() + 1);
+  storage.push_back(std::string("ray") + tool.name);
+  storage.insert(storage.end(), args.begin(), args.end());
+  std::vector<char *> argv;
+  for (auto &arg : storage)
+  {
+    argv.push_back(&arg[0]);
+  }
+  argv.push_back(nullptr);
+  return ray::Tool::run(tool.function, static_cast<int>(storage.size()), argv.data());
+}
+
+/// split a batch line into its words, at white space outside of quotes. Returns false on an unmatched quote
+bool splitCommand(const std::string &line, std::vector<std::string> &words)
+{
+  words.clear();
+  std::string word;
+  bool in_word = false;
+  char quote = 0;
+  for (const char c : line)
+  {
+    if (quote)
+    {
+      if (c == quote)
+      {
+        quote = 0;
+      }
+      else
+      {
+        word += c;
+      }
+    }
+    else if (c == '"' || c == '\'')
+    {
+      quote = c;
+      in_word = true;
+    }
+    else if (std::isspace(static_cast<unsigned char>(c)))
+    {
+      if (in_word)
+      {
+        words.push_back(word);
+        word.clear();
+        in_word = false;
+      }
+    }
+    else
+    {
+      word += c;
+      in_word = true;
+    }
+  }
+  if (in_word)
+  {
+    words.push_back(word);
+  }
+  return quote == 0;
+}
+
+/// run the commands of @c batch_file in turn, returning 1 if any of them failed
+int runBatch(const std::string &batch_file)
+{
+  std::ifstream batch(batch_file);
+  if (!batch.is_open())
+  {
+    std::cerr << "Error: cannot open batch file " << batch_file << std::endl;
+    return 1;
+  }
+  std::vector<std::string> failures;
+  int num_commands = 0;
+  std::string line;
+  std::vector<std::string> words;
+  for (int line_number = 1; std::getline(batch, line); line_number++)
+  {
+    if (!line.empty() && line.back() == '\r')
+    {
+      line.pop_back();
+    }
+    const size_t first = line.find_first_not_of(" \t");
+    if (first == std::string::npos || line[first] == '#')
+    {
+      continue;
+    }
+    num_commands++;
+    const std::string location = batch_file + ":" + std::to_string(line_number) + ": " + line.substr(first);
+    const ToolEntry *tool = nullptr;
+    if (!splitCommand(line, words))
+    {
+      std::cerr << "Error: unmatched quote in " << location << std::endl;
+    }
+    else if (!(tool = findTool(words[0])))
+    {
+      std::cerr << "Error: unknown tool in " << location << std::endl;
+    }
+    if (!tool)
+    {
+      failures.push_back(location);
+      continue;
+    }
+    std::cout << "> " << line.substr(first) << std::endl;
+    const int exit_code = runTool(*tool, std::vector<std::string>(words.begin() + 1, words.end()));
+    if (exit_code != 0)
+    {
+      std::cerr << "Error: exit code " << exit_code << " from " << location << std::endl;
+      failures.push_back(location);
+    }
+  }
+  std::cout << num_commands - static_cast<int>(failures.size()) << " of " << num_commands << " commands succeeded"
+            << std::endl;
+  for (const auto &failure : failures)
+  {
+    std::cout << "failed: " << failure << std::endl;
+  }
+  return failures.empty() ? 0 : 1;
+}
+}  // namespace
+
+// Runs a raycloudtools tool, or a batch of tool commands, in this one process
+int main(int argc, char *argv[])
+{
+  // run as a link named after a tool
+  std::string name = argv[0];
+  const size_t slash = name.find_last_of("/\\");
+  if (slash != std::string::npos)
+  {
+    name = name.substr(slash + 1);
+  }
+  if (name.size() > 4 && name.compare(name.size() - 4, 4, ".exe") == 0)
+  {
+    name.resize(name.size() - 4);
+  }
+  if (name != "ray")
+  {
+    const ToolEntry *tool = findTool(name);
+    if (tool)
+    {
+      return runTool(*tool, std::vector<std::string>(argv + 1, argv + argc));
+    }
+  }
+
+  if (argc == 3 && std::string(argv[1]) == "--batch")
+  {
+    return runBatch(argv[2]);
+  }
+  if (argc < 2)
+  {
+    usage();
+  }
+  const ToolEntry *tool = findTool(argv[1]);
+  if (!tool)
+  {
+    std::cerr << "Error: unknown tool " << argv[1] << std::endl;
+    usage();
+  }
+  return runTool(*tool, std::vector<std::string>(argv + 2, argv + argc));
+}
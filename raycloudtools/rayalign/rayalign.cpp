@@ -7,10 +7,17 @@
 #include "raylib/rayalignment.h"
 #include "raylib/rayaxisalign.h"
 #include "raylib/raycloud.h"
+#include "raylib/raycloudwriter.h"
 #include "raylib/raydebugdraw.h"
 #include "raylib/rayfinealignment.h"
+#include "raylib/raymemory.h"
 #include "raylib/rayparse.h"
+#include "raylib/rayply.h"
 #include "raylib/raypose.h"
+#include "raylib/rayprofile.h"
+#include "raylib/rayregistration.h"
+#include "raylib/raythreads.h"
+#include "raylib/raytool.h"
 
 #include <nabo/nabo.h>
 
@@ -20,6 +27,11 @@
 #include <complex>
 #include <iostream>
 
+namespace
+{
+/// the estimated memory per ray of aligning in memory, beyond each cloud
+const size_t kAlignBytesPerRay = 200;
+
 void usage(int exit_code = 1)
 {
   // clang-format off
@@ -30,20 +42,59 @@ void usage(int exit_code = 1)
   std::cout << "                             --nonrigid - nonrigid (quadratic) alignment" << std::endl;
   std::cout << "                             --verbose  - outputs FFT images and the coarse alignment cloud" << std::endl;
   std::cout << "                             --local    - fine alignment only, assumes clouds are already approximately aligned" << std::endl;
+  std::cout << "                             --fine_width 0.1 - refine the coarse alignment down to this voxel width, in cropped windows" << std::endl;
   std::cout << "rayalign raycloud  - axis aligns to the walls, placing the major walls at (0,0,0), biggest along y." << std::endl;
+  std::cout << "rayalign register raycloud1 raycloud2 raycloud3 ... - fine registration of many approximately aligned clouds," << std::endl;
+  std::cout << "                             rigidly. Outputs the transformed version of each raycloud, the first is fixed." << std::endl;
   // clang-format on
-  exit(exit_code);
+  ray::Tool::exit(exit_code);
 }
+}  // namespace
 
-int main(int argc, char *argv[])
+int rayalignMain(int argc, char *argv[])
 {
+  ray::Threads::initFromArguments(argc, argv);
+  ray::MemoryBudget::initFromArguments(argc, argv);
+  ray::Profile::initFromArguments(argc, argv);
+  ray::CloudWriter::initFromArguments(argc, argv);
   ray::FileArgument cloud_a, cloud_b;
   ray::OptionalFlagArgument nonrigid("nonrigid", 'n'), is_verbose("verbose", 'v'), local("local", 'l');
-  bool cross_align = ray::parseCommandLine(argc, argv, { &cloud_a, &cloud_b }, { &nonrigid, &is_verbose, &local });
+  ray::DoubleArgument fine_width(0.001, 100.0);
+  ray::OptionalKeyValueArgument fine_width_option("fine_width", 'f', &fine_width);
+  bool cross_align = ray::parseCommandLine(argc, argv, { &cloud_a, &cloud_b },
+                                           { &nonrigid, &is_verbose, &local, &fine_width_option });
   bool self_align = ray::parseCommandLine(argc, argv, { &cloud_a });
-  if (!cross_align && !self_align)
+  ray::TextArgument register_text("register");
+  ray::FileArgumentList cloud_files(2);
+  bool multi_register = ray::parseCommandLine(argc, argv, { &register_text, &cloud_files }, { &is_verbose });
+  if (!cross_align && !self_align && !multi_register)
     usage();
 
+  if (multi_register)
+  {
+    std::vector<std::string> file_names;
+    for (auto &file : cloud_files.files()) file_names.push_back(file.name());
+    std::vector<ray::Pose> poses;
+    if (!ray::registerClouds(file_names, poses, nullptr, is_verbose.isSet()))
+      usage();
+    for (size_t i = 0; i < poses.size(); i++)
+    {
+      const ray::Pose &pose = poses[i];
+      const Eigen::AngleAxisd angle_axis(pose.rotation);
+      const Eigen::Vector3d rotation = angle_axis.angle() * angle_axis.axis() * 180.0 / ray::kPi;
+      std::cout << "Transformation of " << cloud_files.files()[i].nameStub() << ":" << std::endl;
+      std::cout << "          rotation: (" << rotation.transpose() << ") degrees (rotation vector)" << std::endl;
+      std::cout << "  then translation: (" << pose.position.transpose() << ")" << std::endl;
+      auto transform = [&pose](Eigen::Vector3d &start, Eigen::Vector3d &end, double &, ray::RGBA &) {
+        start = pose * start;
+        end = pose * end;
+      };
+      if (!ray::convertCloud(file_names[i], cloud_files.files()[i].nameStub() + "_aligned.ply", transform))
+        usage();
+    }
+    return 0;
+  }
+
   std::string aligned_name = cloud_a.nameStub() + "_aligned.ply";
   if (self_align)
   {
@@ -53,6 +104,9 @@ int main(int argc, char *argv[])
   else  // cross_align
   {
     ray::Pose transform;
+    if (!ray::MemoryBudget::checkCloud(cloud_a.name(), kAlignBytesPerRay, "rayalign") ||
+        !ray::MemoryBudget::checkCloud(cloud_b.name(), kAlignBytesPerRay, "rayalign"))
+      return 1;
     ray::Cloud clouds[2];
     if (!clouds[0].load(cloud_a.name()))
       usage();
@@ -81,7 +135,10 @@ int main(int argc, char *argv[])
 
     if (!local_only)
     {
-      alignCloud0ToCloud1(clouds, 0.5, verbose);
+      if (fine_width_option.isSet())
+        alignCloud0ToCloud1Pyramid(clouds, 0.5, fine_width.value(), 128, verbose);
+      else
+        alignCloud0ToCloud1(clouds, 0.5, verbose);
       if (verbose)
         clouds[0].save(cloud_a.nameStub() + "_coarse_aligned.ply");
     }
@@ -109,3 +166,5 @@ int main(int argc, char *argv[])
   }
   return 0;
 }
+
+RAYLIB_TOOL_MAIN(rayalignMain)
@@ -0,0 +1,232 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raylib/raychain.h"
+#include "raylib/raycloud.h"
+#include "raylib/raycloudwriter.h"
+#include "raylib/raymemory.h"
+#include "raylib/rayparse.h"
+#include "raylib/rayprofile.h"
+#include "raylib/raythreads.h"
+#include "raylib/raytool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+namespace
+{
+void usage(int exit_code = 1)
+{
+  // clang-format off
+  std::cout << "Run several tools on a ray cloud in one pass, passing the rays between them in memory rather than in files" << std::endl;
+  std::cout << "usage:" << std::endl;
+  std::cout << "raychain raycloud decimate 3 cm + denoise 5 cm + transients min 2 rays + colour height + split plane 0,0,1" << std::endl;
+  std::cout << "Each stage is as the arguments of its tool, without the file name, and stages are separated by +" << std::endl;
+  std::cout << "  decimate 3 cm | 4 rays                        - as raydecimate. Streamed" << std::endl;
+  std::cout << "  denoise 4 cm | 3 sigmas                       - as raydenoise, on the whole cloud" << std::endl;
+  std::cout << "  denoise range 4 cm                            - as raydenoise. Streamed" << std::endl;
+  std::cout << "  transients min|max|oldest|newest 20 rays      - as raytransients, on the whole cloud, writing raycloud_transient.ply" << std::endl;
+  std::cout << "  colour time | height | alpha | 1,1,1 | alpha 1 - as raycolour. Streamed" << std::endl;
+  std::cout << "  smooth (--iterations 3)                       - as raysmooth, on the whole cloud" << std::endl;
+  std::cout << "  split plane 10,0,0 | box rx,ry,rz | range 10 | alpha 0.0 | time 1000" << std::endl;
+  std::cout << "                                                - as raysplit, writing raycloud_inside.ply and raycloud_outside.ply." << std::endl;
+  std::cout << "                                                  Streamed, and only as the last stage" << std::endl;
+  std::cout << "The output is raycloud_chained.ply, unless the last stage is a split." << std::endl;
+  std::cout << "Streamed stages work a chunk at a time, while the rays of the whole cloud stages are held in memory." << std::endl;
+  // clang-format on
+  ray::Tool::exit(exit_code);
+}
+
+// shortcut, to place the red green blue spectrum into the RGBA structure, as raycolour does
+void spectrumRGB(double value, ray::RGBA &colour)
+{
+  const Eigen::Vector3d col = ray::redGreenBlueSpectrum(value);
+  colour.red = static_cast<uint8_t>(255.0 * col[0]);
+  colour.green = static_cast<uint8_t>(255.0 * col[1]);
+  colour.blue = static_cast<uint8_t>(255.0 * col[2]);
+}
+
+/// The stage from the arguments of one tool, @c argv[1] onwards, or nullptr if they are not a valid stage
+std::unique_ptr<ray::ChainStage> parseStage(int argc, char *argv[], const std::string &name_stub)
+{
+  ray::TextArgument decimate_text("decimate"), denoise_text("denoise"), transients_text("transients"),
+    colour_text("colour"), smooth_text("smooth"), split_text("split"), range_text("range"), cm_text("cm"),
+    rays_text("rays"), alpha_text("alpha");
+
+  ray::IntArgument num_rays(1, 100);
+  ray::DoubleArgument vox_width(0.01, 100.0);
+  ray::ValueKeyChoice decimation({ &vox_width, &num_rays }, { "cm", "rays" });
+  if (ray::parseCommandLine(argc, argv, { &decimate_text, &decimation }))
+  {
+    if (decimation.selectedKey() == "cm")
+      return ray::decimationStage(0.01 * vox_width.value());
+    return ray::everyNthRayStage(static_cast<size_t>(num_rays.value()));
+  }
+
+  ray::DoubleArgument sigmas(0.0, 100.0), denoise_width(1.0, 100.0), range(1.0, 1000.0);
+  ray::ValueKeyChoice denoise({ &denoise_width, &sigmas }, { "cm", "sigmas" });
+  if (ray::parseCommandLine(argc, argv, { &denoise_text, &denoise }))
+  {
+    const bool use_sigmas = denoise.selectedKey() == "sigmas";
+    return ray::denoiseStage(use_sigmas, use_sigmas ? sigmas.value() : 0.01 * denoise_width.value());
+  }
+  if (ray::parseCommandLine(argc, argv, { &denoise_text, &range_text, &range, &cm_text }))
+    return ray::rangeGapStage(0.01 * range.value());
+
+  ray::KeyChoice merge_type({ "min", "max", "oldest", "newest" });
+  ray::DoubleArgument transient_rays(0.1, 100.0);
+  if (ray::parseCommandLine(argc, argv, { &transients_text, &merge_type, &transient_rays, &rays_text }))
+  {
+    ray::MergerConfig config;
+    config.voxel_size = 0.0;
+    config.num_rays_filter_threshold = transient_rays.value();
+    config.colour_cloud = false;
+    const std::string &type = merge_type.selectedKey();
+    config.merge_type = type == "max" ? ray::MergeType::Maximum :
+                        type == "oldest" ? ray::MergeType::Oldest :
+                        type == "newest" ? ray::MergeType::Newest :
+                                           ray::MergeType::Mininum;
+    return ray::transientStage(config, name_stub + "_transient.ply");
+  }
+
+  ray::KeyChoice colour_type({ "time", "height", "alpha" });
+  ray::Vector3dArgument col(0.0, 1.0);
+  ray::DoubleArgument alpha(0.0, 1.0);
+  if (ray::parseCommandLine(argc, argv, { &colour_text, &colour_type }))
+  {
+    const std::string type = colour_type.selectedKey();
+    return ray::chunkStage([type](ray::Cloud &chunk) {
+      for (size_t i = 0; i < chunk.rayCount(); i++)
+      {
+        ray::RGBA &colour = chunk.colours[i];
+        if (type == "time")
+          spectrumRGB(chunk.times[i] / 60.0, colour);  // repeating per minute, as raycolour
+        else if (type == "height")
+          spectrumRGB(chunk.ends[i][2] / 10.0, colour);
+        else
+        {
+          const Eigen::Vector3d col_vec = ray::redGreenBlueGradient(colour.alpha / 255.0);
+          colour.red = uint8_t(255.0 * col_vec[0]);
+          colour.green = uint8_t(255.0 * col_vec[1]);
+          colour.blue = uint8_t(255.0 * col_vec[2]);
+        }
+      }
+    });
+  }
+  if (ray::parseCommandLine(argc, argv, { &colour_text, &col }))
+  {
+    const Eigen::Vector3d flat = col.value();
+    return ray::chunkStage([flat](ray::Cloud &chunk) {
+      for (auto &colour : chunk.colours)
+      {
+        colour.red = (uint8_t)(255.0 * flat[0]);
+        colour.green = (uint8_t)(255.0 * flat[1]);
+        colour.blue = (uint8_t)(255.0 * flat[2]);
+      }
+    });
+  }
+  if (ray::parseCommandLine(argc, argv, { &colour_text, &alpha_text, &alpha }))
+  {
+    const uint8_t flat_alpha = (uint8_t)(255.0 * alpha.value());
+    return ray::chunkStage([flat_alpha](ray::Cloud &chunk) {
+      for (auto &colour : chunk.colours) colour.alpha = flat_alpha;
+    });
+  }
+
+  ray::IntArgument iterations(1, 100);
+  ray::OptionalKeyValueArgument iterations_option("iterations", 'i', &iterations);
+  if (ray::parseCommandLine(argc, argv, { &smooth_text }, { &iterations_option }))
+    return ray::smoothStage(iterations_option.isSet() ? iterations.value() : 1);
+
+  const double max_val = std::numeric_limits<double>::max();
+  ray::Vector3dArgument plane, box_radius(0.0001, max_val);
+  ray::DoubleArgument time, split_alpha(0.0, 1.0), split_range(0.0, 1000.0);
+  ray::KeyValueChoice split_choice({ "plane", "box", "range", "alpha", "time" },
+                                   { &plane, &box_radius, &split_range, &split_alpha, &time });
+  if (ray::parseCommandLine(argc, argv, { &split_text, &split_choice }))
+  {
+    ray::SplitPlan plan;
+    const std::string in_name = name_stub + "_inside.ply";
+    const std::string out_name = name_stub + "_outside.ply";
+    const std::string &key = split_choice.selectedKey();
+    if (key == "plane")
+      plan.addPlane(in_name, out_name, plane.value());
+    else if (key == "box")
+      plan.addBox(in_name, out_name, Eigen::Vector3d(0, 0, 0), box_radius.value());
+    else if (key == "range")
+    {
+      const double max_range = split_range.value();
+      plan.addPredicate(in_name, out_name, [max_range](const ray::Cloud &cloud, int i) -> bool {
+        return (cloud.starts[i] - cloud.ends[i]).norm() > max_range;
+      });
+    }
+    else if (key == "alpha")
+    {
+      const uint8_t c = uint8_t(255.0 * split_alpha.value());
+      plan.addPredicate(in_name, out_name,
+                        [c](const ray::Cloud &cloud, int i) -> bool { return cloud.colours[i].alpha > c; });
+    }
+    else
+    {
+      const double split_time = time.value();
+      plan.addPredicate(in_name, out_name,
+                        [split_time](const ray::Cloud &cloud, int i) -> bool { return cloud.times[i] > split_time; });
+    }
+    return ray::splitStage(std::move(plan));
+  }
+  return nullptr;
+}
+}  // namespace
+
+// Runs a chain of tool operations on a ray cloud, in one read of the file
+int raychainMain(int argc, char *argv[])
+{
+  ray::Threads::initFromArguments(argc, argv);
+  ray::MemoryBudget::initFromArguments(argc, argv);
+  ray::Profile::initFromArguments(argc, argv);
+  ray::CloudWriter::initFromArguments(argc, argv);
+  ray::FileArgument cloud_file;
+  char *file_argv[2] = { argv[0], argc > 1 ? argv[1] : nullptr };
+  if (argc < 3 || !ray::parseCommandLine(2, file_argv, { &cloud_file }))
+    usage();
+
+  // each stage is the arguments between + separators, parsed after a copy of the program name
+  ray::Chain chain;
+  bool ends_in_split = false;
+  for (int first = 2; first < argc;)
+  {
+    int last = first;
+    while (last < argc && std::strcmp(argv[last], "+") != 0) last++;
+    std::vector<char *> stage_argv(1, argv[0]);
+    stage_argv.insert(stage_argv.end(), argv + first, argv + last);
+    if (ends_in_split)
+    {
+      std::cout << "split can only be the last stage" << std::endl;
+      usage();
+    }
+    std::unique_ptr<ray::ChainStage> stage =
+      parseStage(static_cast<int>(stage_argv.size()), stage_argv.data(), cloud_file.nameStub());
+    if (!stage)
+    {
+      std::cout << "unknown stage:";
+      for (size_t i = 1; i < stage_argv.size(); i++) std::cout << " " << stage_argv[i];
+      std::cout << std::endl;
+      usage();
+    }
+    ends_in_split = std::strcmp(argv[first], "split") == 0;
+    chain.add(std::move(stage));
+    first = last + 1;
+  }
+
+  if (!chain.run(cloud_file.name(), ends_in_split ? "" : cloud_file.nameStub() + "_chained.ply"))
+    usage();
+  return 0;
+}
+
+RAYLIB_TOOL_MAIN(raychainMain)
@@ -6,9 +6,13 @@
 #include "raylib/extraction/raysegment.h"
 #include "raylib/raycloud.h"
 #include "raylib/raycloudwriter.h"
+#include "raylib/raymemory.h"
 #include "raylib/rayparse.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "raylib/imageread.h"
+#include "raylib/rayprofile.h"
+#include "raylib/raythreads.h"
+#include "raylib/raytool.h"
 
 #include <nabo/nabo.h>
 #include <cstdio>
@@ -17,6 +21,13 @@
 #include <iostream>
 #include <map>
 
+namespace
+{
+/// the number of points coloured by each parallel task, which reuse their scratch buffers over the block
+const int kColourBlockSize = 1024;
+/// the estimated memory per ray of the neighbourhood colourings, beyond the cloud: the surfels and neighbour index
+const size_t kColourBytesPerRay = 250;
+
 void usage(int exit_code = 1)
 {
   // clang-format off
@@ -31,9 +42,9 @@ void usage(int exit_code = 1)
   std::cout << "                   1,1,1         - set r,g,b" << std::endl;
   std::cout << "                   branches      - red and green are lidar intensity and cylindricality respectively, greater for branches than for leaves" << std::endl;
   std::cout << "                   image planview.png - colour all points from image, stretched to fit the point bounds" << std::endl;
-  std::cout << "                         --lit   - shaded (slow on large datasets)" << std::endl;
+  std::cout << "                         --lit   - shaded" << std::endl;
   // clang-format on
-  exit(exit_code);
+  ray::Tool::exit(exit_code);
 }
 
 /// This is a 2D area measurement on a 3x3 matrix, it is the measure halfway between the trace (1D) and the determinant
@@ -65,6 +76,11 @@ void colourFromImage(const std::string &cloud_file, const std::string &image_fil
   stbi_set_flip_vertically_on_load(1);
   int width, height, num_channels;
   unsigned char *image_data = stbi_load(image_file.c_str(), &width, &height, &num_channels, 0);
+  if (!image_data || num_channels < 3)
+  {
+    std::cerr << "Error: cannot read an rgb image from " << image_file << std::endl;
+    usage();
+  }
   const double width_x = (bounds.max_bound_[0] - bounds.min_bound_[0]) / (double)width;
   const double width_y = (bounds.max_bound_[1] - bounds.min_bound_[1]) / (double)height;
   if (std::max(width_x, width_y) > 1.05 * std::min(width_x, width_y))
@@ -79,8 +95,9 @@ void colourFromImage(const std::string &cloud_file, const std::string &image_fil
                              std::vector<double> &times, std::vector<ray::RGBA> &colours) {
     for (size_t i = 0; i < ends.size(); i++)
     {
-      const int ind0 = static_cast<int>((ends[i][0] - bounds.min_bound_[0]) / width_x);
-      const int ind1 = static_cast<int>((ends[i][1] - bounds.min_bound_[1]) / width_y);
+      // points on the max bound, or unbounded ends outside the bounds, take the nearest edge pixel
+      const int ind0 = ray::clamped(static_cast<int>((ends[i][0] - bounds.min_bound_[0]) / width_x), 0, width - 1);
+      const int ind1 = ray::clamped(static_cast<int>((ends[i][1] - bounds.min_bound_[1]) / width_y), 0, height - 1);
       const int index = num_channels * (ind0 + width * ind1);
       colours[i].red = image_data[index];
       colours[i].green = image_data[index + 1];
@@ -94,10 +111,15 @@ void colourFromImage(const std::string &cloud_file, const std::string &image_fil
 
   stbi_image_free(image_data);
 }
+}  // namespace
 
 // Colours the ray cloud based on the specified arguments
-int main(int argc, char *argv[])
+int raycolourMain(int argc, char *argv[])
 {
+  ray::Threads::initFromArguments(argc, argv);
+  ray::MemoryBudget::initFromArguments(argc, argv);
+  ray::Profile::initFromArguments(argc, argv);
+  ray::CloudWriter::initFromArguments(argc, argv);
   ray::FileArgument cloud_file, image_file;
   ray::KeyChoice colour_type({ "time", "height", "shape", "normal", "alpha", "branches" });
   ray::OptionalFlagArgument lit("lit", 'l');
@@ -190,7 +212,10 @@ int main(int argc, char *argv[])
     std::cout << "reopening file for lighting..." << std::endl;
   }
 
-  // The remainder cannot currently be done with chunk loading
+  // Every per-ray colouring above is streamed a chunk at a time, so runs in constant memory. The remainder needs the
+  // neighbourhood of each point, so cannot currently be done with chunk loading
+  if (!ray::MemoryBudget::checkCloud(in_file, kColourBytesPerRay, "raycolour"))
+    return 1;
   ray::Cloud cloud;
   if (!cloud.load(in_file))
     usage();
@@ -235,30 +260,31 @@ int main(int argc, char *argv[])
 
   if (calc_surfels)
     cloud.getSurfels(search_size, cents, norms, dims, mats, inds, max_distance, false);
+  // each point below writes only its own colour, from the shared surfels and neighbour indices, so the points are
+  // coloured in parallel
+  const int num_points = static_cast<int>(cloud.ends.size());
   if (type == "shape")
   {
-    for (int i = 0; i < (int)cloud.ends.size(); i++)
-    {
+    ray::parallelFor(0, num_points, [&](int i) {
       if (!cloud.rayBounded(i))
-        continue;
+        return;
       const double sphericity = dimensions[i][0] / dimensions[i][2];
       const double cylindricality = 1.0 - dimensions[i][1] / dimensions[i][2];
       const double planarity = 1.0 - dimensions[i][0] / dimensions[i][1];
       cloud.colours[i].red = (uint8_t)(255.0 * sphericity);
       cloud.colours[i].green = (uint8_t)(255.0 * cylindricality);
       cloud.colours[i].blue = (uint8_t)(255.0 * planarity);
-    }
+    });
   }
   else if (type == "normal")
   {
-    for (int i = 0; i < (int)cloud.ends.size(); i++)
-    {
+    ray::parallelFor(0, num_points, [&](int i) {
       if (!cloud.rayBounded(i))
-        continue;
+        return;
       cloud.colours[i].red = (uint8_t)(255.0 * (0.5 + 0.5 * normals[i][0]));
       cloud.colours[i].green = (uint8_t)(255.0 * (0.5 + 0.5 * normals[i][1]));
       cloud.colours[i].blue = (uint8_t)(255.0 * (0.5 + 0.5 * normals[i][2]));
-    }
+    });
   }
   // colour in order to distinguish branches.
   // The red channel is a function of the lidar return intensiity, which is typically higher on
@@ -268,9 +294,7 @@ int main(int argc, char *argv[])
   //  raysplit cloud.ply colour x,y,0 for a choice of x, y
   else if (type == "branches")
   {
-    std::vector<uint8_t> cols;
-    for (int i = 0; i < (int)cloud.ends.size(); i++)
-    {
+    auto colour_branches = [&](int i, std::vector<uint8_t> &cols) {
       // 1. red is median alpha value, rescaled
       // we use the median of the neighbour points to be robust to noise
       cols.clear();
@@ -282,7 +306,7 @@ int main(int argc, char *argv[])
       if (cols.size() == 1)
         cloud.colours[i].red = cloud.colours[i].alpha;
       else
-        cloud.colours[i].red = (uint8_t)ray::median(cols);
+        cloud.colours[i].red = ray::medianInPlace(cols);
 
       // we also compensate for a change in intensity with scale
       double range = (cloud.ends[i] - cloud.starts[i]).norm();
@@ -319,15 +343,21 @@ int main(int argc, char *argv[])
 
       // 3. blue is nothing
       cloud.colours[i].blue = 0;
-    }
+    };
+    const int num_blocks = (num_points + kColourBlockSize - 1) / kColourBlockSize;
+    ray::parallelFor(0, num_blocks, [&](int block) {
+      std::vector<uint8_t> cols;  // the neighbour alphas, reused over the block
+      cols.reserve(5);
+      const int block_end = std::min(num_points, (block + 1) * kColourBlockSize);
+      for (int i = block * kColourBlockSize; i < block_end; i++) colour_branches(i, cols);
+    });
   }
   if (lit.isSet())
   {
     std::vector<double> curvatures(cloud.ends.size());
-    for (int i = 0; i < (int)cloud.ends.size(); i++)
-    {
+    ray::parallelFor(0, num_points, [&](int i) {
       if (!cloud.rayBounded(i))
-        continue;
+        return;
       double sum_x = 0, sum_y = 0, sum_xy = 0, sum_xx = 0, sum_yy = 0, n = 0;
       for (int j = 0; j < search_size && indices(j, i) != Nabo::NNSearchD::InvalidIndex; j++)
       {
@@ -348,22 +378,23 @@ int main(int argc, char *argv[])
         curvatures[i] = 0.0;
       else
         curvatures[i] = (n * sum_xy - sum_x * sum_y) / den;
-    }
-    Eigen::Vector3d light_dir = Eigen::Vector3d(0.2, 0.4, 1.0).normalized();
-    double curve_scale = 4.0;
-    for (int i = 0; i < (int)cloud.ends.size(); i++)
-    {
+    });
+    const Eigen::Vector3d light_dir = Eigen::Vector3d(0.2, 0.4, 1.0).normalized();
+    const double curve_scale = 4.0;
+    ray::parallelFor(0, num_points, [&](int i) {
       if (!cloud.rayBounded(i))
-        continue;
+        return;
       const double scale1 = 0.5 + 0.5 * normals[i].dot(light_dir);
       const double scale2 = 0.5 - 0.5 * curvatures[i] / curve_scale;
       const double s = 0.25 + 0.75 * ray::clamped((scale1 + scale2) / 2.0, 0.0, 1.0);
       cloud.colours[i].red = (uint8_t)((double)cloud.colours[i].red * s);
       cloud.colours[i].green = (uint8_t)((double)cloud.colours[i].green * s);
       cloud.colours[i].blue = (uint8_t)((double)cloud.colours[i].blue * s);
-    }
+    });
   }
   cloud.save(out_file);
 
   return 0;
 }
+
+RAYLIB_TOOL_MAIN(raycolourMain)
@@ -1,154 +1,242 @@
-// Copyright (c) 2020
-// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
-// ABN 41 687 119 230
-//
-// Author: Thomas Lowe
-#include "raylib/raycloud.h"
-#include "raylib/raydebugdraw.h"
-#include "raylib/raymerger.h"
-#include "raylib/raymesh.h"
-#include "raylib/rayparse.h"
-#include "raylib/rayply.h"
-#include "raylib/rayprogressthread.h"
-#include "raylib/raythreads.h"
-
-#include <cstdio>
-#include <cstdlib>
-#include <cstring>
-#include <iostream>
-
-void usage(int exit_code = 1)
-{
-  // clang-format off
-  std::cout << "Combines multiple ray clouds. Clouds are not moved but rays are omitted in the combined cloud according to the merge type specified." << std::endl;
-  std::cout << "Outputs the combined cloud and the residual cloud of differences." << std::endl;
-  std::cout << "usage:" << std::endl;
-  std::cout << "raycombine min raycloud1 raycloud2 ... raycloudN 20 rays - combines into one cloud with minimal objects at differences" << std::endl;
-  std::cout << "                                                           20 is the number of pass through rays to define " << std::endl;
-  std::cout << "           max    - maximal objects included. This is a form of volume intersection (rather than min: union)." << std::endl;
-  std::cout << "           oldest - keeps the oldest geometry when there is a difference in later ray clouds." << std::endl;
-  std::cout << "           newest - uses the newest geometry when there is a difference in newer ray clouds." << std::endl;
-  std::cout << "           order  - conflicts are resolved in argument order, with the first taking priority." << std::endl;
-  std::cout << "           all    - combines as a simple concatenation, with all rays remaining (don't include 'xx rays')." << std::endl;
-  std::cout << "raycombine basecloud min raycloud1 raycloud2 20 rays - 3-way merge, choses the changed geometry (from basecloud) at any differences. " << std::endl;
-  std::cout << "                                                       For merge conflicts it uses the specified merge type." << std::endl;
-  std::cout << "        --output raycloud_combined.ply               - optionally specify the output file name." << std::endl;
-  // clang-format on
-  exit(exit_code);
-}
-
-// Decimates the ray cloud, spatially or in timevpn-new.csiro.au
-int main(int argc, char *argv[])
-{
-  ray::KeyChoice merge_type({ "min", "max", "oldest", "newest", "order" });
-  ray::FileArgumentList cloud_files(2);
-  ray::DoubleArgument num_rays(0.0, 100.0);
-  ray::TextArgument rays_text("rays"), all_text("all");
-
-  // Below: false = allow unusual file extensions, for auto-merging, which occurs on non-standard temporary file names
-  ray::FileArgument base_cloud(false), cloud_1(false), cloud_2(false), output_file(false);
-  ray::OptionalKeyValueArgument output("output", 'o', &output_file);
-
-  // three-way merge option
-  bool standard_format =
-    ray::parseCommandLine(argc, argv, { &merge_type, &cloud_files, &num_rays, &rays_text }, { &output });
-  bool concatenate = ray::parseCommandLine(argc, argv, { &all_text, &cloud_files }, { &output });
-  bool threeway = ray::parseCommandLine(
-    argc, argv, { &base_cloud, &merge_type, &cloud_1, &cloud_2, &num_rays, &rays_text }, { &output });
-  bool threeway_concatenate =
-    ray::parseCommandLine(argc, argv, { &base_cloud, &all_text, &cloud_1, &cloud_2 }, { &output });
-  if (!standard_format && !concatenate && !threeway && !threeway_concatenate)
-    usage();
-
-  // we know there is at least one file, as we specified a minimum number in FileArgumentList
-  std::string file_stub =
-    (threeway || threeway_concatenate) ? base_cloud.nameStub() : cloud_files.files()[0].nameStub();
-
-  std::vector<ray::Cloud> clouds;
-  if (threeway || threeway_concatenate)
-  {
-    clouds.resize(2);
-    if (!clouds[0].load(cloud_1.name(), false))
-      usage();
-    if (!clouds[1].load(cloud_2.name(), false))
-      usage();
-  }
-  else
-  {
-    clouds.resize(cloud_files.files().size());
-    for (int i = 0; i < (int)cloud_files.files().size(); i++)
-      if (!clouds[i].load(cloud_files.files()[i].name()))
-        usage();
-  }
-
-  ray::Threads::init();
-  ray::MergerConfig config;
-  config.voxel_size = 0.0;  // Infer voxel size
-  config.num_rays_filter_threshold = num_rays.value();
-  config.merge_type = ray::MergeType::Mininum;
-
-  if (merge_type.selectedKey() == "order")
-  {
-    config.merge_type = ray::MergeType::Order;
-  }
-  if (merge_type.selectedKey() == "oldest")
-  {
-    config.merge_type = ray::MergeType::Oldest;
-  }
-  if (merge_type.selectedKey() == "newest")
-  {
-    config.merge_type = ray::MergeType::Newest;
-  }
-  if (merge_type.selectedKey() == "min")
-  {
-    config.merge_type = ray::MergeType::Mininum;
-  }
-  if (merge_type.selectedKey() == "max")
-  {
-    config.merge_type = ray::MergeType::Maximum;
-  }
-  if (concatenate || threeway_concatenate)
-  {
-    config.merge_type = ray::MergeType::All;
-  }
-
-  ray::Merger merger(config);
-  ray::Progress progress;
-  ray::ProgressThread progress_thread(progress);
-  ray::Cloud concatenated_cloud;
-  const ray::Cloud *fixed_cloud = &merger.fixedCloud();
-
-  if (threeway || threeway_concatenate)
-  {
-    ray::Cloud base_cloud;
-    if (!base_cloud.load(argv[1], false))
-      usage();
-    merger.mergeThreeWay(base_cloud, clouds[0], clouds[1], &progress);
-  }
-  else if (concatenate)
-  {
-    fixed_cloud = &concatenated_cloud;
-    for (auto &cloud : clouds)
-    {
-      concatenated_cloud.starts.insert(concatenated_cloud.starts.end(), cloud.starts.begin(), cloud.starts.end());
-      concatenated_cloud.ends.insert(concatenated_cloud.ends.end(), cloud.ends.begin(), cloud.ends.end());
-      concatenated_cloud.times.insert(concatenated_cloud.times.end(), cloud.times.begin(), cloud.times.end());
-      concatenated_cloud.colours.insert(concatenated_cloud.colours.end(), cloud.colours.begin(), cloud.colours.end());
-    }
-  }
-  else
-  {
-    merger.mergeMultiple(clouds, &progress);
-    std::cout << merger.differenceCloud().rayCount() << " transients, " << merger.fixedCloud().rayCount()
-              << " fixed rays." << std::endl;
-    merger.differenceCloud().save(file_stub + "_differences.ply");
-  }
-
-  progress_thread.join();
-
-  if (output.isSet())
-    fixed_cloud->save(output_file.name());
-  else
-    fixed_cloud->save(file_stub + "_combined.ply");
-  return 0;
-}
+// Copyright (c) 2020
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raylib/raychange.h"
+#include "raylib/raycheckpoint.h"
+#include "raylib/raycloud.h"
+#include "raylib/raycloudwriter.h"
+#include "raylib/raydebugdraw.h"
+#include "raylib/raymemory.h"
+#include "raylib/raymerger.h"
+#include "raylib/raymesh.h"
+#include "raylib/rayparse.h"
+#include "raylib/rayply.h"
+#include "raylib/rayprofile.h"
+#include "raylib/rayprogressthread.h"
+#include "raylib/raythreads.h"
+#include "raylib/raytool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+void usage(int exit_code = 1)
+{
+  // clang-format off
+  std::cout << "Combines multiple ray clouds. Clouds are not moved but rays are omitted in the combined cloud according to the merge type specified." << std::endl;
+  std::cout << "Outputs the combined cloud and the residual cloud of differences." << std::endl;
+  std::cout << "usage:" << std::endl;
+  std::cout << "raycombine min raycloud1 raycloud2 ... raycloudN 20 rays - combines into one cloud with minimal objects at differences" << std::endl;
+  std::cout << "                                                           20 is the number of pass through rays to define " << std::endl;
+  std::cout << "           max    - maximal objects included. This is a form of volume intersection (rather than min: union)." << std::endl;
+  std::cout << "           oldest - keeps the oldest geometry when there is a difference in later ray clouds." << std::endl;
+  std::cout << "           newest - uses the newest geometry when there is a difference in newer ray clouds." << std::endl;
+  std::cout << "           order  - conflicts are resolved in argument order, with the first taking priority." << std::endl;
+  std::cout << "           all    - combines as a simple concatenation, with all rays remaining (don't include 'xx rays')." << std::endl;
+  std::cout << "                    The clouds are streamed rather than loaded, so any number can be concatenated." << std::endl;
+  std::cout << "raycombine basecloud min raycloud1 raycloud2 20 rays - 3-way merge, choses the changed geometry (from basecloud) at any differences. " << std::endl;
+  std::cout << "                                                       For merge conflicts it uses the specified merge type." << std::endl;
+  std::cout << "raycombine min mapcloud append raycloud 20 rays           - incremental merge, adds raycloud to mapcloud, which is updated in place." << std::endl;
+  std::cout << "                                                       The merge state is kept in mapcloud.merge, so each update only tests" << std::endl;
+  std::cout << "                                                       the part of the map near raycloud. Starts a new map if mapcloud is absent." << std::endl;
+  std::cout << "raycombine changes raycloud1 raycloud2                    - fast change detection, without ellipsoids. Walks each cloud's rays through shared" << std::endl;
+  std::cout << "                                                       voxels once, and saves the voxels occupied in one cloud and free in the other" << std::endl;
+  std::cout << "                                                       to raycloud1_changes.ply, red where geometry has gone and green where it has appeared." << std::endl;
+  std::cout << "        --voxel_width 0.2                            - for changes, the voxel width in m. Defaults to twice the point spacing." << std::endl;
+  std::cout << "        --change_voxels 0.5                          - for min, max, oldest, newest and order, only test for transients near the voxels" << std::endl;
+  std::cout << "                                                       of this width that are occupied in one cloud and free in another." << std::endl;
+  std::cout << "        --output raycloud_combined.ply               - optionally specify the output file name." << std::endl;
+  std::cout << "        --time_ordered                               - for all, merge the rays of clouds that are each in time order, so the" << std::endl;
+  std::cout << "                                                       combined cloud is in time order too." << std::endl;
+  std::cout << "        --resume                                     - for min, max, oldest, newest and order, keeps a checkpoint of the clouds" << std::endl;
+  std::cout << "                                                       tested, so that an interrupted run resumes from it when repeated." << std::endl;
+  // clang-format on
+  ray::Tool::exit(exit_code);
+}
+}  // namespace
+
+// Decimates the ray cloud, spatially or in timevpn-new.csiro.au
+int raycombineMain(int argc, char *argv[])
+{
+  ray::Threads::initFromArguments(argc, argv, ray::Threads::ThreadCountRecommended);
+  ray::MemoryBudget::initFromArguments(argc, argv);
+  ray::Profile::initFromArguments(argc, argv);
+  ray::CloudWriter::initFromArguments(argc, argv);
+  ray::Checkpoint::initFromArguments(argc, argv);
+  ray::KeyChoice merge_type({ "min", "max", "oldest", "newest", "order" });
+  ray::FileArgumentList cloud_files(2);
+  ray::DoubleArgument num_rays(0.0, 100.0);
+  ray::TextArgument rays_text("rays"), all_text("all"), append_text("append"), changes_text("changes");
+
+  // Below: false = allow unusual file extensions, for auto-merging, which occurs on non-standard temporary file names
+  ray::FileArgument base_cloud(false), cloud_1(false), cloud_2(false), output_file(false);
+  ray::FileArgument map_cloud, new_cloud;
+  ray::OptionalKeyValueArgument output("output", 'o', &output_file);
+  ray::OptionalFlagArgument time_ordered("time_ordered", 't');
+  ray::DoubleArgument voxel_width(0.0001, 1000.0), change_width(0.0001, 1000.0);
+  ray::OptionalKeyValueArgument voxel_width_option("voxel_width", 'v', &voxel_width);
+  ray::OptionalKeyValueArgument change_voxels("change_voxels", 'c', &change_width);
+
+  // three-way merge option
+  bool standard_format = ray::parseCommandLine(argc, argv, { &merge_type, &cloud_files, &num_rays, &rays_text },
+                                               { &output, &change_voxels });
+  bool concatenate = ray::parseCommandLine(argc, argv, { &all_text, &cloud_files }, { &output, &time_ordered });
+  bool threeway = ray::parseCommandLine(
+    argc, argv, { &base_cloud, &merge_type, &cloud_1, &cloud_2, &num_rays, &rays_text }, { &output, &change_voxels });
+  bool threeway_concatenate =
+    ray::parseCommandLine(argc, argv, { &base_cloud, &all_text, &cloud_1, &cloud_2 }, { &output });
+  bool incremental = ray::parseCommandLine(
+    argc, argv, { &merge_type, &map_cloud, &append_text, &new_cloud, &num_rays, &rays_text }, { &output });
+  bool changes =
+    ray::parseCommandLine(argc, argv, { &changes_text, &cloud_1, &cloud_2 }, { &output, &voxel_width_option });
+  if (!standard_format && !concatenate && !threeway && !threeway_concatenate && !incremental && !changes)
+    usage();
+
+  // we know there is at least one file, as we specified a minimum number in FileArgumentList
+  std::string file_stub = incremental                           ? new_cloud.nameStub()
+                          : (threeway || threeway_concatenate) ? base_cloud.nameStub()
+                          : changes                            ? cloud_1.nameStub()
+                                                               : cloud_files.files()[0].nameStub();
+
+  if (concatenate)
+  {
+    // streamed, so memory does not depend on the size of the clouds
+    std::vector<std::string> file_names;
+    for (const auto &file : cloud_files.files()) file_names.push_back(file.name());
+    if (!ray::concatenateClouds(file_names, output.isSet() ? output_file.name() : file_stub + "_combined.ply",
+                                time_ordered.isSet()))
+      usage();
+    return 0;
+  }
+
+  if (changes)
+  {
+    // a single streamed pass over each cloud, so memory depends on the voxels reached rather than the rays
+    ray::ChangeConfig change_config;
+    change_config.voxel_width = voxel_width_option.isSet() ? voxel_width.value() : 0.0;
+    size_t num_gone = 0, num_appeared = 0;
+    if (!ray::detectChanges(cloud_1.name(), cloud_2.name(), change_config,
+                            output.isSet() ? output_file.name() : file_stub + "_changes.ply", &num_gone, &num_appeared))
+      usage();
+    std::cout << num_gone << " voxels gone, " << num_appeared << " voxels appeared." << std::endl;
+    return 0;
+  }
+
+  std::vector<ray::Cloud> clouds;
+  if (incremental)
+  {
+    clouds.resize(1);
+    if (!clouds[0].load(new_cloud.name()))
+      usage();
+  }
+  else if (threeway || threeway_concatenate)
+  {
+    clouds.resize(2);
+    if (!clouds[0].load(cloud_1.name(), false))
+      usage();
+    if (!clouds[1].load(cloud_2.name(), false))
+      usage();
+  }
+  else
+  {
+    clouds.resize(cloud_files.files().size());
+    for (int i = 0; i < (int)cloud_files.files().size(); i++)
+      if (!clouds[i].load(cloud_files.files()[i].name()))
+        usage();
+  }
+
+  ray::MergerConfig config;
+  config.voxel_size = 0.0;  // Infer voxel size
+  config.num_rays_filter_threshold = num_rays.value();
+  config.merge_type = ray::MergeType::Mininum;
+  if (change_voxels.isSet())
+  {
+    config.change_voxel_width = change_width.value();
+  }
+
+  if (merge_type.selectedKey() == "order")
+  {
+    config.merge_type = ray::MergeType::Order;
+  }
+  if (merge_type.selectedKey() == "oldest")
+  {
+    config.merge_type = ray::MergeType::Oldest;
+  }
+  if (merge_type.selectedKey() == "newest")
+  {
+    config.merge_type = ray::MergeType::Newest;
+  }
+  if (merge_type.selectedKey() == "min")
+  {
+    config.merge_type = ray::MergeType::Mininum;
+  }
+  if (merge_type.selectedKey() == "max")
+  {
+    config.merge_type = ray::MergeType::Maximum;
+  }
+  if (threeway_concatenate)
+  {
+    config.merge_type = ray::MergeType::All;
+  }
+
+  ray::Merger merger(config);
+  ray::Progress progress;
+  ray::ProgressThread progress_thread(progress);
+
+  if (incremental)
+  {
+    // the map is written beside itself then moved into place, as it is streamed during the merge
+    const std::string state_file = map_cloud.name() + ".merge";
+    const std::string map_output = output.isSet() ? output_file.name() : map_cloud.name();
+    const std::string temp_output = map_cloud.nameStub() + "_merging." + map_cloud.nameExt();
+    const std::string temp_state = state_file + ".tmp";
+    if (!merger.mergeIncremental(map_cloud.name(), state_file, clouds[0], temp_output, temp_state, &progress))
+    {
+      std::remove(temp_output.c_str());
+      std::remove(temp_state.c_str());
+      usage();
+    }
+    progress_thread.join();
+    std::rename(temp_output.c_str(), map_output.c_str());
+    std::rename(temp_state.c_str(), (map_output + ".merge").c_str());
+    std::cout << merger.differenceCloud().rayCount() << " transients removed." << std::endl;
+    merger.differenceCloud().save(file_stub + "_differences.ply");
+    return 0;
+  }
+  // the results are written as they are found, rather than held in the merger
+  ray::CloudWriter fixed_writer, difference_writer;
+  if (!fixed_writer.begin(output.isSet() ? output_file.name() : file_stub + "_combined.ply"))
+    usage();
+  bool success;
+  if (threeway || threeway_concatenate)
+  {
+    ray::Cloud base_cloud;
+    if (!base_cloud.load(argv[1], false))
+      usage();
+    merger.setOutput(&fixed_writer, nullptr);
+    success = merger.mergeThreeWay(base_cloud, clouds[0], clouds[1], &progress);
+  }
+  else
+  {
+    if (!difference_writer.begin(file_stub + "_differences.ply"))
+      usage();
+    merger.setOutput(&fixed_writer, &difference_writer);
+    if (ray::Checkpoint::enabled())
+      merger.setCheckpoint(file_stub + "_combined.checkpoint");
+    success = merger.mergeMultiple(clouds, &progress);
+    std::cout << merger.differenceRayCount() << " transients, " << merger.fixedRayCount() << " fixed rays."
+              << std::endl;
+  }
+
+  progress_thread.join();
+  difference_writer.end();
+  fixed_writer.end();
+  return success ? 0 : 1;
+}
+
+RAYLIB_TOOL_MAIN(raycombineMain)
@@ -5,10 +5,16 @@
 // Author: Thomas Lowe
 #include "raylib/raybuildinggen.h"
 #include "raylib/raycloud.h"
+#include "raylib/raycloudwriter.h"
 #include "raylib/rayforestgen.h"
+#include "raylib/raymemory.h"
 #include "raylib/rayparse.h"
+#include "raylib/rayprofile.h"
 #include "raylib/rayroomgen.h"
+#include "raylib/rayscenegen.h"
 #include "raylib/rayterraingen.h"
+#include "raylib/raythreads.h"
+#include "raylib/raytool.h"
 #include "raylib/raytreegen.h"
 
 #include <cstdio>
@@ -16,6 +22,8 @@
 #include <cstring>
 #include <iostream>
 
+namespace
+{
 void usage(int exit_code = 1)
 {
   // clang-format off
@@ -29,20 +37,53 @@ void usage(int exit_code = 1)
   std::cout << std::endl;
   std::cout << "          forest trees.txt - generate from a comma-separated list of x,y,z,radius trees" << std::endl;
   std::cout << "          terrain mesh.ply      - generate from a ground mesh" << std::endl;
+  std::cout << std::endl;
+  std::cout << "raycreate forest 3 --rays 1e9 --extent 2000 - streams a forest of exactly 1e9 rays over 2000x2000 m," << std::endl;
+  std::cout << "                                              generated in parallel tiles, each seeded from 3. Also:" << std::endl;
+  std::cout << "          city 3 - a city of box buildings, scanned from the air. Always streamed, by default 1e6 rays over 100 m" << std::endl;
+  std::cout << "                             --rays 1e6       - (-r) the exact number of rays to generate" << std::endl;
+  std::cout << "                             --extent 100     - (-e) the width in metres of the square of ground" << std::endl;
   // clang-format on
-  exit(exit_code);
+  ray::Tool::exit(exit_code);
 }
+}  // namespace
 
-int main(int argc, char *argv[])
+int raycreateMain(int argc, char *argv[])
 {
-  ray::KeyChoice cloud_type({ "room", "building", "tree", "forest", "terrain" });
+  ray::Threads::initFromArguments(argc, argv);
+  ray::MemoryBudget::initFromArguments(argc, argv);
+  ray::Profile::initFromArguments(argc, argv);
+  ray::CloudWriter::initFromArguments(argc, argv);
+  ray::KeyChoice cloud_type({ "room", "building", "tree", "forest", "terrain", "city" });
   ray::IntArgument seed(1, 1000000);
   ray::FileArgument input_file;
-  bool from_seed = ray::parseCommandLine(argc, argv, { &cloud_type, &seed });
+  ray::DoubleArgument num_rays(1.0, 1e12), extent(1.0, 1e6);
+  ray::OptionalKeyValueArgument rays_option("rays", 'r', &num_rays);
+  ray::OptionalKeyValueArgument extent_option("extent", 'e', &extent);
+  bool from_seed = ray::parseCommandLine(argc, argv, { &cloud_type, &seed }, { &rays_option, &extent_option });
   bool from_file = ray::parseCommandLine(argc, argv, { &cloud_type, &input_file });
   if (!from_seed && !from_file)
     usage();
 
+  std::string type = cloud_type.selectedKey();
+  const bool streamed = type == "city" || rays_option.isSet() || extent_option.isSet();
+  if (streamed)
+  {
+    // large scenes are generated a tile at a time, straight to the file
+    if (!from_seed || (type != "forest" && type != "city"))
+      usage();
+    ray::SceneParams params;
+    if (rays_option.isSet())
+      params.num_rays = static_cast<uint64_t>(num_rays.value());
+    if (extent_option.isSet())
+      params.extent = extent.value();
+    params.seed = static_cast<unsigned>(seed.value());
+    const ray::SceneType scene_type = type == "forest" ? ray::SceneType::Forest : ray::SceneType::City;
+    if (!ray::generateScene(type + ".ply", scene_type, params))
+      usage();
+    return 0;
+  }
+
   if (from_seed)
   {
     ray::srand(seed.value());
@@ -50,7 +91,6 @@ int main(int argc, char *argv[])
 
   ray::Cloud cloud;
   const double time_delta = 0.001;  // between rays
-  std::string type = cloud_type.selectedKey();
   if (type == "room")
   {
     // create room
@@ -200,3 +240,5 @@ int main(int argc, char *argv[])
 
   return 0;
 }
+
+RAYLIB_TOOL_MAIN(raycreateMain)
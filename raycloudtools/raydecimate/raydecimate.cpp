@@ -5,14 +5,22 @@
 // Author: Thomas Lowe
 #include "raylib/raycloud.h"
 #include "raylib/raycloudwriter.h"
+#include "raylib/raydecimation.h"
+#include "raylib/raylod.h"
+#include "raylib/raymemory.h"
 #include "raylib/rayparse.h"
 #include "raylib/rayply.h"
+#include "raylib/rayprofile.h"
+#include "raylib/raythreads.h"
+#include "raylib/raytool.h"
 
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
 
+namespace
+{
 void usage(int exit_code = 1)
 {
   // clang-format off
@@ -20,20 +28,47 @@ void usage(int exit_code = 1)
   std::cout << "usage:" << std::endl;
   std::cout << "raydecimate raycloud 3 cm   - reduces to one end point every 3 cm" << std::endl;
   std::cout << "raydecimate raycloud 4 rays - reduces to every fourth ray" << std::endl;
+  std::cout << "                     --parallel - spatial decimation of large clouds in parallel spatial buckets, spilling to disk" << std::endl;
+  std::cout << "Spatial decimation reads a level of detail built by raylod instead of the cloud, when it gives the same rays" << std::endl;
   // clang-format off
-  exit(exit_code);
+  ray::Tool::exit(exit_code);
 }
+}  // namespace
 
 // Decimates the ray cloud, spatially or in time
-int main(int argc, char *argv[])
+int raydecimateMain(int argc, char *argv[])
 {
+  ray::Threads::initFromArguments(argc, argv);
+  ray::MemoryBudget::initFromArguments(argc, argv);
+  ray::Profile::initFromArguments(argc, argv);
+  ray::CloudWriter::initFromArguments(argc, argv);
   ray::FileArgument cloud_file;
   ray::IntArgument num_rays(1, 100);
   ray::DoubleArgument vox_width(0.01, 100.0);
   ray::ValueKeyChoice quantity({ &vox_width, &num_rays }, { "cm", "rays" });
-  if (!ray::parseCommandLine(argc, argv, { &cloud_file, &quantity }))
+  ray::OptionalFlagArgument parallel("parallel", 'p');
+  if (!ray::parseCommandLine(argc, argv, { &cloud_file, &quantity }, { &parallel }))
     usage();
   const bool spatial_decimation = quantity.selectedKey() == "cm";
+  // a level of detail whose voxels nest within the decimation voxels holds all of the rays that the decimation keeps
+  std::string read_name = cloud_file.name();
+  std::vector<ray::LodLevel> levels;
+  if (spatial_decimation && ray::readLod(cloud_file.name(), levels))
+  {
+    const int level = ray::coarsestLodLevel(levels, 0.01 * vox_width.value(), true);
+    if (level >= 0)
+    {
+      read_name = ray::lodLevelFileName(cloud_file.name(), level);
+      std::cout << "decimating level " << level << " of the level of detail, " << levels[level].num_rays << " rays"
+                << std::endl;
+    }
+  }
+  if (spatial_decimation && parallel.isSet())
+  {
+    if (!ray::decimateInBuckets(read_name, cloud_file.nameStub() + "_decimated.ply", 0.01 * vox_width.value()))
+      usage();
+    return 0;
+  }
 
   ray::CloudWriter writer;
   if (!writer.begin(cloud_file.nameStub() + "_decimated.ply"))
@@ -44,7 +79,7 @@ int main(int argc, char *argv[])
   std::vector<int64_t> subsample;
   // voxel set is global, however its size is proportional to the decimated cloud size,
   // so we expect it to fit within RAM limits
-  std::set<Eigen::Vector3i, ray::Vector3iLess> voxel_set;
+  ray::VoxelSet voxel_set;
 
   auto decimate = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
                       std::vector<double> &times, std::vector<ray::RGBA> &colours) {
@@ -79,9 +114,11 @@ int main(int argc, char *argv[])
     writer.writeChunk(chunk);
   };
 
-  if (!ray::Cloud::read(cloud_file.name(), decimate))
+  if (!ray::Cloud::read(read_name, decimate))
     usage();
   writer.end();
 
   return 0;
 }
+
+RAYLIB_TOOL_MAIN(raydecimateMain)
@@ -0,0 +1,72 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raylib/raycloud.h"
+#include "raylib/raymemory.h"
+#include "raylib/rayparse.h"
+#include "raylib/rayprofile.h"
+#include "raylib/rayrenderer.h"
+#include "raylib/raythreads.h"
+#include "raylib/raytool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+void usage(int exit_code = 1)
+{
+  // clang-format off
+  std::cout << "Save the per voxel ray statistics (hits, rays and path lengths) beside a ray cloud, for reuse by density renders" << std::endl;
+  std::cout << "usage:" << std::endl;
+  std::cout << "raydensity raycloud.ply             - voxels of twice the point spacing, the default pixel width of rayrender" << std::endl;
+  std::cout << "           --pixel_width 0.1        - optional voxel width in m" << std::endl;
+  std::cout << "The voxels are written to raycloud.ply.density. rayrender density and density_rgb renders of the whole" << std::endl;
+  std::cout << "cloud at the same pixel width then read them rather than walking the rays." << std::endl;
+  // clang-format on
+  ray::Tool::exit(exit_code);
+}
+}  // namespace
+
+// Walks the rays of a cloud through the voxels of its density grid once, and saves the voxels
+int raydensityMain(int argc, char *argv[])
+{
+  ray::Threads::initFromArguments(argc, argv);
+  ray::MemoryBudget::initFromArguments(argc, argv);
+  ray::Profile::initFromArguments(argc, argv);
+  ray::FileArgument cloud_file;
+  ray::DoubleArgument pixel_width(0.0001, 1000.0);
+  ray::OptionalKeyValueArgument pixel_width_option("pixel_width", 'p', &pixel_width);
+  if (!ray::parseCommandLine(argc, argv, { &cloud_file }, { &pixel_width_option }))
+    usage();
+
+  ray::Cloud::Info info;
+  if (!ray::Cloud::getInfo(cloud_file.name(), info))
+    usage();
+  const ray::Cuboid bounds = info.ends_bound;  // the bounds that rayrender renders
+  double voxel_width = pixel_width.value();
+  if (!pixel_width_option.isSet())
+  {
+    const double spacing_scale = 2.0;  // matches the default pixel width of rayrender
+    voxel_width = spacing_scale * ray::Cloud::estimatePointSpacing(cloud_file.name(), bounds, info.num_bounded);
+  }
+  if (voxel_width <= 0.0)
+    usage();
+
+  ray::Cuboid grid_bounds;
+  Eigen::Vector3i dims;
+  ray::densityGridGeometry(bounds, voxel_width, grid_bounds, dims);
+  ray::DensityGrid grid(grid_bounds, voxel_width, dims);
+  grid.calculateDensities(cloud_file.name());
+  std::cout << "saving " << dims[0] << "x" << dims[1] << "x" << dims[2] << " voxels of width " << voxel_width
+            << " m to " << ray::densityFileName(cloud_file.name()) << std::endl;
+  if (!grid.save(cloud_file.name()))
+    usage();
+  return 0;
+}
+
+RAYLIB_TOOL_MAIN(raydensityMain)
@@ -8,12 +8,22 @@
 #include <cstring>
 #include <iostream>
 #include <limits>
+#include <memory>
+#include <unordered_set>
 #include "raylib/raycloud.h"
+#include "raylib/raycloudwriter.h"
 #include "raylib/raylaz.h"
+#include "raylib/raymemory.h"
 #include "raylib/rayparse.h"
 #include "raylib/rayply.h"
+#include "raylib/rayprofile.h"
+#include "raylib/raysort.h"
+#include "raylib/raythreads.h"
+#include "raylib/raytool.h"
 #include "raylib/raytrajectory.h"
 
+namespace
+{
 void usage(int exit_code = 1)
 {
   // clang-format off
@@ -23,132 +33,115 @@ void usage(int exit_code = 1)
   std::cout << "                           pointcloud.laz trajectoryfile.txt" << std::endl;
   std::cout << "                           --traj_delta 0.1 - trajectory temporal decimation period in s. Default is 0.1" << std::endl;
   // clang-format on
-  exit(exit_code);
+  ray::Tool::exit(exit_code);
 }
+}  // namespace
 
-int main(int argc, char *argv[])
+int rayexportMain(int argc, char *argv[])
 {
+  ray::Threads::initFromArguments(argc, argv);
+  ray::MemoryBudget::initFromArguments(argc, argv);
+  ray::Profile::initFromArguments(argc, argv);
+  ray::CloudWriter::initFromArguments(argc, argv);
   ray::FileArgument raycloud_file, pointcloud_file, trajectory_file;
   ray::DoubleArgument traj_delta(0.0, 10000);
   ray::OptionalKeyValueArgument delta_option("traj_delta", 't', &traj_delta);
   if (!ray::parseCommandLine(argc, argv, { &raycloud_file, &pointcloud_file, &trajectory_file }, { &delta_option }))
     usage();
+  const bool laz_points = pointcloud_file.nameExt() == "laz";
+  const bool ply_trajectory = trajectory_file.nameExt() == "ply";
+  if ((!laz_points && pointcloud_file.nameExt() != "ply") || (!ply_trajectory && trajectory_file.nameExt() != "txt"))
+    usage();
 
-  // Saving to a cloud file is fairly simple, we use chunk reading and writing:
-  if (pointcloud_file.nameExt() == "laz")
-  {
-    ray::LasWriter las_writer(pointcloud_file.name());
-    auto add_chunk = [&las_writer](std::vector<Eigen::Vector3d> &, std::vector<Eigen::Vector3d> &ends,
-                                   std::vector<double> &times,
-                                   std::vector<ray::RGBA> &colours) { las_writer.writeChunk(ends, times, colours); };
-    if (!ray::readPly(raycloud_file.name(), true, add_chunk, 0))
-      usage();
-  }
-  else if (pointcloud_file.nameExt() == "ply")
-  {
-    ray::PointPlyBuffer buffer;
-    std::ofstream ofs;
-    if (!ray::writePointCloudChunkStart(pointcloud_file.name(), ofs))
-      usage();
-    bool has_warned = false;
-    auto add_chunk = [&ofs, &buffer, &has_warned](std::vector<Eigen::Vector3d> &, std::vector<Eigen::Vector3d> &ends,
-                                     std::vector<double> &times, std::vector<ray::RGBA> &colours) {
-      ray::writePointCloudChunk(ofs, buffer, ends, times, colours, has_warned);
-    };
-    if (!ray::readPly(raycloud_file.name(), true, add_chunk, 0))
-      usage();
-    ray::writePointCloudChunkEnd(ofs);
-  }
-  else
-  {
+  // One read of the ray cloud feeds both outputs. The point cloud is chunk written as it is read
+  std::unique_ptr<ray::LasWriter> las_writer;
+  ray::PointPlyBuffer points_buffer;
+  std::ofstream points_ofs;
+  bool points_warned = false;
+  if (laz_points)
+    las_writer.reset(new ray::LasWriter(pointcloud_file.name()));
+  else if (!ray::writePointCloudChunkStart(pointcloud_file.name(), points_ofs))
     usage();
-  }
 
   // saving the trajectory is more difficult. Firstly because we need to temporally decimate,
   // secondly because we need to sort the times, when saving to the txt file
   const double time_step = delta_option.isSet() ? traj_delta.value() : 0.1;
-  std::set<int64_t> time_slots;
+  std::unordered_set<int64_t> time_slots;
   int64_t last_time_slot = std::numeric_limits<int64_t>::min();
 
   // if we are outputting to ply then we aren't sorting the times, just temporally decimating
   // that means we can still chunk-write the ply file, and the maximum memory is dictated by time_slots
-  if (trajectory_file.nameExt() == "ply")
-  {
-    ray::PointPlyBuffer buffer;
-    std::ofstream ofs;
-    if (!ray::writePointCloudChunkStart(trajectory_file.name(), ofs))
-      usage();
-    ray::Cloud chunk;
+  ray::PointPlyBuffer traj_buffer;
+  std::ofstream traj_ofs;
+  bool traj_warned = false;
+  ray::Cloud traj_chunk;
+  if (ply_trajectory && !ray::writePointCloudChunkStart(trajectory_file.name(), traj_ofs))
+    usage();
+  // for text files we decimate and then sort. There is one node per time slot, so this is as small as time_slots
+  std::vector<ray::TrajectoryNode> traj_nodes;
+  bool sorted = true;
 
-    bool has_warned = false;
-    auto decimate_time = [&time_slots, &ofs, &buffer, &chunk, &last_time_slot, time_step, &has_warned](
-                           std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
-                           std::vector<double> &times, std::vector<ray::RGBA> &colours) {
-      chunk.clear();
-      for (size_t i = 0; i < ends.size(); i++)
-      {
-        const int64_t time_slot = static_cast<int64_t>(std::floor(times[i] / time_step));
-        if (time_slot == last_time_slot)
-          continue;
-        if (time_slots.find(time_slot) == time_slots.end())
-        {
-          time_slots.insert(time_slot);
-          chunk.starts.push_back(starts[i]);
-          chunk.times.push_back(times[i]);
-          chunk.colours.push_back(colours[i]);
-        }
-        last_time_slot = time_slot;
-      }
-      ray::writePointCloudChunk(ofs, buffer, chunk.starts, chunk.times, chunk.colours, has_warned);
-    };
-    if (!ray::readPly(raycloud_file.name(), true, decimate_time, 0))
-      usage();
-    ray::writePointCloudChunkEnd(ofs);
-  }
-  else if (trajectory_file.nameExt() == "txt")  // for text files we decimate and then sort
-  {
-    std::cout << "traj: " << trajectory_file.name() << std::endl;
-    std::vector<ray::TrajectoryNode> traj_nodes;
-    bool sorted = true;
+  auto export_chunk = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                          std::vector<double> &times, std::vector<ray::RGBA> &colours) {
+    if (laz_points)
+      las_writer->writeChunk(ends, times, colours);
+    else
+      ray::writePointCloudChunk(points_ofs, points_buffer, ends, times, colours, points_warned);
 
-    auto decimate_time = [&time_slots, &traj_nodes, &sorted, &last_time_slot, time_step](
-                           std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
-                           std::vector<double> &times, std::vector<ray::RGBA> &) {
-      for (size_t i = 0; i < ends.size(); i++)
+    traj_chunk.clear();
+    for (size_t i = 0; i < ends.size(); i++)
+    {
+      const int64_t time_slot = static_cast<int64_t>(std::floor(times[i] / time_step));
+      if (time_slot == last_time_slot)
+        continue;
+      if (time_slots.insert(time_slot).second)
       {
-        const int64_t time_slot = static_cast<int64_t>(std::floor(times[i] / time_step));
-        if (time_slot == last_time_slot)
+        if (ply_trajectory)
         {
-          continue;
+          traj_chunk.starts.push_back(starts[i]);
+          traj_chunk.times.push_back(times[i]);
+          traj_chunk.colours.push_back(colours[i]);
         }
-        if (time_slots.find(time_slot) == time_slots.end())
+        else
         {
-          time_slots.insert(time_slot);
           if (!traj_nodes.empty() && times[i] < traj_nodes.back().time)
-          {
             sorted = false;
-          }
           ray::TrajectoryNode traj_node;
           traj_node.time = times[i];
           traj_node.point = starts[i];
           traj_nodes.push_back(traj_node);
         }
-        last_time_slot = time_slot;
       }
-    };
-    if (!ray::readPly(raycloud_file.name(), true, decimate_time, 0))
-    {
-      usage();
-    }
-
-    if (!sorted)
-    {
-      std::sort(traj_nodes.begin(), traj_nodes.end(),
-                [](const ray::TrajectoryNode &a, const ray::TrajectoryNode &b) { return a.time < b.time; });
+      last_time_slot = time_slot;
     }
+    if (ply_trajectory)
+      ray::writePointCloudChunk(traj_ofs, traj_buffer, traj_chunk.starts, traj_chunk.times, traj_chunk.colours,
+                                traj_warned);
+  };
+  if (!ray::Cloud::read(raycloud_file.name(), export_chunk))
+    usage();
+  if (laz_points)
+    las_writer.reset();  // finishes the file
+  else
+    ray::writePointCloudChunkEnd(points_ofs);
 
-    ray::saveTrajectory(traj_nodes, trajectory_file.name());
+  if (ply_trajectory)
+  {
+    ray::writePointCloudChunkEnd(traj_ofs);
+    return 0;
   }
-  else
-    usage();
+  std::cout << "traj: " << trajectory_file.name() << std::endl;
+  if (!sorted)
+  {
+    std::vector<double> node_times(traj_nodes.size());
+    for (size_t i = 0; i < traj_nodes.size(); i++) node_times[i] = traj_nodes[i].time;
+    const std::vector<size_t> order = ray::radixSortOrder(node_times);
+    std::vector<ray::TrajectoryNode> sorted_nodes(traj_nodes.size());
+    for (size_t i = 0; i < order.size(); i++) sorted_nodes[i] = traj_nodes[order[i]];
+    traj_nodes.swap(sorted_nodes);
+  }
+  ray::saveTrajectory(traj_nodes, trajectory_file.name());
+  return 0;
 }
+
+RAYLIB_TOOL_MAIN(rayexportMain)
@@ -8,18 +8,33 @@
 #include "raylib/extraction/rayterrain.h"
 #include "raylib/extraction/raytrees.h"
 #include "raylib/extraction/raytrunks.h"
+#include "raylib/raycheckpoint.h"
 #include "raylib/raycloud.h"
+#include "raylib/raycloudwriter.h"
 #include "raylib/raydebugdraw.h"
 #include "raylib/rayforestgen.h"
+#include "raylib/raymemory.h"
 #include "raylib/raymesh.h"
+#include "raylib/raynodes.h"
 #include "raylib/rayparse.h"
 #include "raylib/rayply.h"
+#include "raylib/rayprofile.h"
+#include "raylib/raythreads.h"
+#include "raylib/raytilecache.h"
+#include "raylib/raytool.h"
 
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
 
+namespace
+{
+/// the estimated memory per ray of each in-memory extraction, beyond the cloud
+const size_t kTrunksBytesPerRay = 100;
+const size_t kTreesBytesPerRay = 300;
+const size_t kTerrainBytesPerRay = 50;
+
 void usage(int exit_code = 1)
 {
   // clang-format off
@@ -27,6 +42,7 @@ void usage(int exit_code = 1)
   std::cout << "usage:" << std::endl;
   std::cout << "rayextract terrain cloud.ply                - extract terrain undersurface to mesh. Slow, so consider decimating first." << std::endl;
   std::cout << "                            --gradient 1    - maximum gradient counted as terrain" << std::endl;
+  std::cout << "                            --tile_width 100- extract in tiles of this width, streamed from disk" << std::endl;
   std::cout << "rayextract trunks cloud.ply                 - extract tree trunk base locations and radii to text file" << std::endl;
   std::cout << "                            --exclude_rays  - does not use rays to exclude candidates with rays passing through" << std::endl;
   std::cout << "rayextract forest cloud.ply                 - extracts tree locations, radii and heights to file" << std::endl;
@@ -50,21 +66,35 @@ void usage(int exit_code = 1)
   std::cout << "                            --gravity_factor 0.3 - (-f) larger values preference vertical trees" << std::endl;
   std::cout << "                            --branch_segmentation- (-b) _segmented.ply is per branch segment" << std::endl;
   std::cout << "                            --grid_width         - (-w) crops results assuming cloud has been gridded with given width" << std::endl;
+  std::cout << "                            --tiled 10           - (-t) extract in parallel tiles, streamed from disk, each with rays this far beyond it" << std::endl;
+  std::cout << "                            --resume             - keeps a checkpoint of the segmentation, or of each tile with --tiled," << std::endl;
+  std::cout << "                                                   so that an interrupted run resumes from it when repeated" << std::endl;
+  std::cout << "                            --tile_cache         - with --tiled, keeps the trees of each tile for the next run, which" << std::endl;
+  std::cout << "                                                   reuses those of the tiles whose rays have not changed" << std::endl;
   std::cout << "                                 --verbose  - extra debug output." << std::endl;
   // clang-format on
-  exit(exit_code);
+  ray::Tool::exit(exit_code);
 }
-
+}  // namespace
 
 /// extracts natural features from a scene
-int main(int argc, char *argv[])
+int rayextractMain(int argc, char *argv[])
 {
+  ray::Threads::initFromArguments(argc, argv);
+  ray::MemoryBudget::initFromArguments(argc, argv);
+  ray::Profile::initFromArguments(argc, argv);
+  ray::CloudWriter::initFromArguments(argc, argv);
+  ray::Nodes::initFromArguments(argc, argv);
+  ray::Checkpoint::initFromArguments(argc, argv);
+  ray::TileCache::initFromArguments(argc, argv);
   ray::FileArgument cloud_file, mesh_file, trunks_file;
   ray::TextArgument forest("forest"), trees("trees"), trunks("trunks"), terrain("terrain");
   ray::OptionalKeyValueArgument groundmesh_option("ground", 'g', &mesh_file);
   ray::OptionalKeyValueArgument trunks_option("trunks", 't', &trunks_file);
   ray::DoubleArgument gradient(0.001, 1000.0);
   ray::OptionalKeyValueArgument gradient_option("gradient", 'g', &gradient);
+  ray::DoubleArgument tile_width(0.1, 100000.0);
+  ray::OptionalKeyValueArgument tile_width_option("tile_width", 't', &tile_width);
   ray::OptionalFlagArgument exclude_rays("exclude_rays", 'e'), segment_branches("branch_segmentation", 'b');
   ray::DoubleArgument width(0.01, 10.0), drop(0.001, 1.0), max_gradient(0.01, 5.0), min_gradient(0.01, 5.0);
 
@@ -86,6 +116,8 @@ int main(int argc, char *argv[])
   ray::OptionalKeyValueArgument span_ratio_option("span_ratio", 's', &span_ratio);
   ray::OptionalKeyValueArgument gravity_factor_option("gravity_factor", 'f', &gravity_factor);
   ray::OptionalKeyValueArgument grid_width_option("grid_width", 'w', &grid_width);
+  ray::DoubleArgument tile_halo(0.1, 1000.0);
+  ray::OptionalKeyValueArgument tiled_option("tiled", 't', &tile_halo);
 
   ray::IntArgument smooth(0, 50);
   ray::OptionalKeyValueArgument width_option("width", 'w', &width), smooth_option("smooth", 's', &smooth),
@@ -93,7 +125,8 @@ int main(int argc, char *argv[])
 
   ray::OptionalFlagArgument verbose("verbose", 'v');
 
-  bool extract_terrain = ray::parseCommandLine(argc, argv, { &terrain, &cloud_file }, { &gradient_option, &verbose });
+  bool extract_terrain = ray::parseCommandLine(argc, argv, { &terrain, &cloud_file },
+                                                { &gradient_option, &tile_width_option, &verbose });
   bool extract_trunks = ray::parseCommandLine(argc, argv, { &trunks, &cloud_file }, { &exclude_rays, &verbose });
   bool extract_forest = ray::parseCommandLine(
     argc, argv, { &forest, &cloud_file },
@@ -102,7 +135,7 @@ int main(int argc, char *argv[])
     argc, argv, { &trees, &cloud_file, &mesh_file },
     { &max_diameter_option, &distance_limit_option, &height_min_option, &min_diameter_option, &length_to_radius_option,
       &cylinder_length_to_width_option, &gap_ratio_option, &span_ratio_option, &gravity_factor_option,
-      &radius_exponent_option, &segment_branches, &grid_width_option, &verbose });
+      &radius_exponent_option, &segment_branches, &grid_width_option, &tiled_option, &verbose });
   if (!extract_trunks && !extract_forest && !extract_terrain && !extract_trees)
   {
     usage();
@@ -115,8 +148,11 @@ int main(int argc, char *argv[])
   // finds cylindrical trunks in the data and saves them to an _trunks.txt file
   if (extract_trunks)
   {
+    // the trunks are found without the ray times, so they are not loaded
+    if (!ray::MemoryBudget::checkCloud(cloud_file.name(), kTrunksBytesPerRay, "rayextract trunks"))
+      return 1;
     ray::Cloud cloud;
-    if (!cloud.load(cloud_file.name()))
+    if (!cloud.loadFields(cloud_file.name(), ray::kCFStarts | ray::kCFEnds | ray::kCFColours))
     {
       usage(true);
     }
@@ -128,13 +164,6 @@ int main(int argc, char *argv[])
   // finds full tree structures (piecewise cylindrical representation) and saves to file
   else if (extract_trees)
   {
-    ray::Cloud cloud;
-    const int min_num_rays = 40;
-    if (!cloud.load(cloud_file.name(), true, min_num_rays))
-    {
-      usage(true);
-    }
-
     ray::Mesh mesh;
     if (!ray::readPlyMesh(mesh_file.name(), mesh))
     {
@@ -186,7 +215,37 @@ int main(int argc, char *argv[])
       params.grid_width = grid_width.value();
     }
     params.segment_branches = segment_branches.isSet();
+    if (ray::Checkpoint::enabled())
+    {
+      params.checkpoint_file = cloud_file.nameStub() + "_trees.checkpoint";
+    }
+    if (ray::TileCache::enabled())
+    {
+      params.tile_cache_file = cloud_file.nameStub() + "_trees.tilecache";
+    }
+
+    // the tiles are extracted in parallel and merged, so that memory is bounded by the tile size
+    if (tiled_option.isSet())
+    {
+      if (!ray::extractTreesInTiles(cloud_file.name(), cloud_file.nameStub(), mesh, params, tile_halo.value(),
+                                    verbose.isSet()))
+      {
+        usage(true);
+      }
+      return 0;
+    }
 
+    if (!ray::MemoryBudget::checkCloud(cloud_file.name(), kTreesBytesPerRay, "rayextract trees"))
+    {
+      std::cerr << "use --tiled to extract the trees in tiles" << std::endl;
+      return 1;
+    }
+    ray::Cloud cloud;
+    const int min_num_rays = 40;
+    if (!cloud.load(cloud_file.name(), true, min_num_rays))
+    {
+      usage(true);
+    }
     ray::Trees trees(cloud, mesh, params, verbose.isSet());
 
     // output the picewise cylindrical description of the trees
@@ -237,10 +296,23 @@ int main(int argc, char *argv[])
   // extract the terrain to a .ply mesh file
   // this uses a sand model (no terrain is sloped more than 'gradient') which is a
   // highest lower bound
+  else if (extract_terrain && tile_width_option.isSet())
+  {
+    ray::Terrain terrain;
+    const double grad = gradient_option.isSet() ? gradient.value() : 1.0;
+    if (!terrain.extractTiled(cloud_file.name(), cloud_file.nameStub(), grad, tile_width.value(), 0.0,
+                              verbose.isSet()))
+    {
+      usage(true);
+    }
+  }
   else if (extract_terrain)
   {
+    // the terrain is extracted from the bounded ray ends only
+    if (!ray::MemoryBudget::checkCloud(cloud_file.name(), kTerrainBytesPerRay, "rayextract terrain"))
+      return 1;
     ray::Cloud cloud;
-    if (!cloud.load(cloud_file.name()))
+    if (!cloud.loadFields(cloud_file.name(), ray::kCFEnds | ray::kCFColours))
     {
       usage(true);
     }
@@ -255,3 +327,5 @@ int main(int argc, char *argv[])
   }
   return 0;
 }
+
+RAYLIB_TOOL_MAIN(rayextractMain)
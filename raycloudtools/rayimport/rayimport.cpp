@@ -9,11 +9,18 @@
 #include <iostream>
 
 #include "raylib/raycloud.h"
+#include "raylib/raycloudwriter.h"
 #include "raylib/raylaz.h"
+#include "raylib/raymemory.h"
 #include "raylib/rayparse.h"
 #include "raylib/rayply.h"
+#include "raylib/rayprofile.h"
+#include "raylib/raythreads.h"
+#include "raylib/raytool.h"
 #include "raylib/raytrajectory.h"
 
+namespace
+{
 void usage(int exit_code = 1)
 {
   // clang-format off
@@ -28,11 +35,16 @@ void usage(int exit_code = 1)
   std::cout << "                                        --remove_start_pos  - translate so first point is at 0,0,0" << std::endl;
   std::cout << "The output is a .ply file of the same name (or with suffix _raycloud if the input was a .ply file)." << std::endl;
   // clang-format on
-  exit(exit_code);
+  ray::Tool::exit(exit_code);
 }
+}  // namespace
 
-int main(int argc, char *argv[])
+int rayimportMain(int argc, char *argv[])
 {
+  ray::Threads::initFromArguments(argc, argv);
+  ray::MemoryBudget::initFromArguments(argc, argv);
+  ray::Profile::initFromArguments(argc, argv);
+  ray::CloudWriter::initFromArguments(argc, argv);
   ray::DoubleArgument max_intensity(0.0, 10000);
   ray::Vector3dArgument position, ray_vec;
   ray::TextArgument ray_text("ray");
@@ -61,22 +73,20 @@ int main(int argc, char *argv[])
     // allow the trajectory file to be in multiple different formats
     if (traj_end == ".ply" || traj_end == ".las" || traj_end == ".laz")
     {
-      std::vector<Eigen::Vector3d> starts;
-      std::vector<Eigen::Vector3d> ends;
-      std::vector<double> times;
-      std::vector<ray::RGBA> colours;
+      // only the positions and times of the trajectory are kept
+      auto add_nodes = [&trajectory](std::vector<Eigen::Vector3d> &, std::vector<Eigen::Vector3d> &ends,
+                                     std::vector<double> &times, std::vector<ray::RGBA> &) {
+        trajectory.points().insert(trajectory.points().end(), ends.begin(), ends.end());
+        trajectory.times().insert(trajectory.times().end(), times.begin(), times.end());
+      };
+      size_t num_traj_bounded;
       if (traj_end == ".ply")
       {
-        if (!ray::readPly(traj_file, starts, ends, times, colours, false))
-          return false;
-      }
-      else
-      {
-        if (!ray::readLas(traj_file, ends, times, colours, maximum_intensity))
-          return false;
+        if (!ray::readPly(traj_file, false, add_nodes, 0))
+          usage();
       }
-      trajectory.points() = std::move(ends);
-      trajectory.times() = std::move(times);
+      else if (!ray::readLas(traj_file, add_nodes, num_traj_bounded, maximum_intensity, nullptr))
+        usage();
     }
     else if (!trajectory.load(traj_file))
       usage();
@@ -85,13 +95,12 @@ int main(int argc, char *argv[])
   std::string save_file = cloud_file.nameStub();
   if (cloud_file.nameExt() == "ply")
     save_file += "_raycloud";
-  size_t num_bounded;
-  std::ofstream ofs;
-  ray::RayPlyBuffer buffer;
-  if (!ray::writeRayCloudChunkStart(save_file + ".ply", ofs))
+  // each chunk is converted and written as it is read, so the point cloud is never held in memory
+  size_t num_bounded = 0;
+  ray::CloudWriter writer;
+  if (!writer.begin(save_file + ".ply"))
     usage();
   Eigen::Vector3d start_pos(0, 0, 0);
-  bool has_warned = false;
   auto add_chunk = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
                        std::vector<double> &times, std::vector<ray::RGBA> &colours) {
     if (start_pos.squaredNorm() == 0.0)
@@ -141,6 +150,11 @@ int main(int argc, char *argv[])
         start -= start_pos;
       }
     }
+    for (const auto &c : colours)
+    {
+      if (c.alpha > 0)
+        num_bounded++;
+    }
     if (maximum_intensity == 0.0)
     {
       for (auto &c : colours) 
@@ -148,7 +162,7 @@ int main(int argc, char *argv[])
         c.alpha = 255;
       }
     }
-    if (!ray::writeRayCloudChunk(ofs, buffer, starts, ends, times, colours, has_warned))
+    if (!writer.writeChunk(starts, ends, times, colours))
     {
       usage();
     }
@@ -164,7 +178,8 @@ int main(int argc, char *argv[])
   }
   else if (cloud_file.nameExt() == "laz" || cloud_file.nameExt() == "las")
   {
-    if (!ray::readLas(cloud_file.name(), add_chunk, num_bounded, maximum_intensity, offset))
+    size_t num_las_bounded;
+    if (!ray::readLas(cloud_file.name(), add_chunk, num_las_bounded, maximum_intensity, offset))
     {
       usage();
     }
@@ -176,11 +191,11 @@ int main(int argc, char *argv[])
   }
   if (num_bounded == 0 && maximum_intensity > 0)
   {
-    std::cout << "warning: all laz file intensities are 0." << std::endl;
+    std::cout << "warning: all point intensities are 0." << std::endl;
     std::cout << "If your sensor lacks intensity information, set them to full using:" << std::endl;
     std::cout << "rayimport <point cloud> <trajectory file> --max_intensity 0" << std::endl;
   }
-  ray::writeRayCloudChunkEnd(ofs);
+  writer.end();
   // if we remove the start position, then it is useful to print this value that is removed
   // so that the user hasn't lost information
   if (remove.isSet())
@@ -189,3 +204,5 @@ int main(int argc, char *argv[])
   }
   return 0;
 }
+
+RAYLIB_TOOL_MAIN(rayimportMain)
@@ -0,0 +1,235 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raylib/raycloudwriter.h"
+#include "raylib/rayingest.h"
+#include "raylib/rayparse.h"
+#include "raylib/raythreads.h"
+
+#include <ros/ros.h>
+#include <nav_msgs/Odometry.h>
+#include <sensor_msgs/PointCloud2.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+void usage(int exit_code = 1)
+{
+  // clang-format off
+  std::cout << "Ingest a live point cloud topic and odometry topic into a ray cloud while they are being captured." << std::endl;
+  std::cout << "The points are expected in the odometry's fixed frame, such as registered scans from a SLAM system." << std::endl;
+  std::cout << "usage:" << std::endl;
+  std::cout << "rayingest /points /odometry live.ply - write the rays to live.ply, chunk by chunk, until shutdown" << std::endl;
+  std::cout << "                              --decimate 5  - keep only the first ray in each 5 cm voxel, as raydecimate" << std::endl;
+  std::cout << "                              --range 4     - remove range gap noise over 4 cm, as raydenoise range" << std::endl;
+  std::cout << "                              --chunk 1     - seconds of sensor time per output chunk (default 1)" << std::endl;
+  std::cout << "                              --max_intensity 100 - maximum intensity value (default 100)." << std::endl;
+  std::cout << "                                                    0 sets all to full intensity (bounded rays)." << std::endl;
+  std::cout << "Each chunk is also published on the ray_cloud topic. A per point 'time' field, in seconds after the" << std::endl;
+  std::cout << "message stamp, is used when present, otherwise each point takes the message stamp." << std::endl;
+  // clang-format on
+  exit(exit_code);
+}
+
+namespace
+{
+/// The value of the field @c field of the point at @c data , as a double
+double readField(const uint8_t *data, const sensor_msgs::PointField &field)
+{
+  const uint8_t *value = data + field.offset;
+  switch (field.datatype)
+  {
+  case sensor_msgs::PointField::INT8:
+    return static_cast<double>(*reinterpret_cast<const int8_t *>(value));
+  case sensor_msgs::PointField::UINT8:
+    return static_cast<double>(*value);
+  case sensor_msgs::PointField::INT16:
+  {
+    int16_t v;
+    std::memcpy(&v, value, sizeof(v));
+    return static_cast<double>(v);
+  }
+  case sensor_msgs::PointField::UINT16:
+  {
+    uint16_t v;
+    std::memcpy(&v, value, sizeof(v));
+    return static_cast<double>(v);
+  }
+  case sensor_msgs::PointField::INT32:
+  {
+    int32_t v;
+    std::memcpy(&v, value, sizeof(v));
+    return static_cast<double>(v);
+  }
+  case sensor_msgs::PointField::UINT32:
+  {
+    uint32_t v;
+    std::memcpy(&v, value, sizeof(v));
+    return static_cast<double>(v);
+  }
+  case sensor_msgs::PointField::FLOAT32:
+  {
+    float v;
+    std::memcpy(&v, value, sizeof(v));
+    return static_cast<double>(v);
+  }
+  default:
+  {
+    double v;
+    std::memcpy(&v, value, sizeof(v));
+    return v;
+  }
+  }
+}
+
+/// The field named @c name of @c msg , or null if there is none
+const sensor_msgs::PointField *findField(const sensor_msgs::PointCloud2 &msg, const std::string &name)
+{
+  for (const auto &field : msg.fields)
+  {
+    if (field.name == name)
+    {
+      return &field;
+    }
+  }
+  return nullptr;
+}
+
+/// The ray cloud chunk @c chunk as a point cloud message of its end points, in @c frame_id
+sensor_msgs::PointCloud2 chunkMessage(const ray::Cloud &chunk, const std::string &frame_id)
+{
+  sensor_msgs::PointCloud2 msg;
+  msg.header.frame_id = frame_id;
+  msg.header.stamp = ros::Time::now();
+  const char *names[4] = { "x", "y", "z", "intensity" };
+  for (int i = 0; i < 4; i++)
+  {
+    sensor_msgs::PointField field;
+    field.name = names[i];
+    field.offset = static_cast<uint32_t>(i * sizeof(float));
+    field.datatype = sensor_msgs::PointField::FLOAT32;
+    field.count = 1;
+    msg.fields.push_back(field);
+  }
+  msg.height = 1;
+  msg.width = static_cast<uint32_t>(chunk.ends.size());
+  msg.point_step = static_cast<uint32_t>(4 * sizeof(float));
+  msg.row_step = msg.point_step * msg.width;
+  msg.is_bigendian = false;
+  msg.is_dense = true;
+  msg.data.resize(msg.row_step);
+  for (size_t i = 0; i < chunk.ends.size(); i++)
+  {
+    const float values[4] = { static_cast<float>(chunk.ends[i][0]), static_cast<float>(chunk.ends[i][1]),
+                              static_cast<float>(chunk.ends[i][2]), static_cast<float>(chunk.colours[i].alpha) };
+    std::memcpy(&msg.data[i * msg.point_step], values, sizeof(values));
+  }
+  return msg;
+}
+}  // namespace
+
+int main(int argc, char *argv[])
+{
+  ros::init(argc, argv, "rayingest");  // removes the ROS remapping arguments
+  ray::Threads::initFromArguments(argc, argv);
+  ray::CloudWriter::initFromArguments(argc, argv);
+  ray::FileArgument points_topic(false), odometry_topic(false), cloud_file;
+  ray::DoubleArgument decimate_cm(0.01, 1000.0), range_cm(0.01, 1000.0), chunk_seconds(0.0, 3600.0);
+  ray::DoubleArgument max_intensity(0.0, 10000.0);
+  ray::OptionalKeyValueArgument decimate_option("decimate", 'd', &decimate_cm);
+  ray::OptionalKeyValueArgument range_option("range", 'r', &range_cm);
+  ray::OptionalKeyValueArgument chunk_option("chunk", 'c', &chunk_seconds);
+  ray::OptionalKeyValueArgument max_intensity_option("max_intensity", 'm', &max_intensity);
+  if (!ray::parseCommandLine(argc, argv, { &points_topic, &odometry_topic, &cloud_file },
+                             { &decimate_option, &range_option, &chunk_option, &max_intensity_option }))
+    usage();
+  // Sensors we use have 0 to 100 for normal output, and to 255 for special reflective surfaces
+  const double maximum_intensity = max_intensity_option.isSet() ? max_intensity.value() : 100.0;
+
+  ray::IngestConfig config;
+  config.voxel_width = decimate_option.isSet() ? 0.01 * decimate_cm.value() : 0.0;
+  config.range_distance = range_option.isSet() ? 0.01 * range_cm.value() : 0.0;
+  if (chunk_option.isSet())
+    config.chunk_duration = chunk_seconds.value();
+
+  ray::CloudWriter writer;
+  if (!writer.begin(cloud_file.name()))
+    usage();
+  ros::NodeHandle node;
+  ros::Publisher publisher = node.advertise<sensor_msgs::PointCloud2>("ray_cloud", 3);
+  std::string frame_id;
+  ray::LiveIngest ingest(config, &writer, [&](const ray::Cloud &chunk) {
+    if (publisher.getNumSubscribers() > 0)
+      publisher.publish(chunkMessage(chunk, frame_id));
+  });
+
+  bool success = true;
+  auto on_odometry = [&](const nav_msgs::Odometry::ConstPtr &msg) {
+    const auto &position = msg->pose.pose.position;
+    if (!ingest.addPose(msg->header.stamp.toSec(), Eigen::Vector3d(position.x, position.y, position.z)))
+    {
+      success = false;
+      ros::shutdown();
+    }
+  };
+  std::vector<Eigen::Vector3d> ends;
+  std::vector<double> times;
+  std::vector<ray::RGBA> colours;
+  auto on_points = [&](const sensor_msgs::PointCloud2::ConstPtr &msg) {
+    const sensor_msgs::PointField *fields[3] = { findField(*msg, "x"), findField(*msg, "y"), findField(*msg, "z") };
+    if (!fields[0] || !fields[1] || !fields[2])
+    {
+      ROS_WARN_ONCE("point cloud messages without x, y and z fields are ignored");
+      return;
+    }
+    const sensor_msgs::PointField *time_field = findField(*msg, "time");
+    const sensor_msgs::PointField *intensity_field = findField(*msg, "intensity");
+    frame_id = msg->header.frame_id;
+    const double stamp = msg->header.stamp.toSec();
+    const size_t num_points = static_cast<size_t>(msg->width) * msg->height;
+    ends.clear();
+    times.clear();
+    colours.clear();
+    for (size_t i = 0; i < num_points; i++)
+    {
+      const uint8_t *data = &msg->data[(i / msg->width) * msg->row_step + (i % msg->width) * msg->point_step];
+      const Eigen::Vector3d end(readField(data, *fields[0]), readField(data, *fields[1]), readField(data, *fields[2]));
+      if (!std::isfinite(end[0]) || !std::isfinite(end[1]) || !std::isfinite(end[2]))
+        continue;
+      ray::RGBA colour;
+      colour.red = colour.green = colour.blue = 127;
+      colour.alpha = 255;
+      if (intensity_field && maximum_intensity > 0.0)
+      {
+        // as rayimport converts intensities, only an intensity of exactly 0 is a non-return
+        const double intensity = readField(data, *intensity_field);
+        colour.alpha = static_cast<uint8_t>(std::ceil(255.0 * ray::clamped(intensity / maximum_intensity, 0.0, 1.0)));
+      }
+      ends.push_back(end);
+      times.push_back(time_field ? stamp + readField(data, *time_field) : stamp);
+      colours.push_back(colour);
+    }
+    if (!ingest.addPoints(ends, times, colours))
+    {
+      success = false;
+      ros::shutdown();
+    }
+  };
+  ros::Subscriber odometry_subscriber =
+    node.subscribe<nav_msgs::Odometry>(odometry_topic.name(), 1000, on_odometry);
+  ros::Subscriber points_subscriber =
+    node.subscribe<sensor_msgs::PointCloud2>(points_topic.name(), 100, on_points);
+  ros::spin();
+
+  if (!ingest.finish())
+    success = false;
+  writer.end();
+  std::cout << ingest.numReceived() << " points ingested into " << ingest.numWritten() << " rays in "
+            << ingest.numChunks() << " chunks, " << ingest.numDenoised() << " removed as range gap noise and "
+            << ingest.numDecimated() << " by decimation" << std::endl;
+  return success ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raylib/raycloud.h"
+#include "raylib/raycloudwriter.h"
+#include "raylib/raylod.h"
+#include "raylib/raymemory.h"
+#include "raylib/rayparse.h"
+#include "raylib/rayprofile.h"
+#include "raylib/raythreads.h"
+#include "raylib/raytool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+void usage(int exit_code = 1)
+{
+  // clang-format off
+  std::cout << "Build a level of detail pyramid beside a ray cloud, for fast coarse renders and decimations" << std::endl;
+  std::cout << "usage:" << std::endl;
+  std::cout << "raylod raycloud.ply          - levels from twice the point spacing, doubling up to the cloud width" << std::endl;
+  std::cout << "raylod raycloud.ply 5 cm     - levels from 5 cm voxels" << std::endl;
+  std::cout << "                    --levels 6 - at most this many levels" << std::endl;
+  std::cout << "The levels are written to raycloud.ply.lod0.ply, raycloud.ply.lod1.ply, ... and listed in raycloud.ply.lod" << std::endl;
+  std::cout << "rayrender and raydecimate then read the coarsest level that suits their resolution." << std::endl;
+  // clang-format on
+  ray::Tool::exit(exit_code);
+}
+}  // namespace
+
+// Builds the level of detail pyramid of a ray cloud
+int raylodMain(int argc, char *argv[])
+{
+  ray::Threads::initFromArguments(argc, argv);
+  ray::MemoryBudget::initFromArguments(argc, argv);
+  ray::Profile::initFromArguments(argc, argv);
+  ray::CloudWriter::initFromArguments(argc, argv);
+  ray::FileArgument cloud_file;
+  ray::DoubleArgument vox_width(0.01, 10000.0);
+  ray::TextArgument cm_text("cm");
+  ray::IntArgument num_levels(1, 32);
+  ray::OptionalKeyValueArgument levels_option("levels", 'l', &num_levels);
+  const bool given_width =
+    ray::parseCommandLine(argc, argv, { &cloud_file, &vox_width, &cm_text }, { &levels_option });
+  if (!given_width && !ray::parseCommandLine(argc, argv, { &cloud_file }, { &levels_option }))
+    usage();
+
+  double voxel_width = 0.01 * vox_width.value();
+  if (!given_width)
+  {
+    ray::Cloud::Info info;
+    if (!ray::Cloud::getInfo(cloud_file.name(), info))
+      usage();
+    const double spacing_scale = 2.0;  // matches the default pixel width of rayrender
+    voxel_width =
+      spacing_scale * ray::Cloud::estimatePointSpacing(cloud_file.name(), info.ends_bound, info.num_bounded);
+    if (voxel_width <= 0.0)
+      usage();
+  }
+  const bool built = levels_option.isSet() ?
+                       ray::buildLod(cloud_file.name(), voxel_width, static_cast<size_t>(num_levels.value())) :
+                       ray::buildLod(cloud_file.name(), voxel_width);
+  if (!built)
+    usage();
+  return 0;
+}
+
+RAYLIB_TOOL_MAIN(raylodMain)
@@ -5,13 +5,21 @@
 // Author: Thomas Lowe
 #include "raylib/raycloud.h"
 #include "raylib/raycloudwriter.h"
+#include "raylib/raymemory.h"
 #include "raylib/rayparse.h"
+#include "raylib/rayprofile.h"
+#include "raylib/raysort.h"
+#include "raylib/raythreads.h"
+#include "raylib/raytool.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
 
+namespace
+{
 void usage(int exit_code = 1)
 {
   // clang-format off
@@ -21,11 +29,16 @@ void usage(int exit_code = 1)
   std::cout << " rayrestore decimated_cloud 10 rays full_cloud - decimated_cloud is an 'every tenth ray' decimation of full_cloud" << std::endl;
   std::cout << "Note: this tool does not work with raysmooth or temporal translations." << std::endl;
   // clang-format on
-  exit(exit_code);
+  ray::Tool::exit(exit_code);
 }
+}  // namespace
 
-int main(int argc, char *argv[])
+int rayrestoreMain(int argc, char *argv[])
 {
+  ray::Threads::initFromArguments(argc, argv);
+  ray::MemoryBudget::initFromArguments(argc, argv);
+  ray::Profile::initFromArguments(argc, argv);
+  ray::CloudWriter::initFromArguments(argc, argv);
   ray::FileArgument cloud_file, full_cloud_file;
   ray::DoubleArgument vox_width(0.1, 100.0);
   ray::IntArgument num_rays(1, 100);
@@ -42,100 +55,97 @@ int main(int argc, char *argv[])
   ray::Cloud decimated_cloud;
   if (!decimated_cloud.load(cloud_file.name()))
     usage();
+  const size_t num_decimated = decimated_cloud.ends.size();
 
-  ray::Cloud full_decimated;       // we need a decimated version of the full cloud, to compare to
-  std::vector<int64_t> subsample;  // single buffer minimises memory allocations
-  std::set<Eigen::Vector3i, ray::Vector3iLess> voxel_set;
-  full_decimated.reserve(decimated_cloud.ends.size());  // good guess at memory required
+  // We match the rays by time, so order the decimated rays by time. Rather than shifting large data, we sort the
+  // indices, and only when the cloud is not already in time order
+  std::vector<size_t> time_order;
+  if (!std::is_sorted(decimated_cloud.times.begin(), decimated_cloud.times.end()))
+    time_order = ray::radixSortOrder(decimated_cloud.times);
+  auto decimated_index = [&time_order](size_t k) { return time_order.empty() ? k : time_order[k]; };
+  auto decimated_time = [&](size_t k) { return decimated_cloud.times[decimated_index(k)]; };
 
-  // decimation functions
-  auto decimate = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
-                      std::vector<double> &times, std::vector<ray::RGBA> &colours) {
+  // Next we decimate the full cloud a chunk at a time, as it was decimated to make decimated_cloud, and look up each
+  // decimated ray by time. We assume that accurate time is a unique identifier per point. This is a join on time
+  // against the ordered decimated rays, so the full cloud need not be in time order, and the decimated full cloud is
+  // never held in memory
+  std::cout << "finding matching points" << std::endl;
+  const double time_eps = 1e-7;  // small enough to account for 200,000 rays per second,
+                                 // but large enough to ignore file format/compression errors
+  std::vector<uint8_t> matched(num_decimated, 0);       // per time ordered decimated ray
+  std::vector<Eigen::Vector3d> matched_ends(num_decimated);  // the matching end point in the full cloud
+  std::vector<bool> sample_matched;  // per decimated ray of the full cloud, for the 'rays' decimation
+  std::vector<Eigen::Vector3i> removed_voxels;
+  size_t num_full_decimated = 0;
+  int num_removed_rays = 0;
+  std::vector<int64_t> subsample;  // single buffer minimises memory allocations
+  ray::VoxelSet voxel_set;
+  auto match_ray = [&](const Eigen::Vector3d &end, double time) {
+    num_full_decimated++;
+    // the first decimated ray that is not too early, by binary search
+    size_t k = 0;
+    for (size_t count = num_decimated; count > 0;)
+    {
+      const size_t half = count / 2;
+      if (decimated_time(k + half) < time - time_eps)
+      {
+        k += half + 1;
+        count -= half + 1;
+      }
+      else
+        count = half;
+    }
+    for (; k < num_decimated && decimated_time(k) <= time + time_eps; k++)
+    {
+      if (!matched[k])
+      {
+        matched[k] = 1;
+        matched_ends[k] = end;
+        return true;
+      }
+    }
+    // rays removed from the full_decimated cloud
+    if (spatial_decimation)
+    {
+      removed_voxels.push_back(Eigen::Vector3i(int(std::floor(end[0] / voxel_width)), int(std::floor(end[1] / voxel_width)),
+                                               int(std::floor(end[2] / voxel_width))));
+    }
+    num_removed_rays++;
+    return false;
+  };
+  auto decimate = [&](std::vector<Eigen::Vector3d> &, std::vector<Eigen::Vector3d> &ends,
+                      std::vector<double> &times, std::vector<ray::RGBA> &) {
     if (spatial_decimation)
     {
       subsample.clear();
       voxelSubsample(ends, voxel_width, subsample, voxel_set);
-      for (auto &id : subsample) full_decimated.addRay(starts[id], ends[id], times[id], colours[id]);
+      for (auto &id : subsample) match_ray(ends[id], times[id]);
     }
     else
     {
       const int num_points = static_cast<int>(ends.size());
-      for (int i = 0, c = 0; i < num_points; i += ray_step, c++)
-        full_decimated.addRay(starts[i], ends[i], times[i], colours[i]);
+      for (int i = 0; i < num_points; i += ray_step) sample_matched.push_back(match_ray(ends[i], times[i]));
     }
   };
   if (!ray::Cloud::read(full_cloud_file.name(), decimate))
     usage();
+  // the voxels are erased only once the decimation has finished, as it would otherwise re-fill them
+  for (auto &voxel : removed_voxels) voxel_set.erase(voxel);
+  std::vector<Eigen::Vector3i>().swap(removed_voxels);
 
-  std::cout << "full cloud decimated size: " << full_decimated.ends.size()
-            << " modified cloud size: " << decimated_cloud.ends.size() << std::endl;
-
-  // Next we need to order the rays by time. Rather than shifting large data, we sort the indices:
-  struct Node
-  {
-    size_t index;
-    double time;
-  };
-  std::vector<Node> decimated_nodes(decimated_cloud.times.size());
-  std::vector<Node> full_decimated_nodes(full_decimated.times.size());
-  for (size_t i = 0; i < decimated_cloud.times.size(); i++)
-  {
-    decimated_nodes[i].index = i;
-    decimated_nodes[i].time = decimated_cloud.times[i];
-  }
-  std::sort(decimated_nodes.begin(), decimated_nodes.end(),
-            [](const Node &n1, const Node &n2) { return n1.time < n2.time; });
-  for (size_t i = 0; i < full_decimated.times.size(); i++)
-  {
-    full_decimated_nodes[i].index = i;
-    full_decimated_nodes[i].time = full_decimated.times[i];
-  }
-  std::sort(full_decimated_nodes.begin(), full_decimated_nodes.end(),
-            [](const Node &n1, const Node &n2) { return n1.time < n2.time; });
-
-  // Now find matching points by time. We assume that accurate time is a unique identifier per point
-  std::cout << "finding matching points" << std::endl;
-  std::vector<Eigen::Vector2i> pairs;  // corresponding ray indices between the two decimated clouds
-  pairs.reserve(std::min(full_decimated.ends.size(), decimated_cloud.ends.size()));
+  // the matched pairs, and the rays added into the decimated_cloud, in time order
+  std::vector<size_t> pairs;  // time ordered indices of the matched decimated rays
+  pairs.reserve(std::min(num_full_decimated, num_decimated));
   std::vector<size_t> added_ray_indices;  // new rays added to the decimated_cloud
-  added_ray_indices.reserve(decimated_cloud.ends.size());
-  int j = 0;
-  const double time_eps = 1e-7;  // small enough to account for 200,000 rays per second,
-                                 // but large enough to ignore file format/compression errors
-  int num_removed_rays = 0;
-  for (size_t i = 0; i < full_decimated_nodes.size(); i++)
+  for (size_t k = 0; k < num_decimated; k++)
   {
-    // rays added into the decimated_cloud
-    while (decimated_nodes[j].time < full_decimated_nodes[i].time - time_eps && j < (int)decimated_nodes.size() - 1)
-    {
-      added_ray_indices.push_back(decimated_nodes[j].index);
-      j++;
-    }
-    // matching points
-    if (std::abs(decimated_nodes[j].time - full_decimated_nodes[i].time) <= time_eps)
-    {
-      pairs.push_back(Eigen::Vector2i(full_decimated_nodes[i].index, decimated_nodes[j].index));
-      j++;
-    }
-    // rays removed from the full_decimated cloud
+    if (matched[k])
+      pairs.push_back(k);
     else
-    {
-      if (spatial_decimation)
-      {
-        Eigen::Vector3d ps = full_decimated.ends[full_decimated_nodes[i].index];
-        Eigen::Vector3i place(int(std::floor(ps[0] / voxel_width)), int(std::floor(ps[1] / voxel_width)),
-                              int(std::floor(ps[2] / voxel_width)));
-        voxel_set.erase(place);
-      }
-      num_removed_rays++;
-    }
-  }
-  // finish adding the additional points
-  while (j < (int)decimated_nodes.size() - 1)
-  {
-    added_ray_indices.push_back(decimated_nodes[j].index);
-    j++;
+      added_ray_indices.push_back(decimated_index(k));
   }
+  std::cout << "full cloud decimated size: " << num_full_decimated << " modified cloud size: " << num_decimated
+            << std::endl;
   std::cout << "number of matched pairs: " << pairs.size() << ", number of removed rays: " << num_removed_rays
             << ", number added: " << added_ray_indices.size() << std::endl;
 
@@ -150,15 +160,14 @@ int main(int argc, char *argv[])
   // only estimate a transform if there are a sufficient number of pairs
   if (pairs.size() >= 6)
   {
-    const int is[3] = { pairs[0][0], pairs[pairs.size() / 3][0], pairs[2 * pairs.size() / 3][0] };
-    const int js[3] = { pairs[0][1], pairs[pairs.size() / 3][1], pairs[2 * pairs.size() / 3][1] };
+    const size_t ks[3] = { pairs[0], pairs[pairs.size() / 3], pairs[2 * pairs.size() / 3] };
     Eigen::Vector3d full_ps[3];  // a triangle in the full_decimated cloud
     Eigen::Vector3d dec_ps[3];   // a triangle in the decimated_cloud
     Eigen::Vector3d mid_full(0, 0, 0), mid_dec(0, 0, 0);
     for (int i = 0; i < 3; i++)
     {
-      full_ps[i] = full_decimated.ends[is[i]];
-      dec_ps[i] = decimated_cloud.ends[js[i]];
+      full_ps[i] = matched_ends[ks[i]];
+      dec_ps[i] = decimated_cloud.ends[decimated_index(ks[i])];
       mid_full += full_ps[i] / 3.0;
       mid_dec += dec_ps[i] / 3.0;
     }
@@ -206,6 +215,7 @@ int main(int argc, char *argv[])
   if (!writer.begin(full_cloud_file.nameStub() + "_restored.ply"))
     usage();
   ray::Cloud chunk;
+  size_t first_sample = 0;  // the index of the chunk's first decimated ray, for the 'rays' decimation
 
   auto transfer = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
                       std::vector<double> &times, std::vector<ray::RGBA> &colours) {
@@ -216,21 +226,22 @@ int main(int argc, char *argv[])
       {
         Eigen::Vector3i place(int(std::floor(ends[i][0] / voxel_width)), int(std::floor(ends[i][1] / voxel_width)),
                               int(std::floor(ends[i][2] / voxel_width)));
-        if (voxel_set.find(place) != voxel_set.end())
+        if (voxel_set.contains(place))
           chunk.addRay(transform * starts[i], transform * ends[i], times[i], colours[i]);
       }
     }
     else
     {
-      int pair_index = 0;
-      int num_points = static_cast<int>(ends.size());
-      for (int i = 0; i < num_points; i++)
+      // each ray is kept if its nearest decimated ray in the chunk was matched
+      const size_t num_points = ends.size();
+      const size_t num_samples = (num_points + ray_step - 1) / ray_step;
+      for (size_t i = 0; i < num_points; i++)
       {
-        int closest_index = (i + ray_step / 2) / ray_step;
-        while (pairs[pair_index][0] < closest_index && pair_index < (int)pairs.size() - 1) pair_index++;
-        if (pairs[pair_index][0] == closest_index)
+        const size_t closest_index = first_sample + std::min((i + ray_step / 2) / ray_step, num_samples - 1);
+        if (closest_index < sample_matched.size() && sample_matched[closest_index])
           chunk.addRay(transform * starts[i], transform * ends[i], times[i], colours[i]);
       }
+      first_sample += num_samples;
     }
     writer.writeChunk(chunk);
   };
@@ -246,3 +257,5 @@ int main(int argc, char *argv[])
 
   return 0;
 }
+
+RAYLIB_TOOL_MAIN(rayrestoreMain)
@@ -4,14 +4,21 @@
 //
 // Author: Thomas Lowe
 #include "raylib/raycloud.h"
+#include "raylib/raycloudwriter.h"
+#include "raylib/raymemory.h"
 #include "raylib/rayparse.h"
 #include "raylib/rayply.h"
+#include "raylib/rayprofile.h"
+#include "raylib/raythreads.h"
+#include "raylib/raytool.h"
 
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
 
+namespace
+{
 void usage(int exit_code = 1)
 {
   // clang-format off
@@ -20,11 +27,16 @@ void usage(int exit_code = 1)
   std::cout << "rayrotate raycloud 30,0,0  - rotation (rx,ry,rz) is a rotation vector in degrees:" << std::endl;
   std::cout << "                             so this example rotates the cloud by 30 degrees in the x axis." << std::endl;
   // clang-format on
-  exit(exit_code);
+  ray::Tool::exit(exit_code);
 }
+}  // namespace
 
-int main(int argc, char *argv[])
+int rayrotateMain(int argc, char *argv[])
 {
+  ray::Threads::initFromArguments(argc, argv);
+  ray::MemoryBudget::initFromArguments(argc, argv);
+  ray::Profile::initFromArguments(argc, argv);
+  ray::CloudWriter::initFromArguments(argc, argv);
   ray::FileArgument cloud_file;
   ray::Vector3dArgument rotation_arg(-360, 360);
   if (!ray::parseCommandLine(argc, argv, { &cloud_file, &rotation_arg }))
@@ -41,9 +53,14 @@ int main(int argc, char *argv[])
     start = rotation * start;
     end = rotation * end;
   };
-  if (!ray::convertCloud(cloud_file.name(), temp_name, rotate))
-    usage();
-
-  std::rename(temp_name.c_str(), cloud_file.name().c_str());
+  // rewrite the cloud in place where its layout allows, otherwise via a temporary file
+  if (!ray::convertCloudInPlace(cloud_file.name(), rotate))
+  {
+    if (!ray::convertCloud(cloud_file.name(), temp_name, rotate))
+      usage();
+    std::rename(temp_name.c_str(), cloud_file.name().c_str());
+  }
   return 0;
 }
+
+RAYLIB_TOOL_MAIN(rayrotateMain)
@@ -0,0 +1,146 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raylib/raycloudserver.h"
+#include "raylib/raycloudwriter.h"
+#include "raylib/raymemory.h"
+#include "raylib/rayparse.h"
+#include "raylib/rayprofile.h"
+#include "raylib/raythreads.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+void usage(int exit_code = 1)
+{
+  // clang-format off
+  std::cout << "Keep a ray cloud resident in memory, answering queries on a local socket without reloading the file" << std::endl;
+  std::cout << "usage:" << std::endl;
+  std::cout << "rayserve raycloud.ply                   - serve on the socket raycloud.sock" << std::endl;
+  std::cout << "                      --socket name     - serve on the given socket file name" << std::endl;
+  std::cout << "Each request is a line of text, answered by a line starting with ok or error, e.g. with socat - UNIX-CONNECT:raycloud.sock" << std::endl;
+  std::cout << "  info                                       - ray counts, bounds and time range" << std::endl;
+  std::cout << "  count minx,miny,minz maxx,maxy,maxz        - the number of rays ending in the box" << std::endl;
+  std::cout << "  crop minx,miny,minz maxx,maxy,maxz out.ply - write the rays ending in the box" << std::endl;
+  std::cout << "  tube x1,y1,z1 x2,y2,z2 radius out.ply      - write the rays ending in the cylinder, as raysplit tube" << std::endl;
+  std::cout << "  render top ends 0.1 out.png                - render as rayrender, with a pixel width, then optionally" << std::endl;
+  std::cout << "         minx,miny,minz maxx,maxy,maxz       - a box to render the rays of" << std::endl;
+  std::cout << "  quit                                       - close this connection" << std::endl;
+  std::cout << "  shutdown                                   - stop the server" << std::endl;
+  std::cout << "Connections are answered concurrently, each on its own thread." << std::endl;
+  // clang-format on
+  exit(exit_code);
+}
+
+namespace
+{
+std::atomic<bool> stopping(false);
+/// the estimated memory per ray of serving, beyond the cloud: the neighbour index and the served fields
+const size_t kServeBytesPerRay = 100;
+
+/// answer the requests of one connection, until it closes or quits. The connection is closed by the caller
+void serveConnection(int connection, int listener, const ray::CloudServer &server)
+{
+  std::string pending;
+  char buffer[4096];
+  bool open = true;
+  while (open)
+  {
+    const ssize_t num_read = read(connection, buffer, sizeof(buffer));
+    if (num_read <= 0)
+      break;
+    pending.append(buffer, static_cast<size_t>(num_read));
+    size_t line_end;
+    while (open && (line_end = pending.find('\n')) != std::string::npos)
+    {
+      std::string request = pending.substr(0, line_end);
+      pending.erase(0, line_end + 1);
+      if (!request.empty() && request.back() == '\r')
+        request.pop_back();
+      if (request == "quit" || request == "shutdown")
+      {
+        open = false;
+        if (request == "shutdown")
+        {
+          stopping = true;
+          shutdown(listener, SHUT_RDWR);  // wakes the accept loop
+        }
+        continue;
+      }
+      const std::string response = server.respond(request) + "\n";
+      if (write(connection, response.data(), response.size()) != static_cast<ssize_t>(response.size()))
+        open = false;
+    }
+  }
+}
+}  // namespace
+
+// Serves queries on a resident ray cloud
+int main(int argc, char *argv[])
+{
+  ray::Threads::initFromArguments(argc, argv);
+  ray::MemoryBudget::initFromArguments(argc, argv);
+  ray::Profile::initFromArguments(argc, argv);
+  ray::CloudWriter::initFromArguments(argc, argv);
+  ray::FileArgument cloud_file, socket_file(false);
+  ray::OptionalKeyValueArgument socket_option("socket", 's', &socket_file);
+  if (!ray::parseCommandLine(argc, argv, { &cloud_file }, { &socket_option }))
+    usage();
+  const std::string socket_name = socket_option.isSet() ? socket_file.name() : cloud_file.nameStub() + ".sock";
+
+  if (!ray::MemoryBudget::checkCloud(cloud_file.name(), kServeBytesPerRay, "rayserve"))
+    return 1;
+  ray::CloudServer server;
+  if (!server.load(cloud_file.name()))
+    usage();
+
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socket_name.size() >= sizeof(address.sun_path))
+  {
+    std::cerr << "Error: socket name " << socket_name << " is too long" << std::endl;
+    return 1;
+  }
+  std::strncpy(address.sun_path, socket_name.c_str(), sizeof(address.sun_path) - 1);
+  const int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(socket_name.c_str());  // a socket file left by a previous server
+  if (listener < 0 || bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+      listen(listener, 16) != 0)
+  {
+    std::cerr << "Error: cannot listen on socket " << socket_name << std::endl;
+    return 1;
+  }
+  std::cout << "serving " << cloud_file.name() << " (" << server.cloud().rayCount() << " rays) on " << socket_name
+            << std::endl;
+
+  std::vector<std::thread> threads;
+  std::vector<int> connections;
+  while (!stopping)
+  {
+    const int connection = accept(listener, nullptr, nullptr);
+    if (connection < 0)
+      break;
+    connections.push_back(connection);
+    threads.emplace_back(serveConnection, connection, listener, std::cref(server));
+  }
+  // any connections still open are ended, so that their threads finish. They are closed only once joined, so that a
+  // connection's descriptor is not reused while its thread may be reading it
+  for (auto &connection : connections) shutdown(connection, SHUT_RDWR);
+  for (auto &thread : threads) thread.join();
+  for (auto &connection : connections) close(connection);
+  close(listener);
+  unlink(socket_name.c_str());
+  return 0;
+}
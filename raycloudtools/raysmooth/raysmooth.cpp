@@ -1,71 +1,76 @@
-// Copyright (c) 2020
-// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
-// ABN 41 687 119 230
-//
-// Author: Thomas Lowe
-#include "raylib/raycloud.h"
-#include "raylib/rayparse.h"
-
-#include <nabo/nabo.h>
-
-#include <cstdio>
-#include <cstdlib>
-#include <cstring>
-#include <iostream>
-
-void usage(int exit_code = 1)
-{
-  // clang-format off
-  std::cout << "Smooth a ray cloud. Nearby off-surface points are moved onto the nearest surface." << std::endl;
-  std::cout << "usage:" << std::endl;
-  std::cout << "raysmooth raycloud" << std::endl;
-  // clang-format on
-  exit(exit_code);
-}
-
-int main(int argc, char *argv[])
-{
-  ray::FileArgument cloud_file;
-  if (!ray::parseCommandLine(argc, argv, { &cloud_file }))
-    usage();
-
-  ray::Cloud cloud;
-  if (!cloud.load(cloud_file.name()))
-    usage();
-
-  // Method:
-  // 1. generate normals and neighbour indices
-  // 2. pull point along normal direction so as to match neighbours, weighted by normal similarity
-
-  const int num_neighbours = 16;
-  std::vector<Eigen::Vector3d> normals;
-  Eigen::MatrixXi neighbour_indices;
-  cloud.getSurfels(num_neighbours, nullptr, &normals, nullptr, nullptr, &neighbour_indices);
-
-  std::vector<Eigen::Vector3d> centroids(cloud.ends.size());
-  for (size_t i = 0; i < cloud.ends.size(); i++)
-  {
-    if (!cloud.rayBounded(i))
-      continue;
-    double total_weight = 0.2;  // more averaging if it uses less of the central position, but 0 risks a divide by 0
-    Eigen::Vector3d weighted_sum = cloud.ends[i] * total_weight;
-    for (int j = 0; j < num_neighbours && neighbour_indices(j, i) != Nabo::NNSearchD::InvalidIndex; j++)
-    {
-      int k = neighbour_indices(j, i);
-      double weight = std::max(0.0, 1.0 - (normals[k] - normals[i]).squaredNorm());
-      weighted_sum += cloud.ends[k] * weight;
-      total_weight += weight;
-    }
-    centroids[i] = weighted_sum / total_weight;
-  }
-  for (size_t i = 0; i < cloud.ends.size(); i++)
-  {
-    if (!cloud.rayBounded(i))
-      continue;
-    cloud.ends[i] += normals[i] * (centroids[i] - cloud.ends[i]).dot(normals[i]);
-  }
-
-  cloud.save(cloud_file.nameStub() + "_smooth.ply");
-
-  return 0;
-}
+// Copyright (c) 2020
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raylib/raycloud.h"
+#include "raylib/raycloudwriter.h"
+#include "raylib/raymemory.h"
+#include "raylib/raynodes.h"
+#include "raylib/rayparse.h"
+#include "raylib/rayprofile.h"
+#include "raylib/raysmooth.h"
+#include "raylib/raythreads.h"
+#include "raylib/raytool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+/// the estimated memory per ray of smoothing in memory, beyond the cloud: the neighbour index, normals and neighbours
+const size_t kSmoothBytesPerRay = 200;
+
+void usage(int exit_code = 1)
+{
+  // clang-format off
+  std::cout << "Smooth a ray cloud. Nearby off-surface points are moved onto the nearest surface." << std::endl;
+  std::cout << "usage:" << std::endl;
+  std::cout << "raysmooth raycloud" << std::endl;
+  std::cout << "                   --iterations 3 - smooth repeatedly, reusing the normals and neighbours of the first" << std::endl;
+  std::cout << "                   --tiled        - smooth in spatial tiles, in parallel, without loading the whole cloud" << std::endl;
+  std::cout << "                                    This is automatic when the cloud won't fit in --max_memory" << std::endl;
+  // clang-format on
+  ray::Tool::exit(exit_code);
+}
+}  // namespace
+
+int raysmoothMain(int argc, char *argv[])
+{
+  ray::Threads::initFromArguments(argc, argv);
+  ray::MemoryBudget::initFromArguments(argc, argv);
+  ray::Profile::initFromArguments(argc, argv);
+  ray::CloudWriter::initFromArguments(argc, argv);
+  ray::Nodes::initFromArguments(argc, argv);
+  ray::FileArgument cloud_file;
+  ray::IntArgument iterations(1, 100);
+  ray::OptionalKeyValueArgument iterations_option("iterations", 'i', &iterations);
+  ray::OptionalFlagArgument tiled("tiled", 't');
+  if (!ray::parseCommandLine(argc, argv, { &cloud_file }, { &iterations_option, &tiled }))
+    usage();
+  const int num_iterations = iterations_option.isSet() ? iterations.value() : 1;
+  const std::string out_name = cloud_file.nameStub() + "_smooth.ply";
+
+  const bool fits = tiled.isSet() || ray::MemoryBudget::fitsCloud(cloud_file.name(), kSmoothBytesPerRay);
+  if (!fits)
+    std::cout << "the cloud does not fit in the memory budget of "
+              << ray::MemoryBudget::formatBytes(ray::MemoryBudget::limit()) << ", so it is smoothed in tiles" << std::endl;
+  if (tiled.isSet() || !fits)
+  {
+    if (!ray::smoothInTiles(cloud_file.name(), out_name, num_iterations))
+      usage();
+    return 0;
+  }
+
+  ray::Cloud cloud;
+  if (!cloud.load(cloud_file.name()))
+    usage();
+  ray::smoothCloud(cloud, num_iterations);
+  cloud.save(out_name);
+
+  return 0;
+}
+
+RAYLIB_TOOL_MAIN(raysmoothMain)
@@ -1,214 +1,339 @@
-// Copyright (c) 2020
-// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
-// ABN 41 687 119 230
-//
-// Author: Thomas Lowe
-#include "raylib/raycloud.h"
-#include "raylib/raymesh.h"
-#include "raylib/rayparse.h"
-#include "raylib/rayply.h"
-#include "raylib/raysplitter.h"
-
-#include <cstdio>
-#include <cstdlib>
-#include <cstring>
-#include <iostream>
-#include <limits>
-
-void usage(int exit_code = 1)
-{
-  // clang-format off
-  std::cout << "Split a ray cloud relative to the supplied triangle mesh, generating two cropped ray clouds" << std::endl;
-  std::cout << "usage:" << std::endl;
-  std::cout << "raysplit raycloud plane 10,0,0           - splits around plane at 10 m along x axis" << std::endl;
-  std::cout << "                  colour                 - splits by colour, one cloud per colour" << std::endl;
-  std::cout << "                  colour 0.5,0,0         - splits by colour, around half red component" << std::endl;
-  std::cout << "                  single_colour 255,0,0  - splits out a single colour, in 0-255 units" << std::endl;
-  std::cout << "                  alpha 0.0              - splits out unbounded rays, which have zero intensity" << std::endl;
-  std::cout << "                  meshfile distance 0.2  - splits raycloud at 0.2m from the meshfile surface" << std::endl;
-  std::cout << "                  raydir 0,0,0.8         - splits based on ray direction, here around nearly vertical rays" << std::endl;
-  std::cout << "                  range 10               - splits out rays more than 10 m long" << std::endl;
-  std::cout << "                  time 1000 (or time 3 %)- splits at given time stamp (or percentage along)" << std::endl;
-  std::cout << "                  box rx,ry,rz           - splits around a centred axis-aligned box of the given radii" << std::endl;
-  std::cout << "                  grid wx,wy,wz          - splits into a 0,0,0 centred grid of files, cell width wx,wy,wz. 0 for unused axes." << std::endl;
-  std::cout << "                  grid wx,wy,wz 1        - same as above, but with a 1 metre overlap between cells." << std::endl;
-  std::cout << "                  grid wx,wy,wz,wt       - splits into a grid of files, cell width wx,wy,wz and period wt. 0 for unused axes." << std::endl;
-  std::cout << "                  trees cloud_forest.txt - splits trees into one file each, allowing a buffer around each tree" << std::endl;
-  std::cout << "                  tube 1,2,3 10,11,12 5  - splits within a tube (cylinder) using start, end and radius" << std::endl;
-  // clang-format on
-  exit(exit_code);
-}
-
-// Decimates the ray cloud, spatially or in time
-int main(int argc, char *argv[])
-{
-  ray::FileArgument cloud_file;
-  double max_val = std::numeric_limits<double>::max();
-  ray::Vector3dArgument plane, colour(0.0, 1.0), single_colour(0.0, 255.0), raydir(-1.0, 1.0),
-    box_radius(0.0001, max_val), cell_width(0.0, max_val), tube_start, tube_end;
-  ray::Vector4dArgument cell_width2(0.0, max_val);
-  ray::DoubleArgument overlap(0.0, 10000.0);
-  ray::DoubleArgument time, alpha(0.0, 1.0), range(0.0, 1000.0), tube_radius(0.001, 1000.0);
-  ray::KeyValueChoice choice({ "plane", "time", "colour", "single_colour", "alpha", "raydir", "range" },
-                             { &plane, &time, &colour, &single_colour, &alpha, &raydir, &range });
-  ray::FileArgument mesh_file, tree_file;
-  ray::TextArgument distance_text("distance"), time_text("time"), tree_text("trees"), percent_text("%");
-  ray::TextArgument box_text("box"), grid_text("grid"), colour_text("colour"), tube_text("tube");
-  ray::DoubleArgument mesh_offset;
-  bool standard_format = ray::parseCommandLine(argc, argv, { &cloud_file, &choice });
-  bool colour_format = ray::parseCommandLine(argc, argv, { &cloud_file, &colour_text });
-  bool time_percent = ray::parseCommandLine(argc, argv, { &cloud_file, &time_text, &time, &percent_text });
-  bool box_format = ray::parseCommandLine(argc, argv, { &cloud_file, &box_text, &box_radius });
-  bool grid_format = ray::parseCommandLine(argc, argv, { &cloud_file, &grid_text, &cell_width });
-  bool grid_format2 = ray::parseCommandLine(argc, argv, { &cloud_file, &grid_text, &cell_width2 });
-  bool grid_format3 = ray::parseCommandLine(argc, argv, { &cloud_file, &grid_text, &cell_width, &overlap });
-  bool mesh_split = ray::parseCommandLine(argc, argv, { &cloud_file, &mesh_file, &distance_text, &mesh_offset });
-  bool tube_split =
-    ray::parseCommandLine(argc, argv, { &cloud_file, &tube_text, &tube_start, &tube_end, &tube_radius });
-  if (!standard_format && !colour_format && !box_format && !grid_format && !grid_format2 && !grid_format3 &&
-      !mesh_split && !time_percent && !tube_split)
-  {
-    usage();
-  }
-
-  const std::string in_name = cloud_file.nameStub() + "_inside.ply";
-  const std::string out_name = cloud_file.nameStub() + "_outside.ply";
-  const std::string rc_name = cloud_file.name();  // ray cloud name
-  bool res = true;
-
-  // split the cloud around a tube (capsule) shape
-  if (tube_split)
-  {
-    Eigen::Vector3d start = tube_start.value();
-    Eigen::Vector3d end = tube_end.value();
-    Eigen::Vector3d dir = end - start;
-    dir /= dir.dot(dir);
-    double radius = tube_radius.value();
-
-    res = ray::split(rc_name, in_name, out_name, [&](const ray::Cloud &cloud, int i) -> bool {
-      double d = (cloud.ends[i] - start).dot(dir);
-      if (d < 0.0 || d > 1.0)
-        return true;
-      Eigen::Vector3d pos = cloud.ends[i] + (start - end) * d;
-      if ((pos - start).squaredNorm() > radius * radius)
-        return true;
-      return false;
-    });
-  }
-  else if (colour_format)
-  {
-    res = ray::splitColour(cloud_file.name(), cloud_file.nameStub());
-  }
-  else if (mesh_split)  // I can't chunk load this one, so it will need to fit in RAM
-  {
-    ray::Cloud cloud;  // used as a buffer when chunk loading
-    if (!cloud.load(rc_name))
-    {
-      usage();
-    }
-    ray::Mesh mesh;
-    ray::readPlyMesh(mesh_file.name(), mesh);
-    ray::Cloud inside, outside;
-    mesh.splitCloud(cloud, mesh_offset.value(), inside, outside);
-    inside.save(in_name);
-    outside.save(out_name);
-  }
-  else if (time_percent)
-  {
-    // chunk load the file just to get the time bounds
-    double min_time = std::numeric_limits<double>::max();
-    double max_time = std::numeric_limits<double>::lowest();
-    auto time_bounds = [&](std::vector<Eigen::Vector3d> &, std::vector<Eigen::Vector3d> &, std::vector<double> &times,
-                           std::vector<ray::RGBA> &) {
-      for (auto &time : times)
-      {
-        min_time = std::min(min_time, time);
-        max_time = std::max(max_time, time);
-      }
-    };
-    if (!ray::Cloud::read(cloud_file.name(), time_bounds))
-      usage();
-    std::cout << "Splitting cloud at " << (max_time - min_time) * time.value() / 100.0 << " seconds into the "
-              << max_time - min_time << " time period of this ray cloud." << std::endl;
-
-    // now split based on this
-    const double time_thresh = min_time + (max_time - min_time) * time.value() / 100.0;
-    res = ray::split(rc_name, in_name, out_name,
-                     [&](const ray::Cloud &cloud, int i) -> bool { return cloud.times[i] > time_thresh; });
-  }
-  else if (box_format)
-  {
-    // Can't use cloud::split as sets are not mutually exclusive here.
-    // we need to include rays that pass through the box. The intensity of these rays needs to be set to 0
-    // so that they are treated as unbounded.
-    res = ray::splitBox(rc_name, in_name, out_name, Eigen::Vector3d(0, 0, 0), box_radius.value());
-  }
-  else if (grid_format)  // standard 3D grid of cuboids
-  {
-    res = ray::splitGrid(rc_name, cloud_file.nameStub(), cell_width.value());
-  }
-  else if (grid_format2)  // this is a 3+1D grid (space and time)
-  {
-    res = ray::splitGrid(rc_name, cloud_file.nameStub(), cell_width2.value());
-  }
-  else if (grid_format3)  // this is a 3D grid with a specified overlap
-  {
-    res = ray::splitGrid(rc_name, cloud_file.nameStub(), cell_width.value(), overlap.value());
-  }
-  else
-  {
-    const std::string &parameter = choice.selectedKey();
-    if (parameter == "time")
-    {
-      res = ray::split(rc_name, in_name, out_name,
-                       [&](const ray::Cloud &cloud, int i) -> bool { return cloud.times[i] > time.value(); });
-    }
-    else if (parameter == "alpha")
-    {
-      uint8_t c = uint8_t(255.0 * alpha.value());
-      res = ray::split(rc_name, in_name, out_name,
-                       [&](const ray::Cloud &cloud, int i) -> bool { return cloud.colours[i].alpha > c; });
-    }
-    else if (parameter == "plane")
-    {
-      ray::splitPlane(rc_name, in_name, out_name, plane.value());
-    }
-    else if (parameter == "raydir")
-    {
-      Eigen::Vector3d vec = raydir.value() / raydir.value().squaredNorm();
-      res = ray::split(rc_name, in_name, out_name, [&](const ray::Cloud &cloud, int i) -> bool {
-        Eigen::Vector3d ray_dir = (cloud.ends[i] - cloud.starts[i]).normalized();
-        return ray_dir.dot(vec) > 1.0;
-      });
-    }
-    else if (parameter == "colour")
-    {
-      Eigen::Vector3d vec = colour.value() / colour.value().squaredNorm();
-      res = ray::split(rc_name, in_name, out_name, [&](const ray::Cloud &cloud, int i) -> bool {
-        Eigen::Vector3d col((double)cloud.colours[i].red / 255.0, (double)cloud.colours[i].green / 255.0,
-                            (double)cloud.colours[i].blue / 255.0);
-        return col.dot(vec) > 1.0;
-      });
-    }
-    else if (parameter == "single_colour")  // split out a single colour
-    {
-      ray::RGBA col;
-      col.red = (uint8_t)single_colour.value()[0];
-      col.green = (uint8_t)single_colour.value()[1];
-      col.blue = (uint8_t)single_colour.value()[2];
-      res = ray::split(rc_name, in_name, out_name, [&](const ray::Cloud &cloud, int i) -> bool {
-        return !(cloud.colours[i].red == col.red && cloud.colours[i].green == col.green &&
-                 cloud.colours[i].blue == col.blue);
-      });
-    }
-    else if (parameter == "range")
-    {
-      res = ray::split(rc_name, in_name, out_name, [&](const ray::Cloud &cloud, int i) -> bool {
-        return (cloud.starts[i] - cloud.ends[i]).norm() > range.value();
-      });
-    }
-  }
-  if (!res)
-    usage();
-  return 0;
-}
+// Copyright (c) 2020
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raylib/raycloud.h"
+#include "raylib/raycloudwriter.h"
+#include "raylib/rayforeststructure.h"
+#include "raylib/raymemory.h"
+#include "raylib/raymesh.h"
+#include "raylib/rayparse.h"
+#include "raylib/rayply.h"
+#include "raylib/rayprofile.h"
+#include "raylib/raysplitter.h"
+#include "raylib/raythreads.h"
+#include "raylib/raytilecache.h"
+#include "raylib/raytool.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <sstream>
+
+namespace
+{
+void usage(int exit_code = 1)
+{
+  // clang-format off
+  std::cout << "Split a ray cloud relative to the supplied triangle mesh, generating two cropped ray clouds" << std::endl;
+  std::cout << "usage:" << std::endl;
+  std::cout << "raysplit raycloud plane 10,0,0           - splits around plane at 10 m along x axis" << std::endl;
+  std::cout << "                  colour                 - splits by colour, one cloud per colour" << std::endl;
+  std::cout << "                  colour 0.5,0,0         - splits by colour, around half red component" << std::endl;
+  std::cout << "                  single_colour 255,0,0  - splits out a single colour, in 0-255 units" << std::endl;
+  std::cout << "                  alpha 0.0              - splits out unbounded rays, which have zero intensity" << std::endl;
+  std::cout << "                  meshfile distance 0.2  - splits raycloud at 0.2m from the meshfile surface" << std::endl;
+  std::cout << "                  raydir 0,0,0.8         - splits based on ray direction, here around nearly vertical rays" << std::endl;
+  std::cout << "                  range 10               - splits out rays more than 10 m long" << std::endl;
+  std::cout << "                  time 1000 (or time 3 %)- splits at given time stamp (or percentage along)" << std::endl;
+  std::cout << "                  box rx,ry,rz           - splits around a centred axis-aligned box of the given radii" << std::endl;
+  std::cout << "                  grid wx,wy,wz          - splits into a 0,0,0 centred grid of files, cell width wx,wy,wz. 0 for unused axes." << std::endl;
+  std::cout << "                  grid wx,wy,wz 1        - same as above, but with a 1 metre overlap between cells." << std::endl;
+  std::cout << "                  grid wx,wy,wz,wt       - splits into a grid of files, cell width wx,wy,wz and period wt. 0 for unused axes." << std::endl;
+  std::cout << "                  grid ... --tile_cache  - keeps a hash of each cell in raycloud_grid.tilecache, and leaves the files of the" << std::endl;
+  std::cout << "                                           cells that have not changed since the last split as they are." << std::endl;
+  std::cout << "                  trees cloud_forest.txt - splits trees into one file each, allowing a buffer around each tree" << std::endl;
+  std::cout << "                  trees cloud_forest.txt 2 - as above, with a 2 m buffer rather than 1 m" << std::endl;
+  std::cout << "                  tube 1,2,3 10,11,12 5  - splits within a tube (cylinder) using start, end and radius" << std::endl;
+  std::cout << "                  tubes tubes.txt        - crops within each tube of the file, one per line as 1,2,3 10,11,12 5" << std::endl;
+  std::cout << "                  The trees and tubes are cropped in one pass of the file, to raycloud_tree_0.ply etc." << std::endl;
+  std::cout << "raysplit raycloud multi plane 10,0,0 range 10 box 1,1,1 - performs several splits in one pass of the file." << std::endl;
+  std::cout << "                  Each is one of plane, time, colour, single_colour, alpha, raydir, range or box above, with the" << std::endl;
+  std::cout << "                  files named after it, e.g. raycloud_range_inside.ply. Repeats are numbered, as in raycloud_range2_inside.ply" << std::endl;
+  // clang-format on
+  ray::Tool::exit(exit_code);
+}
+}  // namespace
+
+// Decimates the ray cloud, spatially or in time
+int raysplitMain(int argc, char *argv[])
+{
+  ray::Threads::initFromArguments(argc, argv);
+  ray::MemoryBudget::initFromArguments(argc, argv);
+  ray::Profile::initFromArguments(argc, argv);
+  ray::CloudWriter::initFromArguments(argc, argv);
+  ray::TileCache::initFromArguments(argc, argv);
+  ray::FileArgument cloud_file;
+  double max_val = std::numeric_limits<double>::max();
+  ray::Vector3dArgument plane, colour(0.0, 1.0), single_colour(0.0, 255.0), raydir(-1.0, 1.0),
+    box_radius(0.0001, max_val), cell_width(0.0, max_val), tube_start, tube_end;
+  ray::Vector4dArgument cell_width2(0.0, max_val);
+  ray::DoubleArgument overlap(0.0, 10000.0);
+  ray::DoubleArgument time, alpha(0.0, 1.0), range(0.0, 1000.0), tube_radius(0.001, 1000.0);
+  ray::KeyValueChoice choice({ "plane", "time", "colour", "single_colour", "alpha", "raydir", "range" },
+                             { &plane, &time, &colour, &single_colour, &alpha, &raydir, &range });
+  ray::FileArgument mesh_file, tree_file, tubes_file;
+  ray::TextArgument distance_text("distance"), time_text("time"), tree_text("trees"), percent_text("%");
+  ray::TextArgument box_text("box"), grid_text("grid"), colour_text("colour"), tube_text("tube"), tubes_text("tubes");
+  ray::DoubleArgument mesh_offset, tree_buffer(0.0, 100.0);
+  bool standard_format = ray::parseCommandLine(argc, argv, { &cloud_file, &choice });
+  bool colour_format = ray::parseCommandLine(argc, argv, { &cloud_file, &colour_text });
+  bool time_percent = ray::parseCommandLine(argc, argv, { &cloud_file, &time_text, &time, &percent_text });
+  bool box_format = ray::parseCommandLine(argc, argv, { &cloud_file, &box_text, &box_radius });
+  bool grid_format = ray::parseCommandLine(argc, argv, { &cloud_file, &grid_text, &cell_width });
+  bool grid_format2 = ray::parseCommandLine(argc, argv, { &cloud_file, &grid_text, &cell_width2 });
+  bool grid_format3 = ray::parseCommandLine(argc, argv, { &cloud_file, &grid_text, &cell_width, &overlap });
+  bool mesh_split = ray::parseCommandLine(argc, argv, { &cloud_file, &mesh_file, &distance_text, &mesh_offset });
+  bool tube_split =
+    ray::parseCommandLine(argc, argv, { &cloud_file, &tube_text, &tube_start, &tube_end, &tube_radius });
+  bool tree_split = ray::parseCommandLine(argc, argv, { &cloud_file, &tree_text, &tree_file });
+  bool tree_buffered = ray::parseCommandLine(argc, argv, { &cloud_file, &tree_text, &tree_file, &tree_buffer });
+  bool tubes_split = ray::parseCommandLine(argc, argv, { &cloud_file, &tubes_text, &tubes_file });
+  // several splits at once. Each is a key and its value, parsed as for the single split formats
+  ray::TextArgument multi_text("multi");
+  std::vector<std::pair<int, int>> multi_splits;  // the argument index of each split, and the format it matches
+  bool multi_format = argc >= 5 && (argc - 3) % 2 == 0;
+  for (int i = 3; i + 1 < argc && multi_format; i += 2)
+  {
+    char *split_argv[4] = { argv[0], argv[1], argv[i], argv[i + 1] };
+    const bool keyed = ray::parseCommandLine(4, split_argv, { &cloud_file, &choice }, {}, false);
+    const bool box = !keyed && ray::parseCommandLine(4, split_argv, { &cloud_file, &box_text, &box_radius }, {}, false);
+    multi_format = keyed || box;
+    multi_splits.push_back(std::make_pair(i, keyed ? 0 : 1));
+  }
+  char *multi_argv[3] = { argv[0], argv[1], argc > 2 ? argv[2] : nullptr };
+  multi_format = multi_format && ray::parseCommandLine(3, multi_argv, { &cloud_file, &multi_text });
+  if (!standard_format && !colour_format && !box_format && !grid_format && !grid_format2 && !grid_format3 &&
+      !mesh_split && !time_percent && !tube_split && !tree_split && !tree_buffered && !tubes_split && !multi_format)
+  {
+    usage();
+  }
+
+  const std::string in_name = cloud_file.nameStub() + "_inside.ply";
+  const std::string out_name = cloud_file.nameStub() + "_outside.ply";
+  const std::string rc_name = cloud_file.name();  // ray cloud name
+  const std::string grid_cache = ray::TileCache::enabled() ? cloud_file.nameStub() + "_grid.tilecache" : "";
+  bool res = true;
+
+  // add the split chosen by the parsed key-value argument to a plan. The values are copied, so that the arguments can
+  // be parsed again for the next split
+  auto add_keyed_split = [&](ray::SplitPlan &plan, const std::string &in_file, const std::string &out_file) {
+    const std::string &parameter = choice.selectedKey();
+    if (parameter == "time")
+    {
+      const double split_time = time.value();
+      plan.addPredicate(in_file, out_file,
+                        [split_time](const ray::Cloud &cloud, int i) -> bool { return cloud.times[i] > split_time; });
+    }
+    else if (parameter == "alpha")
+    {
+      uint8_t c = uint8_t(255.0 * alpha.value());
+      plan.addPredicate(in_file, out_file,
+                        [c](const ray::Cloud &cloud, int i) -> bool { return cloud.colours[i].alpha > c; });
+    }
+    else if (parameter == "plane")
+    {
+      plan.addPlane(in_file, out_file, plane.value());
+    }
+    else if (parameter == "raydir")
+    {
+      Eigen::Vector3d vec = raydir.value() / raydir.value().squaredNorm();
+      plan.addPredicate(in_file, out_file, [vec](const ray::Cloud &cloud, int i) -> bool {
+        Eigen::Vector3d ray_dir = (cloud.ends[i] - cloud.starts[i]).normalized();
+        return ray_dir.dot(vec) > 1.0;
+      });
+    }
+    else if (parameter == "colour")
+    {
+      Eigen::Vector3d vec = colour.value() / colour.value().squaredNorm();
+      plan.addPredicate(in_file, out_file, [vec](const ray::Cloud &cloud, int i) -> bool {
+        Eigen::Vector3d col((double)cloud.colours[i].red / 255.0, (double)cloud.colours[i].green / 255.0,
+                            (double)cloud.colours[i].blue / 255.0);
+        return col.dot(vec) > 1.0;
+      });
+    }
+    else if (parameter == "single_colour")  // split out a single colour
+    {
+      ray::RGBA col;
+      col.red = (uint8_t)single_colour.value()[0];
+      col.green = (uint8_t)single_colour.value()[1];
+      col.blue = (uint8_t)single_colour.value()[2];
+      col.alpha = 255;
+      plan.addPredicate(in_file, out_file, [col](const ray::Cloud &cloud, int i) -> bool {
+        return !(cloud.colours[i].red == col.red && cloud.colours[i].green == col.green &&
+                 cloud.colours[i].blue == col.blue);
+      });
+    }
+    else if (parameter == "range")
+    {
+      const double max_range = range.value();
+      plan.addPredicate(in_file, out_file, [max_range](const ray::Cloud &cloud, int i) -> bool {
+        return (cloud.starts[i] - cloud.ends[i]).norm() > max_range;
+      });
+    }
+  };
+
+  // split the cloud around a tube (capsule) shape
+  if (tube_split)
+  {
+    Eigen::Vector3d start = tube_start.value();
+    Eigen::Vector3d end = tube_end.value();
+    Eigen::Vector3d dir = end - start;
+    dir /= dir.dot(dir);
+    double radius = tube_radius.value();
+
+    res = ray::split(rc_name, in_name, out_name, [&](const ray::Cloud &cloud, int i) -> bool {
+      double d = (cloud.ends[i] - start).dot(dir);
+      if (d < 0.0 || d > 1.0)
+        return true;
+      Eigen::Vector3d pos = cloud.ends[i] + (start - end) * d;
+      if ((pos - start).squaredNorm() > radius * radius)
+        return true;
+      return false;
+    });
+  }
+  else if (tree_split || tree_buffered)
+  {
+    // each tree is cropped to the bounds of its branch segments, plus the buffer
+    ray::ForestStructure forest;
+    if (!forest.load(tree_file.name()))
+    {
+      usage();
+    }
+    const double buffer = tree_buffered ? tree_buffer.value() : 1.0;
+    std::vector<ray::SplitRegion> regions;
+    for (size_t t = 0; t < forest.trees.size(); t++)
+    {
+      Eigen::Vector3d min_bound(max_val, max_val, max_val), max_bound(-max_val, -max_val, -max_val);
+      for (const auto &segment : forest.trees[t].segments())
+      {
+        const Eigen::Vector3d extent(segment.radius, segment.radius, segment.radius);
+        min_bound = min_bound.cwiseMin(segment.tip - extent);
+        max_bound = max_bound.cwiseMax(segment.tip + extent);
+      }
+      const Eigen::Vector3d extent(buffer, buffer, buffer);
+      regions.push_back(ray::SplitRegion::box(cloud_file.nameStub() + "_tree_" + std::to_string(t) + ".ply",
+                                              ray::Cuboid(min_bound - extent, max_bound + extent)));
+    }
+    std::cout << "cropping " << regions.size() << " trees in one pass" << std::endl;
+    res = ray::splitRegions(rc_name, regions);
+  }
+  else if (tubes_split)
+  {
+    // one tube per line, as the arguments of the tube split, ignoring blank lines and # comments
+    std::ifstream ifs(tubes_file.name());
+    if (!ifs.is_open())
+    {
+      std::cerr << "Error: cannot open " << tubes_file.name() << std::endl;
+      usage();
+    }
+    std::vector<ray::SplitRegion> regions;
+    std::string line;
+    while (std::getline(ifs, line))
+    {
+      if (line.empty() || line[0] == '#' || line.find_first_not_of(" \t\r") == std::string::npos)
+        continue;
+      std::replace(line.begin(), line.end(), ',', ' ');
+      std::istringstream values(line);
+      Eigen::Vector3d start, end;
+      double radius;
+      if (!(values >> start[0] >> start[1] >> start[2] >> end[0] >> end[1] >> end[2] >> radius) || radius <= 0.0)
+      {
+        std::cerr << "Error: bad tube line in " << tubes_file.name() << ": " << line << std::endl;
+        usage();
+      }
+      regions.push_back(ray::SplitRegion::tube(
+        cloud_file.nameStub() + "_tube_" + std::to_string(regions.size()) + ".ply", start, end, radius));
+    }
+    std::cout << "cropping " << regions.size() << " tubes in one pass" << std::endl;
+    res = ray::splitRegions(rc_name, regions);
+  }
+  else if (colour_format)
+  {
+    res = ray::splitColour(cloud_file.name(), cloud_file.nameStub());
+  }
+  else if (mesh_split)
+  {
+    ray::Mesh mesh;
+    if (!ray::readPlyMesh(mesh_file.name(), mesh))
+    {
+      usage();
+    }
+    res = ray::splitMesh(rc_name, in_name, out_name, mesh, mesh_offset.value());
+  }
+  else if (time_percent)
+  {
+    // the time bounds come from the cloud's info, which is cached beside the file (or in the .rcb block index), so
+    // only the split itself reads the rays. Only a file without a cached info is read an extra time, to cache it
+    ray::Cloud::Info info;
+    if (!ray::Cloud::getInfo(cloud_file.name(), info))
+      usage();
+    const double min_time = info.min_time;
+    const double max_time = info.max_time;
+    std::cout << "Splitting cloud at " << (max_time - min_time) * time.value() / 100.0 << " seconds into the "
+              << max_time - min_time << " time period of this ray cloud." << std::endl;
+
+    // now split based on this
+    const double time_thresh = min_time + (max_time - min_time) * time.value() / 100.0;
+    res = ray::split(rc_name, in_name, out_name,
+                     [&](const ray::Cloud &cloud, int i) -> bool { return cloud.times[i] > time_thresh; });
+  }
+  else if (box_format)
+  {
+    // Can't use cloud::split as sets are not mutually exclusive here.
+    // we need to include rays that pass through the box. The intensity of these rays needs to be set to 0
+    // so that they are treated as unbounded.
+    res = ray::splitBox(rc_name, in_name, out_name, Eigen::Vector3d(0, 0, 0), box_radius.value());
+  }
+  else if (grid_format)  // standard 3D grid of cuboids
+  {
+    res = ray::splitGrid(rc_name, cloud_file.nameStub(), cell_width.value(), 0.0, grid_cache);
+  }
+  else if (grid_format2)  // this is a 3+1D grid (space and time)
+  {
+    res = ray::splitGrid(rc_name, cloud_file.nameStub(), cell_width2.value(), 0.0, grid_cache);
+  }
+  else if (grid_format3)  // this is a 3D grid with a specified overlap
+  {
+    res = ray::splitGrid(rc_name, cloud_file.nameStub(), cell_width.value(), overlap.value(), grid_cache);
+  }
+  else if (multi_format)
+  {
+    ray::SplitPlan plan;
+    std::map<std::string, int> key_counts;
+    for (const auto &multi_split : multi_splits)
+    {
+      char *split_argv[4] = { argv[0], argv[1], argv[multi_split.first], argv[multi_split.first + 1] };
+      const bool keyed = multi_split.second == 0;
+      if (keyed)
+        ray::parseCommandLine(4, split_argv, { &cloud_file, &choice });
+      else
+        ray::parseCommandLine(4, split_argv, { &cloud_file, &box_text, &box_radius });
+      const std::string key = keyed ? choice.selectedKey() : "box";
+      const int count = ++key_counts[key];
+      const std::string name = cloud_file.nameStub() + "_" + key + (count > 1 ? std::to_string(count) : "");
+      if (keyed)
+        add_keyed_split(plan, name + "_inside.ply", name + "_outside.ply");
+      else
+        plan.addBox(name + "_inside.ply", name + "_outside.ply", Eigen::Vector3d(0, 0, 0), box_radius.value());
+    }
+    res = plan.run(rc_name);
+  }
+  else
+  {
+    ray::SplitPlan plan;
+    add_keyed_split(plan, in_name, out_name);
+    res = plan.run(rc_name);
+  }
+  if (!res)
+    usage();
+  return 0;
+}
+
+RAYLIB_TOOL_MAIN(raysplitMain)
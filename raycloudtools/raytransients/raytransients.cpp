@@ -1,92 +1,210 @@
-// Copyright (c) 2020
-// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
-// ABN 41 687 119 230
-//
-// Author: Thomas Lowe
-#include "raylib/raycloud.h"
-#include "raylib/raydebugdraw.h"
-#include "raylib/raymerger.h"
-#include "raylib/raymesh.h"
-#include "raylib/rayparse.h"
-#include "raylib/rayply.h"
-#include "raylib/rayprogress.h"
-#include "raylib/rayprogressthread.h"
-#include "raylib/raythreads.h"
-
-#include <chrono>
-#include <cstdio>
-#include <cstdlib>
-#include <cstring>
-#include <iostream>
-#include <thread>
-
-void usage(int exit_code = 1)
-{
-  // clang-format off
-  std::cout << "Splits a raycloud into the transient rays and the fixed part" << std::endl;
-  std::cout << "usage:" << std::endl;
-  std::cout << "raytransients min raycloud 20 rays - splits out positive transients (objects that have since moved)." << std::endl;
-  std::cout << "                                     20 is number of pass through rays to classify as transient." << std::endl;
-  std::cout << "              max    - finds negative transients, such as a hallway exposed when a door opens." << std::endl;
-  std::cout << "              oldest - keeps the oldest geometry when there is a difference over time." << std::endl;
-  std::cout << "              newest - uses the newest geometry when there is a difference over time." << std::endl;
-  std::cout << " --colour     - also colours the clouds, to help tweak numRays. red: opacity, green: pass throughs, blue: planarity." << std::endl;
-  // clang-format on
-  exit(exit_code);
-}
-
-int main(int argc, char *argv[])
-{
-  ray::KeyChoice merge_type({ "min", "max", "oldest", "newest" });
-  ray::FileArgument cloud_file;
-  ray::DoubleArgument num_rays(0.1, 100.0);
-  ray::TextArgument text("rays");
-  ray::OptionalFlagArgument colour("colour", 'c');
-  if (!ray::parseCommandLine(argc, argv, { &merge_type, &cloud_file, &num_rays, &text }, { &colour }))
-    usage();
-
-  ray::Cloud cloud;
-  if (!cloud.load(cloud_file.name()))
-    usage();
-
-  ray::Threads::init();
-  ray::MergerConfig config;
-  // Note: we actually get better multi-threaded performace with smaller voxels
-  config.voxel_size = 0.0;
-  config.num_rays_filter_threshold = num_rays.value();
-  config.merge_type = ray::MergeType::Mininum;
-  config.colour_cloud = colour.isSet();
-
-  if (merge_type.selectedKey() == "oldest")
-  {
-    config.merge_type = ray::MergeType::Oldest;
-  }
-  if (merge_type.selectedKey() == "newest")
-  {
-    config.merge_type = ray::MergeType::Newest;
-  }
-  if (merge_type.selectedKey() == "min")
-  {
-    config.merge_type = ray::MergeType::Mininum;
-  }
-  if (merge_type.selectedKey() == "max")
-  {
-    config.merge_type = ray::MergeType::Maximum;
-  }
-
-  ray::Merger filter(config);
-  ray::Progress progress;
-  ray::ProgressThread progress_thread(progress);
-
-  filter.filter(cloud, &progress);
-
-  progress_thread.requestQuit();
-  progress_thread.join();
-
-  const ray::Cloud &transient = filter.differenceCloud();
-  const ray::Cloud &fixed = filter.fixedCloud();
-
-  transient.save(cloud_file.nameStub() + "_transient.ply");
-  fixed.save(cloud_file.nameStub() + "_fixed.ply");
-  return 0;
-}
+// Copyright (c) 2020
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raylib/raycheckpoint.h"
+#include "raylib/raycloud.h"
+#include "raylib/raycloudwriter.h"
+#include "raylib/raydebugdraw.h"
+#include "raylib/raymemory.h"
+#include "raylib/raymerger.h"
+#include "raylib/raymesh.h"
+#include "raylib/rayparse.h"
+#include "raylib/rayply.h"
+#include "raylib/rayprofile.h"
+#include "raylib/rayprogress.h"
+#include "raylib/rayprogressthread.h"
+#include "raylib/raythreads.h"
+#include "raylib/raytool.h"
+#include "raylib/raytransientgrid.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+/// the estimated memory per ray of filtering in memory, beyond the cloud: its ellipsoid, grid entries and marks
+const size_t kTransientBytesPerRay = 400;
+/// the most tiles of Merger::filterTiled
+const double kMaxTiles = 1024.0;
+
+/// the width of the tiles to filter @c file_name in, so that each tile fits in the memory budget. 0 if it cannot
+/// be read, or no tiling fits.
+double budgetTileWidth(const std::string &file_name)
+{
+  ray::Cloud::Info info;
+  if (!ray::Cloud::getInfo(file_name, info))
+    return 0.0;
+  const double num_rays = static_cast<double>(info.num_bounded) + static_cast<double>(info.num_unbounded);
+  const double budget_rays = static_cast<double>(ray::MemoryBudget::limit()) /
+                             static_cast<double>(ray::MemoryBudget::kCloudBytesPerRay + kTransientBytesPerRay);
+  // half the budget, leaving room for the overlap rays and for the rays being spread unevenly across the tiles
+  const double fraction = std::min(1.0, 0.5 * budget_rays / std::max(num_rays, 1.0));
+  const Eigen::Vector3d extent = info.rays_bound.max_bound_ - info.rays_bound.min_bound_;
+  const double width = std::max(std::sqrt(extent[0] * extent[1] * fraction), 0.1);
+  const double num_tiles = std::ceil(extent[0] / width) * std::ceil(extent[1] / width);
+  return num_tiles <= kMaxTiles ? width : 0.0;
+}
+
+void usage(int exit_code = 1)
+{
+  // clang-format off
+  std::cout << "Splits a raycloud into the transient rays and the fixed part" << std::endl;
+  std::cout << "usage:" << std::endl;
+  std::cout << "raytransients min raycloud 20 rays - splits out positive transients (objects that have since moved)." << std::endl;
+  std::cout << "                                     20 is number of pass through rays to classify as transient." << std::endl;
+  std::cout << "              max    - finds negative transients, such as a hallway exposed when a door opens." << std::endl;
+  std::cout << "              oldest - keeps the oldest geometry when there is a difference over time." << std::endl;
+  std::cout << "              newest - uses the newest geometry when there is a difference over time." << std::endl;
+  std::cout << " --colour     - also colours the clouds, to help tweak numRays. red: opacity, green: pass throughs, blue: planarity." << std::endl;
+  std::cout << " --tile 100   - filters the cloud in 100 m square tiles, for clouds too large to fit in memory." << std::endl;
+  std::cout << " --overlap 2  - with --tile, the distance between tiles over which rays are shared. Defaults to 4 voxel widths." << std::endl;
+  std::cout << "                Without --tile or --window, tiles are used when the cloud won't fit in --max_memory." << std::endl;
+  std::cout << " --window 60  - filters a time ordered cloud in 60 s windows, streaming the results, for long continuous runs." << std::endl;
+  std::cout << " --margin 20  - with --window, the time between windows over which rays are shared. Defaults to the window length." << std::endl;
+  std::cout << " --resume     - with tiles, keeps a checkpoint of the tiles filtered, so that an interrupted run resumes from it when repeated." << std::endl;
+ std::cout << " --fast       - approximates the filter on voxels, streaming the cloud, for a quick look at clouds of any size." << std::endl;
+  std::cout << " --voxel_width 0.1 - with --fast, the voxel width in m. Defaults to twice the point spacing." << std::endl;
+  // clang-format on
+  ray::Tool::exit(exit_code);
+}
+}  // namespace
+
+int raytransientsMain(int argc, char *argv[])
+{
+  ray::Threads::initFromArguments(argc, argv, ray::Threads::ThreadCountRecommended);
+  ray::MemoryBudget::initFromArguments(argc, argv);
+  ray::Profile::initFromArguments(argc, argv);
+  ray::CloudWriter::initFromArguments(argc, argv);
+  ray::Checkpoint::initFromArguments(argc, argv);
+  ray::KeyChoice merge_type({ "min", "max", "oldest", "newest" });
+  ray::FileArgument cloud_file;
+  ray::DoubleArgument num_rays(0.1, 100.0);
+  ray::TextArgument text("rays");
+  ray::OptionalFlagArgument colour("colour", 'c');
+  ray::DoubleArgument tile_width(0.1, 1000000.0), overlap(0.0, 10000.0);
+  ray::OptionalKeyValueArgument tile_option("tile", 't', &tile_width);
+  ray::OptionalKeyValueArgument overlap_option("overlap", 'o', &overlap);
+  ray::DoubleArgument window(0.001, 1000000.0), margin(0.0, 1000000.0);
+  ray::OptionalKeyValueArgument window_option("window", 'w', &window);
+  ray::OptionalKeyValueArgument margin_option("margin", 'm', &margin);
+  ray::OptionalFlagArgument fast("fast", 'f');
+  ray::DoubleArgument voxel_width(0.001, 1000.0);
+  ray::OptionalKeyValueArgument voxel_width_option("voxel_width", 'v', &voxel_width);
+  if (!ray::parseCommandLine(argc, argv, { &merge_type, &cloud_file, &num_rays, &text },
+                             { &colour, &tile_option, &overlap_option, &window_option, &margin_option, &fast,
+                               &voxel_width_option }))
+    usage();
+  if (tile_option.isSet() && window_option.isSet())
+    usage();
+  // the voxel filter streams the whole cloud, so neither needs nor supports the tiles, windows or colouring
+  if (fast.isSet() && (tile_option.isSet() || window_option.isSet() || colour.isSet()))
+    usage();
+  if (voxel_width_option.isSet() && !fast.isSet())
+    usage();
+
+  ray::MergerConfig config;
+  // Note: we actually get better multi-threaded performace with smaller voxels
+  config.voxel_size = 0.0;
+  config.num_rays_filter_threshold = num_rays.value();
+  config.merge_type = ray::MergeType::Mininum;
+  config.colour_cloud = colour.isSet();
+
+  if (merge_type.selectedKey() == "oldest")
+  {
+    config.merge_type = ray::MergeType::Oldest;
+  }
+  if (merge_type.selectedKey() == "newest")
+  {
+    config.merge_type = ray::MergeType::Newest;
+  }
+  if (merge_type.selectedKey() == "min")
+  {
+    config.merge_type = ray::MergeType::Mininum;
+  }
+  if (merge_type.selectedKey() == "max")
+  {
+    config.merge_type = ray::MergeType::Maximum;
+  }
+
+  ray::Progress progress;
+  if (fast.isSet())
+  {
+    ray::ProgressThread progress_thread(progress);
+    const bool success = ray::filterTransientsFast(cloud_file.name(), cloud_file.nameStub() + "_transient.ply",
+                                                   cloud_file.nameStub() + "_fixed.ply", config,
+                                                   voxel_width_option.isSet() ? voxel_width.value() : 0.0, &progress);
+    progress_thread.requestQuit();
+    progress_thread.join();
+    return success ? 0 : 1;
+  }
+
+  ray::Merger filter(config);
+  double width = tile_option.isSet() ? tile_width.value() : 0.0;
+  if (!tile_option.isSet() && !window_option.isSet() &&
+      !ray::MemoryBudget::fitsCloud(cloud_file.name(), kTransientBytesPerRay))
+  {
+    width = budgetTileWidth(cloud_file.name());  // 0 when no tiling fits either
+    if (width <= 0.0 && !ray::MemoryBudget::checkCloud(cloud_file.name(), kTransientBytesPerRay, "raytransients"))
+      return 1;
+    if (width > 0.0)
+      std::cout << "the cloud does not fit in the memory budget of "
+                << ray::MemoryBudget::formatBytes(ray::MemoryBudget::limit()) << ", so it is filtered in " << width
+                << " m tiles" << std::endl;
+  }
+  if (width > 0.0)
+  {
+    // out-of-core filtering, which writes the results directly
+    if (ray::Checkpoint::enabled())
+      filter.setCheckpoint(cloud_file.nameStub() + "_transient.checkpoint");
+    ray::ProgressThread progress_thread(progress);
+    const bool success = filter.filterTiled(cloud_file.name(), cloud_file.nameStub() + "_transient.ply",
+                                            cloud_file.nameStub() + "_fixed.ply", width,
+                                            overlap_option.isSet() ? overlap.value() : 0.0, &progress);
+    progress_thread.requestQuit();
+    progress_thread.join();
+    return success ? 0 : 1;
+  }
+  if (window_option.isSet())
+  {
+    // streaming filtering in time windows, which writes the results directly
+    ray::ProgressThread progress_thread(progress);
+    const bool success = filter.filterWindowed(cloud_file.name(), cloud_file.nameStub() + "_transient.ply",
+                                               cloud_file.nameStub() + "_fixed.ply", window.value(),
+                                               margin_option.isSet() ? margin.value() : 0.0, &progress);
+    progress_thread.requestQuit();
+    progress_thread.join();
+    return success ? 0 : 1;
+  }
+
+  ray::Cloud cloud;
+  if (!cloud.load(cloud_file.name()))
+    usage();
+
+  // the results are written as they are found, rather than held in the filter
+  ray::CloudWriter transient_writer, fixed_writer;
+  if (!transient_writer.begin(cloud_file.nameStub() + "_transient.ply") ||
+      !fixed_writer.begin(cloud_file.nameStub() + "_fixed.ply"))
+    usage();
+  filter.setOutput(&fixed_writer, &transient_writer);
+
+  ray::ProgressThread progress_thread(progress);
+
+  const bool success = filter.filter(cloud, &progress);
+
+  progress_thread.requestQuit();
+  progress_thread.join();
+
+  transient_writer.end();
+  fixed_writer.end();
+  return success ? 0 : 1;
+}
+
+RAYLIB_TOOL_MAIN(raytransientsMain)
@@ -4,14 +4,21 @@
 //
 // Author: Thomas Lowe
 #include "raylib/raycloud.h"
+#include "raylib/raycloudwriter.h"
+#include "raylib/raymemory.h"
 #include "raylib/rayparse.h"
 #include "raylib/rayply.h"
+#include "raylib/rayprofile.h"
+#include "raylib/raythreads.h"
+#include "raylib/raytool.h"
 
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
 
+namespace
+{
 void usage(int exit_code = 1)
 {
   // clang-format off
@@ -20,12 +27,16 @@ void usage(int exit_code = 1)
   std::cout << "raytranslate raycloud 0,0,1 - translation (x,y,z) in metres" << std::endl;
   std::cout << "                      0,0,1,24.3 - optional 4th component translates time" << std::endl;
   // clang-format on
-  exit(exit_code);
+  ray::Tool::exit(exit_code);
 }
+}  // namespace
 
-
-int main(int argc, char *argv[])
+int raytranslateMain(int argc, char *argv[])
 {
+  ray::Threads::initFromArguments(argc, argv);
+  ray::MemoryBudget::initFromArguments(argc, argv);
+  ray::Profile::initFromArguments(argc, argv);
+  ray::CloudWriter::initFromArguments(argc, argv);
   ray::FileArgument cloud_file;
   ray::Vector3dArgument translation3;
   ray::Vector4dArgument translation4;
@@ -52,10 +63,15 @@ int main(int argc, char *argv[])
     end += translation;
     time += time_delta;
   };
-  if (!ray::convertCloud(cloud_file.name(), temp_name, translate))
-    usage();
-
-  std::rename(temp_name.c_str(), cloud_file.name().c_str());
+  // rewrite the cloud in place where its layout allows, otherwise via a temporary file
+  if (!ray::convertCloudInPlace(cloud_file.name(), translate))
+  {
+    if (!ray::convertCloud(cloud_file.name(), temp_name, translate))
+      usage();
+    std::rename(temp_name.c_str(), cloud_file.name().c_str());
+  }
 
   return 0;
 }
+
+RAYLIB_TOOL_MAIN(raytranslateMain)
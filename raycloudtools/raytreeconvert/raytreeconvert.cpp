@@ -0,0 +1,54 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raylib/rayforeststructure.h"
+#include "raylib/rayparse.h"
+#include "raylib/raytool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+void usage(int exit_code = 1)
+{
+  // clang-format off
+  std::cout << "Convert a tree file between the text interchange format and the binary format, which is faster to load." << std::endl;
+  std::cout << "Tools that load tree files accept either format." << std::endl;
+  std::cout << "usage:" << std::endl;
+  std::cout << "raytreeconvert forest_trees.txt       - converts to binary forest_trees.bin" << std::endl;
+  std::cout << "raytreeconvert forest_trees.bin       - converts back to text forest_trees.txt" << std::endl;
+  std::cout << "               --output trees.bin     - optional output file name" << std::endl;
+  // clang-format on
+  ray::Tool::exit(exit_code);
+}
+}  // namespace
+
+int raytreeconvertMain(int argc, char *argv[])
+{
+  ray::FileArgument tree_file, output_file;
+  ray::OptionalKeyValueArgument output_option("output", 'o', &output_file);
+  if (!ray::parseCommandLine(argc, argv, { &tree_file }, { &output_option }))
+    usage();
+
+  const bool to_binary = !ray::ForestStructure::isBinaryFile(tree_file.name());
+  ray::ForestStructure forest;
+  if (!forest.load(tree_file.name()))
+    usage();
+  const std::string output =
+    output_option.isSet() ? output_file.name() : tree_file.nameStub() + (to_binary ? ".bin" : ".txt");
+  if (output == tree_file.name())
+  {
+    std::cerr << "Error: the output file " << output << " would overwrite the input" << std::endl;
+    usage();
+  }
+  if (!(to_binary ? forest.saveBinary(output) : forest.save(output)))
+    usage();
+  return 0;
+}
+
+RAYLIB_TOOL_MAIN(raytreeconvertMain)
@@ -4,19 +4,30 @@
 //
 // Author: Thomas Lowe
 #include "raylib/raycloud.h"
+#include "raylib/raycloudwriter.h"
 #include "raylib/rayconcavehull.h"
 #include "raylib/rayconvexhull.h"
 #include "raylib/raydebugdraw.h"
+#include "raylib/rayheightfieldwrap.h"
+#include "raylib/raymemory.h"
 #include "raylib/rayparse.h"
 #include "raylib/rayply.h"
+#include "raylib/rayprofile.h"
+#include "raylib/raythreads.h"
+#include "raylib/raytool.h"
 #include "raylib/rayutils.h"
 
 #include <cstdio>
 #include <cstdlib>
 #include <fstream>
 
+namespace
+{
 // FIXME: Windows compatibility
 
+/// the estimated memory per ray of wrapping in memory, beyond the cloud: the hull points and their mesh
+const size_t kWrapBytesPerRay = 100;
+
 void usage(int exit_code = 1)
 {
   // clang-format off
@@ -25,26 +36,77 @@ void usage(int exit_code = 1)
   std::cout << "raywrap raycloud upwards 1.0 - wraps raycloud from the bottom upwards, or: downwards, inwards, outwards" << std::endl;
   std::cout << "                               the 1.0 is the maximum curvature to bend to" << std::endl;
   std::cout << "--full                       - the full (slower) method accounts for overhangs." << std::endl;
+  std::cout << "--pixel_width 0.1            - pixel width of the upwards and downwards wraps, default is double the point spacing." << std::endl;
   // clang-format on
-  exit(exit_code);
+  ray::Tool::exit(exit_code);
 }
+}  // namespace
 
-int main(int argc, char *argv[])
+int raywrapMain(int argc, char *argv[])
 {
+  ray::Threads::initFromArguments(argc, argv);
+  ray::MemoryBudget::initFromArguments(argc, argv);
+  ray::Profile::initFromArguments(argc, argv);
+  ray::CloudWriter::initFromArguments(argc, argv);
   ray::FileArgument cloud_file;
   ray::KeyChoice direction({ "upwards", "downwards", "inwards", "outwards" });
   ray::DoubleArgument curvature;
+  ray::DoubleArgument pixel_width(0.0001, 1000.0);
   ray::OptionalFlagArgument full("full", 'f');
-  if (!ray::parseCommandLine(argc, argv, { &cloud_file, &direction, &curvature }, { &full }))
+  ray::OptionalKeyValueArgument pixel_width_option("pixel_width", 'p', &pixel_width);
+  if (!ray::parseCommandLine(argc, argv, { &cloud_file, &direction, &curvature }, { &full, &pixel_width_option }))
     usage();
 
+  const bool vertical = direction.selectedKey() == "upwards" || direction.selectedKey() == "downwards";
+  if (vertical && !full.isSet())
+  {
+    // the height field wrap streams the cloud into a grid, so it does not need the cloud in memory
+    ray::Cloud::Info info;
+    if (!ray::Cloud::getInfo(cloud_file.name(), info))
+      usage();
+    const ray::Cuboid bounds = info.ends_bound;
+    double pix_width = pixel_width.value();
+    if (!pixel_width_option.isSet())
+    {
+      const double spacing_scale = 2.0;  // a reasonable default multiplier on the spacing between points
+      pix_width = spacing_scale * ray::Cloud::estimatePointSpacing(cloud_file.name(), bounds, info.num_bounded);
+    }
+    if (pix_width <= 0.0)
+      usage();
+    ray::HeightFieldWrap height_wrap(bounds.min_bound_, bounds.max_bound_, pix_width);
+    auto add_chunk = [&](std::vector<Eigen::Vector3d> &, std::vector<Eigen::Vector3d> &ends, std::vector<double> &,
+                         std::vector<ray::RGBA> &colours) {
+      std::vector<Eigen::Vector3d> bounded_ends;
+      bounded_ends.reserve(ends.size());
+      for (size_t i = 0; i < ends.size(); i++)
+      {
+        if (colours[i].alpha > 0)
+          bounded_ends.push_back(ends[i]);
+      }
+      height_wrap.addPoints(bounded_ends);
+    };
+    if (!ray::Cloud::read(cloud_file.name(), add_chunk))
+      usage();
+    if (direction.selectedKey() == "upwards")
+      height_wrap.growUpwards(curvature.value());
+    else
+      height_wrap.growDownwards(curvature.value());
+    writePlyMesh(cloud_file.nameStub() + "_mesh.ply", height_wrap.mesh(), true);
+    std::cout << "Completed, output: " << cloud_file.nameStub() << "_mesh.ply" << std::endl;
+    return 0;
+  }
+
+  // the hulls only use the bounded ray ends, so the starts and times are not loaded
+  if (!ray::MemoryBudget::checkCloud(cloud_file.name(), kWrapBytesPerRay, "raywrap"))
+    return 1;
   ray::Cloud cloud;
-  if (!cloud.load(cloud_file.name()))
+  if (!cloud.loadFields(cloud_file.name(), ray::kCFEnds | ray::kCFColours))
     usage();
   cloud.removeUnboundedRays();
 
   if (full.isSet())
   {
+#if RAYLIB_WITH_QHULL || RAYLIB_NATIVE_DELAUNAY
     ray::ConcaveHull concave_hull(cloud.ends);
     if (direction.selectedKey() == "inwards")
       concave_hull.growInwards(curvature.value());
@@ -58,6 +120,10 @@ int main(int argc, char *argv[])
       usage();
 
     writePlyMesh(cloud_file.nameStub() + "_mesh.ply", concave_hull.mesh(), true);
+#else
+    std::cerr << "Error: --full requires the library to be built with WITH_QHULL or NATIVE_DELAUNAY" << std::endl;
+    usage();
+#endif
   }
   else
   {
@@ -66,10 +132,6 @@ int main(int argc, char *argv[])
       convex_hull.growInwards(curvature.value());
     else if (direction.selectedKey() == "outwards")
       convex_hull.growOutwards(curvature.value());
-    else if (direction.selectedKey() == "upwards")
-      convex_hull.growUpwards(curvature.value());
-    else if (direction.selectedKey() == "downwards")
-      convex_hull.growDownwards(curvature.value());
     else
       usage();
 
@@ -80,3 +142,5 @@ int main(int argc, char *argv[])
   std::cout << "Completed, output: " << cloud_file.nameStub() << "_mesh.ply" << std::endl;
   return 0;
 }
+
+RAYLIB_TOOL_MAIN(raywrapMain)
@@ -6,13 +6,29 @@
 #include "rayclusters.h"
 #include <nabo/nabo.h>
 #include "raylib/raydebugdraw.h"
+#include "raylib/rayneighbours.h"
+#include "raylib/raythreads.h"
 
 namespace ray
 {
+namespace
+{
+// the root cluster of point @c id , halving the path to it on the way
+int findCluster(std::vector<int> &parents, int id)
+{
+  while (parents[id] != id)
+  {
+    parents[id] = parents[parents[id]];
+    id = parents[id];
+  }
+  return id;
+}
+}  // namespace
+
 // take the input points and separate into clusters based on a minimum and maximum separation diameter criterion
 // this is a form of agglomerative clustering
 void clustersAgglomerate(const std::vector<Eigen::Vector3d> &points, double min_diameter, double max_diameter,
-                         std::vector<std::vector<int>> &point_clusters)
+                         PointClusters &point_clusters)
 {
   // 1. get nearest neighbours for each point
   const int search_size = std::min(8, static_cast<int>(points.size()) - 1);
@@ -21,98 +37,93 @@ void clustersAgglomerate(const std::vector<Eigen::Vector3d> &points, double min_
   {
     points_p.col(i) = points[i];
   }
-  Nabo::NNSearchD *nns = Nabo::NNSearchD::createKDTreeLinearHeap(points_p, 3);
+  const NeighbourIndex index(std::move(points_p));
   // Run the search
   Eigen::MatrixXi indices;
   Eigen::MatrixXd dists2;
-  indices.resize(search_size, points.size());
-  dists2.resize(search_size, points.size());
-  nns->knn(points_p, indices, dists2, search_size, kNearestNeighbourEpsilon, 0, min_diameter);
+  index.knn(search_size, indices, dists2, kNearestNeighbourEpsilon, min_diameter);
 
   // temporary node structure in order to sort the neighbours by distance
   struct Nd
   {
-    Nd(int id1, int id2, double dist2)
-      : id1(id1)
-      , id2(id2)
-      , dist2(dist2)
-    {}
     int id1, id2;
     double dist2;  // square distance
   };
-  std::vector<Nd> nds;
-  for (size_t i = 0; i < points.size(); i++)
-  {
+  // each point fills its own slots, so the nodes are gathered in parallel, then compacted in point order
+  std::vector<Nd> nds(points.size() * search_size, Nd{ -1, -1, 0.0 });
+  parallelFor(0, static_cast<int>(points.size()), [&](int i) {
     for (int j = 0; j < search_size && indices(j, i) != Nabo::NNSearchD::InvalidIndex; j++)
     {
-      nds.push_back(Nd(static_cast<int>(i), indices(j, i), dists2(j, i)));
+      nds[i * search_size + j] = Nd{ i, indices(j, i), dists2(j, i) };
     }
-  }
+  });
+  nds.erase(std::remove_if(nds.begin(), nds.end(), [](const Nd &nd) { return nd.id1 == -1; }), nds.end());
   std::sort(nds.begin(), nds.end(), [](const Nd &nd1, const Nd &nd2) { return nd1.dist2 < nd2.dist2; });
 
-  // temporary cluster structure
-  struct Cluster
-  {
-    Eigen::Vector3d min_bound, max_bound;
-    std::vector<int> ids;
-    bool active;
-  };
-  std::vector<Cluster> clusters(points.size());
-  std::vector<int> cluster_ids(points.size());
-  // initialise the clusters
+  // 2. for each node in turn, from smallest to highest distance, agglomerate.
+  // The clusters are a union-find forest rooted at their lowest point index, with the bounds stored at the root.
+  // Each cluster's points are a linked list, so merging two clusters is constant time
+  std::vector<int> parents(points.size());
+  std::vector<int> heads(points.size()), tails(points.size()), nexts(points.size(), -1);
+  std::vector<Eigen::Vector3d> min_bounds(points), max_bounds(points);
   for (size_t i = 0; i < points.size(); i++)
   {
-    clusters[i].min_bound = clusters[i].max_bound = points[i];
-    clusters[i].active = true;
-    clusters[i].ids.push_back(static_cast<int>(i));
-    cluster_ids[i] = static_cast<int>(i);
+    parents[i] = heads[i] = tails[i] = static_cast<int>(i);
   }
-
-  // 2. for each node in turn, from smallest to highest distance, agglomerate
+  size_t num_clusters = points.size();
   for (auto &node : nds)
   {
-    if (cluster_ids[node.id1] == cluster_ids[node.id2])  // already part of same cluster
+    const int cl1 = findCluster(parents, node.id1);
+    const int cl2 = findCluster(parents, node.id2);
+    if (cl1 == cl2)  // already part of same cluster
     {
       continue;
     }
-    const int cl1 = cluster_ids[node.id1];
-    const int cl2 = cluster_ids[node.id2];
-    Eigen::Vector3d minb = minVector(clusters[cl1].min_bound, clusters[cl2].min_bound);
-    Eigen::Vector3d maxb = maxVector(clusters[cl1].max_bound, clusters[cl2].max_bound);
+    Eigen::Vector3d minb = minVector(min_bounds[cl1], min_bounds[cl2]);
+    Eigen::Vector3d maxb = maxVector(max_bounds[cl1], max_bounds[cl2]);
     Eigen::Vector3d dims = maxb - minb;
     double diam = std::max(dims[0], std::max(dims[1], dims[2]));
     if (diam < max_diameter)  // then merge
     {
       const int first = std::min(cl1, cl2);
       const int last = std::max(cl1, cl2);
-      clusters[first].min_bound = minb;
-      clusters[first].max_bound = maxb;
-      clusters[first].ids.insert(clusters[first].ids.begin(), clusters[last].ids.begin(), clusters[last].ids.end());
-      for (auto &id : clusters[last].ids)
-      {
-        cluster_ids[id] = first;
-      }
-      clusters[last].active = false;
+      min_bounds[first] = minb;
+      max_bounds[first] = maxb;
+      // the last cluster's points go before the first's
+      nexts[tails[last]] = heads[first];
+      heads[first] = heads[last];
+      parents[last] = first;
+      num_clusters--;
     }
   }
-  // convert the vector of clusters into a vector of sets of point indices
-  for (auto &cluster : clusters)
+  // convert the forest into clusters of point indices, in order of their roots
+  point_clusters.clear();
+  point_clusters.offsets.reserve(num_clusters + 1);
+  point_clusters.ids.reserve(points.size());
+  point_clusters.offsets.push_back(0);
+  for (size_t i = 0; i < points.size(); i++)
   {
-    if (cluster.active)
+    if (parents[i] == static_cast<int>(i))
     {
-      point_clusters.push_back(cluster.ids);
+      for (int id = heads[i]; id != -1; id = nexts[id])
+      {
+        point_clusters.ids.push_back(id);
+      }
+      point_clusters.offsets.push_back(point_clusters.ids.size());
     }
   }
 }
 
 /// generate clusters from the set of points, with optional debug rending of the output
-void generateClusters(std::vector<std::vector<int>> &point_clusters, const std::vector<Eigen::Vector3d> &points,
-                      double min_diameter, double max_diameter, bool verbose)
+void generateClusters(PointClusters &point_clusters, const std::vector<Eigen::Vector3d> &points, double min_diameter,
+                      double max_diameter, bool verbose)
 {
+  point_clusters.clear();
   // corner cases
   if (points.size() == 1)
   {
-    point_clusters.push_back(std::vector<int>(1, 0));
+    point_clusters.offsets = { 0, 1 };
+    point_clusters.ids.push_back(0);
   }
   if (points.size() <= 1)
   {
@@ -129,15 +140,27 @@ void generateClusters(std::vector<std::vector<int>> &point_clusters, const std::
     for (size_t i = 0; i < point_clusters.size(); i++)
     {
       const double shade = static_cast<double>(i) / static_cast<double>(point_clusters.size() - 1);
-      for (auto &id : point_clusters[i])
+      for (size_t j = point_clusters.begin(i); j < point_clusters.end(i); j++)
       {
         shades.push_back(shade);
-        ps.push_back(points[id]);
+        ps.push_back(points[point_clusters.ids[j]]);
       }
     }
     DebugDraw::instance()->drawCloud(ps, shades, 0);
   }
 }
 
+void generateClusters(std::vector<std::vector<int>> &point_clusters, const std::vector<Eigen::Vector3d> &points,
+                      double min_diameter, double max_diameter, bool verbose)
+{
+  PointClusters clusters;
+  generateClusters(clusters, points, min_diameter, max_diameter, verbose);
+  point_clusters.reserve(point_clusters.size() + clusters.size());
+  for (size_t i = 0; i < clusters.size(); i++)
+  {
+    point_clusters.push_back(clusters.cluster(i));
+  }
+}
+
 
 }  // namespace ray
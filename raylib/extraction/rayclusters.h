@@ -11,9 +11,40 @@
 
 namespace ray
 {
+/// A set of clusters of point indices in compressed sparse row form. The points of cluster @c i are
+/// @c ids[offsets[i]] to @c ids[offsets[i+1]-1]
+struct RAYLIB_EXPORT PointClusters
+{
+  std::vector<size_t> offsets;
+  std::vector<int> ids;
+
+  /// the number of clusters
+  inline size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+  /// the index of the first point of @c cluster in @c ids
+  inline size_t begin(size_t cluster) const { return offsets[cluster]; }
+  /// one past the index of the last point of @c cluster in @c ids
+  inline size_t end(size_t cluster) const { return offsets[cluster + 1]; }
+  /// the point indices of @c cluster , as a new vector
+  inline std::vector<int> cluster(size_t cluster) const
+  {
+    return std::vector<int>(ids.begin() + offsets[cluster], ids.begin() + offsets[cluster + 1]);
+  }
+  /// empty the clusters, keeping their storage for reuse
+  inline void clear()
+  {
+    offsets.clear();
+    ids.clear();
+  }
+};
+
 /// Generate clusters from a set of points based on min and max diameter criteria
-/// This is an agglomerative clustering method, whereby clusters iteratively grow and fuse
+/// This is an agglomerative clustering method, whereby clusters iteratively grow and fuse.
+/// @c point_clusters is replaced, reusing its storage, so that repeated calls don't reallocate
+void RAYLIB_EXPORT generateClusters(PointClusters &point_clusters, const std::vector<Eigen::Vector3d> &points,
+                                    double min_diameter, double max_diameter, bool verbose = false);
+
+/// As above, appending the clusters to @c point_clusters as a vector per cluster
 void RAYLIB_EXPORT generateClusters(std::vector<std::vector<int>> &point_clusters, const std::vector<Eigen::Vector3d> &points,
                                     double min_diameter, double max_diameter, bool verbose = false);
 }  // namespace ray
-#endif  // RAYLIB_RAYEXTRACT_WOODS_H
\ No newline at end of file
+#endif  // RAYLIB_RAYEXTRACT_WOODS_H
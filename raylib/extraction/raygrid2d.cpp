@@ -4,9 +4,26 @@
 //
 // Author: Thomas Lowe
 #include "raygrid2d.h"
+#include "../raytraversal.h"
+
+#include <limits>
+
+#if RAYLIB_WITH_TBB
+#include <tbb/parallel_for.h>
+#endif  // RAYLIB_WITH_TBB
 
 namespace ray
 {
+namespace
+{
+/// A ray clipped to an occupancy grid, in world and in subpixel units
+struct FreeSpaceRay
+{
+  Eigen::Vector3d start, end;
+  Eigen::Vector3d source, target;
+};
+}  // namespace
+
 /// initialise for a given bounds and pixel width
 void OccupancyGrid2D::init(const Eigen::Vector3d &min_bound, const Eigen::Vector3d &max_bound, double pixel_width)
 {
@@ -62,65 +79,47 @@ void OccupancyGrid2D::fillDensities(const std::string &cloudname, const Eigen::A
   // filling in the free space per chunk of ray cloud
   auto addFreeSpace = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
                           std::vector<double> &, std::vector<ray::RGBA> &) {
+    std::vector<FreeSpaceRay> rays;
+    rays.reserve(ends.size());
     for (size_t i = 0; i < ends.size(); ++i)
     {
-      Eigen::Vector3d start = starts[i];
-      Eigen::Vector3d end = ends[i];
-      bounds_.clipRay(start, end);  // clip the ray within the bounds
+      FreeSpaceRay ray;
+      ray.start = starts[i];
+      ray.end = ends[i];
+      if (!bounds_.clipRay(ray.start, ray.end))  // clip the ray within the bounds
+      {
+        continue;
+      }
+      ray.source = scale * (ray.start - min_bound_) / pixel_width_;
+      ray.target = scale * (ray.end - min_bound_) / pixel_width_;
+      rays.push_back(ray);
+    }
 
-      // now walk the pixels
-      const Eigen::Vector3d dir = scale * (end - start);
-      const Eigen::Vector3d source = scale * (start - min_bound_) / pixel_width_;
-      const Eigen::Vector3d target = scale * (end - min_bound_) / pixel_width_;
-      const double length = dir.norm();
-      const double eps = 1e-9;  // to stay away from edge cases
+    // walk the subpixels of each ray. Only the pixel columns from @c column_min to @c column_max are changed
+    auto add_ray = [&](const FreeSpaceRay &ray, int column_min, int column_max) {
+      const bool forwards = ray.target[0] >= ray.source[0];
+      const double length = (ray.target - ray.source).norm();
       // remove 2 subpixels to give a small buffer around the object
-      const double maxDist = (target - source).norm() - 2.0;
-
-      // cached values to speed up the loop below
-      Eigen::Vector3i adds;
-      Eigen::Vector3d offsets;
-      for (int k = 0; k < 3; ++k)
-      {
-        if (dir[k] > 0.0)
+      const double maxDist = length - 2.0;
+      walkVoxels<2>(ray.source, ray.target, [&](const Eigen::Vector3i &inds, double t_enter, double) {
+        if (t_enter * length > maxDist)
         {
-          adds[k] = 1;
-          offsets[k] = 0.5;
+          return false;
         }
-        else
+        if (inds[0] < 0 || inds[0] >= subpixels * dims_[0] || inds[1] < 0 || inds[1] >= subpixels * dims_[1])
         {
-          adds[k] = -1;
-          offsets[k] = -0.5;
+          return false;
         }
-      }
-
-      Eigen::Vector3d p = source;  // our moving variable as we walk over the grid
-      Eigen::Vector3i inds = p.cast<int>();
-      double depth = 0;
-      // walk over the grid, one pixel at a time.
-      do
-      {
-        // deltas in each axis
-        const double ls[2] = { (round(p[0] + offsets[0]) - p[0]) / dir[0], (round(p[1] + offsets[1]) - p[1]) / dir[1] };
-        // shift in the axis with smallest delta
-        int axis = (ls[0] < ls[1]) ? 0 : 1;
-        // update the index to the new cell
-        inds[axis] += adds[axis];
-        if (inds[axis] < 0 || inds[axis] >= subpixels * dims_[axis])
+        // get the index of the pixel
+        const Eigen::Vector3i index = inds / subpixels;
+        if (index[0] < column_min || index[0] >= column_max)
         {
-          break;
+          // continue until the ray has passed the columns
+          return forwards ? index[0] < column_min : index[0] >= column_max;
         }
-        // minimum length of line segment within cell
-        const double minL = ls[axis] * length;
-        depth += minL + eps;
-        // update position p
-        p = source + dir * (depth / length);
 
-        // get the index of the pixel
-        Eigen::Vector3i index = inds / subpixels;
-
-        // find the world space location
-        Eigen::Vector3d world_point = start + (end - start) * (depth / length);
+        // find the world space location where the ray enters the subpixel
+        const Eigen::Vector3d world_point = ray.start + (ray.end - ray.start) * t_enter;
         // get the height above ground at this location
         const double height = world_point[2] - lows(index[0], index[1]);
         if (height > clip_min && height < clip_max)  // only update occupancy within height window
@@ -130,8 +129,34 @@ void OccupancyGrid2D::fillDensities(const std::string &cloudname, const Eigen::A
           const uint16_t bit = uint16_t(subpixels * rem[0] + rem[1]);
           pixel(index).bits |= uint16_t(1 << bit);
         }
-      } while (depth <= maxDist);
+        return true;
+      });
+    };
+
+#if RAYLIB_WITH_TBB
+    // Each task owns a block of pixel columns, and walks every ray of the chunk that crosses it. No two tasks write
+    // the same pixel, and the bits are or'd together, so the grid is identical to that of the serial loop
+    const int max_blocks = 64;
+    const int num_blocks = std::max(1, std::min(dims_[0], max_blocks));
+    tbb::parallel_for(0, num_blocks, [&](int block) {
+      const int column_min = (dims_[0] * block) / num_blocks;
+      const int column_max = (dims_[0] * (block + 1)) / num_blocks;
+      for (const auto &ray : rays)
+      {
+        const double ray_min = std::min(ray.source[0], ray.target[0]);
+        const double ray_max = std::max(ray.source[0], ray.target[0]);
+        if (ray_max >= scale * static_cast<double>(column_min) && ray_min < scale * static_cast<double>(column_max))
+        {
+          add_ray(ray, column_min, column_max);
+        }
+      }
+    });
+#else   // RAYLIB_WITH_TBB
+    for (const auto &ray : rays)
+    {
+      add_ray(ray, std::numeric_limits<int>::lowest(), std::numeric_limits<int>::max());
     }
+#endif  // RAYLIB_WITH_TBB
   };
   ray::Cloud::read(cloudname, addFreeSpace);
 
@@ -201,6 +226,8 @@ void RayIndexGrid2D::init(const Eigen::Vector3d &min_bound, const Eigen::Vector3
 
   pixels_.resize(dims_[0] * dims_[1]);
   memset(&pixels_[0], 0, sizeof(Pixel) * pixels_.size());
+  // a single layer, indexed by the pixel's x and y
+  ray_ids_.init(min_bound, Eigen::Vector3d(max_bound[0], max_bound[1], min_bound[2] + pixel_width), pixel_width);
 }
 
 void RayIndexGrid2D::fillRays(const Cloud &cloud)
@@ -210,60 +237,32 @@ void RayIndexGrid2D::fillRays(const Cloud &cloud)
   bounds_.min_bound_ = min_bound_ + Eigen::Vector3d(eps, eps, eps);
   bounds_.max_bound_ = min_bound_ + dims_.cast<double>() * pixel_width_ - Eigen::Vector3d(eps, eps, eps);
 
-  for (size_t i = 0; i < cloud.ends.size(); ++i)
-  {
+  // each ray is walked twice, to count and then to fill the ray ids of each pixel that it overlaps
+  auto visit_ray = [&](size_t i, const auto &add) {
     Eigen::Vector3d start = cloud.starts[i];
     Eigen::Vector3d end = cloud.ends[i];
-    bounds_.clipRay(start, end);
+    if (!bounds_.clipRay(start, end))
+    {
+      return;
+    }
 
     // now walk the pixels
-    const Eigen::Vector3d dir = end - start;
     const Eigen::Vector3d source = (start - min_bound_) / pixel_width_;
     const Eigen::Vector3d target = (end - min_bound_) / pixel_width_;
-    const double length = dir.norm();
-    const double eps = 1e-9;  // to stay away from edge cases
-    const double maxDist =
-      (target - source).norm() - 2.0;  // remove 2 subpixels to give a small buffer around the object
-
-    // cached values to speed up the loop below
-    Eigen::Vector3i adds;
-    Eigen::Vector3d offsets;
-    for (int k = 0; k < 3; ++k)
-    {
-      if (dir[k] > 0.0)
+    const double length = (target - source).norm();
+    const double maxDist = length - 2.0;  // remove 2 pixels to give a small buffer around the object
+    walkVoxels<2>(source, target, [&](const Eigen::Vector3i &inds, double t_enter, double) {
+      if (t_enter * length > maxDist || inds[0] < 0 || inds[0] >= dims_[0] || inds[1] < 0 || inds[1] >= dims_[1])
       {
-        adds[k] = 1;
-        offsets[k] = 0.5;
+        return false;
       }
-      else
+      if (pixel(inds).filled)
       {
-        adds[k] = -1;
-        offsets[k] = -0.5;
+        add(Eigen::Vector3i(inds[0], inds[1], 0), static_cast<int>(i));
       }
-    }
-
-    Eigen::Vector3d p = source;  // our moving variable as we walk over the grid
-    Eigen::Vector3i inds = p.cast<int>();
-    double depth = 0;
-    // walk over the grid, one pixel at a time.
-    do
-    {
-      const double ls[2] = { (round(p[0] + offsets[0]) - p[0]) / dir[0], (round(p[1] + offsets[1]) - p[1]) / dir[1] };
-      const int axis = (ls[0] < ls[1]) ? 0 : 1;
-      inds[axis] += adds[axis];
-      if (inds[axis] < 0 || inds[axis] >= dims_[axis])
-      {
-        break;
-      }
-      const double minL = ls[axis] * length;
-      depth += minL + eps;
-      p = source + dir * (depth / length);
-      Pixel &pix = pixel(inds);
-      if (pix.filled)
-      {
-        pix.ray_ids.push_back(static_cast<int>(i));
-      }
-    } while (depth <= maxDist);
-  }
+      return true;
+    });
+  };
+  ray_ids_.build(cloud.ends.size(), visit_ray);
 }
 }  // namespace ray
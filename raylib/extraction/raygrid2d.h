@@ -6,6 +6,7 @@
 #ifndef RAYLIB_RAYGRID2D_H
 #define RAYLIB_RAYGRID2D_H
 
+#include "../raygrid.h"
 #include "../rayutils.h"
 #include "raylib/raylibconfig.h"
 #include "raytrunks.h"
@@ -79,13 +80,13 @@ private:
 
 // A similar 2d grid structure, but this stores the ray indices per pixel
 // this is an acceleration structure that allows overlapping rays to be quickly accessed at any location
+// The ray indices are packed into one array (see ContiguousGrid::build), rather than a vector per pixel
 class RAYLIB_EXPORT RayIndexGrid2D
 {
 public:
   void init(const Eigen::Vector3d &min_bound, const Eigen::Vector3d &max_bound, double pixel_width);
   struct Pixel
   {
-    std::vector<int> ray_ids;
     bool filled;
   };
   inline Eigen::Vector3i pixelIndex(const Eigen::Vector3d &pos) const
@@ -113,6 +114,12 @@ public:
 
   // takes the filled cells and adds the ray ids that overlap these filled cells
   void fillRays(const Cloud &cloud);
+  // the ids of the rays that overlap the pixel at pos, in increasing order, after fillRays
+  inline ContiguousGrid<int>::Span rayIds(const Eigen::Vector3d &pos) const
+  {
+    const Eigen::Vector3i index = pixelIndex(pos);
+    return ray_ids_.values(Eigen::Vector3i(index[0], index[1], 0));
+  }
 
 private:
   Eigen::Vector3i dims_;       // dimensions of the grid. Only the first two elements are used here
@@ -120,6 +127,7 @@ private:
   double pixel_width_;         // pixel width
   std::vector<Pixel> pixels_;  // storing the 2D data contiguously as a vector
   Pixel dummy_pixel_;          // to allow return values (containing no data) for out-of-range locations
+  ContiguousGrid<int> ray_ids_;  // the ids of the rays overlapping each filled pixel, at z index 0
 };
 
 
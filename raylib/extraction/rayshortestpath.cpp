@@ -0,0 +1,46 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "rayshortestpath.h"
+#include <nabo/nabo.h>
+
+namespace ray
+{
+NeighbourGraph NeighbourGraph::build(const NeighbourIndex &index, int k, double max_radius)
+{
+  NeighbourGraph graph;
+  const Eigen::Index num_points = static_cast<Eigen::Index>(index.size());
+  graph.offsets.reserve(num_points + 1);
+  graph.offsets.push_back(0);
+  if (k <= 0)
+  {
+    graph.offsets.resize(num_points + 1, 0);
+    return graph;
+  }
+  // large enough for the searches to be split across threads, small enough that the dense results are a fraction
+  // of the graph
+  const Eigen::Index slice_size = 1 << 18;
+  Eigen::MatrixXi indices;
+  Eigen::MatrixXd dists2;
+  for (Eigen::Index begin = 0; begin < num_points; begin += slice_size)
+  {
+    const Eigen::Index end = std::min(num_points, begin + slice_size);
+    index.knn(index.points().middleCols(begin, end - begin), k, indices, dists2, kNearestNeighbourEpsilon,
+              max_radius);
+    for (Eigen::Index i = 0; i < end - begin; i++)
+    {
+      for (int j = 0; j < k && indices(j, i) != Nabo::NNSearchD::InvalidIndex; j++)
+      {
+        graph.neighbours.push_back(indices(j, i));
+        graph.dists2.push_back(dists2(j, i));
+      }
+      graph.offsets.push_back(graph.neighbours.size());
+    }
+  }
+  graph.neighbours.shrink_to_fit();
+  graph.dists2.shrink_to_fit();
+  return graph;
+}
+}  // namespace ray
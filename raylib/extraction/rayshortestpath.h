@@ -0,0 +1,139 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYSHORTESTPATH_H
+#define RAYLIB_RAYSHORTESTPATH_H
+
+#include "raylib/raylibconfig.h"
+
+#include "../rayneighbours.h"
+#include "../rayutils.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+namespace ray
+{
+/// A k nearest neighbour graph in compressed sparse row form. The neighbours of vertex @c i are
+/// @c neighbours[offsets[i]] to @c neighbours[offsets[i+1]-1] , in order of increasing squared distance @c dists2
+struct RAYLIB_EXPORT NeighbourGraph
+{
+  std::vector<size_t> offsets;
+  std::vector<int> neighbours;
+  std::vector<double> dists2;
+
+  /// the number of vertices in the graph
+  inline size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+  /// the index of the first neighbour of @c vertex
+  inline size_t begin(int vertex) const { return offsets[vertex]; }
+  /// one past the index of the last neighbour of @c vertex
+  inline size_t end(int vertex) const { return offsets[vertex + 1]; }
+
+  /// Build the graph of the @c k nearest neighbours of each point in @c index , within @c max_radius if it is
+  /// non-zero. The points are queried a slice at a time, so only the graph itself is held for every point
+  static NeighbourGraph build(const NeighbourIndex &index, int k, double max_radius = 0.0);
+};
+
+/// A monotone priority queue, for label setting shortest path searches. It pops the value with the least key, where
+/// keys are non-negative doubles and no key is pushed that is smaller than the last popped key. Keys are ordered by
+/// their bit patterns in a radix heap, so a push is constant time and a pop is amortised constant time per bit of key,
+/// compared to the logarithmic cost of a binary heap. Values with equal keys are popped in the reverse of their
+/// push order.
+template <class T>
+class MonotoneQueue
+{
+public:
+  MonotoneQueue()
+    : last_(0)
+    , size_(0)
+  {}
+
+  inline bool empty() const { return size_ == 0; }
+  inline size_t size() const { return size_; }
+
+  /// add @c value with priority @c key . A key below that of the last popped value is treated as equal to it
+  void push(double key, const T &value)
+  {
+    const uint64_t bits = std::max(keyBits(key), last_);
+    buckets_[bucket(bits)].push_back(Entry{ bits, value });
+    size_++;
+  }
+
+  /// the value with the least key. The queue must not be empty
+  const T &top()
+  {
+    if (buckets_[0].empty())
+    {
+      redistribute();
+    }
+    return buckets_[0].back().value;
+  }
+
+  /// remove the value with the least key. The queue must not be empty
+  void pop()
+  {
+    if (buckets_[0].empty())
+    {
+      redistribute();
+    }
+    buckets_[0].pop_back();
+    size_--;
+  }
+
+private:
+  struct Entry
+  {
+    uint64_t key;
+    T value;
+  };
+
+  /// the bit pattern of non-negative doubles sorts in the same order as the doubles
+  static inline uint64_t keyBits(double key)
+  {
+    key = std::max(key, 0.0);
+    uint64_t bits;
+    std::memcpy(&bits, &key, sizeof(bits));
+    return bits;
+  }
+  /// bucket 0 holds keys equal to the last popped key, and bucket b those that first differ from it in bit b-1
+  inline int bucket(uint64_t key) const
+  {
+    int b = 0;
+    for (uint64_t dif = key ^ last_; dif != 0; dif >>= 1)
+    {
+      b++;
+    }
+    return b;
+  }
+  /// move the least keys of the first non-empty bucket into bucket 0
+  void redistribute()
+  {
+    int b = 1;
+    while (buckets_[b].empty())
+    {
+      b++;
+    }
+    uint64_t least = buckets_[b][0].key;
+    for (const auto &entry : buckets_[b])
+    {
+      least = std::min(least, entry.key);
+    }
+    last_ = least;
+    std::vector<Entry> entries;
+    entries.swap(buckets_[b]);
+    for (auto &entry : entries)
+    {
+      buckets_[bucket(entry.key)].push_back(entry);
+    }
+  }
+
+  std::vector<Entry> buckets_[65];
+  uint64_t last_;
+  size_t size_;
+};
+}  // namespace ray
+
+#endif  // RAYLIB_RAYSHORTESTPATH_H
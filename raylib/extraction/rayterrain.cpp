@@ -9,17 +9,34 @@
 #include "../rayply.h"
 #include "../rayprogress.h"
 #include "../rayprogressthread.h"
+#include "../raythreads.h"
+
+#include <cstdio>
+#include <fstream>
+#include <unordered_map>
 
 #if RAYLIB_WITH_TBB
 #include <tbb/enumerable_thread_specific.h>
 #include <tbb/parallel_for.h>
 #endif  // RAYLIB_WITH_TBB
-static int num_visits = 0;
-static int num_cone_tests = 0;
 
 
 namespace ray
 {
+/// Counts of the work done in the pareto front calculation, kept per thread
+struct ParetoStatistics
+{
+  size_t num_visits = 0;
+  size_t num_cone_tests = 0;
+};
+
+/// An end point in a tile file of @c Terrain::extractTiled , with its index among the bounded rays of the input file
+struct TerrainPoint
+{
+  Eigen::Vector3d end;
+  uint64_t id;
+};
+
 /// The node structure used in calculating the pareto front
 struct Node
 {
@@ -45,9 +62,9 @@ struct Node
   int dir_ids[2][2][2];
 
   // returns whether there is a smaller node than the supplied @c corner point
-  bool somethingSmaller(std::vector<Node> &nodes, const Vector4d &corner)
+  bool somethingSmaller(std::vector<Node> &nodes, const Vector4d &corner, ParetoStatistics &stats)
   {
-    num_visits++;
+    stats.num_visits++;
 // This checks in a cone rather than just the corner of a cube shape that you would get
 // from a raw Pareto front calculation    
 #define CONE_CHECK  
@@ -59,7 +76,7 @@ struct Node
       {
         return false;
       }
-      return nodes[dir_ids[0][0][0]].somethingSmaller(nodes, corner);
+      return nodes[dir_ids[0][0][0]].somethingSmaller(nodes, corner, stats);
 #else
       return dir_ids[0][0][0] != -1;
 #endif
@@ -75,7 +92,7 @@ struct Node
     if (i == 0 && j == 0 && k == 0)  // corner is smaller, so deactivate current node
     {
 #if defined CONE_CHECK
-      num_cone_tests++;
+      stats.num_cone_tests++;
       const Eigen::Vector3d dir = -Eigen::Vector3d(dif[0], dif[1], dif[2]).normalized();
       if (dir.dot(diagonal) > cos_ang)
         found = 1;
@@ -86,7 +103,7 @@ struct Node
     else if (i == 1 && j == 1 && k == 1)  // corner is larger, so this node is indeed smaller
     {
 #if defined CONE_CHECK
-      num_cone_tests++;
+      stats.num_cone_tests++;
       const Eigen::Vector3d dir = Eigen::Vector3d(dif[0], dif[1], dif[2]).normalized();
       if (dir.dot(diagonal) > cos_ang)
       {
@@ -104,7 +121,7 @@ struct Node
         {
           if (dir_ids[I][J][K] != -1)
           {
-            if (nodes[dir_ids[I][J][K]].somethingSmaller(nodes, corner))
+            if (nodes[dir_ids[I][J][K]].somethingSmaller(nodes, corner, stats))
             {
               return true;
             }
@@ -116,7 +133,8 @@ struct Node
   }
 };
 
-/// construct an octal space partition tree
+/// construct an octal space partition tree. The tree is the one you get by inserting the points one at a time in a
+/// random order, but it is built one level at a time, partitioning the subtrees of each level in parallel with TBB
 void constructOctalSpacePartition(std::vector<Node> &nodes, std::vector<Vector4d> points)
 {
   nodes.resize(points.size());
@@ -128,25 +146,78 @@ void constructOctalSpacePartition(std::vector<Node> &nodes, std::vector<Vector4d
     points[ind] = points.back();
     points.pop_back();
   }
-  // n log n on average, for each node, trace the tree to add correct direction ids
+  if (nodes.size() < 2)
+  {
+    return;
+  }
+
+  // A subtree holds the nodes below its head, in insertion order. The first node in each octant of the head becomes
+  // the head of that octant's subtree, as it would were the nodes inserted in order.
+  struct Subtree
+  {
+    int head;
+    std::vector<int> ids;
+  };
+  std::vector<Subtree> level(1);
+  level[0].head = 0;
+  level[0].ids.resize(nodes.size() - 1);
   for (size_t n = 1; n < nodes.size(); n++)
   {
-    const Eigen::Vector4d &pos = nodes[n].pos;
-    int head = 0;
-    for (;;)
+    level[0].ids[n - 1] = static_cast<int>(n);
+  }
+  while (!level.empty())
+  {
+    std::vector<std::vector<Subtree>> children(level.size());
+    const auto partition = [&nodes, &level, &children](size_t s) {
+      Subtree &subtree = level[s];
+      Node &head = nodes[subtree.head];
+      std::vector<int> octants[2][2][2];
+      for (const auto &id : subtree.ids)
+      {
+        const Vector4d dif = nodes[id].pos - head.pos;
+        octants[dif[0] > 0.0][dif[1] > 0.0][dif[2] > 0.0].push_back(id);
+      }
+      subtree.ids = std::vector<int>();
+      for (int i = 0; i < 2; i++)
+      {
+        for (int j = 0; j < 2; j++)
+        {
+          for (int k = 0; k < 2; k++)
+          {
+            std::vector<int> &octant = octants[i][j][k];
+            if (octant.empty())
+            {
+              continue;
+            }
+            head.dir_ids[i][j][k] = octant[0];
+            if (octant.size() > 1)
+            {
+              Subtree child;
+              child.head = octant[0];
+              child.ids.assign(octant.begin() + 1, octant.end());
+              children[s].push_back(std::move(child));
+            }
+          }
+        }
+      }
+    };
+#if RAYLIB_WITH_TBB
+    tbb::parallel_for<size_t>(0, level.size(), partition);
+#else
+    for (size_t s = 0; s < level.size(); s++)
+    {
+      partition(s);
+    }
+#endif
+    std::vector<Subtree> next_level;
+    for (auto &child_list : children)
     {
-      const Vector4d dif = pos - nodes[head].pos;
-      const int i = static_cast<int>(dif[0] > 0.0);
-      const int j = static_cast<int>(dif[1] > 0.0);
-      const int k = static_cast<int>(dif[2] > 0.0);
-      const int new_head = nodes[head].dir_ids[i][j][k];
-      if (new_head == -1)
+      for (auto &child : child_list)
       {
-        nodes[head].dir_ids[i][j][k] = static_cast<int>(n);
-        break;
+        next_level.push_back(std::move(child));
       }
-      head = new_head;
     }
+    level = std::move(next_level);
   }
 }
 
@@ -162,26 +233,27 @@ void Terrain::getParetoFront(const std::vector<Vector4d> &points, std::vector<Ve
   ProgressThread progress_thread(progress);
   progress.begin("rays processed:", nodes.size());
 
-  const auto process_rays = [&nodes, &root, &front, &progress](size_t n) {
-    progress.increment();
+#if RAYLIB_WITH_TBB
+  tbb::enumerable_thread_specific<ParetoStatistics> thread_stats;
+#else
+  ParetoStatistics stats;
+#endif
+  const auto process_rays = [&](size_t n) {
     if (nodes[n].found == 1)
     {
       return;
     }
-    bool dominated = root.somethingSmaller(nodes, nodes[n].pos);
+#if RAYLIB_WITH_TBB
+    ParetoStatistics &stats = thread_stats.local();
+#endif
+    bool dominated = root.somethingSmaller(nodes, nodes[n].pos, stats);
     if (dominated)
       nodes[n].found = 1;
     else
       nodes[n].is_set = 1;
   };
-#if RAYLIB_WITH_TBB
-  tbb::parallel_for<size_t>(0, nodes.size(), process_rays);
-#else
-  for (size_t n = 0; n < nodes.size(); n++)
-  {
-    process_rays(n);
-  }
-#endif
+  // the progress is counted per range of nodes, so that the threads do not contend on it
+  parallelFor(size_t(0), nodes.size(), process_rays, &progress);
   for (auto &node : nodes)
   {
     if (node.is_set)
@@ -192,13 +264,20 @@ void Terrain::getParetoFront(const std::vector<Vector4d> &points, std::vector<Ve
   progress.end();
   progress_thread.requestQuit();
   progress_thread.join();
-  std::cout << "number of rays: " << points.size() << ", number of visits: " << num_visits
-            << ", number of cone tests: " << num_cone_tests << std::endl;
+#if RAYLIB_WITH_TBB
+  ParetoStatistics stats;
+  for (const auto &local : thread_stats)
+  {
+    stats.num_visits += local.num_visits;
+    stats.num_cone_tests += local.num_cone_tests;
+  }
+#endif
+  std::cout << "number of rays: " << points.size() << ", number of visits: " << stats.num_visits
+            << ", number of cone tests: " << stats.num_cone_tests << std::endl;
 }
 
-void Terrain::growUpwards(const std::vector<Eigen::Vector3d> &positions, double gradient)
+void Terrain::growUpwards(const std::vector<Eigen::Vector3d> &positions, double gradient, std::vector<int> *vertex_ids)
 {
-#if RAYLIB_WITH_QHULL
   // The idea behind ground extraction is to tilt the upwards vector to the (1,1,1) direction then 
   // find the Pareto front in the three principle axes. https://en.wikipedia.org/wiki/Pareto_front
   //
@@ -254,7 +333,14 @@ void Terrain::growUpwards(const std::vector<Eigen::Vector3d> &positions, double
 
   mesh_.indexList() = hull.mesh().indexList();
   mesh_.vertices() = vecs;
-#endif
+  if (vertex_ids)
+  {
+    vertex_ids->resize(front.size());
+    for (size_t i = 0; i < front.size(); i++)
+    {
+      (*vertex_ids)[i] = static_cast<int>(front[i][3]);  // the count, offset by a half
+    }
+  }
 }
 
 void Terrain::growDownwards(const std::vector<Eigen::Vector3d> &positions, double gradient)
@@ -274,9 +360,9 @@ void Terrain::growDownwards(const std::vector<Eigen::Vector3d> &positions, doubl
 
 // a faster version of the growupwards algorithm
 void Terrain::growUpwardsFast(const std::vector<Eigen::Vector3d> &ends, double pixel_width,
-                              const Eigen::Vector3d &min_bound, const Eigen::Vector3d &max_bound, double gradient)
+                              const Eigen::Vector3d &min_bound, const Eigen::Vector3d &max_bound, double gradient,
+                              std::vector<int> *vertex_ids)
 {
-#if RAYLIB_WITH_QHULL
   // the speed up is one of removing lots of 'above ground' points before running the growUpwards function
   // thereby making the problem size smaller.
 
@@ -305,6 +391,7 @@ void Terrain::growUpwardsFast(const std::vector<Eigen::Vector3d> &ends, double p
   }
 
   std::vector<Eigen::Vector3d> points;
+  std::vector<int> point_ids;
   // then for each point
   for (size_t i = 0; i < ends.size(); i++)
   {
@@ -344,17 +431,23 @@ void Terrain::growUpwardsFast(const std::vector<Eigen::Vector3d> &ends, double p
     }
 
     points.push_back(p);
+    point_ids.push_back(static_cast<int>(i));
   }
   std::cout << "size before: " << ends.size() << ", size after: " << points.size() << std::endl;
 
-  growUpwards(points, gradient);
-#endif
+  growUpwards(points, gradient, vertex_ids);
+  if (vertex_ids)
+  {
+    for (auto &id : *vertex_ids)
+    {
+      id = point_ids[id];
+    }
+  }
 }
 
 // Convert the @c cloud input to the mesh_ member variable. 
 void Terrain::extract(const Cloud &cloud, const std::string &file_prefix, double gradient, bool verbose)
 {
-#if RAYLIB_WITH_QHULL
   // preprocessing to make the cloud smaller.
   Eigen::Vector3d min_bound, max_bound;
   cloud.calcBounds(&min_bound, &max_bound);
@@ -370,7 +463,11 @@ void Terrain::extract(const Cloud &cloud, const std::string &file_prefix, double
   }
   growUpwardsFast(ends, pixel_width, min_bound, max_bound, gradient);
   mesh_.reduce();  // remove disconnected vertices in the mesh
+  save(file_prefix, verbose);
+}
 
+void Terrain::save(const std::string &file_prefix, bool verbose) const
+{
   writePlyMesh(file_prefix + "_mesh.ply", mesh_, true);
   if (verbose)  // debugging output
   {
@@ -384,6 +481,200 @@ void Terrain::extract(const Cloud &cloud, const std::string &file_prefix, double
     }
     local_cloud.save(file_prefix + "_terrain.ply");
   }
+}
+
+bool Terrain::extractTiled(const std::string &file_name, const std::string &file_prefix, double gradient,
+                           double tile_width, double overlap, bool verbose)
+{
+  Cloud::Info info;
+  if (!Cloud::getInfo(file_name, info))
+  {
+    return false;
+  }
+  if (info.num_bounded == 0)
+  {
+    std::cerr << "Error: no bounded rays in " << file_name << " to extract terrain from" << std::endl;
+    return false;
+  }
+  // the pixel width is estimated once, so that all tiles share it
+  const double pixel_width = 2.0 * Cloud::estimatePointSpacing(file_name, info.ends_bound, info.num_bounded);
+  if (overlap <= 0.0)
+  {
+    overlap = 0.1 * tile_width;
+  }
+  const Eigen::Vector3d min_bound = info.ends_bound.min_bound_;
+  const Eigen::Vector3d max_bound = info.ends_bound.max_bound_;
+  int dims[2];
+  for (int k = 0; k < 2; k++)
+  {
+    dims[k] = std::max(1, static_cast<int>(std::ceil((max_bound[k] - min_bound[k]) / tile_width)));
+  }
+  const int num_tiles = dims[0] * dims[1];
+  const int max_allowable_tiles = 1024;  // operating systems will fail with too many open file pointers.
+  std::cout << "extracting terrain in " << num_tiles << " tiles" << std::endl;
+  if (num_tiles > max_allowable_tiles)
+  {
+    std::cout << "Error: more tiles than the maximum of " << max_allowable_tiles << ", use a larger tile width."
+              << std::endl;
+    return false;
+  }
+  // the tile index on axis k of coordinate x, clamped to the tiles
+  auto tile_coord = [&](double x, int k) {
+    return std::max(0, std::min(static_cast<int>(std::floor((x - min_bound[k]) / tile_width)), dims[k] - 1));
+  };
+  auto owner = [&](double x, double y) { return tile_coord(x, 0) + dims[0] * tile_coord(y, 1); };
+  const std::string stub = file_name.substr(0, file_name.find_last_of('.'));
+  auto tile_file = [&stub](int tile) { return stub + "_terrain_tile_" + std::to_string(tile) + ".points"; };
+
+  // 1. copy each bounded end point into the file of each padded tile that contains it
+  std::vector<std::ofstream> tile_points(num_tiles);
+  std::vector<size_t> tile_point_counts(num_tiles, 0);
+  uint64_t point_count = 0;
+  auto split_chunk = [&](std::vector<Eigen::Vector3d> &, std::vector<Eigen::Vector3d> &ends, std::vector<double> &,
+                         std::vector<RGBA> &colours) {
+    for (size_t i = 0; i < ends.size(); i++)
+    {
+      if (colours[i].alpha == 0)
+      {
+        continue;
+      }
+      const TerrainPoint point = { ends[i], point_count++ };
+      for (int y = tile_coord(ends[i][1] - overlap, 1); y <= tile_coord(ends[i][1] + overlap, 1); y++)
+      {
+        for (int x = tile_coord(ends[i][0] - overlap, 0); x <= tile_coord(ends[i][0] + overlap, 0); x++)
+        {
+          const int tile = x + dims[0] * y;
+          if (!tile_points[tile].is_open())
+          {
+            tile_points[tile].open(tile_file(tile), std::ios::binary | std::ios::out);
+          }
+          writePlainOldData(tile_points[tile], point);
+          tile_point_counts[tile]++;
+        }
+      }
+    }
+  };
+  bool success = Cloud::read(file_name, split_chunk);
+  for (auto &out : tile_points)
+  {
+    out.close();
+  }
+
+  // 2. extract each tile's mesh, keeping the triangles whose centroid lies in the tile. The vertices are labelled by
+  // their point index in the file, so that the tiles can be stitched together where they share vertices
+  struct TileMesh
+  {
+    std::vector<Eigen::Vector3d> vertices;
+    std::vector<uint64_t> vertex_ids;
+    std::vector<Eigen::Vector3i> triangles;
+    bool loaded = true;
+  };
+  std::vector<TileMesh> tile_meshes(num_tiles);
+  const auto extract_tile = [&](int tile) {
+    if (tile_point_counts[tile] == 0)
+    {
+      return;
+    }
+    TileMesh &tile_mesh = tile_meshes[tile];
+    std::vector<Eigen::Vector3d> ends(tile_point_counts[tile]);
+    std::vector<uint64_t> ids(tile_point_counts[tile]);
+    Eigen::Vector3d tile_min(std::numeric_limits<double>::max(), std::numeric_limits<double>::max(),
+                             std::numeric_limits<double>::max());
+    Eigen::Vector3d tile_max = -tile_min;
+    std::ifstream in(tile_file(tile), std::ios::binary | std::ios::in);
+    TerrainPoint point;
+    for (size_t i = 0; i < ends.size(); i++)
+    {
+      readPlainOldData(in, point);
+      ends[i] = point.end;
+      ids[i] = point.id;
+      tile_min = minVector(tile_min, point.end);
+      tile_max = maxVector(tile_max, point.end);
+    }
+    tile_mesh.loaded = !in.fail();
+    in.close();
+    std::remove(tile_file(tile).c_str());
+    if (!tile_mesh.loaded)
+    {
+      return;
+    }
+
+    Terrain terrain;
+    std::vector<int> vertex_ids;
+    terrain.growUpwardsFast(ends, pixel_width, tile_min, tile_max + Eigen::Vector3d::Constant(pixel_width), gradient,
+                            &vertex_ids);
+    const std::vector<Eigen::Vector3d> &vertices = terrain.mesh().vertices();
+    std::vector<int> new_ids(vertices.size(), -1);
+    for (const auto &triangle : terrain.mesh().indexList())
+    {
+      const Eigen::Vector3d centroid = (vertices[triangle[0]] + vertices[triangle[1]] + vertices[triangle[2]]) / 3.0;
+      if (owner(centroid[0], centroid[1]) != tile)
+      {
+        continue;
+      }
+      Eigen::Vector3i new_triangle;
+      for (int j = 0; j < 3; j++)
+      {
+        int &new_id = new_ids[triangle[j]];
+        if (new_id == -1)
+        {
+          new_id = static_cast<int>(tile_mesh.vertices.size());
+          tile_mesh.vertices.push_back(vertices[triangle[j]]);
+          tile_mesh.vertex_ids.push_back(ids[vertex_ids[triangle[j]]]);
+        }
+        new_triangle[j] = new_id;
+      }
+      tile_mesh.triangles.push_back(new_triangle);
+    }
+  };
+  if (success)
+  {
+#if RAYLIB_WITH_TBB
+    tbb::parallel_for(0, num_tiles, extract_tile);
+#else
+    for (int tile = 0; tile < num_tiles; tile++)
+    {
+      extract_tile(tile);
+    }
 #endif
+  }
+  for (int tile = 0; tile < num_tiles; tile++)
+  {
+    if (tile_point_counts[tile] > 0)
+    {
+      std::remove(tile_file(tile).c_str());  // any left after a failure
+    }
+    success = success && tile_meshes[tile].loaded;
+  }
+  if (!success)
+  {
+    return false;
+  }
+
+  // 3. stitch the tile meshes together, in tile order, merging the vertices that they share
+  mesh_ = Mesh();
+  std::unordered_map<uint64_t, int> mesh_ids;
+  for (auto &tile_mesh : tile_meshes)
+  {
+    std::vector<int> new_ids(tile_mesh.vertices.size());
+    for (size_t i = 0; i < tile_mesh.vertices.size(); i++)
+    {
+      const auto found = mesh_ids.insert(std::make_pair(tile_mesh.vertex_ids[i], (int)mesh_.vertices().size()));
+      if (found.second)
+      {
+        mesh_.vertices().push_back(tile_mesh.vertices[i]);
+      }
+      new_ids[i] = found.first->second;
+    }
+    for (const auto &triangle : tile_mesh.triangles)
+    {
+      mesh_.indexList().push_back(Eigen::Vector3i(new_ids[triangle[0]], new_ids[triangle[1]], new_ids[triangle[2]]));
+    }
+    tile_mesh = TileMesh();
+  }
+  std::cout << "stitched terrain mesh: " << mesh_.vertices().size() << " vertices, " << mesh_.indexList().size()
+            << " triangles" << std::endl;
+  save(file_prefix, verbose);
+  return true;
 }
 }  // namespace ray
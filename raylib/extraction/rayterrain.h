@@ -29,19 +29,34 @@ public:
   /// The output is the stored mesh, which is accessed with the mesh() accessor.
   void extract(const Cloud &cloud, const std::string &file_prefix, double gradient, bool verbose);
 
-  /// Direct extraction of the pareto front points
-  void growUpwards(const std::vector<Eigen::Vector3d> &positions, double gradient);
+  /// Out-of-core form of @c extract , for ray cloud files too large to hold in memory. The end points of
+  /// @c file_name are streamed into square tiles of @c tile_width in x and y, each holding the points within
+  /// @c overlap of it (zero uses a tenth of @c tile_width ). The tiles are extracted independently, in parallel with
+  /// TBB, and each keeps the triangles whose centroid it owns. Tiles share the vertices that they have in common,
+  /// so the result is one stitched mesh, which is seamless where @c overlap exceeds the size of the border triangles.
+  /// Peak memory is that of the largest tiles. Temporary tile files are written next to the input.
+  bool extractTiled(const std::string &file_name, const std::string &file_prefix, double gradient, double tile_width,
+                    double overlap = 0.0, bool verbose = false);
+
+  /// Direct extraction of the pareto front points. @c vertex_ids optionally returns the index in @c positions of
+  /// each mesh vertex
+  void growUpwards(const std::vector<Eigen::Vector3d> &positions, double gradient,
+                   std::vector<int> *vertex_ids = nullptr);
   void growDownwards(const std::vector<Eigen::Vector3d> &positions, double gradient);
 
-  /// performs voxel-based culling prior to growing upwards
+  /// performs voxel-based culling prior to growing upwards. @c vertex_ids optionally returns the index in @c ends
+  /// of each mesh vertex
   void growUpwardsFast(const std::vector<Eigen::Vector3d> &ends, double pixel_width, const Eigen::Vector3d &min_bound,
-                       const Eigen::Vector3d &max_bound, double gradient);
+                       const Eigen::Vector3d &max_bound, double gradient, std::vector<int> *vertex_ids = nullptr);
 
   /// access the generated mesh
   Mesh &mesh() { return mesh_; }
   const Mesh &mesh() const { return mesh_; }
 
 private:
+  /// write the mesh, and in @c verbose mode its vertices as a cloud
+  void save(const std::string &file_prefix, bool verbose) const;
+
   Mesh mesh_;
   static void getParetoFront(const std::vector<Vector4d> &points, std::vector<Vector4d> &front);
 };
@@ -1,833 +1,1360 @@
-// Copyright (c) 2022
-// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
-// ABN 41 687 119 230
-//
-// Author: Thomas Lowe
-#include "raytrees.h"
-#include <nabo/nabo.h>
-#include "../raydebugdraw.h"
-#include "rayclusters.h"
-
-namespace ray
-{
-TreesParams::TreesParams()
-  : max_diameter(0.9)
-  , min_diameter(0.02)
-  , distance_limit(1.0)
-  , height_min(2.0)
-  , length_to_radius(140.0)
-  , cylinder_length_to_width(4.0)
-  , gap_ratio(2.5)
-  , span_ratio(4.5)
-  , gravity_factor(0.3)
-  , radius_exponent(0.67)
-  , linear_range(3.0)
-  , grid_width(0.0)
-  , segment_branches(false)
-{}
-
-/// The main reconstruction algorithm
-/// It is based on finding the shortest paths using Djikstra's algorithm, followed
-/// by an agglomeration of paths, with repeated splitting from root to tips
-Trees::Trees(Cloud &cloud, const Mesh &mesh, const TreesParams &params, bool verbose)
-{
-  // firstly, get the full set of shortest paths from ground to tips, and the set of roots
-  params_ = &params;
-
-  // cache an often used branch tapering value
-  const double radius_at_min = params_->linear_range / params_->length_to_radius;
-  const double unscaled_rad = std::pow(radius_at_min, params_->radius_exponent);
-  // length = scale_factor * rad^radius_exponent
-  radius_length_scale_ = unscaled_rad / params_->linear_range;
-
-  std::vector<std::vector<int>> roots_list = getRootsAndSegment(
-    points_, cloud, mesh, params_->max_diameter, params_->distance_limit, params_->height_min, params_->gravity_factor);
-
-  // Now we want to convert these paths into a set of branch sections, from root to tips
-  // splitting as we go up...
-
-  // calculate the maximum distance to tip for every point in the cloud
-  calculatePointDistancesToEnd();
-
-  // then generate all the root sections
-  generateRootSections(roots_list);
-
-  // the set of child points will be useful later, so generate them now
-  std::vector<std::vector<int>> children(points_.size());
-  for (size_t i = 0; i < points_.size(); i++)
-  {
-    if (points_[i].parent != -1)
-    {
-      children[points_[i].parent].push_back(static_cast<int>(i));
-    }
-  }
-
-  // now trace from root tree nodes upwards, getting node centroids
-  // create new BranchSections as we go
-  for (sec_ = 0; sec_ < sections_.size(); sec_++)
-  {
-    if (!(sec_ % 10000))
-    {
-      std::cout << "generating segment " << sec_ << std::endl;
-    }
-    const int par = sections_[sec_].parent;
-
-    // any estimate of branch radius is bounded from above by an estimate from the branch's length
-    // estimates from length are more reliable on small branches, and less reliable on large, well
-    // observed trunks.
-    max_radius_ = radFromLength(sections_[sec_].max_distance_to_end);
-
-    // this branch can come to an end as it is now too small
-    if (max_radius_ < 0.5 * params_->min_diameter)
-    {
-      setBranchTip();
-      continue;
-    }
-
-    std::vector<int> nodes;  // all the points in the section
-    bool extract_from_ends = sections_[sec_].ends.size() > 0;
-    // if the branch section has no end points recorded, then we need to examine this branch to
-    // find end points and potentially branch (bifurcate)
-    if (!extract_from_ends)
-    {
-      Eigen::Vector3d base = getRootPosition();
-      extractNodesAndEndsFromRoots(nodes, base, children);
-      bool points_removed = false;
-      std::vector<std::vector<int>> clusters = findPointClusters(base, points_removed);
-
-      if (clusters.size() > 1 || (points_removed && clusters.size() > 0))  // a bifurcation (or an alteration)
-      {
-        extract_from_ends = true;
-        nodes.clear();  // don't trust the found nodes as it is now two separate tree nodes
-        // if points have been removed then this only resets the current section's points
-        // otherwise it creates new branch sections_ for each cluster and adds to the end of the sections_ list
-        bifurcate(clusters);
-        // update the max_radius, since the points have changed
-        max_radius_ = radFromLength(sections_[sec_].max_distance_to_end);
-      }
-    }
-
-    // we have split the ends, so we need to extract the set of nodes in a backwards manner
-    if (extract_from_ends)
-    {
-      extractNodesFromEnds(nodes);
-    }
-
-    // estimate the section's tip (the centre of the cylinder of points)
-    sections_[sec_].tip = calculateTipFromVertices(nodes);
-    // get section's direction
-    Eigen::Vector3d dir = par >= 0 ? (sections_[sec_].tip - sections_[par].tip).normalized() : Eigen::Vector3d(0, 0, 1);
-    // shift to cylinder's centre
-    sections_[sec_].tip += vectorToCylinderCentre(nodes, dir);
-    // now find the segment radius
-    sections_[sec_].radius = estimateCylinderRadius(nodes, dir);
-
-    // now add the single child for this particular tree node, assuming there are still ends
-    if (sections_[sec_].ends.size() > 0)
-    {
-      addChildSection();
-    }
-  }  // end of loop. We now have created all of the BranchSections
-
-  // Now calculate the section ids for all of the points, for the segmented cloud
-  std::vector<int> section_ids(points_.size(), -1);
-  calculateSectionIds(roots_list, section_ids, children);
-
-  // debug draw to rviz the set of cylinders
-  drawTrees(verbose);
-
-  generateLocalSectionIds();
-
-  Eigen::Vector3d min_bound(0, 0, 0), max_bound(0, 0, 0);
-  // remove all sections with a root out of bounds, if we have gridded the cloud with an overlap
-  if (params_->grid_width)
-  {
-    removeOutOfBoundSections(cloud, min_bound, max_bound);
-  }
-
-  std::vector<int> root_segs(cloud.ends.size(), -1);
-  // now colour the ray cloud based on the segmentation
-  segmentCloud(cloud, root_segs, section_ids);
-
-  if (params_->grid_width)  // also remove rays from the segmented cloud
-  {
-    removeOutOfBoundRays(cloud, min_bound, max_bound, root_segs);
-  }
-}
-
-/// calculate a branch radius from its length. We use allometric scaling based on a radius exponent and a
-/// linear range for the final taper of the branch
-/// See "Allometric patterns in Acer platanoides (Aceraceae) branches" for real world data
-double Trees::radFromLength(double length) const
-{
-  if (length < params_->linear_range)
-  {
-    return length / params_->length_to_radius;
-  }
-  // length = scale_factor * rad^radius_exponent
-  return std::pow(length * radius_length_scale_, 1.0 / params_->radius_exponent);
-}
-
-void Trees::calculatePointDistancesToEnd()
-{
-  for (size_t i = 0; i < points_.size(); i++)
-  {
-    int id = static_cast<int>(i);
-    int parent = points_[i].parent;
-    points_[i].visited = false;  // reset the visited flag while we're here
-    while (parent != -1)
-    {
-      const double end_dist =
-        points_[id].distance_to_end + (points_[id].distance_to_ground - points_[parent].distance_to_ground);
-      if (points_[parent].distance_to_end > end_dist)
-      {
-        break;
-      }
-      points_[parent].distance_to_end = end_dist;
-      id = parent;
-      parent = points_[id].parent;
-    }
-  }
-}
-
-// generate the initial branch sections, which are the root locations, defined by @c roots_list
-// we also fill in the @c section_ids, which record which section each point belongs to
-void Trees::generateRootSections(const std::vector<std::vector<int>> &roots_list)
-{
-  // first we initialise to one branch section per root
-  for (size_t i = 0; i < roots_list.size(); i++)
-  {
-    BranchSection base;
-    base.roots = roots_list[i];
-    sections_.push_back(base);
-  }
-
-  // we can now find the maximum distance to tip per root section, which allows us to estimate the
-  // section radius for all the root sections.
-  for (int i = static_cast<int>(sections_.size()) - 1; i >= 0; i--)
-  {
-    for (auto &root : sections_[i].roots)
-    {
-      sections_[i].max_distance_to_end = std::max(sections_[i].max_distance_to_end, points_[root].distance_to_end);
-    }
-    sections_[i].radius = radFromLength(sections_[i].max_distance_to_end);
-  }
-}
-
-void Trees::setBranchTip()
-{
-  // before we finish, we need to calculate the tip of this branch, from its end points
-  sections_[sec_].tip.setZero();
-  for (auto &i : sections_[sec_].ends)
-  {
-    sections_[sec_].tip += points_[i].pos;
-  }
-  size_t sum = sections_[sec_].ends.size();
-  // if it doesnt have end points then we'll have to use the root points
-  if (sections_[sec_].ends.empty())
-  {
-    for (auto &i : sections_[sec_].roots)
-    {
-      sections_[sec_].tip += points_[i].pos;
-    }
-    sum = sections_[sec_].roots.size();
-  }
-  if (sum > 0)
-  {
-    sections_[sec_].tip /= static_cast<double>(sum);
-  }
-}
-
-Eigen::Vector3d Trees::getRootPosition() const
-{
-  // get a base position for the section
-  Eigen::Vector3d base(0, 0, 0);
-  for (auto &root : sections_[sec_].roots)
-  {
-    base += points_[root].pos;
-  }
-  base /= static_cast<double>(sections_[sec_].roots.size());
-  return base;
-}
-
-// find the node and end points for this section, from the root points
-// return the base point (average of roots)
-void Trees::extractNodesAndEndsFromRoots(std::vector<int> &nodes, const Eigen::Vector3d &base,
-                                         const std::vector<std::vector<int>> &children)
-{
-  const double thickness = params_->cylinder_length_to_width * max_radius_;
-  const double thickness_sqr = thickness * thickness;
-  const int par = sections_[sec_].parent;
-
-  nodes = sections_[sec_].roots;
-  // 2. find all the points (and the end points) for this section:
-  for (unsigned int index = 0; index < nodes.size(); index++)
-  {
-    // we cannot use the for (int i: nodes) syntax above, as we are pushing into nodes as we go
-    const int i = nodes[index];
-    for (auto &child : children[i])
-    {
-      const double dist_sqr =
-        par == -1 ? sqr(points_[child].pos[2] - base[2]) : (points_[child].pos - base).squaredNorm();
-      if (dist_sqr < thickness_sqr)  // in same slot, so accumulate
-      {
-        nodes.push_back(child);  // so we recurse on this child too
-      }
-      else
-      {
-        sections_[sec_].ends.push_back(child);
-      }
-    }
-  }
-}
-
-// find clusters of points from the root points up the shortest paths, up to the cylinder length
-std::vector<std::vector<int>> Trees::findPointClusters(const Eigen::Vector3d &base, bool &points_removed)
-{
-  const double thickness = params_->cylinder_length_to_width * max_radius_;
-  const int par = sections_[sec_].parent;
-
-  std::vector<int> all_ends = sections_[sec_].ends;
-  // 3. cluster end points to find if we have separate branches
-  // first, get interpolated edge points_. i.e. interpolate between two connected points inside and outside
-  // the branch section's cylinder, so that the set edge_pos are right on the top boundary of the section
-  for (auto &j : all_ends)
-  {
-    const double dist1j = par == -1 ? points_[j].pos[2] - base[2] : (points_[j].pos - base).norm();
-    const double dist0j =
-      par == -1 ? points_[points_[j].parent].pos[2] - base[2] : (points_[points_[j].parent].pos - base).norm();
-    const double blendj = (thickness - dist0j) / (dist1j - dist0j);
-    points_[j].edge_pos = points_[points_[j].parent].pos * (1.0 - blendj) + points_[j].pos * blendj;
-  }
-  // convert to a structure that is better for the cluster function
-  std::vector<Eigen::Vector3d> ps;
-  std::vector<int> v_indices;
-  ps.reserve(all_ends.size());
-  v_indices.reserve(all_ends.size());
-  for (auto i : all_ends)
-  {
-    ps.push_back(points_[i].edge_pos);
-    v_indices.push_back(i);
-  }
-  // cluster these end points based on two separation criteria (gap_ratio and span_ratio)
-  std::vector<std::vector<int>> clusters;
-  generateClusters(clusters, ps, params_->gap_ratio * max_radius_, params_->span_ratio * max_radius_);
-  // adjust back to global ids
-  for (auto &cluster : clusters)
-  {
-    for (auto &id : cluster)
-    {
-      id = v_indices[id];
-    }
-  }
-
-  points_removed = false;
-  if (par == -1)  // if this is the root section
-  {
-    // then remove children that are smaller than the minimum tree height
-    for (int i = static_cast<int>(clusters.size()) - 1; i >= 0; i--)
-    {
-      double max_dist = 0.0;
-      for (auto &end : clusters[i])
-      {
-        max_dist = std::max(max_dist, points_[end].distance_to_end);
-      }
-      if (max_dist < params_->height_min)
-      {
-        clusters[i] = clusters.back();
-        clusters.pop_back();
-        points_removed = true;
-      }
-    }
-  }
-  return clusters;
-}
-
-// split into multiple branches and add as new branch sections to the end of the sections_ list
-// that is being iterated through.
-void Trees::bifurcate(const std::vector<std::vector<int>> &clusters)
-{
-  const double thickness = params_->cylinder_length_to_width * max_radius_;
-  const int par = sections_[sec_].parent;
-  // find the maximum distance (to tip) for each cluster
-  std::vector<double> max_distances(clusters.size(), 0.0);
-  double maxmax = -1;
-  int maxi = -1;
-  for (size_t i = 0; i < clusters.size(); i++)
-  {
-    for (auto &end : clusters[i])
-    {
-      max_distances[i] = std::max(max_distances[i], points_[end].distance_to_end);
-    }
-    if (max_distances[i] > maxmax)
-    {
-      maxmax = max_distances[i];
-      maxi = static_cast<int>(i);
-    }
-  }
-  
-  // set the current branch section to the cluster with the
-  // maximum distance to tip (i.e. the longest branch).
-  sections_[sec_].ends = clusters[maxi];
-  sections_[sec_].max_distance_to_end = max_distances[maxi] + thickness;
-
-  // for all other clusters, add new sections to the list...
-  for (size_t i = 0; i < clusters.size(); i++)
-  {
-    if (static_cast<int>(i) == maxi)
-    {
-      continue;
-    }
-    BranchSection new_node = sections_[sec_];
-    new_node.max_distance_to_end = max_distances[i] + thickness;
-    const double maxrad = radFromLength(new_node.max_distance_to_end);
-    if (maxrad > 0.5 * params_->min_diameter)  // but only add if they are large enough
-    {
-      // we only specify the end points at this stage. They will therefore enter the
-      // extract_from_ends block below when the sec_ for loop gets to their section
-      new_node.ends = clusters[i];
-      if (par != -1)
-      {
-        sections_[par].children.push_back(static_cast<int>(sections_.size()));
-      }
-      sections_.push_back(new_node);
-    }
-  }
-}
-
-// find the nodes between the section end points and the section root points
-void Trees::extractNodesFromEnds(std::vector<int> &nodes)
-{
-  for (auto &end : sections_[sec_].ends)
-  {
-    int node = points_[end].parent;
-    if (node == -1)
-    {
-      std::cout << "shouldn't be parentless here" << std::endl;
-      continue;
-    }
-    while (node != -1)
-    {
-      if (std::find(nodes.begin(), nodes.end(), node) != nodes.end())
-      {
-        break;
-      }
-      nodes.push_back(node);  // fill in the nodes in this branch section
-      if (std::find(sections_[sec_].roots.begin(), sections_[sec_].roots.end(), node) != sections_[sec_].roots.end())
-      {
-        break;
-      }
-      node = points_[node].parent;
-    }
-  }
-}
-
-// use the list of Vertex IDs to estimate a tip location
-Eigen::Vector3d Trees::calculateTipFromVertices(const std::vector<int> &vertices) const
-{
-  Eigen::Vector3d tip(0, 0, 0);
-  if (vertices.empty())
-  {
-    std::cout << "error: there shouldn't be empty nodes at this point in the processing" << std::endl;
-  }
-  // this code is a backup. If the error above is never called then it is just list = vertices
-  auto &list = vertices.empty() ? (sections_[sec_].ends.empty() ? sections_[sec_].roots : sections_[sec_].ends) : vertices;
-
-  for (auto &i : list)
-  {
-    tip += points_[i].pos;
-  }
-  if (!list.empty())
-  {
-    tip /= static_cast<double>(list.size());
-  }
-  return tip;
-}
-
-Eigen::Vector3d Trees::vectorToCylinderCentre(const std::vector<int> &nodes, const Eigen::Vector3d &dir) const
-{
-#define REAL_CENTROID  // finds a new centroid that is robust to branches scanned from a single side
-#if defined REAL_CENTROID
-  const int par = sections_[sec_].parent;
-  Eigen::Vector3d mean_p(0, 0, 0);
-  std::vector<Eigen::Vector3d> ps;
-  const Eigen::Vector3d vec(1, 2, 3);
-  // obtain two orthogonal planes to the section's direction vector
-  const Eigen::Vector3d ax1 = dir.cross(vec).normalized();
-  const Eigen::Vector3d ax2 = dir.cross(ax1).normalized();
-  double n = 0;
-  // iterate over the nodes and the ends points_...
-  const int start_ii = par >= 0 || sections_[sec_].ends.empty() ? 0 : 1;
-  for (int ii = start_ii; ii < 2; ii++)
-  {
-    const std::vector<int> &node_list = ii == 0 ? nodes : sections_[sec_].ends;
-    // project points into a local space parabola
-    for (auto &i : node_list)
-    {
-      const Eigen::Vector3d pos = points_[i].pos - sections_[sec_].tip;
-      const Eigen::Vector2d offset(ax1.dot(pos), ax2.dot(pos));
-      const Eigen::Vector2d xy = offset / sections_[sec_].radius;
-      const double l2 = xy.squaredNorm();
-      const Eigen::Vector3d point(xy[0], xy[1], 0.5 * l2);  // a paraboloid that has gradient 1 at 1
-      ps.push_back(point);
-      mean_p += point;
-      n++;
-    }
-  }
-  mean_p /= n;
-  if (n > 5)  // assuming there are sufficient points for a resonable guess
-  {
-    // accumulation structure for plane least squares fitting
-    struct Acc
-    {
-      Acc() { x2 = y2 = xy = xz = yz = 0; }
-      double x2, y2, xy, xz, yz;
-    };
-    Acc plane;
-    for (const auto &p : ps)
-    {
-      // fill in the parameters to estimate the plane of best fit to the paraboloid
-      Eigen::Vector3d q = p - mean_p;
-      plane.x2 += q[0] * q[0];
-      plane.y2 += q[1] * q[1];
-      plane.xy += q[0] * q[1];
-      plane.xz += q[0] * q[2];
-      plane.yz += q[1] * q[2];
-    }
-    const double eps = 1e-10;
-    // is the plane is well-determined
-    if (std::abs(plane.x2 * plane.y2 - plane.xy * plane.xy) > eps && std::abs(plane.y2) > eps)
-    {
-      // extract the local plane parameters
-      const double A = (plane.xz * plane.y2 - plane.yz * plane.xy) / (plane.x2 * plane.y2 - plane.xy * plane.xy);
-      const double B = (plane.yz - A * plane.xy) / plane.y2;
-
-      Eigen::Vector2d shift(A, B);
-      const double shift2 = shift.squaredNorm();
-      if (par >= 0 && shift2 > 1.0)  // don't shift more than one radius each iteration, for safety
-      {
-        shift /= std::sqrt(shift2);
-      }
-
-      // apply the plane parameters as a world-space shift in the branch section tip position
-      return (ax1 * shift[0] + ax2 * shift[1]) * sections_[sec_].radius;
-    }
-  }
-  else if (n > 0)  // if only a few points then use the mean instead
-  {
-    return (ax1 * mean_p[0] + ax2 * mean_p[1]) * sections_[sec_].radius;
-  }
-#endif
-  return Eigen::Vector3d(0, 0, 0);
-}
-
-double Trees::estimateCylinderRadius(const std::vector<int> &nodes, const Eigen::Vector3d &dir) const
-{
-  int par = sections_[sec_].parent;
-  if (par == -1)  // if this is the root segment
-  {
-    double rad = 0;
-    // then get the mean radius
-    const auto &list = sections_[sec_].ends.empty() ? nodes : sections_[sec_].ends;
-    for (auto &id : list)
-    {
-      const Eigen::Vector3d offset = points_[id].pos - sections_[sec_].tip;
-      rad += (offset - dir * offset.dot(dir)).norm();
-    }
-    const double radius = list.size() < 2 ? max_radius_ : rad / static_cast<double>(list.size());
-    return std::min(radius, max_radius_);
-  }
-  // for non-root segments
-
-  // use the parent radius as a prior with a weight of 4 points
-  // this avoids spurious radius estimations when the number of points is
-  // small
-  double n = 4.0;
-  double rad = n * sections_[par].radius;
-  for (auto &node : nodes)
-  {
-    const Eigen::Vector3d offset = points_[node].pos - sections_[sec_].tip;
-    rad += (offset - dir * offset.dot(dir)).norm();
-    n++;
-  }
-  return std::min(std::min(rad / n, max_radius_), sections_[par].radius);
-}
-
-// add a child section to continue reconstructing the tree segments
-void Trees::addChildSection()
-{
-  BranchSection new_node;
-  new_node.parent = static_cast<int>(sec_);
-  new_node.roots = sections_[sec_].ends;
-  for (auto &root : new_node.roots)
-  {
-    new_node.max_distance_to_end = std::max(new_node.max_distance_to_end, points_[root].distance_to_end);
-  }
-  max_radius_ = radFromLength(new_node.max_distance_to_end);
-  // constrain each new node's radius to be no larger than its parent radius. This is a reasonable constraint.
-  new_node.radius = std::min(sections_[sec_].radius, max_radius_);
-  if (new_node.radius > 0.5 * params_->min_diameter)  // if it is the first node, then we need a second node
-  {
-    sections_[sec_].children.push_back(static_cast<int>(sections_.size()));
-    new_node.tip = calculateTipFromVertices(new_node.roots);
-    sections_.push_back(new_node);
-  }
-}
-
-// calcualte what section every point belongs to
-void Trees::calculateSectionIds(const std::vector<std::vector<int>> &roots_list, std::vector<int> &section_ids,
-                                const std::vector<std::vector<int>> &children)
-{
-  // first we initialise to one branch section per root
-  for (size_t i = 0; i < roots_list.size(); i++)
-  {
-    for (auto &root : roots_list[i])
-    {
-      section_ids[root] = static_cast<int>(i);
-    }
-  }
-  for (sec_ = 0; sec_ < sections_.size(); sec_++)
-  {
-    std::vector<int> nodes;
-    for (auto &end : sections_[sec_].ends)
-    {
-      int node = points_[end].parent;
-      while (node != -1)
-      {
-        if (std::find(nodes.begin(), nodes.end(), node) != nodes.end())
-        {
-          break;
-        }
-        nodes.push_back(node);
-        if (std::find(sections_[sec_].roots.begin(), sections_[sec_].roots.end(), node) !=
-            sections_[sec_].roots.end())
-        {
-          break;
-        }
-        node = points_[node].parent;
-      }
-    }
-    std::vector<int> ends = sections_[sec_].ends;
-    if (sections_[sec_].children.size() == 0)  // then also add any offshoots...
-    {
-      for (size_t i = 0; i < ends.size(); i++)
-      {
-        for (auto &c : children[ends[i]])
-        {
-          ends.push_back(c);
-        }
-      }
-    }
-    for (auto &node : nodes)
-    {
-      section_ids[node] = static_cast<int>(sec_);
-    }
-    for (auto &end : ends)
-    {
-      section_ids[end] = static_cast<int>(sec_);
-    }
-  }
-
-  // for points without a section id (e.g. end points)
-  // look through their parents
-  for (size_t i = 0; i < points_.size(); i++)
-  {
-    if (section_ids[i] == -1)  // an unfound point
-    {
-      int j = points_[i].parent;
-      while (j != -1 && section_ids[j] == -1)
-      {
-        j = points_[j].parent;
-      }
-      if (j != -1)
-      {
-        section_ids[i] = section_ids[j];
-      }
-    }
-  }
-}
-
-void Trees::drawTrees(bool verbose)
-{
-  if (verbose)
-  {
-    std::vector<Eigen::Vector3d> starts;
-    std::vector<Eigen::Vector3d> ends;
-    std::vector<double> radii;
-    for (auto &tree_node : sections_)
-    {
-      if (tree_node.tip == Eigen::Vector3d(0, 0, 0))
-      {
-        continue;
-      }
-      if (tree_node.parent >= 0)
-      {
-        if ((sections_[tree_node.parent].tip - tree_node.tip).norm() < 0.001)
-        {
-          continue;
-        }
-        starts.push_back(sections_[tree_node.parent].tip);
-        ends.push_back(tree_node.tip);
-        radii.push_back(tree_node.radius);
-      }
-    }
-    DebugDraw::instance()->drawCylinders(starts, ends, radii, 0);
-  }
-}
-
-// generate local parent links. These are parent indices that are
-// independent per tree
-void Trees::generateLocalSectionIds()
-{
-  int num = 0;
-  for (auto &section : sections_)
-  {
-    if (section.parent >= 0 || section.children.empty())
-    {
-      continue;
-    }
-    num++;
-    int child_id = 0;
-    section.id = child_id++;
-    std::vector<int> children = section.children;
-    for (unsigned int c = 0; c < children.size(); c++)
-    {
-      sections_[children[c]].id = child_id++;
-      for (auto i : sections_[children[c]].children)
-      {
-        children.push_back(i);
-      }
-    }
-  }
-  std::cout << num << " trees saved" << std::endl;
-}
-
-void Trees::removeOutOfBoundSections(const Cloud &cloud, Eigen::Vector3d &min_bound, Eigen::Vector3d &max_bound)
-{
-  const double width = params_->grid_width;
-  cloud.calcBounds(&min_bound, &max_bound);
-  const Eigen::Vector3d mid = (min_bound + max_bound) / 2.0;
-  const Eigen::Vector2d inds(std::round(mid[0] / width), std::round(mid[1] / width));
-  min_bound[0] = width * (inds[0] - 0.5);
-  min_bound[1] = width * (inds[1] - 0.5);
-  max_bound[0] = width * (inds[0] + 0.5);
-  max_bound[1] = width * (inds[1] + 0.5);
-  std::cout << "min bound: " << min_bound.transpose() << ", max bound: " << max_bound.transpose() << std::endl;
-
-  // disable trees out of bounds
-  for (auto &section : sections_)
-  {
-    if (section.parent >= 0 || section.children.empty())
-    {
-      continue;
-    }
-    const Eigen::Vector3d pos = section.tip;
-    if (pos[0] < min_bound[0] || pos[0] > max_bound[0] || pos[1] < min_bound[1] || pos[1] > max_bound[1])
-    {
-      section.children.clear();  // make it a non-tree
-    }
-  }
-}
-
-// colour the cloud by tree id, or by branch segment id
-void Trees::segmentCloud(Cloud &cloud, std::vector<int> &root_segs, const std::vector<int> &section_ids)
-{
-  int j = -1;
-  for (size_t i = 0; i < cloud.ends.size(); i++)
-  {
-    RGBA &colour = cloud.colours[i];
-    if (cloud.rayBounded(i))
-    {
-      j++;
-      int seg = section_ids[j];
-      const int root_id = points_[j].root;
-      root_segs[i] = root_id == -1 ? -1 : section_ids[root_id];
-
-      if (!params_->segment_branches)
-      {
-        if (root_id == -1)
-        {
-          colour.red = colour.green = colour.blue = 0;
-          continue;
-        }
-        seg = section_ids[root_id];
-      }
-      if (seg == -1)
-      {
-        colour.red = colour.green = colour.blue = 0;
-        continue;
-      }
-      convertIntToColour(seg, colour);
-    }
-    else
-    {
-      colour.red = colour.green = colour.blue = 0;
-    }
-  }
-}
-
-// remove rays from the ray cloud where the end points are out of bounds
-void Trees::removeOutOfBoundRays(Cloud &cloud, const Eigen::Vector3d &min_bound, const Eigen::Vector3d &max_bound,
-                                 const std::vector<int> &root_segs)
-{
-  for (int i = static_cast<int>(cloud.ends.size()) - 1; i >= 0; i--)
-  {
-    if (!cloud.rayBounded(i))
-    {
-      continue;
-    }
-    const Eigen::Vector3d pos = root_segs[i] == -1 ? cloud.ends[i] : sections_[root_segs[i]].tip;
-
-    if (pos[0] < min_bound[0] || pos[0] > max_bound[0] || pos[1] < min_bound[1] ||
-        pos[1] > max_bound[1])  // nope, can't do this here!
-    {
-      cloud.starts[i] = cloud.starts.back();
-      cloud.starts.pop_back();
-      cloud.ends[i] = cloud.ends.back();
-      cloud.ends.pop_back();
-      cloud.colours[i] = cloud.colours.back();
-      cloud.colours.pop_back();
-      cloud.times[i] = cloud.times.back();
-      cloud.times.pop_back();
-    }
-  }
-}
-
-// save the structure to a text file
-bool Trees::save(const std::string &filename) const
-{
-  std::ofstream ofs(filename.c_str(), std::ios::out);
-  if (!ofs.is_open())
-  {
-    std::cerr << "Error: cannot open " << filename << " for writing." << std::endl;
-    return false;
-  }
-  ofs << "# tree structure file:" << std::endl;
-  ofs << "x,y,z,radius,parent_id,section_id" << std::endl;  // simple format
-  for (size_t sec = 0; sec < sections_.size(); sec++)
-  {
-    const auto &section = sections_[sec];
-    if (section.parent >= 0 || section.children.empty())  // not a root section, so move on
-    {
-      continue;
-    }
-    ofs << section.tip[0] << "," << section.tip[1] << "," << section.tip[2] << "," << section.radius << ",-1," << sec;
-
-    std::vector<int> children = section.children;
-    for (unsigned int c = 0; c < children.size(); c++)
-    {
-      const BranchSection &node = sections_[children[c]];
-      ofs << ", " << node.tip[0] << "," << node.tip[1] << "," << node.tip[2] << "," << node.radius << ","
-          << sections_[node.parent].id;
-      ofs << ", " << children[c];
-      for (auto i : sections_[children[c]].children)
-      {
-        children.push_back(i);
-      }
-    }
-    ofs << std::endl;
-  }
-  return true;
-}
-
-}  // namespace ray
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raytrees.h"
+#include <nabo/nabo.h>
+#include "../raycheckpoint.h"
+#include "../raycloudwriter.h"
+#include "../raydebugdraw.h"
+#include "../rayforeststructure.h"
+#include "../raynodes.h"
+#include "../rayplyindex.h"
+#include "../rayprofile.h"
+#include "../raythreads.h"
+#include "../raytilecache.h"
+#include "../raytiles.h"
+#include "rayclusters.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+
+namespace ray
+{
+namespace
+{
+/// The parameters that the segmentation depends on, as part of a checkpoint key
+std::string segmentKey(const TreesParams &params, const Mesh &mesh)
+{
+  std::ostringstream key;
+  key << std::setprecision(17) << params.max_diameter << " " << params.distance_limit << " " << params.height_min << " "
+      << params.gravity_factor << " " << Checkpoint::hash(mesh.indexList(), Checkpoint::hash(mesh.vertices()));
+  return key.str();
+}
+
+/// The segmentation's points and roots, saved as the raw points and, for each root list, its size then its points
+void saveSegment(Checkpoint &checkpoint, const std::vector<Vertex> &points,
+                 const std::vector<std::vector<int>> &roots_list)
+{
+  std::vector<int> roots = { static_cast<int>(roots_list.size()) };
+  for (const auto &list : roots_list)
+  {
+    roots.push_back(static_cast<int>(list.size()));
+    roots.insert(roots.end(), list.begin(), list.end());
+  }
+  checkpoint.save("segment points", points);
+  checkpoint.save("segment roots", roots);
+}
+
+bool loadSegment(const Checkpoint &checkpoint, std::vector<Vertex> &points, std::vector<std::vector<int>> &roots_list)
+{
+  std::vector<int> roots;
+  if (!checkpoint.completed("segment points") || !checkpoint.load("segment roots", roots) || roots.empty())
+  {
+    return false;
+  }
+  const std::vector<char> data = checkpoint.data("segment points");
+  points.assign(data.size() / sizeof(Vertex), Vertex(Eigen::Vector3d::Zero()));
+  if (!points.empty())
+  {
+    std::memcpy(static_cast<void *>(points.data()), data.data(), points.size() * sizeof(Vertex));
+  }
+  roots_list.resize(roots[0]);
+  size_t j = 1;
+  for (auto &list : roots_list)
+  {
+    const size_t size = j < roots.size() ? static_cast<size_t>(roots[j++]) : 0;
+    if (j + size > roots.size())
+    {
+      return false;
+    }
+    list.assign(roots.begin() + j, roots.begin() + j + size);
+    j += size;
+  }
+  return true;
+}
+}  // namespace
+
+TreesParams::TreesParams()
+  : max_diameter(0.9)
+  , min_diameter(0.02)
+  , distance_limit(1.0)
+  , height_min(2.0)
+  , length_to_radius(140.0)
+  , cylinder_length_to_width(4.0)
+  , gap_ratio(2.5)
+  , span_ratio(4.5)
+  , gravity_factor(0.3)
+  , radius_exponent(0.67)
+  , linear_range(3.0)
+  , grid_width(0.0)
+  , segment_branches(false)
+  , crop_to_bounds(false)
+{}
+
+/// The main reconstruction algorithm
+/// It is based on finding the shortest paths using Djikstra's algorithm, followed
+/// by an agglomeration of paths, with repeated splitting from root to tips
+Trees::Trees(Cloud &cloud, const Mesh &mesh, const TreesParams &params, bool verbose)
+{
+  // firstly, get the full set of shortest paths from ground to tips, and the set of roots
+  params_ = &params;
+
+  // cache an often used branch tapering value
+  const double radius_at_min = params_->linear_range / params_->length_to_radius;
+  const double unscaled_rad = std::pow(radius_at_min, params_->radius_exponent);
+  // length = scale_factor * rad^radius_exponent
+  radius_length_scale_ = unscaled_rad / params_->linear_range;
+
+  // the shortest paths are the slowest stage, so they are kept in any checkpoint, to resume from
+  Checkpoint checkpoint;
+  if (!params_->checkpoint_file.empty())
+  {
+    uint64_t hash = Checkpoint::hash(cloud.starts);
+    hash = Checkpoint::hash(cloud.ends, hash);
+    hash = Checkpoint::hash(cloud.colours, hash);
+    checkpoint.open(params_->checkpoint_file, "segment " + std::to_string(hash) + " " + segmentKey(params, mesh));
+  }
+  std::vector<std::vector<int>> roots_list;
+  if (!loadSegment(checkpoint, points_, roots_list))
+  {
+    roots_list = getRootsAndSegment(points_, cloud, mesh, params_->max_diameter, params_->distance_limit,
+                                    params_->height_min, params_->gravity_factor);
+    saveSegment(checkpoint, points_, roots_list);
+  }
+
+  // Now we want to convert these paths into a set of branch sections, from root to tips
+  // splitting as we go up...
+
+  // calculate the maximum distance to tip for every point in the cloud
+  calculatePointDistancesToEnd();
+
+  // then generate all the root sections
+  generateRootSections(roots_list);
+
+  // the set of child points will be useful later, so generate them now
+  std::vector<std::vector<int>> children(points_.size());
+  for (size_t i = 0; i < points_.size(); i++)
+  {
+    if (points_[i].parent != -1)
+    {
+      children[points_[i].parent].push_back(static_cast<int>(i));
+    }
+  }
+
+  // now trace from root tree nodes upwards, getting node centroids, creating new BranchSections as we go.
+  // The trees do not share any points, so each is reconstructed in parallel in its own list of sections
+  std::vector<TreeSections> trees(sections_.size());
+  std::cout << "reconstructing " << trees.size() << " trees" << std::endl;
+  const auto reconstruct_tree = [&](int i) {
+    TreeSections &tree = trees[i];
+    tree.sections.push_back(sections_[i]);
+    for (tree.sec = 0; tree.sec < tree.sections.size(); tree.sec++)
+    {
+      const size_t num_sections = tree.sections.size();
+      reconstructSection(tree, children);
+      tree.num_added.push_back(static_cast<int>(tree.sections.size() - num_sections));
+    }
+  };
+  parallelFor(0, static_cast<int>(trees.size()), reconstruct_tree);
+  mergeTreeSections(trees);  // We now have created all of the BranchSections
+  std::cout << "generated " << sections_.size() << " branch sections" << std::endl;
+
+  // Now calculate the section ids for all of the points, for the segmented cloud
+  std::vector<int> section_ids(points_.size(), -1);
+  calculateSectionIds(roots_list, section_ids, children);
+
+  // debug draw to rviz the set of cylinders
+  drawTrees(verbose);
+
+  generateLocalSectionIds();
+
+  Eigen::Vector3d min_bound(0, 0, 0), max_bound(0, 0, 0);
+  // remove all sections with a root out of bounds, if we have gridded the cloud with an overlap
+  if (params_->grid_width)
+  {
+    removeOutOfBoundSections(cloud, min_bound, max_bound);
+  }
+  else if (params_->crop_to_bounds)
+  {
+    removeSectionsOutside(params_->crop_bounds.min_bound_, params_->crop_bounds.max_bound_);
+  }
+
+  std::vector<int> root_segs(cloud.ends.size(), -1);
+  // now colour the ray cloud based on the segmentation
+  segmentCloud(cloud, root_segs, section_ids);
+
+  if (params_->grid_width)  // also remove rays from the segmented cloud
+  {
+    removeOutOfBoundRays(cloud, min_bound, max_bound, root_segs);
+  }
+  checkpoint.finish();
+}
+
+/// calculate a branch radius from its length. We use allometric scaling based on a radius exponent and a
+/// linear range for the final taper of the branch
+/// See "Allometric patterns in Acer platanoides (Aceraceae) branches" for real world data
+double Trees::radFromLength(double length) const
+{
+  if (length < params_->linear_range)
+  {
+    return length / params_->length_to_radius;
+  }
+  // length = scale_factor * rad^radius_exponent
+  return std::pow(length * radius_length_scale_, 1.0 / params_->radius_exponent);
+}
+
+// reconstruct the current section of @c tree , adding any new sections that continue the branch
+void Trees::reconstructSection(TreeSections &tree, const std::vector<std::vector<int>> &children)
+{
+  const int par = tree.sections[tree.sec].parent;
+
+  // any estimate of branch radius is bounded from above by an estimate from the branch's length
+  // estimates from length are more reliable on small branches, and less reliable on large, well
+  // observed trunks.
+  tree.max_radius = radFromLength(tree.sections[tree.sec].max_distance_to_end);
+
+  // this branch can come to an end as it is now too small
+  if (tree.max_radius < 0.5 * params_->min_diameter)
+  {
+    setBranchTip(tree);
+    return;
+  }
+
+  std::vector<int> &nodes = tree.scratch.nodes;  // all the points in the section
+  nodes.clear();
+  bool extract_from_ends = tree.sections[tree.sec].ends.size() > 0;
+  // if the branch section has no end points recorded, then we need to examine this branch to
+  // find end points and potentially branch (bifurcate)
+  if (!extract_from_ends)
+  {
+    Eigen::Vector3d base = getRootPosition(tree);
+    extractNodesAndEndsFromRoots(tree, nodes, base, children);
+    bool points_removed = false;
+    PointClusters &clusters = tree.scratch.clusters;
+    findPointClusters(tree, base, clusters, points_removed);
+
+    if (clusters.size() > 1 || (points_removed && clusters.size() > 0))  // a bifurcation (or an alteration)
+    {
+      extract_from_ends = true;
+      nodes.clear();  // don't trust the found nodes as it is now two separate tree nodes
+      // if points have been removed then this only resets the current section's points
+      // otherwise it creates new branch sections for each cluster and adds to the end of the tree's sections
+      bifurcate(tree, clusters);
+      // update the max_radius, since the points have changed
+      tree.max_radius = radFromLength(tree.sections[tree.sec].max_distance_to_end);
+    }
+  }
+
+  // we have split the ends, so we need to extract the set of nodes in a backwards manner
+  if (extract_from_ends)
+  {
+    extractNodesFromEnds(tree, nodes);
+  }
+
+  BranchSection &section = tree.sections[tree.sec];
+  // estimate the section's tip (the centre of the cylinder of points)
+  section.tip = calculateTipFromVertices(tree, nodes);
+  // get section's direction
+  Eigen::Vector3d dir = par >= 0 ? (section.tip - tree.sections[par].tip).normalized() : Eigen::Vector3d(0, 0, 1);
+  // shift to cylinder's centre
+  section.tip += vectorToCylinderCentre(tree, nodes, dir);
+  // now find the segment radius
+  section.radius = estimateCylinderRadius(tree, nodes, dir);
+
+  // now add the single child for this particular tree node, assuming there are still ends
+  if (section.ends.size() > 0)
+  {
+    addChildSection(tree);
+  }
+}
+
+// move the sections of each tree into sections_. They are numbered in the order that a single list of sections for
+// all the trees would have grown: the root sections first, then each section that was added, in the order of the
+// sections that added them
+void Trees::mergeTreeSections(std::vector<TreeSections> &trees)
+{
+  std::vector<std::pair<int, int>> order;  // the tree and local index of each section
+  std::vector<std::vector<int>> global_ids(trees.size());
+  std::vector<int> next_added(trees.size(), 1);
+  for (size_t i = 0; i < trees.size(); i++)
+  {
+    order.push_back(std::make_pair(static_cast<int>(i), 0));
+    global_ids[i].resize(trees[i].sections.size());
+  }
+  for (size_t i = 0; i < order.size(); i++)
+  {
+    const int t = order[i].first;
+    global_ids[t][order[i].second] = static_cast<int>(i);
+    for (int j = 0; j < trees[t].num_added[order[i].second]; j++)
+    {
+      order.push_back(std::make_pair(t, next_added[t]++));
+    }
+  }
+  sections_.resize(order.size());
+  for (size_t i = 0; i < order.size(); i++)
+  {
+    const std::vector<int> &ids = global_ids[order[i].first];
+    BranchSection &section = sections_[i];
+    section = std::move(trees[order[i].first].sections[order[i].second]);
+    if (section.parent >= 0)
+    {
+      section.parent = ids[section.parent];
+    }
+    for (auto &child : section.children)
+    {
+      child = ids[child];
+    }
+  }
+  trees.clear();
+}
+
+void Trees::calculatePointDistancesToEnd()
+{
+  for (size_t i = 0; i < points_.size(); i++)
+  {
+    int id = static_cast<int>(i);
+    int parent = points_[i].parent;
+    points_[i].visited = false;  // reset the visited flag while we're here
+    while (parent != -1)
+    {
+      const double end_dist =
+        points_[id].distance_to_end + (points_[id].distance_to_ground - points_[parent].distance_to_ground);
+      if (points_[parent].distance_to_end > end_dist)
+      {
+        break;
+      }
+      points_[parent].distance_to_end = end_dist;
+      id = parent;
+      parent = points_[id].parent;
+    }
+  }
+}
+
+// generate the initial branch sections, which are the root locations, defined by @c roots_list
+// we also fill in the @c section_ids, which record which section each point belongs to
+void Trees::generateRootSections(const std::vector<std::vector<int>> &roots_list)
+{
+  // first we initialise to one branch section per root
+  for (size_t i = 0; i < roots_list.size(); i++)
+  {
+    BranchSection base;
+    base.roots = roots_list[i];
+    sections_.push_back(base);
+  }
+
+  // we can now find the maximum distance to tip per root section, which allows us to estimate the
+  // section radius for all the root sections.
+  for (int i = static_cast<int>(sections_.size()) - 1; i >= 0; i--)
+  {
+    for (auto &root : sections_[i].roots)
+    {
+      sections_[i].max_distance_to_end = std::max(sections_[i].max_distance_to_end, points_[root].distance_to_end);
+    }
+    sections_[i].radius = radFromLength(sections_[i].max_distance_to_end);
+  }
+}
+
+void Trees::setBranchTip(TreeSections &tree) const
+{
+  // before we finish, we need to calculate the tip of this branch, from its end points
+  tree.sections[tree.sec].tip.setZero();
+  for (auto &i : tree.sections[tree.sec].ends)
+  {
+    tree.sections[tree.sec].tip += points_[i].pos;
+  }
+  size_t sum = tree.sections[tree.sec].ends.size();
+  // if it doesnt have end points then we'll have to use the root points
+  if (tree.sections[tree.sec].ends.empty())
+  {
+    for (auto &i : tree.sections[tree.sec].roots)
+    {
+      tree.sections[tree.sec].tip += points_[i].pos;
+    }
+    sum = tree.sections[tree.sec].roots.size();
+  }
+  if (sum > 0)
+  {
+    tree.sections[tree.sec].tip /= static_cast<double>(sum);
+  }
+}
+
+Eigen::Vector3d Trees::getRootPosition(const TreeSections &tree) const
+{
+  // get a base position for the section
+  Eigen::Vector3d base(0, 0, 0);
+  for (auto &root : tree.sections[tree.sec].roots)
+  {
+    base += points_[root].pos;
+  }
+  base /= static_cast<double>(tree.sections[tree.sec].roots.size());
+  return base;
+}
+
+// find the node and end points for this section, from the root points
+// return the base point (average of roots)
+void Trees::extractNodesAndEndsFromRoots(TreeSections &tree, std::vector<int> &nodes, const Eigen::Vector3d &base,
+                                         const std::vector<std::vector<int>> &children) const
+{
+  const double thickness = params_->cylinder_length_to_width * tree.max_radius;
+  const double thickness_sqr = thickness * thickness;
+  const int par = tree.sections[tree.sec].parent;
+
+  nodes = tree.sections[tree.sec].roots;
+  // 2. find all the points (and the end points) for this section:
+  for (unsigned int index = 0; index < nodes.size(); index++)
+  {
+    // we cannot use the for (int i: nodes) syntax above, as we are pushing into nodes as we go
+    const int i = nodes[index];
+    for (auto &child : children[i])
+    {
+      const double dist_sqr =
+        par == -1 ? sqr(points_[child].pos[2] - base[2]) : (points_[child].pos - base).squaredNorm();
+      if (dist_sqr < thickness_sqr)  // in same slot, so accumulate
+      {
+        nodes.push_back(child);  // so we recurse on this child too
+      }
+      else
+      {
+        tree.sections[tree.sec].ends.push_back(child);
+      }
+    }
+  }
+}
+
+// find clusters of points from the root points up the shortest paths, up to the cylinder length
+void Trees::findPointClusters(TreeSections &tree, const Eigen::Vector3d &base, PointClusters &clusters,
+                              bool &points_removed)
+{
+  const double thickness = params_->cylinder_length_to_width * tree.max_radius;
+  const int par = tree.sections[tree.sec].parent;
+
+  const std::vector<int> &all_ends = tree.sections[tree.sec].ends;
+  // 3. cluster end points to find if we have separate branches
+  // first, get interpolated edge points_. i.e. interpolate between two connected points inside and outside
+  // the branch section's cylinder, so that the set edge_pos are right on the top boundary of the section
+  for (auto &j : all_ends)
+  {
+    const double dist1j = par == -1 ? points_[j].pos[2] - base[2] : (points_[j].pos - base).norm();
+    const double dist0j =
+      par == -1 ? points_[points_[j].parent].pos[2] - base[2] : (points_[points_[j].parent].pos - base).norm();
+    const double blendj = (thickness - dist0j) / (dist1j - dist0j);
+    points_[j].edge_pos = points_[points_[j].parent].pos * (1.0 - blendj) + points_[j].pos * blendj;
+  }
+  // convert to a structure that is better for the cluster function
+  std::vector<Eigen::Vector3d> &ps = tree.scratch.edge_points;
+  std::vector<int> &v_indices = tree.scratch.edge_ids;
+  ps.clear();
+  v_indices.clear();
+  for (auto i : all_ends)
+  {
+    ps.push_back(points_[i].edge_pos);
+    v_indices.push_back(i);
+  }
+  // cluster these end points based on two separation criteria (gap_ratio and span_ratio)
+  generateClusters(clusters, ps, params_->gap_ratio * tree.max_radius, params_->span_ratio * tree.max_radius);
+  // adjust back to global ids
+  for (auto &id : clusters.ids)
+  {
+    id = v_indices[id];
+  }
+
+  points_removed = false;
+  if (par == -1)  // if this is the root section
+  {
+    // then remove children that are smaller than the minimum tree height
+    std::vector<size_t> kept(clusters.size());
+    for (size_t i = 0; i < kept.size(); i++)
+    {
+      kept[i] = i;
+    }
+    for (int i = static_cast<int>(kept.size()) - 1; i >= 0; i--)
+    {
+      double max_dist = 0.0;
+      for (size_t j = clusters.begin(kept[i]); j < clusters.end(kept[i]); j++)
+      {
+        max_dist = std::max(max_dist, points_[clusters.ids[j]].distance_to_end);
+      }
+      if (max_dist < params_->height_min)
+      {
+        kept[i] = kept.back();
+        kept.pop_back();
+        points_removed = true;
+      }
+    }
+    if (points_removed)
+    {
+      PointClusters kept_clusters;
+      kept_clusters.offsets.push_back(0);
+      for (auto &i : kept)
+      {
+        kept_clusters.ids.insert(kept_clusters.ids.end(), clusters.ids.begin() + clusters.begin(i),
+                                 clusters.ids.begin() + clusters.end(i));
+        kept_clusters.offsets.push_back(kept_clusters.ids.size());
+      }
+      clusters = std::move(kept_clusters);
+    }
+  }
+}
+
+// split into multiple branches and add as new branch sections to the end of the tree's list of
+// sections that is being iterated through.
+void Trees::bifurcate(TreeSections &tree, const PointClusters &clusters) const
+{
+  const double thickness = params_->cylinder_length_to_width * tree.max_radius;
+  const int par = tree.sections[tree.sec].parent;
+  // find the maximum distance (to tip) for each cluster
+  std::vector<double> max_distances(clusters.size(), 0.0);
+  double maxmax = -1;
+  int maxi = -1;
+  for (size_t i = 0; i < clusters.size(); i++)
+  {
+    for (size_t j = clusters.begin(i); j < clusters.end(i); j++)
+    {
+      max_distances[i] = std::max(max_distances[i], points_[clusters.ids[j]].distance_to_end);
+    }
+    if (max_distances[i] > maxmax)
+    {
+      maxmax = max_distances[i];
+      maxi = static_cast<int>(i);
+    }
+  }
+  
+  // set the current branch section to the cluster with the
+  // maximum distance to tip (i.e. the longest branch).
+  tree.sections[tree.sec].ends.assign(clusters.ids.begin() + clusters.begin(maxi),
+                                      clusters.ids.begin() + clusters.end(maxi));
+  tree.sections[tree.sec].max_distance_to_end = max_distances[maxi] + thickness;
+
+  // for all other clusters, add new sections to the list...
+  for (size_t i = 0; i < clusters.size(); i++)
+  {
+    if (static_cast<int>(i) == maxi)
+    {
+      continue;
+    }
+    BranchSection new_node = tree.sections[tree.sec];
+    new_node.max_distance_to_end = max_distances[i] + thickness;
+    const double maxrad = radFromLength(new_node.max_distance_to_end);
+    if (maxrad > 0.5 * params_->min_diameter)  // but only add if they are large enough
+    {
+      // we only specify the end points at this stage. They will therefore enter the
+      // extract_from_ends block below when the reconstruction loop gets to their section
+      new_node.ends.assign(clusters.ids.begin() + clusters.begin(i), clusters.ids.begin() + clusters.end(i));
+      if (par != -1)
+      {
+        tree.sections[par].children.push_back(static_cast<int>(tree.sections.size()));
+      }
+      tree.sections.push_back(new_node);
+    }
+  }
+}
+
+// find the nodes between the section end points and the section root points
+void Trees::extractNodesFromEnds(const TreeSections &tree, std::vector<int> &nodes) const
+{
+  for (auto &end : tree.sections[tree.sec].ends)
+  {
+    int node = points_[end].parent;
+    if (node == -1)
+    {
+      std::cout << "shouldn't be parentless here" << std::endl;
+      continue;
+    }
+    while (node != -1)
+    {
+      if (std::find(nodes.begin(), nodes.end(), node) != nodes.end())
+      {
+        break;
+      }
+      nodes.push_back(node);  // fill in the nodes in this branch section
+      if (std::find(tree.sections[tree.sec].roots.begin(), tree.sections[tree.sec].roots.end(), node) != tree.sections[tree.sec].roots.end())
+      {
+        break;
+      }
+      node = points_[node].parent;
+    }
+  }
+}
+
+// use the list of Vertex IDs to estimate a tip location
+Eigen::Vector3d Trees::calculateTipFromVertices(const TreeSections &tree, const std::vector<int> &vertices) const
+{
+  Eigen::Vector3d tip(0, 0, 0);
+  if (vertices.empty())
+  {
+    std::cout << "error: there shouldn't be empty nodes at this point in the processing" << std::endl;
+  }
+  // this code is a backup. If the error above is never called then it is just list = vertices
+  auto &list = vertices.empty() ? (tree.sections[tree.sec].ends.empty() ? tree.sections[tree.sec].roots : tree.sections[tree.sec].ends) : vertices;
+
+  for (auto &i : list)
+  {
+    tip += points_[i].pos;
+  }
+  if (!list.empty())
+  {
+    tip /= static_cast<double>(list.size());
+  }
+  return tip;
+}
+
+Eigen::Vector3d Trees::vectorToCylinderCentre(TreeSections &tree, const std::vector<int> &nodes,
+                                              const Eigen::Vector3d &dir) const
+{
+#define REAL_CENTROID  // finds a new centroid that is robust to branches scanned from a single side
+#if defined REAL_CENTROID
+  const int par = tree.sections[tree.sec].parent;
+  Eigen::Vector3d mean_p(0, 0, 0);
+  std::vector<Eigen::Vector3d> &ps = tree.scratch.projected;
+  ps.clear();
+  const Eigen::Vector3d vec(1, 2, 3);
+  // obtain two orthogonal planes to the section's direction vector
+  const Eigen::Vector3d ax1 = dir.cross(vec).normalized();
+  const Eigen::Vector3d ax2 = dir.cross(ax1).normalized();
+  double n = 0;
+  // iterate over the nodes and the ends points_...
+  const int start_ii = par >= 0 || tree.sections[tree.sec].ends.empty() ? 0 : 1;
+  for (int ii = start_ii; ii < 2; ii++)
+  {
+    const std::vector<int> &node_list = ii == 0 ? nodes : tree.sections[tree.sec].ends;
+    // project points into a local space parabola
+    for (auto &i : node_list)
+    {
+      const Eigen::Vector3d pos = points_[i].pos - tree.sections[tree.sec].tip;
+      const Eigen::Vector2d offset(ax1.dot(pos), ax2.dot(pos));
+      const Eigen::Vector2d xy = offset / tree.sections[tree.sec].radius;
+      const double l2 = xy.squaredNorm();
+      const Eigen::Vector3d point(xy[0], xy[1], 0.5 * l2);  // a paraboloid that has gradient 1 at 1
+      ps.push_back(point);
+      mean_p += point;
+      n++;
+    }
+  }
+  mean_p /= n;
+  if (n > 5)  // assuming there are sufficient points for a resonable guess
+  {
+    // accumulation structure for plane least squares fitting
+    struct Acc
+    {
+      Acc() { x2 = y2 = xy = xz = yz = 0; }
+      double x2, y2, xy, xz, yz;
+    };
+    Acc plane;
+    for (const auto &p : ps)
+    {
+      // fill in the parameters to estimate the plane of best fit to the paraboloid
+      Eigen::Vector3d q = p - mean_p;
+      plane.x2 += q[0] * q[0];
+      plane.y2 += q[1] * q[1];
+      plane.xy += q[0] * q[1];
+      plane.xz += q[0] * q[2];
+      plane.yz += q[1] * q[2];
+    }
+    const double eps = 1e-10;
+    // is the plane is well-determined
+    if (std::abs(plane.x2 * plane.y2 - plane.xy * plane.xy) > eps && std::abs(plane.y2) > eps)
+    {
+      // extract the local plane parameters
+      const double A = (plane.xz * plane.y2 - plane.yz * plane.xy) / (plane.x2 * plane.y2 - plane.xy * plane.xy);
+      const double B = (plane.yz - A * plane.xy) / plane.y2;
+
+      Eigen::Vector2d shift(A, B);
+      const double shift2 = shift.squaredNorm();
+      if (par >= 0 && shift2 > 1.0)  // don't shift more than one radius each iteration, for safety
+      {
+        shift /= std::sqrt(shift2);
+      }
+
+      // apply the plane parameters as a world-space shift in the branch section tip position
+      return (ax1 * shift[0] + ax2 * shift[1]) * tree.sections[tree.sec].radius;
+    }
+  }
+  else if (n > 0)  // if only a few points then use the mean instead
+  {
+    return (ax1 * mean_p[0] + ax2 * mean_p[1]) * tree.sections[tree.sec].radius;
+  }
+#endif
+  return Eigen::Vector3d(0, 0, 0);
+}
+
+double Trees::estimateCylinderRadius(const TreeSections &tree, const std::vector<int> &nodes,
+                                     const Eigen::Vector3d &dir) const
+{
+  int par = tree.sections[tree.sec].parent;
+  if (par == -1)  // if this is the root segment
+  {
+    double rad = 0;
+    // then get the mean radius
+    const auto &list = tree.sections[tree.sec].ends.empty() ? nodes : tree.sections[tree.sec].ends;
+    for (auto &id : list)
+    {
+      const Eigen::Vector3d offset = points_[id].pos - tree.sections[tree.sec].tip;
+      rad += (offset - dir * offset.dot(dir)).norm();
+    }
+    const double radius = list.size() < 2 ? tree.max_radius : rad / static_cast<double>(list.size());
+    return std::min(radius, tree.max_radius);
+  }
+  // for non-root segments
+
+  // use the parent radius as a prior with a weight of 4 points
+  // this avoids spurious radius estimations when the number of points is
+  // small
+  double n = 4.0;
+  double rad = n * tree.sections[par].radius;
+  for (auto &node : nodes)
+  {
+    const Eigen::Vector3d offset = points_[node].pos - tree.sections[tree.sec].tip;
+    rad += (offset - dir * offset.dot(dir)).norm();
+    n++;
+  }
+  return std::min(std::min(rad / n, tree.max_radius), tree.sections[par].radius);
+}
+
+// add a child section to continue reconstructing the tree segments
+void Trees::addChildSection(TreeSections &tree) const
+{
+  BranchSection new_node;
+  new_node.parent = static_cast<int>(tree.sec);
+  new_node.roots = tree.sections[tree.sec].ends;
+  for (auto &root : new_node.roots)
+  {
+    new_node.max_distance_to_end = std::max(new_node.max_distance_to_end, points_[root].distance_to_end);
+  }
+  tree.max_radius = radFromLength(new_node.max_distance_to_end);
+  // constrain each new node's radius to be no larger than its parent radius. This is a reasonable constraint.
+  new_node.radius = std::min(tree.sections[tree.sec].radius, tree.max_radius);
+  if (new_node.radius > 0.5 * params_->min_diameter)  // if it is the first node, then we need a second node
+  {
+    tree.sections[tree.sec].children.push_back(static_cast<int>(tree.sections.size()));
+    new_node.tip = calculateTipFromVertices(tree, new_node.roots);
+    tree.sections.push_back(new_node);
+  }
+}
+
+// calcualte what section every point belongs to
+void Trees::calculateSectionIds(const std::vector<std::vector<int>> &roots_list, std::vector<int> &section_ids,
+                                const std::vector<std::vector<int>> &children)
+{
+  // first we initialise to one branch section per root
+  for (size_t i = 0; i < roots_list.size(); i++)
+  {
+    for (auto &root : roots_list[i])
+    {
+      section_ids[root] = static_cast<int>(i);
+    }
+  }
+  for (size_t sec = 0; sec < sections_.size(); sec++)
+  {
+    std::vector<int> nodes;
+    for (auto &end : sections_[sec].ends)
+    {
+      int node = points_[end].parent;
+      while (node != -1)
+      {
+        if (std::find(nodes.begin(), nodes.end(), node) != nodes.end())
+        {
+          break;
+        }
+        nodes.push_back(node);
+        if (std::find(sections_[sec].roots.begin(), sections_[sec].roots.end(), node) !=
+            sections_[sec].roots.end())
+        {
+          break;
+        }
+        node = points_[node].parent;
+      }
+    }
+    std::vector<int> ends = sections_[sec].ends;
+    if (sections_[sec].children.size() == 0)  // then also add any offshoots...
+    {
+      for (size_t i = 0; i < ends.size(); i++)
+      {
+        for (auto &c : children[ends[i]])
+        {
+          ends.push_back(c);
+        }
+      }
+    }
+    for (auto &node : nodes)
+    {
+      section_ids[node] = static_cast<int>(sec);
+    }
+    for (auto &end : ends)
+    {
+      section_ids[end] = static_cast<int>(sec);
+    }
+  }
+
+  // for points without a section id (e.g. end points)
+  // look through their parents
+  for (size_t i = 0; i < points_.size(); i++)
+  {
+    if (section_ids[i] == -1)  // an unfound point
+    {
+      int j = points_[i].parent;
+      while (j != -1 && section_ids[j] == -1)
+      {
+        j = points_[j].parent;
+      }
+      if (j != -1)
+      {
+        section_ids[i] = section_ids[j];
+      }
+    }
+  }
+}
+
+void Trees::drawTrees(bool verbose)
+{
+  if (verbose)
+  {
+    std::vector<Eigen::Vector3d> starts;
+    std::vector<Eigen::Vector3d> ends;
+    std::vector<double> radii;
+    for (auto &tree_node : sections_)
+    {
+      if (tree_node.tip == Eigen::Vector3d(0, 0, 0))
+      {
+        continue;
+      }
+      if (tree_node.parent >= 0)
+      {
+        if ((sections_[tree_node.parent].tip - tree_node.tip).norm() < 0.001)
+        {
+          continue;
+        }
+        starts.push_back(sections_[tree_node.parent].tip);
+        ends.push_back(tree_node.tip);
+        radii.push_back(tree_node.radius);
+      }
+    }
+    DebugDraw::instance()->drawCylinders(starts, ends, radii, 0);
+  }
+}
+
+// generate local parent links. These are parent indices that are
+// independent per tree
+void Trees::generateLocalSectionIds()
+{
+  int num = 0;
+  for (auto &section : sections_)
+  {
+    if (section.parent >= 0 || section.children.empty())
+    {
+      continue;
+    }
+    num++;
+    int child_id = 0;
+    section.id = child_id++;
+    std::vector<int> children = section.children;
+    for (unsigned int c = 0; c < children.size(); c++)
+    {
+      sections_[children[c]].id = child_id++;
+      for (auto i : sections_[children[c]].children)
+      {
+        children.push_back(i);
+      }
+    }
+  }
+  std::cout << num << " trees saved" << std::endl;
+}
+
+void Trees::removeOutOfBoundSections(const Cloud &cloud, Eigen::Vector3d &min_bound, Eigen::Vector3d &max_bound)
+{
+  const double width = params_->grid_width;
+  cloud.calcBounds(&min_bound, &max_bound);
+  const Eigen::Vector3d mid = (min_bound + max_bound) / 2.0;
+  const Eigen::Vector2d inds(std::round(mid[0] / width), std::round(mid[1] / width));
+  min_bound[0] = width * (inds[0] - 0.5);
+  min_bound[1] = width * (inds[1] - 0.5);
+  max_bound[0] = width * (inds[0] + 0.5);
+  max_bound[1] = width * (inds[1] + 0.5);
+  std::cout << "min bound: " << min_bound.transpose() << ", max bound: " << max_bound.transpose() << std::endl;
+  removeSectionsOutside(min_bound, max_bound);
+}
+
+void Trees::removeSectionsOutside(const Eigen::Vector3d &min_bound, const Eigen::Vector3d &max_bound)
+{
+  // disable trees out of bounds
+  for (auto &section : sections_)
+  {
+    if (section.parent >= 0 || section.children.empty())
+    {
+      continue;
+    }
+    const Eigen::Vector3d pos = section.tip;
+    if (pos[0] < min_bound[0] || pos[0] > max_bound[0] || pos[1] < min_bound[1] || pos[1] > max_bound[1])
+    {
+      section.children.clear();  // make it a non-tree
+    }
+  }
+}
+
+// colour the cloud by tree id, or by branch segment id
+void Trees::segmentCloud(Cloud &cloud, std::vector<int> &root_segs, const std::vector<int> &section_ids)
+{
+  int j = -1;
+  for (size_t i = 0; i < cloud.ends.size(); i++)
+  {
+    RGBA &colour = cloud.colours[i];
+    if (cloud.rayBounded(i))
+    {
+      j++;
+      int seg = section_ids[j];
+      const int root_id = points_[j].root;
+      root_segs[i] = root_id == -1 ? -1 : section_ids[root_id];
+
+      if (!params_->segment_branches)
+      {
+        if (root_id == -1)
+        {
+          colour.red = colour.green = colour.blue = 0;
+          continue;
+        }
+        seg = section_ids[root_id];
+      }
+      if (seg == -1)
+      {
+        colour.red = colour.green = colour.blue = 0;
+        continue;
+      }
+      convertIntToColour(seg, colour);
+    }
+    else
+    {
+      colour.red = colour.green = colour.blue = 0;
+    }
+  }
+}
+
+// remove rays from the ray cloud where the end points are out of bounds
+void Trees::removeOutOfBoundRays(Cloud &cloud, const Eigen::Vector3d &min_bound, const Eigen::Vector3d &max_bound,
+                                 const std::vector<int> &root_segs)
+{
+  cloud.compact([&](size_t i) {
+    if (!cloud.rayBounded(i))
+    {
+      return true;
+    }
+    const Eigen::Vector3d pos = root_segs[i] == -1 ? cloud.ends[i] : sections_[root_segs[i]].tip;
+    return pos[0] >= min_bound[0] && pos[0] <= max_bound[0] && pos[1] >= min_bound[1] && pos[1] <= max_bound[1];
+  });
+}
+
+// save the structure to a text file
+bool Trees::save(const std::string &filename) const
+{
+  std::ofstream ofs(filename.c_str(), std::ios::out);
+  if (!ofs.is_open())
+  {
+    std::cerr << "Error: cannot open " << filename << " for writing." << std::endl;
+    return false;
+  }
+  ofs << "# tree structure file:" << std::endl;
+  ofs << "x,y,z,radius,parent_id,section_id" << std::endl;  // simple format
+  for (size_t sec = 0; sec < sections_.size(); sec++)
+  {
+    const auto &section = sections_[sec];
+    if (section.parent >= 0 || section.children.empty())  // not a root section, so move on
+    {
+      continue;
+    }
+    ofs << section.tip[0] << "," << section.tip[1] << "," << section.tip[2] << "," << section.radius << ",-1," << sec;
+
+    std::vector<int> children = section.children;
+    for (unsigned int c = 0; c < children.size(); c++)
+    {
+      const BranchSection &node = sections_[children[c]];
+      ofs << ", " << node.tip[0] << "," << node.tip[1] << "," << node.tip[2] << "," << node.radius << ","
+          << sections_[node.parent].id;
+      ofs << ", " << children[c];
+      for (auto i : sections_[children[c]].children)
+      {
+        children.push_back(i);
+      }
+    }
+    ofs << std::endl;
+  }
+  return true;
+}
+
+ForestStructure Trees::forestStructure() const
+{
+  ForestStructure forest;
+  for (size_t sec = 0; sec < sections_.size(); sec++)
+  {
+    const auto &section = sections_[sec];
+    if (section.parent >= 0 || section.children.empty())  // not a root section, so move on
+    {
+      continue;
+    }
+    TreeStructure tree;
+    tree.attributes().push_back("section_id");
+    TreeStructure::Segment root;
+    root.tip = section.tip;
+    root.radius = section.radius;
+    root.attributes.push_back(static_cast<double>(sec));
+    tree.segments().push_back(root);
+
+    // the segments are in the same order as the text file
+    std::vector<int> children = section.children;
+    for (unsigned int c = 0; c < children.size(); c++)
+    {
+      const BranchSection &node = sections_[children[c]];
+      TreeStructure::Segment segment;
+      segment.tip = node.tip;
+      segment.radius = node.radius;
+      segment.parent_id = sections_[node.parent].id;
+      segment.attributes.push_back(static_cast<double>(children[c]));
+      tree.segments().push_back(segment);
+      for (auto i : sections_[children[c]].children)
+      {
+        children.push_back(i);
+      }
+    }
+    forest.trees.push_back(tree);
+  }
+  return forest;
+}
+
+bool Trees::saveBinary(const std::string &filename) const
+{
+  return forestStructure().saveBinary(filename);
+}
+
+bool extractTreesInTiles(const std::string &cloud_name, const std::string &out_stub, const Mesh &mesh,
+                         const TreesParams &params, double halo, bool verbose)
+{
+  ProfileScope profile("extractTreesInTiles");
+  Cloud::Info info;
+  if (!Cloud::getInfo(cloud_name, info))
+  {
+    return false;
+  }
+  const size_t num_rays = static_cast<size_t>(info.num_bounded) + static_cast<size_t>(info.num_unbounded);
+  profile.count(num_rays);
+
+  // the trees of each tile, by tile index so that they are merged in tile order
+  std::map<size_t, ForestStructure> tile_trees;
+  // the sections of a tile's trees, which are the only sections that rays are coloured by
+  auto kept_sections = [](const ForestStructure &forest) {
+    std::vector<bool> kept;
+    for (auto &tree : forest.trees)
+    {
+      for (auto &segment : tree.segments())
+      {
+        const size_t section = static_cast<size_t>(segment.attributes[0]);
+        if (section >= kept.size())
+        {
+          kept.resize(section + 1, false);
+        }
+        kept[section] = true;
+      }
+    }
+    return kept;
+  };
+  // the tile-local section that each ray is coloured by, and the tile that it is in
+  struct RayClaim
+  {
+    int32_t tile;
+    int32_t section;
+  };
+  // a ray claimed by trees of two tiles is kept by the lowest numbered tile
+  auto merge_claim = [](RayClaim &claim, const RayClaim &other) {
+    if (other.tile != -1 && (claim.tile == -1 || other.tile < claim.tile))
+    {
+      claim = other;
+    }
+  };
+  std::vector<RayClaim> claims(num_rays, RayClaim{ -1, -1 });
+  std::mutex tile_mutex;
+
+  // the results of a tile are its trees and its claimed rays, as pairs of the ray's position in the tile and its
+  // section, so that they still apply when other tiles' rays have changed
+  std::ostringstream params_key;
+  params_key << std::setprecision(17) << halo << " " << Nodes::index() << " " << Nodes::count() << " "
+             << params.length_to_radius << " " << params.cylinder_length_to_width << " " << params.gap_ratio << " "
+             << params.span_ratio << " " << params.radius_exponent << " " << params.linear_range << " "
+             << params.min_diameter << " " << segmentKey(params, mesh);
+  const std::string node_suffix = Nodes::count() > 1 ? "_node" + std::to_string(Nodes::index()) : "";
+
+  // a checkpoint holds the results of each tile finished by this run. Its trees are saved to a tree file beside it,
+  // as they are not flat data
+  Checkpoint checkpoint;
+  std::string checkpoint_stub;
+  if (!params.checkpoint_file.empty())
+  {
+    checkpoint_stub = params.checkpoint_file.substr(0, params.checkpoint_file.find_last_of('.')) + node_suffix;
+    uint64_t size, hash;
+    int64_t modified;
+    if (fileStamp(cloud_name, size, modified, hash))
+    {
+      checkpoint.open(node_suffix.empty() ? params.checkpoint_file : checkpoint_stub + ".checkpoint",
+                      "trees " + std::to_string(size) + " " + std::to_string(modified) + " " + std::to_string(hash) +
+                        " " + params_key.str());
+    }
+  }
+  // a tile cache holds the results of each tile of the previous run, by the hash of the tile's rays, with its trees
+  // in tree files beside it that are kept for the next run
+  TileCache cache;
+  std::string cache_stub;
+  if (!params.tile_cache_file.empty())
+  {
+    cache_stub = params.tile_cache_file.substr(0, params.tile_cache_file.find_last_of('.')) + node_suffix;
+    cache.open(node_suffix.empty() ? params.tile_cache_file : cache_stub + ".tilecache", "trees " + params_key.str());
+  }
+  std::vector<std::string> forest_files;  // the checkpoint's tree files
+  auto tile_phase = [](size_t tile) { return "tile " + std::to_string(tile); };
+  auto forest_file = [](const std::string &stub, size_t tile) {
+    return stub + "_tile_" + std::to_string(tile) + ".trees";
+  };
+  auto add_tile = [&](size_t tile, ForestStructure &forest, const std::vector<int64_t> &indices,
+                      const std::vector<int64_t> &tile_claims) {
+    std::lock_guard<std::mutex> lock(tile_mutex);
+    for (size_t i = 0; i + 1 < tile_claims.size(); i += 2)
+    {
+      if (tile_claims[i] >= 0 && tile_claims[i] < static_cast<int64_t>(indices.size()))
+      {
+        const RayClaim claim = { static_cast<int32_t>(tile), static_cast<int32_t>(tile_claims[i + 1]) };
+        merge_claim(claims[indices[tile_claims[i]]], claim);
+      }
+    }
+    if (checkpoint.isOpen() && !forest.trees.empty())
+    {
+      forest_files.push_back(forest_file(checkpoint_stub, tile));
+    }
+    tile_trees[tile] = std::move(forest);
+  };
+  // the results of a tile that are in the cache, setting @c cached , or that were finished by an interrupted run, or
+  // false if there are none. The cached claims begin with whether the tile has trees
+  auto reuse_tile = [&](size_t tile, uint64_t content_hash, ForestStructure &forest, std::vector<int64_t> &tile_claims,
+                        bool &cached) {
+    cached = cache.isOpen() && cache.find(tile_phase(tile), content_hash, tile_claims) && !tile_claims.empty() &&
+             (tile_claims[0] == 0 || forest.load(forest_file(cache_stub, tile)));
+    if (cached)
+    {
+      tile_claims.erase(tile_claims.begin());
+      return true;
+    }
+    forest.trees.clear();
+    tile_claims.clear();
+    if (checkpoint.load(tile_phase(tile), tile_claims) &&
+        (!checkpoint.completed(tile_phase(tile) + " forest") || forest.load(forest_file(checkpoint_stub, tile))))
+    {
+      return true;
+    }
+    forest.trees.clear();
+    return false;
+  };
+  // keep the results of a tile in the checkpoint and, unless they came from it, the cache
+  auto keep_tile = [&](size_t tile, uint64_t content_hash, const ForestStructure &forest,
+                       const std::vector<int64_t> &tile_claims, bool cached) {
+    if (checkpoint.isOpen() && !checkpoint.completed(tile_phase(tile)))
+    {
+      if (!forest.trees.empty() && forest.saveBinary(forest_file(checkpoint_stub, tile)))
+      {
+        checkpoint.save(tile_phase(tile) + " forest");
+      }
+      checkpoint.save(tile_phase(tile), tile_claims);
+    }
+    if (cache.isOpen() && !cached)
+    {
+      const std::string name = forest_file(cache_stub, tile);
+      const bool has_forest = !forest.trees.empty() && forest.saveBinary(name);
+      if (!has_forest)
+      {
+        std::remove(name.c_str());
+      }
+      std::vector<int64_t> cached = { has_forest ? 1 : 0 };
+      cached.insert(cached.end(), tile_claims.begin(), tile_claims.end());
+      cache.store(tile_phase(tile), content_hash, cached);
+    }
+  };
+
+  // 1. extract the trees of each tile, keeping those with a base in the tile's region
+  auto extract_tile = [&](Cloud &cloud, const std::vector<int64_t> &indices, const TileRegion &region) {
+    const size_t min_num_rays = 40;  // as required of a whole cloud
+    if (cloud.ends.size() < min_num_rays)
+    {
+      return;
+    }
+    uint64_t content_hash = 0;
+    if (cache.isOpen())
+    {
+      content_hash = TileCache::hash(region.bounds.min_bound_.data(), 3 * sizeof(double), TileCache::hashRays(cloud));
+      content_hash = TileCache::hash(region.bounds.max_bound_.data(), 3 * sizeof(double), content_hash);
+    }
+    ForestStructure forest;
+    std::vector<int64_t> tile_claims;
+    bool cached = false;
+    if (!reuse_tile(region.index, content_hash, forest, tile_claims, cached))
+    {
+      TreesParams tile_params = params;
+      tile_params.grid_width = 0.0;
+      tile_params.crop_to_bounds = true;
+      tile_params.crop_bounds = region.bounds;
+      tile_params.checkpoint_file.clear();
+      tile_params.tile_cache_file.clear();
+      Trees trees(cloud, mesh, tile_params, verbose);
+      forest = trees.forestStructure();
+      const std::vector<bool> kept = kept_sections(forest);
+      for (size_t i = 0; i < indices.size(); i++)
+      {
+        const int section = convertColourToInt(cloud.colours[i]);
+        if (section >= 0 && section < static_cast<int>(kept.size()) && kept[section])
+        {
+          tile_claims.push_back(static_cast<int64_t>(i));
+          tile_claims.push_back(section);
+        }
+      }
+    }
+    keep_tile(region.index, content_hash, forest, tile_claims, cached);
+    add_tile(region.index, forest, indices, tile_claims);
+  };
+  if (!processInTiles(cloud_name, out_stub, halo, extract_tile, cache.isOpen() ? &cache : nullptr))
+  {
+    return false;
+  }
+  cache.save();
+  // once the results are written, the checkpoint and its tree files are no longer needed
+  auto finish_checkpoint = [&]() {
+    for (const auto &name : forest_files)
+    {
+      std::remove(name.c_str());
+    }
+    checkpoint.finish();
+  };
+
+  // across several nodes, each other node saves its trees with their tile index, before node 0 gathers the claims
+  const std::string tile_attribute = "tile";
+  if (!Nodes::isCoordinator())
+  {
+    ForestStructure node_forest;
+    for (auto &tile : tile_trees)
+    {
+      for (auto &tree : tile.second.trees)
+      {
+        tree.attributes().push_back(tile_attribute);
+        for (auto &segment : tree.segments())
+        {
+          segment.attributes.push_back(static_cast<double>(tile.first));
+        }
+        node_forest.trees.push_back(std::move(tree));
+      }
+    }
+    const std::string name = Nodes::resultsName(out_stub + "_trees", Nodes::index());
+    if (!node_forest.trees.empty() && !node_forest.saveBinary(name))
+    {
+      return false;
+    }
+  }
+  if (!Nodes::gather(out_stub, claims, merge_claim))
+  {
+    return false;
+  }
+  if (!Nodes::isCoordinator())
+  {
+    finish_checkpoint();
+    return true;
+  }
+  for (int node = 1; node < Nodes::count(); node++)
+  {
+    const std::string name = Nodes::resultsName(out_stub + "_trees", node);
+    if (!std::ifstream(name).good())
+    {
+      continue;  // the node found no trees
+    }
+    ForestStructure node_forest;
+    if (!node_forest.load(name))
+    {
+      return false;
+    }
+    std::remove(name.c_str());
+    for (auto &tree : node_forest.trees)
+    {
+      const size_t tile = static_cast<size_t>(tree.segments()[0].attributes.back());
+      tree.attributes().pop_back();
+      for (auto &segment : tree.segments())
+      {
+        segment.attributes.pop_back();
+      }
+      tile_trees[tile].trees.push_back(std::move(tree));
+    }
+  }
+
+  // 2. merge the trees in tile order, numbering the sections of each tile after those of the previous tiles
+  ForestStructure forest;
+  std::map<size_t, int> section_offsets;
+  int num_sections = 0;
+  for (auto &tile : tile_trees)
+  {
+    section_offsets[tile.first] = num_sections;
+    const int tile_sections = static_cast<int>(kept_sections(tile.second).size());
+    for (auto &tree : tile.second.trees)
+    {
+      for (auto &segment : tree.segments())
+      {
+        segment.attributes[0] += static_cast<double>(num_sections);
+      }
+      forest.trees.push_back(std::move(tree));
+    }
+    num_sections += tile_sections;
+  }
+  std::cout << "extracted " << forest.trees.size() << " trees from " << tile_trees.size() << " tiles" << std::endl;
+  tile_trees.clear();
+  if (!forest.trees.empty() && !forest.save(out_stub + "_trees.txt"))
+  {
+    return false;
+  }
+
+  // 3. copy the rays in file order, coloured by their section, as Trees does for a single cloud
+  CloudWriter writer;
+  if (!writer.begin(out_stub + "_segmented.ply"))
+  {
+    return false;
+  }
+  Cloud chunk;
+  size_t num_copied = 0;
+  bool success = true;
+  auto colour_rays = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                         std::vector<double> &times, std::vector<RGBA> &colours) {
+    chunk.clear();
+    for (size_t i = 0; i < ends.size() && num_copied + i < num_rays; i++)
+    {
+      RGBA colour = colours[i];
+      const RayClaim &claim = claims[num_copied + i];
+      if (claim.tile >= 0)
+      {
+        convertIntToColour(section_offsets[claim.tile] + claim.section, colour);
+      }
+      else
+      {
+        colour.red = colour.green = colour.blue = 0;
+      }
+      chunk.addRay(starts[i], ends[i], times[i], colour);
+    }
+    num_copied += ends.size();
+    if (!writer.writeChunk(chunk))
+    {
+      success = false;
+    }
+  };
+  if (!Cloud::read(cloud_name, colour_rays))
+  {
+    return false;
+  }
+  writer.end();
+  if (success)
+  {
+    finish_checkpoint();
+  }
+  return success;
+}
+
+}  // namespace ray
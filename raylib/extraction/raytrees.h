@@ -10,6 +10,7 @@
 #include "../raymesh.h"
 #include "../rayutils.h"
 #include "raylib/raylibconfig.h"
+#include "rayclusters.h"
 #include "raysegment.h"
 
 namespace ray
@@ -33,9 +34,14 @@ struct RAYLIB_EXPORT TreesParams
   double linear_range;     // number of metres that branch radius is linear
   double grid_width;       // used on a grid cell with overlap, to remove trees with a base in the overlap zone
   bool segment_branches;   // flag to output the ray cloud coloured by branch segment index rather than by tree index
+  bool crop_to_bounds;     // remove trees with a base outside crop_bounds in x and y, keeping all of the rays
+  Cuboid crop_bounds;      // the region used by crop_to_bounds, such as a tile's owned region
+  std::string checkpoint_file;  // if set, a Checkpoint of the segmentation, or of each tile of extractTreesInTiles
+  std::string tile_cache_file;  // if set, a TileCache of the tiles of extractTreesInTiles, to reuse in the next run
 };
 
 struct BranchSection;  // forwards declaration
+struct ForestStructure;
 
 /// The class for a set of trees, stored as a list of (connected) branch sections
 /// together with the function for their extrsction from a ray cloud
@@ -50,38 +56,69 @@ public:
 
   /// save the trees representation to a text file
   bool save(const std::string &filename) const;
+  /// save the trees representation to a binary tree file, with the same segments and section_id attribute as @c save
+  bool saveBinary(const std::string &filename) const;
+  /// the trees as a forest structure, with the same segments and section_id attribute as @c save
+  ForestStructure forestStructure() const;
 
 private:
   /// The piecewise cylindrical represenation of all of the trees
   std::vector<BranchSection> sections_;
 
+  /// The branch sections of a single tree during its reconstruction, and the section being reconstructed. Each tree
+  /// is reconstructed separately, so that trees can be reconstructed in parallel
+  struct TreeSections
+  {
+    std::vector<BranchSection> sections;
+    std::vector<int> num_added;  // the number of sections added when reconstructing each section
+    size_t sec = 0;
+    double max_radius = 0.0;
+
+    /// Buffers for the working lists of a section, cleared for each section but keeping their storage, so that once
+    /// they have grown to the tree's largest section, reconstructing the tree's sections doesn't allocate them again
+    struct Scratch
+    {
+      std::vector<int> nodes;                    // the points in the section
+      std::vector<Eigen::Vector3d> edge_points;  // the section's end points, interpolated onto its top boundary
+      std::vector<int> edge_ids;                 // the point index of each edge point
+      PointClusters clusters;                    // the clusters of the edge points
+      std::vector<Eigen::Vector3d> projected;    // the section's points projected onto a paraboloid
+    } scratch;
+  };
+
   /// estimate branch radius from its length
   double radFromLength(double length) const;
   /// calculate the distance to farthest connected branch tip, for each point in the cloud
   void calculatePointDistancesToEnd();
   /// create the start branch segments at the root positions
   void generateRootSections(const std::vector<std::vector<int>> &roots_list);
+  /// reconstruct the current section of the tree, adding new sections to continue the branch
+  void reconstructSection(TreeSections &tree, const std::vector<std::vector<int>> &children);
+  /// move the sections of all trees into the single list sections_
+  void mergeTreeSections(std::vector<TreeSections> &trees);
   /// finalise the attributes of an end (tip) of a branch
-  void setBranchTip();
+  void setBranchTip(TreeSections &tree) const;
   /// get the root position for the current section
-  Eigen::Vector3d getRootPosition() const;
+  Eigen::Vector3d getRootPosition(const TreeSections &tree) const;
   /// find the points and end points within this branch section
-  void extractNodesAndEndsFromRoots(std::vector<int> &nodes, const Eigen::Vector3d &base,
-                                    const std::vector<std::vector<int>> &children);
+  void extractNodesAndEndsFromRoots(TreeSections &tree, std::vector<int> &nodes, const Eigen::Vector3d &base,
+                                    const std::vector<std::vector<int>> &children) const;
   /// find separate clusters of points within the branch section
-  std::vector<std::vector<int>> findPointClusters(const Eigen::Vector3d &base, bool &points_removed);
+  void findPointClusters(TreeSections &tree, const Eigen::Vector3d &base, PointClusters &clusters, bool &points_removed);
   /// split the branch section to one branch for each cluster
-  void bifurcate(const std::vector<std::vector<int>> &clusters);
+  void bifurcate(TreeSections &tree, const PointClusters &clusters) const;
   /// find the points within the branch section from its end points
-  void extractNodesFromEnds(std::vector<int> &nodes);
+  void extractNodesFromEnds(const TreeSections &tree, std::vector<int> &nodes) const;
   /// set the branch section tip position from the supplied list of Vertex IDs
-  Eigen::Vector3d calculateTipFromVertices(const std::vector<int> &nodes) const;
+  Eigen::Vector3d calculateTipFromVertices(const TreeSections &tree, const std::vector<int> &nodes) const;
   /// estimate the vector to the cylinder centre from the set of nodes
-  Eigen::Vector3d vectorToCylinderCentre(const std::vector<int> &nodes, const Eigen::Vector3d &dir) const;
+  Eigen::Vector3d vectorToCylinderCentre(TreeSections &tree, const std::vector<int> &nodes,
+                                         const Eigen::Vector3d &dir) const;
   /// estimate the cylinder's radius from its centre, @c dir and set of nodes
-  double estimateCylinderRadius(const std::vector<int> &nodes, const Eigen::Vector3d &dir) const;
+  double estimateCylinderRadius(const TreeSections &tree, const std::vector<int> &nodes,
+                                const Eigen::Vector3d &dir) const;
   /// add a new section to continue reconstructing the branch
-  void addChildSection();
+  void addChildSection(TreeSections &tree) const;
   /// calculate the ownership, what branch section does each point belong to
   void calculateSectionIds(const std::vector<std::vector<int>> &roots_list, std::vector<int> &section_ids,
                            const std::vector<std::vector<int>> &children);
@@ -91,16 +128,16 @@ private:
   void generateLocalSectionIds();
   /// if using an overlapping grid, then remove trees with base outside the non-overlapping cell bounds
   void removeOutOfBoundSections(const Cloud &cloud, Eigen::Vector3d &min_bound, Eigen::Vector3d &max_bound);
+  /// remove the trees with a base outside @c min_bound to @c max_bound in x and y
+  void removeSectionsOutside(const Eigen::Vector3d &min_bound, const Eigen::Vector3d &max_bound);
   /// colour the cloud based on the section id for each point
   void segmentCloud(Cloud &cloud, std::vector<int> &root_segs, const std::vector<int> &section_ids);
   /// remove points from the ray cloud if outside of the non-overlapping grid cell bounds
   void removeOutOfBoundRays(Cloud &cloud, const Eigen::Vector3d &min_bound, const Eigen::Vector3d &max_bound,
                             const std::vector<int> &root_segs);
   // cached data that is used throughout the processing method
-  size_t sec_;
   const TreesParams *params_;
   std::vector<Vertex> points_;
-  double max_radius_;
   double radius_length_scale_; /// Cached ratio from branch taper parameters
 };
 
@@ -124,6 +161,19 @@ struct RAYLIB_EXPORT BranchSection
   std::vector<int> children;
 };
 
+/// Extract the trees of the ray cloud file @c cloud_name in tiles, in parallel, by @c processInTiles , saving the merged
+/// trees to @c out_stub _trees.txt and the segmented cloud to @c out_stub _segmented.ply . Each tile includes the rays
+/// within @c halo of it, which should be wide enough to hold the crowns of the trees that cross the tile's edge. A tree
+/// is kept by the tile that its base is in, and each ray is coloured by the kept tree that it is part of, or by the
+/// lowest numbered tile if trees of two tiles share it. The tile regions replace @c params.grid_width . Memory is
+/// bounded by the tile size and 8 bytes per ray, rather than the cloud size. Across several @c Nodes , node 0 gathers
+/// the other nodes' trees and writes the output. With @c params.checkpoint_file , each tile's trees and claimed rays
+/// are saved as it completes, and a repeated run skips the tiles that are already done. With
+/// @c params.tile_cache_file , the results of each tile are kept for the next run, which reuses those of the tiles
+/// whose rays, halo included, have not changed. Returns false if a file could not be read or written.
+bool RAYLIB_EXPORT extractTreesInTiles(const std::string &cloud_name, const std::string &out_stub, const Mesh &mesh,
+                                       const TreesParams &params, double halo, bool verbose);
+
 /// Converts an index in to a unique colour
 /// only for ints up to 255*255*255-1   (as it leaves black as a special colour)
 inline void RAYLIB_EXPORT convertIntToColour(int x, RGBA &colour)
@@ -28,7 +28,8 @@ Trunk::Trunk()
 {}
 
 // return the points that overlap this trunk, using the grid as an acceleration structure
-std::vector<Eigen::Vector3d> Trunk::getOverlappingPoints(const Grid<Eigen::Vector3d> &grid, double spacing)
+std::vector<Eigen::Vector3d> Trunk::getOverlappingPoints(const PackedGrid<unsigned> &grid, const Cloud &cloud,
+                                                         double spacing)
 {
   std::vector<Eigen::Vector3d> points;
   // get grid bounds
@@ -43,31 +44,26 @@ std::vector<Eigen::Vector3d> Trunk::getOverlappingPoints(const Grid<Eigen::Vecto
   const Eigen::Vector3i min_dims = grid.dims - Eigen::Vector3i(1, 1, 1);
   maxs = minVector(maxs, min_dims);
 
-  // iterate over the cells in the bounds
-  Eigen::Vector3i ind;
-  for (ind[0] = mins[0]; ind[0] <= maxs[0]; ind[0]++)
+  // iterate over the cell columns in the bounds, the points of each column are contiguous in the grid
+  for (int x = mins[0]; x <= maxs[0]; x++)
   {
-    for (ind[1] = mins[1]; ind[1] <= maxs[1]; ind[1]++)
+    for (int y = mins[1]; y <= maxs[1]; y++)
     {
-      for (ind[2] = mins[2]; ind[2] <= maxs[2]; ind[2]++)
+      for (const auto &id : grid.column(x, y, mins[2], maxs[2]))
       {
-        auto &cell = grid.cell(ind);
-        // iterate over the points in the cell
-        for (auto &pos : cell.data)
+        // intersect against the trunk cylinder
+        const Eigen::Vector3d &pos = cloud.ends[id];
+        Eigen::Vector3d p = pos - centre;
+        const double h = p.dot(dir);
+        if (std::abs(h) > length * 0.5)
         {
-          // intersect against the trunk cylinder
-          Eigen::Vector3d p = pos - centre;
-          const double h = p.dot(dir);
-          if (std::abs(h) > length * 0.5)
-          {
-            continue;
-          }
-          p -= dir * h;
-          const double dist2 = p.squaredNorm();
-          if (dist2 <= outer_radius * outer_radius)
-          {
-            points.push_back(pos);
-          }
+          continue;
+        }
+        p -= dir * h;
+        const double dist2 = p.squaredNorm();
+        if (dist2 <= outer_radius * outer_radius)
+        {
+          points.push_back(pos);
         }
       }
     }
@@ -7,6 +7,7 @@
 #define RAYLIB_RAYBRANCH_H
 
 #include "../raycloud.h"
+#include "../raygrid.h"
 #include "../rayutils.h"
 #include "raylib/raylibconfig.h"
 
@@ -32,8 +33,9 @@ struct RAYLIB_EXPORT Trunk
   int parent;
   bool active;
 
-  /// return the overlapping points to the trunk using the @c grid of points
-  std::vector<Eigen::Vector3d> getOverlappingPoints(const Grid<Eigen::Vector3d> &grid, double spacing);
+  /// return the overlapping points to the trunk using the @c grid of the indices of the @c cloud points
+  std::vector<Eigen::Vector3d> getOverlappingPoints(const PackedGrid<unsigned> &grid, const Cloud &cloud,
+                                                    double spacing);
 
   /// estimate the centre and direction of the trunk from the shape of the points
   void estimatePose(const std::vector<Eigen::Vector3d> &points);
@@ -5,6 +5,7 @@
 // Author: Thomas Lowe
 #include "rayalignment.h"
 #include "rayply.h"
+#include "raythreads.h"
 #include "rayunused.h"
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "imagewrite.h"
@@ -15,6 +16,13 @@
 #include <complex>
 #include <iostream>
 
+#if RAYLIB_WITH_FFTW
+#include <fftw3.h>
+#include <map>
+#include <mutex>
+#include <tuple>
+#endif  // RAYLIB_WITH_FFTW
+
 using Complex = std::complex<double>;
 static const double kHighPassPower = 0.25;  // This fixes inout->inout11, inoutD->inoutB2 and house_inside->house3.
                                             // Doesn't break any. power=0.25. 0 is turned off.
@@ -23,20 +31,11 @@ namespace ray
 struct Array1D
 {
   void init(int length);
-  void fft();
-  void inverseFft();
-
-  void operator*=(const Array1D &other);
   inline Complex &operator()(const int &x) { return cells_[x]; }
   inline const Complex &operator()(const int &x) const { return cells_[x]; }
-  inline void operator+=(const Array1D &other)
-  {
-    for (int i = 0; i < (int)cells_.size(); i++) cells_[i] += other.cells_[i];
-  }
   void polarCrossCorrelation(const Array3D *arrays, bool verbose);
 
   int maxRealIndex() const;
-  void conjugate();
   int numCells() { return (int)cells_.size(); }
   Complex &cell(int i) { return cells_[i]; }
   const Complex &cell(int i) const { return cells_[i]; }
@@ -45,11 +44,125 @@ private:
   std::vector<Complex> cells_;
 };
 
+/// A batch of 1D arrays of equal length, held as the rows of one contiguous buffer, so that they are transformed
+/// together: with one reused FFTW plan over the whole batch when built with FFTW, otherwise with a transform per
+/// row, in parallel across the rows.
+struct Array1DBatch
+{
+  void init(int length, int count);
+  void fft();
+  void inverseFft();
+
+  inline Complex *row(int i) { return &cells_[static_cast<size_t>(i) * length_]; }
+  inline const Complex *row(int i) const { return &cells_[static_cast<size_t>(i) * length_]; }
+  inline Complex &operator()(int x, int i) { return cells_[x + static_cast<size_t>(i) * length_]; }
+  inline const Complex &operator()(int x, int i) const { return cells_[x + static_cast<size_t>(i) * length_]; }
+  inline int length() const { return length_; }
+  inline int count() const { return count_; }
+
+private:
+  std::vector<Complex> cells_;
+  int length_ = 0;
+  int count_ = 0;
+};
+
 struct Col
 {
   uint8_t r, g, b, a;
 };
 
+#if RAYLIB_WITH_FFTW
+/// FFTW plans for in-place transforms of 3D grids, kept for reuse across calls. The plans are made for unaligned
+/// buffers, so that one plan suits every grid of the same dimensions. FFTW's planner is not thread safe, so
+/// planning is guarded by a mutex, while executing a plan is thread safe.
+class FftwPlans
+{
+public:
+  enum Kind
+  {
+    Forward,
+    Inverse,
+    RealForward,
+    RealInverse,
+    BatchForward,
+    BatchInverse
+  };
+
+  static FftwPlans &instance()
+  {
+    static FftwPlans plans;
+    return plans;
+  }
+
+  /// The plan for a transform of @c kind on a grid of @c dims , with @c cells as an example buffer. Only the
+  /// buffer's size matters, it is not changed
+  fftw_plan get(const Eigen::Vector3i &dims, Kind kind, Complex *cells)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fftw_plan &plan = plans_[std::make_tuple(dims[0], dims[1], dims[2], static_cast<int>(kind))];
+    if (!plan)
+    {
+      // FFTW is row major, so the x axis, which is contiguous in our grids, is the last dimension
+      fftw_complex *buffer = reinterpret_cast<fftw_complex *>(cells);
+      const unsigned flags = FFTW_ESTIMATE | FFTW_UNALIGNED;  // estimation leaves the buffer untouched
+      switch (kind)
+      {
+      case Forward:
+        plan = fftw_plan_dft_3d(dims[2], dims[1], dims[0], buffer, buffer, FFTW_FORWARD, flags);
+        break;
+      case Inverse:
+        plan = fftw_plan_dft_3d(dims[2], dims[1], dims[0], buffer, buffer, FFTW_BACKWARD, flags);
+        break;
+      case RealForward:
+        plan = fftw_plan_dft_r2c_3d(dims[2], dims[1], dims[0], reinterpret_cast<double *>(cells), buffer, flags);
+        break;
+      case RealInverse:
+        plan = fftw_plan_dft_c2r_3d(dims[2], dims[1], dims[0], buffer, reinterpret_cast<double *>(cells), flags);
+        break;
+      case BatchForward:
+      case BatchInverse:
+        break;  // planned by getBatch()
+      }
+    }
+    return plan;
+  }
+
+  /// The plan for a transform of @c kind , @c BatchForward or @c BatchInverse , of each of @c count contiguous rows of
+  /// @c length cells, with @c cells as an example buffer
+  fftw_plan getBatch(int length, int count, Kind kind, Complex *cells)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    fftw_plan &plan = plans_[std::make_tuple(length, count, 0, static_cast<int>(kind))];
+    if (!plan)
+    {
+      fftw_complex *buffer = reinterpret_cast<fftw_complex *>(cells);
+      const unsigned flags = FFTW_ESTIMATE | FFTW_UNALIGNED;
+      const int sign = kind == BatchForward ? FFTW_FORWARD : FFTW_BACKWARD;
+      plan = fftw_plan_many_dft(1, &length, count, buffer, nullptr, 1, length, buffer, nullptr, 1, length, sign, flags);
+    }
+    return plan;
+  }
+
+private:
+  FftwPlans()
+  {
+    fftw_init_threads();
+    fftw_plan_with_nthreads(Threads::threadCount());
+  }
+  ~FftwPlans()
+  {
+    for (auto &plan : plans_)
+    {
+      fftw_destroy_plan(plan.second);
+    }
+    fftw_cleanup_threads();
+  }
+
+  std::map<std::tuple<int, int, int, int>, fftw_plan> plans_;
+  std::mutex mutex_;
+};
+#endif  // RAYLIB_WITH_FFTW
+
 void Array3D::init(const Eigen::Vector3d &box_min, double voxel_width, const Eigen::Vector3i &dimensions)
 {
   box_min_ = box_min;
@@ -81,17 +194,90 @@ void Array3D::conjugate()
 
 void Array3D::fft()
 {
+#if RAYLIB_WITH_FFTW
+  fftw_plan plan = FftwPlans::instance().get(dims_, FftwPlans::Forward, cells_.data());
+  fftw_complex *buffer = reinterpret_cast<fftw_complex *>(cells_.data());
+  fftw_execute_dft(plan, buffer, buffer);
+#else   // RAYLIB_WITH_FFTW
   const char *error = nullptr;
   // TODO: change to in-place (cells not repeated)
   if (!simple_fft::FFT(*this, *this, dims_[0], dims_[1], dims_[2], error))
     std::cout << "failed to calculate FFT: " << error << std::endl;
+#endif  // RAYLIB_WITH_FFTW
 }
 
 void Array3D::inverseFft()
 {
+#if RAYLIB_WITH_FFTW
+  fftw_plan plan = FftwPlans::instance().get(dims_, FftwPlans::Inverse, cells_.data());
+  fftw_complex *buffer = reinterpret_cast<fftw_complex *>(cells_.data());
+  fftw_execute_dft(plan, buffer, buffer);
+  const double scale = 1.0 / static_cast<double>(cells_.size());  // FFTW leaves the result unnormalised
+  for (auto &cell : cells_) cell *= scale;
+#else   // RAYLIB_WITH_FFTW
   const char *error = nullptr;
   if (!simple_fft::IFFT(*this, *this, dims_[0], dims_[1], dims_[2], error))
     std::cout << "failed to calculate inverse FFT: " << error << std::endl;
+#endif  // RAYLIB_WITH_FFTW
+}
+
+// The real transforms run in place on the cells buffer. FFTW's real grids have rows padded to 2*(dims_[0]/2 + 1)
+// doubles, and its spectra hold only the dims_[0]/2 + 1 non-redundant columns. Both layouts fit in the front of the
+// buffer, so the conversions to and from the full complex layout are in-place copies in a safe order.
+void Array3D::realFft()
+{
+#if RAYLIB_WITH_FFTW
+  const int width = dims_[0];
+  const int half = width / 2 + 1;
+  const int rows = dims_[1] * dims_[2];
+  double *reals = reinterpret_cast<double *>(cells_.data());
+  // pack the real parts into padded rows. The destinations never pass the sources, so copy forwards
+  for (int r = 0; r < rows; r++)
+    for (int x = 0; x < width; x++) reals[2 * half * r + x] = cells_[width * r + x].real();
+
+  fftw_plan plan = FftwPlans::instance().get(dims_, FftwPlans::RealForward, cells_.data());
+  fftw_execute_dft_r2c(plan, reals, reinterpret_cast<fftw_complex *>(cells_.data()));
+
+  // spread the half spectrum rows out to full rows. The destinations never precede the sources, so copy backwards
+  for (int r = rows - 1; r >= 0; r--)
+    for (int x = half - 1; x >= 0; x--) cells_[width * r + x] = cells_[half * r + x];
+  // then fill the redundant columns, from the conjugate symmetry of the transform of real data
+  for (int z = 0; z < dims_[2]; z++)
+  {
+    const int z2 = (dims_[2] - z) % dims_[2];
+    for (int y = 0; y < dims_[1]; y++)
+    {
+      const int y2 = (dims_[1] - y) % dims_[1];
+      for (int x = half; x < width; x++) (*this)(x, y, z) = std::conj((*this)(width - x, y2, z2));
+    }
+  }
+#else   // RAYLIB_WITH_FFTW
+  fft();
+#endif  // RAYLIB_WITH_FFTW
+}
+
+void Array3D::inverseRealFft()
+{
+#if RAYLIB_WITH_FFTW
+  const int width = dims_[0];
+  const int half = width / 2 + 1;
+  const int rows = dims_[1] * dims_[2];
+  // gather the non-redundant columns into half spectrum rows, copying forwards
+  for (int r = 0; r < rows; r++)
+    for (int x = 0; x < half; x++) cells_[half * r + x] = cells_[width * r + x];
+
+  double *reals = reinterpret_cast<double *>(cells_.data());
+  fftw_plan plan = FftwPlans::instance().get(dims_, FftwPlans::RealInverse, cells_.data());
+  fftw_execute_dft_c2r(plan, reinterpret_cast<fftw_complex *>(cells_.data()), reals);
+
+  // unpack the padded real rows into complex cells, copying backwards
+  const double scale = 1.0 / static_cast<double>(cells_.size());
+  for (int r = rows - 1; r >= 0; r--)
+    for (int x = width - 1; x >= 0; x--) cells_[width * r + x] = Complex(reals[2 * half * r + x] * scale, 0.0);
+#else   // RAYLIB_WITH_FFTW
+  inverseFft();
+  for (auto &cell : cells_) cell.imag(0.0);
+#endif  // RAYLIB_WITH_FFTW
 }
 
 Eigen::Vector3i Array3D::maxRealIndex() const
@@ -153,29 +339,56 @@ void Array1D::init(int length)
   memset(&cells_[0], 0, cells_.size() * sizeof(Complex));
 }
 
-void Array1D::operator*=(const Array1D &other)
+namespace
 {
-  for (int i = 0; i < (int)cells_.size(); i++) cells_[i] *= other.cells_[i];
-}
+/// One row of an @c Array1DBatch , in the form that simple_fft transforms
+struct RowView
+{
+  inline Complex &operator()(int x) { return cells[x]; }
+  inline const Complex &operator()(int x) const { return cells[x]; }
+  Complex *cells;
+};
+}  // namespace
 
-void Array1D::conjugate()
+void Array1DBatch::init(int length, int count)
 {
-  for (int i = 0; i < (int)cells_.size(); i++) cells_[i] = conj(cells_[i]);
+  length_ = length;
+  count_ = count;
+  cells_.assign(static_cast<size_t>(length) * count, Complex(0, 0));
 }
 
-void Array1D::fft()
+void Array1DBatch::fft()
 {
-  const char *error = nullptr;
-  // TODO: change to in-place (cells not repeated)
-  if (!simple_fft::FFT(*this, *this, cells_.size(), error))
-    std::cout << "failed to calculate FFT: " << error << std::endl;
+#if RAYLIB_WITH_FFTW
+  fftw_plan plan = FftwPlans::instance().getBatch(length_, count_, FftwPlans::BatchForward, cells_.data());
+  fftw_complex *buffer = reinterpret_cast<fftw_complex *>(cells_.data());
+  fftw_execute_dft(plan, buffer, buffer);
+#else   // RAYLIB_WITH_FFTW
+  parallelFor(0, count_, [&](int i) {
+    RowView view = { row(i) };
+    const char *error = nullptr;
+    if (!simple_fft::FFT(view, static_cast<size_t>(length_), error))
+      std::cout << "failed to calculate FFT: " << error << std::endl;
+  });
+#endif  // RAYLIB_WITH_FFTW
 }
 
-void Array1D::inverseFft()
+void Array1DBatch::inverseFft()
 {
-  const char *error = nullptr;
-  if (!simple_fft::IFFT(*this, *this, cells_.size(), error))
-    std::cout << "failed to calculate inverse FFT: " << error << std::endl;
+#if RAYLIB_WITH_FFTW
+  fftw_plan plan = FftwPlans::instance().getBatch(length_, count_, FftwPlans::BatchInverse, cells_.data());
+  fftw_complex *buffer = reinterpret_cast<fftw_complex *>(cells_.data());
+  fftw_execute_dft(plan, buffer, buffer);
+  const double scale = 1.0 / static_cast<double>(length_);  // FFTW leaves the result unnormalised
+  for (auto &cell : cells_) cell *= scale;
+#else   // RAYLIB_WITH_FFTW
+  parallelFor(0, count_, [&](int i) {
+    RowView view = { row(i) };
+    const char *error = nullptr;
+    if (!simple_fft::IFFT(view, static_cast<size_t>(length_), error))
+      std::cout << "failed to calculate inverse FFT: " << error << std::endl;
+  });
+#endif  // RAYLIB_WITH_FFTW
 }
 
 int Array1D::maxRealIndex() const
@@ -238,7 +451,7 @@ void drawArray(const Array3D &array, const Eigen::Vector3i &dims, const std::str
   stbi_write_png(str.str().c_str(), width, height, 4, (void *)&pixels[0], 4 * width);
 }
 
-void drawArray(const std::vector<Array1D> &arrays, const Eigen::Vector3i &dims, const std::string &file_name, int index)
+void drawArray(const Array1DBatch &arrays, const Eigen::Vector3i &dims, const std::string &file_name, int index)
 {
   int width = dims[0];
   int height = dims[1];
@@ -248,7 +461,7 @@ void drawArray(const std::vector<Array1D> &arrays, const Eigen::Vector3i &dims,
     for (int y = 0; y < height; y++)
     {
       double val = 0.0;
-      for (int z = 0; z < dims[2]; z++) val += abs(arrays[y + dims[1] * z](x));
+      for (int z = 0; z < dims[2]; z++) val += abs(arrays(x, y + dims[1] * z));
       max_val = std::max(max_val, val);
     }
   }
@@ -266,7 +479,7 @@ void drawArray(const std::vector<Array1D> &arrays, const Eigen::Vector3i &dims,
         col[0] = 1.0 - h;
         col[2] = h;
         col[1] = 3.0 * col[0] * col[2];
-        colour += std::abs(arrays[y + dims[1] * z](x)) * col;
+        colour += std::abs(arrays(x, y + dims[1] * z)) * col;
       }
       colour *= 3.0 * 255.0 / max_val;
       Col col;
@@ -287,18 +500,24 @@ void Array1D::polarCrossCorrelation(const Array3D *arrays, bool verbose)
   // OK cool, so next I need to re-map the two arrays into 4x1 grids...
   int max_rad = std::max(arrays[0].dimensions()[0], arrays[0].dimensions()[1]) / 2;
   Eigen::Vector3i polar_dims = Eigen::Vector3i(4 * max_rad, max_rad, arrays[0].dimensions()[2]);
-  std::vector<Array1D> polars[2];
+  const int num_rings = polar_dims[1] * polar_dims[2];
+  // the high pass filter is the same for every ring
+  std::vector<double> high_pass(polar_dims[0], 1.0);
+  if (kHighPassPower > 0.0)
+  {
+    for (int l = 0; l < polar_dims[0]; l++)
+      high_pass[l] = std::pow(std::min((double)l, (double)(polar_dims[0] - l)), kHighPassPower);
+  }
+  // ring j + polar_dims[1] * z is the ring of radius j in layer z
+  Array1DBatch polars[2];
   for (int c = 0; c < 2; c++)
   {
-    std::vector<Array1D> &polar = polars[c];
+    Array1DBatch &polar = polars[c];
     const Array3D &a = arrays[c];
-    polar.resize(polar_dims[1] * polar_dims[2]);
-    for (int j = 0; j < polar_dims[1]; j++)
-      for (int k = 0; k < polar_dims[2]; k++) polar[j + polar_dims[1] * k].init(polar_dims[0]);
+    polar.init(polar_dims[0], num_rings);
 
-    // now map...
-    for (int i = 0; i < polar_dims[0]; i++)
-    {
+    // now map... each angle fills its own cell of every ring
+    parallelFor(0, polar_dims[0], [&](int i) {
       double angle = 2.0 * kPi * (double)(i + 0.5) / (double)polar_dims[0];
       for (int j = 0; j < polar_dims[1]; j++)
       {
@@ -322,40 +541,145 @@ void Array1D::polarCrossCorrelation(const Array3D *arrays, bool verbose)
           double val = abs(a(x, y, z)) * (1.0 - blend_x) * (1.0 - blend_y) +
                        abs(a(x2, y, z)) * blend_x * (1.0 - blend_y) + abs(a(x, y2, z)) * (1.0 - blend_x) * blend_y +
                        abs(a(x2, y2, z)) * blend_x * blend_y;
-          polar[j + polar_dims[1] * z](i) = Complex(radius * val, 0);
+          polar(i, j + polar_dims[1] * z) = Complex(radius * val, 0);
         }
       }
-    }
+    });
     if (verbose)
       drawArray(polar, polar_dims, "translationInvPolar", c);
-    for (int j = 0; j < polar_dims[1]; j++)
+    polar.fft();
+    if (kHighPassPower > 0.0)
     {
-      for (int k = 0; k < polar_dims[2]; k++)
-      {
-        int i = j + polar_dims[1] * k;
-        polar[i].fft();
-        if (kHighPassPower > 0.0)
-        {
-          for (int l = 0; l < polar[i].numCells(); l++)
-            polar[i].cell(l) *= std::pow(std::min((double)l, (double)(polar[i].numCells() - l)), kHighPassPower);
-        }
-      }
+      parallelFor(0, num_rings, [&](int i) {
+        Complex *ring = polar.row(i);
+        for (int l = 0; l < polar_dims[0]; l++) ring[l] *= high_pass[l];
+      });
     }
     if (verbose)
       drawArray(polar, polar_dims, "euclideanInvariant", c);
   }
 
   // now get the inverse fft in place:
+  parallelFor(0, num_rings, [&](int i) {
+    Complex *ring0 = polars[0].row(i);
+    const Complex *ring1 = polars[1].row(i);
+    for (int l = 0; l < polar_dims[0]; l++) ring0[l] *= conj(ring1[l]);
+  });
+  polars[0].inverseFft();
+  // add all the results together into the first array, in ring order for each cell so the sum is deterministic
   init(polar_dims[0]);
-  for (size_t i = 0; i < polars[0].size(); i++)
+  parallelFor(0, polar_dims[0], [&](int l) {
+    Complex sum = cells_[l];
+    for (int i = 0; i < num_rings; i++) sum += polars[0](l, i);
+    cells_[l] = sum;
+  });
+}
+
+/************************************************************************************/
+namespace
+{
+/// Add each bounded end point of @c cloud to @c array , with unit weight
+void fillWithEnds(Array3D &array, const Cloud &cloud)
+{
+  for (int i = 0; i < (int)cloud.ends.size(); i++)
+    if (cloud.rayBounded(i))
+      array(cloud.ends[i]) += Complex(1, 0);
+}
+
+/// Weight the frequencies of the transformed @c array by their radius to the power of @c kHighPassPower
+void highPassFilter(Array3D &array)
+{
+  for (int x = 0; x < array.dimensions()[0]; x++)
   {
-    polars[1][i].conjugate();
-    polars[0][i] *= polars[1][i];
-    polars[0][i].inverseFft();
-    (*this) += polars[0][i];  // add all the results together into the first array
+    double coord_x = x < array.dimensions()[0] / 2 ? x : array.dimensions()[0] - x;
+    for (int y = 0; y < array.dimensions()[1]; y++)
+    {
+      double coord_y = y < array.dimensions()[1] / 2 ? y : array.dimensions()[1] - y;
+      for (int z = 0; z < array.dimensions()[2]; z++)
+      {
+        double coord_z = z < array.dimensions()[2] / 2 ? z : array.dimensions()[2] - z;
+        array(x, y, z) *= pow(sqr(coord_x) + sqr(coord_y) + sqr(coord_z), kHighPassPower);
+      }
+    }
   }
 }
 
+/// The location of the peak of the cross-correlation @c array , in voxels with sub-voxel accuracy. The location is
+/// unwrapped, so it is the offset from the origin cell. A non-negative @c search_radius limits the search to offsets
+/// within that many voxels of the origin on each axis.
+Eigen::Vector3d correlationPeak(const Array3D &array, int search_radius = -1)
+{
+  const Eigen::Vector3i &dims = array.dimensions();
+  Eigen::Vector3i ind = Eigen::Vector3i::Zero();
+  if (search_radius < 0)
+  {
+    ind = array.maxRealIndex();
+  }
+  else
+  {
+    // the origin cell is the peak unless a cell beats it, such as when every cell is NaN
+    double highest = array(ind).real();
+    Eigen::Vector3i r;
+    for (int axis = 0; axis < 3; axis++) r[axis] = std::min(search_radius, (dims[axis] - 1) / 2);
+    for (int x = -r[0]; x <= r[0]; x++)
+    {
+      for (int y = -r[1]; y <= r[1]; y++)
+      {
+        for (int z = -r[2]; z <= r[2]; z++)
+        {
+          Eigen::Vector3i index((x + dims[0]) % dims[0], (y + dims[1]) % dims[1], (z + dims[2]) % dims[2]);
+          if (array(index).real() > highest)
+          {
+            highest = array(index).real();
+            ind = index;
+          }
+        }
+      }
+    }
+  }
+  // add a little bit of sub-pixel accuracy:
+  Eigen::Vector3d pos;
+  for (int axis = 0; axis < 3; axis++)
+  {
+    Eigen::Vector3i back = ind, fwd = ind;
+    const int &dim = dims[axis];
+    back[axis] = (ind[axis] + dim - 1) % dim;
+    fwd[axis] = (ind[axis] + 1) % dim;
+    double y0 = array(back).real();
+    double y1 = array(ind).real();
+    double y2 = array(fwd).real();
+    pos[axis] =
+      ind[axis] + 0.5 * (y0 - y2) / (y0 + y2 - 2.0 * y1);  // just a quadratic maximum -b/2a for heights y0,y1,y2
+    // but the FFT wraps around, so:
+    if (pos[axis] > dim / 2)
+      pos[axis] -= dim;
+  }
+  return pos;
+}
+
+/// The translation that moves clouds[0] onto clouds[1], by cross-correlating their end point densities at
+/// @c voxel_width . Only the end points within a cube of @c window_cells voxels per side, centred on @c centre , are
+/// used, and only translations within @c search_radius voxels are considered.
+Eigen::Vector3d refineTranslation(const Cloud *clouds, const Eigen::Vector3d &centre, double voxel_width,
+                                  int window_cells, int search_radius)
+{
+  const Eigen::Vector3d box_min = centre - Eigen::Vector3d::Constant(0.5 * window_cells * voxel_width);
+  Array3D arrays[2];
+  for (int c = 0; c < 2; c++)
+  {
+    arrays[c].init(box_min, voxel_width, Eigen::Vector3i::Constant(window_cells));
+    fillWithEnds(arrays[c], clouds[c]);
+    arrays[c].realFft();
+    if (kHighPassPower > 0.0)
+      highPassFilter(arrays[c]);
+  }
+  arrays[1].conjugate();
+  arrays[0] *= arrays[1];
+  arrays[0].inverseRealFft();
+  return -voxel_width * correlationPeak(arrays[0], search_radius);
+}
+}  // namespace
+
 /************************************************************************************/
 void alignCloud0ToCloud1(Cloud *clouds, double voxel_width, bool verbose)
 {
@@ -387,10 +711,8 @@ void alignCloud0ToCloud1(Cloud *clouds, double voxel_width, bool verbose)
   for (int c = 0; c < 2; c++)
   {
     arrays[c].init(box_mins[c], box_mins[c] + box_width, voxel_width);
-    for (int i = 0; i < (int)clouds[c].ends.size(); i++)
-      if (clouds[c].rayBounded(i))
-        arrays[c](clouds[c].ends[i]) += Complex(1, 0);
-    arrays[c].fft();
+    fillWithEnds(arrays[c], clouds[c]);
+    arrays[c].realFft();
     if (verbose)
       drawArray(arrays[c], arrays[c].dimensions(), "translationInvariant", c);
   }
@@ -429,12 +751,9 @@ void alignCloud0ToCloud1(Cloud *clouds, double voxel_width, bool verbose)
         box_mins[0] = minVector(box_mins[0], clouds[0].ends[i]);
     arrays[0].clearCells();
     arrays[0].init(box_mins[0], box_mins[0] + box_width, voxel_width);
+    fillWithEnds(arrays[0], clouds[0]);
 
-    for (int i = 0; i < (int)clouds[0].ends.size(); i++)
-      if (clouds[0].rayBounded(i))
-        arrays[0](clouds[0].ends[i]) += Complex(1, 0);
-
-    arrays[0].fft();
+    arrays[0].realFft();
     if (verbose)
       drawArray(arrays[0], arrays[0].dimensions(), "translationInvariantWeighted", 0);
   }
@@ -443,19 +762,7 @@ void alignCloud0ToCloud1(Cloud *clouds, double voxel_width, bool verbose)
   {
     for (int c = 0; c < 2; c++)
     {
-      for (int x = 0; x < arrays[c].dimensions()[0]; x++)
-      {
-        double coord_x = x < arrays[c].dimensions()[0] / 2 ? x : arrays[c].dimensions()[0] - x;
-        for (int y = 0; y < arrays[c].dimensions()[1]; y++)
-        {
-          double coord_y = y < arrays[c].dimensions()[1] / 2 ? y : arrays[c].dimensions()[1] - y;
-          for (int z = 0; z < arrays[c].dimensions()[2]; z++)
-          {
-            double coord_z = z < arrays[c].dimensions()[2] / 2 ? z : arrays[c].dimensions()[2] - z;
-            arrays[c](x, y, z) *= pow(sqr(coord_x) + sqr(coord_y) + sqr(coord_z), kHighPassPower);
-          }
-        }
-      }
+      highPassFilter(arrays[c]);
       if (verbose)
         drawArray(arrays[c], arrays[c].dimensions(), "normalised", c);
     }
@@ -464,28 +771,11 @@ void alignCloud0ToCloud1(Cloud *clouds, double voxel_width, bool verbose)
   // now get the the translation part
   arrays[1].conjugate();
   arrays[0] *= arrays[1];
-  arrays[0].inverseFft();
+  arrays[0].inverseRealFft();
 
   // find the peak
   Array3D &array = arrays[0];
-  Eigen::Vector3i ind = array.maxRealIndex();
-  // add a little bit of sub-pixel accuracy:
-  Eigen::Vector3d pos;
-  for (int axis = 0; axis < 3; axis++)
-  {
-    Eigen::Vector3i back = ind, fwd = ind;
-    int &dim = array.dimensions()[axis];
-    back[axis] = (ind[axis] + dim - 1) % dim;
-    fwd[axis] = (ind[axis] + 1) % dim;
-    double y0 = array(back).real();
-    double y1 = array(ind).real();
-    double y2 = array(fwd).real();
-    pos[axis] =
-      ind[axis] + 0.5 * (y0 - y2) / (y0 + y2 - 2.0 * y1);  // just a quadratic maximum -b/2a for heights y0,y1,y2
-    // but the FFT wraps around, so:
-    if (pos[axis] > dim / 2)
-      pos[axis] -= dim;
-  }
+  Eigen::Vector3d pos = correlationPeak(array);
   pos *= -array.voxelWidth();
   pos += box_mins[1] - box_mins[0];
   if (verbose)
@@ -494,4 +784,51 @@ void alignCloud0ToCloud1(Cloud *clouds, double voxel_width, bool verbose)
   Pose transform(pos, Eigen::Quaterniond::Identity());
   clouds[0].transform(transform, 0.0);
 }
+
+void alignCloud0ToCloud1Pyramid(Cloud *clouds, double coarse_voxel_width, double voxel_width, int window_cells,
+                                bool verbose)
+{
+  alignCloud0ToCloud1(clouds, coarse_voxel_width, verbose);
+  if (voxel_width >= coarse_voxel_width)
+    return;
+  window_cells = 1 << (int)ceil(log2(std::max(window_cells, 4)));  // the FFTs need a power of two
+
+  // centre the refinement windows on the overlap of the two clouds' bounds
+  Eigen::Vector3d box_mins[2], box_maxs[2];
+  for (int c = 0; c < 2; c++)
+  {
+    const double mx = std::numeric_limits<double>::max();
+    const double mn = std::numeric_limits<double>::lowest();
+    box_mins[c] = Eigen::Vector3d(mx, mx, mx);
+    box_maxs[c] = Eigen::Vector3d(mn, mn, mn);
+    for (int i = 0; i < (int)clouds[c].ends.size(); i++)
+    {
+      if (clouds[c].rayBounded(i))
+      {
+        box_mins[c] = minVector(box_mins[c], clouds[c].ends[i]);
+        box_maxs[c] = maxVector(box_maxs[c], clouds[c].ends[i]);
+      }
+    }
+  }
+  const Eigen::Vector3d overlap_min = maxVector(box_mins[0], box_mins[1]);
+  const Eigen::Vector3d overlap_max = minVector(box_maxs[0], box_maxs[1]);
+  const Eigen::Vector3d centre = (overlap_min.array() <= overlap_max.array()).all() ?
+                                   Eigen::Vector3d(0.5 * (overlap_min + overlap_max)) :
+                                   Eigen::Vector3d(0.5 * (box_mins[1] + box_maxs[1]));
+
+  // halve the voxel width at each level, searching within two voxels of the previous level's estimate
+  double previous_width = coarse_voxel_width;
+  while (previous_width > voxel_width)
+  {
+    const double width = std::max(voxel_width, 0.5 * previous_width);
+    const int search_radius = (int)std::ceil(2.0 * previous_width / width);
+    Eigen::Vector3d translation = refineTranslation(clouds, centre, width, window_cells, search_radius);
+    if (verbose)
+      std::cout << "Coarse align: refined translation at voxel width " << width << ": " << translation.transpose()
+                << std::endl;
+    Pose transform(translation, Eigen::Quaterniond::Identity());
+    clouds[0].transform(transform, 0.0);
+    previous_width = width;
+  }
+}
 }  // namespace ray
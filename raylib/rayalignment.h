@@ -25,6 +25,14 @@ namespace ray
 /// densities. NOTE @c clouds is a pair of clouds, it should point to an array with at least 2 elements
 void RAYLIB_EXPORT alignCloud0ToCloud1(Cloud *clouds, double voxel_width, bool verbose = false);
 
+/// Coarse-to-fine form of @c alignCloud0ToCloud1 . The rotation and translation are estimated at
+/// @c coarse_voxel_width , then the translation is refined at successively halved voxel widths down to
+/// @c voxel_width . Each refinement correlates only a cubic window of @c window_cells voxels per side (rounded up to a
+/// power of two), centred on the overlap of the clouds, and searches within two voxels of the previous level's
+/// estimate. Memory is therefore bounded by the window rather than by the cloud extent over @c voxel_width .
+void RAYLIB_EXPORT alignCloud0ToCloud1Pyramid(Cloud *clouds, double coarse_voxel_width, double voxel_width,
+                                              int window_cells = 128, bool verbose = false);
+
 /// 3D grid structure of complex numbers, for performing fast Fourier transforms (FFTs)
 struct Array3D
 {
@@ -36,6 +44,13 @@ struct Array3D
   void fft();
   // Inverse Fast Fourier Transform
   void inverseFft();
+  /// Fast Fourier Transform of a grid whose cells are all real, such as one from @c fillWithRays . With FFTW this is
+  /// a real-to-complex transform, otherwise it is the same as @c fft()
+  void realFft();
+  /// Inverse Fast Fourier Transform of a grid whose result is real, which is the case when the cells have conjugate
+  /// symmetry, such as the product of one @c realFft() grid and the conjugate of another. The imaginary parts of the
+  /// result are zero
+  void inverseRealFft();
 
   void operator*=(const Array3D &other);
 
@@ -0,0 +1,263 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "rayallocprofile.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+
+namespace ray
+{
+namespace
+{
+/// the counters of a category. These are updated by every allocation, so are kept on their own cache lines
+struct alignas(64) CategoryCounters
+{
+  std::atomic<size_t> allocations{ 0 };
+  std::atomic<size_t> bytes{ 0 };
+  std::atomic<size_t> live_bytes{ 0 };
+  std::atomic<size_t> peak_live_bytes{ 0 };
+};
+
+// category 0 is "other", and space k + 1 of the table is for the total
+CategoryCounters counters[AllocationProfile::kMaxCategories + 1];
+const char *category_names[AllocationProfile::kMaxCategories] = { "other" };
+std::atomic<int> num_categories{ 1 };
+std::mutex category_mutex;
+thread_local int current_category = 0;
+
+CategoryCounters &totalCounters()
+{
+  return counters[AllocationProfile::kMaxCategories];
+}
+
+AllocationCounts read(const CategoryCounters &counter)
+{
+  AllocationCounts counts;
+  counts.allocations = counter.allocations.load(std::memory_order_relaxed);
+  counts.bytes = counter.bytes.load(std::memory_order_relaxed);
+  counts.live_bytes = counter.live_bytes.load(std::memory_order_relaxed);
+  counts.peak_live_bytes = counter.peak_live_bytes.load(std::memory_order_relaxed);
+  return counts;
+}
+
+/// the index of category @c name , adding it if there is room
+int categoryIndex(const char *name)
+{
+  const int count = num_categories.load(std::memory_order_acquire);
+  for (int i = 0; i < count; i++)
+  {
+    if (category_names[i] == name || std::strcmp(category_names[i], name) == 0)
+      return i;
+  }
+  std::lock_guard<std::mutex> lock(category_mutex);
+  const int locked_count = num_categories.load(std::memory_order_relaxed);
+  for (int i = count; i < locked_count; i++)
+  {
+    if (std::strcmp(category_names[i], name) == 0)
+      return i;
+  }
+  if (locked_count == AllocationProfile::kMaxCategories)
+    return 0;
+  category_names[locked_count] = name;
+  num_categories.store(locked_count + 1, std::memory_order_release);
+  return locked_count;
+}
+
+#if RAYLIB_ALLOC_PROFILE
+/// Stored before each allocation, so that it can be freed and uncounted. Its space keeps the alignment of malloc.
+struct AllocationHeader
+{
+  void *base;
+  size_t size;
+  int category;
+};
+const size_t kHeaderSpace = 32;
+static_assert(sizeof(AllocationHeader) <= kHeaderSpace, "allocation header does not fit");
+
+void addLive(CategoryCounters &counter, size_t size)
+{
+  counter.allocations.fetch_add(1, std::memory_order_relaxed);
+  counter.bytes.fetch_add(size, std::memory_order_relaxed);
+  const size_t live = counter.live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+  size_t peak = counter.peak_live_bytes.load(std::memory_order_relaxed);
+  while (live > peak && !counter.peak_live_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+  {
+  }
+}
+
+void *allocate(size_t size, size_t alignment)
+{
+  if (alignment < kHeaderSpace)
+    alignment = 1;  // malloc's alignment suffices
+  void *base = std::malloc(size + kHeaderSpace + (alignment > 1 ? alignment : 0));
+  if (!base)
+    return nullptr;
+  uintptr_t data = reinterpret_cast<uintptr_t>(base) + kHeaderSpace;
+  if (alignment > 1)
+    data = (data + alignment - 1) & ~(static_cast<uintptr_t>(alignment) - 1);
+  AllocationHeader *header = reinterpret_cast<AllocationHeader *>(data - kHeaderSpace);
+  header->base = base;
+  header->size = size;
+  header->category = current_category;
+  addLive(counters[header->category], size);
+  addLive(totalCounters(), size);
+  return reinterpret_cast<void *>(data);
+}
+
+void *allocateOrThrow(size_t size, size_t alignment)
+{
+  for (;;)
+  {
+    void *data = allocate(size, alignment);
+    if (data)
+      return data;
+    std::new_handler handler = std::get_new_handler();
+    if (!handler)
+      throw std::bad_alloc();
+    handler();
+  }
+}
+
+void release(void *data)
+{
+  if (!data)
+    return;
+  AllocationHeader *header = reinterpret_cast<AllocationHeader *>(reinterpret_cast<uintptr_t>(data) - kHeaderSpace);
+  counters[header->category].live_bytes.fetch_sub(header->size, std::memory_order_relaxed);
+  totalCounters().live_bytes.fetch_sub(header->size, std::memory_order_relaxed);
+  std::free(header->base);
+}
+#endif  // RAYLIB_ALLOC_PROFILE
+}  // namespace
+
+bool AllocationProfile::available()
+{
+  return RAYLIB_ALLOC_PROFILE != 0;
+}
+
+AllocationCounts AllocationProfile::totals()
+{
+  return read(totalCounters());
+}
+
+std::vector<std::pair<std::string, AllocationCounts>> AllocationProfile::categories()
+{
+  std::vector<std::pair<std::string, AllocationCounts>> result;
+  const int count = num_categories.load(std::memory_order_acquire);
+  for (int i = 0; i < count; i++)
+  {
+    const AllocationCounts counts = read(counters[i]);
+    if (counts.allocations > 0)
+      result.emplace_back(category_names[i], counts);
+  }
+  return result;
+}
+
+AllocationCategory::AllocationCategory(const char *name)
+  : previous_(current_category)
+{
+  if (AllocationProfile::available())
+    current_category = categoryIndex(name);
+}
+
+AllocationCategory::~AllocationCategory()
+{
+  current_category = previous_;
+}
+}  // namespace ray
+
+#if RAYLIB_ALLOC_PROFILE
+// The replacement global allocation functions. The sized and aligned forms of delete find the size and base from the
+// header, so all forms share one release. The aligned forms are only declared from C++17.
+void *operator new(size_t size)
+{
+  return ray::allocateOrThrow(size, 1);
+}
+void *operator new[](size_t size)
+{
+  return ray::allocateOrThrow(size, 1);
+}
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+  return ray::allocate(size, 1);
+}
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+  return ray::allocate(size, 1);
+}
+#ifdef __cpp_aligned_new
+void *operator new(size_t size, std::align_val_t alignment)
+{
+  return ray::allocateOrThrow(size, static_cast<size_t>(alignment));
+}
+void *operator new[](size_t size, std::align_val_t alignment)
+{
+  return ray::allocateOrThrow(size, static_cast<size_t>(alignment));
+}
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+  return ray::allocate(size, static_cast<size_t>(alignment));
+}
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept
+{
+  return ray::allocate(size, static_cast<size_t>(alignment));
+}
+#endif  // __cpp_aligned_new
+void operator delete(void *data) noexcept
+{
+  ray::release(data);
+}
+void operator delete[](void *data) noexcept
+{
+  ray::release(data);
+}
+void operator delete(void *data, size_t) noexcept
+{
+  ray::release(data);
+}
+void operator delete[](void *data, size_t) noexcept
+{
+  ray::release(data);
+}
+void operator delete(void *data, const std::nothrow_t &) noexcept
+{
+  ray::release(data);
+}
+void operator delete[](void *data, const std::nothrow_t &) noexcept
+{
+  ray::release(data);
+}
+#ifdef __cpp_aligned_new
+void operator delete(void *data, std::align_val_t) noexcept
+{
+  ray::release(data);
+}
+void operator delete[](void *data, std::align_val_t) noexcept
+{
+  ray::release(data);
+}
+void operator delete(void *data, size_t, std::align_val_t) noexcept
+{
+  ray::release(data);
+}
+void operator delete[](void *data, size_t, std::align_val_t) noexcept
+{
+  ray::release(data);
+}
+void operator delete(void *data, std::align_val_t, const std::nothrow_t &) noexcept
+{
+  ray::release(data);
+}
+void operator delete[](void *data, std::align_val_t, const std::nothrow_t &) noexcept
+{
+  ray::release(data);
+}
+#endif  // __cpp_aligned_new
+#endif  // RAYLIB_ALLOC_PROFILE
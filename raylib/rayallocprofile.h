@@ -0,0 +1,64 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYALLOCPROFILE_H
+#define RAYLIB_RAYALLOCPROFILE_H
+
+#include "raylib/raylibconfig.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace ray
+{
+/// Counts of heap allocations through operator new
+struct RAYLIB_EXPORT AllocationCounts
+{
+  /// the number of allocations
+  size_t allocations = 0;
+  /// the bytes requested by those allocations
+  size_t bytes = 0;
+  /// the bytes allocated and not yet freed
+  size_t live_bytes = 0;
+  /// the high-water mark of @c live_bytes
+  size_t peak_live_bytes = 0;
+};
+
+/// The allocation counts of a build configured with RAYCLOUD_ALLOC_PROFILE, which replaces the global operator new and
+/// delete with ones that count each allocation. The counts are kept in total and per @c AllocationCategory , and the
+/// @c Profile adds them to each phase that it records. In other builds @c available() is false and the counts are 0.
+class RAYLIB_EXPORT AllocationProfile
+{
+public:
+  /// the most categories that are told apart. Later categories are counted as "other"
+  static const int kMaxCategories = 32;
+
+  /// whether allocations are being counted
+  static bool available();
+  /// the counts of all allocations so far
+  static AllocationCounts totals();
+  /// the counts so far, per category that has been used. Allocations outside any category are under "other"
+  static std::vector<std::pair<std::string, AllocationCounts>> categories();
+};
+
+/// Counts the allocations of the calling thread under the category @c name while in scope, such as "ply decode" or
+/// "neighbours". Categories nest, with the innermost counting. Work that the scope hands to other threads is counted
+/// under their own categories, so parallel bodies need their own scope. @c name must outlive the run, as with a
+/// string literal.
+class RAYLIB_EXPORT AllocationCategory
+{
+public:
+  explicit AllocationCategory(const char *name);
+  AllocationCategory(const AllocationCategory &) = delete;
+  AllocationCategory &operator=(const AllocationCategory &) = delete;
+  ~AllocationCategory();
+
+private:
+  int previous_;
+};
+}  // namespace ray
+
+#endif  // RAYLIB_RAYALLOCPROFILE_H
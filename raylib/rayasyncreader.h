@@ -0,0 +1,54 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYASYNCREADER_H
+#define RAYLIB_RAYASYNCREADER_H
+
+#include "raylib/raylibconfig.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace ray
+{
+/// Reads large ranges of a file as many reads in flight at once, so that fast (NVMe) storage is kept busy, which a
+/// single stream of reads does not do. It uses Linux io_uring when raylib is built WITH_IO_URING, otherwise
+/// @c available() is false, @c open() fails, and callers should use their mapped or stream based reads.
+class RAYLIB_EXPORT AsyncReader
+{
+public:
+  /// the size in bytes of each read
+  static const size_t kReadSize = 1 << 20;
+  /// the most reads in flight at once
+  static const unsigned kQueueDepth = 16;
+
+  AsyncReader();
+  ~AsyncReader();
+  AsyncReader(const AsyncReader &) = delete;
+  AsyncReader &operator=(const AsyncReader &) = delete;
+
+  /// whether raylib was built with an asynchronous read backend
+  static bool available();
+
+  /// open @c file_name for reading. Returns false if it cannot be opened or there is no backend.
+  bool open(const std::string &file_name);
+  /// close the file. Called automatically on destruction.
+  void close();
+  /// whether a file is currently open
+  bool isOpen() const;
+
+  /// Read the @c size bytes at @c offset into @c buffer , and wait for them. Returns the number of bytes read, which
+  /// is fewer if the file ends first or a read fails.
+  size_t read(uint64_t offset, size_t size, unsigned char *buffer);
+
+private:
+  struct Detail;
+  std::unique_ptr<Detail> detail_;
+};
+}  // namespace ray
+
+#endif  // RAYLIB_RAYASYNCREADER_H
@@ -0,0 +1,44 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "rayasyncreader.h"
+
+#include "rayunused.h"
+
+namespace ray
+{
+struct AsyncReader::Detail
+{
+};
+
+AsyncReader::AsyncReader() = default;
+AsyncReader::~AsyncReader() = default;
+
+bool AsyncReader::available()
+{
+  return false;
+}
+
+bool AsyncReader::open(const std::string &file_name)
+{
+  RAYLIB_UNUSED(file_name);
+  return false;
+}
+
+void AsyncReader::close() {}
+
+bool AsyncReader::isOpen() const
+{
+  return false;
+}
+
+size_t AsyncReader::read(uint64_t offset, size_t size, unsigned char *buffer)
+{
+  RAYLIB_UNUSED(offset);
+  RAYLIB_UNUSED(size);
+  RAYLIB_UNUSED(buffer);
+  return 0;
+}
+}  // namespace ray
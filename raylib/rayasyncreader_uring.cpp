@@ -0,0 +1,261 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "rayasyncreader.h"
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+namespace ray
+{
+/// The io_uring queues of an open file. This uses the kernel interface directly, so needs no library. Reads are
+/// vectored reads (IORING_OP_READV) so that it works on all kernels with io_uring, from Linux 5.1.
+struct AsyncReader::Detail
+{
+  int file = -1;
+  int ring = -1;
+  void *sq_map = nullptr;
+  size_t sq_map_size = 0;
+  void *cq_map = nullptr;
+  size_t cq_map_size = 0;
+  io_uring_sqe *sqes = nullptr;
+  size_t sqes_size = 0;
+
+  unsigned *sq_head = nullptr;
+  unsigned *sq_tail = nullptr;
+  unsigned *sq_mask = nullptr;
+  unsigned *sq_array = nullptr;
+  unsigned *cq_head = nullptr;
+  unsigned *cq_tail = nullptr;
+  unsigned *cq_mask = nullptr;
+  io_uring_cqe *cqes = nullptr;
+
+  /// the buffer of each read in flight, by submission slot
+  iovec iovecs[kQueueDepth];
+
+  ~Detail()
+  {
+    if (sqes)
+      munmap(sqes, sqes_size);
+    if (cq_map && cq_map != sq_map)
+      munmap(cq_map, cq_map_size);
+    if (sq_map)
+      munmap(sq_map, sq_map_size);
+    if (ring >= 0)
+      ::close(ring);
+    if (file >= 0)
+      ::close(file);
+  }
+
+  bool setup()
+  {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ring = static_cast<int>(syscall(__NR_io_uring_setup, kQueueDepth, &params));
+    if (ring < 0)
+      return false;
+    sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_map_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single_map = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_map)
+      sq_map_size = cq_map_size = std::max(sq_map_size, cq_map_size);
+    sq_map = mmap(nullptr, sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+    if (sq_map == MAP_FAILED)
+    {
+      sq_map = nullptr;
+      return false;
+    }
+    cq_map = single_map ? sq_map :
+                          mmap(nullptr, cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring,
+                               IORING_OFF_CQ_RING);
+    if (cq_map == MAP_FAILED)
+    {
+      cq_map = nullptr;
+      return false;
+    }
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    void *sqes_map = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+    if (sqes_map == MAP_FAILED)
+      return false;
+    sqes = static_cast<io_uring_sqe *>(sqes_map);
+
+    unsigned char *sq = static_cast<unsigned char *>(sq_map);
+    sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    unsigned char *cq = static_cast<unsigned char *>(cq_map);
+    cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+    return true;
+  }
+
+  /// queue a read of @c size bytes at @c offset into @c buffer , in submission slot @c slot
+  void queue(unsigned slot, uint64_t offset, unsigned char *buffer, size_t size)
+  {
+    const unsigned tail = *sq_tail;
+    const unsigned index = tail & *sq_mask;
+    iovecs[slot].iov_base = buffer;
+    iovecs[slot].iov_len = size;
+    io_uring_sqe &sqe = sqes[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = IORING_OP_READV;
+    sqe.fd = file;
+    sqe.off = offset;
+    sqe.addr = reinterpret_cast<uint64_t>(&iovecs[slot]);
+    sqe.len = 1;
+    sqe.user_data = slot;
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+  }
+
+  /// submit @c to_submit queued reads and wait for at least one completion
+  bool enter(unsigned to_submit)
+  {
+    while (syscall(__NR_io_uring_enter, ring, to_submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0)
+    {
+      if (errno != EINTR)
+        return false;
+      to_submit = 0;  // interrupted calls have already submitted
+    }
+    return true;
+  }
+};
+
+// out of line definitions of the constants, as std::min binds them to references
+const size_t AsyncReader::kReadSize;
+const unsigned AsyncReader::kQueueDepth;
+
+AsyncReader::AsyncReader() = default;
+
+AsyncReader::~AsyncReader() = default;
+
+bool AsyncReader::available()
+{
+  return true;
+}
+
+bool AsyncReader::open(const std::string &file_name)
+{
+  close();
+  std::unique_ptr<Detail> detail(new Detail);
+  detail->file = ::open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+  if (detail->file < 0 || !detail->setup())
+  {
+    return false;  // including kernels without io_uring, or where it is disabled
+  }
+  posix_fadvise(detail->file, 0, 0, POSIX_FADV_SEQUENTIAL);
+  detail_ = std::move(detail);
+  return true;
+}
+
+void AsyncReader::close()
+{
+  detail_.reset();
+}
+
+bool AsyncReader::isOpen() const
+{
+  return detail_ != nullptr;
+}
+
+size_t AsyncReader::read(uint64_t offset, size_t size, unsigned char *buffer)
+{
+  if (!detail_)
+  {
+    return 0;
+  }
+  Detail &d = *detail_;
+  /// the remaining part of each read in flight, which is requeued if the kernel returns fewer bytes
+  struct Piece
+  {
+    size_t start;
+    size_t size;
+  };
+  Piece pieces[kQueueDepth];
+  std::vector<unsigned> free_slots;
+  for (unsigned slot = kQueueDepth; slot-- > 0;) free_slots.push_back(slot);
+  size_t next = 0;    // the start of the first unqueued byte
+  size_t end = size;  // reads shorten this at the end of the file or on failure
+  unsigned in_flight = 0;
+  unsigned requeued = 0;  // reads queued again after a completion, which are submitted with the next reads
+  bool failed = false;
+  while (in_flight > 0 || (next < end && !failed))
+  {
+    unsigned to_submit = requeued;
+    requeued = 0;
+    while (!failed && next < end && !free_slots.empty())
+    {
+      const unsigned slot = free_slots.back();
+      free_slots.pop_back();
+      pieces[slot].start = next;
+      pieces[slot].size = std::min(kReadSize, end - next);
+      d.queue(slot, offset + next, buffer + next, pieces[slot].size);
+      next += pieces[slot].size;
+      to_submit++;
+      in_flight++;
+    }
+    if (!d.enter(to_submit))
+    {
+      std::cerr << "Error: asynchronous read failed: " << std::strerror(errno) << std::endl;
+      close();  // the ring is no longer usable
+      return 0;
+    }
+
+    unsigned head = *d.cq_head;
+    const unsigned tail = __atomic_load_n(d.cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++)
+    {
+      const io_uring_cqe &cqe = d.cqes[head & *d.cq_mask];
+      const unsigned slot = static_cast<unsigned>(cqe.user_data);
+      Piece &piece = pieces[slot];
+      in_flight--;
+      if (cqe.res == -EINTR || cqe.res == -EAGAIN)
+      {
+        d.queue(slot, offset + piece.start, buffer + piece.start, piece.size);
+        in_flight++;
+        requeued++;
+        continue;
+      }
+      if (cqe.res <= 0)
+      {
+        if (cqe.res < 0)
+        {
+          std::cerr << "Error: asynchronous read failed: " << std::strerror(-cqe.res) << std::endl;
+          failed = true;
+        }
+        end = std::min(end, piece.start);  // the end of the file
+        free_slots.push_back(slot);
+        continue;
+      }
+      piece.start += static_cast<size_t>(cqe.res);
+      piece.size -= static_cast<size_t>(cqe.res);
+      if (piece.size > 0 && piece.start < end)
+      {
+        d.queue(slot, offset + piece.start, buffer + piece.start, piece.size);
+        in_flight++;
+        requeued++;
+      }
+      else
+      {
+        free_slots.push_back(slot);
+      }
+    }
+    __atomic_store_n(d.cq_head, head, __ATOMIC_RELEASE);
+  }
+  return end;
+}
+}  // namespace ray
@@ -7,9 +7,20 @@
 #include "raycloud.h"
 #include "raycloudwriter.h"
 #include "rayply.h"
+#include "rayplyindex.h"
+#include "rayrcb.h"
+#include "raythreads.h"
 #include "rayunused.h"
 #include "rayutils.h"
 
+#if RAYLIB_WITH_TBB
+#include <tbb/enumerable_thread_specific.h>
+#endif  // RAYLIB_WITH_TBB
+
+#include <array>
+#include <memory>
+#include <unordered_map>
+
 namespace ray
 {
 namespace
@@ -20,6 +31,268 @@ namespace
 /// function, they are fixed.
 const int ang_res = 256;  // ang_res must be divisible by 2
 const int amp_res = 256;
+
+/// The cells across each axis of the lattices used when the cloud's bounds are not known before it is read. These are
+/// finer than the arrays that they are re-binned into, so that little weight moves between cells of those arrays.
+const int64_t kLatticeCells = 2 * amp_res;
+const int64_t kVerticalLatticeCells = 8 * amp_res;
+
+inline int64_t floorDivide(int64_t value, int64_t divisor)
+{
+  return value >= 0 ? value / divisor : (value - divisor + 1) / divisor;
+}
+
+/// The sum and count of the points in each cell of an N dimensional lattice anchored at the origin. The cell width
+/// starts small and doubles whenever the occupied cells would span more than @c max_cells on an axis, which merges
+/// whole cells, so the sums stay exact and only their cells coarsen. This bins points before their bounds are known.
+/// Each sum is relative to its cell's corner, to keep its precision on clouds far from the origin.
+template <int N>
+class CellSums
+{
+public:
+  using Vector = Eigen::Matrix<double, N, 1>;
+  using Key = std::array<int64_t, N>;
+
+  explicit CellSums(int64_t max_cells)
+    : max_cells_(max_cells)
+  {}
+
+  /// add the point @c pos
+  void add(const Vector &pos)
+  {
+    Key key;
+    for (int d = 0; d < N; d++) key[d] = static_cast<int64_t>(std::floor(pos[d] / width_));
+    addCell(key, pos - corner(key), 1.0);
+  }
+
+  /// add the sums of @c other , which may be at a different cell width
+  void merge(const CellSums &other)
+  {
+    while (width_ < other.width_) coarsen();
+    const int64_t scale = static_cast<int64_t>(std::round(width_ / other.width_));
+    for (const auto &cell : other.cells_)
+    {
+      Key key;
+      for (int d = 0; d < N; d++) key[d] = floorDivide(cell.first[d], scale);
+      addCell(key, cell.second.sum + (other.corner(cell.first) - corner(key)) * cell.second.count, cell.second.count);
+    }
+  }
+
+  /// call @c func(mean, count) with the mean position and number of points in each occupied cell
+  template <class Func>
+  void forEach(const Func &func) const
+  {
+    for (const auto &cell : cells_) func(corner(cell.first) + cell.second.sum / cell.second.count, cell.second.count);
+  }
+
+private:
+  struct Cell
+  {
+    Vector sum = Vector::Zero();
+    double count = 0.0;
+  };
+  struct KeyHash
+  {
+    size_t operator()(const Key &key) const
+    {
+      uint64_t hash = 0;
+      for (const int64_t value : key) hash = (hash ^ static_cast<uint64_t>(value)) * 0x9e3779b97f4a7c15ull;
+      return static_cast<size_t>(hash ^ (hash >> 32));
+    }
+  };
+
+  inline Vector corner(const Key &key) const
+  {
+    Vector pos;
+    for (int d = 0; d < N; d++) pos[d] = static_cast<double>(key[d]) * width_;
+    return pos;
+  }
+
+  /// add a sum relative to the corner of cell @c key , coarsening the lattice until the cell fits within it
+  void addCell(Key key, Vector sum, double count)
+  {
+    while (!fits(key))
+    {
+      const Vector old_corner = corner(key);
+      coarsen();
+      for (int d = 0; d < N; d++) key[d] = floorDivide(key[d], 2);
+      sum += (old_corner - corner(key)) * count;
+    }
+    for (int d = 0; d < N; d++)
+    {
+      min_key_[d] = cells_.empty() ? key[d] : std::min(min_key_[d], key[d]);
+      max_key_[d] = cells_.empty() ? key[d] : std::max(max_key_[d], key[d]);
+    }
+    Cell &cell = cells_[key];
+    cell.sum += sum;
+    cell.count += count;
+  }
+
+  bool fits(const Key &key) const
+  {
+    if (cells_.empty())
+      return true;
+    for (int d = 0; d < N; d++)
+    {
+      if (std::max(max_key_[d], key[d]) - std::min(min_key_[d], key[d]) >= max_cells_)
+        return false;
+    }
+    return true;
+  }
+
+  /// double the cell width, merging each 2^N cells into one
+  void coarsen()
+  {
+    std::unordered_map<Key, Cell, KeyHash> coarse;
+    coarse.reserve(cells_.size());
+    const double old_width = width_;
+    width_ *= 2.0;
+    for (const auto &cell : cells_)
+    {
+      Key key;
+      Vector old_corner;
+      for (int d = 0; d < N; d++)
+      {
+        key[d] = floorDivide(cell.first[d], 2);
+        old_corner[d] = static_cast<double>(cell.first[d]) * old_width;
+      }
+      Cell &coarse_cell = coarse[key];
+      coarse_cell.sum += cell.second.sum + (old_corner - corner(key)) * cell.second.count;
+      coarse_cell.count += cell.second.count;
+    }
+    cells_.swap(coarse);
+    for (int d = 0; d < N; d++)
+    {
+      min_key_[d] = floorDivide(min_key_[d], 2);
+      max_key_[d] = floorDivide(max_key_[d], 2);
+    }
+  }
+
+  int64_t max_cells_;
+  double width_ = 1.0 / 65536.0;  // an initial width well below the resolution of any lidar
+  Key min_key_, max_key_;
+  std::unordered_map<Key, Cell, KeyHash> cells_;
+};
+
+/// The weighted centroid field and vertical density of the bounded end points, over the known bounds of the cloud
+struct GridAccumulator
+{
+  explicit GridAccumulator(const Cuboid &bounds)
+    : min_bound(bounds.min_bound_)
+    , mid_bound((bounds.min_bound_ + bounds.max_bound_) / 2.0)
+    , position_accumulator(amp_res, amp_res)
+    , vertical_weights(amp_res)  // TODO: height is usually much less than width... more constant voxel size?
+  {
+    const double eps = 0.0001;  // to stop edge cases exceeding the array bounds
+    const Eigen::Vector3d extent = bounds.max_bound_ - bounds.min_bound_;
+    for (int i = 0; i < 3; i++) step[i] = (static_cast<double>(amp_res) - 1.0 - eps) / extent[i];
+    position_accumulator.fill(Eigen::Vector3d::Zero());
+    vertical_weights.fill(0);
+  }
+
+  /// add @c count end points with mean horizontal position @c pos to the cell containing it
+  inline void addCentroid(const Eigen::Vector2d &pos, double count)
+  {
+    const int i = static_cast<int>((pos[0] - min_bound[0]) * step[0]);
+    const int j = static_cast<int>((pos[1] - min_bound[1]) * step[1]);
+    // the sum of positions relative to the middle, with element [2] counting the end points within the cell
+    position_accumulator(i, j) +=
+      Eigen::Vector3d(count * (pos[0] - mid_bound[0]), count * (pos[1] - mid_bound[1]), count);
+  }
+
+  /// add @c count end points at height @c z , distributing the weighting linearly between the two nearest cells
+  inline void addHeight(double z, double count)
+  {
+    const double index = (z - min_bound[2]) * step[2];
+    const int k = static_cast<int>(index);
+    const double blend = index - static_cast<double>(k);
+    vertical_weights[k] += (1.0 - blend) * count;
+    vertical_weights[k + 1] += blend * count;
+  }
+
+  inline void add(const Eigen::Vector3d &end)
+  {
+    addCentroid(Eigen::Vector2d(end[0], end[1]), 1.0);
+    addHeight(end[2], 1.0);
+  }
+
+  void merge(const GridAccumulator &other)
+  {
+    for (int j = 0; j < amp_res; j++)
+    {
+      for (int i = 0; i < amp_res; i++) position_accumulator(i, j) += other.position_accumulator(i, j);
+    }
+    vertical_weights += other.vertical_weights;
+  }
+
+  Eigen::Vector3d min_bound, mid_bound, step;
+  Eigen::Array<Eigen::Vector3d, Eigen::Dynamic, Eigen::Dynamic> position_accumulator;
+  Eigen::ArrayXd vertical_weights;
+};
+
+/// The bounded end points binned into fine lattices, for when the cloud's bounds are found in the same read
+struct LatticeAccumulator
+{
+  inline void add(const Eigen::Vector3d &end)
+  {
+    horizontal.add(Eigen::Vector2d(end[0], end[1]));
+    vertical.add(Eigen::Matrix<double, 1, 1>(end[2]));
+  }
+
+  void merge(const LatticeAccumulator &other)
+  {
+    horizontal.merge(other.horizontal);
+    vertical.merge(other.vertical);
+  }
+
+  /// add each lattice cell to @c grid , at the mean position of its points
+  void rebin(GridAccumulator &grid) const
+  {
+    horizontal.forEach([&grid](const Eigen::Vector2d &mean, double count) { grid.addCentroid(mean, count); });
+    vertical.forEach(
+      [&grid](const Eigen::Matrix<double, 1, 1> &mean, double count) { grid.addHeight(mean[0], count); });
+  }
+
+  CellSums<2> horizontal = CellSums<2>(kLatticeCells);
+  CellSums<1> vertical = CellSums<1>(kVerticalLatticeCells);
+};
+
+/// Add the bounded ray ends of @c cloud_name to @c accumulator , also expanding @c info by the rays if it is given.
+/// Each chunk is added in parallel into per-thread copies of @c accumulator , which are combined once it is read.
+template <class Accumulator>
+bool accumulateEnds(const std::string &cloud_name, Accumulator &accumulator, Cloud::Info *info)
+{
+#if RAYLIB_WITH_TBB
+  tbb::enumerable_thread_specific<Accumulator> thread_accumulators(accumulator);
+#endif  // RAYLIB_WITH_TBB
+  auto fill = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                  std::vector<double> &times, std::vector<ray::RGBA> &colours) {
+    if (info)
+      info->expand(starts, ends, times, colours);
+#if RAYLIB_WITH_TBB
+    tbb::parallel_for(tbb::blocked_range<size_t>(0, ends.size()), [&](const tbb::blocked_range<size_t> &range) {
+      Accumulator &local = thread_accumulators.local();
+      for (size_t e = range.begin(); e != range.end(); e++)
+      {
+        if (colours[e].alpha > 0)  // bounded
+          local.add(ends[e]);
+      }
+    });
+#else   // RAYLIB_WITH_TBB
+    for (size_t e = 0; e < ends.size(); e++)
+    {
+      if (colours[e].alpha > 0)  // bounded
+        accumulator.add(ends[e]);
+    }
+#endif  // RAYLIB_WITH_TBB
+  };
+  if (!Cloud::read(cloud_name, fill))
+    return false;
+#if RAYLIB_WITH_TBB
+  for (const auto &local : thread_accumulators) accumulator.merge(local);
+#endif  // RAYLIB_WITH_TBB
+  return true;
+}
 }  // namespace
 
 /// the output file @c out_file is the input file @c in_file, transformed by @c pose
@@ -33,14 +306,14 @@ bool transformAndSaveCloud(const std::string &in_file, const std::string &out_fi
 
   auto transform = [&chunk, &writer, &pose](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
                                             std::vector<double> &times, std::vector<RGBA> &colours) {
-    chunk.clear();
     chunk.times = times;
     chunk.colours = colours;
-    for (size_t i = 0; i < ends.size(); i++)
-    {
-      chunk.starts.push_back(pose * starts[i]);
-      chunk.ends.push_back(pose * ends[i]);
-    }
+    chunk.starts.resize(ends.size());
+    chunk.ends.resize(ends.size());
+    parallelFor(size_t(0), ends.size(), [&](size_t i) {
+      chunk.starts[i] = pose * starts[i];
+      chunk.ends[i] = pose * ends[i];
+    });
     writer.writeChunk(chunk);
   };
 
@@ -71,37 +344,47 @@ Pose estimate2DPose(const Eigen::Array<Eigen::Vector3d, Eigen::Dynamic, Eigen::D
   const double radius = 0.5 * std::sqrt(ray::sqr(max_bound[0] - min_bound[0]) + ray::sqr(max_bound[1] - min_bound[1]));
   const double eps = 0.0001;  // avoids the most distant point exceeding the array bounds
 
-  Eigen::ArrayXXd weights(ang_res, amp_res);  // this is the output of the radon transform
-  weights.fill(0);
-  // Radon transform
+  // the sine wave of each occupied array cell
+  struct Wave
+  {
+    double weight;  // the number of end points under this pixel (array cell)
+    double angle;
+    double amplitude;
+  };
+  std::vector<Wave> waves;
   for (int ii = 0; ii < amp_res; ii++)
   {
     for (int jj = 0; jj < amp_res; jj++)
     {
       const Eigen::Vector3d &accumulator = position_accumulator(ii, jj);
-      const double weight =
-        accumulator[2];  // the weight here is the number of end points under this pixel (array cell)
+      const double weight = accumulator[2];
       if (weight == 0.0)
         continue;
       const Eigen::Vector2d centroid(accumulator[0] / weight, accumulator[1] / weight);
       const double angle = atan2(centroid[0], centroid[1]);
       const double amplitude = std::sqrt(centroid[0] * centroid[0] + centroid[1] * centroid[1]) / radius;
+      waves.push_back({ weight, angle, amplitude });
+    }
+  }
 
+  Eigen::ArrayXXd weights(ang_res, amp_res);  // this is the output of the radon transform
+  weights.fill(0);
+  // Radon transform. Each angle is a row of the weights, so the angles are drawn in parallel
+  parallelFor(0, ang_res, [&](int i) {
+    const double ang = kPi * static_cast<double>(i) / static_cast<double>(ang_res);
+    for (const auto &wave : waves)
+    {
       // now draw the sine wave for this point.
-      for (int i = 0; i < ang_res; i++)
-      {
-        const double ang = kPi * static_cast<double>(i) / static_cast<double>(ang_res);
-        const double height = amplitude * std::sin(ang + angle);
-        const double y = (static_cast<double>(amp_res) - 1.0 - eps) * (0.5 + 0.5 * height);  // rescale the sine wave
-
-        // linear blend of the weight onto the two nearest neighbour pixels
-        const int j = static_cast<int>(y);
-        const double blend = y - static_cast<double>(j);
-        weights(i, j) += (1.0 - blend) * weight;
-        weights(i, j + 1) += blend * weight;
-      }
+      const double height = wave.amplitude * std::sin(ang + wave.angle);
+      const double y = (static_cast<double>(amp_res) - 1.0 - eps) * (0.5 + 0.5 * height);  // rescale the sine wave
+
+      // linear blend of the weight onto the two nearest neighbour pixels
+      const int j = static_cast<int>(y);
+      const double blend = y - static_cast<double>(j);
+      weights(i, j) += (1.0 - blend) * wave.weight;
+      weights(i, j + 1) += blend * wave.weight;
     }
-  }
+  });
   // now find greatest weight cell:
   int max_i = 0, max_j = 0;
   weights.maxCoeff(&max_i, &max_j);
@@ -173,59 +456,35 @@ Pose estimate2DPose(const Eigen::Array<Eigen::Vector3d, Eigen::Dynamic, Eigen::D
 // fairly noisy planes (such as a vineyard row), and it should parallelise well.
 bool alignCloudToAxes(const std::string &cloud_name, const std::string &aligned_file)
 {
-  // Calculate extents:
+  // 1. Convert the cloud into a weighted centroid field. This needs the cloud's extents, which are known without
+  // reading the cloud for .rcb files and for .ply files with an up to date info sidecar. Otherwise the end points are
+  // binned into fine lattices in the same read that finds the extents, then re-binned once they are known.
   Cloud::Info info;
-  if (!Cloud::getInfo(cloud_name, info))
-    return false;
+  const bool known_info = isRcbFileName(cloud_name) ? Cloud::getInfo(cloud_name, info) : readPlyInfo(cloud_name, info);
+  std::unique_ptr<GridAccumulator> grid;
+  if (known_info)
+  {
+    grid.reset(new GridAccumulator(info.rays_bound));
+    if (!accumulateEnds(cloud_name, *grid, nullptr))
+      return false;
+  }
+  else
+  {
+    LatticeAccumulator lattice;
+    info.reset();
+    if (!accumulateEnds(cloud_name, lattice, &info))
+      return false;
+    info.finish();
+    writePlyInfo(cloud_name, info);  // so later readers of the cloud also find its info without a read
+    grid.reset(new GridAccumulator(info.rays_bound));
+    lattice.rebin(*grid);
+  }
   const Eigen::Vector3d &min_bound = info.rays_bound.min_bound_;
-  const Eigen::Vector3d &max_bound = info.rays_bound.max_bound_;
-  const Eigen::Vector3d mid_bound = (min_bound + max_bound) / 2.0;
-
-  // fill in the arrays
-  double eps = 0.0001;  // to stop edge cases exceeding the array bounds
-
-  // 1. Convert the cloud into a weighted centroid field. I'm using element [2] for the weight.
-  Eigen::Array<Eigen::Vector3d, Eigen::Dynamic, Eigen::Dynamic> position_accumulator(amp_res, amp_res);
-  position_accumulator.fill(Eigen::Vector3d::Zero());
-  double step_x = (static_cast<double>(amp_res) - 1.0 - eps) / (max_bound[0] - min_bound[0]);
-  double step_y = (static_cast<double>(amp_res) - 1.0 - eps) / (max_bound[1] - min_bound[1]);
-  double step_z = (static_cast<double>(amp_res) - 1.0 - eps) / (max_bound[2] - min_bound[2]);
-  // and set up the vertical arrays too
-  Eigen::ArrayXd vertical_weights(
-    amp_res);  // TODO: height is usually much less than width... more constant voxel size?
-  vertical_weights.fill(0);
-
-  // fill in the accumulator: (sum of positions, #end points) within each cell
-  // also fill in the vertical density (number of end points) array
-  auto fill_arrays = [&min_bound, &mid_bound, &position_accumulator, &step_x, &step_y, &step_z, &vertical_weights](
-                       std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
-                       std::vector<double> &times, std::vector<ray::RGBA> &colours) {
-    RAYLIB_UNUSED(starts);
-    RAYLIB_UNUSED(times);
-    for (size_t e = 0; e < ends.size(); e++)
-    {
-      if (colours[e].alpha == 0)  // unbounded
-        continue;
-      Eigen::Vector3d index = ends[e] - min_bound;  // find the cell index for this ray end-point
-      index[0] *= step_x;
-      index[1] *= step_y;
-      index[2] *= step_z;
-      Eigen::Vector3d pos = ends[e] - mid_bound;
-      pos[2] = 1.0;  // this element counts the number of end points within the cell
-      position_accumulator((int)index[0], (int)index[1]) += pos;
-
-      // Distribute the weighting linearly between two nearest cells in the 1D array
-      const int k = (int)index[2];
-      const double blend = index[2] - static_cast<double>(k);
-      vertical_weights[k] += (1.0 - blend);
-      vertical_weights[k + 1] += blend;
-    }
-  };
-  if (!Cloud::read(cloud_name, fill_arrays))
-    return false;
+  const double step_z = grid->step[2];
+  const Eigen::ArrayXd &vertical_weights = grid->vertical_weights;
 
   // 2,3,4. Apply the radon transform in 2D
-  Pose pose = estimate2DPose(position_accumulator, info);
+  Pose pose = estimate2DPose(grid->position_accumulator, info);
 
   // 5. get the vertical displacement
   int max_k = 0;  // k is the vertical cell index, as in (i,j,k)
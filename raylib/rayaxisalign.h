@@ -19,6 +19,8 @@ namespace ray
 /// if the centroid y component is farther from the origin than its x component, then make centroid y positive
 /// otherwise make centroid x positive.
 /// The purpose of this is to make the chosen alignment as robust as possible to variation, or rescans.
+/// The cloud is read once to find the planes, with its extents from the .rcb index or the .ply info sidecar when
+/// available, otherwise found in the same read, and once more to write @c aligned_file .
 bool RAYLIB_EXPORT alignCloudToAxes(const std::string &cloud_name, const std::string &aligned_file);
 }  // namespace ray
 
@@ -0,0 +1,276 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raychain.h"
+#include "raydenoise.h"
+#include "rayprofile.h"
+#include "raysmooth.h"
+#include "rayvoxelset.h"
+
+namespace ray
+{
+namespace
+{
+/// the rays of a whole-cloud stage's result are passed on in chunks of this many, as a file is read
+const size_t kChainChunkSize = 1000000;
+
+/// append the rays of @c chunk to @c cloud
+void appendRays(const Cloud &chunk, Cloud &cloud)
+{
+  cloud.starts.insert(cloud.starts.end(), chunk.starts.begin(), chunk.starts.end());
+  cloud.ends.insert(cloud.ends.end(), chunk.ends.begin(), chunk.ends.end());
+  cloud.times.insert(cloud.times.end(), chunk.times.begin(), chunk.times.end());
+  cloud.colours.insert(cloud.colours.end(), chunk.colours.begin(), chunk.colours.end());
+}
+
+/// keep only the rays of @c chunk with a true @c keep
+void keepRays(const std::vector<bool> &keep, Cloud &chunk)
+{
+  size_t num_kept = 0;
+  for (size_t i = 0; i < chunk.rayCount(); i++)
+  {
+    if (!keep[i])
+      continue;
+    chunk.starts[num_kept] = chunk.starts[i];
+    chunk.ends[num_kept] = chunk.ends[i];
+    chunk.times[num_kept] = chunk.times[i];
+    chunk.colours[num_kept] = chunk.colours[i];
+    num_kept++;
+  }
+  chunk.resize(num_kept);
+}
+
+class ChunkStage : public ChainStage
+{
+public:
+  explicit ChunkStage(std::function<void(Cloud &chunk)> function)
+    : function_(std::move(function))
+  {}
+  bool streaming() const override { return true; }
+  void processChunk(Cloud &chunk) override { function_(chunk); }
+
+private:
+  std::function<void(Cloud &chunk)> function_;
+};
+
+class CloudStage : public ChainStage
+{
+public:
+  explicit CloudStage(std::function<bool(Cloud &cloud)> function)
+    : function_(std::move(function))
+  {}
+  bool streaming() const override { return false; }
+  bool processCloud(Cloud &cloud) override { return function_(cloud); }
+
+private:
+  std::function<bool(Cloud &cloud)> function_;
+};
+
+class RangeGapStage : public ChainStage
+{
+public:
+  explicit RangeGapStage(double range_distance)
+    : filter_(range_distance)
+  {}
+  bool streaming() const override { return true; }
+  void processChunk(Cloud &chunk) override
+  {
+    kept_.clear();
+    filter_.filter(chunk.starts, chunk.ends, chunk.times, chunk.colours, kept_);
+    chunk.starts.swap(kept_.starts);
+    chunk.ends.swap(kept_.ends);
+    chunk.times.swap(kept_.times);
+    chunk.colours.swap(kept_.colours);
+  }
+  // the filter always removes the two rays that it holds back at the end
+
+private:
+  RangeGapFilter filter_;
+  Cloud kept_;
+};
+
+class SplitStage : public ChainStage
+{
+public:
+  explicit SplitStage(SplitPlan plan)
+    : plan_(std::move(plan))
+  {}
+  bool streaming() const override { return true; }
+  bool begin() override { return plan_.begin(); }
+  void processChunk(Cloud &chunk) override
+  {
+    plan_.splitChunk(chunk);
+    chunk.clear();
+  }
+  bool finish(Cloud &) override
+  {
+    plan_.end();
+    return true;
+  }
+
+private:
+  SplitPlan plan_;
+};
+}  // namespace
+
+void Chain::add(std::unique_ptr<ChainStage> stage)
+{
+  stages_.push_back(std::move(stage));
+}
+
+bool Chain::push(size_t stage, Cloud &chunk)
+{
+  for (size_t s = stage; s < stages_.size(); s++)
+  {
+    if (!stages_[s]->streaming())
+    {
+      appendRays(chunk, gathered_[s]);
+      return true;
+    }
+    stages_[s]->processChunk(chunk);
+  }
+  return !writing_ || writer_.writeChunk(chunk);
+}
+
+bool Chain::run(const std::string &file_name, const std::string &out_name)
+{
+  ProfileScope profile("chain");
+  for (auto &stage : stages_)
+  {
+    if (!stage->begin())
+      return false;
+  }
+  writing_ = !out_name.empty();
+  if (writing_ && !writer_.begin(out_name))
+    return false;
+  gathered_ = std::vector<Cloud>(stages_.size());
+
+  bool success = true;
+  Cloud chunk;
+  auto per_chunk = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                       std::vector<double> &times, std::vector<RGBA> &colours) {
+    // the stages work on a cloud, so the read buffers are moved into one, then moved back for reuse
+    chunk.starts.swap(starts);
+    chunk.ends.swap(ends);
+    chunk.times.swap(times);
+    chunk.colours.swap(colours);
+    profile.count(chunk.rayCount());
+    if (success)
+      success = push(0, chunk);
+    chunk.starts.swap(starts);
+    chunk.ends.swap(ends);
+    chunk.times.swap(times);
+    chunk.colours.swap(colours);
+  };
+  if (!Cloud::read(file_name, per_chunk))
+    return false;
+
+  // once the file is read, each stage in turn has all of its rays, so passes on its result or the rays it held back
+  for (size_t s = 0; s < stages_.size() && success; s++)
+  {
+    if (!stages_[s]->streaming())
+    {
+      Cloud &cloud = gathered_[s];
+      success = stages_[s]->processCloud(cloud);
+      Cloud slice;
+      for (size_t first = 0; first < cloud.rayCount() && success; first += kChainChunkSize)
+      {
+        const size_t last = std::min(cloud.rayCount(), first + kChainChunkSize);
+        slice.clear();
+        slice.reserve(last - first);
+        for (size_t i = first; i < last; i++)
+        {
+          slice.addRay(cloud, i);
+        }
+        success = push(s + 1, slice);
+      }
+      cloud = Cloud();  // release the memory before the later stages run
+    }
+    Cloud held;
+    success = success && stages_[s]->finish(held) && push(s + 1, held);
+  }
+  if (writing_)
+    writer_.end();
+  return success;
+}
+
+std::unique_ptr<ChainStage> chunkStage(std::function<void(Cloud &chunk)> function)
+{
+  return std::unique_ptr<ChainStage>(new ChunkStage(std::move(function)));
+}
+
+std::unique_ptr<ChainStage> cloudStage(std::function<bool(Cloud &cloud)> function)
+{
+  return std::unique_ptr<ChainStage>(new CloudStage(std::move(function)));
+}
+
+std::unique_ptr<ChainStage> decimationStage(double voxel_width)
+{
+  // the voxel set is kept over all chunks, as in raydecimate, and is proportional to the decimated cloud size
+  std::shared_ptr<VoxelSet> voxel_set = std::make_shared<VoxelSet>();
+  std::shared_ptr<std::vector<int64_t>> subsample = std::make_shared<std::vector<int64_t>>();
+  return chunkStage([voxel_width, voxel_set, subsample](Cloud &chunk) {
+    subsample->clear();
+    voxelSubsample(chunk.ends, voxel_width, *subsample, *voxel_set);
+    std::vector<bool> keep(chunk.rayCount(), false);
+    for (const auto &id : *subsample) keep[static_cast<size_t>(id)] = true;
+    keepRays(keep, chunk);
+  });
+}
+
+std::unique_ptr<ChainStage> everyNthRayStage(size_t num_rays)
+{
+  std::shared_ptr<size_t> count = std::make_shared<size_t>(0);
+  return chunkStage([num_rays, count](Cloud &chunk) {
+    std::vector<bool> keep(chunk.rayCount());
+    for (size_t i = 0; i < keep.size(); i++) keep[i] = ((*count)++ % num_rays) == 0;
+    keepRays(keep, chunk);
+  });
+}
+
+std::unique_ptr<ChainStage> denoiseStage(bool use_sigmas, double threshold)
+{
+  return cloudStage([use_sigmas, threshold](Cloud &cloud) {
+    std::vector<bool> keep;
+    DenoiseStats stats;
+    if (use_sigmas)
+      denoiseSigmas(cloud, threshold, keep, stats);
+    else
+      denoiseDistance(cloud, threshold, keep, stats);
+    keepRays(keep, cloud);
+    return true;
+  });
+}
+
+std::unique_ptr<ChainStage> rangeGapStage(double range_distance)
+{
+  return std::unique_ptr<ChainStage>(new RangeGapStage(range_distance));
+}
+
+std::unique_ptr<ChainStage> transientStage(const MergerConfig &config, const std::string &transient_name)
+{
+  return cloudStage([config, transient_name](Cloud &cloud) {
+    Merger merger(config);
+    if (!merger.filter(cloud))
+      return false;
+    merger.differenceCloud().save(transient_name);
+    cloud = merger.fixedCloud();
+    return true;
+  });
+}
+
+std::unique_ptr<ChainStage> smoothStage(int iterations)
+{
+  return cloudStage([iterations](Cloud &cloud) {
+    smoothCloud(cloud, iterations);
+    return true;
+  });
+}
+
+std::unique_ptr<ChainStage> splitStage(SplitPlan plan)
+{
+  return std::unique_ptr<ChainStage>(new SplitStage(std::move(plan)));
+}
+}  // namespace ray
@@ -0,0 +1,91 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYCHAIN_H
+#define RAYLIB_RAYCHAIN_H
+
+#include "raylib/raylibconfig.h"
+
+#include "raycloud.h"
+#include "raycloudwriter.h"
+#include "raymerger.h"
+#include "raysplitter.h"
+#include "rayutils.h"
+
+#include <functional>
+#include <memory>
+
+namespace ray
+{
+/// One operation of a @c Chain , such as a tool's decimation or denoise, applied to rays in memory. A streaming stage
+/// is given the rays a chunk at a time, in file order, and a whole-cloud stage is given them all at once
+class RAYLIB_EXPORT ChainStage
+{
+public:
+  virtual ~ChainStage() = default;
+
+  /// whether the stage is given chunks by @c processChunk() , or the whole cloud by @c processCloud()
+  virtual bool streaming() const = 0;
+  /// called before any rays are given. Returns false if the stage cannot run, such as an output that cannot be opened
+  virtual bool begin() { return true; }
+  /// process a chunk of rays in place, for streaming stages. Rays may be removed, or held back for a later chunk
+  virtual void processChunk(Cloud &) {}
+  /// process the whole cloud in place, for whole-cloud stages. Returns false on failure
+  virtual bool processCloud(Cloud &) { return true; }
+  /// called after the last rays are given, adding to the empty @c chunk any rays held back. Returns false on failure
+  virtual bool finish(Cloud &) { return true; }
+};
+
+/// A sequence of stages run on one read of a ray cloud file, passing the rays between them in memory, so that a
+/// chain of operations costs a single read and write rather than one of each per operation. Consecutive streaming
+/// stages pass each chunk on as it is read, while a whole-cloud stage gathers the rays of the stages before it, then
+/// passes on its result a chunk at a time. Memory is bounded by the chunk size, except at whole-cloud stages.
+class RAYLIB_EXPORT Chain
+{
+public:
+  /// add @c stage after the stages already added
+  void add(std::unique_ptr<ChainStage> stage);
+  /// the number of stages in the chain
+  inline size_t size() const { return stages_.size(); }
+
+  /// run the stages on @c file_name , writing the rays out of the last stage to @c out_name , or nowhere if it is
+  /// empty, such as when the last stage writes files of its own. Returns false if a file could not be read or written
+  bool run(const std::string &file_name, const std::string &out_name);
+
+private:
+  /// give @c chunk to the stages from @c stage onwards, up to the first whole-cloud stage
+  bool push(size_t stage, Cloud &chunk);
+
+  std::vector<std::unique_ptr<ChainStage>> stages_;
+  std::vector<Cloud> gathered_;  // the rays held for each whole-cloud stage
+  CloudWriter writer_;
+  bool writing_ = false;
+};
+
+/// A streaming stage applying @c function to each chunk
+std::unique_ptr<ChainStage> RAYLIB_EXPORT chunkStage(std::function<void(Cloud &chunk)> function);
+/// A whole-cloud stage applying @c function to the cloud, which returns false on failure
+std::unique_ptr<ChainStage> RAYLIB_EXPORT cloudStage(std::function<bool(Cloud &cloud)> function);
+
+/// Spatial decimation, keeping the first ray whose end is in each voxel of width @c voxel_width , as @c raydecimate
+std::unique_ptr<ChainStage> RAYLIB_EXPORT decimationStage(double voxel_width);
+/// Temporal decimation, keeping every @c num_rays th ray. This counts across chunks, so is independent of chunk size
+std::unique_ptr<ChainStage> RAYLIB_EXPORT everyNthRayStage(size_t num_rays);
+/// A whole-cloud denoise, by @c denoiseSigmas if @c use_sigmas is true and otherwise by @c denoiseDistance , with
+/// @c threshold as its sigmas or distance
+std::unique_ptr<ChainStage> RAYLIB_EXPORT denoiseStage(bool use_sigmas, double threshold);
+/// A streaming removal of range gap noise, by a @c RangeGapFilter
+std::unique_ptr<ChainStage> RAYLIB_EXPORT rangeGapStage(double range_distance);
+/// A whole-cloud transient filter by a @c Merger with @c config , passing on the fixed rays, and writing the transient
+/// rays to @c transient_name
+std::unique_ptr<ChainStage> RAYLIB_EXPORT transientStage(const MergerConfig &config,
+                                                          const std::string &transient_name);
+/// A whole-cloud smoothing, by @c smoothCloud
+std::unique_ptr<ChainStage> RAYLIB_EXPORT smoothStage(int iterations);
+/// A streaming stage performing every split of @c plan on each chunk. It writes the split files, and passes no rays on
+std::unique_ptr<ChainStage> RAYLIB_EXPORT splitStage(SplitPlan plan);
+}  // namespace ray
+
+#endif  // RAYLIB_RAYCHAIN_H
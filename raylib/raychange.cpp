@@ -0,0 +1,181 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raychange.h"
+#include "raycloud.h"
+#include "raycloudwriter.h"
+
+#include <cmath>
+#include <iostream>
+
+namespace ray
+{
+namespace
+{
+// grids larger than this are held as sparse bricks, as most voxels of an epoch's bounds are never reached by its rays
+const int64_t kMaxDenseVoxels = 1 << 20;
+}  // namespace
+
+ChangeGrid::ChangeGrid(const Cuboid &bounds, int num_epochs, const ChangeConfig &config)
+  : config_(config)
+{
+  densityGridGeometry(bounds, config_.voxel_width, grid_bounds_, dims_);
+  for (int e = 0; e < num_epochs; e++)
+  {
+    epochs_.emplace_back(new DensityGrid(grid_bounds_, config_.voxel_width, dims_, kMaxDenseVoxels));
+  }
+}
+
+void ChangeGrid::addRays(int epoch, const std::vector<Eigen::Vector3d> &starts,
+                         const std::vector<Eigen::Vector3d> &ends, const std::vector<RGBA> &colours)
+{
+  epochs_[epoch]->addRays(starts, ends, colours);
+}
+
+bool ChangeGrid::addCloud(int epoch, const std::string &file_name)
+{
+  auto add_chunk = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                       std::vector<double> &, std::vector<RGBA> &colours) { addRays(epoch, starts, ends, colours); };
+  return Cloud::read(file_name, add_chunk);
+}
+
+bool ChangeGrid::occupied(int epoch, const Eigen::Vector3i &inds) const
+{
+  return epochs_[epoch]->voxel(inds).numHits() >= config_.min_hits;
+}
+
+bool ChangeGrid::freeSpace(int epoch, const Eigen::Vector3i &inds) const
+{
+  const DensityGrid::Voxel &voxel = epochs_[epoch]->voxel(inds);
+  return voxel.numHits() == 0.0f && voxel.numRays() >= config_.min_misses;
+}
+
+bool ChangeGrid::changed(int epoch, const Eigen::Vector3i &inds) const
+{
+  if (!occupied(epoch, inds))
+  {
+    return false;
+  }
+  for (int e = 0; e < static_cast<int>(epochs_.size()); e++)
+  {
+    if (e != epoch && freeSpace(e, inds))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool ChangeGrid::changedWithin(int epoch, const Eigen::Vector3d &min_bound, const Eigen::Vector3d &max_bound) const
+{
+  const Eigen::Vector3d from = (min_bound - grid_bounds_.min_bound_) / config_.voxel_width;
+  const Eigen::Vector3d to = (max_bound - grid_bounds_.min_bound_) / config_.voxel_width;
+  Eigen::Vector3i bmin, bmax;
+  for (int k = 0; k < 3; k++)
+  {
+    // clamped as doubles, as a box far outside of the grid need not fit in an int
+    bmin[k] = static_cast<int>(std::floor(std::max(from[k], 0.0)));
+    bmax[k] = static_cast<int>(std::floor(std::min(to[k], static_cast<double>(dims_[k] - 1))));
+    if (bmin[k] > bmax[k])
+    {
+      return false;
+    }
+  }
+  Eigen::Vector3i inds;
+  for (inds[0] = bmin[0]; inds[0] <= bmax[0]; inds[0]++)
+  {
+    for (inds[1] = bmin[1]; inds[1] <= bmax[1]; inds[1]++)
+    {
+      for (inds[2] = bmin[2]; inds[2] <= bmax[2]; inds[2]++)
+      {
+        if (changed(epoch, inds))
+        {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+std::vector<VoxelChange> ChangeGrid::changes() const
+{
+  std::vector<VoxelChange> changes;
+  for (int e = 0; e < static_cast<int>(epochs_.size()); e++)
+  {
+    // only the voxels that are stored can be occupied
+    epochs_[e]->forEachVoxel([&](const Eigen::Vector3i &inds, const DensityGrid::Voxel &voxel) {
+      if (voxel.numHits() > 0.0f && changed(e, inds))
+      {
+        changes.push_back(VoxelChange{ inds, e });
+      }
+    });
+  }
+  return changes;
+}
+
+Eigen::Vector3d ChangeGrid::voxelCentre(const Eigen::Vector3i &inds) const
+{
+  return grid_bounds_.min_bound_ + (inds.cast<double>() + Eigen::Vector3d(0.5, 0.5, 0.5)) * config_.voxel_width;
+}
+
+bool detectChanges(const std::string &cloud_file_1, const std::string &cloud_file_2, const ChangeConfig &config,
+                   const std::string &changes_file, size_t *num_gone, size_t *num_appeared)
+{
+  Cloud::Info info_1, info_2;
+  if (!Cloud::getInfo(cloud_file_1, info_1) || !Cloud::getInfo(cloud_file_2, info_2))
+  {
+    return false;
+  }
+  const Cuboid bounds(minVector(info_1.ends_bound.min_bound_, info_2.ends_bound.min_bound_),
+                      maxVector(info_1.ends_bound.max_bound_, info_2.ends_bound.max_bound_));
+  ChangeConfig grid_config = config;
+  if (grid_config.voxel_width <= 0.0)
+  {
+    const double spacing_scale = 2.0;
+    grid_config.voxel_width =
+      spacing_scale * Cloud::estimatePointSpacing(cloud_file_1, info_1.ends_bound, info_1.num_bounded);
+    if (!(grid_config.voxel_width > 0.0))
+    {
+      std::cerr << "Error: cannot estimate a voxel width for " << cloud_file_1 << std::endl;
+      return false;
+    }
+  }
+
+  // one pass over each cloud, walking its rays through the shared voxels
+  ChangeGrid grid(bounds, 2, grid_config);
+  if (!grid.addCloud(0, cloud_file_1) || !grid.addCloud(1, cloud_file_2))
+  {
+    return false;
+  }
+  const std::vector<VoxelChange> changes = grid.changes();
+
+  Cloud changes_cloud;
+  size_t counts[2] = { 0, 0 };
+  for (const auto &change : changes)
+  {
+    const Eigen::Vector3d centre = grid.voxelCentre(change.index);
+    const bool gone = change.occupied_epoch == 0;
+    const RGBA colour = { static_cast<uint8_t>(gone ? 255 : 0), static_cast<uint8_t>(gone ? 0 : 255), 0, 255 };
+    changes_cloud.addRay(centre, centre, static_cast<double>(change.occupied_epoch), colour);
+    counts[change.occupied_epoch]++;
+  }
+  CloudWriter writer;
+  if (!writer.begin(changes_file) || !writer.writeChunk(changes_cloud))
+  {
+    return false;
+  }
+  writer.end();
+  if (num_gone)
+  {
+    *num_gone = counts[0];
+  }
+  if (num_appeared)
+  {
+    *num_appeared = counts[1];
+  }
+  return true;
+}
+}  // namespace ray
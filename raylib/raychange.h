@@ -0,0 +1,85 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYCHANGE_H
+#define RAYLIB_RAYCHANGE_H
+
+#include "raylib/raylibconfig.h"
+
+#include "raycuboid.h"
+#include "rayrenderer.h"
+#include "rayutils.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ray
+{
+/// Parameters of @c ChangeGrid and @c detectChanges
+struct RAYLIB_EXPORT ChangeConfig
+{
+  double voxel_width = 0.0;  ///< Width of the voxels. Zero uses twice the point spacing of the first cloud.
+  double min_hits = 1;       ///< The number of end points in a voxel for it to be observed occupied.
+  double min_misses = 2;     ///< The number of rays through a voxel without ending in it for it to be observed free.
+};
+
+/// A voxel that is observed occupied in one epoch and free in another
+struct RAYLIB_EXPORT VoxelChange
+{
+  Eigen::Vector3i index;
+  int occupied_epoch;  // the epoch in which the voxel is occupied
+};
+
+/// The per voxel ray statistics of several epochs of a site, on one shared voxel grid, for a fast first pass at the
+/// differences between them. Each epoch's rays are walked through the voxels once, as for a @c DensityGrid , counting
+/// the rays that end in each voxel and those that pass through it, and a voxel is changed when it is observed
+/// occupied in one epoch and free in another. There are no ellipsoids, so this is much cheaper than @c Merger , but it
+/// is only as fine as the voxels: it finds where objects have appeared or gone, for @c Merger to resolve.
+/// Large grids are stored as sparse bricks, which are only allocated where rays pass.
+class RAYLIB_EXPORT ChangeGrid
+{
+public:
+  /// A grid over @c bounds for @c num_epochs epochs, with the voxel width and thresholds of @c config
+  ChangeGrid(const Cuboid &bounds, int num_epochs, const ChangeConfig &config);
+
+  /// Add a chunk of the rays of @c epoch
+  void addRays(int epoch, const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+               const std::vector<RGBA> &colours);
+  /// Stream in the ray cloud file @c file_name as @c epoch . Returns false if it cannot be read
+  bool addCloud(int epoch, const std::string &file_name);
+
+  /// Whether the voxel at @c inds was observed occupied, or free, in @c epoch
+  bool occupied(int epoch, const Eigen::Vector3i &inds) const;
+  bool freeSpace(int epoch, const Eigen::Vector3i &inds) const;
+  /// Whether the voxel at @c inds is occupied in @c epoch and free in another epoch
+  bool changed(int epoch, const Eigen::Vector3i &inds) const;
+  /// Whether any voxel that overlaps the box from @c min_bound to @c max_bound is changed for @c epoch
+  bool changedWithin(int epoch, const Eigen::Vector3d &min_bound, const Eigen::Vector3d &max_bound) const;
+  /// The changed voxels of every epoch, in order of epoch then of voxel
+  std::vector<VoxelChange> changes() const;
+
+  /// The centre of the voxel at @c inds
+  Eigen::Vector3d voxelCentre(const Eigen::Vector3i &inds) const;
+  inline double voxelWidth() const { return config_.voxel_width; }
+  inline const Eigen::Vector3i &dims() const { return dims_; }
+
+private:
+  ChangeConfig config_;
+  Cuboid grid_bounds_;
+  Eigen::Vector3i dims_;
+  std::vector<std::unique_ptr<DensityGrid>> epochs_;
+};
+
+/// Find the voxels that are occupied in one of the ray cloud files @c cloud_file_1 and @c cloud_file_2 and free in the
+/// other, in a single streamed pass over each, and write their centres to the ray cloud @c changes_file , red where
+/// the geometry of the first cloud has gone and green where that of the second has appeared. The numbers of each are
+/// returned in @c num_gone and @c num_appeared . Returns false if a cloud cannot be read or the changes written.
+bool RAYLIB_EXPORT detectChanges(const std::string &cloud_file_1, const std::string &cloud_file_2,
+                                 const ChangeConfig &config, const std::string &changes_file,
+                                 size_t *num_gone = nullptr, size_t *num_appeared = nullptr);
+}  // namespace ray
+
+#endif  // RAYLIB_RAYCHANGE_H
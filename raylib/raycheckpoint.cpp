@@ -0,0 +1,256 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raycheckpoint.h"
+
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+
+namespace ray
+{
+namespace
+{
+const char kCheckpointMagic[4] = { 'R', 'C', 'K', 'P' };
+const uint32_t kCheckpointVersion = 1;
+// a record longer than this is taken to be corrupt, rather than allocated
+const uint64_t kMaxRecordSize = uint64_t(1) << 40;
+
+std::atomic<bool> &checkpointsEnabled()
+{
+  static std::atomic<bool> enabled(false);
+  return enabled;
+}
+
+template <class T>
+void writeValue(std::ostream &out, const T &value)
+{
+  out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <class T>
+bool readValue(std::istream &in, T &value)
+{
+  in.read(reinterpret_cast<char *>(&value), sizeof(T));
+  return static_cast<bool>(in);
+}
+
+void writeRecord(std::ostream &out, const std::string &phase, const void *data, size_t size)
+{
+  uint32_t name_length = static_cast<uint32_t>(phase.size());
+  uint64_t data_length = size;
+  uint64_t checksum = Checkpoint::hash(phase.data(), phase.size());
+  checksum = Checkpoint::hash(data, size, checksum);
+  writeValue(out, name_length);
+  out.write(phase.data(), phase.size());
+  writeValue(out, data_length);
+  if (size > 0)
+  {
+    out.write(static_cast<const char *>(data), size);
+  }
+  writeValue(out, checksum);
+}
+
+/// read the next record, returning false at the end of the file or at a record that was cut short or corrupted
+bool readRecord(std::istream &in, std::string &phase, std::vector<char> &data)
+{
+  uint32_t name_length;
+  uint64_t data_length, checksum;
+  if (!readValue(in, name_length) || name_length > 1 << 16)
+  {
+    return false;
+  }
+  phase.resize(name_length);
+  if (name_length > 0 && !in.read(&phase[0], name_length))
+  {
+    return false;
+  }
+  if (!readValue(in, data_length) || data_length > kMaxRecordSize)
+  {
+    return false;
+  }
+  data.resize(static_cast<size_t>(data_length));
+  if (data_length > 0 && !in.read(data.data(), static_cast<std::streamsize>(data_length)))
+  {
+    return false;
+  }
+  if (!readValue(in, checksum))
+  {
+    return false;
+  }
+  return checksum == Checkpoint::hash(data.data(), data.size(), Checkpoint::hash(phase.data(), phase.size()));
+}
+}  // namespace
+
+void Checkpoint::enable(bool enabled)
+{
+  checkpointsEnabled() = enabled;
+}
+
+bool Checkpoint::enabled()
+{
+  return checkpointsEnabled();
+}
+
+void Checkpoint::initFromArguments(int &argc, char *argv[])
+{
+  for (int i = 1; i < argc; i++)
+  {
+    if (std::string(argv[i]) == "--resume")
+    {
+      for (int j = i; j < argc; j++)  // shift the terminating null too
+      {
+        argv[j] = argv[j + 1];
+      }
+      argc--;
+      enable();
+      return;
+    }
+  }
+}
+
+uint64_t Checkpoint::hash(const void *data, size_t size, uint64_t hash)
+{
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  for (size_t i = 0; i < size; i++)
+  {
+    hash = (hash ^ bytes[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+bool Checkpoint::open(const std::string &file_name, const std::string &key)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (out_.is_open())
+  {
+    out_.close();
+  }
+  file_name_ = file_name;
+  key_hash_ = hash(key.data(), key.size());
+  phases_.clear();
+  num_resumed_ = 0;
+
+  std::ifstream in(file_name_, std::ios::binary);
+  if (in)
+  {
+    char magic[4];
+    uint32_t version;
+    uint64_t key_hash;
+    in.read(magic, 4);
+    if (in && std::memcmp(magic, kCheckpointMagic, 4) == 0 && readValue(in, version) &&
+        version == kCheckpointVersion && readValue(in, key_hash) && key_hash == key_hash_)
+    {
+      std::string phase;
+      std::vector<char> data;
+      while (readRecord(in, phase, data))
+      {
+        phases_[phase].swap(data);
+      }
+      num_resumed_ = phases_.size();
+    }
+    else
+    {
+      std::cout << "checkpoint " << file_name_ << " is from a different job, starting afresh" << std::endl;
+    }
+    in.close();
+  }
+  // rewrite the file with only its intact records, so that new records are not appended after a torn one
+  if (!startFile())
+  {
+    phases_.clear();
+    num_resumed_ = 0;
+    return false;
+  }
+  if (num_resumed_ > 0)
+  {
+    std::cout << "resuming from " << num_resumed_ << " completed phases in checkpoint " << file_name_ << std::endl;
+  }
+  return true;
+}
+
+bool Checkpoint::startFile()
+{
+  out_.open(file_name_, std::ios::binary | std::ios::trunc);
+  if (!out_)
+  {
+    std::cerr << "Warning: cannot write checkpoint file " << file_name_ << ", continuing without checkpoints"
+              << std::endl;
+    return false;
+  }
+  out_.write(kCheckpointMagic, 4);
+  writeValue(out_, kCheckpointVersion);
+  writeValue(out_, key_hash_);
+  for (const auto &phase : phases_)
+  {
+    writeRecord(out_, phase.first, phase.second.data(), phase.second.size());
+  }
+  out_.flush();
+  if (!out_)
+  {
+    out_.close();
+    return false;
+  }
+  return true;
+}
+
+bool Checkpoint::completed(const std::string &phase) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return phases_.find(phase) != phases_.end();
+}
+
+std::vector<char> Checkpoint::data(const std::string &phase) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto it = phases_.find(phase);
+  return it == phases_.end() ? std::vector<char>() : it->second;
+}
+
+bool Checkpoint::save(const std::string &phase, const void *data, size_t size)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!out_.is_open())
+  {
+    return false;
+  }
+  writeRecord(out_, phase, data, size);
+  out_.flush();
+  if (!out_)
+  {
+    std::cerr << "Warning: failed to write checkpoint file " << file_name_ << ", continuing without checkpoints"
+              << std::endl;
+    out_.close();
+    return false;
+  }
+  const char *bytes = static_cast<const char *>(data);
+  phases_[phase].assign(bytes, bytes + size);
+  return true;
+}
+
+void Checkpoint::reset()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!out_.is_open())
+  {
+    return;
+  }
+  out_.close();
+  phases_.clear();
+  startFile();
+}
+
+void Checkpoint::finish()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!out_.is_open())
+  {
+    return;
+  }
+  out_.close();
+  phases_.clear();
+  std::remove(file_name_.c_str());
+}
+}  // namespace ray
@@ -0,0 +1,110 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYCHECKPOINT_H
+#define RAYLIB_RAYCHECKPOINT_H
+
+#include "raylib/raylibconfig.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ray
+{
+/// The completed phases of a long running job, such as the tiles of a tiled filter, kept in a binary state file so
+/// that a job that is stopped part way through, for instance by the pre-emption of its machine, can be run again and
+/// skip the phases that it already completed.
+///
+/// Checkpointing is off unless @c enable() is called, which the tools do for a @c --resume option. The same command
+/// is then run again after an interruption. Each phase is saved with its results as soon as it completes, as a
+/// record that is appended to the file and flushed, and a record cut short by the interruption is discarded on
+/// resuming. The file is keyed on the job's inputs and parameters, so a file left by a different job is replaced
+/// rather than resumed from, and it is removed by @c finish() once the job has completed.
+class RAYLIB_EXPORT Checkpoint
+{
+public:
+  /// Turn checkpointing on, for the jobs that support it.
+  static void enable(bool enabled = true);
+  /// Whether checkpointing is on.
+  static bool enabled();
+  /// Remove a @c --resume option from the command line arguments, and @c enable() checkpointing if it is present.
+  static void initFromArguments(int &argc, char *argv[]);
+
+  /// A hash of @c size bytes at @c data , continuing from @c hash , for building the key of a job from its in-memory
+  /// inputs.
+  static uint64_t hash(const void *data, size_t size, uint64_t hash = 14695981039346656037ull);
+  template <class T>
+  static uint64_t hash(const std::vector<T> &values, uint64_t seed = 14695981039346656037ull)
+  {
+    return hash(values.data(), values.size() * sizeof(T), seed);
+  }
+
+  Checkpoint() = default;
+  Checkpoint(const Checkpoint &) = delete;
+  Checkpoint &operator=(const Checkpoint &) = delete;
+
+  /// Open the state file @c file_name of the job identified by @c key . If the file was left by the same job, its
+  /// completed phases are loaded, otherwise it is started afresh. Returns false, leaving the checkpoint closed, if the
+  /// file cannot be written, in which case the job runs without checkpoints.
+  bool open(const std::string &file_name, const std::string &key);
+  /// Whether the state file is open.
+  bool isOpen() const { return out_.is_open(); }
+  /// The number of completed phases that were loaded when the file was opened.
+  size_t numResumed() const { return num_resumed_; }
+
+  /// Whether @c phase was completed, by this run or by the run that is being resumed.
+  bool completed(const std::string &phase) const;
+  /// The data saved with the completed @c phase , or an empty vector if it is not complete.
+  std::vector<char> data(const std::string &phase) const;
+  /// Copy the data of @c phase into @c values , as saved from a vector of trivially copyable values. Returns false if
+  /// the phase is not complete.
+  template <class T>
+  bool load(const std::string &phase, std::vector<T> &values) const
+  {
+    if (!completed(phase))
+    {
+      return false;
+    }
+    const std::vector<char> bytes = data(phase);
+    values.resize(bytes.size() / sizeof(T));
+    if (!values.empty())
+    {
+      std::memcpy(values.data(), bytes.data(), values.size() * sizeof(T));
+    }
+    return true;
+  }
+
+  /// Record that @c phase is complete with @c size bytes of @c data , writing it to the file. This may be called from
+  /// several threads. Returns false if the checkpoint is closed or could not be written.
+  bool save(const std::string &phase, const void *data = nullptr, size_t size = 0);
+  template <class T>
+  bool save(const std::string &phase, const std::vector<T> &values)
+  {
+    return save(phase, values.data(), values.size() * sizeof(T));
+  }
+
+  /// Forget the completed phases, starting the file afresh, for when the files that they left have gone.
+  void reset();
+  /// Close and remove the state file, once the job has completed.
+  void finish();
+
+private:
+  bool startFile();
+
+  std::string file_name_;
+  uint64_t key_hash_ = 0;
+  size_t num_resumed_ = 0;
+  std::ofstream out_;
+  std::map<std::string, std::vector<char>> phases_;
+  mutable std::mutex mutex_;
+};
+}  // namespace ray
+
+#endif  // RAYLIB_RAYCHECKPOINT_H
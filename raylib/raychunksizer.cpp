@@ -0,0 +1,76 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raychunksizer.h"
+#include "rayprofile.h"
+
+#include <algorithm>
+
+namespace ray
+{
+namespace
+{
+/// the consumer is starved once it waits more than this fraction of its time on a chunk
+const double kStarvedFraction = 0.25;
+/// the decoding is well ahead while the consumer waits less than this fraction of its time on a chunk
+const double kAheadFraction = 1.0 / 32.0;
+/// the number of consecutive chunks in the same direction before the size changes
+const int kTrendLength = 2;
+}  // namespace
+
+// out of line definitions of the constants, as std::min and the tests bind them to references
+const size_t ChunkSizer::kAdaptive;
+const size_t ChunkSizer::kMinChunkSize;
+const size_t ChunkSizer::kInitialChunkSize;
+const size_t ChunkSizer::kMaxChunkSize;
+
+ChunkSizer::ChunkSizer(size_t chunk_size, size_t max_size)
+  : adaptive_(chunk_size == kAdaptive)
+  , min_size_(std::min(kMinChunkSize, std::max<size_t>(max_size, 1)))
+  , max_size_(std::max<size_t>(max_size, 1))
+  , trend_(0)
+{
+  size_ = adaptive_ ? std::min(kInitialChunkSize, max_size_) : chunk_size;
+  if (adaptive_)
+  {
+    Profile::set("read chunk size", size_);
+  }
+}
+
+void ChunkSizer::record(double wait_seconds, double consume_seconds)
+{
+  if (!adaptive_)
+  {
+    return;
+  }
+  if (wait_seconds > kStarvedFraction * consume_seconds)
+  {
+    trend_ = std::max(trend_, 0) + 1;
+  }
+  else if (wait_seconds < kAheadFraction * consume_seconds)
+  {
+    trend_ = std::min(trend_, 0) - 1;
+  }
+  else
+  {
+    trend_ = 0;
+  }
+  size_t size = size_;
+  if (trend_ >= kTrendLength)
+  {
+    size = std::min(size_ * 2, max_size_);
+  }
+  else if (trend_ <= -kTrendLength)
+  {
+    size = std::max(size_ / 2, min_size_);
+  }
+  if (size != size_)
+  {
+    size_ = size;
+    trend_ = 0;
+    Profile::set("read chunk size", size_);
+  }
+}
+}  // namespace ray
@@ -0,0 +1,53 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYCHUNKSIZER_H
+#define RAYLIB_RAYCHUNKSIZER_H
+
+#include "raylib/raylibconfig.h"
+
+#include <cstddef>
+
+namespace ray
+{
+/// Chooses the number of rays in each chunk of a streamed read, such as @c Cloud::read , from the measured time that
+/// the consumer of the chunks waits for each one and the time it takes to consume it. Adaptive chunks start at
+/// @c kInitialChunkSize . While the consumer waits on the decoding, so the read is limited by the storage or the
+/// decoders, the chunks double in size up to the maximum, to amortise the fixed cost of each chunk. While the decoding
+/// keeps ahead, they halve down to @c kMinChunkSize , so that the consumer's per-chunk work stays cache-sized. A
+/// consumer with a lot of work and state per chunk, such as splitGrid binning into many cells, gets smaller chunks.
+/// Each size chosen is recorded in the @c Profile as the "read chunk size" counter.
+class RAYLIB_EXPORT ChunkSizer
+{
+public:
+  /// the chunk size argument that asks for adaptive chunks
+  static const size_t kAdaptive = 0;
+  static const size_t kMinChunkSize = 1 << 16;
+  static const size_t kInitialChunkSize = 1 << 18;
+  static const size_t kMaxChunkSize = 1 << 22;
+
+  /// chunks of @c chunk_size rays, or adaptive chunks of at most @c max_size rays if @c chunk_size is @c kAdaptive
+  explicit ChunkSizer(size_t chunk_size = kAdaptive, size_t max_size = kMaxChunkSize);
+
+  /// whether the chunk size adapts
+  bool adaptive() const { return adaptive_; }
+  /// the number of rays in the next chunk
+  size_t size() const { return size_; }
+
+  /// record that the consumer waited @c wait_seconds for a chunk, then spent @c consume_seconds on it, and choose
+  /// the size of later chunks from it
+  void record(double wait_seconds, double consume_seconds);
+
+private:
+  bool adaptive_;
+  size_t size_;
+  size_t min_size_;
+  size_t max_size_;
+  /// consecutive chunks that asked to grow (positive) or shrink (negative), so that one slow chunk changes nothing
+  int trend_;
+};
+}  // namespace ray
+
+#endif  // RAYLIB_RAYCHUNKSIZER_H
@@ -5,48 +5,267 @@
 // Author: Thomas Lowe
 #include "raycloud.h"
 
+#include "raycompactcloud.h"
 #include "raydebugdraw.h"
+#include "raygpu.h"
 #include "raylaz.h"
+#include "raykernels.h"
+#include "raymorton.h"
+#include "raynuma.h"
 #include "rayply.h"
+#include "rayplyindex.h"
 #include "rayprogress.h"
+#include "rayrcb.h"
+#include "rayremotefile.h"
+#include "raysort.h"
+#include "raysurfelcache.h"
+#include "raythreads.h"
 
 #include <nabo/nabo.h>
 
+#if RAYLIB_WITH_TBB
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#endif  // RAYLIB_WITH_TBB
+
 #include <iostream>
 #include <limits>
+#include <map>
+#include <random>
 #include <set>
 // #define OUTPUT_CLOUD_MOMENTS // useful for setting up unit tests comparisons
 
 namespace ray
 {
+namespace
+{
+/// move each of @c values to its place in the given @c order , so that values[i] becomes the previous
+/// values[order[i]], or the reverse if @c inverse . Fields that the cloud does not hold are left empty
+template <class T>
+void permute(std::vector<T> &values, const std::vector<size_t> &order, bool inverse)
+{
+  if (values.size() != order.size())
+    return;
+  std::vector<T> permuted(values.size());
+  auto move_value = [&](size_t i) {
+    if (inverse)
+      permuted[order[i]] = values[i];
+    else
+      permuted[i] = values[order[i]];
+  };
+#if RAYLIB_WITH_TBB
+  tbb::parallel_for(size_t(0), order.size(), move_value);
+#else   // RAYLIB_WITH_TBB
+  for (size_t i = 0; i < order.size(); i++) move_value(i);
+#endif  // RAYLIB_WITH_TBB
+  values.swap(permuted);
+}
+}  // namespace
+
 void Cloud::clear()
 {
   starts.clear();
   ends.clear();
   times.clear();
   colours.clear();
+  neighbour_index_cache_.clear();
+  fields_ = kCFAll;
+  spatially_sorted_ = false;
+}
+
+std::vector<size_t> Cloud::sortSpatially()
+{
+  std::vector<size_t> order = mortonOrder(ends);
+  permute(starts, order, false);
+  permute(ends, order, false);
+  permute(times, order, false);
+  permute(colours, order, false);
+  neighbour_index_cache_.clear();
+  spatially_sorted_ = true;
+  return order;
+}
+
+std::vector<size_t> Cloud::sortByTime()
+{
+  std::vector<size_t> order = radixSortOrder(times);
+  permute(starts, order, false);
+  permute(ends, order, false);
+  permute(times, order, false);
+  permute(colours, order, false);
+  neighbour_index_cache_.clear();
+  spatially_sorted_ = false;
+  return order;
+}
+
+void Cloud::restoreOrder(const std::vector<size_t> &order)
+{
+  permute(starts, order, true);
+  permute(ends, order, true);
+  permute(times, order, true);
+  permute(colours, order, true);
+  neighbour_index_cache_.clear();
+  spatially_sorted_ = false;
 }
 
 void Cloud::save(const std::string &file_name) const
 {
+  if (isRemoteFileName(file_name))
+  {
+    // written to a local spool file, which is uploaded as it is written
+    const std::string spool_file_name = RemoteUpload::spoolFileName(file_name);
+    RemoteUpload upload;
+    if (upload.begin(file_name, spool_file_name))
+    {
+      save(spool_file_name);
+      if (upload.end())
+        std::cout << "uploaded to " << file_name << std::endl;
+    }
+    return;
+  }
+  if (isRcbFileName(file_name))
+  {
+    RcbWriter writer;
+    if (writer.begin(file_name, 0.0, RcbWriter::kDefaultBlockCapacity, spatially_sorted_) &&
+        writer.writeChunk(starts, ends, times, colours))
+    {
+      std::cout << writer.end() << " rays saved to " << file_name << std::endl;
+    }
+    return;
+  }
   std::string name = file_name;
-  writePlyRayCloud(name, starts, ends, times, colours);
+  writePlyRayCloud(name, starts, ends, times, colours, spatially_sorted_);
 }
 
 bool Cloud::load(const std::string &file_name, bool check_extension, int min_num_rays)
 {
+  file_name_ = file_name;
+  fields_ = kCFAll;
+  if (isRcbFileName(file_name))
+    return loadRCB(file_name, min_num_rays);
   // look first for the raycloud PLY
   if (file_name.substr(file_name.size() - 4) == ".ply" || !check_extension)
     return loadPLY(file_name, min_num_rays);
 
-  std::cerr << "Attempting to load ray cloud " << file_name << " which doesn't have expected file extension .ply"
-            << std::endl;
+  std::cerr << "Attempting to load ray cloud " << file_name
+            << " which doesn't have expected file extension .ply or .rcb" << std::endl;
   return false;
 }
 
+bool Cloud::loadFields(const std::string &file_name, unsigned fields, bool check_extension, int min_num_rays)
+{
+  fields |= kCFEnds;
+  if ((fields & kCFAll) == kCFAll)
+    return load(file_name, check_extension, min_num_rays);
+  const bool is_ply = file_name.size() >= 4 && file_name.substr(file_name.size() - 4) == ".ply";
+  if (check_extension && !is_ply && !isRcbFileName(file_name))
+  {
+    std::cerr << "Attempting to load ray cloud " << file_name
+              << " which doesn't have expected file extension .ply or .rcb" << std::endl;
+    return false;
+  }
+  clear();
+  file_name_ = file_name;
+  fields_ = 0;
+  if (!appendFields(fields & kCFAll))
+    return false;
+  if (isRcbFileName(file_name))
+  {
+    RcbIndex index;
+    spatially_sorted_ = readRcbIndex(file_name, index) && index.spatially_sorted;
+  }
+  else
+  {
+    spatially_sorted_ = readPlySpatiallySorted(file_name);
+  }
+  return (int)ends.size() >= min_num_rays;
+}
+
+bool Cloud::materialiseFields(unsigned fields)
+{
+  const unsigned missing = fields & kCFAll & ~fields_;
+  if (missing == 0)
+    return true;
+  if (file_name_.empty())
+    return false;
+  const size_t num_rays = rayCount();
+  if (appendFields(missing) && (!(missing & kCFStarts) || starts.size() == num_rays) &&
+      (!(missing & kCFTimes) || times.size() == num_rays) && (!(missing & kCFColours) || colours.size() == num_rays))
+    return true;
+  // the file no longer matches the cloud, so the fields are not kept
+  if (missing & kCFStarts)
+    std::vector<Eigen::Vector3d>().swap(starts);
+  if (missing & kCFTimes)
+    std::vector<double>().swap(times);
+  if (missing & kCFColours)
+    std::vector<RGBA>().swap(colours);
+  fields_ &= ~missing;
+  std::cerr << "Error: the ray cloud no longer matches " << file_name_ << ", so its fields cannot be loaded" << std::endl;
+  return false;
+}
+
+bool Cloud::appendFields(unsigned fields)
+{
+  // the ray count is only used to reserve the vectors, so that they are not reallocated as they grow
+  uint64_t num_rays = 0;
+  if (isRcbFileName(file_name_))
+  {
+    RcbIndex index;
+    if (readRcbIndex(file_name_, index))
+      num_rays = index.num_rays;
+  }
+  else if (!readPlyRowCount(file_name_, true, num_rays))
+  {
+    num_rays = 0;
+  }
+  if (fields & kCFStarts)
+    placedReserve(starts, num_rays);
+  if (fields & kCFEnds)
+    placedReserve(ends, num_rays);
+  if (fields & kCFTimes)
+    placedReserve(times, num_rays);
+  if (fields & kCFColours)
+    placedReserve(colours, num_rays);
+  auto append = [&](std::vector<Eigen::Vector3d> &chunk_starts, std::vector<Eigen::Vector3d> &chunk_ends,
+                    std::vector<double> &chunk_times, std::vector<RGBA> &chunk_colours) {
+    if (fields & kCFStarts)
+      starts.insert(starts.end(), chunk_starts.begin(), chunk_starts.end());
+    if (fields & kCFEnds)
+      ends.insert(ends.end(), chunk_ends.begin(), chunk_ends.end());
+    if (fields & kCFTimes)
+      times.insert(times.end(), chunk_times.begin(), chunk_times.end());
+    if (fields & kCFColours)
+      colours.insert(colours.end(), chunk_colours.begin(), chunk_colours.end());
+  };
+  if (!read(file_name_, append))
+    return false;
+  fields_ |= fields;
+  return true;
+}
+
+bool Cloud::loadRCB(const std::string &file, int min_num_rays)
+{
+  RcbIndex index;
+  if (!readRcbIndex(file, index))
+    return false;
+  clear();
+  reserve(index.num_rays);
+  auto append = [&](std::vector<Eigen::Vector3d> &chunk_starts, std::vector<Eigen::Vector3d> &chunk_ends,
+                    std::vector<double> &chunk_times, std::vector<RGBA> &chunk_colours) {
+    starts.insert(starts.end(), chunk_starts.begin(), chunk_starts.end());
+    ends.insert(ends.end(), chunk_ends.begin(), chunk_ends.end());
+    times.insert(times.end(), chunk_times.begin(), chunk_times.end());
+    colours.insert(colours.end(), chunk_colours.begin(), chunk_colours.end());
+  };
+  if (!readRcb(file, append))
+    return false;
+  spatially_sorted_ = index.spatially_sorted;
+  return (int)ends.size() >= min_num_rays;
+}
+
 bool Cloud::loadPLY(const std::string &file, int min_num_rays)
 {
   bool res = readPly(file, starts, ends, times, colours, true);
+  spatially_sorted_ = res && readPlySpatiallySorted(file);
   if ((int)ends.size() < min_num_rays)
     return false;
 #if defined OUTPUT_CLOUD_MOMENTS // Only used to supply data to unit tests
@@ -65,11 +284,9 @@ Eigen::Vector3d Cloud::calcMinBound() const
 {
   Eigen::Vector3d min_v(std::numeric_limits<double>::max(), std::numeric_limits<double>::max(),
                         std::numeric_limits<double>::max());
-  for (int i = 0; i < (int)ends.size(); i++)
-  {
-    if (rayBounded(i))
-      min_v = minVector(min_v, minVector(starts[i], ends[i]));
-  }
+  Eigen::Vector3d max_v = -min_v;
+  expandBounds(starts, &colours, min_v, max_v);
+  expandBounds(ends, &colours, min_v, max_v);
   return min_v;
 }
 
@@ -77,11 +294,9 @@ Eigen::Vector3d Cloud::calcMaxBound() const
 {
   Eigen::Vector3d max_v(std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest(),
                         std::numeric_limits<double>::lowest());
-  for (int i = 0; i < (int)ends.size(); i++)
-  {
-    if (rayBounded(i))
-      max_v = maxVector(max_v, maxVector(starts[i], ends[i]));
-  }
+  Eigen::Vector3d min_v = -max_v;
+  expandBounds(starts, &colours, min_v, max_v);
+  expandBounds(ends, &colours, min_v, max_v);
   return max_v;
 }
 
@@ -102,63 +317,41 @@ bool Cloud::calcBounds(Eigen::Vector3d *min_bounds, Eigen::Vector3d *max_bounds,
                                 std::numeric_limits<double>::max());
   *max_bounds = Eigen::Vector3d(std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest(),
                                 std::numeric_limits<double>::lowest());
-  bool invalid_bounds = true;
-  for (size_t i = 0; i < rayCount(); ++i)
+  size_t num_bounded = 0;
+  if (flags & kBFEnd)
   {
-    if (rayBounded(i))
-    {
-      invalid_bounds = false;
-      if (flags & kBFEnd)
-      {
-        *min_bounds = minVector(*min_bounds, ends[i]);
-        *max_bounds = maxVector(*max_bounds, ends[i]);
-      }
-      if (flags & kBFStart)
-      {
-        *min_bounds = minVector(*min_bounds, starts[i]);
-        *max_bounds = maxVector(*max_bounds, starts[i]);
-      }
-    }
+    num_bounded = expandBounds(ends, &colours, *min_bounds, *max_bounds);
+  }
+  if (flags & kBFStart)
+  {
+    num_bounded = expandBounds(starts, &colours, *min_bounds, *max_bounds);
+  }
+  if (!(flags & (kBFEnd | kBFStart)))
+  {
+    for (const auto &colour : colours) num_bounded += colour.alpha > 0 ? 1 : 0;
+  }
 
-    if (progress)
-    {
-      progress->increment();
-    }
+  if (progress)
+  {
+    progress->increment(rayCount());
   }
 
-  return !invalid_bounds;
+  return num_bounded > 0;
 }
 
 void Cloud::transform(const Pose &pose, double time_delta)
 {
-  for (int i = 0; i < (int)starts.size(); i++)
-  {
-    starts[i] = pose * starts[i];
-    ends[i] = pose * ends[i];
-    times[i] += time_delta;
-  }
+  transformPoints(starts, pose);
+  transformPoints(ends, pose);
+  offsetTimes(times, time_delta);
 }
 
 void Cloud::removeUnboundedRays()
 {
-  std::vector<int> valids;
-  for (int i = 0; i < (int)ends.size(); i++)
-    if (rayBounded(i))
-      valids.push_back(i);
-  for (int i = 0; i < (int)valids.size(); i++)
-  {
-    starts[i] = starts[valids[i]];
-    ends[i] = ends[valids[i]];
-    times[i] = times[valids[i]];
-    colours[i] = colours[valids[i]];
-  }
-  starts.resize(valids.size());
-  ends.resize(valids.size());
-  times.resize(valids.size());
-  colours.resize(valids.size());
+  compact([this](size_t i) { return rayBounded(i); });
 }
 
-void Cloud::decimate(double voxel_width, std::set<Eigen::Vector3i, Vector3iLess> &voxel_set)
+void Cloud::decimate(double voxel_width, VoxelSet &voxel_set)
 {
   std::vector<int64_t> subsample;
   voxelSubsample(ends, voxel_width, subsample, voxel_set);
@@ -176,117 +369,203 @@ void Cloud::decimate(double voxel_width, std::set<Eigen::Vector3i, Vector3iLess>
   times.resize(subsample.size());
 }
 
-void Cloud::eigenSolve(const std::vector<int> &ray_ids, const Eigen::MatrixXi &indices, int index, int num_neighbours,
-                       Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> &solver, Eigen::Vector3d &centroid) const
+namespace
+{
+/// points per batch of surfel eigen solves, which bounds the memory of the batch
+const int kSurfelBatchSize = 1 << 16;
+/// batches smaller than this are solved on the CPU, as the GPU transfers would cost more
+const size_t kGpuMinBatchSize = 1 << 14;
+
+// Convert the set of neighbouring indices into the centroid and scatter matrix of an ellipsoid of best fit.
+template <class CloudT>
+void neighbourScatter(const CloudT &cloud, const std::vector<int> &ray_ids, const Eigen::MatrixXi &indices, int index,
+                      int num_neighbours, Eigen::Vector3d &centroid, Eigen::Matrix3d &scatter)
 {
   int ray_id = ray_ids[index];
-  centroid = ends[ray_id];
-  for (int j = 0; j < num_neighbours; j++) centroid += ends[ray_ids[indices(j, index)]];
+  centroid = cloud.rayEnd(ray_id);
+  for (int j = 0; j < num_neighbours; j++) centroid += cloud.rayEnd(ray_ids[indices(j, index)]);
   centroid /= (double)(num_neighbours + 1);
-  Eigen::Matrix3d scatter = (ends[ray_id] - centroid) * (ends[ray_id] - centroid).transpose();
+  scatter = (cloud.rayEnd(ray_id) - centroid) * (cloud.rayEnd(ray_id) - centroid).transpose();
   for (int j = 0; j < num_neighbours; j++)
   {
-    Eigen::Vector3d offset = ends[ray_ids[indices(j, index)]] - centroid;
+    Eigen::Vector3d offset = cloud.rayEnd(ray_ids[indices(j, index)]) - centroid;
     scatter += offset * offset.transpose();
   }
   scatter /= (double)(num_neighbours + 1);
-  solver.compute(scatter.transpose());
-  ASSERT(solver.info() == Eigen::ComputationInfo::Success);
+}
+}  // namespace
+
+void eigenSolveBatch(const std::vector<Eigen::Matrix3d> &matrices, std::vector<Eigen::Vector3d> &values,
+                     std::vector<Eigen::Matrix3d> &vectors)
+{
+  values.resize(matrices.size());
+  vectors.resize(matrices.size());
+  if (matrices.size() >= kGpuMinBatchSize &&
+      Gpu::eigenSolve(matrices.data()->data(), matrices.size(), values.data()->data(), vectors.data()->data()))
+  {
+    return;
+  }
+  // closed-form decomposition, which is much faster than the iterative solver for 3x3 matrices
+  parallelFor(size_t(0), matrices.size(), [&](size_t i) {
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver;
+    solver.computeDirect(matrices[i]);
+    ASSERT(solver.info() == Eigen::ComputationInfo::Success);
+    values[i] = solver.eigenvalues();
+    vectors[i] = solver.eigenvectors();
+  });
 }
 
 void Cloud::getSurfels(int search_size, std::vector<Eigen::Vector3d> *centroids, std::vector<Eigen::Vector3d> *normals,
                        std::vector<Eigen::Vector3d> *dimensions, std::vector<Eigen::Matrix3d> *mats,
                        Eigen::MatrixXi *neighbour_indices, double max_distance, bool reject_back_facing_rays) const
 {
+  const SurfelRequest request = { search_size, max_distance, reject_back_facing_rays, centroids, normals,
+                                  dimensions,  mats,         neighbour_indices };
+  const bool cached = surfelCacheEnabled() && !file_name_.empty() && !isRemoteFileName(file_name_);
+  if (cached && readSurfelCache(*this, file_name_, request))
+    return;
+  calculateSurfels(*this, search_size, centroids, normals, dimensions, mats, neighbour_indices, max_distance,
+                   reject_back_facing_rays);
+  if (cached)
+    writeSurfelCache(*this, file_name_, request);
+}
+
+std::shared_ptr<const NeighbourIndex> Cloud::neighbourIndex(bool bounded_only) const
+{
+  return neighbour_index_cache_.get(*this, bounded_only);
+}
+
+template <class CloudT>
+void calculateSurfels(const CloudT &cloud, int search_size, std::vector<Eigen::Vector3d> *centroids,
+                      std::vector<Eigen::Vector3d> *normals, std::vector<Eigen::Vector3d> *dimensions,
+                      std::vector<Eigen::Matrix3d> *mats, Eigen::MatrixXi *neighbour_indices, double max_distance,
+                      bool reject_back_facing_rays)
+{
+  const size_t ray_count = cloud.rayCount();
   // simplest scheme... find 3 nearest neighbours and do cross product
   if (centroids)
-    centroids->resize(ends.size());
+    centroids->resize(ray_count);
   if (normals)
-    normals->resize(ends.size());
+    normals->resize(ray_count);
   if (dimensions)
-    dimensions->resize(ends.size());
+    dimensions->resize(ray_count);
   if (mats)
-    mats->resize(ends.size());
-  Nabo::NNSearchD *nns;
-  std::vector<int> ray_ids;
-  ray_ids.reserve(ends.size());
-  for (unsigned int i = 0; i < ends.size(); i++)
-    if (rayBounded(i))
-      ray_ids.push_back(i);
-  Eigen::MatrixXd points_p(3, ray_ids.size());
-  for (unsigned int i = 0; i < ray_ids.size(); i++) points_p.col(i) = ends[ray_ids[i]];
-  nns = Nabo::NNSearchD::createKDTreeLinearHeap(points_p, 3);
+    mats->resize(ray_count);
+  // the neighbours of the bounded end points
+  const std::shared_ptr<const NeighbourIndex> index = cloud.neighbourIndex(true);
+  const std::vector<int> &ray_ids = index->ids();
 
   // Run the search
   Eigen::MatrixXi indices;
   Eigen::MatrixXd dists2;
-  indices.resize(search_size, ray_ids.size());
-  dists2.resize(search_size, ray_ids.size());
-  if (max_distance != 0.0)
-    nns->knn(points_p, indices, dists2, search_size, kNearestNeighbourEpsilon, 0, max_distance);
-  else
-    nns->knn(points_p, indices, dists2, search_size, kNearestNeighbourEpsilon, 0);
-  delete nns;
+  index->knn(search_size, indices, dists2, kNearestNeighbourEpsilon, max_distance);
 
   if (neighbour_indices)
-    neighbour_indices->resize(search_size, ends.size());
-  for (int i = 0; i < (int)ray_ids.size(); i++)
+    neighbour_indices->resize(search_size, ray_count);
+  // The points are solved a batch at a time: the scatter of each point's neighbours, then one batched eigen solve.
+  // Each point writes only to its own ray's outputs and its own column of indices, so the points are independent
+  const int num_points = static_cast<int>(ray_ids.size());
+  std::vector<int> neighbour_counts;
+  std::vector<Eigen::Vector3d> batch_centroids, values;
+  std::vector<Eigen::Matrix3d> scatters, vectors;
+  for (int begin = 0; begin < num_points; begin += kSurfelBatchSize)
   {
-    int ray_id = ray_ids[i];
-    Eigen::Vector3d centroid;
-    int num_neighbours;
-    for (num_neighbours = 0; num_neighbours < search_size && indices(num_neighbours, i) != Nabo::NNSearchD::InvalidIndex; num_neighbours++)
-      ;
-    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eigen_solver(3);
-
-    eigenSolve(ray_ids, indices, i, num_neighbours, eigen_solver, centroid);
+    const int batch_size = std::min(kSurfelBatchSize, num_points - begin);
+    neighbour_counts.resize(batch_size);
+    batch_centroids.resize(batch_size);
+    scatters.resize(batch_size);
+    parallelFor(0, batch_size, [&](int b) {
+      const int i = begin + b;
+      int &num_neighbours = neighbour_counts[b];
+      for (num_neighbours = 0; num_neighbours < search_size && indices(num_neighbours, i) != Nabo::NNSearchD::InvalidIndex; num_neighbours++)
+        ;
+      neighbourScatter(cloud, ray_ids, indices, i, num_neighbours, batch_centroids[b], scatters[b]);
+    });
+    eigenSolveBatch(scatters, values, vectors);
 
     if (reject_back_facing_rays)
     {
-      Eigen::Vector3d normal = eigen_solver.eigenvectors().col(0);
-      if ((ends[ray_id] - starts[ray_id]).dot(normal) > 0.0)
-        normal = -normal;
-      bool changed = false;
-      for (int j = num_neighbours - 1; j >= 0; j--)
+      // remove the neighbours that face away from each surfel, and solve again the surfels that lost any
+      std::vector<uint8_t> changed(batch_size, 0);
+      parallelFor(0, batch_size, [&](int b) {
+        const int i = begin + b;
+        const int ray_id = ray_ids[i];
+        int &num_neighbours = neighbour_counts[b];
+        Eigen::Vector3d normal = vectors[b].col(0);
+        if ((cloud.rayEnd(ray_id) - cloud.rayStart(ray_id)).dot(normal) > 0.0)
+          normal = -normal;
+        for (int j = num_neighbours - 1; j >= 0; j--)
+        {
+          int id = ray_ids[indices(j, i)];
+          if ((cloud.rayEnd(id) - cloud.rayStart(id)).dot(normal) > 0.0)
+          {
+            indices(j, i) = indices(--num_neighbours, i);
+            changed[b] = 1;
+          }
+        }
+        if (changed[b])
+        {
+          neighbourScatter(cloud, ray_ids, indices, i, num_neighbours, batch_centroids[b], scatters[b]);
+        }
+      });
+      std::vector<int> resolved;
+      std::vector<Eigen::Matrix3d> resolved_scatters;
+      for (int b = 0; b < batch_size; b++)
       {
-        int id = ray_ids[indices(j, i)];
-        if ((ends[id] - starts[id]).dot(normal) > 0.0)
+        if (changed[b])
         {
-          indices(j, i) = indices(--num_neighbours, i);
-          changed = true;
+          resolved.push_back(b);
+          resolved_scatters.push_back(scatters[b]);
         }
       }
-      if (changed)
+      std::vector<Eigen::Vector3d> resolved_values;
+      std::vector<Eigen::Matrix3d> resolved_vectors;
+      eigenSolveBatch(resolved_scatters, resolved_values, resolved_vectors);
+      for (size_t r = 0; r < resolved.size(); r++)
       {
-        eigenSolve(ray_ids, indices, i, num_neighbours, eigen_solver, centroid);
+        values[resolved[r]] = resolved_values[r];
+        vectors[resolved[r]] = resolved_vectors[r];
       }
     }
 
-    if (neighbour_indices)
-    {
-      int j;
-      for (j = 0; j < num_neighbours; j++) (*neighbour_indices)(j, ray_id) = ray_ids[indices(j, i)];
-    }
-    if (centroids)
-      (*centroids)[ray_id] = centroid;
-    if (normals)
-    {
-      Eigen::Vector3d normal = eigen_solver.eigenvectors().col(0);
-      if ((ends[ray_id] - starts[ray_id]).dot(normal) > 0.0)
-        normal = -normal;
-      (*normals)[ray_id] = normal;
-    }
-    if (dimensions)
-    {
-      Eigen::Vector3d eigenvals = maxVector(Eigen::Vector3d(1e-10, 1e-10, 1e-10), eigen_solver.eigenvalues());
-      (*dimensions)[ray_id] =
-        Eigen::Vector3d(std::sqrt(eigenvals[0]), std::sqrt(eigenvals[1]), std::sqrt(eigenvals[2]));
-    }
-    if (mats)
-      (*mats)[ray_id] = eigen_solver.eigenvectors();
+    parallelFor(0, batch_size, [&](int b) {
+      const int i = begin + b;
+      const int ray_id = ray_ids[i];
+      const int num_neighbours = neighbour_counts[b];
+      if (neighbour_indices)
+      {
+        int j;
+        for (j = 0; j < num_neighbours; j++) (*neighbour_indices)(j, ray_id) = ray_ids[indices(j, i)];
+        for (; j < search_size; j++) (*neighbour_indices)(j, ray_id) = Nabo::NNSearchD::InvalidIndex;
+      }
+      if (centroids)
+        (*centroids)[ray_id] = batch_centroids[b];
+      if (normals)
+      {
+        Eigen::Vector3d normal = vectors[b].col(0);
+        if ((cloud.rayEnd(ray_id) - cloud.rayStart(ray_id)).dot(normal) > 0.0)
+          normal = -normal;
+        (*normals)[ray_id] = normal;
+      }
+      if (dimensions)
+      {
+        Eigen::Vector3d eigenvals = maxVector(Eigen::Vector3d(1e-10, 1e-10, 1e-10), values[b]);
+        (*dimensions)[ray_id] =
+          Eigen::Vector3d(std::sqrt(eigenvals[0]), std::sqrt(eigenvals[1]), std::sqrt(eigenvals[2]));
+      }
+      if (mats)
+        (*mats)[ray_id] = vectors[b];
+    });
   }
 }
 
+template void calculateSurfels<Cloud>(const Cloud &, int, std::vector<Eigen::Vector3d> *,
+                                      std::vector<Eigen::Vector3d> *, std::vector<Eigen::Vector3d> *,
+                                      std::vector<Eigen::Matrix3d> *, Eigen::MatrixXi *, double, bool);
+template void calculateSurfels<CompactCloud>(const CompactCloud &, int, std::vector<Eigen::Vector3d> *,
+                                             std::vector<Eigen::Vector3d> *, std::vector<Eigen::Vector3d> *,
+                                             std::vector<Eigen::Matrix3d> *, Eigen::MatrixXi *, double, bool);
+
 // starts are required to get the normal the right way around
 std::vector<Eigen::Vector3d> Cloud::generateNormals(int search_size)
 {
@@ -295,48 +574,99 @@ std::vector<Eigen::Vector3d> Cloud::generateNormals(int search_size)
   return normals;
 }
 
-bool RAYLIB_EXPORT Cloud::getInfo(const std::string &file_name, Info &info)
+void Cloud::Info::reset()
 {
   double min_s = std::numeric_limits<double>::max();
   double max_s = std::numeric_limits<double>::lowest();
   Eigen::Vector3d min_v(min_s, min_s, min_s);
   Eigen::Vector3d max_v(max_s, max_s, max_s);
   Cuboid unbounded(min_v, max_v);
-  info.ends_bound = info.starts_bound = info.rays_bound = unbounded;
-  info.num_unbounded = info.num_bounded = 0;
-  info.min_time = min_s;
-  info.max_time = max_s;
-  info.centroid.setZero();
-  auto find_bounds = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
-                         std::vector<double> &times, std::vector<ray::RGBA> &colours) {
-    for (size_t i = 0; i < ends.size(); i++)
+  ends_bound = starts_bound = rays_bound = unbounded;
+  num_unbounded = num_bounded = 0;
+  min_time = min_s;
+  max_time = max_s;
+  centroid.setZero();
+}
+
+void Cloud::Info::expand(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+                         const std::vector<double> &times, const std::vector<RGBA> &colours)
+{
+  const int chunk_bounded =
+    static_cast<int>(expandBounds(ends, &colours, ends_bound.min_bound_, ends_bound.max_bound_, &centroid));
+  num_bounded += chunk_bounded;
+  num_unbounded += static_cast<int>(ends.size()) - chunk_bounded;
+  expandBounds(starts, nullptr, starts_bound.min_bound_, starts_bound.max_bound_);
+  expandBounds(ends, nullptr, rays_bound.min_bound_, rays_bound.max_bound_);
+  expandTimeRange(times, min_time, max_time);
+  rays_bound.min_bound_ = minVector(rays_bound.min_bound_, starts_bound.min_bound_);
+  rays_bound.max_bound_ = maxVector(rays_bound.max_bound_, starts_bound.max_bound_);
+}
+
+void Cloud::Info::finish()
+{
+  centroid /= static_cast<double>(num_bounded);
+}
+
+bool RAYLIB_EXPORT Cloud::getInfo(const std::string &file_name, Info &info)
+{
+  info.reset();
+  if (isRcbFileName(file_name))
+  {
+    // the block index already holds the summary, so the rays themselves are not read
+    RcbIndex index;
+    if (!readRcbIndex(file_name, index))
+      return false;
+    for (const auto &block : index.blocks)
     {
-      if (colours[i].alpha > 0)
-      {
-        info.ends_bound.min_bound_ = minVector(info.ends_bound.min_bound_, ends[i]);
-        info.ends_bound.max_bound_ = maxVector(info.ends_bound.max_bound_, ends[i]);
-        info.num_bounded++;
-        info.centroid += ends[i];
-      }
-      info.num_unbounded++;
-      info.starts_bound.min_bound_ = minVector(info.starts_bound.min_bound_, starts[i]);
-      info.starts_bound.max_bound_ = maxVector(info.starts_bound.max_bound_, starts[i]);
-      info.rays_bound.min_bound_ = minVector(info.rays_bound.min_bound_, ends[i]);
-      info.rays_bound.max_bound_ = maxVector(info.rays_bound.max_bound_, ends[i]);
-      info.min_time = std::min(info.min_time, times[i]);
-      info.max_time = std::max(info.max_time, times[i]);
+      info.ends_bound.min_bound_ = minVector(info.ends_bound.min_bound_, block.ends_bound.min_bound_);
+      info.ends_bound.max_bound_ = maxVector(info.ends_bound.max_bound_, block.ends_bound.max_bound_);
+      info.starts_bound.min_bound_ = minVector(info.starts_bound.min_bound_, block.starts_bound.min_bound_);
+      info.starts_bound.max_bound_ = maxVector(info.starts_bound.max_bound_, block.starts_bound.max_bound_);
+      info.rays_bound.min_bound_ = minVector(info.rays_bound.min_bound_, block.rays_bound.min_bound_);
+      info.rays_bound.max_bound_ = maxVector(info.rays_bound.max_bound_, block.rays_bound.max_bound_);
+      info.num_bounded += static_cast<int>(block.num_bounded);
+      info.num_unbounded += static_cast<int>(block.num_rays - block.num_bounded);
+      info.min_time = std::min(info.min_time, block.min_time);
+      info.max_time = std::max(info.max_time, block.max_time);
+      info.centroid += block.ends_sum;
     }
-    info.rays_bound.min_bound_ = minVector(info.rays_bound.min_bound_, info.starts_bound.min_bound_);
-    info.rays_bound.max_bound_ = maxVector(info.rays_bound.max_bound_, info.starts_bound.max_bound_);
+    info.finish();
+    return index.num_rays > 0;
+  }
+  if (readPlyInfo(file_name, info))
+    return true;
+  auto find_bounds = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                         std::vector<double> &times, std::vector<ray::RGBA> &colours) {
+    info.expand(starts, ends, times, colours);
   };
   bool success = readPly(file_name, true, find_bounds, 0);
-  info.centroid /= static_cast<double>(info.num_bounded);
+  info.finish();
+  if (success)
+    writePlyInfo(file_name, info);  // if the sidecar can't be written, later calls just read the file again
   return success;
 }
 
 
-double Cloud::estimatePointSpacing(const std::string &file_name, const Cuboid &bounds, int num_points)
+namespace
+{
+/// files with more points than this are estimated from a sample
+const int kMinSampledPoints = 4000000;
+const size_t kSpacingSampleRuns = 16384;
+const size_t kSpacingSampleRunSize = 16;
+}  // namespace
+
+double Cloud::estimatePointSpacing(const std::string &file_name, const Cuboid &bounds, int num_points,
+                                   double *relative_error)
 {
+  if (num_points > kMinSampledPoints && !isRcbFileName(file_name))
+  {
+    const double width =
+      samplePointSpacing(file_name, bounds, num_points, kSpacingSampleRuns, kSpacingSampleRunSize, relative_error);
+    if (width > 0.0)
+      return width;
+  }
+  if (relative_error)
+    *relative_error = 0.0;
   // two-iteration estimation, modelling the point distribution by the below exponent.
   // larger exponents (towards 2.5) match thick forests, lower exponents (towards 2) match smooth terrain and surfaces
   const double cloud_exponent = 2.0;  // model num_points = (cloud_width/voxel_width)^cloud_exponent
@@ -348,7 +678,7 @@ double Cloud::estimatePointSpacing(const std::string &file_name, const Cuboid &b
     5.0;  // we want to use a larger width because this process only works when the width is an overestimation
   std::cout << "initial voxel width estimate: " << voxel_width << std::endl;
   double num_voxels = 0;
-  std::set<Eigen::Vector3i, Vector3iLess> test_set;
+  VoxelSet test_set;
 
   auto estimate_size = [&](std::vector<Eigen::Vector3d> &, std::vector<Eigen::Vector3d> &ends, std::vector<double> &,
                            std::vector<ray::RGBA> &colours) {
@@ -360,14 +690,13 @@ double Cloud::estimatePointSpacing(const std::string &file_name, const Cuboid &b
       const Eigen::Vector3d &point = ends[i];
       Eigen::Vector3i place(int(std::floor(point[0] / voxel_width)), int(std::floor(point[1] / voxel_width)),
                             int(std::floor(point[2] / voxel_width)));
-      if (test_set.find(place) == test_set.end())
+      if (test_set.insert(place))
       {
-        test_set.insert(place);
         num_voxels++;
       }
     }
   };
-  if (!readPly(file_name, true, estimate_size, 0))
+  if (!read(file_name, estimate_size))
     return 0;
 
   double points_per_voxel = (double)num_points / num_voxels;
@@ -376,36 +705,142 @@ double Cloud::estimatePointSpacing(const std::string &file_name, const Cuboid &b
   return width;
 }
 
+double Cloud::samplePointSpacing(const std::string &file_name, const Cuboid &bounds, int num_points, size_t num_runs,
+                                 size_t run_size, double *relative_error)
+{
+  const double cloud_exponent = 2.0;  // as estimatePointSpacing
+  uint64_t num_rows = 0;
+  if (num_points <= 0 || num_runs == 0 || run_size == 0 || !readPlyRowCount(file_name, true, num_rows))
+    return 0;
+  num_runs = static_cast<size_t>(std::min<uint64_t>(num_runs, num_rows / run_size));
+  if (num_runs < 2)
+    return 0;
+
+  // one run at a random place in each of num_runs equal parts of the file. Every row is then equally likely to be
+  // sampled, whether the file is in scan order or not
+  std::vector<PlyRowRange> runs(num_runs);
+  std::mt19937 generator(static_cast<unsigned>(num_rows));  // repeatable for the same file
+  for (size_t i = 0; i < num_runs; i++)
+  {
+    const uint64_t part_start = num_rows * i / num_runs;
+    const uint64_t part_size = num_rows * (i + 1) / num_runs - part_start;
+    std::uniform_int_distribution<uint64_t> offset(0, part_size - std::min<uint64_t>(part_size, run_size));
+    runs[i].first_row = part_start + offset(generator);
+    runs[i].num_rows = std::min<uint64_t>(run_size, part_size);
+  }
+
+  // the voxels are sized so that each is met by many runs on average, even in scan-ordered files where a run
+  // only covers a small area
+  Eigen::Vector3d extent = bounds.max_bound_ - bounds.min_bound_;
+  double cloud_width = pow(extent[0] * extent[1] * extent[2], 1.0 / 3.0);  // an average
+  double voxel_width = 5.0 * cloud_width / pow((double)num_runs, 1.0 / cloud_exponent);
+  struct VoxelRuns
+  {
+    size_t last_run;
+    size_t num_runs;
+  };
+  std::map<Eigen::Vector3i, VoxelRuns, Vector3iLess> voxels;
+  size_t run = 0;
+  auto count_runs = [&](std::vector<Eigen::Vector3d> &, std::vector<Eigen::Vector3d> &ends, std::vector<double> &,
+                        std::vector<ray::RGBA> &colours) {
+    for (size_t i = 0; i < ends.size(); i++)
+    {
+      if (colours[i].alpha == 0)
+        continue;
+      const Eigen::Vector3d &point = ends[i];
+      Eigen::Vector3i place(int(std::floor(point[0] / voxel_width)), int(std::floor(point[1] / voxel_width)),
+                            int(std::floor(point[2] / voxel_width)));
+      auto found = voxels.insert(std::make_pair(place, VoxelRuns{ run, 1 }));
+      if (!found.second && found.first->second.last_run != run)
+      {
+        found.first->second.last_run = run;
+        found.first->second.num_runs++;
+      }
+    }
+    run++;  // each selected range is passed as one chunk
+  };
+  if (!readPlyRows(file_name, true, count_runs, 0, run_size, &runs, nullptr) || voxels.empty())
+    return 0;
+
+  // Chao2 incidence estimate of the number of occupied voxels, from those met by exactly one and two runs
+  double singles = 0, doubles = 0;
+  for (const auto &voxel : voxels)
+  {
+    if (voxel.second.num_runs == 1)
+      singles++;
+    else if (voxel.second.num_runs == 2)
+      doubles++;
+  }
+  const double scale = (static_cast<double>(num_runs) - 1.0) / static_cast<double>(num_runs);
+  double num_voxels, variance;
+  if (doubles > 0)
+  {
+    const double ratio = singles / doubles;
+    num_voxels = static_cast<double>(voxels.size()) + scale * singles * ratio / 2.0;
+    variance = doubles * (ratio * ratio * ratio * ratio / 4.0 + ratio * ratio * ratio + ratio * ratio / 2.0);
+  }
+  else  // the bias-corrected form
+  {
+    num_voxels = static_cast<double>(voxels.size()) + scale * singles * (singles - 1.0) / 2.0;
+    variance = scale * singles * (singles - 1.0) / 2.0 +
+               scale * scale * singles * (2.0 * singles - 1.0) * (2.0 * singles - 1.0) / 4.0 -
+               scale * scale * singles * singles * singles * singles / (4.0 * num_voxels);
+  }
+
+  double points_per_voxel = (double)num_points / num_voxels;
+  double width = voxel_width / pow(points_per_voxel, 1.0 / cloud_exponent);
+  // the spacing is proportional to num_voxels^(1/cloud_exponent)
+  const double error = std::sqrt(std::max(variance, 0.0)) / (num_voxels * cloud_exponent);
+  if (relative_error)
+    *relative_error = error;
+  std::cout << "sampled point spacing: " << width << " +/- " << 100.0 * error << "%, from " << num_runs * run_size
+            << " of " << num_rows << " rays" << std::endl;
+  return width;
+}
+
 double Cloud::estimatePointSpacing() const
+{
+  return calculatePointSpacing(*this);
+}
+
+template <class CloudT>
+double calculatePointSpacing(const CloudT &cloud)
 {
   // two-iteration estimation, modelling the point distribution by the below exponent.
   // larger exponents (towards 2.5) match thick forests, lower exponents (towards 2) match smooth terrain and surfaces
   const double cloud_exponent = 2.0;  // model num_points = (cloud_width/voxel_width)^cloud_exponent
 
-  Eigen::Vector3d min_bound, max_bound;
-  calcBounds(&min_bound, &max_bound, kBFEnd);
-  Eigen::Vector3d extent = max_bound - min_bound;
+  Eigen::Vector3d min_bound(std::numeric_limits<double>::max(), std::numeric_limits<double>::max(),
+                            std::numeric_limits<double>::max());
+  Eigen::Vector3d max_bound(std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest(),
+                            std::numeric_limits<double>::lowest());
   int num_points = 0;
-  for (unsigned int i = 0; i < ends.size(); i++)
-    if (rayBounded(i))
+  for (size_t i = 0; i < cloud.rayCount(); i++)
+  {
+    if (cloud.rayBounded(i))
+    {
+      min_bound = minVector(min_bound, cloud.rayEnd(i));
+      max_bound = maxVector(max_bound, cloud.rayEnd(i));
       num_points++;
+    }
+  }
+  Eigen::Vector3d extent = max_bound - min_bound;
   double cloud_width = pow(extent[0] * extent[1] * extent[2], 1.0 / 3.0);  // an average
   double voxel_width = cloud_width / pow((double)num_points, 1.0 / cloud_exponent);
   voxel_width *=
     5.0;  // we want to use a larger width because this process only works when the width is an overestimation
   std::cout << "initial voxel width estimate: " << voxel_width << std::endl;
   double num_voxels = 0;
-  std::set<Eigen::Vector3i, Vector3iLess> test_set;
-  for (unsigned int i = 0; i < ends.size(); i++)
+  VoxelSet test_set;
+  for (size_t i = 0; i < cloud.rayCount(); i++)
   {
-    if (rayBounded(i))
+    if (cloud.rayBounded(i))
     {
-      const Eigen::Vector3d &point = ends[i];
+      const Eigen::Vector3d point = cloud.rayEnd(i);
       Eigen::Vector3i place(int(std::floor(point[0] / voxel_width)), int(std::floor(point[1] / voxel_width)),
                             int(std::floor(point[2] / voxel_width)));
-      if (test_set.find(place) == test_set.end())
+      if (test_set.insert(place))
       {
-        test_set.insert(place);
         num_voxels++;
       }
     }
@@ -416,13 +851,116 @@ double Cloud::estimatePointSpacing() const
   return width;
 }
 
+template double calculatePointSpacing<Cloud>(const Cloud &);
+template double calculatePointSpacing<CompactCloud>(const CompactCloud &);
+
 void Cloud::split(Cloud &cloud1, Cloud &cloud2, std::function<bool(int i)> fptr)
 {
-  for (int i = 0; i < (int)ends.size(); i++)
+  partition([&fptr](size_t i) { return fptr(static_cast<int>(i)); }, cloud2, &cloud1);
+}
+
+namespace
+{
+/// the number of rays in each block of @c Cloud::partition , which are tested, counted and copied on one thread
+const size_t kPartitionBlockSize = 1 << 16;
+
+/// move the @c values whose @c mask entry is set to the front, in order, and drop the rest
+template <class T>
+void compactValues(std::vector<T> &values, const std::vector<char> &mask)
+{
+  size_t num_kept = 0;
+  for (size_t i = 0; i < values.size(); i++)
+  {
+    if (mask[i])
+    {
+      values[num_kept++] = values[i];
+    }
+  }
+  values.resize(num_kept);
+}
+}  // namespace
+
+void Cloud::partition(const std::function<bool(size_t i)> &is_selected, Cloud &selected, Cloud *rest) const
+{
+  const size_t count = rayCount();
+  const size_t num_blocks = (count + kPartitionBlockSize - 1) / kPartitionBlockSize;
+  std::vector<char> mask(count);
+  // the number of selected rays in each block, then by prefix sum the number before each block
+  std::vector<size_t> selected_before(num_blocks + 1, 0);
+  parallelFor(size_t(0), num_blocks, [&](size_t b) {
+    const size_t last = std::min(count, (b + 1) * kPartitionBlockSize);
+    size_t num_selected = 0;
+    for (size_t i = b * kPartitionBlockSize; i < last; i++)
+    {
+      mask[i] = is_selected(i) ? 1 : 0;
+      num_selected += mask[i];
+    }
+    selected_before[b + 1] = num_selected;
+  });
+  for (size_t b = 0; b < num_blocks; b++)
+  {
+    selected_before[b + 1] += selected_before[b];
+  }
+  const size_t total_selected = selected_before[num_blocks];
+
+  // only the fields that the cloud holds are copied, for clouds loaded with loadFields
+  const bool has_starts = (fields_ & kCFStarts) != 0;
+  const bool has_times = (fields_ & kCFTimes) != 0;
+  const size_t selected_offset = selected.rayCount();
+  const size_t rest_offset = rest ? rest->rayCount() : 0;
+  auto resize = [&](Cloud &cloud, size_t size) {
+    if (has_starts)
+      cloud.starts.resize(size);
+    cloud.ends.resize(size);
+    if (has_times)
+      cloud.times.resize(size);
+    cloud.colours.resize(size);
+    cloud.neighbour_index_cache_.clear();
+  };
+  resize(selected, selected_offset + total_selected);
+  if (rest)
   {
-    Cloud &cloud = fptr(i) ? cloud2 : cloud1;
-    cloud.addRay(*this, i);
+    resize(*rest, rest_offset + count - total_selected);
   }
+  auto copy_ray = [&](Cloud &cloud, size_t to, size_t from) {
+    if (has_starts)
+      cloud.starts[to] = starts[from];
+    cloud.ends[to] = ends[from];
+    if (has_times)
+      cloud.times[to] = times[from];
+    cloud.colours[to] = colours[from];
+  };
+  parallelFor(size_t(0), num_blocks, [&](size_t b) {
+    const size_t first = b * kPartitionBlockSize;
+    const size_t last = std::min(count, first + kPartitionBlockSize);
+    size_t next_selected = selected_offset + selected_before[b];
+    size_t next_rest = rest_offset + first - selected_before[b];
+    for (size_t i = first; i < last; i++)
+    {
+      if (mask[i])
+        copy_ray(selected, next_selected++, i);
+      else if (rest)
+        copy_ray(*rest, next_rest++, i);
+    }
+  });
+}
+
+void Cloud::compact(const std::function<bool(size_t i)> &is_selected)
+{
+  std::vector<char> mask(rayCount());
+  parallelFor(size_t(0), mask.size(), [&](size_t i) { mask[i] = is_selected(i) ? 1 : 0; });
+  // the moves within a field overlap, so are in order, but the fields are independent. Unheld fields are empty
+  parallelFor(0, 4, [&](int field) {
+    if (field == 0)
+      compactValues(starts, mask);
+    else if (field == 1)
+      compactValues(ends, mask);
+    else if (field == 2)
+      compactValues(times, mask);
+    else
+      compactValues(colours, mask);
+  });
+  neighbour_index_cache_.clear();
 }
 
 void Cloud::addRay(const Eigen::Vector3d &start, const Eigen::Vector3d &end, double time, const RGBA &colour)
@@ -444,18 +982,18 @@ void Cloud::addRay(const Cloud &other_cloud, size_t index)
 
 void Cloud::resize(size_t size)
 {
-  starts.resize(size);
-  ends.resize(size);
-  times.resize(size);
-  colours.resize(size);
+  placedResize(starts, size);
+  placedResize(ends, size);
+  placedResize(times, size);
+  placedResize(colours, size);
 }
 
 void Cloud::reserve(size_t size)
 {
-  starts.reserve(size);
-  ends.reserve(size);
-  times.reserve(size);
-  colours.reserve(size);
+  placedReserve(starts, size);
+  placedReserve(ends, size);
+  placedReserve(times, size);
+  placedReserve(colours, size);
 }
 
 Eigen::Array<double, 22, 1> Cloud::getMoments() const
@@ -468,24 +1006,23 @@ Eigen::Array<double, 22, 1> Cloud::getMoments() const
   double timeSigma = 0.0;
   Eigen::Vector4d colourMean(0, 0, 0, 0);
   Eigen::Array4d colourSigma(0, 0, 0, 0);
+  startMean = sumPoints(starts);
+  endMean = sumPoints(ends);
+  const Eigen::Map<const Eigen::ArrayXd> time_array(times.data(), static_cast<Eigen::Index>(times.size()));
+  timeMean = time_array.sum();
   for (size_t i = 0; i < ends.size(); i++)
   {
-    startMean += starts[i];
-    endMean += ends[i];
-    timeMean += times[i];
     colourMean += Eigen::Vector4d(colours[i].red, colours[i].green, colours[i].blue, colours[i].alpha) / 255.0;
   }
   startMean /= (double)ends.size();
   endMean /= (double)ends.size();
   timeMean /= (double)ends.size();
   colourMean /= (double)ends.size();
+  startSigma = sumSquaredDeviations(starts, startMean).array();
+  endSigma = sumSquaredDeviations(ends, endMean).array();
+  timeSigma = (time_array - timeMean).square().sum();
   for (size_t i = 0; i < ends.size(); i++)
   {
-    Eigen::Array3d start = (starts[i] - startMean).array();
-    startSigma += start * start;
-    Eigen::Array3d end = (ends[i] - endMean).array();
-    endSigma += end * end;
-    timeSigma += ray::sqr(times[i] - timeMean);
     Eigen::Vector4d colour(colours[i].red, colours[i].green, colours[i].blue, colours[i].alpha);
     Eigen::Array4d col = (colour / 255.0 - colourMean).array();
     colourSigma += col * col;
@@ -506,9 +1043,48 @@ Eigen::Array<double, 22, 1> Cloud::getMoments() const
 bool Cloud::read(const std::string &file_name,
                  std::function<void(std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
                                     std::vector<double> &times, std::vector<RGBA> &colours)>
-                   apply)
+                   apply,
+                 size_t chunk_size)
 {
-  return readPly(file_name, true, apply, 0);
+  if (isRcbFileName(file_name))
+    return readRcb(file_name, apply);
+  return readPly(file_name, true, apply, 0, chunk_size);
+}
+
+bool Cloud::read(const std::string &file_name,
+                 std::function<void(std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                                    std::vector<double> &times, std::vector<RGBA> &colours)>
+                   apply,
+                 const Cuboid &bounds, double min_time, double max_time)
+{
+  auto overlaps = [&](const Cuboid &rays_bound, double range_min_time, double range_max_time) {
+    return bounds.overlaps(rays_bound) && range_min_time <= max_time && range_max_time >= min_time;
+  };
+  if (isRcbFileName(file_name))
+  {
+    return readRcb(file_name, apply, [&](const RcbBlockInfo &block) {
+      return overlaps(block.rays_bound, block.min_time, block.max_time);
+    });
+  }
+
+  std::vector<PlyRowRange> ranges;
+  if (!readPlyIndex(file_name, ranges))
+  {
+    // no usable index, so this read passes the whole cloud to apply, and builds the index for later reads
+    if (!readPlyRows(file_name, true, apply, 0, kPlyIndexRangeSize, nullptr, &ranges))
+      return false;
+    writePlyIndex(file_name, ranges);  // if the index can't be written, later reads are just not accelerated
+    return true;
+  }
+  std::vector<PlyRowRange> selection;
+  for (const auto &range : ranges)
+  {
+    if (overlaps(range.rays_bound, range.min_time, range.max_time))
+      selection.push_back(range);
+  }
+  if (selection.empty())
+    return true;
+  return readPlyRows(file_name, true, apply, 0, kPlyIndexRangeSize, &selection, nullptr);
 }
 
 }  // namespace ray
@@ -11,8 +11,10 @@
 
 #include <set>
 #include "raygrid.h"
+#include "rayneighbours.h"
 #include "raypose.h"
 #include "rayutils.h"
+#include "rayvoxelset.h"
 
 namespace ray
 {
@@ -27,6 +29,16 @@ enum BoundsFlag
   kBFStart = (1 << 1)
 };
 
+/// Flags for the per-ray fields loaded by @c Cloud::loadFields()
+enum CloudField
+{
+  kCFStarts = (1 << 0),
+  kCFEnds = (1 << 1),
+  kCFTimes = (1 << 2),
+  kCFColours = (1 << 3),
+  kCFAll = kCFStarts | kCFEnds | kCFTimes | kCFColours
+};
+
 /// This is the principle structure for representing a ray cloud.
 /// Rays are stored as line segments ( @c starts[i] to @c ends[i] ) together with a @c time and @c colour
 /// The colour's alpha channel is used to store intensity, and so alpha=0 represents an unbounded ray
@@ -40,11 +52,16 @@ public:
   std::vector<RGBA> colours;
 
   void clear();
-  /// reserve the cloud's vectors
+  /// reserve the cloud's vectors. Large new storage is placed across the memory nodes, see @c Numa
   void reserve(size_t size);
-  /// resize the cloud's vectors
+  /// resize the cloud's vectors, placing large new storage as @c reserve does
   void resize(size_t size);
 
+  /// per-ray accessors. These are shared with @c CompactCloud, for algorithms that are templated on the cloud type
+  inline const Eigen::Vector3d &rayStart(size_t i) const { return starts[i]; }
+  inline const Eigen::Vector3d &rayEnd(size_t i) const { return ends[i]; }
+  inline double rayTime(size_t i) const { return times[i]; }
+  inline const RGBA &rayColour(size_t i) const { return colours[i]; }
   /// is the ray at index @c i bounded. Unbounded rays are non-returns, typically due to exceeding lidar range.
   inline bool rayBounded(size_t i) const { return colours[i].alpha > 0; }
   /// this reflects the intensity of return recorded by the lidar. It is optional and does not affect the raycloudtools
@@ -54,9 +71,34 @@ public:
   /// the number of rays
   inline size_t rayCount() const { return ends.size(); }
 
+  /// save the ray cloud, in the ray cloud binary format if @c file_name ends in .rcb, otherwise as a .ply
   void save(const std::string &file_name) const;
   /// load a ray cloud file. @c check_extension checks the file extension before proceeding
   bool load(const std::string &file_name, bool check_extension = true, int min_num_rays = 4);
+  /// load only the @c fields (see @c CloudField ) of a ray cloud file, leaving the other vectors empty. This saves
+  /// their memory for algorithms that use only some fields, e.g. only the ends and colours of the bounded points. The
+  /// file is read a chunk at a time, so the unloaded fields are only held a chunk at a time. The ends are always
+  /// loaded, as they give the ray count.
+  bool loadFields(const std::string &file_name, unsigned fields, bool check_extension = true, int min_num_rays = 4);
+  /// load those of @c fields that the cloud does not hold, from the file it was loaded from. This is only valid while
+  /// the cloud's rays are as loaded, and returns false if they are not, or if the cloud was not loaded from a file.
+  bool materialiseFields(unsigned fields);
+  /// the fields that the cloud holds. This is all of them, unless it was loaded with @c loadFields
+  inline unsigned fields() const { return fields_; }
+
+  /// reorder the rays into Morton order of their end points, so that rays that are close in space are close in
+  /// memory, for algorithms that visit neighbouring rays together. Returns the order, where ray i of the sorted cloud
+  /// was ray order[i] of the cloud before, for use with @c restoreOrder . Sorted in parallel when built with TBB.
+  std::vector<size_t> sortSpatially();
+  /// reorder the rays by increasing time, keeping the order of rays with equal times. Returns the order, as with
+  /// @c sortSpatially . Sorted with @c radixSortOrder , and each field permuted in parallel in turn.
+  std::vector<size_t> sortByTime();
+  /// undo @c sortSpatially or @c sortByTime , given the @c order that it returned
+  void restoreOrder(const std::vector<size_t> &order);
+  /// whether the rays are in the order given by @c sortSpatially . This is kept in saved files and read on loading. It
+  /// is not tracked through later edits of the ray vectors, only reset by @c clear , @c sortByTime and
+  /// @c restoreOrder
+  inline bool spatiallySorted() const { return spatially_sorted_; }
 
   /// minimum bounds of all bounded rays
   Eigen::Vector3d calcMinBound() const;
@@ -66,7 +108,7 @@ public:
   /// apply a Euclidean transform and time shift to the ray cloud
   void transform(const Pose &pose, double time_delta);
   /// spatial decimation of the ray cloud, into one end point per voxel of width @c voxel_width
-  void decimate(double voxel_width, std::set<Eigen::Vector3i, Vector3iLess> &voxel_set);
+  void decimate(double voxel_width, VoxelSet &voxel_set);
   /// add a new ray to the ray cloud
   void addRay(const Eigen::Vector3d &start, const Eigen::Vector3d &end, double time, const RGBA &colour);
   /// add a new ray to the ray cloud, from another cloud
@@ -79,6 +121,8 @@ public:
   /// SURFace ELement (surfel) with a centroid, normal, matrix and dimensions (of the ellipsoid that it represents)
   /// The list of neighbours can also be returned, to allow further analysis.
   /// The last argument excludes back-facing rays from the surfel, this produces flatter surfels on thin double walls
+  /// When surfel caching is enabled (see raysurfelcache.h), the results for a cloud loaded from a local file are read
+  /// from, or written to, the cloud file's surfel cache sidecar.
   void getSurfels(int search_size, std::vector<Eigen::Vector3d> *centroids, std::vector<Eigen::Vector3d> *normals,
                   std::vector<Eigen::Vector3d> *dimensions, std::vector<Eigen::Matrix3d> *mats,
                   Eigen::MatrixXi *neighbour_indices, double max_distance = 0.0,
@@ -89,11 +133,24 @@ public:
   /// colour sigma. Times are doubles and colours vector4s, the others are vector3s, to give a total of 22 real values.
   Eigen::Array<double, 22, 1> getMoments() const;
 
+  /// the nearest neighbour index of the ray end points, or of only those of the bounded rays if @c bounded_only . The index
+  /// is built on first use and shared by later calls while the end points are unchanged. Its ids are the ray indices.
+  std::shared_ptr<const NeighbourIndex> neighbourIndex(bool bounded_only = true) const;
+
   /// generates just the normal vectors of the ray end points based on each point's nearest neighbours.
   std::vector<Eigen::Vector3d> generateNormals(int search_size = 16);
 
-  /// split a cloud based on the passed in function
+  /// split a cloud based on the passed in function, adding the rays where @c fptr is true to @c cloud2 , and the others
+  /// to @c cloud1 . This uses @c partition , so @c fptr is called in parallel
   void split(Cloud &cloud1, Cloud &cloud2, std::function<bool(int i)> fptr);
+  /// append the rays for which @c is_selected is true to @c selected , and the others to @c rest if it is not null,
+  /// keeping their order. The rays are tested and counted in parallel blocks, then each block's rays are copied
+  /// in parallel to its place in the pre-sized outputs, rather than added one at a time. So @c is_selected must be safe
+  /// to call from several threads. The outputs must not be this cloud, see @c compact for that
+  void partition(const std::function<bool(size_t i)> &is_selected, Cloud &selected, Cloud *rest = nullptr) const;
+  /// keep only the rays for which @c is_selected is true, in order, without copying the cloud. The rays are tested in
+  /// parallel, and each of the ray fields is then compacted on its own thread
+  void compact(const std::function<bool(size_t i)> &is_selected);
 
   /// estimate the average spacing between end points of the ray cloud. This should be similar to the voxel
   /// width used on any spatially decimated ray clouds
@@ -113,14 +170,33 @@ public:
 
   /// Static functions. These operate on the cloud file, and so do not require the full file to fit in memory
 
-  /// Version for estimating the spacing between points for raycloud files.
-  static double estimatePointSpacing(const std::string &file_name, const Cuboid &bounds, int num_points);
+  /// Version for estimating the spacing between points for raycloud files. Large .ply files are estimated from a
+  /// sample of the file (see @c samplePointSpacing ), smaller ones from every point.
+  /// @c relative_error if given is set to the approximate standard error of the estimate, relative to its value
+  static double estimatePointSpacing(const std::string &file_name, const Cuboid &bounds, int num_points,
+                                     double *relative_error = nullptr);
+
+  /// Estimate the spacing between points of the .ply file @c file_name from @c num_runs short runs of @c run_size rows,
+  /// one at a random place in each equal part of the file, so only a small part of the file is read. The voxels
+  /// occupied by the runs are counted at a width that each voxel is met by many runs, with the Chao2 estimate of the
+  /// voxels that no run met. @c relative_error if given is set to the standard error of that estimate, as a fraction
+  /// of the spacing. Returns 0 if the file cannot be sampled.
+  static double samplePointSpacing(const std::string &file_name, const Cuboid &bounds, int num_points, size_t num_runs,
+                                   size_t run_size, double *relative_error = nullptr);
 
   /// Calculate the key information of a ray cloud, such as its bounds
   /// @c ends are only the bounded ones. @c starts are for all rays
   /// @c rays is all rays, so using the minimum known length for unbounded rays
-  struct Info
+  struct RAYLIB_EXPORT Info
   {
+    /// empty the bounds and counts, ready for @c expand
+    void reset();
+    /// include a chunk of rays. Until @c finish is called, @c centroid is the sum of the bounded ray ends
+    void expand(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+                const std::vector<double> &times, const std::vector<RGBA> &colours);
+    /// convert the sum of the ray ends into their centroid
+    void finish();
+
     // Axis-aligned bounding boxes
     Cuboid ends_bound;    // just the end points (not including for unbounded rays)
     Cuboid starts_bound;  // all start points
@@ -132,22 +208,62 @@ public:
     double max_time;
     Eigen::Vector3d centroid;
   };
+  /// For .rcb files the info is summed from the block index. For .ply files it is read from the info sidecar when
+  /// that is up to date (see rayplyindex.h), otherwise the whole file is read, and the sidecar written for next time.
   static bool RAYLIB_EXPORT getInfo(const std::string &file_name, Info &info);
 
   /// Reads a ray cloud from file, and calls the function for each ray
-  /// This forwards the call to a function appropriate to the ray cloud file format
+  /// This forwards the call to a function appropriate to the ray cloud file format. The .ply chunks are
+  /// @c chunk_size rays, or adaptive (see @c ChunkSizer ) by default. The .rcb chunks are the file's blocks.
   static bool read(const std::string &file_name,
                    std::function<void(std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
                                       std::vector<double> &times, std::vector<RGBA> &colours)>
-                     apply);
+                     apply,
+                   size_t chunk_size = 0);
+
+  /// As read, but skips the parts of the file that cannot hold rays overlapping @c bounds in the time window
+  /// @c min_time to @c max_time. This is a coarse selection, so @c apply may still receive some rays outside these
+  /// bounds, and should test each ray as before. Ply files use an index sidecar, which is built on the first such read.
+  static bool read(const std::string &file_name,
+                   std::function<void(std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                                      std::vector<double> &times, std::vector<RGBA> &colours)>
+                     apply,
+                   const Cuboid &bounds, double min_time = std::numeric_limits<double>::lowest(),
+                   double max_time = std::numeric_limits<double>::max());
 
 private:
   bool loadPLY(const std::string &file, int min_num_rays);
-  // Convert the set of neighbouring indices into a eigen solution, which is an ellipsoid of best fit.
-  inline void eigenSolve(const std::vector<int> &ray_ids, const Eigen::MatrixXi &indices, int index, int num_neighbours,
-                         Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> &solver, Eigen::Vector3d &centroid) const;
+  bool loadRCB(const std::string &file, int min_num_rays);
+  /// read the @c fields of @c file_name_ a chunk at a time, appending them to the cloud's vectors
+  bool appendFields(unsigned fields);
+
+  mutable NeighbourIndexCache neighbour_index_cache_;
+  /// the file that the cloud was loaded from, and the fields it holds, for @c materialiseFields
+  std::string file_name_;
+  unsigned fields_ = kCFAll;
+  bool spatially_sorted_ = false;
 };
 
+/// Implementation of @c Cloud::getSurfels for any cloud type with the per-ray accessors of @c Cloud.
+/// Instantiated for @c Cloud and @c CompactCloud
+template <class CloudT>
+void RAYLIB_EXPORT calculateSurfels(const CloudT &cloud, int search_size, std::vector<Eigen::Vector3d> *centroids,
+                                    std::vector<Eigen::Vector3d> *normals, std::vector<Eigen::Vector3d> *dimensions,
+                                    std::vector<Eigen::Matrix3d> *mats, Eigen::MatrixXi *neighbour_indices,
+                                    double max_distance, bool reject_back_facing_rays);
+
+/// Implementation of @c Cloud::estimatePointSpacing for any cloud type with the per-ray accessors of @c Cloud.
+/// Instantiated for @c Cloud and @c CompactCloud
+template <class CloudT>
+double RAYLIB_EXPORT calculatePointSpacing(const CloudT &cloud);
+
+/// The eigen decomposition of each of the symmetric @c matrices , in closed form as
+/// @c Eigen::SelfAdjointEigenSolver::computeDirect , with the eigenvalues in increasing order in @c values and the
+/// eigenvectors as the columns of @c vectors . This is the batched solve of surfel and ellipsoid generation, which runs
+/// on the GPU for large batches when built WITH_CUDA, and otherwise in parallel on the CPU.
+void RAYLIB_EXPORT eigenSolveBatch(const std::vector<Eigen::Matrix3d> &matrices, std::vector<Eigen::Vector3d> &values,
+                                   std::vector<Eigen::Matrix3d> &vectors);
+
 }  // namespace ray
 
 #endif  // RAYLIB_RAYCLOUD_H
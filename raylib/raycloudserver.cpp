@@ -0,0 +1,225 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raycloudserver.h"
+#include "raycloudwriter.h"
+#include "rayparse.h"
+#include "rayprofile.h"
+#include "rayrenderer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+
+namespace ray
+{
+namespace
+{
+/// the column index aims for this many rays per column
+const double kRaysPerColumn = 256.0;
+/// and has at most this many columns along each axis, which bounds its size for long thin clouds
+const double kMaxColumnsPerAxis = 4096.0;
+
+/// the rays of @c cloud at @c indices , in order
+Cloud selectRays(const Cloud &cloud, const std::vector<size_t> &indices)
+{
+  Cloud selected;
+  selected.reserve(indices.size());
+  for (const auto &i : indices) selected.addRay(cloud, i);
+  return selected;
+}
+
+/// write @c cloud to @c file_name , returning false if it could not be written
+bool writeCloud(Cloud &cloud, const std::string &file_name)
+{
+  CloudWriter writer;
+  if (!writer.begin(file_name) || !writer.writeChunk(cloud))
+    return false;
+  writer.end();
+  return true;
+}
+
+std::string vectorText(const Eigen::Vector3d &vec)
+{
+  std::ostringstream text;
+  text.precision(10);
+  text << vec[0] << "," << vec[1] << "," << vec[2];
+  return text.str();
+}
+}  // namespace
+
+bool CloudServer::load(const std::string &file_name)
+{
+  ProfileScope profile("CloudServer::load");
+  if (!cloud_.load(file_name))
+    return false;
+  info_.reset();
+  info_.expand(cloud_.starts, cloud_.ends, cloud_.times, cloud_.colours);
+  info_.finish();
+
+  // the columns cover every ray end, bounded or not, so that each ray is in exactly one column
+  Eigen::Vector2d index_max(std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest());
+  index_min_ = Eigen::Vector2d(std::numeric_limits<double>::max(), std::numeric_limits<double>::max());
+  for (const auto &end : cloud_.ends)
+  {
+    index_min_ = index_min_.cwiseMin(end.head<2>());
+    index_max = index_max.cwiseMax(end.head<2>());
+  }
+  const size_t num_rays = cloud_.rayCount();
+  const Eigen::Vector2d extent = num_rays > 0 ? Eigen::Vector2d(index_max - index_min_) : Eigen::Vector2d(1.0, 1.0);
+  const double num_target = std::max(1.0, static_cast<double>(num_rays) / kRaysPerColumn);
+  column_width_ = std::sqrt(std::max(extent[0] * extent[1], 1e-12) / num_target);
+  column_width_ = std::max(column_width_, std::max(extent[0], extent[1]) / kMaxColumnsPerAxis);
+  column_width_ = std::max(column_width_, 1e-6);
+  num_columns_ = (extent / column_width_).cast<int>() + Eigen::Vector2i(1, 1);
+
+  // a counting sort of the rays by column, which keeps them in cloud order within each column
+  std::vector<size_t> columns(num_rays);
+  column_starts_.assign(static_cast<size_t>(num_columns_[0]) * static_cast<size_t>(num_columns_[1]) + 1, 0);
+  for (size_t i = 0; i < num_rays; i++)
+  {
+    const Eigen::Vector2i cell = ((cloud_.ends[i].head<2>() - index_min_) / column_width_).cast<int>();
+    columns[i] = static_cast<size_t>(std::min(cell[0], num_columns_[0] - 1)) +
+                 static_cast<size_t>(num_columns_[0]) * static_cast<size_t>(std::min(cell[1], num_columns_[1] - 1));
+    column_starts_[columns[i] + 1]++;
+  }
+  for (size_t c = 1; c < column_starts_.size(); c++) column_starts_[c] += column_starts_[c - 1];
+  column_rays_.resize(num_rays);
+  std::vector<size_t> fill(column_starts_.begin(), column_starts_.end() - 1);
+  for (size_t i = 0; i < num_rays; i++) column_rays_[fill[columns[i]]++] = i;
+  return true;
+}
+
+void CloudServer::query(const Cuboid &box, std::vector<size_t> &indices) const
+{
+  if (cloud_.rayCount() == 0)
+    return;
+  const Eigen::Vector2d min_cell = (box.min_bound_.head<2>() - index_min_) / column_width_;
+  const Eigen::Vector2d max_cell = (box.max_bound_.head<2>() - index_min_) / column_width_;
+  const int min_x = std::max(0, static_cast<int>(std::floor(min_cell[0])));
+  const int min_y = std::max(0, static_cast<int>(std::floor(min_cell[1])));
+  const int max_x = std::min(num_columns_[0] - 1, static_cast<int>(std::floor(max_cell[0])));
+  const int max_y = std::min(num_columns_[1] - 1, static_cast<int>(std::floor(max_cell[1])));
+  const size_t first = indices.size();
+  for (int y = min_y; y <= max_y; y++)
+  {
+    for (int x = min_x; x <= max_x; x++)
+    {
+      const size_t column = static_cast<size_t>(x) + static_cast<size_t>(num_columns_[0]) * static_cast<size_t>(y);
+      for (size_t j = column_starts_[column]; j < column_starts_[column + 1]; j++)
+      {
+        const Eigen::Vector3d &end = cloud_.ends[column_rays_[j]];
+        if ((end.array() >= box.min_bound_.array()).all() && (end.array() <= box.max_bound_.array()).all())
+          indices.push_back(column_rays_[j]);
+      }
+    }
+  }
+  std::sort(indices.begin() + static_cast<std::ptrdiff_t>(first), indices.end());
+}
+
+std::string CloudServer::respond(const std::string &request) const
+{
+  // the request is parsed as the command line of a tool, after a placeholder program name
+  std::istringstream stream(request);
+  std::vector<std::string> words(1, "server");
+  std::string word;
+  while (stream >> word) words.push_back(word);
+  std::vector<char *> argv;
+  for (auto &text : words) argv.push_back(&text[0]);
+  const int argc = static_cast<int>(argv.size());
+
+  TextArgument info_text("info"), count_text("count"), crop_text("crop"), tube_text("tube"),
+    render_text("render");
+  Vector3dArgument box_min, box_max, tube_start, tube_end;
+  DoubleArgument tube_radius(0.001, 1000.0), pixel_width(0.0001, 1000.0);
+  FileArgument out_file;
+  KeyChoice viewpoint({ "top", "left", "right", "front", "back" });
+  KeyChoice style({ "ends", "mean", "sum", "starts", "rays", "height", "density", "density_rgb" });
+
+  std::ostringstream response;
+  response.precision(10);
+  if (parseCommandLine(argc, argv.data(), { &info_text }))
+  {
+    response << "ok rays " << cloud_.rayCount() << " bounded " << info_.num_bounded << " ends_min "
+             << vectorText(info_.ends_bound.min_bound_) << " ends_max " << vectorText(info_.ends_bound.max_bound_)
+             << " times " << info_.min_time << " " << info_.max_time;
+  }
+  else if (parseCommandLine(argc, argv.data(), { &count_text, &box_min, &box_max }))
+  {
+    std::vector<size_t> indices;
+    query(Cuboid(box_min.value(), box_max.value()), indices);
+    response << "ok " << indices.size();
+  }
+  else if (parseCommandLine(argc, argv.data(), { &crop_text, &box_min, &box_max, &out_file }))
+  {
+    std::vector<size_t> indices;
+    query(Cuboid(box_min.value(), box_max.value()), indices);
+    Cloud cropped = selectRays(cloud_, indices);
+    if (!writeCloud(cropped, out_file.name()))
+      return "error cannot write " + out_file.name();
+    response << "ok " << indices.size();
+  }
+  else if (parseCommandLine(argc, argv.data(), { &tube_text, &tube_start, &tube_end, &tube_radius, &out_file }))
+  {
+    // the cylinder test of raysplit's tube split, on the rays that end within the cylinder's bounds
+    const Eigen::Vector3d start = tube_start.value();
+    const Eigen::Vector3d end = tube_end.value();
+    const double radius = tube_radius.value();
+    Eigen::Vector3d dir = end - start;
+    dir /= dir.dot(dir);
+    const Eigen::Vector3d offset(radius, radius, radius);
+    std::vector<size_t> candidates, indices;
+    query(Cuboid(start.cwiseMin(end) - offset, start.cwiseMax(end) + offset), candidates);
+    for (const auto &i : candidates)
+    {
+      const double d = (cloud_.ends[i] - start).dot(dir);
+      if (d < 0.0 || d > 1.0)
+        continue;
+      const Eigen::Vector3d pos = cloud_.ends[i] + (start - end) * d;
+      if ((pos - start).squaredNorm() <= radius * radius)
+        indices.push_back(i);
+    }
+    Cloud tube = selectRays(cloud_, indices);
+    if (!writeCloud(tube, out_file.name()))
+      return "error cannot write " + out_file.name();
+    response << "ok " << indices.size();
+  }
+  else if (parseCommandLine(argc, argv.data(), { &render_text, &viewpoint, &style, &pixel_width, &out_file }) ||
+           parseCommandLine(argc, argv.data(),
+                            { &render_text, &viewpoint, &style, &pixel_width, &out_file, &box_min, &box_max }))
+  {
+    // the view and style keys are in the same order as their enums, as in rayrender
+    const ViewDirection view_dir = static_cast<ViewDirection>(viewpoint.selectedID());
+    const RenderStyle render_style = static_cast<RenderStyle>(style.selectedID());
+    bool rendered = false;
+    if (argc == 6)
+    {
+      rendered = renderCloud(cloud_, info_.ends_bound, view_dir, render_style, pixel_width.value(), out_file.name(),
+                             "", false);
+    }
+    else
+    {
+      // the renderer needs every bounded ray end within its bounds, so only those rays are rendered
+      Cuboid bounds(box_min.value().cwiseMax(info_.ends_bound.min_bound_),
+                    box_max.value().cwiseMin(info_.ends_bound.max_bound_));
+      if ((bounds.min_bound_.array() > bounds.max_bound_.array()).any())
+        return "error the box is outside the cloud";
+      std::vector<size_t> indices;
+      query(bounds, indices);
+      indices.erase(std::remove_if(indices.begin(), indices.end(), [this](size_t i) { return !cloud_.rayBounded(i); }),
+                    indices.end());
+      rendered = renderCloud(selectRays(cloud_, indices), bounds, view_dir, render_style, pixel_width.value(),
+                             out_file.name(), "", false);
+    }
+    if (!rendered)
+      return "error cannot render " + out_file.name();
+    response << "ok " << out_file.name();
+  }
+  else
+    return "error unknown request: " + request;
+  return response.str();
+}
+}  // namespace ray
@@ -0,0 +1,57 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYCLOUDSERVER_H
+#define RAYLIB_RAYCLOUDSERVER_H
+
+#include "raylib/raylibconfig.h"
+
+#include "raycloud.h"
+#include "raycuboid.h"
+#include "rayutils.h"
+
+namespace ray
+{
+/// A ray cloud kept resident in memory, with a spatial index of its ray ends, to answer many small queries without
+/// reloading the file each time. The index bins the rays into columns in x and y, each holding around a few hundred
+/// rays, so a query of a small box only visits the rays near it.
+/// Requests are lines of text, answered by @c respond , which is const, so any number of requests can be answered
+/// concurrently once the cloud is loaded. The requests are:
+///   info                                      - the ray counts, bounds and time range of the cloud
+///   count minx,miny,minz maxx,maxy,maxz       - the number of rays that end in the box
+///   crop minx,miny,minz maxx,maxy,maxz out.ply - write the rays that end in the box to out.ply
+///   tube x1,y1,z1 x2,y2,z2 radius out.ply      - write the rays that end within the cylinder to out.ply, as raysplit
+///   render top ends 0.1 out.png               - render as rayrender, with the view, style and pixel width, optionally
+///          (minx,miny,minz maxx,maxy,maxz)      of only the bounded rays that end in the box
+/// Each response is a single line, starting with "ok" or "error".
+class RAYLIB_EXPORT CloudServer
+{
+public:
+  /// load the ray cloud @c file_name and build its index. Returns false if the file could not be read
+  bool load(const std::string &file_name);
+
+  /// answer a single line @c request, returning a single line response
+  std::string respond(const std::string &request) const;
+
+  /// the resident cloud and its info
+  inline const Cloud &cloud() const { return cloud_; }
+  inline const Cloud::Info &info() const { return info_; }
+
+private:
+  /// add to @c indices the rays that end within @c box , in cloud order
+  void query(const Cuboid &box, std::vector<size_t> &indices) const;
+
+  Cloud cloud_;
+  Cloud::Info info_;
+  /// the column index: the rays of each column are @c column_rays_[column_starts_[c]] up to the next column's start
+  Eigen::Vector2d index_min_;
+  double column_width_;
+  Eigen::Vector2i num_columns_;
+  std::vector<size_t> column_starts_;
+  std::vector<size_t> column_rays_;
+};
+}  // namespace ray
+
+#endif  // RAYLIB_RAYCLOUDSERVER_H
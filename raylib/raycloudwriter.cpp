@@ -5,9 +5,69 @@
 // Author: Thomas Lowe
 #include "raycloudwriter.h"
 #include "raycloud.h"
+#include "rayplyindex.h"
+#include "raythreads.h"
+
+#include <cstdlib>
+#include <cstring>
 
 namespace ray
 {
+namespace
+{
+/// smaller chunks are written directly, as a background write would cost more than it saves
+const size_t kMinBackgroundWriteRays = 1 << 16;
+/// the block size of the .ply writers, set once by the tool at start up
+size_t write_block_size = 0;
+}  // namespace
+
+void CloudWriter::setBlockSize(size_t block_size)
+{
+  write_block_size = block_size;
+}
+
+size_t CloudWriter::blockSize()
+{
+  return write_block_size;
+}
+
+void CloudWriter::initFromArguments(int &argc, char *argv[])
+{
+  for (int i = 1; i < argc - 1; i++)
+  {
+    char *end = nullptr;
+    bool parsed = false;
+    if (std::strcmp(argv[i], "--write_block") == 0)
+    {
+      const long block_mb = std::strtol(argv[i + 1], &end, 10);
+      parsed = end != argv[i + 1] && *end == '\0' && block_mb > 0;
+      if (parsed)
+      {
+        setBlockSize(static_cast<size_t>(block_mb) << 20);
+      }
+    }
+    else if (std::strcmp(argv[i], "--rcb_compress") == 0)
+    {
+      const double tolerance = std::strtod(argv[i + 1], &end);
+      parsed = end != argv[i + 1] && *end == '\0' && tolerance >= 0.0;
+      if (parsed)
+      {
+        RcbWriter::setCompression(true, tolerance);
+      }
+    }
+    if (!parsed)
+    {
+      continue;
+    }
+    for (int j = i + 2; j <= argc; j++)
+    {
+      argv[j - 2] = argv[j];  // includes the terminating null pointer
+    }
+    argc -= 2;
+    i--;
+  }
+}
+
 bool CloudWriter::begin(const std::string &file_name)
 {
   if (file_name.empty())
@@ -17,10 +77,31 @@ bool CloudWriter::begin(const std::string &file_name)
   }
   has_warned_ = false;
   file_name_ = file_name;
-  if (!writeRayCloudChunkStart(file_name_, ofs_))
+  info_.reset();
+  use_rcb_ = isRcbFileName(file_name_);
+  // remote files are written to a local spool file, which is uploaded as it is written
+  remote_ = isRemoteFileName(file_name_);
+  const std::string path = remote_ ? RemoteUpload::spoolFileName(file_name_) : file_name_;
+  if (remote_ && !upload_.begin(file_name_, path))
   {
     return false;
   }
+  if (use_rcb_)
+  {
+    return rcb_writer_.begin(path);
+  }
+  if (!writeRayCloudChunkStart(path, ofs_, header_))
+  {
+    return false;
+  }
+  block_.clear();
+  block_fill_ = 0;
+  if (write_block_size > 0)
+  {
+    // the first block follows the header, so that later blocks start on multiples of the block size
+    block_.resize(write_block_size);
+    block_end_ = write_block_size - static_cast<size_t>(ofs_.tellp()) % write_block_size;
+  }
   return true;
 }
 
@@ -30,14 +111,118 @@ void CloudWriter::end()
   {
     return;
   }
-  const unsigned long num_rays = ray::writeRayCloudChunkEnd(ofs_);
-  std::cout << num_rays << " rays saved to " << file_name_ << std::endl;
+  if (use_rcb_)
+  {
+    const uint64_t num_rays = rcb_writer_.end();
+    if (!remote_ || upload_.end())
+      std::cout << num_rays << " rays saved to " << file_name_ << std::endl;
+    return;
+  }
+  finishPending();
+  flushBlock();
+  const unsigned long num_rays = ray::writeRayCloudChunkEnd(ofs_, header_);
   ofs_.close();
+  if (remote_)
+  {
+    if (!ofs_.fail() && upload_.end())
+      std::cout << num_rays << " rays saved to " << file_name_ << std::endl;
+    return;  // info sidecars are only kept for local files
+  }
+  std::cout << num_rays << " rays saved to " << file_name_ << std::endl;
+  // an empty file has no info, as Cloud::getInfo fails on it
+  if (!ofs_.fail() && num_rays > 0 && info_.num_bounded + info_.num_unbounded > 0)
+  {
+    info_.finish();
+    writePlyInfo(file_name_, info_);
+  }
 }
 
 bool CloudWriter::writeChunk(const Cloud &chunk)
 {
-  return writeRayCloudChunk(ofs_, buffer_, chunk.starts, chunk.ends, chunk.times, chunk.colours, has_warned_);
+  if (use_rcb_)
+    return rcb_writer_.writeChunk(chunk.starts, chunk.ends, chunk.times, chunk.colours);
+  return writePlyChunk(chunk.starts, chunk.ends, chunk.times, chunk.colours);
+}
+
+bool CloudWriter::writePlyChunk(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+                                const std::vector<double> &times, const std::vector<RGBA> &colours)
+{
+  if (ends.size() == 0)
+  {
+    // this is not an error. Allowing empty chunks avoids wrapping every call to writeChunk in a condition
+    return true;
+  }
+  // the free buffer is never the one being written, so it can be encoded while the previous chunk is written
+  RayPlyBuffer &buffer = buffers_[free_buffer_];
+  encodeRayCloudChunk(buffer, starts, ends, times, colours, has_warned_);
+  if (!finishPending())
+    return false;
+  if (ends.size() < kMinBackgroundWriteRays || Threads::threadCount() <= 1)
+  {
+    return writeBuffer(buffer);
+  }
+  pending_write_ = std::async(std::launch::async, [this, &buffer]() { return writeBuffer(buffer); });
+  free_buffer_ = 1 - free_buffer_;
+  return true;
+}
+
+bool CloudWriter::writeBuffer(const RayPlyBuffer &buffer)
+{
+  if (block_.empty() ? !writeRayCloudRows(ofs_, buffer)
+                     : !writeBlocks(reinterpret_cast<const char *>(buffer.data()), buffer.size() * sizeof(RayPlyEntry)))
+    return false;
+  decodeRayCloudChunk(buffer, decoded_starts_, decoded_ends_, decoded_times_, decoded_colours_);
+  info_.expand(decoded_starts_, decoded_ends_, decoded_times_, decoded_colours_);
+  return true;
+}
+
+bool CloudWriter::finishPending()
+{
+  if (!pending_write_.valid())
+    return true;
+  return pending_write_.get();
+}
+
+bool CloudWriter::writeBlocks(const char *data, size_t size)
+{
+  while (size > 0)
+  {
+    if (block_fill_ == 0 && size >= block_end_)
+    {
+      // whole blocks are written straight from the rows, without a copy
+      const size_t num_bytes = block_end_ + ((size - block_end_) / block_.size()) * block_.size();
+      ofs_.write(data, static_cast<std::streamsize>(num_bytes));
+      data += num_bytes;
+      size -= num_bytes;
+      block_end_ = block_.size();
+    }
+    else
+    {
+      const size_t num_bytes = std::min(size, block_end_ - block_fill_);
+      std::memcpy(block_.data() + block_fill_, data, num_bytes);
+      data += num_bytes;
+      size -= num_bytes;
+      block_fill_ += num_bytes;
+      if (block_fill_ == block_end_ && !flushBlock())
+        return false;
+    }
+    if (!ofs_.good())
+    {
+      std::cerr << "error writing to file" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CloudWriter::flushBlock()
+{
+  if (block_fill_ == 0)
+    return true;
+  ofs_.write(block_.data(), static_cast<std::streamsize>(block_fill_));
+  block_fill_ = 0;
+  block_end_ = block_.size();
+  return ofs_.good();
 }
 
 
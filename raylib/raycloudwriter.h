@@ -7,15 +7,38 @@
 #define RAYLIB_RAYCLOUDWRITER_H
 
 #include "raylib/raylibconfig.h"
+#include "raycloud.h"
 #include "rayply.h"
+#include "rayrcb.h"
+#include "rayremotefile.h"
+
+#include <future>
 
 namespace ray
 {
 /// This helper class is for writing a ray cloud to a file, one chunk at a time
 /// These chunks can be any size, even 0
+/// The file format is chosen by extension: .rcb files use the ray cloud binary format, all others are .ply
+/// The @c Cloud::Info of a .ply file is found as it is written, and stored in its info sidecar by @c end()
+/// Large .ply chunks are encoded in parallel, then written on a background thread while the caller prepares the next
+/// chunk, so a write error may only be returned by the following @c writeChunk
+/// When a block size is set, .ply rows are gathered into blocks of that size, aligned to it in the file, so a
+/// parallel filesystem sees whole stripe-sized writes rather than one write per chunk
+/// A remote file name (see @c isRemoteFileName ) is written to a local spool file, which is uploaded to object storage
+/// as it is written, then removed
 class RAYLIB_EXPORT CloudWriter
 {
 public:
+  /// Set the block size in bytes of the .ply files begun after this call, or 0 to write each chunk as it comes
+  static void setBlockSize(size_t block_size);
+  /// The block size in bytes that @c begin() uses
+  static size_t blockSize();
+  /// Remove the @c --write_block N and @c --rcb_compress T options from the command line arguments. These set a block
+  /// size of N MiB, and compress the .rcb files written with a ray start tolerance of T metres (see
+  /// @c RcbWriter::setCompression ). An N that is not a positive integer, or a T that is negative, is left in the
+  /// arguments, for the tool's own parsing to reject.
+  static void initFromArguments(int &argc, char *argv[]);
+
   /// Open the file to write to
   bool begin(const std::string &file_name);
 
@@ -26,7 +49,9 @@ public:
   bool writeChunk(std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends, std::vector<double> &times,
                   std::vector<RGBA> &colours)
   {
-    return writeRayCloudChunk(ofs_, buffer_, starts, ends, times, colours, has_warned_);
+    if (use_rcb_)
+      return rcb_writer_.writeChunk(starts, ends, times, colours);
+    return writePlyChunk(starts, ends, times, colours);
   }
 
   /// finish writing, and adjust the vertex count at the start.
@@ -36,14 +61,46 @@ public:
   const std::string &fileName() { return file_name_; }
 
 private:
+  /// encode the rays into the free buffer, and write it
+  bool writePlyChunk(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+                     const std::vector<double> &times, const std::vector<RGBA> &colours);
+  /// write @c buffer and include its rays in @c info_ , as they will be read back from the file
+  bool writeBuffer(const RayPlyBuffer &buffer);
+  /// wait for the buffer being written in the background, returning whether it succeeded
+  bool finishPending();
+  /// append @c size bytes to the file through the block buffer, writing each block as it fills
+  bool writeBlocks(const char *data, size_t size);
+  /// write the partly filled block
+  bool flushBlock();
+
   /// store the output file stream
   std::ofstream ofs_;
+  /// the positions of the header fields of the file, completed on end()
+  RayPlyHeader header_;
   /// store the file name, in order to provide a clear 'saved' message on end()
   std::string file_name_;
-  /// ray buffer to avoid repeated reallocations
-  RayPlyBuffer buffer_;
+  /// ray buffers to avoid repeated reallocations. One is filled while the other is written in the background
+  RayPlyBuffer buffers_[2];
+  int free_buffer_ = 0;
+  /// the block buffer, empty when blocks are not used, and the bytes filled and to fill in the current block
+  std::vector<char> block_;
+  size_t block_fill_ = 0;
+  size_t block_end_ = 0;
   /// whether a warning has been issued or not. This prevents multiple warnings.
   bool has_warned_;
+  /// whether the file is written in the .rcb format, and its writer
+  bool use_rcb_ = false;
+  RcbWriter rcb_writer_;
+  /// whether the file is uploaded to object storage, and its upload
+  bool remote_ = false;
+  RemoteUpload upload_;
+  /// the info of the rays written so far, and buffers for decoding them
+  Cloud::Info info_;
+  std::vector<Eigen::Vector3d> decoded_starts_, decoded_ends_;
+  std::vector<double> decoded_times_;
+  std::vector<RGBA> decoded_colours_;
+  /// the background write, which uses the members above, so is declared last to be waited on first in destruction
+  std::future<bool> pending_write_;
 };
 
 }  // namespace ray
@@ -0,0 +1,188 @@
+// Copyright (c) 2020
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raycompactcloud.h"
+#include "raycloudwriter.h"
+
+#include <iostream>
+#include <limits>
+
+namespace ray
+{
+void CompactCloud::clear()
+{
+  reference_set_ = false;
+  starts.clear();
+  ends.clear();
+  times.clear();
+  colours.clear();
+  neighbour_index_cache_.clear();
+}
+
+void CompactCloud::reserve(size_t size)
+{
+  starts.reserve(size);
+  ends.reserve(size);
+  times.reserve(size);
+  colours.reserve(size);
+}
+
+void CompactCloud::setReference(const Eigen::Vector3d &new_origin, double new_base_time)
+{
+  if (!ends.empty())
+  {
+    std::cerr << "Error: the compact cloud reference cannot be changed once it holds rays" << std::endl;
+    return;
+  }
+  origin = new_origin;
+  base_time = new_base_time;
+  reference_set_ = true;
+}
+
+void CompactCloud::addRay(const Eigen::Vector3d &start, const Eigen::Vector3d &end, double time, const RGBA &colour)
+{
+  if (!reference_set_)
+  {
+    setReference(end, time);
+  }
+  starts.push_back((start - origin).cast<float>());
+  ends.push_back((end - origin).cast<float>());
+  times.push_back(static_cast<float>(time - base_time));
+  colours.push_back(colour);
+}
+
+void CompactCloud::addRay(const Cloud &cloud, size_t index)
+{
+  addRay(cloud.starts[index], cloud.ends[index], cloud.times[index], cloud.colours[index]);
+}
+
+void CompactCloud::fromCloud(const Cloud &cloud)
+{
+  clear();
+  if (cloud.rayCount() == 0)
+  {
+    return;
+  }
+  Eigen::Vector3d min_bound, max_bound;
+  if (!cloud.calcBounds(&min_bound, &max_bound, kBFEnd | kBFStart))
+  {
+    min_bound = max_bound = cloud.ends[0];
+  }
+  setReference(0.5 * (min_bound + max_bound), cloud.times[0]);
+  reserve(cloud.rayCount());
+  for (size_t i = 0; i < cloud.rayCount(); i++)
+  {
+    addRay(cloud, i);
+  }
+}
+
+void CompactCloud::toCloud(Cloud &cloud) const
+{
+  cloud.resize(rayCount());
+  for (size_t i = 0; i < rayCount(); i++)
+  {
+    cloud.starts[i] = rayStart(i);
+    cloud.ends[i] = rayEnd(i);
+    cloud.times[i] = rayTime(i);
+    cloud.colours[i] = colours[i];
+  }
+}
+
+bool CompactCloud::load(const std::string &file_name, int min_num_rays)
+{
+  Cloud::Info info;
+  if (!Cloud::getInfo(file_name, info))
+  {
+    return false;
+  }
+  clear();
+  setReference(0.5 * (info.rays_bound.min_bound_ + info.rays_bound.max_bound_), info.min_time);
+  reserve(info.num_bounded + info.num_unbounded);
+  auto append = [&](std::vector<Eigen::Vector3d> &chunk_starts, std::vector<Eigen::Vector3d> &chunk_ends,
+                    std::vector<double> &chunk_times, std::vector<RGBA> &chunk_colours) {
+    for (size_t i = 0; i < chunk_ends.size(); i++)
+    {
+      addRay(chunk_starts[i], chunk_ends[i], chunk_times[i], chunk_colours[i]);
+    }
+  };
+  if (!Cloud::read(file_name, append))
+  {
+    return false;
+  }
+  return static_cast<int>(rayCount()) >= min_num_rays;
+}
+
+bool CompactCloud::save(const std::string &file_name) const
+{
+  CloudWriter writer;
+  if (!writer.begin(file_name))
+  {
+    return false;
+  }
+  const size_t chunk_size = 1000000;
+  Cloud chunk;
+  for (size_t first = 0; first < rayCount(); first += chunk_size)
+  {
+    const size_t num = std::min(chunk_size, rayCount() - first);
+    chunk.resize(num);
+    for (size_t i = 0; i < num; i++)
+    {
+      chunk.starts[i] = rayStart(first + i);
+      chunk.ends[i] = rayEnd(first + i);
+      chunk.times[i] = rayTime(first + i);
+      chunk.colours[i] = colours[first + i];
+    }
+    if (!writer.writeChunk(chunk))
+    {
+      return false;
+    }
+  }
+  writer.end();
+  return true;
+}
+
+void CompactCloud::getSurfels(int search_size, std::vector<Eigen::Vector3d> *centroids,
+                              std::vector<Eigen::Vector3d> *normals, std::vector<Eigen::Vector3d> *dimensions,
+                              std::vector<Eigen::Matrix3d> *mats, Eigen::MatrixXi *neighbour_indices,
+                              double max_distance, bool reject_back_facing_rays) const
+{
+  calculateSurfels(*this, search_size, centroids, normals, dimensions, mats, neighbour_indices, max_distance,
+                   reject_back_facing_rays);
+}
+
+std::shared_ptr<const NeighbourIndex> CompactCloud::neighbourIndex(bool bounded_only) const
+{
+  return neighbour_index_cache_.get(*this, bounded_only);
+}
+
+double CompactCloud::estimatePointSpacing() const
+{
+  return calculatePointSpacing(*this);
+}
+
+Eigen::Vector3d CompactCloud::calcMinBound() const
+{
+  Eigen::Vector3d min_v(std::numeric_limits<double>::max(), std::numeric_limits<double>::max(),
+                        std::numeric_limits<double>::max());
+  for (size_t i = 0; i < rayCount(); i++)
+  {
+    if (rayBounded(i))
+      min_v = minVector(min_v, minVector(rayStart(i), rayEnd(i)));
+  }
+  return min_v;
+}
+
+Eigen::Vector3d CompactCloud::calcMaxBound() const
+{
+  Eigen::Vector3d max_v(std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest(),
+                        std::numeric_limits<double>::lowest());
+  for (size_t i = 0; i < rayCount(); i++)
+  {
+    if (rayBounded(i))
+      max_v = maxVector(max_v, maxVector(rayStart(i), rayEnd(i)));
+  }
+  return max_v;
+}
+}  // namespace ray
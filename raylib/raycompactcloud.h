@@ -0,0 +1,86 @@
+// Copyright (c) 2020
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYCOMPACTCLOUD_H
+#define RAYLIB_RAYCOMPACTCLOUD_H
+
+#include "raylib/raylibconfig.h"
+
+#include "raycloud.h"
+
+namespace ray
+{
+/// A lower memory alternative to @c Cloud, for clouds that are too large to hold in double precision.
+/// Ray starts and ends are stored as single precision offsets from a double precision @c origin, and times as single
+/// precision offsets from a double precision @c base_time. This is 32 bytes per ray rather than 60.
+/// Position precision is roughly 1e-7 times the distance from @c origin (0.1 mm at 1 km), and time precision roughly
+/// 1e-7 times the time since @c base_time (0.4 ms after one hour).
+/// The per-ray accessors match those of @c Cloud, so the algorithms that are templated on the cloud type (surfels,
+/// ellipsoids, transient filtering and mesh splitting) accept either.
+class RAYLIB_EXPORT CompactCloud
+{
+public:
+  /// double precision reference for the stored positions and times. Set on the first ray added, if not set before.
+  Eigen::Vector3d origin = Eigen::Vector3d::Zero();
+  double base_time = 0.0;
+  /// the stored ray data, relative to @c origin and @c base_time
+  std::vector<Eigen::Vector3f> starts;
+  std::vector<Eigen::Vector3f> ends;
+  std::vector<float> times;
+  std::vector<RGBA> colours;
+
+  void clear();
+  /// reserve the cloud's vectors
+  void reserve(size_t size);
+  /// set the position and time reference. Must be called before any rays are added.
+  void setReference(const Eigen::Vector3d &new_origin, double new_base_time);
+
+  inline Eigen::Vector3d rayStart(size_t i) const { return origin + starts[i].cast<double>(); }
+  inline Eigen::Vector3d rayEnd(size_t i) const { return origin + ends[i].cast<double>(); }
+  inline double rayTime(size_t i) const { return base_time + static_cast<double>(times[i]); }
+  inline const RGBA &rayColour(size_t i) const { return colours[i]; }
+  /// is the ray at index @c i bounded. Unbounded rays are non-returns, typically due to exceeding lidar range.
+  inline bool rayBounded(size_t i) const { return colours[i].alpha > 0; }
+  inline uint8_t rayIntensity(size_t i) const { return colours[i].alpha; }
+  /// the number of rays
+  inline size_t rayCount() const { return ends.size(); }
+
+  /// add a new ray to the cloud
+  void addRay(const Eigen::Vector3d &start, const Eigen::Vector3d &end, double time, const RGBA &colour);
+  /// add the ray at @c index of a full precision cloud
+  void addRay(const Cloud &cloud, size_t index);
+
+  /// convert from a full precision cloud, using the centre of its rays as the reference
+  void fromCloud(const Cloud &cloud);
+  /// convert to a full precision cloud
+  void toCloud(Cloud &cloud) const;
+
+  /// load a ray cloud file one chunk at a time, so the full precision cloud is never in memory
+  bool load(const std::string &file_name, int min_num_rays = 4);
+  /// save to a ray cloud file, converting one chunk at a time
+  bool save(const std::string &file_name) const;
+
+  /// see @c Cloud::getSurfels
+  void getSurfels(int search_size, std::vector<Eigen::Vector3d> *centroids, std::vector<Eigen::Vector3d> *normals,
+                  std::vector<Eigen::Vector3d> *dimensions, std::vector<Eigen::Matrix3d> *mats,
+                  Eigen::MatrixXi *neighbour_indices, double max_distance = 0.0,
+                  bool reject_back_facing_rays = true) const;
+  /// see @c Cloud::neighbourIndex
+  std::shared_ptr<const NeighbourIndex> neighbourIndex(bool bounded_only = true) const;
+  /// see @c Cloud::estimatePointSpacing
+  double estimatePointSpacing() const;
+  /// minimum bounds of all bounded rays
+  Eigen::Vector3d calcMinBound() const;
+  /// maximum bounds of all bounded rays
+  Eigen::Vector3d calcMaxBound() const;
+
+private:
+  bool reference_set_ = false;
+  mutable NeighbourIndexCache neighbour_index_cache_;
+};
+
+}  // namespace ray
+
+#endif  // RAYLIB_RAYCOMPACTCLOUD_H
@@ -7,7 +7,11 @@
 
 #include "raydebugdraw.h"
 
-#if RAYLIB_WITH_QHULL
+#if RAYLIB_WITH_QHULL || RAYLIB_NATIVE_DELAUNAY
+#include "raythreads.h"
+#if RAYLIB_NATIVE_DELAUNAY
+#include "raydelaunay.h"
+#else  // RAYLIB_NATIVE_DELAUNAY
 #include <libqhullcpp/Qhull.h>
 #include <libqhullcpp/QhullFacet.h>
 #include <libqhullcpp/QhullFacetList.h>
@@ -16,8 +20,8 @@
 #include <libqhullcpp/QhullPoints.h>
 #include <libqhullcpp/QhullRidge.h>
 #include <libqhullcpp/QhullVertexSet.h>
+#endif  // RAYLIB_NATIVE_DELAUNAY
 #include <map>
-#include <unordered_map>
 
 #ifdef __unix__
 #include <cstdio>
@@ -33,137 +37,241 @@ namespace ray
 {
 static const double deadFace = 1e10;
 
-class Hasher
-{
-public:
-  size_t operator()(const Eigen::Vector2i &key) const { return key[0] + key[1]; }
-};
-
+#if RAYLIB_NATIVE_DELAUNAY
 ConcaveHull::ConcaveHull(const std::vector<Eigen::Vector3d> &points)
 {
   centre_ = mean(points);
-  std::unordered_map<Eigen::Vector2i, int, Hasher> edgeLookup(points.size() * 2);
-
   std::cout << "number of points: " << points.size() << std::endl;
-  vertices_ = points;
-  vertex_on_surface_.resize(vertices_.size());
-  for (int i = 0; i < (int)vertex_on_surface_.size(); i++) vertex_on_surface_[i] = false;
-
-  std::vector<double> coordinates(points.size() * 3);
-  for (int i = 0; i < (int)points.size(); i++)
-  {
-    coordinates[3 * i + 0] = points[i][0];
-    coordinates[3 * i + 1] = points[i][1];
-    coordinates[3 * i + 2] = points[i][2];
-  }
+  mesh_.vertices() = points;
+  vertex_on_surface_.assign(points.size(), false);
 
-  orgQhull::Qhull hull;
-  hull.setOutputStream(&std::cout);
-  hull.runQhull("", 3, int(points.size()), coordinates.data(), "d Qbb Qt");
-
-  orgQhull::QhullFacetList facets = hull.facetList();
-  int maxFacets = 0;
-  for (const orgQhull::QhullFacet &f : facets) maxFacets = std::max(maxFacets, f.id() + 1);
-  std::cout << "number of total facets: " << facets.size() << std::endl;
-  tetrahedra_.resize(maxFacets);
-
-  int maxTris = 0;
-  for (const orgQhull::QhullFacet &f : facets)
+  int num_tetrahedra = 0;
   {
-    if (f.isUpperDelaunay())
-      continue;
-    qh_makeridges(hull.qh(), f.getFacetT());
-    for (const orgQhull::QhullRidge &r : f.ridges()) maxTris = std::max(maxTris, r.id() + 1);
+    // freed before the edges are numbered, as it is larger than the hull's own arrays
+    DelaunayTetrahedralisation delaunay;
+    if (!delaunay.build(points))
+    {
+      std::cout << "cannot tetrahedralise coplanar points" << std::endl;
+    }
+    const std::vector<Eigen::Vector4i> &tetras = delaunay.tetrahedra();
+    const std::vector<Eigen::Vector4i> &neighbours = delaunay.neighbours();
+    num_tetrahedra = static_cast<int>(tetras.size());
+    // a single invalid tetrahedron stands for the outside of the convex hull, as do Qhull's upper Delaunay facets
+    const int outside = num_tetrahedra;
+    tetrahedra_.resize(num_tetrahedra + 1);
+
+    // each triangle is numbered by the first of its two tetrahedra
+    std::vector<int> first_triangle(num_tetrahedra + 1, 0);
+    parallelFor(0, num_tetrahedra, [&](int t) {
+      for (int i = 0; i < 4; i++) first_triangle[t + 1] += neighbours[t][i] < 0 || neighbours[t][i] > t;
+    });
+    for (int t = 0; t < num_tetrahedra; t++) first_triangle[t + 1] += first_triangle[t];
+    triangles_.resize(first_triangle[num_tetrahedra]);
+    parallelFor(0, num_tetrahedra, [&](int t) {
+      Tetrahedron &tetra = tetrahedra_[t];
+      int triangle_id = first_triangle[t];
+      for (int i = 0; i < 4; i++)
+      {
+        tetra.vertices[i] = tetras[t][i];
+        const int neighbour = neighbours[t][i];
+        if (neighbour >= 0 && neighbour < t)
+        {
+          continue;
+        }
+        Triangle &triangle = triangles_[triangle_id];
+        for (int j = 0, k = 0; j < 4; j++)
+        {
+          if (j != i)
+          {
+            triangle.vertices[k++] = tetras[t][j];
+          }
+        }
+        triangle.tetrahedra[0] = t;
+        triangle.tetrahedra[1] = neighbour < 0 ? outside : neighbour;
+        triangle.is_surface = neighbour < 0;
+        tetra.triangles[i] = triangle_id++;
+      }
+    });
+    // the shared triangles, from the neighbour that numbered them
+    parallelFor(0, num_tetrahedra, [&](int t) {
+      for (int i = 0; i < 4; i++)
+      {
+        const int neighbour = neighbours[t][i];
+        if (neighbour >= 0 && neighbour < t)
+        {
+          for (int j = 0; j < 4; j++)
+          {
+            if (neighbours[neighbour][j] == t)
+            {
+              tetrahedra_[t].triangles[i] = tetrahedra_[neighbour].triangles[j];
+            }
+          }
+        }
+      }
+    });
   }
-  triangles_.resize(maxTris);
-  std::cout << "maximum number of triangles: " << maxTris << std::endl;
+  numberEdges();
+  std::cout << "number of tetrahedrons: " << num_tetrahedra << std::endl;
+}
+#else   // RAYLIB_NATIVE_DELAUNAY
+ConcaveHull::ConcaveHull(const std::vector<Eigen::Vector3d> &points)
+{
+  centre_ = mean(points);
+  std::cout << "number of points: " << points.size() << std::endl;
+  mesh_.vertices() = points;
+  const std::vector<Eigen::Vector3d> &vertices = mesh_.vertices();
+  vertex_on_surface_.assign(points.size(), false);
 
+  // released before the edges are numbered. Qhull reads the points in place, as they are packed triples
   int c = 0;
-  for (const orgQhull::QhullFacet &f : facets)
   {
-    if (f.isUpperDelaunay())
-      continue;
-    int i = 0;
-    Tetrahedron tetra;
-    tetra.id = f.id();
-    orgQhull::QhullVertexSet verts = f.vertices();
-    for (const orgQhull::QhullVertex &v : verts)
+    orgQhull::Qhull hull;
+    hull.setOutputStream(&std::cout);
+    hull.runQhull("", 3, int(points.size()), reinterpret_cast<const double *>(points.data()), "d Qbb Qt");
+
+    orgQhull::QhullFacetList facets = hull.facetList();
+    int maxFacets = 0;
+    for (const orgQhull::QhullFacet &f : facets) maxFacets = std::max(maxFacets, f.id() + 1);
+    std::cout << "number of total facets: " << facets.size() << std::endl;
+    tetrahedra_.resize(maxFacets);
+
+    int maxTris = 0;
+    for (const orgQhull::QhullFacet &f : facets)
     {
-      const double *data = v.point().coordinates();
-      Eigen::Vector3d vec(data[0], data[1], data[2]);
-      tetra.vertices[i++] = v.point().id();
-      if ((vertices_[v.point().id()] - vec).squaredNorm() > 1e-8)
-        std::cout << "vertex data doesn't match its id" << std::endl;
+      if (f.isUpperDelaunay())
+        continue;
+      qh_makeridges(hull.qh(), f.getFacetT());
+      for (const orgQhull::QhullRidge &r : f.ridges()) maxTris = std::max(maxTris, r.id() + 1);
     }
+    triangles_.resize(maxTris);
+    std::cout << "maximum number of triangles: " << maxTris << std::endl;
 
-    orgQhull::QhullRidgeSet ridges = f.ridges();
-    if (ridges.size() != 4)
-      std::cout << "bad number of ridges: " << ridges.size() << std::endl;
-    i = 0;
-    for (const orgQhull::QhullRidge &r : ridges)
+    for (const orgQhull::QhullFacet &f : facets)
     {
-      if (r.vertices().size() != 3)
-        std::cout << "bad ridge size: " << r.vertices().size() << std::endl;
-      tetra.neighbours[i] = r.topFacet() == f ? r.bottomFacet().id() : r.topFacet().id();
-      tetra.triangles[i++] = r.id();
-      if (r.id() > maxTris)
-        std::cout << "bad rid" << std::endl;
-      int j = 0;
-      int rid = r.id();
-      if (rid >= (int)triangles_.size() || r.id() < 0)
-        std::cout << "bag bad" << std::endl;
-      if (triangles_[rid].valid())
+      if (f.isUpperDelaunay())
+        continue;
+      int i = 0;
+      Tetrahedron tetra;
+      orgQhull::QhullVertexSet verts = f.vertices();
+      for (const orgQhull::QhullVertex &v : verts)
       {
-        if (triangles_[rid].tetrahedra[0] != r.topFacet().id() && triangles_[rid].tetrahedra[0] != r.bottomFacet().id())
-          std::cout << "replacing with bad data" << std::endl;
+        const double *data = v.point().coordinates();
+        Eigen::Vector3d vec(data[0], data[1], data[2]);
+        tetra.vertices[i++] = v.point().id();
+        if ((vertices[v.point().id()] - vec).squaredNorm() > 1e-8)
+          std::cout << "vertex data doesn't match its id" << std::endl;
       }
-      else
+
+      orgQhull::QhullRidgeSet ridges = f.ridges();
+      if (ridges.size() != 4)
+        std::cout << "bad number of ridges: " << ridges.size() << std::endl;
+      i = 0;
+      for (const orgQhull::QhullRidge &r : ridges)
       {
-        triangles_[rid].tetrahedra[0] = r.topFacet().id();
-        triangles_[rid].tetrahedra[1] = r.bottomFacet().id();
-        triangles_[rid].is_surface = r.topFacet().isUpperDelaunay() != r.bottomFacet().isUpperDelaunay();
-        if (triangles_[rid].tetrahedra[0] != f.id() && triangles_[rid].tetrahedra[1] != f.id())
-          std::cout << "bad too" << std::endl;
-        for (const orgQhull::QhullVertex &v : r.vertices())
+        if (r.vertices().size() != 3)
+          std::cout << "bad ridge size: " << r.vertices().size() << std::endl;
+        tetra.triangles[i++] = r.id();
+        if (r.id() > maxTris)
+          std::cout << "bad rid" << std::endl;
+        int j = 0;
+        int rid = r.id();
+        if (rid >= (int)triangles_.size() || r.id() < 0)
+          std::cout << "bag bad" << std::endl;
+        if (triangles_[rid].valid())
         {
-          int vid = v.point().id();
-          if (vid != tetra.vertices[0] && vid != tetra.vertices[1] && vid != tetra.vertices[2] &&
-              vid != tetra.vertices[3])
-            std::cout << "bad" << std::endl;
-          triangles_[rid].vertices[j++] = vid;
+          if (triangles_[rid].tetrahedra[0] != r.topFacet().id() &&
+              triangles_[rid].tetrahedra[0] != r.bottomFacet().id())
+            std::cout << "replacing with bad data" << std::endl;
         }
-        for (int i = 0; i < 3; i++)
+        else
         {
-          int a = triangles_[rid].vertices[i];
-          int b = triangles_[rid].vertices[(i + 1) % 3];
-          Eigen::Vector2i v(std::min(a, b), std::max(a, b));
-          const auto &res = edgeLookup.find(v);
-          if (res == edgeLookup.end())
+          triangles_[rid].tetrahedra[0] = r.topFacet().id();
+          triangles_[rid].tetrahedra[1] = r.bottomFacet().id();
+          triangles_[rid].is_surface = r.topFacet().isUpperDelaunay() != r.bottomFacet().isUpperDelaunay();
+          if (triangles_[rid].tetrahedra[0] != f.id() && triangles_[rid].tetrahedra[1] != f.id())
+            std::cout << "bad too" << std::endl;
+          for (const orgQhull::QhullVertex &v : r.vertices())
           {
-            triangles_[rid].edges[i] = int(edges_.size());
-            edgeLookup.insert({ v, edges_.size() });
-            edges_.push_back(Edge(v[0], v[1]));
+            int vid = v.point().id();
+            if (vid != tetra.vertices[0] && vid != tetra.vertices[1] && vid != tetra.vertices[2] &&
+                vid != tetra.vertices[3])
+              std::cout << "bad" << std::endl;
+            triangles_[rid].vertices[j++] = vid;
           }
-          else
-            triangles_[rid].edges[i] = res->second;
         }
       }
-    }
 
-    if (f.id() >= (int)tetrahedra_.size())
-      std::cout << "bad" << std::endl;
-    tetrahedra_[f.id()] = tetra;
+      if (f.id() >= (int)tetrahedra_.size())
+        std::cout << "bad" << std::endl;
+      tetrahedra_[f.id()] = tetra;
 
-    c++;
+      c++;
+    }
   }
+  numberEdges();
   std::cout << "number of tetrahedrons: " << c << std::endl;
 }
+#endif  // RAYLIB_NATIVE_DELAUNAY
+
+// number each distinct edge of the triangles, by the list of the higher vertices of the edges at each vertex,
+// rather than a hash map or a sorted list of vertex pairs, which are several times larger
+void ConcaveHull::numberEdges()
+{
+  const int num_vertices = static_cast<int>(mesh_.vertices().size());
+  const int num_triangles = static_cast<int>(triangles_.size());
+  std::vector<int> first(num_vertices + 1, 0);
+  for (const auto &triangle : triangles_)
+  {
+    if (!triangle.valid())
+      continue;
+    for (int i = 0; i < 3; i++) first[std::min(triangle.vertices[i], triangle.vertices[(i + 1) % 3]) + 1]++;
+  }
+  for (int v = 0; v < num_vertices; v++) first[v + 1] += first[v];
+  std::vector<int> others(first[num_vertices]);
+  {
+    std::vector<int> next(first.begin(), first.end() - 1);
+    for (const auto &triangle : triangles_)
+    {
+      if (!triangle.valid())
+        continue;
+      for (int i = 0; i < 3; i++)
+      {
+        const int a = triangle.vertices[i], b = triangle.vertices[(i + 1) % 3];
+        others[next[std::min(a, b)]++] = std::max(a, b);
+      }
+    }
+  }
+  // each vertex's distinct neighbours go at the start of its list, and are numbered consecutively
+  std::vector<int> first_edge(num_vertices + 1, 0);
+  parallelFor(0, num_vertices, [&](int v) {
+    int *begin = others.data() + first[v];
+    int *end = others.data() + first[v + 1];
+    std::sort(begin, end);
+    first_edge[v + 1] = static_cast<int>(std::unique(begin, end) - begin);
+  });
+  for (int v = 0; v < num_vertices; v++) first_edge[v + 1] += first_edge[v];
+  edge_has_had_face_.assign(first_edge[num_vertices], false);
+  parallelFor(0, num_triangles, [&](int t) {
+    Triangle &triangle = triangles_[t];
+    if (!triangle.valid())
+      return;
+    for (int i = 0; i < 3; i++)
+    {
+      const int a = triangle.vertices[i], b = triangle.vertices[(i + 1) % 3];
+      const int v0 = std::min(a, b);
+      const int *begin = others.data() + first[v0];
+      const int *end = begin + (first_edge[v0 + 1] - first_edge[v0]);
+      triangle.edges[i] = first_edge[v0] + static_cast<int>(std::lower_bound(begin, end, std::max(a, b)) - begin);
+    }
+  });
+}
 
 double ConcaveHull::circumcurvature(const ConcaveHull::Tetrahedron &tetra, int triangleID)
 {
+  const std::vector<Eigen::Vector3d> &vertices = mesh_.vertices();
   Triangle &triangle = triangles_[triangleID];
   Eigen::Vector3d vs[4];
-  for (int i = 0; i < 4; i++) vs[i] = vertices_[tetra.vertices[i]];
+  for (int i = 0; i < 4; i++) vs[i] = vertices[tetra.vertices[i]];
 
   Eigen::Vector3d m1 = (vs[0] + vs[1]) * 0.5;
   Eigen::Vector3d m2 = (vs[0] + vs[2]) * 0.5;
@@ -187,7 +295,7 @@ double ConcaveHull::circumcurvature(const ConcaveHull::Tetrahedron &tetra, int t
   double circumradius = (circumcentre_ - vs[0]).norm();
 
   Eigen::Vector3d cs[3];
-  for (int i = 0; i < 3; i++) cs[i] = vertices_[triangle.vertices[i]];
+  for (int i = 0; i < 3; i++) cs[i] = vertices[triangle.vertices[i]];
 
   Eigen::Vector3d triNormal = (cs[2] - cs[0]).cross(cs[1] - cs[0]);
   double circumcentre_Side = (circumcentre_ - cs[0]).dot(triNormal);
@@ -202,7 +310,7 @@ double ConcaveHull::circumcurvature(const ConcaveHull::Tetrahedron &tetra, int t
     {
       if (tetra.triangles[j] == triangleID)
         continue;
-      if (triangles_[tetra.triangles[j]].surface_face_cached.triangle != -1)
+      if (triangles_[tetra.triangles[j]].on_surface)
       {
         numFaceIntersects++;
         faceIntersects = j;
@@ -213,7 +321,7 @@ double ConcaveHull::circumcurvature(const ConcaveHull::Tetrahedron &tetra, int t
       int otherFace = tetra.triangles[faceIntersects];
       Triangle tri = triangles_[otherFace];
       Eigen::Vector3d ds[3];
-      for (int i = 0; i < 3; i++) ds[i] = vertices_[tri.vertices[i]];
+      for (int i = 0; i < 3; i++) ds[i] = vertices[tri.vertices[i]];
 
       Eigen::Vector3d triNormal2 = (ds[2] - ds[0]).cross(ds[1] - ds[0]);
       double circumcentre_Side2 = (circumcentre_ - ds[0]).dot(triNormal2);
@@ -228,11 +336,102 @@ double ConcaveHull::circumcurvature(const ConcaveHull::Tetrahedron &tetra, int t
   return 1.0 / circumradius;
 }
 
+void ConcaveHull::SurfaceQueue::clear()
+{
+  faces_.clear();
+  positions_.clear();
+  heap_.clear();
+}
+
+int ConcaveHull::SurfaceQueue::push(const SurfaceFace &face)
+{
+  const int handle = static_cast<int>(faces_.size());
+  faces_.push_back(face);
+  positions_.push_back(-1);
+  heap_.push_back(handle);
+  place(heap_.size() - 1, handle);
+  siftUp(heap_.size() - 1);
+  return handle;
+}
+
+void ConcaveHull::SurfaceQueue::erase(int handle)
+{
+  const size_t position = positions_[handle];
+  const int last = heap_.back();
+  heap_.pop_back();
+  positions_[handle] = -1;
+  if (last == handle)
+    return;
+  place(position, last);
+  siftUp(position);
+  siftDown(positions_[last]);
+}
+
+void ConcaveHull::SurfaceQueue::siftUp(size_t position)
+{
+  const int handle = heap_[position];
+  while (position > 0)
+  {
+    const size_t parent = (position - 1) / 2;
+    if (!less(handle, heap_[parent]))
+      break;
+    place(position, heap_[parent]);
+    position = parent;
+  }
+  place(position, handle);
+}
+
+void ConcaveHull::SurfaceQueue::siftDown(size_t position)
+{
+  const int handle = heap_[position];
+  for (;;)
+  {
+    size_t child = 2 * position + 1;
+    if (child >= heap_.size())
+      break;
+    if (child + 1 < heap_.size() && less(heap_[child + 1], heap_[child]))
+      child++;
+    if (!less(heap_[child], handle))
+      break;
+    place(position, heap_[child]);
+    position = child;
+  }
+  place(position, handle);
+}
+
+std::vector<ConcaveHull::SurfaceFace> ConcaveHull::SurfaceQueue::sortedFaces() const
+{
+  std::vector<SurfaceFace> faces;
+  faces.reserve(heap_.size());
+  for (const auto &handle : heap_) faces.push_back(faces_[handle]);
+  std::sort(faces.begin(), faces.end(), FaceComp());
+  return faces;
+}
+
+// the surface holds each distinct face once, so re-adding a triangle's queued face has no effect
+void ConcaveHull::addSurfaceFace(const SurfaceFace &face)
+{
+  Triangle &tri = triangles_[face.triangle];
+  tri.on_surface = true;
+  if (surface_.holds(tri.surface_handle, face))
+    return;
+  tri.surface_handle = surface_.push(face);
+}
+
+// the triangles' handles are dropped with the queue, as they would otherwise refer to the new entries
+void ConcaveHull::clearSurface()
+{
+  surface_.clear();
+  for (auto &triangle : triangles_) triangle.surface_handle = -1;
+}
+
 static int newTriCount = 0;
 
 bool ConcaveHull::growFront(double maxCurvature)
 {
-  SurfaceFace face = *surface_.begin();
+  if (surface_.empty())
+    return false;
+  SurfaceFace face = surface_.top();
   if (face.curvature == deadFace || face.curvature > maxCurvature)
     return false;
   int vertexI = 0;
@@ -251,20 +450,18 @@ bool ConcaveHull::growFront(double maxCurvature)
   bool intersects = vertex_on_surface_[newVertex];
   int faceIntersects = -1;
   int numFaceIntersects = 0;
-  const SurfaceFace *faceIntersectTri = nullptr;
   for (int j = 0; j < 4; j++)
   {
     if (tetra.triangles[j] == face.triangle)
       continue;
-    if (triangles_[tetra.triangles[j]].surface_face_cached.triangle != -1)
+    if (triangles_[tetra.triangles[j]].on_surface)
     {
       numFaceIntersects++;
       faceIntersects = j;
-      faceIntersectTri = &triangles_[tetra.triangles[j]].surface_face_cached;
     }
   }
 
-  surface_.erase(surface_.begin());
+  surface_.pop();
   if (numFaceIntersects == 1)
   {
     intersects = false;
@@ -281,20 +478,24 @@ bool ConcaveHull::growFront(double maxCurvature)
       tri2 = tetra.triangles[(faceIntersects + 2) % 3];
     int v0 = std::min(otherVertex, newVertex);
     int v1 = std::max(otherVertex, newVertex);
+    const Triangle &triangle2 = triangles_[tri2];
     for (int i = 0; i < 3; i++)
     {
-      Edge &edge = edges_[triangles_[tri2].edges[i]];
-      if (edge.vertices[0] == v0 && edge.vertices[1] == v1 && edge.has_had_face)
+      const int a = triangle2.vertices[i], b = triangle2.vertices[(i + 1) % 3];
+      if (std::min(a, b) == v0 && std::max(a, b) == v1 && edge_has_had_face_[triangle2.edges[i]])
         intersects = true;
     }
     if (!intersects)
-      surface_.erase(*faceIntersectTri);
+    {
+      const Triangle &tri = triangles_[tetra.triangles[faceIntersects]];
+      if (surface_.contains(tri.surface_handle))
+        surface_.erase(tri.surface_handle);
+    }
   }
   if (intersects)
   {
     face.curvature = deadFace;
-    triangles_[face.triangle].surface_face_cached = face;
-    surface_.insert(face);  // put it at the back of the queue
+    addSurfaceFace(face);  // put it at the back of the queue
     return true;
   }
 
@@ -305,7 +506,7 @@ bool ConcaveHull::growFront(double maxCurvature)
       continue;
     SurfaceFace newFace;
 
-    newFace.tetrahedron = tetra.neighbours[i];
+    newFace.tetrahedron = neighbour(face.tetrahedron, i);
     newFace.triangle = tetra.triangles[i];
     for (int j = 0; j < 3; j++) vertex_on_surface_[triangles_[newFace.triangle].vertices[j]] = true;
     double grad;
@@ -313,50 +514,41 @@ bool ConcaveHull::growFront(double maxCurvature)
       newFace.curvature = grad = deadFace;
     else
       newFace.curvature = circumcurvature(tetrahedra_[newFace.tetrahedron], newFace.triangle);
-    triangles_[newFace.triangle].surface_face_cached = newFace;
-    for (int j = 0; j < 3; j++) edges_[triangles_[newFace.triangle].edges[j]].has_had_face = true;
-    surface_.insert(newFace);
+    for (int j = 0; j < 3; j++) edge_has_had_face_[triangles_[newFace.triangle].edges[j]] = true;
+    addSurfaceFace(newFace);
   }
   return true;
 }
 
 void ConcaveHull::growSurface(double maxCurvature)
 {
+  int reported_count = -1;
   do
   {
-    if (!(newTriCount % 1600))
+    // report once per 1600 new triangles, rather than on every face that is rejected in between
+    if (!(newTriCount % 1600) && newTriCount != reported_count && !surface_.empty())
     {
-      std::cout << "max curvature of structure: " << surface_.begin()->curvature << std::endl;
-      std::vector<std::vector<Eigen::Vector3d>> tris;
-      for (auto &tri : surface_)
-      {
-        std::vector<Eigen::Vector3d> corners(3);
-        for (int i = 0; i < 3; i++) corners[i] = vertices_[triangles_[tri.triangle].vertices[i]];
-        tris.push_back(corners);
-      }
-      // if (DebugDraw *debug = DebugDraw::instance())
-      // {
-      //   debug->drawTriangles(tris, 0.5);
-      // }
+      std::cout << "max curvature of structure: " << surface_.top().curvature << std::endl;
+      reported_count = newTriCount;
     }
   } while (growFront(maxCurvature));
 }
 
 // starting with given tetrahedron, grow it outwards to achieve a maximum curvature
-void ConcaveHull::growOutwards(const ConcaveHull::Tetrahedron &tetra, double maxCurvature)
+void ConcaveHull::growOutwards(int tetrahedron, double maxCurvature)
 {
-  surface_.clear();
+  clearSurface();
+  const Tetrahedron &tetra = tetrahedra_[tetrahedron];
   for (int i = 0; i < 4; i++)
   {
     SurfaceFace face;
-    face.tetrahedron = tetra.neighbours[i];
+    face.tetrahedron = neighbour(tetrahedron, i);
     face.triangle = tetra.triangles[i];
     if (triangles_[face.triangle].is_surface)
       face.curvature = deadFace;
     else
       face.curvature = circumcurvature(tetrahedra_[face.tetrahedron], face.triangle);
-    triangles_[face.triangle].surface_face_cached = face;
-    surface_.insert(face);
+    addSurfaceFace(face);
   }
   growSurface(maxCurvature);
 }
@@ -364,11 +556,11 @@ void ConcaveHull::growOutwards(const ConcaveHull::Tetrahedron &tetra, double max
 void ConcaveHull::growOutwards(double maxCurvature)
 {
   bool found = false;
-  for (auto &tetra : tetrahedra_)
+  for (int t = 0; t < static_cast<int>(tetrahedra_.size()); t++)
   {
-    if (insideTetrahedron(centre_, tetra))
+    if (insideTetrahedron(centre_, tetrahedra_[t]))
     {
-      growOutwards(tetra, maxCurvature);
+      growOutwards(t, maxCurvature);
       found = true;
     }
   }
@@ -380,7 +572,7 @@ void ConcaveHull::growOutwards(double maxCurvature)
 // starting with the outer (convex) surface mesh, grow inwards up to the maxCurvature value
 void ConcaveHull::growInwards(double maxCurvature)
 {
-  surface_.clear();
+  clearSurface();
   // find the surface triangles...
   for (int i = 0; i < (int)triangles_.size(); i++)
   {
@@ -391,8 +583,7 @@ void ConcaveHull::growInwards(double maxCurvature)
       face.tetrahedron = tetrahedra_[tri.tetrahedra[0]].valid() ? tri.tetrahedra[0] : tri.tetrahedra[1];
       face.triangle = i;
       face.curvature = circumcurvature(tetrahedra_[face.tetrahedron], face.triangle);
-      triangles_[i].surface_face_cached = face;
-      surface_.insert(face);
+      addSurfaceFace(face);
     }
   }
   growSurface(maxCurvature);
@@ -401,7 +592,7 @@ void ConcaveHull::growInwards(double maxCurvature)
 
 void ConcaveHull::growInDirection(double maxCurvature, const Eigen::Vector3d &dir)
 {
-  surface_.clear();
+  clearSurface();
   // find the surface triangles...
   for (int i = 0; i < (int)triangles_.size(); i++)
   {
@@ -412,11 +603,12 @@ void ConcaveHull::growInDirection(double maxCurvature, const Eigen::Vector3d &di
       face.tetrahedron = tetrahedra_[tri.tetrahedra[0]].valid() ? tri.tetrahedra[0] : tri.tetrahedra[1];
       if (face.tetrahedron < 0)
         std::cout << "bad face tetrahedron" << std::endl;
+      const std::vector<Eigen::Vector3d> &vertices = mesh_.vertices();
       Eigen::Vector3d mid(0, 0, 0);
-      for (int j = 0; j < 4; j++) mid += vertices_[tetrahedra_[face.tetrahedron].vertices[j]] / 4.0;
-      Eigen::Vector3d normal = (vertices_[tri.vertices[2]] - vertices_[tri.vertices[0]])
-                                 .cross(vertices_[tri.vertices[1]] - vertices_[tri.vertices[0]]);
-      if ((mid - vertices_[tri.vertices[0]]).dot(normal) < 0.0)
+      for (int j = 0; j < 4; j++) mid += vertices[tetrahedra_[face.tetrahedron].vertices[j]] / 4.0;
+      Eigen::Vector3d normal = (vertices[tri.vertices[2]] - vertices[tri.vertices[0]])
+                                 .cross(vertices[tri.vertices[1]] - vertices[tri.vertices[0]]);
+      if ((mid - vertices[tri.vertices[0]]).dot(normal) < 0.0)
         normal = -normal;
       if (normal.dot(dir) < 0.0)  // downwards facing
         continue;
@@ -424,11 +616,10 @@ void ConcaveHull::growInDirection(double maxCurvature, const Eigen::Vector3d &di
       for (int j = 0; j < 3; j++)
       {
         vertex_on_surface_[tri.vertices[j]] = true;
-        edges_[tri.edges[j]].has_had_face = true;
+        edge_has_had_face_[tri.edges[j]] = true;
       }
       face.curvature = circumcurvature(tetrahedra_[face.tetrahedron], face.triangle);
-      triangles_[i].surface_face_cached = face;
-      surface_.insert(face);
+      addSurfaceFace(face);
     }
   }
   growSurface(maxCurvature);
@@ -437,9 +628,9 @@ void ConcaveHull::growInDirection(double maxCurvature, const Eigen::Vector3d &di
 
 void ConcaveHull::convertToMesh()
 {
-  mesh_.vertices() = vertices_;
+  const std::vector<Eigen::Vector3d> &vertices = mesh_.vertices();
   int num_bads = 0;
-  for (auto &face : surface_)
+  for (auto &face : surface_.sortedFaces())
   {
     Eigen::Vector3d centroid(0, 0, 0);
     ray::ConcaveHull::Tetrahedron &tetra = tetrahedra_[face.tetrahedron];
@@ -448,9 +639,9 @@ void ConcaveHull::convertToMesh()
       std::cout << "bad vertices in the surface" << std::endl;
     if (tetra.vertices[0] != -1)
     {
-      for (int i = 0; i < 4; i++) centroid += vertices_[tetra.vertices[i]] / 4.0;
+      for (int i = 0; i < 4; i++) centroid += vertices[tetra.vertices[i]] / 4.0;
       Eigen::Vector3d vs[3];
-      for (int i = 0; i < 3; i++) vs[i] = vertices_[tri_verts[i]];
+      for (int i = 0; i < 3; i++) vs[i] = vertices[tri_verts[i]];
       Eigen::Vector3d normal = (vs[2] - vs[0]).cross(vs[1] - vs[0]);
       if ((centroid - vs[0]).dot(normal) < 0.0)
         std::swap(tri_verts[1], tri_verts[2]);
@@ -6,18 +6,19 @@
 #ifndef RAYLIB_RAYCONCAVEHULL_H
 #define RAYLIB_RAYCONCAVEHULL_H
 
-#include <set>
 #include "raylib/raylibconfig.h"
 #include "raylib/raymesh.h"
 #include "rayutils.h"
 
-#if RAYLIB_WITH_QHULL
+#if RAYLIB_WITH_QHULL || RAYLIB_NATIVE_DELAUNAY
 namespace ray
 {
 /// Class for calculating concave hulls. This is a single, simply connected polyhedron with a maximum allowed
 /// concave curvature @c maxCurvature. It is a generalisation of a convex hull (@c maxCurvature=0) to any
 /// concave curvature. It is used like a vacuum wrapping of a ray cloud, particularly to extract ground terrain.
-/// It contains multiple methods for generating the hull, depending on which direction it should grow
+/// It contains multiple methods for generating the hull, depending on which direction it should grow.
+/// The hull is carved from the Delaunay tetrahedralisation of the points, which is Qhull's unless the library is
+/// built with NATIVE_DELAUNAY, to use @c DelaunayTetrahedralisation
 class RAYLIB_EXPORT ConcaveHull
 {
 public:
@@ -48,52 +49,39 @@ private:
     int triangle;
     double curvature;
   };
-  class Edge
-  {
-  public:
-    Edge() {}
-    Edge(int v1, int v2)
-    {
-      vertices[0] = v1;
-      vertices[1] = v2;
-      has_had_face = false;
-    }
-    int vertices[2];
-    bool has_had_face;
-  };
+  /// A triangle of the tetrahedralisation. The edge i runs from vertex i to vertex i + 1
   class Triangle
   {
   public:
     Triangle()
+      : vertices(-1, -1, -1)
+      , edges(-1, -1, -1)
+      , surface_handle(-1)
+      , is_surface(false)
+      , on_surface(false)
     {
-      vertices[0] = vertices[1] = vertices[2] = -1;
-      edges = Eigen::Vector3i(-1, -1, -1);
-      is_surface = false;
-      used = false;
+      tetrahedra[0] = tetrahedra[1] = -1;
     }
-    bool valid() { return vertices[0] != -1; }
-    bool is_surface;
-    bool used;
+    bool valid() const { return vertices[0] != -1; }
     Eigen::Vector3i vertices;
     Eigen::Vector3i edges;
     int tetrahedra[2];
-    SurfaceFace surface_face_cached;
+    int surface_handle;  // the entry of the triangle's latest face in the surface queue
+    bool is_surface;     // on the convex hull
+    bool on_surface;     // has been a face of the growing surface
   };
+  /// A tetrahedron, whose neighbour opposite vertex i is the other tetrahedron of its triangle i
   class Tetrahedron
   {
   public:
     Tetrahedron()
     {
       vertices[0] = vertices[1] = vertices[2] = vertices[3] = -1;
-      seen = false;
-      id = -1;
+      triangles[0] = triangles[1] = triangles[2] = triangles[3] = -1;
     }
-    bool valid() { return vertices[0] != -1; }
+    bool valid() const { return vertices[0] != -1; }
     int vertices[4];
     int triangles[4];
-    int neighbours[4];
-    int id;
-    bool seen;
   };
   class FaceComp
   {
@@ -109,37 +97,90 @@ private:
       return lhs.curvature < rhs.curvature;
     }
   };
+  /// An indexed binary heap of the surface faces, ordered by @c FaceComp . Each pushed face is given a handle, by which
+  /// it can be erased from anywhere in the heap in logarithmic time
+  class SurfaceQueue
+  {
+  public:
+    void clear();
+    inline bool empty() const { return heap_.empty(); }
+    /// the face that is least by @c FaceComp . The queue must not be empty
+    inline const SurfaceFace &top() const { return faces_[heap_[0]]; }
+    /// whether @c handle is still in the queue. Handles from before a @c clear() must not be used
+    inline bool contains(int handle) const
+    {
+      return handle >= 0 && handle < static_cast<int>(faces_.size()) && positions_[handle] != -1;
+    }
+    /// whether @c face is still in the queue at @c handle . Handles from before a @c clear() are not held
+    inline bool holds(int handle, const SurfaceFace &face) const
+    {
+      if (handle < 0 || handle >= static_cast<int>(faces_.size()) || positions_[handle] == -1)
+        return false;
+      const SurfaceFace &held = faces_[handle];
+      return held.triangle == face.triangle && held.tetrahedron == face.tetrahedron && held.curvature == face.curvature;
+    }
+    /// add @c face , returning its handle
+    int push(const SurfaceFace &face);
+    void pop() { erase(heap_[0]); }
+    void erase(int handle);
+    /// the faces in the queue, in @c FaceComp order
+    std::vector<SurfaceFace> sortedFaces() const;
+
+  private:
+    inline bool less(int handle1, int handle2) const { return FaceComp()(faces_[handle1], faces_[handle2]); }
+    void place(size_t position, int handle)
+    {
+      heap_[position] = handle;
+      positions_[handle] = static_cast<int>(position);
+    }
+    void siftUp(size_t position);
+    void siftDown(size_t position);
+
+    std::vector<SurfaceFace> faces_;  // indexed by handle
+    std::vector<int> positions_;      // the heap position of each handle, or -1 once removed
+    std::vector<int> heap_;           // handles
+  };
 
   inline bool insideTetrahedron(const Eigen::Vector3d &pos, const Tetrahedron &tetra)
   {
+    const std::vector<Eigen::Vector3d> &vertices = mesh_.vertices();
     Eigen::Vector3d mid(0, 0, 0);
     if (tetra.vertices[0] == -1 || tetra.vertices[1] == -1 || tetra.vertices[2] == -1 ||
         tetra.vertices[3] == -1)  // an outer tetrahedron
       return false;
-    for (int j = 0; j < 4; j++) mid += vertices_[tetra.vertices[j]] / 4.0;
+    for (int j = 0; j < 4; j++) mid += vertices[tetra.vertices[j]] / 4.0;
     for (int i = 0; i < 4; i++)
     {
       Eigen::Vector3d vs[3];
-      for (int j = 0; j < 3; j++) vs[j] = vertices_[triangles_[tetra.triangles[i]].vertices[j]];
+      for (int j = 0; j < 3; j++) vs[j] = vertices[triangles_[tetra.triangles[i]].vertices[j]];
       Eigen::Vector3d normal = (vs[1] - vs[0]).cross(vs[2] - vs[0]);
       if ((pos - vs[0]).dot(normal) * (mid - vs[0]).dot(normal) < 0)
         return false;
     }
     return true;
   }
+  /// the tetrahedron on the other side of triangle @c i of the tetrahedron at @c index
+  inline int neighbour(int index, int i) const
+  {
+    const Triangle &triangle = triangles_[tetrahedra_[index].triangles[i]];
+    return triangle.tetrahedra[0] == index ? triangle.tetrahedra[1] : triangle.tetrahedra[0];
+  }
+  void addSurfaceFace(const SurfaceFace &face);
   void growSurface(double maxCurvature);
   bool growFront(double maxCurvature);
   double circumcurvature(const ConcaveHull::Tetrahedron &tetra, int triangleID);
-  void growOutwards(const ConcaveHull::Tetrahedron &tetra, double maxCurvature);
+  void growOutwards(int tetrahedron, double maxCurvature);
+  void clearSurface();
+  void numberEdges();
   void convertToMesh();
 
+  // the points are held only as the mesh vertices
   std::vector<bool> vertex_on_surface_;
-  std::vector<Eigen::Vector3d> vertices_;
-  std::vector<Edge> edges_;
+  std::vector<bool> edge_has_had_face_;
   std::vector<Triangle> triangles_;
   std::vector<Tetrahedron> tetrahedra_;
   Eigen::Vector3d centre_;
-  std::set<SurfaceFace, FaceComp> surface_;
+  SurfaceQueue surface_;
   Mesh mesh_;
 };
 }  // namespace ray
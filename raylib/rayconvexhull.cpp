@@ -5,68 +5,34 @@
 // Author: Thomas Lowe
 #include "rayconvexhull.h"
 
-#if RAYLIB_WITH_QHULL
-
-#include <libqhullcpp/Qhull.h>
-#include <libqhullcpp/QhullFacet.h>
-#include <libqhullcpp/QhullFacetList.h>
-#include <libqhullcpp/QhullFacetSet.h>
-#include <libqhullcpp/QhullPointSet.h>
-#include <libqhullcpp/QhullPoints.h>
-#include <libqhullcpp/QhullRidge.h>
-#include <libqhullcpp/QhullVertexSet.h>
-
-#include <map>
+#include "rayquickhull.h"
 
 namespace ray
 {
-class lessThan
-{
-public:
-  bool operator()(const Eigen::Vector3d &v1, const Eigen::Vector3d &v2) const
-  {
-    return v1[0] + kPi * v1[1] + kPi * kPi * v1[2] < v2[0] + kPi * v2[1] + kPi * kPi * v2[2];
-  }
-};
-
 void ConvexHull::construct(const std::vector<Eigen::Vector3d> &points, const Eigen::Vector3d ignoreDirection)
 {
   if (points.size() < 3)  // two or fewer points generate an empty mesh
   {
     return;
   }
-  std::vector<double> coordinates(points.size() * 3);
-  for (int i = 0; i < (int)points.size(); i++)
+  QuickHull hull;
+  if (!hull.build(points))
   {
-    coordinates[3 * i + 0] = points[i][0];
-    coordinates[3 * i + 1] = points[i][1];
-    coordinates[3 * i + 2] = points[i][2];
+    std::cout << "points are coplanar, so have no hull" << std::endl;
+    return;
   }
 
-  orgQhull::Qhull hull;
-  hull.setOutputStream(&std::cout);
-  hull.runQhull("", 3, int(points.size()), coordinates.data(), "Qt");
-
-  orgQhull::QhullFacetList facets = hull.facetList();
-  std::cout << "number of triangles: " << facets.size() << std::endl;
-  mesh_.indexList().reserve(facets.size());
+  const std::vector<Eigen::Vector3i> &triangles = hull.triangles();
+  std::cout << "number of triangles: " << triangles.size() << std::endl;
+  mesh_.indexList().reserve(triangles.size());
   std::cout << "ignore direction: " << ignoreDirection.transpose() << std::endl;
   int count = 0;
-  for (const orgQhull::QhullFacet &f : facets)
+  for (size_t i = 0; i < triangles.size(); i++)
   {
-    double *c = f.hyperplane().coordinates();
-    Eigen::Vector3d coords(c[0], c[1], c[2]);
-    if (coords.dot(ignoreDirection) <= 0.0)
+    if (hull.normals()[i].dot(ignoreDirection) <= 0.0)
     {
       count++;
-      orgQhull::QhullVertexSet verts = f.vertices();
-      int i = 0;
-      Eigen::Vector3i index;
-      for (const orgQhull::QhullVertex &v : verts) index[i++] = v.point().id();
-      Eigen::Vector3d norm = (points[index[1]] - points[index[0]]).cross(points[index[2]] - points[index[0]]);
-      if (norm.dot(coords) < 0.0)
-        std::swap(index[1], index[2]);
-      mesh_.indexList().push_back(index);
+      mesh_.indexList().push_back(triangles[i]);
     }
   }
   std::cout << "num remaining triangles: " << count << std::endl;
@@ -119,4 +85,3 @@ void ConvexHull::growInDirection(double maxCurvature, const Eigen::Vector3d &dir
   construct(points, dir);
 }
 }  // namespace ray
-#endif
\ No newline at end of file
@@ -11,7 +11,6 @@
 #include <set>
 #include "raymesh.h"
 #include "rayutils.h"
-#if RAYLIB_WITH_QHULL
 
 namespace ray
 {
@@ -19,7 +18,7 @@ namespace ray
 /// It wraps a non-convex mesh onto a specified ray cloud by using a convec hull algorithm on a non-linear
 /// transformation of the cloud. The result is a non-convex 'vacuum wrapping' of the ray cloud that is computationally
 /// much faster than convex hull, but which does not support overhangs. Multiple wrap directions allow it to be used in
-/// a variety of situations.
+/// a variety of situations. The hull is raylib's own parallel @c QuickHull , so Qhull is not needed.
 class RAYLIB_EXPORT ConvexHull
 {
 public:
@@ -46,6 +45,5 @@ private:
   void construct(const std::vector<Eigen::Vector3d> &points, const Eigen::Vector3d ignoreDirection);
 };
 }  // namespace ray
-#endif
 
 #endif  // RAYLIB_RAYCONVEXHULL_H
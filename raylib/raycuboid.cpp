@@ -6,6 +6,34 @@
 #include "raycuboid.h"
 namespace ray
 {
+namespace
+{
+using Packet = Eigen::Array<double, CuboidBatch::kPacketSize, 1>;
+
+/// The slab test of @c Cuboid::clipRay on a packet of rays and a packet of cuboids at once, step for step, so that
+/// the @c near and @c far fractions along each ray are the same as for a single ray
+inline void clipPacket(const Packet min_bound[3], const Packet max_bound[3], const Packet start[3],
+                       const Packet end[3], Packet &near, Packet &far)
+{
+  near = Packet::Zero();
+  far = Packet::Ones();
+  for (int ax = 0; ax < 3; ax++)
+  {
+    const Packet centre = (min_bound[ax] + max_bound[ax]) / 2.0;
+    const Packet extent = (max_bound[ax] - min_bound[ax]) / 2.0;
+    const Packet to_centre = centre - start[ax];
+    const Packet dir = end[ax] - start[ax];
+    const Packet s = (dir > 0.0).select(Packet::Ones(), -Packet::Ones());
+    const Packet near_d = (to_centre - s * extent) / dir;
+    const Packet far_d = (to_centre + s * extent) / dir;
+    // axes that the ray does not move along leave the range unchanged
+    const auto moving = dir != 0.0;
+    near = moving.select(near.max(near_d), near);
+    far = moving.select(far.min(far_d), far);
+  }
+}
+}  // namespace
+
 Cuboid::Cuboid(const Eigen::Vector3d &min_bound, const Eigen::Vector3d &max_bound)
 {
   min_bound_ = min_bound;
@@ -39,6 +67,40 @@ bool Cuboid::clipRay(Eigen::Vector3d &start, Eigen::Vector3d &end) const
   return true;
 }
 
+void Cuboid::clipRays(const Eigen::Vector3d *starts, const Eigen::Vector3d *ends, size_t count, double *near,
+                      double *far) const
+{
+  Packet min_bound[3], max_bound[3];
+  for (int ax = 0; ax < 3; ax++)
+  {
+    min_bound[ax] = Packet::Constant(min_bound_[ax]);
+    max_bound[ax] = Packet::Constant(max_bound_[ax]);
+  }
+  for (size_t first = 0; first < count; first += CuboidBatch::kPacketSize)
+  {
+    // the rays are gathered into a packet per axis. Zero padding gives zero length rays, whose results are not returned
+    const size_t num = std::min(count - first, static_cast<size_t>(CuboidBatch::kPacketSize));
+    Packet start[3], end[3];
+    for (int ax = 0; ax < 3; ax++)
+    {
+      start[ax].setZero();
+      end[ax].setZero();
+      for (size_t i = 0; i < num; i++)
+      {
+        start[ax][i] = starts[first + i][ax];
+        end[ax][i] = ends[first + i][ax];
+      }
+    }
+    Packet near_d, far_d;
+    clipPacket(min_bound, max_bound, start, end, near_d, far_d);
+    for (size_t i = 0; i < num; i++)
+    {
+      near[first + i] = near_d[i];
+      far[first + i] = far_d[i];
+    }
+  }
+}
+
 bool Cuboid::intersectsRay(const Eigen::Vector3d &start, const Eigen::Vector3d &dir, double &depth,
                            bool positive_box) const
 {
@@ -71,4 +133,80 @@ bool Cuboid::intersects(const Eigen::Vector3d &pos) const
          pos[1] <= max_bound_[1] && pos[2] <= max_bound_[2];
 }
 
+void CuboidBatch::clear()
+{
+  for (int ax = 0; ax < 3; ax++)
+  {
+    min_bounds_[ax].clear();
+    max_bounds_[ax].clear();
+  }
+  size_ = 0;
+}
+
+void CuboidBatch::add(const Cuboid &cuboid)
+{
+  if (size_ % kPacketSize == 0)
+  {
+    // zero padding gives empty cuboids, whose results are not returned
+    for (int ax = 0; ax < 3; ax++)
+    {
+      min_bounds_[ax].resize(size_ + kPacketSize, 0.0);
+      max_bounds_[ax].resize(size_ + kPacketSize, 0.0);
+    }
+  }
+  for (int ax = 0; ax < 3; ax++)
+  {
+    min_bounds_[ax][size_] = cuboid.min_bound_[ax];
+    max_bounds_[ax][size_] = cuboid.max_bound_[ax];
+  }
+  size_++;
+}
+
+void CuboidBatch::clipRay(const Eigen::Vector3d &start, const Eigen::Vector3d &end, std::vector<double> &near,
+                          std::vector<double> &far) const
+{
+  using PacketMap = Eigen::Map<const Packet>;
+  near.resize(size_);
+  far.resize(size_);
+  Packet ray_start[3], ray_end[3];
+  for (int ax = 0; ax < 3; ax++)
+  {
+    ray_start[ax] = Packet::Constant(start[ax]);
+    ray_end[ax] = Packet::Constant(end[ax]);
+  }
+  for (size_t first = 0; first < size_; first += kPacketSize)
+  {
+    const Packet min_bound[3] = { PacketMap(&min_bounds_[0][first]), PacketMap(&min_bounds_[1][first]),
+                                  PacketMap(&min_bounds_[2][first]) };
+    const Packet max_bound[3] = { PacketMap(&max_bounds_[0][first]), PacketMap(&max_bounds_[1][first]),
+                                  PacketMap(&max_bounds_[2][first]) };
+    Packet near_d, far_d;
+    clipPacket(min_bound, max_bound, ray_start, ray_end, near_d, far_d);
+    const size_t num = std::min(size_ - first, static_cast<size_t>(kPacketSize));
+    for (size_t i = 0; i < num; i++)
+    {
+      near[first + i] = near_d[i];
+      far[first + i] = far_d[i];
+    }
+  }
+}
+
+void CuboidBatch::intersects(const Eigen::Vector3d &pos, std::vector<char> &inside) const
+{
+  using PacketMap = Eigen::Map<const Packet>;
+  inside.resize(size_);
+  for (size_t first = 0; first < size_; first += kPacketSize)
+  {
+    auto in = (PacketMap(&min_bounds_[0][first]) <= pos[0]) && (PacketMap(&min_bounds_[1][first]) <= pos[1]) &&
+              (PacketMap(&min_bounds_[2][first]) <= pos[2]) && (PacketMap(&max_bounds_[0][first]) >= pos[0]) &&
+              (PacketMap(&max_bounds_[1][first]) >= pos[1]) && (PacketMap(&max_bounds_[2][first]) >= pos[2]);
+    const Eigen::Array<char, kPacketSize, 1> result = in.cast<char>();
+    const size_t num = std::min(size_ - first, static_cast<size_t>(kPacketSize));
+    for (size_t i = 0; i < num; i++)
+    {
+      inside[first + i] = result[i];
+    }
+  }
+}
+
 }  // namespace ray
\ No newline at end of file
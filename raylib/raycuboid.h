@@ -9,6 +9,8 @@
 #include "raylib/raylibconfig.h"
 #include "rayutils.h"
 
+#include <vector>
+
 namespace ray
 {
 /// Class for intersection tests on axis-aligned cuboids. These are closed intervals, their boundary is
@@ -39,8 +41,57 @@ public:
   /// clip ray to cuboid. Return false if no ray left.
   bool clipRay(Eigen::Vector3d &start, Eigen::Vector3d &end) const;
 
+  /// The batched form of @c clipRay , for the @c count rays from @c starts to @c ends . A packet of
+  /// @c CuboidBatch::kPacketSize rays is slab tested at once. Each ray's clipped start and end are returned as the
+  /// fractions @c near and @c far along it, and the ray intersects the cuboid when near < far. These are the fractions
+  /// that @c clipRay computes, so @c clipToRange gives the same clipped ray.
+  void clipRays(const Eigen::Vector3d *starts, const Eigen::Vector3d *ends, size_t count, double *near,
+                double *far) const;
+  /// Clip the ray from @c start to @c end to the fractions @c near to @c far along it, as found by @c clipRays .
+  /// Returns false, leaving the ray unchanged, if there is no ray left.
+  static inline bool clipToRange(double near, double far, Eigen::Vector3d &start, Eigen::Vector3d &end)
+  {
+    if (far <= near)
+    {
+      return false;
+    }
+    const Eigen::Vector3d dir = end - start;
+    start += dir * near;
+    end -= dir * (1.0 - far);
+    return true;
+  }
+
   Eigen::Vector3d min_bound_, max_bound_;
 };
+
+/// A batch of cuboids to test one ray or point against, such as the candidate cells of a ray in a grid, in
+/// structure-of-arrays form. The arrays are padded to whole packets of @c kPacketSize cuboids, which are tested at
+/// once, and the results match those of the @c Cuboid functions on each cuboid.
+class RAYLIB_EXPORT CuboidBatch
+{
+public:
+  /// cuboids per packet. 8 doubles are two AVX registers, or four NEON registers
+  static const int kPacketSize = 8;
+
+  /// remove all of the cuboids, keeping the memory
+  void clear();
+  /// add @c cuboid to the batch
+  void add(const Cuboid &cuboid);
+  /// the number of cuboids added since @c clear()
+  inline size_t size() const { return size_; }
+
+  /// As @c Cuboid::clipRays for the ray from @c start to @c end against each cuboid. @c near and @c far are resized to
+  /// the number of cuboids.
+  void clipRay(const Eigen::Vector3d &start, const Eigen::Vector3d &end, std::vector<double> &near,
+               std::vector<double> &far) const;
+  /// As @c Cuboid::intersects of @c pos for each cuboid. @c inside is resized to the number of cuboids.
+  void intersects(const Eigen::Vector3d &pos, std::vector<char> &inside) const;
+
+private:
+  std::vector<double> min_bounds_[3];  // per axis
+  std::vector<double> max_bounds_[3];  // per axis
+  size_t size_ = 0;
+};
 }  // namespace ray
 
 #endif  // RAYLIB_RAYCUBOID_H
@@ -16,6 +16,11 @@ namespace ray
 {
 struct DebugDrawDetail;
 
+/// Debug visualisation through 3rd Eye Scene or ROS rviz, depending on the build options, or none.
+/// The draw calls copy their geometry into a bounded queue, which a background thread sends to the visualiser, so
+/// that visualising doesn't slow the algorithm that draws. Point clouds and lines are subsampled to at most
+/// @c kDebugDrawMaxPoints per call, a newer draw of the same kind and id replaces one that is still queued, and draws
+/// that don't fit in the queue are dropped rather than waited on.
 class RAYLIB_EXPORT DebugDraw
 {
 public:
@@ -59,6 +64,9 @@ public:
   void drawEllipsoids(const std::vector<Eigen::Vector3d> &centres, const std::vector<Eigen::Matrix3d> &poses,
                       const std::vector<Eigen::Vector3d> &radii, const Eigen::Vector3d &colour, int id);
 
+  /// wait until the queued draws have been sent, e.g. before pausing to inspect them
+  void flush();
+
 private:
   std::unique_ptr<DebugDrawDetail> imp_;
   static std::unique_ptr<DebugDraw> s_instance;
@@ -7,6 +7,7 @@
 
 #if RAYLIB_WITH_3ES
 
+#include "raydebugdrawqueue.h"
 #include "rayunused.h"
 
 #include <3esconnectionmonitor.h>
@@ -23,6 +24,7 @@ struct DebugDrawDetail
 {
   tes::Server *server = nullptr;
   std::string fixed_frame_id;
+  DebugDrawQueue queue;  // the server is only used by the queue's thread, once constructed
 };
 }  // namespace ray
 
@@ -39,6 +41,15 @@ void updateTes(tes::Server &server)
   }
   connections->commitConnections();
 }
+
+/// the kinds of draw, which along with the draw's id determine which queued draws a new one replaces
+enum DrawKind
+{
+  kDrawCloud,
+  kDrawLines,
+  kDrawCylinders,
+  kDrawEllipsoids
+};
 }  // namespace
 
 std::unique_ptr<DebugDraw> DebugDraw::s_instance;
@@ -66,6 +77,7 @@ DebugDraw::DebugDraw(const std::string &fixed_frame_id)
 
 DebugDraw::~DebugDraw()
 {
+  imp_->queue.stop();
   if (imp_->server)
   {
     imp_->server->dispose();
@@ -92,16 +104,10 @@ DebugDraw *DebugDraw::instance()
   return s_instance.get();
 }
 
-void DebugDraw::drawCloud(const std::vector<Eigen::Vector3d> &points, const std::vector<double> &point_shade, int id)
+namespace
+{
+void sendCloud(tes::Server &server, const std::vector<Eigen::Vector3d> &points, int id)
 {
-  if (points.empty())
-  {
-    return;
-  }
-
-  // TODO: (KS) use point_shade to apply colour.
-  RAYLIB_UNUSED(point_shade);
-
   std::vector<float> points_single(points.size() * 3);
   tes::Vector3d reference_vertex(points[0].x(), points[0].y(), points[0].z());
 
@@ -119,20 +125,14 @@ void DebugDraw::drawCloud(const std::vector<Eigen::Vector3d> &points, const std:
   // Replace any existing shape with the same ID.
   points_shape.setFlags(points_shape.flags() | tes::OFReplace);
   // Send the shape.
-  imp_->server->create(points_shape);
+  server.create(points_shape);
 
   // Send update.
-  updateTes(*imp_->server);
+  updateTes(server);
 }
 
-void DebugDraw::drawLines(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
-                          const std::vector<Eigen::Vector3d> &colours)
+void sendLines(tes::Server &server, const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends)
 {
-  if (starts.empty())
-  {
-    return;
-  }
-
   // Convert to sinle precision.
   tes::Vector3d reference_vertex(starts[0].x(), starts[0].y(), starts[0].z());
   std::vector<float> vertices(starts.size() * 2 * 3);
@@ -156,20 +156,15 @@ void DebugDraw::drawLines(const std::vector<Eigen::Vector3d> &starts, const std:
   // Replace any existing shape with the same ID.
   lines_shape.setFlags(lines_shape.flags() | tes::OFReplace);
   // Send the shape.
-  imp_->server->create(lines_shape);
+  server.create(lines_shape);
 
   // Send update.
-  updateTes(*imp_->server);
+  updateTes(server);
 }
 
-void DebugDraw::drawCylinders(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
-                              const std::vector<double> &radii, int id)
+void sendCylinders(tes::Server &server, const std::vector<Eigen::Vector3d> &starts,
+                   const std::vector<Eigen::Vector3d> &ends, const std::vector<double> &radii, int id)
 {
-  if (starts.empty())
-  {
-    return;
-  }
-
   // TODO: (KS) handle requests for drawing more than tes::MultiShape::ShapeCountLimit items.
   tes::Vector3d reference_pos(starts[0].x(), starts[0].y(), starts[0].z());
   std::vector<tes::Cylinder> cylinders(starts.size());
@@ -195,20 +190,16 @@ void DebugDraw::drawCylinders(const std::vector<Eigen::Vector3d> &starts, const
   // Replace any existing shape with the same ID.
   cylinders_multi_shape.setFlags(cylinders_multi_shape.flags() | tes::OFReplace);
   // Send the shape.
-  imp_->server->create(cylinders_multi_shape);
+  server.create(cylinders_multi_shape);
 
   // Send update.
-  updateTes(*imp_->server);
+  updateTes(server);
 }
 
-void DebugDraw::drawEllipsoids(const std::vector<Eigen::Vector3d> &centres, const std::vector<Eigen::Matrix3d> &poses,
-                               const std::vector<Eigen::Vector3d> &radii, const Eigen::Vector3d &colour, int id)
+void sendEllipsoids(tes::Server &server, const std::vector<Eigen::Vector3d> &centres,
+                    const std::vector<Eigen::Matrix3d> &poses, const std::vector<Eigen::Vector3d> &radii,
+                    const Eigen::Vector3d &colour, int id)
 {
-  if (centres.empty())
-  {
-    return;
-  }
-
   // TODO: (KS) handle requests for drawing more than tes::MultiShape::ShapeCountLimit items.
   std::vector<tes::Sphere> elliptoids(centres.size());
   std::vector<tes::Shape *> shape_ptrs(centres.size());
@@ -235,10 +226,84 @@ void DebugDraw::drawEllipsoids(const std::vector<Eigen::Vector3d> &centres, cons
   // Replace any existing shape with the same ID.
   elliptoids_multi_shape.setFlags(elliptoids_multi_shape.flags() | tes::OFReplace);
   // Send the shape.
-  imp_->server->create(elliptoids_multi_shape);
+  server.create(elliptoids_multi_shape);
 
   // Send update.
-  updateTes(*imp_->server);
+  updateTes(server);
+}
+
+}  // namespace
+
+void DebugDraw::drawCloud(const std::vector<Eigen::Vector3d> &points, const std::vector<double> &point_shade, int id)
+{
+  if (points.empty())
+  {
+    return;
+  }
+
+  // TODO: (KS) use point_shade to apply colour.
+  RAYLIB_UNUSED(point_shade);
+
+  // large clouds are subsampled on the calling thread, so that only what is drawn is copied
+  std::vector<Eigen::Vector3d> drawn = subsampleForDrawing(points);
+  const size_t bytes = drawn.size() * sizeof(Eigen::Vector3d);
+  tes::Server *server = imp_->server;
+  imp_->queue.push(kDrawCloud, id, bytes,
+                   [server, drawn = std::move(drawn), id]() { sendCloud(*server, drawn, id); });
+}
+
+void DebugDraw::drawLines(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+                          const std::vector<Eigen::Vector3d> &colours)
+{
+  if (starts.empty())
+  {
+    return;
+  }
+  RAYLIB_UNUSED(colours);
+
+  std::vector<Eigen::Vector3d> drawn_starts = subsampleForDrawing(starts);
+  std::vector<Eigen::Vector3d> drawn_ends = subsampleForDrawing(ends);
+  const size_t bytes = 2 * drawn_starts.size() * sizeof(Eigen::Vector3d);
+  tes::Server *server = imp_->server;
+  imp_->queue.push(kDrawLines, 0, bytes,
+                   [server, drawn_starts = std::move(drawn_starts), drawn_ends = std::move(drawn_ends)]() {
+                     sendLines(*server, drawn_starts, drawn_ends);
+                   });
+}
+
+void DebugDraw::drawCylinders(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+                              const std::vector<double> &radii, int id, const std::vector<Eigen::Vector4d> &colours)
+{
+  if (starts.empty())
+  {
+    return;
+  }
+  RAYLIB_UNUSED(colours);
+
+  const size_t bytes = starts.size() * (2 * sizeof(Eigen::Vector3d) + sizeof(double));
+  tes::Server *server = imp_->server;
+  imp_->queue.push(kDrawCylinders, id, bytes,
+                   [server, starts, ends, radii, id]() { sendCylinders(*server, starts, ends, radii, id); });
+}
+
+void DebugDraw::drawEllipsoids(const std::vector<Eigen::Vector3d> &centres, const std::vector<Eigen::Matrix3d> &poses,
+                               const std::vector<Eigen::Vector3d> &radii, const Eigen::Vector3d &colour, int id)
+{
+  if (centres.empty())
+  {
+    return;
+  }
+
+  const size_t bytes = centres.size() * (2 * sizeof(Eigen::Vector3d) + sizeof(Eigen::Matrix3d));
+  tes::Server *server = imp_->server;
+  imp_->queue.push(kDrawEllipsoids, id, bytes, [server, centres, poses, radii, colour, id]() {
+    sendEllipsoids(*server, centres, poses, radii, colour, id);
+  });
+}
+
+void DebugDraw::flush()
+{
+  imp_->queue.flush();
 }
 
 #endif  // RAYLIB_WITH_3ES
@@ -73,4 +73,6 @@ void DebugDraw::drawEllipsoids(const std::vector<Eigen::Vector3d> &centres, cons
   RAYLIB_UNUSED(id);
 }
 
+void DebugDraw::flush() {}
+
 }  // namespace ray
@@ -2,6 +2,8 @@
 
 #if RAYLIB_WITH_ROS
 
+#include "raydebugdrawqueue.h"
+
 #include <ros/ros.h>
 #include <sensor_msgs/PointCloud2.h>
 #include <visualization_msgs/MarkerArray.h>
@@ -21,6 +23,7 @@ struct DebugDrawDetail
   ros::Publisher cylinders_publisher;
   ros::Publisher ring_publisher;
   std::string fixed_frame_id;
+  DebugDrawQueue queue;  // last, so that it is stopped before the publishers are destroyed
 };
 }  // namespace ray
 
@@ -66,6 +69,18 @@ DebugDraw *DebugDraw::instance()
   return s_instance.get();
 }
 
+namespace
+{
+/// the kinds of draw, which along with the draw's id determine which queued draws a new one replaces
+enum DrawKind
+{
+  kDrawCloud,
+  kDrawLines,
+  kDrawCylinders,
+  kDrawEllipsoids
+};
+}  // namespace
+
 void setField2(sensor_msgs::PointField &field, const std::string &name, int offset, uint8_t type, int count)
 {
   field.name = name;
@@ -74,10 +89,13 @@ void setField2(sensor_msgs::PointField &field, const std::string &name, int offs
   field.count = count;
 }
 
-void DebugDraw::drawCloud(const std::vector<Eigen::Vector3d> &points, const std::vector<double> &point_shade, int id)
+namespace
+{
+void sendCloud(DebugDrawDetail &detail, const std::vector<Eigen::Vector3d> &points,
+               const std::vector<double> &point_shade, int id)
 {
   sensor_msgs::PointCloud2 point_cloud;
-  point_cloud.header.frame_id = imp_->fixed_frame_id;
+  point_cloud.header.frame_id = detail.fixed_frame_id;
   point_cloud.header.stamp = ros::Time();
   unsigned int point_step = 0;
 
@@ -132,15 +150,15 @@ void DebugDraw::drawCloud(const std::vector<Eigen::Vector3d> &points, const std:
 
   if (point_cloud.width > 0)
   {
-    imp_->cloud_publisher[id].publish(point_cloud);
+    detail.cloud_publisher[id].publish(point_cloud);
   }
 }
 
-void DebugDraw::drawLines(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
-                          const std::vector<Eigen::Vector3d> &colours)
+void sendLines(DebugDrawDetail &detail, const std::vector<Eigen::Vector3d> &starts,
+               const std::vector<Eigen::Vector3d> &ends, const std::vector<Eigen::Vector3d> &colours)
 {
   visualization_msgs::Marker points;
-  points.header.frame_id = imp_->fixed_frame_id;
+  points.header.frame_id = detail.fixed_frame_id;
   points.header.stamp = ros::Time::now();
   points.ns = "lines";
   points.action = visualization_msgs::Marker::ADD;
@@ -195,17 +213,18 @@ void DebugDraw::drawLines(const std::vector<Eigen::Vector3d> &starts, const std:
   }
 
   // Publish the marker
-  imp_->line_publisher.publish(points);
+  detail.line_publisher.publish(points);
 }
 
-void DebugDraw::drawCylinders(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
-                              const std::vector<double> &radii, int id, const std::vector<Eigen::Vector4d> &colours)
+void sendCylinders(DebugDrawDetail &detail, const std::vector<Eigen::Vector3d> &starts,
+                   const std::vector<Eigen::Vector3d> &ends, const std::vector<double> &radii, int id,
+                   const std::vector<Eigen::Vector4d> &colours)
 {
   visualization_msgs::MarkerArray marker_array;
   for (int i = 0; i < (int)starts.size(); i++)
   {
     visualization_msgs::Marker marker;
-    marker.header.frame_id = imp_->fixed_frame_id;
+    marker.header.frame_id = detail.fixed_frame_id;
     marker.id = i;
     marker.type = marker.CYLINDER;
     marker.action = marker.ADD;
@@ -247,17 +266,18 @@ void DebugDraw::drawCylinders(const std::vector<Eigen::Vector3d> &starts, const
 
     marker_array.markers.push_back(marker);
   }
-  imp_->cylinder_publisher[id].publish(marker_array);
+  detail.cylinder_publisher[id].publish(marker_array);
 }
 
-void DebugDraw::drawEllipsoids(const std::vector<Eigen::Vector3d> &centres, const std::vector<Eigen::Matrix3d> &poses,
-                               const std::vector<Eigen::Vector3d> &radii, const Eigen::Vector3d &colour, int id)
+void sendEllipsoids(DebugDrawDetail &detail, const std::vector<Eigen::Vector3d> &centres,
+                    const std::vector<Eigen::Matrix3d> &poses, const std::vector<Eigen::Vector3d> &radii,
+                    const Eigen::Vector3d &colour, int id)
 {
   visualization_msgs::MarkerArray marker_array;
   for (int i = 0; i < (int)centres.size(); i++)
   {
     visualization_msgs::Marker marker;
-    marker.header.frame_id = imp_->fixed_frame_id;
+    marker.header.frame_id = detail.fixed_frame_id;
     marker.id = i;
     marker.type = marker.SPHERE;
     marker.action = marker.ADD;
@@ -286,7 +306,63 @@ void DebugDraw::drawEllipsoids(const std::vector<Eigen::Vector3d> &centres, cons
     marker_array.markers.push_back(marker);
   }
 
-  imp_->ellipsoid_publisher[id].publish(marker_array);
+  detail.ellipsoid_publisher[id].publish(marker_array);
+}
+
+}  // namespace
+
+void DebugDraw::drawCloud(const std::vector<Eigen::Vector3d> &points, const std::vector<double> &point_shade, int id)
+{
+  // large clouds are subsampled on the calling thread, so that only what is drawn is copied
+  std::vector<Eigen::Vector3d> drawn = subsampleForDrawing(points);
+  std::vector<double> drawn_shade = subsampleForDrawing(point_shade);
+  const size_t bytes = drawn.size() * (sizeof(Eigen::Vector3d) + sizeof(double));
+  DebugDrawDetail *detail = imp_.get();
+  imp_->queue.push(kDrawCloud, id, bytes,
+                   [detail, drawn = std::move(drawn), drawn_shade = std::move(drawn_shade), id]() {
+                     sendCloud(*detail, drawn, drawn_shade, id);
+                   });
+}
+
+void DebugDraw::drawLines(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+                          const std::vector<Eigen::Vector3d> &colours)
+{
+  std::vector<Eigen::Vector3d> drawn_starts = subsampleForDrawing(starts);
+  std::vector<Eigen::Vector3d> drawn_ends = subsampleForDrawing(ends);
+  std::vector<Eigen::Vector3d> drawn_colours = subsampleForDrawing(colours);
+  const size_t bytes = (drawn_starts.size() * 2 + drawn_colours.size()) * sizeof(Eigen::Vector3d);
+  DebugDrawDetail *detail = imp_.get();
+  imp_->queue.push(kDrawLines, 0, bytes,
+                   [detail, drawn_starts = std::move(drawn_starts), drawn_ends = std::move(drawn_ends),
+                    drawn_colours = std::move(drawn_colours)]() {
+                     sendLines(*detail, drawn_starts, drawn_ends, drawn_colours);
+                   });
+}
+
+void DebugDraw::drawCylinders(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+                              const std::vector<double> &radii, int id, const std::vector<Eigen::Vector4d> &colours)
+{
+  const size_t bytes = starts.size() * (2 * sizeof(Eigen::Vector3d) + sizeof(double)) +
+                       colours.size() * sizeof(Eigen::Vector4d);
+  DebugDrawDetail *detail = imp_.get();
+  imp_->queue.push(kDrawCylinders, id, bytes, [detail, starts, ends, radii, id, colours]() {
+    sendCylinders(*detail, starts, ends, radii, id, colours);
+  });
+}
+
+void DebugDraw::drawEllipsoids(const std::vector<Eigen::Vector3d> &centres, const std::vector<Eigen::Matrix3d> &poses,
+                               const std::vector<Eigen::Vector3d> &radii, const Eigen::Vector3d &colour, int id)
+{
+  const size_t bytes = centres.size() * (2 * sizeof(Eigen::Vector3d) + sizeof(Eigen::Matrix3d));
+  DebugDrawDetail *detail = imp_.get();
+  imp_->queue.push(kDrawEllipsoids, id, bytes, [detail, centres, poses, radii, colour, id]() {
+    sendEllipsoids(*detail, centres, poses, radii, colour, id);
+  });
+}
+
+void DebugDraw::flush()
+{
+  imp_->queue.flush();
 }
 
 #endif  // RAYLIB_WITH_ROS
@@ -0,0 +1,110 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raydebugdrawqueue.h"
+
+namespace ray
+{
+const size_t DebugDrawQueue::default_max_bytes;
+
+DebugDrawQueue::DebugDrawQueue(size_t max_bytes)
+  : max_bytes_(max_bytes)
+  , queued_bytes_(0)
+  , num_dropped_(0)
+  , sending_(false)
+  , stopping_(false)
+  , thread_(&DebugDrawQueue::run, this)
+{}
+
+DebugDrawQueue::~DebugDrawQueue()
+{
+  stop();
+}
+
+bool DebugDrawQueue::push(int kind, int id, size_t bytes, std::function<void()> draw)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_)
+    {
+      num_dropped_++;
+      return false;
+    }
+    for (auto &queued : draws_)
+    {
+      if (queued.kind == kind && queued.id == id)
+      {
+        // the unsent draw would be replaced in the visualiser, so replace it here, keeping its place in the order
+        num_dropped_++;
+        queued_bytes_ = queued_bytes_ - queued.bytes + bytes;
+        queued.bytes = bytes;
+        queued.draw = std::move(draw);
+        return true;
+      }
+    }
+    // a draw larger than the whole bound is still sent when the queue is empty, otherwise it would never be drawn
+    if (!draws_.empty() && queued_bytes_ + bytes > max_bytes_)
+    {
+      num_dropped_++;
+      return false;
+    }
+    draws_.push_back({ kind, id, bytes, std::move(draw) });
+    queued_bytes_ += bytes;
+  }
+  queued_.notify_one();
+  return true;
+}
+
+void DebugDrawQueue::flush()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  sent_.wait(lock, [this] { return draws_.empty() && !sending_; });
+}
+
+void DebugDrawQueue::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  queued_.notify_one();
+  if (thread_.joinable())
+  {
+    thread_.join();
+  }
+}
+
+size_t DebugDrawQueue::numDropped() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_dropped_;
+}
+
+void DebugDrawQueue::run()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true)
+  {
+    queued_.wait(lock, [this] { return !draws_.empty() || stopping_; });
+    if (draws_.empty())
+    {
+      break;  // stopping, with everything sent
+    }
+    Draw draw = std::move(draws_.front());
+    draws_.pop_front();
+    queued_bytes_ -= draw.bytes;
+    sending_ = true;
+    lock.unlock();
+    draw.draw();
+    lock.lock();
+    sending_ = false;
+    if (draws_.empty())
+    {
+      sent_.notify_all();
+    }
+  }
+  sent_.notify_all();
+}
+}  // namespace ray
@@ -0,0 +1,89 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYDEBUGDRAWQUEUE_H
+#define RAYLIB_RAYDEBUGDRAWQUEUE_H
+
+#include "raylib/raylibconfig.h"
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ray
+{
+/// The most points (or lines) that a debug draw call sends, larger sets are subsampled to this
+const size_t kDebugDrawMaxPoints = 1000000;
+
+/// A queue of debug draws, which are sent in order by a background thread so that the algorithm being visualised
+/// doesn't wait on the visualiser. Each draw replaces any unsent draw of the same kind and id, as the newer one would
+/// replace it in the visualiser anyway. The queue is bounded in bytes: a draw that doesn't fit is dropped rather than
+/// stalling the caller.
+class RAYLIB_EXPORT DebugDrawQueue
+{
+public:
+  /// the default bound on the bytes of the queued draws
+  static const size_t default_max_bytes = 256 << 20;
+
+  DebugDrawQueue(size_t max_bytes = default_max_bytes);
+  /// Destructor calling @c stop()
+  ~DebugDrawQueue();
+  DebugDrawQueue(const DebugDrawQueue &) = delete;
+  DebugDrawQueue &operator=(const DebugDrawQueue &) = delete;
+
+  /// queue the function @c draw , which holds @c bytes of geometry, to be called on the background thread. Returns
+  /// false if it is dropped, as the queue is full or stopped.
+  bool push(int kind, int id, size_t bytes, std::function<void()> draw);
+  /// wait until the queued draws have been sent
+  void flush();
+  /// send the queued draws, then end the background thread. Further draws are dropped.
+  void stop();
+  /// the number of draws dropped or replaced before being sent
+  size_t numDropped() const;
+
+private:
+  struct Draw
+  {
+    int kind;
+    int id;
+    size_t bytes;
+    std::function<void()> draw;
+  };
+  void run();
+
+  std::deque<Draw> draws_;
+  size_t max_bytes_;
+  size_t queued_bytes_;
+  size_t num_dropped_;
+  bool sending_;
+  bool stopping_;
+  mutable std::mutex mutex_;
+  std::condition_variable queued_;  // wakes the sender on a new draw or on stop
+  std::condition_variable sent_;    // wakes @c flush() once the queue is empty
+  std::thread thread_;
+};
+
+/// every nth of @c values , so that at most @c max_count are kept. The stride depends only on the number of values,
+/// so parallel arrays (e.g. points and their shades) are subsampled alike.
+template <class T>
+std::vector<T> subsampleForDrawing(const std::vector<T> &values, size_t max_count = kDebugDrawMaxPoints)
+{
+  if (values.size() <= max_count || max_count == 0)
+  {
+    return values;
+  }
+  const size_t stride = (values.size() + max_count - 1) / max_count;
+  std::vector<T> subsampled;
+  subsampled.reserve(values.size() / stride + 1);
+  for (size_t i = 0; i < values.size(); i += stride) subsampled.push_back(values[i]);
+  return subsampled;
+}
+}  // namespace ray
+
+#endif  // RAYLIB_RAYDEBUGDRAWQUEUE_H
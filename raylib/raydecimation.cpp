@@ -0,0 +1,212 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raydecimation.h"
+#include "raycloud.h"
+#include "raycloudwriter.h"
+#include "rayprofile.h"
+#include "raythreads.h"
+#include "rayvoxelset.h"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+
+#if RAYLIB_WITH_TBB
+#include <tbb/parallel_sort.h>
+#endif  // RAYLIB_WITH_TBB
+
+namespace ray
+{
+namespace
+{
+/// the buckets are sized to hold about this many rays each, on average
+const size_t kBucketRays = 1 << 20;
+/// there are at most this many buckets, which bounds the number of spill files
+const int kMaxBuckets = 4096;
+/// all buckets are spilled to file once this many entries are held in memory
+const size_t kMaxBufferedEntries = 1 << 22;
+
+/// The voxel of a ray's end point, and the ray's index in the file
+struct BucketEntry
+{
+  Eigen::Vector3i voxel;
+  int64_t index;
+};
+
+struct Bucket
+{
+  std::vector<BucketEntry> entries;
+  bool spilled = false;
+};
+
+inline int64_t floorDivide(int64_t a, int64_t b)
+{
+  return a >= 0 ? a / b : -((b - 1 - a) / b);
+}
+}  // namespace
+
+bool decimateInBuckets(const std::string &file_name, const std::string &out_name, double voxel_width)
+{
+  ProfileScope profile("decimateInBuckets");
+  Cloud::Info info;
+  if (!Cloud::getInfo(file_name, info))
+    return false;
+  const size_t num_rays = static_cast<size_t>(info.num_bounded) + static_cast<size_t>(info.num_unbounded);
+  profile.count(num_rays);
+
+  // the bucket grid is in x and y, in whole voxels, so each voxel is in exactly one bucket. Bounds only affect how
+  // evenly the rays are spread, as outlying voxels are clamped into the edge buckets
+  const Eigen::Vector3d min_bound = info.rays_bound.min_bound_;
+  const Eigen::Vector3d extent = info.rays_bound.max_bound_ - min_bound;
+  const int target_buckets = static_cast<int>(std::max<size_t>(
+    1, std::min<size_t>(kMaxBuckets, std::max<size_t>(4 * Threads::threadCount(), num_rays / kBucketRays))));
+  const double bucket_width = std::max({ std::sqrt(extent[0] * extent[1] / target_buckets), extent[0] / target_buckets,
+                                         extent[1] / target_buckets, voxel_width });
+  const int64_t bucket_voxels = static_cast<int64_t>(std::ceil(bucket_width / voxel_width));
+  const int64_t min_voxel[2] = { static_cast<int64_t>(std::floor(min_bound[0] / voxel_width)),
+                                 static_cast<int64_t>(std::floor(min_bound[1] / voxel_width)) };
+  int64_t dims[2];
+  for (int i = 0; i < 2; i++)
+  {
+    dims[i] = floorDivide(static_cast<int64_t>(std::floor((min_bound[i] + extent[i]) / voxel_width)) - min_voxel[i],
+                          bucket_voxels) +
+              1;
+  }
+  const auto bucket_of = [&](const Eigen::Vector3i &voxel) {
+    int64_t coord[2];
+    for (int i = 0; i < 2; i++)
+    {
+      coord[i] = std::max<int64_t>(0, std::min(floorDivide(voxel[i] - min_voxel[i], bucket_voxels), dims[i] - 1));
+    }
+    return static_cast<int>(coord[0] + dims[0] * coord[1]);
+  };
+  std::vector<Bucket> buckets(static_cast<size_t>(dims[0] * dims[1]));
+  const auto spill_name = [&out_name](size_t b) { return out_name + "_bucket" + std::to_string(b) + ".spill"; };
+  std::atomic_bool success(true);
+
+  // 1. bin the voxel of each ray into its bucket, in file order
+  size_t num_buffered = 0;
+  int64_t num_read = 0;
+  std::vector<Eigen::Vector3i> voxels;
+  std::vector<int> bucket_ids;
+  auto spill_buckets = [&]() {
+    parallelFor(size_t(0), buckets.size(), [&](size_t b) {
+      Bucket &bucket = buckets[b];
+      if (bucket.entries.empty())
+      {
+        return;
+      }
+      std::ofstream out(spill_name(b),
+                        std::ios::binary | std::ios::out | (bucket.spilled ? std::ios::app : std::ios::trunc));
+      out.write(reinterpret_cast<const char *>(bucket.entries.data()),
+                static_cast<std::streamsize>(bucket.entries.size() * sizeof(BucketEntry)));
+      if (out.fail())
+      {
+        success = false;
+      }
+      bucket.spilled = true;
+      std::vector<BucketEntry>().swap(bucket.entries);
+    });
+    num_buffered = 0;
+  };
+  auto bin_rays = [&](std::vector<Eigen::Vector3d> &, std::vector<Eigen::Vector3d> &ends, std::vector<double> &,
+                      std::vector<RGBA> &) {
+    voxels.resize(ends.size());
+    bucket_ids.resize(ends.size());
+    parallelFor(size_t(0), ends.size(), [&](size_t i) {
+      const Eigen::Vector3d &end = ends[i];
+      voxels[i] = Eigen::Vector3i(int(std::floor(end[0] / voxel_width)), int(std::floor(end[1] / voxel_width)),
+                                  int(std::floor(end[2] / voxel_width)));
+      bucket_ids[i] = bucket_of(voxels[i]);
+    });
+    for (size_t i = 0; i < ends.size(); i++)
+    {
+      buckets[bucket_ids[i]].entries.push_back(BucketEntry{ voxels[i], num_read + static_cast<int64_t>(i) });
+    }
+    num_read += static_cast<int64_t>(ends.size());
+    num_buffered += ends.size();
+    if (num_buffered >= kMaxBufferedEntries)
+    {
+      spill_buckets();
+    }
+  };
+  if (!Cloud::read(file_name, bin_rays))
+    return false;
+  std::vector<Eigen::Vector3i>().swap(voxels);
+  std::vector<int>().swap(bucket_ids);
+
+  // 2. decimate each bucket independently, as its entries are in file order
+  std::vector<std::vector<int64_t>> bucket_kept(buckets.size());
+  parallelFor(size_t(0), buckets.size(), [&](size_t b) {
+    Bucket &bucket = buckets[b];
+    std::vector<BucketEntry> entries;
+    if (bucket.spilled)
+    {
+      std::ifstream in(spill_name(b), std::ios::binary | std::ios::in | std::ios::ate);
+      const size_t num_spilled = static_cast<size_t>(in.tellg()) / sizeof(BucketEntry);
+      entries.resize(num_spilled);
+      in.seekg(0);
+      in.read(reinterpret_cast<char *>(entries.data()), static_cast<std::streamsize>(num_spilled * sizeof(BucketEntry)));
+      if (in.fail())
+      {
+        success = false;
+      }
+      in.close();
+      std::remove(spill_name(b).c_str());
+    }
+    entries.insert(entries.end(), bucket.entries.begin(), bucket.entries.end());
+    std::vector<BucketEntry>().swap(bucket.entries);
+    VoxelSet voxel_set;
+    for (const auto &entry : entries)
+    {
+      if (voxel_set.insert(entry.voxel))
+      {
+        bucket_kept[b].push_back(entry.index);
+      }
+    }
+  });
+  if (!success)
+    return false;
+  std::vector<int64_t> kept;
+  for (auto &indices : bucket_kept)
+  {
+    kept.insert(kept.end(), indices.begin(), indices.end());
+    std::vector<int64_t>().swap(indices);
+  }
+#if RAYLIB_WITH_TBB
+  tbb::parallel_sort(kept.begin(), kept.end());
+#else   // RAYLIB_WITH_TBB
+  std::sort(kept.begin(), kept.end());
+#endif  // RAYLIB_WITH_TBB
+
+  // 3. copy the kept rays, in file order
+  CloudWriter writer;
+  if (!writer.begin(out_name))
+    return false;
+  Cloud chunk;
+  size_t next_kept = 0;
+  int64_t num_copied = 0;
+  auto copy_rays = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                       std::vector<double> &times, std::vector<RGBA> &colours) {
+    chunk.clear();
+    const int64_t chunk_end = num_copied + static_cast<int64_t>(ends.size());
+    for (; next_kept < kept.size() && kept[next_kept] < chunk_end; next_kept++)
+    {
+      const size_t i = static_cast<size_t>(kept[next_kept] - num_copied);
+      chunk.addRay(starts[i], ends[i], times[i], colours[i]);
+    }
+    num_copied = chunk_end;
+    if (!writer.writeChunk(chunk))
+    {
+      success = false;
+    }
+  };
+  if (!Cloud::read(file_name, copy_rays))
+    return false;
+  writer.end();
+  return success;
+}
+}  // namespace ray
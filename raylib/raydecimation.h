@@ -0,0 +1,24 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYDECIMATION_H
+#define RAYLIB_RAYDECIMATION_H
+
+#include "raylib/raylibconfig.h"
+
+#include <string>
+
+namespace ray
+{
+/// Spatial decimation of the ray cloud file @c file_name into @c out_name , keeping the first ray in file order whose
+/// end point is in each voxel of width @c voxel_width . The output is identical to decimating the chunks in order
+/// against a single @c VoxelSet , but the voxels are first binned into spatial buckets, in columns of whole voxels,
+/// which are then decimated in parallel with a set each. The surviving rays are copied in a second read of the file.
+/// Bucket entries are spilled to temporary files beside @c out_name when too many are held in memory, so memory is
+/// bounded by the bucket size rather than the cloud size. Returns false if a file could not be read or written.
+bool RAYLIB_EXPORT decimateInBuckets(const std::string &file_name, const std::string &out_name, double voxel_width);
+}  // namespace ray
+
+#endif  // RAYLIB_RAYDECIMATION_H
@@ -0,0 +1,761 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raydelaunay.h"
+#include "raymorton.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace ray
+{
+namespace
+{
+/// The vertex index of the point at infinity. Every face of the convex hull is joined to it by an outer
+/// tetrahedron, which keeps it as its fourth vertex
+const int kInfinite = -1;
+/// Points whose cavity grows beyond this many tetrahedra are left out, as it only happens when floating point
+/// errors make the cavity inconsistent
+const size_t kMaxCavitySize = 100000;
+
+/// Machine epsilon, and the error bounds of the filtered predicates as derived by Shewchuk in "Adaptive Precision
+/// Floating-Point Arithmetic and Fast Robust Geometric Predicates", 1997
+const double kEpsilon = std::ldexp(1.0, -53);
+const double kOrientationErrorBound = (7.0 + 56.0 * kEpsilon) * kEpsilon;
+const double kInSphereErrorBound = (16.0 + 224.0 * kEpsilon) * kEpsilon;
+
+/// An exact floating point number, as the sum of non-overlapping, non-zero doubles of increasing magnitude
+using Expansion = std::vector<double>;
+
+inline void twoSum(double a, double b, double &sum, double &error)
+{
+  sum = a + b;
+  const double b_virtual = sum - a;
+  const double a_virtual = sum - b_virtual;
+  error = (a - a_virtual) + (b - b_virtual);
+}
+
+inline void twoProduct(double a, double b, double &product, double &error)
+{
+  product = a * b;
+  error = std::fma(a, b, -product);
+}
+
+/// the exact sum of expansion @c e and @c b
+Expansion grow(const Expansion &e, double b)
+{
+  Expansion result;
+  result.reserve(e.size() + 1);
+  double q = b;
+  for (const double &component : e)
+  {
+    double error;
+    twoSum(q, component, q, error);
+    if (error != 0.0)
+      result.push_back(error);
+  }
+  if (q != 0.0)
+    result.push_back(q);
+  return result;
+}
+
+Expansion difference(double a, double b)
+{
+  double sum, error;
+  twoSum(a, -b, sum, error);
+  Expansion result;
+  if (error != 0.0)
+    result.push_back(error);
+  if (sum != 0.0)
+    result.push_back(sum);
+  return result;
+}
+
+Expansion sum(const Expansion &e, const Expansion &f)
+{
+  Expansion result = e;
+  for (const double &component : f) result = grow(result, component);
+  return result;
+}
+
+Expansion product(const Expansion &e, const Expansion &f)
+{
+  Expansion result;
+  for (const double &b : f)
+  {
+    for (const double &a : e)
+    {
+      double prod, error;
+      twoProduct(a, b, prod, error);
+      result = grow(grow(result, error), prod);
+    }
+  }
+  return result;
+}
+
+Expansion negate(Expansion e)
+{
+  for (auto &component : e) component = -component;
+  return e;
+}
+
+/// the largest component has the sign of the whole expansion
+inline int sign(const Expansion &e)
+{
+  return e.empty() ? 0 : (e.back() > 0.0 ? 1 : -1);
+}
+
+/// The orientation determinant in exact arithmetic, for when the floating point result is too small to be trusted
+int exactOrientation(const Eigen::Vector3d &a, const Eigen::Vector3d &b, const Eigen::Vector3d &c,
+                     const Eigen::Vector3d &d)
+{
+  const Expansion adx = difference(a[0], d[0]), ady = difference(a[1], d[1]), adz = difference(a[2], d[2]);
+  const Expansion bdx = difference(b[0], d[0]), bdy = difference(b[1], d[1]), bdz = difference(b[2], d[2]);
+  const Expansion cdx = difference(c[0], d[0]), cdy = difference(c[1], d[1]), cdz = difference(c[2], d[2]);
+  const Expansion bc = sum(product(bdx, cdy), negate(product(cdx, bdy)));
+  const Expansion ca = sum(product(cdx, ady), negate(product(adx, cdy)));
+  const Expansion ab = sum(product(adx, bdy), negate(product(bdx, ady)));
+  return sign(sum(sum(product(adz, bc), product(bdz, ca)), product(cdz, ab)));
+}
+
+/// The in-sphere determinant in exact arithmetic
+int exactInSphere(const Eigen::Vector3d &a, const Eigen::Vector3d &b, const Eigen::Vector3d &c,
+                  const Eigen::Vector3d &d, const Eigen::Vector3d &e)
+{
+  const Expansion aex = difference(a[0], e[0]), aey = difference(a[1], e[1]), aez = difference(a[2], e[2]);
+  const Expansion bex = difference(b[0], e[0]), bey = difference(b[1], e[1]), bez = difference(b[2], e[2]);
+  const Expansion cex = difference(c[0], e[0]), cey = difference(c[1], e[1]), cez = difference(c[2], e[2]);
+  const Expansion dex = difference(d[0], e[0]), dey = difference(d[1], e[1]), dez = difference(d[2], e[2]);
+  const Expansion ab = sum(product(aex, bey), negate(product(bex, aey)));
+  const Expansion bc = sum(product(bex, cey), negate(product(cex, bey)));
+  const Expansion cd = sum(product(cex, dey), negate(product(dex, cey)));
+  const Expansion da = sum(product(dex, aey), negate(product(aex, dey)));
+  const Expansion ac = sum(product(aex, cey), negate(product(cex, aey)));
+  const Expansion bd = sum(product(bex, dey), negate(product(dex, bey)));
+  const Expansion abc = sum(sum(product(aez, bc), negate(product(bez, ac))), product(cez, ab));
+  const Expansion bcd = sum(sum(product(bez, cd), negate(product(cez, bd))), product(dez, bc));
+  const Expansion cda = sum(sum(product(cez, da), product(dez, ac)), product(aez, cd));
+  const Expansion dab = sum(sum(product(dez, ab), product(aez, bd)), product(bez, da));
+  auto lift = [](const Expansion &x, const Expansion &y, const Expansion &z) {
+    return sum(sum(product(x, x), product(y, y)), product(z, z));
+  };
+  const Expansion det = sum(sum(product(lift(dex, dey, dez), abc), negate(product(lift(cex, cey, cez), dab))),
+                            sum(product(lift(bex, bey, bez), cda), negate(product(lift(aex, aey, aez), bcd))));
+  return sign(det);
+}
+
+/// The indices of @c points in Morton order. Consecutive points are then close together, so each insertion
+/// starts its walk near to where the point is, and alters tetrahedra that are still in cache
+std::vector<int> spatialOrder(const std::vector<Eigen::Vector3d> &points)
+{
+  const std::vector<size_t> order = mortonOrder(points);
+  return std::vector<int>(order.begin(), order.end());
+}
+
+/// Incremental Bowyer-Watson tetrahedralisation. Each point's cavity is the set of tetrahedra whose circumsphere
+/// contains it, grown where necessary so that it is star shaped from the point by the exact orientation test. The
+/// tetrahedralisation is therefore always valid, even where the floating point sphere test is inconsistent.
+class Tetrahedraliser
+{
+public:
+  Tetrahedraliser(const std::vector<Eigen::Vector3d> &points)
+    : points_(points)
+    , vertex_marks_(points.size(), 0)
+    , stamp_(0)
+    , hint_(0)
+    , random_(2463534242u)
+  {}
+
+  /// start from the first non-degenerate tetrahedron of the ordered points, returning its vertices
+  bool initialise(const std::vector<int> &order, Eigen::Vector4i &corners);
+  /// add the point @c vertex , returning false if it is left out
+  bool insert(int vertex);
+  /// the tetrahedra inside the convex hull, and their neighbours
+  void extract(std::vector<Eigen::Vector4i> &tetrahedra, std::vector<Eigen::Vector4i> &neighbours) const;
+
+private:
+  struct BoundaryFace
+  {
+    int tetrahedron;
+    int face;
+  };
+  /// face @c face of the new tetrahedron @c tetrahedron
+  struct InnerFace
+  {
+    int tetrahedron;
+    int face;
+  };
+
+  inline bool isOuter(int tetrahedron) const { return vertices_[tetrahedron][3] == kInfinite; }
+  /// orientation of the tetrahedron with vertex @c i replaced by point @c vertex . Negative when the point is on
+  /// the far side of face @c i
+  inline int replacedOrientation(const Eigen::Vector4i &tetra, int i, int vertex) const
+  {
+    const Eigen::Vector3d *corners[4];
+    for (int j = 0; j < 4; j++) corners[j] = &points_[j == i ? vertex : tetra[j]];
+    return DelaunayTetrahedralisation::orientation(*corners[0], *corners[1], *corners[2], *corners[3]);
+  }
+  /// whether joining the point @c vertex to face @c i of @c tetrahedron gives a positively oriented tetrahedron
+  bool validJoin(int tetrahedron, int i, int vertex) const;
+  /// whether the point @c vertex is in the circumsphere of @c tetrahedron or, if it is outer, in front of its hull
+  /// face or within its circumcircle
+  bool inConflict(int tetrahedron, int vertex) const;
+  /// whether @c tetrahedron must be in the cavity of the point @c vertex , as it contains it
+  bool isRequired(int tetrahedron, int vertex) const;
+  /// the tetrahedron containing the point @c vertex , or the outer tetrahedron that it is in front of
+  int locate(int vertex);
+  int newTetrahedron(const Eigen::Vector4i &vertices);
+  inline void addToCavity(int tetrahedron)
+  {
+    marks_[tetrahedron] = stamp_;
+    cavity_.push_back(tetrahedron);
+  }
+  /// Pair up the faces that the new tetrahedra @c tetras share, which are those that contain their vertex at
+  /// @c apexes , into @c inner_pairs_ . Returns false unless every face is shared by exactly two of them
+  bool pairInnerFaces(const std::vector<Eigen::Vector4i> &tetras, const std::vector<int> &apexes);
+
+  const std::vector<Eigen::Vector3d> &points_;
+  std::vector<Eigen::Vector4i> vertices_;
+  std::vector<Eigen::Vector4i> neighbours_;
+  std::vector<bool> alive_;
+  std::vector<int> free_;
+  std::vector<int> marks_;
+  std::vector<int> required_;
+  std::vector<int> vertex_marks_;
+  std::vector<int> cavity_;
+  std::vector<BoundaryFace> boundary_;
+  std::vector<Eigen::Vector4i> new_vertices_;
+  std::vector<int> new_apexes_;
+  std::vector<int> new_tetrahedra_;
+  std::vector<uint64_t> edge_keys_;  // hash table of the inner faces, by their edge opposite the apex
+  std::vector<InnerFace> edge_faces_;
+  std::vector<std::pair<InnerFace, InnerFace>> inner_pairs_;
+  Eigen::Vector3d interior_;  // a point inside the first tetrahedron, so inside the convex hull throughout
+  int stamp_;
+  int hint_;
+  uint32_t random_;
+};
+
+bool Tetrahedraliser::validJoin(int tetrahedron, int i, int vertex) const
+{
+  const Eigen::Vector4i &tetra = vertices_[tetrahedron];
+  if (isOuter(tetrahedron) && i != 3)
+  {
+    // the new outer tetrahedron's hull face must face away from the interior
+    const Eigen::Vector3d *corners[3];
+    for (int j = 0; j < 3; j++) corners[j] = &points_[j == i ? vertex : tetra[j]];
+    return DelaunayTetrahedralisation::orientation(*corners[0], *corners[1], *corners[2], interior_) < 0;
+  }
+  return replacedOrientation(tetra, i, vertex) > 0;
+}
+
+bool Tetrahedraliser::inConflict(int tetrahedron, int vertex) const
+{
+  const Eigen::Vector4i &tetra = vertices_[tetrahedron];
+  if (isOuter(tetrahedron))
+  {
+    const int orientation = DelaunayTetrahedralisation::orientation(points_[tetra[0]], points_[tetra[1]],
+                                                                    points_[tetra[2]], points_[vertex]);
+    if (orientation != 0)
+    {
+      return orientation > 0;
+    }
+    // in the plane of the hull face, so in conflict if it is within the face's circumcircle. This is where the
+    // plane cuts the circumsphere of the tetrahedron inside the face
+    return inConflict(neighbours_[tetrahedron][3], vertex);
+  }
+  return DelaunayTetrahedralisation::inSphere(points_[tetra[0]], points_[tetra[1]], points_[tetra[2]],
+                                              points_[tetra[3]], points_[vertex]) > 0;
+}
+
+bool Tetrahedraliser::isRequired(int tetrahedron, int vertex) const
+{
+  if (required_[tetrahedron] == stamp_)
+  {
+    return true;
+  }
+  if (isOuter(tetrahedron))
+  {
+    return false;
+  }
+  for (int i = 0; i < 4; i++)
+  {
+    if (replacedOrientation(vertices_[tetrahedron], i, vertex) < 0)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+int Tetrahedraliser::locate(int vertex)
+{
+  // a stochastic visibility walk, which always terminates on a Delaunay tetrahedralisation
+  int tetrahedron = hint_;
+  const size_t max_steps = 4 * vertices_.size() + 16;
+  for (size_t step = 0; step < max_steps; step++)
+  {
+    if (isOuter(tetrahedron))
+    {
+      return tetrahedron;
+    }
+    random_ ^= random_ << 13;
+    random_ ^= random_ >> 17;
+    random_ ^= random_ << 5;
+    const int offset = static_cast<int>(random_ & 3);
+    int next = -1;
+    for (int k = 0; k < 4 && next == -1; k++)
+    {
+      const int i = (offset + k) & 3;
+      if (replacedOrientation(vertices_[tetrahedron], i, vertex) < 0)
+      {
+        next = neighbours_[tetrahedron][i];
+      }
+    }
+    if (next == -1)
+    {
+      return tetrahedron;
+    }
+    tetrahedron = next;
+  }
+  return -1;
+}
+
+int Tetrahedraliser::newTetrahedron(const Eigen::Vector4i &vertices)
+{
+  if (!free_.empty())
+  {
+    const int tetrahedron = free_.back();
+    free_.pop_back();
+    vertices_[tetrahedron] = vertices;
+    alive_[tetrahedron] = true;
+    return tetrahedron;
+  }
+  vertices_.push_back(vertices);
+  neighbours_.push_back(Eigen::Vector4i(-1, -1, -1, -1));
+  alive_.push_back(true);
+  marks_.push_back(0);
+  required_.push_back(0);
+  return static_cast<int>(vertices_.size()) - 1;
+}
+
+bool Tetrahedraliser::pairInnerFaces(const std::vector<Eigen::Vector4i> &tetras, const std::vector<int> &apexes)
+{
+  inner_pairs_.clear();
+  size_t capacity = 64;
+  while (capacity < 6 * tetras.size())  // at most half full
+  {
+    capacity *= 2;
+  }
+  edge_keys_.assign(capacity, 0);
+  edge_faces_.resize(capacity);
+  size_t num_unpaired = 0;
+  for (size_t t = 0; t < tetras.size(); t++)
+  {
+    for (int j = 0; j < 4; j++)
+    {
+      if (j == apexes[t])
+      {
+        continue;
+      }
+      // every inner face contains the apex, so it is identified by its other edge
+      int edge[2], k = 0;
+      for (int l = 0; l < 4; l++)
+      {
+        if (l != j && l != apexes[t])
+        {
+          edge[k++] = tetras[t][l];
+        }
+      }
+      const uint64_t key = static_cast<uint64_t>(std::min(edge[0], edge[1]) + 2) << 32 |
+                           static_cast<uint64_t>(std::max(edge[0], edge[1]) + 2);
+      size_t slot = static_cast<size_t>((key * 0x9e3779b97f4a7c15ull) >> 40) & (capacity - 1);
+      while (edge_keys_[slot] != 0 && edge_keys_[slot] != key)
+      {
+        slot = (slot + 1) & (capacity - 1);
+      }
+      const InnerFace face{ static_cast<int>(t), j };
+      if (edge_keys_[slot] == 0)
+      {
+        edge_keys_[slot] = key;
+        edge_faces_[slot] = face;
+        num_unpaired++;
+      }
+      else if (edge_faces_[slot].tetrahedron >= 0)
+      {
+        inner_pairs_.push_back(std::make_pair(edge_faces_[slot], face));
+        edge_faces_[slot].tetrahedron = -1;
+        num_unpaired--;
+      }
+      else  // a third face on the same edge
+      {
+        return false;
+      }
+    }
+  }
+  return num_unpaired == 0;
+}
+
+bool Tetrahedraliser::initialise(const std::vector<int> &order, Eigen::Vector4i &corners)
+{
+  const int num_points = static_cast<int>(order.size());
+  const Eigen::Vector3d &a = points_[order[0]];
+  int b = 1;
+  while (b < num_points && points_[order[b]] == a) b++;
+  if (b == num_points)
+  {
+    return false;
+  }
+  const Eigen::Vector3d ab = points_[order[b]] - a;
+  int c = b + 1;
+  for (; c < num_points; c++)
+  {
+    const Eigen::Vector3d ac = points_[order[c]] - a;
+    if (ab.cross(ac).squaredNorm() > 1e-20 * ab.squaredNorm() * ac.squaredNorm())
+    {
+      break;
+    }
+  }
+  if (c >= num_points)
+  {
+    return false;
+  }
+  for (int d = b + 1; d < num_points; d++)
+  {
+    if (d == c)
+    {
+      continue;
+    }
+    Eigen::Vector4i tetra(order[0], order[b], order[c], order[d]);
+    const int orientation = DelaunayTetrahedralisation::orientation(a, points_[tetra[1]], points_[tetra[2]],
+                                                                    points_[tetra[3]]);
+    if (orientation == 0)
+    {
+      continue;
+    }
+    if (orientation < 0)
+    {
+      std::swap(tetra[2], tetra[3]);
+    }
+    interior_ = (a + points_[tetra[1]] + points_[tetra[2]] + points_[tetra[3]]) / 4.0;
+    bool inside = true;
+    for (int i = 0; i < 4; i++)
+    {
+      const Eigen::Vector3d *vs[4];
+      for (int j = 0; j < 4; j++) vs[j] = i == j ? &interior_ : &points_[tetra[j]];
+      inside = inside && DelaunayTetrahedralisation::orientation(*vs[0], *vs[1], *vs[2], *vs[3]) > 0;
+    }
+    if (!inside)  // too flat for its centroid to be inside it in floating point
+    {
+      continue;
+    }
+
+    // the tetrahedron and the outer tetrahedron on each of its faces. The point at infinity is in front of face i,
+    // so an odd permutation that moves it to the fourth vertex keeps the outer tetrahedra positively oriented
+    const int first = newTetrahedron(tetra);
+    for (int i = 0; i < 4; i++)
+    {
+      Eigen::Vector4i outer = tetra;
+      outer[i] = kInfinite;
+      if (i == 3)
+      {
+        std::swap(outer[0], outer[1]);
+      }
+      else
+      {
+        std::swap(outer[i], outer[3]);
+      }
+      const int o = newTetrahedron(outer);
+      neighbours_[first][i] = o;
+      neighbours_[o][3] = first;
+      new_tetrahedra_.push_back(o);
+    }
+    // the outer tetrahedra join each other on their faces that contain the point at infinity
+    new_vertices_.clear();
+    for (const auto &outer : new_tetrahedra_) new_vertices_.push_back(vertices_[outer]);
+    new_apexes_.assign(4, 3);
+    pairInnerFaces(new_vertices_, new_apexes_);
+    for (const auto &pair : inner_pairs_)
+    {
+      neighbours_[new_tetrahedra_[pair.first.tetrahedron]][pair.first.face] = new_tetrahedra_[pair.second.tetrahedron];
+      neighbours_[new_tetrahedra_[pair.second.tetrahedron]][pair.second.face] = new_tetrahedra_[pair.first.tetrahedron];
+    }
+    new_tetrahedra_.clear();
+    hint_ = first;
+    corners = tetra;
+    return true;
+  }
+  return false;
+}
+
+bool Tetrahedraliser::insert(int vertex)
+{
+  const int seed = locate(vertex);
+  if (seed < 0)
+  {
+    return false;
+  }
+  const Eigen::Vector3d &point = points_[vertex];
+  if (!isOuter(seed))
+  {
+    for (int j = 0; j < 4; j++)
+    {
+      if (points_[vertices_[seed][j]] == point)  // a duplicate point
+      {
+        return false;
+      }
+    }
+  }
+
+  stamp_++;
+  cavity_.clear();
+  addToCavity(seed);
+  required_[seed] = stamp_;
+  // grow the cavity over the tetrahedra whose circumsphere contains the point
+  for (size_t k = 0; k < cavity_.size(); k++)
+  {
+    const int tetrahedron = cavity_[k];
+    for (int i = 0; i < 4; i++)
+    {
+      const int neighbour = neighbours_[tetrahedron][i];
+      if (marks_[neighbour] != stamp_ && inConflict(neighbour, vertex))
+      {
+        addToCavity(neighbour);
+      }
+    }
+  }
+  // Where the point cannot be joined to a boundary face, as it is beside or behind it, the sphere tests were
+  // inconsistent (near cospherical points), so the tetrahedron is removed from the cavity. Only the tetrahedra
+  // that contain the point must stay, and then the face is one that the point lies on, so the cavity grows over it
+  for (;;)
+  {
+    bool changed = false;
+    for (size_t k = 0; k < cavity_.size(); k++)
+    {
+      const int tetrahedron = cavity_[k];
+      for (int i = 0; i < 4 && marks_[tetrahedron] == stamp_; i++)
+      {
+        const int neighbour = neighbours_[tetrahedron][i];
+        if (marks_[neighbour] == stamp_ || validJoin(tetrahedron, i, vertex))
+        {
+          continue;
+        }
+        changed = true;
+        if (isRequired(tetrahedron, vertex))
+        {
+          addToCavity(neighbour);
+          required_[neighbour] = stamp_;
+        }
+        else
+        {
+          marks_[tetrahedron] = 0;
+        }
+      }
+    }
+    if (!changed)
+    {
+      break;
+    }
+    cavity_.erase(std::remove_if(cavity_.begin(), cavity_.end(), [&](int t) { return marks_[t] != stamp_; }),
+                  cavity_.end());
+    if (cavity_.size() > kMaxCavitySize)
+    {
+      return false;
+    }
+  }
+  boundary_.clear();
+  for (const auto &tetrahedron : cavity_)
+  {
+    for (int i = 0; i < 4; i++)
+    {
+      if (marks_[neighbours_[tetrahedron][i]] != stamp_)
+      {
+        boundary_.push_back(BoundaryFace{ tetrahedron, i });
+      }
+    }
+  }
+
+  // every vertex of the cavity must remain on its boundary, or it would be lost
+  for (const auto &face : boundary_)
+  {
+    for (int j = 0; j < 4; j++)
+    {
+      const int v = vertices_[face.tetrahedron][j];
+      if (j != face.face && v != kInfinite)
+      {
+        vertex_marks_[v] = stamp_;
+      }
+    }
+  }
+  for (const auto &tetrahedron : cavity_)
+  {
+    for (int j = 0; j < 4; j++)
+    {
+      const int v = vertices_[tetrahedron][j];
+      if (v != kInfinite && vertex_marks_[v] != stamp_)
+      {
+        return false;
+      }
+    }
+  }
+  new_vertices_.resize(boundary_.size());
+  new_apexes_.resize(boundary_.size());
+  for (size_t b = 0; b < boundary_.size(); b++)
+  {
+    new_vertices_[b] = vertices_[boundary_[b].tetrahedron];
+    new_vertices_[b][boundary_[b].face] = vertex;
+    new_apexes_[b] = boundary_[b].face;
+  }
+  if (!pairInnerFaces(new_vertices_, new_apexes_))
+  {
+    return false;
+  }
+
+  // join the point to each boundary face
+  new_tetrahedra_.resize(boundary_.size());
+  for (size_t b = 0; b < boundary_.size(); b++)
+  {
+    const BoundaryFace &face = boundary_[b];
+    const int tetrahedron = newTetrahedron(new_vertices_[b]);
+    const int neighbour = neighbours_[face.tetrahedron][face.face];
+    neighbours_[tetrahedron][face.face] = neighbour;
+    for (int j = 0; j < 4; j++)
+    {
+      if (neighbours_[neighbour][j] == face.tetrahedron)
+      {
+        neighbours_[neighbour][j] = tetrahedron;
+      }
+    }
+    new_tetrahedra_[b] = tetrahedron;
+    if (!isOuter(tetrahedron))
+    {
+      hint_ = tetrahedron;
+    }
+  }
+  for (const auto &pair : inner_pairs_)
+  {
+    neighbours_[new_tetrahedra_[pair.first.tetrahedron]][pair.first.face] = new_tetrahedra_[pair.second.tetrahedron];
+    neighbours_[new_tetrahedra_[pair.second.tetrahedron]][pair.second.face] = new_tetrahedra_[pair.first.tetrahedron];
+  }
+  for (const auto &tetrahedron : cavity_)
+  {
+    alive_[tetrahedron] = false;
+    free_.push_back(tetrahedron);
+  }
+  return true;
+}
+
+void Tetrahedraliser::extract(std::vector<Eigen::Vector4i> &tetrahedra, std::vector<Eigen::Vector4i> &neighbours) const
+{
+  std::vector<int> ids(vertices_.size(), -1);
+  int num_tetrahedra = 0;
+  for (size_t t = 0; t < vertices_.size(); t++)
+  {
+    if (alive_[t] && !isOuter(static_cast<int>(t)))
+    {
+      ids[t] = num_tetrahedra++;
+    }
+  }
+  tetrahedra.resize(num_tetrahedra);
+  neighbours.resize(num_tetrahedra);
+  for (size_t t = 0; t < vertices_.size(); t++)
+  {
+    if (ids[t] == -1)
+    {
+      continue;
+    }
+    tetrahedra[ids[t]] = vertices_[t];
+    for (int i = 0; i < 4; i++) neighbours[ids[t]][i] = ids[neighbours_[t][i]];
+  }
+}
+}  // namespace
+
+int DelaunayTetrahedralisation::orientation(const Eigen::Vector3d &a, const Eigen::Vector3d &b,
+                                            const Eigen::Vector3d &c, const Eigen::Vector3d &d)
+{
+  const double adx = a[0] - d[0], ady = a[1] - d[1], adz = a[2] - d[2];
+  const double bdx = b[0] - d[0], bdy = b[1] - d[1], bdz = b[2] - d[2];
+  const double cdx = c[0] - d[0], cdy = c[1] - d[1], cdz = c[2] - d[2];
+  const double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy;
+  const double cdxady = cdx * ady, adxcdy = adx * cdy;
+  const double adxbdy = adx * bdy, bdxady = bdx * ady;
+  const double det = adz * (bdxcdy - cdxbdy) + bdz * (cdxady - adxcdy) + cdz * (adxbdy - bdxady);
+  const double permanent = (std::abs(bdxcdy) + std::abs(cdxbdy)) * std::abs(adz) +
+                           (std::abs(cdxady) + std::abs(adxcdy)) * std::abs(bdz) +
+                           (std::abs(adxbdy) + std::abs(bdxady)) * std::abs(cdz);
+  const double error_bound = kOrientationErrorBound * permanent;
+  if (det > error_bound)
+  {
+    return 1;
+  }
+  if (-det > error_bound)
+  {
+    return -1;
+  }
+  return exactOrientation(a, b, c, d);
+}
+
+int DelaunayTetrahedralisation::inSphere(const Eigen::Vector3d &a, const Eigen::Vector3d &b, const Eigen::Vector3d &c,
+                                         const Eigen::Vector3d &d, const Eigen::Vector3d &e)
+{
+  const Eigen::Vector3d ae = a - e, be = b - e, ce = c - e, de = d - e;
+  // the 2x2 minors, and the sums of the magnitudes of their terms for the error bound
+  const double ab = ae[0] * be[1] - be[0] * ae[1], ab_p = std::abs(ae[0] * be[1]) + std::abs(be[0] * ae[1]);
+  const double bc = be[0] * ce[1] - ce[0] * be[1], bc_p = std::abs(be[0] * ce[1]) + std::abs(ce[0] * be[1]);
+  const double cd = ce[0] * de[1] - de[0] * ce[1], cd_p = std::abs(ce[0] * de[1]) + std::abs(de[0] * ce[1]);
+  const double da = de[0] * ae[1] - ae[0] * de[1], da_p = std::abs(de[0] * ae[1]) + std::abs(ae[0] * de[1]);
+  const double ac = ae[0] * ce[1] - ce[0] * ae[1], ac_p = std::abs(ae[0] * ce[1]) + std::abs(ce[0] * ae[1]);
+  const double bd = be[0] * de[1] - de[0] * be[1], bd_p = std::abs(be[0] * de[1]) + std::abs(de[0] * be[1]);
+  const double abc = ae[2] * bc - be[2] * ac + ce[2] * ab;
+  const double bcd = be[2] * cd - ce[2] * bd + de[2] * bc;
+  const double cda = ce[2] * da + de[2] * ac + ae[2] * cd;
+  const double dab = de[2] * ab + ae[2] * bd + be[2] * da;
+  const double abc_p = std::abs(ae[2]) * bc_p + std::abs(be[2]) * ac_p + std::abs(ce[2]) * ab_p;
+  const double bcd_p = std::abs(be[2]) * cd_p + std::abs(ce[2]) * bd_p + std::abs(de[2]) * bc_p;
+  const double cda_p = std::abs(ce[2]) * da_p + std::abs(de[2]) * ac_p + std::abs(ae[2]) * cd_p;
+  const double dab_p = std::abs(de[2]) * ab_p + std::abs(ae[2]) * bd_p + std::abs(be[2]) * da_p;
+  const double a_lift = ae.squaredNorm(), b_lift = be.squaredNorm(), c_lift = ce.squaredNorm(),
+               d_lift = de.squaredNorm();
+  const double det = (d_lift * abc - c_lift * dab) + (b_lift * cda - a_lift * bcd);
+  const double permanent = d_lift * abc_p + c_lift * dab_p + b_lift * cda_p + a_lift * bcd_p;
+  const double error_bound = kInSphereErrorBound * permanent;
+  if (det > error_bound)
+  {
+    return 1;
+  }
+  if (-det > error_bound)
+  {
+    return -1;
+  }
+  return exactInSphere(a, b, c, d, e);
+}
+
+bool DelaunayTetrahedralisation::build(const std::vector<Eigen::Vector3d> &points)
+{
+  tetrahedra_.clear();
+  neighbours_.clear();
+  if (points.size() < 4)
+  {
+    return false;
+  }
+  const std::vector<int> order = spatialOrder(points);
+  Tetrahedraliser tetrahedraliser(points);
+  Eigen::Vector4i corners;
+  if (!tetrahedraliser.initialise(order, corners))
+  {
+    return false;
+  }
+  for (const auto &vertex : order)
+  {
+    if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2] && vertex != corners[3])
+    {
+      tetrahedraliser.insert(vertex);
+    }
+  }
+  tetrahedraliser.extract(tetrahedra_, neighbours_);
+  return true;
+}
+}  // namespace ray
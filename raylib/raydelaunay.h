@@ -0,0 +1,45 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYDELAUNAY_H
+#define RAYLIB_RAYDELAUNAY_H
+
+#include "raylib/raylibconfig.h"
+#include "rayutils.h"
+
+namespace ray
+{
+/// The Delaunay tetrahedralisation of a set of 3D points, by incremental insertion in space filling curve order.
+/// Each tetrahedron is positively oriented, and its neighbour opposite vertex i is the tetrahedron sharing its other
+/// three vertices, or -1 on the convex hull. Duplicate points are not vertices of the tetrahedralisation, nor are the
+/// rare points whose insertion would not give a valid tetrahedralisation in floating point arithmetic.
+class RAYLIB_EXPORT DelaunayTetrahedralisation
+{
+public:
+  /// tetrahedralise @c points . Returns false, with no tetrahedra, if there are fewer than four non-coplanar points
+  bool build(const std::vector<Eigen::Vector3d> &points);
+
+  /// the indices of the four points of each tetrahedron
+  const std::vector<Eigen::Vector4i> &tetrahedra() const { return tetrahedra_; }
+  /// the index of the neighbouring tetrahedron opposite each vertex of each tetrahedron, or -1 if it is outside
+  const std::vector<Eigen::Vector4i> &neighbours() const { return neighbours_; }
+
+  /// Exact orientation test. Positive if @c d is below the plane through @c a , @c b and @c c , where they appear
+  /// anticlockwise from above, negative if above and zero if coplanar
+  static int orientation(const Eigen::Vector3d &a, const Eigen::Vector3d &b, const Eigen::Vector3d &c,
+                         const Eigen::Vector3d &d);
+
+  /// Positive if @c e is inside the sphere through the positively oriented @c a , @c b , @c c and @c d , negative if
+  /// outside, and zero if it is on the sphere
+  static int inSphere(const Eigen::Vector3d &a, const Eigen::Vector3d &b, const Eigen::Vector3d &c,
+                      const Eigen::Vector3d &d, const Eigen::Vector3d &e);
+
+private:
+  std::vector<Eigen::Vector4i> tetrahedra_;
+  std::vector<Eigen::Vector4i> neighbours_;
+};
+}  // namespace ray
+
+#endif  // RAYLIB_RAYDELAUNAY_H
@@ -0,0 +1,265 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raydenoise.h"
+#include "raycloud.h"
+#include "raycloudwriter.h"
+#include "rayneighbours.h"
+#include "raynodes.h"
+#include "rayprofile.h"
+#include "raytiles.h"
+
+#include <nabo/nabo.h>
+#include <mutex>
+
+namespace ray
+{
+namespace
+{
+/// the halo of the sigma denoise, in point spacings. Its neighbourhoods are of ten points, at a few spacings across
+const double kSigmaHaloSpacings = 10.0;
+}  // namespace
+
+void denoiseDistance(const Cloud &cloud, double distance, std::vector<bool> &keep, DenoiseStats &stats,
+                     const std::vector<bool> *decide)
+{
+  keep.assign(cloud.ends.size(), true);
+  if (cloud.ends.size() < 2)
+  {
+    // a lone ray has no other end to be near
+    for (size_t i = 0; i < cloud.ends.size(); i++)
+    {
+      if (cloud.rayBounded(i) && (!decide || (*decide)[i]))
+      {
+        keep[i] = false;
+        stats.num_removed++;
+      }
+    }
+    return;
+  }
+  // only whether the nearest end is within the distance matters, so this is a grid query that stops at the first
+  std::vector<uint8_t> has_neighbour;
+  findNeighboursWithin(cloud.ends, distance, has_neighbour);
+
+  for (size_t i = 0; i < cloud.ends.size(); i++)
+  {
+    if (decide && !(*decide)[i])
+      continue;
+    keep[i] = !cloud.rayBounded(i) || has_neighbour[i];
+    if (!keep[i])
+      stats.num_removed++;
+  }
+}
+
+void denoiseSigmas(const Cloud &cloud, double sigmas, std::vector<bool> &keep, DenoiseStats &stats,
+                   const std::vector<bool> *decide)
+{
+  keep.assign(cloud.ends.size(), true);
+  size_t num_bounded = 0;
+  for (size_t i = 0; i < cloud.ends.size(); i++)
+  {
+    if (cloud.rayBounded(i))
+      num_bounded++;
+  }
+  if (num_bounded < 2)
+  {
+    // no bounded ray has a neighbour, so all are considered noise
+    for (size_t i = 0; i < cloud.ends.size(); i++)
+    {
+      if (cloud.rayBounded(i) && (!decide || (*decide)[i]))
+      {
+        keep[i] = false;
+        stats.num_removed++;
+      }
+    }
+    return;
+  }
+  std::vector<Eigen::Vector3d> centroids;
+  std::vector<Eigen::Vector3d> dimensions;
+  std::vector<Eigen::Matrix3d> matrices;
+  Eigen::MatrixXi indices;
+
+  const int search_size = std::min(10, (int)cloud.ends.size() - 1);
+  cloud.getSurfels(search_size, &centroids, nullptr, &dimensions, &matrices, &indices);
+
+  for (size_t i = 0; i < matrices.size(); i++)
+  {
+    if (decide && !(*decide)[i])
+      continue;
+    bool is_noise = false;
+    if (cloud.rayBounded(i))
+    {
+      if (indices(0, i) == Nabo::NNSearchD::InvalidIndex)  // no neighbours in range, we consider this as noise
+      {
+        keep[i] = false;
+        stats.num_removed++;
+        continue;
+      }
+      int other_i = indices(0, i);
+      Eigen::Vector3d vec = cloud.ends[i] - centroids[other_i];
+      Eigen::Vector3d newVec = matrices[other_i].transpose() * vec;
+      newVec[0] /= dimensions[other_i][0];
+      newVec[1] /= dimensions[other_i][1];
+      newVec[2] /= dimensions[other_i][2];
+      int num = 0;
+      for (int j = 0; j < search_size && indices(j, i) != Nabo::NNSearchD::InvalidIndex; j++) num = j + 1;
+      stats.num_neighbours_sum += (double)num;
+      stats.dimensions_sum += dimensions[other_i];
+      stats.num_tested++;
+      double scale2 = newVec.squaredNorm();
+      is_noise = scale2 > sigmas * sigmas;
+    }
+    if (is_noise)
+    {
+      keep[i] = false;
+      stats.num_removed++;
+    }
+  }
+}
+
+bool denoiseInTiles(const std::string &file_name, const std::string &out_name, bool use_sigmas, double threshold,
+                    DenoiseStats &stats)
+{
+  ProfileScope profile("denoiseInTiles");
+  Cloud::Info info;
+  if (!Cloud::getInfo(file_name, info))
+    return false;
+  const size_t num_rays = static_cast<size_t>(info.num_bounded) + static_cast<size_t>(info.num_unbounded);
+  profile.count(num_rays);
+  double halo = threshold;
+  if (use_sigmas)
+  {
+    const double spacing = Cloud::estimatePointSpacing(file_name, info.ends_bound, info.num_bounded);
+    halo = kSigmaHaloSpacings * spacing;
+  }
+
+  // 1. denoise each tile independently, deciding only the rays that it owns
+  std::vector<uint8_t> kept(num_rays, 0);
+  std::mutex stats_mutex;
+  auto denoise_tile = [&](Cloud &cloud, const std::vector<int64_t> &indices) {
+    std::vector<bool> owned(indices.size()), keep;
+    for (size_t i = 0; i < indices.size(); i++) owned[i] = indices[i] >= 0 && indices[i] < (int64_t)num_rays;
+    DenoiseStats tile_stats;
+    if (use_sigmas)
+      denoiseSigmas(cloud, threshold, keep, tile_stats, &owned);
+    else
+      denoiseDistance(cloud, threshold, keep, tile_stats, &owned);
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+      if (owned[i] && keep[i])
+        kept[indices[i]] = 1;
+    }
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    stats.num_removed += tile_stats.num_removed;
+    stats.dimensions_sum += tile_stats.dimensions_sum;
+    stats.num_neighbours_sum += tile_stats.num_neighbours_sum;
+    stats.num_tested += tile_stats.num_tested;
+  };
+  if (!processInTiles(file_name, out_name, halo, denoise_tile))
+    return false;
+  // across several nodes, node 0 gathers the other nodes' decisions and writes the output
+  if (!Nodes::gather(out_name, kept, [](uint8_t &value, uint8_t other) { value |= other; }))
+    return false;
+  if (!Nodes::isCoordinator())
+    return true;
+
+  // 2. copy the kept rays, in file order
+  CloudWriter writer;
+  if (!writer.begin(out_name))
+    return false;
+  Cloud chunk;
+  size_t num_copied = 0;
+  bool success = true;
+  auto copy_rays = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                       std::vector<double> &times, std::vector<RGBA> &colours) {
+    const size_t chunk_size = ends.size();
+    chunk.clear();
+    chunk.starts.swap(starts);  // the reader's vectors are end-of-life, so can be taken
+    chunk.ends.swap(ends);
+    chunk.times.swap(times);
+    chunk.colours.swap(colours);
+    chunk.compact([&](size_t i) { return num_copied + i < num_rays && kept[num_copied + i]; });
+    num_copied += chunk_size;
+    if (!writer.writeChunk(chunk))
+    {
+      success = false;
+    }
+  };
+  if (!Cloud::read(file_name, copy_rays))
+    return false;
+  writer.end();
+  return success;
+}
+
+RangeGapFilter::RangeGapFilter(double range_distance)
+  : range_distance_(range_distance)
+  , num_held_(0)
+  , num_read_(0)
+  , num_kept_(0)
+{}
+
+void RangeGapFilter::filter(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+                            const std::vector<double> &times, const std::vector<RGBA> &colours, Cloud &kept)
+{
+  for (size_t i = 0; i < ends.size(); i++)
+  {
+    const double range2 = (ends[i] - starts[i]).norm();
+    if (num_held_ == 2)
+    {
+      // We don't want to throw away large changes, instead, the intermediate of 3 adjacent ranges that is too far
+      // from both ends...
+      const double range0 = held_ranges_[0];
+      const double range1 = held_ranges_[1];
+      const double min_dist =
+        std::min(std::abs(range0 - range2), std::min(std::abs(range1 - range0), std::abs(range2 - range1)));
+      if (held_colours_[1].alpha == 0 || min_dist < range_distance_)
+      {
+        kept.addRay(held_starts_[1], held_ends_[1], held_times_[1], held_colours_[1]);
+        num_kept_++;
+      }
+    }
+    if (num_held_ > 0)
+    {
+      held_starts_[0] = held_starts_[1];
+      held_ends_[0] = held_ends_[1];
+      held_times_[0] = held_times_[1];
+      held_colours_[0] = held_colours_[1];
+      held_ranges_[0] = held_ranges_[1];
+    }
+    held_starts_[1] = starts[i];
+    held_ends_[1] = ends[i];
+    held_times_[1] = times[i];
+    held_colours_[1] = colours[i];
+    held_ranges_[1] = range2;
+    num_held_ = std::min<size_t>(num_held_ + 1, 2);
+  }
+  num_read_ += ends.size();
+}
+
+bool denoiseRangeGaps(const std::string &file_name, const std::string &out_name, double range_distance,
+                      size_t &num_removed)
+{
+  CloudWriter writer;
+  if (!writer.begin(out_name))
+    return false;
+  RangeGapFilter filter(range_distance);
+  Cloud chunk;
+  bool success = true;
+  auto denoise = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                     std::vector<double> &times, std::vector<RGBA> &colours) {
+    chunk.clear();
+    filter.filter(starts, ends, times, colours, chunk);
+    if (!writer.writeChunk(chunk))
+    {
+      success = false;
+    }
+  };
+  if (!Cloud::read(file_name, denoise))
+    return false;
+  writer.end();
+  num_removed = filter.numRemoved();
+  return success;
+}
+}  // namespace ray
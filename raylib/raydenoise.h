@@ -0,0 +1,87 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYDENOISE_H
+#define RAYLIB_RAYDENOISE_H
+
+#include "raylib/raylibconfig.h"
+
+#include "rayutils.h"
+
+namespace ray
+{
+class Cloud;
+
+/// Totals of a denoise, for reporting
+struct RAYLIB_EXPORT DenoiseStats
+{
+  size_t num_removed = 0;
+  /// for a sigma denoise, the sums over the bounded rays of their nearest surfel's dimensions and neighbour count
+  Eigen::Vector3d dimensions_sum = Eigen::Vector3d::Zero();
+  double num_neighbours_sum = 0.0;
+  double num_tested = 0.0;
+};
+
+/// Set @c keep for each ray of @c cloud , removing the bounded rays whose end is @c distance or more from any other
+/// ray end. Unbounded rays are kept, but their ends count as neighbours. If @c decide is given, only the rays it marks
+/// are decided and added to @c stats , and the rest are kept.
+void RAYLIB_EXPORT denoiseDistance(const Cloud &cloud, double distance, std::vector<bool> &keep, DenoiseStats &stats,
+                                   const std::vector<bool> *decide = nullptr);
+
+/// Set @c keep for each ray of @c cloud , removing the bounded rays whose end is more than @c sigmas standard deviations
+/// from the surfel of its nearest bounded neighbour, which is the Mahalanobis distance. Unbounded rays are kept.
+/// @c decide is as for @c denoiseDistance .
+void RAYLIB_EXPORT denoiseSigmas(const Cloud &cloud, double sigmas, std::vector<bool> &keep, DenoiseStats &stats,
+                                 const std::vector<bool> *decide = nullptr);
+
+/// Denoise the ray cloud file @c file_name into @c out_name , by @c denoiseDistance if @c use_sigmas is false
+/// and otherwise by @c denoiseSigmas , with @c threshold as its distance or sigmas. The cloud is denoised in tiles, in
+/// parallel, by @c processInTiles . Every ray is decided by the one tile that owns it, and is written in file order, in
+/// a second read of the file. Tile rays are spilled to temporary files beside @c out_name , so memory is bounded by
+/// the tile size and a byte per ray, rather than the cloud size.
+/// The distance denoise has a halo of @c threshold , so gives the same result as denoising the whole cloud. The
+/// sigma denoise is not bounded in distance, so uses a halo of several point spacings, and an isolated ray with no
+/// neighbour within the halo is removed. Across several @c Nodes , node 0 gathers the other nodes' decisions and writes
+/// the output, and @c stats are of this node's tiles. Returns false if a file could not be read or written.
+bool RAYLIB_EXPORT denoiseInTiles(const std::string &file_name, const std::string &out_name, bool use_sigmas,
+                                  double threshold, DenoiseStats &stats);
+
+/// Removes the mixed-signal noise at range gaps, from rays given a chunk at a time in file order. Of each three
+/// adjacent rays, the middle is removed if it is bounded and its range differs from both neighbours' by at least
+/// @c range_distance , while the neighbours also differ by that much. The last two rays are held back for the next
+/// chunk, so only two rays are in memory between chunks. The first and last rays have no neighbour on one side, so
+/// are always removed.
+class RAYLIB_EXPORT RangeGapFilter
+{
+public:
+  explicit RangeGapFilter(double range_distance);
+
+  /// add to @c kept the rays of this chunk and the held back rays that are decided to be kept
+  void filter(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+              const std::vector<double> &times, const std::vector<RGBA> &colours, Cloud &kept);
+
+  /// the number of rays given so far that are not kept, including any held back rays
+  size_t numRemoved() const { return num_read_ - num_kept_; }
+
+private:
+  double range_distance_;
+  Eigen::Vector3d held_starts_[2];
+  Eigen::Vector3d held_ends_[2];
+  double held_times_[2];
+  RGBA held_colours_[2];
+  double held_ranges_[2];
+  size_t num_held_;
+  size_t num_read_;
+  size_t num_kept_;
+};
+
+/// Remove the range gap noise of the ray cloud file @c file_name into @c out_name , using a @c RangeGapFilter on each
+/// chunk as it is read, so in constant memory. @c num_removed is set to the number of rays removed. Returns false if
+/// a file could not be read or written.
+bool RAYLIB_EXPORT denoiseRangeGaps(const std::string &file_name, const std::string &out_name, double range_distance,
+                                    size_t &num_removed);
+}  // namespace ray
+
+#endif  // RAYLIB_RAYDENOISE_H
@@ -5,114 +5,98 @@
 // Author: Tom Lowe, Kazys Stepanas
 #include "rayellipsoid.h"
 
+#include "rayallocprofile.h"
 #include "raycloud.h"
+#include "raycompactcloud.h"
 #include "rayprogress.h"
+#include "raythreads.h"
 
 #include <nabo/nabo.h>
 
+#include <algorithm>
 #include <memory>
 
-#if RAYLIB_WITH_TBB
-#include <tbb/parallel_for.h>
-#endif  // RAYLIB_WITH_TBB
-
 namespace ray
 {
+namespace
+{
+/// rays per batch of neighbour searches and eigen solves, which bounds the memory of the neighbours
+const Eigen::Index kEllipsoidBatchSize = 1 << 16;
+}  // namespace
+
+template <class CloudT>
 void generateEllipsoids(std::vector<Ellipsoid> *ellipsoids, Eigen::Vector3d *bounds_min, Eigen::Vector3d *bounds_max,
-                        const Cloud &cloud, Progress *progress)
+                        const CloudT &cloud, Progress *progress)
 {
+  AllocationCategory category("ellipsoids");
   ellipsoids->clear();
   ellipsoids->resize(cloud.rayCount());
   const int search_size = std::min(16, (int)cloud.rayCount() - 1);
   const double max_double = std::numeric_limits<double>::max();
   Eigen::Vector3d ellipsoids_min(max_double, max_double, max_double);
   Eigen::Vector3d ellipsoids_max(-max_double, -max_double, -max_double);
-  Nabo::Parameters params("bucketSize", 8);
 
   if (progress)
   {
-    progress->begin("generateEllipsoids - KDTree", 2);
-  }
-
-  Eigen::MatrixXd points_p(3, cloud.ends.size());
-  for (size_t i = 0; i < cloud.rayCount(); ++i)
-  {
-    points_p.col(i) = cloud.ends[i];
+    progress->begin("generateEllipsoids - KDTree", 1);
   }
-  std::unique_ptr<Nabo::NNSearchD> nns(Nabo::NNSearchD::createKDTreeLinearHeap(points_p, 3));
 
-  // Run the search
-  Eigen::MatrixXi indices;
-  Eigen::MatrixXd dists2;
-  indices.resize(search_size, cloud.rayCount());
-  dists2.resize(search_size, cloud.rayCount());
-
-  if (progress)
-  {
-    progress->increment();
-  }
-  nns->knn(points_p, indices, dists2, search_size, kNearestNeighbourEpsilon, 0);
-  nns.reset(nullptr);
+  // the neighbours of all end points, including those of unbounded rays
+  const std::shared_ptr<const NeighbourIndex> index = cloud.neighbourIndex(false);
 
   if (progress)
   {
     progress->increment();
     progress->end();
-    progress->begin("generateEllipsoids", cloud.ends.size());
+    progress->begin("generateEllipsoids", cloud.rayCount());
   }
-  const auto generate_ellipsoid = [&](size_t i)  //
-  {
+  // ellipsoid i is fitted to the bounded points among its neighbours in column col of the neighbour indices, and
+  // returns false if there are too few of them
+  const auto neighbour_scatter = [&](size_t i, const Eigen::MatrixXi &indices, Eigen::Index col,
+                                     Eigen::Vector3d &centroid, Eigen::Matrix3d &scatter) {
     Ellipsoid &ellipsoid = (*ellipsoids)[i];
     ellipsoid.clear();
     ellipsoid.transient = false;
     ellipsoid.opacity = 1.0;
 
-    // Increment progress here as we have multiple exit points
-    if (progress)
-    {
-      progress->increment();
-    }
-
     if (!cloud.rayBounded(i))
     {
-      return;
+      return false;
     }
 
-    Eigen::Matrix3d scatter;
     scatter.setZero();
-    Eigen::Vector3d centroid(0, 0, 0);
+    centroid.setZero();
     double num_neighbours = 0;
-    for (int j = 0; j < search_size && indices(j, i) != Nabo::NNSearchD::InvalidIndex; ++j)
+    for (int j = 0; j < search_size && indices(j, col) != Nabo::NNSearchD::InvalidIndex; ++j)
     {
-      int index = indices(j, i);
+      int index = indices(j, col);
       if (cloud.rayBounded(index))
       {
-        centroid += cloud.ends[index];
+        centroid += cloud.rayEnd(index);
         num_neighbours++;
       }
     }
     if (num_neighbours < 4)
     {
-      return;
+      return false;
     }
     centroid /= num_neighbours;
-    for (int j = 0; j < search_size && indices(j, i) != Nabo::NNSearchD::InvalidIndex; j++)
+    for (int j = 0; j < search_size && indices(j, col) != Nabo::NNSearchD::InvalidIndex; j++)
     {
-      int index = indices(j, i);
+      int index = indices(j, col);
       if (cloud.rayBounded(index))
       {
-        Eigen::Vector3d offset = cloud.ends[index] - centroid;
+        Eigen::Vector3d offset = cloud.rayEnd(index) - centroid;
         scatter += offset * offset.transpose();
       }
     }
     scatter /= num_neighbours;
-
-    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eigen_solver(scatter.transpose());
-    ASSERT(eigen_solver.info() == Eigen::ComputationInfo::Success);
-
-    Eigen::Vector3d eigen_value = eigen_solver.eigenvalues();
-    Eigen::Matrix3d eigen_vector = eigen_solver.eigenvectors();
-
+    return true;
+  };
+  // ellipsoid i from the eigen decomposition of its scatter matrix
+  const auto set_ellipsoid = [&](size_t i, const Eigen::Vector3d &centroid, Eigen::Vector3d eigen_value,
+                                 const Eigen::Matrix3d &eigen_vector) {
+    Ellipsoid &ellipsoid = (*ellipsoids)[i];
     ellipsoid.pos = centroid;
     double scale = 1.7;  // this scale roughly matches the dimensions of a uniformly dense ellipsoid
     eigen_value[0] = scale * sqrt(std::max(1e-10, eigen_value[0]));
@@ -121,32 +105,67 @@ void generateEllipsoids(std::vector<Ellipsoid> *ellipsoids, Eigen::Vector3d *bou
     ellipsoid.eigen_mat.row(0) = eigen_vector.col(0) / eigen_value[0];
     ellipsoid.eigen_mat.row(1) = eigen_vector.col(1) / eigen_value[1];
     ellipsoid.eigen_mat.row(2) = eigen_vector.col(2) / eigen_value[2];
-    ellipsoid.time = cloud.times[i];
+    ellipsoid.time = cloud.rayTime(i);
     ellipsoid.setExtents(eigen_vector, eigen_value);
     ellipsoid.setPlanarity(eigen_value);
   };
 
-#if RAYLIB_WITH_TBB
-  tbb::parallel_for<size_t>(0, cloud.rayCount(), generate_ellipsoid);
-
-  for (size_t i = 0; i < ellipsoids->size(); ++i)
+  // Run the search a batch at a time, generating each batch's ellipsoids directly from its neighbours, so that the
+  // neighbours of the whole cloud are never held at once. Each batch's scatter matrices are decomposed in one batched
+  // eigen solve, which runs on the GPU when available
+  const Eigen::Index num_rays = static_cast<Eigen::Index>(cloud.rayCount());
+  Eigen::MatrixXi indices;
+  Eigen::MatrixXd dists2;
+  std::vector<int> fitted;
+  std::vector<Eigen::Vector3d> centroids, values;
+  std::vector<Eigen::Matrix3d> scatters, vectors;
+  for (Eigen::Index begin = 0; begin < num_rays; begin += kEllipsoidBatchSize)
   {
-    Ellipsoid &ellipsoid = (*ellipsoids)[i];
-    const auto ellipsoid_min = ellipsoid.pos - ellipsoid.extents;
-    const auto ellipsoid_max = ellipsoid.pos + ellipsoid.extents;
-
-    ellipsoids_min.x() = std::min(ellipsoids_min.x(), ellipsoid_min.x());
-    ellipsoids_min.y() = std::min(ellipsoids_min.y(), ellipsoid_min.y());
-    ellipsoids_min.z() = std::min(ellipsoids_min.z(), ellipsoid_min.z());
-    ellipsoids_max.x() = std::max(ellipsoids_max.x(), ellipsoid_max.x());
-    ellipsoids_max.y() = std::max(ellipsoids_max.y(), ellipsoid_max.y());
-    ellipsoids_max.z() = std::max(ellipsoids_max.z(), ellipsoid_max.z());
+    const Eigen::Index batch_size = std::min(kEllipsoidBatchSize, num_rays - begin);
+    if (search_size > 0)
+    {
+      index->knn(index->points().middleCols(begin, batch_size), search_size, indices, dists2,
+                 kNearestNeighbourEpsilon);
+    }
+    fitted.resize(static_cast<size_t>(batch_size));
+    centroids.resize(static_cast<size_t>(batch_size));
+    scatters.resize(static_cast<size_t>(batch_size));
+    // with too few points for any neighbours, every ellipsoid is left cleared
+    parallelFor(Eigen::Index(0), batch_size, [&](Eigen::Index b) {
+      fitted[b] = neighbour_scatter(static_cast<size_t>(begin + b), indices, b, centroids[b], scatters[b]) ? 1 : 0;
+    });
+    // only the fitted ellipsoids are solved, so fitted becomes the index of each in the solve, or -1
+    int num_fitted = 0;
+    for (size_t b = 0; b < fitted.size(); b++)
+    {
+      if (fitted[b])
+      {
+        centroids[num_fitted] = centroids[b];
+        scatters[num_fitted] = scatters[b];
+        fitted[b] = num_fitted++;
+      }
+      else
+      {
+        fitted[b] = -1;
+      }
+    }
+    scatters.resize(static_cast<size_t>(num_fitted));
+    eigenSolveBatch(scatters, values, vectors);
+    parallelFor(size_t(0), fitted.size(), [&](size_t b) {
+      const int f = fitted[b];
+      if (f >= 0)
+      {
+        set_ellipsoid(static_cast<size_t>(begin) + b, centroids[f], values[f], vectors[f]);
+      }
+    });
+    if (progress)
+    {
+      progress->increment(static_cast<size_t>(batch_size));
+    }
   }
-#else   // RAYLIB_WITH_TBB
-  for (size_t i = 0; i < cloud.rayCount(); ++i)
-  {
-    generate_ellipsoid(i);
 
+  for (size_t i = 0; i < ellipsoids->size(); ++i)
+  {
     Ellipsoid &ellipsoid = (*ellipsoids)[i];
     const auto ellipsoid_min = ellipsoid.pos - ellipsoid.extents;
     const auto ellipsoid_max = ellipsoid.pos + ellipsoid.extents;
@@ -158,7 +177,6 @@ void generateEllipsoids(std::vector<Ellipsoid> *ellipsoids, Eigen::Vector3d *bou
     ellipsoids_max.y() = std::max(ellipsoids_max.y(), ellipsoid_max.y());
     ellipsoids_max.z() = std::max(ellipsoids_max.z(), ellipsoid_max.z());
   }
-#endif  // RAYLIB_WITH_TBB
 
   if (bounds_min)
   {
@@ -170,4 +188,82 @@ void generateEllipsoids(std::vector<Ellipsoid> *ellipsoids, Eigen::Vector3d *bou
     *bounds_max = ellipsoids_max;
   }
 }
+
+void EllipsoidRayBatch::begin(const Eigen::Vector3d &centre)
+{
+  centre_ = centre;
+  size_ = 0;
+  for (int k = 0; k < 3; k++)
+  {
+    starts_[k].clear();
+    dirs_[k].clear();
+  }
+}
+
+void EllipsoidRayBatch::add(const Eigen::Vector3d &start, const Eigen::Vector3d &end)
+{
+  if (size_ % kPacketSize == 0)
+  {
+    // zero padding gives zero length rays, whose results are not returned
+    for (int k = 0; k < 3; k++)
+    {
+      starts_[k].resize(size_ + kPacketSize, 0.0f);
+      dirs_[k].resize(size_ + kPacketSize, 0.0f);
+    }
+  }
+  for (int k = 0; k < 3; k++)
+  {
+    starts_[k][size_] = static_cast<float>(start[k] - centre_[k]);
+    dirs_[k][size_] = static_cast<float>(end[k] - start[k]);
+  }
+  size_++;
+}
+
+void Ellipsoid::intersect(const EllipsoidRayBatch &rays, std::vector<IntersectResult> &results) const
+{
+  using Packet = Eigen::Array<float, EllipsoidRayBatch::kPacketSize, 1>;
+  using PacketMap = Eigen::Map<const Packet>;
+  const Eigen::Matrix3f mat = eigen_mat.cast<float>();
+  results.resize(rays.size());
+  for (size_t first = 0; first < rays.size(); first += EllipsoidRayBatch::kPacketSize)
+  {
+    const PacketMap sx(&rays.starts_[0][first]), sy(&rays.starts_[1][first]), sz(&rays.starts_[2][first]);
+    const PacketMap dx(&rays.dirs_[0][first]), dy(&rays.dirs_[1][first]), dz(&rays.dirs_[2][first]);
+
+    // the same steps as the single ray intersect, one packet of rays per operation
+    Packet ray[3], to[3];
+    for (int k = 0; k < 3; k++)
+    {
+      ray[k] = mat(k, 0) * dx + mat(k, 1) * dy + mat(k, 2) * dz;
+      to[k] = -(mat(k, 0) * sx + mat(k, 1) * sy + mat(k, 2) * sz);
+    }
+    const Packet ray_length_sqr = ray[0].square() + ray[1].square() + ray[2].square();
+    Packet d = (to[0] * ray[0] + to[1] * ray[1] + to[2] * ray[2]) / ray_length_sqr;
+    const Packet dist2 = (to[0] - ray[0] * d).square() + (to[1] - ray[1] * d).square() + (to[2] - ray[2] * d).square();
+    const Packet along_dist = (1.0f - dist2).sqrt();
+    const Packet ray_length = ray_length_sqr.sqrt();
+    d *= ray_length;
+    const float pass_distance = 0.05f;
+    const Packet ratio = pass_distance / (dx.square() + dy.square() + dz.square()).sqrt();
+
+    // comparisons are written as in the single ray intersect, so that degenerate rays are classified the same way
+    const auto miss = (dist2 > 1.0f) || (ray_length < d - along_dist);
+    const auto pass_through = ray_length * (1.0f - ratio) > d + along_dist;
+    using IntPacket = Eigen::Array<int, EllipsoidRayBatch::kPacketSize, 1>;
+    const IntPacket result =
+      miss.select(IntPacket::Constant(static_cast<int>(IntersectResult::Miss)),
+                  pass_through.select(IntPacket::Constant(static_cast<int>(IntersectResult::Passthrough)),
+                                      IntPacket::Constant(static_cast<int>(IntersectResult::Hit))));
+    const size_t count = std::min(rays.size() - first, static_cast<size_t>(EllipsoidRayBatch::kPacketSize));
+    for (size_t i = 0; i < count; i++)
+    {
+      results[first + i] = static_cast<IntersectResult>(result[i]);
+    }
+  }
+}
+
+template void generateEllipsoids<Cloud>(std::vector<Ellipsoid> *, Eigen::Vector3d *, Eigen::Vector3d *, const Cloud &,
+                                        Progress *);
+template void generateEllipsoids<CompactCloud>(std::vector<Ellipsoid> *, Eigen::Vector3d *, Eigen::Vector3d *,
+                                               const CompactCloud &, Progress *);
 }  // namespace ray
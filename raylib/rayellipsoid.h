@@ -25,6 +25,30 @@ enum class RAYLIB_EXPORT IntersectResult
   Hit,
 };
 
+/// A batch of rays to test against one ellipsoid with @c Ellipsoid::intersect , in single precision and
+/// structure-of-arrays form. Ray starts are stored relative to the ellipsoid centre, which keeps single precision
+/// accurate on georeferenced clouds. The arrays are padded to whole packets of @c kPacketSize rays.
+class RAYLIB_EXPORT EllipsoidRayBatch
+{
+public:
+  /// rays per packet. 16 floats are one AVX-512 register, or two AVX registers
+  static const int kPacketSize = 16;
+
+  /// start a new batch, for an ellipsoid centred at @c centre
+  void begin(const Eigen::Vector3d &centre);
+  /// add the ray from @c start to @c end
+  void add(const Eigen::Vector3d &start, const Eigen::Vector3d &end);
+  /// the number of rays added since @c begin()
+  inline size_t size() const { return size_; }
+
+private:
+  friend class Ellipsoid;
+  Eigen::Vector3d centre_;
+  std::vector<float> starts_[3];  // per axis, relative to centre_
+  std::vector<float> dirs_[3];    // per axis
+  size_t size_ = 0;
+};
+
 class RAYLIB_EXPORT Ellipsoid
 {
 public:
@@ -44,12 +68,18 @@ public:
   void setPlanarity(const Eigen::Vector3d &vals) { planarity = (vals[1] - vals[0]) / vals[1]; }
 
   IntersectResult intersect(const Eigen::Vector3d &start, const Eigen::Vector3d &end) const;
+  /// As @c intersect for each ray in @c rays , which must have been begun at this ellipsoid's centre. This tests a
+  /// packet of rays at a time, in single precision, so results may differ from @c intersect on rays that graze the
+  /// ellipsoid. @c results is resized to the number of rays.
+  void intersect(const EllipsoidRayBatch &rays, std::vector<IntersectResult> &results) const;
 };
 
 /// Convert the cloud into a list of ellipsoids, which represent a volume around each cloud point,
 /// shaped by the distribution of its neighbouring points.
+/// Instantiated for @c Cloud and @c CompactCloud
+template <class CloudT>
 void RAYLIB_EXPORT generateEllipsoids(std::vector<Ellipsoid> *ellipsoids, Eigen::Vector3d *bounds_min,
-                                      Eigen::Vector3d *bounds_max, const Cloud &cloud, Progress *progress = nullptr);
+                                      Eigen::Vector3d *bounds_max, const CloudT &cloud, Progress *progress = nullptr);
 
 inline void Ellipsoid::clear()
 {
@@ -6,6 +6,11 @@
 #include "rayfinealignment.h"
 #include <nabo/nabo.h>
 #include "raydebugdraw.h"
+#include "rayneighbours.h"
+
+#if RAYLIB_WITH_TBB
+#include <tbb/parallel_for.h>
+#endif  // RAYLIB_WITH_TBB
 
 namespace ray
 {
@@ -24,16 +29,14 @@ void FineAlignment::Surfel::draw(const std::vector<Surfel> &surfels, const Eigen
   DebugDraw::instance()->drawEllipsoids(centroids, matrices, widths, colour, 1);
 }
 
-// Convert the set of points into a covariance matrix, and from that into surfel information, using an
-// eigendecomposition
-void getSurfel(const std::vector<Eigen::Vector3d> &points, const std::vector<int> &ids, Eigen::Vector3d &centroid,
-               Eigen::Vector3d &width, Eigen::Matrix3d &mat)
+// Convert the set of points into a covariance matrix, for the eigendecomposition of @c getSurfel
+void getScatter(const std::vector<Eigen::Vector3d> &points, const std::vector<int> &ids, Eigen::Vector3d &centroid,
+                Eigen::Matrix3d &scatter)
 {
   Eigen::Vector3d total(0, 0, 0);
   for (auto &id : ids) total += points[id];
   centroid = total / (double)ids.size();
 
-  Eigen::Matrix3d scatter;
   scatter.setZero();
   for (auto &id : ids)
   {
@@ -41,14 +44,16 @@ void getSurfel(const std::vector<Eigen::Vector3d> &points, const std::vector<int
     scatter += offset * offset.transpose();
   }
   scatter / (double)ids.size();
+}
 
-  // eigendecomposition:
-  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> eigen_solver(scatter.transpose());
-  ASSERT(eigen_solver.info() == Eigen::ComputationInfo::Success);
-  width = ray::maxVector(eigen_solver.eigenvalues(), Eigen::Vector3d(1e-5, 1e-5, 1e-5));
+// Convert the eigendecomposition of a covariance matrix into surfel information
+void getSurfel(const Eigen::Vector3d &eigen_values, const Eigen::Matrix3d &eigen_vectors, Eigen::Vector3d &width,
+               Eigen::Matrix3d &mat)
+{
+  width = ray::maxVector(eigen_values, Eigen::Vector3d(1e-5, 1e-5, 1e-5));
   // ellipsoid radii are the square root because it is the decomposition of a covariance matrix
   width = Eigen::Vector3d(sqrt(width[0]), sqrt(width[1]), sqrt(width[2]));
-  mat = eigen_solver.eigenvectors();
+  mat = eigen_vectors;
   if (mat.determinant() < 0.0)
     mat.col(0) = -mat.col(0);  // make right-handed, so that we can convert to a quaternion for rendering
 }
@@ -56,131 +61,194 @@ void getSurfel(const std::vector<Eigen::Vector3d> &points, const std::vector<int
 // Convert clouds_[] into sets of surfels.
 void FineAlignment::generateSurfels()
 {
-  double point_spacings[2];
   double avg_max_spacing = 0.0;
   for (int c = 0; c < 2; c++)
   {
-    point_spacings[c] = clouds_[c].estimatePointSpacing();
-    ASSERT(point_spacings[c] >= 0.0);
-    const double min_spacing_scale = 2.0;
-    const double max_spacing_scale = 20.0;
-    double min_spacing = min_spacing_scale * point_spacings[c];
-    double max_spacing = max_spacing_scale * point_spacings[c];
-    avg_max_spacing += 0.5 * max_spacing;
-    if (verbose_)
-      std::cout << "fine alignment min voxel size: " << min_spacing << "m and maximum voxel size: " << max_spacing
-                << "m" << std::endl;
-
-    // 1. decimate quite fine
-    std::vector<int64_t> decimated;
-    ray::voxelSubsample(clouds_[c].ends, min_spacing, decimated);
-    std::vector<Eigen::Vector3d> decimated_points;
-    decimated_points.reserve(decimated.size());
-    std::vector<Eigen::Vector3d> decimated_starts;
-    decimated_starts.reserve(decimated.size());
-    centres_[c].setZero();
-    for (size_t i = 0; i < decimated.size(); i++)
-    {
-      if (clouds_[c].rayBounded((int)decimated[i]))
-      {
-        decimated_points.push_back(clouds_[c].ends[decimated[i]]);
-        centres_[c] += decimated_points.back();
-        decimated_starts.push_back(clouds_[c].starts[decimated[i]]);
-      }
-    }
-    centres_[c] /= (double)decimated_points.size();
-
-    // 2. find the coarser random candidate points. We just want a fairly even spread but not the voxel centres
-    std::vector<int64_t> candidates;
-    ray::voxelSubsample(decimated_points, max_spacing, candidates);
-    std::vector<Eigen::Vector3d> candidate_points(candidates.size());
-    std::vector<Eigen::Vector3d> candidate_starts(candidates.size());
-    for (int64_t i = 0; i < (int64_t)candidates.size(); i++)
+    CloudSurfels cloud_surfels = generateCloudSurfels(clouds_[c], verbose_, c);
+    surfels_[c] = c == 0 ? std::move(cloud_surfels.source) : std::move(cloud_surfels.target);
+    centres_[c] = cloud_surfels.centre;
+    avg_max_spacing += 0.5 * cloud_surfels.max_spacing;
+  }
+  translation_weight_ = 0.4 / avg_max_spacing;  // smaller finds matches further away
+  if (verbose_)
+    Surfel::draw(surfels_[1], Eigen::Vector3d(0, 1, 0));
+}
+
+FineAlignment::CloudSurfels FineAlignment::generateCloudSurfels(const Cloud &cloud, bool verbose, int debug_id)
+{
+  CloudSurfels result;
+  const double point_spacing = cloud.estimatePointSpacing();
+  ASSERT(point_spacing >= 0.0);
+  const double min_spacing_scale = 2.0;
+  const double max_spacing_scale = 20.0;
+  double min_spacing = min_spacing_scale * point_spacing;
+  double max_spacing = max_spacing_scale * point_spacing;
+  result.max_spacing = max_spacing;
+  if (verbose)
+    std::cout << "fine alignment min voxel size: " << min_spacing << "m and maximum voxel size: " << max_spacing
+              << "m" << std::endl;
+
+  // 1. decimate quite fine
+  std::vector<int64_t> decimated;
+  ray::voxelSubsample(cloud.ends, min_spacing, decimated);
+  std::vector<Eigen::Vector3d> decimated_points;
+  decimated_points.reserve(decimated.size());
+  std::vector<Eigen::Vector3d> decimated_starts;
+  decimated_starts.reserve(decimated.size());
+  result.centre.setZero();
+  for (size_t i = 0; i < decimated.size(); i++)
+  {
+    if (cloud.rayBounded((int)decimated[i]))
     {
-      candidate_points[i] = decimated_points[candidates[i]];
-      candidate_starts[i] = decimated_starts[candidates[i]];
+      decimated_points.push_back(cloud.ends[decimated[i]]);
+      result.centre += decimated_points.back();
+      decimated_starts.push_back(cloud.starts[decimated[i]]);
     }
+  }
+  result.centre /= (double)decimated_points.size();
 
-    // Now find all the finely decimated points that are close neighbours of each coarse candidate point
-    size_t q_size = candidates.size();
-    size_t p_size = decimated_points.size();
-    const int search_size = std::min(20, (int)p_size - 1);
-    Nabo::NNSearchD *nns;
-    Eigen::MatrixXd points_q(3, q_size);
-    for (size_t i = 0; i < q_size; i++) points_q.col(i) = candidate_points[i];
-    Eigen::MatrixXd points_p(3, p_size);
-    for (size_t i = 0; i < p_size; i++) points_p.col(i) = decimated_points[i];
-    nns = Nabo::NNSearchD::createKDTreeLinearHeap(points_p, 3);
+  // 2. find the coarser random candidate points. We just want a fairly even spread but not the voxel centres
+  std::vector<int64_t> candidates;
+  ray::voxelSubsample(decimated_points, max_spacing, candidates);
+  std::vector<Eigen::Vector3d> candidate_points(candidates.size());
+  std::vector<Eigen::Vector3d> candidate_starts(candidates.size());
+  for (int64_t i = 0; i < (int64_t)candidates.size(); i++)
+  {
+    candidate_points[i] = decimated_points[candidates[i]];
+    candidate_starts[i] = decimated_starts[candidates[i]];
+  }
 
-    // Run the search
-    Eigen::MatrixXi indices;
-    Eigen::MatrixXd dists2;
-    indices.resize(search_size, q_size);
-    dists2.resize(search_size, q_size);
-    nns->knn(points_q, indices, dists2, search_size, 0.01 * max_spacing, 0, max_spacing);
-    delete nns;
+  // Now find all the finely decimated points that are close neighbours of each coarse candidate point
+  size_t q_size = candidates.size();
+  size_t p_size = decimated_points.size();
+  const int search_size = std::min(20, (int)p_size - 1);
+  Eigen::MatrixXd points_q(3, q_size);
+  for (size_t i = 0; i < q_size; i++) points_q.col(i) = candidate_points[i];
+  Eigen::MatrixXd points_p(3, p_size);
+  for (size_t i = 0; i < p_size; i++) points_p.col(i) = decimated_points[i];
+  const NeighbourIndex index(std::move(points_p));
+
+  // Run the search
+  Eigen::MatrixXi indices;
+  Eigen::MatrixXd dists2;
+  index.knn(points_q, search_size, indices, dists2, 0.01 * max_spacing, max_spacing);
 
-    // Convert these set of nearest neighbours into surfels
-    surfels_[c].reserve(q_size);
+  // Convert these set of nearest neighbours into surfels. The eigen solves are batched, first for every candidate that
+  // is dense enough, then for the planar candidates without their back facing points
+  const size_t min_points_per_ellipsoid = 5;
+  std::vector<std::vector<int>> neighbours;
+  std::vector<size_t> dense;
+  std::vector<Eigen::Vector3d> centroids;
+  std::vector<Eigen::Matrix3d> scatters;
+  for (size_t i = 0; i < q_size; i++)
+  {
     std::vector<int> ids;
-    ids.reserve(search_size);
-    const size_t min_points_per_ellipsoid = 5;
-    for (size_t i = 0; i < q_size; i++)
-    {
-      ids.clear();
-      for (int j = 0; j < search_size && indices(j, i) != Nabo::NNSearchD::InvalidIndex; j++) ids.push_back(indices(j, i));
-      if (ids.size() < min_points_per_ellipsoid)  // not dense enough
-        continue;
+    for (int j = 0; j < search_size && indices(j, i) != Nabo::NNSearchD::InvalidIndex; j++) ids.push_back(indices(j, i));
+    if (ids.size() < min_points_per_ellipsoid)  // not dense enough
+      continue;
+    Eigen::Vector3d centroid;
+    Eigen::Matrix3d scatter;
+    getScatter(decimated_points, ids, centroid, scatter);
+    dense.push_back(i);
+    neighbours.push_back(std::move(ids));
+    centroids.push_back(centroid);
+    scatters.push_back(scatter);
+  }
+  std::vector<Eigen::Vector3d> values;
+  std::vector<Eigen::Matrix3d> vectors;
+  eigenSolveBatch(scatters, values, vectors);
 
-      Eigen::Vector3d centroid;
-      Eigen::Vector3d width;
-      Eigen::Matrix3d mat;
-      getSurfel(decimated_points, ids, centroid, width, mat);
-      double q1 = width[0] / width[1];
-      double q2 = width[1] / width[2];
-      if (q2 < q1)  // cylindrical
-      {
-        if (q2 > 0.5)  // not cylinderical enough
-          continue;
-        // register two ellipsoids as the normal is ambiguous
-        surfels_[c].push_back(Surfel(centroid, mat, width, mat.col(2), false));
-        if (c == 1)
-          surfels_[c].push_back(Surfel(centroid, mat, width, -mat.col(2), false));
-      }
-      else  // planar
+  // the index of each dense candidate in the planar solve, or -1 if it is not planar. Cylindrical candidates are -2
+  const int kNotPlanar = -1, kCylindrical = -2;
+  std::vector<int> planar(dense.size(), kNotPlanar);
+  std::vector<Eigen::Vector3d> planar_centroids;
+  std::vector<Eigen::Matrix3d> planar_scatters;
+  for (size_t d = 0; d < dense.size(); d++)
+  {
+    Eigen::Vector3d width;
+    Eigen::Matrix3d mat;
+    getSurfel(values[d], vectors[d], width, mat);
+    double q1 = width[0] / width[1];
+    double q2 = width[1] / width[2];
+    if (q2 < q1)  // cylindrical
+    {
+      if (!(q2 > 0.5))  // cylindrical enough
+        planar[d] = kCylindrical;
+      continue;
+    }
+    // planar
+    const size_t i = dense[d];
+    Eigen::Vector3d normal = mat.col(0);
+    if ((centroids[d] - candidate_starts[i]).dot(normal) > 0.0)
+      normal = -normal;
+    // now repeat but removing back facing points. This deals better with double walls, which are quite common
+    std::vector<int> &ids = neighbours[d];
+    for (int j = (int)ids.size() - 1; j >= 0; j--)
+    {
+      int id = ids[j];
+      if ((decimated_points[id] - decimated_starts[id]).dot(normal) > 0.0)
       {
-        Eigen::Vector3d normal = mat.col(0);
-        if ((centroid - candidate_starts[i]).dot(normal) > 0.0)
-          normal = -normal;
-        // now repeat but removing back facing points. This deals better with double walls, which are quite common
-        for (int j = (int)ids.size() - 1; j >= 0; j--)
-        {
-          int id = ids[j];
-          if ((decimated_points[id] - decimated_starts[id]).dot(normal) > 0.0)
-          {
-            ids[j] = ids.back();
-            ids.pop_back();
-          }
-        }
-        if (ids.size() < min_points_per_ellipsoid)  // not dense enough
-          continue;
-        getSurfel(decimated_points, ids, centroid, width, mat);
-        normal = mat.col(0);
-        double q1 = width[0] / width[1];
-
-        if (q1 > 0.5)  // not planar enough
-          continue;
-        if ((centroid - candidate_starts[i]).dot(normal) > 0.0)
-          normal = -normal;
-        surfels_[c].push_back(Surfel(centroid, mat, width, normal, true));
+        ids[j] = ids.back();
+        ids.pop_back();
       }
     }
-    if (verbose_)
-      DebugDraw::instance()->drawCloud(decimated_points, 0.5 + 0.4 * (double)c, c);
+    if (ids.size() < min_points_per_ellipsoid)  // not dense enough
+      continue;
+    Eigen::Vector3d centroid;
+    Eigen::Matrix3d scatter;
+    getScatter(decimated_points, ids, centroid, scatter);
+    planar[d] = static_cast<int>(planar_scatters.size());
+    planar_centroids.push_back(centroid);
+    planar_scatters.push_back(scatter);
   }
-  translation_weight_ = 0.4 / avg_max_spacing;  // smaller finds matches further away
-  if (verbose_)
-    Surfel::draw(surfels_[1], Eigen::Vector3d(0, 1, 0));
+  std::vector<Eigen::Vector3d> planar_values;
+  std::vector<Eigen::Matrix3d> planar_vectors;
+  eigenSolveBatch(planar_scatters, planar_values, planar_vectors);
+
+  // the surfels are added in candidate order
+  result.source.reserve(q_size);
+  result.target.reserve(q_size);
+  for (size_t d = 0; d < dense.size(); d++)
+  {
+    Eigen::Vector3d width;
+    Eigen::Matrix3d mat;
+    if (planar[d] == kCylindrical)
+    {
+      getSurfel(values[d], vectors[d], width, mat);
+      const Eigen::Vector3d &centroid = centroids[d];
+      // register two ellipsoids as the normal is ambiguous
+      result.source.push_back(Surfel(centroid, mat, width, mat.col(2), false));
+      result.target.push_back(Surfel(centroid, mat, width, mat.col(2), false));
+      result.target.push_back(Surfel(centroid, mat, width, -mat.col(2), false));
+    }
+    else if (planar[d] != kNotPlanar)
+    {
+      const int p = planar[d];
+      getSurfel(planar_values[p], planar_vectors[p], width, mat);
+      const Eigen::Vector3d &centroid = planar_centroids[p];
+      Eigen::Vector3d normal = mat.col(0);
+      double q1 = width[0] / width[1];
+
+      if (q1 > 0.5)  // not planar enough
+        continue;
+      if ((centroid - candidate_starts[dense[d]]).dot(normal) > 0.0)
+        normal = -normal;
+      result.source.push_back(Surfel(centroid, mat, width, normal, true));
+      result.target.push_back(result.source.back());
+    }
+  }
+  if (verbose)
+    DebugDraw::instance()->drawCloud(decimated_points, 0.5 + 0.4 * (double)debug_id, debug_id);
+  return result;
+}
+
+Eigen::Matrix<double, 7, 1> FineAlignment::searchPoint(const Surfel &s) const
+{
+  Eigen::Vector3d p = s.centroid * translation_weight_;
+  p[2] *= 2.0;  // doen't make much difference...
+  Eigen::Matrix<double, 7, 1> point;
+  point << p, s.normal, s.is_plane ? 1.0 : 0.0;
+  return point;
 }
 
 // Match surfels_[0] to surfels_[1] based on proximity, normal difference and whether it is a plane or cylinder
@@ -188,66 +256,111 @@ void FineAlignment::generateSurfelMatches(std::vector<Match> &matches)
 {
   std::vector<Eigen::Vector3d> line_starts;
   std::vector<Eigen::Vector3d> line_ends;
-  int search_size = 1;
   size_t q_size = surfels_[0].size();
   size_t p_size = surfels_[1].size();
-  Nabo::NNSearchD *nns;
-  Eigen::MatrixXd points_q(7, q_size);
-  for (size_t i = 0; i < q_size; i++)
+  if (!surfel_index_)  // surfels_[1] never moves, so its index is built once
   {
-    Surfel &s = surfels_[0][i];
-    Eigen::Vector3d p = s.centroid * translation_weight_;
-    p[2] *= 2.0;  // doen't make much difference...
-    points_q.col(i) << p, s.normal, s.is_plane ? 1.0 : 0.0;
+    Eigen::MatrixXd points_p(7, p_size);
+    for (size_t i = 0; i < p_size; i++) points_p.col(i) = searchPoint(surfels_[1][i]);
+    surfel_index_ = std::make_shared<const NeighbourIndex>(std::move(points_p));
+    neighbour_queries_.clear();
   }
-  Eigen::MatrixXd points_p(7, p_size);
-  for (size_t i = 0; i < p_size; i++)
-  {
-    Surfel &s = surfels_[1][i];
-    Eigen::Vector3d p = s.centroid * translation_weight_;
-    p[2] *= 2.0;
-    points_p.col(i) << p, s.normal, s.is_plane ? 1.0 : 0.0;
-  }
-  nns = Nabo::NNSearchD::createKDTreeLinearHeap(points_p, 7);
-
-  // Run the search
-  Eigen::MatrixXi indices;
-  Eigen::MatrixXd dists2;
-  indices.resize(search_size, q_size);
-  dists2.resize(search_size, q_size);
-  nns->knn(points_q, indices, dists2, search_size, ray::kNearestNeighbourEpsilon * max_normal_difference_, 0,
-           max_normal_difference_);
-  delete nns;
 
-  for (int i = 0; i < (int)q_size; i++)
+  // A surfel that has moved by distance delta in the search space keeps its previous nearest neighbour while that
+  // neighbour remains nearer than delta less the previous distance to all other surfels. It has no neighbour while
+  // that lower bound exceeds the search radius. The queries look a little beyond the search radius to widen the bound.
+  const double max_radius = max_normal_difference_;
+  const double query_radius = 1.5 * max_radius;
+  std::vector<int> requeries;
+  for (size_t i = 0; i < q_size; i++)
   {
-    for (int j = 0; j < search_size && indices(j, i) != Nabo::NNSearchD::InvalidIndex; j++)
+    if (i >= neighbour_queries_.size())
     {
-      Match match;
-      match.ids[0] = i;
-      match.ids[1] = indices(j, i);
-      Surfel &s0 = surfels_[0][i];
-      Surfel &s1 = surfels_[1][indices(j, i)];
-      if (s0.is_plane != s1.is_plane)
-        continue;
-      Eigen::Vector3d mid_norm = (s0.normal + s1.normal).normalized();
-      if (s0.is_plane)
+      requeries.push_back((int)i);
+      continue;
+    }
+    NeighbourQuery &query = neighbour_queries_[i];
+    const Eigen::Matrix<double, 7, 1> point = searchPoint(surfels_[0][i]);
+    const double others_bound = query.others_distance - (point - query.point).norm();
+    bool unchanged = others_bound > max_radius;
+    if (query.neighbour >= 0)
+    {
+      const double distance = (point - surfel_index_->points().col(query.neighbour)).norm();
+      unchanged = unchanged || (distance > 0.0 && distance < others_bound);
+      if (unchanged && (distance > max_radius || distance <= 0.0))
       {
-        match.normal = mid_norm;
-        matches.push_back(match);
+        // the neighbour has moved out of range (or onto the search point), and no other surfel can be in range
+        query.neighbour = -1;
+        query.others_distance = query.distance;
       }
-      else
+    }
+    if (!unchanged)
+      requeries.push_back((int)i);
+  }
+  if (verbose_)
+    std::cout << "matching " << requeries.size() << " of " << q_size << " surfels" << std::endl;
+  if (!requeries.empty())
+  {
+    Eigen::MatrixXd points_q(7, requeries.size());
+    for (size_t i = 0; i < requeries.size(); i++) points_q.col(i) = searchPoint(surfels_[0][requeries[i]]);
+
+    // Run the search
+    const int search_size = std::min(2, (int)p_size);
+    Eigen::MatrixXi indices;
+    Eigen::MatrixXd dists2;
+    if (search_size > 0)
+      surfel_index_->knn(points_q, search_size, indices, dists2, ray::kNearestNeighbourEpsilon * max_radius,
+                         query_radius);
+    neighbour_queries_.resize(q_size);
+    for (size_t i = 0; i < requeries.size(); i++)
+    {
+      NeighbourQuery &query = neighbour_queries_[requeries[i]];
+      query.point = points_q.col(i);
+      query.neighbour = -1;
+      query.distance = 0.0;
+      query.others_distance = query_radius;
+      if (search_size > 0 && indices(0, i) != Nabo::NNSearchD::InvalidIndex)
       {
-        // a cylinder is like two normal constraints
-        match.normal = mid_norm.cross(Eigen::Vector3d(1, 2, 3)).normalized();
-        matches.push_back(match);
-        match.normal = mid_norm.cross(match.normal);
-        matches.push_back(match);
+        query.distance = std::sqrt(dists2(0, i));
+        if (query.distance <= max_radius)
+          query.neighbour = indices(0, i);
+        if (search_size > 1 && indices(1, i) != Nabo::NNSearchD::InvalidIndex)
+          query.others_distance = std::sqrt(dists2(1, i));
+        if (query.neighbour < 0)  // the nearest surfel is out of range, so it bounds the others
+          query.others_distance = query.distance;
       }
-      line_starts.push_back(s0.centroid);
-      line_ends.push_back(s1.centroid);
     }
   }
+
+  for (int i = 0; i < (int)q_size; i++)
+  {
+    const int neighbour = neighbour_queries_[i].neighbour;
+    if (neighbour < 0)
+      continue;
+    Match match;
+    match.ids[0] = i;
+    match.ids[1] = neighbour;
+    Surfel &s0 = surfels_[0][i];
+    Surfel &s1 = surfels_[1][neighbour];
+    if (s0.is_plane != s1.is_plane)
+      continue;
+    Eigen::Vector3d mid_norm = (s0.normal + s1.normal).normalized();
+    if (s0.is_plane)
+    {
+      match.normal = mid_norm;
+      matches.push_back(match);
+    }
+    else
+    {
+      // a cylinder is like two normal constraints
+      match.normal = mid_norm.cross(Eigen::Vector3d(1, 2, 3)).normalized();
+      matches.push_back(match);
+      match.normal = mid_norm.cross(match.normal);
+      matches.push_back(match);
+    }
+    line_starts.push_back(s0.centroid);
+    line_ends.push_back(s1.centroid);
+  }
   if (verbose_)
   {
     DebugDraw::instance()->drawLines(line_starts, line_ends);
@@ -259,10 +372,7 @@ void FineAlignment::generateSurfelMatches(std::vector<Match> &matches)
 void FineAlignment::buildLinearSystem(const std::vector<Match> &matches, double d, FineAlignment::LinearSystem &system)
 {
   // don't go above 30*... or below 10*...
-  double square_error = 0.0;
-  for (size_t i = 0; i < matches.size(); i++)
-  {
-    auto &match = matches[i];
+  auto add_match = [&](const Match &match, LinearSystem &partial, double &square_error) {
     Surfel &s0 = surfels_[0][match.ids[0]];
     Surfel &s1 = surfels_[1][match.ids[1]];
     Eigen::Vector3d positions[2] = { s0.centroid, s1.centroid };
@@ -303,8 +413,31 @@ void FineAlignment::buildLinearSystem(const std::vector<Match> &matches, double
       a[10] = positions[0][0] * positions[0][1] * match.normal[0];
       a[11] = positions[0][0] * positions[0][1] * match.normal[1];
     }
-    system.At_A += a.transpose() * weight * a;
-    system.At_b += a.transpose() * weight * error;
+    partial.At_A += a.transpose() * weight * a;
+    partial.At_b += a.transpose() * weight * error;
+  };
+
+  // Sum the matches in fixed size blocks, then sum the blocks in order, so that the result does not depend on the
+  // number of threads
+  const size_t block_size = 256;
+  const size_t num_blocks = (matches.size() + block_size - 1) / block_size;
+  std::vector<LinearSystem, Eigen::aligned_allocator<LinearSystem>> block_systems(num_blocks);
+  std::vector<double> block_square_errors(num_blocks, 0.0);
+  auto add_block = [&](size_t b) {
+    const size_t end = std::min(matches.size(), (b + 1) * block_size);
+    for (size_t i = b * block_size; i < end; i++) add_match(matches[i], block_systems[b], block_square_errors[b]);
+  };
+#if RAYLIB_WITH_TBB
+  tbb::parallel_for<size_t>(0, num_blocks, add_block);
+#else   // RAYLIB_WITH_TBB
+  for (size_t b = 0; b < num_blocks; b++) add_block(b);
+#endif  // RAYLIB_WITH_TBB
+  double square_error = 0.0;
+  for (size_t b = 0; b < num_blocks; b++)
+  {
+    system.At_A += block_systems[b].At_A;
+    system.At_b += block_systems[b].At_b;
+    square_error += block_square_errors[b];
   }
   if (verbose_)
     std::cout << "rmse: " << sqrt(square_error / (double)matches.size()) << std::endl;
@@ -337,6 +470,8 @@ void FineAlignment::updateLinearSystem(std::vector<Match> &matches, const Quadra
 
   // NOTE: transforming the whole cloud each time is a bit slow,
   // we should be able to concatenate these transforms and only apply them once at the end
+  if (!clouds_)
+    return;  // aligning surfels only
   for (auto &end : clouds_[0].ends)
   {
     Eigen::Vector3d relPos = end - centres_[0];
@@ -353,7 +488,12 @@ void FineAlignment::align()
   // Decimate again to pick one point per cubic 1m (for instance)
   // Now match the closest X points in 1 to those in 2, and generate surfel per point in 2.
   generateSurfels();
+  iterate();
+}
 
+Pose FineAlignment::iterate(int *num_matches)
+{
+  Pose transformation(Eigen::Vector3d(0, 0, 0), Eigen::Quaterniond::Identity());
   // Iteratively reweighted least squares. Iteration loop:
   int max_iterations = 8;
   for (int it = 0; it < max_iterations; it++)
@@ -361,6 +501,8 @@ void FineAlignment::align()
     // Match surfels in cloud0 to those in cloud1
     std::vector<Match> matches;
     generateSurfelMatches(matches);
+    if (num_matches)
+      *num_matches = (int)matches.size();
 
     // Convert the match constraints into a linear system
     LinearSystem system;
@@ -372,7 +514,19 @@ void FineAlignment::align()
 
     // Update the ray cloud and surfels from on the transformation of best fit
     updateLinearSystem(matches, perturbation);
+    transformation = perturbation.getEuclideanPart() * transformation;
   }
+  return transformation;
 }
 
+Pose FineAlignment::alignSurfels(const CloudSurfels &source, const CloudSurfels &target, int *num_matches)
+{
+  FineAlignment aligner(nullptr, false, false);
+  aligner.surfels_[0] = source.source;
+  aligner.surfels_[1] = target.target;
+  aligner.centres_[0] = source.centre;
+  aligner.centres_[1] = target.centre;
+  aligner.translation_weight_ = 0.4 / (0.5 * (source.max_spacing + target.max_spacing));
+  return aligner.iterate(num_matches);
+}
 }  // namespace ray
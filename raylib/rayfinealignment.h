@@ -11,9 +11,13 @@
 #include "raycloud.h"
 #include "rayutils.h"
 
+#include <memory>
+
 
 namespace ray
 {
+class NeighbourIndex;
+
 /// Class for fine alignment of two ray clouds.
 /// Being a gradient-descent based method, it requires the ray clouds to be nearly aligned at the start.
 /// This means that the nearest surface on one ray cloud should be corresponding surface on the other cloud most of the
@@ -35,7 +39,6 @@ public:
   /// for slight bend or warping within the cloud.
   void align();
 
-private:
   /// Surfel object, suited to this alignment method
   struct RAYLIB_EXPORT Surfel
   {
@@ -57,6 +60,26 @@ private:
     static void draw(const std::vector<Surfel> &surfels, const Eigen::Vector3d &colour);
   };
 
+  /// The surfels of one cloud, which can be generated once and used in any number of alignments
+  struct RAYLIB_EXPORT CloudSurfels
+  {
+    std::vector<Surfel> source;  // the surfels for aligning this cloud to another
+    std::vector<Surfel> target;  // the surfels for aligning another cloud to this one
+    double max_spacing;          // the neighbourhood size used for the surfels
+    Eigen::Vector3d centre;      // mean of the decimated end points
+  };
+
+  /// Generate the surfels of @c cloud . @c verbose draws the decimated points, shaded by @c debug_id
+  static CloudSurfels generateCloudSurfels(const Cloud &cloud, bool verbose = false, int debug_id = 0);
+
+  /// Rigidly align the cloud of surfels @c source to that of @c target , returning the transformation of the
+  /// source cloud. Neither cloud is modified. @c num_matches optionally returns the number of surfel matches used in
+  /// the final iteration, as a measure of the overlap.
+  static Pose alignSurfels(const CloudSurfels &source, const CloudSurfels &target, int *num_matches = nullptr);
+
+private:
+
+private:
   /// Identify matches between surfels by ID
   struct Match
   {
@@ -64,6 +87,16 @@ private:
     Eigen::Vector3d normal;
   };
 
+  /// The nearest neighbour of a surfels_[0] surfel, as found by its last neighbour query. This stays the nearest
+  /// neighbour until the surfel's search point has moved far enough that another surfel could be nearer.
+  struct NeighbourQuery
+  {
+    Eigen::Matrix<double, 7, 1> point;  // the search point at the time of the query
+    int neighbour;                      // the surfels_[1] index of the nearest neighbour, or -1 if none
+    double distance;                    // distance to the nearest neighbour at the time of the query
+    double others_distance;             // a lower bound on the distance to any other surfel at the time of the query
+  };
+
   /// A simple linear system structure. For solving Ax=b in least squares form (as AtA=Atb where t is transposition).
   struct LinearSystem
   {
@@ -101,7 +134,14 @@ private:
 
   /// Create surfels per voxel of a vexelisation of the ray end points
   void generateSurfels();
-  /// Find the list of correspondences between the two surfel sets surfels_[0] and surfels_[1]
+  /// The iterative alignment of surfels_[0] to surfels_[1]. Returns the rigid transformation applied, and
+  /// optionally the number of matches in the final iteration
+  Pose iterate(int *num_matches = nullptr);
+  /// The point in the 7D match search space of surfel @c s
+  Eigen::Matrix<double, 7, 1> searchPoint(const Surfel &s) const;
+  /// Find the list of correspondences between the two surfel sets surfels_[0] and surfels_[1]. The neighbour index
+  /// over surfels_[1] is built on the first call and reused, and only the surfels_[0] neighbours that could have
+  /// changed since the previous call are searched again.
   void generateSurfelMatches(std::vector<Match> &matches);
   /// Convert the matches into a linear system
   void buildLinearSystem(const std::vector<Match> &matches, double d, FineAlignment::LinearSystem &system);
@@ -118,6 +158,8 @@ private:
   std::vector<Surfel> surfels_[2];
   double translation_weight_;
   Eigen::Vector3d centres_[2];
+  std::shared_ptr<const NeighbourIndex> surfel_index_;  // search points of surfels_[1]
+  std::vector<NeighbourQuery> neighbour_queries_;      // per surfels_[0] surfel
 };
 }  // namespace ray
 
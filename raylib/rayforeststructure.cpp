@@ -4,11 +4,195 @@
 //
 // Author: Thomas Lowe
 #include "rayforeststructure.h"
+#include "raymappedfile.h"
 // #define OUTPUT_MOMENTS  // used in unit tests
+#include <cstring>
 #include <unordered_map>
 
 namespace ray
 {
+namespace
+{
+const char kTreeMagic[4] = { 'R', 'T', 'R', 'E' };
+const uint32_t kTreeVersion = 1;
+
+/// @c size rounded up to the 8 byte alignment of the columns of the binary tree file
+size_t aligned(size_t size)
+{
+  return (size + 7) & ~static_cast<size_t>(7);
+}
+
+template <class T>
+void writeValue(std::ofstream &out, const T &value)
+{
+  out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+/// write a column of the binary tree file, padded to the alignment of the next
+template <class T>
+void writeColumn(std::ofstream &out, const std::vector<T> &column)
+{
+  const size_t size = column.size() * sizeof(T);
+  const char padding[8] = {};
+  out.write(reinterpret_cast<const char *>(column.data()), static_cast<std::streamsize>(size));
+  out.write(padding, static_cast<std::streamsize>(aligned(size) - size));
+}
+
+/// bounds checked reading of the bytes of a binary tree file
+class TreeFileReader
+{
+public:
+  TreeFileReader(const unsigned char *data, size_t size)
+    : data_(data)
+    , size_(size)
+    , pos_(0)
+  {}
+  template <class T>
+  bool read(T &value)
+  {
+    if (pos_ > size_ || size_ - pos_ < sizeof(T))
+    {
+      return false;
+    }
+    std::memcpy(&value, data_ + pos_, sizeof(T));
+    pos_ += sizeof(T);
+    return true;
+  }
+  bool readString(std::string &text, size_t length)
+  {
+    if (pos_ > size_ || size_ - pos_ < length)
+    {
+      return false;
+    }
+    text.assign(reinterpret_cast<const char *>(data_ + pos_), length);
+    pos_ += length;
+    return true;
+  }
+  /// the start of the next column, of @c count values of type @c T, or nullptr if the file is too short
+  template <class T>
+  const unsigned char *column(size_t count)
+  {
+    pos_ = aligned(pos_);
+    if (pos_ > size_ || (size_ - pos_) / sizeof(T) < count)
+    {
+      return nullptr;
+    }
+    const unsigned char *start = data_ + pos_;
+    pos_ += count * sizeof(T);
+    return start;
+  }
+
+private:
+  const unsigned char *data_;
+  size_t size_;
+  size_t pos_;
+};
+
+/// value @c i of a column, which is copied as the mapping need not be aligned for @c T
+template <class T>
+T columnValue(const unsigned char *column, size_t i)
+{
+  T value;
+  std::memcpy(&value, column + i * sizeof(T), sizeof(T));
+  return value;
+}
+
+/// parse the bytes of a binary tree file, adding its trees to @c trees
+bool parseBinaryTrees(const unsigned char *data, size_t size, const std::string &filename,
+                      std::vector<TreeStructure> &trees)
+{
+  TreeFileReader reader(data, size);
+  char magic[4];
+  uint32_t version, num_attributes, reserved;
+  uint64_t num_trees, num_segments;
+  if (!reader.read(magic) || std::memcmp(magic, kTreeMagic, 4) != 0 || !reader.read(version) ||
+      version != kTreeVersion || !reader.read(num_attributes) || !reader.read(reserved) || !reader.read(num_trees) ||
+      !reader.read(num_segments))
+  {
+    std::cerr << "Error: unrecognised binary tree file " << filename << std::endl;
+    return false;
+  }
+  std::vector<std::string> attributes(num_attributes);
+  for (auto &attribute : attributes)
+  {
+    uint32_t length;
+    if (!reader.read(length) || !reader.readString(attribute, length))
+    {
+      std::cerr << "Error: truncated binary tree file " << filename << std::endl;
+      return false;
+    }
+  }
+  if (attributes.size() > 0)
+  {
+    std::cout << "reading extra tree attributes: ";
+    for (auto &at : attributes) std::cout << at << "; ";
+    std::cout << std::endl;
+  }
+  const unsigned char *tree_starts = reader.column<uint64_t>(num_trees + 1);
+  const unsigned char *tips[3] = { reader.column<double>(num_segments), reader.column<double>(num_segments),
+                                   reader.column<double>(num_segments) };
+  const unsigned char *radii = reader.column<double>(num_segments);
+  const unsigned char *parent_ids = reader.column<int32_t>(num_segments);
+  std::vector<const unsigned char *> attribute_columns(num_attributes);
+  for (auto &column : attribute_columns) column = reader.column<double>(num_segments);
+  if (!tree_starts || !tips[0] || !tips[1] || !tips[2] || !radii || !parent_ids ||
+      std::find(attribute_columns.begin(), attribute_columns.end(), nullptr) != attribute_columns.end())
+  {
+    std::cerr << "Error: truncated binary tree file " << filename << std::endl;
+    return false;
+  }
+
+  trees.reserve(trees.size() + num_trees);
+  for (size_t t = 0; t < num_trees; t++)
+  {
+    const uint64_t start = columnValue<uint64_t>(tree_starts, t);
+    const uint64_t end = columnValue<uint64_t>(tree_starts, t + 1);
+    if (start >= end || end > num_segments)
+    {
+      std::cerr << "Error: tree " << t << " has no segments in binary tree file " << filename << std::endl;
+      return false;
+    }
+    TreeStructure tree;
+    tree.attributes() = attributes;
+    tree.segments().resize(static_cast<size_t>(end - start));
+    for (size_t i = 0; i < tree.segments().size(); i++)
+    {
+      TreeStructure::Segment &segment = tree.segments()[i];
+      const size_t j = static_cast<size_t>(start) + i;
+      segment.tip = Eigen::Vector3d(columnValue<double>(tips[0], j), columnValue<double>(tips[1], j),
+                                    columnValue<double>(tips[2], j));
+      segment.radius = columnValue<double>(radii, j);
+      segment.parent_id = columnValue<int32_t>(parent_ids, j);
+      segment.attributes.resize(num_attributes);
+      for (size_t a = 0; a < num_attributes; a++)
+      {
+        segment.attributes[a] = columnValue<double>(attribute_columns[a], j);
+      }
+    }
+    trees.push_back(std::move(tree));
+  }
+  return !trees.empty();
+}
+
+/// load a binary tree file from a memory mapping, or from a stream where the file cannot be mapped
+bool loadBinaryTrees(const std::string &filename, std::vector<TreeStructure> &trees)
+{
+  MappedFile mapping;
+  if (mapping.open(filename))
+  {
+    return parseBinaryTrees(mapping.data(), mapping.size(), filename, trees);
+  }
+  std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
+  if (!ifs.is_open())
+  {
+    std::cerr << "Error: cannot open " << filename << std::endl;
+    return false;
+  }
+  std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+  return parseBinaryTrees(bytes.data(), bytes.size(), filename, trees);
+}
+}  // namespace
+
 Eigen::Array<double, 9, 1> ForestStructure::getMoments() const
 {
   Eigen::Array<double, 9, 1> moments;
@@ -75,6 +259,10 @@ Eigen::Array<double, 9, 1> ForestStructure::getMoments() const
 bool ForestStructure::load(const std::string &filename)
 {
   std::cout << "loading tree file: " << filename << std::endl;
+  if (isBinaryFile(filename))
+  {
+    return loadBinaryTrees(filename, trees);
+  }
   std::ifstream ifs(filename.c_str(), std::ios::in);
   if (!ifs.is_open())
   {
@@ -270,4 +458,72 @@ bool ForestStructure::save(const std::string &filename)
   }
   return true;
 }
+
+bool ForestStructure::saveBinary(const std::string &filename) const
+{
+  if (trees.empty())
+  {
+    std::cerr << "No data to save to " << filename << std::endl;
+    return false;
+  }
+  const std::vector<std::string> &attributes = trees[0].attributes();
+  // gather the segments of all the trees into columns, in tree order
+  std::vector<uint64_t> tree_starts(1, 0);
+  std::vector<double> tips[3], radii;
+  std::vector<int32_t> parent_ids;
+  std::vector<std::vector<double>> attribute_columns(attributes.size());
+  for (auto &tree : trees)
+  {
+    for (auto &segment : tree.segments())
+    {
+      if (segment.attributes.size() != attributes.size())
+      {
+        std::cerr << "Error: each segment needs the " << attributes.size() << " attributes of the first tree to save "
+                  << filename << std::endl;
+        return false;
+      }
+      for (int i = 0; i < 3; i++) tips[i].push_back(segment.tip[i]);
+      radii.push_back(segment.radius);
+      parent_ids.push_back(segment.parent_id);
+      for (size_t a = 0; a < attributes.size(); a++) attribute_columns[a].push_back(segment.attributes[a]);
+    }
+    tree_starts.push_back(radii.size());
+  }
+
+  std::cout << "outputting binary tree file: " << filename << std::endl;
+  std::ofstream ofs(filename.c_str(), std::ios::out | std::ios::binary);
+  if (!ofs.is_open())
+  {
+    std::cerr << "Error: cannot open " << filename << " for writing." << std::endl;
+    return false;
+  }
+  ofs.write(kTreeMagic, 4);
+  writeValue(ofs, kTreeVersion);
+  writeValue(ofs, static_cast<uint32_t>(attributes.size()));
+  writeValue(ofs, static_cast<uint32_t>(0));  // reserved
+  writeValue(ofs, static_cast<uint64_t>(trees.size()));
+  writeValue(ofs, static_cast<uint64_t>(radii.size()));
+  std::vector<char> names;
+  for (auto &attribute : attributes)
+  {
+    const uint32_t length = static_cast<uint32_t>(attribute.size());
+    names.insert(names.end(), reinterpret_cast<const char *>(&length),
+                 reinterpret_cast<const char *>(&length) + sizeof(length));
+    names.insert(names.end(), attribute.begin(), attribute.end());
+  }
+  writeColumn(ofs, names);
+  writeColumn(ofs, tree_starts);
+  for (int i = 0; i < 3; i++) writeColumn(ofs, tips[i]);
+  writeColumn(ofs, radii);
+  writeColumn(ofs, parent_ids);
+  for (auto &column : attribute_columns) writeColumn(ofs, column);
+  return ofs.good();
+}
+
+bool ForestStructure::isBinaryFile(const std::string &filename)
+{
+  std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
+  char magic[4];
+  return ifs.read(magic, 4) && std::memcmp(magic, kTreeMagic, 4) == 0;
+}
 }  // namespace ray
\ No newline at end of file
@@ -13,12 +13,22 @@
 namespace ray
 {
 /// Underlying structure for sets of trees
+/// Tree files are comma separated text, one tree per line. For large forests they can also be stored in a compact
+/// binary form, with a header followed by one 8 byte aligned column per segment attribute (x, y, z, radius, parent_id
+/// and the user attributes) over all segments in tree order, so that the columns can be read straight from a memory
+/// mapping of the file. Text remains the interchange format.
 struct RAYLIB_EXPORT ForestStructure
 {
   std::vector<TreeStructure> trees;
 
+  /// load a tree file, which may be text or binary, adding to @c trees
   bool load(const std::string &filename);
+  /// save to a text tree file
   bool save(const std::string &filename);
+  /// save to a binary tree file, for faster loading
+  bool saveBinary(const std::string &filename) const;
+  /// whether @c filename starts as a binary tree file
+  static bool isBinaryFile(const std::string &filename);
   bool trunksOnly() { return trees.size() > 0 && trees[0].segments().size() == 1; }
   Eigen::Array<double, 9, 1> getMoments() const;
 };
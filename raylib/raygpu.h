@@ -0,0 +1,89 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYGPU_H
+#define RAYLIB_RAYGPU_H
+
+#include "raylib/raylibconfig.h"
+
+#include <cstddef>
+#include <memory>
+
+namespace ray
+{
+/// The optional GPU backend of the batched work in surfel and ellipsoid generation: nearest neighbour searches and
+/// 3x3 eigen decompositions, and of the density grids of rendering. It is built with WITH_CUDA, otherwise @c available() is false, every call fails, and
+/// the callers use their CPU path. The interface takes plain arrays so that it can be compiled by the CUDA compiler
+/// without the rest of raylib. Points and vectors are xyz triples, and matrices are 9 doubles in column-major order,
+/// which match the memory of the columns of an @c Eigen::MatrixXd and of an @c Eigen::Matrix3d .
+class RAYLIB_EXPORT Gpu
+{
+public:
+  /// the most neighbours per query of @c GpuNeighbourGrid::knn , which are kept in each GPU thread's registers
+  static const int kMaxNeighbours = 32;
+
+  /// whether raylib was built with the GPU backend and a device is present
+  static bool available();
+
+  /// The eigen decomposition of each of the @c count symmetric @c matrices , in closed form as
+  /// @c Eigen::SelfAdjointEigenSolver::computeDirect , with the eigenvalues in increasing order in @c values and the
+  /// eigenvectors as the columns of @c vectors . Returns false if it was not run on the GPU.
+  static bool eigenSolve(const double *matrices, size_t count, double *values, double *vectors);
+};
+
+/// A uniform grid of points on the GPU, for batched nearest neighbour searches. The points are sorted by cell and each
+/// query searches outwards a shell of cells at a time, until no unsearched cell could hold a nearer neighbour, so the
+/// results are exact.
+class RAYLIB_EXPORT GpuNeighbourGrid
+{
+public:
+  /// the grid of the @c num_points @c points , or null without a GPU
+  static std::unique_ptr<GpuNeighbourGrid> create(const double *points, size_t num_points);
+  ~GpuNeighbourGrid();
+
+  /// The @c k nearest points to each of the @c num_queries @c queries , excluding points that coincide with the
+  /// query, and only those within @c max_radius if it is non-zero. Each query's @c k point indices and squared
+  /// distances are written to @c indices and @c dists2 in order of increasing distance, then of index, with index -1
+  /// where there are fewer than @c k neighbours. Returns false if @c k is over @c Gpu::kMaxNeighbours or the device failed.
+  bool knn(const double *queries, size_t num_queries, int k, double max_radius, int *indices, double *dists2) const;
+
+private:
+  GpuNeighbourGrid();
+  struct Detail;
+  std::unique_ptr<Detail> detail_;
+};
+
+/// A dense density grid on the GPU, of three floats per voxel: the hit count, ray count and path length of a
+/// @c DensityGrid::Voxel , in the order of @c DensityGrid::getIndex . Each ray is walked by one GPU thread, which adds
+/// to the voxels atomically, so the sums match the CPU path up to the order of the additions.
+class RAYLIB_EXPORT GpuDensityGrid
+{
+public:
+  /// the grid of @c dims[0] x @c dims[1] x @c dims[2] voxels, starting from @c voxels , or null without a GPU or the
+  /// device memory for it
+  static std::unique_ptr<GpuDensityGrid> create(const int *dims, const float *voxels);
+  ~GpuDensityGrid();
+
+  /// Walk each of the @c num_rays rays from @c sources to @c targets , which are in voxel units, adding its path
+  /// length within each voxel as @c DensityGrid::addRays does. @c lengths are the ray lengths in metres, and a ray with
+  /// a non-zero @c hits entry is a hit in the voxel that it ends in. Returns false if the device failed.
+  bool addRays(const double *sources, const double *targets, const double *lengths, const unsigned char *hits,
+               size_t num_rays);
+  /// Fuse each voxel within the faces of the grid with its Moore neighbourhood, up to @c min_rays rays, and write it
+  /// to the voxel one lower on each axis, as the dense path of @c DensityGrid::addNeighbourPriors does. The voxels with
+  /// hits, and those of them whose neighbourhood has too few rays, are added to @c num_hit_points and
+  /// @c num_unsatisfied . Returns false if the device failed.
+  bool addNeighbourPriors(float min_rays, double &num_hit_points, double &num_unsatisfied);
+  /// copy the voxels to @c voxels . Returns false if the device failed.
+  bool download(float *voxels) const;
+
+private:
+  GpuDensityGrid();
+  struct Detail;
+  std::unique_ptr<Detail> detail_;
+};
+}  // namespace ray
+
+#endif  // RAYLIB_RAYGPU_H
@@ -0,0 +1,724 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raygpu.h"
+
+#include <cuda_runtime.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace ray
+{
+namespace
+{
+/// threads per block of the kernels
+const int kBlockThreads = 128;
+/// queries per knn launch, which bounds the device memory of the results
+const size_t kQueryChunkSize = 1 << 20;
+/// bits per axis of the packed cell keys, as in @c findNeighboursWithin
+const int kCellAxisBits = 21;
+/// the grid is refined until its occupied cells hold about this many points each
+const double kTargetPointsPerCell = 8.0;
+/// the most grid refinements, each of which sorts the points on the host
+const int kMaxRefinements = 4;
+
+/// An array in device memory, freed on destruction
+template <class T>
+class DeviceArray
+{
+public:
+  explicit DeviceArray(size_t size)
+    : size_(size)
+  {
+    if (size_ > 0 && cudaMalloc(reinterpret_cast<void **>(&data_), size_ * sizeof(T)) != cudaSuccess)
+    {
+      data_ = nullptr;
+    }
+  }
+  ~DeviceArray() { cudaFree(data_); }
+  DeviceArray(const DeviceArray &) = delete;
+  DeviceArray &operator=(const DeviceArray &) = delete;
+
+  bool ok() const { return size_ == 0 || data_ != nullptr; }
+  T *data() const { return data_; }
+  bool upload(const T *values, size_t count)
+  {
+    return count == 0 || cudaMemcpy(data_, values, count * sizeof(T), cudaMemcpyHostToDevice) == cudaSuccess;
+  }
+  bool download(T *values, size_t count) const
+  {
+    return count == 0 || cudaMemcpy(values, data_, count * sizeof(T), cudaMemcpyDeviceToHost) == cudaSuccess;
+  }
+  void swap(DeviceArray &other)
+  {
+    std::swap(size_, other.size_);
+    std::swap(data_, other.data_);
+  }
+
+private:
+  size_t size_;
+  T *data_ = nullptr;
+};
+
+/// The grid's geometry, passed to the kernel by value
+struct GridShape
+{
+  double min_bound[3];
+  double cell_width;
+  int dims[3];
+};
+
+__host__ __device__ inline uint64_t cellKey(int x, int y, int z)
+{
+  return static_cast<uint64_t>(x) | (static_cast<uint64_t>(y) << kCellAxisBits) |
+         (static_cast<uint64_t>(z) << (2 * kCellAxisBits));
+}
+
+__host__ __device__ inline int cellCoord(double value, double min_value, double cell_width, int dim)
+{
+  // clamped before the conversion, so that distant queries do not overflow
+  const double coord = floor((value - min_value) / cell_width);
+  return !(coord >= 0.0) ? 0 : (coord >= static_cast<double>(dim) ? dim - 1 : static_cast<int>(coord));
+}
+
+/// the index of the cell with @c key in the sorted @c keys , or -1
+__device__ inline int findCell(const uint64_t *keys, int num_cells, uint64_t key)
+{
+  int low = 0, high = num_cells;
+  while (low < high)
+  {
+    const int mid = (low + high) / 2;
+    if (keys[mid] < key)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+  return low < num_cells && keys[low] == key ? low : -1;
+}
+
+/// whether the neighbour @c id at @c dist2 precedes the neighbour @c other_id at @c other_dist2
+__device__ inline bool nearer(double dist2, int id, double other_dist2, int other_id)
+{
+  return dist2 < other_dist2 || (dist2 == other_dist2 && id < other_id);
+}
+
+/// Each thread finds the nearest neighbours of one query. The neighbours so far are kept sorted, and the search moves
+/// out a shell of cells at a time until the k'th nearest is closer than any unsearched cell.
+__global__ void knnKernel(const double *points, const int *point_ids, const uint64_t *cell_keys, const int *cell_starts,
+                          int num_cells, GridShape grid, const double *queries, int num_queries, int k,
+                          double max_radius2, int *indices, double *dists2)
+{
+  const int q = blockIdx.x * blockDim.x + threadIdx.x;
+  if (q >= num_queries)
+    return;
+  const double query[3] = { queries[3 * q], queries[3 * q + 1], queries[3 * q + 2] };
+  int centre[3];
+  for (int j = 0; j < 3; j++) centre[j] = cellCoord(query[j], grid.min_bound[j], grid.cell_width, grid.dims[j]);
+  const int max_ring = max(grid.dims[0], max(grid.dims[1], grid.dims[2]));
+
+  int best_ids[Gpu::kMaxNeighbours];
+  double best_dists2[Gpu::kMaxNeighbours];
+  int count = 0;
+  for (int ring = 0; ring <= max_ring; ring++)
+  {
+    int lo[3], hi[3];
+    for (int j = 0; j < 3; j++)
+    {
+      lo[j] = max(centre[j] - ring, 0);
+      hi[j] = min(centre[j] + ring, grid.dims[j] - 1);
+    }
+    for (int z = lo[2]; z <= hi[2]; z++)
+    {
+      for (int y = lo[1]; y <= hi[1]; y++)
+      {
+        const bool inner = abs(z - centre[2]) < ring && abs(y - centre[1]) < ring;
+        // cells strictly inside the shell were searched on earlier rings
+        const int x_step = inner ? max(1, 2 * ring) : 1;
+        for (int x = centre[0] - ring; x <= centre[0] + ring; x += x_step)
+        {
+          if (x < lo[0] || x > hi[0])
+            continue;
+          const int cell = findCell(cell_keys, num_cells, cellKey(x, y, z));
+          if (cell < 0)
+            continue;
+          for (int p = cell_starts[cell]; p < cell_starts[cell + 1]; p++)
+          {
+            const double dx = points[3 * p] - query[0];
+            const double dy = points[3 * p + 1] - query[1];
+            const double dz = points[3 * p + 2] - query[2];
+            const double dist2 = dx * dx + dy * dy + dz * dz;
+            // coincident points are excluded, as in libnabo
+            if (dist2 > max_radius2 || !(dist2 > 2.2204460492503131e-16))
+              continue;
+            // neighbours at equal distances are ordered by index, as NeighbourIndex orders them
+            const int id = point_ids[p];
+            if (count == k && !nearer(dist2, id, best_dists2[k - 1], best_ids[k - 1]))
+              continue;
+            int slot = count < k ? count++ : k - 1;
+            for (; slot > 0 && nearer(dist2, id, best_dists2[slot - 1], best_ids[slot - 1]); slot--)
+            {
+              best_dists2[slot] = best_dists2[slot - 1];
+              best_ids[slot] = best_ids[slot - 1];
+            }
+            best_dists2[slot] = dist2;
+            best_ids[slot] = id;
+          }
+        }
+      }
+    }
+    // the distance from the query to the nearest unsearched cell. There are no points beyond the grid
+    double covered = INFINITY;
+    for (int j = 0; j < 3; j++)
+    {
+      if (centre[j] - ring > 0)
+        covered = fmin(covered, query[j] - (grid.min_bound[j] + grid.cell_width * (centre[j] - ring)));
+      if (centre[j] + ring < grid.dims[j] - 1)
+        covered = fmin(covered, grid.min_bound[j] + grid.cell_width * (centre[j] + ring + 1) - query[j]);
+    }
+    if (isinf(covered))
+      break;
+    covered = fmax(covered, 0.0);
+    // an unsearched point at the covered distance could still be in range, or precede an equally distant neighbour
+    if (covered * covered > max_radius2 || (count == k && best_dists2[k - 1] < covered * covered))
+      break;
+  }
+  for (int j = 0; j < k; j++)
+  {
+    indices[q * k + j] = j < count ? best_ids[j] : -1;
+    dists2[q * k + j] = j < count ? best_dists2[j] : INFINITY;
+  }
+}
+
+__device__ inline void cross(const double *a, const double *b, double *result)
+{
+  result[0] = a[1] * b[2] - a[2] * b[1];
+  result[1] = a[2] * b[0] - a[0] * b[2];
+  result[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+__device__ inline double dot(const double *a, const double *b)
+{
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+__device__ inline void normalise(double *vec)
+{
+  const double length = sqrt(dot(vec, vec));
+  for (int j = 0; j < 3; j++) vec[j] /= length;
+}
+
+/// a unit vector orthogonal to the unit vector @c vec
+__device__ inline void unitOrthogonal(const double *vec, double *result)
+{
+  int axis = 0;
+  for (int j = 1; j < 3; j++)
+  {
+    if (fabs(vec[j]) < fabs(vec[axis]))
+      axis = j;
+  }
+  double other[3] = { 0, 0, 0 };
+  other[axis] = 1.0;
+  cross(vec, other, result);
+  normalise(result);
+}
+
+/// the kernel of the rank 2 symmetric matrix @c mat , and a column of @c mat which is orthogonal to it, as Eigen's
+/// direct solver
+__device__ inline void extractKernel(const double mat[3][3], double *kernel, double *representative)
+{
+  int i0 = 0;
+  for (int j = 1; j < 3; j++)
+  {
+    if (fabs(mat[j][j]) > fabs(mat[i0][i0]))
+      i0 = j;
+  }
+  const double *col0 = mat[i0];  // the matrix is symmetric, so its rows are its columns
+  double c0[3], c1[3];
+  cross(col0, mat[(i0 + 1) % 3], c0);
+  cross(col0, mat[(i0 + 2) % 3], c1);
+  const double n0 = dot(c0, c0), n1 = dot(c1, c1);
+  for (int j = 0; j < 3; j++)
+  {
+    kernel[j] = n0 > n1 ? c0[j] / sqrt(n0) : c1[j] / sqrt(n1);
+    representative[j] = col0[j];
+  }
+}
+
+/// Each thread decomposes one matrix, following @c Eigen::SelfAdjointEigenSolver::computeDirect for 3x3 matrices
+__global__ void eigenKernel(const double *matrices, int count, double *values, double *vectors)
+{
+  const int m = blockIdx.x * blockDim.x + threadIdx.x;
+  if (m >= count)
+    return;
+  const double *in = matrices + 9 * m;
+  double scale = 0.0;
+  for (int j = 0; j < 9; j++) scale = fmax(scale, fabs(in[j]));
+  if (scale == 0.0)
+    scale = 1.0;
+  double mat[3][3];
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 3; j++) mat[i][j] = in[3 * i + j] / scale;
+  }
+  const double shift = (mat[0][0] + mat[1][1] + mat[2][2]) / 3.0;
+  for (int j = 0; j < 3; j++) mat[j][j] -= shift;
+
+  // the roots of the characteristic polynomial, in increasing order
+  const double c0 = mat[0][0] * mat[1][1] * mat[2][2] + 2.0 * mat[1][0] * mat[2][0] * mat[2][1] -
+                    mat[0][0] * mat[2][1] * mat[2][1] - mat[1][1] * mat[2][0] * mat[2][0] -
+                    mat[2][2] * mat[1][0] * mat[1][0];
+  const double c1 = mat[0][0] * mat[1][1] - mat[1][0] * mat[1][0] + mat[0][0] * mat[2][2] - mat[2][0] * mat[2][0] +
+                    mat[1][1] * mat[2][2] - mat[2][1] * mat[2][1];
+  const double c2 = mat[0][0] + mat[1][1] + mat[2][2];
+  const double c2_over_3 = c2 / 3.0;
+  const double a_over_3 = fmax((c2 * c2_over_3 - c1) / 3.0, 0.0);
+  const double half_b = 0.5 * (c0 + c2_over_3 * (2.0 * c2_over_3 * c2_over_3 - c1));
+  const double q = fmax(a_over_3 * a_over_3 * a_over_3 - half_b * half_b, 0.0);
+  const double rho = sqrt(a_over_3);
+  const double theta = atan2(sqrt(q), half_b) / 3.0;
+  const double cos_theta = cos(theta), sin_theta = sin(theta);
+  double eigen_values[3];
+  eigen_values[0] = c2_over_3 - rho * (cos_theta + sqrt(3.0) * sin_theta);
+  eigen_values[1] = c2_over_3 - rho * (cos_theta - sqrt(3.0) * sin_theta);
+  eigen_values[2] = c2_over_3 + 2.0 * rho * cos_theta;
+
+  double eigen_vectors[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };  // the eigenvectors, as rows
+  const double epsilon = 2.2204460492503131e-16;
+  if (eigen_values[2] - eigen_values[0] > epsilon)
+  {
+    // the eigenvector of the most distinct eigenvalue first
+    double d0 = eigen_values[2] - eigen_values[1];
+    const double d1 = eigen_values[1] - eigen_values[0];
+    int k = 0, l = 2;
+    if (d0 > d1)
+    {
+      k = 2;
+      l = 0;
+      d0 = d1;
+    }
+    double tmp[3][3];
+    for (int i = 0; i < 3; i++)
+    {
+      for (int j = 0; j < 3; j++) tmp[i][j] = mat[i][j] - (i == j ? eigen_values[k] : 0.0);
+    }
+    extractKernel(tmp, eigen_vectors[k], eigen_vectors[l]);
+    if (d0 <= 2.0 * epsilon * d1)
+    {
+      // the other two eigenvalues are the same, so any orthogonal vector is an eigenvector
+      const double along = dot(eigen_vectors[k], eigen_vectors[l]);
+      for (int j = 0; j < 3; j++) eigen_vectors[l][j] -= along * eigen_vectors[k][j];
+      if (dot(eigen_vectors[l], eigen_vectors[l]) > epsilon)
+        normalise(eigen_vectors[l]);
+      else
+        unitOrthogonal(eigen_vectors[k], eigen_vectors[l]);
+    }
+    else
+    {
+      for (int i = 0; i < 3; i++)
+      {
+        for (int j = 0; j < 3; j++) tmp[i][j] = mat[i][j] - (i == j ? eigen_values[l] : 0.0);
+      }
+      double representative[3];
+      extractKernel(tmp, eigen_vectors[l], representative);
+    }
+    cross(eigen_vectors[2], eigen_vectors[0], eigen_vectors[1]);
+    normalise(eigen_vectors[1]);
+  }
+  for (int i = 0; i < 3; i++)
+  {
+    values[3 * m + i] = (eigen_values[i] + shift) * scale;
+    for (int j = 0; j < 3; j++) vectors[9 * m + 3 * i + j] = eigen_vectors[i][j];
+  }
+}
+
+/// The dimensions of a density grid, passed to the kernels by value
+struct VoxelDims
+{
+  int dims[3];
+};
+
+/// Each thread walks one ray through the density voxels, as @c walkVoxels does, and adds its path length within each
+/// voxel to that voxel, as a hit in the voxel that it ends in if it is a hit ray, and as a miss elsewhere
+__global__ void densityRaysKernel(const double *sources, const double *targets, const double *lengths,
+                                  const unsigned char *hits, int num_rays, VoxelDims grid, float *voxels)
+{
+  const int r = blockIdx.x * blockDim.x + threadIdx.x;
+  if (r >= num_rays)
+    return;
+  const double *source = sources + 3 * static_cast<size_t>(r);
+  const double *target = targets + 3 * static_cast<size_t>(r);
+  for (int k = 0; k < 3; k++)
+  {
+    if (!isfinite(source[k]) || !isfinite(target[k]))
+      return;
+  }
+  int index[3], step[3];
+  double t_max[3], t_delta[3];
+  for (int k = 0; k < 3; k++)
+  {
+    index[k] = static_cast<int>(floor(source[k]));
+    const double dir = target[k] - source[k];
+    if (dir > 0.0)
+    {
+      step[k] = 1;
+      t_delta[k] = 1.0 / dir;
+      t_max[k] = (static_cast<double>(index[k]) + 1.0 - source[k]) * t_delta[k];
+    }
+    else if (dir < 0.0)
+    {
+      step[k] = -1;
+      t_delta[k] = -1.0 / dir;
+      t_max[k] = (source[k] - static_cast<double>(index[k])) * t_delta[k];
+    }
+    else
+    {
+      step[k] = 0;
+      t_delta[k] = t_max[k] = INFINITY;
+    }
+  }
+
+  double t_enter = 0.0;
+  for (;;)
+  {
+    int axis = 0;
+    if (t_max[1] < t_max[axis])
+      axis = 1;
+    if (t_max[2] < t_max[axis])
+      axis = 2;
+    const double t_exit = fmin(t_max[axis], 1.0);
+    // the clipped ray can touch the far faces of the bounds
+    bool inside = true;
+    for (int k = 0; k < 3; k++) inside = inside && index[k] >= 0 && index[k] < grid.dims[k];
+    if (inside)
+    {
+      float *voxel = voxels + 3 * (static_cast<size_t>(index[0]) +
+                                   static_cast<size_t>(grid.dims[0]) *
+                                     (index[1] + static_cast<size_t>(grid.dims[1]) * index[2]));
+      if (hits[r] && t_exit >= 1.0)
+        atomicAdd(&voxel[0], 1.0f);
+      atomicAdd(&voxel[1], 1.0f);
+      atomicAdd(&voxel[2], static_cast<float>((t_exit - t_enter) * lengths[r]));
+    }
+    if (t_max[axis] >= 1.0)
+      return;
+    index[axis] += step[axis];
+    t_enter = t_max[axis];
+    t_max[axis] += t_delta[axis];
+  }
+}
+
+/// the Moore neighbourhood of a voxel, in the rings of @c addNeighbourPrior in rayrenderer.cpp, and in its order
+__constant__ int kNeighbourOffsets[26][3] = {
+  { -1, 0, 0 },   { 1, 0, 0 },   { 0, -1, 0 },  { 0, 1, 0 },   { 0, 0, -1 },  { 0, 0, 1 },   { -1, -1, 0 },
+  { -1, 1, 0 },   { 1, -1, 0 },  { 1, 1, 0 },   { -1, 0, -1 }, { -1, 0, 1 },  { 1, 0, -1 },  { 1, 0, 1 },
+  { 0, -1, -1 },  { 0, -1, 1 },  { 0, 1, -1 },  { 0, 1, 1 },   { -1, -1, -1 }, { -1, -1, 1 }, { -1, 1, -1 },
+  { 1, -1, -1 },  { -1, 1, 1 },  { 1, -1, 1 },  { 1, 1, -1 },  { 1, 1, 1 }
+};
+/// the end of each ring in @c kNeighbourOffsets
+__constant__ int kNeighbourRingEnds[3] = { 6, 18, 26 };
+
+/// Each thread fuses one voxel within the faces of the grid with the fewest rings of its Moore neighbourhood for it to
+/// gain @c min_rays rays, as @c addNeighbourPrior does, and writes it to the voxel one lower on each axis of
+/// @c priors . The rounding intrinsics stop the scaled additions from being contracted into fused multiply-adds, so
+/// each step rounds as the CPU's does. The voxels with hits, and those of them whose neighbourhood has too few rays,
+/// are counted into @c counts
+__global__ void neighbourPriorsKernel(const float *voxels, VoxelDims grid, float min_rays, float *priors,
+                                      unsigned long long *counts)
+{
+  const int64_t inner[3] = { grid.dims[0] - 2, grid.dims[1] - 2, grid.dims[2] - 2 };
+  const int64_t i = static_cast<int64_t>(blockIdx.x) * blockDim.x + threadIdx.x;
+  if (i >= inner[0] * inner[1] * inner[2])
+    return;
+  const int64_t strides[3] = { 1, grid.dims[0], static_cast<int64_t>(grid.dims[0]) * grid.dims[1] };
+  const int64_t ind = (1 + i % inner[0]) * strides[0] + (1 + (i / inner[0]) % inner[1]) * strides[1] +
+                      (1 + i / (inner[0] * inner[1])) * strides[2];
+  const float *centre = voxels + 3 * ind;
+  float voxel[3] = { centre[0], centre[1], centre[2] };
+  const bool has_hits = centre[0] > 0.0f;
+  if (has_hits)
+    atomicAdd(&counts[0], 1ull);
+  float needed = min_rays - centre[1];
+  if (needed >= 0.0f)
+  {
+    bool satisfied = false;
+    for (int ring = 0, n = 0; ring < 3 && !satisfied; ring++)
+    {
+      float neighbours[3] = { 0.0f, 0.0f, 0.0f };
+      for (; n < kNeighbourRingEnds[ring]; n++)
+      {
+        const float *neighbour = voxels + 3 * (ind + kNeighbourOffsets[n][0] * strides[0] +
+                                               kNeighbourOffsets[n][1] * strides[1] +
+                                               kNeighbourOffsets[n][2] * strides[2]);
+        for (int j = 0; j < 3; j++) neighbours[j] = __fadd_rn(neighbours[j], neighbour[j]);
+      }
+      if (neighbours[1] >= needed)
+      {
+        const float scale = __fdiv_rn(needed, neighbours[1]);
+        for (int j = 0; j < 3; j++) voxel[j] = __fadd_rn(voxel[j], __fmul_rn(neighbours[j], scale));
+        satisfied = true;
+      }
+      else
+      {
+        for (int j = 0; j < 3; j++) voxel[j] = __fadd_rn(voxel[j], neighbours[j]);
+        needed = __fsub_rn(needed, neighbours[1]);
+      }
+    }
+    if (!satisfied && has_hits)
+      atomicAdd(&counts[1], 1ull);
+  }
+  float *prior = priors + 3 * (ind - strides[0] - strides[1] - strides[2]);
+  for (int j = 0; j < 3; j++) prior[j] = voxel[j];
+}
+
+inline int numBlocks(size_t count)
+{
+  return static_cast<int>((count + kBlockThreads - 1) / kBlockThreads);
+}
+}  // namespace
+
+bool Gpu::available()
+{
+  static const bool has_device = []() {
+    int count = 0;
+    return cudaGetDeviceCount(&count) == cudaSuccess && count > 0;
+  }();
+  return has_device;
+}
+
+bool Gpu::eigenSolve(const double *matrices, size_t count, double *values, double *vectors)
+{
+  if (!available() || count > static_cast<size_t>(std::numeric_limits<int>::max()))
+    return false;
+  DeviceArray<double> device_matrices(9 * count), device_values(3 * count), device_vectors(9 * count);
+  if (!device_matrices.ok() || !device_values.ok() || !device_vectors.ok() ||
+      !device_matrices.upload(matrices, 9 * count))
+    return false;
+  if (count > 0)
+  {
+    eigenKernel<<<numBlocks(count), kBlockThreads>>>(device_matrices.data(), static_cast<int>(count),
+                                                      device_values.data(), device_vectors.data());
+  }
+  return cudaGetLastError() == cudaSuccess && device_values.download(values, 3 * count) &&
+         device_vectors.download(vectors, 9 * count);
+}
+
+struct GpuNeighbourGrid::Detail
+{
+  Detail(size_t num_points, size_t num_cells)
+    : points(3 * num_points)
+    , point_ids(num_points)
+    , cell_keys(num_cells)
+    , cell_starts(num_cells + 1)
+  {}
+  GridShape grid;
+  int num_cells;
+  DeviceArray<double> points;  // sorted by cell
+  DeviceArray<int> point_ids;  // the index of each sorted point
+  DeviceArray<uint64_t> cell_keys;
+  DeviceArray<int> cell_starts;
+};
+
+GpuNeighbourGrid::GpuNeighbourGrid() = default;
+GpuNeighbourGrid::~GpuNeighbourGrid() = default;
+
+std::unique_ptr<GpuNeighbourGrid> GpuNeighbourGrid::create(const double *points, size_t num_points)
+{
+  if (!Gpu::available() || num_points == 0 || num_points > static_cast<size_t>(std::numeric_limits<int>::max()))
+    return nullptr;
+  GridShape grid;
+  double extent[3];
+  double max_extent = 0.0;
+  for (int j = 0; j < 3; j++)
+  {
+    double min_value = std::numeric_limits<double>::infinity(), max_value = -min_value;
+    for (size_t i = 0; i < num_points; i++)
+    {
+      min_value = std::min(min_value, points[3 * i + j]);
+      max_value = std::max(max_value, points[3 * i + j]);
+    }
+    if (!std::isfinite(min_value) || !std::isfinite(max_value))
+      return nullptr;
+    grid.min_bound[j] = min_value;
+    extent[j] = max_value - min_value;
+    max_extent = std::max(max_extent, extent[j]);
+  }
+  // start with cells for a volume of points, and refine them for the surfaces that scans mostly hold
+  const double min_width = std::max(max_extent / static_cast<double>((1 << kCellAxisBits) - 1), 1e-9);
+  double width = std::max(min_width, max_extent / std::cbrt(static_cast<double>(num_points) / kTargetPointsPerCell));
+  std::vector<std::pair<uint64_t, int>> keys(num_points);
+  size_t num_cells = 0;
+  for (int refinement = 0;; refinement++)
+  {
+    grid.cell_width = width;
+    for (int j = 0; j < 3; j++) grid.dims[j] = static_cast<int>(std::floor(extent[j] / width)) + 1;
+    for (size_t i = 0; i < num_points; i++)
+    {
+      int coord[3];
+      for (int j = 0; j < 3; j++) coord[j] = cellCoord(points[3 * i + j], grid.min_bound[j], width, grid.dims[j]);
+      keys[i] = std::make_pair(cellKey(coord[0], coord[1], coord[2]), static_cast<int>(i));
+    }
+    std::sort(keys.begin(), keys.end());
+    num_cells = 0;
+    for (size_t i = 0; i < num_points; i++)
+    {
+      if (i == 0 || keys[i].first != keys[i - 1].first)
+        num_cells++;
+    }
+    const double points_per_cell = static_cast<double>(num_points) / static_cast<double>(num_cells);
+    const double next_width = std::max(min_width, width * std::sqrt(kTargetPointsPerCell / points_per_cell));
+    if (refinement == kMaxRefinements || points_per_cell < 2.0 * kTargetPointsPerCell || next_width >= width)
+      break;
+    width = next_width;
+  }
+
+  std::vector<double> sorted_points(3 * num_points);
+  std::vector<int> point_ids(num_points);
+  std::vector<uint64_t> cell_keys;
+  std::vector<int> cell_starts;
+  cell_keys.reserve(num_cells);
+  cell_starts.reserve(num_cells + 1);
+  for (size_t i = 0; i < num_points; i++)
+  {
+    if (i == 0 || keys[i].first != keys[i - 1].first)
+    {
+      cell_keys.push_back(keys[i].first);
+      cell_starts.push_back(static_cast<int>(i));
+    }
+    point_ids[i] = keys[i].second;
+    for (int j = 0; j < 3; j++) sorted_points[3 * i + j] = points[3 * static_cast<size_t>(keys[i].second) + j];
+  }
+  cell_starts.push_back(static_cast<int>(num_points));
+
+  std::unique_ptr<GpuNeighbourGrid> result(new GpuNeighbourGrid);
+  result->detail_.reset(new Detail(num_points, num_cells));
+  Detail &detail = *result->detail_;
+  detail.grid = grid;
+  detail.num_cells = static_cast<int>(num_cells);
+  if (!detail.points.ok() || !detail.point_ids.ok() || !detail.cell_keys.ok() || !detail.cell_starts.ok() ||
+      !detail.points.upload(sorted_points.data(), sorted_points.size()) ||
+      !detail.point_ids.upload(point_ids.data(), point_ids.size()) ||
+      !detail.cell_keys.upload(cell_keys.data(), cell_keys.size()) ||
+      !detail.cell_starts.upload(cell_starts.data(), cell_starts.size()))
+    return nullptr;
+  return result;
+}
+
+bool GpuNeighbourGrid::knn(const double *queries, size_t num_queries, int k, double max_radius, int *indices,
+                           double *dists2) const
+{
+  if (k <= 0 || k > Gpu::kMaxNeighbours)
+    return false;
+  const double max_radius2 = max_radius != 0.0 ? max_radius * max_radius : INFINITY;
+  const size_t chunk_size = std::min(kQueryChunkSize, num_queries);
+  DeviceArray<double> device_queries(3 * chunk_size), device_dists2(k * chunk_size);
+  DeviceArray<int> device_indices(k * chunk_size);
+  if (!device_queries.ok() || !device_dists2.ok() || !device_indices.ok())
+    return false;
+  for (size_t begin = 0; begin < num_queries; begin += chunk_size)
+  {
+    const size_t count = std::min(chunk_size, num_queries - begin);
+    if (!device_queries.upload(queries + 3 * begin, 3 * count))
+      return false;
+    knnKernel<<<numBlocks(count), kBlockThreads>>>(
+      detail_->points.data(), detail_->point_ids.data(), detail_->cell_keys.data(), detail_->cell_starts.data(),
+      detail_->num_cells, detail_->grid, device_queries.data(), static_cast<int>(count), k, max_radius2,
+      device_indices.data(), device_dists2.data());
+    if (cudaGetLastError() != cudaSuccess || !device_indices.download(indices + k * begin, k * count) ||
+        !device_dists2.download(dists2 + k * begin, k * count))
+      return false;
+  }
+  return true;
+}
+
+struct GpuDensityGrid::Detail
+{
+  explicit Detail(size_t num_voxels)
+    : num_voxels(num_voxels)
+    , voxels(3 * num_voxels)
+  {}
+  VoxelDims grid;
+  size_t num_voxels;
+  DeviceArray<float> voxels;
+};
+
+GpuDensityGrid::GpuDensityGrid() = default;
+GpuDensityGrid::~GpuDensityGrid() = default;
+
+std::unique_ptr<GpuDensityGrid> GpuDensityGrid::create(const int *dims, const float *voxels)
+{
+  if (!Gpu::available())
+    return nullptr;
+  VoxelDims grid;
+  size_t num_voxels = 1;
+  for (int j = 0; j < 3; j++)
+  {
+    if (dims[j] <= 0)
+      return nullptr;
+    grid.dims[j] = dims[j];
+    num_voxels *= static_cast<size_t>(dims[j]);
+  }
+  std::unique_ptr<GpuDensityGrid> result(new GpuDensityGrid);
+  result->detail_.reset(new Detail(num_voxels));
+  result->detail_->grid = grid;
+  if (!result->detail_->voxels.ok() || !result->detail_->voxels.upload(voxels, 3 * num_voxels))
+    return nullptr;
+  return result;
+}
+
+bool GpuDensityGrid::addRays(const double *sources, const double *targets, const double *lengths,
+                             const unsigned char *hits, size_t num_rays)
+{
+  if (num_rays > static_cast<size_t>(std::numeric_limits<int>::max()))
+    return false;
+  if (num_rays == 0)
+    return true;
+  DeviceArray<double> device_sources(3 * num_rays), device_targets(3 * num_rays), device_lengths(num_rays);
+  DeviceArray<unsigned char> device_hits(num_rays);
+  if (!device_sources.ok() || !device_targets.ok() || !device_lengths.ok() || !device_hits.ok() ||
+      !device_sources.upload(sources, 3 * num_rays) || !device_targets.upload(targets, 3 * num_rays) ||
+      !device_lengths.upload(lengths, num_rays) || !device_hits.upload(hits, num_rays))
+    return false;
+  densityRaysKernel<<<numBlocks(num_rays), kBlockThreads>>>(device_sources.data(), device_targets.data(),
+                                                            device_lengths.data(), device_hits.data(),
+                                                            static_cast<int>(num_rays), detail_->grid,
+                                                            detail_->voxels.data());
+  return cudaGetLastError() == cudaSuccess;
+}
+
+bool GpuDensityGrid::addNeighbourPriors(float min_rays, double &num_hit_points, double &num_unsatisfied)
+{
+  const VoxelDims &grid = detail_->grid;
+  if (grid.dims[0] < 3 || grid.dims[1] < 3 || grid.dims[2] < 3)
+    return true;  // no voxel is within the faces of the grid
+  const size_t count = static_cast<size_t>(grid.dims[0] - 2) * (grid.dims[1] - 2) * (grid.dims[2] - 2);
+  DeviceArray<float> priors(3 * detail_->num_voxels);
+  DeviceArray<unsigned long long> device_counts(2);
+  const unsigned long long zeros[2] = { 0, 0 };
+  // the voxels that are not written to keep their values, as in the CPU pass
+  if (!priors.ok() || !device_counts.ok() || !device_counts.upload(zeros, 2) ||
+      cudaMemcpy(priors.data(), detail_->voxels.data(), 3 * detail_->num_voxels * sizeof(float),
+                 cudaMemcpyDeviceToDevice) != cudaSuccess)
+    return false;
+  neighbourPriorsKernel<<<numBlocks(count), kBlockThreads>>>(detail_->voxels.data(), grid, min_rays, priors.data(),
+                                                               device_counts.data());
+  unsigned long long counts[2];
+  if (cudaGetLastError() != cudaSuccess || !device_counts.download(counts, 2))
+    return false;
+  detail_->voxels.swap(priors);
+  num_hit_points += static_cast<double>(counts[0]);
+  num_unsatisfied += static_cast<double>(counts[1]);
+  return true;
+}
+
+bool GpuDensityGrid::download(float *voxels) const
+{
+  return cudaDeviceSynchronize() == cudaSuccess && detail_->voxels.download(voxels, 3 * detail_->num_voxels);
+}
+}  // namespace ray
@@ -0,0 +1,90 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raygpu.h"
+
+#include "rayunused.h"
+
+namespace ray
+{
+struct GpuNeighbourGrid::Detail
+{
+};
+
+struct GpuDensityGrid::Detail
+{
+};
+
+bool Gpu::available()
+{
+  return false;
+}
+
+bool Gpu::eigenSolve(const double *matrices, size_t count, double *values, double *vectors)
+{
+  RAYLIB_UNUSED(matrices);
+  RAYLIB_UNUSED(count);
+  RAYLIB_UNUSED(values);
+  RAYLIB_UNUSED(vectors);
+  return false;
+}
+
+GpuNeighbourGrid::GpuNeighbourGrid() = default;
+GpuNeighbourGrid::~GpuNeighbourGrid() = default;
+
+std::unique_ptr<GpuNeighbourGrid> GpuNeighbourGrid::create(const double *points, size_t num_points)
+{
+  RAYLIB_UNUSED(points);
+  RAYLIB_UNUSED(num_points);
+  return nullptr;
+}
+
+bool GpuNeighbourGrid::knn(const double *queries, size_t num_queries, int k, double max_radius, int *indices,
+                           double *dists2) const
+{
+  RAYLIB_UNUSED(queries);
+  RAYLIB_UNUSED(num_queries);
+  RAYLIB_UNUSED(k);
+  RAYLIB_UNUSED(max_radius);
+  RAYLIB_UNUSED(indices);
+  RAYLIB_UNUSED(dists2);
+  return false;
+}
+
+GpuDensityGrid::GpuDensityGrid() = default;
+GpuDensityGrid::~GpuDensityGrid() = default;
+
+std::unique_ptr<GpuDensityGrid> GpuDensityGrid::create(const int *dims, const float *voxels)
+{
+  RAYLIB_UNUSED(dims);
+  RAYLIB_UNUSED(voxels);
+  return nullptr;
+}
+
+bool GpuDensityGrid::addRays(const double *sources, const double *targets, const double *lengths,
+                             const unsigned char *hits, size_t num_rays)
+{
+  RAYLIB_UNUSED(sources);
+  RAYLIB_UNUSED(targets);
+  RAYLIB_UNUSED(lengths);
+  RAYLIB_UNUSED(hits);
+  RAYLIB_UNUSED(num_rays);
+  return false;
+}
+
+bool GpuDensityGrid::addNeighbourPriors(float min_rays, double &num_hit_points, double &num_unsatisfied)
+{
+  RAYLIB_UNUSED(min_rays);
+  RAYLIB_UNUSED(num_hit_points);
+  RAYLIB_UNUSED(num_unsatisfied);
+  return false;
+}
+
+bool GpuDensityGrid::download(float *voxels) const
+{
+  RAYLIB_UNUSED(voxels);
+  return false;
+}
+}  // namespace ray
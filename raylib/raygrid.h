@@ -8,13 +8,22 @@
 
 #include "raylib/raylibconfig.h"
 
+#include "raymorton.h"
 #include "rayutils.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <functional>
+#include <limits>
+#include <memory>
+#include <vector>
 
 #if RAYLIB_WITH_TBB
 #define RAYLIB_PARALLEL_GRID 1
 #if RAYLIB_PARALLEL_GRID
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/parallel_for.h>
 #include <tbb/spin_mutex.h>
 #endif  // RAYLIB_PARALLEL_GRID
 #endif  // RAYLIB_WITH_TBB
@@ -31,7 +40,8 @@ struct RAYLIB_EXPORT GridRayInfo
 
 /// 3D grid container class based on hash lookup, to accelerate the access to spatial data by location
 /// A hash lookup is used because ray cloud geometry is generally sparse, and so continuous 3D voxel arrays are memory
-/// intensive
+/// intensive. Voxels are hashed by their Morton key, and the number of buckets is independent of the grid extent, so
+/// large extents at fine voxel widths do not overflow the indexing
 template <class T>
 class Grid
 {
@@ -73,10 +83,13 @@ public:
     std::function<void(const Grid<T> &, const Eigen::Vector3i &, const GridRayInfo &info)>;
   using WalkCellsVisitFunction = std::function<void(const Grid<T> &, const Cell &)>;
 
+  /// the number of buckets when no expected number of cells is given, at most
+  static const size_t kMaxDefaultBuckets = 1 << 22;
+
   Grid() {}
-  Grid(const Eigen::Vector3d &box_min, const Eigen::Vector3d &box_max, double voxel_width)
+  Grid(const Eigen::Vector3d &box_min, const Eigen::Vector3d &box_max, double voxel_width, size_t expected_cells = 0)
   {
-    init(box_min, box_max, voxel_width);
+    init(box_min, box_max, voxel_width, expected_cells);
   }
 
   /// Generate a grid indexer from a spatial position.
@@ -123,26 +136,55 @@ public:
                            box_min.z() + z * voxel_width + 0.5 * voxel_width);
   }
 
-  /// the grid is axis aligned, so initialised from a bounding box and a voxel width
-  void init(const Eigen::Vector3d &box_min, const Eigen::Vector3d &box_max, double voxel_width)
+  /// the grid is axis aligned, so initialised from a bounding box and a voxel width. The buckets are sized for
+  /// @c expected_cells occupied voxels when it is given, otherwise for a surface over the extent (dims[0]*dims[1]
+  /// voxels) up to @c kMaxDefaultBuckets
+  void init(const Eigen::Vector3d &box_min, const Eigen::Vector3d &box_max, double voxel_width,
+            size_t expected_cells = 0)
   {
     this->box_min = box_min;
     this->box_max = box_max;
     this->voxel_width = voxel_width;
     Eigen::Vector3d diff = (box_max - box_min) / voxel_width;
-    dims = Eigen::Vector3i(diff.array().ceil().cast<int>());
+    // per-axis indices are int, so the extent is limited to 2^31 voxels on each axis
+    const double max_dim = static_cast<double>(std::numeric_limits<int>::max());
+    dims = Eigen::Vector3i(diff.array().ceil().min(max_dim).cast<int>());
 
-    int bucket_size = dims[0] * dims[1];  // let's assume a surface for the map. This is still significantly better on
-                                          // memory than a 3D grid (dims[0]*dims[1]*dims[2])
-    buckets_.resize(bucket_size);
+    if (expected_cells == 0)
+    {
+      // let's assume a surface for the map. This is still significantly better on memory than a 3D grid
+      const double surface_cells = static_cast<double>(dims[0]) * static_cast<double>(dims[1]);
+      expected_cells = static_cast<size_t>(std::min(surface_cells, static_cast<double>(kMaxDefaultBuckets)));
+    }
+    buckets_.clear();
+    buckets_.resize(std::max<size_t>(expected_cells, 1));
     null_cell_.index = Eigen::Vector3i(-1, -1, -1);
   }
 
+  /// resize the buckets for @c expected_cells occupied voxels, keeping the cells. Use this when the occupancy is
+  /// found to be much larger than the grid was initialised for. Must not be called concurrently with @c insert()
+  void reserve(size_t expected_cells)
+  {
+    std::vector<Bucket> old_buckets(std::max<size_t>(expected_cells, 1));
+    old_buckets.swap(buckets_);
+    for (auto &bucket : old_buckets)
+    {
+      for (auto &c : bucket.cells) buckets_[hashFunc(c.index)].cells.emplace_back(std::move(c));
+    }
+  }
+
+  /// the number of occupied voxels
+  size_t cellCount() const
+  {
+    size_t count = 0;
+    for (const auto &bucket : buckets_) count += bucket.cells.size();
+    return count;
+  }
+
   Cell &cell(int x, int y, int z) { return cell(Eigen::Vector3i(x, y, z)); }
   Cell &cell(const Eigen::Vector3i &index)
   {
-    int hash = hashFunc(index.x(), index.y(), index.z());
-    Bucket &bucket = buckets_.at(hash);
+    Bucket &bucket = buckets_[hashFunc(index)];
     // linearly search through the bucket
     for (auto &c : bucket.cells)
       if (c.index == index)
@@ -154,8 +196,7 @@ public:
   const Cell &cell(int x, int y, int z) const { return cell(Eigen::Vector3i(x, y, z)); }
   const Cell &cell(const Eigen::Vector3i &index) const
   {
-    int hash = hashFunc(index.x(), index.y(), index.z());
-    const Bucket &bucket = buckets_.at(hash);
+    const Bucket &bucket = buckets_[hashFunc(index)];
     for (const auto &c : bucket.cells)
       if (c.index == index)
         return c;
@@ -170,8 +211,7 @@ public:
 
   void insert(const Eigen::Vector3i &index, const T &value)
   {
-    int hash = hashFunc(index[0], index[1], index[2]);
-    Bucket &bucket = buckets_.at(hash);
+    Bucket &bucket = buckets_[hashFunc(index)];
 #if RAYLIB_PARALLEL_GRID
     Mutex::scoped_lock bucket_lock(bucket.mutex);
 #endif  // RAYLIB_PARALLEL_GRID
@@ -252,16 +292,239 @@ protected:
     {}
   };
 
-  inline int hashFunc(int x, int y, int z) const { return int((x * 17 + y * 101 + z * 797) % buckets_.size()); }
+  /// the bucket of the voxel at @c index . The Morton key is mixed, as its low bits only vary with the low index bits
+  inline size_t hashFunc(const Eigen::Vector3i &index) const
+  {
+    const uint64_t key = mortonKey(index) * 0x9e3779b97f4a7c15ull;
+    return static_cast<size_t>((key ^ (key >> 32)) % buckets_.size());
+  }
 
   std::vector<Bucket> buckets_;
   Cell null_cell_;
 };
 
+/// 3D grid for insertion-heavy workloads, such as filling every voxel along every ray. The grid is built in two
+/// phases: values are first appended to per-thread lists with @c insert() , without any locking, then @c finalise()
+/// counting-sorts them into a compact layout (CSR) of the occupied voxels, with the values of each voxel stored
+/// contiguously. Voxels are ordered by (x, y) column then by z, so @c column() reads a run of voxels in z as a single
+/// range. Only indices within @c dims are stored, and values within a voxel are in ascending order, so that the
+/// layout does not depend on the order of insertion. @c T must therefore be less-than comparable.
+template <class T>
+class PackedGrid
+{
+public:
+  /// a contiguous range of values in the grid, for use in range-based for loops
+  class Span
+  {
+  public:
+    Span(const T *begin, const T *end)
+      : begin_(begin)
+      , end_(end)
+    {}
+    inline const T *begin() const { return begin_; }
+    inline const T *end() const { return end_; }
+    inline size_t size() const { return static_cast<size_t>(end_ - begin_); }
+    inline bool empty() const { return begin_ == end_; }
+    inline const T &operator[](size_t i) const { return begin_[i]; }
+
+  private:
+    const T *begin_;
+    const T *end_;
+  };
+
+  PackedGrid() {}
+  PackedGrid(const Eigen::Vector3d &box_min, const Eigen::Vector3d &box_max, double voxel_width)
+  {
+    init(box_min, box_max, voxel_width);
+  }
+
+  /// the grid is axis aligned, so initialised from a bounding box and a voxel width. This clears any values.
+  void init(const Eigen::Vector3d &box_min, const Eigen::Vector3d &box_max, double voxel_width)
+  {
+    this->box_min = box_min;
+    this->box_max = box_max;
+    this->voxel_width = voxel_width;
+    Eigen::Vector3d diff = (box_max - box_min) / voxel_width;
+    dims = Eigen::Vector3i(diff.array().ceil().cast<int>());
+    column_voxels_.clear();
+    voxel_z_.clear();
+    voxel_offsets_.clear();
+    values_.clear();
+#if RAYLIB_PARALLEL_GRID
+    local_entries_.clear();
+#else   // RAYLIB_PARALLEL_GRID
+    entries_.clear();
+#endif  // RAYLIB_PARALLEL_GRID
+  }
+
+  /// add @c value to the voxel at @c index. This can be called concurrently, but values are only readable once
+  /// @c finalise() is called. Indices outside of @c dims are ignored.
+  void insert(const Eigen::Vector3i &index, const T &value) { append(localEntries(), index, value); }
+  void insert(int x, int y, int z, const T &value) { insert(Eigen::Vector3i(x, y, z), value); }
+  /// add @c value to each of the voxels at @c indices , such as those traversed by a ray
+  void insert(const std::vector<Eigen::Vector3i> &indices, const T &value)
+  {
+    std::vector<Entry> &entries = localEntries();
+    for (const auto &index : indices) append(entries, index, value);
+  }
+
+  /// gather the inserted values into the packed layout. Must not be called concurrently with @c insert()
+  void finalise()
+  {
+    std::vector<std::vector<Entry> *> lists;
+#if RAYLIB_PARALLEL_GRID
+    for (auto &local : local_entries_) lists.push_back(&local);
+#else   // RAYLIB_PARALLEL_GRID
+    lists.push_back(&entries_);
+#endif  // RAYLIB_PARALLEL_GRID
+
+    // counting sort of the entries by column
+    const size_t num_columns = static_cast<size_t>(dims[0]) * static_cast<size_t>(dims[1]);
+    std::vector<size_t> column_starts(num_columns + 1, 0);
+    for (const auto list : lists)
+      for (const auto &entry : *list) column_starts[entry.column + 1]++;
+    for (size_t c = 0; c < num_columns; c++) column_starts[c + 1] += column_starts[c];
+    std::vector<Entry> sorted(column_starts[num_columns]);
+    {
+      std::vector<size_t> cursors(column_starts.begin(), column_starts.end() - 1);
+      for (auto list : lists)
+      {
+        for (const auto &entry : *list) sorted[cursors[entry.column]++] = entry;
+        std::vector<Entry>().swap(*list);
+      }
+    }
+#if RAYLIB_PARALLEL_GRID
+    local_entries_.clear();
+#endif  // RAYLIB_PARALLEL_GRID
+
+    // then counting sort each column by z. This is stable, so only the values from different lists need sorting
+    const bool sort_values = lists.size() > 1;
+    auto sort_column = [&](size_t c) {
+      const size_t begin = column_starts[c], end = column_starts[c + 1];
+      if (end - begin < 2)
+        return;
+      std::vector<size_t> z_starts(static_cast<size_t>(dims[2]) + 1, 0);
+      for (size_t i = begin; i < end; i++) z_starts[sorted[i].z + 1]++;
+      for (int z = 0; z < dims[2]; z++) z_starts[z + 1] += z_starts[z];
+      std::vector<Entry> column(sorted.begin() + begin, sorted.begin() + end);
+      for (const auto &entry : column) sorted[begin + z_starts[entry.z]++] = entry;
+      if (sort_values)
+      {
+        for (size_t i = begin, j = begin; i < end; i = j)
+        {
+          for (j = i + 1; j < end && sorted[j].z == sorted[i].z; j++)
+            ;
+          std::sort(sorted.begin() + i, sorted.begin() + j);
+        }
+      }
+    };
+#if RAYLIB_PARALLEL_GRID
+    tbb::parallel_for<size_t>(0, num_columns, sort_column);
+#else   // RAYLIB_PARALLEL_GRID
+    for (size_t c = 0; c < num_columns; c++) sort_column(c);
+#endif  // RAYLIB_PARALLEL_GRID
+
+    column_voxels_.assign(num_columns + 1, 0);
+    voxel_z_.clear();
+    voxel_offsets_.clear();
+    values_.resize(sorted.size());
+    for (size_t c = 0; c < num_columns; c++)
+    {
+      column_voxels_[c] = voxel_z_.size();
+      for (size_t i = column_starts[c]; i < column_starts[c + 1]; i++)
+      {
+        if (i == column_starts[c] || sorted[i].z != sorted[i - 1].z)
+        {
+          voxel_z_.push_back(sorted[i].z);
+          voxel_offsets_.push_back(i);
+        }
+        values_[i] = sorted[i].value;
+      }
+    }
+    column_voxels_[num_columns] = voxel_z_.size();
+    voxel_offsets_.push_back(sorted.size());
+  }
+
+  /// the values in voxel (x, y, z)
+  Span cell(int x, int y, int z) const { return column(x, y, z, z); }
+
+  /// the values in voxels (x, y, z) for @c z_min <= z <= @c z_max, which are contiguous
+  Span column(int x, int y, int z_min, int z_max) const
+  {
+    if (x < 0 || x >= dims[0] || y < 0 || y >= dims[1] || z_max < z_min || column_voxels_.empty())
+    {
+      return Span(nullptr, nullptr);
+    }
+    const size_t c = static_cast<size_t>(x) * static_cast<size_t>(dims[1]) + static_cast<size_t>(y);
+    const auto column_begin = voxel_z_.begin() + column_voxels_[c];
+    const auto column_end = voxel_z_.begin() + column_voxels_[c + 1];
+    const auto first = std::lower_bound(column_begin, column_end, z_min);
+    const auto last = std::upper_bound(first, column_end, z_max);
+    return Span(values_.data() + voxel_offsets_[first - voxel_z_.begin()],
+                values_.data() + voxel_offsets_[last - voxel_z_.begin()]);
+  }
+
+  /// the number of voxels that hold values, after @c finalise()
+  size_t occupiedCount() const { return voxel_z_.size(); }
+  /// the total number of values stored, after @c finalise()
+  size_t valueCount() const { return values_.size(); }
+
+  Eigen::Vector3d box_min, box_max;
+  double voxel_width;
+  Eigen::Vector3i dims;
+
+protected:
+  struct Entry
+  {
+    size_t column;  // x * dims[1] + y
+    int z;
+    T value;
+    inline bool operator<(const Entry &other) const { return z < other.z || (z == other.z && value < other.value); }
+  };
+
+  inline std::vector<Entry> &localEntries()
+  {
+#if RAYLIB_PARALLEL_GRID
+    return local_entries_.local();
+#else   // RAYLIB_PARALLEL_GRID
+    return entries_;
+#endif  // RAYLIB_PARALLEL_GRID
+  }
+  inline void append(std::vector<Entry> &entries, const Eigen::Vector3i &index, const T &value) const
+  {
+    if (index[0] < 0 || index[0] >= dims[0] || index[1] < 0 || index[1] >= dims[1] || index[2] < 0 ||
+        index[2] >= dims[2])
+    {
+      return;
+    }
+    entries.push_back(
+      Entry{ static_cast<size_t>(index[0]) * static_cast<size_t>(dims[1]) + static_cast<size_t>(index[1]), index[2],
+             value });
+  }
+
+  /// The packed layout. The occupied voxels of column c are voxel indices column_voxels_[c] to column_voxels_[c + 1],
+  /// in increasing z. The values of voxel v are values_[voxel_offsets_[v]] to values_[voxel_offsets_[v + 1]]
+  std::vector<size_t> column_voxels_;
+  std::vector<int> voxel_z_;
+  std::vector<size_t> voxel_offsets_;
+  std::vector<T> values_;
+#if RAYLIB_PARALLEL_GRID
+  tbb::enumerable_thread_specific<std::vector<Entry>> local_entries_;
+#else   // RAYLIB_PARALLEL_GRID
+  std::vector<Entry> entries_;
+#endif  // RAYLIB_PARALLEL_GRID
+};
+
+/// Dense 3D grid, with an index per voxel. Values can be appended to each voxel's @c Cell , or built in one pass with
+/// @c build() into a packed layout (CSR) of one contiguous array of values with an offset per voxel, read with
+/// @c values() . The packed layout avoids an allocation per voxel, and neighbouring voxels in x are adjacent in memory.
 template <class T>
 class ContiguousGrid
 {
 public:
+  /// a contiguous range of values in the grid, for use in range-based for loops
+  using Span = typename PackedGrid<T>::Span;
+
   ContiguousGrid() {}
   ContiguousGrid(const Eigen::Vector3d &box_min, const Eigen::Vector3d &box_max, double voxel_width,
                  double voxel_height = 0)
@@ -274,8 +537,11 @@ public:
     this->voxel_width = voxel_width;
     this->voxel_height = voxel_height ? voxel_height : voxel_width;
     Eigen::Vector3d diff = (box_max - box_min) / voxel_width;
-    dims = Eigen::Vector3i(ceil(diff[0]), ceil(diff[1]), ceil((box_max[2] - box_min[2]) / voxel_height));
-    cells.resize(dims[0] * dims[1] * dims[2]);
+    dims = Eigen::Vector3i(ceil(diff[0]), ceil(diff[1]), ceil((box_max[2] - box_min[2]) / this->voxel_height));
+    cells.clear();
+    cells.resize(static_cast<size_t>(dims[0]) * static_cast<size_t>(dims[1]) * static_cast<size_t>(dims[2]));
+    cell_offsets_.clear();
+    values_.clear();
   }
   struct Cell
   {
@@ -291,39 +557,86 @@ public:
   }
   inline Cell &cell(const Eigen::Vector3i &index)
   {
-    const double &x = index[0];
-    const double &y = index[1];
-    const double &z = index[2];
-    if (x < 0 || x >= dims[0] || y < 0 || y >= dims[1] || z < 0 || z >= dims[2])
-      return null_cell_;
-    return cells[x + dims[0] * y + dims[0] * dims[1] * z];
+    const size_t c = cellId(index);
+    return c == kNoCell ? null_cell_ : cells[c];
   }
   inline const Cell &cell(const Eigen::Vector3i &index) const
   {
-    const double &x = index[0];
-    const double &y = index[1];
-    const double &z = index[2];
-    if (x < 0 || x >= dims[0] || y < 0 || y >= dims[1] || z < 0 || z >= dims[2])
-      return null_cell_;
-    return cells[x + dims[0] * y + dims[0] * dims[1] * z];
+    const size_t c = cellId(index);
+    return c == kNoCell ? null_cell_ : cells[c];
   }
   inline void insert(const Eigen::Vector3i &index, const T &value)
   {
-    const double &x = index[0];
-    const double &y = index[1];
-    const double &z = index[2];
-    if (x < 0 || x >= dims[0] || y < 0 || y >= dims[1] || z < 0 || z >= dims[2])
-      std::cout << "warning: bad input coordinates: " << x << ", " << y << ", " << z << std::endl;
-    cell(x, y, z).data.emplace_back(value);
+    const size_t c = cellId(index);
+    if (c == kNoCell)
+    {
+      std::cout << "warning: bad input coordinates: " << index.transpose() << std::endl;
+      return;
+    }
+    cells[c].data.emplace_back(value);
   }
+
+  /// Build the packed layout in two passes over @c num_items items, replacing any packed values. For each item i,
+  /// @c visit(i, add) calls @c add(index, value) for each of its values. The items are first visited to count the
+  /// values of each voxel, in parallel when built with TBB, then the counts are prefix summed into the voxel offsets,
+  /// and the items are visited again in order to fill the values. So @c visit must add the same indices each time,
+  /// and the values of each voxel are in the order they were added. Indices outside of @c dims are ignored.
+  template <class Visit>
+  void build(size_t num_items, const Visit &visit)
+  {
+    const size_t num_cells = cells.size();
+    cell_offsets_.assign(num_cells + 1, 0);
+#if RAYLIB_PARALLEL_GRID
+    std::unique_ptr<std::atomic<size_t>[]> counts(new std::atomic<size_t>[num_cells]);
+    for (size_t c = 0; c < num_cells; c++) counts[c].store(0, std::memory_order_relaxed);
+    tbb::parallel_for<size_t>(0, num_items, [&](size_t i) {
+      visit(i, [&](const Eigen::Vector3i &index, const T &) {
+        const size_t c = cellId(index);
+        if (c != kNoCell)
+          counts[c].fetch_add(1, std::memory_order_relaxed);
+      });
+    });
+    for (size_t c = 0; c < num_cells; c++) cell_offsets_[c + 1] = counts[c].load(std::memory_order_relaxed);
+#else   // RAYLIB_PARALLEL_GRID
+    for (size_t i = 0; i < num_items; i++)
+    {
+      visit(i, [&](const Eigen::Vector3i &index, const T &) {
+        const size_t c = cellId(index);
+        if (c != kNoCell)
+          cell_offsets_[c + 1]++;
+      });
+    }
+#endif  // RAYLIB_PARALLEL_GRID
+    for (size_t c = 0; c < num_cells; c++) cell_offsets_[c + 1] += cell_offsets_[c];
+    values_.resize(cell_offsets_[num_cells]);
+    std::vector<size_t> cursors(cell_offsets_.begin(), cell_offsets_.end() - 1);
+    for (size_t i = 0; i < num_items; i++)
+    {
+      visit(i, [&](const Eigen::Vector3i &index, const T &value) {
+        const size_t c = cellId(index);
+        if (c != kNoCell)
+          values_[cursors[c]++] = value;
+      });
+    }
+  }
+
+  /// the packed values of the voxel at @c index , after @c build() . Empty outside of @c dims
+  inline Span values(const Eigen::Vector3i &index) const
+  {
+    const size_t c = cellId(index);
+    if (c == kNoCell || cell_offsets_.empty())
+      return Span(nullptr, nullptr);
+    return Span(values_.data() + cell_offsets_[c], values_.data() + cell_offsets_[c + 1]);
+  }
+
   void report()
   {
-    int count = 0;
-    int totalCount = 0;
+    size_t count = 0;
+    size_t totalCount = 0;
 
     for (auto &cell : cells)
     {
-      int size = cell.data.size();
+      size_t size = cell.data.size();
       if (size > 0)
         count++;
       totalCount += size;
@@ -339,8 +652,22 @@ public:
   Eigen::Vector3i dims;
 
 protected:
+  static constexpr size_t kNoCell = std::numeric_limits<size_t>::max();
+  /// the position of the voxel at @c index in @c cells , or @c kNoCell outside of @c dims
+  inline size_t cellId(const Eigen::Vector3i &index) const
+  {
+    if (index[0] < 0 || index[0] >= dims[0] || index[1] < 0 || index[1] >= dims[1] || index[2] < 0 ||
+        index[2] >= dims[2])
+      return kNoCell;
+    return static_cast<size_t>(index[0]) +
+           static_cast<size_t>(dims[0]) * (static_cast<size_t>(index[1]) + static_cast<size_t>(dims[1]) * index[2]);
+  }
+
   std::vector<Cell> cells;
   Cell null_cell_;
+  /// the packed layout. The values of voxel c are values_[cell_offsets_[c]] to values_[cell_offsets_[c + 1]]
+  std::vector<size_t> cell_offsets_;
+  std::vector<T> values_;
 };
 
 }  // namespace ray
@@ -0,0 +1,199 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "rayheightfieldwrap.h"
+#include "rayprofile.h"
+
+#include <limits>
+
+#if RAYLIB_WITH_TBB
+#include <tbb/parallel_for.h>
+#endif  // RAYLIB_WITH_TBB
+
+namespace ray
+{
+namespace
+{
+const double kEmpty = std::numeric_limits<double>::infinity();
+
+/// the lower envelope of the parabolas of height @c line[i] at i and second differential 2 @c k , written in place
+/// to the @c n values of @c line , @c stride apart. This is the 1D squared distance transform of Felzenszwalb and
+/// Huttenlocher, linear in @c n . Empty values are missing parabolas
+void lowerEnvelope(double *line, int n, int stride, double k, std::vector<int> &apexes, std::vector<double> &bounds,
+                   std::vector<double> &envelope)
+{
+  apexes.resize(n);
+  bounds.resize(n + 1);
+  envelope.resize(n);
+  int num = 0;
+  for (int q = 0; q < n; q++)
+  {
+    const double fq = line[q * stride];
+    if (fq == kEmpty)
+    {
+      continue;
+    }
+    double s = -kEmpty;
+    while (num > 0)
+    {
+      const int v = apexes[num - 1];
+      s = ((fq + k * q * q) - (line[v * stride] + k * v * v)) / (2.0 * k * (q - v));
+      if (s > bounds[num - 1])
+      {
+        break;
+      }
+      num--;
+    }
+    if (num == 0)
+    {
+      s = -kEmpty;
+    }
+    apexes[num] = q;
+    bounds[num] = s;
+    num++;
+  }
+  if (num == 0)
+  {
+    return;
+  }
+  bounds[num] = kEmpty;
+  int j = 0;
+  for (int q = 0; q < n; q++)
+  {
+    while (bounds[j + 1] < static_cast<double>(q))
+    {
+      j++;
+    }
+    const int v = apexes[j];
+    envelope[q] = line[v * stride] + k * (q - v) * (q - v);
+  }
+  for (int q = 0; q < n; q++)
+  {
+    line[q * stride] = envelope[q];
+  }
+}
+
+/// call @c func on each of @c num lines, in parallel with TBB
+template <class Func>
+void forEachLine(int num, const Func &func)
+{
+#if RAYLIB_WITH_TBB
+  tbb::parallel_for(0, num, [&](int line) {
+    std::vector<int> apexes;
+    std::vector<double> bounds, envelope;
+    func(line, apexes, bounds, envelope);
+  });
+#else
+  std::vector<int> apexes;
+  std::vector<double> bounds, envelope;
+  for (int line = 0; line < num; line++)
+  {
+    func(line, apexes, bounds, envelope);
+  }
+#endif  // RAYLIB_WITH_TBB
+}
+
+/// @c field(x) becomes the minimum over y of @c field(y) + @c k |x - y|^2 , which is separable into the two axes
+void lowerEnvelope(Eigen::ArrayXXd &field, double k)
+{
+  const int rows = static_cast<int>(field.rows());
+  const int cols = static_cast<int>(field.cols());
+  double *data = field.data();  // column major
+  forEachLine(cols, [&](int col, std::vector<int> &apexes, std::vector<double> &bounds, std::vector<double> &envelope) {
+    lowerEnvelope(data + col * rows, rows, 1, k, apexes, bounds, envelope);
+  });
+  forEachLine(rows, [&](int row, std::vector<int> &apexes, std::vector<double> &bounds, std::vector<double> &envelope) {
+    lowerEnvelope(data + row, cols, rows, k, apexes, bounds, envelope);
+  });
+}
+}  // namespace
+
+HeightFieldWrap::HeightFieldWrap(const Eigen::Vector3d &min_bound, const Eigen::Vector3d &max_bound,
+                                 double pixel_width)
+  : min_bound_(min_bound)
+  , pixel_width_(pixel_width)
+{
+  const Eigen::Vector3d extent = max_bound - min_bound;
+  dims_ = Eigen::Vector2i(std::max(1, static_cast<int>(std::ceil(extent[0] / pixel_width))),
+                          std::max(1, static_cast<int>(std::ceil(extent[1] / pixel_width))));
+  lowests_ = Eigen::ArrayXXd::Constant(dims_[0], dims_[1], kEmpty);
+  highests_ = Eigen::ArrayXXd::Constant(dims_[0], dims_[1], -kEmpty);
+}
+
+void HeightFieldWrap::addPoints(const std::vector<Eigen::Vector3d> &points)
+{
+  for (const auto &point : points)
+  {
+    const Eigen::Vector3d pos = (point - min_bound_) / pixel_width_;
+    const int x = std::max(0, std::min(static_cast<int>(pos[0]), dims_[0] - 1));
+    const int y = std::max(0, std::min(static_cast<int>(pos[1]), dims_[1] - 1));
+    lowests_(x, y) = std::min(lowests_(x, y), point[2]);
+    highests_(x, y) = std::max(highests_(x, y), point[2]);
+  }
+}
+
+void HeightFieldWrap::grow(double maxCurvature, bool upwards)
+{
+  ProfileScope profile("HeightFieldWrap::grow");
+  profile.count(static_cast<size_t>(dims_[0]) * static_cast<size_t>(dims_[1]));
+  mesh_.vertices().clear();
+  mesh_.indexList().clear();
+  // work in the upwards sense, with heights negated for the downwards wrap
+  Eigen::ArrayXXd heights = upwards ? lowests_ : Eigen::ArrayXXd(-highests_);
+  const double lowest = heights.minCoeff();
+  if (lowest == kEmpty)
+  {
+    return;  // no points
+  }
+  // the wrap is the upper envelope of the paraboloids z = a - 0.5 maxCurvature r^2 that are below every height, so
+  // the erosion by the paraboloid gives the highest paraboloid at each apex, and the dilation their upper envelope
+  const double k = 0.5 * maxCurvature * pixel_width_ * pixel_width_;
+  if (k <= 0.0)
+  {
+    heights.setConstant(lowest);  // only horizontal planes are allowed
+  }
+  else
+  {
+    lowerEnvelope(heights, k);
+    heights = -heights;
+    lowerEnvelope(heights, k);
+    heights = -heights;
+  }
+  const double sign = upwards ? 1.0 : -1.0;
+
+  mesh_.vertices().reserve(dims_[0] * dims_[1]);
+  for (int y = 0; y < dims_[1]; y++)
+  {
+    for (int x = 0; x < dims_[0]; x++)
+    {
+      mesh_.vertices().push_back(Eigen::Vector3d(min_bound_[0] + (static_cast<double>(x) + 0.5) * pixel_width_,
+                                                 min_bound_[1] + (static_cast<double>(y) + 0.5) * pixel_width_,
+                                                 sign * heights(x, y)));
+    }
+  }
+  mesh_.indexList().reserve(2 * std::max(0, dims_[0] - 1) * std::max(0, dims_[1] - 1));
+  for (int y = 0; y < dims_[1] - 1; y++)
+  {
+    for (int x = 0; x < dims_[0] - 1; x++)
+    {
+      const int a = x + dims_[0] * y;
+      const int b = a + 1;
+      const int c = a + dims_[0];
+      const int d = c + 1;
+      // wound to face downwards when growing upwards, away from the cloud as the convex hull's faces are
+      if (upwards)
+      {
+        mesh_.indexList().push_back(Eigen::Vector3i(a, d, b));
+        mesh_.indexList().push_back(Eigen::Vector3i(a, c, d));
+      }
+      else
+      {
+        mesh_.indexList().push_back(Eigen::Vector3i(a, b, d));
+        mesh_.indexList().push_back(Eigen::Vector3i(a, d, c));
+      }
+    }
+  }
+}
+}  // namespace ray
@@ -0,0 +1,52 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYHEIGHTFIELDWRAP_H
+#define RAYLIB_RAYHEIGHTFIELDWRAP_H
+
+#include "raylib/raylibconfig.h"
+
+#include "raymesh.h"
+#include "rayutils.h"
+
+namespace ray
+{
+/// A 2.5D form of the upwards and downwards wrapping of @c ConvexHull , for clouds without overhangs. The end points
+/// are binned into a grid of their lowest (upwards) or highest (downwards) heights, and the wrap is the highest
+/// surface below the lowest heights (lowest above the highest) whose curvature away from the cloud nowhere exceeds
+/// @c maxCurvature . This is the opening of the height grid by the paraboloid of that curvature, calculated exactly
+/// per pixel with two separable squared distance transforms, so time and memory are linear in the number of pixels.
+/// Pixels without points are bridged, like the convex hull does over its gaps.
+class RAYLIB_EXPORT HeightFieldWrap
+{
+public:
+  /// the grid covers @c min_bound to @c max_bound in x and y, at @c pixel_width per pixel
+  HeightFieldWrap(const Eigen::Vector3d &min_bound, const Eigen::Vector3d &max_bound, double pixel_width);
+
+  /// add the end points @c points to the height grid. This can be called repeatedly, for chunked clouds
+  void addPoints(const std::vector<Eigen::Vector3d> &points);
+
+  /// upwards growth is for extracting the ground mesh underneath a scene
+  void growUpwards(double maxCurvature) { grow(maxCurvature, true); }
+  /// downwards growth is for extracting a 'blanket mesh' of a forest canopy or of building roofs
+  void growDownwards(double maxCurvature) { grow(maxCurvature, false); }
+
+  /// access the generated mesh. It has a vertex at the centre of each pixel, and faces away from the cloud
+  Mesh &mesh() { return mesh_; }
+  const Mesh &mesh() const { return mesh_; }
+
+private:
+  void grow(double maxCurvature, bool upwards);
+
+  Eigen::Vector3d min_bound_;
+  double pixel_width_;
+  Eigen::Vector2i dims_;
+  Eigen::ArrayXXd lowests_;
+  Eigen::ArrayXXd highests_;
+  Mesh mesh_;
+};
+}  // namespace ray
+
+#endif  // RAYLIB_RAYHEIGHTFIELDWRAP_H
@@ -0,0 +1,207 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "rayingest.h"
+#include "raycloudwriter.h"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+
+namespace ray
+{
+LiveIngest::LiveIngest(const IngestConfig &config, CloudWriter *writer, const ChunkCallback &on_chunk)
+  : config_(config)
+  , writer_(writer)
+  , on_chunk_(on_chunk)
+  , chunk_begin_time_(0.0)
+  , chunk_begun_(false)
+  , last_point_time_(std::numeric_limits<double>::lowest())
+  , num_received_(0)
+  , num_written_(0)
+  , num_decimated_(0)
+  , num_chunks_(0)
+{
+  if (config_.range_distance > 0.0)
+  {
+    filter_.reset(new RangeGapFilter(config_.range_distance));
+  }
+}
+
+bool LiveIngest::addPose(double time, const Eigen::Vector3d &position)
+{
+  if (!trajectory_.times().empty() && time <= trajectory_.times().back())
+  {
+    return true;
+  }
+  trajectory_.times().push_back(time);
+  trajectory_.points().push_back(position);
+  return update(false);
+}
+
+bool LiveIngest::addPoints(const std::vector<Eigen::Vector3d> &ends, const std::vector<double> &times,
+                           const std::vector<RGBA> &colours)
+{
+  pending_ends_.insert(pending_ends_.end(), ends.begin(), ends.end());
+  pending_times_.insert(pending_times_.end(), times.begin(), times.end());
+  pending_colours_.insert(pending_colours_.end(), colours.begin(), colours.end());
+  num_received_ += ends.size();
+  return update(false);
+}
+
+bool LiveIngest::finish()
+{
+  if (!update(true))
+  {
+    return false;
+  }
+  return !chunk_begun_ || outputChunk();
+}
+
+bool LiveIngest::update(bool final)
+{
+  size_t count = 0;
+  if (final)
+  {
+    if (trajectory_.times().empty() && !pending_times_.empty())
+    {
+      std::cerr << "Warning: " << pending_times_.size() << " points have no trajectory, so are not ingested"
+                << std::endl;
+      pending_ends_.clear();
+      pending_times_.clear();
+      pending_colours_.clear();
+    }
+    count = pending_times_.size();
+  }
+  else if (!trajectory_.times().empty() && !pending_times_.empty())
+  {
+    // points up to the last pose are interpolated, and those that have waited too long are extrapolated
+    const double ready_time = std::max(trajectory_.times().back(), pending_times_.back() - config_.max_wait);
+    count = std::upper_bound(pending_times_.begin(), pending_times_.end(), ready_time) - pending_times_.begin();
+  }
+
+  // a chunk is output once its rays span the chunk duration, so the rays are converted up to each chunk's end
+  size_t first = 0;
+  while (first < count)
+  {
+    if (!chunk_begun_)
+    {
+      chunk_begin_time_ = pending_times_[first];
+      chunk_begun_ = true;
+    }
+    const double chunk_end_time = chunk_begin_time_ + config_.chunk_duration;
+    size_t last = std::lower_bound(pending_times_.begin() + first, pending_times_.begin() + count, chunk_end_time) -
+                  pending_times_.begin();
+    last = std::max(last, first + 1);  // so a chunk of zero duration holds one ray
+    convert(first, last);
+    first = last;
+    // the chunk is complete once a later point is due after its end
+    if (last < pending_times_.size() && pending_times_[last] >= chunk_end_time)
+    {
+      if (!outputChunk())
+      {
+        return false;
+      }
+    }
+  }
+  pending_ends_.erase(pending_ends_.begin(), pending_ends_.begin() + count);
+  pending_times_.erase(pending_times_.begin(), pending_times_.begin() + count);
+  pending_colours_.erase(pending_colours_.begin(), pending_colours_.begin() + count);
+  pruneTrajectory();
+  return true;
+}
+
+void LiveIngest::convert(size_t first, size_t last)
+{
+  if (first == last)
+  {
+    return;
+  }
+  const std::vector<double> times(pending_times_.begin() + first, pending_times_.begin() + last);
+  std::vector<Eigen::Vector3d> ends(pending_ends_.begin() + first, pending_ends_.begin() + last);
+  const std::vector<RGBA> colours(pending_colours_.begin() + first, pending_colours_.begin() + last);
+  if (trajectory_.times().size() == 1)
+  {
+    starts_.assign(times.size(), trajectory_.points()[0]);
+  }
+  else
+  {
+    trajectory_.linear(times, starts_);
+  }
+  for (size_t i = 0; i < ends.size(); i++)
+  {
+    if (colours[i].alpha == 0 && ends[i][2] < starts_[i][2])  // a downward non-return, shortened as in rayimport
+    {
+      const double minimal_distance_for_nonreturns = 0.1;
+      ends[i] = starts_[i] + (ends[i] - starts_[i]).normalized() * minimal_distance_for_nonreturns;
+    }
+  }
+  last_point_time_ = times.back();
+
+  filtered_.clear();
+  if (filter_)
+  {
+    filter_->filter(starts_, ends, times, colours, filtered_);
+  }
+  else
+  {
+    filtered_.starts = starts_;
+    filtered_.ends = ends;
+    filtered_.times = times;
+    filtered_.colours = colours;
+  }
+
+  if (config_.voxel_width > 0.0)
+  {
+    subsample_.clear();
+    voxelSubsample(filtered_.ends, config_.voxel_width, subsample_, voxel_set_);
+    for (const auto &id : subsample_)
+    {
+      chunk_.addRay(filtered_, static_cast<size_t>(id));
+    }
+    num_decimated_ += filtered_.ends.size() - subsample_.size();
+  }
+  else
+  {
+    for (size_t i = 0; i < filtered_.ends.size(); i++)
+    {
+      chunk_.addRay(filtered_, i);
+    }
+  }
+}
+
+void LiveIngest::pruneTrajectory()
+{
+  std::vector<double> &times = trajectory_.times();
+  std::vector<Eigen::Vector3d> &points = trajectory_.points();
+  // no point earlier than the first waiting point, or else the last converted point, is still to come
+  const double earliest = pending_times_.empty() ? last_point_time_ : pending_times_.front();
+  const size_t index = std::lower_bound(times.begin(), times.end(), earliest) - times.begin();
+  // keep the pose before the earliest point, and at least two poses to interpolate between
+  const size_t num_dropped = std::min(index > 0 ? index - 1 : 0, times.size() > 2 ? times.size() - 2 : 0);
+  if (num_dropped > 0)
+  {
+    times.erase(times.begin(), times.begin() + num_dropped);
+    points.erase(points.begin(), points.begin() + num_dropped);
+  }
+}
+
+bool LiveIngest::outputChunk()
+{
+  chunk_begun_ = false;
+  num_chunks_++;
+  num_written_ += chunk_.ends.size();
+  if (writer_ && !writer_->writeChunk(chunk_))
+  {
+    return false;
+  }
+  if (on_chunk_)
+  {
+    on_chunk_(chunk_);
+  }
+  chunk_.clear();
+  return true;
+}
+}  // namespace ray
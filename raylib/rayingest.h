@@ -0,0 +1,111 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYINGEST_H
+#define RAYLIB_RAYINGEST_H
+
+#include "raylib/raylibconfig.h"
+
+#include "raycloud.h"
+#include "raydenoise.h"
+#include "raytrajectory.h"
+#include "rayutils.h"
+#include "rayvoxelset.h"
+
+#include <functional>
+#include <memory>
+
+namespace ray
+{
+class CloudWriter;
+
+/// Parameters of @c LiveIngest
+struct RAYLIB_EXPORT IngestConfig
+{
+  double voxel_width = 0.0;     ///< Keep only the first ray ending in each voxel of this width. Zero keeps every ray.
+  double range_distance = 0.0;  ///< Remove rays whose range jumps from both neighbours, as @c RangeGapFilter . Zero
+                                ///< keeps every ray.
+  double chunk_duration = 1.0;  ///< The seconds of sensor time gathered into each output chunk.
+  double max_wait = 2.0;        ///< The seconds of sensor time that a point waits for a later trajectory pose, after
+                                ///< which its start is extrapolated from the poses so far.
+};
+
+/// Incremental conversion of streamed points and trajectory poses into a ray cloud, while they are still being
+/// captured, such as from a vehicle's sensor topics. Each point waits until a pose at or after its time arrives, then
+/// its start is interpolated on the trajectory, as in @c rayimport . The converted rays pass through the streaming
+/// stages of the offline tools, the range gap denoise of @c RangeGapFilter then the spatial decimation of
+/// @c raydecimate against one @c VoxelSet , and are output every @c chunk_duration seconds of sensor time: appended to
+/// a @c CloudWriter and passed to a callback, to be published. So the latency from capture to output is the chunk
+/// duration plus the trajectory's lag, and at most @c max_wait seconds beyond the chunk duration.
+///
+/// The points and poses are each expected in time order, and the points in the trajectory's frame. Only the poses
+/// still needed by the waiting points are kept, so memory is bounded by the latency, apart from the decimation voxels,
+/// which grow with the decimated cloud as in @c raydecimate .
+class RAYLIB_EXPORT LiveIngest
+{
+public:
+  using ChunkCallback = std::function<void(const Cloud &chunk)>;
+
+  /// Ingest with the stages of @c config , appending the output to @c writer , which must have been begun, and passing
+  /// each output chunk to @c on_chunk . Either may be null.
+  LiveIngest(const IngestConfig &config, CloudWriter *writer, const ChunkCallback &on_chunk = ChunkCallback());
+
+  /// Add the trajectory position @c position at @c time . Poses that are not after the previous pose are ignored.
+  /// Returns false if an output chunk could not be written.
+  bool addPose(double time, const Eigen::Vector3d &position);
+  /// Add the points @c ends , observed at @c times , with @c colours whose alpha is the intensity, zero for
+  /// non-returns. Returns false if an output chunk could not be written.
+  bool addPoints(const std::vector<Eigen::Vector3d> &ends, const std::vector<double> &times,
+                 const std::vector<RGBA> &colours);
+  /// Convert all the waiting points, extrapolating the trajectory for those after its last pose, and output the last
+  /// chunk, at the end of the stream. Returns false if it could not be written.
+  bool finish();
+
+  /// The number of points given, the number waiting to be converted, and the number of rays output
+  inline size_t numReceived() const { return num_received_; }
+  inline size_t numPending() const { return pending_ends_.size(); }
+  inline size_t numWritten() const { return num_written_; }
+  /// The number of rays removed by the range gap denoise, and by the decimation
+  inline size_t numDenoised() const { return filter_ ? filter_->numRemoved() : 0; }
+  inline size_t numDecimated() const { return num_decimated_; }
+  /// The number of output chunks
+  inline size_t numChunks() const { return num_chunks_; }
+
+private:
+  /// convert the waiting points that are ready, and output the chunk if it is complete
+  bool update(bool final);
+  /// convert the waiting points from index @c first up to @c last into @c chunk_
+  void convert(size_t first, size_t last);
+  /// drop the poses before the one preceding the earliest point still to be converted
+  void pruneTrajectory();
+  /// output @c chunk_ and start a new chunk
+  bool outputChunk();
+
+  IngestConfig config_;
+  CloudWriter *writer_;
+  ChunkCallback on_chunk_;
+  Trajectory trajectory_;
+  std::unique_ptr<RangeGapFilter> filter_;
+  VoxelSet voxel_set_;
+
+  std::vector<Eigen::Vector3d> pending_ends_;
+  std::vector<double> pending_times_;
+  std::vector<RGBA> pending_colours_;
+  std::vector<Eigen::Vector3d> starts_;  // buffers of the rays being converted, kept to avoid reallocation
+  Cloud filtered_;
+  Cloud chunk_;
+  std::vector<int64_t> subsample_;
+  double chunk_begin_time_;
+  bool chunk_begun_;
+  double last_point_time_;  // the time of the last point converted, before which no more points are expected
+
+  size_t num_received_;
+  size_t num_written_;
+  size_t num_decimated_;
+  size_t num_chunks_;
+};
+}  // namespace ray
+
+#endif  // RAYLIB_RAYINGEST_H
@@ -0,0 +1,163 @@
+// Copyright (c) 2020
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raykernels.h"
+
+#if RAYLIB_WITH_TBB
+#include <tbb/parallel_for.h>
+#endif  // RAYLIB_WITH_TBB
+
+#include <limits>
+
+namespace ray
+{
+namespace
+{
+// the point arrays are read directly as 3xN matrices, which relies on there being no padding
+static_assert(sizeof(Eigen::Vector3d) == 3 * sizeof(double), "Eigen::Vector3d is expected to be unpadded");
+
+/// A block of points in structure-of-arrays form. Eigen is column-major, so each axis is contiguous
+using PointBlock = Eigen::Matrix<double, Eigen::Dynamic, 3>;
+
+inline size_t numBlocks(size_t count)
+{
+  return (count + kKernelBlockSize - 1) / kKernelBlockSize;
+}
+
+/// Calls @c op(block_index, begin, end) for each block of the @c count elements, in parallel when available
+template <class BlockOp>
+void forEachBlock(size_t count, const BlockOp &op)
+{
+  const size_t num_blocks = numBlocks(count);
+  auto run_block = [&](size_t block) {
+    op(block, block * kKernelBlockSize, std::min(count, (block + 1) * kKernelBlockSize));
+  };
+#if RAYLIB_WITH_TBB
+  tbb::parallel_for<size_t>(0, num_blocks, run_block);
+#else   // RAYLIB_WITH_TBB
+  for (size_t block = 0; block < num_blocks; block++) run_block(block);
+#endif  // RAYLIB_WITH_TBB
+}
+
+inline Eigen::Map<const Eigen::Matrix3Xd> pointMap(const std::vector<Eigen::Vector3d> &points, size_t begin,
+                                                   size_t end)
+{
+  return Eigen::Map<const Eigen::Matrix3Xd>(points[begin].data(), 3, static_cast<Eigen::Index>(end - begin));
+}
+}  // namespace
+
+void transformPoints(std::vector<Eigen::Vector3d> &points, const Pose &pose)
+{
+  // as row vectors, p' = p R^T + t
+  const Eigen::Matrix3d rotation_t = pose.rotation.toRotationMatrix().transpose();
+  const Eigen::RowVector3d position = pose.position.transpose();
+  forEachBlock(points.size(), [&](size_t, size_t begin, size_t end) {
+    Eigen::Map<Eigen::Matrix3Xd> map(points[begin].data(), 3, static_cast<Eigen::Index>(end - begin));
+    const PointBlock block = map.transpose();
+    PointBlock result;
+    result.noalias() = block * rotation_t;
+    result.rowwise() += position;
+    map = result.transpose();
+  });
+}
+
+void offsetTimes(std::vector<double> &times, double delta)
+{
+  forEachBlock(times.size(), [&](size_t, size_t begin, size_t end) {
+    Eigen::Map<Eigen::ArrayXd>(times.data() + begin, static_cast<Eigen::Index>(end - begin)) += delta;
+  });
+}
+
+size_t expandBounds(const std::vector<Eigen::Vector3d> &points, const std::vector<RGBA> *colours,
+                    Eigen::Vector3d &min_bound, Eigen::Vector3d &max_bound, Eigen::Vector3d *sum)
+{
+  const size_t num_blocks = numBlocks(points.size());
+  std::vector<Eigen::Vector3d> block_mins(num_blocks, min_bound);
+  std::vector<Eigen::Vector3d> block_maxs(num_blocks, max_bound);
+  std::vector<Eigen::Vector3d> block_sums(num_blocks, Eigen::Vector3d::Zero());
+  std::vector<size_t> block_counts(num_blocks, 0);
+  forEachBlock(points.size(), [&](size_t block_index, size_t begin, size_t end) {
+    if (!colours)
+    {
+      const PointBlock block = pointMap(points, begin, end).transpose();
+      block_mins[block_index] = block.colwise().minCoeff().transpose();
+      block_maxs[block_index] = block.colwise().maxCoeff().transpose();
+      if (sum)
+        block_sums[block_index] = block.colwise().sum().transpose();
+      block_counts[block_index] = end - begin;
+      return;
+    }
+    // when masked, the points are accumulated in place, as gathering the bounded ones costs more than it saves
+    Eigen::Vector3d &block_min = block_mins[block_index];
+    Eigen::Vector3d &block_max = block_maxs[block_index];
+    Eigen::Vector3d &block_sum = block_sums[block_index];
+    size_t num = 0;
+    for (size_t i = begin; i < end; i++)
+    {
+      if ((*colours)[i].alpha > 0)
+      {
+        block_min = block_min.cwiseMin(points[i]);
+        block_max = block_max.cwiseMax(points[i]);
+        block_sum += points[i];
+        num++;
+      }
+    }
+    block_counts[block_index] = num;
+  });
+  size_t total = 0;
+  for (size_t i = 0; i < num_blocks; i++)
+  {
+    min_bound = minVector(min_bound, block_mins[i]);
+    max_bound = maxVector(max_bound, block_maxs[i]);
+    if (sum)
+      *sum += block_sums[i];
+    total += block_counts[i];
+  }
+  return total;
+}
+
+void expandTimeRange(const std::vector<double> &times, double &min_time, double &max_time)
+{
+  const size_t num_blocks = numBlocks(times.size());
+  std::vector<double> block_mins(num_blocks, min_time);
+  std::vector<double> block_maxs(num_blocks, max_time);
+  forEachBlock(times.size(), [&](size_t block_index, size_t begin, size_t end) {
+    Eigen::Map<const Eigen::ArrayXd> block(times.data() + begin, static_cast<Eigen::Index>(end - begin));
+    block_mins[block_index] = std::min(block_mins[block_index], block.minCoeff());
+    block_maxs[block_index] = std::max(block_maxs[block_index], block.maxCoeff());
+  });
+  for (size_t i = 0; i < num_blocks; i++)
+  {
+    min_time = std::min(min_time, block_mins[i]);
+    max_time = std::max(max_time, block_maxs[i]);
+  }
+}
+
+Eigen::Vector3d sumPoints(const std::vector<Eigen::Vector3d> &points)
+{
+  std::vector<Eigen::Vector3d> block_sums(numBlocks(points.size()));
+  forEachBlock(points.size(), [&](size_t block_index, size_t begin, size_t end) {
+    const PointBlock block = pointMap(points, begin, end).transpose();
+    block_sums[block_index] = block.colwise().sum().transpose();
+  });
+  Eigen::Vector3d sum(0, 0, 0);
+  for (const auto &block_sum : block_sums) sum += block_sum;
+  return sum;
+}
+
+Eigen::Vector3d sumSquaredDeviations(const std::vector<Eigen::Vector3d> &points, const Eigen::Vector3d &mean)
+{
+  std::vector<Eigen::Vector3d> block_sums(numBlocks(points.size()));
+  const Eigen::RowVector3d mean_row = mean.transpose();
+  forEachBlock(points.size(), [&](size_t block_index, size_t begin, size_t end) {
+    PointBlock block = pointMap(points, begin, end).transpose();
+    block.rowwise() -= mean_row;
+    block_sums[block_index] = block.array().square().colwise().sum().transpose();
+  });
+  Eigen::Vector3d sum(0, 0, 0);
+  for (const auto &block_sum : block_sums) sum += block_sum;
+  return sum;
+}
+}  // namespace ray
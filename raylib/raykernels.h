@@ -0,0 +1,47 @@
+// Copyright (c) 2020
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYKERNELS_H
+#define RAYLIB_RAYKERNELS_H
+
+#include "raylib/raylibconfig.h"
+
+#include "raypose.h"
+#include "rayutils.h"
+
+namespace ray
+{
+/// Bulk operations over the per-ray arrays of a ray cloud.
+/// The arrays are processed in blocks of @c kKernelBlockSize elements. Each block of points is transposed into
+/// structure-of-arrays form, so that Eigen's packet operations (SSE2 by default, AVX2 or NEON when built with the
+/// NATIVE_ARCH option) run along each axis. Blocks are spread across threads when built with TBB, and reductions are
+/// combined in block order, so the results do not depend on the number of threads.
+const size_t kKernelBlockSize = 2048;
+
+/// apply @c pose to each of the @c points, in place
+void RAYLIB_EXPORT transformPoints(std::vector<Eigen::Vector3d> &points, const Pose &pose);
+
+/// add @c delta to each of the @c times, in place
+void RAYLIB_EXPORT offsetTimes(std::vector<double> &times, double delta);
+
+/// expand @c min_bound and @c max_bound to contain the @c points. If @c colours is given then only the points of
+/// bounded rays (non-zero alpha) are included. The sum of the included points is added to @c sum, if given.
+/// @return the number of points included
+size_t RAYLIB_EXPORT expandBounds(const std::vector<Eigen::Vector3d> &points, const std::vector<RGBA> *colours,
+                                  Eigen::Vector3d &min_bound, Eigen::Vector3d &max_bound,
+                                  Eigen::Vector3d *sum = nullptr);
+
+/// expand @c min_time and @c max_time to contain the @c times
+void RAYLIB_EXPORT expandTimeRange(const std::vector<double> &times, double &min_time, double &max_time);
+
+/// the per-axis sum of the @c points
+Eigen::Vector3d RAYLIB_EXPORT sumPoints(const std::vector<Eigen::Vector3d> &points);
+
+/// the per-axis sum of squared differences between the @c points and @c mean
+Eigen::Vector3d RAYLIB_EXPORT sumSquaredDeviations(const std::vector<Eigen::Vector3d> &points,
+                                                   const Eigen::Vector3d &mean);
+}  // namespace ray
+
+#endif  // RAYLIB_RAYKERNELS_H
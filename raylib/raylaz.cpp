@@ -4,10 +4,19 @@
 //
 // Author: Thomas Lowe
 #include "raylaz.h"
+#include "raylib/raymemory.h"
+#include "raylib/rayprofile.h"
 #include "raylib/rayprogress.h"
 #include "raylib/rayprogressthread.h"
+#include "raylib/rayremotefile.h"
+#include "raythreads.h"
 #include "rayunused.h"
 
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
 #if RAYLIB_WITH_LAS
 #include <liblas/factory.hpp>
 #include <liblas/point.hpp>
@@ -15,6 +24,222 @@
 
 namespace ray
 {
+#if RAYLIB_WITH_LAS
+namespace
+{
+/// A decoded chunk of las points, with the intensity in the colour alpha
+struct LasChunk
+{
+  std::vector<Eigen::Vector3d> starts;
+  std::vector<Eigen::Vector3d> ends;
+  std::vector<double> times;
+  std::vector<RGBA> colours;
+  size_t num_bounded = 0;
+};
+
+/// A reader with its own stream, so that separate decoders can seek and decompress in parallel
+struct LasDecoder
+{
+  std::unique_ptr<InputFile> ifs;  // a local file or a remote object
+  std::unique_ptr<liblas::Reader> reader;
+  size_t next_point = 0;
+
+  bool open(const std::string &file_name)
+  {
+    ifs.reset(new InputFile(file_name));
+    if (ifs->fail())
+      return false;
+    liblas::ReaderFactory f;
+    reader.reset(new liblas::Reader(f.CreateWithStream(*ifs)));
+    return true;
+  }
+
+  /// decode @c count points from @c first_point . Consecutive chunks are read without seeking
+  bool decode(size_t first_point, size_t count, bool using_colour, double max_intensity, LasChunk &chunk)
+  {
+    chunk.starts.clear();
+    chunk.ends.clear();
+    chunk.times.clear();
+    chunk.colours.clear();
+    chunk.num_bounded = 0;
+    if (first_point != next_point && !reader->Seek(first_point))
+      return false;
+    next_point = first_point + count;
+    std::vector<uint8_t> intensities;
+    intensities.reserve(count);
+    chunk.ends.reserve(count);
+    chunk.times.reserve(count);
+    chunk.colours.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+      if (!reader->ReadNextPoint())
+        return false;
+      const liblas::Point &point = reader->GetPoint();
+      chunk.ends.emplace_back(point.GetX(), point.GetY(), point.GetZ());
+      if (using_colour)
+      {
+        liblas::Color colour = point.GetColor();
+        RGBA col;
+        col.red = static_cast<uint8_t>(colour.GetRed());
+        col.green = static_cast<uint8_t>(colour.GetGreen());
+        col.blue = static_cast<uint8_t>(colour.GetBlue());
+        chunk.colours.push_back(col);
+      }
+      chunk.times.push_back(point.GetTime());
+
+      const double point_int = point.GetIntensity();
+      const double normalised_intensity = (255.0 * point_int) / max_intensity;
+      const uint8_t intensity = static_cast<uint8_t>(std::min(normalised_intensity, 255.0));
+      if (intensity > 0)
+        chunk.num_bounded++;
+      intensities.push_back(intensity);
+    }
+    chunk.starts = chunk.ends;  // equal to position for laz files, as we do not store the start points
+    if (chunk.colours.size() == 0)
+    {
+      colourByTime(chunk.times, chunk.colours);
+    }
+    for (size_t i = 0; i < chunk.colours.size(); i++)  // add intensity into alpha channel
+      chunk.colours[i].alpha = intensities[i];
+    return true;
+  }
+};
+
+/// Decodes the chunks of a las file on a set of worker threads, each with its own @c LasDecoder , and passes them to
+/// @c apply in file order on the calling thread. Worker w decodes chunks w, w + num_workers, and so on, so the laz
+/// chunk table lets each seek to its chunks without decompressing the points between. Each worker holds at most
+/// two chunks, one being decoded and one waiting to be applied.
+class LasChunkPipeline
+{
+public:
+  using ApplyFunction = std::function<void(std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                                           std::vector<double> &times, std::vector<RGBA> &colours)>;
+
+  LasChunkPipeline(size_t number_of_points, size_t chunk_size, bool using_colour, double max_intensity)
+    : number_of_points_(number_of_points)
+    , chunk_size_(chunk_size)
+    , num_chunks_((number_of_points + (chunk_size - 1)) / chunk_size)
+    , using_colour_(using_colour)
+    , max_intensity_(max_intensity)
+  {}
+
+  /// the number of decode threads to use. Each has its own file stream and decompressor
+  static int defaultWorkerCount()
+  {
+    return std::max(1, std::min(Threads::threadCount() - 1, static_cast<int>(Threads::MaxRecommendedThreads)));
+  }
+
+  /// pass each chunk to @c apply in point order, decoding from the already opened @c first_decoder and from
+  /// @c num_workers - 1 more decoders of @c file_name . Returns false if a chunk could not be decoded.
+  bool run(const std::string &file_name, LasDecoder &first_decoder, const ApplyFunction &apply,
+           Progress &progress, int num_workers, size_t &num_bounded)
+  {
+    num_bounded = 0;
+    num_workers = static_cast<int>(std::min<size_t>(num_workers, num_chunks_));
+    if (num_workers <= 1)
+    {
+      // no benefit to threading, so decode the chunks in turn, without seeking
+      LasChunk chunk;
+      for (size_t c = 0; c < num_chunks_; c++)
+      {
+        if (!first_decoder.decode(firstPoint(c), chunkCount(c), using_colour_, max_intensity_, chunk))
+          return false;
+        num_bounded += chunk.num_bounded;
+        apply(chunk.starts, chunk.ends, chunk.times, chunk.colours);
+        progress.increment();
+      }
+      return true;
+    }
+
+    std::vector<std::unique_ptr<LasDecoder>> decoders;
+    for (int w = 1; w < num_workers; w++)
+    {
+      decoders.emplace_back(new LasDecoder);
+      if (!decoders.back()->open(file_name))
+        return false;
+    }
+    slots_.resize(num_workers);
+    std::vector<std::thread> workers;
+    for (int w = 0; w < num_workers; w++)
+    {
+      LasDecoder *decoder = w == 0 ? &first_decoder : decoders[w - 1].get();
+      workers.emplace_back(&LasChunkPipeline::decodeChunks, this, w, num_workers, decoder);
+    }
+
+    bool success = true;
+    LasChunk chunk;
+    for (size_t c = 0; c < num_chunks_ && success; c++)
+    {
+      Slot &slot = slots_[c % num_workers];
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait(lock, [&] { return slot.ready; });
+        std::swap(chunk, slot.chunk);
+        success = slot.success;
+        slot.ready = false;
+      }
+      condition_.notify_all();
+      if (!success)
+        break;
+      num_bounded += chunk.num_bounded;
+      apply(chunk.starts, chunk.ends, chunk.times, chunk.colours);
+      progress.increment();
+    }
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      abort_ = true;
+    }
+    condition_.notify_all();
+    for (auto &worker : workers) worker.join();
+    return success;
+  }
+
+private:
+  struct Slot
+  {
+    LasChunk chunk;
+    bool ready = false;
+    bool success = true;
+  };
+
+  size_t firstPoint(size_t index) const { return index * chunk_size_; }
+  size_t chunkCount(size_t index) const { return std::min(chunk_size_, number_of_points_ - firstPoint(index)); }
+
+  void decodeChunks(int worker, int num_workers, LasDecoder *decoder)
+  {
+    Slot &slot = slots_[worker];
+    LasChunk chunk;
+    for (size_t c = worker; c < num_chunks_; c += num_workers)
+    {
+      const bool success = decoder->decode(firstPoint(c), chunkCount(c), using_colour_, max_intensity_, chunk);
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait(lock, [&] { return !slot.ready || abort_; });
+        if (abort_)
+          return;
+        std::swap(chunk, slot.chunk);
+        slot.success = success;
+        slot.ready = true;
+      }
+      condition_.notify_all();
+      if (!success)
+        return;
+    }
+  }
+
+  size_t number_of_points_;
+  size_t chunk_size_;
+  size_t num_chunks_;
+  bool using_colour_;
+  double max_intensity_;
+  std::vector<Slot> slots_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  bool abort_ = false;
+};
+}  // namespace
+#endif  // RAYLIB_WITH_LAS
+
 bool readLas(const std::string &file_name,
              std::function<void(std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
                                 std::vector<double> &times, std::vector<RGBA> &colours)>
@@ -24,18 +249,13 @@ bool readLas(const std::string &file_name,
 #if RAYLIB_WITH_LAS
   std::cout << "readLas: filename: " << file_name << std::endl;
 
-  std::ifstream ifs;
-  ifs.open(file_name.c_str(), std::ios::in | std::ios::binary);
-
-  if (ifs.fail())
+  LasDecoder decoder;
+  if (!decoder.open(file_name))
   {
     std::cerr << "readLas: failed to open stream" << std::endl;
     return false;
   }
-
-  liblas::ReaderFactory f;
-  liblas::Reader reader = f.CreateWithStream(ifs);
-  liblas::Header const &header = reader.GetHeader();
+  liblas::Header const &header = decoder.reader->GetHeader();
 
   Eigen::Vector3d offset(header.GetOffsetX(), header.GetOffsetY(), header.GetOffsetZ());
   if (offset_to_remove)
@@ -56,75 +276,28 @@ bool readLas(const std::string &file_name,
 
   ray::Progress progress;
   ray::ProgressThread progress_thread(progress);
-  const size_t num_chunks = (number_of_points + (chunk_size - 1)) / chunk_size;
-  chunk_size = std::min(number_of_points, chunk_size);
-  progress.begin("read and process", num_chunks);
-
-  std::vector<Eigen::Vector3d> starts;
-  std::vector<Eigen::Vector3d> ends;
-  std::vector<double> times;
-  std::vector<RGBA> colours;
-  std::vector<uint8_t> intensities;
-  starts.reserve(chunk_size);
-  ends.reserve(chunk_size);
-  times.reserve(chunk_size);
-  intensities.reserve(chunk_size);
-  colours.reserve(chunk_size);
-
-  num_bounded = 0;
-  for (unsigned int i = 0; i < number_of_points; i++)
+  if (chunk_size == ChunkSizer::kAdaptive)
   {
-    reader.ReadNextPoint();
-    liblas::Point point = reader.GetPoint();
-
-    Eigen::Vector3d position;
-    position[0] = point.GetX();
-    position[1] = point.GetY();
-    position[2] = point.GetZ();
-
-    ends.push_back(position);
-    starts.push_back(position);  // equal to position for laz files, as we do not store the start points
-
-    if (using_colour)
-    {
-      liblas::Color colour = point.GetColor();
-      RGBA col;
-      col.red = static_cast<uint8_t>(colour.GetRed());
-      col.green = static_cast<uint8_t>(colour.GetGreen());
-      col.blue = static_cast<uint8_t>(colour.GetBlue());
-      colours.push_back(col);
-    }
-    times.push_back(point.GetTime());
-
-    const double point_int = point.GetIntensity();
-    const double normalised_intensity = (255.0 * point_int) / max_intensity;
-    const uint8_t intensity = static_cast<uint8_t>(std::min(normalised_intensity, 255.0));
-    if (intensity > 0)
-      num_bounded++;
-    intensities.push_back(intensity);
-
-    if (ends.size() == chunk_size || i == number_of_points - 1)
-    {
-      if (colours.size() == 0)
-      {
-        colourByTime(times, colours);
-      }
-      for (int i = 0; i < (int)colours.size(); i++)  // add intensity into alhpa channel
-        colours[i].alpha = intensities[i];
-      apply(starts, ends, times, colours);
-      starts.clear();
-      ends.clear();
-      times.clear();
-      colours.clear();
-      intensities.clear();
-      progress.increment();
-    }
+    // each worker holds up to two chunks
+    chunk_size = MemoryBudget::chunkRays(ChunkSizer::kInitialChunkSize, MemoryBudget::kCloudBytesPerRay,
+                                         2 * static_cast<size_t>(LasChunkPipeline::defaultWorkerCount()));
+    Profile::set("read chunk size", chunk_size);
   }
+  chunk_size = std::max<size_t>(1, std::min(number_of_points, chunk_size));
+  LasChunkPipeline pipeline(number_of_points, chunk_size, using_colour, max_intensity);
+  progress.begin("read and process", (number_of_points + (chunk_size - 1)) / chunk_size);
+  const bool success =
+    pipeline.run(file_name, decoder, apply, progress, LasChunkPipeline::defaultWorkerCount(), num_bounded);
 
   progress.end();
   progress_thread.requestQuit();
   progress_thread.join();
 
+  if (!success)
+  {
+    std::cerr << "readLas: failed to decode the points of " << file_name << std::endl;
+    return false;
+  }
   std::cout << "loaded " << file_name << " with " << number_of_points << " points" << std::endl;
   return true;
 #else   // RAYLIB_WITH_LAS
@@ -133,7 +306,7 @@ bool readLas(const std::string &file_name,
   RAYLIB_UNUSED(apply);
   RAYLIB_UNUSED(num_bounded);
   RAYLIB_UNUSED(chunk_size);
-  RAYLIB_UNUSED(max_intensity);
+  RAYLIB_UNUSED(offset_to_remove);
   std::cerr << "readLas: cannot read file as WITHLAS not enabled. Enable using: cmake .. -DWITH_LAS=true" << std::endl;
   return false;
 #endif  // RAYLIB_WITH_LAS
@@ -216,6 +389,7 @@ bool RAYLIB_EXPORT writeLas(std::string file_name, const std::vector<Eigen::Vect
 #if RAYLIB_WITH_LAS
 LasWriter::LasWriter(const std::string &file_name)
   : file_name_(file_name)
+  , writer_(nullptr)
 {
   header_.SetDataFormatId(liblas::ePointFormat1);  // Time only
   if (file_name_.find(".laz") != std::string::npos)
@@ -245,6 +419,7 @@ LasWriter::LasWriter(const std::string &file_name)
 LasWriter::~LasWriter()
 {
 #if RAYLIB_WITH_LAS
+  finishPending();
   delete writer_;
 #else
   std::cerr << "writeLas: cannot write file as WITHLAS not enabled. Enable using: cmake .. -DWITH_LAS=true"
@@ -260,22 +435,32 @@ bool LasWriter::writeChunk(const std::vector<Eigen::Vector3d> &points, const std
   {
     return true;  // this is acceptable behaviour. It avoids calling function checking for emptiness each time
   }
-  if (out_.fail())
+  if (out_.fail() || !writer_)
   {
     std::cerr << "Error: cannot open " << file_name_ << " for writing." << std::endl;
     return false;
   }
-  liblas::Point point(&header_);
-  point.SetHeader(&header_);  // TODO HACK Version 1.7.0 does not correctly resize the data. Commit
-                              // 6e8657336ba445fcec3c9e70c2ebcd2e25af40b9 (1.8.0 3 July fixes it)
-  for (unsigned int i = 0; i < points.size(); i++)
-  {
-    point.SetCoordinates(points[i][0], points[i][1], points[i][2]);
-    point.SetIntensity(colours[i].alpha);
-    if (!times.empty())
-      point.SetTime(times[i]);
-    writer_->WritePoint(point);
-  }
+  // the writer is only used by one chunk at a time, so this waits for the previous chunk before taking a copy
+  if (!finishPending())
+    return false;
+  pending_points_ = points;
+  pending_times_ = times;
+  pending_intensities_.resize(colours.size());
+  for (size_t i = 0; i < colours.size(); i++) pending_intensities_[i] = colours[i].alpha;
+  pending_write_ = std::async(std::launch::async, [this]() {
+    liblas::Point point(&header_);
+    point.SetHeader(&header_);  // TODO HACK Version 1.7.0 does not correctly resize the data. Commit
+                                // 6e8657336ba445fcec3c9e70c2ebcd2e25af40b9 (1.8.0 3 July fixes it)
+    for (size_t i = 0; i < pending_points_.size(); i++)
+    {
+      point.SetCoordinates(pending_points_[i][0], pending_points_[i][1], pending_points_[i][2]);
+      point.SetIntensity(pending_intensities_[i]);
+      if (!pending_times_.empty())
+        point.SetTime(pending_times_[i]);
+      writer_->WritePoint(point);
+    }
+    return !out_.fail();
+  });
   return true;
 #else   // RAYLIB_WITH_LAS
   RAYLIB_UNUSED(points);
@@ -287,4 +472,18 @@ bool LasWriter::writeChunk(const std::vector<Eigen::Vector3d> &points, const std
 #endif  // RAYLIB_WITH_LAS
 }
 
+bool LasWriter::finishPending()
+{
+#if RAYLIB_WITH_LAS
+  if (!pending_write_.valid())
+    return true;
+  if (pending_write_.get())
+    return true;
+  std::cerr << "Error: failed writing points to " << file_name_ << std::endl;
+  return false;
+#else   // RAYLIB_WITH_LAS
+  return false;
+#endif  // RAYLIB_WITH_LAS
+}
+
 }  // namespace ray
@@ -7,12 +7,15 @@
 #define RAYLIB_RAYLAZ_H
 
 #include "raylib/raylibconfig.h"
+#include "raychunksizer.h"
 #include "rayutils.h"
 
 #if RAYLIB_WITH_LAS
 #include <liblas/reader.hpp>
 #endif  // RAYLIB_WITH_LAS
 
+#include <future>
+
 
 namespace ray
 {
@@ -21,20 +24,24 @@ bool RAYLIB_EXPORT readLas(std::string file_name, std::vector<Eigen::Vector3d> &
                            std::vector<RGBA> &colours, double max_intensity,
                            Eigen::Vector3d *offset_to_remove = nullptr);
 
-/// Chunk-based version of readLas. This calls @c apply for every @c chunk_size points loaded
+/// Chunk-based version of readLas. This calls @c apply for every @c chunk_size points loaded, in file order. The chunks
+/// are decompressed ahead of @c apply on several threads, each seeking to its own chunks of the file. As the chunks
+/// are shared out between the threads in advance, @c ChunkSizer::kAdaptive uses a fixed
+/// @c ChunkSizer::kInitialChunkSize , within the @c MemoryBudget .
 bool RAYLIB_EXPORT readLas(const std::string &file_name,
                            std::function<void(std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
                                               std::vector<double> &times, std::vector<RGBA> &colours)>
                              apply,
                            size_t &num_bounded, double max_intensity, Eigen::Vector3d *offset_to_remove,
-                           size_t chunk_size = 1000000);
+                           size_t chunk_size = ChunkSizer::kAdaptive);
 
 
 /// Write to a laz or las file. The intensity is the only part that is extracted from the @c colours argument.
 bool RAYLIB_EXPORT writeLas(std::string file_name, const std::vector<Eigen::Vector3d> &points,
                             const std::vector<double> &times, const std::vector<RGBA> &colours);
 
-/// Class for chunked writing of las/laz files.
+/// Class for chunked writing of las/laz files. Each chunk is encoded and compressed on a background thread, while the
+/// caller prepares the next one.
 class RAYLIB_EXPORT LasWriter
 {
 public:
@@ -42,16 +49,24 @@ public:
   LasWriter(const std::string &file_name);
   /// the destructor
   ~LasWriter();
-  /// write a chunk of points to the file, described by the vector arguments
+  /// write a chunk of points to the file, described by the vector arguments. The arguments are copied, so may be
+  /// reused as soon as this returns. Returns false if this or the previous chunk failed to write.
   bool writeChunk(const std::vector<Eigen::Vector3d> &points, const std::vector<double> &times,
                   const std::vector<RGBA> &colours);
 
 private:
-  const std::string &file_name_;
+  /// wait for the chunk being written, returning whether it succeeded
+  bool finishPending();
+
+  const std::string file_name_;
   std::ofstream out_;
 #if RAYLIB_WITH_LAS
   liblas::Header header_;
   liblas::Writer *writer_;
+  std::vector<Eigen::Vector3d> pending_points_;
+  std::vector<double> pending_times_;
+  std::vector<uint8_t> pending_intensities_;
+  std::future<bool> pending_write_;
 #endif  // RAYLIB_WITH_LAS
 };
 }  // namespace ray
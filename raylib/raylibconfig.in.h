@@ -58,11 +58,17 @@
 #define GLM_FORCE_SIZE_T_LENGTH
 
 #define RAYLIB_WITH_3ES @WITH_3ES@
+#define RAYLIB_WITH_CUDA @WITH_CUDA@
+#define RAYLIB_WITH_CURL @WITH_CURL@
+#define RAYLIB_WITH_FFTW @WITH_FFTW@
+#define RAYLIB_WITH_IO_URING @WITH_IO_URING@
 #define RAYLIB_WITH_LAS @WITH_LAS@
 #define RAYLIB_WITH_QHULL @WITH_QHULL@
 #define RAYLIB_WITH_ROS @WITH_ROS@
 #define RAYLIB_WITH_TBB @WITH_TBB@
 #define RAYLIB_WITH_TIFF @WITH_TIFF@
 #define RAYLIB_DOUBLE_RAYS @DOUBLE_RAYS@
+#define RAYLIB_NATIVE_DELAUNAY @NATIVE_DELAUNAY@
+#define RAYLIB_ALLOC_PROFILE @RAYCLOUD_ALLOC_PROFILE@
 
 #endif  // RAYLIB_CONFIG_H
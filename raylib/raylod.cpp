@@ -0,0 +1,235 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raylod.h"
+
+#include "raycloud.h"
+#include "raycloudwriter.h"
+#include "rayplyindex.h"
+#include "rayvoxelset.h"
+
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+namespace ray
+{
+namespace
+{
+const char kLodMagic[4] = { 'R', 'L', 'O', 'D' };
+const uint32_t kLodVersion = 1;
+
+template <class T>
+void writeValue(std::ofstream &out, const T &value)
+{
+  out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <class T>
+void readValue(std::ifstream &in, T &value)
+{
+  in.read(reinterpret_cast<char *>(&value), sizeof(T));
+}
+
+bool writeLod(const std::string &cloud_file, const std::vector<LodLevel> &levels)
+{
+  uint64_t size, hash;
+  int64_t modified;
+  if (!fileStamp(cloud_file, size, modified, hash))
+  {
+    std::cerr << "Error: cannot stamp level of detail of missing file " << cloud_file << std::endl;
+    return false;
+  }
+  std::ofstream out(lodFileName(cloud_file), std::ios::binary | std::ios::out);
+  if (out.fail())
+  {
+    std::cerr << "Error: cannot open " << lodFileName(cloud_file) << " for writing." << std::endl;
+    return false;
+  }
+  out.write(kLodMagic, 4);
+  writeValue(out, kLodVersion);
+  writeValue(out, size);
+  writeValue(out, modified);
+  writeValue(out, hash);
+  writeValue(out, static_cast<uint64_t>(levels.size()));
+  for (const auto &level : levels)
+  {
+    writeValue(out, level.voxel_width);
+    writeValue(out, level.num_rays);
+  }
+  return out.good();
+}
+}  // namespace
+
+std::string lodFileName(const std::string &cloud_file)
+{
+  return cloud_file + ".lod";
+}
+
+std::string lodLevelFileName(const std::string &cloud_file, size_t level)
+{
+  return cloud_file + ".lod" + std::to_string(level) + ".ply";
+}
+
+bool buildLod(const std::string &cloud_file, double voxel_width, size_t max_levels)
+{
+  if (voxel_width <= 0.0 || max_levels == 0)
+  {
+    std::cerr << "Error: the level of detail needs a positive voxel width and number of levels" << std::endl;
+    return false;
+  }
+  Cloud::Info info;
+  if (!Cloud::getInfo(cloud_file, info))
+  {
+    return false;
+  }
+  // the levels double in width up to the root of the octree, whose voxel spans the cloud
+  const double extent = (info.ends_bound.max_bound_ - info.ends_bound.min_bound_).maxCoeff();
+  std::vector<LodLevel> levels;
+  for (double width = voxel_width; levels.size() < max_levels; width *= 2.0)
+  {
+    levels.push_back({ width, 0 });
+    if (width >= extent)
+    {
+      break;
+    }
+  }
+
+  std::vector<std::unique_ptr<CloudWriter>> writers(levels.size());
+  for (size_t i = 0; i < levels.size(); i++)
+  {
+    writers[i].reset(new CloudWriter);
+    if (!writers[i]->begin(lodLevelFileName(cloud_file, i)))
+    {
+      return false;
+    }
+  }
+  // the voxel sets grow with the decimated levels, the finest of which is expected to fit within RAM limits
+  std::vector<VoxelSet> voxel_sets(levels.size());
+  std::vector<Cloud> kept(levels.size());
+  std::vector<int64_t> subsample;
+  Cloud chunk;
+  bool success = true;
+  auto decimate = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                      std::vector<double> &times, std::vector<RGBA> &colours) {
+    chunk.starts.swap(starts);
+    chunk.ends.swap(ends);
+    chunk.times.swap(times);
+    chunk.colours.swap(colours);
+    // each level is decimated from the rays that the finer level kept from this chunk
+    const Cloud *source = &chunk;
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+      subsample.clear();
+      voxelSubsample(source->ends, levels[i].voxel_width, subsample, voxel_sets[i]);
+      kept[i].resize(subsample.size());
+      for (size_t j = 0; j < subsample.size(); j++)
+      {
+        const int64_t id = subsample[j];
+        kept[i].starts[j] = source->starts[id];
+        kept[i].ends[j] = source->ends[id];
+        kept[i].times[j] = source->times[id];
+        kept[i].colours[j] = source->colours[id];
+      }
+      levels[i].num_rays += subsample.size();
+      success = writers[i]->writeChunk(kept[i]) && success;
+      source = &kept[i];
+    }
+    chunk.starts.swap(starts);
+    chunk.ends.swap(ends);
+    chunk.times.swap(times);
+    chunk.colours.swap(colours);
+  };
+  if (!Cloud::read(cloud_file, decimate))
+  {
+    success = false;
+  }
+  for (auto &writer : writers) writer->end();
+  if (!success)
+  {
+    std::cerr << "Error: failed to build the level of detail of " << cloud_file << std::endl;
+    return false;
+  }
+  for (size_t i = 0; i < levels.size(); i++)
+  {
+    std::cout << "level " << i << ": " << levels[i].num_rays << " rays in voxels of width " << levels[i].voxel_width
+              << " m" << std::endl;
+  }
+  return writeLod(cloud_file, levels);
+}
+
+bool readLod(const std::string &cloud_file, std::vector<LodLevel> &levels)
+{
+  std::ifstream in(lodFileName(cloud_file), std::ios::in | std::ios::binary);
+  if (in.fail())
+  {
+    return false;  // not an error, the pyramid is optional
+  }
+  uint64_t size, stored_size, hash, stored_hash;
+  int64_t modified, stored_modified;
+  if (!fileStamp(cloud_file, size, modified, hash))
+  {
+    return false;
+  }
+  char magic[4];
+  uint32_t version;
+  uint64_t num_levels;
+  in.read(magic, 4);
+  readValue(in, version);
+  readValue(in, stored_size);
+  readValue(in, stored_modified);
+  readValue(in, stored_hash);
+  readValue(in, num_levels);
+  if (!in || std::memcmp(magic, kLodMagic, 4) != 0 || version != kLodVersion)
+  {
+    std::cout << "warning: ignoring unrecognised level of detail file " << lodFileName(cloud_file) << std::endl;
+    return false;
+  }
+  if (stored_size != size || stored_modified != modified || stored_hash != hash)
+  {
+    std::cout << "level of detail " << lodFileName(cloud_file) << " is out of date, " << cloud_file
+              << " has changed since it was written" << std::endl;
+    return false;
+  }
+  levels.resize(num_levels);
+  for (auto &level : levels)
+  {
+    readValue(in, level.voxel_width);
+    readValue(in, level.num_rays);
+  }
+  if (!in)
+  {
+    std::cout << "warning: ignoring truncated level of detail file " << lodFileName(cloud_file) << std::endl;
+    levels.clear();
+    return false;
+  }
+  return true;
+}
+
+int coarsestLodLevel(const std::vector<LodLevel> &levels, double voxel_width, bool nested)
+{
+  const double eps = 1e-6;  // relative tolerance on the widths, which are doubled from the finest
+  int coarsest = -1;
+  for (size_t i = 0; i < levels.size(); i++)
+  {
+    const double ratio = voxel_width / levels[i].voxel_width;
+    if (ratio < 1.0 - eps)
+    {
+      continue;
+    }
+    if (nested && std::abs(ratio - std::round(ratio)) > eps * ratio)
+    {
+      continue;
+    }
+    if (coarsest == -1 || levels[i].voxel_width > levels[coarsest].voxel_width)
+    {
+      coarsest = static_cast<int>(i);
+    }
+  }
+  return coarsest;
+}
+}  // namespace ray
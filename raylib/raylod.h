@@ -0,0 +1,51 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYLOD_H
+#define RAYLIB_RAYLOD_H
+
+#include "raylib/raylibconfig.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ray
+{
+/// A level of detail (LOD) pyramid is stored beside a ray cloud file (cloud.ply) as a set of levels
+/// (cloud.ply.lod0.ply, cloud.ply.lod1.ply, ...), each a spatial decimation of the cloud to the first ray in file order
+/// whose end is in each voxel. The voxel width doubles from each level to the next, as the levels of an octree, up to
+/// a voxel that spans the cloud. A small manifest (cloud.ply.lod) lists the levels, stamped in the same way as the ply
+/// index, so that the pyramid is ignored once the cloud changes. Renders and decimations at coarse resolutions can then
+/// read a level rather than the whole cloud.
+
+/// one level of a level of detail pyramid
+struct RAYLIB_EXPORT LodLevel
+{
+  double voxel_width;
+  uint64_t num_rays;
+};
+
+/// the file name of the manifest of the pyramid of @c cloud_file
+std::string RAYLIB_EXPORT lodFileName(const std::string &cloud_file);
+
+/// the file name of level @c level of the pyramid of @c cloud_file
+std::string RAYLIB_EXPORT lodLevelFileName(const std::string &cloud_file, size_t level);
+
+/// build the pyramid of @c cloud_file in a single read of it, with a finest voxel width of @c voxel_width and at most
+/// @c max_levels levels. Each level is decimated from the rays kept by the level below, which gives the same rays as
+/// decimating the whole cloud, as each voxel is made of whole voxels of the finer level.
+bool RAYLIB_EXPORT buildLod(const std::string &cloud_file, double voxel_width, size_t max_levels = 24);
+
+/// read the levels of the pyramid of @c cloud_file . Returns false if there is no pyramid, or if it is out of date.
+bool RAYLIB_EXPORT readLod(const std::string &cloud_file, std::vector<LodLevel> &levels);
+
+/// the coarsest of @c levels whose voxel width is at most @c voxel_width , or -1 if there is none. If @c nested , only
+/// levels whose voxels fit a whole number of times into @c voxel_width are chosen, so that decimating the level at
+/// @c voxel_width keeps the same rays as decimating the cloud.
+int RAYLIB_EXPORT coarsestLodLevel(const std::vector<LodLevel> &levels, double voxel_width, bool nested = false);
+}  // namespace ray
+
+#endif  // RAYLIB_RAYLOD_H
@@ -0,0 +1,142 @@
+// Copyright (c) 2020
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raymappedfile.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ray
+{
+MappedFile::~MappedFile()
+{
+  close();
+}
+
+#if defined(_WIN32)
+bool MappedFile::open(const std::string &file_name, bool writable)
+{
+  close();
+  const DWORD access = writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ;
+  HANDLE file = CreateFileA(file_name.c_str(), access, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    return false;
+  }
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+  {
+    CloseHandle(file);
+    return false;
+  }
+  HANDLE mapping = CreateFileMappingA(file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, NULL);
+  if (mapping == NULL)
+  {
+    CloseHandle(file);
+    return false;
+  }
+  void *view = MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+  if (view == NULL)
+  {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+  file_handle_ = file;
+  mapping_handle_ = mapping;
+  data_ = static_cast<unsigned char *>(view);
+  size_ = static_cast<size_t>(file_size.QuadPart);
+  writable_ = writable;
+  return true;
+}
+
+bool MappedFile::flush()
+{
+  if (!writable_)
+  {
+    return true;
+  }
+  return FlushViewOfFile(data_, 0) && FlushFileBuffers(file_handle_);
+}
+
+void MappedFile::close()
+{
+  if (data_)
+  {
+    UnmapViewOfFile(data_);
+  }
+  if (mapping_handle_)
+  {
+    CloseHandle(mapping_handle_);
+  }
+  if (file_handle_)
+  {
+    CloseHandle(file_handle_);
+  }
+  data_ = nullptr;
+  mapping_handle_ = file_handle_ = nullptr;
+  size_ = 0;
+  writable_ = false;
+}
+#else
+bool MappedFile::open(const std::string &file_name, bool writable)
+{
+  close();
+  int fd = ::open(file_name.c_str(), writable ? O_RDWR : O_RDONLY);
+  if (fd < 0)
+  {
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0)
+  {
+    ::close(fd);
+    return false;
+  }
+  // a shared mapping is needed for modifications to reach the file
+  void *view = mmap(nullptr, static_cast<size_t>(file_stat.st_size), writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                    writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+  ::close(fd);  // the mapping remains valid after the descriptor is closed
+  if (view == MAP_FAILED)
+  {
+    return false;
+  }
+  // the ray cloud readers pass through the data once, front to back
+  madvise(view, static_cast<size_t>(file_stat.st_size), MADV_SEQUENTIAL);
+  data_ = static_cast<unsigned char *>(view);
+  size_ = static_cast<size_t>(file_stat.st_size);
+  writable_ = writable;
+  return true;
+}
+
+bool MappedFile::flush()
+{
+  if (!writable_)
+  {
+    return true;
+  }
+  return msync(data_, size_, MS_SYNC) == 0;
+}
+
+void MappedFile::close()
+{
+  if (data_)
+  {
+    munmap(data_, size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  writable_ = false;
+}
+#endif  // defined(_WIN32)
+
+}  // namespace ray
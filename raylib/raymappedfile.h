@@ -0,0 +1,57 @@
+// Copyright (c) 2020
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYMAPPEDFILE_H
+#define RAYLIB_RAYMAPPEDFILE_H
+
+#include "raylib/raylibconfig.h"
+
+#include <cstddef>
+#include <string>
+
+namespace ray
+{
+/// A memory mapping of a whole file. This gives direct access to the file's bytes without copying them through a
+/// stream buffer, which is significant when decoding large binary ray clouds. The mapping is read-only unless opened
+/// as writable, in which case changes to the bytes are written back to the file.
+/// Mapping can fail (e.g. on file systems that don't support it), so callers should keep a stream based fallback.
+class RAYLIB_EXPORT MappedFile
+{
+public:
+  MappedFile() = default;
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  /// map the full contents of @c file_name. Returns false if the file cannot be opened or mapped.
+  bool open(const std::string &file_name, bool writable = false);
+  /// unmap the file. Called automatically on destruction.
+  void close();
+
+  /// whether a file is currently mapped
+  inline bool isOpen() const { return data_ != nullptr; }
+  /// the mapped bytes, or nullptr if not open
+  inline const unsigned char *data() const { return data_; }
+  /// the mapped bytes for modification, or nullptr if not open as writable
+  inline unsigned char *writableData() { return writable_ ? data_ : nullptr; }
+  /// the number of mapped bytes
+  inline size_t size() const { return size_; }
+
+  /// write any modified bytes back to the file now, rather than on close. Returns false on failure.
+  bool flush();
+
+private:
+  unsigned char *data_ = nullptr;
+  size_t size_ = 0;
+  bool writable_ = false;
+#if defined(_WIN32)
+  void *file_handle_ = nullptr;
+  void *mapping_handle_ = nullptr;
+#endif
+};
+
+}  // namespace ray
+
+#endif  // RAYLIB_RAYMAPPEDFILE_H
@@ -0,0 +1,186 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raymemory.h"
+#include "raycloud.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+namespace ray
+{
+namespace
+{
+size_t memory_budget = 0;
+
+/// parse a positive size such as 512M or 16G, returning 0 if it is not one
+size_t parseSize(const char *text)
+{
+  char *end = nullptr;
+  const double value = std::strtod(text, &end);
+  if (end == text || !(value > 0.0))
+  {
+    return 0;
+  }
+  double scale = 1.0;
+  switch (*end)
+  {
+  case 'T':
+  case 't':
+    scale *= 1024.0;
+    // fall through
+  case 'G':
+  case 'g':
+    scale *= 1024.0;
+    // fall through
+  case 'M':
+  case 'm':
+    scale *= 1024.0;
+    // fall through
+  case 'K':
+  case 'k':
+    scale *= 1024.0;
+    end++;
+    break;
+  default:
+    break;
+  }
+  if (*end == 'B' || *end == 'b')
+  {
+    end++;
+  }
+  const double bytes = value * scale;
+  return *end == '\0' && bytes >= 1.0 && bytes < 1.8e19 ? static_cast<size_t>(bytes) : 0;
+}
+}  // namespace
+
+void MemoryBudget::init(size_t bytes)
+{
+  memory_budget = bytes;
+}
+
+void MemoryBudget::initFromArguments(int &argc, char *argv[])
+{
+  for (int i = 1; i < argc - 1; i++)
+  {
+    if (std::strcmp(argv[i], "--max_memory") != 0)
+    {
+      continue;
+    }
+    const size_t bytes = parseSize(argv[i + 1]);
+    if (bytes > 0)
+    {
+      init(bytes);
+      for (int j = i + 2; j <= argc; j++)
+      {
+        argv[j - 2] = argv[j];  // includes the terminating null pointer
+      }
+      argc -= 2;
+    }
+    break;
+  }
+}
+
+size_t MemoryBudget::budget()
+{
+  return memory_budget;
+}
+
+size_t MemoryBudget::physicalMemory()
+{
+#if defined(__unix__) || defined(__APPLE__)
+  const long pages = sysconf(_SC_PHYS_PAGES);
+  const long page_size = sysconf(_SC_PAGE_SIZE);
+  if (pages > 0 && page_size > 0)
+  {
+    return static_cast<size_t>(pages) * static_cast<size_t>(page_size);
+  }
+#endif
+  return 0;
+}
+
+size_t MemoryBudget::limit()
+{
+  return memory_budget > 0 ? memory_budget : physicalMemory();
+}
+
+bool MemoryBudget::estimate(const std::string &file_name, size_t bytes_per_ray, size_t &bytes)
+{
+  Cloud::Info info;
+  if (!Cloud::getInfo(file_name, info))
+  {
+    return false;
+  }
+  const size_t num_rays = static_cast<size_t>(info.num_bounded) + static_cast<size_t>(info.num_unbounded);
+  bytes = num_rays * (kCloudBytesPerRay + bytes_per_ray);
+  return true;
+}
+
+bool MemoryBudget::fits(size_t bytes)
+{
+  const size_t memory = limit();
+  return memory == 0 || bytes <= memory;
+}
+
+bool MemoryBudget::fitsCloud(const std::string &file_name, size_t bytes_per_ray)
+{
+  if (limit() == 0)
+  {
+    return true;
+  }
+  size_t bytes;
+  return !estimate(file_name, bytes_per_ray, bytes) || fits(bytes);
+}
+
+bool MemoryBudget::checkCloud(const std::string &file_name, size_t bytes_per_ray, const std::string &tool)
+{
+  size_t bytes;
+  if (limit() == 0 || !estimate(file_name, bytes_per_ray, bytes) || fits(bytes))
+  {
+    return true;
+  }
+  if (budget() > 0)
+  {
+    std::cerr << "Error: " << tool << " needs an estimated " << formatBytes(bytes) << " to process " << file_name
+              << ", more than the memory budget of " << formatBytes(budget()) << std::endl;
+    return false;
+  }
+  std::cout << "warning: " << tool << " needs an estimated " << formatBytes(bytes) << " to process " << file_name
+            << ", more than the physical memory of " << formatBytes(physicalMemory()) << std::endl;
+  return true;
+}
+
+size_t MemoryBudget::chunkRays(size_t default_rays, size_t bytes_per_ray, size_t num_chunks, size_t min_rays)
+{
+  if (memory_budget == 0 || bytes_per_ray == 0 || num_chunks == 0)
+  {
+    return default_rays;
+  }
+  const size_t budget_rays = memory_budget / 4 / (bytes_per_ray * num_chunks);
+  return std::min(default_rays, std::max(budget_rays, min_rays));
+}
+
+std::string MemoryBudget::formatBytes(size_t bytes)
+{
+  const char *units[] = { "B", "KiB", "MiB", "GiB", "TiB" };
+  double value = static_cast<double>(bytes);
+  int unit = 0;
+  while (value >= 1024.0 && unit < 4)
+  {
+    value /= 1024.0;
+    unit++;
+  }
+  char text[32];
+  std::snprintf(text, sizeof(text), unit == 0 ? "%.0f %s" : "%.1f %s", value, units[unit]);
+  return text;
+}
+}  // namespace ray
@@ -0,0 +1,66 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYMEMORY_H
+#define RAYLIB_RAYMEMORY_H
+
+#include "raylib/raylibconfig.h"
+
+#include <cstddef>
+#include <string>
+
+namespace ray
+{
+/// The memory that a tool may use. The tools call @c initFromArguments() , so each accepts a common
+/// @c --max_memory 16G option. Before loading a whole cloud, a tool estimates the memory it needs from the cloud's
+/// @c Cloud::Info and its own cost per ray. Tools with a tiled path take it when the estimate is over the budget, and
+/// the others stop with the estimate rather than being killed part way through. The tiles of @c processInTiles and the
+/// chunks of @c Cloud::read are also sized to the budget. Without the option the budget is the physical memory, and
+/// an estimate over it is only a warning, as it may still fit in swap.
+class RAYLIB_EXPORT MemoryBudget
+{
+public:
+  /// the bytes per ray of a loaded cloud: its start, end, time and colour
+  static const size_t kCloudBytesPerRay = 60;
+
+  /// Set the budget to @c bytes , or remove it if @c bytes is 0
+  static void init(size_t bytes);
+
+  /// Remove a @c --max_memory N option from the command line arguments, and initialise the budget to N bytes. N may
+  /// have a K, M, G or T suffix (powers of 1024). An N that is not a positive size is left in the arguments, for the
+  /// tool's own argument parsing to reject.
+  static void initFromArguments(int &argc, char *argv[]);
+
+  /// the budget set by @c init() , or 0 if there is none
+  static size_t budget();
+  /// the total physical memory, or 0 if it is not known
+  static size_t physicalMemory();
+  /// the memory that may be used: the @c budget() if set, otherwise the @c physicalMemory() . 0 if neither is known
+  static size_t limit();
+
+  /// Estimate the memory needed to hold the ray cloud @c file_name with @c bytes_per_ray for each ray, including the
+  /// cloud itself. Returns false if the cloud's info cannot be read.
+  static bool estimate(const std::string &file_name, size_t bytes_per_ray, size_t &bytes);
+
+  /// whether @c bytes fits in the @c limit()
+  static bool fits(size_t bytes);
+  /// whether the ray cloud @c file_name can be processed with @c bytes_per_ray in memory. True when it cannot be
+  /// estimated, so that the tool's own loading reports the error.
+  static bool fitsCloud(const std::string &file_name, size_t bytes_per_ray);
+
+  /// Check that the ray cloud @c file_name can be processed in memory by @c tool with @c bytes_per_ray , before it is
+  /// loaded. Over a @c budget() this prints the estimate and returns false; over the @c physicalMemory() it warns.
+  static bool checkCloud(const std::string &file_name, size_t bytes_per_ray, const std::string &tool);
+
+  /// the number of rays to process at a time, which is @c default_rays unless @c num_chunks chunks of
+  /// @c bytes_per_ray rays would take more than a quarter of the @c budget() . At least @c min_rays .
+  static size_t chunkRays(size_t default_rays, size_t bytes_per_ray, size_t num_chunks = 1, size_t min_rays = 4096);
+
+  /// @c bytes as a readable size, such as 3.2 GiB
+  static std::string formatBytes(size_t bytes);
+};
+}  // namespace ray
+
+#endif  // RAYLIB_RAYMEMORY_H
@@ -5,19 +5,38 @@
 // Author: Kazys Stepanas, Tom Lowe
 #include "raymerger.h"
 
+#include "rayallocprofile.h"
+#include "raychange.h"
+#include "raycheckpoint.h"
+#include "raycloudwriter.h"
+#include "raycompactcloud.h"
 #include "raygrid.h"
+#include "rayplyindex.h"
+#include "rayprofile.h"
 #include "rayprogress.h"
+#include "raythreads.h"
+#include "raytraversal.h"
 #include "rayunused.h"
 
 #if RAYLIB_WITH_TBB
+#include <tbb/blocked_range.h>
 #include <tbb/enumerable_thread_specific.h>
 #include <tbb/parallel_for.h>
 #endif  // RAYLIB_WITH_TBB
 
 #include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <queue>
 #include <set>
+#include <sstream>
+#include <thread>
 
 #if RAYLIB_WITH_TBB
 // With threads we use std::atomic_bool for the transient marks. These are default initialised to false. No additional
@@ -31,6 +50,300 @@
 
 namespace ray
 {
+namespace
+{
+/// The output colour of a filtered ray. With @c colour_cloud this shows the properties of the ray's @c ellipsoid
+inline RGBA filteredColour(RGBA colour, const Ellipsoid &ellipsoid, bool colour_cloud)
+{
+  if (colour_cloud)
+  {
+    colour.red = (uint8_t)((1.0 - ellipsoid.planarity) * 255.0);
+    colour.blue = (uint8_t)(ellipsoid.opacity * 255.0);
+    colour.green = (uint8_t)((double)ellipsoid.num_gone / ((double)ellipsoid.num_gone + 10.0) * 255.0);
+  }
+  return colour;
+}
+
+/// The key of a checkpointed merge, from the merger's parameters and the @c inputs of the call
+std::string checkpointKey(const MergerConfig &config, const std::string &inputs)
+{
+  std::ostringstream key;
+  key << std::setprecision(17) << config.voxel_size << " " << config.num_rays_filter_threshold << " "
+      << static_cast<int>(config.merge_type) << " " << static_cast<int>(config.grid) << " " << config.colour_cloud
+      << " " << config.change_voxel_width << " " << inputs;
+  return key.str();
+}
+
+bool fileExists(const std::string &file_name)
+{
+  return std::ifstream(file_name, std::ios::binary).good();
+}
+
+/// A ray in a tile file of @c Merger::filterTiled , with its index in the input file
+struct TileRay
+{
+  Eigen::Vector3d start;
+  Eigen::Vector3d end;
+  double time;
+  RGBA colour;
+  uint64_t id;
+};
+
+/// The filter result of a ray, in the result file of the tile that owns it
+struct TileResult
+{
+  RGBA colour;
+  uint8_t transient;
+};
+
+/// A ray held by @c Merger::filterWindowed until no later window can reach it
+struct WindowRay
+{
+  Eigen::Vector3d start;
+  Eigen::Vector3d end;
+  double time;
+  RGBA colour;
+  bool removed;        // removed by the ellipsoid of some other ray
+  TileResult result;  // from the ray's own ellipsoid, in the window that contains it
+};
+
+/// The ray grid voxel size for filtering the whole of @c file_name , so that all its tiles or windows share it
+double fileVoxelSize(const std::string &file_name, const Cloud::Info &info)
+{
+  return info.num_bounded > 0 ? 4.0 * Cloud::estimatePointSpacing(file_name, info.ends_bound, info.num_bounded) : 0.25;
+}
+
+/// Square tiles over the x,y extent of a cloud. The z extent is not split
+struct TileLayout
+{
+  Eigen::Vector3d min_bound;
+  Eigen::Vector3d max_bound;
+  double width;
+  Eigen::Vector2i dims;
+
+  /// the tile index on axis @c k of coordinate @c x , clamped to the layout
+  inline int tileCoord(double x, int k) const
+  {
+    return std::max(0, std::min(dims[k] - 1, static_cast<int>(std::floor((x - min_bound[k]) / width))));
+  }
+  /// the tile that owns the ray ending at @c end
+  inline int owner(const Eigen::Vector3d &end) const { return tileCoord(end[0], 0) + dims[0] * tileCoord(end[1], 1); }
+  /// the bounds of @c tile , padded by @c overlap in x and y
+  inline Cuboid padded(int tile, double overlap) const
+  {
+    const Eigen::Vector3d tile_min(min_bound[0] + width * (tile % dims[0]) - overlap,
+                                   min_bound[1] + width * (tile / dims[0]) - overlap, min_bound[2] - 1.0);
+    const Eigen::Vector3d tile_max(tile_min[0] + width + 2.0 * overlap, tile_min[1] + width + 2.0 * overlap,
+                                   max_bound[2] + 1.0);
+    return Cuboid(tile_min, tile_max);
+  }
+};
+
+/// The header of a @c Merger::mergeIncremental state file, which is followed by the @c Ellipsoid of each map ray in
+/// the order of the map file
+struct MergeStateHeader
+{
+  char magic[8];
+  uint64_t ray_count;
+};
+const char kMergeStateMagic[8] = "RAYMRG1";
+
+/// Writes a merge state file one ellipsoid at a time. The ray count in the header is filled in by @c end()
+class MergeStateWriter
+{
+public:
+  bool begin(const std::string &file_name)
+  {
+    out_.open(file_name, std::ios::binary | std::ios::out);
+    count_ = 0;
+    writeHeader();
+    return !out_.fail();
+  }
+  void add(const Ellipsoid &ellipsoid)
+  {
+    writePlainOldData(out_, ellipsoid);
+    count_++;
+  }
+  bool end()
+  {
+    out_.seekp(0);
+    writeHeader();
+    const bool success = !out_.fail();
+    out_.close();
+    return success;
+  }
+
+private:
+  void writeHeader()
+  {
+    MergeStateHeader header;
+    std::copy(kMergeStateMagic, kMergeStateMagic + sizeof(header.magic), header.magic);
+    header.ray_count = count_;
+    writePlainOldData(out_, header);
+  }
+  std::ofstream out_;
+  uint64_t count_ = 0;
+};
+
+/// Open a merge state file for reading, returning its ray count in @c ray_count
+bool openMergeState(const std::string &file_name, std::ifstream &in, uint64_t &ray_count)
+{
+  in.open(file_name, std::ios::binary | std::ios::in);
+  if (!in.is_open())
+  {
+    return false;
+  }
+  MergeStateHeader header;
+  readPlainOldData(in, header);
+  if (in.fail() || !std::equal(kMergeStateMagic, kMergeStateMagic + sizeof(header.magic), header.magic))
+  {
+    std::cerr << "Error: " << file_name << " is not a merge state file" << std::endl;
+    return false;
+  }
+  ray_count = header.ray_count;
+  return true;
+}
+
+/// The rays of a ray cloud file, read a chunk at a time on a background thread by @c Cloud::read , so that several
+/// files can be consumed in step. The reader waits while @c kMaxQueued chunks are unconsumed.
+class ChunkStream
+{
+public:
+  static const size_t kMaxQueued = 2;
+
+  explicit ChunkStream(const std::string &file_name)
+  {
+    thread_ = std::thread([this, file_name]() { run(file_name); });
+  }
+  ~ChunkStream()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      abandoned_ = true;
+    }
+    condition_.notify_all();
+    thread_.join();
+  }
+
+  /// move the next chunk into @c chunk , returning false once the file has been read
+  bool next(Cloud &chunk)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [this]() { return !chunks_.empty() || finished_; });
+    if (chunks_.empty())
+      return false;
+    chunk = std::move(chunks_.front());
+    chunks_.pop_front();
+    condition_.notify_all();
+    return true;
+  }
+  /// whether the whole file was read. Valid once @c next() has returned false
+  bool succeeded() const { return succeeded_; }
+
+private:
+  void run(const std::string &file_name)
+  {
+    auto add_chunk = [this](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                            std::vector<double> &times, std::vector<RGBA> &colours) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      condition_.wait(lock, [this]() { return chunks_.size() < kMaxQueued || abandoned_; });
+      if (abandoned_)
+        return;
+      Cloud chunk;
+      chunk.starts.swap(starts);  // the reader's vectors are end-of-life, so can be taken
+      chunk.ends.swap(ends);
+      chunk.times.swap(times);
+      chunk.colours.swap(colours);
+      chunks_.push_back(std::move(chunk));
+      condition_.notify_all();
+    };
+    const bool succeeded = Cloud::read(file_name, add_chunk);
+    std::lock_guard<std::mutex> lock(mutex_);
+    succeeded_ = succeeded;
+    finished_ = true;
+    condition_.notify_all();
+  }
+
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::deque<Cloud> chunks_;
+  bool finished_ = false;
+  bool succeeded_ = false;
+  bool abandoned_ = false;
+  std::thread thread_;
+};
+
+/// append rays @c first to @c last of @c cloud to @c chunk
+void appendRays(const Cloud &cloud, size_t first, size_t last, Cloud &chunk)
+{
+  chunk.starts.insert(chunk.starts.end(), cloud.starts.begin() + first, cloud.starts.begin() + last);
+  chunk.ends.insert(chunk.ends.end(), cloud.ends.begin() + first, cloud.ends.begin() + last);
+  chunk.times.insert(chunk.times.end(), cloud.times.begin() + first, cloud.times.begin() + last);
+  chunk.colours.insert(chunk.colours.end(), cloud.colours.begin() + first, cloud.colours.begin() + last);
+}
+
+/// The voxels @c bmin to @c bmax of @c grid that the bounds of @c ellipsoid overlap. Returns false if it is outside of
+/// the grid
+bool ellipsoidVoxels(const Ellipsoid &ellipsoid, const PackedGrid<unsigned> &grid, Eigen::Vector3i *bmin,
+                     Eigen::Vector3i *bmax)
+{
+  const Eigen::Vector3d ellipsoid_bounds_min = (ellipsoid.pos - ellipsoid.extents - grid.box_min) / grid.voxel_width;
+  const Eigen::Vector3d ellipsoid_bounds_max = (ellipsoid.pos + ellipsoid.extents - grid.box_min) / grid.voxel_width;
+
+  if (ellipsoid_bounds_max[0] < 0.0 || ellipsoid_bounds_max[1] < 0.0 || ellipsoid_bounds_max[2] < 0.0)
+  {
+    return false;
+  }
+
+  if (ellipsoid_bounds_min[0] >= (double)grid.dims[0] || ellipsoid_bounds_min[1] >= (double)grid.dims[1] ||
+      ellipsoid_bounds_min[2] >= (double)grid.dims[2])
+  {
+    // Out of bounds against the grid.
+    return false;
+  }
+
+  *bmin = maxVector(Eigen::Vector3i(0, 0, 0), Eigen::Vector3i(ellipsoid_bounds_min.cast<int>()));
+  *bmax = minVector(Eigen::Vector3i(ellipsoid_bounds_max.cast<int>()),
+                    Eigen::Vector3i(grid.dims[0] - 1, grid.dims[1] - 1, grid.dims[2] - 1));
+  return true;
+}
+
+/// The rays to test against each ellipsoid, found by walking the rays through a grid of the ellipsoids (see
+/// @c fillEllipsoidRays ). This is the dual of the ray grid, which holds every voxel crossed by every ray. The rays of
+/// each ellipsoid are in the order that the ray grid gives them, so that both find the same transients.
+struct EllipsoidRays
+{
+  /// the rays of one ellipsoid
+  struct Rays
+  {
+    const unsigned *ids;
+    size_t count;
+    bool gridded;  // false where the ray grid would not test the ellipsoid
+  };
+  inline Rays rays(size_t ellipsoid_id) const
+  {
+    return Rays{ ray_ids.data() + offsets[ellipsoid_id], offsets[ellipsoid_id + 1] - offsets[ellipsoid_id],
+                 gridded[ellipsoid_id] != 0 };
+  }
+
+  /// the rays of ellipsoid i are ray_ids[offsets[i]] to ray_ids[offsets[i + 1]]
+  std::vector<size_t> offsets;
+  std::vector<unsigned> ray_ids;
+  std::vector<char> gridded;
+};
+
+/// the rays of ellipsoid @c ellipsoid_id in either kind of ray source
+inline const PackedGrid<unsigned> &raysOf(const PackedGrid<unsigned> &ray_grid, size_t ellipsoid_id)
+{
+  RAYLIB_UNUSED(ellipsoid_id);
+  return ray_grid;
+}
+inline EllipsoidRays::Rays raysOf(const EllipsoidRays &ellipsoid_rays, size_t ellipsoid_id)
+{
+  return ellipsoid_rays.rays(ellipsoid_id);
+}
+}  // namespace
+
 class EllipsoidTransientMarker
 {
 public:
@@ -49,14 +362,25 @@ public:
   /// @param ray_grid The voxelised representation of @p cloud .
   /// @param num_rays Thresholding value indicating the number of nearby rays required to mark the ellipsoid as
   /// transient.
-  /// @param merge_type The merging strategy.
-  /// @param self_transient True when the @p ellipsoid was generated from @p cloud and we are looking for transient
+  /// @tparam kMergeType The merging strategy.
+  /// @tparam kSelfTransient True when the @p ellipsoid was generated from @p cloud and we are looking for transient
   /// points within this cloud.
-  void mark(Ellipsoid *ellipsoid, std::vector<Merger::Bool> *transient_ray_marks, const Cloud &cloud,
-            const Grid<unsigned> &ray_grid, double num_rays, MergeType merge_type, bool self_transient,
-            bool ellipsoid_cloud_first);
+  /// @tparam kEllipsoidCloudFirst For @c MergeType::Order , true when the cloud of the @p ellipsoid is first in order.
+  /// The merge settings are template parameters so that the loops over the rays do not branch on them.
+  template <MergeType kMergeType, bool kSelfTransient, bool kEllipsoidCloudFirst, class CloudT>
+  void mark(Ellipsoid *ellipsoid, std::vector<Merger::Bool> *transient_ray_marks, const CloudT &cloud,
+            const PackedGrid<unsigned> &ray_grid, double num_rays);
+  /// As above, testing the @p rays found for the @p ellipsoid through an ellipsoid grid.
+  template <MergeType kMergeType, bool kSelfTransient, bool kEllipsoidCloudFirst, class CloudT>
+  void mark(Ellipsoid *ellipsoid, std::vector<Merger::Bool> *transient_ray_marks, const CloudT &cloud,
+            const EllipsoidRays::Rays &rays, double num_rays);
 
 private:
+  /// Intersect the @p ellipsoid with the rays of @c ray_batch , whose ids are @c test_ray_ids , and resolve the marks
+  template <MergeType kMergeType, bool kSelfTransient, bool kEllipsoidCloudFirst, class CloudT>
+  void resolve(Ellipsoid *ellipsoid, std::vector<Merger::Bool> *transient_ray_marks, const CloudT &cloud,
+               double num_rays);
+
   // Working memory.
 
   /// Tracks which rays have been tested. Sized to match incoming cloud ray count.
@@ -65,6 +389,9 @@ private:
   std::vector<unsigned> test_ray_ids;
   /// Ids of rays which intersect the ellipsoid with a @c IntersectResult::Passthrough result.
   std::vector<unsigned> pass_through_ids;
+  /// The rays to test, gathered for a batched intersection, and the results.
+  EllipsoidRayBatch ray_batch;
+  std::vector<IntersectResult> intersections;
 };
 
 typedef Eigen::Matrix<double, 6, 1> Vector6i;
@@ -107,9 +434,9 @@ void rayLookup(const Cloud *cloud, std::set<Vector6i, Vector6iLess> &ray_lookup)
   }
 }
 
+template <MergeType kMergeType, bool kSelfTransient, bool kEllipsoidCloudFirst, class CloudT>
 void EllipsoidTransientMarker::mark(Ellipsoid *ellipsoid, std::vector<Merger::Bool> *transient_ray_marks,
-                                    const Cloud &cloud, const Grid<unsigned> &ray_grid, double num_rays,
-                                    MergeType merge_type, bool self_transient, bool ellipsoid_cloud_first)
+                                    const CloudT &cloud, const PackedGrid<unsigned> &ray_grid, double num_rays)
 {
   if (ellipsoid->transient)
   {
@@ -131,55 +458,71 @@ void EllipsoidTransientMarker::mark(Ellipsoid *ellipsoid, std::vector<Merger::Bo
   pass_through_ids.clear();
 
   // get all the rays that overlap this ellipsoid
-  const Eigen::Vector3d ellipsoid_bounds_min =
-    (ellipsoid->pos - ellipsoid->extents - ray_grid.box_min) / ray_grid.voxel_width;
-  const Eigen::Vector3d ellipsoid_bounds_max =
-    (ellipsoid->pos + ellipsoid->extents - ray_grid.box_min) / ray_grid.voxel_width;
-
-  if (ellipsoid_bounds_max[0] < 0.0 || ellipsoid_bounds_max[1] < 0.0 || ellipsoid_bounds_max[2] < 0.0)
-  {
-    return;
-  }
-
-  if (ellipsoid_bounds_min[0] >= (double)ray_grid.dims[0] || ellipsoid_bounds_min[1] >= (double)ray_grid.dims[1] ||
-      ellipsoid_bounds_min[2] >= (double)ray_grid.dims[2])
+  Eigen::Vector3i bmin, bmax;
+  if (!ellipsoidVoxels(*ellipsoid, ray_grid, &bmin, &bmax))
   {
-    // Out of bounds against the ray grid.
     return;
   }
 
-  Eigen::Vector3i bmin = maxVector(Eigen::Vector3i(0, 0, 0), Eigen::Vector3i(ellipsoid_bounds_min.cast<int>()));
-  Eigen::Vector3i bmax = minVector(Eigen::Vector3i(ellipsoid_bounds_max.cast<int>()),
-                                   Eigen::Vector3i(ray_grid.dims[0] - 1, ray_grid.dims[1] - 1, ray_grid.dims[2] - 1));
-
   for (int x = bmin[0]; x <= bmax[0]; x++)
   {
     for (int y = bmin[1]; y <= bmax[1]; y++)
     {
-      for (int z = bmin[2]; z <= bmax[2]; z++)
+      // the rays of the voxel column from bmin[2] to bmax[2] are stored contiguously
+      for (const auto &ray_id : ray_grid.column(x, y, bmin[2], bmax[2]))
       {
-        auto &ray_list = ray_grid.cell(x, y, z).data;
-        for (auto &ray_id : ray_list)
+        if (ray_tested[ray_id])
         {
-          if (ray_tested[ray_id])
-          {
-            continue;
-          }
-          ray_tested[ray_id] = true;
-          test_ray_ids.push_back(ray_id);
+          continue;
         }
+        ray_tested[ray_id] = true;
+        test_ray_ids.push_back(ray_id);
       }
     }
   }
 
-  double first_intersection_time = std::numeric_limits<double>::max();
-  double last_intersection_time = std::numeric_limits<double>::lowest();
-  unsigned hits = 0;
+  ray_batch.begin(ellipsoid->pos);
   for (auto &ray_id : test_ray_ids)
   {
     ray_tested[ray_id] = false;
+    ray_batch.add(cloud.rayStart(ray_id), cloud.rayEnd(ray_id));
+  }
+  resolve<kMergeType, kSelfTransient, kEllipsoidCloudFirst>(ellipsoid, transient_ray_marks, cloud, num_rays);
+}
+
+template <MergeType kMergeType, bool kSelfTransient, bool kEllipsoidCloudFirst, class CloudT>
+void EllipsoidTransientMarker::mark(Ellipsoid *ellipsoid, std::vector<Merger::Bool> *transient_ray_marks,
+                                    const CloudT &cloud, const EllipsoidRays::Rays &rays, double num_rays)
+{
+  // ellipsoids that are transient, unbounded or outside of the grid were not gridded
+  if (!rays.gridded || ellipsoid->transient)
+  {
+    return;
+  }
+  test_ray_ids.assign(rays.ids, rays.ids + rays.count);
+  pass_through_ids.clear();
 
-    switch (ellipsoid->intersect(cloud.starts[ray_id], cloud.ends[ray_id]))
+  ray_batch.begin(ellipsoid->pos);
+  for (auto &ray_id : test_ray_ids)
+  {
+    ray_batch.add(cloud.rayStart(ray_id), cloud.rayEnd(ray_id));
+  }
+  resolve<kMergeType, kSelfTransient, kEllipsoidCloudFirst>(ellipsoid, transient_ray_marks, cloud, num_rays);
+}
+
+template <MergeType kMergeType, bool kSelfTransient, bool kEllipsoidCloudFirst, class CloudT>
+void EllipsoidTransientMarker::resolve(Ellipsoid *ellipsoid, std::vector<Merger::Bool> *transient_ray_marks,
+                                       const CloudT &cloud, double num_rays)
+{
+  ellipsoid->intersect(ray_batch, intersections);
+
+  double first_intersection_time = std::numeric_limits<double>::max();
+  double last_intersection_time = std::numeric_limits<double>::lowest();
+  unsigned hits = 0;
+  for (size_t i = 0; i < test_ray_ids.size(); i++)
+  {
+    const unsigned ray_id = test_ray_ids[i];
+    switch (intersections[i])
     {
     default:
     case IntersectResult::Miss:
@@ -190,15 +533,15 @@ void EllipsoidTransientMarker::mark(Ellipsoid *ellipsoid, std::vector<Merger::Bo
       break;
     case IntersectResult::Hit:
       ++hits;
-      first_intersection_time = std::min(first_intersection_time, cloud.times[ray_id]);
-      last_intersection_time = std::max(last_intersection_time, cloud.times[ray_id]);
+      first_intersection_time = std::min(first_intersection_time, cloud.rayTime(ray_id));
+      last_intersection_time = std::max(last_intersection_time, cloud.rayTime(ray_id));
       break;
     }
   }
 
   size_t num_before = 0, num_after = 0;
   ellipsoid->num_rays = hits + pass_through_ids.size();
-  if (num_rays == 0 || self_transient)
+  if (num_rays == 0 || kSelfTransient)
   {
     ellipsoid->opacity = (double)hits / ((double)hits + (double)pass_through_ids.size());
   }
@@ -206,18 +549,18 @@ void EllipsoidTransientMarker::mark(Ellipsoid *ellipsoid, std::vector<Merger::Bo
   {
     return;
   }
-  if (self_transient)
+  if (kSelfTransient)
   {
     ellipsoid->num_gone = pass_through_ids.size();
     // now get some density stats...
     double misses = 0;
     for (auto &ray_id : pass_through_ids)
     {
-      if (cloud.times[ray_id] > last_intersection_time)
+      if (cloud.rayTime(ray_id) > last_intersection_time)
       {
         num_after++;
       }
-      else if (cloud.times[ray_id] < first_intersection_time)
+      else if (cloud.rayTime(ray_id) < first_intersection_time)
       {
         num_before++;
       }
@@ -234,7 +577,7 @@ void EllipsoidTransientMarker::mark(Ellipsoid *ellipsoid, std::vector<Merger::Bo
   {
     if (pass_through_ids.size() > 0)
     {
-      if (cloud.times[pass_through_ids[0]] > ellipsoid->time)
+      if (cloud.rayTime(pass_through_ids[0]) > ellipsoid->time)
       {
         num_after = pass_through_ids.size();
       }
@@ -247,13 +590,13 @@ void EllipsoidTransientMarker::mark(Ellipsoid *ellipsoid, std::vector<Merger::Bo
 
   double sequence_length = num_rays / ellipsoid->opacity;
   int remove_ellipsoid = false;
-  if (merge_type == MergeType::Oldest || merge_type == MergeType::Newest)
+  if (kMergeType == MergeType::Oldest || kMergeType == MergeType::Newest)
   {
     if (double(std::max(num_before, num_after)) < sequence_length)
     {
       return;
     }
-    if (merge_type == MergeType::Oldest)
+    if (kMergeType == MergeType::Oldest)
     {  // if false then remove numAfter rays if > seqLength
       remove_ellipsoid = double(num_before) >= sequence_length;
     }
@@ -272,15 +615,15 @@ void EllipsoidTransientMarker::mark(Ellipsoid *ellipsoid, std::vector<Merger::Bo
       // TODO: even a tiny bit of translucency will make a single ray not enough
       return;
     }
-    if (merge_type == MergeType::Order)  // order
+    if (kMergeType == MergeType::Order)  // order
     {
       // if the cloud containing the ellipsoid is the first cloud in order, then remove the ray
-      remove_ellipsoid = !ellipsoid_cloud_first;
+      remove_ellipsoid = !kEllipsoidCloudFirst;
     }
     else
     {
       // min is remove ellipsoid, max is remove ray
-      remove_ellipsoid = merge_type == MergeType::Mininum;
+      remove_ellipsoid = kMergeType == MergeType::Mininum;
     }
   }
 
@@ -306,8 +649,8 @@ void EllipsoidTransientMarker::mark(Ellipsoid *ellipsoid, std::vector<Merger::Bo
       }
 
       unsigned ray_id = pass_through_ids[j];
-      if (!self_transient || cloud.times[ray_id] < first_intersection_time ||
-          cloud.times[ray_id] > last_intersection_time)
+      if (!kSelfTransient || cloud.rayTime(ray_id) < first_intersection_time ||
+          cloud.rayTime(ray_id) > last_intersection_time)
       {
         // remove ray i
         (*transient_ray_marks)[ray_id] = true;
@@ -322,7 +665,8 @@ Merger::Merger(const MergerConfig &config)
 
 Merger::~Merger() = default;
 
-bool Merger::filter(const Cloud &cloud, Progress *progress)
+template <class CloudT>
+bool Merger::filter(const CloudT &cloud, Progress *progress)
 {
   // Ensure we have a value progress pointer to update. This simplifies code below.
   Progress tracker;
@@ -342,23 +686,22 @@ bool Merger::filter(const Cloud &cloud, Progress *progress)
     std::cout << "estimated required voxel size: " << voxel_size << std::endl;
   }
 
-  Grid<unsigned> ray_grid(bounds_min, bounds_max, voxel_size);
-  fillRayGrid(&ray_grid, cloud, progress);
-
   // Atomic do not support assignment and construction so we can't really retain the vector memory.
   std::vector<Bool> transient_ray_marks(cloud.rayCount() MARKER_BOOL_INIT);
-  markIntersectedEllipsoids(cloud, ray_grid, &transient_ray_marks, config_.num_rays_filter_threshold, true, progress);
+  markTransients(&ellipsoids_, cloud, bounds_min, bounds_max, voxel_size, &transient_ray_marks,
+                 config_.num_rays_filter_threshold, true, progress);
 
   finaliseFilter(cloud, transient_ray_marks);
+  const bool success = flushResults();
 
   progress->end();
 
-  return true;
+  return success;
 }
 
-bool Merger::mergeMultiple(std::vector<Cloud> &clouds, Progress *progress)
+bool Merger::filterTiled(const std::string &file_name, const std::string &transient_file,
+                         const std::string &fixed_file, double tile_width, double overlap, Progress *progress)
 {
-  // Ensure we have a value progress pointer to update. This simplifies code below.
   Progress tracker;
   if (!progress)
   {
@@ -367,87 +710,714 @@ bool Merger::mergeMultiple(std::vector<Cloud> &clouds, Progress *progress)
 
   clear();
 
-  std::vector<Grid<unsigned>> grids(clouds.size());
-  for (size_t c = 0; c < clouds.size(); c++)
+  Cloud::Info info;
+  if (!Cloud::getInfo(file_name, info))
   {
-    const double voxel_size = voxelSizeForCloud(clouds[c]);
-    if (config_.voxel_size == 0)
-    {
-      std::cout << "estimated required voxel size for cloud " << c << ": " << voxel_size << std::endl;
-    }
-
-    grids[c].init(clouds[c].calcMinBound(), clouds[c].calcMaxBound(), voxel_size);
-    fillRayGrid(&grids[c], clouds[c], progress);
+    return false;
   }
-
-  std::vector<std::vector<Bool>> transient_ray_marks;
-  transient_ray_marks.reserve(clouds.size());
-  for (size_t c = 0; c < clouds.size(); c++)
+  // the voxel size is estimated once, so that all tiles share it
+  const MergerConfig original_config = config_;
+  if (config_.voxel_size <= 0)
+  {
+    config_.voxel_size = fileVoxelSize(file_name, info);
+    std::cout << "estimated required voxel size: " << config_.voxel_size << std::endl;
+  }
+  if (overlap <= 0.0)
   {
-    transient_ray_marks.emplace_back(std::vector<Bool>(clouds[c].rayCount() MARKER_BOOL_INIT));
+    overlap = 4.0 * config_.voxel_size;
   }
 
-  // now for each cloud, look for other clouds that penetrate it
-  for (size_t c = 0; c < clouds.size(); c++)
+  TileLayout layout;
+  layout.min_bound = info.rays_bound.min_bound_;
+  layout.max_bound = info.rays_bound.max_bound_;
+  layout.width = tile_width;
+  for (int k = 0; k < 2; k++)
   {
-    generateEllipsoids(&ellipsoids_, nullptr, nullptr, clouds[c], progress);
-    // just set opacity
-    markIntersectedEllipsoids(clouds[c], grids[c], &transient_ray_marks[c], 0, false, progress);
+    layout.dims[k] = std::max(1, static_cast<int>(std::ceil((layout.max_bound[k] - layout.min_bound[k]) / tile_width)));
+  }
+  const int num_tiles = layout.dims[0] * layout.dims[1];
+  const int max_allowable_tiles = 1024;  // operating systems will fail with too many open file pointers.
+  std::cout << "filtering in " << num_tiles << " tiles" << std::endl;
+  if (num_tiles > max_allowable_tiles)
+  {
+    std::cout << "Error: more tiles than the maximum of " << max_allowable_tiles << ", use a larger tile width."
+              << std::endl;
+    config_ = original_config;
+    return false;
+  }
+  const std::string stub = file_name.substr(0, file_name.find_last_of('.'));
+  auto tile_file = [&stub](int tile, const std::string &type) {
+    return stub + "_tile_" + std::to_string(tile) + "." + type;
+  };
 
-    for (size_t d = 0; d < clouds.size(); d++)
+  // a checkpoint records the split, then each tile as it is filtered. Their tile files are kept until then
+  Checkpoint checkpoint;
+  if (!checkpoint_file_.empty())
+  {
+    uint64_t size, hash;
+    int64_t modified;
+    if (fileStamp(file_name, size, modified, hash))
     {
-      if (d == c)
+      std::ostringstream inputs;
+      inputs << std::setprecision(17) << "filterTiled " << size << " " << modified << " " << hash << " "
+             << tile_width << " " << overlap;
+      checkpoint.open(checkpoint_file_, checkpointKey(config_, inputs.str()));
+    }
+  }
+  auto tile_phase = [](int tile) { return "tile " + std::to_string(tile); };
+
+  // 1. copy each ray into the file of each padded tile that it passes through
+  std::vector<std::ofstream> tile_rays(num_tiles);
+  std::vector<size_t> tile_ray_counts(num_tiles, 0);
+  uint64_t ray_count = 0;
+  std::vector<uint64_t> split;
+  if (checkpoint.load("split", split))
+  {
+    // the split can be reused if each tile still has the file that the next stage reads
+    bool resumable = split.size() == static_cast<size_t>(num_tiles) + 1;
+    for (int tile = 0; tile < num_tiles && resumable; tile++)
+    {
+      const bool filtered = checkpoint.completed(tile_phase(tile));
+      resumable = split[1 + tile] == 0 || fileExists(tile_file(tile, filtered ? "results" : "rays"));
+    }
+    if (resumable)
+    {
+      ray_count = split[0];
+      tile_ray_counts.assign(split.begin() + 1, split.end());
+    }
+    else
+    {
+      std::cout << "the tile files of checkpoint " << checkpoint_file_ << " have gone, starting afresh" << std::endl;
+      checkpoint.reset();
+      split.clear();
+    }
+  }
+  progress->begin("transient-tile-split", info.num_bounded + info.num_unbounded);
+  auto split_chunk = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                         std::vector<double> &times, std::vector<RGBA> &colours) {
+    for (size_t i = 0; i < ends.size(); i++, ray_count++)
+    {
+      const TileRay tile_ray = { starts[i], ends[i], times[i], colours[i], ray_count };
+      const Eigen::Vector3d ray_min = minVector(starts[i], ends[i]);
+      const Eigen::Vector3d ray_max = maxVector(starts[i], ends[i]);
+      for (int y = layout.tileCoord(ray_min[1] - overlap, 1); y <= layout.tileCoord(ray_max[1] + overlap, 1); y++)
       {
-        continue;
+        for (int x = layout.tileCoord(ray_min[0] - overlap, 0); x <= layout.tileCoord(ray_max[0] + overlap, 0); x++)
+        {
+          const int tile = x + layout.dims[0] * y;
+          Eigen::Vector3d start = starts[i];
+          Eigen::Vector3d end = ends[i];
+          if (!layout.padded(tile, overlap).clipRay(start, end))
+          {
+            continue;
+          }
+          if (!tile_rays[tile].is_open())
+          {
+            tile_rays[tile].open(tile_file(tile, "rays"), std::ios::binary | std::ios::out);
+          }
+          writePlainOldData(tile_rays[tile], tile_ray);
+          tile_ray_counts[tile]++;
+        }
       }
-      const bool ellipsoid_cloud_first = c < d;  // used when argument order of the files is the merge type
-      // use ellipsoid opacity to set transient flag true on transients
-      markIntersectedEllipsoids(clouds[d], grids[d], &transient_ray_marks[d], config_.num_rays_filter_threshold, false,
-                                progress, ellipsoid_cloud_first);
+      progress->increment();
     }
-
-    for (size_t i = 0; i < clouds[c].rayCount(); i++)
+  };
+  bool success = true;
+  if (split.empty())
+  {
+    success = Cloud::read(file_name, split_chunk);
+    for (auto &out : tile_rays)
     {
-      if (ellipsoids_[i].transient)
+      if (out.is_open())
       {
-        transient_ray_marks[c][i] = true;
+        out.close();
+        success = success && !out.fail();
       }
     }
+    if (success)
+    {
+      split.push_back(ray_count);
+      split.insert(split.end(), tile_ray_counts.begin(), tile_ray_counts.end());
+      checkpoint.save("split", split);
+    }
   }
 
-  for (size_t c = 0; c < clouds.size(); c++)
+  // 2. filter each tile in turn. Removals from any tile are collected, while each ray's own ellipsoid result is
+  // written to the file of the tile that owns it
+  std::vector<bool> removed(ray_count, false);
+  for (int tile = 0; tile < num_tiles && success; tile++)
   {
-    auto &cloud = clouds[c];
+    if (tile_ray_counts[tile] == 0)
+    {
+      continue;
+    }
+    std::vector<uint64_t> tile_removed;
+    if (checkpoint.load(tile_phase(tile), tile_removed))
+    {
+      for (const auto &id : tile_removed)
+      {
+        removed[id] = true;
+      }
+      continue;
+    }
+    Cloud cloud;
+    std::vector<uint64_t> ids;
+    cloud.reserve(tile_ray_counts[tile]);
+    ids.reserve(tile_ray_counts[tile]);
+    std::ifstream in(tile_file(tile, "rays"), std::ios::binary | std::ios::in);
+    TileRay tile_ray;
+    for (size_t i = 0; i < tile_ray_counts[tile]; i++)
+    {
+      readPlainOldData(in, tile_ray);
+      cloud.addRay(tile_ray.start, tile_ray.end, tile_ray.time, tile_ray.colour);
+      ids.push_back(tile_ray.id);
+    }
+    success = !in.fail();
+    in.close();
+    if (!checkpoint.isOpen())
+    {
+      std::remove(tile_file(tile, "rays").c_str());
+    }
+
+    Eigen::Vector3d bounds_min, bounds_max;
+    generateEllipsoids(&ellipsoids_, &bounds_min, &bounds_max, cloud, progress);
+
+    // the ellipsoids of rays owned by other tiles are missing some of their rays here, so are left to their own
+    // tile. Marking them as transient excludes them from the test
+    std::vector<bool> owned(cloud.rayCount());
     for (size_t i = 0; i < cloud.rayCount(); i++)
     {
-      if (transient_ray_marks[c][i])
+      owned[i] = layout.owner(cloud.ends[i]) == tile;
+      if (!owned[i])
       {
-        difference_.addRay(cloud, i);
+        ellipsoids_[i].transient = true;
       }
-      else
+    }
+    std::vector<Bool> transient_ray_marks(cloud.rayCount() MARKER_BOOL_INIT);
+    markTransients(&ellipsoids_, cloud, bounds_min, bounds_max, config_.voxel_size, &transient_ray_marks,
+                   config_.num_rays_filter_threshold, true, progress);
+
+    std::ofstream results(tile_file(tile, "results"), std::ios::binary | std::ios::out);
+    for (size_t i = 0; i < cloud.rayCount(); i++)
+    {
+      if (transient_ray_marks[i])
+      {
+        removed[ids[i]] = true;
+        tile_removed.push_back(ids[i]);
+      }
+      if (owned[i])
       {
-        fixed_.addRay(cloud, i);
+        const TileResult result = { filteredColour(cloud.colours[i], ellipsoids_[i], config_.colour_cloud),
+                                    static_cast<uint8_t>(ellipsoids_[i].transient ? 1 : 0) };
+        writePlainOldData(results, result);
       }
     }
+    results.close();
+    if (success && !results.fail() && checkpoint.save(tile_phase(tile), tile_removed))
+    {
+      std::remove(tile_file(tile, "rays").c_str());
+    }
+  }
+  ellipsoids_.clear();
+  for (int tile = 0; tile < num_tiles; tile++)
+  {
+    if (tile_ray_counts[tile] > 0)
+    {
+      std::remove(tile_file(tile, "rays").c_str());  // any left after a failure
+    }
   }
 
-  return true;
+  // 3. stitch the results back together in the input order. Each tile's owned rays are in input order in its
+  // result file, so the next result of the ray's owning tile is the result for that ray
+  std::vector<std::ifstream> tile_results(num_tiles);
+  for (int tile = 0; tile < num_tiles; tile++)
+  {
+    if (tile_ray_counts[tile] > 0)
+    {
+      tile_results[tile].open(tile_file(tile, "results"), std::ios::binary | std::ios::in);
+    }
+  }
+  CloudWriter transient_writer, fixed_writer;
+  if (success)
+  {
+    success = transient_writer.begin(transient_file) && fixed_writer.begin(fixed_file);
+  }
+  uint64_t ray_id = 0;
+  Cloud transient_chunk, fixed_chunk;
+  auto merge_chunk = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                         std::vector<double> &times, std::vector<RGBA> &) {
+    for (size_t i = 0; i < ends.size(); i++, ray_id++)
+    {
+      TileResult result;
+      readPlainOldData(tile_results[layout.owner(ends[i])], result);
+      Cloud &chunk = (result.transient || removed[ray_id]) ? transient_chunk : fixed_chunk;
+      chunk.addRay(starts[i], ends[i], times[i], result.colour);
+    }
+    transient_writer.writeChunk(transient_chunk);
+    fixed_writer.writeChunk(fixed_chunk);
+    transient_chunk.clear();
+    fixed_chunk.clear();
+  };
+  if (success)
+  {
+    success = Cloud::read(file_name, merge_chunk);
+    transient_writer.end();
+    fixed_writer.end();
+  }
+  for (int tile = 0; tile < num_tiles; tile++)
+  {
+    if (tile_ray_counts[tile] > 0)
+    {
+      tile_results[tile].close();
+      std::remove(tile_file(tile, "results").c_str());
+    }
+  }
+  if (success)
+  {
+    checkpoint.finish();
+  }
+
+  config_ = original_config;
+  progress->end();
+  return success;
 }
 
-bool Merger::mergeThreeWay(const Cloud &base_cloud, Cloud &cloud1, Cloud &cloud2, Progress *progress)
+bool Merger::filterWindowed(const std::string &file_name, const std::string &transient_file,
+                            const std::string &fixed_file, double window, double margin, Progress *progress)
 {
-  // The 3-way merge is similar to those performed on text files for version control systems. It attempts to apply the
-  // changes in both cloud 1 and cloud2 (compared to base_cloud). When there is a conflict (different changes in the
-  // same location) it resolves that according to the selected merge_type. unlike with text, a change requires a small
-  // threshold, since positions are floating point values. In our case, we define a ray as unchanged when the start and
-  // end points are within the same small voxel as they were in base_cloud. so the threshold is test_width.
+  Progress tracker;
+  if (!progress)
+  {
+    progress = &tracker;
+  }
 
-  // generate quick lookup for the existance of a particular (quantised) ray
-  Cloud *clouds[2] = { &cloud1, &cloud2 };
-  std::set<Vector6i, Vector6iLess> base_ray_lookup;
-  rayLookup(&base_cloud, base_ray_lookup);
-  std::set<Vector6i, Vector6iLess> ray_lookups[2];
-  for (int c = 0; c < 2; c++) rayLookup(clouds[c], ray_lookups[c]);
+  clear();
+
+  Cloud::Info info;
+  if (!Cloud::getInfo(file_name, info))
+  {
+    return false;
+  }
+  // the voxel size is estimated once, so that all windows share it
+  const MergerConfig original_config = config_;
+  if (config_.voxel_size <= 0)
+  {
+    config_.voxel_size = fileVoxelSize(file_name, info);
+    std::cout << "estimated required voxel size: " << config_.voxel_size << std::endl;
+  }
+  if (margin <= 0.0)
+  {
+    margin = window;
+  }
+  CloudWriter transient_writer, fixed_writer;
+  if (!transient_writer.begin(transient_file) || !fixed_writer.begin(fixed_file))
+  {
+    config_ = original_config;
+    return false;
+  }
+
+  // the held rays are in time order. The first num_decided of them have been tested in their own window
+  std::deque<WindowRay> rays;
+  size_t num_decided = 0;
+  double window_begin = 0.0;
+  double last_time = -std::numeric_limits<double>::infinity();
+  bool in_time_order = true;
+  Cloud transient_chunk, fixed_chunk;
+
+  // filter the window from window_begin, then move on to the next window
+  auto filter_window = [&]() {
+    // skip the windows that contain no rays
+    const double next_time = rays[num_decided].time;
+    while (next_time >= window_begin + window)
+    {
+      window_begin += window * std::max(1.0, std::floor((next_time - window_begin) / window));
+    }
+    window_begin = std::min(window_begin, next_time);  // in case of rounding
+    const double window_end = window_begin + window;
+    // the rays within the margin of the window, and the rays in the window itself, are contiguous ranges
+    size_t first = 0;
+    while (first < rays.size() && rays[first].time < window_begin - margin) first++;
+    size_t last = num_decided;
+    while (last < rays.size() && rays[last].time < window_end + margin) last++;
+    size_t owned_last = num_decided;
+    while (owned_last < rays.size() && rays[owned_last].time < window_end) owned_last++;
+
+    Cloud cloud;
+    cloud.reserve(last - first);
+    for (size_t i = first; i < last; i++) cloud.addRay(rays[i].start, rays[i].end, rays[i].time, rays[i].colour);
+    Eigen::Vector3d bounds_min, bounds_max;
+    generateEllipsoids(&ellipsoids_, &bounds_min, &bounds_max, cloud, progress);
+
+    // the ellipsoids of rays owned by other windows are missing some of their rays here, so are left to their own
+    // window. Marking them as transient excludes them from the test
+    for (size_t i = first; i < last; i++)
+    {
+      if (i < num_decided || i >= owned_last)
+      {
+        ellipsoids_[i - first].transient = true;
+      }
+    }
+    std::vector<Bool> transient_ray_marks(cloud.rayCount() MARKER_BOOL_INIT);
+    markTransients(&ellipsoids_, cloud, bounds_min, bounds_max, config_.voxel_size, &transient_ray_marks,
+                   config_.num_rays_filter_threshold, true, progress);
+    for (size_t i = first; i < last; i++)
+    {
+      WindowRay &ray = rays[i];
+      if (transient_ray_marks[i - first])
+      {
+        ray.removed = true;
+      }
+      if (i >= num_decided && i < owned_last)
+      {
+        const Ellipsoid &ellipsoid = ellipsoids_[i - first];
+        ray.result = { filteredColour(ray.colour, ellipsoid, config_.colour_cloud),
+                       static_cast<uint8_t>(ellipsoid.transient ? 1 : 0) };
+      }
+    }
+    num_decided = owned_last;
+    window_begin = window_end;
+  };
+  // write the decided rays that are earlier than final_time, which no later window can reach
+  auto write_final = [&](double final_time) {
+    while (num_decided > 0 && rays.front().time < final_time)
+    {
+      const WindowRay &ray = rays.front();
+      Cloud &chunk = (ray.result.transient || ray.removed) ? transient_chunk : fixed_chunk;
+      chunk.addRay(ray.start, ray.end, ray.time, ray.result.colour);
+      rays.pop_front();
+      num_decided--;
+    }
+    transient_writer.writeChunk(transient_chunk);
+    fixed_writer.writeChunk(fixed_chunk);
+    transient_chunk.clear();
+    fixed_chunk.clear();
+  };
+
+  progress->begin("transient-window-read", info.num_bounded + info.num_unbounded);
+  auto filter_chunk = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                          std::vector<double> &times, std::vector<RGBA> &colours) {
+    for (size_t i = 0; i < ends.size() && in_time_order; i++)
+    {
+      if (!(times[i] >= last_time))
+      {
+        in_time_order = false;
+        break;
+      }
+      if (last_time == -std::numeric_limits<double>::infinity())
+      {
+        window_begin = times[i];
+      }
+      last_time = times[i];
+      rays.push_back(WindowRay{ starts[i], ends[i], times[i], colours[i], false, TileResult{ colours[i], 0 } });
+    }
+    // a window is complete once a ray beyond its margin has been read
+    while (in_time_order && num_decided < rays.size() && rays.back().time >= window_begin + window + margin)
+    {
+      filter_window();
+      write_final(window_begin - margin);
+    }
+  };
+  bool success = Cloud::read(file_name, filter_chunk);
+  if (!in_time_order)
+  {
+    std::cerr << "Error: " << file_name << " is not in time order, so cannot be filtered in time windows" << std::endl;
+    success = false;
+  }
+  while (success && num_decided < rays.size())
+  {
+    filter_window();
+  }
+  if (success)
+  {
+    write_final(std::numeric_limits<double>::infinity());
+  }
+  transient_writer.end();
+  fixed_writer.end();
+  ellipsoids_.clear();
+  config_ = original_config;
+  progress->end();
+  return success;
+}
+
+bool Merger::mergeMultiple(std::vector<Cloud> &clouds, Progress *progress)
+{
+  // Ensure we have a value progress pointer to update. This simplifies code below.
+  Progress tracker;
+  if (!progress)
+  {
+    progress = &tracker;
+  }
+
+  clear();
+
+  std::vector<const Cloud *> cloud_ptrs;
+  for (const auto &cloud : clouds)
+  {
+    cloud_ptrs.push_back(&cloud);
+  }
+  // the clouds are keyed by a hash of their rays, as they need not have come from files
+  Checkpoint checkpoint;
+  if (!checkpoint_file_.empty())
+  {
+    std::vector<uint64_t> hashes(clouds.size());
+    parallelFor(0, static_cast<int>(clouds.size()), [&](int c) {
+      const Cloud &cloud = clouds[c];
+      hashes[c] = Checkpoint::hash(cloud.starts);
+      hashes[c] = Checkpoint::hash(cloud.ends, hashes[c]);
+      hashes[c] = Checkpoint::hash(cloud.times, hashes[c]);
+      hashes[c] = Checkpoint::hash(cloud.colours, hashes[c]);
+    });
+    std::ostringstream inputs;
+    inputs << "mergeMultiple";
+    for (const auto &hash : hashes)
+    {
+      inputs << " " << hash;
+    }
+    checkpoint.open(checkpoint_file_, checkpointKey(config_, inputs.str()));
+  }
+  std::vector<std::vector<Bool>> transient_ray_marks;
+  markTransientsBetween(cloud_ptrs, &transient_ray_marks, progress, &checkpoint);
+
+  for (size_t c = 0; c < clouds.size(); c++)
+  {
+    auto &cloud = clouds[c];
+    for (size_t i = 0; i < cloud.rayCount(); i++)
+    {
+      addResult(cloud.starts[i], cloud.ends[i], cloud.times[i], cloud.colours[i], transient_ray_marks[c][i]);
+    }
+  }
+
+  const bool success = flushResults();
+  if (success)
+  {
+    checkpoint.finish();
+  }
+  return success;
+}
+
+bool Merger::mergeIncremental(const std::string &map_file, const std::string &state_file, const Cloud &new_cloud,
+                              const std::string &output_file, const std::string &output_state_file,
+                              Progress *progress)
+{
+  Progress tracker;
+  if (!progress)
+  {
+    progress = &tracker;
+  }
+
+  clear();
+
+  const double voxel_size = voxelSizeForCloud(new_cloud);
+  if (config_.voxel_size == 0)
+  {
+    std::cout << "estimated required voxel size for the new cloud: " << voxel_size << std::endl;
+  }
+
+  // the ellipsoids of a cloud, with opacities from its own rays, as in mergeMultiple
+  auto opaque_ellipsoids = [&](const Cloud &cloud, PackedGrid<unsigned> *grid, std::vector<Bool> *marks,
+                               Eigen::Vector3d *bounds_min, Eigen::Vector3d *bounds_max) {
+    generateEllipsoids(&ellipsoids_, bounds_min, bounds_max, cloud, progress);
+    grid->init(cloud.calcMinBound(), cloud.calcMaxBound(), voxel_size);
+    fillRayGrid(grid, cloud, progress);
+    markIntersectedEllipsoids(&ellipsoids_, cloud, *grid, marks, 0, false, progress);
+  };
+
+  PackedGrid<unsigned> new_grid;
+  std::vector<Bool> new_marks(new_cloud.rayCount() MARKER_BOOL_INIT);
+  Eigen::Vector3d new_bounds_min, new_bounds_max;
+  opaque_ellipsoids(new_cloud, &new_grid, &new_marks, &new_bounds_min, &new_bounds_max);
+  std::vector<Ellipsoid> new_ellipsoids;
+  std::swap(new_ellipsoids, ellipsoids_);
+
+  if (!std::ifstream(map_file).good())
+  {
+    std::cout << "no map " << map_file << ", so the new cloud starts the map" << std::endl;
+    new_cloud.save(output_file);
+    MergeStateWriter state_writer;
+    if (!state_writer.begin(output_state_file))
+    {
+      return false;
+    }
+    for (const auto &ellipsoid : new_ellipsoids)
+    {
+      state_writer.add(ellipsoid);
+    }
+    return state_writer.end();
+  }
+
+  if (!std::ifstream(state_file).good())
+  {
+    std::cout << "no merge state " << state_file << ", building it from the whole map" << std::endl;
+    Cloud map;
+    if (!map.load(map_file, false))
+    {
+      return false;
+    }
+    PackedGrid<unsigned> map_grid;
+    std::vector<Bool> map_marks(map.rayCount() MARKER_BOOL_INIT);
+    opaque_ellipsoids(map, &map_grid, &map_marks, nullptr, nullptr);
+    MergeStateWriter state_writer;
+    if (!state_writer.begin(state_file))
+    {
+      return false;
+    }
+    for (const auto &ellipsoid : ellipsoids_)
+    {
+      state_writer.add(ellipsoid);
+    }
+    ellipsoids_.clear();
+    if (!state_writer.end())
+    {
+      return false;
+    }
+  }
+
+  // 1. gather the map rays that can interact with the new cloud. These either have a stored ellipsoid that overlaps
+  // the new rays, or pass through the region of the new ellipsoids
+  const Cuboid new_ray_bounds(new_cloud.calcMinBound(), new_cloud.calcMaxBound());
+  const Cuboid new_ellipsoid_bounds(new_bounds_min, new_bounds_max);
+  Cloud near_cloud;
+  std::vector<uint64_t> near_ids;
+  std::ifstream state_in;
+  uint64_t state_ray_count = 0;
+  if (!openMergeState(state_file, state_in, state_ray_count))
+  {
+    return false;
+  }
+  uint64_t ray_count = 0;
+  bool state_valid = true;
+  auto gather_chunk = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                          std::vector<double> &times, std::vector<RGBA> &colours) {
+    for (size_t i = 0; i < ends.size(); i++, ray_count++)
+    {
+      Ellipsoid ellipsoid;
+      readPlainOldData(state_in, ellipsoid);
+      if (state_in.fail())
+      {
+        state_valid = false;
+        return;
+      }
+      bool near = ellipsoid.extents != Eigen::Vector3d::Zero() &&
+                  new_ray_bounds.overlaps(Cuboid(ellipsoid.pos - ellipsoid.extents, ellipsoid.pos + ellipsoid.extents));
+      if (!near)
+      {
+        Eigen::Vector3d start = starts[i];
+        Eigen::Vector3d end = ends[i];
+        near = new_ellipsoid_bounds.clipRay(start, end);
+      }
+      if (near)
+      {
+        near_cloud.addRay(starts[i], ends[i], times[i], colours[i]);
+        ellipsoid.transient = false;
+        ellipsoids_.push_back(ellipsoid);
+        near_ids.push_back(ray_count);
+      }
+    }
+  };
+  if (!Cloud::read(map_file, gather_chunk))
+  {
+    return false;
+  }
+  state_in.close();
+  if (!state_valid || ray_count != state_ray_count)
+  {
+    std::cerr << "Error: merge state " << state_file << " does not match the map " << map_file << std::endl;
+    return false;
+  }
+  std::cout << near_cloud.rayCount() << " of " << ray_count << " map rays are near the new cloud" << std::endl;
+
+  // 2. test the stored ellipsoids against the new rays, then the new ellipsoids against the nearby map rays. The map
+  // is the earlier cloud for the Order merge type
+  std::vector<Bool> near_marks(near_cloud.rayCount() MARKER_BOOL_INIT);
+  markIntersectedEllipsoids(&ellipsoids_, new_cloud, new_grid, &new_marks, config_.num_rays_filter_threshold, false,
+                            progress, true);
+  std::vector<bool> near_removed(near_cloud.rayCount());
+  for (size_t j = 0; j < near_cloud.rayCount(); j++)
+  {
+    near_removed[j] = ellipsoids_[j].transient;
+  }
+  std::swap(new_ellipsoids, ellipsoids_);
+  if (near_cloud.rayCount() > 0)
+  {
+    markTransients(&ellipsoids_, near_cloud, new_bounds_min, new_bounds_max, voxel_size, &near_marks,
+                   config_.num_rays_filter_threshold, false, progress, false);
+  }
+  for (size_t j = 0; j < near_cloud.rayCount(); j++)
+  {
+    if (near_marks[j])
+    {
+      near_removed[j] = true;
+    }
+  }
+
+  // 3. stream the map and its state to the output, without the removed map rays, then append the kept new rays
+  CloudWriter writer;
+  MergeStateWriter state_writer;
+  if (!writer.begin(output_file) || !state_writer.begin(output_state_file) ||
+      !openMergeState(state_file, state_in, state_ray_count))
+  {
+    return false;
+  }
+  uint64_t ray_id = 0;
+  size_t next_near = 0;
+  Cloud chunk;
+  auto merge_chunk = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                         std::vector<double> &times, std::vector<RGBA> &colours) {
+    for (size_t i = 0; i < ends.size(); i++, ray_id++)
+    {
+      Ellipsoid ellipsoid;
+      readPlainOldData(state_in, ellipsoid);
+      if (next_near < near_ids.size() && near_ids[next_near] == ray_id)
+      {
+        if (near_removed[next_near++])
+        {
+          addResult(starts[i], ends[i], times[i], colours[i], true);
+          continue;
+        }
+      }
+      chunk.addRay(starts[i], ends[i], times[i], colours[i]);
+      state_writer.add(ellipsoid);
+    }
+    writer.writeChunk(chunk);
+    chunk.clear();
+  };
+  bool success = Cloud::read(map_file, merge_chunk) && !state_in.fail();
+  state_in.close();
+  for (size_t i = 0; i < new_cloud.rayCount(); i++)
+  {
+    if (new_marks[i] || ellipsoids_[i].transient)
+    {
+      addResult(new_cloud.starts[i], new_cloud.ends[i], new_cloud.times[i], new_cloud.colours[i], true);
+    }
+    else
+    {
+      chunk.addRay(new_cloud, i);
+      ellipsoids_[i].transient = false;
+      state_writer.add(ellipsoids_[i]);
+    }
+  }
+  writer.writeChunk(chunk);
+  writer.end();
+  success = state_writer.end() && success;
+  success = flushResults() && success;
+  ellipsoids_.clear();
+  return success;
+}
+
+bool Merger::mergeThreeWay(const Cloud &base_cloud, Cloud &cloud1, Cloud &cloud2, Progress *progress)
+{
+  // The 3-way merge is similar to those performed on text files for version control systems. It attempts to apply the
+  // changes in both cloud 1 and cloud2 (compared to base_cloud). When there is a conflict (different changes in the
+  // same location) it resolves that according to the selected merge_type. unlike with text, a change requires a small
+  // threshold, since positions are floating point values. In our case, we define a ray as unchanged when the start and
+  // end points are within the same small voxel as they were in base_cloud. so the threshold is test_width.
+
+  // generate quick lookup for the existance of a particular (quantised) ray
+  Cloud *clouds[2] = { &cloud1, &cloud2 };
+  std::set<Vector6i, Vector6iLess> base_ray_lookup;
+  rayLookup(&base_cloud, base_ray_lookup);
+  std::set<Vector6i, Vector6iLess> ray_lookups[2];
+  for (int c = 0; c < 2; c++) rayLookup(clouds[c], ray_lookups[c]);
 
   std::cout << "set size " << ray_lookups[0].size() << ", " << ray_lookups[1].size() << ", " << base_ray_lookup.size()
             << std::endl;
@@ -474,7 +1444,7 @@ bool Merger::mergeThreeWay(const Cloud &base_cloud, Cloud &cloud1, Cloud &cloud2
       {
         if (c == preferred_cloud)
         {
-          fixed_.addRay(start, point, cloud.times[i], cloud.colours[i]);
+          addResult(start, point, cloud.times[i], cloud.colours[i], false);
           u++;
         }
       }
@@ -508,139 +1478,365 @@ bool Merger::mergeThreeWay(const Cloud &base_cloud, Cloud &cloud1, Cloud &cloud2
   {
     for (int c = 0; c < 2; c++)
     {
-      fixed_.starts.insert(fixed_.starts.end(), clouds[c]->starts.begin(), clouds[c]->starts.end());
-      fixed_.ends.insert(fixed_.ends.end(), clouds[c]->ends.begin(), clouds[c]->ends.end());
-      fixed_.times.insert(fixed_.times.end(), clouds[c]->times.begin(), clouds[c]->times.end());
-      fixed_.colours.insert(fixed_.colours.end(), clouds[c]->colours.begin(), clouds[c]->colours.end());
+      const Cloud &cloud = *clouds[c];
+      for (size_t i = 0; i < cloud.rayCount(); i++)
+      {
+        addResult(cloud.starts[i], cloud.ends[i], cloud.times[i], cloud.colours[i], false);
+      }
     }
-    return true;
+    return flushResults();
   }
   // otherwise we run combine on the altered clouds
-  // first, grid the rays for fast lookup
-  Grid<unsigned> grids[2];
+  std::vector<std::vector<Bool>> transients;
+  markTransientsBetween({ clouds[0], clouds[1] }, &transients, progress);
   for (int c = 0; c < 2; c++)
   {
-    grids[c].init(clouds[c]->calcMinBound(), clouds[c]->calcMaxBound(), voxelSizeForCloud(*clouds[c]));
-    fillRayGrid(&grids[c], *clouds[c], progress);
+    auto &cloud = *clouds[c];
+    size_t removed_count = 0;
+    for (size_t i = 0; i < transients[c].size(); i++)
+    {
+      if (!transients[c][i])
+      {
+        addResult(cloud.starts[i], cloud.ends[i], cloud.times[i], cloud.colours[i], false);
+      }
+      else
+      {
+        removed_count++;  // we aren't storing the differences. No current demand for this.
+      }
+    }
+    std::cout << removed_count << " removed rays, " << fixed_count_ << " fixed rays." << std::endl;
   }
 
-  std::vector<Bool> transients[2] = { std::vector<Bool>(clouds[0]->rayCount() MARKER_BOOL_INIT),
-                                      std::vector<Bool>(clouds[1]->rayCount() MARKER_BOOL_INIT) };
-  // now for each cloud, represent the end points as ellipsoids, and ray cast the other cloud's rays against it
-  for (int c = 0; c < 2; c++)
+  return flushResults();
+}
+
+void Merger::markTransientsBetween(const std::vector<const Cloud *> &clouds,
+                                   std::vector<std::vector<Bool>> *transient_ray_marks, Progress *progress,
+                                   Checkpoint *checkpoint)
+{
+  const size_t num_clouds = clouds.size();
+  transient_ray_marks->clear();
+  transient_ray_marks->reserve(num_clouds);
+  for (const auto &cloud : clouds)
   {
+    transient_ray_marks->emplace_back(std::vector<Bool>(cloud->rayCount() MARKER_BOOL_INIT));
+  }
+
+  // first, grid the rays for fast lookup
+  std::vector<PackedGrid<unsigned>> grids(num_clouds);
+  std::vector<double> voxel_sizes(num_clouds);
+  auto grid_cloud = [&](size_t c, Progress *cloud_progress) {
+    voxel_sizes[c] = voxelSizeForCloud(*clouds[c]);
+    grids[c].init(clouds[c]->calcMinBound(), clouds[c]->calcMaxBound(), voxel_sizes[c]);
+    fillRayGrid(&grids[c], *clouds[c], cloud_progress);
+  };
+  // represent each cloud's end points as ellipsoids, with opacities from its own rays
+  std::vector<std::vector<Ellipsoid>> ellipsoids(num_clouds);
+  auto generate_cloud_ellipsoids = [&](size_t c, Progress *cloud_progress) {
     if (clouds[c]->rayCount() == 0)
     {
-      continue;
+      return;
     }
-    generateEllipsoids(&ellipsoids_, nullptr, nullptr, *clouds[c]);
-
+    generateEllipsoids(&ellipsoids[c], nullptr, nullptr, *clouds[c], cloud_progress);
     // just set opacity
-    markIntersectedEllipsoids(*clouds[c], grids[c], &transients[c], 0, false, progress);
-
-    const int d = 1 - c;
-    const bool ellipsoid_cloud_first = c < d;  // used when argument order of the files is the merge type
-    // use ellipsoid opacity to set transient flag true on transients (intersected ellipsoids)
-    markIntersectedEllipsoids(*clouds[d], grids[d], &transients[d], config_.num_rays_filter_threshold, false, progress,
-                              ellipsoid_cloud_first);
-
-    for (size_t i = 0; i < ellipsoids_.size(); i++)
+    markIntersectedEllipsoids(&ellipsoids[c], *clouds[c], grids[c], &(*transient_ray_marks)[c], 0, false,
+                              cloud_progress);
+  };
+  // with a change voxel width, the clouds are first walked through a shared voxel grid, and only the ellipsoids near
+  // the voxels that are occupied in their own cloud and free in another are tested
+  std::unique_ptr<ChangeGrid> change_grid;
+  if (config_.change_voxel_width > 0.0 && num_clouds > 1)
+  {
+    Eigen::Vector3d min_bound = Eigen::Vector3d::Constant(std::numeric_limits<double>::max());
+    Eigen::Vector3d max_bound = Eigen::Vector3d::Constant(std::numeric_limits<double>::lowest());
+    for (const auto &cloud : clouds)
+    {
+      if (cloud->rayCount() > 0)
+      {
+        min_bound = minVector(min_bound, cloud->calcMinBound());
+        max_bound = maxVector(max_bound, cloud->calcMaxBound());
+      }
+    }
+    if ((min_bound.array() <= max_bound.array()).all())
     {
-      if (ellipsoids_[i].transient)
+      ChangeConfig change_config;
+      change_config.voxel_width = config_.change_voxel_width;
+      change_grid.reset(new ChangeGrid(Cuboid(min_bound, max_bound), static_cast<int>(num_clouds), change_config));
+      for (size_t c = 0; c < num_clouds; c++)
       {
-        transients[c][i] = true;
+        change_grid->addRays(static_cast<int>(c), clouds[c]->starts, clouds[c]->ends, clouds[c]->colours);
       }
     }
   }
-  for (int c = 0; c < 2; c++)
+  // ray cast the other clouds' rays against the ellipsoids of cloud c, which only changes cloud c's ellipsoids
+  // and the marks given
+  auto mark_cloud = [&](size_t c, std::vector<std::vector<Bool>> *marks, Progress *cloud_progress) {
+    if (clouds[c]->rayCount() == 0)
+    {
+      return;
+    }
+    // the ellipsoids that can be passed through by another cloud's rays, and their indices in cloud c
+    std::vector<Ellipsoid> *tested = &ellipsoids[c];
+    std::vector<Ellipsoid> changed_ellipsoids;
+    std::vector<size_t> changed_ids;
+    if (change_grid)
+    {
+      const Eigen::Vector3d margin = Eigen::Vector3d::Constant(change_grid->voxelWidth());
+      for (size_t i = 0; i < ellipsoids[c].size(); i++)
+      {
+        const Ellipsoid &ellipsoid = ellipsoids[c][i];
+        if (!ellipsoid.transient && ellipsoid.extents != Eigen::Vector3d::Zero() &&
+            change_grid->changedWithin(static_cast<int>(c), ellipsoid.pos - ellipsoid.extents - margin,
+                                       ellipsoid.pos + ellipsoid.extents + margin))
+        {
+          changed_ids.push_back(i);
+          changed_ellipsoids.push_back(ellipsoid);
+        }
+      }
+      Profile::count("ellipsoids in changed voxels", changed_ids.size());
+      tested = &changed_ellipsoids;
+    }
+    for (size_t d = 0; d < num_clouds; d++)
+    {
+      if (d == c)
+      {
+        continue;
+      }
+      const bool ellipsoid_cloud_first = c < d;  // used when argument order of the files is the merge type
+      // use ellipsoid opacity to set transient flag true on transients
+      markIntersectedEllipsoids(tested, *clouds[d], grids[d], &(*marks)[d], config_.num_rays_filter_threshold, false,
+                                cloud_progress, ellipsoid_cloud_first);
+    }
+    for (size_t j = 0; j < changed_ids.size(); j++)
+    {
+      ellipsoids[c][changed_ids[j]] = changed_ellipsoids[j];
+    }
+    for (size_t i = 0; i < ellipsoids[c].size(); i++)
+    {
+      if (ellipsoids[c][i].transient)
+      {
+        (*marks)[c][i] = true;
+      }
+    }
+    std::vector<Ellipsoid>().swap(ellipsoids[c]);
+  };
+
+  // a checkpoint holds, for each cloud whose ellipsoids have been tested, the marks that they gave, listed for each
+  // cloud d as the number of marked rays followed by their indices
+  auto cloud_phase = [](size_t c) { return "cloud " + std::to_string(c); };
+  auto cloud_done = [&](size_t c) { return checkpoint && checkpoint->completed(cloud_phase(c)); };
+  auto save_marks = [&](size_t c, const std::vector<std::vector<Bool>> &marks) {
+    if (!checkpoint || !checkpoint->isOpen())
+    {
+      return;
+    }
+    std::vector<uint64_t> record;
+    for (size_t d = 0; d < num_clouds; d++)
+    {
+      const size_t count_index = record.size();
+      record.push_back(0);
+      for (size_t i = 0; i < marks[d].size(); i++)
+      {
+        if (marks[d][i])
+        {
+          record.push_back(i);
+        }
+      }
+      record[count_index] = record.size() - count_index - 1;
+    }
+    checkpoint->save(cloud_phase(c), record);
+  };
+  if (checkpoint)
   {
-    auto &cloud = *clouds[c];
-    size_t removed_count = 0;
-    for (size_t i = 0; i < transients[c].size(); i++)
+    for (size_t c = 0; c < num_clouds; c++)
     {
-      if (!transients[c][i])
+      std::vector<uint64_t> record;
+      if (!checkpoint->load(cloud_phase(c), record))
       {
-        fixed_.addRay(cloud, i);
+        continue;
       }
-      else
+      size_t j = 0;
+      for (size_t d = 0; d < num_clouds && j < record.size(); d++)
       {
-        removed_count++;  // we aren't storing the differences. No current demand for this.
+        const size_t end = std::min(record.size(), j + 1 + static_cast<size_t>(record[j]));
+        for (j++; j < end; j++)
+        {
+          if (record[j] < (*transient_ray_marks)[d].size())
+          {
+            (*transient_ray_marks)[d][record[j]] = true;
+          }
+        }
       }
     }
-    std::cout << removed_count << " removed rays, " << fixed_.rayCount() << " fixed rays." << std::endl;
   }
 
-  return true;
+#if RAYLIB_WITH_TBB
+  // The per-cloud setup runs concurrently, as does the marking with each cloud's ellipsoids. Each marking task marks
+  // into its own vectors, which are combined as it finishes, so tasks do not contend on the shared marks
+  progress->begin("merge-prepare", num_clouds);
+  // the prepared marks of each cloud are kept apart until its own marking task saves them, with its marks
+  std::vector<std::vector<Bool>> prepare_marks(num_clouds);
+  tbb::parallel_for<size_t>(0u, num_clouds, [&](size_t c) {
+    Progress cloud_progress;
+    grid_cloud(c, &cloud_progress);
+    if (!cloud_done(c))
+    {
+      prepare_marks[c] = std::vector<Bool>(clouds[c]->rayCount() MARKER_BOOL_INIT);
+      std::swap(prepare_marks[c], (*transient_ray_marks)[c]);
+      generate_cloud_ellipsoids(c, &cloud_progress);
+      std::swap(prepare_marks[c], (*transient_ray_marks)[c]);
+    }
+    progress->increment();
+  });
+  progress->begin("merge-mark", num_clouds);
+  std::mutex marks_mutex;
+  tbb::parallel_for<size_t>(0u, num_clouds, [&](size_t c) {
+    if (cloud_done(c))
+    {
+      progress->increment();
+      return;
+    }
+    Progress cloud_progress;
+    std::vector<std::vector<Bool>> task_marks;
+    task_marks.reserve(num_clouds);
+    for (const auto &cloud : clouds)
+    {
+      task_marks.emplace_back(std::vector<Bool>(cloud->rayCount() MARKER_BOOL_INIT));
+    }
+    mark_cloud(c, &task_marks, &cloud_progress);
+    for (size_t i = 0; i < prepare_marks[c].size(); i++)
+    {
+      if (prepare_marks[c][i])
+      {
+        task_marks[c][i] = true;
+      }
+    }
+    std::vector<Bool>().swap(prepare_marks[c]);
+    save_marks(c, task_marks);
+    std::lock_guard<std::mutex> lock(marks_mutex);
+    for (size_t d = 0; d < num_clouds; d++)
+    {
+      for (size_t i = 0; i < task_marks[d].size(); i++)
+      {
+        if (task_marks[d][i])
+        {
+          (*transient_ray_marks)[d][i] = true;
+        }
+      }
+    }
+    progress->increment();
+  });
+#else   // RAYLIB_WITH_TBB
+  // one cloud's ellipsoids are held at a time
+  for (size_t c = 0; c < num_clouds; c++)
+  {
+    grid_cloud(c, progress);
+  }
+  for (size_t c = 0; c < num_clouds; c++)
+  {
+    if (cloud_done(c))
+    {
+      continue;
+    }
+    generate_cloud_ellipsoids(c, progress);
+    mark_cloud(c, transient_ray_marks, progress);
+    save_marks(c, *transient_ray_marks);  // all the marks so far, which include those of the earlier clouds
+  }
+#endif  // RAYLIB_WITH_TBB
+  if (config_.voxel_size == 0)
+  {
+    for (size_t c = 0; c < num_clouds; c++)
+    {
+      std::cout << "estimated required voxel size for cloud " << c << ": " << voxel_sizes[c] << std::endl;
+    }
+  }
 }
 
 void Merger::clear()
 {
   difference_.clear();
   fixed_.clear();
+  difference_count_ = fixed_count_ = 0;
+  write_failed_ = false;
   ellipsoids_.clear();
 }
 
-void Merger::fillRayGrid(Grid<unsigned> *grid, const Cloud &cloud, Progress *progress)
+void Merger::setOutput(CloudWriter *fixed_writer, CloudWriter *difference_writer)
 {
-  if (progress)
+  fixed_writer_ = fixed_writer;
+  difference_writer_ = difference_writer;
+}
+
+void Merger::addResult(const Eigen::Vector3d &start, const Eigen::Vector3d &end, double time, const RGBA &colour,
+                       bool transient)
+{
+  const size_t chunk_size = 1000000;
+  Cloud &results = transient ? difference_ : fixed_;
+  CloudWriter *writer = transient ? difference_writer_ : fixed_writer_;
+  results.addRay(start, end, time, colour);
+  (transient ? difference_count_ : fixed_count_)++;
+  if (writer && results.rayCount() >= chunk_size)
   {
-    progress->begin("fillRayGrid", cloud.rayCount());
+    write_failed_ = !writer->writeChunk(results) || write_failed_;
+    results.clear();
   }
+}
 
-  const auto add_ray = [grid, &cloud, progress](unsigned i)  //
+bool Merger::flushResults()
+{
+  if (difference_writer_ && difference_.rayCount() > 0)
   {
-    Eigen::Vector3d dir = cloud.ends[i] - cloud.starts[i];
-    Eigen::Vector3d dir_sign(sgn(dir[0]), sgn(dir[1]), sgn(dir[2]));
-    Eigen::Vector3d start = (cloud.starts[i] - grid->box_min) / grid->voxel_width;
-    Eigen::Vector3d end = (cloud.ends[i] - grid->box_min) / grid->voxel_width;
-    Eigen::Vector3i start_index((int)floor(start[0]), (int)floor(start[1]), (int)floor(start[2]));
-    Eigen::Vector3i end_index((int)floor(end[0]), (int)floor(end[1]), (int)floor(end[2]));
-    double length_sqr = (end_index - start_index).squaredNorm();
-    Eigen::Vector3i index = start_index;
-    for (;;)
-    {
-      grid->insert(index[0], index[1], index[2], i);
+    write_failed_ = !difference_writer_->writeChunk(difference_) || write_failed_;
+    difference_.clear();
+  }
+  if (fixed_writer_ && fixed_.rayCount() > 0)
+  {
+    write_failed_ = !fixed_writer_->writeChunk(fixed_) || write_failed_;
+    fixed_.clear();
+  }
+  return !write_failed_;
+}
 
-      if (index == end_index || (index - start_index).squaredNorm() > length_sqr)
-      {
-        break;
-      }
-      Eigen::Vector3d mid =
-        grid->box_min + grid->voxel_width * Eigen::Vector3d(index[0] + 0.5, index[1] + 0.5, index[2] + 0.5);
-      Eigen::Vector3d next_boundary = mid + 0.5 * grid->voxel_width * dir_sign;
-      Eigen::Vector3d delta = next_boundary - cloud.starts[i];
-      Eigen::Vector3d d(delta[0] / dir[0], delta[1] / dir[1], delta[2] / dir[2]);
-      if (d[0] < d[1] && d[0] < d[2])
-      {
-        index[0] += int(dir_sign[0]);
-      }
-      else if (d[1] < d[0] && d[1] < d[2])
-      {
-        index[1] += int(dir_sign[1]);
-      }
-      else
-      {
-        index[2] += int(dir_sign[2]);
-      }
-    }
+template <class CloudT>
+void Merger::fillRayGrid(PackedGrid<unsigned> *grid, const CloudT &cloud, Progress *progress)
+{
+  if (progress)
+  {
+    progress->begin("fillRayGrid", cloud.rayCount());
+  }
 
-    if (progress)
+  // each ray's voxels are gathered then inserted together, which is a single thread-local lookup in the grid. The
+  // progress is counted per range, so that the threads do not contend on it
+  const auto add_rays = [grid, &cloud, progress](unsigned begin, unsigned end) {
+    AllocationCategory category("ray grid");
+    std::vector<Eigen::Vector3i> voxels;
+    ProgressBatch batch(progress);
+    for (unsigned i = begin; i < end; i++)
     {
-      progress->increment();
+      voxels.clear();
+      gatherVoxels((cloud.rayStart(i) - grid->box_min) / grid->voxel_width,
+                   (cloud.rayEnd(i) - grid->box_min) / grid->voxel_width, voxels);
+      grid->insert(voxels, i);
+      batch.increment();
     }
   };
 
 #if RAYLIB_PARALLEL_GRID
-  tbb::parallel_for<unsigned>(0u, unsigned(cloud.rayCount()), add_ray);
+  tbb::parallel_for(tbb::blocked_range<unsigned>(0u, unsigned(cloud.rayCount())),
+                    [&add_rays](const tbb::blocked_range<unsigned> &range) { add_rays(range.begin(), range.end()); });
 #else   // RAYLIB_PARALLEL_GRID
-  for (unsigned i = 0; i < unsigned(cloud.rayCount()); i++)
+  add_rays(0u, unsigned(cloud.rayCount()));
+#endif  // RAYLIB_PARALLEL_GRID
   {
-    add_ray(i);
+    AllocationCategory category("ray grid");
+    grid->finalise();
   }
-#endif  // RAYLIB_PARALLEL_GRID
+  Profile::count("rays gridded", cloud.rayCount());
+  Profile::count("voxels occupied", grid->occupiedCount());
 }
 
-double Merger::voxelSizeForCloud(const Cloud &cloud) const
+template <class CloudT>
+double Merger::voxelSizeForCloud(const CloudT &cloud) const
 {
   double voxel_size = config_.voxel_size;
   if (voxel_size <= 0)
@@ -658,69 +1854,372 @@ double Merger::voxelSizeForCloud(const Cloud &cloud) const
   return voxel_size;
 }
 
-void Merger::markIntersectedEllipsoids(const Cloud &cloud, const Grid<unsigned> &ray_grid,
-                                       std::vector<Bool> *transient_ray_marks, double num_rays, bool self_transient,
-                                       Progress *progress, bool ellipsoid_cloud_first)
+namespace
+{
+/// A candidate ray of an ellipsoid, and the first voxel in (x, y, z) order where it meets the ellipsoid's voxels
+struct EllipsoidRayCandidate
+{
+  unsigned ellipsoid;
+  unsigned ray;
+  uint64_t voxel;
+};
+
+/// Find the rays of @c cloud to test against each of @c ellipsoids , as @c fillRayGrid and
+/// @c EllipsoidTransientMarker::mark would, but without a ray grid. The ellipsoids are inserted into a grid of the
+/// voxels that they overlap, then each ray is walked through it, adding the ray to the ellipsoids in its voxels. This
+/// holds the ellipsoid voxels and the candidate rays, rather than every voxel crossed by every ray.
+template <class CloudT>
+void fillEllipsoidRays(EllipsoidRays *ellipsoid_rays, const std::vector<Ellipsoid> &ellipsoids, const CloudT &cloud,
+                       const Eigen::Vector3d &bounds_min, const Eigen::Vector3d &bounds_max, double voxel_size,
+                       Progress *progress)
 {
-  progress->begin("transient-mark-ellipsoids", cloud.rayCount());
+  // 1. grid the ellipsoids that the ray grid would test, over the voxels of their bounds
+  PackedGrid<unsigned> grid(bounds_min, bounds_max, voxel_size);
+  ellipsoid_rays->gridded.assign(ellipsoids.size(), 0);
+  parallelFor(size_t(0), ellipsoids.size(), [&](size_t ellipsoid_id) {
+    const Ellipsoid &ellipsoid = ellipsoids[ellipsoid_id];
+    Eigen::Vector3i bmin, bmax;
+    if (ellipsoid.transient || ellipsoid.extents == Eigen::Vector3d::Zero() ||
+        !ellipsoidVoxels(ellipsoid, grid, &bmin, &bmax))
+    {
+      return;
+    }
+    ellipsoid_rays->gridded[ellipsoid_id] = 1;
+    std::vector<Eigen::Vector3i> voxels;
+    Eigen::Vector3i ind;
+    for (ind[0] = bmin[0]; ind[0] <= bmax[0]; ind[0]++)
+      for (ind[1] = bmin[1]; ind[1] <= bmax[1]; ind[1]++)
+        for (ind[2] = bmin[2]; ind[2] <= bmax[2]; ind[2]++) voxels.push_back(ind);
+    grid.insert(voxels, static_cast<unsigned>(ellipsoid_id));
+  });
+  grid.finalise();
+  Profile::count("ellipsoid voxels", grid.valueCount());
+
+  // 2. walk each ray through the grid. A ray is a candidate of each ellipsoid once, at the first of their shared
+  // voxels in (x, y, z) order, which is where the ray grid lookup finds it
+  if (progress)
+  {
+    progress->begin("fillEllipsoidRays", cloud.rayCount());
+  }
+  const uint64_t dims_y = static_cast<uint64_t>(grid.dims[1]), dims_z = static_cast<uint64_t>(grid.dims[2]);
+  const auto add_rays = [&grid, &cloud, progress, dims_y, dims_z](unsigned begin, unsigned end,
+                                                                   std::vector<EllipsoidRayCandidate> &candidates) {
+    std::vector<Eigen::Vector3i> voxels;
+    std::vector<EllipsoidRayCandidate> ray_candidates;
+    ProgressBatch batch(progress);
+    for (unsigned i = begin; i < end; i++)
+    {
+      voxels.clear();
+      ray_candidates.clear();
+      gatherVoxels((cloud.rayStart(i) - grid.box_min) / grid.voxel_width,
+                   (cloud.rayEnd(i) - grid.box_min) / grid.voxel_width, voxels);
+      for (const auto &voxel : voxels)
+      {
+        const auto ids = grid.cell(voxel[0], voxel[1], voxel[2]);
+        if (ids.empty())
+        {
+          continue;
+        }
+        const uint64_t key = (static_cast<uint64_t>(voxel[0]) * dims_y + static_cast<uint64_t>(voxel[1])) * dims_z +
+                             static_cast<uint64_t>(voxel[2]);
+        for (const auto &id : ids) ray_candidates.push_back(EllipsoidRayCandidate{ id, i, key });
+      }
+      std::sort(ray_candidates.begin(), ray_candidates.end(),
+                [](const EllipsoidRayCandidate &a, const EllipsoidRayCandidate &b) {
+                  return a.ellipsoid < b.ellipsoid || (a.ellipsoid == b.ellipsoid && a.voxel < b.voxel);
+                });
+      for (size_t j = 0; j < ray_candidates.size(); j++)
+      {
+        if (j == 0 || ray_candidates[j].ellipsoid != ray_candidates[j - 1].ellipsoid)
+        {
+          candidates.push_back(ray_candidates[j]);
+        }
+      }
+      batch.increment();
+    }
+  };
+  std::vector<std::vector<EllipsoidRayCandidate>> lists;
+#if RAYLIB_PARALLEL_GRID
+  tbb::enumerable_thread_specific<std::vector<EllipsoidRayCandidate>> local_candidates;
+  tbb::parallel_for(tbb::blocked_range<unsigned>(0u, unsigned(cloud.rayCount())),
+                    [&](const tbb::blocked_range<unsigned> &range) {
+                      add_rays(range.begin(), range.end(), local_candidates.local());
+                    });
+  for (auto &local : local_candidates) lists.emplace_back(std::move(local));
+#else   // RAYLIB_PARALLEL_GRID
+  lists.emplace_back();
+  add_rays(0u, unsigned(cloud.rayCount()), lists.back());
+#endif  // RAYLIB_PARALLEL_GRID
 
-  // Check each ellipsoid against the ray grid for intersections.
+  // 3. counting sort of the candidates by ellipsoid, then each ellipsoid's rays by first voxel and id
+  std::vector<size_t> &offsets = ellipsoid_rays->offsets;
+  offsets.assign(ellipsoids.size() + 1, 0);
+  for (const auto &list : lists)
+    for (const auto &candidate : list) offsets[candidate.ellipsoid + 1]++;
+  for (size_t e = 0; e < ellipsoids.size(); e++) offsets[e + 1] += offsets[e];
+  std::vector<EllipsoidRayCandidate> sorted(offsets.back());
+  {
+    std::vector<size_t> cursors(offsets.begin(), offsets.end() - 1);
+    for (auto &list : lists)
+    {
+      for (const auto &candidate : list) sorted[cursors[candidate.ellipsoid]++] = candidate;
+      std::vector<EllipsoidRayCandidate>().swap(list);
+    }
+  }
+  parallelFor(size_t(0), ellipsoids.size(), [&](size_t e) {
+    std::sort(sorted.begin() + offsets[e], sorted.begin() + offsets[e + 1],
+              [](const EllipsoidRayCandidate &a, const EllipsoidRayCandidate &b) {
+                return a.voxel < b.voxel || (a.voxel == b.voxel && a.ray < b.ray);
+              });
+  });
+  ellipsoid_rays->ray_ids.resize(sorted.size());
+  for (size_t i = 0; i < sorted.size(); i++) ellipsoid_rays->ray_ids[i] = sorted[i].ray;
+  Profile::count("ellipsoid ray candidates", sorted.size());
+}
+
+/// Whether the ellipsoid grid should hold fewer values than the ray grid, which holds every voxel crossed by every
+/// ray, so grows with the ray lengths. The ellipsoid grid holds the voxels of each ellipsoid's bounds, and then the
+/// candidate rays of each ellipsoid, which are estimated as @c kCandidatesPerVoxel per ellipsoid voxel.
+template <class CloudT>
+bool preferEllipsoidGrid(const std::vector<Ellipsoid> &ellipsoids, const CloudT &cloud, double voxel_size)
+{
+  const double kCandidatesPerVoxel = 16.0;
+  const auto add = [](double a, double b) { return a + b; };
+  // the walk crosses one voxel more than the number of voxel boundaries on each axis
+  const double ray_voxels = parallelReduce(
+    size_t(0), cloud.rayCount(), 0.0,
+    [&](size_t i, double &sum) {
+      sum += 1.0 + ((cloud.rayEnd(i) - cloud.rayStart(i)).cwiseAbs() / voxel_size).sum();
+    },
+    add);
+  const double ellipsoid_voxels = parallelReduce(
+    size_t(0), ellipsoids.size(), 0.0,
+    [&](size_t i, double &sum) {
+      const Ellipsoid &ellipsoid = ellipsoids[i];
+      if (!ellipsoid.transient && ellipsoid.extents != Eigen::Vector3d::Zero())
+      {
+        sum += (2.0 * ellipsoid.extents / voxel_size + Eigen::Vector3d::Ones()).prod();
+      }
+    },
+    add);
+  return ellipsoid_voxels * kCandidatesPerVoxel < ray_voxels;
+}
+
+/// Mark each of @c ellipsoids against @c cloud , as @c Merger::markIntersectedEllipsoids , for merge settings that are
+/// known at compile time
+template <MergeType kMergeType, bool kSelfTransient, bool kEllipsoidCloudFirst, class CloudT, class RaySource>
+void markEllipsoids(std::vector<Ellipsoid> *ellipsoids, const CloudT &cloud, const RaySource &rays,
+                    std::vector<Merger::Bool> *transient_ray_marks, double num_rays, Progress *progress)
+{
 #if RAYLIB_WITH_TBB
   // Declare thread local for ellipsoid marking
   using ThreadLocalRayMarkers = tbb::enumerable_thread_specific<EllipsoidTransientMarker>;
   ThreadLocalRayMarkers thread_markers(EllipsoidTransientMarker(cloud.rayCount()));
 
-  auto tbb_process_ellipsoid = [this, &cloud, &ray_grid, transient_ray_marks, &num_rays, &thread_markers,
-                                ellipsoid_cloud_first, progress, self_transient](size_t ellipsoid_id)  //
+  auto tbb_process_ellipsoid = [ellipsoids, &cloud, &rays, transient_ray_marks, &num_rays,
+                                &thread_markers](size_t ellipsoid_id)  //
   {
     // Resolve the ray marker for this thread.
     EllipsoidTransientMarker &marker = thread_markers.local();
-    marker.mark(&ellipsoids_[ellipsoid_id], transient_ray_marks, cloud, ray_grid, num_rays, config_.merge_type,
-                self_transient, ellipsoid_cloud_first);
-    progress->increment();
+    marker.mark<kMergeType, kSelfTransient, kEllipsoidCloudFirst>(&(*ellipsoids)[ellipsoid_id], transient_ray_marks,
+                                                                  cloud, raysOf(rays, ellipsoid_id), num_rays);
   };
-  tbb::parallel_for<size_t>(0u, cloud.rayCount(), tbb_process_ellipsoid);
+  // the progress is counted per range of ellipsoids, so that the threads do not contend on it
+  parallelFor(size_t(0), ellipsoids->size(), tbb_process_ellipsoid, progress);
 #else   // RAYLIB_WITH_TBB
-  std::vector<bool> ray_tested;
-  ray_tested.resize(cloud.rayCount(), false);
   EllipsoidTransientMarker ellipsoid_maker(cloud.rayCount());
-  for (size_t i = 0; i < ellipsoids_.size(); ++i)
+  for (size_t i = 0; i < ellipsoids->size(); ++i)
   {
-    ellipsoid_maker.mark(&ellipsoids_[i], transient_ray_marks, cloud, ray_grid, num_rays, config_.merge_type,
-                         self_transient, ellipsoid_cloud_first);
+    ellipsoid_maker.mark<kMergeType, kSelfTransient, kEllipsoidCloudFirst>(&(*ellipsoids)[i], transient_ray_marks,
+                                                                           cloud, raysOf(rays, i), num_rays);
     progress->increment();
   }
 #endif  // RAYLIB_WITH_TBB
 }
 
+/// Dispatch @c markEllipsoids for the run time flags. The order of the clouds only matters to @c MergeType::Order
+template <MergeType kMergeType, class CloudT, class RaySource>
+void markEllipsoids(std::vector<Ellipsoid> *ellipsoids, const CloudT &cloud, const RaySource &rays,
+                    std::vector<Merger::Bool> *transient_ray_marks, double num_rays, bool self_transient,
+                    bool ellipsoid_cloud_first, Progress *progress)
+{
+  const bool cloud_first = kMergeType == MergeType::Order && ellipsoid_cloud_first;
+  const bool is_order = kMergeType == MergeType::Order;
+  if (self_transient && cloud_first)
+    markEllipsoids<kMergeType, true, is_order>(ellipsoids, cloud, rays, transient_ray_marks, num_rays, progress);
+  else if (self_transient)
+    markEllipsoids<kMergeType, true, false>(ellipsoids, cloud, rays, transient_ray_marks, num_rays, progress);
+  else if (cloud_first)
+    markEllipsoids<kMergeType, false, is_order>(ellipsoids, cloud, rays, transient_ray_marks, num_rays, progress);
+  else
+    markEllipsoids<kMergeType, false, false>(ellipsoids, cloud, rays, transient_ray_marks, num_rays, progress);
+}
+}  // namespace
+
+template <class CloudT>
+void Merger::markTransients(std::vector<Ellipsoid> *ellipsoids, const CloudT &cloud, const Eigen::Vector3d &bounds_min,
+                            const Eigen::Vector3d &bounds_max, double voxel_size,
+                            std::vector<Bool> *transient_ray_marks, double num_rays, bool self_transient,
+                            Progress *progress, bool ellipsoid_cloud_first)
+{
+  const bool ellipsoid_grid =
+    config_.grid == MergeGrid::Ellipsoids ||
+    (config_.grid == MergeGrid::Auto && preferEllipsoidGrid(*ellipsoids, cloud, voxel_size));
+  if (ellipsoid_grid)
+  {
+    EllipsoidRays ellipsoid_rays;
+    fillEllipsoidRays(&ellipsoid_rays, *ellipsoids, cloud, bounds_min, bounds_max, voxel_size, progress);
+    markIntersectedEllipsoids(ellipsoids, cloud, ellipsoid_rays, transient_ray_marks, num_rays, self_transient,
+                              progress, ellipsoid_cloud_first);
+  }
+  else
+  {
+    PackedGrid<unsigned> ray_grid(bounds_min, bounds_max, voxel_size);
+    fillRayGrid(&ray_grid, cloud, progress);
+    markIntersectedEllipsoids(ellipsoids, cloud, ray_grid, transient_ray_marks, num_rays, self_transient, progress,
+                              ellipsoid_cloud_first);
+  }
+}
 
-void Merger::finaliseFilter(const Cloud &cloud, const std::vector<Bool> &transient_ray_marks)
+template <class CloudT, class RaySource>
+void Merger::markIntersectedEllipsoids(std::vector<Ellipsoid> *ellipsoids, const CloudT &cloud,
+                                       const RaySource &rays, std::vector<Bool> *transient_ray_marks,
+                                       double num_rays, bool self_transient, Progress *progress,
+                                       bool ellipsoid_cloud_first)
+{
+  progress->begin("transient-mark-ellipsoids", ellipsoids->size());
+
+  // Check each ellipsoid against its rays for intersections. The merge settings are dispatched once here, to
+  // markers that are compiled for each of them.
+  switch (config_.merge_type)
+  {
+  case MergeType::Oldest:
+    markEllipsoids<MergeType::Oldest>(ellipsoids, cloud, rays, transient_ray_marks, num_rays, self_transient,
+                                      ellipsoid_cloud_first, progress);
+    break;
+  case MergeType::Newest:
+    markEllipsoids<MergeType::Newest>(ellipsoids, cloud, rays, transient_ray_marks, num_rays, self_transient,
+                                      ellipsoid_cloud_first, progress);
+    break;
+  case MergeType::Mininum:
+    markEllipsoids<MergeType::Mininum>(ellipsoids, cloud, rays, transient_ray_marks, num_rays, self_transient,
+                                       ellipsoid_cloud_first, progress);
+    break;
+  case MergeType::Maximum:
+    markEllipsoids<MergeType::Maximum>(ellipsoids, cloud, rays, transient_ray_marks, num_rays, self_transient,
+                                       ellipsoid_cloud_first, progress);
+    break;
+  case MergeType::Order:
+    markEllipsoids<MergeType::Order>(ellipsoids, cloud, rays, transient_ray_marks, num_rays, self_transient,
+                                     ellipsoid_cloud_first, progress);
+    break;
+  case MergeType::All:
+    markEllipsoids<MergeType::All>(ellipsoids, cloud, rays, transient_ray_marks, num_rays, self_transient,
+                                   ellipsoid_cloud_first, progress);
+    break;
+  }
+  Profile::count("ellipsoids marked", ellipsoids->size());
+}
+
+
+template <class CloudT>
+void Merger::finaliseFilter(const CloudT &cloud, const std::vector<Bool> &transient_ray_marks)
 {
   // Lastly, generate the new ray clouds from this sphere information
   for (size_t i = 0; i < ellipsoids_.size(); i++)
   {
-    RGBA col = cloud.colours[i];
-    if (config_.colour_cloud)
+    const RGBA col = filteredColour(cloud.rayColour(i), ellipsoids_[i], config_.colour_cloud);
+    addResult(cloud.rayStart(i), cloud.rayEnd(i), cloud.rayTime(i), col,
+              ellipsoids_[i].transient || transient_ray_marks[i]);
+  }
+}
+
+template bool Merger::filter<Cloud>(const Cloud &, Progress *);
+template bool Merger::filter<CompactCloud>(const CompactCloud &, Progress *);
+template void Merger::fillRayGrid<Cloud>(PackedGrid<unsigned> *, const Cloud &, Progress *);
+template void Merger::fillRayGrid<CompactCloud>(PackedGrid<unsigned> *, const CompactCloud &, Progress *);
+
+bool concatenateClouds(const std::vector<std::string> &file_names, const std::string &output_file, bool time_ordered)
+{
+  CloudWriter writer;
+  if (!writer.begin(output_file))
+    return false;
+  bool succeeded = true;
+  if (!time_ordered)
+  {
+    for (const auto &file_name : file_names)
     {
-      col.red = (uint8_t)((1.0 - ellipsoids_[i].planarity) * 255.0);
-      col.blue = (uint8_t)(ellipsoids_[i].opacity * 255.0);
-      col.green = (uint8_t)((double)ellipsoids_[i].num_gone / ((double)ellipsoids_[i].num_gone + 10.0) * 255.0);
+      auto write_chunk = [&writer, &succeeded](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                                               std::vector<double> &times, std::vector<RGBA> &colours) {
+        succeeded = writer.writeChunk(starts, ends, times, colours) && succeeded;
+      };
+      if (!Cloud::read(file_name, write_chunk))
+      {
+        succeeded = false;
+        break;
+      }
     }
+    writer.end();
+    return succeeded;
+  }
 
-    if (ellipsoids_[i].transient || transient_ray_marks[i])
+  // k-way merge. The heap holds the time of the next ray of each file that has rays left
+  const size_t chunk_size = 1000000;
+  std::vector<std::unique_ptr<ChunkStream>> streams(file_names.size());
+  std::vector<Cloud> chunks(file_names.size());
+  std::vector<size_t> next_ray(file_names.size(), 0);
+  std::vector<double> last_time(file_names.size(), std::numeric_limits<double>::lowest());
+  std::vector<bool> warned(file_names.size(), false);
+  for (size_t i = 0; i < file_names.size(); i++) streams[i].reset(new ChunkStream(file_names[i]));
+  auto has_rays = [&](size_t i) {
+    while (next_ray[i] >= chunks[i].times.size())
     {
-      difference_.starts.emplace_back(cloud.starts[i]);
-      difference_.ends.emplace_back(cloud.ends[i]);
-      difference_.times.emplace_back(cloud.times[i]);
-      difference_.colours.emplace_back(col);
+      next_ray[i] = 0;
+      if (!streams[i]->next(chunks[i]))
+        return false;
     }
-    else
+    return true;
+  };
+  using HeapEntry = std::pair<double, size_t>;
+  std::priority_queue<HeapEntry, std::vector<HeapEntry>, std::greater<HeapEntry>> heap;
+  for (size_t i = 0; i < file_names.size(); i++)
+  {
+    if (has_rays(i))
+      heap.push(HeapEntry(chunks[i].times[0], i));
+  }
+  Cloud merged;
+  while (!heap.empty())
+  {
+    const size_t i = heap.top().second;
+    heap.pop();
+    // copy the run of rays up to the next ray of the other files together, rather than one at a time through the heap
+    const double limit = heap.empty() ? std::numeric_limits<double>::max() : heap.top().first;
+    const Cloud &chunk = chunks[i];
+    const size_t first = next_ray[i];
+    size_t last = first;
+    do
+    {
+      if (chunk.times[last] < last_time[i] && !warned[i])
+      {
+        std::cerr << "Warning: " << file_names[i] << " is not in time order, so the combined cloud is not either"
+                  << std::endl;
+        warned[i] = true;
+      }
+      last_time[i] = chunk.times[last++];
+    } while (last < chunk.times.size() && chunk.times[last] <= limit);
+    appendRays(chunk, first, last, merged);
+    next_ray[i] = last;
+    if (merged.times.size() >= chunk_size)
     {
-      fixed_.starts.emplace_back(cloud.starts[i]);
-      fixed_.ends.emplace_back(cloud.ends[i]);
-      fixed_.times.emplace_back(cloud.times[i]);
-      fixed_.colours.emplace_back(col);
+      succeeded = writer.writeChunk(merged) && succeeded;
+      merged.clear();
     }
+    if (has_rays(i))
+      heap.push(HeapEntry(chunks[i].times[next_ray[i]], i));
   }
+  succeeded = writer.writeChunk(merged) && succeeded;
+  for (const auto &stream : streams) succeeded = succeeded && stream->succeeded();
+  writer.end();
+  return succeeded;
 }
 }  // namespace ray
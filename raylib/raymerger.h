@@ -17,7 +17,9 @@
 
 namespace ray
 {
+class Checkpoint;
 class Cloud;
+class CloudWriter;
 class Progress;
 
 /// Mode selection for @c Merger
@@ -33,13 +35,31 @@ enum class RAYLIB_EXPORT MergeType : int
   All
 };
 
+/// How @c Merger finds the rays near each ellipsoid. Both find the same transients
+enum class RAYLIB_EXPORT MergeGrid : int
+{
+  /// Choose the grid that holds fewer values, from the ray lengths and the ellipsoid sizes.
+  Auto,
+  /// Insert every ray into every voxel it crosses, then look up the rays in each ellipsoid's voxels. Memory grows with
+  /// the total ray length.
+  Rays,
+  /// Insert each ellipsoid into the voxels it overlaps, then walk the rays through them. Memory grows with the number
+  /// of ellipsoids and their candidate rays, so suits long range rays.
+  Ellipsoids
+};
+
 /// Parameter configuration structure for @c Merger
 struct RAYLIB_EXPORT MergerConfig
 {
   double voxel_size = 0;  ///< Ray grid voxel size. Use zero use an estimated voxel size.
   double num_rays_filter_threshold = 20;
   MergeType merge_type = MergeType::Mininum;
+  MergeGrid grid = MergeGrid::Auto;
   bool colour_cloud = true;
+  /// With a positive width, @c mergeMultiple and @c mergeThreeWay first find the voxels of this width that are occupied
+  /// in one cloud and free in another, with a @c ChangeGrid , and only test the ellipsoids near them. Zero tests every
+  /// ellipsoid.
+  double change_voxel_width = 0;
 };
 
 /// A cloud merger which supports filtering 'transient' rays and merging from a ray clouds. A transient ray is one which
@@ -63,13 +83,64 @@ public:
   inline const Cloud &differenceCloud() const { return difference_; }
   /// Query the preserved ray results. Empty before @c filter() is called.
   inline const Cloud &fixedCloud() const { return fixed_; }
-
-  /// Perform the transient filtering on the given @p cloud .
-  bool filter(const Cloud &cloud, Progress *progress = nullptr);
+  /// The number of removed rays in the results, including those already written to the difference writer
+  inline size_t differenceRayCount() const { return difference_count_; }
+  /// The number of preserved rays in the results, including those already written to the fixed writer
+  inline size_t fixedRayCount() const { return fixed_count_; }
+
+  /// Write the results of the following @c filter , @c mergeMultiple , @c mergeIncremental and @c mergeThreeWay calls
+  /// to @c fixed_writer and @c difference_writer a chunk at a time as they are found, rather than holding them in
+  /// @c fixedCloud() and @c differenceCloud() , which then stay empty. This avoids a second copy of the rays in memory.
+  /// The writers are begun and ended by the caller. A null writer keeps that result in memory.
+  void setOutput(CloudWriter *fixed_writer, CloudWriter *difference_writer);
+
+  /// Keep a @c Checkpoint of the following @c filterTiled and @c mergeMultiple calls in @c file_name , so that a call
+  /// that is interrupted can be made again and resume where it stopped: from the tiles already filtered, or the clouds
+  /// whose ellipsoids have already been tested. An empty name, the default, keeps no checkpoint. The file is removed
+  /// when the call succeeds.
+  void setCheckpoint(const std::string &file_name) { checkpoint_file_ = file_name; }
+
+  /// Perform the transient filtering on the given @p cloud . Instantiated for @c Cloud and @c CompactCloud
+  template <class CloudT>
+  bool filter(const CloudT &cloud, Progress *progress = nullptr);
+
+  /// Out-of-core form of @c filter , for ray cloud files too large to hold in memory. The file is split into tiles
+  /// of @c tile_width square in x and y, which are filtered one at a time. Each tile holds every ray that passes
+  /// within @c overlap of it, so @c overlap should exceed the size of the largest ellipsoid. Zero uses four ray grid
+  /// voxel widths. Each ray's ellipsoid is tested in the tile that contains the ray's end point, and a ray removed in
+  /// any tile is removed. The results are written to @c transient_file and @c fixed_file in the order of the input
+  /// file, not to @c differenceCloud() and @c fixedCloud() . Temporary tile files are written next to the input.
+  /// Peak memory is that of the largest tile, plus one bit per ray.
+  bool filterTiled(const std::string &file_name, const std::string &transient_file, const std::string &fixed_file,
+                   double tile_width, double overlap = 0.0, Progress *progress = nullptr);
+
+  /// Streaming form of @c filter , for long continuous runs whose rays are in time order in @c file_name . The run is
+  /// filtered in consecutive time windows of @c window seconds, each holding the rays within @c margin seconds of it,
+  /// so @c margin should exceed the time over which the sensor sees the same geometry. Zero uses the window length.
+  /// Each ray's ellipsoid is tested in the window that contains the ray's time, and a ray removed in any window is
+  /// removed. Rays are written to @c transient_file and @c fixed_file in the input order as soon as no later window
+  /// can reach them, so peak memory is that of a window and its margins, rather than of the whole run. Transients
+  /// between visits of the same place more than a margin apart are not found. Returns false if the file is not in
+  /// time order, or could not be read or written.
+  bool filterWindowed(const std::string &file_name, const std::string &transient_file, const std::string &fixed_file,
+                      double window, double margin = 0.0, Progress *progress = nullptr);
 
   /// Multi-merge
   bool mergeMultiple(std::vector<Cloud> &clouds, Progress *progress = nullptr);
 
+  /// Incremental form of @c mergeMultiple , for adding a @c new_cloud to a merged map that is kept on disk. The map
+  /// ray cloud @c map_file has a sidecar @c state_file holding the ellipsoid of each of its rays, as left by the
+  /// previous merge. Only the stored ellipsoids that overlap @c new_cloud are tested against its rays, and only the map
+  /// rays that pass through the ellipsoids of @c new_cloud are tested against them, so the filtering cost depends on
+  /// the size of @c new_cloud rather than that of the map. The map is streamed, not loaded. @c new_cloud is treated as
+  /// the later cloud for the @c Order merge type.
+  /// The merged map and its state are written to @c output_file and @c output_state_file , which must differ from
+  /// the inputs, and the removed rays to @c differenceCloud() . If @c map_file does not exist then the map is
+  /// @c new_cloud alone. If @c state_file does not exist then it is first built from the whole map.
+  bool mergeIncremental(const std::string &map_file, const std::string &state_file, const Cloud &new_cloud,
+                        const std::string &output_file, const std::string &output_state_file,
+                        Progress *progress = nullptr);
+
   /// Three way merger
   bool mergeThreeWay(const Cloud &base_cloud, Cloud &cloud1, Cloud &cloud2, Progress *progress = nullptr);
 
@@ -79,33 +150,71 @@ public:
   /// Fill a @p grid with with rays from @p cloud . For each ray we add its index to each grid cell it traces through.
   ///
   /// The grid bounds must be set sufficiently large to hold the rays before calling. The grid resolution is also set
-  /// before calling
+  /// before calling. The grid is finalised on return, ready for reading.
   ///
   /// @param grid The grid to populate
   /// @param cloud The cloud which grid indices reference rays in.
   /// @param progress Optional progress tracker.
   /// @todo This needs a more global home
-  static void fillRayGrid(Grid<unsigned> *grid, const Cloud &cloud, Progress *progress = nullptr);
+  template <class CloudT>
+  static void fillRayGrid(PackedGrid<unsigned> *grid, const CloudT &cloud, Progress *progress = nullptr);
 
 private:
-  double voxelSizeForCloud(const Cloud &cloud) const;
+  template <class CloudT>
+  double voxelSizeForCloud(const CloudT &cloud) const;
 
-  /// For all ellipsoids_ intersect with rays in @c cloud (accelerated using @c ray_grid)
+  /// For all @c ellipsoids intersect with rays in @c cloud (accelerated using @c rays , a ray grid from
+  /// @c fillRayGrid or the rays of each ellipsoid found through an ellipsoid grid)
   /// depending on config.merge_type, either mark the ellipsoid object as removed, or
   /// mark the ray (through @c transient_ray_marks) as removed.
   /// @c ellipsoid_cloud_first is used only for the 'order' merge type, to choose which to mark
-  void markIntersectedEllipsoids(const Cloud &cloud, const Grid<unsigned> &ray_grid,
+  template <class CloudT, class RaySource>
+  void markIntersectedEllipsoids(std::vector<Ellipsoid> *ellipsoids, const CloudT &cloud, const RaySource &rays,
                                  std::vector<Bool> *transient_ray_marks, double num_rays, bool self_transient,
                                  Progress *progress, bool ellipsoid_cloud_first = false);
 
-  /// Finalise the cloud filter and populate @c transientResults() and @c fixedResults() .
-  void finaliseFilter(const Cloud &cloud, const std::vector<Bool> &transient_ray_marks);
+  /// As @c markIntersectedEllipsoids , using the grid chosen by @c config_.grid , of @c voxel_size voxels from
+  /// @c bounds_min to @c bounds_max
+  template <class CloudT>
+  void markTransients(std::vector<Ellipsoid> *ellipsoids, const CloudT &cloud, const Eigen::Vector3d &bounds_min,
+                      const Eigen::Vector3d &bounds_max, double voxel_size, std::vector<Bool> *transient_ray_marks,
+                      double num_rays, bool self_transient, Progress *progress, bool ellipsoid_cloud_first = false);
+
+  /// Mark the transient rays of each of @c clouds in @c transient_ray_marks , by testing the ellipsoids of each cloud
+  /// against the rays of the others. This is the shared core of @c mergeMultiple and @c mergeThreeWay . With a
+  /// @c checkpoint , the marks found with each cloud's ellipsoids are saved, and the clouds already done are skipped.
+  void markTransientsBetween(const std::vector<const Cloud *> &clouds,
+                             std::vector<std::vector<Bool>> *transient_ray_marks, Progress *progress,
+                             Checkpoint *checkpoint = nullptr);
+
+  /// Finalise the cloud filter and add each ray to the results, through @c addResult .
+  template <class CloudT>
+  void finaliseFilter(const CloudT &cloud, const std::vector<Bool> &transient_ray_marks);
+
+  /// Add a ray to the removed (@c transient ) or preserved results, writing a chunk of them if there is a writer
+  void addResult(const Eigen::Vector3d &start, const Eigen::Vector3d &end, double time, const RGBA &colour,
+                 bool transient);
+  /// Write the remaining results to the writers, returning false if any writes failed
+  bool flushResults();
 
   Cloud difference_;
   Cloud fixed_;
+  CloudWriter *difference_writer_ = nullptr;
+  CloudWriter *fixed_writer_ = nullptr;
+  size_t difference_count_ = 0;
+  size_t fixed_count_ = 0;
+  bool write_failed_ = false;
   MergerConfig config_;
   std::vector<Ellipsoid> ellipsoids_;
+  std::string checkpoint_file_;
 };
+
+/// Streaming form of @c MergeType::All , which writes all the rays of the ray clouds @c file_names to @c output_file
+/// without loading them. The rays are written file by file, or with @c time_ordered , as a k-way merge by ray time of
+/// the files, which must each be in time order. Each file is read on its own thread, a chunk at a time, so memory
+/// depends on the number of files but not their size. Returns false if a file could not be read or written.
+bool RAYLIB_EXPORT concatenateClouds(const std::vector<std::string> &file_names, const std::string &output_file,
+                                     bool time_ordered = false);
 }  // namespace ray
 
 #endif  // RAYMERGER_H
@@ -5,12 +5,21 @@
 // Author: Thomas Lowe
 #include "raymesh.h"
 
+#include "raycompactcloud.h"
 #include "raylaz.h"
 #include "rayply.h"
+#include "rayprofile.h"
+#include "raythreads.h"
 #include "rayunused.h"
 
+#include <cstring>
+#include <memory>
 #include <set>
 
+#if RAYLIB_WITH_TBB
+#include <tbb/parallel_for.h>
+#endif  // RAYLIB_WITH_TBB
+
 namespace ray
 {
 class Triangle
@@ -18,8 +27,7 @@ class Triangle
 public:
   Eigen::Vector3d corners[3];
   Eigen::Vector3d normal;
-  bool tested;
-  bool intersectsRay(const Eigen::Vector3d &ray_start, const Eigen::Vector3d &ray_end, double &depth)
+  bool intersectsRay(const Eigen::Vector3d &ray_start, const Eigen::Vector3d &ray_end, double &depth) const
   {
     // 1. plane test:
     double d1 = (ray_start - corners[0]).dot(normal);
@@ -39,7 +47,7 @@ public:
     }
     return true;
   }
-  double distSqrToPoint(const Eigen::Vector3d &point)
+  double distSqrToPoint(const Eigen::Vector3d &point) const
   {
     Eigen::Vector3d pos = point - normal * (point - corners[0]).dot(normal);
     bool outs[3];
@@ -74,105 +82,266 @@ public:
   }
 };
 
-// remove additional points that are not connected to the mesh
+// weld the vertices at the same position, and remove additional points that are not connected to the mesh
 void Mesh::reduce()
 {
-  std::vector<Eigen::Vector3d> verts;
-  std::vector<int> new_ids(vertices_.size(), -1);
-  // we do this by iterating the index list, and only adding the vertices that are in these triangles
-  for (auto &ind : index_list_)
+  ProfileScope profile("Mesh::reduce");
+  profile.count(vertices_.size());
+  const int num_vertices = static_cast<int>(vertices_.size());
+  std::vector<uint8_t> used(num_vertices, 0);
+  for (const auto &ind : index_list_) used[ind[0]] = used[ind[1]] = used[ind[2]] = 1;
+
+  // the used vertices are bucketed by a hash of their position, so that the buckets can be welded in parallel
+  const int num_buckets = std::max(1, std::min(num_vertices / 16, 64 * Threads::threadCount()));
+  auto position_hash = [](const Eigen::Vector3d &pos) {
+    uint64_t hash = 0;
+    for (int i = 0; i < 3; i++)
+    {
+      const double coord = pos[i] + 0.0;  // so that -0 hashes as 0, to which it is equal
+      uint64_t bits;
+      std::memcpy(&bits, &coord, sizeof(bits));
+      hash = (hash ^ bits) * 0x100000001b3ull;
+    }
+    return hash ^ (hash >> 29);
+  };
+  std::vector<int> representative(num_vertices, -1);  // the lowest index vertex at the same position
+  std::vector<int> bucket_of(num_vertices, -1);
+  parallelFor(0, num_vertices, [&](int v) {
+    if (!used[v])
+      return;
+    const Eigen::Vector3d &pos = vertices_[v];
+    if (pos == pos)
+      bucket_of[v] = static_cast<int>(position_hash(pos) % static_cast<uint64_t>(num_buckets));
+    else
+      representative[v] = v;  // NaN vertices are never welded
+  });
+  std::vector<int> first(num_buckets + 1, 0);
+  for (int v = 0; v < num_vertices; v++)
+  {
+    if (bucket_of[v] != -1)
+      first[bucket_of[v] + 1]++;
+  }
+  for (int b = 0; b < num_buckets; b++) first[b + 1] += first[b];
+  std::vector<int> members(first[num_buckets]);
   {
+    std::vector<int> next(first.begin(), first.end() - 1);
+    for (int v = 0; v < num_vertices; v++)
+    {
+      if (bucket_of[v] != -1)
+        members[next[bucket_of[v]]++] = v;
+    }
+  }
+  auto position_less = [&](int a, int b) {
+    const Eigen::Vector3d &p = vertices_[a], &q = vertices_[b];
     for (int i = 0; i < 3; i++)
     {
-      if (new_ids[ind[i]] == -1)
-      {
-        new_ids[ind[i]] = (int)verts.size();
-        verts.push_back(vertices_[ind[i]]);
-      }
-      ind[i] = new_ids[ind[i]];
+      if (p[i] != q[i])
+        return p[i] < q[i];
+    }
+    return a < b;
+  };
+  parallelFor(0, num_buckets, [&](int b) {
+    int *begin = members.data() + first[b];
+    int *end = members.data() + first[b + 1];
+    std::sort(begin, end, position_less);
+    for (int *m = begin; m < end; m++)
+    {
+      representative[*m] = m != begin && vertices_[*m] == vertices_[*(m - 1)] ? representative[*(m - 1)] : *m;
+    }
+  });
+
+  // the kept vertices are numbered in the order that the triangles first use them
+  std::vector<int> new_ids(num_vertices, -1);
+  int num_kept = 0;
+  for (const auto &ind : index_list_)
+  {
+    for (int i = 0; i < 3; i++)
+    {
+      int &id = new_ids[representative[ind[i]]];
+      if (id == -1)
+        id = num_kept++;
     }
   }
-  vertices_ = verts;
+  const bool has_colours = colours_.size() == vertices_.size() && !colours_.empty();
+  std::vector<Eigen::Vector3d> verts(num_kept);
+  std::vector<RGBA> colours(has_colours ? num_kept : 0);
+  parallelFor(0, num_vertices, [&](int v) {
+    if (representative[v] != v)
+      return;
+    verts[new_ids[v]] = vertices_[v];
+    if (has_colours)
+      colours[new_ids[v]] = colours_[v];
+  });
+  parallelFor(0, static_cast<int>(index_list_.size()), [&](int t) {
+    for (int i = 0; i < 3; i++) index_list_[t][i] = new_ids[representative[index_list_[t][i]]];
+  });
+  vertices_ = std::move(verts);
+  if (has_colours)
+    colours_ = std::move(colours);
 }
 
 // convert the mesh to a height field
 void Mesh::toHeightField(Eigen::ArrayXXd &field, const Eigen::Vector3d &box_min, Eigen::Vector3d box_max,
                          double width) const
 {
+  ProfileScope profile("Mesh::toHeightField");
+  profile.count(index_list_.size());
   double top = box_max[2];
   box_max[2] = box_min[2] + 0.5 * width;  // ensure that the grid is only 1 voxel high
-  // first convert the mesh to a list of triangles, with calculated normals
+  const Eigen::Vector3d diff = (box_max - box_min) / width;
+  const Eigen::Vector2i dims(static_cast<int>(std::ceil(diff[0])), static_cast<int>(std::ceil(diff[1])));
+  // first convert the mesh to a list of triangles, with calculated normals, and the pixels that they span
+  const double pixel_margin = 1e-4;
   std::vector<Triangle> triangles(index_list_.size());
-  for (int i = 0; i < (int)index_list_.size(); i++)
-  {
+  std::vector<Eigen::Vector2i> pixel_mins(index_list_.size()), pixel_maxs(index_list_.size());
+  auto prepare_triangle = [&](int i) {
     Triangle &tri = triangles[i];
-    for (int j = 0; j < 3; j++) 
+    for (int j = 0; j < 3; j++)
     {
       tri.corners[j] = vertices_[index_list_[i][j]];
     }
-    tri.tested = false;
     tri.normal = (tri.corners[1] - tri.corners[0]).cross(tri.corners[2] - tri.corners[0]);
+    // the pixel centres within the triangle's bounds. These and the scanline spans below are padded by
+    // @c pixel_margin against rounding, and each pixel is confirmed by the ray intersection
+    const Eigen::Vector3d tri_min =
+      (minVector(tri.corners[0], minVector(tri.corners[1], tri.corners[2])) - box_min) / width;
+    const Eigen::Vector3d tri_max =
+      (maxVector(tri.corners[0], maxVector(tri.corners[1], tri.corners[2])) - box_min) / width;
+    for (int k = 0; k < 2; k++)
+    {
+      const double lo = std::ceil(tri_min[k] - 0.5 - pixel_margin);
+      const double hi = std::floor(tri_max[k] - 0.5 + pixel_margin);
+      pixel_mins[i][k] = static_cast<int>(clamped(lo, 0.0, static_cast<double>(dims[k])));
+      pixel_maxs[i][k] = static_cast<int>(clamped(hi, -1.0, static_cast<double>(dims[k] - 1)));
+    }
+  };
+#if RAYLIB_WITH_TBB
+  tbb::parallel_for(0, (int)index_list_.size(), prepare_triangle);
+#else
+  for (int i = 0; i < (int)index_list_.size(); i++)
+  {
+    prepare_triangle(i);
   }
+#endif  // RAYLIB_WITH_TBB
 
-  // put the triangles into a grid
-  Grid<Triangle *> grid(box_min, box_max, width);
-  for (auto &tri : triangles)
+  // bin the triangles into square tiles of pixels, in index order
+  const int tile_width = 64;
+  const Eigen::Vector2i tile_dims((dims[0] + tile_width - 1) / tile_width, (dims[1] + tile_width - 1) / tile_width);
+  const int num_tiles = std::max(0, tile_dims[0] * tile_dims[1]);
+  std::vector<size_t> tile_offsets(num_tiles + 1, 0);
+  std::vector<int> tile_triangles;
+  for (int pass = 0; pass < 2; pass++)
   {
-    Eigen::Vector3d tri_min = (minVector(tri.corners[0], minVector(tri.corners[1], tri.corners[2])) - box_min) / width;
-    Eigen::Vector3d tri_max = (maxVector(tri.corners[0], maxVector(tri.corners[1], tri.corners[2])) - box_min) / width;
-    for (int x = (int)tri_min[0]; x <= (int)tri_max[0]; x++)
+    std::vector<size_t> fill(tile_offsets.begin(), tile_offsets.end() - 1);
+    for (int i = 0; i < (int)triangles.size(); i++)
     {
-      for (int y = (int)tri_min[1]; y <= (int)tri_max[1]; y++) 
+      if (pixel_mins[i][0] > pixel_maxs[i][0] || pixel_mins[i][1] > pixel_maxs[i][1])
+        continue;
+      for (int y = pixel_mins[i][1] / tile_width; y <= pixel_maxs[i][1] / tile_width; y++)
       {
-        grid.insert(x, y, 0, &tri);
+        for (int x = pixel_mins[i][0] / tile_width; x <= pixel_maxs[i][0] / tile_width; x++)
+        {
+          const int tile = x + tile_dims[0] * y;
+          if (pass == 0)
+            tile_offsets[tile + 1]++;
+          else
+            tile_triangles[fill[tile]++] = i;
+        }
       }
     }
+    if (pass == 0)
+    {
+      for (int t = 0; t < num_tiles; t++) tile_offsets[t + 1] += tile_offsets[t];
+      tile_triangles.resize(tile_offsets.back());
+    }
   }
-  // now look up the triangle for each pixel centre
+
+  // now look up the triangle for each pixel centre. Each tile rasterises its triangles in scanlines, in index order,
+  // and a pixel takes the height of the first triangle that its vertical ray intersects
   const double unset = std::numeric_limits<double>::lowest();
-  field = Eigen::ArrayXXd::Constant(grid.dims[0], grid.dims[1], unset);
-  std::cout << "dims for low: " << grid.dims.transpose() << ", rows: " << field.rows() << ", cols: " << field.cols()
+  field = Eigen::ArrayXXd::Constant(dims[0], dims[1], unset);
+  std::cout << "dims for low: " << dims.transpose() << ", rows: " << field.rows() << ", cols: " << field.cols()
             << std::endl;
-  for (int x = 0; x < grid.dims[0]; x++)
-  {
-    for (int y = 0; y < grid.dims[1]; y++)
+  auto rasterise_tile = [&](int tile) {
+    const Eigen::Vector2i tile_min(tile_width * (tile % tile_dims[0]), tile_width * (tile / tile_dims[0]));
+    const Eigen::Vector2i tile_max =
+      (tile_min + Eigen::Vector2i(tile_width - 1, tile_width - 1)).cwiseMin(dims - Eigen::Vector2i(1, 1));
+    for (size_t t = tile_offsets[tile]; t < tile_offsets[tile + 1]; t++)
     {
-      Eigen::Vector3d pos_top = box_min + width * (Eigen::Vector3d((double)x + 0.5, (double)y + 0.5, 0));
-      Eigen::Vector3d pos_base = pos_top;
-      pos_top[2] = top;
-      pos_base[2] = box_min[2];
-      auto &tris = grid.cell(x, y, 0).data;
-      // search the triangles in this cell 'bucket'
-      for (auto &tri : tris)
+      const int i = tile_triangles[t];
+      const Triangle &tri = triangles[i];
+      Eigen::Vector2d corners[3];
+      for (int j = 0; j < 3; j++)
       {
-        double depth;
-        if (tri->intersectsRay(pos_top, pos_base, depth))
+        corners[j] = (tri.corners[j].head<2>() - box_min.head<2>()) / width - Eigen::Vector2d(0.5, 0.5);
+      }
+      const Eigen::Vector2d side1 = corners[1] - corners[0], side2 = corners[2] - corners[0];
+      const double area = side1[0] * side2[1] - side1[1] * side2[0];
+      const int y_min = std::max(pixel_mins[i][1], tile_min[1]);
+      const int y_max = std::min(pixel_maxs[i][1], tile_max[1]);
+      for (int y = y_min; y <= y_max; y++)
+      {
+        // the edge functions are linear in x along the scanline, so bound the span of x where all are inside
+        double x_low = static_cast<double>(std::max(pixel_mins[i][0], tile_min[0]));
+        double x_high = static_cast<double>(std::min(pixel_maxs[i][0], tile_max[0]));
+        if (area != 0.0)
         {
-          // intersects so interpolate the height
-          double height = pos_top[2] + (pos_base[2] - pos_top[2]) * depth;
-          field(x, y) = height;
-          break;
+          for (int j = 0; j < 3; j++)
+          {
+            const Eigen::Vector2d &p = corners[j];
+            const Eigen::Vector2d edge = corners[(j + 1) % 3] - p;
+            // edge function (edge x (pos - p)) * sign(area) = a x + b
+            const double a = -edge[1] * area;
+            const double b = (edge[0] * (static_cast<double>(y) - p[1]) + edge[1] * p[0]) * area;
+            if (a > 0.0)
+              x_low = std::max(x_low, std::ceil(-b / a - pixel_margin));
+            else if (a < 0.0)
+              x_high = std::min(x_high, std::floor(-b / a + pixel_margin));
+          }
+        }
+        for (int x = static_cast<int>(x_low); x <= static_cast<int>(x_high); x++)
+        {
+          if (field(x, y) != unset)
+            continue;
+          Eigen::Vector3d pos_top = box_min + width * (Eigen::Vector3d((double)x + 0.5, (double)y + 0.5, 0));
+          Eigen::Vector3d pos_base = pos_top;
+          pos_top[2] = top;
+          pos_base[2] = box_min[2];
+          double depth;
+          if (tri.intersectsRay(pos_top, pos_base, depth))
+          {
+            // intersects so interpolate the height
+            field(x, y) = pos_top[2] + (pos_base[2] - pos_top[2]) * depth;
+          }
         }
       }
     }
+  };
+#if RAYLIB_WITH_TBB
+  tbb::parallel_for(0, num_tiles, rasterise_tile);
+#else
+  for (int tile = 0; tile < num_tiles; tile++)
+  {
+    rasterise_tile(tile);
   }
+#endif  // RAYLIB_WITH_TBB
   // lastly, we repeatedly fill in the gaps
   bool gaps_remain = true;
   while (gaps_remain)
   {
     gaps_remain = false;
-    for (int x = 0; x < grid.dims[0]; x++)
+    for (int x = 0; x < dims[0]; x++)
     {
-      for (int y = 0; y < grid.dims[1]; y++)
+      for (int y = 0; y < dims[1]; y++)
       {
         if (field(x, y) == unset)
         {
           double count = 0;
           double total_height = 0;
           // look at the Moore neighbourhood to obtain a mean neighbour height
-          for (int i = std::max(0, x - 1); i <= std::min(x + 1, grid.dims[0] - 1); i++)
+          for (int i = std::max(0, x - 1); i <= std::min(x + 1, dims[0] - 1); i++)
           {
-            for (int j = std::max(0, y - 1); j <= std::min(y + 1, grid.dims[1] - 1); j++)
+            for (int j = std::max(0, y - 1); j <= std::min(y + 1, dims[1] - 1); j++)
             {
               if (field(i, j) != unset)
               {
@@ -193,160 +362,257 @@ void Mesh::toHeightField(Eigen::ArrayXXd &field, const Eigen::Vector3d &box_min,
   }
 }
 
-void Mesh::splitCloud(const Cloud &cloud, double offset, Cloud &inside, Cloud &outside)
+namespace
 {
-  // Firstly, find the average vertex normals
-  std::vector<Eigen::Vector3d> normals(vertices_.size());
-  for (auto &normal : normals) normal.setZero();
-  for (auto &index : index_list_)
-  {
-    Eigen::Vector3d normal =
-      (vertices_[index[1]] - vertices_[index[0]]).cross(vertices_[index[2]] - vertices_[index[0]]);
-    for (int i = 0; i < 3; i++) normals[index[i]] += normal;
-  }
-  for (auto &normal : normals) normal.normalize();
-
-  // convert to separate triangles for convenience
-  std::vector<Triangle> triangles(index_list_.size());
-  double mx = std::numeric_limits<double>::max();
-  double mn = std::numeric_limits<double>::lowest();
-  Eigen::Vector3d box_min(mx, mx, mx), box_max(mn, mn, mn);
-  for (int i = 0; i < (int)index_list_.size(); i++)
+/// The triangles overlapping each cell of a 2D grid in plan view, in compressed sparse row form. The cell width adapts
+/// to the size and density of the triangles, and lookups are stateless so can be made in parallel
+class TriangleGrid2D
+{
+public:
+  /// bin the triangles by their bounds @c mins to @c maxs in x and y
+  TriangleGrid2D(const std::vector<Eigen::Vector2d> &mins, const std::vector<Eigen::Vector2d> &maxs)
+    : width_(1.0)
   {
-    Triangle &tri = triangles[i];
-    for (int j = 0; j < 3; j++) tri.corners[j] = vertices_[index_list_[i][j]];
-    tri.tested = false;
-    tri.normal = (tri.corners[1] - tri.corners[0]).cross(tri.corners[2] - tri.corners[0]).normalized();
-    for (int j = 0; j < 3; j++)
+    box_min_ = Eigen::Vector2d::Constant(std::numeric_limits<double>::max());
+    Eigen::Vector2d box_max = Eigen::Vector2d::Constant(std::numeric_limits<double>::lowest());
+    double mean_extent = 0.0;
+    for (size_t i = 0; i < mins.size(); i++)
     {
-      box_min = minVector(box_min, tri.corners[j]);
-      box_max = maxVector(box_max, tri.corners[j]);
+      box_min_ = box_min_.cwiseMin(mins[i]);
+      box_max = box_max.cwiseMax(maxs[i]);
+      mean_extent += (maxs[i] - mins[i]).maxCoeff() / static_cast<double>(mins.size());
     }
-  }
+    dims_.setZero();
+    if (mins.empty())
+    {
+      return;
+    }
+    // cells about the size of a triangle, but no more cells than triangles
+    const Eigen::Vector2d extent = box_max - box_min_;
+    width_ = std::max(mean_extent, std::sqrt(extent[0] * extent[1] / static_cast<double>(mins.size())));
+    if (!(width_ > 0.0))
+    {
+      width_ = std::max(1.0, extent.maxCoeff());
+    }
+    dims_ = ((extent / width_).array().floor().cast<int>() + 1).matrix();
 
-  // Thirdly, put the triangles into a grid
-  double voxel_width = 1.0;
-  std::vector<int> inside_indices;
-  {
-    int inside_val = offset >= 0.0 ? 1 : 0;
-    Grid<Triangle *> grid(box_min, box_max, voxel_width);
-    for (auto &tri : triangles)
+    offsets_.assign(static_cast<size_t>(dims_[0]) * dims_[1] + 1, 0);
+    for (int pass = 0; pass < 2; pass++)
     {
-      Eigen::Vector3d tri_min =
-        (minVector(tri.corners[0], minVector(tri.corners[1], tri.corners[2])) - box_min) / voxel_width;
-      Eigen::Vector3d tri_max =
-        (maxVector(tri.corners[0], maxVector(tri.corners[1], tri.corners[2])) - box_min) / voxel_width;
-      for (int x = (int)tri_min[0]; x <= (int)tri_max[0]; x++)
+      for (size_t i = 0; i < mins.size(); i++)
       {
-        for (int y = (int)tri_min[1]; y <= (int)tri_max[1]; y++)
+        const Eigen::Vector2i lo = cellIndex(mins[i]);
+        const Eigen::Vector2i hi = cellIndex(maxs[i]);
+        for (int y = lo[1]; y <= hi[1]; y++)
         {
-          for (int z = (int)tri_min[2]; z <= (int)tri_max[2]; z++)
+          for (int x = lo[0]; x <= hi[0]; x++)
           {
-            grid.insert(x, y, z, &tri);
+            const size_t cell = x + static_cast<size_t>(dims_[0]) * y;
+            if (pass == 0)
+            {
+              offsets_[cell + 1]++;
+            }
+            else
+            {
+              triangles_[fill_[cell]++] = static_cast<int>(i);
+            }
           }
         }
       }
-    }
-
-    // Fourthly, drop each end point downwards to decide whether it is inside or outside..
-    std::vector<Triangle *> tris_tested;
-    tris_tested.reserve(100.0);
-    for (int r = 0; r < (int)cloud.ends.size(); r++)
-    {
-      int intersections = 0;
-      // for (int dir = -1; dir<=1; dir += 2)
-      int dir = -1;
+      if (pass == 0)
       {
-        Eigen::Vector3d start = (cloud.ends[r] - box_min) / voxel_width;
-        Eigen::Vector3i index(start.cast<int>());
-        int end_i = dir < 0 ? 0 : grid.dims[2] - 1;
-        tris_tested.clear();
-        for (int z = clamped(index[2], 0, grid.dims[2] - 1); (z * dir) <= end_i; z += dir)
+        for (size_t c = 1; c < offsets_.size(); c++)
         {
-          auto &tris = grid.cell(index[0], index[1], z).data;
-          for (auto &tri : tris)
-          {
-            if (tri->tested)
-              continue;
-            tri->tested = true;
-            tris_tested.push_back(tri);
-            double depth;
-            if (tri->intersectsRay(cloud.ends[r], cloud.ends[r] + (double)dir * Eigen::Vector3d(0.0, 0.0, 1e3), depth))
-              intersections++;
-          }
+          offsets_[c] += offsets_[c - 1];
         }
-        for (auto &tri : tris_tested) tri->tested = false;
+        triangles_.resize(offsets_.back());
+        fill_.assign(offsets_.begin(), offsets_.end() - 1);
       }
-      if ((intersections % 2) == inside_val)  // inside
-        inside_indices.push_back(r);
     }
+    fill_.clear();
+    fill_.shrink_to_fit();
   }
-  std::cout << inside_indices.size() << "/" << cloud.ends.size() << " inside mesh" << std::endl;
 
-  // what if offset is negative?
-  // we have to ...
-  if (offset != 0.0)
+  /// the triangles whose bounds may contain @c pos , as the range @c begin to @c end
+  inline void candidates(const Eigen::Vector2d &pos, const int *&begin, const int *&end) const
   {
-    // Thirdly, put the triangles into a grid
-    double voxel_width = 1.0;
-    Grid<Triangle *> grid2(box_min, box_max, voxel_width);
-    for (int i = 0; i < (int)index_list_.size(); i++)
+    begin = end = nullptr;
+    const Eigen::Vector2d coord = (pos - box_min_) / width_;
+    if (!(coord[0] >= 0.0 && coord[1] >= 0.0 && coord[0] < dims_[0] && coord[1] < dims_[1]))
     {
-      if (!(i % 100000))
-        std::cout << "filling volumes " << i << "/" << index_list_.size() << std::endl;
-      Triangle &tri = triangles[i];
+      return;
+    }
+    const size_t cell = static_cast<int>(coord[0]) + static_cast<size_t>(dims_[0]) * static_cast<int>(coord[1]);
+    begin = triangles_.data() + offsets_[cell];
+    end = triangles_.data() + offsets_[cell + 1];
+  }
+
+private:
+  inline Eigen::Vector2i cellIndex(const Eigen::Vector2d &pos) const
+  {
+    const Eigen::Vector2d coord = (pos - box_min_) / width_;
+    return Eigen::Vector2i(clamped(static_cast<int>(coord[0]), 0, dims_[0] - 1),
+                           clamped(static_cast<int>(coord[1]), 0, dims_[1] - 1));
+  }
+
+  Eigen::Vector2d box_min_;
+  double width_;
+  Eigen::Vector2i dims_;
+  std::vector<size_t> offsets_;
+  std::vector<int> triangles_;
+  std::vector<size_t> fill_;
+};
+
+const double kOffsetVoxelWidth = 1.0;  // of the unit voxels that bound the offset volumes
+
+/// Decides which side of a mesh each end point is on. It is built once per mesh, and its queries are stateless, so
+/// points can be classified in parallel
+class MeshSideClassifier
+{
+public:
+  MeshSideClassifier(const std::vector<Eigen::Vector3d> &vertices, const std::vector<Eigen::Vector3i> &index_list,
+                     double offset)
+    : offset_(offset)
+  {
+    // Firstly, find the average vertex normals
+    std::vector<Eigen::Vector3d> normals(vertices.size());
+    for (auto &normal : normals) normal.setZero();
+    for (auto &index : index_list)
+    {
+      Eigen::Vector3d normal =
+        (vertices[index[1]] - vertices[index[0]]).cross(vertices[index[2]] - vertices[index[0]]);
+      for (int i = 0; i < 3; i++) normals[index[i]] += normal;
+    }
+    for (auto &normal : normals) normal.normalize();
+
+    // convert to separate triangles for convenience
+    triangles_.resize(index_list.size());
+    double mx = std::numeric_limits<double>::max();
+    double mn = std::numeric_limits<double>::lowest();
+    box_min_ = Eigen::Vector3d(mx, mx, mx);
+    Eigen::Vector3d box_max(mn, mn, mn);
+    std::vector<Eigen::Vector2d> mins(index_list.size()), maxs(index_list.size());
+    for (size_t i = 0; i < index_list.size(); i++)
+    {
+      Triangle &tri = triangles_[i];
+      for (int j = 0; j < 3; j++) tri.corners[j] = vertices[index_list[i][j]];
+      tri.normal = (tri.corners[1] - tri.corners[0]).cross(tri.corners[2] - tri.corners[0]).normalized();
+      const Eigen::Vector3d tri_min = minVector(tri.corners[0], minVector(tri.corners[1], tri.corners[2]));
+      const Eigen::Vector3d tri_max = maxVector(tri.corners[0], maxVector(tri.corners[1], tri.corners[2]));
+      mins[i] = tri_min.head<2>();
+      maxs[i] = tri_max.head<2>();
+      box_min_ = minVector(box_min_, tri_min);
+      box_max = maxVector(box_max, tri_max);
+    }
+    // Secondly, bin the triangles in plan view, for the downwards end point rays
+    surface_grid_.reset(new TriangleGrid2D(mins, maxs));
+    if (offset_ == 0.0)
+    {
+      return;
+    }
+
+    // Thirdly, bin the triangles by their unit voxels when extruded by the offset, and by their offset bounds
+    extruded_mins_.resize(index_list.size());
+    extruded_maxs_.resize(index_list.size());
+    for (size_t i = 0; i < index_list.size(); i++)
+    {
+      const Triangle &tri = triangles_[i];
       Eigen::Vector3d extruded_corners[3];
-      for (int j = 0; j < 3; j++) extruded_corners[j] = tri.corners[j] + normals[index_list_[i][j]] * offset;
+      for (int j = 0; j < 3; j++) extruded_corners[j] = tri.corners[j] + normals[index_list[i][j]] * offset_;
 
       Eigen::Vector3d tri_min = minVector(tri.corners[0], minVector(tri.corners[1], tri.corners[2]));
       Eigen::Vector3d tri_max = maxVector(tri.corners[0], maxVector(tri.corners[1], tri.corners[2]));
       Eigen::Vector3d tri_min2 = minVector(extruded_corners[0], minVector(extruded_corners[1], extruded_corners[2]));
       Eigen::Vector3d tri_max2 = maxVector(extruded_corners[0], maxVector(extruded_corners[1], extruded_corners[2]));
 
-      tri_min = (minVector(tri_min, tri_min2) - box_min) / voxel_width;
-      tri_max = (maxVector(tri_max, tri_max2) - box_min) / voxel_width;
-      for (int x = (int)tri_min[0]; x <= (int)tri_max[0]; x++)
-        for (int y = (int)tri_min[1]; y <= (int)tri_max[1]; y++)
-          for (int z = (int)tri_min[2]; z <= (int)tri_max[2]; z++) grid2.insert(x, y, z, &tri);
+      extruded_mins_[i] = ((minVector(tri_min, tri_min2) - box_min_) / kOffsetVoxelWidth).cast<int>();
+      extruded_maxs_[i] = ((maxVector(tri_max, tri_max2) - box_min_) / kOffsetVoxelWidth).cast<int>();
+      // only points within the offset of the triangle's bounds can be within the offset of the triangle
+      mins[i] = tri_min.head<2>() - Eigen::Vector2d::Constant(std::abs(offset_));
+      maxs[i] = tri_max.head<2>() + Eigen::Vector2d::Constant(std::abs(offset_));
     }
-    // now go through the remaining inside points
-    std::vector<int> new_insides;
-    double offset_sqr = sqr(offset);
-    int p = 0;
-    for (auto &r : inside_indices)
+    offset_grid_.reset(new TriangleGrid2D(mins, maxs));
+  }
+
+  /// whether @c point is inside the mesh, on the side of the offset surface that a positive offset grows into
+  bool inside(const Eigen::Vector3d &point) const
+  {
+    // drop the end point downwards to decide whether it is inside or outside
+    int intersections = 0;
+    const int *begin, *end;
+    surface_grid_->candidates(point.head<2>(), begin, end);
+    for (const int *t = begin; t != end; t++)
     {
-      if (!(p++ % 1000000))
-        std::cout << "checking points " << p - 1 << "/" << inside_indices.size() << std::endl;
-      Eigen::Vector3d pos = (cloud.ends[r] - box_min) / voxel_width;
-      Eigen::Vector3i index(pos.cast<int>());
-      auto &tris = grid2.cell(index[0], index[1], index[2]).data;
-      bool in_tri = false;
-      for (auto &tri : tris)
+      double depth;
+      if (triangles_[*t].intersectsRay(point, point - Eigen::Vector3d(0.0, 0.0, 1e3), depth))
+        intersections++;
+    }
+    const int inside_val = offset_ >= 0.0 ? 1 : 0;
+    bool in = (intersections % 2) == inside_val;
+    if (in && offset_ != 0.0)
+    {
+      // discard points within the offset distance of the surface
+      const Eigen::Vector3i index(((point - box_min_) / kOffsetVoxelWidth).cast<int>());
+      offset_grid_->candidates(point.head<2>(), begin, end);
+      const double offset_sqr = sqr(offset_);
+      for (const int *t = begin; t != end && in; t++)
       {
-        if (tri->distSqrToPoint(cloud.ends[r]) < offset_sqr)
+        if ((index.array() >= extruded_mins_[*t].array()).all() &&
+            (index.array() <= extruded_maxs_[*t].array()).all() &&
+            triangles_[*t].distSqrToPoint(point) < offset_sqr)
         {
-          in_tri = true;
-          break;
-        };
+          in = false;
+        }
       }
-      if (!in_tri)
-        new_insides.push_back(r);
     }
-    std::cout << "new inside count: " << new_insides.size() << "/" << cloud.ends.size() << std::endl;
-    inside_indices = new_insides;
+    return in == (offset_ >= 0.0);
   }
 
-  std::vector<bool> inside_i(cloud.ends.size());
-  int ins = offset >= 0.0;
-  for (int i = 0; i < (int)cloud.ends.size(); i++) inside_i[i] = !ins;
-  for (auto &ind : inside_indices) inside_i[ind] = ins;
-  for (int i = 0; i < (int)cloud.ends.size(); i++)
+private:
+  double offset_;
+  Eigen::Vector3d box_min_;
+  std::vector<Triangle> triangles_;
+  std::unique_ptr<TriangleGrid2D> surface_grid_;
+  std::unique_ptr<TriangleGrid2D> offset_grid_;
+  std::vector<Eigen::Vector3i> extruded_mins_;
+  std::vector<Eigen::Vector3i> extruded_maxs_;
+};
+}  // namespace
+
+std::function<bool(const Eigen::Vector3d &end)> Mesh::insideTest(double offset) const
+{
+  std::shared_ptr<const MeshSideClassifier> classifier =
+    std::make_shared<MeshSideClassifier>(vertices_, index_list_, offset);
+  return [classifier](const Eigen::Vector3d &end) { return classifier->inside(end); };
+}
+
+template <class CloudT>
+void Mesh::splitCloud(const CloudT &cloud, double offset, CloudT &inside, CloudT &outside)
+{
+  const MeshSideClassifier classifier(vertices_, index_list_, offset);
+  std::vector<char> inside_i(cloud.rayCount());
+  auto classify = [&](size_t i) { inside_i[i] = classifier.inside(cloud.rayEnd(i)); };
+#if RAYLIB_WITH_TBB
+  tbb::parallel_for(size_t(0), cloud.rayCount(), classify);
+#else
+  for (size_t i = 0; i < cloud.rayCount(); i++)
   {
-    Cloud &out = inside_i[i] ? inside : outside;
-    out.addRay(cloud, i);
+    classify(i);
   }
+#endif  // RAYLIB_WITH_TBB
+  size_t num_inside = 0;
+  for (size_t i = 0; i < cloud.rayCount(); i++)
+  {
+    CloudT &out = inside_i[i] ? inside : outside;
+    out.addRay(cloud.rayStart(i), cloud.rayEnd(i), cloud.rayTime(i), cloud.rayColour(i));
+    num_inside += inside_i[i];
+  }
+  std::cout << num_inside << "/" << cloud.rayCount() << " inside mesh" << std::endl;
 }
 
+template void Mesh::splitCloud<Cloud>(const Cloud &, double, Cloud &, Cloud &);
+template void Mesh::splitCloud<CompactCloud>(const CompactCloud &, double, CompactCloud &, CompactCloud &);
+
 Eigen::Array<double, 6, 1> Mesh::getMoments() const
 {
   Eigen::Array3d mean(0, 0, 0);
@@ -11,6 +11,8 @@
 #include "raycloud.h"
 #include "rayutils.h"
 
+#include <functional>
+
 namespace ray
 {
 /// A triangular mesh data structure. For mesh based operations.
@@ -18,8 +20,13 @@ class RAYLIB_EXPORT Mesh
 {
 public:
   /// Use the mesh to split a @c cloud based on which side of the mesh its end points are on
-  /// The two resulting clouds are @c inside and @c outside
-  void splitCloud(const Cloud &cloud, double offset, Cloud &inside, Cloud &outside);
+  /// The two resulting clouds are @c inside and @c outside. Instantiated for @c Cloud and @c CompactCloud
+  template <class CloudT>
+  void splitCloud(const CloudT &cloud, double offset, CloudT &inside, CloudT &outside);
+
+  /// The test that @c splitCloud makes, as a function that is true for the end points it puts @c inside . The mesh is
+  /// indexed once, and the function is thread safe, so it can split a large cloud chunk by chunk, in parallel
+  std::function<bool(const Eigen::Vector3d &end)> insideTest(double offset) const;
 
   /// Convert the mesh into a height field (2D array of heights) based on the supplied bounding box and cell width
   void toHeightField(Eigen::ArrayXXd &field, const Eigen::Vector3d &box_min, Eigen::Vector3d box_max,
@@ -40,7 +47,8 @@ public:
   /// These stats are arranged as the mean vertex location, then the standard deviation in each axis
   Eigen::Array<double, 6, 1> getMoments() const;
 
-  // remove surplus points that are not part of any triangles
+  /// Weld the vertices that are at identical positions, and remove the surplus points that are not part of any
+  /// triangles. The remaining vertices are in the order that the index list first uses them, and keep their colours
   void reduce();
 
 private:
@@ -0,0 +1,43 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raymorton.h"
+
+#include <algorithm>
+
+#if RAYLIB_WITH_TBB
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+#endif  // RAYLIB_WITH_TBB
+
+namespace ray
+{
+std::vector<size_t> mortonOrder(const std::vector<Eigen::Vector3d> &points)
+{
+  if (points.empty())
+    return std::vector<size_t>();
+  Eigen::Vector3d min_bound = points[0], max_bound = points[0];
+  for (const auto &point : points)
+  {
+    min_bound = minVector(min_bound, point);
+    max_bound = maxVector(max_bound, point);
+  }
+  const double max_extent = std::max((max_bound - min_bound).maxCoeff(), 1e-10);
+  const double scale = static_cast<double>((1 << 21) - 1) / max_extent;
+  // the index is part of the key, so that the order is the same whether or not the sort is stable
+  std::vector<std::pair<uint64_t, size_t>> keys(points.size());
+  auto set_key = [&](size_t i) { keys[i] = std::make_pair(mortonCode(points[i], min_bound, scale), i); };
+#if RAYLIB_WITH_TBB
+  tbb::parallel_for(size_t(0), points.size(), set_key);
+  tbb::parallel_sort(keys.begin(), keys.end());
+#else   // RAYLIB_WITH_TBB
+  for (size_t i = 0; i < points.size(); i++) set_key(i);
+  std::sort(keys.begin(), keys.end());
+#endif  // RAYLIB_WITH_TBB
+  std::vector<size_t> order(points.size());
+  for (size_t i = 0; i < keys.size(); i++) order[i] = keys[i].second;
+  return order;
+}
+}  // namespace ray
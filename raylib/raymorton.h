@@ -0,0 +1,49 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYMORTON_H
+#define RAYLIB_RAYMORTON_H
+
+#include "raylib/raylibconfig.h"
+
+#include "rayutils.h"
+
+namespace ray
+{
+/// spread the lower 21 bits of @c x out to every third bit, for interleaving
+inline uint64_t spreadBits(uint64_t x)
+{
+  x &= 0x1fffff;
+  x = (x | x << 32) & 0x1f00000000ffffull;
+  x = (x | x << 16) & 0x1f0000ff0000ffull;
+  x = (x | x << 8) & 0x100f00f00f00f00full;
+  x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+  x = (x | x << 2) & 0x1249249249249249ull;
+  return x;
+}
+
+/// A 64-bit key of the voxel @c index , interleaving the lower 21 bits of each axis. It is unique within each
+/// 2^21 voxel cube, and indices that differ by a multiple of 2^21 on an axis share a key, so it suits hashing
+inline uint64_t mortonKey(const Eigen::Vector3i &index)
+{
+  return spreadBits(static_cast<uint32_t>(index[0])) | spreadBits(static_cast<uint32_t>(index[1])) << 1 |
+         spreadBits(static_cast<uint32_t>(index[2])) << 2;
+}
+
+/// The Morton (Z-order) code of @c pos , quantised to 21 bits per axis by @c scale from @c min_bound
+inline uint64_t mortonCode(const Eigen::Vector3d &pos, const Eigen::Vector3d &min_bound, double scale)
+{
+  const Eigen::Vector3d cell = (pos - min_bound) * scale;
+  return spreadBits(static_cast<uint64_t>(cell[0])) | spreadBits(static_cast<uint64_t>(cell[1])) << 1 |
+         spreadBits(static_cast<uint64_t>(cell[2])) << 2;
+}
+
+/// The indices of @c points in Morton order, over the points' bounding cube. Consecutive points are then close
+/// together, so algorithms that visit the points in this order find their neighbours still in cache. Points with
+/// equal codes stay in their original order. Sorted in parallel when built with TBB.
+std::vector<size_t> RAYLIB_EXPORT mortonOrder(const std::vector<Eigen::Vector3d> &points);
+}  // namespace ray
+
+#endif  // RAYLIB_RAYMORTON_H
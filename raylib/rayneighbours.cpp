@@ -0,0 +1,367 @@
+// Copyright (c) 2020
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "rayneighbours.h"
+#include "raycloud.h"
+#include "raycompactcloud.h"
+#include "raygpu.h"
+#include "raythreads.h"
+
+#include <nabo/nabo.h>
+
+#if RAYLIB_WITH_TBB
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_sort.h>
+#endif  // RAYLIB_WITH_TBB
+
+namespace ray
+{
+namespace
+{
+/// number of queries per parallel task. Large enough to amortise the per-task copies
+const Eigen::Index kQueryBlockSize = 4096;
+/// indices of fewer points than this are only searched on the CPU, as the GPU transfers would cost more
+const Eigen::Index kGpuMinPoints = 1 << 16;
+/// bits per axis of the packed grid cell keys of findNeighboursWithin. x is the lowest, so a row of cells is a
+/// contiguous run of keys
+const int kCellAxisBits = 21;
+
+/// A point's grid cell, packed into a key, and its index
+struct CellPoint
+{
+  uint64_t key;
+  int64_t index;
+  bool operator<(const CellPoint &other) const
+  {
+    return key < other.key || (key == other.key && index < other.index);
+  }
+};
+
+/// Order each query's neighbours at equal distances by index, as the GPU search does. libnabo leaves them in the
+/// order that its tree visits them, so this is an insertion sort that only moves neighbours past equally distant ones
+void orderTies(Eigen::MatrixXi &indices, const Eigen::MatrixXd &dists2)
+{
+  for (Eigen::Index q = 0; q < indices.cols(); q++)
+  {
+    for (Eigen::Index i = 1; i < indices.rows(); i++)
+    {
+      for (Eigen::Index j = i; j > 0 && dists2(j, q) == dists2(j - 1, q) && indices(j, q) < indices(j - 1, q); j--)
+      {
+        std::swap(indices(j, q), indices(j - 1, q));
+      }
+    }
+  }
+}
+
+/// The search on the GPU, if @c grid is not null, with its results converted to those of libnabo. Returns false if
+/// the search must run on the CPU instead
+bool gpuKnn(const GpuNeighbourGrid *grid, const Eigen::MatrixXd &queries, int k, double max_radius,
+            Eigen::MatrixXi &indices, Eigen::MatrixXd &dists2)
+{
+  if (!grid || queries.rows() != 3)
+  {
+    return false;
+  }
+  indices.resize(k, queries.cols());
+  dists2.resize(k, queries.cols());
+  if (!grid->knn(queries.data(), static_cast<size_t>(queries.cols()), k, max_radius, indices.data(), dists2.data()))
+  {
+    return false;
+  }
+  for (Eigen::Index i = 0; i < indices.size(); i++)
+  {
+    if (indices.data()[i] < 0)
+    {
+      indices.data()[i] = Nabo::NNSearchD::InvalidIndex;
+      dists2.data()[i] = Nabo::NNSearchD::InvalidValue;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+/// The kd-tree is built on first use, as a GPU grid may serve every query
+struct NeighbourIndex::Tree
+{
+  const Nabo::NNSearchD &nns(const Eigen::MatrixXd &points)
+  {
+    std::call_once(built, [&]() {
+      kd_tree.reset(Nabo::NNSearchD::createKDTreeLinearHeap(points, static_cast<int>(points.rows())));
+    });
+    return *kd_tree;
+  }
+  std::once_flag built;
+  std::unique_ptr<Nabo::NNSearchD> kd_tree;
+  std::unique_ptr<GpuNeighbourGrid> gpu;
+};
+
+NeighbourIndex::NeighbourIndex(Eigen::MatrixXd points, std::vector<int> ids)
+  : points_(std::move(points))
+  , ids_(std::move(ids))
+  , tree_(new Tree)
+{
+  if (points_.rows() == 3 && points_.cols() >= kGpuMinPoints)
+  {
+    tree_->gpu = GpuNeighbourGrid::create(points_.data(), static_cast<size_t>(points_.cols()));
+  }
+}
+
+NeighbourIndex::~NeighbourIndex() = default;
+
+void NeighbourIndex::knn(const Eigen::MatrixXd &queries, int k, Eigen::MatrixXi &indices, Eigen::MatrixXd &dists2,
+                         double epsilon, double max_radius) const
+{
+  const Eigen::Index num_queries = queries.cols();
+  indices.resize(k, num_queries);
+  dists2.resize(k, num_queries);
+  if (k <= 0 || num_queries == 0)
+  {
+    return;
+  }
+  // the GPU search is exact, which is within any allowed approximation
+  if (gpuKnn(tree_->gpu.get(), queries, k, max_radius, indices, dists2))
+  {
+    return;
+  }
+  const double radius = max_radius != 0.0 ? max_radius : std::numeric_limits<double>::infinity();
+  const Nabo::NNSearchD &nns = tree_->nns(points_);
+  if (num_queries <= kQueryBlockSize)
+  {
+    nns.knn(queries, indices, dists2, k, epsilon, 0, radius);
+    orderTies(indices, dists2);
+    return;
+  }
+  // each block of queries is searched independently, and its results copied into place
+  auto search_block = [&](Eigen::Index begin, Eigen::Index end) {
+    const Eigen::MatrixXd block = queries.middleCols(begin, end - begin);
+    Eigen::MatrixXi block_indices;
+    Eigen::MatrixXd block_dists2;
+    nns.knn(block, block_indices, block_dists2, k, epsilon, 0, radius);
+    orderTies(block_indices, block_dists2);
+    indices.middleCols(begin, end - begin) = block_indices;
+    dists2.middleCols(begin, end - begin) = block_dists2;
+  };
+  const Eigen::Index num_blocks = (num_queries + kQueryBlockSize - 1) / kQueryBlockSize;
+#if RAYLIB_WITH_TBB
+  tbb::parallel_for(tbb::blocked_range<Eigen::Index>(0, num_blocks, 1),
+                    [&](const tbb::blocked_range<Eigen::Index> &range) {
+                      for (Eigen::Index b = range.begin(); b != range.end(); ++b)
+                      {
+                        search_block(b * kQueryBlockSize, std::min(num_queries, (b + 1) * kQueryBlockSize));
+                      }
+                    });
+#else   // RAYLIB_WITH_TBB
+  for (Eigen::Index b = 0; b < num_blocks; ++b)
+  {
+    search_block(b * kQueryBlockSize, std::min(num_queries, (b + 1) * kQueryBlockSize));
+  }
+#endif  // RAYLIB_WITH_TBB
+}
+
+void NeighbourIndex::knn(int k, Eigen::MatrixXi &indices, Eigen::MatrixXd &dists2, double epsilon,
+                         double max_radius) const
+{
+  knn(points_, k, indices, dists2, epsilon, max_radius);
+}
+
+void NeighbourIndex::knnBlocks(
+  int k, const std::function<void(Eigen::Index begin, Eigen::Index end, const Eigen::MatrixXi &indices)> &func,
+  double epsilon, double max_radius) const
+{
+  const Eigen::Index num_points = points_.cols();
+  if (k <= 0 || num_points == 0)
+  {
+    return;
+  }
+  const double radius = max_radius != 0.0 ? max_radius : std::numeric_limits<double>::infinity();
+  auto search_block = [&](Eigen::Index begin, Eigen::Index end) {
+    const Eigen::MatrixXd block = points_.middleCols(begin, end - begin);
+    Eigen::MatrixXi block_indices;
+    Eigen::MatrixXd block_dists2;
+    if (!gpuKnn(tree_->gpu.get(), block, k, max_radius, block_indices, block_dists2))
+    {
+      tree_->nns(points_).knn(block, block_indices, block_dists2, k, epsilon, 0, radius);
+      orderTies(block_indices, block_dists2);
+    }
+    func(begin, end, block_indices);
+  };
+  const Eigen::Index num_blocks = (num_points + kQueryBlockSize - 1) / kQueryBlockSize;
+#if RAYLIB_WITH_TBB
+  tbb::parallel_for(tbb::blocked_range<Eigen::Index>(0, num_blocks, 1),
+                    [&](const tbb::blocked_range<Eigen::Index> &range) {
+                      for (Eigen::Index b = range.begin(); b != range.end(); ++b)
+                      {
+                        search_block(b * kQueryBlockSize, std::min(num_points, (b + 1) * kQueryBlockSize));
+                      }
+                    });
+#else   // RAYLIB_WITH_TBB
+  for (Eigen::Index b = 0; b < num_blocks; ++b)
+  {
+    search_block(b * kQueryBlockSize, std::min(num_points, (b + 1) * kQueryBlockSize));
+  }
+#endif  // RAYLIB_WITH_TBB
+}
+
+NeighbourIndexCache::NeighbourIndexCache(const NeighbourIndexCache &other)
+{
+  *this = other;
+}
+
+NeighbourIndexCache &NeighbourIndexCache::operator=(const NeighbourIndexCache &other)
+{
+  if (this == &other)
+  {
+    return *this;
+  }
+  std::shared_ptr<const NeighbourIndex> copies[2];
+  {
+    std::lock_guard<std::mutex> lock(other.mutex_);
+    copies[0] = other.indices_[0];
+    copies[1] = other.indices_[1];
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  indices_[0] = copies[0];
+  indices_[1] = copies[1];
+  return *this;
+}
+
+template <class CloudT>
+std::shared_ptr<const NeighbourIndex> NeighbourIndexCache::get(const CloudT &cloud, bool bounded_only)
+{
+  std::vector<int> ids;
+  ids.reserve(cloud.rayCount());
+  for (size_t i = 0; i < cloud.rayCount(); i++)
+  {
+    if (!bounded_only || cloud.rayBounded(i))
+    {
+      ids.push_back(static_cast<int>(i));
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::shared_ptr<const NeighbourIndex> &cached = indices_[bounded_only ? 1 : 0];
+  if (cached && cached->ids() == ids)
+  {
+    // checking the points costs far less than a rebuild
+    const Eigen::MatrixXd &points = cached->points();
+    bool unchanged = true;
+    for (size_t j = 0; j < ids.size() && unchanged; j++)
+    {
+      unchanged = points.col(j) == cloud.rayEnd(ids[j]);
+    }
+    if (unchanged)
+    {
+      return cached;
+    }
+  }
+
+  Eigen::MatrixXd points(3, ids.size());
+  for (size_t j = 0; j < ids.size(); j++)
+  {
+    points.col(j) = cloud.rayEnd(ids[j]);
+  }
+  cached = std::make_shared<const NeighbourIndex>(std::move(points), std::move(ids));
+  return cached;
+}
+
+void NeighbourIndexCache::clear()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  indices_[0].reset();
+  indices_[1].reset();
+}
+
+template std::shared_ptr<const NeighbourIndex> NeighbourIndexCache::get<Cloud>(const Cloud &, bool);
+template std::shared_ptr<const NeighbourIndex> NeighbourIndexCache::get<CompactCloud>(const CompactCloud &, bool);
+void findNeighboursWithin(const std::vector<Eigen::Vector3d> &points, double radius,
+                          std::vector<uint8_t> &has_neighbour)
+{
+  has_neighbour.assign(points.size(), 0);
+  if (points.size() < 2)
+    return;
+  // the grid is relative to the minimum cell, with the points that are not finite left out
+  Eigen::Vector3d min_bound(std::numeric_limits<double>::max(), std::numeric_limits<double>::max(),
+                            std::numeric_limits<double>::max());
+  Eigen::Vector3d max_bound = -min_bound;
+  for (const auto &point : points)
+  {
+    if (point.allFinite())
+    {
+      min_bound = minVector(min_bound, point);
+      max_bound = maxVector(max_bound, point);
+    }
+  }
+  if (!(min_bound[0] <= max_bound[0]))
+    return;
+  const Eigen::Vector3d min_cell = (min_bound / radius).array().floor();
+  const Eigen::Vector3d num_cells = (max_bound / radius).array().floor() - min_cell.array() + 1.0;
+  const double max_cells = static_cast<double>((int64_t(1) << kCellAxisBits) - 2);  // leaves room for the cells around
+  if (num_cells.maxCoeff() > max_cells)
+  {
+    // too wide a grid to pack, so use a radius query, with one neighbour each
+    Eigen::MatrixXd matrix(3, points.size());
+    for (size_t i = 0; i < points.size(); i++) matrix.col(i) = points[i];
+    NeighbourIndex index(std::move(matrix));
+    Eigen::MatrixXi indices;
+    Eigen::MatrixXd dists2;
+    index.knn(1, indices, dists2, 0.0, radius);
+    for (size_t i = 0; i < points.size(); i++)
+      has_neighbour[i] = indices(0, i) != Nabo::NNSearchD::InvalidIndex && dists2(0, i) < radius * radius;
+    return;
+  }
+  auto cell_of = [&](const Eigen::Vector3d &point) {
+    const Eigen::Vector3d cell = (point / radius).array().floor() - min_cell.array() + 1.0;
+    return Eigen::Matrix<uint64_t, 3, 1>(static_cast<uint64_t>(cell[0]), static_cast<uint64_t>(cell[1]),
+                                         static_cast<uint64_t>(cell[2]));
+  };
+  auto key_of = [](uint64_t x, uint64_t y, uint64_t z) {
+    return x | (y << kCellAxisBits) | (z << (2 * kCellAxisBits));
+  };
+
+  std::vector<CellPoint> cell_points(points.size());
+  size_t num_finite = 0;
+  for (size_t i = 0; i < points.size(); i++)
+  {
+    if (points[i].allFinite())
+    {
+      const Eigen::Matrix<uint64_t, 3, 1> cell = cell_of(points[i]);
+      cell_points[num_finite++] = CellPoint{ key_of(cell[0], cell[1], cell[2]), static_cast<int64_t>(i) };
+    }
+  }
+  cell_points.resize(num_finite);
+#if RAYLIB_WITH_TBB
+  tbb::parallel_sort(cell_points.begin(), cell_points.end());
+#else   // RAYLIB_WITH_TBB
+  std::sort(cell_points.begin(), cell_points.end());
+#endif  // RAYLIB_WITH_TBB
+
+  const double radius2 = radius * radius;
+  parallelFor(size_t(0), cell_points.size(), [&](size_t c) {
+    const Eigen::Vector3d &point = points[cell_points[c].index];
+    const uint64_t key = cell_points[c].key;
+    const uint64_t mask = (uint64_t(1) << kCellAxisBits) - 1;
+    const uint64_t x = key & mask, y = (key >> kCellAxisBits) & mask, z = key >> (2 * kCellAxisBits);
+    for (uint64_t nz = z - 1; nz <= z + 1; nz++)
+    {
+      for (uint64_t ny = y - 1; ny <= y + 1; ny++)
+      {
+        // the three cells of the row are consecutive keys
+        const uint64_t first_key = key_of(x - 1, ny, nz), last_key = key_of(x + 1, ny, nz);
+        auto it = std::lower_bound(cell_points.begin(), cell_points.end(), CellPoint{ first_key, -1 });
+        for (; it != cell_points.end() && it->key <= last_key; ++it)
+        {
+          const double dist2 = (points[it->index] - point).squaredNorm();
+          if (dist2 > 0.0 && dist2 < radius2)
+          {
+            has_neighbour[cell_points[c].index] = 1;
+            return;
+          }
+        }
+      }
+    }
+  });
+}
+}  // namespace ray
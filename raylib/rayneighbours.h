@@ -0,0 +1,97 @@
+// Copyright (c) 2020
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYNEIGHBOURS_H
+#define RAYLIB_RAYNEIGHBOURS_H
+
+#include "raylib/raylibconfig.h"
+
+#include "rayutils.h"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace ray
+{
+/// A nearest neighbour index over a fixed set of points, built once and then queried any number of times.
+/// Queries are batched, with the batch split across threads when built with TBB. Each query's result matches that
+/// of a single libnabo query, with neighbours at equal distances in increasing index order, so results do not depend
+/// on the number of threads. When built WITH_CUDA, large indices are searched exactly on the GPU by
+/// @c GpuNeighbourGrid instead, which orders neighbours in the same way and is within any @c epsilon . The two agree
+/// except at a tie for the k'th neighbour, where which of the tied points a libnabo query keeps may differ.
+/// Neighbour indices are columns of @c points(), and unfilled neighbours are @c Nabo::NNSearchD::InvalidIndex .
+class RAYLIB_EXPORT NeighbourIndex
+{
+public:
+  /// build the index over the columns of @c points . @c ids optionally records an id for each column, typically
+  /// the ray index that the point came from
+  explicit NeighbourIndex(Eigen::MatrixXd points, std::vector<int> ids = std::vector<int>());
+  ~NeighbourIndex();
+
+  /// the @c k nearest neighbours of each column of @c queries , excluding points that coincide with the query.
+  /// @c indices and @c dists2 are resized to @c k by the number of queries, with the neighbours in order of
+  /// increasing squared distance @c dists2 . @c epsilon is the allowed approximation, and if @c max_radius is
+  /// non-zero then only neighbours within this radius are returned, making it a radius query.
+  void knn(const Eigen::MatrixXd &queries, int k, Eigen::MatrixXi &indices, Eigen::MatrixXd &dists2,
+           double epsilon = kNearestNeighbourEpsilon, double max_radius = 0.0) const;
+  /// as above, with the indexed points as the queries
+  void knn(int k, Eigen::MatrixXi &indices, Eigen::MatrixXd &dists2, double epsilon = kNearestNeighbourEpsilon,
+           double max_radius = 0.0) const;
+
+  /// As @c knn with the indexed points as the queries, but a block of points at a time. @c func(begin, end, indices) is
+  /// called for each block of the points from @c begin up to @c end , with their neighbours as the columns of
+  /// @c indices . The blocks are searched and passed to @c func in parallel when built with TBB, so @c func must only
+  /// modify data owned by its block. This holds only a block of neighbours per thread, rather than the matrices for
+  /// every point.
+  void knnBlocks(int k, const std::function<void(Eigen::Index begin, Eigen::Index end, const Eigen::MatrixXi &indices)> &func,
+                 double epsilon = kNearestNeighbourEpsilon, double max_radius = 0.0) const;
+
+  /// the indexed points, one per column
+  inline const Eigen::MatrixXd &points() const { return points_; }
+  /// the id of each indexed point, if given on construction
+  inline const std::vector<int> &ids() const { return ids_; }
+  /// the number of indexed points
+  inline size_t size() const { return static_cast<size_t>(points_.cols()); }
+
+private:
+  struct Tree;
+  Eigen::MatrixXd points_;
+  std::vector<int> ids_;
+  std::unique_ptr<Tree> tree_;
+};
+
+/// Caches the neighbour index of a cloud's ray end points, so that the algorithms run on one cloud share a single
+/// build. There is one index over all the end points and one over only those of the bounded rays. A cached index is
+/// checked against the cloud's current end points on each use, and rebuilt if they have changed.
+class RAYLIB_EXPORT NeighbourIndexCache
+{
+public:
+  NeighbourIndexCache() = default;
+  /// copies share the cached indices, which are immutable
+  NeighbourIndexCache(const NeighbourIndexCache &other);
+  NeighbourIndexCache &operator=(const NeighbourIndexCache &other);
+
+  /// the index of the end points of @c cloud , or only of its bounded rays if @c bounded_only . The ids of the
+  /// index are the ray indices. Instantiated for @c Cloud and @c CompactCloud
+  template <class CloudT>
+  std::shared_ptr<const NeighbourIndex> get(const CloudT &cloud, bool bounded_only);
+  /// release the cached indices
+  void clear();
+
+private:
+  mutable std::mutex mutex_;
+  std::shared_ptr<const NeighbourIndex> indices_[2];  // all end points, then bounded end points
+};
+
+/// Set @c has_neighbour for each of @c points , to whether another point is nearer than @c radius to it, excluding
+/// points that coincide with it as @c NeighbourIndex::knn does. The points are sorted into a grid of @c radius cells,
+/// so each test visits only the adjacent cells, and stops at the first neighbour found. This takes about 16 bytes per
+/// point, rather than the nearest neighbour matrices of a @c knn query. Runs in parallel when built with TBB.
+void RAYLIB_EXPORT findNeighboursWithin(const std::vector<Eigen::Vector3d> &points, double radius,
+                                        std::vector<uint8_t> &has_neighbour);
+}  // namespace ray
+
+#endif  // RAYLIB_RAYNEIGHBOURS_H
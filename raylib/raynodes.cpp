@@ -0,0 +1,115 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raynodes.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+namespace ray
+{
+namespace
+{
+int node_index = 0;
+int node_count = 1;
+
+/// how often node 0 checks for the results of another node
+const std::chrono::milliseconds kPollInterval(500);
+}  // namespace
+
+void Nodes::init(int index, int count)
+{
+  node_count = std::max(count, 1);
+  node_index = std::min(std::max(index, 0), node_count - 1);
+}
+
+void Nodes::initFromArguments(int &argc, char *argv[])
+{
+  for (int i = 1; i < argc - 1; i++)
+  {
+    if (std::strcmp(argv[i], "--node") != 0)
+    {
+      continue;
+    }
+    int index = -1, count = 0;
+    char tail = 0;
+    if (std::sscanf(argv[i + 1], "%d/%d%c", &index, &count, &tail) == 2 && count > 0 && index >= 0 && index < count)
+    {
+      init(index, count);
+      for (int j = i + 2; j <= argc; j++)
+      {
+        argv[j - 2] = argv[j];  // includes the terminating null pointer
+      }
+      argc -= 2;
+    }
+    break;
+  }
+}
+
+int Nodes::index()
+{
+  return node_index;
+}
+
+int Nodes::count()
+{
+  return node_count;
+}
+
+std::string Nodes::resultsName(const std::string &stub, int node)
+{
+  return stub + "_node" + std::to_string(node) + ".results";
+}
+
+bool Nodes::writeResults(const std::string &stub, const void *data, size_t bytes)
+{
+  const std::string name = resultsName(stub, index());
+  const std::string partial_name = name + ".part";
+  std::ofstream out(partial_name, std::ios::binary | std::ios::out | std::ios::trunc);
+  out.write(static_cast<const char *>(data), static_cast<std::streamsize>(bytes));
+  out.close();
+  if (out.fail() || std::rename(partial_name.c_str(), name.c_str()) != 0)
+  {
+    std::cerr << "Error: cannot write node results " << name << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool Nodes::readResults(const std::string &stub, int node, void *data, size_t bytes)
+{
+  const std::string name = resultsName(stub, node);
+  std::ifstream in;
+  bool waited = false;
+  while (true)
+  {
+    in.open(name, std::ios::binary | std::ios::in);
+    if (in.is_open())
+    {
+      break;
+    }
+    if (!waited)
+    {
+      std::cout << "waiting for the results of node " << node << std::endl;
+      waited = true;
+    }
+    std::this_thread::sleep_for(kPollInterval);
+  }
+  in.read(static_cast<char *>(data), static_cast<std::streamsize>(bytes));
+  const bool success = !in.fail();
+  in.close();
+  std::remove(name.c_str());
+  if (!success)
+  {
+    std::cerr << "Error: node results " << name << " are not the expected size" << std::endl;
+  }
+  return success;
+}
+}  // namespace ray
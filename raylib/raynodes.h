@@ -0,0 +1,86 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYNODES_H
+#define RAYLIB_RAYNODES_H
+
+#include "raylib/raylibconfig.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace ray
+{
+/// Spreads the tiles of @c processInTiles over the nodes of a cluster that share a file system. The same command is
+/// run on every node with a @c --node i/N option, and node @c i processes only the tiles whose index is @c i modulo
+/// @c N . Every node streams the whole input file, so the halo rays of its tiles need no exchange. The per-ray results
+/// are then gathered through files on the shared file system: each node other than node 0 writes its results and is
+/// done, while node 0 waits for them, merges them into its own and writes the tool's output. Without the option
+/// there is a single node, and no files are exchanged.
+class RAYLIB_EXPORT Nodes
+{
+public:
+  /// Set this process to be node @c index of @c count nodes
+  static void init(int index, int count);
+
+  /// Remove a @c --node i/N option from the command line arguments, and initialise to node i of N. An option that is
+  /// not a valid node is left in the arguments, for the tool's own argument parsing to reject.
+  static void initFromArguments(int &argc, char *argv[]);
+
+  /// the index of this node
+  static int index();
+  /// the number of nodes
+  static int count();
+  /// whether this node merges the results and writes the output, which is node 0
+  static bool isCoordinator() { return index() == 0; }
+  /// whether this node processes the tile with index @c tile
+  static bool ownsTile(size_t tile) { return static_cast<int>(tile % static_cast<size_t>(count())) == index(); }
+
+  /// Gather the per-ray @c values of every node into node 0's @c values , through files named from @c stub . Each node
+  /// other than node 0 writes its values and returns. Node 0 waits for each node's values in turn, calling
+  /// @c merge(value, other) to merge each of them into its own. The values must be trivially copyable, and the same
+  /// size on each node. Returns false if a file could not be read or written.
+  template <class T, class Merge>
+  static bool gather(const std::string &stub, std::vector<T> &values, const Merge &merge);
+
+  /// the name of the file of the results of @c node , named from @c stub
+  static std::string resultsName(const std::string &stub, int node);
+
+private:
+  /// write @c bytes of @c data as this node's results, renaming once written so that node 0 never reads part of it
+  static bool writeResults(const std::string &stub, const void *data, size_t bytes);
+  /// wait for the results of @c node , then read @c bytes of them into @c data and remove the file
+  static bool readResults(const std::string &stub, int node, void *data, size_t bytes);
+};
+
+template <class T, class Merge>
+bool Nodes::gather(const std::string &stub, std::vector<T> &values, const Merge &merge)
+{
+  if (count() <= 1)
+  {
+    return true;
+  }
+  if (!isCoordinator())
+  {
+    return writeResults(stub, values.data(), values.size() * sizeof(T));
+  }
+  std::vector<T> other(values.size());
+  for (int node = 1; node < count(); node++)
+  {
+    if (!readResults(stub, node, other.data(), other.size() * sizeof(T)))
+    {
+      return false;
+    }
+    for (size_t i = 0; i < values.size(); i++)
+    {
+      merge(values[i], other[i]);
+    }
+  }
+  return true;
+}
+}  // namespace ray
+
+#endif  // RAYLIB_RAYNODES_H
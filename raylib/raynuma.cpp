@@ -0,0 +1,157 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raynuma.h"
+
+#include "raythreads.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif  // defined(__linux__)
+
+namespace ray
+{
+namespace
+{
+std::atomic<int> &placementFlag()
+{
+  static std::atomic<int> placement{ [] {
+    const char *value = std::getenv("RAYCLOUD_NUMA");
+    if (value && std::strcmp(value, "off") == 0)
+      return static_cast<int>(Numa::kOff);
+    if (value && std::strcmp(value, "interleave") == 0)
+      return static_cast<int>(Numa::kInterleave);
+    return static_cast<int>(Numa::kFirstTouch);
+  }() };
+  return placement;
+}
+
+/// parse a sysfs list such as "0-3,8-11" into its numbers
+std::vector<int> parseList(const std::string &text)
+{
+  std::vector<int> numbers;
+  std::stringstream stream(text);
+  std::string range;
+  while (std::getline(stream, range, ','))
+  {
+    const size_t dash = range.find('-');
+    const int first = std::atoi(range.substr(0, dash).c_str());
+    const int last = dash == std::string::npos ? first : std::atoi(range.substr(dash + 1).c_str());
+    for (int i = first; i <= last && !range.empty(); i++) numbers.push_back(i);
+  }
+  return numbers;
+}
+
+std::vector<int> readList(const std::string &file_name)
+{
+  std::ifstream input(file_name);
+  std::string text;
+  if (!std::getline(input, text))
+    return std::vector<int>();
+  return parseList(text);
+}
+
+/// the online memory nodes
+const std::vector<int> &nodes()
+{
+  static const std::vector<int> online = readList("/sys/devices/system/node/online");
+  return online;
+}
+}  // namespace
+
+void Numa::init(Placement placement)
+{
+  placementFlag() = static_cast<int>(placement);
+}
+
+Numa::Placement Numa::placement()
+{
+  return static_cast<Placement>(placementFlag().load());
+}
+
+int Numa::nodeCount()
+{
+  return std::max(1, static_cast<int>(nodes().size()));
+}
+
+std::vector<int> Numa::cpus()
+{
+  std::vector<int> ordered;
+#if defined(__linux__)
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    return ordered;
+  for (const int node : nodes())
+  {
+    for (const int cpu : readList("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"))
+    {
+      if (cpu >= 0 && cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+        ordered.push_back(cpu);
+    }
+  }
+  if (ordered.empty())  // no node topology, so in CPU order
+  {
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+      if (CPU_ISSET(cpu, &allowed))
+        ordered.push_back(cpu);
+    }
+  }
+#endif  // defined(__linux__)
+  return ordered;
+}
+
+void Numa::place(void *data, size_t bytes)
+{
+  const Placement mode = placement();
+  if (mode == kOff || bytes < kMinPlacedBytes || !data)
+    return;
+#if defined(__linux__)
+  // the advice and policy apply to whole pages, so to the pages within the buffer
+  const uintptr_t page_size = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+  const uintptr_t begin = (reinterpret_cast<uintptr_t>(data) + page_size - 1) & ~(page_size - 1);
+  const uintptr_t end = (reinterpret_cast<uintptr_t>(data) + bytes) & ~(page_size - 1);
+  if (end > begin)
+  {
+    void *pages = reinterpret_cast<void *>(begin);
+#if defined(MADV_HUGEPAGE)
+    madvise(pages, end - begin, MADV_HUGEPAGE);
+#endif  // defined(MADV_HUGEPAGE)
+#if defined(SYS_mbind)
+    if (mode == kInterleave && nodeCount() > 1)
+    {
+      const int kMpolInterleave = 3;  // from numaif.h, which needs libnuma
+      const size_t bits_per_word = 8 * sizeof(unsigned long);
+      std::vector<unsigned long> mask(static_cast<size_t>(nodes().back()) / bits_per_word + 1, 0);
+      for (const int node : nodes()) mask[static_cast<size_t>(node) / bits_per_word] |= 1ul << (node % bits_per_word);
+      // a failure leaves the default policy, the first touch below
+      syscall(SYS_mbind, pages, end - begin, kMpolInterleave, mask.data(), mask.size() * bits_per_word + 1, 0);
+    }
+#endif  // defined(SYS_mbind)
+  }
+#endif  // defined(__linux__)
+  // each thread touches one contiguous share, which places the pages on its node under the first touch policy
+  char *first = static_cast<char *>(data);
+  const size_t num_shares = static_cast<size_t>(std::max(1, Threads::threadCount()));
+  parallelFor(size_t(0), num_shares, [&](size_t share) {
+    const size_t share_begin = bytes * share / num_shares;
+    const size_t share_end = bytes * (share + 1) / num_shares;
+    std::memset(first + share_begin, 0, share_end - share_begin);
+  });
+}
+}  // namespace ray
@@ -0,0 +1,77 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYNUMA_H
+#define RAYLIB_RAYNUMA_H
+
+#include "raylib/raylibconfig.h"
+
+#include <cstddef>
+#include <vector>
+
+namespace ray
+{
+/// Placement of the large ray buffers in memory, for machines with several memory nodes (NUMA), such as dual-socket
+/// servers. A buffer filled by one thread has all its pages on that thread's node, and the parallel passes over it
+/// then mostly read remote memory. So new large buffers are first touched by the thread pool, each thread writing a
+/// contiguous share as a parallel for over the elements would, and are hinted to use transparent huge pages. The
+/// environment variable RAYCLOUD_NUMA selects the placement: first_touch (the default), interleave, to spread the
+/// pages evenly over the nodes, or off. See also @c Threads::pin , which keeps the pool's threads on their CPUs so
+/// that they stay beside the pages they touched.
+class RAYLIB_EXPORT Numa
+{
+public:
+  enum Placement
+  {
+    kOff,
+    kFirstTouch,
+    kInterleave
+  };
+  /// buffers smaller than this are left to the allocator, as placing them costs more than it saves
+  static const size_t kMinPlacedBytes = 16 << 20;
+
+  /// set the placement of new buffers, in place of RAYCLOUD_NUMA
+  static void init(Placement placement);
+  /// the placement of new buffers
+  static Placement placement();
+
+  /// the number of memory nodes, 1 on machines that are not NUMA and on platforms other than Linux
+  static int nodeCount();
+  /// the CPUs that this process may run on, ordered by their memory node
+  static std::vector<int> cpus();
+
+  /// Place the @c bytes at @c data , which have not yet been written: hint that they use huge pages, set the
+  /// interleave policy if selected, then touch them in parallel. Buffers under @c kMinPlacedBytes are left as they are.
+  static void place(void *data, size_t bytes);
+};
+
+/// Reserve @c size elements of @c values . Storage that this allocates is placed with @c Numa::place before the
+/// current values are moved into it. The storage is written before its elements are constructed, so this is for the
+/// plain data types of the ray fields.
+template <class T>
+void placedReserve(std::vector<T> &values, size_t size)
+{
+  if (size <= values.capacity() || size * sizeof(T) < Numa::kMinPlacedBytes || Numa::placement() == Numa::kOff)
+  {
+    values.reserve(size);
+    return;
+  }
+  std::vector<T> placed;
+  placed.reserve(size);
+  Numa::place(placed.data(), size * sizeof(T));
+  placed.insert(placed.end(), values.begin(), values.end());
+  values.swap(placed);
+}
+
+/// Resize @c values to @c size , placing any storage that this allocates as @c placedReserve does
+template <class T>
+void placedResize(std::vector<T> &values, size_t size)
+{
+  placedReserve(values, size);
+  values.resize(size);
+}
+}  // namespace ray
+
+#endif  // RAYLIB_RAYNUMA_H
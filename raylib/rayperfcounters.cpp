@@ -0,0 +1,329 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "rayperfcounters.h"
+
+#include "rayprofile.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#if RAYLIB_WITH_TBB
+#include <tbb/task_scheduler_observer.h>
+#endif  // RAYLIB_WITH_TBB
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif  // defined(__linux__)
+
+namespace ray
+{
+namespace
+{
+/// the counted events of each thread, in the order of the @c PerfCounts fields
+const int kNumEvents = 4;
+/// the bytes of a memory controller's column access
+const uint64_t kDramLineBytes = 64;
+
+struct ThreadCounters
+{
+  int index = 0;
+  /// the file of each event, or -1 where the processor lacks it. The first leads the group
+  int files[kNumEvents] = { -1, -1, -1, -1 };
+  /// the counts at the last read, which are kept once the thread has exited
+  uint64_t counts[kNumEvents] = { 0, 0, 0, 0 };
+};
+
+struct CounterData
+{
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadCounters>> threads;
+  std::vector<int> dram_files;
+};
+
+/// kept until exit, as the profile reads it from its own exit handler
+CounterData &counterData()
+{
+  static CounterData *data = new CounterData;
+  return *data;
+}
+
+std::atomic<bool> counting(false);
+std::atomic<bool> dram_measured(false);
+thread_local bool thread_counted = false;
+
+#if defined(__linux__)
+int openEvent(perf_event_attr &attr, pid_t pid, int cpu, int group)
+{
+  return static_cast<int>(syscall(__NR_perf_event_open, &attr, pid, cpu, group, PERF_FLAG_FD_CLOEXEC));
+}
+
+/// open the counters of the calling thread, or return null if the leading cycle counter cannot be opened
+std::unique_ptr<ThreadCounters> openThread(int index)
+{
+  const uint64_t configs[kNumEvents] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                         PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+  std::unique_ptr<ThreadCounters> counters(new ThreadCounters);
+  counters->index = index;
+  for (int i = 0; i < kNumEvents; i++)
+  {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = configs[i];
+    attr.exclude_kernel = 1;  // permitted at the default perf_event_paranoid of 2
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    counters->files[i] = openEvent(attr, 0, -1, i == 0 ? -1 : counters->files[0]);
+    if (i == 0 && counters->files[0] < 0)
+      return nullptr;
+  }
+  return counters;
+}
+
+/// read the group of @c counters , scaled up where the kernel multiplexed it with other groups
+void readThread(ThreadCounters &counters)
+{
+  struct
+  {
+    uint64_t number, time_enabled, time_running;
+    uint64_t values[kNumEvents];
+  } group;
+  const ssize_t size = read(counters.files[0], &group, sizeof(group));
+  if (size < static_cast<ssize_t>(3 * sizeof(uint64_t)) || group.time_running == 0)
+    return;  // keeps the last counts
+  const double scale = static_cast<double>(group.time_enabled) / static_cast<double>(group.time_running);
+  uint64_t value = 0;
+  for (int i = 0; i < kNumEvents; i++)
+  {
+    if (counters.files[i] < 0)
+      continue;
+    if (value >= group.number)
+      break;
+    counters.counts[i] = static_cast<uint64_t>(static_cast<double>(group.values[value++]) * scale);
+  }
+}
+
+std::string readLine(const std::string &file_name)
+{
+  std::ifstream input(file_name);
+  std::string text;
+  std::getline(input, text);
+  return text;
+}
+
+/// the CPUs of a sysfs mask such as "0,28" or "0-1"
+std::vector<int> readCpus(const std::string &file_name)
+{
+  std::vector<int> cpus;
+  std::stringstream stream(readLine(file_name));
+  std::string range;
+  while (std::getline(stream, range, ','))
+  {
+    const size_t dash = range.find('-');
+    const int first = std::atoi(range.substr(0, dash).c_str());
+    const int last = dash == std::string::npos ? first : std::atoi(range.substr(dash + 1).c_str());
+    for (int i = first; i <= last && !range.empty(); i++) cpus.push_back(i);
+  }
+  return cpus;
+}
+
+/// The config of the event in @c spec , such as "event=0x04,umask=0x03", from the bit fields named in the device's
+/// format directory, such as "config:0-7". Returns false for a field outside config.
+bool eventConfig(const std::string &device, const std::string &spec, uint64_t *config)
+{
+  *config = 0;
+  std::stringstream stream(spec);
+  std::string term;
+  while (std::getline(stream, term, ','))
+  {
+    const size_t equals = term.find('=');
+    const std::string format = readLine(device + "/format/" + term.substr(0, equals));
+    if (format.compare(0, 7, "config:") != 0)
+      return false;
+    const int low = std::atoi(format.c_str() + 7);
+    const size_t dash = format.find('-');
+    const int high = dash == std::string::npos ? low : std::atoi(format.c_str() + dash + 1);
+    const uint64_t value = equals == std::string::npos ? 1 : std::strtoull(term.c_str() + equals + 1, nullptr, 0);
+    const uint64_t mask = high - low >= 63 ? ~uint64_t(0) : (uint64_t(1) << (high - low + 1)) - 1;
+    *config |= (value & mask) << low;
+  }
+  return true;
+}
+
+/// Open the read and write column access counters of each memory controller, on one CPU of each socket. All or none
+/// are opened, so that the traffic is not undercounted.
+void openDram(std::vector<int> *files)
+{
+  const std::string root = "/sys/bus/event_source/devices";
+  DIR *devices = opendir(root.c_str());
+  if (!devices)
+    return;
+  bool failed = false;
+  while (dirent *entry = readdir(devices))
+  {
+    const std::string name = entry->d_name;
+    if (name.compare(0, 10, "uncore_imc") != 0 || name.find("free_running") != std::string::npos)
+      continue;
+    const std::string device = root + "/" + name;
+    const int type = std::atoi(readLine(device + "/type").c_str());
+    const std::vector<int> cpus = readCpus(device + "/cpumask");
+    for (const char *event : { "cas_count_read", "cas_count_write" })
+    {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.type = static_cast<uint32_t>(type);
+      attr.size = sizeof(attr);
+      const std::string spec = readLine(device + "/events/" + event);
+      uint64_t config = 0;
+      if (spec.empty() || !eventConfig(device, spec, &config))
+        continue;
+      attr.config = config;
+      for (const int cpu : cpus)
+      {
+        const int file = openEvent(attr, -1, cpu, -1);
+        failed |= file < 0;
+        if (file >= 0)
+          files->push_back(file);
+      }
+    }
+  }
+  closedir(devices);
+  if (failed)
+  {
+    for (const int file : *files) close(file);
+    files->clear();
+  }
+}
+#endif  // defined(__linux__)
+
+#if RAYLIB_WITH_TBB
+/// Opens the counters of each thread as it joins the pool
+class CountingObserver : public tbb::task_scheduler_observer
+{
+public:
+  CountingObserver() { observe(true); }
+  ~CountingObserver() override { observe(false); }
+
+  void on_scheduler_entry(bool) override { PerfCounters::addThread(Profile::threadIndex()); }
+};
+std::unique_ptr<CountingObserver> observer;
+#endif  // RAYLIB_WITH_TBB
+}  // namespace
+
+void PerfCounters::start(bool force)
+{
+  const char *value = std::getenv("RAYCLOUD_PERF_COUNTERS");
+  if (counting || (!force && (!value || std::strcmp(value, "1") != 0)))
+    return;
+#if defined(__linux__)
+  CounterData &data = counterData();
+  {
+    std::lock_guard<std::mutex> lock(data.mutex);
+    std::unique_ptr<ThreadCounters> counters = openThread(Profile::threadIndex());
+    if (!counters)
+      return;
+    data.threads.push_back(std::move(counters));
+    thread_counted = true;
+    openDram(&data.dram_files);
+    dram_measured = !data.dram_files.empty();
+    counting = true;
+  }
+#if RAYLIB_WITH_TBB
+  observer.reset(new CountingObserver);
+#endif  // RAYLIB_WITH_TBB
+#endif  // defined(__linux__)
+}
+
+bool PerfCounters::available()
+{
+  return counting;
+}
+
+bool PerfCounters::dramMeasured()
+{
+  return dram_measured;
+}
+
+void PerfCounters::addThread(int index)
+{
+  if (!counting || thread_counted)
+    return;
+  thread_counted = true;
+#if defined(__linux__)
+  std::unique_ptr<ThreadCounters> counters = openThread(index);
+  if (counters)
+  {
+    CounterData &data = counterData();
+    std::lock_guard<std::mutex> lock(data.mutex);
+    data.threads.push_back(std::move(counters));
+  }
+#else
+  (void)index;
+#endif  // defined(__linux__)
+}
+
+PerfCounts PerfCounters::totals()
+{
+  PerfCounts totals;
+  if (!counting)
+    return totals;
+  for (const auto &thread : threads())
+  {
+    totals.cycles += thread.second.cycles;
+    totals.instructions += thread.second.instructions;
+    totals.llc_misses += thread.second.llc_misses;
+    totals.branch_misses += thread.second.branch_misses;
+  }
+  totals.dram_bytes = totals.llc_misses * kDramLineBytes;
+#if defined(__linux__)
+  if (dram_measured)
+  {
+    CounterData &data = counterData();
+    std::lock_guard<std::mutex> lock(data.mutex);
+    totals.dram_bytes = 0;
+    for (const int file : data.dram_files)
+    {
+      uint64_t count = 0;
+      if (read(file, &count, sizeof(count)) == static_cast<ssize_t>(sizeof(count)))
+        totals.dram_bytes += count * kDramLineBytes;
+    }
+  }
+#endif  // defined(__linux__)
+  return totals;
+}
+
+std::vector<std::pair<int, PerfCounts>> PerfCounters::threads()
+{
+  std::vector<std::pair<int, PerfCounts>> result;
+  if (!counting)
+    return result;
+  CounterData &data = counterData();
+  std::lock_guard<std::mutex> lock(data.mutex);
+  for (const auto &thread : data.threads)
+  {
+#if defined(__linux__)
+    readThread(*thread);
+#endif  // defined(__linux__)
+    PerfCounts counts;
+    counts.cycles = thread->counts[0];
+    counts.instructions = thread->counts[1];
+    counts.llc_misses = thread->counts[2];
+    counts.branch_misses = thread->counts[3];
+    result.emplace_back(thread->index, counts);
+  }
+  return result;
+}
+}  // namespace ray
@@ -0,0 +1,57 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYPERFCOUNTERS_H
+#define RAYLIB_RAYPERFCOUNTERS_H
+
+#include "raylib/raylibconfig.h"
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace ray
+{
+/// Hardware counts, of user space execution
+struct RAYLIB_EXPORT PerfCounts
+{
+  uint64_t cycles = 0;
+  uint64_t instructions = 0;
+  /// last level cache misses
+  uint64_t llc_misses = 0;
+  uint64_t branch_misses = 0;
+  /// the bytes read from and written to memory, by the whole machine
+  uint64_t dram_bytes = 0;
+};
+
+/// Hardware performance counters around the @c Profile phases, through Linux's perf_event_open. Set the environment
+/// variable RAYCLOUD_PERF_COUNTERS=1 with @c --profile to add them to the report, which tells whether a phase is
+/// memory or compute bound: its instructions per cycle, cache and branch misses, and memory bandwidth.
+///
+/// Each thread has its own counters, opened when it first records a phase or joins the TBB pool, and a phase counts
+/// the work of all of these threads over its duration. Other threads, such as those of the ply decoders, are not
+/// counted. Memory traffic is read from the memory controllers of the uncore, which needs a perf_event_paranoid of 0
+/// or CAP_PERFMON. Without them @c dramMeasured() is false and the traffic is estimated as a 64 byte line per last
+/// level cache miss.
+class RAYLIB_EXPORT PerfCounters
+{
+public:
+  /// Start counting, if RAYCLOUD_PERF_COUNTERS=1 is set or @c force is true. @c Profile::enable() calls this.
+  static void start(bool force = false);
+  /// whether counting is on, which needs Linux and a kernel that permits it
+  static bool available();
+  /// whether @c PerfCounts::dram_bytes is measured, rather than estimated from the cache misses
+  static bool dramMeasured();
+
+  /// Open the counters of the calling thread, if it has none yet, labelled as thread @c index of the profile.
+  static void addThread(int index);
+  /// the counts so far of all of the counted threads
+  static PerfCounts totals();
+  /// the counts so far of each counted thread, by its index. The memory traffic is not told apart by thread, so is 0
+  static std::vector<std::pair<int, PerfCounts>> threads();
+};
+}  // namespace ray
+
+#endif  // RAYLIB_RAYPERFCOUNTERS_H
@@ -4,21 +4,39 @@
 //
 // Author: Thomas Lowe
 #include "rayply.h"
+#include "raylib/rayallocprofile.h"
+#include "raylib/rayasyncreader.h"
+#include "raylib/raychunksizer.h"
+#include "raylib/raymappedfile.h"
+#include "raylib/raymemory.h"
+#include "raylib/raynuma.h"
+#include "raylib/rayplyindex.h"
+#include "raylib/rayprofile.h"
 #include "raylib/rayprogress.h"
 #include "raylib/rayprogressthread.h"
+#include "raylib/rayremotefile.h"
+#include "raylib/raythreads.h"
 #include "raymesh.h"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
 // #define OUTPUT_MOMENTS // useful when setting up unit test expected ray clouds
 
 namespace ray
 {
 namespace
 {
-// these are set once and are constant after that
-unsigned long chunk_header_length = 0;
+// these are set once and are constant after that, as every point cloud header is the same length
 unsigned long point_cloud_chunk_header_length = 0;
-unsigned long vertex_size_pos = 0;
 unsigned long point_cloud_vertex_size_pos = 0;
 
 enum DataType
@@ -29,9 +47,755 @@ enum DataType
   kDTuchar,
   kDTnone
 };
+
+/// The layout of the vertex rows of a ply file, as described by its header
+struct PlyLayout
+{
+  size_t row_size = 0;
+  size_t num_rows = 0;
+  int offset = -1;
+  int normal_offset = -1;
+  int time_offset = -1;
+  int colour_offset = -1;
+  int intensity_offset = -1;
+  bool pos_is_float = false;
+  bool normal_is_float = false;
+  bool time_is_float = false;
+  DataType intensity_type = kDTnone;
+  /// the rows are in Morton order of their end points, see Cloud::sortSpatially
+  bool spatially_sorted = false;
+};
+
+/// A contiguous range of rows from the ply body, and the rays decoded from them. These are reused from chunk to
+/// chunk, so that the vectors only allocate on their first use.
+struct PlyChunk
+{
+  /// the position of the chunk in the order that the chunks are read
+  size_t sequence = 0;
+  size_t first_row = 0;
+  size_t num_rows = 0;
+  /// the raw rows. Points into the file mapping, or into @c raw_buffer when read from a stream
+  const unsigned char *rows = nullptr;
+  std::vector<unsigned char> raw_buffer;
+  std::vector<Eigen::Vector3d> starts;
+  std::vector<Eigen::Vector3d> ends;
+  std::vector<double> times;
+  std::vector<RGBA> colours;
+  std::vector<uint8_t> intensities;
+  bool decoded = false;
+};
+
+/// Gives access to the rows of a binary ply body. When raylib is built with an asynchronous reader (see
+/// @c AsyncReader ) the rows are read into the chunk's own buffer with many large reads in flight, to keep fast
+/// storage busy. Otherwise, where possible the rows are read directly from a memory mapping of the file, which avoids
+/// copying every row through the stream buffer, and failing that they are read from the stream into the chunk's
+/// buffer. Chunks must be fetched in increasing row order, but need not be contiguous.
+class PlyRowReader
+{
+public:
+  PlyRowReader(std::istream &input, const std::string &file_name, std::streampos body_start, size_t row_size)
+    : input_(input)
+    , body_start_(body_start)
+    , row_size_(row_size)
+  {
+    if (async_reader_.open(file_name))
+    {
+      return;
+    }
+    if (mapped_file_.open(file_name) && mapped_file_.size() >= static_cast<size_t>(body_start))
+    {
+      body_ = mapped_file_.data() + static_cast<size_t>(body_start);
+    }
+    else
+    {
+      mapped_file_.close();
+    }
+  }
+
+  /// point @c chunk at its rows, reading them from the stream if the file is not mapped
+  void fetch(PlyChunk &chunk)
+  {
+    if (body_)
+    {
+      chunk.rows = body_ + chunk.first_row * row_size_;
+      return;
+    }
+    if (async_reader_.isOpen())
+    {
+      chunk.raw_buffer.resize(chunk.num_rows * row_size_);
+      const size_t num_bytes =
+        async_reader_.read(static_cast<uint64_t>(body_start_) + chunk.first_row * row_size_, chunk.raw_buffer.size(),
+                           chunk.raw_buffer.data());
+      chunk.num_rows = num_bytes / row_size_;
+      chunk.rows = chunk.raw_buffer.data();
+      return;
+    }
+    if (chunk.first_row != next_row_)
+    {
+      input_.seekg(body_start_ + static_cast<std::streamoff>(chunk.first_row * row_size_));
+    }
+    chunk.raw_buffer.resize(chunk.num_rows * row_size_);
+    input_.read(reinterpret_cast<char *>(chunk.raw_buffer.data()), chunk.raw_buffer.size());
+    chunk.num_rows = static_cast<size_t>(input_.gcount()) / row_size_;
+    chunk.rows = chunk.raw_buffer.data();
+    next_row_ = chunk.first_row + chunk.num_rows;
+  }
+
+private:
+  std::istream &input_;
+  std::streampos body_start_;
+  size_t next_row_ = 0;
+  size_t row_size_;
+  MappedFile mapped_file_;
+  const unsigned char *body_ = nullptr;
+  AsyncReader async_reader_;
+};
+
+/// Placeholder field type for a property that is absent from the ply file
+struct PlyNone
+{
+};
+
+/// read a scalar of type @c T from a row. memcpy is used as the fields are not aligned within the row.
+template <typename T>
+inline T readPlyValue(const unsigned char *row, int offset)
+{
+  T value;
+  std::memcpy(&value, row + offset, sizeof(T));
+  return value;
+}
+
+/// read a 3-vector with components of type @c T from a row
+template <typename T>
+inline Eigen::Vector3d readPlyVector(const unsigned char *row, int offset)
+{
+  T xyz[3];
+  std::memcpy(xyz, row + offset, sizeof(xyz));
+  return Eigen::Vector3d(xyz[0], xyz[1], xyz[2]);
+}
+template <>
+inline Eigen::Vector3d readPlyVector<PlyNone>(const unsigned char *, int)
+{
+  return Eigen::Vector3d(0, 0, 0);
+}
+
+template <typename T>
+inline double readPlyTime(const unsigned char *row, int offset)
+{
+  return (double)readPlyValue<T>(row, offset);
+}
+template <>
+inline double readPlyTime<PlyNone>(const unsigned char *, int)
+{
+  return 0.0;
+}
+
+/// read the intensity of a point cloud row, converted to the 8-bit ray cloud alpha value
+template <typename T>
+inline uint8_t readPlyIntensity(const unsigned char *row, int offset, double max_intensity)
+{
+  double intensity = (double)readPlyValue<T>(row, offset);
+  if (intensity >= 0.0)
+  {
+    // only intensity exactly 0 will be used for alpha=0 in uint_8 format.
+    intensity = std::ceil(255.0 * clamped(intensity / max_intensity, 0.0, 1.0));  
+  }
+  // support for special codes for out of range cases, defined by intensity:
+  // -1 non-return of unknown length
+  // -2 the object is within minimum range, so range is not certain but small
+  // -3 outside maximum range, so range is uncertain but large
+  else if (intensity == -1.0) 
+  {
+    intensity = 0.0;
+  }
+  else // here a range is specified, just low certainty. We choose to this range.
+  {
+    intensity = 1.0;
+  }
+  return static_cast<uint8_t>(intensity);
+}
+template <>
+inline uint8_t readPlyIntensity<PlyNone>(const unsigned char *, int, double)
+{
+  return 0;
+}
+
+/// Decode the rows of @c chunk into the chunk's pre-sized ray vectors, for a given set of field types. The types are
+/// compile time parameters so that the row loop has no per-field type checks. The offsets are passed separately
+/// from the layout so that constant offsets can be propagated into the loop for the standard ray cloud layout.
+/// @return the number of valid (non-NaN) rays decoded
+template <typename PosT, typename NormalT, typename TimeT, typename IntensityT>
+inline size_t decodeRowsAt(size_t row_size, int pos_offset, int normal_offset, int time_offset, int colour_offset,
+                           int intensity_offset, double max_intensity, std::atomic_bool &warning_set, PlyChunk &chunk)
+{
+  const bool has_normal = !std::is_same<NormalT, PlyNone>::value;
+  const bool has_colour = colour_offset != -1;
+  const bool has_intensity = !std::is_same<IntensityT, PlyNone>::value;
+  bool warned = warning_set;
+  size_t count = 0;
+  for (size_t r = 0; r < chunk.num_rows; r++)
+  {
+    const unsigned char *row = chunk.rows + r * row_size;
+    const Eigen::Vector3d end = readPlyVector<PosT>(row, pos_offset);
+    const Eigen::Vector3d normal = readPlyVector<NormalT>(row, normal_offset);
+    const bool end_valid = end == end;
+    const bool norm_valid = !has_normal || normal == normal;
+    if (!warned)
+    {
+      const size_t i = chunk.first_row + r;
+      warned = true;
+      if (!end_valid)
+        std::cout << "warning, NANs in point " << i << ", removing all NANs." << std::endl;
+      else if (abs(end[0]) > 100000.0)
+        std::cout << "warning: very large data in point " << i << ", suspicious: " << end.transpose() << std::endl;
+      else if (!norm_valid)
+        std::cout << "warning, NANs in raystart stored in normal " << i << ", removing all such rays." << std::endl;
+      else if (has_normal && abs(normal[0]) > 100000.0)
+        std::cout << "warning: very large data in normal " << i << ", suspicious: " << normal.transpose() << std::endl;
+      else
+        warned = false;
+      if (warned)
+        warning_set = true;
+    }
+    if (!end_valid || !norm_valid)
+      continue;
+
+    chunk.ends[count] = end;
+    chunk.starts[count] = end + normal;
+    chunk.times[count] = readPlyTime<TimeT>(row, time_offset);
+    if (has_colour)
+      chunk.colours[count] = readPlyValue<RGBA>(row, colour_offset);
+    if (has_intensity)
+      chunk.intensities[count] = readPlyIntensity<IntensityT>(row, intensity_offset, max_intensity);
+    count++;
+  }
+  return count;
+}
+
+using PlyDecodeFunction = size_t (*)(const PlyLayout &layout, double max_intensity, std::atomic_bool &warning_set,
+                                     PlyChunk &chunk);
+
+template <typename PosT, typename NormalT, typename TimeT, typename IntensityT>
+size_t decodeRows(const PlyLayout &layout, double max_intensity, std::atomic_bool &warning_set, PlyChunk &chunk)
+{
+  return decodeRowsAt<PosT, NormalT, TimeT, IntensityT>(layout.row_size, layout.offset, layout.normal_offset,
+                                                        layout.time_offset, layout.colour_offset,
+                                                        layout.intensity_offset, max_intensity, warning_set, chunk);
+}
+
+#if RAYLIB_DOUBLE_RAYS
+using RayPlyPosition = double;
+#else
+using RayPlyPosition = float;
+#endif
+// field offsets of the ray cloud layout written by writeRayCloudChunkStart
+const int kRayPlyTimeOffset = 3 * sizeof(RayPlyPosition);
+const int kRayPlyNormalOffset = kRayPlyTimeOffset + sizeof(double);
+const int kRayPlyColourOffset = kRayPlyNormalOffset + 3 * sizeof(float);
+static_assert(kRayPlyColourOffset + sizeof(RGBA) == sizeof(RayPlyEntry), "ray cloud ply layout mismatch");
+
+/// Decoder for the layout written by raycloudtools itself, which is by far the most common. All offsets are
+/// constants here, leaving a tight row loop.
+size_t decodeRayCloudRows(const PlyLayout &, double, std::atomic_bool &warning_set, PlyChunk &chunk)
+{
+  return decodeRowsAt<RayPlyPosition, float, double, PlyNone>(sizeof(RayPlyEntry), 0, kRayPlyNormalOffset,
+                                                                kRayPlyTimeOffset, kRayPlyColourOffset, -1, 0.0,
+                                                                warning_set, chunk);
+}
+
+bool isRayCloudLayout(const PlyLayout &layout)
+{
+  return layout.row_size == sizeof(RayPlyEntry) && layout.offset == 0 &&
+         layout.pos_is_float == std::is_same<RayPlyPosition, float>::value &&
+         layout.time_offset == kRayPlyTimeOffset && !layout.time_is_float &&
+         layout.normal_offset == kRayPlyNormalOffset && layout.normal_is_float &&
+         layout.colour_offset == kRayPlyColourOffset;
+}
+
+/// Selection of the decoder's intensity type. Ray clouds store intensity in the colour alpha, so only point cloud
+/// decoders (those with no normal field) read an intensity property.
+template <typename PosT, typename NormalT, typename TimeT>
+struct PlyIntensitySelect
+{
+  static PlyDecodeFunction select(const PlyLayout &) { return &decodeRows<PosT, NormalT, TimeT, PlyNone>; }
+};
+template <typename PosT, typename TimeT>
+struct PlyIntensitySelect<PosT, PlyNone, TimeT>
+{
+  static PlyDecodeFunction select(const PlyLayout &layout)
+  {
+    if (layout.intensity_offset == -1)
+      return &decodeRows<PosT, PlyNone, TimeT, PlyNone>;
+    switch (layout.intensity_type)
+    {
+    case kDTfloat:
+      return &decodeRows<PosT, PlyNone, TimeT, float>;
+    case kDTdouble:
+      return &decodeRows<PosT, PlyNone, TimeT, double>;
+    case kDTuchar:
+      return &decodeRows<PosT, PlyNone, TimeT, unsigned char>;
+    default:
+      return &decodeRows<PosT, PlyNone, TimeT, unsigned short>;
+    }
+  }
+};
+
+template <typename PosT, typename NormalT>
+PlyDecodeFunction selectTimeDecoder(const PlyLayout &layout)
+{
+  if (layout.time_offset == -1)
+    return PlyIntensitySelect<PosT, NormalT, PlyNone>::select(layout);
+  if (layout.time_is_float)
+    return PlyIntensitySelect<PosT, NormalT, float>::select(layout);
+  return PlyIntensitySelect<PosT, NormalT, double>::select(layout);
+}
+
+template <typename PosT>
+PlyDecodeFunction selectNormalDecoder(const PlyLayout &layout, bool is_ray_cloud)
+{
+  if (!is_ray_cloud)
+    return selectTimeDecoder<PosT, PlyNone>(layout);
+  if (layout.normal_is_float)
+    return selectTimeDecoder<PosT, float>(layout);
+  return selectTimeDecoder<PosT, double>(layout);
+}
+
+/// Choose the row decoder for the file's layout. This is done once per file, rather than per row.
+PlyDecodeFunction selectDecoder(const PlyLayout &layout, bool is_ray_cloud)
+{
+  if (is_ray_cloud && isRayCloudLayout(layout))
+    return &decodeRayCloudRows;
+  if (layout.pos_is_float)
+    return selectNormalDecoder<float>(layout, is_ray_cloud);
+  return selectNormalDecoder<double>(layout, is_ray_cloud);
+}
+
+/// Convert the raw rows of @c chunk into its ray vectors. This is independent per chunk, so may be run concurrently
+/// on different chunks. @c warning_set is shared, so that the warnings are only issued once per file.
+void decodeChunk(PlyDecodeFunction decode, const PlyLayout &layout, bool is_ray_cloud, double max_intensity,
+                 std::atomic_bool &warning_set, PlyChunk &chunk)
+{
+  AllocationCategory category("ply decode");
+  const bool has_intensity = !is_ray_cloud && layout.intensity_offset != -1;
+  // a whole file chunk is decoded by one thread, so its new storage is first placed across the thread pool
+  placedResize(chunk.starts, chunk.num_rows);
+  placedResize(chunk.ends, chunk.num_rows);
+  placedResize(chunk.times, chunk.num_rows);
+  placedResize(chunk.colours, chunk.num_rows);
+  chunk.intensities.resize(has_intensity ? chunk.num_rows : 0);
+
+  const size_t count = decode(layout, max_intensity, warning_set, chunk);
+  chunk.starts.resize(count);
+  chunk.ends.resize(count);
+  chunk.times.resize(count);
+  chunk.colours.resize(count);
+  chunk.intensities.resize(has_intensity ? count : 0);
+
+  if (layout.time_offset == -1)
+  {
+    for (size_t j = 0; j < chunk.times.size(); j++) 
+    {
+      chunk.times[j] = (double)(chunk.first_row + j);
+    }
+  }
+  if (layout.colour_offset == -1)
+  {
+    colourByTime(chunk.times, chunk.colours);
+  }
+  if (has_intensity)
+  {
+    for (size_t j = 0; j < chunk.intensities.size(); j++)
+    {
+      chunk.colours[j].alpha = chunk.intensities[j];
+      // colour zero-intensity rays black. This is a helpful debug tool.
+      if (chunk.intensities[j] == 0)
+      {
+        chunk.colours[j].red = chunk.colours[j].green = chunk.colours[j].blue = 0;
+      }
+    }
+  }
+}
+
+/// Reads, decodes and applies the chunks of a ply body. A reader thread fetches the raw rows, a set of worker threads
+/// decode them, and the calling thread passes the decoded chunks to @c apply in file order. The chunks
+/// form a fixed pool, so at most @c num_workers + 2 chunks are in memory at any time. An exception on any of the
+/// threads stops the pipeline, and is rethrown by @c run once the threads have finished.
+class PlyChunkPipeline
+{
+public:
+  using ApplyFunction = std::function<void(std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                                           std::vector<double> &times, std::vector<RGBA> &colours)>;
+
+  /// split the whole body into chunks of the sizes chosen by @c sizer , or if @c selection is given, use one chunk
+  /// per selected row range
+  PlyChunkPipeline(PlyRowReader &reader, const PlyLayout &layout, bool is_ray_cloud, double max_intensity,
+                   const ChunkSizer &sizer, const std::vector<PlyRowRange> *selection)
+    : reader_(reader)
+    , layout_(layout)
+    , decode_(selectDecoder(layout, is_ray_cloud))
+    , is_ray_cloud_(is_ray_cloud)
+    , max_intensity_(max_intensity)
+    , sizer_(sizer)
+    , use_ranges_(selection != nullptr)
+  {
+    if (selection)
+    {
+      for (const auto &range : *selection)
+      {
+        if (range.first_row < layout.num_rows)
+          ranges_.emplace_back(range.first_row, std::min<size_t>(range.num_rows, layout.num_rows - range.first_row));
+      }
+    }
+  }
+
+  /// the number of decode threads to use. More threads than this show little benefit, as the pipeline is then
+  /// limited by the consumer or the disk.
+  static int defaultWorkerCount()
+  {
+    return std::max(1, std::min(Threads::threadCount() - 1, static_cast<int>(Threads::MaxRecommendedThreads)));
+  }
+
+  /// the number of rows that will be read
+  size_t numRows() const
+  {
+    if (!use_ranges_)
+      return layout_.num_rows;
+    size_t num_rows = 0;
+    for (const auto &range : ranges_) num_rows += range.second;
+    return num_rows;
+  }
+
+  /// pass each chunk to @c apply in row order. If @c ranges_out is given, the row range and bounds of each chunk are
+  /// appended to it.
+  void run(const ApplyFunction &apply, Progress &progress, int num_workers, std::vector<PlyRowRange> *ranges_out)
+  {
+    using Clock = std::chrono::steady_clock;
+    const auto seconds = [](Clock::time_point from, Clock::time_point to) {
+      return std::chrono::duration<double>(to - from).count();
+    };
+    if (num_workers <= 1 || numRows() <= sizer_.size())
+    {
+      // no benefit to threading, so decode each chunk in turn. The consumer then waits for all of the decoding
+      PlyChunk chunk;
+      while (nextRange(chunk))
+      {
+        const Clock::time_point start = Clock::now();
+        reader_.fetch(chunk);
+        decodeChunk(decode_, layout_, is_ray_cloud_, max_intensity_, warning_set_, chunk);
+        const Clock::time_point decoded = Clock::now();
+        if (ranges_out)
+          ranges_out->push_back(summariseChunk(chunk));
+        apply(chunk.starts, chunk.ends, chunk.times, chunk.colours);
+        progress.increment(chunk.num_rows);
+        sizer_.record(seconds(start, decoded), seconds(decoded, Clock::now()));
+      }
+      return;
+    }
+
+    std::vector<PlyChunk> chunks(num_workers + 2);
+    for (auto &chunk : chunks) free_chunks_.push_back(&chunk);
+    {
+      // stops and joins the threads however the consumer loop ends, including by an exception from apply
+      ThreadJoiner joiner(*this);
+      joiner.threads.emplace_back(&PlyChunkPipeline::readChunks, this);
+      for (int i = 0; i < num_workers; i++) joiner.threads.emplace_back(&PlyChunkPipeline::decodeChunks, this);
+
+      for (size_t c = 0;; c++)
+      {
+        PlyChunk *chunk = nullptr;
+        const Clock::time_point wait_start = Clock::now();
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          condition_.wait(lock, [&] {
+            chunk = findDecoded(c);
+            return chunk != nullptr || stopped_ || (reading_finished_ && c >= num_read_);
+          });
+          if (stopped_)
+            break;
+        }
+        if (!chunk)
+          break;
+        const Clock::time_point consume_start = Clock::now();
+        if (ranges_out)
+          ranges_out->push_back(summariseChunk(*chunk));
+        apply(chunk->starts, chunk->ends, chunk->times, chunk->colours);
+        progress.increment(chunk->num_rows);
+        const double consume_seconds = seconds(consume_start, Clock::now());
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          chunk->decoded = false;
+          in_flight_.erase(std::find(in_flight_.begin(), in_flight_.end(), chunk));
+          free_chunks_.push_back(chunk);
+          sizer_.record(seconds(wait_start, consume_start), consume_seconds);
+        }
+        condition_.notify_all();
+      }
+    }
+    if (error_)
+      std::rethrow_exception(error_);
+  }
+
+private:
+  /// The reader and decode threads of a run, which are stopped and joined on destruction
+  struct ThreadJoiner
+  {
+    explicit ThreadJoiner(PlyChunkPipeline &pipeline)
+      : pipeline(pipeline)
+    {}
+    ~ThreadJoiner()
+    {
+      pipeline.stop(nullptr);
+      for (auto &thread : threads) thread.join();
+    }
+    PlyChunkPipeline &pipeline;
+    std::vector<std::thread> threads;
+  };
+
+  /// stop the reader, decoders and consumer, keeping the first @c error , if any, for @c run to rethrow
+  void stop(std::exception_ptr error)
+  {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (error && !error_)
+        error_ = error;
+      stopped_ = true;
+    }
+    condition_.notify_all();
+  }
+
+  /// set the rows of the next chunk to read, returning false once there are none. This is called by one thread at a
+  /// time, and under the lock when the consumer is on another thread.
+  bool nextRange(PlyChunk &chunk)
+  {
+    if (use_ranges_)
+    {
+      if (next_range_ >= ranges_.size())
+        return false;
+      chunk.first_row = ranges_[next_range_].first;
+      chunk.num_rows = ranges_[next_range_].second;
+      next_range_++;
+    }
+    else
+    {
+      if (next_row_ >= layout_.num_rows)
+        return false;
+      chunk.first_row = next_row_;
+      chunk.num_rows = std::min(sizer_.size(), layout_.num_rows - next_row_);
+      next_row_ += chunk.num_rows;
+    }
+    chunk.sequence = num_read_++;
+    return true;
+  }
+
+  PlyChunk *findDecoded(size_t sequence)
+  {
+    for (auto &chunk : in_flight_)
+      if (chunk->decoded && chunk->sequence == sequence)
+        return chunk;
+    return nullptr;
+  }
+
+  /// the rows and bounds of a decoded chunk, as recorded in a ply index
+  static PlyRowRange summariseChunk(const PlyChunk &chunk)
+  {
+    PlyRowRange range;
+    range.first_row = chunk.first_row;
+    range.num_rows = chunk.num_rows;
+    const double min_s = std::numeric_limits<double>::max();
+    const double max_s = std::numeric_limits<double>::lowest();
+    range.rays_bound = Cuboid(Eigen::Vector3d(min_s, min_s, min_s), Eigen::Vector3d(max_s, max_s, max_s));
+    range.min_time = min_s;
+    range.max_time = max_s;
+    for (size_t i = 0; i < chunk.ends.size(); i++)
+    {
+      range.rays_bound.min_bound_ = minVector(range.rays_bound.min_bound_, minVector(chunk.starts[i], chunk.ends[i]));
+      range.rays_bound.max_bound_ = maxVector(range.rays_bound.max_bound_, maxVector(chunk.starts[i], chunk.ends[i]));
+      range.min_time = std::min(range.min_time, chunk.times[i]);
+      range.max_time = std::max(range.max_time, chunk.times[i]);
+    }
+    return range;
+  }
+
+  void readChunks()
+  {
+    try
+    {
+      while (true)
+      {
+        PlyChunk *chunk;
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          condition_.wait(lock, [&] { return !free_chunks_.empty() || stopped_; });
+          if (stopped_)
+            break;
+          chunk = free_chunks_.back();
+          if (!nextRange(*chunk))
+          {
+            reading_finished_ = true;
+            break;
+          }
+          free_chunks_.pop_back();
+        }
+        reader_.fetch(*chunk);
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          in_flight_.push_back(chunk);
+          to_decode_.push_back(chunk);
+        }
+        condition_.notify_all();
+      }
+    }
+    catch (...)
+    {
+      stop(std::current_exception());
+    }
+    condition_.notify_all();
+  }
+
+  void decodeChunks()
+  {
+    try
+    {
+      while (true)
+      {
+        PlyChunk *chunk;
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          condition_.wait(lock, [&] { return !to_decode_.empty() || reading_finished_ || stopped_; });
+          if (to_decode_.empty() || stopped_)
+            return;
+          chunk = to_decode_.front();
+          to_decode_.pop_front();
+        }
+        decodeChunk(decode_, layout_, is_ray_cloud_, max_intensity_, warning_set_, *chunk);
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          chunk->decoded = true;
+        }
+        condition_.notify_all();
+      }
+    }
+    catch (...)
+    {
+      stop(std::current_exception());
+    }
+  }
+
+  PlyRowReader &reader_;
+  const PlyLayout &layout_;
+  PlyDecodeFunction decode_;
+  bool is_ray_cloud_;
+  double max_intensity_;
+  /// chooses the number of rows of each chunk, when there is no selection
+  ChunkSizer sizer_;
+  /// the first row and number of rows of each selected chunk
+  bool use_ranges_;
+  std::vector<std::pair<size_t, size_t>> ranges_;
+  size_t next_range_ = 0;
+  size_t next_row_ = 0;
+  /// the number of chunks given out to be read
+  size_t num_read_ = 0;
+  std::atomic_bool warning_set_{ false };
+
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::vector<PlyChunk *> free_chunks_;
+  std::deque<PlyChunk *> to_decode_;
+  std::vector<PlyChunk *> in_flight_;
+  bool reading_finished_ = false;
+  /// set when the pipeline is to stop early, by an exception on a thread or on leaving @c run
+  bool stopped_ = false;
+  /// the first exception thrown on a reader or decode thread
+  std::exception_ptr error_;
+};
+
+/// Read the header of a binary ply file, leaving @c input at the start of the body, whose position is @c start
+/// the header comment marking a ray cloud whose rays are in Morton order
+const std::string kSpatiallySortedComment = "comment spatially sorted";
+
+bool readPlyHeader(std::istream &input, const std::string &file_name, bool is_ray_cloud, PlyLayout &layout,
+                   std::streampos &start)
+{
+  std::string line;
+  int row_size = 0;
+  int rowsteps[] = { int(sizeof(float)), int(sizeof(double)), int(sizeof(unsigned short)), int(sizeof(unsigned char)),
+                     0 };  // to match each DataType enum
+
+  while (line != "end_header\r" && line != "end_header")
+  {
+    if (!getline(input, line))
+    {
+      break;
+    }
+    if (line.compare(0, kSpatiallySortedComment.size(), kSpatiallySortedComment) == 0)
+    {
+      layout.spatially_sorted = true;
+      continue;
+    }
+    // support multiple data types
+    DataType data_type = kDTnone;
+    if (line.find("property float") != std::string::npos)
+      data_type = kDTfloat;
+    else if (line.find("property double") != std::string::npos)
+      data_type = kDTdouble;
+    else if (line.find("property uchar") != std::string::npos)
+      data_type = kDTuchar;
+    else if (line.find("property ushort") != std::string::npos)
+      data_type = kDTushort;
+
+    if (line.find("property float x") != std::string::npos || line.find("property double x") != std::string::npos)
+    {
+      layout.offset = row_size;
+      if (line.find("float") != std::string::npos)
+        layout.pos_is_float = true;
+    }
+    if (line.find("property float nx") != std::string::npos || line.find("property double nx") != std::string::npos)
+    {
+      layout.normal_offset = row_size;
+      if (line.find("float") != std::string::npos)
+        layout.normal_is_float = true;
+    }
+    if (line.find("time") != std::string::npos)
+    {
+      layout.time_offset = row_size;
+      if (line.find("float") != std::string::npos)
+        layout.time_is_float = true;
+    }
+    if (line.find("intensity") != std::string::npos)
+    {
+      layout.intensity_offset = row_size;
+      layout.intensity_type = data_type;
+    }
+    if (line.find("property uchar red") != std::string::npos)
+      layout.colour_offset = row_size;
+
+    row_size += rowsteps[data_type];
+  }
+  if (layout.offset == -1)
+  {
+    std::cerr << "could not find position properties of file: " << file_name << std::endl;
+    return false;
+  }
+  if (is_ray_cloud && layout.normal_offset == -1)
+  {
+    std::cerr << "could not find normal properties of file: " << file_name << std::endl;
+    std::cerr << "ray clouds store the ray starts using the normal field" << std::endl;
+    return false;
+  }
+
+  start = input.tellg();
+  input.seekg(0, input.end);
+  size_t length = input.tellg() - start;
+  input.seekg(start);
+  layout.row_size = row_size;
+  layout.num_rows = length / row_size;
+  return true;
+}
+
 }  // namespace
 
-bool writeRayCloudChunkStart(const std::string &file_name, std::ofstream &out)
+bool writeRayCloudChunkStart(const std::string &file_name, std::ofstream &out, RayPlyHeader &header,
+                             bool spatially_sorted)
 {
   int num_zeros = std::numeric_limits<unsigned long>::digits10;
   out.open(file_name, std::ios::binary | std::ios::out);
@@ -43,10 +807,12 @@ bool writeRayCloudChunkStart(const std::string &file_name, std::ofstream &out)
   out << "ply" << std::endl;
   out << "format binary_little_endian 1.0" << std::endl;
   out << "comment generated by raycloudtools library" << std::endl;
+  if (spatially_sorted)
+    out << kSpatiallySortedComment << std::endl;
   out << "element vertex ";
   for (int i = 0; i < num_zeros; i++)
     out << "0";  // fill in with zeros. I will replace rightmost characters later, to give actual number
-  vertex_size_pos = out.tellp();
+  header.vertex_size_pos = out.tellp();
   out << std::endl;
 #if RAYLIB_DOUBLE_RAYS
   out << "property double x" << std::endl;
@@ -66,50 +832,55 @@ bool writeRayCloudChunkStart(const std::string &file_name, std::ofstream &out)
   out << "property uchar blue" << std::endl;
   out << "property uchar alpha" << std::endl;
   out << "end_header" << std::endl;
-  chunk_header_length = out.tellp();
+  header.length = out.tellp();
   return true;
 }
 
-bool writeRayCloudChunk(std::ofstream &out, RayPlyBuffer &vertices, const std::vector<Eigen::Vector3d> &starts,
-                        const std::vector<Eigen::Vector3d> &ends, const std::vector<double> &times,
-                        const std::vector<RGBA> &colours, bool &has_warned)
+void encodeRayCloudChunk(RayPlyBuffer &vertices, const std::vector<Eigen::Vector3d> &starts,
+                         const std::vector<Eigen::Vector3d> &ends, const std::vector<double> &times,
+                         const std::vector<RGBA> &colours, bool &has_warned)
 {
-  if (ends.size() == 0)
-  {
-    // this is not an error. Allowing empty chunks avoids wrapping every call to writeRayCloudChunk in a condition
-    return true;
-  }
-  if (out.tellp() < (long)chunk_header_length)
-  {
-    std::cerr << "Error: file header has not been written, use writeRayCloudChunkStart" << std::endl;
-    return false;
-  }
   vertices.resize(ends.size());
-
-  for (size_t i = 0; i < ends.size(); i++)
+  if (!has_warned)
   {
-    if (!has_warned)
+    // find the first suspicious ray, and warn of it alone, as a serial scan would
+    auto suspicious = [&](size_t i) {
+#if !RAYLIB_DOUBLE_RAYS
+      if (abs(ends[i][0]) > 100000.0)
+        return true;
+#endif
+      return !(ends[i] == ends[i]) || !(starts[i] == starts[i]);
+    };
+    const size_t first = parallelReduce(
+      size_t(0), ends.size(), ends.size(),
+      [&](size_t i, size_t &value) {
+        if (i < value && suspicious(i))
+          value = i;
+      },
+      [](size_t a, size_t b) { return std::min(a, b); });
+    if (first < ends.size())
     {
+      const size_t i = first;
       if (!(ends[i] == ends[i]))
       {
         std::cout << "WARNING: nans in point: " << i << ": " << ends[i].transpose() << std::endl;
-        has_warned = true;
       }
 #if !RAYLIB_DOUBLE_RAYS
       if (abs(ends[i][0]) > 100000.0)
       {
         std::cout << "WARNING: very large point location at: " << i << ": " << ends[i].transpose() << ", suspicious"
                   << std::endl;
-        has_warned = true;
       }
 #endif
-      bool b = starts[i] == starts[i];
-      if (!b)
+      if (!(starts[i] == starts[i]))
       {
         std::cout << "WARNING: nans in start: " << i << ": " << starts[i].transpose() << std::endl;
-        has_warned = true;
       }
+      has_warned = true;
     }
+  }
+
+  parallelFor(size_t(0), ends.size(), [&](size_t i) {
     Eigen::Vector3d n = starts[i] - ends[i];
     union U  // TODO: this is nasty, better to just make vertices an unsigned char vector
     {
@@ -125,37 +896,94 @@ bool writeRayCloudChunk(std::ofstream &out, RayPlyBuffer &vertices, const std::v
     end1.d = ends[i][1];
     end2.d = ends[i][2];
     vertices[i] << end0.f[0], end0.f[1], end1.f[0], end1.f[1], end2.f[0], end2.f[1], u.f[0], u.f[1], (float)n[0],
-      (float)n[1], (float)n[2], (float &)colours[i];
+      (float)n[1], (float)n[2], (const float &)colours[i];
 #else
     vertices[i] << (float)ends[i][0], (float)ends[i][1], (float)ends[i][2], u.f[0], u.f[1], (float)n[0], (float)n[1],
-      (float)n[2], (float &)colours[i];
+      (float)n[2], (const float &)colours[i];
 #endif
+  });
+}
+
+bool writeRayCloudRows(std::ofstream &out, const RayPlyBuffer &vertices)
+{
+  if (vertices.empty())
+  {
+    return true;
+  }
+  if (!out.is_open() || out.tellp() <= 0)
+  {
+    std::cerr << "Error: file header has not been written, use writeRayCloudChunkStart" << std::endl;
+    return false;
+  }
+  out.write((const char *)&vertices[0], sizeof(RayPlyEntry) * vertices.size());
+  if (!out.good())
+  {
+    std::cerr << "error writing to file" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool writeRayCloudChunk(std::ofstream &out, RayPlyBuffer &vertices, const std::vector<Eigen::Vector3d> &starts,
+                        const std::vector<Eigen::Vector3d> &ends, const std::vector<double> &times,
+                        const std::vector<RGBA> &colours, bool &has_warned)
+{
+  if (ends.size() == 0)
+  {
+    // this is not an error. Allowing empty chunks avoids wrapping every call to writeRayCloudChunk in a condition
+    return true;
   }
-  out.write((const char *)&vertices[0], sizeof(RayPlyEntry) * vertices.size());
-  if (!out.good())
+  if (!out.is_open() || out.tellp() <= 0)
   {
-    std::cerr << "error writing to file" << std::endl;
+    std::cerr << "Error: file header has not been written, use writeRayCloudChunkStart" << std::endl;
     return false;
   }
-  return true;
+  encodeRayCloudChunk(vertices, starts, ends, times, colours, has_warned);
+  return writeRayCloudRows(out, vertices);
 }
 
-unsigned long writeRayCloudChunkEnd(std::ofstream &out)
+unsigned long writeRayCloudChunkEnd(std::ofstream &out, const RayPlyHeader &header)
 {
-  const unsigned long size = static_cast<unsigned long>(out.tellp()) - chunk_header_length;
+  const unsigned long size = static_cast<unsigned long>(out.tellp()) - header.length;
   const unsigned long number_of_rays = size / sizeof(RayPlyEntry);
   std::stringstream stream;
   stream << number_of_rays;
   std::string str = stream.str();
-  out.seekp(vertex_size_pos - str.length());
+  out.seekp(header.vertex_size_pos - str.length());
   out << str;
   return number_of_rays;
 }
 
+void decodeRayCloudChunk(const RayPlyBuffer &vertices, std::vector<Eigen::Vector3d> &starts,
+                         std::vector<Eigen::Vector3d> &ends, std::vector<double> &times, std::vector<RGBA> &colours)
+{
+  PlyChunk chunk;
+  chunk.num_rows = vertices.size();
+  chunk.rows = reinterpret_cast<const unsigned char *>(vertices.data());
+  chunk.starts.swap(starts);
+  chunk.ends.swap(ends);
+  chunk.times.swap(times);
+  chunk.colours.swap(colours);
+  chunk.starts.resize(chunk.num_rows);
+  chunk.ends.resize(chunk.num_rows);
+  chunk.times.resize(chunk.num_rows);
+  chunk.colours.resize(chunk.num_rows);
+  std::atomic_bool warning_set(true);  // the writer has already warned of these rows
+  const size_t count = decodeRayCloudRows(PlyLayout(), 0.0, warning_set, chunk);
+  chunk.starts.resize(count);
+  chunk.ends.resize(count);
+  chunk.times.resize(count);
+  chunk.colours.resize(count);
+  starts.swap(chunk.starts);
+  ends.swap(chunk.ends);
+  times.swap(chunk.times);
+  colours.swap(chunk.colours);
+}
+
 // Save the polygon file to disk
 bool writePlyRayCloud(const std::string &file_name, const std::vector<Eigen::Vector3d> &starts,
                       const std::vector<Eigen::Vector3d> &ends, const std::vector<double> &times,
-                      const std::vector<RGBA> &colours)
+                      const std::vector<RGBA> &colours, bool spatially_sorted)
 {
   std::vector<RGBA> rgb(times.size());
   if (colours.size() > 0)
@@ -164,7 +992,8 @@ bool writePlyRayCloud(const std::string &file_name, const std::vector<Eigen::Vec
     colourByTime(times, rgb);
 
   std::ofstream ofs;
-  if (!writeRayCloudChunkStart(file_name, ofs))
+  RayPlyHeader header;
+  if (!writeRayCloudChunkStart(file_name, ofs, header, spatially_sorted))
     return false;
   RayPlyBuffer buffer;
   bool has_warned = false;
@@ -173,7 +1002,7 @@ bool writePlyRayCloud(const std::string &file_name, const std::vector<Eigen::Vec
   {
     return false;
   }
-  const unsigned long num_rays = ray::writeRayCloudChunkEnd(ofs);
+  const unsigned long num_rays = ray::writeRayCloudChunkEnd(ofs, header);
   std::cout << num_rays << " rays saved to " << file_name << std::endl;
   return true;
 }
@@ -323,113 +1152,42 @@ bool readPly(const std::string &file_name, bool is_ray_cloud,
                                 std::vector<double> &times, std::vector<RGBA> &colours)>
                apply,
              double max_intensity, size_t chunk_size)
+{
+  return readPlyRows(file_name, is_ray_cloud, apply, max_intensity, chunk_size, nullptr, nullptr);
+}
+
+bool readPlyRows(const std::string &file_name, bool is_ray_cloud,
+                 std::function<void(std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                                    std::vector<double> &times, std::vector<RGBA> &colours)>
+                   apply,
+                 double max_intensity, size_t chunk_size, const std::vector<PlyRowRange> *selection,
+                 std::vector<PlyRowRange> *ranges_out)
 {
   std::cout << "reading: " << file_name << std::endl;
-  std::ifstream input(file_name.c_str());
+  InputFile input(file_name, std::ios::in);
   if (input.fail())
   {
     std::cerr << "Couldn't open file: " << file_name << std::endl;
     return false;
   }
-  std::string line;
-  int row_size = 0;
-  int offset = -1, normal_offset = -1, time_offset = -1, colour_offset = -1;
-  int intensity_offset = -1;
-  bool time_is_float = false;
-  bool pos_is_float = false;
-  bool normal_is_float = false;
-  DataType intensity_type = kDTnone;
-  int rowsteps[] = { int(sizeof(float)), int(sizeof(double)), int(sizeof(unsigned short)), int(sizeof(unsigned char)),
-                     0 };  // to match each DataType enum
-
-  while (line != "end_header\r" && line != "end_header")
-  {
-    if (!getline(input, line))
-    {
-      break;
-    }
-    // support multiple data types
-    DataType data_type = kDTnone;
-    if (line.find("property float") != std::string::npos)
-      data_type = kDTfloat;
-    else if (line.find("property double") != std::string::npos)
-      data_type = kDTdouble;
-    else if (line.find("property uchar") != std::string::npos)
-      data_type = kDTuchar;
-    else if (line.find("property ushort") != std::string::npos)
-      data_type = kDTushort;
-
-    if (line.find("property float x") != std::string::npos || line.find("property double x") != std::string::npos)
-    {
-      offset = row_size;
-      if (line.find("float") != std::string::npos)
-        pos_is_float = true;
-    }
-    if (line.find("property float nx") != std::string::npos || line.find("property double nx") != std::string::npos)
-    {
-      normal_offset = row_size;
-      if (line.find("float") != std::string::npos)
-        normal_is_float = true;
-    }
-    if (line.find("time") != std::string::npos)
-    {
-      time_offset = row_size;
-      if (line.find("float") != std::string::npos)
-        time_is_float = true;
-    }
-    if (line.find("intensity") != std::string::npos)
-    {
-      intensity_offset = row_size;
-      intensity_type = data_type;
-    }
-    if (line.find("property uchar red") != std::string::npos)
-      colour_offset = row_size;
-
-    row_size += rowsteps[data_type];
-  }
-  if (offset == -1)
-  {
-    std::cerr << "could not find position properties of file: " << file_name << std::endl;
-    return false;
-  }
-  if (is_ray_cloud && normal_offset == -1)
+  PlyLayout layout;
+  std::streampos start;
+  if (!readPlyHeader(input, file_name, is_ray_cloud, layout, start))
   {
-    std::cerr << "could not find normal properties of file: " << file_name << std::endl;
-    std::cerr << "ray clouds store the ray starts using the normal field" << std::endl;
     return false;
   }
 
-  std::streampos start = input.tellg();
-  input.seekg(0, input.end);
-  size_t length = input.tellg() - start;
-  input.seekg(start);
-  size_t size = length / row_size;
-
-  ray::Progress progress;
-  ray::ProgressThread progress_thread(progress);
-  size_t num_chunks = (size + (chunk_size - 1)) / chunk_size;
-  progress.begin("read and process", num_chunks);
-
-  std::vector<unsigned char> vertices(row_size);
-  size_t num_bounded = 0;
-  size_t num_unbounded = 0;
-  bool warning_set = false;
-  if (size == 0)
+  if (layout.num_rows == 0)
   {
     std::cerr << "no entries found in ply file" << std::endl;
     return false;
   }
-  if (time_offset == -1)
-  {
-    //    std::cerr << "error: no time information found in " << file_name << std::endl;
-    //    return false;
-  }
-  if (colour_offset == -1)
+  if (layout.colour_offset == -1)
     std::cout << "warning: no colour information found in " << file_name
               << ", setting colours red->green->blue based on time" << std::endl;
-  if (!is_ray_cloud && intensity_offset != -1)
+  if (!is_ray_cloud && layout.intensity_offset != -1)
   {
-    if (colour_offset != -1)
+    if (layout.colour_offset != -1)
       std::cout << "warning: intensity and colour information both found in file. Replacing alpha with intensity value."
                 << std::endl;
     else
@@ -437,166 +1195,20 @@ bool readPly(const std::string &file_name, bool is_ray_cloud,
                 << std::endl;
   }
 
-  // pre-reserving avoids memory fragmentation
-  std::vector<Eigen::Vector3d> ends;
-  std::vector<Eigen::Vector3d> starts;
-  std::vector<double> times;
-  std::vector<ray::RGBA> colours;
-  std::vector<uint8_t> intensities;
-  size_t reserve_size = std::min(chunk_size, size);
-  ends.reserve(reserve_size);
-  starts.reserve(reserve_size);
-  if (time_offset != -1)
-    times.reserve(reserve_size);
-  if (colour_offset != -1)
-    colours.reserve(reserve_size);
-  if (intensity_offset != -1)
-    intensities.reserve(reserve_size);
-  for (size_t i = 0; i < size; i++)
-  {
-    input.read((char *)&vertices[0], row_size);
-    Eigen::Vector3d end;
-    if (pos_is_float)
-    {
-      Eigen::Vector3f e = (Eigen::Vector3f &)vertices[offset];
-      end = Eigen::Vector3d(e[0], e[1], e[2]);
-    }
-    else
-      end = (Eigen::Vector3d &)vertices[offset];
-    bool end_valid = end == end;
-    if (!warning_set)
-    {
-      if (!end_valid)
-      {
-        std::cout << "warning, NANs in point " << i << ", removing all NANs." << std::endl;
-        warning_set = true;
-      }
-      if (abs(end[0]) > 100000.0)
-      {
-        std::cout << "warning: very large data in point " << i << ", suspicious: " << end.transpose() << std::endl;
-        warning_set = true;
-      }
-    }
-    if (!end_valid)
-      continue;
-
-    Eigen::Vector3d normal(0, 0, 0);
-    if (is_ray_cloud)
-    {
-      if (normal_is_float)
-      {
-        Eigen::Vector3f n = (Eigen::Vector3f &)vertices[normal_offset];
-        normal = Eigen::Vector3d(n[0], n[1], n[2]);
-      }
-      else
-        normal = (Eigen::Vector3d &)vertices[normal_offset];
-      bool norm_valid = normal == normal;
-      if (!warning_set)
-      {
-        if (!norm_valid)
-        {
-          std::cout << "warning, NANs in raystart stored in normal " << i << ", removing all such rays." << std::endl;
-          warning_set = true;
-        }
-        if (abs(normal[0]) > 100000.0)
-        {
-          std::cout << "warning: very large data in normal " << i << ", suspicious: " << normal.transpose()
-                    << std::endl;
-          warning_set = true;
-        }
-      }
-      if (!norm_valid)
-        continue;
-    }
-
-    ends.push_back(end);
-    if (time_offset != -1)
-    {
-      double time;
-      if (time_is_float)
-        time = (double)((float &)vertices[time_offset]);
-      else
-        time = (double &)vertices[time_offset];
-      times.push_back(time);
-    }
-    starts.push_back(end + normal);
+  PlyRowReader row_reader(input, file_name, start, layout.row_size);
+  // adaptive chunks fit the memory budget, each chunk in flight holding its rows and their decoded rays. A chunk size
+  // given by the caller is kept, as some callers need the whole file in one chunk
+  const size_t max_chunk_size =
+    MemoryBudget::chunkRays(ChunkSizer::kMaxChunkSize, layout.row_size + MemoryBudget::kCloudBytesPerRay,
+                            static_cast<size_t>(PlyChunkPipeline::defaultWorkerCount()) + 2);
+  const ChunkSizer sizer(chunk_size == ChunkSizer::kAdaptive ? chunk_size : std::min(chunk_size, layout.num_rows),
+                         max_chunk_size);
+  PlyChunkPipeline pipeline(row_reader, layout, is_ray_cloud, max_intensity, sizer, selection);
 
-    if (colour_offset != -1)
-    {
-      RGBA colour = (RGBA &)vertices[colour_offset];
-      colours.push_back(colour);
-      if (colour.alpha > 0)
-        num_bounded++;
-      else
-        num_unbounded++;
-    }
-    if (!is_ray_cloud)
-    {
-      if (intensity_offset != -1)
-      {
-        double intensity;
-        if (intensity_type == kDTfloat)
-          intensity = (double)((float &)vertices[intensity_offset]);
-        else if (intensity_type == kDTdouble)
-          intensity = (double &)vertices[intensity_offset];
-        else  // (intensity_type == kDTushort)
-          intensity = (double)((unsigned short &)vertices[intensity_offset]);
-        if (intensity >= 0.0)
-        {
-          // only intensity exactly 0 will be used for alpha=0 in uint_8 format.
-          intensity = std::ceil(255.0 * clamped(intensity / max_intensity, 0.0, 1.0));  
-        }
-        // support for special codes for out of range cases, defined by intensity:
-        // -1 non-return of unknown length
-        // -2 the object is within minimum range, so range is not certain but small
-        // -3 outside maximum range, so range is uncertain but large
-        else if (intensity == -1.0) 
-        {
-          intensity = 0.0;
-        }
-        else // here a range is specified, just low certainty. We choose to this range.
-        {
-          intensity = 1.0;
-        }
-        intensities.push_back(static_cast<uint8_t>(intensity));
-      }
-    }
-    if (ends.size() == chunk_size || i == size - 1)
-    {
-      if (time_offset == -1)
-      {
-        times.resize(ends.size());
-        for (size_t j = 0; j < times.size(); j++) 
-        {
-          times[j] = (double)(i + j);
-        }
-      }
-      if (colour_offset == -1)
-      {
-        colourByTime(times, colours);
-        num_bounded = ends.size();
-      }
-      if (!is_ray_cloud && intensity_offset != -1)
-      {
-        for (size_t j = 0; j < intensities.size(); j++)
-        {
-          colours[j].alpha = intensities[j];
-          // colour zero-intensity rays black. This is a helpful debug tool.
-          if (intensities[j] == 0)
-          {
-            colours[j].red = colours[j].green = colours[j].blue = 0;
-          }
-        }
-      }
-      apply(starts, ends, times, colours);
-      starts.clear();
-      ends.clear();
-      times.clear();
-      colours.clear();
-      intensities.clear();
-      progress.increment();
-    }
-  }
+  ray::Progress progress;
+  ray::ProgressThread progress_thread(progress);
+  progress.begin("read and process", pipeline.numRows());
+  pipeline.run(apply, progress, PlyChunkPipeline::defaultWorkerCount(), ranges_out);
   progress.end();
   progress_thread.requestQuit();
   progress_thread.join();
@@ -604,6 +1216,27 @@ bool readPly(const std::string &file_name, bool is_ray_cloud,
   return true;
 }
 
+bool readPlyRowCount(const std::string &file_name, bool is_ray_cloud, uint64_t &num_rows)
+{
+  InputFile input(file_name);
+  PlyLayout layout;
+  std::streampos start;
+  if (input.fail() || !readPlyHeader(input, file_name, is_ray_cloud, layout, start))
+  {
+    return false;
+  }
+  num_rows = layout.num_rows;
+  return true;
+}
+
+bool readPlySpatiallySorted(const std::string &file_name)
+{
+  InputFile input(file_name);
+  PlyLayout layout;
+  std::streampos start;
+  return !input.fail() && readPlyHeader(input, file_name, true, layout, start) && layout.spatially_sorted;
+}
+
 bool readPly(const std::string &file_name, std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
              std::vector<double> &times, std::vector<RGBA> &colours, bool is_ray_cloud, double max_intensity)
 {
@@ -629,25 +1262,23 @@ bool writePlyMesh(const std::string &file_name, const Mesh &mesh, bool flip_norm
     std::cout << "Warning: mesh is empty or too small to save. Num vertices: " << mesh.vertices().size() << std::endl;
     return false;
   }
+  ProfileScope profile("writePlyMesh");
+  profile.count(mesh.indexList().size());
 
   std::vector<Eigen::Vector4f> vertices(mesh.vertices().size());  // 4d to give space for colour
-  if (mesh.colours().size() > 0)                                  // support per-triangle colours on meshes
-  {
-    for (size_t i = 0; i < mesh.vertices().size(); i++)
-    {
-      vertices[i] << (float)mesh.vertices()[i][0], (float)mesh.vertices()[i][1], (float)mesh.vertices()[i][2],
-        (float &)mesh.colours()[i];
-    }
-  }
-  else
-  {
-    for (size_t i = 0; i < mesh.vertices().size(); i++)
-    {
-      vertices[i] << (float)mesh.vertices()[i][0], (float)mesh.vertices()[i][1], (float)mesh.vertices()[i][2], 1.0;
-    }
-  }
+  const bool has_colours = mesh.colours().size() > 0;             // support per-triangle colours on meshes
+  parallelFor(0, static_cast<int>(vertices.size()), [&](int i) {
+    const Eigen::Vector3d &pos = mesh.vertices()[i];
+    vertices[i] << (float)pos[0], (float)pos[1], (float)pos[2], has_colours ? (float &)mesh.colours()[i] : 1.0f;
+  });
+  std::vector<Eigen::Vector4i> triangles(mesh.indexList().size());
+  auto &list = mesh.indexList();
+  parallelFor(0, static_cast<int>(list.size()), [&](int i) {
+    triangles[i] = flip_normals ? Eigen::Vector4i(3, list[i][2], list[i][1], list[i][0])
+                                : Eigen::Vector4i(3, list[i][0], list[i][1], list[i][2]);
+  });
 
-  FILE *fid = fopen(file_name.c_str(), "w+");
+  FILE *fid = fopen(file_name.c_str(), "wb");
   if (!fid)
   {
     std::cerr << "error opening file " << file_name << " for writing." << std::endl;
@@ -668,17 +1299,11 @@ bool writePlyMesh(const std::string &file_name, const Mesh &mesh, bool flip_norm
   fprintf(fid, "property list int int vertex_indices\n");
   fprintf(fid, "end_header\n");
 
-  fwrite(&vertices[0], sizeof(Eigen::Vector4f), vertices.size(), fid);
-
-  std::vector<Eigen::Vector4i> triangles(mesh.indexList().size());
-  auto &list = mesh.indexList();
-  if (flip_normals)
-    for (size_t i = 0; i < list.size(); i++) triangles[i] = Eigen::Vector4i(3, list[i][2], list[i][1], list[i][0]);
-  else
-    for (size_t i = 0; i < list.size(); i++) triangles[i] = Eigen::Vector4i(3, list[i][0], list[i][1], list[i][2]);
-  size_t written = fwrite(&triangles[0], sizeof(Eigen::Vector4i), triangles.size(), fid);
-  fclose(fid);
-  if (written == 0)
+  // each array is written as a single block
+  size_t written = fwrite(vertices.data(), sizeof(Eigen::Vector4f), vertices.size(), fid);
+  written += fwrite(triangles.data(), sizeof(Eigen::Vector4i), triangles.size(), fid);
+  const bool closed = fclose(fid) == 0;
+  if (written != vertices.size() + triangles.size() || !closed)
   {
     std::cerr << "Error writing to file " << file_name << std::endl;
     return false;
@@ -696,60 +1321,233 @@ bool writePlyMesh(const std::string &file_name, const Mesh &mesh, bool flip_norm
   return true;
 }
 
+namespace
+{
+/// The layout of a binary mesh ply file, as described by its header
+struct PlyMeshLayout
+{
+  size_t num_vertices = 0;
+  size_t num_faces = 0;
+  size_t vertex_size = 0;
+  int position_offset = -1;
+  bool position_is_float = false;
+  int count_size = 0;  // of the number of vertices in each face
+  int index_size = 0;
+};
 
-bool readPlyMesh(const std::string &file, Mesh &mesh)
+/// the size in bytes of a ply property type, or 0 if it is not a known type
+int plyTypeSize(const std::string &type)
 {
-  std::ifstream input(file.c_str());
-  if (input.fail())
+  if (type == "char" || type == "uchar" || type == "int8" || type == "uint8")
+    return 1;
+  if (type == "short" || type == "ushort" || type == "int16" || type == "uint16")
+    return 2;
+  if (type == "int" || type == "uint" || type == "float" || type == "int32" || type == "uint32" || type == "float32")
+    return 4;
+  if (type == "double" || type == "float64")
+    return 8;
+  return 0;
+}
+
+/// read an unsigned integer of @c size bytes, as a face vertex count or index
+inline int readPlyIndex(const unsigned char *data, int size)
+{
+  switch (size)
   {
-    std::cerr << "Couldn't open file: " << file << std::endl;
-    return false;
+  case 1:
+    return readPlyValue<uint8_t>(data, 0);
+  case 2:
+    return readPlyValue<uint16_t>(data, 0);
+  default:
+    return readPlyValue<int32_t>(data, 0);
   }
+}
+
+/// Read the header of a binary mesh ply file, which has a vertex element followed by a face element, leaving
+/// @c input at the start of the body
+bool readPlyMeshHeader(std::istream &input, const std::string &file_name, PlyMeshLayout &layout)
+{
   std::string line;
-  unsigned row_size = 0;
-  unsigned number_of_faces = 0;
-  unsigned number_of_vertices = 0;
-  char char1[100], char2[100];
-  while (line != "end_header\r" && line != "end_header")
+  std::string element;
+  bool binary = false;
+  while (getline(input, line))
   {
-    if (!getline(input, line))
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    if (line == "end_header")
     {
       break;
     }
-    if (line.find("float") != std::string::npos)
+    std::istringstream words(line);
+    std::string keyword;
+    words >> keyword;
+    if (keyword == "format")
     {
-      row_size += 4;
+      std::string format;
+      words >> format;
+      binary = format == "binary_little_endian";
     }
-    if (line.find("property uchar") != std::string::npos)
+    else if (keyword == "element")
     {
-      row_size++;
+      size_t count = 0;
+      words >> element >> count;
+      if (element == "vertex")
+        layout.num_vertices = count;
+      else if (element == "face")
+        layout.num_faces = count;
+      else if (layout.num_faces == 0 && count > 0)
+      {
+        std::cerr << "unsupported element " << element << " before the faces, in mesh file: " << file_name << std::endl;
+        return false;
+      }
     }
-    if (line.find("element vertex") != std::string::npos)
+    else if (keyword == "property" && element == "vertex")
     {
-      sscanf(line.c_str(), "%s %s %u", char1, char2, &number_of_vertices);
+      std::string type, name;
+      words >> type >> name;
+      const int size = plyTypeSize(type);
+      if (size == 0)
+      {
+        std::cerr << "unsupported vertex property type " << type << " in mesh file: " << file_name << std::endl;
+        return false;
+      }
+      if (name == "x")
+      {
+        layout.position_offset = static_cast<int>(layout.vertex_size);
+        layout.position_is_float = size == 4;
+      }
+      layout.vertex_size += size;
     }
-    if (line.find("element face") != std::string::npos)
+    else if (keyword == "property" && element == "face")
     {
-      sscanf(line.c_str(), "%s %s %u", char1, char2, &number_of_faces);
+      std::string list, count_type, index_type;
+      words >> list >> count_type >> index_type;
+      layout.count_size = plyTypeSize(count_type);
+      layout.index_size = plyTypeSize(index_type);
+      if (list != "list" || layout.count_size == 0 || layout.count_size > 4 || layout.index_size == 0 ||
+          layout.index_size > 4)
+      {
+        std::cerr << "unsupported face property in mesh file: " << file_name << std::endl;
+        return false;
+      }
     }
   }
+  if (line != "end_header")
+  {
+    std::cerr << "no ply header in mesh file: " << file_name << std::endl;
+    return false;
+  }
+  if (!binary)
+  {
+    std::cerr << "only binary little endian mesh files are supported: " << file_name << std::endl;
+    return false;
+  }
+  if (layout.position_offset == -1 || (layout.num_faces > 0 && layout.count_size == 0))
+  {
+    std::cerr << "could not find the vertex positions or face indices of mesh file: " << file_name << std::endl;
+    return false;
+  }
+  return true;
+}
+}  // namespace
 
-  std::vector<Eigen::Vector4f> vertices(number_of_vertices);
-  // read data as a block:
-  input.read((char *)&vertices[0], sizeof(Eigen::Vector4f) * vertices.size());
-  std::vector<Eigen::Vector4i> triangles(number_of_faces);
-  input.read((char *)&triangles[0], sizeof(Eigen::Vector4i) * triangles.size());
+bool readPlyMesh(const std::string &file, Mesh &mesh)
+{
+  std::ifstream input(file.c_str(), std::ios::binary);
+  if (input.fail())
+  {
+    std::cerr << "Couldn't open file: " << file << std::endl;
+    return false;
+  }
+  PlyMeshLayout layout;
+  if (!readPlyMeshHeader(input, file, layout))
+  {
+    return false;
+  }
+  ProfileScope profile("readPlyMesh");
+  profile.count(layout.num_faces);
 
-  mesh.vertices().resize(vertices.size());
-  for (int i = 0; i < (int)vertices.size(); i++)
+  // the body is mapped, or else read in a single block, then decoded in parallel into the pre-sized mesh arrays
+  const size_t body_start = static_cast<size_t>(input.tellg());
+  MappedFile mapping;
+  std::vector<unsigned char> buffer;
+  const unsigned char *body = nullptr;
+  size_t body_size = 0;
+  if (mapping.open(file) && mapping.size() >= body_start)
+  {
+    body = mapping.data() + body_start;
+    body_size = mapping.size() - body_start;
+  }
+  else
+  {
+    input.seekg(0, input.end);
+    buffer.resize(static_cast<size_t>(input.tellg()) - body_start);
+    input.seekg(body_start);
+    input.read(reinterpret_cast<char *>(buffer.data()), buffer.size());
+    buffer.resize(static_cast<size_t>(input.gcount()));
+    body = buffer.data();
+    body_size = buffer.size();
+  }
+  const size_t vertices_size = layout.num_vertices * layout.vertex_size;
+  const size_t triangle_size = layout.count_size + 3 * layout.index_size;
+  if (vertices_size + layout.num_faces * (layout.count_size + layout.index_size) > body_size)
   {
-    mesh.vertices()[i] = Eigen::Vector3d(vertices[i][0], vertices[i][1], vertices[i][2]);
+    std::cerr << "mesh file is shorter than its header describes: " << file << std::endl;
+    return false;
   }
 
-  mesh.indexList().resize(triangles.size());
-  for (int i = 0; i < (int)triangles.size(); i++)
+  mesh.vertices().resize(layout.num_vertices);
+  parallelFor(0, static_cast<int>(layout.num_vertices), [&](int i) {
+    const unsigned char *row = body + i * layout.vertex_size;
+    mesh.vertices()[i] = layout.position_is_float ? readPlyVector<float>(row, layout.position_offset)
+                                                  : readPlyVector<double>(row, layout.position_offset);
+  });
+
+  // faces are normally all triangles, which have a fixed size, so can be decoded independently
+  const unsigned char *faces = body + vertices_size;
+  const int num_faces = static_cast<int>(layout.num_faces);
+  const bool all_triangles =
+    vertices_size + layout.num_faces * triangle_size <= body_size &&
+    parallelReduce(0, num_faces, true,
+                   [&](int i, bool &triangles) {
+                     triangles = triangles && readPlyIndex(faces + i * triangle_size, layout.count_size) == 3;
+                   },
+                   [](bool a, bool b) { return a && b; });
+  if (all_triangles)
+  {
+    mesh.indexList().resize(layout.num_faces);
+    parallelFor(0, num_faces, [&](int i) {
+      const unsigned char *face = faces + i * triangle_size + layout.count_size;
+      for (int j = 0; j < 3; j++)
+      {
+        mesh.indexList()[i][j] = readPlyIndex(face + j * layout.index_size, layout.index_size);
+      }
+    });
+  }
+  else  // polygons of other sizes are split into fans of triangles
   {
-    mesh.indexList()[i] = Eigen::Vector3i(triangles[i][1], triangles[i][2], triangles[i][3]);
+    mesh.indexList().clear();
+    mesh.indexList().reserve(layout.num_faces);
+    const unsigned char *face = faces;
+    const unsigned char *faces_end = body + body_size;
+    for (int i = 0; i < num_faces; i++)
+    {
+      const int count = readPlyIndex(face, layout.count_size);
+      const unsigned char *indices = face + layout.count_size;
+      face = indices + count * layout.index_size;
+      if (face > faces_end)
+      {
+        std::cerr << "mesh file is shorter than its header describes: " << file << std::endl;
+        return false;
+      }
+      const int size = layout.index_size;
+      for (int j = 2; j < count; j++)
+      {
+        mesh.indexList().push_back(Eigen::Vector3i(readPlyIndex(indices, size),
+                                                   readPlyIndex(indices + (j - 1) * size, size),
+                                                   readPlyIndex(indices + j * size, size)));
+      }
+    }
   }
   std::cout << "reading from " << file << ", " << mesh.indexList().size() << " triangles." << std::endl;
   return true;
@@ -759,7 +1557,8 @@ bool convertCloud(const std::string &in_name, const std::string &out_name,
                   std::function<void(Eigen::Vector3d &start, Eigen::Vector3d &ends, double &time, RGBA &colour)> apply)
 {
   std::ofstream ofs;
-  if (!writeRayCloudChunkStart(out_name, ofs))
+  RayPlyHeader header;
+  if (!writeRayCloudChunkStart(out_name, ofs, header))
   {
     return false;
   }
@@ -781,7 +1580,91 @@ bool convertCloud(const std::string &in_name, const std::string &out_name,
   {
     return false;
   }
-  ray::writeRayCloudChunkEnd(ofs);
+  ray::writeRayCloudChunkEnd(ofs, header);
+  return true;
+}
+
+bool convertCloudInPlace(const std::string &file_name,
+                         std::function<void(Eigen::Vector3d &start, Eigen::Vector3d &end, double &time, RGBA &colour)>
+                           apply)
+{
+  PlyLayout layout;
+  std::streampos start;
+  {
+    std::ifstream input(file_name.c_str(), std::ios::binary);
+    if (input.fail() || !readPlyHeader(input, file_name, true, layout, start))
+    {
+      return false;
+    }
+  }
+  // rows are rewritten field for field, so the file must already have the layout that convertCloud would write
+  if (!isRayCloudLayout(layout) || layout.num_rows == 0)
+  {
+    return false;
+  }
+  MappedFile mapping;
+  if (!mapping.open(file_name, true))
+  {
+    return false;
+  }
+  const size_t body_start = static_cast<size_t>(start);
+  if (body_start + layout.num_rows * layout.row_size > mapping.size())
+  {
+    return false;
+  }
+  std::cout << "converting in place: " << file_name << std::endl;
+  unsigned char *body = mapping.writableData() + body_start;
+
+  auto convert_rows = [&](size_t first_row, size_t end_row) {
+    for (size_t r = first_row; r < end_row; r++)
+    {
+      unsigned char *row = body + r * layout.row_size;
+      Eigen::Vector3d end = readPlyVector<RayPlyPosition>(row, 0);
+      const Eigen::Vector3d normal = readPlyVector<float>(row, kRayPlyNormalOffset);
+      if (!(end == end) || !(normal == normal))
+      {
+        continue;  // the readers drop these rows, so they are left as they are
+      }
+      Eigen::Vector3d start = end + normal;
+      double time = readPlyValue<double>(row, kRayPlyTimeOffset);
+      RGBA colour = readPlyValue<RGBA>(row, kRayPlyColourOffset);
+      apply(start, end, time, colour);
+
+      const RayPlyPosition position[3] = { static_cast<RayPlyPosition>(end[0]), static_cast<RayPlyPosition>(end[1]),
+                                           static_cast<RayPlyPosition>(end[2]) };
+      const Eigen::Vector3f new_normal = (start - end).cast<float>();
+      std::memcpy(row, position, sizeof(position));
+      std::memcpy(row + kRayPlyNormalOffset, new_normal.data(), 3 * sizeof(float));
+      std::memcpy(row + kRayPlyTimeOffset, &time, sizeof(double));
+      std::memcpy(row + kRayPlyColourOffset, &colour, sizeof(RGBA));
+    }
+  };
+
+  // each worker converts whole chunks of rows, taken in turn
+  const size_t chunk_size = 1000000;
+  const size_t num_chunks = (layout.num_rows + chunk_size - 1) / chunk_size;
+  std::atomic<size_t> next_chunk(0);
+  auto worker = [&]() {
+    for (size_t chunk = next_chunk++; chunk < num_chunks; chunk = next_chunk++)
+    {
+      convert_rows(chunk * chunk_size, std::min(layout.num_rows, (chunk + 1) * chunk_size));
+    }
+  };
+  const int num_workers =
+    std::min(PlyChunkPipeline::defaultWorkerCount(), static_cast<int>(std::max<size_t>(num_chunks, 1)));
+  std::vector<std::thread> workers;
+  for (int i = 1; i < num_workers; i++) workers.emplace_back(worker);
+  worker();
+  for (auto &thread : workers) thread.join();
+
+  // the rays have moved, or may be partly written, so any index or info of them is out of date
+  std::remove(plyIndexFileName(file_name).c_str());
+  std::remove(plyInfoFileName(file_name).c_str());
+  if (!mapping.flush())
+  {
+    std::cerr << "Error: failed to write the converted rays back to " << file_name << std::endl;
+    return false;
+  }
   return true;
 }
 
@@ -8,6 +8,8 @@
 
 #include "raylib/raylibconfig.h"
 
+#include "raychunksizer.h"
+#include "raycuboid.h"
 #include "rayutils.h"
 
 namespace ray
@@ -35,13 +37,44 @@ bool RAYLIB_EXPORT readPlyMesh(const std::string &file, class Mesh &mesh);
 bool RAYLIB_EXPORT writePlyMesh(const std::string &file_name, const class Mesh &mesh, bool flip_normals = false);
 
 /// ready in a ray cloud or point cloud .ply file, and call the @c apply function one chunk at a time,
-/// @c chunk_size is the number of rays to read at one time. This method can be used on large clouds where
-/// the full set of rays is not required to be in memory at one time.
+/// @c chunk_size is the number of rays to read at one time, or @c ChunkSizer::kAdaptive to size the chunks from the
+/// measured decode and @c apply rates. This method can be used on large clouds where the full set of rays is not
+/// required to be in memory at one time.
+/// Chunks are decoded on worker threads ahead of the @c apply calls, but @c apply is always called from the calling
+/// thread, one chunk at a time and in file order.
 bool RAYLIB_EXPORT readPly(const std::string &file_name, bool is_ray_cloud,
                            std::function<void(std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
                                               std::vector<double> &times, std::vector<RGBA> &colours)>
                              apply,
-                           double max_intensity, size_t chunk_size = 1000000);
+                           double max_intensity, size_t chunk_size = ChunkSizer::kAdaptive);
+
+/// A contiguous range of rows in a .ply file, with the bounds of the rays and times within it
+struct RAYLIB_EXPORT PlyRowRange
+{
+  uint64_t first_row;
+  uint64_t num_rows;
+  /// bounds of all ray starts and ends in the range
+  Cuboid rays_bound;
+  double min_time;
+  double max_time;
+};
+
+/// As the chunked readPly, but if @c selection is given only those row ranges are read, each as one chunk. The
+/// ranges must be in increasing row order. If @c ranges_out is given, the row range and bounds of each chunk read
+/// are appended to it, which is how a ply index is built (see rayplyindex.h).
+bool RAYLIB_EXPORT readPlyRows(const std::string &file_name, bool is_ray_cloud,
+                               std::function<void(std::vector<Eigen::Vector3d> &starts,
+                                                  std::vector<Eigen::Vector3d> &ends, std::vector<double> &times,
+                                                  std::vector<RGBA> &colours)>
+                                 apply,
+                               double max_intensity, size_t chunk_size, const std::vector<PlyRowRange> *selection,
+                               std::vector<PlyRowRange> *ranges_out);
+
+/// the number of rows in the binary .ply file @c file_name , read from its header alone
+bool RAYLIB_EXPORT readPlyRowCount(const std::string &file_name, bool is_ray_cloud, uint64_t &num_rows);
+
+/// whether the ray cloud file @c file_name is marked in its header as being in Morton order, see Cloud::sortSpatially
+bool RAYLIB_EXPORT readPlySpatiallySorted(const std::string &file_name);
 
 /// write a .ply file representing a point cloud
 bool RAYLIB_EXPORT writePlyPointCloud(const std::string &file_name, const std::vector<Eigen::Vector3d> &points,
@@ -50,15 +83,37 @@ bool RAYLIB_EXPORT writePlyPointCloud(const std::string &file_name, const std::v
 /// write a .ply file representing a ray cloud
 bool RAYLIB_EXPORT writePlyRayCloud(const std::string &file_name, const std::vector<Eigen::Vector3d> &starts,
                                     const std::vector<Eigen::Vector3d> &ends, const std::vector<double> &times,
-                                    const std::vector<RGBA> &colours);
+                                    const std::vector<RGBA> &colours, bool spatially_sorted = false);
+
+/// The positions in a ray cloud file of its header fields, recorded by @c writeRayCloudChunkStart for
+/// @c writeRayCloudChunkEnd to complete. Each file keeps its own, as the header length depends on its comments.
+struct RayPlyHeader
+{
+  unsigned long vertex_size_pos = 0;  // the end of the zero padded vertex count
+  unsigned long length = 0;           // the start of the rows
+};
 
 /// Chunked version of writePlyRayCloud
-bool RAYLIB_EXPORT writeRayCloudChunkStart(const std::string &file_name, std::ofstream &out);
+bool RAYLIB_EXPORT writeRayCloudChunkStart(const std::string &file_name, std::ofstream &out, RayPlyHeader &header,
+                                           bool spatially_sorted = false);
 bool RAYLIB_EXPORT writeRayCloudChunk(std::ofstream &out, RayPlyBuffer &vertices,
                                       const std::vector<Eigen::Vector3d> &starts,
                                       const std::vector<Eigen::Vector3d> &ends, const std::vector<double> &times,
                                       const std::vector<RGBA> &colours, bool &has_warned);
-unsigned long RAYLIB_EXPORT writeRayCloudChunkEnd(std::ofstream &out);
+unsigned long RAYLIB_EXPORT writeRayCloudChunkEnd(std::ofstream &out, const RayPlyHeader &header);
+
+/// encode the rays into @c vertices , the rows of a ray cloud file, in parallel. If @c has_warned is false, this warns
+/// of the first ray with nans or a suspiciously large position, and sets it true
+void RAYLIB_EXPORT encodeRayCloudChunk(RayPlyBuffer &vertices, const std::vector<Eigen::Vector3d> &starts,
+                                       const std::vector<Eigen::Vector3d> &ends, const std::vector<double> &times,
+                                       const std::vector<RGBA> &colours, bool &has_warned);
+/// append the rows @c vertices , as filled by @c encodeRayCloudChunk , to a file begun by @c writeRayCloudChunkStart
+bool RAYLIB_EXPORT writeRayCloudRows(std::ofstream &out, const RayPlyBuffer &vertices);
+
+/// decode the rows of @c vertices , as filled by @c encodeRayCloudChunk , into the rays that a read of the file gives
+void RAYLIB_EXPORT decodeRayCloudChunk(const RayPlyBuffer &vertices, std::vector<Eigen::Vector3d> &starts,
+                                       std::vector<Eigen::Vector3d> &ends, std::vector<double> &times,
+                                       std::vector<RGBA> &colours);
 
 /// Chunked version of writePlyPointCloud
 bool RAYLIB_EXPORT writePointCloudChunkStart(const std::string &file_name, std::ofstream &out);
@@ -70,6 +125,15 @@ void RAYLIB_EXPORT writePointCloudChunkEnd(std::ofstream &out);
 /// Simple function for converting a ray cloud according to the per-ray function @c apply
 bool convertCloud(const std::string &in_name, const std::string &out_name,
                   std::function<void(Eigen::Vector3d &start, Eigen::Vector3d &ends, double &time, RGBA &colour)> apply);
+
+/// Converts the ray cloud @c file_name in place, rewriting each ray's fields within a memory mapping of the file
+/// rather than writing a new file. This requires the file to already have the ray cloud layout that @c convertCloud
+/// writes. Returns false without modifying the file if it does not, or if it cannot be mapped, in which case
+/// @c convertCloud should be used instead. @c apply is called from multiple threads, so must be thread-safe.
+bool RAYLIB_EXPORT convertCloudInPlace(const std::string &file_name,
+                                       std::function<void(Eigen::Vector3d &start, Eigen::Vector3d &end, double &time,
+                                                          RGBA &colour)>
+                                         apply);
 }  // namespace ray
 
 #endif  // RAYLIB_RAYPLY_H
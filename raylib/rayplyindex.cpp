@@ -0,0 +1,283 @@
+// Copyright (c) 2020
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "rayplyindex.h"
+#include "rayremotefile.h"
+
+#include <sys/stat.h>
+#include <cstring>
+#include <iostream>
+
+namespace ray
+{
+namespace
+{
+const char kPlyIndexMagic[4] = { 'R', 'P', 'I', 'X' };
+const uint32_t kPlyIndexVersion = 1;
+const char kPlyInfoMagic[4] = { 'R', 'P', 'I', 'N' };
+const uint32_t kPlyInfoVersion = 1;
+
+template <class T>
+void writeValue(std::ofstream &out, const T &value)
+{
+  out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <class T>
+void readValue(std::ifstream &in, T &value)
+{
+  in.read(reinterpret_cast<char *>(&value), sizeof(T));
+}
+
+void writeVector(std::ofstream &out, const Eigen::Vector3d &vector)
+{
+  for (int i = 0; i < 3; i++) writeValue(out, vector[i]);
+}
+
+void readVector(std::ifstream &in, Eigen::Vector3d &vector)
+{
+  for (int i = 0; i < 3; i++) readValue(in, vector[i]);
+}
+}  // namespace
+
+bool fileStamp(const std::string &file_name, uint64_t &size, int64_t &modified, uint64_t &hash)
+{
+  struct stat file_stat;
+  if (stat(file_name.c_str(), &file_stat) != 0)
+  {
+    return false;
+  }
+  size = static_cast<uint64_t>(file_stat.st_size);
+  // in nanoseconds where the platform has them, so that files rewritten within a second differ
+  modified = static_cast<int64_t>(file_stat.st_mtime) * 1000000000;
+#if defined(__APPLE__)
+  modified += static_cast<int64_t>(file_stat.st_mtimespec.tv_nsec);
+#elif defined(__linux__)
+  modified += static_cast<int64_t>(file_stat.st_mtim.tv_nsec);
+#endif
+
+  std::ifstream in(file_name, std::ios::in | std::ios::binary);
+  const uint64_t sample_size = std::min<uint64_t>(size, 4096);
+  std::vector<char> sample(2 * sample_size);
+  in.read(sample.data(), sample_size);
+  in.seekg(static_cast<std::streamoff>(size - sample_size));
+  in.read(sample.data() + sample_size, sample_size);
+  if (!in)
+  {
+    return false;
+  }
+  hash = 14695981039346656037ull;  // FNV-1a
+  for (const char c : sample)
+  {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+  }
+  return true;
+}
+
+std::string plyIndexFileName(const std::string &ply_file_name)
+{
+  return ply_file_name + ".idx";
+}
+
+bool readPlyIndex(const std::string &ply_file_name, std::vector<PlyRowRange> &ranges)
+{
+  std::ifstream in(plyIndexFileName(ply_file_name), std::ios::in | std::ios::binary);
+  if (in.fail())
+  {
+    return false;  // not an error, the index is optional
+  }
+  uint64_t size, stored_size, hash, stored_hash;
+  int64_t modified, stored_modified;
+  if (!fileStamp(ply_file_name, size, modified, hash))
+  {
+    return false;
+  }
+  char magic[4];
+  uint32_t version;
+  uint64_t num_ranges;
+  in.read(magic, 4);
+  readValue(in, version);
+  readValue(in, stored_size);
+  readValue(in, stored_modified);
+  readValue(in, stored_hash);
+  readValue(in, num_ranges);
+  if (!in || std::memcmp(magic, kPlyIndexMagic, 4) != 0 || version != kPlyIndexVersion)
+  {
+    std::cout << "warning: ignoring unrecognised index file " << plyIndexFileName(ply_file_name) << std::endl;
+    return false;
+  }
+  if (stored_size != size || stored_modified != modified || stored_hash != hash)
+  {
+    std::cout << "index " << plyIndexFileName(ply_file_name) << " is out of date, " << ply_file_name
+              << " has changed since it was written" << std::endl;
+    return false;
+  }
+  ranges.resize(num_ranges);
+  for (auto &range : ranges)
+  {
+    readValue(in, range.first_row);
+    readValue(in, range.num_rows);
+    for (int i = 0; i < 3; i++) readValue(in, range.rays_bound.min_bound_[i]);
+    for (int i = 0; i < 3; i++) readValue(in, range.rays_bound.max_bound_[i]);
+    readValue(in, range.min_time);
+    readValue(in, range.max_time);
+  }
+  if (!in)
+  {
+    std::cout << "warning: ignoring truncated index file " << plyIndexFileName(ply_file_name) << std::endl;
+    ranges.clear();
+    return false;
+  }
+  return true;
+}
+
+bool writePlyIndex(const std::string &ply_file_name, const std::vector<PlyRowRange> &ranges)
+{
+  if (isRemoteFileName(ply_file_name))
+  {
+    return false;  // sidecars are only kept beside local files
+  }
+  uint64_t size, hash;
+  int64_t modified;
+  if (!fileStamp(ply_file_name, size, modified, hash))
+  {
+    std::cerr << "Error: cannot index missing file " << ply_file_name << std::endl;
+    return false;
+  }
+  std::ofstream out(plyIndexFileName(ply_file_name), std::ios::binary | std::ios::out);
+  if (out.fail())
+  {
+    std::cerr << "Error: cannot open " << plyIndexFileName(ply_file_name) << " for writing." << std::endl;
+    return false;
+  }
+  out.write(kPlyIndexMagic, 4);
+  writeValue(out, kPlyIndexVersion);
+  writeValue(out, size);
+  writeValue(out, modified);
+  writeValue(out, hash);
+  writeValue(out, static_cast<uint64_t>(ranges.size()));
+  for (const auto &range : ranges)
+  {
+    writeValue(out, range.first_row);
+    writeValue(out, range.num_rows);
+    for (int i = 0; i < 3; i++) writeValue(out, range.rays_bound.min_bound_[i]);
+    for (int i = 0; i < 3; i++) writeValue(out, range.rays_bound.max_bound_[i]);
+    writeValue(out, range.min_time);
+    writeValue(out, range.max_time);
+  }
+  return out.good();
+}
+
+bool buildPlyIndex(const std::string &ply_file_name, std::vector<PlyRowRange> &ranges,
+                   std::function<void(std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                                      std::vector<double> &times, std::vector<RGBA> &colours)>
+                     apply)
+{
+  auto ignore = [](std::vector<Eigen::Vector3d> &, std::vector<Eigen::Vector3d> &, std::vector<double> &,
+                   std::vector<RGBA> &) {};
+  ranges.clear();
+  if (!readPlyRows(ply_file_name, true, apply ? apply : ignore, 0, kPlyIndexRangeSize, nullptr, &ranges))
+  {
+    return false;
+  }
+  std::cout << "writing index " << plyIndexFileName(ply_file_name) << std::endl;
+  return writePlyIndex(ply_file_name, ranges);
+}
+std::string plyInfoFileName(const std::string &ply_file_name)
+{
+  return ply_file_name + ".info";
+}
+
+bool readPlyInfo(const std::string &ply_file_name, Cloud::Info &info)
+{
+  std::ifstream in(plyInfoFileName(ply_file_name), std::ios::in | std::ios::binary);
+  if (in.fail())
+  {
+    return false;  // not an error, the sidecar is optional
+  }
+  uint64_t size, stored_size, hash, stored_hash;
+  int64_t modified, stored_modified;
+  if (!fileStamp(ply_file_name, size, modified, hash))
+  {
+    return false;
+  }
+  char magic[4];
+  uint32_t version;
+  in.read(magic, 4);
+  readValue(in, version);
+  readValue(in, stored_size);
+  readValue(in, stored_modified);
+  readValue(in, stored_hash);
+  if (!in || std::memcmp(magic, kPlyInfoMagic, 4) != 0 || version != kPlyInfoVersion)
+  {
+    std::cout << "warning: ignoring unrecognised info file " << plyInfoFileName(ply_file_name) << std::endl;
+    return false;
+  }
+  if (stored_size != size || stored_modified != modified || stored_hash != hash)
+  {
+    return false;  // the ply file has changed, so the info is found again
+  }
+  Cloud::Info stored;
+  int64_t num_bounded, num_unbounded;
+  readVector(in, stored.ends_bound.min_bound_);
+  readVector(in, stored.ends_bound.max_bound_);
+  readVector(in, stored.starts_bound.min_bound_);
+  readVector(in, stored.starts_bound.max_bound_);
+  readVector(in, stored.rays_bound.min_bound_);
+  readVector(in, stored.rays_bound.max_bound_);
+  readValue(in, num_bounded);
+  readValue(in, num_unbounded);
+  readValue(in, stored.min_time);
+  readValue(in, stored.max_time);
+  readVector(in, stored.centroid);
+  if (!in)
+  {
+    std::cout << "warning: ignoring truncated info file " << plyInfoFileName(ply_file_name) << std::endl;
+    return false;
+  }
+  stored.num_bounded = static_cast<int>(num_bounded);
+  stored.num_unbounded = static_cast<int>(num_unbounded);
+  info = stored;
+  return true;
+}
+
+bool writePlyInfo(const std::string &ply_file_name, const Cloud::Info &info)
+{
+  if (isRemoteFileName(ply_file_name))
+  {
+    return false;  // sidecars are only kept beside local files
+  }
+  uint64_t size, hash;
+  int64_t modified;
+  if (!fileStamp(ply_file_name, size, modified, hash))
+  {
+    std::cerr << "Error: cannot stamp info of missing file " << ply_file_name << std::endl;
+    return false;
+  }
+  std::ofstream out(plyInfoFileName(ply_file_name), std::ios::binary | std::ios::out);
+  if (out.fail())
+  {
+    std::cerr << "Error: cannot open " << plyInfoFileName(ply_file_name) << " for writing." << std::endl;
+    return false;
+  }
+  out.write(kPlyInfoMagic, 4);
+  writeValue(out, kPlyInfoVersion);
+  writeValue(out, size);
+  writeValue(out, modified);
+  writeValue(out, hash);
+  writeVector(out, info.ends_bound.min_bound_);
+  writeVector(out, info.ends_bound.max_bound_);
+  writeVector(out, info.starts_bound.min_bound_);
+  writeVector(out, info.starts_bound.max_bound_);
+  writeVector(out, info.rays_bound.min_bound_);
+  writeVector(out, info.rays_bound.max_bound_);
+  writeValue(out, static_cast<int64_t>(info.num_bounded));
+  writeValue(out, static_cast<int64_t>(info.num_unbounded));
+  writeValue(out, info.min_time);
+  writeValue(out, info.max_time);
+  writeVector(out, info.centroid);
+  return out.good();
+}
+}  // namespace ray
@@ -0,0 +1,60 @@
+// Copyright (c) 2020
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYPLYINDEX_H
+#define RAYLIB_RAYPLYINDEX_H
+
+#include "raylib/raylibconfig.h"
+
+#include "raycloud.h"
+#include "rayply.h"
+
+namespace ray
+{
+/// A ply index is a small sidecar file (cloud.ply.idx) that records the bounds and time range of each fixed-size
+/// range of rows in a ray cloud .ply file. This lets readers skip the parts of a large cloud that they don't need.
+/// The index records the size, modification time and a hash of the ends of its ply file, and is ignored once the ply
+/// file changes.
+
+/// the number of rows in each range of a ply index
+const size_t kPlyIndexRangeSize = 65536;
+
+/// The size, modification time and a hash of the first and last bytes of a file, used to detect when a sidecar is out
+/// of date. @c modified is in nanoseconds, at the platform's resolution, which is one second where @c stat has no
+/// nanoseconds. The hash catches files rewritten within that resolution.
+bool RAYLIB_EXPORT fileStamp(const std::string &file_name, uint64_t &size, int64_t &modified, uint64_t &hash);
+
+/// the file name of the index sidecar for a ply file
+std::string RAYLIB_EXPORT plyIndexFileName(const std::string &ply_file_name);
+
+/// read the index of @c ply_file_name. Returns false if there is no index, or if it is out of date.
+bool RAYLIB_EXPORT readPlyIndex(const std::string &ply_file_name, std::vector<PlyRowRange> &ranges);
+
+/// write the index of @c ply_file_name
+bool RAYLIB_EXPORT writePlyIndex(const std::string &ply_file_name, const std::vector<PlyRowRange> &ranges);
+
+/// read the whole of the ray cloud @c ply_file_name in order to build and write its index. If @c apply is given, it is
+/// called for every chunk of the cloud, so the index can be built as a side effect of a full read.
+bool RAYLIB_EXPORT buildPlyIndex(const std::string &ply_file_name, std::vector<PlyRowRange> &ranges,
+                                 std::function<void(std::vector<Eigen::Vector3d> &starts,
+                                                    std::vector<Eigen::Vector3d> &ends, std::vector<double> &times,
+                                                    std::vector<RGBA> &colours)>
+                                   apply = nullptr);
+
+/// An info sidecar (cloud.ply.info) records the @c Cloud::Info of a ray cloud .ply file, stamped in the same way as
+/// the index, so that @c Cloud::getInfo on an unchanged file does not read it again. It is written by
+/// @c CloudWriter and by the first @c Cloud::getInfo of each file.
+
+/// the file name of the info sidecar for a ply file
+std::string RAYLIB_EXPORT plyInfoFileName(const std::string &ply_file_name);
+
+/// read the info of @c ply_file_name from its sidecar. Returns false if there is no sidecar, or if it is out of date.
+bool RAYLIB_EXPORT readPlyInfo(const std::string &ply_file_name, Cloud::Info &info);
+
+/// write the info sidecar of @c ply_file_name
+bool RAYLIB_EXPORT writePlyInfo(const std::string &ply_file_name, const Cloud::Info &info);
+}  // namespace ray
+
+#endif  // RAYLIB_RAYPLYINDEX_H
@@ -0,0 +1,448 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "rayprofile.h"
+#include "raythreads.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+namespace ray
+{
+namespace
+{
+struct PhaseEvent
+{
+  std::string name;
+  long long start_us, duration_us;
+  size_t count;
+  size_t peak_memory, memory_growth;
+  size_t allocations, allocated_bytes, peak_live_bytes, live_growth;
+  PerfCounts perf;
+  int thread;
+};
+
+struct CounterEvent
+{
+  std::string name;
+  long long time_us;
+  size_t total;
+};
+
+/// The recording, kept until exit
+struct ProfileData
+{
+  std::mutex mutex;
+  std::string file_name;
+  bool write_at_exit = false;  // whether writeAtExit is registered
+  Profile::Clock::time_point origin;
+  std::vector<PhaseEvent> phases;
+  std::vector<CounterEvent> counter_events;
+  std::map<std::string, size_t> counters;
+};
+
+std::atomic<bool> profile_enabled(false);
+
+ProfileData &profileData()
+{
+  static ProfileData data;
+  return data;
+}
+
+template <class T>
+T growth(T start, T end)
+{
+  return end > start ? end - start : 0;
+}
+
+PerfCounts growth(const PerfCounts &start, const PerfCounts &end)
+{
+  PerfCounts counts;
+  counts.cycles = growth(start.cycles, end.cycles);
+  counts.instructions = growth(start.instructions, end.instructions);
+  counts.llc_misses = growth(start.llc_misses, end.llc_misses);
+  counts.branch_misses = growth(start.branch_misses, end.branch_misses);
+  counts.dram_bytes = growth(start.dram_bytes, end.dram_bytes);
+  return counts;
+}
+
+void add(PerfCounts *total, const PerfCounts &counts)
+{
+  total->cycles += counts.cycles;
+  total->instructions += counts.instructions;
+  total->llc_misses += counts.llc_misses;
+  total->branch_misses += counts.branch_misses;
+  total->dram_bytes += counts.dram_bytes;
+}
+
+/// the hardware counts as json fields, with the instructions per cycle that tell compute bound code from memory bound
+std::string perfFields(const PerfCounts &counts, bool with_dram)
+{
+  const double ipc =
+    counts.cycles ? static_cast<double>(counts.instructions) / static_cast<double>(counts.cycles) : 0.0;
+  std::stringstream fields;
+  fields << ", \"cycles\": " << counts.cycles << ", \"instructions\": " << counts.instructions << ", \"ipc\": " << ipc
+         << ", \"llc_misses\": " << counts.llc_misses << ", \"branch_misses\": " << counts.branch_misses;
+  if (with_dram)
+  {
+    fields << ", \"dram_bytes\": " << counts.dram_bytes;
+  }
+  return fields.str();
+}
+
+long long microseconds(Profile::Clock::duration duration)
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+}
+
+std::string jsonString(const std::string &text)
+{
+  std::string result = "\"";
+  for (const char c : text)
+  {
+    if (c == '"' || c == '\\')
+    {
+      result += '\\';
+      result += c;
+    }
+    else if (static_cast<unsigned char>(c) < 0x20)
+    {
+      char code[8];
+      std::snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned>(c));
+      result += code;
+    }
+    else
+    {
+      result += c;
+    }
+  }
+  return result + "\"";
+}
+
+void writeAtExit()
+{
+  Profile::finish();
+}
+}  // namespace
+
+void Profile::enable(const std::string &file_name)
+{
+  ProfileData &data = profileData();
+  std::lock_guard<std::mutex> lock(data.mutex);
+  if (!profile_enabled)
+  {
+    data.origin = Clock::now();
+  }
+  if (!data.write_at_exit)
+  {
+    std::atexit(writeAtExit);  // registered after the data is constructed, so it runs before its destruction
+    data.write_at_exit = true;
+  }
+  data.file_name = file_name;
+  profile_enabled = true;
+  PerfCounters::start();
+}
+
+bool Profile::enabled()
+{
+  return profile_enabled;
+}
+
+bool Profile::finish()
+{
+  if (!profile_enabled)
+  {
+    return true;
+  }
+  ProfileData &data = profileData();
+  const bool written = write(data.file_name);
+  if (!written)
+  {
+    std::cerr << "Error: cannot write profile to " << data.file_name << std::endl;
+  }
+  std::lock_guard<std::mutex> lock(data.mutex);
+  profile_enabled = false;
+  data.file_name.clear();
+  data.phases.clear();
+  data.counter_events.clear();
+  data.counters.clear();
+  return written;
+}
+
+void Profile::initFromArguments(int &argc, char *argv[])
+{
+  for (int i = 1; i < argc - 1; i++)
+  {
+    if (std::strcmp(argv[i], "--profile") != 0)
+    {
+      continue;
+    }
+    enable(argv[i + 1]);
+    for (int j = i + 2; j <= argc; j++)
+    {
+      argv[j - 2] = argv[j];  // includes the terminating null pointer
+    }
+    argc -= 2;
+    break;
+  }
+}
+
+void Profile::addPhase(const std::string &name, Clock::time_point start, Clock::time_point end, size_t count,
+                       const Mark &start_mark)
+{
+  if (!profile_enabled)
+  {
+    return;
+  }
+  const Mark end_mark = mark();
+  const int thread = threadIndex();
+  ProfileData &data = profileData();
+  std::lock_guard<std::mutex> lock(data.mutex);
+  PhaseEvent phase;
+  phase.name = name;
+  phase.start_us = microseconds(start - data.origin);
+  phase.duration_us = microseconds(end - start);
+  phase.count = count;
+  phase.peak_memory = end_mark.peak_memory;
+  phase.memory_growth = growth(start_mark.peak_memory, end_mark.peak_memory);
+  phase.allocations = growth(start_mark.allocations.allocations, end_mark.allocations.allocations);
+  phase.allocated_bytes = growth(start_mark.allocations.bytes, end_mark.allocations.bytes);
+  phase.peak_live_bytes = end_mark.allocations.peak_live_bytes;
+  phase.live_growth = growth(start_mark.allocations.peak_live_bytes, end_mark.allocations.peak_live_bytes);
+  phase.perf = growth(start_mark.perf, end_mark.perf);
+  phase.thread = thread;
+  data.phases.push_back(phase);
+}
+
+void Profile::count(const std::string &name, size_t value)
+{
+  if (!profile_enabled)
+  {
+    return;
+  }
+  const Clock::time_point now = Clock::now();
+  ProfileData &data = profileData();
+  std::lock_guard<std::mutex> lock(data.mutex);
+  size_t &total = data.counters[name];
+  total += value;
+  data.counter_events.push_back(CounterEvent{ name, microseconds(now - data.origin), total });
+}
+
+void Profile::set(const std::string &name, size_t value)
+{
+  if (!profile_enabled)
+  {
+    return;
+  }
+  const Clock::time_point now = Clock::now();
+  ProfileData &data = profileData();
+  std::lock_guard<std::mutex> lock(data.mutex);
+  data.counters[name] = value;
+  data.counter_events.push_back(CounterEvent{ name, microseconds(now - data.origin), value });
+}
+
+Profile::Mark Profile::mark()
+{
+  Mark result;
+  result.peak_memory = peakMemory();
+  result.allocations = AllocationProfile::totals();
+  if (PerfCounters::available())
+  {
+    PerfCounters::addThread(threadIndex());
+    result.perf = PerfCounters::totals();
+  }
+  return result;
+}
+
+int Profile::threadIndex()
+{
+  static std::atomic<int> next_index(0);
+  thread_local int index = next_index++;
+  return index;
+}
+
+size_t Profile::peakMemory()
+{
+#if defined(__unix__) || defined(__APPLE__)
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+  {
+    return 0;
+  }
+#if defined(__APPLE__)
+  return static_cast<size_t>(usage.ru_maxrss);  // bytes
+#else
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;  // kilobytes
+#endif
+#else
+  return 0;
+#endif
+}
+
+bool Profile::write(const std::string &file_name)
+{
+  ProfileData &data = profileData();
+  std::lock_guard<std::mutex> lock(data.mutex);
+  std::ofstream file(file_name);
+  if (!file.is_open())
+  {
+    return false;
+  }
+  const bool perf_available = PerfCounters::available();
+  file << "{\n\"traceEvents\": [\n";
+  bool first = true;
+  for (const auto &phase : data.phases)
+  {
+    file << (first ? "" : ",\n") << "{\"name\": " << jsonString(phase.name)
+         << ", \"cat\": \"phase\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << phase.thread << ", \"ts\": " << phase.start_us
+         << ", \"dur\": " << phase.duration_us << ", \"args\": {\"count\": " << phase.count
+         << ", \"peak_memory_bytes\": " << phase.peak_memory << ", \"memory_growth_bytes\": " << phase.memory_growth;
+    if (AllocationProfile::available())
+    {
+      file << ", \"allocations\": " << phase.allocations << ", \"allocated_bytes\": " << phase.allocated_bytes
+           << ", \"peak_live_bytes\": " << phase.peak_live_bytes << ", \"live_growth_bytes\": " << phase.live_growth;
+    }
+    if (perf_available)
+    {
+      file << perfFields(phase.perf, true);
+    }
+    file << "}}";
+    first = false;
+  }
+  for (const auto &counter : data.counter_events)
+  {
+    file << (first ? "" : ",\n") << "{\"name\": " << jsonString(counter.name)
+         << ", \"cat\": \"counter\", \"ph\": \"C\", \"pid\": 1, \"ts\": " << counter.time_us
+         << ", \"args\": {\"total\": " << counter.total << "}}";
+    first = false;
+  }
+  file << "\n],\n\"displayTimeUnit\": \"ms\",\n";
+
+  // the totals per phase name, in order of first appearance
+  struct PhaseSummary
+  {
+    std::string name;
+    size_t calls = 0, count = 0, peak_memory = 0, memory_growth = 0;
+    size_t allocations = 0, allocated_bytes = 0, peak_live_bytes = 0, live_growth = 0;
+    PerfCounts perf;
+    long long total_us = 0, max_us = 0;
+  };
+  std::vector<PhaseSummary> summaries;
+  std::map<std::string, size_t> summary_index;
+  for (const auto &phase : data.phases)
+  {
+    auto found = summary_index.find(phase.name);
+    if (found == summary_index.end())
+    {
+      found = summary_index.emplace(phase.name, summaries.size()).first;
+      summaries.emplace_back();
+      summaries.back().name = phase.name;
+    }
+    PhaseSummary &summary = summaries[found->second];
+    summary.calls++;
+    summary.count += phase.count;
+    summary.total_us += phase.duration_us;
+    summary.max_us = std::max(summary.max_us, phase.duration_us);
+    summary.peak_memory = std::max(summary.peak_memory, phase.peak_memory);
+    summary.memory_growth = std::max(summary.memory_growth, phase.memory_growth);
+    summary.allocations += phase.allocations;
+    summary.allocated_bytes += phase.allocated_bytes;
+    summary.peak_live_bytes = std::max(summary.peak_live_bytes, phase.peak_live_bytes);
+    summary.live_growth = std::max(summary.live_growth, phase.live_growth);
+    add(&summary.perf, phase.perf);
+  }
+  file << "\"summary\": {\n\"wall_time_s\": " << 1e-6 * static_cast<double>(microseconds(Clock::now() - data.origin))
+       << ",\n\"threads\": " << Threads::threadCount() << ",\n\"peak_memory_bytes\": " << peakMemory()
+       << ",\n\"phases\": [";
+  for (size_t i = 0; i < summaries.size(); i++)
+  {
+    const PhaseSummary &summary = summaries[i];
+    file << (i ? ",\n" : "\n") << "{\"name\": " << jsonString(summary.name) << ", \"calls\": " << summary.calls
+         << ", \"total_s\": " << 1e-6 * static_cast<double>(summary.total_us)
+         << ", \"max_s\": " << 1e-6 * static_cast<double>(summary.max_us) << ", \"count\": " << summary.count
+         << ", \"peak_memory_bytes\": " << summary.peak_memory
+         << ", \"memory_growth_bytes\": " << summary.memory_growth;
+    if (AllocationProfile::available())
+    {
+      file << ", \"allocations\": " << summary.allocations << ", \"allocated_bytes\": " << summary.allocated_bytes
+           << ", \"peak_live_bytes\": " << summary.peak_live_bytes
+           << ", \"live_growth_bytes\": " << summary.live_growth;
+    }
+    if (perf_available)
+    {
+      const double seconds = 1e-6 * static_cast<double>(summary.total_us);
+      file << perfFields(summary.perf, true) << ", \"dram_bytes_per_s\": "
+           << (seconds > 0.0 ? static_cast<double>(summary.perf.dram_bytes) / seconds : 0.0);
+    }
+    file << "}";
+  }
+  file << "\n],\n\"counters\": {";
+  first = true;
+  for (const auto &counter : data.counters)
+  {
+    file << (first ? "\n" : ",\n") << jsonString(counter.first) << ": " << counter.second;
+    first = false;
+  }
+  file << "\n}";
+  if (AllocationProfile::available())
+  {
+    file << ",\n\"allocation_categories\": [";
+    const auto categories = AllocationProfile::categories();
+    for (size_t i = 0; i < categories.size(); i++)
+    {
+      const AllocationCounts &counts = categories[i].second;
+      file << (i ? ",\n" : "\n") << "{\"name\": " << jsonString(categories[i].first)
+           << ", \"allocations\": " << counts.allocations << ", \"allocated_bytes\": " << counts.bytes
+           << ", \"live_bytes\": " << counts.live_bytes << ", \"peak_live_bytes\": " << counts.peak_live_bytes << "}";
+    }
+    file << "\n]";
+  }
+  if (perf_available)
+  {
+    file << ",\n\"perf_counters\": {\"dram_measured\": " << (PerfCounters::dramMeasured() ? "true" : "false")
+         << ", \"threads\": [";
+    const auto threads = PerfCounters::threads();
+    for (size_t i = 0; i < threads.size(); i++)
+    {
+      file << (i ? ",\n" : "\n") << "{\"thread\": " << threads[i].first << perfFields(threads[i].second, false) << "}";
+    }
+    file << "\n]}";
+  }
+  file << "\n}\n}\n";
+  return file.good();
+}
+
+ProfileScope::ProfileScope(const std::string &name)
+  : count_(0)
+  , enabled_(Profile::enabled())
+{
+  if (enabled_)
+  {
+    name_ = name;
+    start_mark_ = Profile::mark();
+    start_ = Profile::Clock::now();
+  }
+}
+
+ProfileScope::~ProfileScope()
+{
+  if (enabled_)
+  {
+    Profile::addPhase(name_, start_, Profile::Clock::now(), count_, start_mark_);
+  }
+}
+}  // namespace ray
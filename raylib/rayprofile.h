@@ -0,0 +1,102 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYPROFILE_H
+#define RAYLIB_RAYPROFILE_H
+
+#include "raylib/raylibconfig.h"
+
+#include "raylib/rayallocprofile.h"
+#include "raylib/rayperfcounters.h"
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+namespace ray
+{
+/// Structured instrumentation of where a run spends its time and memory. Recording is off until @c enable() is
+/// called, after which the named phases of @c Progress , the @c ProfileScope timers and the @c count() calls are
+/// recorded, and written at exit as a Chrome trace (chrome://tracing or ui.perfetto.dev) with an added @c summary
+/// object of the totals per phase.
+///
+/// Each phase records its duration, the progress it reached, and the process memory high-water mark at its end, along
+/// with how much the phase raised that mark. In builds configured with RAYCLOUD_ALLOC_PROFILE each phase also records
+/// its allocations, the bytes they requested and the high-water mark of live heap bytes, and the summary has the
+/// totals per @c AllocationCategory . With RAYCLOUD_PERF_COUNTERS=1 on Linux each phase also records the hardware
+/// counts of its threads from the @c PerfCounters , and the summary has the totals per thread. Recording takes a lock,
+/// so is intended per phase or per batch, not per ray. When disabled each call is a single flag test.
+class RAYLIB_EXPORT Profile
+{
+public:
+  using Clock = std::chrono::high_resolution_clock;  // as used by Progress
+
+  /// Start recording, for writing to @c file_name at exit.
+  static void enable(const std::string &file_name);
+  /// Whether recording is on.
+  static bool enabled();
+  /// Write the recording to the @c enable() file, then stop recording and clear it, so that a later @c enable() starts
+  /// afresh. This happens at exit, and at the end of each command that @c Tool::run calls. Returns false if the file
+  /// could not be written, and true if recording was off.
+  static bool finish();
+
+  /// Remove a @c --profile file.json option from the command line arguments, and @c enable() recording to that file
+  /// if it is present.
+  static void initFromArguments(int &argc, char *argv[]);
+
+  /// The state at the start of a phase, which the state at its end is compared with
+  struct Mark
+  {
+    size_t peak_memory = 0;
+    AllocationCounts allocations;
+    PerfCounts perf;
+  };
+  /// the current @c peakMemory() , allocation totals and hardware counts
+  static Mark mark();
+
+  /// Record a completed phase called @c name , from @c start to @c end , which processed @c count items. The @c mark()
+  /// at the start tells how much the phase raised the memory marks and how much it allocated.
+  static void addPhase(const std::string &name, Clock::time_point start, Clock::time_point end, size_t count,
+                       const Mark &start_mark);
+
+  /// Add @c value to the counter @c name , such as the number of rays, voxels or ellipsoids processed.
+  static void count(const std::string &name, size_t value);
+  /// Set the counter @c name to @c value , for a quantity that changes over the run rather than accumulating, such as
+  /// the chunk size chosen by a @c ChunkSizer .
+  static void set(const std::string &name, size_t value);
+
+  /// A small index for the calling thread, which is its row in the trace.
+  static int threadIndex();
+
+  /// The process memory high-water mark so far, in bytes, or 0 where the platform does not report it.
+  static size_t peakMemory();
+
+  /// Write the recording so far to @c file_name . Returns false if the file could not be written.
+  static bool write(const std::string &file_name);
+};
+
+/// A scoped timer, recording a phase called @c name from its construction to its destruction, when the @c Profile is
+/// enabled.
+class RAYLIB_EXPORT ProfileScope
+{
+public:
+  explicit ProfileScope(const std::string &name);
+  ProfileScope(const ProfileScope &) = delete;
+  ProfileScope &operator=(const ProfileScope &) = delete;
+  ~ProfileScope();
+
+  /// Add @c value to the number of items processed in this scope.
+  void count(size_t value) { count_ += value; }
+
+private:
+  std::string name_;
+  Profile::Clock::time_point start_;
+  Profile::Mark start_mark_;
+  size_t count_;
+  bool enabled_;
+};
+}  // namespace ray
+
+#endif  // RAYLIB_RAYPROFILE_H
@@ -8,6 +8,8 @@
 
 #include "raylib/raylibconfig.h"
 
+#include "rayprofile.h"
+
 #include <atomic>
 #include <chrono>
 #include <cstddef>
@@ -27,6 +29,8 @@ namespace ray
 /// range. When @c target() is known, the progress may be reported as a ratio `[0, 1]`.
 ///
 /// Updating the progress value is threadsafe, however, the @c begin() operations are not.
+///
+/// Each named phase is recorded by the @c Profile when it is enabled, with its progress as the items processed.
 class RAYLIB_EXPORT Progress
 {
 public:
@@ -95,18 +99,75 @@ private:
   Clock::duration last_duration_;
   std::atomic_size_t target_;
   std::atomic_size_t progress_;
+  Profile::Mark phase_start_mark_;
   bool last_phase_ended_ = false;
 };
 
+/// A batched handle on a @c Progress , for the work of one thread or one range of a parallel loop. Increments are
+/// counted locally, and only added to the shared progress value every @c batchSize() steps and on destruction, so that
+/// the threads of a parallel loop do not contend on it with an atomic update per item. The @c progress may be null,
+/// in which case the increments are ignored.
+class RAYLIB_EXPORT ProgressBatch
+{
+public:
+  /// The default number of steps counted locally before they are added to the progress.
+  static const size_t kDefaultBatchSize = 1024;
+
+  explicit ProgressBatch(Progress *progress, size_t batch_size = kDefaultBatchSize)
+    : progress_(progress)
+    , batch_size_(batch_size)
+  {}
+  ProgressBatch(const ProgressBatch &) = delete;
+  ProgressBatch &operator=(const ProgressBatch &) = delete;
+  ~ProgressBatch() { flush(); }
+
+  /// Increment the local count by one step, adding it to the progress once a batch is counted.
+  inline void increment()
+  {
+    if (++count_ >= batch_size_)
+    {
+      flush();
+    }
+  }
+  /// Increment the local count by @p step, adding it to the progress once a batch is counted.
+  inline void increment(size_t step)
+  {
+    count_ += step;
+    if (count_ >= batch_size_)
+    {
+      flush();
+    }
+  }
+  /// Add the steps counted so far to the progress.
+  inline void flush()
+  {
+    if (progress_ && count_ > 0)
+    {
+      progress_->increment(count_);
+    }
+    count_ = 0;
+  }
+
+  /// The number of steps counted locally before they are added to the progress.
+  inline size_t batchSize() const { return batch_size_; }
+
+private:
+  Progress *progress_;
+  size_t batch_size_;
+  size_t count_ = 0;
+};
+
 
 inline Progress::Progress(size_t target)
-  : target_(target)
+  : phase_start_(Clock::now())
+  , target_(target)
   , progress_(0u)
 {}
 
 
 inline Progress::Progress(const std::string &phase, size_t target)
   : phase_(phase)
+  , phase_start_(Clock::now())
   , target_(target)
   , progress_(0u)
 {}
@@ -127,6 +188,10 @@ inline void Progress::begin(const std::string &phase, size_t target)
   target_ = target;
   progress_ = 0u;
   last_phase_ended_ = false;
+  if (Profile::enabled())
+  {
+    phase_start_mark_ = Profile::mark();
+  }
   phase_start_ = Clock::now();
 }
 
@@ -140,8 +205,13 @@ inline void Progress::end(bool set_progress)
     {
       progress_ = target_.load();
     }
-    last_duration_ = Clock::now() - phase_start_;
+    const Clock::time_point now = Clock::now();
+    last_duration_ = now - phase_start_;
     last_phase_ended_ = true;
+    if (!phase_.empty() && Profile::enabled())
+    {
+      Profile::addPhase(phase_, phase_start_, now, progress_, phase_start_mark_);
+    }
   }
 }
 
@@ -11,6 +11,8 @@
 #include "rayprogress.h"
 
 #include <atomic>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 
 namespace ray
@@ -30,7 +32,7 @@ public:
   /// Destructor ensuring the thread is joined.
   ~ProgressThread();
 
-  void requestQuit() { quit_flag_ = true; }
+  void requestQuit();
   void join();
 
 private:
@@ -40,6 +42,8 @@ private:
 
   Progress &progress_;
   std::atomic_bool quit_flag_;
+  std::mutex quit_mutex_;
+  std::condition_variable quit_condition_;  // wakes the display early on quit, so short reads don't wait for it
   std::atomic_bool running_;
   std::thread thread_;
 };
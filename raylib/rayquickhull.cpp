@@ -0,0 +1,607 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "rayquickhull.h"
+#include "raythreads.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace ray
+{
+namespace
+{
+/// Smaller inputs are neither filtered nor split into parts
+const size_t kMinFilterPoints = 1000;
+/// the fewest points per part of the parallel hull
+const size_t kMinPartPoints = 20000;
+/// the most cells along each axis of the filtering grid
+const int kMaxGridCells = 64;
+/// points to reassign beyond which the faces that each goes outside are found in parallel
+const size_t kParallelAssignPoints = 32768;
+
+struct Face
+{
+  /// anticlockwise from outside
+  Eigen::Vector3i vertices;
+  /// neighbour i shares the edge from vertex i to vertex i + 1
+  Eigen::Vector3i neighbours;
+  Eigen::Vector3d normal;
+  double offset;
+  /// the points outside this face and no other that was tested before it, with the furthest of them
+  std::vector<int> outside;
+  int furthest;
+  double furthest_distance;
+  bool alive;
+};
+
+/// An edge of the horizon, which is edge @c edge of visible face @c face
+struct HorizonEdge
+{
+  int face, edge;
+};
+
+/// The incremental Quickhull of a subset of the points. Each step takes the furthest point outside a face, removes
+/// the faces that it can see, and joins it to the edges of the horizon around them
+class HullBuilder
+{
+public:
+  HullBuilder(const std::vector<Eigen::Vector3d> &points, double tolerance)
+    : points_(points)
+    , tolerance_(tolerance)
+  {}
+
+  /// the hull of the points at @c indices . Returns false if they are degenerate
+  bool build(const std::vector<int> &indices);
+  /// the point indices of the hull vertices, in order
+  std::vector<int> vertices() const;
+  /// the planes of the faces, as an outward normal and offset
+  void planes(std::vector<Eigen::Vector3d> *normals, std::vector<double> *offsets) const;
+  void triangles(std::vector<Eigen::Vector3i> *triangles, std::vector<Eigen::Vector3d> *normals) const;
+
+private:
+  double distance(const Face &face, int point) const { return face.normal.dot(points_[point]) - face.offset; }
+  int addFace(int a, int b, int c);
+  bool addInitialSimplex(const std::vector<int> &indices, std::vector<int> *simplex);
+  void assign(const std::vector<int> &candidates, const std::vector<int> &new_faces);
+  void addToFace(int face, int point, double dist);
+  void addPoint(int face, std::vector<int> *pending);
+  bool findHorizon(int face, int eye, std::vector<int> *visible, std::vector<HorizonEdge> *horizon);
+
+  const std::vector<Eigen::Vector3d> &points_;
+  double tolerance_;
+  std::vector<Face> faces_;
+  std::vector<int> free_faces_;
+};
+
+int HullBuilder::addFace(int a, int b, int c)
+{
+  int index;
+  if (!free_faces_.empty())
+  {
+    index = free_faces_.back();
+    free_faces_.pop_back();
+  }
+  else
+  {
+    index = static_cast<int>(faces_.size());
+    faces_.emplace_back();
+  }
+  Face &face = faces_[index];
+  face.vertices = Eigen::Vector3i(a, b, c);
+  face.neighbours = Eigen::Vector3i(-1, -1, -1);
+  const Eigen::Vector3d normal = (points_[b] - points_[a]).cross(points_[c] - points_[a]);
+  const double length = normal.norm();
+  face.normal = length > 0.0 ? Eigen::Vector3d(normal / length) : Eigen::Vector3d(0, 0, 0);
+  face.offset = face.normal.dot(points_[a]);
+  face.outside.clear();
+  face.furthest = -1;
+  face.furthest_distance = 0.0;
+  face.alive = true;
+  return index;
+}
+
+bool HullBuilder::addInitialSimplex(const std::vector<int> &indices, std::vector<int> *simplex)
+{
+  // the two furthest apart of the extreme points along each axis
+  int extremes[6];
+  for (int j = 0; j < 6; j++) extremes[j] = indices[0];
+  for (const int i : indices)
+  {
+    for (int axis = 0; axis < 3; axis++)
+    {
+      if (points_[i][axis] < points_[extremes[axis]][axis])
+        extremes[axis] = i;
+      if (points_[i][axis] > points_[extremes[axis + 3]][axis])
+        extremes[axis + 3] = i;
+    }
+  }
+  int a = extremes[0], b = extremes[3];
+  double max_distance = -1.0;
+  for (int j = 0; j < 6; j++)
+  {
+    for (int k = j + 1; k < 6; k++)
+    {
+      const double dist = (points_[extremes[j]] - points_[extremes[k]]).squaredNorm();
+      if (dist > max_distance)
+      {
+        max_distance = dist;
+        a = extremes[j];
+        b = extremes[k];
+      }
+    }
+  }
+  if (std::sqrt(max_distance) <= tolerance_)
+    return false;
+  // the furthest from the line through them
+  const Eigen::Vector3d line = (points_[b] - points_[a]).normalized();
+  int c = a;
+  max_distance = 0.0;
+  for (const int i : indices)
+  {
+    const double dist = (points_[i] - points_[a]).cross(line).squaredNorm();
+    if (dist > max_distance)
+    {
+      max_distance = dist;
+      c = i;
+    }
+  }
+  if (std::sqrt(max_distance) <= tolerance_)
+    return false;
+  // and the furthest from the plane through the three
+  const Eigen::Vector3d normal = (points_[b] - points_[a]).cross(points_[c] - points_[a]).normalized();
+  int d = a;
+  max_distance = 0.0;
+  for (const int i : indices)
+  {
+    const double dist = std::abs(normal.dot(points_[i] - points_[a]));
+    if (dist > max_distance)
+    {
+      max_distance = dist;
+      d = i;
+    }
+  }
+  if (max_distance <= tolerance_)
+    return false;
+
+  if (normal.dot(points_[d] - points_[a]) > 0.0)
+    std::swap(b, c);  // so that abc faces away from d
+  addFace(a, b, c);
+  addFace(a, d, b);
+  addFace(b, d, c);
+  addFace(c, d, a);
+  for (int f = 0; f < 4; f++)
+  {
+    for (int e = 0; e < 3; e++)
+    {
+      for (int g = 0; g < 4; g++)
+      {
+        for (int h = 0; h < 3; h++)
+        {
+          if (faces_[g].vertices[h] == faces_[f].vertices[(e + 1) % 3] &&
+              faces_[g].vertices[(h + 1) % 3] == faces_[f].vertices[e])
+            faces_[f].neighbours[e] = g;
+        }
+      }
+    }
+  }
+  *simplex = { a, b, c, d };
+  return true;
+}
+
+void HullBuilder::addToFace(int face, int point, double dist)
+{
+  Face &f = faces_[face];
+  f.outside.push_back(point);
+  if (dist > f.furthest_distance)
+  {
+    f.furthest_distance = dist;
+    f.furthest = point;
+  }
+}
+
+void HullBuilder::assign(const std::vector<int> &candidates, const std::vector<int> &new_faces)
+{
+  auto furthest_face = [&](int point, double &max_distance) {
+    int best = -1;
+    max_distance = tolerance_;
+    for (const int face : new_faces)
+    {
+      const double dist = distance(faces_[face], point);
+      if (dist > max_distance)
+      {
+        max_distance = dist;
+        best = face;
+      }
+    }
+    return best;
+  };
+  if (candidates.size() < kParallelAssignPoints)
+  {
+    for (const int point : candidates)
+    {
+      double dist;
+      const int face = furthest_face(point, dist);
+      if (face >= 0)
+        addToFace(face, point, dist);
+    }
+    return;
+  }
+  std::vector<int> best(candidates.size());
+  std::vector<double> distances(candidates.size());
+  parallelFor(size_t(0), candidates.size(), [&](size_t i) { best[i] = furthest_face(candidates[i], distances[i]); });
+  for (size_t i = 0; i < candidates.size(); i++)
+  {
+    if (best[i] >= 0)
+      addToFace(best[i], candidates[i], distances[i]);
+  }
+}
+
+bool HullBuilder::findHorizon(int face, int eye, std::vector<int> *visible, std::vector<HorizonEdge> *horizon)
+{
+  // a depth first search over the visible faces, which meets the horizon edges in order around the eye
+  struct Visit
+  {
+    int face, first_edge, edges, step;
+  };
+  std::vector<Visit> stack;
+  stack.push_back(Visit{ face, 0, 3, 0 });
+  faces_[face].alive = false;
+  visible->push_back(face);
+  while (!stack.empty())
+  {
+    Visit &visit = stack.back();
+    if (visit.step == visit.edges)
+    {
+      stack.pop_back();
+      continue;
+    }
+    const int from = visit.face;
+    const int edge = (visit.first_edge + visit.step++) % 3;
+    const int neighbour = faces_[from].neighbours[edge];
+    if (!faces_[neighbour].alive)
+      continue;
+    if (distance(faces_[neighbour], eye) > tolerance_)
+    {
+      // continue from the edge after the one crossed, so the crossed edge is the last of the neighbour's
+      const int start = faces_[from].vertices[(edge + 1) % 3];
+      int crossed = 0;
+      while (faces_[neighbour].vertices[crossed] != start && crossed < 2) crossed++;
+      faces_[neighbour].alive = false;
+      visible->push_back(neighbour);
+      stack.push_back(Visit{ neighbour, (crossed + 1) % 3, 2, 0 });
+    }
+    else
+    {
+      horizon->push_back(HorizonEdge{ from, edge });
+    }
+  }
+  // the horizon must be a single loop, which rounding errors in extreme cases can break
+  if (horizon->size() < 3)
+    return false;
+  for (size_t k = 0; k < horizon->size(); k++)
+  {
+    const HorizonEdge &edge = (*horizon)[k];
+    const HorizonEdge &next = (*horizon)[(k + 1) % horizon->size()];
+    if (faces_[edge.face].vertices[(edge.edge + 1) % 3] != faces_[next.face].vertices[next.edge])
+      return false;
+  }
+  return true;
+}
+
+void HullBuilder::addPoint(int face, std::vector<int> *pending)
+{
+  const int eye = faces_[face].furthest;
+  std::vector<int> visible;
+  std::vector<HorizonEdge> horizon;
+  if (!findHorizon(face, eye, &visible, &horizon))
+  {
+    // leave the point out, as if inside the hull
+    for (const int f : visible) faces_[f].alive = true;
+    Face &f = faces_[face];
+    f.outside.erase(std::find(f.outside.begin(), f.outside.end(), eye));
+    f.furthest = -1;
+    f.furthest_distance = 0.0;
+    std::vector<int> outside;
+    outside.swap(f.outside);
+    for (const int point : outside) addToFace(face, point, distance(f, point));
+    if (!f.outside.empty())
+      pending->push_back(face);
+    return;
+  }
+
+  std::vector<int> orphans;
+  for (const int f : visible)
+  {
+    for (const int point : faces_[f].outside)
+    {
+      if (point != eye)
+        orphans.push_back(point);
+    }
+    std::vector<int>().swap(faces_[f].outside);
+  }
+  // the horizon faces are added before freeing the visible ones, which are still read
+  std::vector<int> new_faces(horizon.size());
+  for (size_t k = 0; k < horizon.size(); k++)
+  {
+    const Face visible_face = faces_[horizon[k].face];
+    const int a = visible_face.vertices[horizon[k].edge];
+    const int b = visible_face.vertices[(horizon[k].edge + 1) % 3];
+    const int across = visible_face.neighbours[horizon[k].edge];
+    const int new_face = addFace(a, b, eye);
+    new_faces[k] = new_face;
+    faces_[new_face].neighbours[0] = across;
+    Face &other = faces_[across];
+    for (int e = 0; e < 3; e++)
+    {
+      if (other.vertices[e] == b && other.vertices[(e + 1) % 3] == a)
+        other.neighbours[e] = new_face;
+    }
+  }
+  for (size_t k = 0; k < horizon.size(); k++)
+  {
+    faces_[new_faces[k]].neighbours[1] = new_faces[(k + 1) % horizon.size()];
+    faces_[new_faces[k]].neighbours[2] = new_faces[(k + horizon.size() - 1) % horizon.size()];
+  }
+  free_faces_.insert(free_faces_.end(), visible.begin(), visible.end());
+
+  assign(orphans, new_faces);
+  for (const int f : new_faces)
+  {
+    if (!faces_[f].outside.empty())
+      pending->push_back(f);
+  }
+}
+
+bool HullBuilder::build(const std::vector<int> &indices)
+{
+  faces_.clear();
+  free_faces_.clear();
+  std::vector<int> simplex;
+  if (indices.size() < 4 || !addInitialSimplex(indices, &simplex))
+  {
+    faces_.clear();
+    return false;
+  }
+  std::vector<int> candidates;
+  candidates.reserve(indices.size());
+  for (const int i : indices)
+  {
+    if (std::find(simplex.begin(), simplex.end(), i) == simplex.end())
+      candidates.push_back(i);
+  }
+  assign(candidates, { 0, 1, 2, 3 });
+  std::vector<int> pending = { 0, 1, 2, 3 };
+  while (!pending.empty())
+  {
+    const int face = pending.back();
+    pending.pop_back();
+    if (faces_[face].alive && !faces_[face].outside.empty())
+      addPoint(face, &pending);
+  }
+  return true;
+}
+
+std::vector<int> HullBuilder::vertices() const
+{
+  std::vector<int> result;
+  for (const auto &face : faces_)
+  {
+    if (face.alive)
+      result.insert(result.end(), face.vertices.data(), face.vertices.data() + 3);
+  }
+  std::sort(result.begin(), result.end());
+  result.erase(std::unique(result.begin(), result.end()), result.end());
+  return result;
+}
+
+void HullBuilder::planes(std::vector<Eigen::Vector3d> *normals, std::vector<double> *offsets) const
+{
+  for (const auto &face : faces_)
+  {
+    if (face.alive)
+    {
+      normals->push_back(face.normal);
+      offsets->push_back(face.offset);
+    }
+  }
+}
+
+void HullBuilder::triangles(std::vector<Eigen::Vector3i> *triangles, std::vector<Eigen::Vector3d> *normals) const
+{
+  for (const auto &face : faces_)
+  {
+    if (face.alive)
+    {
+      triangles->push_back(face.vertices);
+      normals->push_back(face.normal);
+    }
+  }
+}
+
+/// The indices of the points that may be on the hull. The hull of the extreme points in 26 directions is inside the
+/// full hull, so the points strictly within it are discarded, testing the corners of a coarse grid first so that most
+/// of them are discarded by the cell that they are in.
+std::vector<int> hullCandidates(const std::vector<Eigen::Vector3d> &points, double tolerance)
+{
+  std::vector<int> all(points.size());
+  for (size_t i = 0; i < points.size(); i++) all[i] = static_cast<int>(i);
+  if (points.size() < kMinFilterPoints)
+    return all;
+
+  std::vector<Eigen::Vector3d> directions;
+  for (int i = 0; i < 27; i++)
+  {
+    if (i != 13)
+      directions.push_back(Eigen::Vector3d(i % 3 - 1, (i / 3) % 3 - 1, i / 9 - 1));
+  }
+  struct Extremes
+  {
+    std::vector<int> indices;
+    std::vector<double> values;
+    Eigen::Vector3d min_bound, max_bound;
+  };
+  Extremes identity;
+  identity.indices.assign(directions.size(), 0);
+  identity.values.assign(directions.size(), std::numeric_limits<double>::lowest());
+  identity.min_bound = Eigen::Vector3d::Constant(std::numeric_limits<double>::max());
+  identity.max_bound = -identity.min_bound;
+  const Extremes extremes = parallelReduce(
+    size_t(0), points.size(), identity,
+    [&](size_t i, Extremes &value) {
+      for (size_t j = 0; j < directions.size(); j++)
+      {
+        const double projection = directions[j].dot(points[i]);
+        if (projection > value.values[j])
+        {
+          value.values[j] = projection;
+          value.indices[j] = static_cast<int>(i);
+        }
+      }
+      value.min_bound = minVector(value.min_bound, points[i]);
+      value.max_bound = maxVector(value.max_bound, points[i]);
+    },
+    [&](Extremes a, const Extremes &b) {
+      for (size_t j = 0; j < directions.size(); j++)
+      {
+        if (b.values[j] > a.values[j])
+        {
+          a.values[j] = b.values[j];
+          a.indices[j] = b.indices[j];
+        }
+      }
+      a.min_bound = minVector(a.min_bound, b.min_bound);
+      a.max_bound = maxVector(a.max_bound, b.max_bound);
+      return a;
+    });
+  std::vector<int> extreme_points = extremes.indices;
+  std::sort(extreme_points.begin(), extreme_points.end());
+  extreme_points.erase(std::unique(extreme_points.begin(), extreme_points.end()), extreme_points.end());
+  HullBuilder inner_hull(points, tolerance);
+  if (!inner_hull.build(extreme_points))
+    return all;
+  std::vector<Eigen::Vector3d> normals;
+  std::vector<double> offsets;
+  inner_hull.planes(&normals, &offsets);
+  auto inside = [&](const Eigen::Vector3d &pos) {
+    for (size_t j = 0; j < normals.size(); j++)
+    {
+      if (normals[j].dot(pos) - offsets[j] >= -tolerance)
+        return false;
+    }
+    return true;
+  };
+
+  // a cell is entirely inside when its eight corners are
+  const Eigen::Vector3d extent = extremes.max_bound - extremes.min_bound;
+  const int cells = std::max(
+    1, std::min(kMaxGridCells, static_cast<int>(std::cbrt(static_cast<double>(points.size()) / 8.0))));
+  const Eigen::Vector3d cell_width = extent / static_cast<double>(cells);
+  const int corners = cells + 1;
+  std::vector<char> corner_inside(static_cast<size_t>(corners) * corners * corners);
+  parallelFor(0, corners, [&](int z) {
+    for (int y = 0; y < corners; y++)
+    {
+      for (int x = 0; x < corners; x++)
+      {
+        const Eigen::Vector3d corner = extremes.min_bound + Eigen::Vector3d(x, y, z).cwiseProduct(cell_width);
+        corner_inside[(static_cast<size_t>(z) * corners + y) * corners + x] = inside(corner);
+      }
+    }
+  });
+  std::vector<char> cell_inside(static_cast<size_t>(cells) * cells * cells);
+  parallelFor(0, cells, [&](int z) {
+    for (int y = 0; y < cells; y++)
+    {
+      for (int x = 0; x < cells; x++)
+      {
+        bool all_inside = true;
+        for (int j = 0; j < 8 && all_inside; j++)
+        {
+          const int cx = x + (j & 1), cy = y + ((j >> 1) & 1), cz = z + (j >> 2);
+          all_inside = corner_inside[(static_cast<size_t>(cz) * corners + cy) * corners + cx] != 0;
+        }
+        cell_inside[(static_cast<size_t>(z) * cells + y) * cells + x] = all_inside;
+      }
+    }
+  });
+
+  std::vector<char> keep(points.size());
+  parallelFor(size_t(0), points.size(), [&](size_t i) {
+    Eigen::Vector3i cell;
+    for (int axis = 0; axis < 3; axis++)
+    {
+      const double position =
+        cell_width[axis] > 0.0 ? (points[i][axis] - extremes.min_bound[axis]) / cell_width[axis] : 0.0;
+      cell[axis] = std::max(0, std::min(cells - 1, static_cast<int>(position)));
+    }
+    const size_t index = (static_cast<size_t>(cell[2]) * cells + cell[1]) * cells + cell[0];
+    keep[i] = !cell_inside[index] && !inside(points[i]);
+  });
+  std::vector<int> candidates;
+  for (size_t i = 0; i < points.size(); i++)
+  {
+    if (keep[i])
+      candidates.push_back(static_cast<int>(i));
+  }
+  return candidates;
+}
+}  // namespace
+
+bool QuickHull::build(const std::vector<Eigen::Vector3d> &points)
+{
+  triangles_.clear();
+  normals_.clear();
+  if (points.size() < 4)
+    return false;
+  // the rounding error of a distance from a face, as in Lloyd's QuickHull3D
+  Eigen::Vector3d max_coordinates(0, 0, 0);
+  for (const auto &point : points) max_coordinates = max_coordinates.cwiseMax(point.cwiseAbs());
+  const double tolerance = 3.0 * std::numeric_limits<double>::epsilon() * max_coordinates.sum();
+
+  // the hull vertices of each part, merged in pairs until there is one part
+  const std::vector<int> candidates = hullCandidates(points, tolerance);
+  const size_t max_parts = Threads::threadCount() > 1 ? static_cast<size_t>(2 * Threads::threadCount()) : 1;
+  const size_t num_parts = std::max(size_t(1), std::min(max_parts, candidates.size() / kMinPartPoints));
+  std::vector<std::vector<int>> parts(num_parts);
+  for (size_t i = 0; i < num_parts; i++)
+  {
+    parts[i].assign(candidates.begin() + candidates.size() * i / num_parts,
+                    candidates.begin() + candidates.size() * (i + 1) / num_parts);
+  }
+  while (parts.size() > 1)
+  {
+    std::vector<size_t> part_sizes(parts.size());
+    parallelFor(size_t(0), parts.size(), [&](size_t i) {
+      part_sizes[i] = parts[i].size();
+      HullBuilder part_hull(points, tolerance);
+      if (part_hull.build(parts[i]))
+        parts[i] = part_hull.vertices();  // otherwise the degenerate part is kept whole
+    });
+    size_t num_points = 0, num_vertices = 0;
+    for (size_t i = 0; i < parts.size(); i++)
+    {
+      num_points += part_sizes[i];
+      num_vertices += parts[i].size();
+    }
+    // merging in pairs only pays while the hulls of the parts leave out most of their points, as it does not for
+    // points that are nearly all on the hull, such as after the inversion of an outwards wrap
+    const size_t merge_count = 2 * num_vertices < num_points ? 2 : parts.size();
+    std::vector<std::vector<int>> merged((parts.size() + merge_count - 1) / merge_count);
+    for (size_t i = 0; i < parts.size(); i++)
+    {
+      merged[i / merge_count].insert(merged[i / merge_count].end(), parts[i].begin(), parts[i].end());
+    }
+    parts.swap(merged);
+  }
+
+  HullBuilder hull(points, tolerance);
+  if (!hull.build(parts[0]))
+    return false;
+  hull.triangles(&triangles_, &normals_);
+  return true;
+}
+}  // namespace ray
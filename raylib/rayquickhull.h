@@ -0,0 +1,37 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYQUICKHULL_H
+#define RAYLIB_RAYQUICKHULL_H
+
+#include "raylib/raylibconfig.h"
+#include "rayutils.h"
+
+namespace ray
+{
+/// The convex hull of a set of 3D points, as triangles, by Quickhull. Points within a rounding tolerance of a face
+/// count as on it, so a face that several points are coplanar with is split into triangles between some of them.
+///
+/// Large inputs are first filtered: the points inside the hull of the extreme points in 26 directions cannot be on the
+/// hull, and are discarded a whole cell of a coarse grid at a time. The rest are split into parts whose hulls are
+/// found in parallel, then merged in pairs, so that only the vertices of each part's hull go on to the next level.
+class RAYLIB_EXPORT QuickHull
+{
+public:
+  /// Find the hull of @c points . Returns false, with no triangles, if there are fewer than four non-coplanar points
+  bool build(const std::vector<Eigen::Vector3d> &points);
+
+  /// the indices of the three points of each triangle, anticlockwise as seen from outside the hull
+  const std::vector<Eigen::Vector3i> &triangles() const { return triangles_; }
+  /// the unit outward normal of each triangle
+  const std::vector<Eigen::Vector3d> &normals() const { return normals_; }
+
+private:
+  std::vector<Eigen::Vector3i> triangles_;
+  std::vector<Eigen::Vector3d> normals_;
+};
+}  // namespace ray
+
+#endif  // RAYLIB_RAYQUICKHULL_H
@@ -9,7 +9,8 @@ namespace ray
 {
 PCGRandomGenerator &PCGRandomGenerator::instance()
 {
-  static PCGRandomGenerator generator;
+  // one per thread, so that a parallel task that seeds it with @c srand() gets the same numbers on any thread
+  static thread_local PCGRandomGenerator generator;
   return generator;
 }
 
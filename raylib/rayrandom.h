@@ -63,6 +63,7 @@ private:
 
 /// Return a random number using some magic engine behind the hood.
 /// Use this over std::rand() as there's a good chance this will be faster/better.
+/// The generator is per thread, so @c srand() seeds only the calling thread's numbers.
 unsigned int RAYLIB_EXPORT rand();
 void RAYLIB_EXPORT srand(unsigned int seed);
 
@@ -0,0 +1,982 @@
+// Copyright (c) 2020
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "rayrcb.h"
+#include "rayremotefile.h"
+#include "raysort.h"
+#include "raytrajectory.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+namespace ray
+{
+namespace
+{
+const char kRcbMagic[4] = { 'R', 'C', 'B', '1' };
+const char kRcbIndexMagic[4] = { 'R', 'C', 'B', 'I' };
+const uint32_t kRcbVersion = 1;
+/// the version of files with compressed blocks, which version 1 readers cannot read
+const uint32_t kRcbCompressedVersion = 2;
+/// block encodings, in the block header
+const uint32_t kRcbRawBlock = 0;
+const uint32_t kRcbCompressedBlock = 1;
+/// the file header flag for rays in spatial order
+const uint32_t kRcbSpatiallySorted = 1;
+const size_t kRcbFileHeaderSize = 4 + 3 * sizeof(uint32_t);
+const size_t kRcbBlockHeaderSize = 2 * sizeof(uint32_t) + 4 * sizeof(double);
+const size_t kRcbFooterSize = 3 * sizeof(uint64_t) + 4 + sizeof(uint32_t);
+/// offset, num_rays, num_bounded, min and max time, three cuboids, ends sum
+const size_t kRcbIndexRecordSize = 3 * sizeof(uint64_t) + (2 + 3 * 6 + 3) * sizeof(double);
+
+template <class T>
+void appendValue(std::vector<char> &buffer, const T &value)
+{
+  const size_t size = buffer.size();
+  buffer.resize(size + sizeof(T));
+  std::memcpy(&buffer[size], &value, sizeof(T));
+}
+
+void appendVector(std::vector<char> &buffer, const Eigen::Vector3d &vec)
+{
+  for (int i = 0; i < 3; i++) appendValue(buffer, vec[i]);
+}
+
+template <class T>
+T readValue(const char *&data)
+{
+  T value;
+  std::memcpy(&value, data, sizeof(T));
+  data += sizeof(T);
+  return value;
+}
+
+Eigen::Vector3d readVector(const char *&data)
+{
+  Eigen::Vector3d vec;
+  for (int i = 0; i < 3; i++) vec[i] = readValue<double>(data);
+  return vec;
+}
+
+Cuboid emptyCuboid()
+{
+  const double min_s = std::numeric_limits<double>::max();
+  const double max_s = std::numeric_limits<double>::lowest();
+  return Cuboid(Eigen::Vector3d(min_s, min_s, min_s), Eigen::Vector3d(max_s, max_s, max_s));
+}
+
+/// positions are stored relative to the block origin, either as floats or quantised to int32 at @c resolution
+void appendPositions(std::vector<char> &buffer, const std::vector<Eigen::Vector3d> &positions,
+                     const Eigen::Vector3d &origin, double resolution)
+{
+  for (const auto &pos : positions)
+  {
+    const Eigen::Vector3d offset = pos - origin;
+    for (int i = 0; i < 3; i++)
+    {
+      if (resolution > 0.0)
+        appendValue(buffer, static_cast<int32_t>(std::round(offset[i] / resolution)));
+      else
+        appendValue(buffer, static_cast<float>(offset[i]));
+    }
+  }
+}
+
+void readPositions(const char *&data, std::vector<Eigen::Vector3d> &positions, const Eigen::Vector3d &origin,
+                   double resolution)
+{
+  for (auto &pos : positions)
+  {
+    for (int i = 0; i < 3; i++)
+    {
+      if (resolution > 0.0)
+        pos[i] = origin[i] + resolution * static_cast<double>(readValue<int32_t>(data));
+      else
+        pos[i] = origin[i] + static_cast<double>(readValue<float>(data));
+    }
+  }
+}
+
+/// size in bytes of a block's ray data, excluding its header
+size_t blockDataSize(size_t num_rays, double resolution)
+{
+  const size_t position_size = resolution > 0.0 ? sizeof(int32_t) : sizeof(float);
+  return num_rays * (6 * position_size + sizeof(double) + sizeof(RGBA));
+}
+
+/// The order 0 rANS entropy coder of the compressed blocks, with 12 bit symbol probabilities, a 32 bit state and byte
+/// renormalisation. Each coded stream starts with its 256 symbol frequencies, so blocks decode independently.
+const uint32_t kRansProbBits = 12;
+const uint32_t kRansProbScale = 1u << kRansProbBits;
+const uint32_t kRansLow = 1u << 23;
+const size_t kRansTableSize = 256 * sizeof(uint16_t);
+
+/// symbol frequencies of @c data , scaled to sum to @c kRansProbScale with every used symbol kept above zero
+void ransFrequencies(const std::vector<uint8_t> &data, uint32_t freqs[256])
+{
+  uint64_t counts[256] = { 0 };
+  for (const auto &byte : data) counts[byte]++;
+  uint32_t total = 0;
+  int largest = 0;
+  for (int s = 0; s < 256; s++)
+  {
+    freqs[s] = counts[s] == 0 ? 0 :
+                                std::max<uint32_t>(1, static_cast<uint32_t>((counts[s] * kRansProbScale) / data.size()));
+    total += freqs[s];
+    if (counts[s] > counts[largest])
+      largest = s;
+  }
+  // the rounding error is taken from or given to the other symbols, largest frequencies first
+  while (total != kRansProbScale)
+  {
+    if (total < kRansProbScale)
+    {
+      freqs[largest] += kRansProbScale - total;
+      total = kRansProbScale;
+    }
+    else
+    {
+      int s = static_cast<int>(std::max_element(freqs, freqs + 256) - freqs);
+      const uint32_t take = std::min(total - kRansProbScale, freqs[s] / 2);
+      freqs[s] -= take;
+      total -= take;
+    }
+  }
+}
+
+/// rANS coding of @c data , appended to @c out after the frequency table
+void ransEncode(const std::vector<uint8_t> &data, std::vector<uint8_t> &out)
+{
+  uint32_t freqs[256], cum_freqs[257];
+  ransFrequencies(data, freqs);
+  cum_freqs[0] = 0;
+  for (int s = 0; s < 256; s++) cum_freqs[s + 1] = cum_freqs[s] + freqs[s];
+  for (int s = 0; s < 256; s++)
+  {
+    out.push_back(static_cast<uint8_t>(freqs[s]));
+    out.push_back(static_cast<uint8_t>(freqs[s] >> 8));
+  }
+  // rANS codes in reverse, so the bytes are reversed after coding
+  const size_t start = out.size();
+  uint32_t state = kRansLow;
+  for (size_t i = data.size(); i-- > 0;)
+  {
+    const uint32_t freq = freqs[data[i]];
+    const uint32_t max_state = ((kRansLow >> kRansProbBits) << 8) * freq;
+    while (state >= max_state)
+    {
+      out.push_back(static_cast<uint8_t>(state));
+      state >>= 8;
+    }
+    state = ((state / freq) << kRansProbBits) + (state % freq) + cum_freqs[data[i]];
+  }
+  for (int shift = 0; shift < 32; shift += 8) out.push_back(static_cast<uint8_t>(state >> shift));
+  std::reverse(out.begin() + start, out.end());
+}
+
+/// decodes the @c size bytes of a rANS stream into the @c raw_size bytes of @c out . Returns false if it is corrupt.
+bool ransDecode(const uint8_t *data, size_t size, size_t raw_size, std::vector<uint8_t> &out)
+{
+  if (size < kRansTableSize + 4)
+    return false;
+  uint32_t freqs[256], cum_freqs[257];
+  cum_freqs[0] = 0;
+  for (int s = 0; s < 256; s++)
+  {
+    freqs[s] = static_cast<uint32_t>(data[2 * s]) | (static_cast<uint32_t>(data[2 * s + 1]) << 8);
+    cum_freqs[s + 1] = cum_freqs[s] + freqs[s];
+  }
+  if (cum_freqs[256] != kRansProbScale)
+    return false;
+  uint8_t symbols[kRansProbScale];
+  for (int s = 0; s < 256; s++) std::memset(symbols + cum_freqs[s], s, freqs[s]);
+
+  const uint8_t *end = data + size;
+  data += kRansTableSize;
+  uint32_t state = (static_cast<uint32_t>(data[0]) << 24) | (static_cast<uint32_t>(data[1]) << 16) |
+                   (static_cast<uint32_t>(data[2]) << 8) | static_cast<uint32_t>(data[3]);
+  data += 4;
+  out.resize(raw_size);
+  for (auto &byte : out)
+  {
+    const uint32_t slot = state & (kRansProbScale - 1);
+    const uint8_t symbol = symbols[slot];
+    byte = symbol;
+    state = freqs[symbol] * (state >> kRansProbBits) + slot - cum_freqs[symbol];
+    while (state < kRansLow)
+    {
+      if (data == end)
+        return false;
+      state = (state << 8) | *data++;
+    }
+  }
+  return true;
+}
+
+/// stream methods of a compressed block
+const uint8_t kStreamStored = 0;
+const uint8_t kStreamRans = 1;
+const size_t kStreamHeaderSize = 1 + 2 * sizeof(uint32_t);
+
+/// appends @c raw to @c buffer as a stream: uint8 method, uint32 raw size, uint32 stored size, then the stored bytes,
+/// which are rANS coded unless that is no smaller
+void appendStream(std::vector<char> &buffer, const std::vector<uint8_t> &raw)
+{
+  std::vector<uint8_t> coded;
+  if (!raw.empty())
+    ransEncode(raw, coded);
+  const bool use_rans = !raw.empty() && coded.size() < raw.size();
+  const std::vector<uint8_t> &stored = use_rans ? coded : raw;
+  appendValue(buffer, use_rans ? kStreamRans : kStreamStored);
+  appendValue(buffer, static_cast<uint32_t>(raw.size()));
+  appendValue(buffer, static_cast<uint32_t>(stored.size()));
+  buffer.insert(buffer.end(), stored.begin(), stored.end());
+}
+
+/// reads a stream of @c appendStream into @c raw , advancing @c data . Returns false if it runs past @c end .
+bool readStream(const char *&data, const char *end, std::vector<uint8_t> &raw)
+{
+  if (end - data < static_cast<std::ptrdiff_t>(kStreamHeaderSize))
+    return false;
+  const uint8_t method = readValue<uint8_t>(data);
+  const uint32_t raw_size = readValue<uint32_t>(data);
+  const uint32_t size = readValue<uint32_t>(data);
+  if (static_cast<size_t>(end - data) < size)
+    return false;
+  const uint8_t *bytes = reinterpret_cast<const uint8_t *>(data);
+  data += size;
+  if (method == kStreamStored)
+  {
+    raw.assign(bytes, bytes + size);
+    return size == raw_size;
+  }
+  return method == kStreamRans && ransDecode(bytes, size, raw_size, raw);
+}
+
+void appendVarint(std::vector<uint8_t> &bytes, uint64_t value)
+{
+  for (; value >= 0x80; value >>= 7) bytes.push_back(static_cast<uint8_t>(value | 0x80));
+  bytes.push_back(static_cast<uint8_t>(value));
+}
+
+bool readVarint(const uint8_t *&data, const uint8_t *end, uint64_t &value)
+{
+  value = 0;
+  for (int shift = 0; shift < 64; shift += 7)
+  {
+    if (data == end)
+      return false;
+    const uint8_t byte = *data++;
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0)
+      return true;
+  }
+  return false;
+}
+
+/// signed values are interleaved as 0, -1, 1, -2, ... so that small magnitudes have short varints
+inline uint64_t zigzag(int64_t value)
+{
+  return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t unzigzag(uint64_t value)
+{
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+/// Positions relative to @c origin , with the same values as @c appendPositions . Quantised positions are stored as
+/// varint deltas from the previous position, and float offsets as separate byte planes, so that the bytes that vary
+/// little within a block, such as their exponents, are coded together.
+void encodePositions(const std::vector<Eigen::Vector3d> &positions, const Eigen::Vector3d &origin, double resolution,
+                     std::vector<uint8_t> &bytes)
+{
+  if (resolution > 0.0)
+  {
+    int64_t previous[3] = { 0, 0, 0 };
+    for (const auto &pos : positions)
+    {
+      for (int i = 0; i < 3; i++)
+      {
+        const int64_t value = static_cast<int32_t>(std::round((pos[i] - origin[i]) / resolution));
+        appendVarint(bytes, zigzag(value - previous[i]));
+        previous[i] = value;
+      }
+    }
+    return;
+  }
+  const size_t num = positions.size();
+  const size_t start = bytes.size();
+  bytes.resize(start + 3 * sizeof(float) * num);
+  for (size_t j = 0; j < num; j++)
+  {
+    for (int i = 0; i < 3; i++)
+    {
+      const float value = static_cast<float>(positions[j][i] - origin[i]);
+      uint8_t value_bytes[sizeof(float)];
+      std::memcpy(value_bytes, &value, sizeof(float));
+      for (size_t k = 0; k < sizeof(float); k++) bytes[start + (sizeof(float) * i + k) * num + j] = value_bytes[k];
+    }
+  }
+}
+
+bool decodePositions(const uint8_t *&data, const uint8_t *end, const Eigen::Vector3d &origin, double resolution,
+                     std::vector<Eigen::Vector3d> &positions)
+{
+  if (resolution > 0.0)
+  {
+    int64_t value[3] = { 0, 0, 0 };
+    for (auto &pos : positions)
+    {
+      for (int i = 0; i < 3; i++)
+      {
+        uint64_t delta;
+        if (!readVarint(data, end, delta))
+          return false;
+        value[i] += unzigzag(delta);
+        pos[i] = origin[i] + resolution * static_cast<double>(value[i]);
+      }
+    }
+    return true;
+  }
+  const size_t num = positions.size();
+  if (static_cast<size_t>(end - data) < 3 * sizeof(float) * num)
+    return false;
+  for (size_t j = 0; j < num; j++)
+  {
+    for (int i = 0; i < 3; i++)
+    {
+      uint8_t value_bytes[sizeof(float)];
+      for (size_t k = 0; k < sizeof(float); k++) value_bytes[k] = data[(sizeof(float) * i + k) * num + j];
+      float value;
+      std::memcpy(&value, value_bytes, sizeof(float));
+      positions[j][i] = origin[i] + static_cast<double>(value);
+    }
+  }
+  data += 3 * sizeof(float) * num;
+  return true;
+}
+
+/// Fits a trajectory to the ray @c starts over their @c times , for predicting the starts from the times. Knots are
+/// placed at rays in time order, each as far along as keeps the rays since the previous knot within @c tolerance of
+/// the segment between them, with at most @c kMaxKnotSpacing rays per segment. Returns false if there are fewer than
+/// two distinct times, as the knot times must increase.
+const size_t kMaxKnotSpacing = 128;
+bool fitTrajectory(const std::vector<Eigen::Vector3d> &starts, const std::vector<double> &times, double tolerance,
+                   Trajectory &trajectory)
+{
+  for (const auto &time : times)
+  {
+    if (!std::isfinite(time))
+      return false;
+  }
+  const std::vector<size_t> order = radixSortOrder(times);
+  auto &knot_points = trajectory.points();
+  auto &knot_times = trajectory.times();
+  knot_points.clear();
+  knot_times.clear();
+  if (order.empty())
+    return false;
+  auto add_knot = [&](size_t j) {
+    knot_points.push_back(starts[order[j]]);
+    knot_times.push_back(times[order[j]]);
+  };
+  add_knot(0);
+  size_t knot = 0;
+  size_t furthest = 0;  // the furthest ray since the knot that the segment to it fits to, or the knot itself
+  for (size_t j = 1; j < order.size(); j++)
+  {
+    const double time = times[order[j]];
+    if (time <= knot_times.back())
+      continue;
+    bool fits = j - knot <= kMaxKnotSpacing;
+    for (size_t k = knot + 1; k < j && fits; k++)
+    {
+      const double blend = (times[order[k]] - knot_times.back()) / (time - knot_times.back());
+      const Eigen::Vector3d predicted = knot_points.back() * (1.0 - blend) + starts[order[j]] * blend;
+      fits = (predicted - starts[order[k]]).cwiseAbs().maxCoeff() <= tolerance;
+    }
+    if (fits)
+    {
+      furthest = j;
+      continue;
+    }
+    // the segment ends at the furthest ray that fits, and the rays after it are tried again from there
+    knot = furthest > knot ? furthest : j;
+    add_knot(knot);
+    furthest = knot;
+    j = knot;
+  }
+  if (times[order.back()] > knot_times.back())
+    add_knot(order.size() - 1);
+  return knot_times.size() >= 2;
+}
+
+/// start encodings of a compressed block
+const uint8_t kStartsExplicit = 0;
+const uint8_t kStartsTrajectory = 1;
+
+/// The starts as their trajectory: varint knot count, the knots as double time and position, a bit per ray that
+/// has a residual from the trajectory, then the residuals, varint quantised or as floats.
+bool encodeTrajectoryStarts(const std::vector<Eigen::Vector3d> &starts, const std::vector<double> &times,
+                            double resolution, double tolerance, std::vector<uint8_t> &bytes)
+{
+  Trajectory trajectory;
+  if (!fitTrajectory(starts, times, tolerance, trajectory))
+    return false;
+  bytes.push_back(kStartsTrajectory);
+  appendVarint(bytes, trajectory.times().size());
+  auto append_double = [&bytes](double value) {
+    uint8_t value_bytes[sizeof(double)];
+    std::memcpy(value_bytes, &value, sizeof(double));
+    bytes.insert(bytes.end(), value_bytes, value_bytes + sizeof(double));
+  };
+  for (size_t i = 0; i < trajectory.times().size(); i++)
+  {
+    append_double(trajectory.times()[i]);
+    for (int j = 0; j < 3; j++) append_double(trajectory.points()[i][j]);
+  }
+  // the decoder predicts with the same call, so the residuals are exact
+  std::vector<Eigen::Vector3d> predicted;
+  trajectory.linear(times, predicted);
+  const size_t flags_start = bytes.size();
+  bytes.resize(flags_start + (starts.size() + 7) / 8, 0);
+  std::vector<uint8_t> residuals;
+  for (size_t i = 0; i < starts.size(); i++)
+  {
+    const Eigen::Vector3d residual = starts[i] - predicted[i];
+    if (residual.cwiseAbs().maxCoeff() <= tolerance)
+      continue;
+    bytes[flags_start + i / 8] |= static_cast<uint8_t>(1u << (i % 8));
+    for (int j = 0; j < 3; j++)
+    {
+      if (resolution > 0.0)
+      {
+        appendVarint(residuals, zigzag(static_cast<int64_t>(std::round(residual[j] / resolution))));
+      }
+      else
+      {
+        const float value = static_cast<float>(residual[j]);
+        uint8_t value_bytes[sizeof(float)];
+        std::memcpy(value_bytes, &value, sizeof(float));
+        residuals.insert(residuals.end(), value_bytes, value_bytes + sizeof(float));
+      }
+    }
+  }
+  bytes.insert(bytes.end(), residuals.begin(), residuals.end());
+  return true;
+}
+
+bool decodeTrajectoryStarts(const uint8_t *&data, const uint8_t *end, const std::vector<double> &times,
+                            double resolution, std::vector<Eigen::Vector3d> &starts)
+{
+  uint64_t num_knots;
+  if (!readVarint(data, end, num_knots) || num_knots < 2 ||
+      static_cast<uint64_t>(end - data) / (4 * sizeof(double)) < num_knots)
+    return false;
+  auto read_double = [&data]() {
+    double value;
+    std::memcpy(&value, data, sizeof(double));
+    data += sizeof(double);
+    return value;
+  };
+  Trajectory trajectory;
+  trajectory.times().resize(num_knots);
+  trajectory.points().resize(num_knots);
+  for (size_t i = 0; i < num_knots; i++)
+  {
+    trajectory.times()[i] = read_double();
+    for (int j = 0; j < 3; j++) trajectory.points()[i][j] = read_double();
+  }
+  trajectory.linear(times, starts);
+  const size_t flags_size = (starts.size() + 7) / 8;
+  if (static_cast<size_t>(end - data) < flags_size)
+    return false;
+  const uint8_t *flags = data;
+  data += flags_size;
+  for (size_t i = 0; i < starts.size(); i++)
+  {
+    if ((flags[i / 8] & (1u << (i % 8))) == 0)
+      continue;
+    for (int j = 0; j < 3; j++)
+    {
+      if (resolution > 0.0)
+      {
+        uint64_t value;
+        if (!readVarint(data, end, value))
+          return false;
+        starts[i][j] += resolution * static_cast<double>(unzigzag(value));
+      }
+      else
+      {
+        if (static_cast<size_t>(end - data) < sizeof(float))
+          return false;
+        float value;
+        std::memcpy(&value, data, sizeof(float));
+        data += sizeof(float);
+        starts[i][j] += static_cast<double>(value);
+      }
+    }
+  }
+  return true;
+}
+
+/// Serialises the rays of a compressed block as four streams: ends, starts, times and colours. The starts are stored
+/// relative to a trajectory through them when that is smaller than storing them in the same way as the ends. Times are
+/// the varint differences of the bit patterns of successive times, which are lossless and small for increasing
+/// times, and colours are split into byte planes.
+void appendCompressedRays(std::vector<char> &buffer, const std::vector<Eigen::Vector3d> &starts,
+                          const std::vector<Eigen::Vector3d> &ends, const std::vector<double> &times,
+                          const std::vector<RGBA> &colours, const Eigen::Vector3d &origin, double resolution,
+                          double tolerance)
+{
+  std::vector<uint8_t> bytes;
+  encodePositions(ends, origin, resolution, bytes);
+  appendStream(buffer, bytes);
+
+  std::vector<char> explicit_stream, trajectory_stream;
+  bytes.assign(1, kStartsExplicit);
+  encodePositions(starts, origin, resolution, bytes);
+  appendStream(explicit_stream, bytes);
+  bytes.clear();
+  if (encodeTrajectoryStarts(starts, times, resolution, tolerance, bytes))
+    appendStream(trajectory_stream, bytes);
+  const bool use_trajectory = !trajectory_stream.empty() && trajectory_stream.size() < explicit_stream.size();
+  const std::vector<char> &starts_stream = use_trajectory ? trajectory_stream : explicit_stream;
+  buffer.insert(buffer.end(), starts_stream.begin(), starts_stream.end());
+
+  bytes.clear();
+  uint64_t previous = 0;
+  for (const auto &time : times)
+  {
+    uint64_t bits;
+    std::memcpy(&bits, &time, sizeof(double));
+    appendVarint(bytes, zigzag(static_cast<int64_t>(bits - previous)));
+    previous = bits;
+  }
+  appendStream(buffer, bytes);
+
+  bytes.resize(colours.size() * sizeof(RGBA));
+  for (size_t i = 0; i < colours.size(); i++)
+  {
+    bytes[i] = colours[i].red;
+    bytes[colours.size() + i] = colours[i].green;
+    bytes[2 * colours.size() + i] = colours[i].blue;
+    bytes[3 * colours.size() + i] = colours[i].alpha;
+  }
+  appendStream(buffer, bytes);
+}
+
+/// reads the rays of @c appendCompressedRays , which are already sized to the block. Returns false if it is corrupt.
+bool readCompressedRays(const char *data, const char *end, std::vector<Eigen::Vector3d> &starts,
+                        std::vector<Eigen::Vector3d> &ends, std::vector<double> &times, std::vector<RGBA> &colours,
+                        const Eigen::Vector3d &origin, double resolution)
+{
+  std::vector<uint8_t> bytes;
+  const uint8_t *byte = nullptr, *bytes_end = nullptr;
+  auto next_stream = [&]() {
+    if (!readStream(data, end, bytes))
+      return false;
+    byte = bytes.data();
+    bytes_end = byte + bytes.size();
+    return true;
+  };
+  if (!next_stream() || !decodePositions(byte, bytes_end, origin, resolution, ends))
+    return false;
+
+  // the times are needed to reconstruct the starts, so are read first
+  std::vector<uint8_t> starts_bytes;
+  if (!readStream(data, end, starts_bytes) || starts_bytes.empty() || !next_stream())
+    return false;
+  uint64_t bits = 0;
+  for (auto &time : times)
+  {
+    uint64_t delta;
+    if (!readVarint(byte, bytes_end, delta))
+      return false;
+    bits += static_cast<uint64_t>(unzigzag(delta));
+    std::memcpy(&time, &bits, sizeof(double));
+  }
+  const uint8_t *starts_byte = starts_bytes.data() + 1;
+  const uint8_t *starts_end = starts_bytes.data() + starts_bytes.size();
+  if (starts_bytes[0] == kStartsExplicit)
+  {
+    if (!decodePositions(starts_byte, starts_end, origin, resolution, starts))
+      return false;
+  }
+  else if (starts_bytes[0] != kStartsTrajectory ||
+           !decodeTrajectoryStarts(starts_byte, starts_end, times, resolution, starts))
+  {
+    return false;
+  }
+
+  if (!next_stream() || bytes.size() != colours.size() * sizeof(RGBA))
+    return false;
+  for (size_t i = 0; i < colours.size(); i++)
+  {
+    colours[i].red = bytes[i];
+    colours[i].green = bytes[colours.size() + i];
+    colours[i].blue = bytes[2 * colours.size() + i];
+    colours[i].alpha = bytes[3 * colours.size() + i];
+  }
+  return true;
+}
+
+/// the settings of the writers begun after @c RcbWriter::setCompression
+bool compress_blocks = false;
+double compress_start_tolerance = RcbWriter::kDefaultStartTolerance;
+}  // namespace
+
+bool isRcbFileName(const std::string &file_name)
+{
+  return file_name.size() >= 4 && file_name.substr(file_name.size() - 4) == ".rcb";
+}
+
+bool readRcbIndex(const std::string &file_name, RcbIndex &index)
+{
+  InputFile ifs(file_name);
+  if (ifs.fail())
+  {
+    std::cerr << "Error: cannot open: " << file_name << std::endl;
+    return false;
+  }
+  char header[kRcbFileHeaderSize];
+  ifs.read(header, kRcbFileHeaderSize);
+  if (!ifs || std::memcmp(header, kRcbMagic, 4) != 0)
+  {
+    std::cerr << "Error: " << file_name << " is not a ray cloud binary file" << std::endl;
+    return false;
+  }
+  const char *version_data = header + 4;
+  if (readValue<uint32_t>(version_data) > kRcbCompressedVersion)
+  {
+    std::cerr << "Error: " << file_name << " is from a newer version of raylib" << std::endl;
+    return false;
+  }
+  const char *flags_data = header + 4 + 2 * sizeof(uint32_t);
+  index.spatially_sorted = (readValue<uint32_t>(flags_data) & kRcbSpatiallySorted) != 0;
+  ifs.seekg(0, std::ios::end);
+  const std::streamoff file_size = ifs.tellg();
+  if (file_size < static_cast<std::streamoff>(kRcbFileHeaderSize + kRcbFooterSize))
+  {
+    std::cerr << "Error: " << file_name << " is truncated" << std::endl;
+    return false;
+  }
+  char footer[kRcbFooterSize];
+  ifs.seekg(file_size - static_cast<std::streamoff>(kRcbFooterSize));
+  ifs.read(footer, kRcbFooterSize);
+  const char *data = footer;
+  const uint64_t index_offset = readValue<uint64_t>(data);
+  const uint64_t num_blocks = readValue<uint64_t>(data);
+  index.num_rays = readValue<uint64_t>(data);
+  if (!ifs || std::memcmp(data, kRcbIndexMagic, 4) != 0 ||
+      index_offset + num_blocks * kRcbIndexRecordSize + kRcbFooterSize != static_cast<uint64_t>(file_size))
+  {
+    std::cerr << "Error: " << file_name << " has a missing or corrupt block index, it may not have been closed properly"
+              << std::endl;
+    return false;
+  }
+
+  std::vector<char> records(num_blocks * kRcbIndexRecordSize);
+  ifs.seekg(static_cast<std::streamoff>(index_offset));
+  ifs.read(records.data(), records.size());
+  if (!ifs)
+  {
+    std::cerr << "Error: cannot read the block index of " << file_name << std::endl;
+    return false;
+  }
+  index.blocks.resize(num_blocks);
+  data = records.data();
+  for (auto &block : index.blocks)
+  {
+    block.offset = readValue<uint64_t>(data);
+    block.num_rays = readValue<uint64_t>(data);
+    block.num_bounded = readValue<uint64_t>(data);
+    block.min_time = readValue<double>(data);
+    block.max_time = readValue<double>(data);
+    for (Cuboid *cuboid : { &block.ends_bound, &block.starts_bound, &block.rays_bound })
+    {
+      cuboid->min_bound_ = readVector(data);
+      cuboid->max_bound_ = readVector(data);
+    }
+    block.ends_sum = readVector(data);
+  }
+  return true;
+}
+
+bool readRcb(const std::string &file_name,
+             std::function<void(std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                                std::vector<double> &times, std::vector<RGBA> &colours)>
+               apply)
+{
+  return readRcb(file_name, apply, nullptr);
+}
+
+bool readRcb(const std::string &file_name,
+             std::function<void(std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                                std::vector<double> &times, std::vector<RGBA> &colours)>
+               apply,
+             std::function<bool(const RcbBlockInfo &block)> select)
+{
+  RcbIndex index;
+  if (!readRcbIndex(file_name, index))
+  {
+    return false;
+  }
+  if (index.num_rays == 0)
+  {
+    std::cerr << "Error: no entries found in " << file_name << std::endl;
+    return false;
+  }
+  InputFile ifs(file_name);
+  std::vector<char> buffer;
+  std::vector<Eigen::Vector3d> starts, ends;
+  std::vector<double> times;
+  std::vector<RGBA> colours;
+  for (const auto &block : index.blocks)
+  {
+    if (select && !select(block))
+    {
+      continue;
+    }
+    char header[kRcbBlockHeaderSize];
+    ifs.seekg(static_cast<std::streamoff>(block.offset));
+    ifs.read(header, kRcbBlockHeaderSize);
+    const char *data = header;
+    const uint32_t num_rays = readValue<uint32_t>(data);
+    const uint32_t encoding = readValue<uint32_t>(data);
+    const Eigen::Vector3d origin = readVector(data);
+    const double resolution = readValue<double>(data);
+    uint64_t data_size = blockDataSize(num_rays, resolution);
+    if (ifs && encoding == kRcbCompressedBlock)
+    {
+      ifs.read(reinterpret_cast<char *>(&data_size), sizeof(data_size));
+    }
+    if (!ifs || num_rays != block.num_rays || (encoding != kRcbRawBlock && encoding != kRcbCompressedBlock) ||
+        data_size > static_cast<uint64_t>(std::numeric_limits<std::streamsize>::max()))
+    {
+      std::cerr << "Error: corrupt block at offset " << block.offset << " in " << file_name << std::endl;
+      return false;
+    }
+    buffer.resize(data_size);
+    ifs.read(buffer.data(), buffer.size());
+    if (!ifs)
+    {
+      std::cerr << "Error: " << file_name << " is truncated" << std::endl;
+      return false;
+    }
+
+    starts.resize(num_rays);
+    ends.resize(num_rays);
+    times.resize(num_rays);
+    colours.resize(num_rays);
+    data = buffer.data();
+    if (encoding == kRcbCompressedBlock)
+    {
+      if (!readCompressedRays(data, data + buffer.size(), starts, ends, times, colours, origin, resolution))
+      {
+        std::cerr << "Error: corrupt block at offset " << block.offset << " in " << file_name << std::endl;
+        return false;
+      }
+    }
+    else
+    {
+      readPositions(data, ends, origin, resolution);
+      readPositions(data, starts, origin, resolution);
+      std::memcpy(times.data(), data, num_rays * sizeof(double));
+      data += num_rays * sizeof(double);
+      std::memcpy(colours.data(), data, num_rays * sizeof(RGBA));
+    }
+    apply(starts, ends, times, colours);
+  }
+  return true;
+}
+
+void RcbWriter::setCompression(bool compressed, double start_tolerance)
+{
+  compress_blocks = compressed;
+  compress_start_tolerance = start_tolerance;
+}
+
+bool RcbWriter::compressed()
+{
+  return compress_blocks;
+}
+
+double RcbWriter::startTolerance()
+{
+  return compress_start_tolerance;
+}
+
+bool RcbWriter::begin(const std::string &file_name, double resolution, size_t block_capacity, bool spatially_sorted)
+{
+  ofs_.open(file_name, std::ios::binary | std::ios::out);
+  if (ofs_.fail())
+  {
+    std::cerr << "Error: cannot open " << file_name << " for writing." << std::endl;
+    return false;
+  }
+  resolution_ = resolution;
+  compressed_ = compress_blocks;
+  start_tolerance_ = compress_start_tolerance;
+  block_capacity_ = std::max<size_t>(block_capacity, 1);
+  num_rays_ = 0;
+  blocks_.clear();
+  starts_.clear();
+  ends_.clear();
+  times_.clear();
+  colours_.clear();
+
+  buffer_.clear();
+  buffer_.insert(buffer_.end(), kRcbMagic, kRcbMagic + 4);
+  appendValue(buffer_, compressed_ ? kRcbCompressedVersion : kRcbVersion);
+  appendValue(buffer_, static_cast<uint32_t>(block_capacity_));
+  appendValue(buffer_, spatially_sorted ? kRcbSpatiallySorted : static_cast<uint32_t>(0));  // flags
+  ofs_.write(buffer_.data(), buffer_.size());
+  return ofs_.good();
+}
+
+bool RcbWriter::writeChunk(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+                           const std::vector<double> &times, const std::vector<RGBA> &colours)
+{
+  if (!ofs_.is_open())
+  {
+    std::cerr << "Error: file header has not been written, use RcbWriter::begin" << std::endl;
+    return false;
+  }
+  bool warned = false;
+  for (size_t i = 0; i < ends.size(); i++)
+  {
+    // the ply reader drops non-finite rays, so they are dropped on writing here, to give the same result
+    if (!ends[i].allFinite() || !starts[i].allFinite())
+    {
+      if (!warned)
+      {
+        std::cout << "WARNING: non-finite ray removed: " << starts[i].transpose() << ", " << ends[i].transpose()
+                  << std::endl;
+        warned = true;
+      }
+      continue;
+    }
+    starts_.push_back(starts[i]);
+    ends_.push_back(ends[i]);
+    times_.push_back(times[i]);
+    colours_.push_back(colours[i]);
+    if (ends_.size() == block_capacity_ && !writeBlock())
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool RcbWriter::writeBlock()
+{
+  RcbBlockInfo block;
+  block.offset = static_cast<uint64_t>(ofs_.tellp());
+  block.num_rays = ends_.size();
+  block.num_bounded = 0;
+  block.min_time = std::numeric_limits<double>::max();
+  block.max_time = std::numeric_limits<double>::lowest();
+  block.ends_bound = block.starts_bound = block.rays_bound = emptyCuboid();
+  block.ends_sum.setZero();
+  for (size_t i = 0; i < ends_.size(); i++)
+  {
+    if (colours_[i].alpha > 0)
+    {
+      block.ends_bound.min_bound_ = minVector(block.ends_bound.min_bound_, ends_[i]);
+      block.ends_bound.max_bound_ = maxVector(block.ends_bound.max_bound_, ends_[i]);
+      block.ends_sum += ends_[i];
+      block.num_bounded++;
+    }
+    block.starts_bound.min_bound_ = minVector(block.starts_bound.min_bound_, starts_[i]);
+    block.starts_bound.max_bound_ = maxVector(block.starts_bound.max_bound_, starts_[i]);
+    block.rays_bound.min_bound_ = minVector(block.rays_bound.min_bound_, minVector(starts_[i], ends_[i]));
+    block.rays_bound.max_bound_ = maxVector(block.rays_bound.max_bound_, maxVector(starts_[i], ends_[i]));
+    block.min_time = std::min(block.min_time, times_[i]);
+    block.max_time = std::max(block.max_time, times_[i]);
+  }
+
+  // quantise only when every offset fits in an int32, otherwise fall back to floats for this block
+  const Eigen::Vector3d origin = block.rays_bound.min_bound_;
+  double resolution = resolution_;
+  const double max_extent = (block.rays_bound.max_bound_ - origin).maxCoeff();
+  if (resolution > 0.0 && max_extent / resolution >= static_cast<double>(std::numeric_limits<int32_t>::max()))
+  {
+    resolution = 0.0;
+  }
+
+  buffer_.clear();
+  appendValue(buffer_, static_cast<uint32_t>(block.num_rays));
+  appendValue(buffer_, compressed_ ? kRcbCompressedBlock : kRcbRawBlock);
+  appendVector(buffer_, origin);
+  appendValue(buffer_, resolution);
+  if (compressed_)
+  {
+    const size_t size_pos = buffer_.size();
+    appendValue(buffer_, static_cast<uint64_t>(0));
+    appendCompressedRays(buffer_, starts_, ends_, times_, colours_, origin, resolution, start_tolerance_);
+    const uint64_t data_size = buffer_.size() - size_pos - sizeof(uint64_t);
+    std::memcpy(&buffer_[size_pos], &data_size, sizeof(data_size));
+  }
+  else
+  {
+    appendPositions(buffer_, ends_, origin, resolution);
+    appendPositions(buffer_, starts_, origin, resolution);
+    const size_t times_pos = buffer_.size();
+    buffer_.resize(times_pos + times_.size() * sizeof(double) + colours_.size() * sizeof(RGBA));
+    std::memcpy(&buffer_[times_pos], times_.data(), times_.size() * sizeof(double));
+    std::memcpy(&buffer_[times_pos + times_.size() * sizeof(double)], colours_.data(),
+                colours_.size() * sizeof(RGBA));
+  }
+  ofs_.write(buffer_.data(), buffer_.size());
+
+  num_rays_ += block.num_rays;
+  blocks_.push_back(block);
+  starts_.clear();
+  ends_.clear();
+  times_.clear();
+  colours_.clear();
+  return ofs_.good();
+}
+
+uint64_t RcbWriter::end()
+{
+  if (!ofs_.is_open())
+  {
+    return 0;
+  }
+  if (!ends_.empty())
+  {
+    writeBlock();
+  }
+  const uint64_t index_offset = static_cast<uint64_t>(ofs_.tellp());
+  buffer_.clear();
+  for (const auto &block : blocks_)
+  {
+    appendValue(buffer_, block.offset);
+    appendValue(buffer_, block.num_rays);
+    appendValue(buffer_, block.num_bounded);
+    appendValue(buffer_, block.min_time);
+    appendValue(buffer_, block.max_time);
+    for (const Cuboid *cuboid : { &block.ends_bound, &block.starts_bound, &block.rays_bound })
+    {
+      appendVector(buffer_, cuboid->min_bound_);
+      appendVector(buffer_, cuboid->max_bound_);
+    }
+    appendVector(buffer_, block.ends_sum);
+  }
+  appendValue(buffer_, index_offset);
+  appendValue(buffer_, static_cast<uint64_t>(blocks_.size()));
+  appendValue(buffer_, num_rays_);
+  buffer_.insert(buffer_.end(), kRcbIndexMagic, kRcbIndexMagic + 4);
+  appendValue(buffer_, compressed_ ? kRcbCompressedVersion : kRcbVersion);
+  ofs_.write(buffer_.data(), buffer_.size());
+  ofs_.close();
+  return num_rays_;
+}
+}  // namespace ray
@@ -0,0 +1,135 @@
+// Copyright (c) 2020
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYRCB_H
+#define RAYLIB_RAYRCB_H
+
+#include "raylib/raylibconfig.h"
+
+#include "raycuboid.h"
+#include "rayutils.h"
+
+namespace ray
+{
+/// The ray cloud binary (.rcb) format. This is a compact native alternative to the ray cloud .ply format.
+/// Rays are stored in fixed-capacity blocks, and each block stores its rays column-wise: ends, then starts,
+/// then times, then colours. Positions are stored relative to a per-block double precision origin, either as floats
+/// or (optionally) as int32 values quantised to a fixed resolution.
+/// The file ends with an index of per-block bounds, time ranges and ray counts, so the summary information of a
+/// cloud (see @c Cloud::getInfo) is available without reading the rays, and readers can skip whole blocks.
+///
+/// File layout (little endian):
+///   file header: "RCB1", uint32 version, uint32 block capacity, uint32 flags (bit 0 is set when the rays are
+///                in spatial order, see @c Cloud::sortSpatially )
+///   blocks:      uint32 num_rays, uint32 encoding, double origin[3], double resolution (0 for float positions),
+///                then for encoding 0: ends[3 * num_rays], starts[3 * num_rays], double times[num_rays],
+///                RGBA colours[num_rays]
+///                or for encoding 1 (compressed, version 2 files): uint64 data size, then entropy coded streams of
+///                the ends, starts, times and colours (see @c RcbWriter::setCompression )
+///   index:       one record per block (see @c RcbBlockInfo)
+///   footer:      uint64 index offset, uint64 num_blocks, uint64 num_rays, "RCBI", uint32 version
+
+/// Summary of one block of an .rcb file, as stored in the file's index
+struct RAYLIB_EXPORT RcbBlockInfo
+{
+  /// byte offset of the block within the file
+  uint64_t offset;
+  /// number of rays in the block
+  uint64_t num_rays;
+  /// number of bounded rays in the block
+  uint64_t num_bounded;
+  double min_time;
+  double max_time;
+  /// bounds of the bounded ray ends
+  Cuboid ends_bound;
+  /// bounds of all ray starts
+  Cuboid starts_bound;
+  /// bounds of all ray starts and ends, including unbounded rays
+  Cuboid rays_bound;
+  /// sum of the bounded ray ends, so that centroids can be found from the index alone
+  Eigen::Vector3d ends_sum;
+};
+
+/// Summary of an .rcb file, read from its index
+struct RAYLIB_EXPORT RcbIndex
+{
+  uint64_t num_rays;
+  /// whether the rays were written in spatial order, from the file header
+  bool spatially_sorted = false;
+  std::vector<RcbBlockInfo> blocks;
+};
+
+/// whether @c file_name has the .rcb extension
+bool RAYLIB_EXPORT isRcbFileName(const std::string &file_name);
+
+/// read only the block index of an .rcb file. This is independent of the number of rays in the file.
+bool RAYLIB_EXPORT readRcbIndex(const std::string &file_name, RcbIndex &index);
+
+/// read an .rcb file one block at a time, calling @c apply for each block
+bool RAYLIB_EXPORT readRcb(const std::string &file_name,
+                           std::function<void(std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                                              std::vector<double> &times, std::vector<RGBA> &colours)>
+                             apply);
+
+/// as readRcb, but only reads the blocks for which @c select returns true. Other blocks are skipped without being read.
+bool RAYLIB_EXPORT readRcb(const std::string &file_name,
+                           std::function<void(std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                                              std::vector<double> &times, std::vector<RGBA> &colours)>
+                             apply,
+                           std::function<bool(const RcbBlockInfo &block)> select);
+
+/// Writes an .rcb file, one chunk at a time. Chunks can be any size, rays are regrouped into fixed-capacity blocks.
+class RAYLIB_EXPORT RcbWriter
+{
+public:
+  /// default number of rays per block
+  static const size_t kDefaultBlockCapacity = 65536;
+  /// default largest distance in metres of each axis of a compressed ray start from its reconstruction
+  static constexpr double kDefaultStartTolerance = 0.001;
+
+  /// Compress the blocks of the files begun after this call. The times are delta coded and each block is entropy
+  /// coded, and the ray starts are reconstructed from a trajectory through them, from their times, to within
+  /// @c start_tolerance on each axis, with ray residuals stored only when they exceed it. The other values are
+  /// unchanged. Compressed files are version 2, which older readers do not read.
+  static void setCompression(bool compressed, double start_tolerance = kDefaultStartTolerance);
+  /// whether @c begin() compresses the file
+  static bool compressed();
+  /// the start tolerance of compressed files
+  static double startTolerance();
+
+  /// open the file for writing. A @c resolution greater than zero quantises the positions to that resolution
+  /// (in metres), otherwise they are stored as floats relative to the block origin. @c spatially_sorted records in
+  /// the header that the rays are written in spatial order.
+  bool begin(const std::string &file_name, double resolution = 0.0, size_t block_capacity = kDefaultBlockCapacity,
+             bool spatially_sorted = false);
+
+  /// add a set of rays to the file
+  bool writeChunk(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+                  const std::vector<double> &times, const std::vector<RGBA> &colours);
+
+  /// write any remaining rays and the index, and close the file. Returns the number of rays written.
+  uint64_t end();
+
+private:
+  bool writeBlock();
+
+  std::ofstream ofs_;
+  double resolution_ = 0.0;
+  bool compressed_ = false;
+  double start_tolerance_ = kDefaultStartTolerance;
+  size_t block_capacity_ = kDefaultBlockCapacity;
+  uint64_t num_rays_ = 0;
+  std::vector<RcbBlockInfo> blocks_;
+  /// rays waiting to be written as a full block
+  std::vector<Eigen::Vector3d> starts_;
+  std::vector<Eigen::Vector3d> ends_;
+  std::vector<double> times_;
+  std::vector<RGBA> colours_;
+  /// serialisation buffer, kept to avoid repeated allocations
+  std::vector<char> buffer_;
+};
+}  // namespace ray
+
+#endif  // RAYLIB_RAYRCB_H
@@ -0,0 +1,206 @@
+// Copyright (c) 2020
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "rayregistration.h"
+#include "raycloud.h"
+#include "rayfinealignment.h"
+#include "raythreads.h"
+
+#include <iostream>
+
+namespace ray
+{
+namespace
+{
+/// The fewest surfel matches for a pair of clouds to be counted as overlapping
+const int kMinRegistrationMatches = 10;
+
+/// The registration data kept for each cloud, in place of the cloud itself
+struct RegistrationCloud
+{
+  FineAlignment::CloudSurfels surfels;
+  Eigen::Vector3d box_min, box_max;  // bounds of the surfels, grown by their neighbourhood size
+  bool loaded = false;
+};
+
+/// The small rotation vector equivalent to @c rotation
+Eigen::Vector3d rotationVector(const Eigen::Quaterniond &rotation)
+{
+  Eigen::AngleAxisd angle_axis(rotation);
+  return angle_axis.angle() * angle_axis.axis();
+}
+
+/// The rotation of the rotation vector @c vector
+Eigen::Quaterniond rotationFromVector(const Eigen::Vector3d &vector)
+{
+  const double angle = vector.norm();
+  if (angle == 0.0)
+    return Eigen::Quaterniond::Identity();
+  return Eigen::Quaterniond(Eigen::AngleAxisd(angle, vector / angle));
+}
+
+/// The skew symmetric matrix of @c v , so that skew(v) * w = v x w
+Eigen::Matrix3d skew(const Eigen::Vector3d &v)
+{
+  Eigen::Matrix3d m;
+  m << 0, -v[2], v[1], v[2], 0, -v[0], -v[1], v[0], 0;
+  return m;
+}
+}  // namespace
+
+bool registerClouds(const std::vector<std::string> &file_names, std::vector<Pose> &poses,
+                    std::vector<RegistrationPair> *pairs, bool verbose)
+{
+  const int num_clouds = (int)file_names.size();
+  std::vector<RegistrationCloud> clouds(num_clouds);
+
+  // 1. load each cloud once, keeping only its surfels
+  parallelFor(0, num_clouds, [&](int i) {
+    Cloud cloud;
+    if (!cloud.load(file_names[i]))
+      return;
+    RegistrationCloud &entry = clouds[i];
+    entry.surfels = FineAlignment::generateCloudSurfels(cloud);
+    const double mx = std::numeric_limits<double>::max();
+    entry.box_min = Eigen::Vector3d(mx, mx, mx);
+    entry.box_max = -entry.box_min;
+    for (auto &surfel : entry.surfels.source)
+    {
+      entry.box_min = minVector(entry.box_min, surfel.centroid);
+      entry.box_max = maxVector(entry.box_max, surfel.centroid);
+    }
+    const Eigen::Vector3d margin = Eigen::Vector3d::Constant(entry.surfels.max_spacing);
+    entry.box_min -= margin;
+    entry.box_max += margin;
+    entry.loaded = true;
+  });
+  for (int i = 0; i < num_clouds; i++)
+  {
+    if (!clouds[i].loaded)
+    {
+      std::cerr << "Error: cannot load " << file_names[i] << " for registration" << std::endl;
+      return false;
+    }
+  }
+
+  // 2. the overlap graph, from the bounds of the surfels
+  std::vector<RegistrationPair> candidates;
+  for (int i = 0; i < num_clouds; i++)
+  {
+    for (int j = i + 1; j < num_clouds; j++)
+    {
+      if ((clouds[i].box_min.array() < clouds[j].box_max.array()).all() &&
+          (clouds[j].box_min.array() < clouds[i].box_max.array()).all())
+      {
+        RegistrationPair pair;
+        pair.clouds[0] = i;
+        pair.clouds[1] = j;
+        pair.num_matches = 0;
+        candidates.push_back(pair);
+      }
+    }
+  }
+
+  // 3. align each pair of overlapping clouds
+  parallelFor(0, (int)candidates.size(), [&](int p) {
+    RegistrationPair &pair = candidates[p];
+    pair.pose = FineAlignment::alignSurfels(clouds[pair.clouds[0]].surfels, clouds[pair.clouds[1]].surfels,
+                                            &pair.num_matches);
+  });
+  std::vector<RegistrationPair> constraints;
+  for (auto &pair : candidates)
+  {
+    if (pair.num_matches >= kMinRegistrationMatches && pair.pose.position.allFinite() &&
+        pair.pose.rotation.coeffs().allFinite())
+      constraints.push_back(pair);
+  }
+  if (verbose)
+  {
+    for (auto &pair : constraints)
+      std::cout << "cloud " << pair.clouds[0] << " onto " << pair.clouds[1] << ": " << pair.num_matches
+                << " matches, translation: " << pair.pose.position.transpose()
+                << ", rotation vector: " << rotationVector(pair.pose.rotation).transpose() << std::endl;
+  }
+  if (verbose)
+    std::cout << "registration: " << constraints.size() << " overlapping pairs of " << candidates.size()
+              << " candidates" << std::endl;
+
+  // 4. pose graph refinement, by Gauss-Newton iterations. Each iteration solves for a small rotation vector r_k and
+  // translation t_k that updates the pose of each cloud k, in coordinates relative to an origin on the first cloud to
+  // keep the problem well conditioned. A pair (i, j) with transformation T requires pose_i = pose_j T, so its
+  // remaining error is E = pose_j T pose_i^-1 , which the updates must remove near the centre c of the overlap. To
+  // first order this is r_i - r_j = r_E and t_i - t_j - c x (r_i - r_j) = t_E - c x r_E.
+  const Eigen::Vector3d origin = clouds[0].surfels.centre;
+  const int state_size = 6 * num_clouds;
+  poses.assign(num_clouds, Pose(Eigen::Vector3d(0, 0, 0), Eigen::Quaterniond::Identity()));
+  const int max_iterations = 10;
+  for (int it = 0; it < max_iterations; it++)
+  {
+    Eigen::MatrixXd At_A = Eigen::MatrixXd::Zero(state_size, state_size);
+    Eigen::VectorXd At_b = Eigen::VectorXd::Zero(state_size);
+    double max_weight = 1.0;
+    for (auto &pair : constraints)
+    {
+      const RegistrationCloud &cloud0 = clouds[pair.clouds[0]];
+      const RegistrationCloud &cloud1 = clouds[pair.clouds[1]];
+      const Eigen::Vector3d overlap_min = maxVector(cloud0.box_min, cloud1.box_min);
+      const Eigen::Vector3d overlap_max = minVector(cloud0.box_max, cloud1.box_max);
+      const Pose &pose0 = poses[pair.clouds[0]];
+      const Eigen::Vector3d centre = pose0 * Eigen::Vector3d(0.5 * (overlap_min + overlap_max)) - origin;
+      // weight the rotation rows by the square of the overlap radius, so that both errors are in metres
+      const double radius = std::max(0.5 * (overlap_max - overlap_min).norm(), cloud0.surfels.max_spacing);
+
+      // the remaining error, in origin relative coordinates
+      const Pose error = poses[pair.clouds[1]] * pair.pose * ~pose0;
+      const Eigen::Vector3d r_e = rotationVector(error.rotation);
+      const Eigen::Vector3d t_e = error.position + error.rotation * origin - origin;
+
+      Eigen::Matrix<double, 6, 6> jacobian;  // of the residual with respect to the update of the first cloud
+      jacobian.setZero();
+      jacobian.block<3, 3>(0, 0) = Eigen::Matrix3d::Identity();
+      jacobian.block<3, 3>(0, 3) = -skew(centre);
+      jacobian.block<3, 3>(3, 3) = Eigen::Matrix3d::Identity();
+      Eigen::Matrix<double, 6, 1> b;
+      b << t_e - centre.cross(r_e), r_e;
+      Eigen::Matrix<double, 6, 6> weights = Eigen::Matrix<double, 6, 6>::Zero();
+      weights.diagonal() << Eigen::Vector3d::Constant(1.0), Eigen::Vector3d::Constant(sqr(radius));
+      weights *= (double)pair.num_matches;
+      max_weight = std::max(max_weight, weights.diagonal().maxCoeff());
+
+      // the residual is jacobian * (x_i - x_j) - b
+      const Eigen::Matrix<double, 6, 6> jt_w_j = jacobian.transpose() * weights * jacobian;
+      const Eigen::Matrix<double, 6, 1> jt_w_b = jacobian.transpose() * weights * b;
+      const int i = 6 * pair.clouds[0], j = 6 * pair.clouds[1];
+      At_A.block<6, 6>(i, i) += jt_w_j;
+      At_A.block<6, 6>(j, j) += jt_w_j;
+      At_A.block<6, 6>(i, j) -= jt_w_j;
+      At_A.block<6, 6>(j, i) -= jt_w_j;
+      At_b.segment<6>(i) += jt_w_b;
+      At_b.segment<6>(j) -= jt_w_b;
+    }
+    // hold the first cloud fixed, and keep unconstrained clouds in place
+    At_A.diagonal().array() += 1e-6;
+    At_A.block<6, 6>(0, 0).diagonal().array() += 1e6 * max_weight;
+    const Eigen::VectorXd x = At_A.ldlt().solve(At_b);
+
+    double max_change = 0.0;
+    for (int k = 0; k < num_clouds; k++)
+    {
+      const Eigen::Quaterniond rotation = rotationFromVector(x.segment<3>(6 * k + 3));
+      // back to absolute coordinates, update(y) = R (y - origin) + t + origin
+      const Pose update(Eigen::Vector3d(x.segment<3>(6 * k)) + origin - rotation * origin, rotation);
+      poses[k] = update * poses[k];
+      max_change = std::max(max_change, x.segment<3>(6 * k).norm());
+    }
+    if (verbose)
+      std::cout << "registration iteration " << it << ", largest translation update: " << max_change << std::endl;
+    if (max_change < 1e-6)
+      break;
+  }
+  if (pairs)
+    *pairs = constraints;
+  return true;
+}
+}  // namespace ray
@@ -0,0 +1,37 @@
+// Copyright (c) 2020
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYREGISTRATION_H
+#define RAYLIB_RAYREGISTRATION_H
+
+#include "raylib/raylibconfig.h"
+
+#include "raypose.h"
+#include "rayutils.h"
+
+#include <string>
+#include <vector>
+
+namespace ray
+{
+/// The fine alignment of one cloud of a registration onto another
+struct RAYLIB_EXPORT RegistrationPair
+{
+  int clouds[2];    // the indices of the clouds, the first is aligned onto the second
+  Pose pose;        // the rigid transformation of clouds[0] that aligns it to clouds[1]
+  int num_matches;  // the surfel matches of the final iteration, a measure of the overlap
+};
+
+/// Fine registration of a set of overlapping ray clouds @c file_names , which must already be approximately aligned,
+/// as for @c FineAlignment . Each cloud is loaded once and its surfels are generated once. Every pair of clouds with
+/// overlapping bounds is then aligned, in parallel when built with TBB, and the pairwise alignments are combined by a
+/// linearised pose graph refinement that holds the first cloud fixed. A cloud that overlaps no other is not moved.
+/// The rigid transformation of each cloud is returned in @c poses , and the pairwise alignments that constrained them
+/// in @c pairs , if given. Returns false if a cloud cannot be loaded.
+bool RAYLIB_EXPORT registerClouds(const std::vector<std::string> &file_names, std::vector<Pose> &poses,
+                                  std::vector<RegistrationPair> *pairs = nullptr, bool verbose = false);
+}  // namespace ray
+
+#endif  // RAYLIB_RAYREGISTRATION_H
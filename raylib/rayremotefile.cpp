@@ -0,0 +1,228 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "rayremotefile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+
+#if defined(_WIN32)
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+namespace ray
+{
+bool isRemoteFileName(const std::string &file_name)
+{
+  for (const char *scheme : { "http://", "https://", "s3://" })
+  {
+    if (file_name.compare(0, std::strlen(scheme), scheme) == 0)
+      return true;
+  }
+  return false;
+}
+
+// out of line definition of the constant, as std::min binds it to a reference
+const size_t RemoteStreamBuf::kBufferSize;
+
+/// the next window of a remote stream, which is fetched while the current window is read
+struct RemoteStreamBuf::ReadAhead
+{
+  uint64_t start = 0;
+  std::vector<char> data;
+  std::future<size_t> result;
+};
+
+RemoteStreamBuf::RemoteStreamBuf() = default;
+
+RemoteStreamBuf::~RemoteStreamBuf()
+{
+  if (read_ahead_ && read_ahead_->result.valid())
+  {
+    read_ahead_->result.wait();  // it writes into the read-ahead buffer
+  }
+}
+
+bool RemoteStreamBuf::open(const std::string &url)
+{
+  open_ = file_.open(url);
+  buffer_.resize(kBufferSize);
+  buffer_start_ = 0;
+  setg(buffer_.data(), buffer_.data(), buffer_.data());
+  return open_;
+}
+
+bool RemoteStreamBuf::fill(uint64_t position)
+{
+  const uint64_t size = file_.size();
+  setg(buffer_.data(), buffer_.data(), buffer_.data());
+  buffer_start_ = position;
+  if (position >= size)
+  {
+    return false;
+  }
+  size_t count;
+  if (read_ahead_ && read_ahead_->result.valid() && read_ahead_->start == position)
+  {
+    count = read_ahead_->result.get();
+    buffer_.swap(read_ahead_->data);
+  }
+  else
+  {
+    if (read_ahead_ && read_ahead_->result.valid())
+    {
+      read_ahead_->result.wait();  // a read-ahead that a seek has made unwanted
+    }
+    count = file_.read(position, static_cast<size_t>(std::min<uint64_t>(kBufferSize, size - position)),
+                       reinterpret_cast<unsigned char *>(buffer_.data()));
+  }
+  setg(buffer_.data(), buffer_.data(), buffer_.data() + count);
+
+  const uint64_t next = position + count;
+  if (count > 0 && next < size)
+  {
+    if (!read_ahead_)
+    {
+      read_ahead_.reset(new ReadAhead);
+    }
+    read_ahead_->start = next;
+    read_ahead_->data.resize(kBufferSize);
+    const size_t next_count = static_cast<size_t>(std::min<uint64_t>(kBufferSize, size - next));
+    ReadAhead *read_ahead = read_ahead_.get();
+    read_ahead_->result = std::async(std::launch::async, [this, read_ahead, next, next_count]() {
+      return file_.read(next, next_count, reinterpret_cast<unsigned char *>(read_ahead->data.data()));
+    });
+  }
+  return count > 0;
+}
+
+RemoteStreamBuf::int_type RemoteStreamBuf::underflow()
+{
+  if (gptr() < egptr())
+  {
+    return traits_type::to_int_type(*gptr());
+  }
+  if (!open_ || !fill(position()))
+  {
+    return traits_type::eof();
+  }
+  return traits_type::to_int_type(*gptr());
+}
+
+std::streamsize RemoteStreamBuf::xsgetn(char *data, std::streamsize count)
+{
+  std::streamsize done = 0;
+  while (done < count)
+  {
+    const std::streamsize available = egptr() - gptr();
+    if (available > 0)
+    {
+      const std::streamsize num = std::min(available, count - done);
+      std::memcpy(data + done, gptr(), static_cast<size_t>(num));
+      gbump(static_cast<int>(num));
+      done += num;
+      continue;
+    }
+    const uint64_t pos = position();
+    const size_t remaining = static_cast<size_t>(count - done);
+    if (remaining >= kBufferSize)
+    {
+      // large reads skip the window, and are fetched in parallel parts
+      if (read_ahead_ && read_ahead_->result.valid())
+      {
+        read_ahead_->result.wait();
+      }
+      const size_t num = open_ ? file_.read(pos, remaining, reinterpret_cast<unsigned char *>(data + done)) : 0;
+      done += static_cast<std::streamsize>(num);
+      setg(buffer_.data(), buffer_.data(), buffer_.data());
+      buffer_start_ = pos + num;
+      break;
+    }
+    if (!open_ || !fill(pos))
+    {
+      break;
+    }
+  }
+  return done;
+}
+
+std::streamsize RemoteStreamBuf::showmanyc()
+{
+  const uint64_t pos = position();
+  return pos < file_.size() ? static_cast<std::streamsize>(file_.size() - pos) : -1;
+}
+
+RemoteStreamBuf::pos_type RemoteStreamBuf::seekoff(off_type offset, std::ios_base::seekdir direction,
+                                                   std::ios_base::openmode mode)
+{
+  if (!(mode & std::ios_base::in))
+  {
+    return pos_type(off_type(-1));
+  }
+  off_type base = 0;
+  if (direction == std::ios_base::cur)
+    base = static_cast<off_type>(position());
+  else if (direction == std::ios_base::end)
+    base = static_cast<off_type>(file_.size());
+  return seekpos(pos_type(base + offset), mode);
+}
+
+RemoteStreamBuf::pos_type RemoteStreamBuf::seekpos(pos_type position, std::ios_base::openmode mode)
+{
+  const off_type target = off_type(position);
+  if (!(mode & std::ios_base::in) || target < 0)
+  {
+    return pos_type(off_type(-1));
+  }
+  const uint64_t pos = static_cast<uint64_t>(target);
+  const uint64_t window_size = static_cast<uint64_t>(egptr() - eback());
+  if (pos >= buffer_start_ && pos <= buffer_start_ + window_size)
+  {
+    setg(eback(), eback() + static_cast<std::ptrdiff_t>(pos - buffer_start_), egptr());
+  }
+  else
+  {
+    setg(buffer_.data(), buffer_.data(), buffer_.data());
+    buffer_start_ = pos;
+  }
+  return position;
+}
+
+InputFile::InputFile(const std::string &file_name, std::ios_base::openmode mode)
+  : std::istream(nullptr)
+{
+  std::streambuf *buffer = nullptr;
+  if (isRemoteFileName(file_name))
+  {
+    if (remote_buf_.open(file_name))
+      buffer = &remote_buf_;
+  }
+  else if (file_buf_.open(file_name, mode | std::ios::in))
+  {
+    buffer = &file_buf_;
+  }
+  rdbuf(buffer);  // a null buffer leaves the stream failed, as a std::ifstream that cannot open its file
+}
+
+std::string RemoteUpload::spoolFileName(const std::string &url)
+{
+  static std::atomic<unsigned> counter{ 0 };
+  const char *directory = nullptr;
+  for (const char *variable : { "TMPDIR", "TMP", "TEMP" })
+  {
+    if ((directory = std::getenv(variable)) != nullptr)
+      break;
+  }
+  std::string name = url.substr(url.find_last_of('/') + 1);
+  return std::string(directory ? directory : "/tmp") + "/raycloud_spool_" + std::to_string(getpid()) + "_" +
+         std::to_string(counter++) + "_" + name;
+}
+}  // namespace ray
@@ -0,0 +1,137 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYREMOTEFILE_H
+#define RAYLIB_RAYREMOTEFILE_H
+
+#include "raylib/raylibconfig.h"
+
+#include <cstdint>
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ray
+{
+/// whether @c file_name is the URL of an object in web or object storage: http://, https:// or s3://bucket/key
+bool RAYLIB_EXPORT isRemoteFileName(const std::string &file_name);
+
+/// An object in web or S3-compatible object storage, read with ranged GET requests. Large reads are split into parts
+/// that are fetched in parallel. This needs raylib built WITH_CURL, otherwise @c available() is false and @c open()
+/// fails.
+/// s3://bucket/key URLs are requested from the endpoint in RAYCLOUD_S3_ENDPOINT (https://s3.amazonaws.com by default),
+/// and signed (AWS signature version 4) when AWS_ACCESS_KEY_ID and AWS_SECRET_ACCESS_KEY are set, for the region in
+/// AWS_REGION (us-east-1 by default). For temporary credentials, AWS_SESSION_TOKEN is sent with each request.
+class RAYLIB_EXPORT RemoteFile
+{
+public:
+  /// the size in bytes of each request of a large read
+  static const size_t kPartSize = 8 << 20;
+  /// the most requests in flight at once
+  static const int kMaxConnections = 8;
+
+  RemoteFile();
+  ~RemoteFile();
+  RemoteFile(const RemoteFile &) = delete;
+  RemoteFile &operator=(const RemoteFile &) = delete;
+
+  /// whether raylib was built with remote file support
+  static bool available();
+
+  /// find the size of the object at @c url . Returns false if it does not exist or cannot be reached.
+  bool open(const std::string &url);
+  /// the size of the object in bytes
+  uint64_t size() const { return size_; }
+
+  /// Read the @c size bytes at @c offset into @c buffer . Returns the number of bytes read, which is fewer if the object
+  /// ends first or a request fails.
+  size_t read(uint64_t offset, size_t size, unsigned char *buffer);
+
+private:
+  struct Detail;
+  std::unique_ptr<Detail> detail_;
+  uint64_t size_ = 0;
+};
+
+/// A stream buffer over a @c RemoteFile , so that remote objects can be read as @c std::istream . Small reads are
+/// served from a @c kBufferSize window, and read-ahead fetches the next window in the background as the reads reach
+/// it. Reads larger than the window go directly to @c RemoteFile::read , in parallel parts.
+class RAYLIB_EXPORT RemoteStreamBuf : public std::streambuf
+{
+public:
+  static const size_t kBufferSize = 4 << 20;
+
+  RemoteStreamBuf();
+  ~RemoteStreamBuf() override;
+
+  bool open(const std::string &url);
+  bool isOpen() const { return open_; }
+
+protected:
+  int_type underflow() override;
+  std::streamsize xsgetn(char *data, std::streamsize count) override;
+  std::streamsize showmanyc() override;
+  pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode) override;
+  pos_type seekpos(pos_type position, std::ios_base::openmode mode) override;
+
+private:
+  /// fill the window from @c position , using the read-ahead if it holds it
+  bool fill(uint64_t position);
+  /// the file position of the character at the read pointer
+  uint64_t position() const { return buffer_start_ + static_cast<uint64_t>(gptr() - eback()); }
+
+  struct ReadAhead;
+  RemoteFile file_;
+  bool open_ = false;
+  std::vector<char> buffer_;
+  uint64_t buffer_start_ = 0;
+  std::unique_ptr<ReadAhead> read_ahead_;
+};
+
+/// An input stream of a local file, or of a remote object where @c isRemoteFileName is true. It is used in place of
+/// @c std::ifstream by the ray cloud readers, so that they can read from object storage without a local copy.
+class RAYLIB_EXPORT InputFile : public std::istream
+{
+public:
+  InputFile(const std::string &file_name, std::ios_base::openmode mode = std::ios::in | std::ios::binary);
+
+private:
+  std::filebuf file_buf_;
+  RemoteStreamBuf remote_buf_;
+};
+
+/// Uploads a file to object storage with an S3 multipart upload, while the file is being written. The file is
+/// written to a local spool file (see @c spoolFileName ) and each part is uploaded once the file has grown past it,
+/// so most of the upload overlaps the writing. The first part is uploaded last, as writers may still change the file
+/// header. This needs raylib built WITH_CURL.
+class RAYLIB_EXPORT RemoteUpload
+{
+public:
+  /// the size in bytes of each uploaded part. S3 requires at least 5 MiB for all but the last part
+  static const size_t kPartSize = 16 << 20;
+
+  RemoteUpload();
+  ~RemoteUpload();
+  RemoteUpload(const RemoteUpload &) = delete;
+  RemoteUpload &operator=(const RemoteUpload &) = delete;
+
+  /// a new local file name, to write the file to be uploaded to @c url in to
+  static std::string spoolFileName(const std::string &url);
+
+  /// start the upload to @c url of the file @c spool_file_name , which is being written
+  bool begin(const std::string &url, const std::string &spool_file_name);
+  /// upload the rest of the spool file, which has now been closed, then complete the upload and remove the spool
+  /// file. Returns false if the object was not stored.
+  bool end();
+
+private:
+  struct Detail;
+  std::unique_ptr<Detail> detail_;
+};
+}  // namespace ray
+
+#endif  // RAYLIB_RAYREMOTEFILE_H
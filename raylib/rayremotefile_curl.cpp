@@ -0,0 +1,541 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "rayremotefile.h"
+
+#include <curl/curl.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace ray
+{
+namespace
+{
+/// the number of attempts at each request before a read or upload fails
+const int kMaxAttempts = 3;
+
+/// The HTTP URL of a remote object, and how to sign requests for it
+struct RemoteTarget
+{
+  std::string url;
+  std::string credentials;
+  std::string sigv4;
+  /// the headers sent with each request, which hold the session token of temporary credentials
+  std::shared_ptr<curl_slist> headers;
+};
+
+RemoteTarget resolveTarget(const std::string &url)
+{
+  static std::once_flag curl_initialised;
+  std::call_once(curl_initialised, []() { curl_global_init(CURL_GLOBAL_DEFAULT); });
+
+  RemoteTarget target;
+  const std::string s3_scheme = "s3://";
+  if (url.compare(0, s3_scheme.size(), s3_scheme) != 0)
+  {
+    target.url = url;
+    return target;
+  }
+  // path style addressing, which S3-compatible stores also support
+  const char *endpoint = std::getenv("RAYCLOUD_S3_ENDPOINT");
+  target.url = std::string(endpoint ? endpoint : "https://s3.amazonaws.com") + "/" + url.substr(s3_scheme.size());
+  const char *key_id = std::getenv("AWS_ACCESS_KEY_ID");
+  const char *secret = std::getenv("AWS_SECRET_ACCESS_KEY");
+  if (key_id && secret)
+  {
+    const char *region = std::getenv("AWS_REGION");
+    target.credentials = std::string(key_id) + ":" + secret;
+    target.sigv4 = std::string("aws:amz:") + (region ? region : "us-east-1") + ":s3";
+    const char *token = std::getenv("AWS_SESSION_TOKEN");
+    if (token && *token)
+    {
+      // libcurl signs the headers that it sends, so the token is part of the signature
+      const std::string header = std::string("x-amz-security-token: ") + token;
+      target.headers.reset(curl_slist_append(nullptr, header.c_str()), curl_slist_free_all);
+    }
+  }
+  return target;
+}
+
+/// reset @c curl for a request to @c url of @c target
+void configure(CURL *curl, const RemoteTarget &target, const std::string &url)
+{
+  curl_easy_reset(curl);
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  // a stalled connection fails after a minute, rather than hanging the tool
+  curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+  curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 60L);
+  if (!target.sigv4.empty())
+  {
+    curl_easy_setopt(curl, CURLOPT_USERPWD, target.credentials.c_str());
+    curl_easy_setopt(curl, CURLOPT_AWS_SIGV4, target.sigv4.c_str());
+  }
+  if (target.headers)
+  {
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, target.headers.get());
+  }
+}
+
+long responseCode(CURL *curl)
+{
+  long code = 0;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+  return code;
+}
+
+size_t appendToString(char *data, size_t size, size_t count, void *user)
+{
+  static_cast<std::string *>(user)->append(data, size * count);
+  return size * count;
+}
+
+/// the text between @c <tag> and @c </tag> in @c xml , or empty if it is not there
+std::string xmlValue(const std::string &xml, const std::string &tag)
+{
+  const std::string open = "<" + tag + ">";
+  const size_t start = xml.find(open);
+  const size_t end = start == std::string::npos ? start : xml.find("</" + tag + ">", start);
+  return end == std::string::npos ? std::string() : xml.substr(start + open.size(), end - start - open.size());
+}
+
+/// A request in a batch of parallel requests. Each is either a ranged GET into @c data , or a PUT from it.
+struct Transfer
+{
+  std::string url;
+  unsigned char *data = nullptr;
+  size_t size = 0;
+  /// the byte offset in the object, for ranged GETs
+  uint64_t offset = 0;
+  bool upload = false;
+  size_t done = 0;
+  int attempts = 0;
+  bool succeeded = false;
+  std::string etag;
+};
+
+size_t receiveRange(char *data, size_t size, size_t count, void *user)
+{
+  Transfer &transfer = *static_cast<Transfer *>(user);
+  const size_t num = size * count;
+  if (transfer.done + num > transfer.size)
+    return 0;  // more than the range, such as a server that ignores ranges, so fail the request
+  std::memcpy(transfer.data + transfer.done, data, num);
+  transfer.done += num;
+  return num;
+}
+
+size_t sendPart(char *data, size_t size, size_t count, void *user)
+{
+  Transfer &transfer = *static_cast<Transfer *>(user);
+  const size_t num = std::min(size * count, transfer.size - transfer.done);
+  std::memcpy(data, transfer.data + transfer.done, num);
+  transfer.done += num;
+  return num;
+}
+
+size_t receiveHeader(char *data, size_t size, size_t count, void *user)
+{
+  Transfer &transfer = *static_cast<Transfer *>(user);
+  const std::string line(data, size * count);
+  if (line.size() > 5 && (line.compare(0, 5, "ETag:") == 0 || line.compare(0, 5, "etag:") == 0))
+  {
+    const size_t start = line.find_first_not_of(" \t", 5);
+    const size_t end = line.find_last_not_of(" \t\r\n");
+    if (start != std::string::npos && end >= start)
+      transfer.etag = line.substr(start, end + 1 - start);
+  }
+  return size * count;
+}
+
+/// A pool of curl handles, so that connections are reused from request to request
+class HandlePool
+{
+public:
+  ~HandlePool()
+  {
+    for (auto &handle : handles_) curl_easy_cleanup(handle);
+  }
+  CURL *take()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (handles_.empty())
+      return curl_easy_init();
+    CURL *handle = handles_.back();
+    handles_.pop_back();
+    return handle;
+  }
+  void give(CURL *handle)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    handles_.push_back(handle);
+  }
+
+private:
+  std::mutex mutex_;
+  std::vector<CURL *> handles_;
+};
+
+/// Run the @c transfers , with up to @c RemoteFile::kMaxConnections at once, retrying failed requests. Sets
+/// @c succeeded on each transfer that completed.
+void runTransfers(std::vector<Transfer> &transfers, const RemoteTarget &target, HandlePool &pool)
+{
+  CURLM *multi = curl_multi_init();
+  size_t next = 0;
+  int running = 0;
+  auto start = [&](Transfer &transfer, CURL *curl) {
+    transfer.done = 0;
+    transfer.attempts++;
+    transfer.etag.clear();
+    configure(curl, target, transfer.url);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, &transfer);
+    if (transfer.upload)
+    {
+      curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L);
+      curl_easy_setopt(curl, CURLOPT_READFUNCTION, sendPart);
+      curl_easy_setopt(curl, CURLOPT_READDATA, &transfer);
+      curl_easy_setopt(curl, CURLOPT_INFILESIZE_LARGE, static_cast<curl_off_t>(transfer.size));
+      curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, receiveHeader);
+      curl_easy_setopt(curl, CURLOPT_HEADERDATA, &transfer);
+    }
+    else
+    {
+      const std::string range =
+        std::to_string(transfer.offset) + "-" + std::to_string(transfer.offset + transfer.size - 1);
+      curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str());  // libcurl copies the string
+      curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, receiveRange);
+      curl_easy_setopt(curl, CURLOPT_WRITEDATA, &transfer);
+    }
+    curl_multi_add_handle(multi, curl);
+    running++;
+  };
+  for (; next < transfers.size() && running < RemoteFile::kMaxConnections; next++) start(transfers[next], pool.take());
+
+  while (running > 0)
+  {
+    int still_running = 0;
+    curl_multi_perform(multi, &still_running);
+    int num_messages = 0;
+    while (CURLMsg *message = curl_multi_info_read(multi, &num_messages))
+    {
+      if (message->msg != CURLMSG_DONE)
+        continue;
+      CURL *curl = message->easy_handle;
+      Transfer *transfer = nullptr;
+      curl_easy_getinfo(curl, CURLINFO_PRIVATE, reinterpret_cast<char **>(&transfer));
+      const long code = responseCode(curl);
+      const CURLcode result = message->data.result;  // the message is freed by removing its handle
+      curl_multi_remove_handle(multi, curl);
+      running--;
+      const bool whole_object = !transfer->upload && transfer->offset == 0 && code == 200;
+      transfer->succeeded = result == CURLE_OK && transfer->done == transfer->size &&
+                            (transfer->upload ? code == 200 && !transfer->etag.empty() : code == 206 || whole_object);
+      if (!transfer->succeeded && transfer->attempts < kMaxAttempts)
+      {
+        start(*transfer, curl);
+      }
+      else if (next < transfers.size())
+      {
+        start(transfers[next++], curl);
+      }
+      else
+      {
+        pool.give(curl);
+      }
+    }
+    if (running > 0)
+      curl_multi_poll(multi, nullptr, 0, 1000, nullptr);
+  }
+  curl_multi_cleanup(multi);
+}
+
+/// a request with a text body and response, returning the response code (or 0 on a connection failure)
+long request(HandlePool &pool, const RemoteTarget &target, const std::string &url, const char *method,
+             const std::string &body, std::string &response)
+{
+  CURL *curl = pool.take();
+  long code = 0;
+  for (int attempt = 0; attempt < kMaxAttempts && (code == 0 || code >= 500); attempt++)
+  {
+    response.clear();
+    configure(curl, target, url);
+    curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method);
+    if (std::strcmp(method, "POST") == 0)
+    {
+      curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body.c_str());
+      curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(body.size()));
+    }
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, appendToString);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+    code = curl_easy_perform(curl) == CURLE_OK ? responseCode(curl) : 0;
+  }
+  pool.give(curl);
+  return code;
+}
+}  // namespace
+
+// out of line definitions of the constants, as std::min binds them to references
+const size_t RemoteFile::kPartSize;
+const int RemoteFile::kMaxConnections;
+const size_t RemoteUpload::kPartSize;
+
+struct RemoteFile::Detail
+{
+  RemoteTarget target;
+  HandlePool pool;
+};
+
+RemoteFile::RemoteFile() = default;
+RemoteFile::~RemoteFile() = default;
+
+bool RemoteFile::available()
+{
+  return true;
+}
+
+bool RemoteFile::open(const std::string &url)
+{
+  std::unique_ptr<Detail> detail(new Detail);
+  detail->target = resolveTarget(url);
+  CURL *curl = detail->pool.take();
+  configure(curl, detail->target, detail->target.url);
+  curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+  curl_off_t length = -1;
+  const CURLcode result = curl_easy_perform(curl);
+  if (result == CURLE_OK)
+    curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+  const long code = responseCode(curl);
+  detail->pool.give(curl);
+  if (result != CURLE_OK || code != 200 || length < 0)
+  {
+    std::cerr << "Error: cannot open " << url << ": "
+              << (result != CURLE_OK ? curl_easy_strerror(result) : "HTTP status " + std::to_string(code))
+              << std::endl;
+    return false;
+  }
+  size_ = static_cast<uint64_t>(length);
+  detail_ = std::move(detail);
+  return true;
+}
+
+size_t RemoteFile::read(uint64_t offset, size_t size, unsigned char *buffer)
+{
+  if (!detail_ || offset >= size_)
+  {
+    return 0;
+  }
+  size = static_cast<size_t>(std::min<uint64_t>(size, size_ - offset));
+  std::vector<Transfer> transfers;
+  for (size_t start = 0; start < size; start += kPartSize)
+  {
+    Transfer transfer;
+    transfer.url = detail_->target.url;
+    transfer.data = buffer + start;
+    transfer.size = std::min(kPartSize, size - start);
+    transfer.offset = offset + start;
+    transfers.push_back(transfer);
+  }
+  runTransfers(transfers, detail_->target, detail_->pool);
+  // the bytes read are those before the first failed part
+  for (const auto &transfer : transfers)
+  {
+    if (!transfer.succeeded)
+    {
+      std::cerr << "Error: failed to read bytes " << transfer.offset << " to " << transfer.offset + transfer.size
+                << " of " << detail_->target.url << std::endl;
+      return static_cast<size_t>(transfer.offset - offset);
+    }
+  }
+  return size;
+}
+
+struct RemoteUpload::Detail
+{
+  RemoteTarget target;
+  HandlePool pool;
+  std::string spool_file_name;
+  std::string upload_id;
+  /// the ETag of each part, by part number - 1. Parts from 2 are uploaded while the spool file is written.
+  std::vector<std::string> etags;
+  bool failed = false;
+
+  std::thread uploader;
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool writing_finished = false;
+
+  std::string partUrl(size_t part_number) const
+  {
+    return target.url + "?partNumber=" + std::to_string(part_number) + "&uploadId=" + upload_id;
+  }
+
+  /// upload parts @c first to @c last (inclusive, numbered from 1), of a spool file of @c file_size bytes
+  bool uploadParts(size_t first, size_t last, uint64_t file_size)
+  {
+    FILE *file = std::fopen(spool_file_name.c_str(), "rb");
+    if (!file)
+      return false;
+    std::vector<std::vector<unsigned char>> buffers;
+    std::vector<Transfer> transfers;
+    bool read_ok = true;
+    for (size_t part = first; part <= last; part++)
+    {
+      const uint64_t start = static_cast<uint64_t>(part - 1) * kPartSize;
+      buffers.emplace_back(static_cast<size_t>(std::min<uint64_t>(kPartSize, file_size - start)));
+      read_ok = read_ok && fseeko(file, static_cast<off_t>(start), SEEK_SET) == 0 &&
+                std::fread(buffers.back().data(), 1, buffers.back().size(), file) == buffers.back().size();
+    }
+    std::fclose(file);
+    if (!read_ok)
+      return false;
+    for (size_t part = first; part <= last; part++)
+    {
+      Transfer transfer;
+      transfer.url = partUrl(part);
+      transfer.data = buffers[part - first].data();
+      transfer.size = buffers[part - first].size();
+      transfer.upload = true;
+      transfers.push_back(transfer);
+    }
+    runTransfers(transfers, target, pool);
+    if (etags.size() < last)
+      etags.resize(last);
+    for (size_t part = first; part <= last; part++)
+    {
+      if (!transfers[part - first].succeeded)
+        return false;
+      etags[part - 1] = transfers[part - first].etag;
+    }
+    return true;
+  }
+
+  /// upload each whole part after the first, as the spool file grows past it
+  void followSpool()
+  {
+    size_t uploaded = 1;  // the last part uploaded, counting the first, which is uploaded at the end
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!writing_finished && !failed)
+    {
+      condition.wait_for(lock, std::chrono::milliseconds(200));
+      struct stat file_stat;
+      if (stat(spool_file_name.c_str(), &file_stat) != 0)
+        continue;
+      // part n is complete once the file has grown past it. Later parts may still be written, so wait for the rest.
+      const size_t complete = static_cast<size_t>(static_cast<uint64_t>(file_stat.st_size) / kPartSize);
+      if (complete > uploaded)
+      {
+        lock.unlock();
+        const size_t last = std::min(complete, uploaded + RemoteFile::kMaxConnections);
+        const bool ok = uploadParts(uploaded + 1, last, static_cast<uint64_t>(last) * kPartSize);
+        lock.lock();
+        failed = !ok;
+        uploaded = last;
+      }
+    }
+  }
+
+  void abort()
+  {
+    std::string response;
+    request(pool, target, target.url + "?uploadId=" + upload_id, "DELETE", std::string(), response);
+  }
+};
+
+RemoteUpload::RemoteUpload() = default;
+
+RemoteUpload::~RemoteUpload()
+{
+  if (detail_ && detail_->uploader.joinable())
+  {
+    {
+      std::unique_lock<std::mutex> lock(detail_->mutex);
+      detail_->writing_finished = true;
+    }
+    detail_->condition.notify_all();
+    detail_->uploader.join();
+    detail_->abort();  // not ended, so the object is not stored
+  }
+}
+
+bool RemoteUpload::begin(const std::string &url, const std::string &spool_file_name)
+{
+  std::unique_ptr<Detail> detail(new Detail);
+  detail->target = resolveTarget(url);
+  detail->spool_file_name = spool_file_name;
+  std::string response;
+  const long code = request(detail->pool, detail->target, detail->target.url + "?uploads", "POST", "", response);
+  detail->upload_id = xmlValue(response, "UploadId");
+  if (code != 200 || detail->upload_id.empty())
+  {
+    std::cerr << "Error: cannot start an upload to " << url << ", HTTP status " << code << std::endl;
+    return false;
+  }
+  char *escaped = curl_easy_escape(nullptr, detail->upload_id.c_str(), static_cast<int>(detail->upload_id.size()));
+  detail->upload_id = escaped;
+  curl_free(escaped);
+  detail_ = std::move(detail);
+  Detail *d = detail_.get();
+  detail_->uploader = std::thread([d]() { d->followSpool(); });
+  return true;
+}
+
+bool RemoteUpload::end()
+{
+  if (!detail_)
+  {
+    return false;
+  }
+  Detail &d = *detail_;
+  {
+    std::unique_lock<std::mutex> lock(d.mutex);
+    d.writing_finished = true;
+  }
+  d.condition.notify_all();
+  d.uploader.join();
+
+  struct stat file_stat;
+  bool ok = !d.failed && stat(d.spool_file_name.c_str(), &file_stat) == 0;
+  if (ok)
+  {
+    const uint64_t file_size = static_cast<uint64_t>(file_stat.st_size);
+    const size_t num_parts = std::max<size_t>(1, static_cast<size_t>((file_size + kPartSize - 1) / kPartSize));
+    for (size_t first = std::max<size_t>(2, d.etags.size() + 1); ok && first <= num_parts;
+         first += RemoteFile::kMaxConnections)
+    {
+      ok = d.uploadParts(first, std::min(num_parts, first + RemoteFile::kMaxConnections - 1), file_size);
+    }
+    ok = ok && d.uploadParts(1, 1, file_size);
+  }
+  if (ok)
+  {
+    std::string body = "<CompleteMultipartUpload>";
+    for (size_t i = 0; i < d.etags.size(); i++)
+      body += "<Part><PartNumber>" + std::to_string(i + 1) + "</PartNumber><ETag>" + d.etags[i] + "</ETag></Part>";
+    body += "</CompleteMultipartUpload>";
+    std::string response;
+    const long code = request(d.pool, d.target, d.target.url + "?uploadId=" + d.upload_id, "POST", body, response);
+    // S3 can report a failure in the body of a 200 response
+    ok = code == 200 && response.find("<Error>") == std::string::npos;
+  }
+  if (!ok)
+  {
+    std::cerr << "Error: failed to upload " << d.target.url << std::endl;
+    d.abort();
+  }
+  std::remove(d.spool_file_name.c_str());
+  detail_.reset();
+  return ok;
+}
+}  // namespace ray
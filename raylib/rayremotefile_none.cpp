@@ -0,0 +1,60 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "rayremotefile.h"
+
+#include "rayunused.h"
+
+#include <iostream>
+
+namespace ray
+{
+struct RemoteFile::Detail
+{
+};
+
+struct RemoteUpload::Detail
+{
+};
+
+RemoteFile::RemoteFile() = default;
+RemoteFile::~RemoteFile() = default;
+
+bool RemoteFile::available()
+{
+  return false;
+}
+
+bool RemoteFile::open(const std::string &url)
+{
+  std::cerr << "Error: cannot read " << url << ", raylib is built without remote file support (WITH_CURL)"
+            << std::endl;
+  return false;
+}
+
+size_t RemoteFile::read(uint64_t offset, size_t size, unsigned char *buffer)
+{
+  RAYLIB_UNUSED(offset);
+  RAYLIB_UNUSED(size);
+  RAYLIB_UNUSED(buffer);
+  return 0;
+}
+
+RemoteUpload::RemoteUpload() = default;
+RemoteUpload::~RemoteUpload() = default;
+
+bool RemoteUpload::begin(const std::string &url, const std::string &spool_file_name)
+{
+  RAYLIB_UNUSED(spool_file_name);
+  std::cerr << "Error: cannot write " << url << ", raylib is built without remote file support (WITH_CURL)"
+            << std::endl;
+  return false;
+}
+
+bool RemoteUpload::end()
+{
+  return false;
+}
+}  // namespace ray
@@ -6,20 +6,172 @@
 #include "rayrenderer.h"
 #include "imagewrite.h"
 #include "raycloud.h"
+#include "raygpu.h"
 #include "raylib/raylibconfig.h"
+#include "raylod.h"
 #include "rayparse.h"
+#include "rayplyindex.h"
+#include "raythreads.h"
+#include "raytraversal.h"
 #if RAYLIB_WITH_TIFF   // build option to support outputting to geotif (.tif) format
 #include "geotiffio.h" /* for GeoTIFF */
 #include "xtiffio.h"   /* for TIFF */
 #endif
+#include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
+#include <functional>
+#include <limits>
+#include <memory>
 #include "rayunused.h"
 
+#if RAYLIB_WITH_TBB
+#include <tbb/parallel_for.h>
+#endif  // RAYLIB_WITH_TBB
+
 #define DENSITY_MIN_RAYS 10  // larger is more accurate but more blurred. 0 for no adaptive blending
 
 namespace ray
 {
 #if RAYLIB_WITH_TIFF
+// set the geotiff keys of a tiff image from the parameters in @c projection_file , with the top left corner of the
+// image at @c origin_x , @c origin_y
+bool setGeoTiffKeys(TIFF *tif, GTIF *gtif, double pixel_width, const std::string &projection_file, double origin_x,
+                    double origin_y)
+{
+  if (projection_file.empty())
+  {
+    return true;
+  }
+  std::ifstream ifs(projection_file.c_str(), std::ios::in);
+  if (ifs.fail())
+  {
+    std::cerr << "cannot open file " << projection_file << std::endl;
+    return false;
+  }
+  std::string line;
+  if (!getline(ifs, line))
+  {
+    return false;
+  }
+  // the set of keys in the key-value pairs that we are parsing
+  const std::vector<std::string> keys = { "+proj", "+ellps", "+datum", "+units", "+lat_0", "+lon_0", "+x_0", "+y_0" };
+  std::vector<std::string> values;
+  for (const auto &key : keys)
+  {
+    std::string::size_type found = line.find(key);
+    if (found == std::string::npos)  // error checking
+    {
+      if (key == "+ellps")
+      {
+        std::cout << "No ellps field found in proj file, setting it equal to the datum." << std::endl;
+        values.push_back("");
+        continue;
+      }
+      std::cerr << "Error: cannot find key: " << key << " in the projection file: " << projection_file << std::endl;
+      return false;
+    }
+    // generate the list of values that correspond to the list of keys
+    found += key.length() + 1;
+    std::string::size_type space = line.find(" ", found);
+    if (space == std::string::npos)
+      space = line.length() - 1;
+    values.push_back(line.substr(found, space - found));
+  }
+  if (values[1].empty())  // if ellipsoid type not specified, we take it to be the same as the datum
+  {
+    values[1] = values[2];
+  }
+  double coord_lat = 0.0;
+  if (!values[4].empty())
+  {
+    coord_lat = std::stod(values[4]);  // latitude
+  }
+  double coord_long = 0.0;
+  if (!values[5].empty())
+  {
+    coord_long = std::stod(values[5]);  // longitude
+  }
+  Eigen::Vector2d geo_offset(0, 0);
+  if (!values[6].empty())
+  {
+    geo_offset[0] = std::stod(values[6]);  // offset in m
+  }
+  if (!values[7].empty())
+  {
+    geo_offset[1] = std::stod(values[7]);  // offset in m
+  }
+  std::cout << "geooffset: " << geo_offset << ", geokey: " << values[1] << ", datum: " << values[2]
+            << ", coord_long: " << coord_long << std::endl;
+
+  const double scales[3] = { pixel_width, pixel_width, pixel_width };
+  TIFFSetField(tif, TIFFTAG_GEOPIXELSCALE, 3, scales);  // set the width of a pixel
+
+  // Set GeoTIFF information
+  // We are only supporting a limited set of projection types, so here we assume standard settings
+  GTIFKeySet(gtif, GTModelTypeGeoKey, TYPE_SHORT, 1, ModelTypeProjected);
+  GTIFKeySet(gtif, GTRasterTypeGeoKey, TYPE_SHORT, 1, RasterPixelIsArea);
+
+  GTIFKeySet(gtif, ProjLinearUnitsGeoKey, TYPE_SHORT, 1, Linear_Meter);
+  GTIFKeySet(gtif, VerticalUnitsGeoKey, TYPE_SHORT, 1, Linear_Meter);
+
+  GTIFKeySet(gtif, ProjectionGeoKey, TYPE_SHORT, 1, KvUserDefined);
+  GTIFKeySet(gtif, ProjCoordTransGeoKey, TYPE_SHORT, 1, CT_Orthographic);
+
+  // describe the coordinates of the image corners
+  const double tiepoints[6] = { 0, 0, 0, origin_x + geo_offset[0], origin_y + geo_offset[1], 0 };
+  TIFFSetField(tif, TIFFTAG_GEOTIEPOINTS, 6, tiepoints);
+
+  if (values[1] == "WGS84")  // we support WGS84 by name
+  {
+    GTIFKeySet(gtif, GeographicTypeGeoKey, TYPE_SHORT, 1, GCS_WGS_84);
+  }
+  else  // all other Geographic type geokeys we parse directly by their number
+  {
+    std::stringstream ss(values[1]);
+    int geokey = 0;
+    ss >> geokey;
+    if (!ss.fail())  // we are using a direct number here, so
+    {
+      GTIFKeySet(gtif, GeographicTypeGeoKey, TYPE_SHORT, 1, geokey);
+    }
+    else
+    {
+      std::cout << "unknown geographic projection type: " << values[1] << std::endl;
+      return false;
+    }
+  }
+  if (values[2] == "WGS84")  // we support the datum type by name
+  {
+    GTIFKeySet(gtif, GeogGeodeticDatumGeoKey, TYPE_SHORT, 1, Datum_WGS84);
+  }
+  else if (!values[2].empty())
+  {
+    std::cout << "unknown geodetic datum: " << values[2] << std::endl;
+    return false;
+  }
+
+  GTIFKeySet(gtif, ProjectedCSTypeGeoKey, TYPE_SHORT, 1, KvUserDefined);
+  GTIFKeySet(gtif, ProjectionGeoKey, TYPE_SHORT, 1, KvUserDefined);
+  if (values[0] != "ortho")  // we only support ortho projection
+  {
+    std::cout << "unknown projection type: " << values[0] << std::endl;
+    return false;
+  }
+  if (values[3] != "m")  // we only support metres as the units
+  {
+    std::cout << "unknown unit type: " << values[3] << std::endl;
+    return false;
+  }
+  GTIFKeySet(gtif, ProjCenterLongGeoKey, TYPE_DOUBLE, 1, coord_long);
+  GTIFKeySet(gtif, ProjCenterLatGeoKey, TYPE_DOUBLE, 1, coord_lat);
+
+  // Store the keys into the TIFF Tags
+  GTIFWriteKeys(gtif);
+  return true;
+}
+
 // save to geotif format using floating-point per-channel colour data. This function passes a projection file in order
 // to geolocate the image
 bool writeGeoTiffFloat(const std::string &filename, int x, int y, const float *data, double pixel_width, bool scalar,
@@ -93,551 +245,1360 @@ bool writeGeoTiffFloat(const std::string &filename, int x, int y, const float *d
   }
 
   // read in the projection parameters
-  if (!projection_file.empty())
+  if (!setGeoTiffKeys(tif, gtif, pixel_width, projection_file, origin_x, origin_y))
+  {
+    return false;
+  }
+
+  // get rid of the key parser
+  GTIFFree(gtif);
+
+  // save and close the TIFF file descriptor
+  XTIFFClose(tif);
+
+  return true;
+}
+#endif
+
+namespace
+{
+/// dense grids of fewer voxels than this are only filled on the CPU, as the GPU transfers would cost more
+const int64_t kGpuMinVoxels = 1 << 20;
+
+/// A ray clipped to a density grid, in voxel units
+struct DensityRay
+{
+  Eigen::Vector3d source;
+  Eigen::Vector3d target;
+  double length;  // in metres
+  bool hit;       // whether the ray ends in its last voxel
+};
+
+/// The rays from @c starts to @c ends that cross @c bounds , clipped to them, in units of @c voxel_width from the
+/// minimum bound
+std::vector<DensityRay> clipDensityRays(const Cuboid &bounds, double voxel_width,
+                                        const std::vector<Eigen::Vector3d> &starts,
+                                        const std::vector<Eigen::Vector3d> &ends, const std::vector<RGBA> &colours)
+{
+  std::vector<DensityRay> rays;
+  rays.reserve(ends.size());
+  std::vector<double> near(ends.size()), far(ends.size());
+  bounds.clipRays(starts.data(), ends.data(), ends.size(), near.data(), far.data());
+  for (size_t i = 0; i < ends.size(); ++i)
   {
-    std::ifstream ifs(projection_file.c_str(), std::ios::in);
-    if (ifs.fail())
+    Eigen::Vector3d start = starts[i];
+    Eigen::Vector3d end = ends[i];
+    if (!Cuboid::clipToRange(near[i], far[i], start, end))
     {
-      std::cerr << "cannot open file " << projection_file << std::endl;
-      return false;
+      continue;
+    }
+    DensityRay ray;
+    // only an unclipped, bounded ray ends in its last voxel
+    ray.hit = colours[i].alpha > 0 && end == ends[i];
+    ray.length = (end - start).norm();
+    ray.source = (start - bounds.min_bound_) / voxel_width;
+    ray.target = (end - bounds.min_bound_) / voxel_width;
+    rays.push_back(ray);
+  }
+  return rays;
+}
+
+/// Add to @c voxel the fewest rings of the Moore neighbourhood of a voxel for it to gain @c needed rays, scaling down
+/// the last ring so that it gains exactly that many. @c neighbour(dx, dy, dz) gives the neighbour at that offset.
+/// Returns false if the whole neighbourhood has too few rays
+template <class Neighbour>
+bool addNeighbourPrior(DensityGrid::Voxel &voxel, float needed, const Neighbour &neighbour)
+{
+  DensityGrid::Voxel neighbours = neighbour(-1, 0, 0);
+  neighbours += neighbour(1, 0, 0);
+  neighbours += neighbour(0, -1, 0);
+  neighbours += neighbour(0, 1, 0);
+  neighbours += neighbour(0, 0, -1);
+  neighbours += neighbour(0, 0, 1);
+  if (neighbours.numRays() >= needed)
+  {
+    voxel += neighbours * (needed / neighbours.numRays());  // add minimal amount to reach DENSITY_MIN_RAYS
+    return true;
+  }
+  voxel += neighbours;
+  needed -= neighbours.numRays();
+
+  neighbours = neighbour(-1, -1, 0);
+  neighbours += neighbour(-1, 1, 0);
+  neighbours += neighbour(1, -1, 0);
+  neighbours += neighbour(1, 1, 0);
+
+  neighbours += neighbour(-1, 0, -1);
+  neighbours += neighbour(-1, 0, 1);
+  neighbours += neighbour(1, 0, -1);
+  neighbours += neighbour(1, 0, 1);
+
+  neighbours += neighbour(0, -1, -1);
+  neighbours += neighbour(0, -1, 1);
+  neighbours += neighbour(0, 1, -1);
+  neighbours += neighbour(0, 1, 1);
+  if (neighbours.numRays() >= needed)
+  {
+    voxel += neighbours * (needed / neighbours.numRays());  // add minimal amount to reach DENSITY_MIN_RAYS
+    return true;
+  }
+  voxel += neighbours;
+  needed -= neighbours.numRays();
+
+  neighbours = neighbour(-1, -1, -1);
+  neighbours += neighbour(-1, -1, 1);
+  neighbours += neighbour(-1, 1, -1);
+  neighbours += neighbour(1, -1, -1);
+  neighbours += neighbour(-1, 1, 1);
+  neighbours += neighbour(1, -1, 1);
+  neighbours += neighbour(1, 1, -1);
+  neighbours += neighbour(1, 1, 1);
+  if (neighbours.numRays() >= needed)
+  {
+    voxel += neighbours * (needed / neighbours.numRays());  // add minimal amount to reach DENSITY_MIN_RAYS
+    return true;
+  }
+  voxel += neighbours;
+  return false;
+}
+}  // namespace
+
+const int DensityGrid::brick_width;
+const int64_t DensityGrid::default_max_dense_voxels;
+
+/// Calculate the surface area per cubic metre within each voxel of the grid. Assuming an unbiased distribution
+/// of surface angles.
+void DensityGrid::calculateDensities(const std::string &file_name)
+{
+  Filler filler(*this);
+  auto calculate = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends, std::vector<double> &,
+                       std::vector<RGBA> &colours) { filler.addRays(starts, ends, colours); };
+  Cloud::read(file_name, calculate);
+}
+
+DensityGrid::Filler::Filler(DensityGrid &grid)
+  : grid_(grid)
+{
+  if (!grid_.sparse() && static_cast<int64_t>(grid_.voxels_.size()) >= kGpuMinVoxels)
+  {
+    gpu_ = GpuDensityGrid::create(grid_.voxel_dims_.data(), reinterpret_cast<const float *>(grid_.voxels_.data()));
+  }
+}
+
+DensityGrid::Filler::~Filler()
+{
+  if (gpu_ && !gpu_->download(reinterpret_cast<float *>(grid_.voxels_.data())))
+  {
+    std::cerr << "Error: the GPU failed while calculating the densities, so they are missing" << std::endl;
+  }
+}
+
+void DensityGrid::Filler::addRays(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+                                  const std::vector<RGBA> &colours)
+{
+  if (gpu_)
+  {
+    const std::vector<DensityRay> rays = clipDensityRays(grid_.bounds_, grid_.voxel_width_, starts, ends, colours);
+    std::vector<double> sources(3 * rays.size()), targets(3 * rays.size()), lengths(rays.size());
+    std::vector<unsigned char> hits(rays.size());
+    for (size_t i = 0; i < rays.size(); i++)
+    {
+      for (int j = 0; j < 3; j++)
+      {
+        sources[3 * i + j] = rays[i].source[j];
+        targets[3 * i + j] = rays[i].target[j];
+      }
+      lengths[i] = rays[i].length;
+      hits[i] = rays[i].hit ? 1 : 0;
     }
-    std::string line;
-    if (!getline(ifs, line))
+    if (gpu_->addRays(sources.data(), targets.data(), lengths.data(), hits.data(), rays.size()))
     {
-      return false;
+      return;
     }
-    // the set of keys in the key-value pairs that we are parsing
-    const std::vector<std::string> keys = { "+proj", "+ellps", "+datum", "+units", "+lat_0", "+lon_0", "+x_0", "+y_0" };
-    std::vector<std::string> values;
-    for (const auto &key : keys)
+    // the rest of the rays are added on the CPU, to the voxels that the GPU has filled so far
+    if (!gpu_->download(reinterpret_cast<float *>(grid_.voxels_.data())))
     {
-      std::string::size_type found = line.find(key);
-      if (found == std::string::npos)  // error checking
+      std::cerr << "Error: the GPU failed while calculating the densities, so the rays before now are missing"
+                << std::endl;
+    }
+    gpu_.reset();
+  }
+  grid_.addRays(starts, ends, colours);
+}
+
+void DensityGrid::addRays(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+                          const std::vector<RGBA> &colours)
+{
+  const std::vector<DensityRay> rays = clipDensityRays(bounds_, voxel_width_, starts, ends, colours);
+
+  // walk the voxels of each ray, adding the path length within each one. Only the voxels from @c slab_min to
+  // @c slab_max on @c axis are changed
+  auto add_ray = [this](const DensityRay &ray, int axis, int slab_min, int slab_max) {
+    const bool forwards = ray.target[axis] >= ray.source[axis];
+    walkVoxels(ray.source, ray.target, [&](const Eigen::Vector3i &inds, double t_enter, double t_exit) {
+      if (inds[axis] < slab_min || inds[axis] >= slab_max)
       {
-        if (key == "+ellps")
-        {
-          std::cout << "No ellps field found in proj file, setting it equal to the datum." << std::endl;
-          values.push_back("");
-          continue;
-        }
-        std::cerr << "Error: cannot find key: " << key << " in the projection file: " << projection_file << std::endl;
-        return false;
+        // continue until the ray has passed the slab
+        return forwards ? inds[axis] < slab_min : inds[axis] >= slab_max;
+      }
+      if ((inds.array() < 0).any() || (inds.array() >= voxel_dims_.array()).any())
+      {
+        return true;  // the clipped ray can touch the far faces of the bounds
+      }
+      const float length_in_voxel = static_cast<float>((t_exit - t_enter) * ray.length);
+      if (ray.hit && t_exit >= 1.0)
+      {
+        touch(inds).addHitRay(length_in_voxel);
+      }
+      else
+      {
+        touch(inds).addMissRay(length_in_voxel);
+      }
+      return true;
+    });
+  };
+
+#if RAYLIB_WITH_TBB
+  // Each task owns a slab of voxels across the longest axis of the grid, and adds every ray that crosses the slab.
+  // Each voxel therefore sums its rays in ray order, as the serial loop does, so the densities are bitwise identical
+  // for any number of threads. The slabs are whole bricks thick, so that each brick is only allocated by one task
+  int axis = 0;
+  voxel_dims_.maxCoeff(&axis);
+  const int max_slabs = 64;
+  const int num_bricks = (voxel_dims_[axis] + brick_width - 1) / brick_width;
+  const int num_slabs = std::max(1, std::min(num_bricks, max_slabs));
+  tbb::parallel_for(0, num_slabs, [&](int slab) {
+    const int slab_min = std::min(voxel_dims_[axis], brick_width * ((num_bricks * slab) / num_slabs));
+    const int slab_max = std::min(voxel_dims_[axis], brick_width * ((num_bricks * (slab + 1)) / num_slabs));
+    for (const auto &ray : rays)
+    {
+      const double ray_min = std::min(ray.source[axis], ray.target[axis]);
+      const double ray_max = std::max(ray.source[axis], ray.target[axis]);
+      if (ray_max >= static_cast<double>(slab_min) && ray_min < static_cast<double>(slab_max))
+      {
+        add_ray(ray, axis, slab_min, slab_max);
       }
-      // generate the list of values that correspond to the list of keys
-      found += key.length() + 1;
-      std::string::size_type space = line.find(" ", found);
-      if (space == std::string::npos)
-        space = line.length() - 1;
-      values.push_back(line.substr(found, space - found));
     }
-    if (values[1].empty())  // if ellipsoid type not specified, we take it to be the same as the datum
+  });
+#else   // RAYLIB_WITH_TBB
+  for (const auto &ray : rays)
+  {
+    add_ray(ray, 0, std::numeric_limits<int>::lowest(), std::numeric_limits<int>::max());
+  }
+#endif  // RAYLIB_WITH_TBB
+}
+
+// This is a form of windowed average over the Moore neighbourhood (3x3x3) window.
+void DensityGrid::addNeighbourPriors()
+{
+#if DENSITY_MIN_RAYS > 0
+  double num_hit_points = 0.0;
+  double num_hit_points_unsatisfied = 0.0;
+
+  if (!sparse())
+  {
+    // a large grid is convolved on the GPU where there is one, otherwise on the CPU
+    std::unique_ptr<GpuDensityGrid> gpu;
+    if (static_cast<int64_t>(voxels_.size()) >= kGpuMinVoxels)
     {
-      values[1] = values[2];
+      gpu = GpuDensityGrid::create(voxel_dims_.data(), reinterpret_cast<const float *>(voxels_.data()));
     }
-    double coord_lat = 0.0;
-    if (!values[4].empty())
+    if (!gpu || !gpu->addNeighbourPriors(DENSITY_MIN_RAYS, num_hit_points, num_hit_points_unsatisfied) ||
+        !gpu->download(reinterpret_cast<float *>(voxels_.data())))
     {
-      coord_lat = std::stod(values[4]);  // latitude
+      num_hit_points = num_hit_points_unsatisfied = 0.0;
+      const int64_t X = 1;
+      const int64_t Y = voxel_dims_[0];
+      const int64_t Z = static_cast<int64_t>(voxel_dims_[0]) * voxel_dims_[1];
+      // This simple 3x3x3 convolution needs to be a bit sneaky to avoid having to double the memory cost.
+      // well, not that sneaky, we just shift the output -1,-1,-1 for each cell
+      for (int x = 1; x < voxel_dims_[0] - 1; x++)
+      {
+        for (int y = 1; y < voxel_dims_[1] - 1; y++)
+        {
+          for (int z = 1; z < voxel_dims_[2] - 1; z++)
+          {
+            const int64_t ind = getIndex(Eigen::Vector3i(x, y, z));
+            if (voxels_[ind].numHits() > 0)
+              num_hit_points++;
+            const float needed = DENSITY_MIN_RAYS - voxels_[ind].numRays();
+            const DensityGrid::Voxel corner_vox = voxels_[ind - X - Y - Z];
+            voxels_[ind - X - Y - Z] = voxels_[ind];  // move centre up to corner
+            DensityGrid::Voxel &voxel = voxels_[ind - X - Y - Z];
+            if (needed < 0.0)
+              continue;
+            // the corner has been overwritten, but every other neighbour is yet to be shifted
+            auto neighbour = [&](int dx, int dy, int dz) -> const Voxel & {
+              return dx < 0 && dy < 0 && dz < 0 ? corner_vox : voxels_[ind + dx * X + dy * Y + dz * Z];
+            };
+            if (!addNeighbourPrior(voxel, needed, neighbour) && voxels_[ind].numHits() > 0)
+              num_hit_points_unsatisfied++;
+          }
+        }
+      }
     }
-    double coord_long = 0.0;
-    if (!values[5].empty())
+  }
+  else
+  {
+    // only the centres within a brick of an allocated brick have voxels in their neighbourhood
+    std::vector<bool> active(bricks_.size(), false);
+    Eigen::Vector3i brick;
+    for (brick[2] = 0; brick[2] < brick_dims_[2]; brick[2]++)
     {
-      coord_long = std::stod(values[5]);  // longitude
+      for (brick[1] = 0; brick[1] < brick_dims_[1]; brick[1]++)
+      {
+        for (brick[0] = 0; brick[0] < brick_dims_[0]; brick[0]++)
+        {
+          if (!bricks_[brickIndex(brick)])
+            continue;
+          const Eigen::Vector3i first = (brick.array() - 1).max(0);
+          const Eigen::Vector3i last = (brick.array() + 1).min(brick_dims_.array() - 1);
+          Eigen::Vector3i near;
+          for (near[2] = first[2]; near[2] <= last[2]; near[2]++)
+          {
+            for (near[1] = first[1]; near[1] <= last[1]; near[1]++)
+            {
+              for (near[0] = first[0]; near[0] <= last[0]; near[0]++) active[brickIndex(near)] = true;
+            }
+          }
+        }
+      }
     }
-    Eigen::Vector2d geo_offset(0, 0);
-    if (!values[6].empty())
+    // the bricks are visited in turn rather than in the order that lets the dense grid be shifted in place, so the
+    // shifted output is written to a copy. As in the dense grid, voxels that are not shifted onto keep their values
+    std::vector<std::unique_ptr<Brick>> priors(bricks_.size());
+    for (size_t i = 0; i < bricks_.size(); i++)
     {
-      geo_offset[0] = std::stod(values[6]);  // offset in m
+      if (bricks_[i])
+        priors[i].reset(new Brick(*bricks_[i]));
     }
-    if (!values[7].empty())
+    for (brick[2] = 0; brick[2] < brick_dims_[2]; brick[2]++)
     {
-      geo_offset[1] = std::stod(values[7]);  // offset in m
+      for (brick[1] = 0; brick[1] < brick_dims_[1]; brick[1]++)
+      {
+        for (brick[0] = 0; brick[0] < brick_dims_[0]; brick[0]++)
+        {
+          if (!active[brickIndex(brick)])
+            continue;
+          const Eigen::Vector3i first = (brick * brick_width).array().max(1);
+          const Eigen::Vector3i last = ((brick.array() + 1) * brick_width).min(voxel_dims_.array() - 1);
+          Eigen::Vector3i centre;
+          for (centre[2] = first[2]; centre[2] < last[2]; centre[2]++)
+          {
+            for (centre[1] = first[1]; centre[1] < last[1]; centre[1]++)
+            {
+              for (centre[0] = first[0]; centre[0] < last[0]; centre[0]++)
+              {
+                const DensityGrid::Voxel &centre_vox = voxel(centre);
+                if (centre_vox.numHits() > 0)
+                  num_hit_points++;
+                const float needed = DENSITY_MIN_RAYS - centre_vox.numRays();
+                DensityGrid::Voxel prior = centre_vox;
+                if (needed >= 0.0)
+                {
+                  auto neighbour = [&](int dx, int dy, int dz) -> const Voxel & {
+                    return voxel(centre + Eigen::Vector3i(dx, dy, dz));
+                  };
+                  if (!addNeighbourPrior(prior, needed, neighbour) && centre_vox.numHits() > 0)
+                    num_hit_points_unsatisfied++;
+                }
+                // an empty prior has an empty neighbourhood, so its corner is already empty
+                if (prior.numRays() > 0)
+                {
+                  const Eigen::Vector3i corner = centre - Eigen::Vector3i(1, 1, 1);
+                  std::unique_ptr<Brick> &corner_brick = priors[brickIndex(corner / brick_width)];
+                  if (!corner_brick)
+                    corner_brick.reset(new Brick);
+                  (*corner_brick)[voxelInBrick(corner)] = prior;
+                }
+              }
+            }
+          }
+        }
+      }
     }
-    std::cout << "geooffset: " << geo_offset << ", geokey: " << values[1] << ", datum: " << values[2]
-              << ", coord_long: " << coord_long << std::endl;
+    bricks_.swap(priors);
+  }
+  const double percentage = 100.0 * num_hit_points_unsatisfied / num_hit_points;
+  std::cout << "Density calculation: " << percentage << "% of voxels had insufficient (<" << DENSITY_MIN_RAYS
+            << ") rays within them" << std::endl;
+  if (percentage > 50.0)
+  {
+    std::cout << "This is high. Consider using a larger pixel size, or a denser cloud, or reducing DENSITY_MIN_RAYS, "
+                 "for consistent results"
+              << std::endl;
+  }
+  else if (percentage < 1.0)
+  {
+    std::cout << "This is low enough that you could get more fidelity from using a smaller pixel size" << std::endl;
+    std::cout << "or more accuracy by increasing DENSITY_MIN_RAYS" << std::endl;
+  }
+#endif
+}
 
-    const double scales[3] = { pixel_width, pixel_width, pixel_width };
-    TIFFSetField(tif, TIFFTAG_GEOPIXELSCALE, 3, scales);  // set the width of a pixel
+namespace
+{
+const char kDensityMagic[4] = { 'R', 'D', 'E', 'N' };
+const uint32_t kDensityVersion = 1;
 
-    // Set GeoTIFF information
-    // We are only supporting a limited set of projection types, so here we assume standard settings
-    GTIFKeySet(gtif, GTModelTypeGeoKey, TYPE_SHORT, 1, ModelTypeProjected);
-    GTIFKeySet(gtif, GTRasterTypeGeoKey, TYPE_SHORT, 1, RasterPixelIsArea);
+template <class T>
+void writeValue(std::ofstream &out, const T &value)
+{
+  out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
 
-    GTIFKeySet(gtif, ProjLinearUnitsGeoKey, TYPE_SHORT, 1, Linear_Meter);
-    GTIFKeySet(gtif, VerticalUnitsGeoKey, TYPE_SHORT, 1, Linear_Meter);
+template <class T>
+void readValue(std::ifstream &in, T &value)
+{
+  in.read(reinterpret_cast<char *>(&value), sizeof(T));
+}
+}  // namespace
 
-    GTIFKeySet(gtif, ProjectionGeoKey, TYPE_SHORT, 1, KvUserDefined);
-    GTIFKeySet(gtif, ProjCoordTransGeoKey, TYPE_SHORT, 1, CT_Orthographic);
+std::string densityFileName(const std::string &cloud_file)
+{
+  return cloud_file + ".density";
+}
 
-    // describe the coordinates of the image corners
-    const double tiepoints[6] = { 0, 0, 0, origin_x + geo_offset[0], origin_y + geo_offset[1], 0 };
-    TIFFSetField(tif, TIFFTAG_GEOTIEPOINTS, 6, tiepoints);
+void densityGridGeometry(const Cuboid &bounds, double voxel_width, Cuboid &grid_bounds, Eigen::Vector3i &dims)
+{
+  const Eigen::Vector3d extent = bounds.max_bound_ - bounds.min_bound_;
+  dims = (extent / voxel_width).cast<int>() + Eigen::Vector3i(1, 1, 1);
+#if DENSITY_MIN_RAYS > 0
+  dims += Eigen::Vector3i(1, 1, 1);  // so that we have extra space to convolve
+#endif
+  grid_bounds = bounds;
+  grid_bounds.min_bound_ -= Eigen::Vector3d(voxel_width, voxel_width, voxel_width);
+}
 
-    if (values[1] == "WGS84")  // we support WGS84 by name
+bool DensityGrid::save(const std::string &cloud_file) const
+{
+  static_assert(sizeof(Voxel) == 3 * sizeof(float), "the voxels are saved as three floats");
+  uint64_t size, hash;
+  int64_t modified;
+  if (!fileStamp(cloud_file, size, modified, hash))
+  {
+    std::cerr << "Error: cannot stamp the densities of missing file " << cloud_file << std::endl;
+    return false;
+  }
+  // the bricks are gathered the same way from either storage, and only the non-empty ones are kept
+  const Eigen::Vector3i brick_dims = (voxel_dims_.array() + (brick_width - 1)) / brick_width;
+  std::vector<Eigen::Vector3i> brick_list;
+  Eigen::Vector3i brick;
+  for (brick[2] = 0; brick[2] < brick_dims[2]; brick[2]++)
+  {
+    for (brick[1] = 0; brick[1] < brick_dims[1]; brick[1]++)
     {
-      GTIFKeySet(gtif, GeographicTypeGeoKey, TYPE_SHORT, 1, GCS_WGS_84);
+      for (brick[0] = 0; brick[0] < brick_dims[0]; brick[0]++)
+      {
+        if (!sparse() || bricks_[brickIndex(brick)])
+          brick_list.push_back(brick);
+      }
     }
-    else  // all other Geographic type geokeys we parse directly by their number
+  }
+  const std::string file_name = densityFileName(cloud_file);
+  std::ofstream out(file_name, std::ios::binary | std::ios::out);
+  if (out.fail())
+  {
+    std::cerr << "Error: cannot open " << file_name << " for writing." << std::endl;
+    return false;
+  }
+  out.write(kDensityMagic, 4);
+  writeValue(out, kDensityVersion);
+  writeValue(out, size);
+  writeValue(out, modified);
+  writeValue(out, hash);
+  writeValue(out, voxel_width_);
+  writeValue(out, bounds_.min_bound_);
+  writeValue(out, bounds_.max_bound_);
+  writeValue(out, voxel_dims_);
+  writeValue(out, static_cast<int32_t>(brick_width));
+  const std::streampos count_pos = out.tellp();
+  uint64_t num_bricks = 0;
+  writeValue(out, num_bricks);
+  Brick voxels;
+  for (const auto &b : brick_list)
+  {
+    bool empty = true;
+    Eigen::Vector3i inds;
+    for (inds[2] = 0; inds[2] < brick_width; inds[2]++)
     {
-      std::stringstream ss(values[1]);
-      int geokey = 0;
-      ss >> geokey;
-      if (!ss.fail())  // we are using a direct number here, so
+      for (inds[1] = 0; inds[1] < brick_width; inds[1]++)
       {
-        GTIFKeySet(gtif, GeographicTypeGeoKey, TYPE_SHORT, 1, geokey);
+        for (inds[0] = 0; inds[0] < brick_width; inds[0]++)
+        {
+          const Eigen::Vector3i voxel_inds = b * brick_width + inds;
+          Voxel &vox = voxels[voxelInBrick(inds)];
+          vox = (voxel_inds.array() < voxel_dims_.array()).all() ? voxel(voxel_inds) : Voxel();
+          empty = empty && vox.numRays() == 0.0f;
+        }
       }
-      else
+    }
+    if (empty)
+      continue;
+    writeValue(out, b);
+    out.write(reinterpret_cast<const char *>(voxels.data()), sizeof(Brick));
+    num_bricks++;
+  }
+  out.seekp(count_pos);
+  writeValue(out, num_bricks);
+  return out.good();
+}
+
+bool DensityGrid::load(const std::string &cloud_file)
+{
+  const std::string file_name = densityFileName(cloud_file);
+  std::ifstream in(file_name, std::ios::in | std::ios::binary);
+  if (in.fail())
+  {
+    return false;  // not an error, the saved densities are optional
+  }
+  uint64_t size, stored_size, hash, stored_hash;
+  int64_t modified, stored_modified;
+  if (!fileStamp(cloud_file, size, modified, hash))
+  {
+    return false;
+  }
+  char magic[4];
+  uint32_t version;
+  double voxel_width;
+  Eigen::Vector3d min_bound, max_bound;
+  Eigen::Vector3i dims;
+  int32_t stored_brick_width;
+  uint64_t num_bricks;
+  in.read(magic, 4);
+  readValue(in, version);
+  readValue(in, stored_size);
+  readValue(in, stored_modified);
+  readValue(in, stored_hash);
+  readValue(in, voxel_width);
+  readValue(in, min_bound);
+  readValue(in, max_bound);
+  readValue(in, dims);
+  readValue(in, stored_brick_width);
+  readValue(in, num_bricks);
+  if (!in || std::memcmp(magic, kDensityMagic, 4) != 0 || version != kDensityVersion ||
+      stored_brick_width != brick_width)
+  {
+    std::cout << "warning: ignoring unrecognised densities file " << file_name << std::endl;
+    return false;
+  }
+  if (stored_size != size || stored_modified != modified || stored_hash != hash)
+  {
+    std::cout << "densities " << file_name << " are out of date, " << cloud_file
+              << " has changed since they were written" << std::endl;
+    return false;
+  }
+  if (voxel_width != voxel_width_ || min_bound != bounds_.min_bound_ || max_bound != bounds_.max_bound_ ||
+      dims != voxel_dims_)
+  {
+    std::cout << "densities " << file_name << " are of a different grid, with voxels of width " << voxel_width << " m"
+              << std::endl;
+    return false;
+  }
+  // only a fully read file replaces the voxels
+  std::vector<std::pair<Eigen::Vector3i, Brick>> bricks(num_bricks);
+  for (auto &brick : bricks)
+  {
+    readValue(in, brick.first);
+    in.read(reinterpret_cast<char *>(brick.second.data()), sizeof(Brick));
+  }
+  if (!in)
+  {
+    std::cout << "warning: ignoring truncated densities file " << file_name << std::endl;
+    return false;
+  }
+  for (auto &brick : bricks)
+  {
+    Eigen::Vector3i inds;
+    for (inds[2] = 0; inds[2] < brick_width; inds[2]++)
+    {
+      for (inds[1] = 0; inds[1] < brick_width; inds[1]++)
       {
-        std::cout << "unknown geographic projection type: " << values[1] << std::endl;
-        return false;
+        for (inds[0] = 0; inds[0] < brick_width; inds[0]++)
+        {
+          const Eigen::Vector3i voxel_inds = brick.first * brick_width + inds;
+          const Voxel &vox = brick.second[voxelInBrick(inds)];
+          if (vox.numRays() > 0.0f && (voxel_inds.array() < voxel_dims_.array()).all())
+            touch(voxel_inds) = vox;
+        }
       }
     }
-    if (values[2] == "WGS84")  // we support the datum type by name
+  }
+  return true;
+}
+
+namespace
+{
+/// Gives the rays to render a chunk at a time to @c apply , returning false if they could not be read. Only the chunks
+/// that may overlap @c bounds are needed, or every chunk when it is null
+using RaySource = std::function<bool(
+  const Cuboid *bounds, std::function<void(std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                                           std::vector<double> &times, std::vector<RGBA> &colours)>
+                          apply)>;
+
+/// The accumulated colour buffer of the rows of an image from @c first_row , held as separate bands of rows so that a
+/// large image needs no single contiguous allocation, and so that each thread can render into its own bands. The
+/// channels are single precision, half of the memory of double precision pixels.
+class PixelBands
+{
+public:
+  static const int kBandRows = 32;
+
+  PixelBands(int width, int height, int first_row = 0)
+    : width_(width)
+    , height_(height)
+    , first_row_(first_row)
+  {
+    bands_.resize((height + kBandRows - 1) / kBandRows);
+    for (size_t b = 0; b < bands_.size(); b++)
     {
-      GTIFKeySet(gtif, GeogGeodeticDatumGeoKey, TYPE_SHORT, 1, Datum_WGS84);
+      const int rows = std::min(kBandRows, height - static_cast<int>(b) * kBandRows);
+      bands_[b].assign(static_cast<size_t>(width) * rows, Eigen::Vector4f(0, 0, 0, 0));
     }
-    else if (!values[2].empty())
+  }
+  /// the pixel at column @c x of image row @c y
+  Eigen::Vector4f &operator()(int x, int y)
+  {
+    const int row = y - first_row_;
+    return bands_[row / kBandRows][x + width_ * (row % kBandRows)];
+  }
+  const Eigen::Vector4f &operator()(int x, int y) const { return const_cast<PixelBands &>(*this)(x, y); }
+  int firstRow() const { return first_row_; }
+  /// one past the last row
+  int endRow() const { return first_row_ + height_; }
+  int numBands() const { return static_cast<int>(bands_.size()); }
+  /// the band containing image row @c y
+  int band(int y) const { return (y - first_row_) / kBandRows; }
+  /// the first row of band @c band
+  int bandBegin(int band) const { return first_row_ + band * kBandRows; }
+  /// one past the last row of band @c band
+  int bandEnd(int band) const { return std::min(endRow(), bandBegin(band + 1)); }
+  /// call @c func(pixel) on every pixel
+  template <class Func>
+  void forEach(const Func &func) const
+  {
+    for (const auto &band : bands_)
     {
-      std::cout << "unknown geodetic datum: " << values[2] << std::endl;
-      return false;
+      for (const auto &pixel : band) func(pixel);
     }
+  }
+
+private:
+  int width_, height_, first_row_;
+  std::vector<std::vector<Eigen::Vector4f>> bands_;
+};
+
+/// Receives an image a row at a time, from its top row down, as three floats (red, green, blue) per pixel
+class ImageRowWriter
+{
+public:
+  virtual ~ImageRowWriter() = default;
+  /// whether the image was opened for writing
+  virtual bool good() const = 0;
+  /// add the next row down the image
+  virtual bool addRow(const float *row) = 0;
+  /// complete the image, once all of its rows are added
+  virtual bool end() = 0;
+};
 
-    GTIFKeySet(gtif, ProjectedCSTypeGeoKey, TYPE_SHORT, 1, KvUserDefined);
-    GTIFKeySet(gtif, ProjectionGeoKey, TYPE_SHORT, 1, KvUserDefined);
-    if (values[0] != "ortho")  // we only support ortho projection
+/// Writes a Radiance (.hdr) image as its rows arrive, in flat (not run length encoded) scanlines
+class HdrRowWriter : public ImageRowWriter
+{
+public:
+  HdrRowWriter(const std::string &file_name, int width, int height)
+    : rgbe_(4 * static_cast<size_t>(width))
+  {
+    out_.open(file_name, std::ios::binary | std::ios::out);
+    if (out_.fail())
     {
-      std::cout << "unknown projection type: " << values[0] << std::endl;
-      return false;
+      std::cerr << "Error: cannot open " << file_name << " for writing." << std::endl;
+      return;
     }
-    if (values[3] != "m")  // we only support metres as the units
+    out_ << "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y " << height << " +X " << width << "\n";
+  }
+  bool good() const override { return out_.good(); }
+  bool addRow(const float *row) override
+  {
+    for (size_t x = 0; x < rgbe_.size() / 4; x++)
     {
-      std::cout << "unknown unit type: " << values[3] << std::endl;
-      return false;
+      const float *rgb = row + 3 * x;
+      unsigned char *rgbe = &rgbe_[4 * x];
+      // a shared exponent, with the largest component's mantissa in the upper half of the byte range
+      const float max_component = std::max(rgb[0], std::max(rgb[1], rgb[2]));
+      if (max_component < 1e-32f)
+      {
+        rgbe[0] = rgbe[1] = rgbe[2] = rgbe[3] = 0;
+        continue;
+      }
+      int exponent;
+      const float scale = static_cast<float>(std::frexp(max_component, &exponent)) * 256.0f / max_component;
+      for (int c = 0; c < 3; c++) rgbe[c] = static_cast<unsigned char>(std::max(0.0f, rgb[c] * scale));
+      rgbe[3] = static_cast<unsigned char>(exponent + 128);
     }
-    GTIFKeySet(gtif, ProjCenterLongGeoKey, TYPE_DOUBLE, 1, coord_long);
-    GTIFKeySet(gtif, ProjCenterLatGeoKey, TYPE_DOUBLE, 1, coord_lat);
-
-    // Store the keys into the TIFF Tags
-    GTIFWriteKeys(gtif);
+    out_.write(reinterpret_cast<const char *>(rgbe_.data()), rgbe_.size());
+    return out_.good();
+  }
+  bool end() override
+  {
+    out_.close();
+    return !out_.fail();
   }
 
-  // get rid of the key parser
-  GTIFFree(gtif);
-
-  // save and close the TIFF file descriptor
-  XTIFFClose(tif);
-
-  return true;
-}
-#endif
+private:
+  std::ofstream out_;
+  std::vector<unsigned char> rgbe_;
+};
 
-/// Calculate the surface area per cubic metre within each voxel of the grid. Assuming an unbiased distribution
-/// of surface angles.
-void DensityGrid::calculateDensities(const std::string &file_name)
+#if RAYLIB_WITH_TIFF
+/// Writes a tiled, floating-point GeoTIFF with internal overviews as its rows arrive, holding one row of tiles in
+/// memory. Each overview halves the resolution of the one above, down to a single tile. Its rows are averaged from the
+/// resolution above as they complete, and spooled to a temporary file, to be appended as a reduced resolution image of
+/// the file once the full resolution image is complete.
+class GeoTiffTileWriter : public ImageRowWriter
 {
-  auto calculate = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends, std::vector<double> &,
-                       std::vector<RGBA> &colours) {
-    for (size_t i = 0; i < ends.size(); ++i)
-    {
-      Eigen::Vector3d start = starts[i];
-      Eigen::Vector3d end = ends[i];
-      bounds_.clipRay(start, end);
-
-      // now walk the voxels
-      const Eigen::Vector3d dir = end - start;
-      const Eigen::Vector3d source = (start - bounds_.min_bound_) / voxel_width_;
-      const Eigen::Vector3d target = (end - bounds_.min_bound_) / voxel_width_;
-      const double length = dir.norm();
-      const double eps = 1e-9;  // to stay away from edge cases
-      const double maxDist = (target - source).norm();
-
-      // cached values to speed up the loop below
-      Eigen::Vector3i adds;
-      Eigen::Vector3d offsets;
-      for (int k = 0; k < 3; ++k)
-      {
-        if (dir[k] > 0.0)
-        {
-          adds[k] = 1;
-          offsets[k] = 0.5;
-        }
-        else
-        {
-          adds[k] = -1;
-          offsets[k] = -0.5;
-        }
+public:
+  GeoTiffTileWriter(const std::string &file_name, int width, int height, int tile_size, double pixel_width,
+                    const std::string &projection_file, double origin_x, double origin_y)
+    : tile_size_(tile_size)
+    , tile_(4 * static_cast<size_t>(tile_size) * tile_size)
+  {
+    levels_.resize(1);
+    levels_[0].width = width;
+    levels_[0].height = height;
+    while (std::max(levels_.back().width, levels_.back().height) > tile_size)
+    {
+      Level level;
+      level.width = (levels_.back().width + 1) / 2;
+      level.height = (levels_.back().height + 1) / 2;
+      level.spool_name = file_name + ".overview" + std::to_string(levels_.size());
+      levels_.push_back(std::move(level));
+    }
+    for (auto &level : levels_) level.rows.resize(4 * static_cast<size_t>(level.width) * tile_size);
+    for (size_t i = 1; i < levels_.size(); i++)
+    {
+      levels_[i].spool.open(levels_[i].spool_name, std::ios::binary | std::ios::out);
+      if (levels_[i].spool.fail())
+      {
+        std::cerr << "Error: cannot open " << levels_[i].spool_name << " for writing." << std::endl;
+        return;
       }
+    }
 
-      Eigen::Vector3d p = source;  // our moving variable as we walk over the grid
-      Eigen::Vector3i inds = p.cast<int>();
-      double depth = 0;
-      // walk over the grid, one voxel at a time.
-      do
+    tif_ = XTIFFOpen(file_name.c_str(), "w");
+    if (!tif_)
+    {
+      std::cerr << "Error: cannot open " << file_name << " for writing." << std::endl;
+      return;
+    }
+    gtif_ = GTIFNew(tif_);
+    setFields(levels_[0], false);
+    if (!gtif_ || !setGeoTiffKeys(tif_, gtif_, pixel_width, projection_file, origin_x, origin_y))
+    {
+      close();
+    }
+  }
+  ~GeoTiffTileWriter() override
+  {
+    close();
+    removeSpools();
+  }
+  bool good() const override { return tif_ != nullptr; }
+  bool addRow(const float *row) override
+  {
+    // the alpha channel punches through the pixels without colour, as in writeGeoTiffFloat
+    Level &level = levels_[0];
+    float *rgba = &level.rows[4 * static_cast<size_t>(level.width) * (level.num_rows % tile_size_)];
+    for (int x = 0; x < level.width; x++)
+    {
+      const float shade = (row[3 * x + 0] + row[3 * x + 1] + row[3 * x + 2]) / 3.0f;
+      rgba[4 * x + 0] = row[3 * x + 0];
+      rgba[4 * x + 1] = row[3 * x + 1];
+      rgba[4 * x + 2] = row[3 * x + 2];
+      rgba[4 * x + 3] = shade == 0.0f ? 0.0f : 255.0f;
+    }
+    if (!addLevelRow(level) || !addOverviewRow(1, rgba))
+    {
+      close();
+      return false;
+    }
+    return true;
+  }
+  bool end() override
+  {
+    if (!tif_)
+    {
+      return false;
+    }
+    // an unpaired last row is averaged on its own
+    for (size_t i = 1; i < levels_.size(); i++)
+    {
+      if (levels_[i].has_pending && !addOverviewRow(i, nullptr))
       {
-        double ls[3] = { (round(p[0] + offsets[0]) - p[0]) / dir[0], (round(p[1] + offsets[1]) - p[1]) / dir[1],
-                         (round(p[2] + offsets[2]) - p[2]) / dir[2] };
-        int axis = (ls[0] < ls[1] && ls[0] < ls[2]) ? 0 : (ls[1] < ls[2] ? 1 : 2);
-        inds[axis] += adds[axis];
-        if (inds[axis] < 0 || inds[axis] >= voxel_dims_[axis])
-        {
-          break;
-        }
-        double minL = ls[axis] * length;
-        depth += minL + eps;
-        p = source + dir * (depth / length);
-        int index = getIndex(inds);
-        if (depth > maxDist)
-        {
-          double length_in_voxel = minL + maxDist - depth;
-          if (colours[i].alpha > 0)
-          {
-            voxels_[index].addHitRay(static_cast<float>(length_in_voxel * voxel_width_));
-          }
-          else
-          {
-            voxels_[index].addMissRay(static_cast<float>(length_in_voxel * voxel_width_));
-          }
-        }
-        else
-        {
-          voxels_[index].addMissRay(static_cast<float>(minL * voxel_width_));
-        }
-      } while (depth <= maxDist);
+        close();
+        return false;
+      }
+    }
+    bool success = TIFFWriteDirectory(tif_) != 0;
+    for (size_t i = 1; i < levels_.size() && success; i++)
+    {
+      Level &level = levels_[i];
+      level.spool.close();
+      std::ifstream spool(level.spool_name, std::ios::binary | std::ios::in);
+      setFields(level, true);
+      const std::streamsize row_bytes = 4 * static_cast<std::streamsize>(level.width) * sizeof(float);
+      level.num_rows = 0;
+      for (int y = 0; y < level.height && success; y++)
+      {
+        float *rgba = &level.rows[4 * static_cast<size_t>(level.width) * (level.num_rows % tile_size_)];
+        spool.read(reinterpret_cast<char *>(rgba), row_bytes);
+        success = spool.good() && addLevelRow(level);
+      }
+      success = success && TIFFWriteDirectory(tif_) != 0;
+    }
+    close();
+    removeSpools();
+    if (!success)
+    {
+      std::cerr << "Error: failed to write the tiled tif image" << std::endl;
     }
+    return success;
+  }
+
+private:
+  /// one resolution of the image, each of whose pixels are 4 floats (red, green, blue, alpha)
+  struct Level
+  {
+    int width = 0;
+    int height = 0;
+    std::vector<float> rows;     // the current row of tiles
+    int num_rows = 0;            // the number of rows added
+    std::vector<float> pending;  // a row of the resolution above, waiting for the row below it
+    bool has_pending = false;
+    std::string spool_name;
+    std::ofstream spool;
   };
-  Cloud::read(file_name, calculate);
-}
 
-// This is a form of windowed average over the Moore neighbourhood (3x3x3) window.
-void DensityGrid::addNeighbourPriors()
-{
-#if DENSITY_MIN_RAYS > 0
-  const int X = 1;
-  const int Y = voxel_dims_[0];
-  const int Z = voxel_dims_[0] * voxel_dims_[1];
-  DensityGrid::Voxel neighbours;
-  double num_hit_points = 0.0;
-  double num_hit_points_unsatisfied = 0.0;
+  void setFields(const Level &level, bool reduced)
+  {
+    TIFFSetField(tif_, TIFFTAG_SUBFILETYPE, reduced ? FILETYPE_REDUCEDIMAGE : 0);
+    TIFFSetField(tif_, TIFFTAG_IMAGEWIDTH, static_cast<uint32_t>(level.width));
+    TIFFSetField(tif_, TIFFTAG_IMAGELENGTH, static_cast<uint32_t>(level.height));
+    TIFFSetField(tif_, TIFFTAG_TILEWIDTH, static_cast<uint32_t>(tile_size_));
+    TIFFSetField(tif_, TIFFTAG_TILELENGTH, static_cast<uint32_t>(tile_size_));
+    TIFFSetField(tif_, TIFFTAG_BITSPERSAMPLE, 32);
+    TIFFSetField(tif_, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
+    TIFFSetField(tif_, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+    TIFFSetField(tif_, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_IEEEFP);
+    TIFFSetField(tif_, TIFFTAG_FILLORDER, FILLORDER_MSB2LSB);
+    TIFFSetField(tif_, TIFFTAG_SAMPLESPERPIXEL, 4);
+    const uint16_t ex_samp[] = { EXTRASAMPLE_ASSOCALPHA };
+    TIFFSetField(tif_, TIFFTAG_EXTRASAMPLES, 1, &ex_samp);
+    TIFFSetField(tif_, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+  }
 
-  // This simple 3x3x3 convolution needs to be a bit sneaky to avoid having to double the memory cost.
-  // well, not that sneaky, we just shift the output -1,-1,-1 for each cell
-  for (int x = 1; x < voxel_dims_[0] - 1; x++)
-  {
-    for (int y = 1; y < voxel_dims_[1] - 1; y++)
-    {
-      for (int z = 1; z < voxel_dims_[2] - 1; z++)
-      {
-        const int ind = getIndex(Eigen::Vector3i(x, y, z));
-        if (voxels_[ind].numHits() > 0)
-          num_hit_points++;
-        float needed = DENSITY_MIN_RAYS - voxels_[ind].numRays();
-        const DensityGrid::Voxel corner_vox = voxels_[ind - X - Y - Z];
-        voxels_[ind - X - Y - Z] = voxels_[ind];  // move centre up to corner
-        DensityGrid::Voxel &voxel = voxels_[ind - X - Y - Z];
-        if (needed < 0.0)
-          continue;
-        neighbours = voxels_[ind - X];
-        neighbours += voxels_[ind + X];
-        neighbours += voxels_[ind - Y];
-        neighbours += voxels_[ind + Y];
-        neighbours += voxels_[ind - Z];
-        neighbours += voxels_[ind + Z];
-        if (neighbours.numRays() >= needed)
-        {
-          voxel += neighbours * (needed / neighbours.numRays());  // add minimal amount to reach DENSITY_MIN_RAYS
-          continue;
-        }
-        voxel += neighbours;
-        needed -= neighbours.numRays();
-
-        neighbours = voxels_[ind - X - Y];
-        neighbours += voxels_[ind - X + Y];
-        neighbours += voxels_[ind + X - Y];
-        neighbours += voxels_[ind + X + Y];
-
-        neighbours += voxels_[ind - X - Z];
-        neighbours += voxels_[ind - X + Z];
-        neighbours += voxels_[ind + X - Z];
-        neighbours += voxels_[ind + X + Z];
-
-        neighbours += voxels_[ind - Y - Z];
-        neighbours += voxels_[ind - Y + Z];
-        neighbours += voxels_[ind + Y - Z];
-        neighbours += voxels_[ind + Y + Z];
-        if (neighbours.numRays() >= needed)
-        {
-          voxel += neighbours * (needed / neighbours.numRays());  // add minimal amount to reach DENSITY_MIN_RAYS
-          continue;
-        }
-        voxel += neighbours;
-        needed -= neighbours.numRays();
-
-        neighbours = corner_vox;
-        neighbours += voxels_[ind - X - Y + Z];
-        neighbours += voxels_[ind - X + Y - Z];
-        neighbours += voxels_[ind + X - Y - Z];
-        neighbours += voxels_[ind - X + Y + Z];
-        neighbours += voxels_[ind + X - Y + Z];
-        neighbours += voxels_[ind + X + Y - Z];
-        neighbours += voxels_[ind + X + Y + Z];
-        if (neighbours.numRays() >= needed)
+  /// count the row just placed in @c level.rows , writing the row of tiles once it is complete
+  bool addLevelRow(Level &level)
+  {
+    level.num_rows++;
+    const int rows = (level.num_rows - 1) % tile_size_ + 1;
+    if (rows < tile_size_ && level.num_rows < level.height)
+    {
+      return true;
+    }
+    const int tile_y = level.num_rows - rows;
+    for (int tile_x = 0; tile_x < level.width; tile_x += tile_size_)
+    {
+      const int columns = std::min(tile_size_, level.width - tile_x);
+      std::fill(tile_.begin(), tile_.end(), 0.0f);
+      for (int y = 0; y < rows; y++)
+      {
+        const float *source = &level.rows[4 * (static_cast<size_t>(level.width) * y + tile_x)];
+        std::copy(source, source + 4 * columns, &tile_[4 * static_cast<size_t>(tile_size_) * y]);
+      }
+      if (TIFFWriteTile(tif_, tile_.data(), static_cast<uint32_t>(tile_x), static_cast<uint32_t>(tile_y), 0, 0) < 0)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /// add a row of the resolution above overview @c index . Each pair of rows is averaged into a row of the overview,
+  /// which is spooled and added to the overview below. A null @c row averages the pending row on its own
+  bool addOverviewRow(size_t index, const float *row)
+  {
+    if (index >= levels_.size())
+    {
+      return true;
+    }
+    Level &level = levels_[index];
+    const int source_width = levels_[index - 1].width;
+    if (row && !level.has_pending)
+    {
+      level.pending.assign(row, row + 4 * static_cast<size_t>(source_width));
+      level.has_pending = true;
+      return true;
+    }
+    level.has_pending = false;
+    std::vector<float> averaged(4 * static_cast<size_t>(level.width), 0.0f);
+    for (int x = 0; x < level.width; x++)
+    {
+      // the mean colour of the coloured pixels of the 2x2 block
+      double colour[3] = { 0.0, 0.0, 0.0 };
+      int count = 0;
+      for (int i = 0; i < 2; i++)
+      {
+        const float *source = i == 0 ? level.pending.data() : row;
+        for (int xx = 2 * x; xx < std::min(2 * x + 2, source_width) && source; xx++)
         {
-          voxel += neighbours * (needed / neighbours.numRays());  // add minimal amount to reach DENSITY_MIN_RAYS
-          continue;
+          if (source[4 * xx + 3] > 0.0f)
+          {
+            for (int c = 0; c < 3; c++) colour[c] += source[4 * xx + c];
+            count++;
+          }
         }
-        voxel += neighbours;
-        if (voxels_[ind].numHits() > 0)
-          num_hit_points_unsatisfied++;
+      }
+      if (count > 0)
+      {
+        for (int c = 0; c < 3; c++) averaged[4 * x + c] = static_cast<float>(colour[c] / count);
+        averaged[4 * x + 3] = 255.0f;
       }
     }
+    level.spool.write(reinterpret_cast<const char *>(averaged.data()), averaged.size() * sizeof(float));
+    return level.spool.good() && addOverviewRow(index + 1, averaged.data());
   }
-  const double percentage = 100.0 * num_hit_points_unsatisfied / num_hit_points;
-  std::cout << "Density calculation: " << percentage << "% of voxels had insufficient (<" << DENSITY_MIN_RAYS
-            << ") rays within them" << std::endl;
-  if (percentage > 50.0)
+
+  void close()
   {
-    std::cout << "This is high. Consider using a larger pixel size, or a denser cloud, or reducing DENSITY_MIN_RAYS, "
-                 "for consistent results"
-              << std::endl;
+    if (gtif_)
+    {
+      GTIFFree(gtif_);
+      gtif_ = nullptr;
+    }
+    if (tif_)
+    {
+      XTIFFClose(tif_);
+      tif_ = nullptr;
+    }
   }
-  else if (percentage < 1.0)
+  void removeSpools()
   {
-    std::cout << "This is low enough that you could get more fidelity from using a smaller pixel size" << std::endl;
-    std::cout << "or more accuracy by increasing DENSITY_MIN_RAYS" << std::endl;
+    for (size_t i = 1; i < levels_.size(); i++)
+    {
+      if (levels_[i].spool.is_open())
+      {
+        levels_[i].spool.close();
+      }
+      std::remove(levels_[i].spool_name.c_str());
+    }
   }
-#endif
-}
 
-bool renderCloud(const std::string &cloud_file, const Cuboid &bounds, ViewDirection view_direction, RenderStyle style,
-                 double pix_width, const std::string &image_file, const std::string &projection_file, bool mark_origin,
-                 const std::string *const transform_file)
+  TIFF *tif_ = nullptr;
+  GTIF *gtif_ = nullptr;
+  int tile_size_;
+  std::vector<Level> levels_;
+  std::vector<float> tile_;
+};
+#endif  // RAYLIB_WITH_TIFF
+
+/// The image axes and size of a view of @c bounds with pixels of @c pix_width
+struct ViewGeometry
 {
-  // convert the view direction into useable parameters
-  int axis = 0;
-  if (view_direction == ViewDirection::Top)
-    axis = 2;
-  else if (view_direction == ViewDirection::Front || view_direction == ViewDirection::Back)
-    axis = 1;
-  double dir = 1;
-  if (view_direction == ViewDirection::Left || view_direction == ViewDirection::Front)
-    dir = -1;
-  const bool flip_x = view_direction == ViewDirection::Left || view_direction == ViewDirection::Back;
-
-  // pull out the main image axes (ax1,ax2 are the horiz,vertical axes)
-  const Eigen::Vector3d extent = bounds.max_bound_ - bounds.min_bound_;
-  // for each view axis (side,top,front = 0,1,2) we need to have an image x axis, and y axis.
-  // e.g. x_axes[axis] is the 3D axis to use (x,y,z = 0,1,2) for the image horizontal direction
-  const std::array<int, 3> x_axes = { 1, 0, 0 };
-  const std::array<int, 3> y_axes = { 2, 2, 1 };
-  const int ax1 = x_axes[axis];
-  const int ax2 = y_axes[axis];
-  const int width = 1 + static_cast<int>(extent[ax1] / pix_width);
-  const int height = 1 + static_cast<int>(extent[ax2] / pix_width);
-  const int depth = 1 + static_cast<int>(extent[axis] / pix_width);
-  std::cout << "outputting " << width << "x" << height << " image" << std::endl;
+  ViewGeometry(const Cuboid &bounds, ViewDirection view_direction, double pix_width)
+  {
+    // convert the view direction into useable parameters
+    axis = 0;
+    if (view_direction == ViewDirection::Top)
+      axis = 2;
+    else if (view_direction == ViewDirection::Front || view_direction == ViewDirection::Back)
+      axis = 1;
+    dir = 1;
+    if (view_direction == ViewDirection::Left || view_direction == ViewDirection::Front)
+      dir = -1;
+    flip_x = view_direction == ViewDirection::Left || view_direction == ViewDirection::Back;
 
-  try  // there is a possibility of running out of memory here. So provide a helpful message rather than just asserting
+    // pull out the main image axes (ax1,ax2 are the horiz,vertical axes)
+    const Eigen::Vector3d extent = bounds.max_bound_ - bounds.min_bound_;
+    // for each view axis (side,top,front = 0,1,2) we need to have an image x axis, and y axis.
+    // e.g. x_axes[axis] is the 3D axis to use (x,y,z = 0,1,2) for the image horizontal direction
+    const std::array<int, 3> x_axes = { 1, 0, 0 };
+    const std::array<int, 3> y_axes = { 2, 2, 1 };
+    ax1 = x_axes[axis];
+    ax2 = y_axes[axis];
+    width = 1 + static_cast<int>(extent[ax1] / pix_width);
+    height = 1 + static_cast<int>(extent[ax2] / pix_width);
+    depth = 1 + static_cast<int>(extent[axis] / pix_width);
+  }
+  int axis;      // the 3D axis that is viewed along
+  int ax1, ax2;  // the 3D axes of the image's horizontal and vertical axes
+  double dir;    // the sign of the view direction along the axis
+  bool flip_x;   // whether the image is flipped horizontally
+  int width, height, depth;
+};
+
+/// Accumulates the rays of a ray cloud a chunk at a time into the pixels of an image strip, for the styles other than
+/// the density styles. Each chunk's rays are first sorted into the bands of rows that they touch, then the bands are
+/// rendered in parallel. Each band takes its rays in file order, so the image matches rendering the rays one by one
+class BandRenderer
+{
+public:
+  BandRenderer(const Cuboid &bounds, const ViewGeometry &view, RenderStyle style, double pix_width,
+               PixelBands &pixels)
+    : bounds_(bounds)
+    , view_(view)
+    , style_(style)
+    , pix_width_(pix_width)
+    , pixels_(pixels)
+    , draw_rays_(style == RenderStyle::Rays)
+    , band_rays_(pixels.numBands())
+  {}
+
+  /// Render a chunk of rays into the strip
+  void addRays(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+               const std::vector<RGBA> &colours);
+
+private:
+  Cuboid bounds_;
+  ViewGeometry view_;
+  RenderStyle style_;
+  double pix_width_;
+  PixelBands &pixels_;
+  bool draw_rays_;
+  std::vector<std::vector<size_t>> band_rays_;
+  // the rays of a chunk clipped to within the image (since we exclude unbounded rays from the image bounds)
+  std::vector<Eigen::Vector3d> clipped_starts_, clipped_ends_;
+  std::vector<double> near_, far_;
+};
+
+void BandRenderer::addRays(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+                           const std::vector<RGBA> &colours)
+{
+  const int first_row = pixels_.firstRow();
+  const int last_row = pixels_.endRow() - 1;
+  for (auto &rays : band_rays_) rays.clear();
+  if (draw_rays_)
   {
-    // accumulated colour buffer
-    std::vector<Eigen::Vector4d> pixels(width * height);
-    std::fill(pixels.begin(), pixels.end(), Eigen::Vector4d(0, 0, 0, 0));
-    // density calculation is a special case
-    if (style == RenderStyle::Density || style == RenderStyle::Density_rgb)
+    // the chunk is clipped once, a packet of rays at a time, for both the banding and the drawing
+    clipped_starts_ = starts;
+    clipped_ends_ = ends;
+    near_.resize(ends.size());
+    far_.resize(ends.size());
+    bounds_.clipRays(starts.data(), ends.data(), ends.size(), near_.data(), far_.data());
+    for (size_t i = 0; i < ends.size(); i++)
+      Cuboid::clipToRange(near_[i], far_[i], clipped_starts_[i], clipped_ends_[i]);
+  }
+  for (size_t i = 0; i < ends.size(); i++)
+  {
+    if (colours[i].alpha == 0)
+      continue;
+    if (draw_rays_)
     {
-      Eigen::Vector3i dims = (extent / pix_width).cast<int>() + Eigen::Vector3i(1, 1, 1);
-#if DENSITY_MIN_RAYS > 0
-      dims += Eigen::Vector3i(1, 1, 1);  // so that we have extra space to convolve
-#endif
-      Cuboid grid_bounds = bounds;
-      grid_bounds.min_bound_ -= Eigen::Vector3d(pix_width, pix_width, pix_width);
-      DensityGrid grid(grid_bounds, pix_width, dims);
+      const Eigen::Vector3d &cloud_start = clipped_starts_[i];
+      const Eigen::Vector3d &cloud_end = clipped_ends_[i];
+      const int y_start = static_cast<int>((cloud_start[view_.ax2] - bounds_.min_bound_[view_.ax2]) / pix_width_);
+      const int y_end = static_cast<int>((cloud_end[view_.ax2] - bounds_.min_bound_[view_.ax2]) / pix_width_);
+      // the line's midpoint heights can be a row beyond its ends
+      const int row_min = std::max(first_row, std::min(y_start, y_end) - 1);
+      const int row_max = std::min(last_row, std::max(y_start, y_end) + 1);
+      if (row_min > row_max)
+        continue;  // the ray is in another strip
+      for (int b = pixels_.band(row_min); b <= pixels_.band(row_max); b++) band_rays_[b].push_back(i);
+    }
+    else
+    {
+      const Eigen::Vector3d &point = style_ == RenderStyle::Starts ? starts[i] : ends[i];
+      const int y = static_cast<int>((point[view_.ax2] - bounds_.min_bound_[view_.ax2]) / pix_width_);
+      if (y < first_row || y > last_row)
+        continue;
+      band_rays_[pixels_.band(y)].push_back(i);
+    }
+  }
 
-      grid.calculateDensities(cloud_file);
+  parallelFor(0, pixels_.numBands(), [&](int band) {
+    const int row_begin = pixels_.bandBegin(band);
+    const int row_end = pixels_.bandEnd(band);
+    for (const size_t i : band_rays_[band])
+    {
+      const RGBA &colour = colours[i];
+      const Eigen::Vector3f col = Eigen::Vector3f(colour.red, colour.green, colour.blue) / 255.0f;
+      const Eigen::Vector4f col4(col[0], col[1], col[2], 1.0f);
+      if (draw_rays_)
+      {
+        const Eigen::Vector3d &cloud_start = clipped_starts_[i];
+        const Eigen::Vector3d &cloud_end = clipped_ends_[i];
+        Eigen::Vector3d start = (cloud_start - bounds_.min_bound_) / pix_width_;
+        Eigen::Vector3d end = (cloud_end - bounds_.min_bound_) / pix_width_;
+        const Eigen::Vector3d ray_dir = cloud_end - cloud_start;
 
-      grid.addNeighbourPriors();
+        // fast approximate 2D line rendering requires picking the long axis to iterate along
+        const bool x_long = std::abs(ray_dir[view_.ax1]) > std::abs(ray_dir[view_.ax2]);
+        const int axis_long = x_long ? view_.ax1 : view_.ax2;
+        const int axis_short = x_long ? view_.ax2 : view_.ax1;
 
-      for (int x = 0; x < width; x++)
+        const double gradient = ray_dir[axis_long] == 0.0 ? 0.0 : ray_dir[axis_short] / ray_dir[axis_long];
+        if (ray_dir[axis_long] < 0.0)
+          std::swap(start, end);  // this lets us iterate from low up to high values
+        const int start_long = static_cast<int>(start[axis_long]);
+        int l_begin = start_long;
+        int l_end = static_cast<int>(end[axis_long]);
+        // place a pixel at the height of each midpoint (of the pixel) in the long axis
+        const double start_mid_point = 0.5 + static_cast<double>(start_long);
+        const double start_height = start[axis_short] + (start_mid_point - start[axis_long]) * gradient;
+        // only iterate over the part of the line that is within this band's rows
+        if (!x_long)
+        {
+          l_begin = std::max(l_begin, row_begin);
+          l_end = std::min(l_end, row_end - 1);
+        }
+        else if (gradient != 0.0)
+        {
+          const double l0 = start_long + (row_begin - start_height) / gradient;
+          const double l1 = start_long + (row_end - start_height) / gradient;
+          l_begin = std::max(l_begin, static_cast<int>(std::floor(std::min(l0, l1))) - 1);
+          l_end = std::min(l_end, static_cast<int>(std::ceil(std::max(l0, l1))) + 1);
+        }
+        for (int l = l_begin; l <= l_end; l++)
+        {
+          const int s = static_cast<int>(start_height + static_cast<double>(l - start_long) * gradient);
+          const int x = x_long ? l : s;
+          const int y = x_long ? s : l;
+          if (y >= row_begin && y < row_end)
+            pixels_(x, y) += col4;
+        }
+        continue;
+      }
+      const Eigen::Vector3d point = style_ == RenderStyle::Starts ? starts[i] : ends[i];
+      const Eigen::Vector3d pos = (point - bounds_.min_bound_) / pix_width_;
+      const Eigen::Vector3i p = (pos).cast<int>();
+      // using 4 dimensions helps us to accumulate colours in a greater variety of ways
+      Eigen::Vector4f &pix = pixels_(p[view_.ax1], p[view_.ax2]);
+      switch (style_)  // render the image according to the chosen style
+      {
+      case RenderStyle::Ends:
+      case RenderStyle::Starts:
+      case RenderStyle::Height:
       {
-        for (int y = 0; y < height; y++)
+        const float depth_pos = static_cast<float>(pos[view_.axis]);
+        if (depth_pos * view_.dir > pix[3] * view_.dir || pix[3] == 0.0f)  // using 0.0 precisely as a flag here
         {
-          double total_density = 0.0;
-          for (int z = 0; z < depth; z++)
-          {
-            Eigen::Vector3i ind;
-            ind[axis] = z;
-            ind[ax1] = x;
-            ind[ax2] = y;
-            total_density += grid.voxels()[grid.getIndex(ind)].density();
-          }
-          pixels[x + width * y] = Eigen::Vector4d(total_density, total_density, total_density, total_density);
+          pix = Eigen::Vector4f(col[0], col[1], col[2], depth_pos);
         }
+        break;
+      }
+      case RenderStyle::Mean:
+      case RenderStyle::Sum:
+        pix += col4;
+        break;
+      default:
+        break;
       }
     }
-    else  // otherwise we use a common algorithm, specialising on render style only per-ray
+  });
+}
+
+/// Fill @c pixels with the densities of @c grid summed along the view axis
+void renderDensities(const DensityGrid &grid, const ViewGeometry &view, PixelBands &pixels)
+{
+  const int width = view.width;
+  const int height = view.height;
+  // sum the densities along the view axis. The stored voxels are visited in increasing order along each axis, so
+  // a sparse grid only visits its allocated bricks, and sums in the same order as a dense grid
+  std::vector<double> total_densities(static_cast<size_t>(width) * height, 0.0);
+  grid.forEachVoxel([&](const Eigen::Vector3i &ind, const DensityGrid::Voxel &voxel) {
+    if (ind[view.ax1] < width && ind[view.ax2] < height && ind[view.axis] < view.depth)
+      total_densities[ind[view.ax1] + static_cast<size_t>(width) * ind[view.ax2]] += voxel.density();
+  });
+  for (int x = 0; x < width; x++)
+  {
+    for (int y = 0; y < height; y++)
     {
-      // this lambda expression lets us chunk load the ray cloud file, so we don't run out of RAM
-      auto render = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends, std::vector<double> &,
-                        std::vector<RGBA> &colours) {
-        for (size_t i = 0; i < ends.size(); i++)
-        {
-          const RGBA &colour = colours[i];
-          if (colour.alpha == 0)
-            continue;
-          const Eigen::Vector3d col = Eigen::Vector3d(colour.red, colour.green, colour.blue) / 255.0;
-          const Eigen::Vector3d point = style == RenderStyle::Starts ? starts[i] : ends[i];
-          const Eigen::Vector3d pos = (point - bounds.min_bound_) / pix_width;
-          const Eigen::Vector3i p = (pos).cast<int>();
-          const int x = p[ax1], y = p[ax2];
-          // using 4 dimensions helps us to accumulate colours in a greater variety of ways
-          Eigen::Vector4d &pix = pixels[x + width * y];
-          switch (style)  // render the image according to the chosen style
-          {
-          case RenderStyle::Ends:
-          case RenderStyle::Starts:
-          case RenderStyle::Height:
-            if (pos[axis] * dir > pix[3] * dir || pix[3] == 0.0)  // using 0.0 precisely as a flag here
-            {
-              pix = Eigen::Vector4d(col[0], col[1], col[2], pos[axis]);
-            }
-            break;
-          case RenderStyle::Mean:
-            pix += Eigen::Vector4d(col[0], col[1], col[2], 1.0);
-            break;
-          case RenderStyle::Sum:
-            pix += Eigen::Vector4d(col[0], col[1], col[2], 1.0);
-            break;
-          case RenderStyle::Rays:
-          {
-            Eigen::Vector3d cloud_start = starts[i];
-            Eigen::Vector3d cloud_end = ends[i];
-            // clip to within the image (since we exclude unbounded rays from the image bounds)
-            bounds.clipRay(cloud_start, cloud_end);
-            Eigen::Vector3d start = (cloud_start - bounds.min_bound_) / pix_width;
-            Eigen::Vector3d end = (cloud_end - bounds.min_bound_) / pix_width;
-            const Eigen::Vector3d dir = cloud_end - cloud_start;
-
-            // fast approximate 2D line rendering requires picking the long axis to iterate along
-            const bool x_long = std::abs(dir[ax1]) > std::abs(dir[ax2]);
-            const int axis_long = x_long ? ax1 : ax2;
-            const int axis_short = x_long ? ax2 : ax1;
-            const int width_long = x_long ? 1 : width;
-            const int width_short = x_long ? width : 1;
-
-            const double gradient = dir[axis_short] / dir[axis_long];
-            if (dir[axis_long] < 0.0)
-              std::swap(start, end);  // this lets us iterate from low up to high values
-            const int start_long = static_cast<int>(start[axis_long]);
-            const int end_long = static_cast<int>(end[axis_long]);
-            // place a pixel at the height of each midpoint (of the pixel) in the long axis
-            const double start_mid_point = 0.5 + static_cast<double>(start_long);
-            double height = start[axis_short] + (start_mid_point - start[axis_long]) * gradient;
-            for (int l = start_long; l <= end_long; l++, height += gradient)
-            {
-              const int s = static_cast<int>(height);
-              pixels[width_long * l + width_short * s] += Eigen::Vector4d(col[0], col[1], col[2], 1.0);
-            }
-            break;
-          }
-          default:
-            break;
-          }
-        }
-      };
-      if (!Cloud::read(cloud_file, render))
-        return false;
+      const float density = static_cast<float>(total_densities[x + static_cast<size_t>(width) * y]);
+      pixels(x, y) = Eigen::Vector4f(density, density, density, density);
     }
+  }
+}
+
+/// Accumulates the rows of @c pixels from the image rows @c pixels.firstRow() up to @c pixels.endRow()
+using StripRenderer = std::function<bool(PixelBands &pixels)>;
+
+/// Convert the pixels accumulated by @c render_strip into the colours of @c style , and write them to
+/// @c image_file , with the origin mark and the transform file of @c renderCloud . A positive @c tile_size renders and
+/// writes the image in strips of that many rows, otherwise @c render_strip is called once for the whole image
+bool writeRender(const StripRenderer &render_strip, const Cuboid &bounds, const ViewGeometry &view,
+                 RenderStyle style, double pix_width, const std::string &image_file,
+                 const std::string &projection_file, bool mark_origin, const std::string *const transform_file,
+                 int tile_size)
+{
+  const int ax1 = view.ax1, ax2 = view.ax2;
+  const double dir = view.dir;
+  const bool flip_x = view.flip_x;
+  const int width = view.width, height = view.height;
+  std::cout << "outputting " << width << "x" << height << " image" << std::endl;
+
+  const std::string image_ext = getFileNameExtension(image_file);
+  const bool is_hdr = image_ext == "hdr" || image_ext == "tif";
+  // a tiled render is made one strip of tile_size rows at a time, from the top of the image down, so that only the
+  // strip's pixels are accumulated at once. Otherwise the whole image is a single strip
+  const bool tiled = tile_size > 0;
+  const int strip_rows = tiled ? std::min(tile_size, height) : height;
+  const int num_strips = (height + strip_rows - 1) / strip_rows;
 
+  try  // there is a possibility of running out of memory here. So provide a helpful message rather than just asserting
+  {
     double max_val = 1.0;
     double min_val = 0.0;
-    const std::string image_ext = getFileNameExtension(image_file);
-    const bool is_hdr = image_ext == "hdr" || image_ext == "tif";
-    if (!is_hdr)  // limited range, so work out a sensible maximum value, I'm using mean + two standard deviations:
+    if (!is_hdr && tiled && (style == RenderStyle::Height || style == RenderStyle::Sum))
     {
+      // the colour range is that of the whole image, so it is found in a first pass over the strips
       double sum = 0.0;
-      double num = 0.0;
-      for (auto &pixel : pixels)
-      {
-        sum += pixel[3];
-        if (pixel[3] > 0.0)
-          num++;
-      }
-      double mean = sum / num;
       double sum_sqr = 0.0;
-      for (auto &pixel : pixels)
+      double num = 0.0;
+      for (int strip = 0; strip < num_strips; strip++)
       {
-        if (pixel[3] > 0.0)
-          sum_sqr += sqr(pixel[3] - mean);
+        const int row_end = height - strip * strip_rows;
+        const int row_begin = std::max(0, row_end - strip_rows);
+        PixelBands pixels(width, row_end - row_begin, row_begin);
+        if (!render_strip(pixels))
+          return false;
+        pixels.forEach([&](const Eigen::Vector4f &pixel) {
+          if (pixel[3] > 0.0f)
+          {
+            sum += pixel[3];
+            sum_sqr += sqr(pixel[3]);
+            num++;
+          }
+        });
       }
-      const double standard_deviation = std::sqrt(sum_sqr / num);
+      const double mean = sum / num;
+      const double standard_deviation = std::sqrt(std::max(0.0, sum_sqr / num - sqr(mean)));
       max_val = mean + 2.0 * standard_deviation;
       min_val = mean - 2.0 * standard_deviation;
     }
 
-    // The final pixel buffer
+    // The final pixel buffer. A tiled hdr image only holds the current strip, whose rows are written as they complete
     std::vector<RGBA> pixel_colours;
     std::vector<float> float_pixel_colours;
     if (is_hdr)
-      float_pixel_colours.resize(3 * width * height);
+      float_pixel_colours.resize(3 * width * strip_rows);
     else
       pixel_colours.resize(width * height);
+    std::unique_ptr<ImageRowWriter> row_writer;
+    if (tiled && is_hdr)
+    {
+      std::cout << "outputting image: " << image_file << std::endl;
+      if (image_ext == "hdr")
+        row_writer.reset(new HdrRowWriter(image_file, width, height));
+#if RAYLIB_WITH_TIFF
+      else
+      {
+        // obtain the origin offsets
+        const double x = bounds.min_bound_[ax1], y = bounds.min_bound_[ax2] + static_cast<double>(height) * pix_width;
+        row_writer.reset(
+          new GeoTiffTileWriter(image_file, width, height, tile_size, pix_width, projection_file, x, y));
+      }
+#endif
+      if (!row_writer->good())
+        return false;
+    }
 
-    for (int x = 0; x < width; x++)
+    for (int strip = 0; strip < num_strips; strip++)
     {
-      const int indx = flip_x ? width - 1 - x : x;  // possible horizontal flip, depending on view direction
-      for (int y = 0; y < height; y++)
+      const int row_end = height - strip * strip_rows;
+      const int row_begin = std::max(0, row_end - strip_rows);
+      if (tiled)
+        std::cout << "rendering strip " << strip + 1 << " of " << num_strips << std::endl;
+      PixelBands pixels(width, row_end - row_begin, row_begin);
+      if (!render_strip(pixels))
+        return false;
+
+      // limited range, so work out a sensible maximum value, I'm using mean + two standard deviations:
+      if (!is_hdr && !tiled)
       {
-        const Eigen::Vector4d colour = pixels[x + width * y];
-        Eigen::Vector3d col3d(colour[0], colour[1], colour[2]);
-        const uint8_t alpha = colour[3] == 0.0 ? 0 : 255;  // 'punch-through' alpha
-        switch (style)  // convert to the colour data structure based on the chosen style
-        {
-        case RenderStyle::Mean:
-        case RenderStyle::Rays:
-          col3d /= colour[3];  // simple mean
-          break;
-        case RenderStyle::Height:
-        {
-          double shade =
-            dir == 1.0 ? (colour[3] - min_val) / (max_val - min_val) : (colour[3] - max_val) / (min_val - max_val);
-          col3d = Eigen::Vector3d(shade, shade, shade);
-          break;
-        }
-        case RenderStyle::Sum:
-        case RenderStyle::Density:
-          col3d /= max_val;  // rescale to within limited colour range
-          break;
-        case RenderStyle::Density_rgb:
+        double sum = 0.0;
+        double num = 0.0;
+        pixels.forEach([&](const Eigen::Vector4f &pixel) {
+          sum += pixel[3];
+          if (pixel[3] > 0.0f)
+            num++;
+        });
+        double mean = sum / num;
+        double sum_sqr = 0.0;
+        pixels.forEach([&](const Eigen::Vector4f &pixel) {
+          if (pixel[3] > 0.0f)
+            sum_sqr += sqr(pixel[3] - mean);
+        });
+        const double standard_deviation = std::sqrt(sum_sqr / num);
+        max_val = mean + 2.0 * standard_deviation;
+        min_val = mean - 2.0 * standard_deviation;
+      }
+
+      const int float_first_row = row_writer ? row_begin : 0;
+      for (int x = 0; x < width; x++)
+      {
+        const int indx = flip_x ? width - 1 - x : x;  // possible horizontal flip, depending on view direction
+        for (int y = row_begin; y < row_end; y++)
         {
+          const Eigen::Vector4d colour = pixels(x, y).cast<double>();
+          Eigen::Vector3d col3d(colour[0], colour[1], colour[2]);
+          const uint8_t alpha = colour[3] == 0.0 ? 0 : 255;  // 'punch-through' alpha
+          switch (style)  // convert to the colour data structure based on the chosen style
+          {
+          case RenderStyle::Mean:
+          case RenderStyle::Rays:
+            col3d /= colour[3];  // simple mean
+            break;
+          case RenderStyle::Height:
+          {
+            double shade =
+              dir == 1.0 ? (colour[3] - min_val) / (max_val - min_val) : (colour[3] - max_val) / (min_val - max_val);
+            col3d = Eigen::Vector3d(shade, shade, shade);
+            break;
+          }
+          case RenderStyle::Sum:
+          case RenderStyle::Density:
+            col3d /= max_val;  // rescale to within limited colour range
+            break;
+          case RenderStyle::Density_rgb:
+          {
+            if (is_hdr)
+              col3d = colour[0] * redGreenBlueSpectrum(std::log10(std::max(1e-6, colour[0])));
+            else
+            {
+              double shade = colour[0] / max_val;
+              col3d = redGreenBlueGradient(shade);
+              if (shade < 0.05)
+                col3d *= 20.0 * shade;  // this blends the lowest densities down to black
+            }
+            break;
+          }
+          default:
+            break;
+          }
           if (is_hdr)
-            col3d = colour[0] * redGreenBlueSpectrum(std::log10(std::max(1e-6, colour[0])));
+          {
+            const int ind = indx + width * (y - float_first_row);
+            float_pixel_colours[3 * ind + 0] = (float)col3d[0];
+            float_pixel_colours[3 * ind + 1] = (float)col3d[1];
+            float_pixel_colours[3 * ind + 2] = (float)col3d[2];
+          }
           else
           {
-            double shade = colour[0] / max_val;
-            col3d = redGreenBlueGradient(shade);
-            if (shade < 0.05)
-              col3d *= 20.0 * shade;  // this blends the lowest densities down to black
+            const int ind = indx + width * y;
+            RGBA col;
+            col.red = uint8_t(std::max(0.0, std::min(255.0 * col3d[0], 255.0)));
+            col.green = uint8_t(std::max(0.0, std::min(255.0 * col3d[1], 255.0)));
+            col.blue = uint8_t(std::max(0.0, std::min(255.0 * col3d[2], 255.0)));
+            col.alpha = alpha;
+            pixel_colours[ind] = col;
           }
-          break;
-        }
-        default:
-          break;
-        }
-        const int ind = indx + width * y;
-        if (is_hdr)
-        {
-          float_pixel_colours[3 * ind + 0] = (float)col3d[0];
-          float_pixel_colours[3 * ind + 1] = (float)col3d[1];
-          float_pixel_colours[3 * ind + 2] = (float)col3d[2];
         }
-        else
+      }
+      if (row_writer)
+      {
+        for (int y = row_end - 1; y >= row_begin; y--)  // the image is written from its top row down
         {
-          RGBA col;
-          col.red = uint8_t(std::max(0.0, std::min(255.0 * col3d[0], 255.0)));
-          col.green = uint8_t(std::max(0.0, std::min(255.0 * col3d[1], 255.0)));
-          col.blue = uint8_t(std::max(0.0, std::min(255.0 * col3d[2], 255.0)));
-          col.alpha = alpha;
-          pixel_colours[ind] = col;
+          if (!row_writer->addRow(&float_pixel_colours[3 * width * (y - row_begin)]))
+            return false;
         }
       }
     }
@@ -729,36 +1690,44 @@ bool renderCloud(const std::string &cloud_file, const Cuboid &bounds, ViewDirect
       ofs << "]" << std::endl;
       ofs.close();
     }
-    std::cout << "outputting image: " << image_file << std::endl;
-
-    // write the image depending on the file format
-    const char *image_name = image_file.c_str();
-    stbi_flip_vertically_on_write(1);
-    if (image_ext == "png")
-      stbi_write_png(image_name, width, height, 4, (void *)&pixel_colours[0], 4 * width);
-    else if (image_ext == "bmp")
-      stbi_write_bmp(image_name, width, height, 4, (void *)&pixel_colours[0]);
-    else if (image_ext == "tga")
-      stbi_write_tga(image_name, width, height, 4, (void *)&pixel_colours[0]);
-    else if (image_ext == "jpg")
-      stbi_write_jpg(image_name, width, height, 4, (void *)&pixel_colours[0], 100);  // 100 is maximal quality
-    else if (image_ext == "hdr")
-      stbi_write_hdr(image_name, width, height, 3, &float_pixel_colours[0]);
-#if RAYLIB_WITH_TIFF
-    else if (image_ext == "tif")
+    if (row_writer)
     {
-      // obtain the origin offsets
-      const Eigen::Vector3d origin(0, 0, 0);
-      const Eigen::Vector3d pos = -(origin - bounds.min_bound_);
-      const double x = pos[ax1], y = pos[ax2] + static_cast<double>(height) * pix_width;
-      // generate the geotiff file
-      writeGeoTiffFloat(image_file, width, height, &float_pixel_colours[0], pix_width, false, projection_file, x, y);
+      if (!row_writer->end())
+        return false;
     }
-#endif
     else
     {
-      std::cerr << "Error: image format " << image_ext << " not supported" << std::endl;
-      return false;
+      std::cout << "outputting image: " << image_file << std::endl;
+
+      // write the image depending on the file format
+      const char *image_name = image_file.c_str();
+      stbi_flip_vertically_on_write(1);
+      if (image_ext == "png")
+        stbi_write_png(image_name, width, height, 4, (void *)&pixel_colours[0], 4 * width);
+      else if (image_ext == "bmp")
+        stbi_write_bmp(image_name, width, height, 4, (void *)&pixel_colours[0]);
+      else if (image_ext == "tga")
+        stbi_write_tga(image_name, width, height, 4, (void *)&pixel_colours[0]);
+      else if (image_ext == "jpg")
+        stbi_write_jpg(image_name, width, height, 4, (void *)&pixel_colours[0], 100);  // 100 is maximal quality
+      else if (image_ext == "hdr")
+        stbi_write_hdr(image_name, width, height, 3, &float_pixel_colours[0]);
+#if RAYLIB_WITH_TIFF
+      else if (image_ext == "tif")
+      {
+        // obtain the origin offsets
+        const Eigen::Vector3d origin(0, 0, 0);
+        const Eigen::Vector3d pos = -(origin - bounds.min_bound_);
+        const double x = pos[ax1], y = pos[ax2] + static_cast<double>(height) * pix_width;
+        // generate the geotiff file
+        writeGeoTiffFloat(image_file, width, height, &float_pixel_colours[0], pix_width, false, projection_file, x, y);
+      }
+#endif
+      else
+      {
+        std::cerr << "Error: image format " << image_ext << " not supported" << std::endl;
+        return false;
+      }
     }
   }
   catch (std::bad_alloc const &)  // catch any memory allocation problems in generating large images
@@ -772,4 +1741,236 @@ bool renderCloud(const std::string &cloud_file, const Cuboid &bounds, ViewDirect
   return true;
 }
 
+/// Render the rays from @c source , as @c renderCloud . The density styles use the densities saved beside
+/// @c cloud_file when it is given and they are of the same grid
+bool renderRays(const RaySource &source, const Cuboid &bounds, ViewDirection view_direction, RenderStyle style,
+                double pix_width, const std::string &image_file, const std::string &projection_file, bool mark_origin,
+                const std::string *const transform_file, int tile_size, const std::string &cloud_file)
+{
+  const ViewGeometry view(bounds, view_direction, pix_width);
+  const std::string image_ext = getFileNameExtension(image_file);
+  const bool tiled = tile_size > 0;
+  if (tiled)
+  {
+    if (style == RenderStyle::Density || style == RenderStyle::Density_rgb)
+    {
+      std::cerr << "Error: the density styles estimate the density over the whole cloud, so cannot be tiled"
+                << std::endl;
+      return false;
+    }
+    if (image_ext != "png" && image_ext != "bmp" && image_ext != "tga" && image_ext != "jpg" && image_ext != "hdr" &&
+        (image_ext != "tif" || !RAYLIB_WITH_TIFF))
+    {
+      std::cerr << "Error: image format " << image_ext << " not supported" << std::endl;
+      return false;
+    }
+    if (image_ext == "tif" && tile_size % 16 != 0)
+    {
+      std::cerr << "Error: the tiles of a tif image must be a multiple of 16 pixels wide" << std::endl;
+      return false;
+    }
+  }
+
+  // accumulate the rays into the rows of @c pixels , which are the whole image unless tiled
+  auto render_strip = [&](PixelBands &pixels) {
+    // density calculation is a special case
+    if (style == RenderStyle::Density || style == RenderStyle::Density_rgb)
+    {
+      Cuboid grid_bounds;
+      Eigen::Vector3i dims;
+      densityGridGeometry(bounds, pix_width, grid_bounds, dims);
+      DensityGrid grid(grid_bounds, pix_width, dims);
+
+      // densities saved beside the cloud for the same grid save walking the rays again
+      if (!cloud_file.empty() && grid.load(cloud_file))
+      {
+        std::cout << "using the saved densities " << densityFileName(cloud_file) << std::endl;
+      }
+      else
+      {
+        // rays passing through the grid contribute to its density, so every chunk is needed
+        DensityGrid::Filler filler(grid);
+        auto add_rays = [&filler](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                                  std::vector<double> &, std::vector<RGBA> &colours) {
+          filler.addRays(starts, ends, colours);
+        };
+        if (!source(nullptr, add_rays))
+          return false;
+      }
+      grid.addNeighbourPriors();
+      renderDensities(grid, view, pixels);
+      return true;
+    }
+    // otherwise we use a common algorithm, specialising on render style only per-ray
+    BandRenderer renderer(bounds, view, style, pix_width, pixels);
+    // this lambda expression lets us chunk load the ray cloud file, so we don't run out of RAM
+    auto render = [&renderer](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                              std::vector<double> &, std::vector<RGBA> &colours) {
+      renderer.addRays(starts, ends, colours);
+    };
+    // only the parts of the cloud that overlap the strip are read
+    Cuboid strip_bounds = bounds;
+    if (tiled)
+    {
+      strip_bounds.min_bound_[view.ax2] = bounds.min_bound_[view.ax2] + pixels.firstRow() * pix_width;
+      strip_bounds.max_bound_[view.ax2] =
+        std::min(bounds.max_bound_[view.ax2], bounds.min_bound_[view.ax2] + pixels.endRow() * pix_width);
+    }
+    return source(&strip_bounds, render);
+  };
+  return writeRender(render_strip, bounds, view, style, pix_width, image_file, projection_file, mark_origin,
+                     transform_file, tile_size);
+}
+
+/// Render each of @c views of the rays from @c source , as @c renderCloud , from a single pass over the rays
+bool renderViews(const RaySource &source, const Cuboid &bounds, const std::vector<RenderView> &views,
+                 double pix_width, const std::string &projection_file, bool mark_origin,
+                 const std::string *const transform_file, const std::string &cloud_file)
+{
+  std::vector<ViewGeometry> geometries;
+  std::vector<std::unique_ptr<PixelBands>> images(views.size());
+  std::vector<std::unique_ptr<BandRenderer>> renderers;
+  bool has_density = false;
+  try
+  {
+    for (size_t i = 0; i < views.size(); i++)
+    {
+      geometries.emplace_back(bounds, views[i].view_direction, pix_width);
+      images[i].reset(new PixelBands(geometries[i].width, geometries[i].height));
+      if (views[i].style == RenderStyle::Density || views[i].style == RenderStyle::Density_rgb)
+        has_density = true;
+      else
+        renderers.emplace_back(new BandRenderer(bounds, geometries[i], views[i].style, pix_width, *images[i]));
+    }
+
+    // the density grid is the same whichever the view, so it is calculated once for all of the density styles
+    std::unique_ptr<DensityGrid> grid;
+    bool add_densities = false;
+    if (has_density)
+    {
+      Cuboid grid_bounds;
+      Eigen::Vector3i dims;
+      densityGridGeometry(bounds, pix_width, grid_bounds, dims);
+      grid.reset(new DensityGrid(grid_bounds, pix_width, dims));
+      if (!cloud_file.empty() && grid->load(cloud_file))
+        std::cout << "using the saved densities " << densityFileName(cloud_file) << std::endl;
+      else
+        add_densities = true;
+    }
+    if (add_densities || !renderers.empty())
+    {
+      std::unique_ptr<DensityGrid::Filler> filler(add_densities ? new DensityGrid::Filler(*grid) : nullptr);
+      auto render = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                        std::vector<double> &, std::vector<RGBA> &colours) {
+        if (filler)
+          filler->addRays(starts, ends, colours);
+        for (auto &renderer : renderers) renderer->addRays(starts, ends, colours);
+      };
+      // rays passing through the density grid contribute to it, so every chunk is needed for the density styles
+      if (!source(add_densities ? nullptr : &bounds, render))
+        return false;
+    }
+    renderers.clear();
+    if (grid)
+    {
+      grid->addNeighbourPriors();
+      for (size_t i = 0; i < views.size(); i++)
+      {
+        if (views[i].style == RenderStyle::Density || views[i].style == RenderStyle::Density_rgb)
+          renderDensities(*grid, geometries[i], *images[i]);
+      }
+    }
+  }
+  catch (std::bad_alloc const &)
+  {
+    std::cout << "Not enough memory to render " << views.size() << " images at once." << std::endl;
+    std::cout << "The --pixel_width option can be used to reduce the resolution." << std::endl;
+    return false;
+  }
+
+  // every view's pixels are accumulated, so each image is written from its own pixels. The transform, which is that
+  // of the bounds, is written once
+  for (size_t i = 0; i < views.size(); i++)
+  {
+    auto take_pixels = [&](PixelBands &pixels) {
+      pixels = std::move(*images[i]);
+      return true;
+    };
+    if (!writeRender(take_pixels, bounds, geometries[i], views[i].style, pix_width, views[i].image_file,
+                     projection_file, mark_origin, i == 0 ? transform_file : nullptr, 0))
+      return false;
+    images[i].reset();
+  }
+  return true;
+}
+}  // namespace
+
+namespace
+{
+/// Whether a render in @c style is approximated well by a level of detail whose voxels are no wider than the pixels
+bool lodRenderable(RenderStyle style)
+{
+  // the top end points, heights and mean colours in each pixel
+  return style == RenderStyle::Ends || style == RenderStyle::Height || style == RenderStyle::Mean;
+}
+
+/// The source of the rays of @c cloud_file , or of its level of detail for pixels of @c pix_width when @c use_lod
+RaySource fileSource(const std::string &cloud_file, double pix_width, bool use_lod)
+{
+  std::string read_name = cloud_file;
+  std::vector<LodLevel> levels;
+  if (use_lod && readLod(cloud_file, levels))
+  {
+    const int level = coarsestLodLevel(levels, pix_width);
+    if (level >= 0)
+    {
+      read_name = lodLevelFileName(cloud_file, level);
+      std::cout << "rendering level " << level << " of the level of detail, " << levels[level].num_rays << " rays"
+                << std::endl;
+    }
+  }
+  return [read_name](const Cuboid *read_bounds,
+                     std::function<void(std::vector<Eigen::Vector3d> &, std::vector<Eigen::Vector3d> &,
+                                        std::vector<double> &, std::vector<RGBA> &)>
+                       apply) {
+    // rays outside the image bounds cannot contribute to it, so only the overlapping parts of the cloud are read
+    return read_bounds ? Cloud::read(read_name, apply, *read_bounds) : Cloud::read(read_name, apply);
+  };
+}
+}  // namespace
+
+bool renderCloud(const std::string &cloud_file, const Cuboid &bounds, ViewDirection view_direction, RenderStyle style,
+                 double pix_width, const std::string &image_file, const std::string &projection_file, bool mark_origin,
+                 const std::string *const transform_file, int tile_size)
+{
+  return renderRays(fileSource(cloud_file, pix_width, lodRenderable(style)), bounds, view_direction, style, pix_width,
+                    image_file, projection_file, mark_origin, transform_file, tile_size, cloud_file);
+}
+
+bool renderCloud(const std::string &cloud_file, const Cuboid &bounds, const std::vector<RenderView> &views,
+                 double pix_width, const std::string &projection_file, bool mark_origin,
+                 const std::string *const transform_file)
+{
+  bool use_lod = !views.empty();
+  for (const auto &view : views) use_lod = use_lod && lodRenderable(view.style);
+  return renderViews(fileSource(cloud_file, pix_width, use_lod), bounds, views, pix_width, projection_file,
+                     mark_origin, transform_file, cloud_file);
+}
+
+bool renderCloud(const Cloud &cloud, const Cuboid &bounds, ViewDirection view_direction, RenderStyle style,
+                 double pix_width, const std::string &image_file, const std::string &projection_file, bool mark_origin,
+                 const std::string *const transform_file)
+{
+  // the render only reads the rays, but shares its chunk function type with Cloud::read, which takes them non-const
+  Cloud &rays = const_cast<Cloud &>(cloud);
+  auto read_cloud = [&rays](const Cuboid *,
+                            std::function<void(std::vector<Eigen::Vector3d> &, std::vector<Eigen::Vector3d> &,
+                                               std::vector<double> &, std::vector<RGBA> &)>
+                              apply) {
+    apply(rays.starts, rays.ends, rays.times, rays.colours);
+    return true;
+  };
+  return renderRays(read_cloud, bounds, view_direction, style, pix_width, image_file, projection_file, mark_origin,
+                    transform_file, 0, "");
+}
 }  // namespace ray
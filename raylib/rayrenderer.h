@@ -10,8 +10,14 @@
 #include "raypose.h"
 #include "rayutils.h"
 
+#include <array>
+#include <memory>
+
 namespace ray
 {
+class Cloud;
+class GpuDensityGrid;
+
 /// Supported view directions on cloud data
 enum class RAYLIB_EXPORT ViewDirection
 {
@@ -35,10 +41,38 @@ enum class RAYLIB_EXPORT RenderStyle
   Density_rgb
 };
 
-/// Render a ray cloud according to the supplied parameters
+/// Render a ray cloud according to the supplied parameters. A positive @c tile_size renders the image in strips of
+/// @c tile_size rows from the top down, reading only the parts of the cloud that overlap each strip, which is fastest
+/// on a spatially sorted cloud. The hdr and tif images are then written as each strip completes, the tif as tiles of
+/// @c tile_size pixels (a multiple of 16) with internal overviews, so that memory is bounded by the strip. The other
+/// formats still hold the 8 bit image. The density styles cannot be tiled.
 bool RAYLIB_EXPORT renderCloud(const std::string &cloud_file, const Cuboid &bounds, ViewDirection view_direction,
                                RenderStyle style, double pix_width, const std::string &image_file,
                                const std::string &projection_file, bool mark_origin,
+                               const std::string *transform_file = nullptr, int tile_size = 0);
+
+/// As above, but rendering a ray cloud that is already in memory, such as a cloud kept resident to be rendered many
+/// times. The ends of the bounded rays of @c cloud must be within @c bounds
+bool RAYLIB_EXPORT renderCloud(const Cloud &cloud, const Cuboid &bounds, ViewDirection view_direction, RenderStyle style,
+                               double pix_width, const std::string &image_file, const std::string &projection_file,
+                               bool mark_origin, const std::string *transform_file = nullptr);
+
+/// One image of a multi-view render: a view direction and render style, and the image file to write it to
+struct RAYLIB_EXPORT RenderView
+{
+  ViewDirection view_direction;
+  RenderStyle style;
+  std::string image_file;
+};
+
+/// Render each of @c views of a ray cloud, as @c renderCloud above, from a single read of @c cloud_file rather than a
+/// read per view. The pixels of every view are accumulated at once, and the density styles of all views share one
+/// @c DensityGrid , so memory is that of all of the images and the grid together. The renders cannot be tiled. The
+/// level of detail is read in place of the cloud only when every style can use it. The transform file is that of the
+/// bounds, so is written once.
+bool RAYLIB_EXPORT renderCloud(const std::string &cloud_file, const Cuboid &bounds,
+                               const std::vector<RenderView> &views, double pix_width,
+                               const std::string &projection_file, bool mark_origin,
                                const std::string *transform_file = nullptr);
 
 /// This is used for estimating the per-voxel density of a ray cloud
@@ -46,18 +80,34 @@ bool RAYLIB_EXPORT renderCloud(const std::string &cloud_file, const Cuboid &boun
 /// It is most effective as a measure of leaf area per volume on vegetation, and is described in:
 /// Lowe, Thomas, et al. "Canopy Density Estimation in Perennial Horticulture Crops Using 3D Spinning LiDAR SLAM."
 /// arXiv preprint arXiv:2007.15652 (2020).
+///
+/// Grids of up to @c max_dense_voxels voxels are stored densely. Larger grids, such as fine resolutions over tall
+/// forests, are mostly empty air, so they are stored sparsely as bricks of @c brick_width ^3 voxels, allocated when a
+/// ray first enters them.
 struct RAYLIB_EXPORT DensityGrid
 {
   static const int min_voxel_hits = 2;
   static constexpr double spherical_distribution_scale =
     2.0;  // average area scale due to a spherical uniform distribution of leave angles relative to the rays
+  static const int brick_width = 8;
+  static const int64_t default_max_dense_voxels = 1 << 24;
 
-  DensityGrid(const Cuboid &grid_bounds, double vox_width, const Eigen::Vector3i &dims)
+  DensityGrid(const Cuboid &grid_bounds, double vox_width, const Eigen::Vector3i &dims,
+              int64_t max_dense_voxels = default_max_dense_voxels)
     : bounds_(grid_bounds)
     , voxel_width_(vox_width)
     , voxel_dims_(dims)
   {
-    voxels_.resize(dims[0] * dims[1] * dims[2]);
+    const int64_t num_voxels = static_cast<int64_t>(dims[0]) * dims[1] * dims[2];
+    if (num_voxels <= max_dense_voxels)
+    {
+      voxels_.resize(num_voxels);
+    }
+    else
+    {
+      brick_dims_ = (dims.array() + (brick_width - 1)) / brick_width;
+      bricks_.resize(static_cast<size_t>(brick_dims_[0]) * brick_dims_[1] * brick_dims_[2]);
+    }
   }
 
   /// This specific voxel class represents a density
@@ -87,25 +137,87 @@ struct RAYLIB_EXPORT DensityGrid
     float path_length_;
   };
 
-  /// This streams in a ray cloud file, and fills in the voxel density information
+  /// Fills a grid with chunks of rays, as @c addRays does. A large dense grid is filled on the GPU when raylib is built
+  /// WITH_CUDA and there is one, with the same sums up to the order of their additions. The grid's voxels are only
+  /// up to date once the filler is destroyed
+  class RAYLIB_EXPORT Filler
+  {
+  public:
+    explicit Filler(DensityGrid &grid);
+    ~Filler();
+    Filler(const Filler &) = delete;
+    Filler &operator=(const Filler &) = delete;
+    void addRays(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+                 const std::vector<RGBA> &colours);
+
+  private:
+    DensityGrid &grid_;
+    std::unique_ptr<GpuDensityGrid> gpu_;  // null when the grid is filled on the CPU
+  };
+
+  /// This streams in a ray cloud file, and fills in the voxel density information, through a @c Filler
   void calculateDensities(const std::string &file_name);
+  /// Add one chunk of rays to the voxel density information, on the CPU.
+  /// Each ray is clipped to the bounds, then adds its path length in metres within each voxel to that voxel. It is a
+  /// hit only in the voxel that it ends in, and only if it is bounded and was not clipped; it is a miss elsewhere
+  void addRays(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+               const std::vector<RGBA> &colours);
+  /// Save the voxels beside @c cloud_file , as @c densityFileName(cloud_file) , stamped in the same way as the ply index
+  /// so that they are ignored once the cloud changes. Only the non-empty bricks are saved. These are the per ray
+  /// statistics, so the voxels should be saved before @c addNeighbourPriors
+  bool save(const std::string &cloud_file) const;
+  /// Load the voxels saved beside @c cloud_file in place of adding its rays. Returns false if there are none, if they
+  /// are out of date, or if they were saved from a grid with other bounds, voxel width or dimensions
+  bool load(const std::string &cloud_file);
   /// To void low-ray-count voxels giving unstable density estimates, we fuse with neighbour information
-  /// up to a specified minimum number of rays. Specified in DENSITY_MIN_RAYS
+  /// up to a specified minimum number of rays. Specified in DENSITY_MIN_RAYS. As in @c calculateDensities , a large
+  /// dense grid is fused on the GPU where there is one
   void addNeighbourPriors();
+  /// The index of a voxel in the dense storage.
   /// Note, for performance, this index function does not check that the specified indices are in valid bounds.
   /// It is up to the calling function to assure this condition
-  inline int getIndex(const Eigen::Vector3i &inds) const;
-  inline int getIndexFromPos(const Eigen::Vector3d &pos) const;
-  /// Return the vector of density voxels
-  inline const std::vector<Voxel> &voxels() const { return voxels_; }
+  inline int64_t getIndex(const Eigen::Vector3i &inds) const;
+  inline int64_t getIndexFromPos(const Eigen::Vector3d &pos) const;
+  /// whether the voxels are stored as sparse bricks
+  inline bool sparse() const { return voxels_.empty() && !bricks_.empty(); }
+  /// the voxel at @c inds , which is empty if it is in an unallocated brick. As for @c getIndex , the indices are not
+  /// checked
+  inline const Voxel &voxel(const Eigen::Vector3i &inds) const;
+  /// call @c func(inds, voxel) on each stored voxel, which are all of the voxels of a dense grid, or those of the
+  /// allocated bricks of a sparse grid. In either case, the voxels along any one axis are visited in increasing order
+  template <class Func>
+  void forEachVoxel(const Func &func) const;
 
 private:
+  using Brick = std::array<Voxel, brick_width * brick_width * brick_width>;
+  /// the voxel at @c inds , allocating its brick if the grid is sparse. Allocation only changes the brick's own entry,
+  /// so threads may touch voxels in different bricks at once
+  inline Voxel &touch(const Eigen::Vector3i &inds);
+  inline size_t brickIndex(const Eigen::Vector3i &brick) const
+  {
+    return static_cast<size_t>(brick[0]) +
+           static_cast<size_t>(brick_dims_[0]) * (brick[1] + static_cast<size_t>(brick_dims_[1]) * brick[2]);
+  }
+  static inline int voxelInBrick(const Eigen::Vector3i &inds)
+  {
+    return (inds[0] % brick_width) + brick_width * ((inds[1] % brick_width) + brick_width * (inds[2] % brick_width));
+  }
+
   Cuboid bounds_;
-  std::vector<Voxel> voxels_;
+  std::vector<Voxel> voxels_;                   // the dense storage
+  std::vector<std::unique_ptr<Brick>> bricks_;  // the sparse storage
+  Eigen::Vector3i brick_dims_ = Eigen::Vector3i::Zero();
   double voxel_width_;
   Eigen::Vector3i voxel_dims_;
 };
 
+/// the file name of the density voxels saved beside @c cloud_file
+std::string RAYLIB_EXPORT densityFileName(const std::string &cloud_file);
+
+/// the bounds and dimensions of the density grid that renders the rays within @c bounds with pixels of @c voxel_width
+void RAYLIB_EXPORT densityGridGeometry(const Cuboid &bounds, double voxel_width, Cuboid &grid_bounds,
+                                       Eigen::Vector3i &dims);
+
 // inline functions
 double DensityGrid::Voxel::numerator() const
 {
@@ -150,15 +262,80 @@ void DensityGrid::Voxel::addMissRay(float length)
   path_length_ += length;
   num_rays_++;
 }
-int DensityGrid::getIndex(const Eigen::Vector3i &inds) const
+int64_t DensityGrid::getIndex(const Eigen::Vector3i &inds) const
 {
-  return inds[0] + inds[1] * voxel_dims_[0] + inds[2] * voxel_dims_[0] * voxel_dims_[1];
+  return static_cast<int64_t>(inds[0]) +
+         static_cast<int64_t>(voxel_dims_[0]) * (inds[1] + static_cast<int64_t>(voxel_dims_[1]) * inds[2]);
 }
-int DensityGrid::getIndexFromPos(const Eigen::Vector3d &pos) const
+int64_t DensityGrid::getIndexFromPos(const Eigen::Vector3d &pos) const
 {
   Eigen::Vector3d gridspace = (pos - bounds_.min_bound_) / voxel_width_;
   return getIndex(gridspace.cast<int>());
 }
+const DensityGrid::Voxel &DensityGrid::voxel(const Eigen::Vector3i &inds) const
+{
+  if (!sparse())
+  {
+    return voxels_[getIndex(inds)];
+  }
+  static const Voxel empty;
+  const std::unique_ptr<Brick> &brick = bricks_[brickIndex(inds / brick_width)];
+  return brick ? (*brick)[voxelInBrick(inds)] : empty;
+}
+DensityGrid::Voxel &DensityGrid::touch(const Eigen::Vector3i &inds)
+{
+  if (!sparse())
+  {
+    return voxels_[getIndex(inds)];
+  }
+  std::unique_ptr<Brick> &brick = bricks_[brickIndex(inds / brick_width)];
+  if (!brick)
+  {
+    brick.reset(new Brick);
+  }
+  return (*brick)[voxelInBrick(inds)];
+}
+template <class Func>
+void DensityGrid::forEachVoxel(const Func &func) const
+{
+  if (!sparse())
+  {
+    Eigen::Vector3i inds;
+    for (inds[2] = 0; inds[2] < voxel_dims_[2]; inds[2]++)
+    {
+      for (inds[1] = 0; inds[1] < voxel_dims_[1]; inds[1]++)
+      {
+        for (inds[0] = 0; inds[0] < voxel_dims_[0]; inds[0]++) func(inds, voxels_[getIndex(inds)]);
+      }
+    }
+    return;
+  }
+  Eigen::Vector3i brick;
+  for (brick[2] = 0; brick[2] < brick_dims_[2]; brick[2]++)
+  {
+    for (brick[1] = 0; brick[1] < brick_dims_[1]; brick[1]++)
+    {
+      for (brick[0] = 0; brick[0] < brick_dims_[0]; brick[0]++)
+      {
+        const std::unique_ptr<Brick> &voxels = bricks_[brickIndex(brick)];
+        if (!voxels)
+        {
+          continue;
+        }
+        const Eigen::Vector3i first = brick * brick_width;
+        const Eigen::Vector3i last = (first.array() + brick_width).min(voxel_dims_.array());
+        Eigen::Vector3i inds;
+        for (inds[2] = first[2]; inds[2] < last[2]; inds[2]++)
+        {
+          for (inds[1] = first[1]; inds[1] < last[1]; inds[1]++)
+          {
+            for (inds[0] = first[0]; inds[0] < last[0]; inds[0]++) func(inds, (*voxels)[voxelInBrick(inds)]);
+          }
+        }
+      }
+    }
+  }
+}
 
 }  // namespace ray
 #endif  // RAYLIB_RAYRENDERER_H
@@ -0,0 +1,221 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "rayscenegen.h"
+#include "raycloud.h"
+#include "raycloudwriter.h"
+#include "raycuboid.h"
+#include "rayforestgen.h"
+#include "rayprofile.h"
+#include "rayrandom.h"
+#include "raythreads.h"
+#include "raytreegen.h"
+
+namespace ray
+{
+namespace
+{
+/// tiles are at most this wide, in metres, which is a forest plot or a city block
+const double kMaxTileWidth = 20.0;
+/// and hold at most this many rays, so that a batch of tiles fits in memory
+const uint64_t kMaxTileRays = 1 << 20;
+/// tiles generated at once per thread. More than one balances the uneven tile times
+const int kTilesPerThread = 2;
+/// tree rays are at most this fraction of a forest tile, the rest are ground rays
+const double kMaxTreeFraction = 0.5;
+/// vertical noise in the forest ground, in metres
+const double kGroundNoise = 0.025;
+/// the ground rays start at this height above their end, with up to this lateral deviation
+const double kGroundRayHeight = 1.5;
+const double kGroundRayDeviation = 0.1;
+/// streets are this wide between city blocks, in metres
+const double kStreetWidth = 8.0;
+/// the aerial scan of the city is from this height, with rays at up to this horizontal slope
+const double kFlightHeight = 100.0;
+const double kMaxRaySlope = 0.1;
+/// city ray ranges have this much noise, in metres
+const double kRangeNoise = 0.02;
+
+/// The tiles of a scene, and the share of the rays of each
+struct SceneTiling
+{
+  SceneTiling(const SceneParams &params)
+  {
+    const double num_by_width = std::ceil(params.extent / kMaxTileWidth);
+    const double num_by_rays = std::ceil(std::sqrt(static_cast<double>(params.num_rays) / (double)kMaxTileRays));
+    num_per_side = std::max(1, static_cast<int>(std::max(num_by_width, num_by_rays)));
+    width = params.extent / static_cast<double>(num_per_side);
+    num_tiles = num_per_side * num_per_side;
+    rays_per_tile = params.num_rays / static_cast<uint64_t>(num_tiles);
+    num_extra_rays = params.num_rays % static_cast<uint64_t>(num_tiles);
+    box_min = -0.5 * params.extent * Eigen::Vector3d(1, 1, 0);
+  }
+  /// the number of rays of tile @c t , and the index of its first ray
+  uint64_t numRays(int t) const { return rays_per_tile + (static_cast<uint64_t>(t) < num_extra_rays ? 1 : 0); }
+  uint64_t firstRay(int t) const
+  {
+    return rays_per_tile * static_cast<uint64_t>(t) + std::min<uint64_t>(static_cast<uint64_t>(t), num_extra_rays);
+  }
+  /// the minimum corner of tile @c t , which are in rows along x
+  Eigen::Vector3d tileMin(int t) const
+  {
+    return box_min + width * Eigen::Vector3d(static_cast<double>(t % num_per_side),
+                                             static_cast<double>(t / num_per_side), 0.0);
+  }
+
+  int num_per_side;
+  int num_tiles;
+  double width;
+  uint64_t rays_per_tile;
+  uint64_t num_extra_rays;
+  Eigen::Vector3d box_min;
+};
+
+/// Add to @c cloud exactly @c num_keep of the rays from @c starts and @c ends , chosen at random and kept in order
+void addRandomSubset(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+                     const Eigen::Vector3d &offset, size_t num_keep, Cloud &cloud)
+{
+  const size_t num = ends.size();
+  size_t num_kept = 0;
+  for (size_t i = 0; i < num && num_kept < num_keep; i++)
+  {
+    // selection sampling, each ray is kept with the probability of the remaining keeps over the remaining rays
+    if (randUniformDouble() * static_cast<double>(num - i) < static_cast<double>(num_keep - num_kept))
+    {
+      cloud.addRay(starts[i] + offset, ends[i] + offset, 0.0, RGBA());
+      num_kept++;
+    }
+  }
+}
+
+/// A forest plot from @c ForestGen , the width of the tile, on a rough ground
+void generateForestTile(const Eigen::Vector3d &tile_min, double width, size_t num_rays, Cloud &cloud)
+{
+  ForestParams params;
+  params.field_width = width;
+  params.random_factor = 0.25;
+  ForestGen forest_gen;
+  forest_gen.make(params);
+  // the bark is sampled at the same areal density as the ground
+  forest_gen.generateRays(static_cast<double>(num_rays) / (width * width));
+
+  const Eigen::Vector3d centre = tile_min + 0.5 * width * Eigen::Vector3d(1, 1, 0);
+  size_t num_tree_rays = 0;
+  for (auto &tree : forest_gen.trees()) num_tree_rays += tree.rayEnds().size();
+  const size_t max_tree_rays = static_cast<size_t>(kMaxTreeFraction * static_cast<double>(num_rays));
+  for (auto &tree : forest_gen.trees())
+  {
+    const std::vector<Eigen::Vector3d> starts = tree.rayStarts();
+    const std::vector<Eigen::Vector3d> ends = tree.rayEnds();
+    if (num_tree_rays <= max_tree_rays)
+    {
+      for (size_t i = 0; i < ends.size(); i++) cloud.addRay(starts[i] + centre, ends[i] + centre, 0.0, RGBA());
+    }
+    else
+    {
+      // each tree keeps its share of the allowed tree rays, rounded down
+      const size_t num_keep = ends.size() * max_tree_rays / num_tree_rays;
+      addRandomSubset(starts, ends, centre, num_keep, cloud);
+    }
+  }
+
+  // the ground makes up the remaining rays
+  while (cloud.rayCount() < num_rays)
+  {
+    const Eigen::Vector3d end(random(tile_min[0], tile_min[0] + width), random(tile_min[1], tile_min[1] + width),
+                              random(-kGroundNoise, kGroundNoise));
+    const Eigen::Vector3d start = end + Eigen::Vector3d(random(-kGroundRayDeviation, kGroundRayDeviation),
+                                                        random(-kGroundRayDeviation, kGroundRayDeviation),
+                                                        kGroundRayHeight);
+    cloud.addRay(start, end, 0.0, RGBA());
+  }
+}
+
+/// A city block of box buildings, with a street on each side, scanned from the air
+void generateCityTile(const Eigen::Vector3d &tile_min, double width, size_t num_rays, Cloud &cloud)
+{
+  // the block is split into a row of lots, each with a building of its own height and setback
+  std::vector<Cuboid> buildings;
+  const double block_width = width - kStreetWidth;
+  if (block_width > 0.0)
+  {
+    const int num_lots = 1 + static_cast<int>(rand() % 3);
+    const double lot_width = block_width / static_cast<double>(num_lots);
+    for (int i = 0; i < num_lots; i++)
+    {
+      const double setback = random(0.0, 0.2) * lot_width;
+      Eigen::Vector3d lot_min = tile_min + Eigen::Vector3d(0.5 * kStreetWidth + lot_width * i, 0.5 * kStreetWidth, 0);
+      Eigen::Vector3d lot_max = lot_min + Eigen::Vector3d(lot_width, block_width, random(5.0, 40.0));
+      lot_min.head<2>() += Eigen::Vector2d(setback, setback);
+      lot_max.head<2>() -= Eigen::Vector2d(setback, setback);
+      buildings.push_back(Cuboid(lot_min, lot_max));
+    }
+  }
+
+  for (size_t i = 0; i < num_rays; i++)
+  {
+    const Eigen::Vector3d target(random(tile_min[0], tile_min[0] + width), random(tile_min[1], tile_min[1] + width),
+                                 0.0);
+    const double max_offset = kMaxRaySlope * kFlightHeight;
+    const Eigen::Vector3d start =
+      target + Eigen::Vector3d(random(-max_offset, max_offset), random(-max_offset, max_offset), kFlightHeight);
+    const Eigen::Vector3d dir = target - start;
+    // the ray stops at the ground, or at the first building that it meets
+    double depth = 1.0;
+    for (auto &building : buildings) building.intersectsRay(start, dir, depth, true);
+    const double length = dir.norm();
+    const double noisy_depth = depth + random(-kRangeNoise, kRangeNoise) / length;
+    cloud.addRay(start, start + dir * noisy_depth, 0.0, RGBA());
+  }
+}
+}  // namespace
+
+bool generateScene(const std::string &file_name, SceneType type, const SceneParams &params)
+{
+  ProfileScope profile("generateScene");
+  profile.count(params.num_rays);
+  const SceneTiling tiling(params);
+  if (type == SceneType::Forest)
+  {
+    fillBranchAngleLookup();  // shared by the tree generators of every tile
+  }
+
+  CloudWriter writer;
+  if (!writer.begin(file_name))
+    return false;
+  const int batch_size = std::max(1, Threads::threadCount() * kTilesPerThread);
+  std::vector<Cloud> tiles(static_cast<size_t>(std::min(batch_size, tiling.num_tiles)));
+  for (int batch_start = 0; batch_start < tiling.num_tiles; batch_start += batch_size)
+  {
+    const int batch_end = std::min(tiling.num_tiles, batch_start + batch_size);
+    parallelFor(batch_start, batch_end, [&](int t) {
+      Cloud &cloud = tiles[static_cast<size_t>(t - batch_start)];
+      cloud.clear();
+      const size_t num_rays = static_cast<size_t>(tiling.numRays(t));
+      cloud.reserve(num_rays);
+      // the random generator is per thread, so seeding it here makes the tile independent of the thread
+      srand(params.seed * 1000003u + static_cast<unsigned>(t));
+      if (type == SceneType::Forest)
+        generateForestTile(tiling.tileMin(t), tiling.width, num_rays, cloud);
+      else
+        generateCityTile(tiling.tileMin(t), tiling.width, num_rays, cloud);
+
+      const uint64_t first_ray = tiling.firstRay(t);
+      for (size_t i = 0; i < cloud.times.size(); i++)
+      {
+        cloud.times[i] = static_cast<double>(first_ray + i) * params.time_delta;
+      }
+      colourByTime(cloud.times, cloud.colours);
+    });
+    for (int t = batch_start; t < batch_end; t++)
+    {
+      if (!writer.writeChunk(tiles[static_cast<size_t>(t - batch_start)]))
+        return false;
+    }
+  }
+  writer.end();
+  return true;
+}
+}  // namespace ray
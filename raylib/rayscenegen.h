@@ -0,0 +1,47 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYSCENEGEN_H
+#define RAYLIB_RAYSCENEGEN_H
+
+#include "raylib/raylibconfig.h"
+
+#include "rayutils.h"
+
+namespace ray
+{
+/// The kinds of scene that @c generateScene can stream
+enum class SceneType
+{
+  Forest,  // trees from @c ForestGen on a rough ground, scanned from beneath and around the trees
+  City     // blocks of box buildings between streets, scanned from the air
+};
+
+/// Parameters of a streamed synthetic scene
+struct RAYLIB_EXPORT SceneParams
+{
+  SceneParams()
+    : num_rays(1000000)
+    , extent(100.0)
+    , seed(1)
+    , time_delta(0.001)
+  {}
+  uint64_t num_rays;  // the exact number of rays generated
+  double extent;      // width in metres of the square of ground, centred on the origin
+  unsigned seed;      // each tile is seeded from this and its index
+  double time_delta;  // between rays
+};
+
+/// Generate a synthetic ray cloud of @c params.num_rays rays over a square of @c params.extent metres, and write it to
+/// @c file_name a chunk at a time through a @c CloudWriter , so that clouds of billions of rays can be made for load
+/// testing. The square is split into tiles of at most 20 m and a million rays, each with an equal share of the rays.
+/// Tiles are generated in parallel batches, each seeded from @c params.seed and its index, then written in order, so
+/// the file is the same whatever the thread count, and memory is bounded by the batch of tiles. Each tile is
+/// generated without knowledge of its neighbours, so trees can overhang the tile edges, and a few city rays that
+/// cross a street miss a neighbouring building. Returns false if the file could not be written.
+bool RAYLIB_EXPORT generateScene(const std::string &file_name, SceneType type, const SceneParams &params);
+}  // namespace ray
+
+#endif  // RAYLIB_RAYSCENEGEN_H
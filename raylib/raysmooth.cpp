@@ -0,0 +1,129 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raysmooth.h"
+#include "raycloud.h"
+#include "raycloudwriter.h"
+#include "raynodes.h"
+#include "rayprofile.h"
+#include "raythreads.h"
+#include "raytiles.h"
+
+#include <nabo/nabo.h>
+#include <cmath>
+#include <limits>
+
+namespace ray
+{
+namespace
+{
+/// the number of neighbours that each end is smoothed towards
+const int kSmoothNeighbours = 16;
+/// the halo per iteration, in point spacings. The normals take a neighbourhood, and so does each iteration, at a few
+/// spacings across
+const double kSmoothHaloSpacings = 10.0;
+}  // namespace
+
+void smoothCloud(Cloud &cloud, int iterations)
+{
+  // Method:
+  // 1. generate normals and neighbour indices
+  // 2. pull point along normal direction so as to match neighbours, weighted by normal similarity
+  size_t num_bounded = 0;
+  for (size_t i = 0; i < cloud.ends.size(); i++)
+  {
+    if (cloud.rayBounded(i))
+      num_bounded++;
+  }
+  if (num_bounded < 2 || iterations < 1)
+    return;
+  const int num_neighbours = static_cast<int>(std::min<size_t>(kSmoothNeighbours, num_bounded - 1));
+  std::vector<Eigen::Vector3d> normals;
+  Eigen::MatrixXi neighbour_indices;
+  cloud.getSurfels(num_neighbours, nullptr, &normals, nullptr, nullptr, &neighbour_indices);
+
+  // the ends are double buffered, so each iteration reads the previous one's positions
+  std::vector<Eigen::Vector3d> next_ends(cloud.ends.size());
+  for (int iteration = 0; iteration < iterations; iteration++)
+  {
+    const std::vector<Eigen::Vector3d> &ends = cloud.ends;
+    parallelFor(size_t(0), ends.size(), [&](size_t i) {
+      if (!cloud.rayBounded(i))
+      {
+        next_ends[i] = ends[i];
+        return;
+      }
+      double total_weight = 0.2;  // more averaging if it uses less of the central position, but 0 risks a divide by 0
+      Eigen::Vector3d weighted_sum = ends[i] * total_weight;
+      for (int j = 0; j < num_neighbours && neighbour_indices(j, i) != Nabo::NNSearchD::InvalidIndex; j++)
+      {
+        int k = neighbour_indices(j, i);
+        double weight = std::max(0.0, 1.0 - (normals[k] - normals[i]).squaredNorm());
+        weighted_sum += ends[k] * weight;
+        total_weight += weight;
+      }
+      const Eigen::Vector3d centroid = weighted_sum / total_weight;
+      next_ends[i] = ends[i] + normals[i] * (centroid - ends[i]).dot(normals[i]);
+    });
+    cloud.ends.swap(next_ends);
+  }
+}
+
+bool smoothInTiles(const std::string &file_name, const std::string &out_name, int iterations)
+{
+  ProfileScope profile("smoothInTiles");
+  Cloud::Info info;
+  if (!Cloud::getInfo(file_name, info))
+    return false;
+  const size_t num_rays = static_cast<size_t>(info.num_bounded) + static_cast<size_t>(info.num_unbounded);
+  profile.count(num_rays);
+  const double spacing = Cloud::estimatePointSpacing(file_name, info.ends_bound, info.num_bounded);
+  const double halo = kSmoothHaloSpacings * spacing * static_cast<double>(std::max(iterations, 0) + 1);
+
+  // 1. smooth each tile independently, keeping the ends of only the rays that it owns
+  // the ends are NaN until smoothed, so that the ends smoothed by other nodes can be told apart
+  std::vector<Eigen::Vector3d> smoothed_ends(num_rays,
+                                             Eigen::Vector3d::Constant(std::numeric_limits<double>::quiet_NaN()));
+  auto smooth_tile = [&](Cloud &cloud, const std::vector<int64_t> &indices) {
+    smoothCloud(cloud, iterations);
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+      if (indices[i] >= 0 && indices[i] < (int64_t)num_rays)
+        smoothed_ends[indices[i]] = cloud.ends[i];
+    }
+  };
+  if (!processInTiles(file_name, out_name, halo, smooth_tile))
+    return false;
+  // across several nodes, node 0 gathers the other nodes' ends and writes the output
+  auto merge = [](Eigen::Vector3d &value, const Eigen::Vector3d &other) {
+    if (!std::isnan(other[0]))
+      value = other;
+  };
+  if (!Nodes::gather(out_name, smoothed_ends, merge))
+    return false;
+  if (!Nodes::isCoordinator())
+    return true;
+
+  // 2. copy the rays with their smoothed ends, in file order
+  CloudWriter writer;
+  if (!writer.begin(out_name))
+    return false;
+  size_t num_copied = 0;
+  bool success = true;
+  auto copy_rays = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                       std::vector<double> &times, std::vector<RGBA> &colours) {
+    for (size_t i = 0; i < ends.size() && num_copied + i < num_rays; i++) ends[i] = smoothed_ends[num_copied + i];
+    num_copied += ends.size();
+    if (!writer.writeChunk(starts, ends, times, colours))
+    {
+      success = false;
+    }
+  };
+  if (!Cloud::read(file_name, copy_rays))
+    return false;
+  writer.end();
+  return success;
+}
+}  // namespace ray
@@ -0,0 +1,32 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYSMOOTH_H
+#define RAYLIB_RAYSMOOTH_H
+
+#include "raylib/raylibconfig.h"
+
+#include "rayutils.h"
+
+namespace ray
+{
+class Cloud;
+
+/// Smooth the bounded ray ends of @c cloud , moving each end along its normal onto the centroid of its neighbours,
+/// weighted by the similarity of their normals. The normals and neighbours are found once, and reused for each of the
+/// @c iterations . Every iteration reads only the previous iteration's ends, so the points are moved in parallel.
+void RAYLIB_EXPORT smoothCloud(Cloud &cloud, int iterations = 1);
+
+/// Smooth the ray cloud file @c file_name into @c out_name , as @c smoothCloud , in tiles, in parallel, by
+/// @c processInTiles . The halo of each tile is several point spacings for each of the @c iterations , so the owned rays
+/// are moved as in the whole cloud, except where the neighbourhoods of sparse points reach beyond the halo. The
+/// smoothed ends are written in file order, in a second read of the file.
+/// Tile rays are spilled to temporary files beside @c out_name , so memory is bounded by the tile size and an end
+/// point per ray, rather than the cloud size. Across several @c Nodes , node 0 gathers the other nodes' ends and writes
+/// the output. Returns false if a file could not be read or written.
+bool RAYLIB_EXPORT smoothInTiles(const std::string &file_name, const std::string &out_name, int iterations = 1);
+}  // namespace ray
+
+#endif  // RAYLIB_RAYSMOOTH_H
@@ -0,0 +1,115 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raysort.h"
+
+#include "raythreads.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace ray
+{
+namespace
+{
+const int kDigitBits = 8;
+const size_t kRadix = size_t(1) << kDigitBits;
+/// the fewest keys per block of a pass, as smaller blocks cost more in counts than they save
+const size_t kMinBlockSize = 1 << 16;
+
+/// the unsigned key that orders as @c value does: the sign bit is flipped, and the other bits too when negative
+inline uint64_t sortableKey(double value)
+{
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  const uint64_t sign = uint64_t(1) << 63;
+  return (bits & sign) ? ~bits : bits | sign;
+}
+
+template <class T, class ToKey>
+std::vector<size_t> sortOrder(const std::vector<T> &values, const ToKey &to_key)
+{
+  std::vector<uint64_t> keys(values.size());
+  std::vector<size_t> order(values.size());
+  parallelFor(size_t(0), values.size(), [&](size_t i) {
+    keys[i] = to_key(values[i]);
+    order[i] = i;
+  });
+  radixSort(keys, order);
+  return order;
+}
+}  // namespace
+
+void radixSort(std::vector<uint64_t> &keys, std::vector<size_t> &payload)
+{
+  const size_t num = keys.size();
+  if (num < 2 || payload.size() != num)
+    return;
+  // only the digits in which the keys differ need a pass
+  typedef std::pair<uint64_t, uint64_t> Bits;  // the bits set in any key, and those set in all keys
+  const Bits bits = parallelReduce(
+    size_t(0), num, Bits(0, ~uint64_t(0)),
+    [&](size_t i, Bits &value) {
+      value.first |= keys[i];
+      value.second &= keys[i];
+    },
+    [](const Bits &a, const Bits &b) { return Bits(a.first | b.first, a.second & b.second); });
+  const uint64_t varying = bits.first ^ bits.second;
+  if (!varying)
+    return;
+
+  const size_t num_blocks =
+    std::max<size_t>(1, std::min<size_t>(num / kMinBlockSize, 4 * static_cast<size_t>(Threads::threadCount())));
+  const size_t block_size = (num + num_blocks - 1) / num_blocks;
+  std::vector<size_t> offsets(num_blocks * kRadix);
+  std::vector<uint64_t> next_keys(num);
+  std::vector<size_t> next_payload(num);
+  for (int shift = 0; shift < 64; shift += kDigitBits)
+  {
+    if (!((varying >> shift) & (kRadix - 1)))
+      continue;
+    std::fill(offsets.begin(), offsets.end(), 0);
+    parallelFor(size_t(0), num_blocks, [&](size_t block) {
+      size_t *counts = &offsets[block * kRadix];
+      const size_t end = std::min(num, (block + 1) * block_size);
+      for (size_t i = block * block_size; i < end; i++) counts[(keys[i] >> shift) & (kRadix - 1)]++;
+    });
+    // each block places its keys of a digit after those of the earlier blocks, which keeps the sort stable
+    size_t total = 0;
+    for (size_t digit = 0; digit < kRadix; digit++)
+    {
+      for (size_t block = 0; block < num_blocks; block++)
+      {
+        const size_t count = offsets[block * kRadix + digit];
+        offsets[block * kRadix + digit] = total;
+        total += count;
+      }
+    }
+    parallelFor(size_t(0), num_blocks, [&](size_t block) {
+      size_t *positions = &offsets[block * kRadix];
+      const size_t end = std::min(num, (block + 1) * block_size);
+      for (size_t i = block * block_size; i < end; i++)
+      {
+        const size_t position = positions[(keys[i] >> shift) & (kRadix - 1)]++;
+        next_keys[position] = keys[i];
+        next_payload[position] = payload[i];
+      }
+    });
+    keys.swap(next_keys);
+    payload.swap(next_payload);
+  }
+}
+
+std::vector<size_t> radixSortOrder(const std::vector<double> &keys)
+{
+  return sortOrder(keys, [](double value) { return sortableKey(value); });
+}
+
+std::vector<size_t> radixSortOrder(const std::vector<int64_t> &keys)
+{
+  return sortOrder(keys, [](int64_t value) { return static_cast<uint64_t>(value) ^ (uint64_t(1) << 63); });
+}
+}  // namespace ray
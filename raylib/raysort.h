@@ -0,0 +1,30 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYSORT_H
+#define RAYLIB_RAYSORT_H
+
+#include "raylib/raylibconfig.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ray
+{
+/// Sort @c keys ascending, moving @c payload alongside them, so that payload[i] stays with keys[i]. This is a stable
+/// least significant digit radix sort, in 8-bit digits, skipping the digits that all keys share. Each pass counts and
+/// scatters blocks of the keys in parallel. @c payload must be the same size as @c keys .
+void RAYLIB_EXPORT radixSort(std::vector<uint64_t> &keys, std::vector<size_t> &payload);
+
+/// the order that sorts @c keys ascending: element i of the sorted keys is keys[order[i]]. Equal keys keep their
+/// order, as with @c std::stable_sort , except that minus zero is placed before zero. NaNs are placed after
+/// infinity, or before minus infinity if negative.
+std::vector<size_t> RAYLIB_EXPORT radixSortOrder(const std::vector<double> &keys);
+/// as above, for integer keys
+std::vector<size_t> RAYLIB_EXPORT radixSortOrder(const std::vector<int64_t> &keys);
+}  // namespace ray
+
+#endif  // RAYLIB_RAYSORT_H
@@ -4,180 +4,496 @@
 //
 // Author: Thomas Lowe
 #include "raysplitter.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <limits>
+#include <list>
 #include <map>
+#include <memory>
+#include <sstream>
+#include <unordered_map>
 #include "extraction/rayforest.h"
 #include "raycloudwriter.h"
 #include "raycuboid.h"
+#include "rayplyindex.h"
+#include "rayprofile.h"
+#include "raytilecache.h"
+
+#if RAYLIB_WITH_TBB
+#include <tbb/parallel_for.h>
+#endif  // RAYLIB_WITH_TBB
 
 namespace ray
 {
-/// This is a helper function to aid in splitting the cloud while chunk-loading it. The purpose is to be able to
-/// split clouds of any size, without running out of main memory.
-bool split(const std::string &file_name, const std::string &in_name, const std::string &out_name,
-           std::function<bool(const Cloud &cloud, int i)> is_outside)
+void SplitPlan::add(const std::string &in_name, const std::string &out_name, SplitFunction split_function)
 {
-  Cloud cloud_buffer;
-  CloudWriter in_writer, out_writer;
-  if (!in_writer.begin(in_name))
-    return false;
-  if (!out_writer.begin(out_name))
-    return false;
-  Cloud in_chunk, out_chunk;
-
-  /// move each ray into either the in_chunk or out_chunk, depending on the condition function is_outside
-  auto per_chunk = [&cloud_buffer, &in_writer, &out_writer, &in_chunk, &out_chunk, &is_outside](
-                     std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
-                     std::vector<double> &times, std::vector<RGBA> &colours) {
-    // I move these into the cloud buffer, so that they can be indexed easily in is_outside (by index).
-    cloud_buffer.starts = starts;
-    cloud_buffer.ends = ends;
-    cloud_buffer.times = times;
-    cloud_buffer.colours = colours;
-
-    for (int i = 0; i < (int)cloud_buffer.ends.size(); i++)
-    {
-      Cloud &cloud = is_outside(cloud_buffer, i) ? out_chunk : in_chunk;
-      cloud.addRay(cloud_buffer.starts[i], cloud_buffer.ends[i], cloud_buffer.times[i], cloud_buffer.colours[i]);
-    }
-    in_writer.writeChunk(in_chunk);
-    out_writer.writeChunk(out_chunk);
-    in_chunk.clear();
-    out_chunk.clear();
-  };
-  if (!Cloud::read(file_name, per_chunk))
-    return false;
-  in_writer.end();
-  out_writer.end();
-  return true;
+  splits_.push_back({ in_name, out_name, std::move(split_function) });
 }
 
-/// Special case for splitting around a plane.
-bool splitPlane(const std::string &file_name, const std::string &in_name, const std::string &out_name,
-                const Eigen::Vector3d &plane)
+void SplitPlan::addPredicate(const std::string &in_name, const std::string &out_name,
+                             std::function<bool(const Cloud &cloud, int i)> is_outside)
 {
-  CloudWriter inside_writer, outside_writer;
-  if (!inside_writer.begin(in_name))
-    return false;
-  if (!outside_writer.begin(out_name))
-    return false;
-  Cloud in_chunk, out_chunk;
+  add(in_name, out_name, [is_outside](const Cloud &chunk, Cloud &in_chunk, Cloud &out_chunk) {
+    chunk.partition([&](size_t i) { return !is_outside(chunk, static_cast<int>(i)); }, in_chunk, &out_chunk);
+  });
+}
 
-  // the split operation
-  auto per_chunk = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
-                       std::vector<double> &times, std::vector<RGBA> &colours) {
-    const Eigen::Vector3d plane_vec = plane / plane.dot(plane);
-    for (size_t i = 0; i < ends.size(); i++)
+void SplitPlan::addPlane(const std::string &in_name, const std::string &out_name, const Eigen::Vector3d &plane)
+{
+  const Eigen::Vector3d plane_vec = plane / plane.dot(plane);
+  add(in_name, out_name, [plane_vec](const Cloud &chunk, Cloud &in_chunk, Cloud &out_chunk) {
+    for (size_t i = 0; i < chunk.ends.size(); i++)
     {
-      const double d1 = starts[i].dot(plane_vec) - 1.0;
-      const double d2 = ends[i].dot(plane_vec) - 1.0;
+      const double d1 = chunk.starts[i].dot(plane_vec) - 1.0;
+      const double d2 = chunk.ends[i].dot(plane_vec) - 1.0;
       if (d1 * d2 > 0.0)  // start and end are on the same side of the plane, so don't split...
       {
-        Cloud &chunk = d1 > 0.0 ? out_chunk : in_chunk;
-        chunk.addRay(starts[i], ends[i], times[i], colours[i]);
+        Cloud &cloud = d1 > 0.0 ? out_chunk : in_chunk;
+        cloud.addRay(chunk.starts[i], chunk.ends[i], chunk.times[i], chunk.colours[i]);
       }
       else  // split the ray...
       {
-        RGBA col = colours[i];
+        RGBA col = chunk.colours[i];
         col.red = col.green = col.blue = col.alpha = 0;
-        const Eigen::Vector3d mid = starts[i] + (ends[i] - starts[i]) * d1 / (d1 - d2);
+        const Eigen::Vector3d mid = chunk.starts[i] + (chunk.ends[i] - chunk.starts[i]) * d1 / (d1 - d2);
         if (d1 > 0.0)
         {
-          out_chunk.addRay(starts[i], mid, times[i], col);
-          in_chunk.addRay(mid, ends[i], times[i], colours[i]);
+          out_chunk.addRay(chunk.starts[i], mid, chunk.times[i], col);
+          in_chunk.addRay(mid, chunk.ends[i], chunk.times[i], chunk.colours[i]);
         }
         else
         {
-          in_chunk.addRay(starts[i], mid, times[i], col);
-          out_chunk.addRay(mid, ends[i], times[i], colours[i]);
+          in_chunk.addRay(chunk.starts[i], mid, chunk.times[i], col);
+          out_chunk.addRay(mid, chunk.ends[i], chunk.times[i], chunk.colours[i]);
         }
       }
     }
-    inside_writer.writeChunk(in_chunk);
-    outside_writer.writeChunk(out_chunk);
-    in_chunk.clear();
-    out_chunk.clear();
-  };
-  if (!readPly(file_name, true, per_chunk, 0))
-    return false;
-
-  inside_writer.end();
-  outside_writer.end();
-  return true;
+  });
 }
 
-/// Special case for splitting a box.
-bool splitBox(const std::string &file_name, const std::string &in_name, const std::string &out_name,
-              const Eigen::Vector3d &centre, const Eigen::Vector3d &extents)
+void SplitPlan::addBox(const std::string &in_name, const std::string &out_name, const Eigen::Vector3d &centre,
+                       const Eigen::Vector3d &extents)
 {
-  CloudWriter inside_writer, outside_writer;
-  if (!inside_writer.begin(in_name))
-    return false;
-  if (!outside_writer.begin(out_name))
-    return false;
-  Cloud in_chunk, out_chunk;
-
-  // splitting per chunk
-  auto per_chunk = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
-                       std::vector<double> &times, std::vector<RGBA> &colours) {
-    // I move these into the cloud buffer, so that they can be indexed easily in fptr (by index).
-    const Cuboid cuboid(centre - extents, centre + extents);
-    for (size_t i = 0; i < ends.size(); i++)
+  const Cuboid cuboid(centre - extents, centre + extents);
+  add(in_name, out_name, [cuboid](const Cloud &chunk, Cloud &in_chunk, Cloud &out_chunk) {
+    // the whole chunk is clipped at once, a packet of rays at a time
+    std::vector<double> near(chunk.ends.size()), far(chunk.ends.size());
+    cuboid.clipRays(chunk.starts.data(), chunk.ends.data(), chunk.ends.size(), near.data(), far.data());
+    for (size_t i = 0; i < chunk.ends.size(); i++)
     {
-      Eigen::Vector3d start = starts[i];
-      Eigen::Vector3d end = ends[i];
-      if (cuboid.clipRay(start, end))  // true if ray intersects the cuboid
+      Eigen::Vector3d start = chunk.starts[i];
+      Eigen::Vector3d end = chunk.ends[i];
+      if (Cuboid::clipToRange(near[i], far[i], start, end))  // true if ray intersects the cuboid
       {
-        RGBA col = colours[i];
-        if (!cuboid.intersects(ends[i]))  // mark as unbounded for the in_chunk
+        RGBA col = chunk.colours[i];
+        if (!cuboid.intersects(chunk.ends[i]))  // mark as unbounded for the in_chunk
         {
           col.red = col.green = col.blue = col.alpha = 0;
         }
-        in_chunk.addRay(start, end, times[i], col);
-        if (start != starts[i])  // start part is clipped
+        in_chunk.addRay(start, end, chunk.times[i], col);
+        if (start != chunk.starts[i])  // start part is clipped
         {
           col.red = col.green = col.blue = col.alpha = 0;
-          out_chunk.addRay(starts[i], start, times[i], col);
+          out_chunk.addRay(chunk.starts[i], start, chunk.times[i], col);
         }
-        if (ends[i] != end)  // end part is clipped
+        if (chunk.ends[i] != end)  // end part is clipped
         {
-          out_chunk.addRay(end, ends[i], times[i], colours[i]);
+          out_chunk.addRay(end, chunk.ends[i], chunk.times[i], chunk.colours[i]);
         }
       }
       else  // no intersection
       {
-        out_chunk.addRay(starts[i], ends[i], times[i], colours[i]);
+        out_chunk.addRay(chunk.starts[i], chunk.ends[i], chunk.times[i], chunk.colours[i]);
       }
     }
-    inside_writer.writeChunk(in_chunk);
-    outside_writer.writeChunk(out_chunk);
-    in_chunk.clear();
-    out_chunk.clear();
+  });
+}
+
+void SplitPlan::addMesh(const std::string &in_name, const std::string &out_name, const Mesh &mesh, double offset)
+{
+  const std::function<bool(const Eigen::Vector3d &end)> is_inside = mesh.insideTest(offset);
+  add(in_name, out_name, [is_inside](const Cloud &chunk, Cloud &in_chunk, Cloud &out_chunk) {
+    chunk.partition([&](size_t i) { return is_inside(chunk.ends[i]); }, in_chunk, &out_chunk);
+  });
+}
+
+bool SplitPlan::begin()
+{
+  const size_t num_splits = splits_.size();
+  in_writers_ = std::vector<CloudWriter>(num_splits);
+  out_writers_ = std::vector<CloudWriter>(num_splits);
+  for (size_t s = 0; s < num_splits; s++)
+  {
+    if (!in_writers_[s].begin(splits_[s].in_name) || !out_writers_[s].begin(splits_[s].out_name))
+      return false;
+  }
+  in_chunks_.resize(num_splits);
+  out_chunks_.resize(num_splits);
+  return true;
+}
+
+void SplitPlan::splitChunk(const Cloud &chunk)
+{
+  // each split has its own chunks and writers, so the splits of a chunk are independent
+  auto split_chunk = [this, &chunk](size_t s) {
+    splits_[s].split_function(chunk, in_chunks_[s], out_chunks_[s]);
+    in_writers_[s].writeChunk(in_chunks_[s]);
+    out_writers_[s].writeChunk(out_chunks_[s]);
+    in_chunks_[s].clear();
+    out_chunks_[s].clear();
   };
-  if (!readPly(file_name, true, per_chunk, 0))
-    return false;
+#if RAYLIB_WITH_TBB
+  tbb::parallel_for<size_t>(0u, splits_.size(), split_chunk);
+#else   // RAYLIB_WITH_TBB
+  for (size_t s = 0; s < splits_.size(); s++)
+  {
+    split_chunk(s);
+  }
+#endif  // RAYLIB_WITH_TBB
+}
+
+void SplitPlan::end()
+{
+  for (size_t s = 0; s < in_writers_.size(); s++)
+  {
+    in_writers_[s].end();
+    out_writers_[s].end();
+  }
+  in_writers_.clear();
+  out_writers_.clear();
+}
 
-  inside_writer.end();
-  outside_writer.end();
+bool SplitPlan::run(const std::string &file_name)
+{
+  ProfileScope profile("split");
+  if (!begin())
+    return false;
+  Cloud chunk;
+  auto per_chunk = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                       std::vector<double> &times, std::vector<RGBA> &colours) {
+    // I move these into the chunk cloud, so that they can be indexed easily by the splits, then move them back
+    chunk.starts.swap(starts);
+    chunk.ends.swap(ends);
+    chunk.times.swap(times);
+    chunk.colours.swap(colours);
+    profile.count(chunk.rayCount());
+    splitChunk(chunk);
+    chunk.starts.swap(starts);
+    chunk.ends.swap(ends);
+    chunk.times.swap(times);
+    chunk.colours.swap(colours);
+  };
+  if (!Cloud::read(file_name, per_chunk))
+    return false;
+  end();
   return true;
 }
 
+bool split(const std::string &file_name, const std::string &in_name, const std::string &out_name,
+           std::function<bool(const Cloud &cloud, int i)> is_outside)
+{
+  SplitPlan plan;
+  plan.addPredicate(in_name, out_name, is_outside);
+  return plan.run(file_name);
+}
+
+/// Special case for splitting around a plane.
+bool splitPlane(const std::string &file_name, const std::string &in_name, const std::string &out_name,
+                const Eigen::Vector3d &plane)
+{
+  SplitPlan plan;
+  plan.addPlane(in_name, out_name, plane);
+  return plan.run(file_name);
+}
+
+/// Special case for splitting a box.
+bool splitBox(const std::string &file_name, const std::string &in_name, const std::string &out_name,
+              const Eigen::Vector3d &centre, const Eigen::Vector3d &extents)
+{
+  SplitPlan plan;
+  plan.addBox(in_name, out_name, centre, extents);
+  return plan.run(file_name);
+}
+
+/// Special case for splitting around a mesh.
+bool splitMesh(const std::string &file_name, const std::string &in_name, const std::string &out_name,
+               const Mesh &mesh, double offset)
+{
+  SplitPlan plan;
+  plan.addMesh(in_name, out_name, mesh, offset);
+  return plan.run(file_name);
+}
+
 /// Special case for splitting based on a grid.
 bool splitGrid(const std::string &file_name, const std::string &cloud_name_stub, const Eigen::Vector3d &cell_width,
-               double overlap)
+               double overlap, const std::string &cache_file)
 {
   return splitGrid(file_name, cloud_name_stub, Eigen::Vector4d(cell_width[0], cell_width[1], cell_width[2], 0),
-                   overlap);
+                   overlap, cache_file);
 }
 
+namespace
+{
+/// A ray clipped to a grid cell, as stored in the cell's temporary spill file
+struct CellRay
+{
+  Eigen::Vector3d start;
+  Eigen::Vector3d end;
+  double time;
+  RGBA colour;
+};
+
+/// A ray binned to a grid cell by the workers of splitGrid, with the cell's index and coordinates
+struct BinnedRay
+{
+  int64_t index;
+  Eigen::Vector3i coord;
+  long int time_coord;
+  CellRay ray;
+};
+
+/// Buffers the rays of each cell in memory, and writes them out in batches. A cell is a grid cell of splitGrid, or a
+/// region of splitRegions, and is named by @c cell_name when it receives its first ray. The first
+/// @c kMaxDirectCells cells to receive rays are written directly to their ray cloud files. Any later cells are
+/// appended to temporary spill files, through a small LRU of open streams, and converted into ray cloud files by
+/// @c end() . This bounds the number of open files, whatever the number of cells.
+///
+/// With a @c cache , each cell's rays are hashed as they are added. The cells in the cache are always spilled, and if
+/// their rays are unchanged and their file is as the previous run left it, then the file is not written again, so it
+/// keeps its contents and modification time for the tools that process it next.
+class CellWriter
+{
+public:
+  /// at most this many ray cloud files are open at once
+  static const size_t kMaxDirectCells = 512;
+  /// at most this many spill files are open at once
+  static const size_t kMaxOpenSpills = 64;
+  /// a cell's rays are written once it buffers this many
+  static const size_t kCellFlushSize = 8192;
+  /// all cells are written once this many rays are buffered in total
+  static const size_t kMaxBufferedRays = 1 << 21;
+
+  explicit CellWriter(std::function<std::string(const BinnedRay &binned)> cell_name, TileCache *cache = nullptr)
+    : cell_name_(std::move(cell_name))
+    , cache_(cache)
+  {}
+
+  /// add a binned ray to its cell's buffer
+  void add(const BinnedRay &binned)
+  {
+    auto found = cells_.find(binned.index);
+    if (found == cells_.end())
+    {
+      found = cells_.emplace(binned.index, Cell()).first;
+      found->second.name = cell_name_(binned);
+      const bool cached = cache_ && cache_->contains(found->second.name);
+      if (!cached && num_direct_ < kMaxDirectCells)
+      {
+        found->second.writer.reset(new CloudWriter);
+        if (!found->second.writer->begin(found->second.name))
+        {
+          success_ = false;
+        }
+        num_direct_++;
+      }
+    }
+    const CellRay &ray = binned.ray;
+    found->second.buffer.addRay(ray.start, ray.end, ray.time, ray.colour);
+    if (cache_)
+    {
+      Cell &cell = found->second;
+      cell.hash = TileCache::hash(ray.start.data(), 3 * sizeof(double), cell.hash);
+      cell.hash = TileCache::hash(ray.end.data(), 3 * sizeof(double), cell.hash);
+      cell.hash = TileCache::hash(&ray.time, sizeof(double), cell.hash);
+      cell.hash = TileCache::hash(&ray.colour, sizeof(RGBA), cell.hash);
+    }
+    num_buffered_++;
+  }
+
+  /// write out the buffers that are full, or all buffers when too many rays are buffered
+  void flush(bool all = false)
+  {
+    all = all || num_buffered_ >= kMaxBufferedRays;
+    std::vector<Cell *> direct, spill;
+    for (auto &cell : cells_)
+    {
+      const size_t count = cell.second.buffer.rayCount();
+      if (count > 0 && (all || count >= kCellFlushSize))
+      {
+        (cell.second.writer ? direct : spill).push_back(&cell.second);
+        num_buffered_ -= count;
+      }
+    }
+    // each direct cell has its own file, so these are written concurrently
+    auto write_direct = [this](Cell *cell) {
+      if (!cell->writer->writeChunk(cell->buffer))
+      {
+        success_ = false;
+      }
+      cell->buffer.clear();
+    };
+#if RAYLIB_WITH_TBB
+    tbb::parallel_for<size_t>(0u, direct.size(), [&](size_t i) { write_direct(direct[i]); });
+#else   // RAYLIB_WITH_TBB
+    for (auto &cell : direct)
+    {
+      write_direct(cell);
+    }
+#endif  // RAYLIB_WITH_TBB
+    for (auto &cell : spill)
+    {
+      std::ofstream &out = spillStream(*cell);
+      for (size_t i = 0; i < cell->buffer.rayCount(); i++)
+      {
+        const CellRay ray = { cell->buffer.starts[i], cell->buffer.ends[i], cell->buffer.times[i],
+                              cell->buffer.colours[i] };
+        writePlainOldData(out, ray);
+      }
+      if (out.fail())
+      {
+        success_ = false;
+      }
+      cell->buffer.clear();
+    }
+  }
+
+  /// write all remaining rays, and convert the spill files into ray cloud files
+  bool end()
+  {
+    flush(true);
+    for (auto &open : open_spills_)
+    {
+      open.second.close();
+    }
+    open_spills_.clear();
+    for (auto &cell : cells_)
+    {
+      if (cell.second.writer)
+      {
+        cell.second.writer->end();
+        cell.second.writer.reset();
+        cacheCell(cell.second);
+        continue;
+      }
+      const std::string spill_name = cell.second.name + ".spill";
+      if (unchanged(cell.second))
+      {
+        std::remove(spill_name.c_str());
+        continue;
+      }
+      std::ifstream in(spill_name, std::ios::binary | std::ios::in);
+      CloudWriter writer;
+      if (!writer.begin(cell.second.name))
+      {
+        success_ = false;
+        continue;
+      }
+      Cloud chunk;
+      CellRay ray;
+      for (;;)
+      {
+        readPlainOldData(in, ray);
+        if (in.fail())
+        {
+          break;
+        }
+        chunk.addRay(ray.start, ray.end, ray.time, ray.colour);
+        if (chunk.rayCount() >= kCellFlushSize)
+        {
+          writer.writeChunk(chunk);
+          chunk.clear();
+        }
+      }
+      writer.writeChunk(chunk);
+      writer.end();
+      in.close();
+      std::remove(spill_name.c_str());
+      cacheCell(cell.second);
+    }
+    return success_;
+  }
+
+private:
+  struct Cell
+  {
+    std::string name;
+    Cloud buffer;
+    std::unique_ptr<CloudWriter> writer;  // null for spilled cells
+    bool spill_started = false;
+    uint64_t hash = 0;  // of the cell's rays, with a cache
+  };
+  /// the size, modification time and hash of a cell's file, which the cache holds against the hash of its rays
+  struct CellStamp
+  {
+    uint64_t size;
+    int64_t modified;
+    uint64_t hash;
+  };
+
+  /// whether the rays of @c cell are the same as in the previous run, and its file has not changed since then
+  bool unchanged(const Cell &cell)
+  {
+    std::vector<CellStamp> cached;
+    CellStamp stamp;
+    return cache_ && cache_->find(cell.name, cell.hash, cached) && cached.size() == 1 &&
+           fileStamp(cell.name, stamp.size, stamp.modified, stamp.hash) && stamp.size == cached[0].size &&
+           stamp.modified == cached[0].modified && stamp.hash == cached[0].hash;
+  }
+  /// store the file stamp of a written cell in the cache
+  void cacheCell(const Cell &cell)
+  {
+    CellStamp stamp;
+    if (cache_ && fileStamp(cell.name, stamp.size, stamp.modified, stamp.hash))
+    {
+      cache_->store(cell.name, cell.hash, &stamp, sizeof(stamp));
+    }
+  }
+
+  /// the open spill stream of @c cell , closing the least recently used stream if too many are open
+  std::ofstream &spillStream(Cell &cell)
+  {
+    auto found = std::find_if(open_spills_.begin(), open_spills_.end(),
+                              [&cell](const std::pair<Cell *, std::ofstream> &open) { return open.first == &cell; });
+    if (found != open_spills_.end())
+    {
+      open_spills_.splice(open_spills_.begin(), open_spills_, found);
+      return open_spills_.front().second;
+    }
+    if (open_spills_.size() >= kMaxOpenSpills)
+    {
+      open_spills_.back().second.close();
+      open_spills_.pop_back();
+    }
+    open_spills_.emplace_front(&cell, std::ofstream());
+    const std::ios::openmode mode = cell.spill_started ? std::ios::app : std::ios::trunc;
+    open_spills_.front().second.open(cell.name + ".spill", std::ios::binary | std::ios::out | mode);
+    cell.spill_started = true;
+    return open_spills_.front().second;
+  }
+
+  std::function<std::string(const BinnedRay &binned)> cell_name_;
+  TileCache *cache_;
+  std::map<int64_t, Cell> cells_;
+  std::list<std::pair<Cell *, std::ofstream>> open_spills_;  // most recently used first
+  size_t num_direct_ = 0;
+  size_t num_buffered_ = 0;
+  std::atomic_bool success_{ true };
+};
+}  // namespace
+
 /// Special case for splitting based on a grid.
 bool splitGrid(const std::string &file_name, const std::string &cloud_name_stub, const Eigen::Vector4d &cell_width,
-               double overlap)
+               double overlap, const std::string &cache_file)
 {
+  ProfileScope profile("splitGrid");
   overlap /= 2.0;  // it now means overlap relative to grid edge
   Cloud::Info info;
-  Cloud::getInfo(cloud_name_stub + ".ply", info);
+  if (!Cloud::getInfo(file_name, info))
+    return false;
   const Eigen::Vector3d &min_bound = info.rays_bound.min_bound_;
   const Eigen::Vector3d &max_bound = info.rays_bound.max_bound_;
 
@@ -205,30 +521,40 @@ bool splitGrid(const std::string &file_name, const std::string &cloud_name_stub,
   const int time_dimension = static_cast<int>(
     max_time - min_time);  // the difference won't overflow integers. We don't scan for 20 years straight.
 
-  const int length = dimensions[0] * dimensions[1] * dimensions[2] * time_dimension;
-  const int max_allowable_cells = 1024;  // operating systems will fail with too many open file pointers.
+  const int64_t length = static_cast<int64_t>(dimensions[0]) * dimensions[1] * dimensions[2] * time_dimension;
   std::cout << "splitting into maximum of: " << length << " files" << std::endl;
-  if (length > 256)
+  TileCache cache;
+  if (!cache_file.empty())
   {
-    std::cout << "Warning: nominally more than 256 file pointers will be open at once." << std::endl;
-    std::cout << "If simultaneous open files exceeds your operating system maximum, some output data may be lost."
-              << std::endl;
-    std::cout << "Consider using a larger cell size." << std::endl;
-  }
-  if (length > max_allowable_cells)
-  {
-    std::cout << "Error: grid has nominally more cells than the maximum of " << max_allowable_cells << "." << std::endl;
-    return false;
+    std::ostringstream key;
+    key << std::setprecision(17) << "grid " << cloud_name_stub << " " << cell_width.transpose() << " " << overlap;
+    cache.open(cache_file, key.str());
   }
-  std::vector<CloudWriter> cells(length);
-  std::vector<Cloud> chunks(length);
+  auto cell_name = [&](const BinnedRay &binned) {
+    std::stringstream name;
+    name << cloud_name_stub;
+    for (int k = 0; k < 3; k++)
+    {
+      if (cell_width[k] > 0.0)
+        name << "_" << binned.coord[k];
+    }
+    if (cell_width[3] > 0.0)
+      name << "_" << binned.time_coord;
+    name << ".ply";
+    return name.str();
+  };
+  CellWriter cells(cell_name, cache.isOpen() ? &cache : nullptr);
 
-  // splitting performed per chunk
-  auto per_chunk = [&min_index, &max_index, &width, min_time, &dimensions, &cells, &chunks, length, &cell_width,
-                    &cloud_name_stub, &overlap](std::vector<Eigen::Vector3d> &starts,
-                                                std::vector<Eigen::Vector3d> &ends, std::vector<double> &times,
-                                                std::vector<RGBA> &colours) {
-    for (size_t i = 0; i < ends.size(); i++)
+  // bin and clip the rays from @c begin to @c end into @c binned , in ray order
+  auto bin_rays = [&](const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+                      const std::vector<double> &times, const std::vector<RGBA> &colours, size_t begin, size_t end,
+                      std::vector<BinnedRay> &binned) {
+    // the candidate cells of each ray, which it is clipped against together
+    CuboidBatch cell_boxes;
+    std::vector<std::pair<int64_t, Eigen::Vector3i>> cell_ids;
+    std::vector<double> near, far;
+    std::vector<char> end_inside;
+    for (size_t i = begin; i < end; i++)
     {
       // get set of cells that the ray may intersect
       const Eigen::Vector3d from(0.5 + starts[i][0] / width[0], 0.5 + starts[i][1] / width[1],
@@ -244,75 +570,251 @@ bool splitGrid(const std::string &file_name, const std::string &cloud_name_stub,
         maxI = minVector(maxI, max_index);
       }
       const long int t = static_cast<long int>(std::floor(0.5 + times[i] / width[3]));
+      cell_boxes.clear();
+      cell_ids.clear();
       for (int x = minI[0]; x < maxI[0]; x++)
       {
         for (int y = minI[1]; y < maxI[1]; y++)
         {
           for (int z = minI[2]; z < maxI[2]; z++)
           {
-            const int time_dif = static_cast<int>(t - min_time);
-            const int index = (x - min_index[0]) + dimensions[0] * (y - min_index[1]) +
-                              dimensions[0] * dimensions[1] * (z - min_index[2]) +
-                              dimensions[0] * dimensions[1] * dimensions[2] * time_dif;
+            const int64_t time_dif = t - min_time;
+            const int64_t index = (x - min_index[0]) + static_cast<int64_t>(dimensions[0]) * (y - min_index[1]) +
+                                  static_cast<int64_t>(dimensions[0]) * dimensions[1] * (z - min_index[2]) +
+                                  static_cast<int64_t>(dimensions[0]) * dimensions[1] * dimensions[2] * time_dif;
             if (index < 0 || index >= length)
             {
               std::cout << "Error: bad index: " << index << std::endl;  // this should not happen
               return;
             }
-            // do actual clipping here....
+            // the cell's bounds, with its overlap
             const Eigen::Vector3d box_min(((double)x - 0.5) * width[0] - overlap,
                                           ((double)y - 0.5) * width[1] - overlap, ((double)z - 0.5) * width[2]);
             const Eigen::Vector3d box_max(((double)x + 0.5) * width[0] + overlap,
                                           ((double)y + 0.5) * width[1] + overlap, ((double)z + 0.5) * width[2]);
-            const Cuboid cuboid(box_min, box_max);
-            Eigen::Vector3d start = starts[i];
-            Eigen::Vector3d end = ends[i];
-
-            if (cuboid.clipRay(start, end))
-            {
-              RGBA col = colours[i];
-              if (cells[index].fileName().empty())  // first time in this cell, so start writing to a new file
-              {
-                std::stringstream name;
-                name << cloud_name_stub;
-                if (cell_width[0] > 0.0)
-                  name << "_" << x;
-                if (cell_width[1] > 0.0)
-                  name << "_" << y;
-                if (cell_width[2] > 0.0)
-                  name << "_" << z;
-                if (cell_width[3] > 0.0)
-                  name << "_" << t;
-                name << ".ply";
-                cells[index].begin(name.str());
-              }
-              if (!cuboid.intersects(ends[i]))  // end point is outside, so mark an unbounded ray
-              {
-                col.red = col.green = col.blue = col.alpha = 0;
-              }
-              chunks[index].addRay(start, end, times[i], col);
-            }
+            cell_boxes.add(Cuboid(box_min, box_max));
+            cell_ids.push_back(std::make_pair(index, Eigen::Vector3i(x, y, z)));
+          }
+        }
+      }
+      if (cell_ids.empty())
+      {
+        continue;
+      }
+      cell_boxes.clipRay(starts[i], ends[i], near, far);
+      cell_boxes.intersects(ends[i], end_inside);
+      for (size_t c = 0; c < cell_ids.size(); c++)
+      {
+        Eigen::Vector3d start = starts[i];
+        Eigen::Vector3d end = ends[i];
+        if (Cuboid::clipToRange(near[c], far[c], start, end))
+        {
+          RGBA col = colours[i];
+          if (!end_inside[c])  // end point is outside, so mark an unbounded ray
+          {
+            col.red = col.green = col.blue = col.alpha = 0;
           }
+          const BinnedRay ray = { cell_ids[c].first, cell_ids[c].second, t, { start, end, times[i], col } };
+          binned.push_back(ray);
         }
       }
     }
-    for (int i = 0; i < length; i++)
+  };
+
+  // splitting performed per chunk. The rays are binned in parallel blocks, then added to their cells in ray order
+  const size_t block_size = 4096;
+  std::vector<std::vector<BinnedRay>> blocks;
+  auto per_chunk = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                       std::vector<double> &times, std::vector<RGBA> &colours) {
+    const size_t num_blocks = (ends.size() + block_size - 1) / block_size;
+    blocks.resize(num_blocks);
+    auto bin_block = [&](size_t b) {
+      blocks[b].clear();
+      bin_rays(starts, ends, times, colours, b * block_size, std::min(ends.size(), (b + 1) * block_size), blocks[b]);
+    };
+#if RAYLIB_WITH_TBB
+    tbb::parallel_for<size_t>(0u, num_blocks, bin_block);
+#else   // RAYLIB_WITH_TBB
+    for (size_t b = 0; b < num_blocks; b++)
     {
-      if (chunks[i].ends.size() > 0)
+      bin_block(b);
+    }
+#endif  // RAYLIB_WITH_TBB
+    for (const auto &block : blocks)
+    {
+      for (const auto &binned : block)
       {
-        cells[i].writeChunk(chunks[i]);
-        chunks[i].clear();
+        cells.add(binned);
       }
     }
+    cells.flush();
   };
   if (!Cloud::read(file_name, per_chunk))
     return false;
 
-  for (int i = 0; i < length; i++)
+  if (!cells.end())
+    return false;
+  if (cache.isOpen())
+    cache.save();
+  return true;
+}
+
+SplitRegion SplitRegion::tube(const std::string &name, const Eigen::Vector3d &start, const Eigen::Vector3d &end,
+                              double radius)
+{
+  SplitRegion region;
+  region.file_name = name;
+  region.is_tube = true;
+  region.start = start;
+  region.end = end;
+  region.radius = radius;
+  return region;
+}
+
+SplitRegion SplitRegion::box(const std::string &name, const Cuboid &box)
+{
+  SplitRegion region;
+  region.file_name = name;
+  region.is_tube = false;
+  region.start = box.min_bound_;
+  region.end = box.max_bound_;
+  region.radius = 0.0;
+  return region;
+}
+
+bool SplitRegion::contains(const Eigen::Vector3d &pos) const
+{
+  if (!is_tube)
+    return (pos.array() >= start.array()).all() && (pos.array() <= end.array()).all();
+  // the same arithmetic as raysplit's tube split, so that a tube region crops exactly the same rays
+  Eigen::Vector3d dir = end - start;
+  dir /= dir.dot(dir);
+  const double d = (pos - start).dot(dir);
+  if (d < 0.0 || d > 1.0)
+    return false;
+  const Eigen::Vector3d offset = pos + (start - end) * d;
+  return (offset - start).squaredNorm() <= radius * radius;
+}
+
+Cuboid SplitRegion::bounds() const
+{
+  if (!is_tube)
+    return Cuboid(start, end);
+  const Eigen::Vector3d extent(radius, radius, radius);
+  return Cuboid(minVector(start, end) - extent, maxVector(start, end) + extent);
+}
+
+bool splitRegions(const std::string &file_name, const std::vector<SplitRegion> &regions)
+{
+  ProfileScope profile("splitRegions");
+  if (regions.empty())
   {
-    cells[i].end();  // has no effect on writers where begin has not been called
+    std::cerr << "Error: no regions to split" << std::endl;
+    return false;
   }
-  return true;
+  // the columns are the median of the regions' narrower widths in x and y, so that a typical region spans only a few
+  // columns, and a typical column is spanned by only a few regions
+  std::vector<double> widths;
+  for (const auto &region : regions)
+  {
+    const Cuboid bounds = region.bounds();
+    const Eigen::Vector3d extent = bounds.max_bound_ - bounds.min_bound_;
+    widths.push_back(std::min(extent[0], extent[1]));
+  }
+  std::nth_element(widths.begin(), widths.begin() + widths.size() / 2, widths.end());
+  const double column_width = std::max(widths[widths.size() / 2], 1e-3);
+  auto column_of = [column_width](double x) { return static_cast<int64_t>(std::floor(x / column_width)); };
+  auto column_key = [](int64_t x, int64_t y) { return (x << 32) ^ (y & 0xffffffff); };
+
+  // bin each region into the columns it may overlap. Long tubes are swept along their length, so that a diagonal
+  // corridor only fills the columns along it, not its whole bounding box
+  std::unordered_map<int64_t, std::vector<int>> columns;
+  std::vector<int64_t> keys;
+  for (size_t r = 0; r < regions.size(); r++)
+  {
+    const SplitRegion &region = regions[r];
+    keys.clear();
+    auto add_square = [&](const Eigen::Vector3d &min_bound, const Eigen::Vector3d &max_bound) {
+      for (int64_t x = column_of(min_bound[0]); x <= column_of(max_bound[0]); x++)
+      {
+        for (int64_t y = column_of(min_bound[1]); y <= column_of(max_bound[1]); y++)
+        {
+          keys.push_back(column_key(x, y));
+        }
+      }
+    };
+    if (region.is_tube)
+    {
+      const Eigen::Vector3d extent(region.radius, region.radius, 0.0);
+      const Eigen::Vector3d axis = region.end - region.start;
+      const double step = 0.5 * std::max(column_width, region.radius);
+      const int num_steps = 1 + static_cast<int>(std::ceil(axis.head<2>().norm() / step));
+      for (int i = 0; i <= num_steps; i++)
+      {
+        // each step's square covers the tube between its neighbouring steps
+        const Eigen::Vector3d pos = region.start + axis * (static_cast<double>(i) / static_cast<double>(num_steps));
+        const Eigen::Vector3d margin = extent + Eigen::Vector3d(step, step, 0.0);
+        add_square(pos - margin, pos + margin);
+      }
+      std::sort(keys.begin(), keys.end());
+      keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    }
+    else
+    {
+      add_square(region.start, region.end);
+    }
+    for (const auto &key : keys)
+    {
+      columns[key].push_back(static_cast<int>(r));
+    }
+  }
+
+  CellWriter cells([&regions](const BinnedRay &binned) { return regions[binned.index].file_name; });
+  const size_t block_size = 4096;
+  std::vector<std::vector<BinnedRay>> blocks;
+  auto per_chunk = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                       std::vector<double> &times, std::vector<RGBA> &colours) {
+    profile.count(ends.size());
+    const size_t num_blocks = (ends.size() + block_size - 1) / block_size;
+    blocks.resize(num_blocks);
+    // the rays are tested against their column's regions in parallel blocks, then added to the regions in ray order
+    auto bin_block = [&](size_t b) {
+      blocks[b].clear();
+      for (size_t i = b * block_size; i < std::min(ends.size(), (b + 1) * block_size); i++)
+      {
+        const auto found = columns.find(column_key(column_of(ends[i][0]), column_of(ends[i][1])));
+        if (found == columns.end())
+          continue;
+        for (const auto &r : found->second)
+        {
+          if (regions[r].contains(ends[i]))
+          {
+            const BinnedRay ray = { r, Eigen::Vector3i(0, 0, 0), 0, { starts[i], ends[i], times[i], colours[i] } };
+            blocks[b].push_back(ray);
+          }
+        }
+      }
+    };
+#if RAYLIB_WITH_TBB
+    tbb::parallel_for<size_t>(0u, num_blocks, bin_block);
+#else   // RAYLIB_WITH_TBB
+    for (size_t b = 0; b < num_blocks; b++)
+    {
+      bin_block(b);
+    }
+#endif  // RAYLIB_WITH_TBB
+    for (const auto &block : blocks)
+    {
+      for (const auto &binned : block)
+      {
+        cells.add(binned);
+      }
+    }
+    cells.flush();
+  };
+  if (!Cloud::read(file_name, per_chunk))
+    return false;
+  return cells.end();
 }
 
 class RGBALess
@@ -9,11 +9,63 @@
 #include <iostream>
 #include <limits>
 #include "raycloud.h"
+#include "raycloudwriter.h"
+#include "raycuboid.h"
+#include "raymesh.h"
 #include "rayutils.h"
 
 namespace ray
 {
-/// Split a file into @c in_name or @c out_name depending on the function @c is_outside.
+/// A set of splits performed together, in a single read of the input file. Each split writes its own pair of inside
+/// and outside files, as the single split functions below do, so several splits of one large file cost one read
+/// rather than one each.
+class RAYLIB_EXPORT SplitPlan
+{
+public:
+  /// A split of one chunk of rays, which adds each ray, or the parts of it, to @c in_chunk or @c out_chunk
+  using SplitFunction = std::function<void(const Cloud &chunk, Cloud &in_chunk, Cloud &out_chunk)>;
+
+  /// add a general split, writing to @c in_name and @c out_name
+  void add(const std::string &in_name, const std::string &out_name, SplitFunction split_function);
+  /// add a split of whole rays, according to @c is_outside , as @c split()
+  void addPredicate(const std::string &in_name, const std::string &out_name,
+                    std::function<bool(const Cloud &cloud, int i)> is_outside);
+  /// add a split around a plane, as @c splitPlane()
+  void addPlane(const std::string &in_name, const std::string &out_name, const Eigen::Vector3d &plane);
+  /// add a split around a cuboid, as @c splitBox()
+  void addBox(const std::string &in_name, const std::string &out_name, const Eigen::Vector3d &centre,
+              const Eigen::Vector3d &extents);
+  /// add a split around a mesh, as @c splitMesh()
+  void addMesh(const std::string &in_name, const std::string &out_name, const Mesh &mesh, double offset);
+
+  /// the number of splits in the plan
+  inline size_t size() const { return splits_.size(); }
+
+  /// perform every split on @c file_name , in one read of the file. The splits of each chunk are run in parallel
+  /// when built with TBB
+  bool run(const std::string &file_name);
+
+  /// open the inside and outside files of every split, for splitting chunks that are not read from a file
+  bool begin();
+  /// perform every split on @c chunk , writing the parts to the files opened by @c begin()
+  void splitChunk(const Cloud &chunk);
+  /// finish writing the files of every split
+  void end();
+
+private:
+  struct Split
+  {
+    std::string in_name;
+    std::string out_name;
+    SplitFunction split_function;
+  };
+  std::vector<Split> splits_;
+  std::vector<CloudWriter> in_writers_, out_writers_;
+  std::vector<Cloud> in_chunks_, out_chunks_;
+};
+
+/// Split a file into @c in_name or @c out_name depending on the function @c is_outside. This is called in parallel
+/// (see @c Cloud::partition ), so must be safe to call from several threads.
 bool RAYLIB_EXPORT split(const std::string &file_name, const std::string &in_name, const std::string &out_name,
                          std::function<bool(const Cloud &cloud, int i)> is_outside);
 
@@ -28,17 +80,57 @@ bool RAYLIB_EXPORT splitPlane(const std::string &file_name, const std::string &i
 bool RAYLIB_EXPORT splitBox(const std::string &file_name, const std::string &in_name, const std::string &out_name,
                             const Eigen::Vector3d &centre, const Eigen::Vector3d &extents);
 
+/// Split a ray cloud around the surface of @c mesh , offset by @c offset , as @c Mesh::splitCloud does. The mesh is
+/// indexed once and the cloud is streamed a chunk at a time, so the cloud does not need to fit in memory
+bool RAYLIB_EXPORT splitMesh(const std::string &file_name, const std::string &in_name, const std::string &out_name,
+                             const Mesh &mesh, double offset);
+
 /// Split a ray cloud into a grid of files, named with suffix _X_Y_Z.ply, for each grid coordinate X,Y,Z.
 /// Aligned so that cell 0,0,0 is centred at 0,0,0, and has dimensions @c cell_width
 /// @c overlap generates larger cells so that they overlap by the specified value
+/// There is no limit on the number of cells. Beyond a few hundred cells, the rays of later cells are held in
+/// temporary .spill files beside the outputs until the input has been read.
+/// With a @c cache_file , a @c TileCache of the hash of each cell's rays is kept, and the file of a cell whose rays are
+/// the same as in the previous split is left as it is, rather than written again.
 bool RAYLIB_EXPORT splitGrid(const std::string &file_name, const std::string &cloud_name_stub,
-                             const Eigen::Vector3d &cell_width, double overlap = 0.0);
+                             const Eigen::Vector3d &cell_width, double overlap = 0.0,
+                             const std::string &cache_file = "");
 
 /// Split a ray cloud into a grid of files, named with suffix _X_Y_Z_T.ply, for each grid coordinate X,Y,Z,T.
 /// Aligned so that cell 0,0,0,0 is centred at 0,0,0,0 and has dimensions @c cell_width
 /// @c overlap generates larger cells so that they overlap by the specified value
 bool RAYLIB_EXPORT splitGrid(const std::string &file_name, const std::string &cloud_name_stub,
-                             const Eigen::Vector4d &cell_width, double overlap = 0.0);
+                             const Eigen::Vector4d &cell_width, double overlap = 0.0,
+                             const std::string &cache_file = "");
+
+/// A region of @c splitRegions , which is either a box, or a tube of @c radius around the line segment from @c start to
+/// @c end , as in raysplit's tube split.
+struct RAYLIB_EXPORT SplitRegion
+{
+  /// a tube region, cropped to file @c name
+  static SplitRegion tube(const std::string &name, const Eigen::Vector3d &start, const Eigen::Vector3d &end,
+                          double radius);
+  /// a box region, cropped to file @c name
+  static SplitRegion box(const std::string &name, const Cuboid &box);
+
+  /// whether a ray ending at @c pos is in the region
+  bool contains(const Eigen::Vector3d &pos) const;
+  /// the bounds of the region
+  Cuboid bounds() const;
+
+  std::string file_name;
+  bool is_tube;
+  Eigen::Vector3d start, end;  // the box's minimum and maximum for box regions
+  double radius;
+};
+
+/// Crop a ray cloud into a file per region, in a single read of the file. Each file receives the rays that end
+/// inside its region, so rays are copied to every region that they end in, and regions may overlap. The regions are
+/// binned into a grid of columns in x and y, so each ray is only tested against the few regions near its end.
+/// Thousands of regions can be cropped at once, as beyond a few hundred, the rays of later regions are held in
+/// temporary .spill files beside the outputs until the input has been read. No file is written for regions without
+/// any rays.
+bool RAYLIB_EXPORT splitRegions(const std::string &file_name, const std::vector<SplitRegion> &regions);
 
 /// Split a ray cloud into one cloud per colour, ignoring differences in alpha. For example, when identified objects in
 /// the cloud are given a unique colour
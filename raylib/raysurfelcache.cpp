@@ -0,0 +1,239 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raysurfelcache.h"
+#include "rayplyindex.h"
+#include "rayremotefile.h"
+#include "raythreads.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace ray
+{
+namespace
+{
+const char kSurfelCacheMagic[4] = { 'R', 'S', 'F', 'C' };
+const uint32_t kSurfelCacheVersion = 1;
+
+/// the outputs held in a surfel cache, in the order that they are stored
+enum SurfelOutputs : uint32_t
+{
+  kSOCentroids = 1,
+  kSONormals = 2,
+  kSODimensions = 4,
+  kSOMatrices = 8,
+  kSONeighbours = 16
+};
+
+std::atomic<bool> &surfelCacheFlag()
+{
+  static std::atomic<bool> enabled{ [] {
+    const char *value = std::getenv("RAYCLOUD_SURFEL_CACHE");
+    return value != nullptr && std::strcmp(value, "0") != 0 && value[0] != '\0';
+  }() };
+  return enabled;
+}
+
+uint32_t requestedOutputs(const SurfelRequest &request)
+{
+  return (request.centroids ? kSOCentroids : 0u) | (request.normals ? kSONormals : 0u) |
+         (request.dimensions ? kSODimensions : 0u) | (request.mats ? kSOMatrices : 0u) |
+         (request.neighbour_indices ? kSONeighbours : 0u);
+}
+
+template <class T>
+void writeValue(std::ofstream &out, const T &value)
+{
+  out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <class T>
+void readValue(std::ifstream &in, T &value)
+{
+  in.read(reinterpret_cast<char *>(&value), sizeof(T));
+}
+
+/// read an array of @c num_bytes into @c data , or skip over it when @c data is null
+void readArray(std::ifstream &in, void *data, size_t num_bytes)
+{
+  if (data)
+    in.read(reinterpret_cast<char *>(data), static_cast<std::streamsize>(num_bytes));
+  else
+    in.seekg(static_cast<std::streamoff>(num_bytes), std::ios::cur);
+}
+
+uint64_t mix(uint64_t hash, double value)
+{
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  hash ^= bits + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2);
+  return hash;
+}
+}  // namespace
+
+bool surfelCacheEnabled()
+{
+  return surfelCacheFlag();
+}
+
+void setSurfelCacheEnabled(bool enabled)
+{
+  surfelCacheFlag() = enabled;
+}
+
+std::string surfelCacheFileName(const std::string &cloud_file_name)
+{
+  return cloud_file_name + ".surfels";
+}
+
+uint64_t surfelCacheRaysHash(const Cloud &cloud)
+{
+  // the per-ray hashes are summed, so the result does not depend on how the reduction is grouped
+  return parallelReduce(
+    size_t(0), cloud.ends.size(), uint64_t(cloud.ends.size()),
+    [&](size_t i, uint64_t &hash) {
+      uint64_t ray_hash = static_cast<uint64_t>(i) * 0xff51afd7ed558ccdull;
+      for (int j = 0; j < 3; j++)
+      {
+        ray_hash = mix(ray_hash, cloud.starts[i][j]);
+        ray_hash = mix(ray_hash, cloud.ends[i][j]);
+      }
+      hash += ray_hash;
+    },
+    [](uint64_t a, uint64_t b) { return a + b; });
+}
+
+bool readSurfelCache(const Cloud &cloud, const std::string &cloud_file_name, const SurfelRequest &request)
+{
+  const std::string cache_file_name = surfelCacheFileName(cloud_file_name);
+  std::ifstream in(cache_file_name, std::ios::in | std::ios::binary);
+  if (in.fail())
+  {
+    return false;  // not an error, the cache is optional
+  }
+  uint64_t size, stored_size, hash, stored_hash, stored_rays_hash, num_rays;
+  int64_t modified, stored_modified;
+  if (!fileStamp(cloud_file_name, size, modified, hash))
+  {
+    return false;
+  }
+  char magic[4];
+  uint32_t version, outputs;
+  int32_t search_size;
+  double max_distance;
+  uint8_t reject_back_facing_rays;
+  in.read(magic, 4);
+  readValue(in, version);
+  readValue(in, stored_size);
+  readValue(in, stored_modified);
+  readValue(in, stored_hash);
+  readValue(in, stored_rays_hash);
+  readValue(in, num_rays);
+  readValue(in, search_size);
+  readValue(in, max_distance);
+  readValue(in, reject_back_facing_rays);
+  readValue(in, outputs);
+  if (!in || std::memcmp(magic, kSurfelCacheMagic, 4) != 0 || version != kSurfelCacheVersion)
+  {
+    std::cout << "warning: ignoring unrecognised surfel cache " << cache_file_name << std::endl;
+    return false;
+  }
+  if (stored_size != size || stored_modified != modified || stored_hash != hash)
+  {
+    std::cout << "surfel cache " << cache_file_name << " is out of date, " << cloud_file_name
+              << " has changed since it was written" << std::endl;
+    return false;
+  }
+  const uint32_t requested = requestedOutputs(request);
+  if (num_rays != cloud.ends.size() || search_size != request.search_size || max_distance != request.max_distance ||
+      (reject_back_facing_rays != 0) != request.reject_back_facing_rays || (outputs & requested) != requested)
+  {
+    return false;  // cached for other settings or outputs
+  }
+  if (stored_rays_hash != surfelCacheRaysHash(cloud))
+  {
+    return false;  // the cloud has been changed since it was loaded
+  }
+
+  const size_t n = static_cast<size_t>(num_rays);
+  if (request.centroids)
+    request.centroids->resize(n);
+  if (request.normals)
+    request.normals->resize(n);
+  if (request.dimensions)
+    request.dimensions->resize(n);
+  if (request.mats)
+    request.mats->resize(n);
+  if (request.neighbour_indices)
+    request.neighbour_indices->resize(search_size, static_cast<Eigen::Index>(n));
+  if (outputs & kSOCentroids)
+    readArray(in, request.centroids ? request.centroids->data() : nullptr, n * sizeof(Eigen::Vector3d));
+  if (outputs & kSONormals)
+    readArray(in, request.normals ? request.normals->data() : nullptr, n * sizeof(Eigen::Vector3d));
+  if (outputs & kSODimensions)
+    readArray(in, request.dimensions ? request.dimensions->data() : nullptr, n * sizeof(Eigen::Vector3d));
+  if (outputs & kSOMatrices)
+    readArray(in, request.mats ? request.mats->data() : nullptr, n * sizeof(Eigen::Matrix3d));
+  if (outputs & kSONeighbours)
+    readArray(in, request.neighbour_indices ? request.neighbour_indices->data() : nullptr,
+              n * static_cast<size_t>(search_size) * sizeof(int));
+  if (!in)
+  {
+    std::cout << "warning: ignoring truncated surfel cache " << cache_file_name << std::endl;
+    return false;
+  }
+  std::cout << "read surfels from " << cache_file_name << std::endl;
+  return true;
+}
+
+bool writeSurfelCache(const Cloud &cloud, const std::string &cloud_file_name, const SurfelRequest &request)
+{
+  if (isRemoteFileName(cloud_file_name))
+  {
+    return false;  // sidecars are only kept beside local files
+  }
+  uint64_t size, hash;
+  int64_t modified;
+  if (!fileStamp(cloud_file_name, size, modified, hash))
+  {
+    return false;
+  }
+  const std::string cache_file_name = surfelCacheFileName(cloud_file_name);
+  std::ofstream out(cache_file_name, std::ios::binary | std::ios::out);
+  if (out.fail())
+  {
+    std::cerr << "Error: cannot open " << cache_file_name << " for writing." << std::endl;
+    return false;
+  }
+  const size_t n = cloud.ends.size();
+  out.write(kSurfelCacheMagic, 4);
+  writeValue(out, kSurfelCacheVersion);
+  writeValue(out, size);
+  writeValue(out, modified);
+  writeValue(out, hash);
+  writeValue(out, surfelCacheRaysHash(cloud));
+  writeValue(out, static_cast<uint64_t>(n));
+  writeValue(out, static_cast<int32_t>(request.search_size));
+  writeValue(out, request.max_distance);
+  writeValue(out, static_cast<uint8_t>(request.reject_back_facing_rays ? 1 : 0));
+  writeValue(out, requestedOutputs(request));
+  if (request.centroids)
+    out.write(reinterpret_cast<const char *>(request.centroids->data()), n * sizeof(Eigen::Vector3d));
+  if (request.normals)
+    out.write(reinterpret_cast<const char *>(request.normals->data()), n * sizeof(Eigen::Vector3d));
+  if (request.dimensions)
+    out.write(reinterpret_cast<const char *>(request.dimensions->data()), n * sizeof(Eigen::Vector3d));
+  if (request.mats)
+    out.write(reinterpret_cast<const char *>(request.mats->data()), n * sizeof(Eigen::Matrix3d));
+  if (request.neighbour_indices)
+    out.write(reinterpret_cast<const char *>(request.neighbour_indices->data()),
+              n * static_cast<size_t>(request.search_size) * sizeof(int));
+  return out.good();
+}
+}  // namespace ray
@@ -0,0 +1,56 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYSURFELCACHE_H
+#define RAYLIB_RAYSURFELCACHE_H
+
+#include "raylib/raylibconfig.h"
+
+#include "raycloud.h"
+
+namespace ray
+{
+/// A surfel cache is a sidecar file (cloud.ply.surfels) holding the outputs of a @c Cloud::getSurfels call on a ray
+/// cloud file, so that a chain of tools over the same cloud (e.g. raycolour then raydenoise) does not repeat the
+/// neighbour search. It records the stamp of its cloud file (see @c fileStamp ), a hash of the rays, and the surfel
+/// settings, and is ignored when any of these differ. The outputs are stored at full precision, so a cached result
+/// is identical to a calculated one. Only the requested outputs are stored, a later call requesting more of them
+/// recalculates and replaces the cache.
+
+/// The settings and outputs of a @c Cloud::getSurfels call. Null outputs are not requested.
+struct RAYLIB_EXPORT SurfelRequest
+{
+  int search_size;
+  double max_distance;
+  bool reject_back_facing_rays;
+  std::vector<Eigen::Vector3d> *centroids;
+  std::vector<Eigen::Vector3d> *normals;
+  std::vector<Eigen::Vector3d> *dimensions;
+  std::vector<Eigen::Matrix3d> *mats;
+  Eigen::MatrixXi *neighbour_indices;
+};
+
+/// whether @c Cloud::getSurfels reads and writes surfel caches. It is off by default, and turned on by setting the
+/// environment variable RAYCLOUD_SURFEL_CACHE=1, or by @c setSurfelCacheEnabled
+bool RAYLIB_EXPORT surfelCacheEnabled();
+void RAYLIB_EXPORT setSurfelCacheEnabled(bool enabled);
+
+/// the file name of the surfel cache sidecar for a ray cloud file
+std::string RAYLIB_EXPORT surfelCacheFileName(const std::string &cloud_file_name);
+
+/// a hash of the starts and ends of @c cloud , which tells whether it has changed since it was loaded
+uint64_t RAYLIB_EXPORT surfelCacheRaysHash(const Cloud &cloud);
+
+/// read the outputs of @c request for @c cloud , loaded from @c cloud_file_name , from its surfel cache. Returns false
+/// if there is no cache, if it is out of date, or if it does not hold all of the requested outputs.
+bool RAYLIB_EXPORT readSurfelCache(const Cloud &cloud, const std::string &cloud_file_name,
+                                   const SurfelRequest &request);
+
+/// write the (calculated) outputs of @c request for @c cloud to the surfel cache of @c cloud_file_name
+bool RAYLIB_EXPORT writeSurfelCache(const Cloud &cloud, const std::string &cloud_file_name,
+                                    const SurfelRequest &request);
+}  // namespace ray
+
+#endif  // RAYLIB_RAYSURFELCACHE_H
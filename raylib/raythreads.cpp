@@ -5,27 +5,97 @@
 // Author: Kazys Stepanas
 #include "raythreads.h"
 
-#include "rayunused.h"
+#include "raynuma.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
 
 #if RAYLIB_WITH_TBB
-#include <tbb/task_scheduler_init.h>
+#include <tbb/global_control.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_scheduler_observer.h>
 #endif  // RAYLIB_WITH_TBB
 
+#if RAYLIB_WITH_TBB && defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif  // RAYLIB_WITH_TBB && defined(__linux__)
+
 using namespace ray;
 
 namespace
 {
 #if RAYLIB_WITH_TBB
-std::unique_ptr<tbb::task_scheduler_init> scheduler;
+std::unique_ptr<tbb::global_control> scheduler;
 #endif  // RAYLIB_WITH_TBB
+int initialised_thread_count = 0;  // 0 until init() is called
+int requested_thread_count = 0;    // the argument of the last init() call
+
+#if RAYLIB_WITH_TBB && defined(__linux__)
+/// Pins each thread to the next of @c cpus the first time that it joins the pool while pinning is on. Threads that
+/// leave and rejoin keep their CPU, until pinning is turned off, when they return to their former CPUs as they rejoin.
+class PinningObserver : public tbb::task_scheduler_observer
+{
+public:
+  explicit PinningObserver(const std::vector<int> &cpus)
+    : cpus_(cpus)
+  {
+    observe(true);
+  }
+  ~PinningObserver() override { observe(false); }
+
+  void on_scheduler_entry(bool) override
+  {
+    thread_local bool pinned = false;
+    thread_local cpu_set_t former;
+    if (cpus_.empty() || pinned == pinning_)
+      return;
+    if (pinned)
+    {
+      pthread_setaffinity_np(pthread_self(), sizeof(former), &former);
+      pinned = false;
+      return;
+    }
+    pthread_getaffinity_np(pthread_self(), sizeof(former), &former);
+    pinned = true;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpus_[next_++ % cpus_.size()], &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  }
+  void setPinning(bool pinning) { pinning_ = pinning; }
+
+private:
+  std::vector<int> cpus_;
+  std::atomic<size_t> next_{ 0 };
+  std::atomic<bool> pinning_{ true };
+};
+std::unique_ptr<PinningObserver> pinning;
+#endif  // RAYLIB_WITH_TBB && defined(__linux__)
+
+/// Parse @c text as a positive integer, returning 0 if it isn't one
+int parsePositiveInt(const char *text)
+{
+  char *end = nullptr;
+  const long value = std::strtol(text, &end, 10);
+  if (end == text || *end != '\0' || value <= 0 || value > 1 << 16)
+  {
+    return 0;
+  }
+  return static_cast<int>(value);
+}
 }  // namespace
 
 int Threads::availableThreads()
 {
 #if RAYLIB_WITH_TBB
-  return tbb::task_scheduler_init::default_num_threads();
+  return tbb::this_task_arena::max_concurrency();
 #else   // RAYLIB_WITH_TBB
-  return 1;  // Single threaded.
+  return std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
 #endif  // RAYLIB_WITH_TBB
 }
 
@@ -50,22 +120,92 @@ int Threads::recommendedThreadCount()
 
 void Threads::init(int thread_count)
 {
+  if (initialised_thread_count > 0 && thread_count == requested_thread_count)
+  {
+    return;  // keep the scheduler, for the commands of a multi-call process that use the same count
+  }
+  requested_thread_count = thread_count;
+#if RAYLIB_WITH_TBB
+  scheduler.reset();  // so availableThreads() is not capped by a previous call
+#endif  // RAYLIB_WITH_TBB
+  int init_thread_count = availableThreads();
+  if (thread_count == ThreadCountRecommended)
+  {
+    init_thread_count = recommendedThreadCount();
+  }
+  else if (thread_count > 0)
+  {
+    init_thread_count = thread_count;
+  }
+  initialised_thread_count = init_thread_count;
 #if RAYLIB_WITH_TBB
-  if (!scheduler)
+  scheduler = std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism,
+                                                    static_cast<size_t>(init_thread_count));
+#endif  // RAYLIB_WITH_TBB
+}
+
+
+void Threads::initFromArguments(int &argc, char *argv[], int default_count)
+{
+  int thread_count = default_count;
+  for (int i = 1; i < argc - 1; i++)
   {
-    // Translate to TBB thread count
-    int init_thread_count = tbb::task_scheduler_init::automatic;
-    if (thread_count == ThreadCountRecommended)
+    if (std::strcmp(argv[i], "--threads") != 0)
     {
-      init_thread_count = recommendedThreadCount();
+      continue;
     }
-    else if (thread_count > 0)
+    const int count = parsePositiveInt(argv[i + 1]);
+    if (count > 0)
     {
-      init_thread_count = thread_count;
+      thread_count = count;
+      for (int j = i + 2; j <= argc; j++)
+      {
+        argv[j - 2] = argv[j];  // includes the terminating null pointer
+      }
+      argc -= 2;
     }
-    scheduler = std::make_unique<tbb::task_scheduler_init>(init_thread_count);
+    break;
   }
-#else   // RAYLIB_WITH_TBB
-  RAYLIB_UNUSED(thread_count);
-#endif  // RAYLIB_WITH_TBB
+  for (int i = 1; i < argc; i++)
+  {
+    if (std::strcmp(argv[i], "--pin_threads") == 0)
+    {
+      for (int j = i + 1; j <= argc; j++)
+      {
+        argv[j - 1] = argv[j];
+      }
+      argc--;
+      pin();
+      break;
+    }
+  }
+  init(thread_count);
+}
+
+
+int Threads::threadCount()
+{
+  return initialised_thread_count > 0 ? initialised_thread_count : availableThreads();
+}
+
+
+void Threads::pin()
+{
+#if RAYLIB_WITH_TBB && defined(__linux__)
+  if (!pinning)
+  {
+    pinning = std::make_unique<PinningObserver>(Numa::cpus());
+  }
+  pinning->setPinning(true);
+#endif  // RAYLIB_WITH_TBB && defined(__linux__)
+}
+
+void Threads::unpin()
+{
+#if RAYLIB_WITH_TBB && defined(__linux__)
+  if (pinning)
+  {
+    pinning->setPinning(false);
+  }
+#endif  // RAYLIB_WITH_TBB && defined(__linux__)
 }
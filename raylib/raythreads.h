@@ -7,19 +7,28 @@
 #define RAYTHREADS_H
 
 #include "raylib/raylibconfig.h"
+#include "raylib/rayprogress.h"
+#include "raylib/rayunused.h"
 
 #include <memory>
 
+#if RAYLIB_WITH_TBB
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+#endif  // RAYLIB_WITH_TBB
+
 namespace ray
 {
 /// A utility class for initialising the thread pool size.
 ///
 /// Typical usage is to call @c init() at the start of your program. This is optional and it not specified, all
-/// available threads will be used.
-///
-/// Note: some parts of the program may use threads even when Intel TBB is not availabe (via OpenMP).
+/// available threads will be used. The tools call @c initFromArguments() instead, so each accepts a common
+/// @c --threads N option, and @c --pin_threads .
 ///
-/// @todo Also cap OpenMP thread usage.
+/// When built with Intel TBB the pool is TBB's work stealing scheduler, shared by @c parallelFor() ,
+/// @c parallelReduce() and any direct use of TBB. The thread count also caps the library's own worker threads, such as
+/// the ply decoders, and the FFTW plans.
 class RAYLIB_EXPORT Threads
 {
 public:
@@ -31,17 +40,104 @@ public:
   /// The maximum number of threads to use for @c recommendedThreadCount() .
   static const int MaxRecommendedThreads = 8;
 
-  /// Returns the number of available threads. When built with Intel TBB, this returns the number of available
-  /// processors. Without TBB, this returns 1.
+  /// Returns the number of available threads. When built with Intel TBB, this is the concurrency TBB would use by
+  /// default, which respects the process affinity mask. Without TBB it is the number of hardware threads.
   static int availableThreads();
 
   /// Query the recommended thread count. This is set at least two threads if available, prefering one less than the
   /// @c availableThreads() up to @c MaxRecommendedThreads threads.
   static int recommendedThreadCount();
 
-  /// Initialise the thread count.
+  /// Initialise the thread count. This may be called again to change the count, which then applies to subsequent
+  /// parallel work. A call with the same @c thread_count as the last keeps the current scheduler.
   static void init(int thread_count = ThreadCountRecommended);
+
+  /// Remove a @c --threads N option from the command line arguments, and initialise the thread count to N, or to
+  /// @c default_count when the option is absent. An N that is not a positive integer is left in the arguments, for
+  /// the tool's own argument parsing to reject. A @c --pin_threads option is also removed, and calls @c pin() .
+  static void initFromArguments(int &argc, char *argv[], int default_count = ThreadCountAll);
+
+  /// The number of threads that parallel work may use, as set by @c init() , or @c availableThreads() if it has not
+  /// been called.
+  static int threadCount();
+
+  /// Pin each thread of the pool to its own CPU as it joins, taking the CPUs in the order of @c Numa::cpus() , so that
+  /// the threads stay on the memory nodes of the pages that they first touched. This needs TBB on Linux, and is
+  /// otherwise ignored. @c initFromArguments() calls it for a @c --pin_threads option.
+  static void pin();
+  /// Stop pinning the threads of the pool. The pinned threads return to their former CPUs as they next join the pool.
+  static void unpin();
 };
+
+/// Call @c func(i) for each index i from @c begin up to @c end . This runs in parallel on the thread pool when built
+/// with TBB, otherwise in order. Each call must only modify data owned by its own index.
+template <class Index, class Func>
+void parallelFor(Index begin, Index end, const Func &func)
+{
+#if RAYLIB_WITH_TBB
+  tbb::parallel_for(begin, end, func);
+#else   // RAYLIB_WITH_TBB
+  for (Index i = begin; i < end; i++)
+  {
+    func(i);
+  }
+#endif  // RAYLIB_WITH_TBB
+}
+
+/// As above, also adding the indices done to @c progress , once per range of indices rather than once per index, so
+/// that the threads do not contend on the shared progress value. @c progress may be null. When built without TBB the
+/// indices are added in batches, as with @c ProgressBatch .
+template <class Index, class Func>
+void parallelFor(Index begin, Index end, const Func &func, Progress *progress)
+{
+#if RAYLIB_WITH_TBB
+  tbb::parallel_for(tbb::blocked_range<Index>(begin, end), [&](const tbb::blocked_range<Index> &range) {
+    for (Index i = range.begin(); i != range.end(); i++)
+    {
+      func(i);
+    }
+    if (progress)
+    {
+      progress->increment(static_cast<size_t>(range.end() - range.begin()));
+    }
+  });
+#else   // RAYLIB_WITH_TBB
+  ProgressBatch batch(progress);
+  for (Index i = begin; i < end; i++)
+  {
+    func(i);
+    batch.increment();
+  }
+#endif  // RAYLIB_WITH_TBB
+}
+
+/// Reduce the indices from @c begin up to @c end into a value, starting from @c identity . @c accumulate(i, value)
+/// adds index i into a partial value, and @c combine(a, b) returns the combination of two partial values. This runs
+/// in parallel on the thread pool when built with TBB, otherwise in order. The grouping of the partial values varies
+/// between parallel runs, so floating point sums can differ in their last bits.
+template <class Index, class T, class Accumulate, class Combine>
+T parallelReduce(Index begin, Index end, const T &identity, const Accumulate &accumulate, const Combine &combine)
+{
+#if RAYLIB_WITH_TBB
+  return tbb::parallel_reduce(tbb::blocked_range<Index>(begin, end), identity,
+                              [&](const tbb::blocked_range<Index> &range, T value) {
+                                for (Index i = range.begin(); i != range.end(); i++)
+                                {
+                                  accumulate(i, value);
+                                }
+                                return value;
+                              },
+                              combine);
+#else   // RAYLIB_WITH_TBB
+  RAYLIB_UNUSED(combine);
+  T value = identity;
+  for (Index i = begin; i < end; i++)
+  {
+    accumulate(i, value);
+  }
+  return value;
+#endif  // RAYLIB_WITH_TBB
+}
 }  // namespace ray
 
 #endif  // RAYTHREADS_H
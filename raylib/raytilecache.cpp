@@ -0,0 +1,273 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raytilecache.h"
+#include "raycloud.h"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace ray
+{
+namespace
+{
+const char kTileCacheMagic[4] = { 'R', 'T', 'C', 'H' };
+const uint32_t kTileCacheVersion = 1;
+// an entry longer than this is taken to be corrupt, rather than allocated
+const uint64_t kMaxEntrySize = uint64_t(1) << 40;
+
+std::atomic<bool> &cacheEnabled()
+{
+  static std::atomic<bool> enabled(false);
+  return enabled;
+}
+
+template <class T>
+void writeValue(std::ostream &out, const T &value)
+{
+  out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <class T>
+bool readValue(std::istream &in, T &value)
+{
+  in.read(reinterpret_cast<char *>(&value), sizeof(T));
+  return static_cast<bool>(in);
+}
+
+inline uint64_t mixWord(uint64_t hash, uint64_t word)
+{
+  word *= 0x87c37b91114253d5ull;
+  word = (word << 31) | (word >> 33);
+  hash ^= word * 0x4cf5ad432745937full;
+  return ((hash << 27) | (hash >> 37)) * 5 + 0x52dce729;
+}
+
+template <class T>
+uint64_t hashVector(const std::vector<T> &values, uint64_t hash)
+{
+  return TileCache::hash(values.data(), values.size() * sizeof(T), hash);
+}
+}  // namespace
+
+void TileCache::enable(bool enabled)
+{
+  cacheEnabled() = enabled;
+}
+
+bool TileCache::enabled()
+{
+  return cacheEnabled();
+}
+
+void TileCache::initFromArguments(int &argc, char *argv[])
+{
+  for (int i = 1; i < argc; i++)
+  {
+    if (std::string(argv[i]) == "--tile_cache")
+    {
+      for (int j = i; j < argc; j++)  // shift the terminating null too
+      {
+        argv[j] = argv[j + 1];
+      }
+      argc--;
+      enable();
+      return;
+    }
+  }
+}
+
+uint64_t TileCache::hash(const void *data, size_t size, uint64_t hash)
+{
+  const char *bytes = static_cast<const char *>(data);
+  size_t i = 0;
+  for (; i + 8 <= size; i += 8)
+  {
+    uint64_t word;
+    std::memcpy(&word, bytes + i, 8);
+    hash = mixWord(hash, word);
+  }
+  uint64_t tail = 0;
+  if (size > i)
+  {
+    std::memcpy(&tail, bytes + i, size - i);
+  }
+  hash = mixWord(hash, tail ^ (static_cast<uint64_t>(size) << 56));
+  // avalanche, so that hashes of similar tiles differ in every bit
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdull;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+uint64_t TileCache::hashRays(const Cloud &cloud, uint64_t hash)
+{
+  hash = hashVector(cloud.starts, hash);
+  hash = hashVector(cloud.ends, hash);
+  hash = hashVector(cloud.times, hash);
+  return hashVector(cloud.colours, hash);
+}
+
+void TileCache::open(const std::string &file_name, const std::string &key)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  file_name_ = file_name;
+  key_hash_ = hash(key.data(), key.size());
+  entries_.clear();
+  layout_.clear();
+  num_found_ = num_stored_ = 0;
+
+  std::ifstream in(file_name_, std::ios::binary);
+  if (!in)
+  {
+    return;
+  }
+  char magic[4];
+  uint32_t version;
+  uint64_t key_hash, layout_length, num_entries;
+  in.read(magic, 4);
+  if (!in || std::memcmp(magic, kTileCacheMagic, 4) != 0 || !readValue(in, version) ||
+      version != kTileCacheVersion || !readValue(in, key_hash))
+  {
+    return;
+  }
+  if (key_hash != key_hash_)
+  {
+    std::cout << "tile cache " << file_name_ << " has different parameters, so all tiles are processed" << std::endl;
+    return;
+  }
+  std::vector<char> layout;
+  if (!readValue(in, layout_length) || layout_length > kMaxEntrySize)
+  {
+    return;
+  }
+  layout.resize(static_cast<size_t>(layout_length));
+  if ((layout_length > 0 && !in.read(layout.data(), static_cast<std::streamsize>(layout_length))) ||
+      !readValue(in, num_entries))
+  {
+    return;
+  }
+  layout_.swap(layout);
+  for (uint64_t e = 0; e < num_entries; e++)
+  {
+    uint32_t name_length;
+    uint64_t data_length;
+    Entry entry;
+    if (!readValue(in, name_length) || name_length > 1 << 16)
+    {
+      break;
+    }
+    std::string tile(name_length, ' ');
+    if ((name_length > 0 && !in.read(&tile[0], name_length)) || !readValue(in, entry.content_hash) ||
+        !readValue(in, data_length) || data_length > kMaxEntrySize)
+    {
+      break;
+    }
+    entry.data.resize(static_cast<size_t>(data_length));
+    if (data_length > 0 && !in.read(entry.data.data(), static_cast<std::streamsize>(data_length)))
+    {
+      break;
+    }
+    entries_[tile] = std::move(entry);
+  }
+}
+
+std::vector<char> TileCache::layout()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return layout_;
+}
+
+void TileCache::setLayout(const void *data, size_t size)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  const char *bytes = static_cast<const char *>(data);
+  layout_.assign(bytes, bytes + size);
+}
+
+bool TileCache::contains(const std::string &tile)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return entries_.find(tile) != entries_.end();
+}
+
+bool TileCache::find(const std::string &tile, uint64_t content_hash, std::vector<char> &data)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto found = entries_.find(tile);
+  if (found == entries_.end() || found->second.content_hash != content_hash)
+  {
+    return false;
+  }
+  found->second.used = true;
+  data = found->second.data;
+  num_found_++;
+  return true;
+}
+
+void TileCache::store(const std::string &tile, uint64_t content_hash, const void *data, size_t size)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (file_name_.empty())
+  {
+    return;
+  }
+  Entry &entry = entries_[tile];
+  entry.content_hash = content_hash;
+  const char *bytes = static_cast<const char *>(data);
+  entry.data.assign(bytes, bytes + size);
+  entry.used = true;
+  num_stored_++;
+}
+
+bool TileCache::save()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (file_name_.empty())
+  {
+    return false;
+  }
+  // written beside the cache then moved into place, so an interrupted run leaves the previous cache intact
+  const std::string partial_name = file_name_ + ".partial";
+  std::ofstream out(partial_name, std::ios::binary | std::ios::trunc);
+  uint64_t num_entries = 0;
+  for (const auto &entry : entries_)
+  {
+    num_entries += entry.second.used ? 1 : 0;
+  }
+  out.write(kTileCacheMagic, 4);
+  writeValue(out, kTileCacheVersion);
+  writeValue(out, key_hash_);
+  const uint64_t layout_length = layout_.size();
+  writeValue(out, layout_length);
+  out.write(layout_.data(), static_cast<std::streamsize>(layout_length));
+  writeValue(out, num_entries);
+  for (const auto &entry : entries_)
+  {
+    if (!entry.second.used)
+    {
+      continue;
+    }
+    const uint32_t name_length = static_cast<uint32_t>(entry.first.size());
+    const uint64_t data_length = entry.second.data.size();
+    writeValue(out, name_length);
+    out.write(entry.first.data(), entry.first.size());
+    writeValue(out, entry.second.content_hash);
+    writeValue(out, data_length);
+    out.write(entry.second.data.data(), static_cast<std::streamsize>(data_length));
+  }
+  out.close();
+  if (out.fail() || std::rename(partial_name.c_str(), file_name_.c_str()) != 0)
+  {
+    std::remove(partial_name.c_str());
+    std::cerr << "Warning: cannot write tile cache " << file_name_ << std::endl;
+    return false;
+  }
+  std::cout << "tile cache: " << num_found_ << " tiles reused, " << num_stored_ << " processed" << std::endl;
+  return true;
+}
+}  // namespace ray
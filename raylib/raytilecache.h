@@ -0,0 +1,114 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYTILECACHE_H
+#define RAYLIB_RAYTILECACHE_H
+
+#include "raylib/raylibconfig.h"
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ray
+{
+class Cloud;
+
+/// The results of each tile of a tiled tool, from the previous run, kept in a binary file keyed on a hash of each
+/// tile's rays. When part of a site is captured again, only the tiles whose rays have changed, including the tiles
+/// with the changed rays in their halo, differ in hash, so a repeated run reuses the results of all the other tiles
+/// and its cost is that of the changed area rather than of the whole site.
+///
+/// The cache is off unless @c enable() is called, which the tools do for a @c --tile_cache option. The file is keyed
+/// on the tool's parameters, so a cache of different parameters is ignored, and @c save() keeps only the tiles found
+/// or stored by the current run, so tiles that no longer exist are dropped.
+class RAYLIB_EXPORT TileCache
+{
+public:
+  /// Turn the cache on, for the tools that support it.
+  static void enable(bool enabled = true);
+  /// Whether the cache is on.
+  static bool enabled();
+  /// Remove a @c --tile_cache option from the command line arguments, and @c enable() the cache if it is present.
+  static void initFromArguments(int &argc, char *argv[]);
+
+  /// A hash of @c size bytes at @c data , continuing from @c hash . It hashes a word at a time, to be cheap beside
+  /// the processing of a tile.
+  static uint64_t hash(const void *data, size_t size, uint64_t hash = 0);
+  /// A hash of the rays of @c cloud , in order, continuing from @c hash
+  static uint64_t hashRays(const Cloud &cloud, uint64_t hash = 0);
+
+  TileCache() = default;
+  TileCache(const TileCache &) = delete;
+  TileCache &operator=(const TileCache &) = delete;
+
+  /// Open the cache file @c file_name of the tool run identified by @c key , loading its tiles if it has the same key.
+  void open(const std::string &file_name, const std::string &key);
+  /// Whether the cache is open
+  bool isOpen() const { return !file_name_.empty(); }
+  /// The number of tiles whose results were found, and the number stored, by this run
+  size_t numFound() const { return num_found_; }
+  size_t numStored() const { return num_stored_; }
+
+  /// The layout of the tiles in the previous run, such as the origin and width of a grid, so that this run keeps the
+  /// same tiles. Empty if there was no previous run.
+  std::vector<char> layout();
+  /// Set the layout of the tiles of this run
+  void setLayout(const void *data, size_t size);
+
+  /// Whether there are results of @c tile from the previous run, whatever their content hash
+  bool contains(const std::string &tile);
+  /// Get the results of @c tile if they were stored for the same @c content_hash , returning false if there are none
+  /// or the tile has changed. This may be called from several threads.
+  bool find(const std::string &tile, uint64_t content_hash, std::vector<char> &data);
+  template <class T>
+  bool find(const std::string &tile, uint64_t content_hash, std::vector<T> &values)
+  {
+    std::vector<char> bytes;
+    if (!find(tile, content_hash, bytes))
+    {
+      return false;
+    }
+    values.resize(bytes.size() / sizeof(T));
+    if (!values.empty())
+    {
+      std::memcpy(static_cast<void *>(values.data()), bytes.data(), values.size() * sizeof(T));
+    }
+    return true;
+  }
+  /// Store the results of @c tile with @c content_hash , replacing any earlier results. This may be called from
+  /// several threads.
+  void store(const std::string &tile, uint64_t content_hash, const void *data, size_t size);
+  template <class T>
+  void store(const std::string &tile, uint64_t content_hash, const std::vector<T> &values)
+  {
+    store(tile, content_hash, values.data(), values.size() * sizeof(T));
+  }
+
+  /// Write the tiles found or stored by this run to the file, for the next run. Returns false if it cannot be written.
+  bool save();
+
+private:
+  struct Entry
+  {
+    uint64_t content_hash = 0;
+    std::vector<char> data;
+    bool used = false;
+  };
+
+  std::string file_name_;
+  uint64_t key_hash_ = 0;
+  size_t num_found_ = 0;
+  size_t num_stored_ = 0;
+  std::vector<char> layout_;
+  std::map<std::string, Entry> entries_;
+  std::mutex mutex_;
+};
+}  // namespace ray
+
+#endif  // RAYLIB_RAYTILECACHE_H
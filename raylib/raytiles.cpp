@@ -0,0 +1,282 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raytiles.h"
+#include "raycloud.h"
+#include "raymemory.h"
+#include "raynodes.h"
+#include "rayprofile.h"
+#include "raythreads.h"
+#include "raytilecache.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+namespace ray
+{
+namespace
+{
+/// the tiles are sized to hold about this many rays each, on average, or fewer to fit a memory budget
+const size_t kTileRays = 1 << 20;
+/// there are at most this many tiles, which bounds the number of spill files
+const int kMaxTiles = 4096;
+/// all tiles are spilled to file once this many rays are held in memory, or fewer to fit a memory budget
+const size_t kMaxBufferedRays = 1 << 21;
+/// across several nodes there are at least this many tiles per node, so that the nodes' work is balanced
+const size_t kMinTilesPerNode = 16;
+/// the estimated working memory per ray of processing a tile, such as its neighbour index and surfels
+const size_t kTileBytesPerRay = 512;
+
+/// A ray in a tile, with its index in the file, and whether the tile owns it or it is in the tile's halo
+struct TileRay
+{
+  Eigen::Vector3d start;
+  Eigen::Vector3d end;
+  double time;
+  RGBA colour;
+  bool owned;
+  int64_t index;
+};
+
+struct Tile
+{
+  std::vector<TileRay> rays;
+  bool spilled = false;
+};
+
+/// The tile grid, as kept in a @c TileCache layout so that a repeated run has the same tiles
+struct TileGrid
+{
+  double min_bound[2];
+  double tile_width;
+  int64_t dims[2];
+};
+
+/// the tile coordinate of @c value , clamped into the @c dim tiles, with non-finite values in the first tile
+inline int64_t tileCoord(double value, double min_value, double tile_width, int64_t dim)
+{
+  const double coord = std::floor((value - min_value) / tile_width);
+  if (!(coord >= 0.0))
+    return 0;
+  return std::min(static_cast<int64_t>(std::min(coord, static_cast<double>(dim))), dim - 1);
+}
+/// the shared implementation of the @c processInTiles overloads, passing every ray's file index and whether it is owned
+bool processTiles(const std::string &file_name, const std::string &spill_stub, double halo,
+                  const std::function<void(Cloud &tile, const std::vector<int64_t> &indices,
+                                           const std::vector<bool> &owned, const TileRegion &region)> &process_tile,
+                  TileCache *cache)
+{
+  ProfileScope profile("processInTiles");
+  Cloud::Info info;
+  if (!Cloud::getInfo(file_name, info))
+    return false;
+  const size_t num_rays = static_cast<size_t>(info.num_bounded) + static_cast<size_t>(info.num_unbounded);
+  profile.count(num_rays);
+
+  // the tile grid is in x and y. Bounds only affect how evenly the rays are spread, as outlying rays are clamped into
+  // the edge tiles
+  Eigen::Vector3d min_bound = info.rays_bound.min_bound_;
+  const Eigen::Vector3d extent = info.rays_bound.max_bound_ - min_bound;
+  // the grid must be the same on every node, so across nodes it doesn't depend on the node's thread count
+  const size_t min_tiles = Nodes::count() > 1 ? kMinTilesPerNode * static_cast<size_t>(Nodes::count())
+                                              : static_cast<size_t>(Threads::threadCount());
+  // under a memory budget, the tiles processed at once must fit in it. Across nodes this is one tile at a time, as the
+  // grid cannot depend on the thread count
+  const size_t tile_rays = MemoryBudget::chunkRays(
+    kTileRays, kTileBytesPerRay, Nodes::count() > 1 ? 1 : static_cast<size_t>(Threads::threadCount()));
+  const int target_tiles = static_cast<int>(
+    std::max<size_t>(1, std::min<size_t>(kMaxTiles, std::max<size_t>(min_tiles, num_rays / tile_rays))));
+  // tiles narrower than a few halos would hold mostly halo rays
+  double tile_width = std::max({ std::sqrt(extent[0] * extent[1] / target_tiles), extent[0] / target_tiles,
+                                 extent[1] / target_tiles, 4.0 * halo, 1e-6 });
+  int64_t dims[2];
+  for (int i = 0; i < 2; i++)
+  {
+    dims[i] = static_cast<int64_t>(std::floor(extent[i] / tile_width)) + 1;
+  }
+  // with a cache, the previous run's grid is kept while it still covers the rays, so that unchanged tiles have the
+  // same rays and their results can be reused. Across nodes the grid must be the same on every node, so is not kept
+  if (cache)
+  {
+    const std::vector<char> layout = cache->layout();
+    TileGrid grid;
+    if (layout.size() == sizeof(TileGrid) && Nodes::count() == 1)
+    {
+      std::memcpy(&grid, layout.data(), sizeof(TileGrid));
+      bool covers = grid.tile_width >= 4.0 * halo;
+      for (int i = 0; i < 2; i++)
+      {
+        covers = covers && grid.min_bound[i] <= info.rays_bound.min_bound_[i] &&
+                 grid.min_bound[i] + grid.tile_width * static_cast<double>(grid.dims[i]) >=
+                   info.rays_bound.max_bound_[i];
+      }
+      if (covers)
+      {
+        tile_width = grid.tile_width;
+        for (int i = 0; i < 2; i++)
+        {
+          min_bound[i] = grid.min_bound[i];
+          dims[i] = grid.dims[i];
+        }
+      }
+    }
+    grid = TileGrid{ { min_bound[0], min_bound[1] }, tile_width, { dims[0], dims[1] } };
+    cache->setLayout(&grid, sizeof(TileGrid));
+  }
+  std::vector<Tile> tiles(static_cast<size_t>(dims[0] * dims[1]));
+  const std::string node_stub =
+    Nodes::count() > 1 ? spill_stub + "_node" + std::to_string(Nodes::index()) : spill_stub;
+  const auto spill_name = [&node_stub](size_t t) { return node_stub + "_tile" + std::to_string(t) + ".spill"; };
+  std::atomic_bool success(true);
+
+  // 1. add each ray to the tile that owns it, and to the tiles whose halo it is in, in file order
+  const size_t max_buffered_rays = MemoryBudget::chunkRays(kMaxBufferedRays, sizeof(TileRay));
+  size_t num_buffered = 0;
+  int64_t num_read = 0;
+  auto spill_tiles = [&]() {
+    parallelFor(size_t(0), tiles.size(), [&](size_t t) {
+      Tile &tile = tiles[t];
+      if (tile.rays.empty())
+      {
+        return;
+      }
+      std::ofstream out(spill_name(t),
+                        std::ios::binary | std::ios::out | (tile.spilled ? std::ios::app : std::ios::trunc));
+      out.write(reinterpret_cast<const char *>(tile.rays.data()),
+                static_cast<std::streamsize>(tile.rays.size() * sizeof(TileRay)));
+      if (out.fail())
+      {
+        success = false;
+      }
+      tile.spilled = true;
+      std::vector<TileRay>().swap(tile.rays);
+    });
+    num_buffered = 0;
+  };
+  auto bin_rays = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                      std::vector<double> &times, std::vector<RGBA> &colours) {
+    for (size_t i = 0; i < ends.size(); i++)
+    {
+      const Eigen::Vector3d &end = ends[i];
+      int64_t owner[2], first[2], last[2];
+      for (int j = 0; j < 2; j++)
+      {
+        owner[j] = tileCoord(end[j], min_bound[j], tile_width, dims[j]);
+        first[j] = tileCoord(end[j] - halo, min_bound[j], tile_width, dims[j]);
+        last[j] = std::max(owner[j], tileCoord(end[j] + halo, min_bound[j], tile_width, dims[j]));
+        first[j] = std::min(first[j], owner[j]);
+      }
+      const int64_t index = num_read + static_cast<int64_t>(i);
+      for (int64_t y = first[1]; y <= last[1]; y++)
+      {
+        for (int64_t x = first[0]; x <= last[0]; x++)
+        {
+          if (!Nodes::ownsTile(static_cast<size_t>(x + dims[0] * y)))
+          {
+            continue;  // another node processes this tile
+          }
+          const bool owned = x == owner[0] && y == owner[1];
+          tiles[x + dims[0] * y].rays.push_back(TileRay{ starts[i], end, times[i], colours[i], owned, index });
+          num_buffered++;
+        }
+      }
+    }
+    num_read += static_cast<int64_t>(ends.size());
+    if (num_buffered >= max_buffered_rays)
+    {
+      spill_tiles();
+    }
+  };
+  if (!Cloud::read(file_name, bin_rays))
+    return false;
+
+  // 2. process each tile independently
+  parallelFor(size_t(0), tiles.size(), [&](size_t t) {
+    Tile &tile = tiles[t];
+    std::vector<TileRay> rays;
+    if (tile.spilled)
+    {
+      std::ifstream in(spill_name(t), std::ios::binary | std::ios::in | std::ios::ate);
+      const size_t num_spilled = static_cast<size_t>(in.tellg()) / sizeof(TileRay);
+      rays.resize(num_spilled);
+      in.seekg(0);
+      in.read(reinterpret_cast<char *>(rays.data()), static_cast<std::streamsize>(num_spilled * sizeof(TileRay)));
+      if (in.fail())
+      {
+        success = false;
+      }
+      in.close();
+      std::remove(spill_name(t).c_str());
+    }
+    rays.insert(rays.end(), tile.rays.begin(), tile.rays.end());
+    std::vector<TileRay>().swap(tile.rays);
+    if (rays.empty())
+    {
+      return;
+    }
+    Cloud cloud;
+    cloud.reserve(rays.size());
+    std::vector<int64_t> indices(rays.size());
+    std::vector<bool> owned(rays.size());
+    for (size_t i = 0; i < rays.size(); i++)
+    {
+      cloud.addRay(rays[i].start, rays[i].end, rays[i].time, rays[i].colour);
+      indices[i] = rays[i].index;
+      owned[i] = rays[i].owned;
+    }
+    std::vector<TileRay>().swap(rays);
+
+    // the owned region is the tile's cell of the grid, with the edge tiles extended to hold the clamped rays
+    const int64_t coord[2] = { static_cast<int64_t>(t) % dims[0], static_cast<int64_t>(t) / dims[0] };
+    const double inf = std::numeric_limits<double>::infinity();
+    TileRegion region;
+    region.index = t;
+    region.num_tiles = tiles.size();
+    region.bounds.min_bound_ = Eigen::Vector3d(-inf, -inf, -inf);
+    region.bounds.max_bound_ = Eigen::Vector3d(inf, inf, inf);
+    for (int j = 0; j < 2; j++)
+    {
+      if (coord[j] > 0)
+        region.bounds.min_bound_[j] = min_bound[j] + tile_width * static_cast<double>(coord[j]);
+      if (coord[j] < dims[j] - 1)
+        region.bounds.max_bound_[j] = min_bound[j] + tile_width * static_cast<double>(coord[j] + 1);
+    }
+    process_tile(cloud, indices, owned, region);
+  });
+  return success;
+}
+}  // namespace
+
+bool processInTiles(const std::string &file_name, const std::string &spill_stub, double halo,
+                    const std::function<void(Cloud &tile, const std::vector<int64_t> &indices)> &process_tile)
+{
+  auto process_owned = [&](Cloud &tile, std::vector<int64_t> indices, const std::vector<bool> &owned,
+                           const TileRegion &) {
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+      if (!owned[i])
+        indices[i] = -1;
+    }
+    process_tile(tile, indices);
+  };
+  return processTiles(file_name, spill_stub, halo, process_owned, nullptr);
+}
+
+bool processInTiles(
+  const std::string &file_name, const std::string &spill_stub, double halo,
+  const std::function<void(Cloud &tile, const std::vector<int64_t> &indices, const TileRegion &region)> &process_tile,
+  TileCache *cache)
+{
+  return processTiles(
+    file_name, spill_stub, halo,
+    [&](Cloud &tile, const std::vector<int64_t> &indices, const std::vector<bool> &, const TileRegion &region) {
+      process_tile(tile, indices, region);
+    },
+    cache);
+}
+}  // namespace ray
@@ -0,0 +1,50 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYTILES_H
+#define RAYLIB_RAYTILES_H
+
+#include "raylib/raylibconfig.h"
+
+#include "raycuboid.h"
+#include "rayutils.h"
+
+#include <functional>
+
+namespace ray
+{
+class Cloud;
+class TileCache;
+
+/// Process the ray cloud file @c file_name in columns of tiles in x and y, for algorithms that only need the rays
+/// within @c halo of each ray. The file is streamed into the tiles, and each ray is added to the one tile that owns it
+/// and to every tile whose halo it is in. @c process_tile is then called on each non-empty tile in parallel, with a
+/// cloud of its rays in file order and the index in the file of each ray, which is -1 for the halo rays. Tile rays are
+/// spilled to temporary files named from @c spill_stub , so memory is bounded by the tile size rather than the cloud
+/// size. When run across several @c Nodes , only this node's tiles are processed. Returns false if a file could not be
+/// read or written.
+bool RAYLIB_EXPORT processInTiles(const std::string &file_name, const std::string &spill_stub, double halo,
+                                  const std::function<void(Cloud &tile, const std::vector<int64_t> &indices)> &process_tile);
+
+/// The region of a tile of @c processInTiles , and its place in the grid of tiles
+struct RAYLIB_EXPORT TileRegion
+{
+  size_t index;      // the tile's index in the grid, in x then y order
+  size_t num_tiles;  // the number of tiles in the grid, including empty tiles
+  Cuboid bounds;     // the x,y region whose ray ends the tile owns, unbounded in z and beyond the edge tiles
+};
+
+/// As above, but @c indices is the index in the file of every ray of the tile, including its halo rays, and @c region
+/// is the region that the tile owns. This is for algorithms where ownership depends on more than a ray's end, such as
+/// the base of the tree that the ray is part of. With a @c cache , the tile grid of its previous run is kept while it
+/// covers the cloud, so that the tiles that have not changed have the same rays, and @c process_tile can reuse their
+/// results from the cache.
+bool RAYLIB_EXPORT processInTiles(
+  const std::string &file_name, const std::string &spill_stub, double halo,
+  const std::function<void(Cloud &tile, const std::vector<int64_t> &indices, const TileRegion &region)> &process_tile,
+  TileCache *cache = nullptr);
+}  // namespace ray
+
+#endif  // RAYLIB_RAYTILES_H
@@ -0,0 +1,79 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raytool.h"
+#include "raycheckpoint.h"
+#include "raycloudwriter.h"
+#include "raymemory.h"
+#include "raynodes.h"
+#include "rayprofile.h"
+#include "rayrcb.h"
+#include "raythreads.h"
+#include "raytilecache.h"
+
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+
+namespace ray
+{
+namespace
+{
+/// thrown by @c Tool::exit within @c Tool::run , to unwind the tool to its caller
+struct ToolExit
+{
+  int exit_code;
+};
+
+/// the number of nested @c Tool::run calls
+int run_depth = 0;
+}  // namespace
+
+void Tool::exit(int exit_code)
+{
+  if (run_depth > 0)
+  {
+    throw ToolExit{ exit_code };
+  }
+  std::exit(exit_code);
+}
+
+int Tool::run(Function tool, int argc, char *argv[])
+{
+  // the defaults, as a new process would have them
+  MemoryBudget::init(0);
+  Nodes::init(0, 1);
+  Checkpoint::enable(false);
+  TileCache::enable(false);
+  CloudWriter::setBlockSize(0);
+  RcbWriter::setCompression(false);
+  Threads::unpin();
+
+  int exit_code = 0;
+  run_depth++;
+  try
+  {
+    exit_code = tool(argc, argv);
+  }
+  catch (const ToolExit &tool_exit)
+  {
+    exit_code = tool_exit.exit_code;
+  }
+  catch (const std::exception &error)
+  {
+    std::cerr << "Error: " << error.what() << std::endl;
+    exit_code = 1;
+  }
+  run_depth--;
+  // each command's --profile is written to its own file, and recording stops until a later command enables it
+  Profile::finish();
+  return exit_code;
+}
+
+bool Tool::running()
+{
+  return run_depth > 0;
+}
+}  // namespace ray
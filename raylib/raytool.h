@@ -0,0 +1,51 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYTOOL_H
+#define RAYLIB_RAYTOOL_H
+
+#include "raylib/raylibconfig.h"
+
+namespace ray
+{
+/// Support for running the raycloudtools as functions of one process, as the multi-call @c ray executable does, so
+/// that a batch of commands shares one process start up, one thread pool and the library's warm caches. Each tool is
+/// a function with the signature of @c main , which its standalone executable calls through @c RAYLIB_TOOL_MAIN .
+class RAYLIB_EXPORT Tool
+{
+public:
+  /// The signature of a tool function, that of @c main
+  using Function = int (*)(int argc, char *argv[]);
+
+  /// End the current tool with @c exit_code , as a tool's usage message does. A standalone tool exits the process,
+  /// while a tool called by @c run returns @c exit_code from @c run , leaving the process to run its next command.
+  [[noreturn]] static void exit(int exit_code);
+
+  /// Call the tool function @c tool with @c argc and @c argv , returning its exit code. The process wide options that
+  /// a previous command may have set through the tools' common arguments are first reset to their defaults: the
+  /// memory budget, node, checkpoint, tile cache, ply block size, rcb compression and thread pinning. The thread pool
+  /// is reused by a command with the same thread count as the last, rather than rebuilt. A @c --profile recording is
+  /// written to its file when the tool returns, and stopped. An exception escaping the tool is reported and returned
+  /// as exit code 1.
+  static int run(Function tool, int argc, char *argv[]);
+
+  /// Whether a tool is being called by @c run
+  static bool running();
+};
+}  // namespace ray
+
+/// Define the standalone executable's @c main as calling the tool function @c tool_function . The multi-call @c ray
+/// executable builds the tool sources with @c RAYLIB_MULTI_CALL , leaving it to call the tool functions instead.
+#if RAYLIB_MULTI_CALL
+#define RAYLIB_TOOL_MAIN(tool_function)
+#else  // RAYLIB_MULTI_CALL
+#define RAYLIB_TOOL_MAIN(tool_function) \
+  int main(int argc, char *argv[])      \
+  {                                     \
+    return tool_function(argc, argv);   \
+  }
+#endif  // RAYLIB_MULTI_CALL
+
+#endif  // RAYLIB_RAYTOOL_H
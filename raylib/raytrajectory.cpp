@@ -4,16 +4,25 @@
 //
 // Author: Thomas Lowe
 #include "raytrajectory.h"
+#include "raysort.h"
+#include "raythreads.h"
 
 namespace ray
 {
-void Trajectory::calculateStartPoints(const std::vector<double> &times, std::vector<Eigen::Vector3d> &starts)
+namespace
+{
+/// the number of times interpolated together by one thread
+const size_t kInterpolationBlockSize = 4096;
+/// the trajectory nodes stepped through before searching the rest of the trajectory instead
+const size_t kMaxCursorSteps = 8;
+}  // namespace
+
+void Trajectory::calculateStartPoints(const std::vector<double> &times, std::vector<Eigen::Vector3d> &starts) const
 {
   if (points_.empty() || times_.empty())
     std::cout << "Warning: can only calculate start points when a trajectory is available" << std::endl;
 
-  starts.resize(times.size());
-  for (size_t i = 0; i < times.size(); i++) starts[i] = linear(times[i]);
+  linear(times, starts);
 }
 
 bool Trajectory::save(const std::string &file_name)
@@ -117,25 +126,14 @@ bool Trajectory::load(const std::string &file_name)
   {
     std::cout << "Warning: trajectory times not ordered. Ordering them now." << std::endl;
 
-    struct Temp
-    {
-      double time;
-      size_t index;
-    };
-    std::vector<Temp> time_list(times_.size());
-    for (size_t i = 0; i < time_list.size(); i++)
-    {
-      time_list[i].time = times_[i];
-      time_list[i].index = i;
-    }
-    sort(time_list.begin(), time_list.end(), [](const Temp &a, const Temp &b) { return a.time < b.time; });
+    const std::vector<size_t> order = radixSortOrder(times_);
 
     std::vector<Eigen::Vector3d> new_points(points_.size());
     std::vector<double> new_times(times_.size());
     for (size_t i = 0; i < points_.size(); i++)
     {
-      new_points[i] = points_[time_list[i].index];
-      new_times[i] = times_[time_list[i].index];
+      new_points[i] = points_[order[i]];
+      new_times[i] = times_[order[i]];
       if (!(i % 100))
         std::cout << "time: " << new_times[i] - new_times[0] << std::endl;
     }
@@ -164,13 +162,46 @@ Eigen::Vector3d Trajectory::linear(double time, bool extrapolate) const
   if (points_.size() == 1)
     return points_[0];
   const size_t index = getIndexAndNormaliseTime(time);
-  if (!extrapolate)
+  return interpolate(index, time, extrapolate);
+}
+
+void Trajectory::linear(const std::vector<double> &times, std::vector<Eigen::Vector3d> &points, bool extrapolate) const
+{
+  ASSERT(!points_.empty());
+  points.resize(times.size());
+  if (points_.size() == 1)
   {
-    if (time < 0.0)
-      return points_.front();
-    else if (time > 1.0)
-      return points_.back();
+    std::fill(points.begin(), points.end(), points_[0]);
+    return;
   }
-  return points_[index] * (1 - time) + points_[index + 1] * time;
+  const size_t num_blocks = (times.size() + kInterpolationBlockSize - 1) / kInterpolationBlockSize;
+  parallelFor(size_t(0), num_blocks, [&](size_t block) {
+    const size_t begin = block * kInterpolationBlockSize;
+    const size_t end = std::min(begin + kInterpolationBlockSize, times.size());
+    size_t bound = 0;  // the lower bound of the previous time in times_
+    for (size_t i = begin; i < end; i++)
+    {
+      double time = times[i];
+      if (i > begin && time >= times[i - 1])
+      {
+        // the lower bound can only have moved on
+        for (size_t steps = 0; bound < times_.size() && times_[bound] < time; steps++)
+        {
+          if (steps == kMaxCursorSteps)
+          {
+            bound = std::lower_bound(times_.begin() + bound, times_.end(), time) - times_.begin();
+            break;
+          }
+          bound++;
+        }
+      }
+      else
+      {
+        bound = std::lower_bound(times_.begin(), times_.end(), time) - times_.begin();
+      }
+      const size_t index = normaliseTime(bound, time);
+      points[i] = interpolate(index, time, extrapolate);
+    }
+  });
 }
 }  // namespace ray
\ No newline at end of file
@@ -29,7 +29,7 @@ public:
   bool load(const std::string &file_name);
 
   /// Interpolation of the set @c starts based on the @c times_ of the trajectory
-  void calculateStartPoints(const std::vector<double> &times, std::vector<Eigen::Vector3d> &starts);
+  void calculateStartPoints(const std::vector<double> &times, std::vector<Eigen::Vector3d> &starts) const;
 
   /// Nearest position node on the trajectory to the given @c time
   Eigen::Vector3d nearest(double time) const;
@@ -38,10 +38,19 @@ public:
   /// If 'extrapolate' is false, outlier times will clamp to the start or end value
   Eigen::Vector3d linear(double time, bool extrapolate = true) const;
 
+  /// As @c linear for each of @c times , in parallel blocks. Within a block, each time after a time no later than it
+  /// is found by stepping on through the trajectory from the last one, so time ordered input, which is the usual
+  /// case, is not searched for ray by ray. The results are identical to calling @c linear for each time.
+  void linear(const std::vector<double> &times, std::vector<Eigen::Vector3d> &points, bool extrapolate = true) const;
+
 private:
   inline size_t getIndexAndNormaliseTime(double &time) const
   {
-    size_t index = std::lower_bound(times_.begin(), times_.end(), time) - times_.begin();
+    return normaliseTime(std::lower_bound(times_.begin(), times_.end(), time) - times_.begin(), time);
+  }
+  /// as above, given the lower bound @c index of @c time in @c times_
+  inline size_t normaliseTime(size_t index, double &time) const
+  {
     if (index == 0)
       index++;
     if (index == times_.size())
@@ -50,6 +59,18 @@ private:
     time = (time - times_[index]) / (times_[index + 1] - times_[index]);
     return index;
   }
+  /// the interpolation of @c linear , at the index and normalised time of @c normaliseTime
+  inline Eigen::Vector3d interpolate(size_t index, double time, bool extrapolate) const
+  {
+    if (!extrapolate)
+    {
+      if (time < 0.0)
+        return points_.front();
+      else if (time > 1.0)
+        return points_.back();
+    }
+    return points_[index] * (1 - time) + points_[index + 1] * time;
+  }
   std::vector<Eigen::Vector3d> points_;
   std::vector<double> times_;
 };
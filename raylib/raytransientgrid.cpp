@@ -0,0 +1,267 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "raytransientgrid.h"
+#include "raycloud.h"
+#include "raycloudwriter.h"
+#include "raythreads.h"
+#include "raytraversal.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+namespace ray
+{
+TransientGrid::Voxel::Voxel()
+  : hits(0.0f)
+  , misses(0.0f)
+  , before(0.0f)
+  , after(0.0f)
+  , first_time(std::numeric_limits<double>::max())
+  , last_time(std::numeric_limits<double>::lowest())
+  , opacity(0.0f)
+  , dither(0.0f)
+  , state(State::Fixed)
+{}
+
+TransientGrid::TransientGrid(double voxel_width, const MergerConfig &config)
+  : voxel_width_(voxel_width)
+  , config_(config)
+{}
+
+void TransientGrid::addHits(const std::vector<Eigen::Vector3d> &ends, const std::vector<double> &times,
+                            const std::vector<RGBA> &colours)
+{
+  for (size_t i = 0; i < ends.size(); i++)
+  {
+    if (colours[i].alpha == 0)
+    {
+      continue;
+    }
+    const auto found = ids_.emplace(voxelIndex(ends[i]), static_cast<int>(voxels_.size()));
+    if (found.second)
+    {
+      voxels_.emplace_back();
+    }
+    Voxel &voxel = voxels_[found.first->second];
+    voxel.hits++;
+    voxel.first_time = std::min(voxel.first_time, times[i]);
+    voxel.last_time = std::max(voxel.last_time, times[i]);
+  }
+}
+
+void TransientGrid::gatherPasses(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+                                 const std::vector<RGBA> &colours)
+{
+  if (passes_.size() < ends.size())
+  {
+    passes_.resize(ends.size());
+  }
+  // the voxel map is only read here, so the rays are walked in parallel
+  parallelFor(static_cast<size_t>(0), ends.size(), [&](size_t i) {
+    std::vector<int> &passes = passes_[i];
+    passes.clear();
+    const bool bounded = colours[i].alpha > 0;
+    walkVoxels(starts[i] / voxel_width_, ends[i] / voxel_width_,
+               [&](const Eigen::Vector3i &inds, double, double t_exit) {
+                 if (bounded && t_exit >= 1.0)
+                 {
+                   return true;  // the ray ends in this voxel, so is a hit rather than a pass
+                 }
+                 const auto found = ids_.find(inds);
+                 if (found != ids_.end())
+                 {
+                   passes.push_back(found->second);
+                 }
+                 return true;
+               });
+  });
+}
+
+void TransientGrid::addPasses(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+                              const std::vector<double> &times, const std::vector<RGBA> &colours)
+{
+  gatherPasses(starts, ends, colours);
+  // the counts are added in ray order, so they do not depend on the number of threads
+  for (size_t i = 0; i < ends.size(); i++)
+  {
+    for (const int id : passes_[i])
+    {
+      Voxel &voxel = voxels_[id];
+      if (times[i] < voxel.first_time)
+      {
+        voxel.before++;
+      }
+      else if (times[i] > voxel.last_time)
+      {
+        voxel.after++;
+      }
+      else
+      {
+        voxel.misses++;
+      }
+    }
+  }
+}
+
+void TransientGrid::classify()
+{
+  const MergeType merge_type = config_.merge_type;
+  for (auto &voxel : voxels_)
+  {
+    // as for the Merger's ellipsoids, subtracting 1 gives an unbiased opacity estimate
+    const double h = voxel.hits + 1e-8 - 1.0;
+    voxel.opacity = static_cast<float>(h / (h + voxel.misses));
+    const double sequence_length = config_.num_rays_filter_threshold / voxel.opacity;
+    voxel.state = State::Fixed;
+    bool remove_geometry = false;
+    if (merge_type == MergeType::Oldest || merge_type == MergeType::Newest)
+    {
+      if (static_cast<double>(std::max(voxel.before, voxel.after)) < sequence_length)
+      {
+        continue;
+      }
+      remove_geometry = static_cast<double>(merge_type == MergeType::Oldest ? voxel.before : voxel.after) >=
+                        sequence_length;
+    }
+    else
+    {
+      if (static_cast<double>(voxel.before + voxel.after) < sequence_length)
+      {
+        continue;
+      }
+      remove_geometry = merge_type == MergeType::Mininum;
+    }
+    voxel.state = remove_geometry ? State::RemoveGeometry : State::RemovePassThrough;
+  }
+}
+
+void TransientGrid::transient(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+                              const std::vector<double> &times, const std::vector<RGBA> &colours,
+                              std::vector<bool> &transient)
+{
+  gatherPasses(starts, ends, colours);
+  transient.assign(ends.size(), false);
+  for (size_t i = 0; i < ends.size(); i++)
+  {
+    if (colours[i].alpha > 0)
+    {
+      const auto found = ids_.find(voxelIndex(ends[i]));
+      if (found != ids_.end() && voxels_[found->second].state == State::RemoveGeometry)
+      {
+        transient[i] = true;
+      }
+    }
+    // a fraction of the passes through a kept transient voxel, its opacity, are the rays that it would have stopped
+    for (const int id : passes_[i])
+    {
+      Voxel &voxel = voxels_[id];
+      if (voxel.state != State::RemovePassThrough)
+      {
+        continue;
+      }
+      voxel.dither += voxel.opacity;
+      if (voxel.dither < 1.0f)
+      {
+        continue;
+      }
+      voxel.dither--;
+      if (times[i] < voxel.first_time || times[i] > voxel.last_time)
+      {
+        transient[i] = true;
+      }
+    }
+  }
+}
+
+size_t TransientGrid::numTransientVoxels() const
+{
+  return static_cast<size_t>(std::count_if(voxels_.begin(), voxels_.end(),
+                                           [](const Voxel &voxel) { return voxel.state != State::Fixed; }));
+}
+
+bool filterTransientsFast(const std::string &file_name, const std::string &transient_file,
+                          const std::string &fixed_file, const MergerConfig &config, double voxel_width,
+                          Progress *progress)
+{
+  Progress tracker;
+  if (!progress)
+  {
+    progress = &tracker;
+  }
+  Cloud::Info info;
+  if (!Cloud::getInfo(file_name, info))
+  {
+    return false;
+  }
+  if (voxel_width <= 0.0)
+  {
+    const double spacing_scale = 2.0;
+    voxel_width = spacing_scale * Cloud::estimatePointSpacing(file_name, info.ends_bound, info.num_bounded);
+    if (!(voxel_width > 0.0))
+    {
+      std::cerr << "Error: cannot estimate a voxel width for " << file_name << std::endl;
+      return false;
+    }
+    std::cout << "estimated voxel width: " << voxel_width << std::endl;
+  }
+  const size_t num_rays = info.num_bounded + info.num_unbounded;
+  TransientGrid grid(voxel_width, config);
+
+  progress->begin("transient-fast-hits", num_rays);
+  auto add_hits = [&](std::vector<Eigen::Vector3d> &, std::vector<Eigen::Vector3d> &ends, std::vector<double> &times,
+                      std::vector<RGBA> &colours) {
+    grid.addHits(ends, times, colours);
+    progress->increment(ends.size());
+  };
+  if (!Cloud::read(file_name, add_hits))
+  {
+    return false;
+  }
+
+  progress->begin("transient-fast-passes", num_rays);
+  auto add_passes = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                        std::vector<double> &times, std::vector<RGBA> &colours) {
+    grid.addPasses(starts, ends, times, colours);
+    progress->increment(ends.size());
+  };
+  if (!Cloud::read(file_name, add_passes))
+  {
+    return false;
+  }
+  grid.classify();
+  std::cout << grid.numTransientVoxels() << " of " << grid.numVoxels() << " occupied voxels are transient"
+            << std::endl;
+
+  CloudWriter transient_writer, fixed_writer;
+  if (!transient_writer.begin(transient_file) || !fixed_writer.begin(fixed_file))
+  {
+    return false;
+  }
+  progress->begin("transient-fast-split", num_rays);
+  Cloud transient_chunk, fixed_chunk;
+  std::vector<bool> transient;
+  bool written = true;
+  auto split = [&](std::vector<Eigen::Vector3d> &starts, std::vector<Eigen::Vector3d> &ends,
+                   std::vector<double> &times, std::vector<RGBA> &colours) {
+    grid.transient(starts, ends, times, colours, transient);
+    transient_chunk.clear();
+    fixed_chunk.clear();
+    for (size_t i = 0; i < ends.size(); i++)
+    {
+      (transient[i] ? transient_chunk : fixed_chunk).addRay(starts[i], ends[i], times[i], colours[i]);
+    }
+    written = written && transient_writer.writeChunk(transient_chunk) && fixed_writer.writeChunk(fixed_chunk);
+    progress->increment(ends.size());
+  };
+  const bool read = Cloud::read(file_name, split);
+  transient_writer.end();
+  fixed_writer.end();
+  progress->end();
+  return read && written;
+}
+}  // namespace ray
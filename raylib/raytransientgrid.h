@@ -0,0 +1,113 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYTRANSIENTGRID_H
+#define RAYLIB_RAYTRANSIENTGRID_H
+
+#include "raylib/raylibconfig.h"
+
+#include "raymerger.h"
+#include "rayprogress.h"
+#include "rayutils.h"
+
+#include <cmath>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ray
+{
+/// A fast voxel approximation of the transient filtering of @c Merger::filter , for a quick look at clouds far larger
+/// than its ellipsoids can hold. Each occupied voxel, one that a ray ends in, stands in for the ellipsoids in it: its
+/// rays' end points give its hit count and the time span over which it was observed, and the rays that pass through it
+/// are counted before, during and after that span, walking each ray through the voxels as @c walkVoxels . The voxel
+/// is then judged as @c Merger judges an ellipsoid, with @c MergerConfig::num_rays_filter_threshold and
+/// @c MergerConfig::merge_type : it is transient when enough rays pass through it outside its observed span, relative
+/// to its opacity, the hits against the passes during its span.
+///
+/// Only the occupied voxels are stored, so memory is proportional to the surface area of the cloud rather than to the
+/// space that its rays cross. The cloud is streamed three times, in the same chunk order each time: @c addHits ,
+/// @c addPasses then, after @c classify , @c transient for each chunk.
+class RAYLIB_EXPORT TransientGrid
+{
+public:
+  /// Voxels of @c voxel_width , judged by the threshold and merge type of @c config
+  TransientGrid(double voxel_width, const MergerConfig &config);
+
+  /// Add the end points of a chunk of rays. The unbounded rays have no end point in the cloud so are ignored
+  void addHits(const std::vector<Eigen::Vector3d> &ends, const std::vector<double> &times,
+               const std::vector<RGBA> &colours);
+  /// Add the passes of a chunk of rays through the occupied voxels, once every chunk's hits have been added
+  void addPasses(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+                 const std::vector<double> &times, const std::vector<RGBA> &colours);
+  /// Judge which voxels are transient, once every chunk's passes have been added
+  void classify();
+  /// Set @c transient to whether each ray of a chunk is transient, once classified. The chunks must be given in the
+  /// same order as to @c addPasses , as removed pass-through rays are spread along each voxel's passes as @c Merger
+  /// does, by its opacity.
+  void transient(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+                 const std::vector<double> &times, const std::vector<RGBA> &colours, std::vector<bool> &transient);
+
+  /// The number of occupied voxels, and of those judged transient
+  inline size_t numVoxels() const { return voxels_.size(); }
+  size_t numTransientVoxels() const;
+  inline double voxelWidth() const { return voxel_width_; }
+
+private:
+  /// What the rays of a voxel are judged to be
+  enum class State : uint8_t
+  {
+    Fixed,             // not transient
+    RemoveGeometry,    // the rays ending in the voxel are transient
+    RemovePassThrough  // the rays passing through the voxel outside its observed span are transient
+  };
+  struct Voxel
+  {
+    Voxel();
+    float hits;
+    float misses;  // passes during the time span of its hits
+    float before, after;
+    double first_time, last_time;
+    float opacity;
+    float dither;  // the running sum of the opacity over the passes, to spread the removed rays
+    State state;
+  };
+  struct VoxelHash
+  {
+    size_t operator()(const Eigen::Vector3i &inds) const
+    {
+      uint64_t hash = 0;
+      for (int k = 0; k < 3; k++) hash = (hash ^ static_cast<uint64_t>(inds[k])) * 0x9e3779b97f4a7c15ull;
+      return static_cast<size_t>(hash ^ (hash >> 32));
+    }
+  };
+
+  inline Eigen::Vector3i voxelIndex(const Eigen::Vector3d &point) const
+  {
+    return Eigen::Vector3i(static_cast<int>(std::floor(point[0] / voxel_width_)),
+                           static_cast<int>(std::floor(point[1] / voxel_width_)),
+                           static_cast<int>(std::floor(point[2] / voxel_width_)));
+  }
+  /// fill @c passes_ with the occupied voxels that each ray of a chunk passes through, in order along the ray
+  void gatherPasses(const std::vector<Eigen::Vector3d> &starts, const std::vector<Eigen::Vector3d> &ends,
+                    const std::vector<RGBA> &colours);
+
+  double voxel_width_;
+  MergerConfig config_;
+  std::unordered_map<Eigen::Vector3i, int, VoxelHash> ids_;
+  std::vector<Voxel> voxels_;
+  std::vector<std::vector<int>> passes_;  // per ray of the current chunk, kept to avoid reallocation
+};
+
+/// Split the ray cloud file @c file_name into the @c transient_file and @c fixed_file rays, approximating
+/// @c Merger::filter with a @c TransientGrid of @c voxel_width voxels. Zero uses twice the cloud's point spacing. The
+/// cloud is streamed, never held, so peak memory is that of the occupied voxels. The @c colour_cloud option is not
+/// supported. Returns false if the cloud cannot be read or the results written.
+bool RAYLIB_EXPORT filterTransientsFast(const std::string &file_name, const std::string &transient_file,
+                                        const std::string &fixed_file, const MergerConfig &config,
+                                        double voxel_width = 0.0, Progress *progress = nullptr);
+}  // namespace ray
+
+#endif  // RAYLIB_RAYTRANSIENTGRID_H
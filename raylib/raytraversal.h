@@ -0,0 +1,100 @@
+// Copyright (c) 2020
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYTRAVERSAL_H
+#define RAYLIB_RAYTRAVERSAL_H
+
+#include "raylib/raylibconfig.h"
+
+#include "rayutils.h"
+
+#include <cmath>
+#include <limits>
+
+namespace ray
+{
+/// Visit the voxels crossed by the line segment from @c source to @c target, in order along the segment.
+/// @c source and @c target are in voxel units, i.e. the position relative to the grid's minimum bound divided by the
+/// voxel width, so that voxel (i, j, k) covers [i, i+1) x [j, j+1) x [k, k+1).
+///
+/// This is the Amanatides-Woo traversal. The parametric distance to the next voxel boundary on each axis is computed
+/// once, then advanced by a constant per axis, so that each step is a comparison and an addition.
+///
+/// Only the first @c Dims axes are traversed, so @c Dims=2 walks the pixels of a 2D grid crossed by the segment's xy
+/// projection, leaving the z index at that of @c source .
+///
+/// @c visit(const Eigen::Vector3i &index, double t_enter, double t_exit) is called for each voxel, where the segment
+/// is within the voxel from @c t_enter to @c t_exit, as fractions of the way from @c source to @c target . The first
+/// voxel has @c t_enter 0 and the last has @c t_exit 1. Returning false from @c visit ends the walk.
+/// Index bounds are the caller's responsibility, typically by clipping the segment to the grid first.
+template <int Dims = 3, class VisitFunction>
+inline void walkVoxels(const Eigen::Vector3d &source, const Eigen::Vector3d &target, VisitFunction &&visit)
+{
+  static_assert(Dims == 2 || Dims == 3, "walkVoxels is for 2D or 3D grids");
+  if (!source.allFinite() || !target.allFinite())
+  {
+    return;
+  }
+  const double inf = std::numeric_limits<double>::infinity();
+  Eigen::Vector3i index(static_cast<int>(std::floor(source[0])), static_cast<int>(std::floor(source[1])),
+                        static_cast<int>(std::floor(source[2])));
+  int step[Dims];
+  double t_max[Dims];    // the parametric distance at which the segment crosses the next boundary on each axis
+  double t_delta[Dims];  // the parametric distance between boundaries on each axis
+  for (int k = 0; k < Dims; k++)
+  {
+    const double dir = target[k] - source[k];
+    if (dir > 0.0)
+    {
+      step[k] = 1;
+      t_delta[k] = 1.0 / dir;
+      t_max[k] = (static_cast<double>(index[k]) + 1.0 - source[k]) * t_delta[k];
+    }
+    else if (dir < 0.0)
+    {
+      step[k] = -1;
+      t_delta[k] = -1.0 / dir;
+      t_max[k] = (source[k] - static_cast<double>(index[k])) * t_delta[k];
+    }
+    else
+    {
+      step[k] = 0;
+      t_delta[k] = t_max[k] = inf;
+    }
+  }
+
+  double t_enter = 0.0;
+  for (;;)
+  {
+    int axis = 0;
+    if (t_max[1] < t_max[axis])
+      axis = 1;
+    if (Dims == 3 && t_max[Dims - 1] < t_max[axis])
+      axis = Dims - 1;
+    const double t_exit = std::min(t_max[axis], 1.0);
+    if (!visit(static_cast<const Eigen::Vector3i &>(index), t_enter, t_exit) || t_max[axis] >= 1.0)
+    {
+      return;
+    }
+    index[axis] += step[axis];
+    t_enter = t_max[axis];
+    t_max[axis] += t_delta[axis];
+  }
+}
+
+/// Batched form of @c walkVoxels . The indices of the voxels crossed by the segment from @c source to @c target are
+/// appended to @c voxels , for callers that process a ray's voxels together.
+template <int Dims = 3>
+inline void gatherVoxels(const Eigen::Vector3d &source, const Eigen::Vector3d &target,
+                         std::vector<Eigen::Vector3i> &voxels)
+{
+  walkVoxels<Dims>(source, target, [&voxels](const Eigen::Vector3i &index, double, double) {
+    voxels.push_back(index);
+    return true;
+  });
+}
+}  // namespace ray
+
+#endif  // RAYLIB_RAYTRAVERSAL_H
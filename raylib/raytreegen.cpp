@@ -40,6 +40,10 @@ double getMainBranchAngle(double tip_angle)
 /// pre-fill the lookup table that approximates the choice of branch angles
 void fillBranchAngleLookup()
 {
+  static bool filled = false;  // the table is always the same, so the commands of a multi-call process fill it once
+  if (filled)
+    return;
+  filled = true;
   double last_g = 0.0;
   double last_ang1 = 0.0;
   int j = 0;
@@ -74,8 +78,8 @@ void fillBranchAngleLookup()
 }
 
 static const double kMinimumRadius = 0.001;
-static Eigen::Vector3d com(0, 0, 0);
-static double total_mass = 0.0;
+static thread_local Eigen::Vector3d com(0, 0, 0);  // per thread, so trees can be made in parallel
+static thread_local double total_mass = 0.0;
 
 void TreeGen::addBranch(int parent_index, Pose pose, double radius, const TreeParams &params)
 {
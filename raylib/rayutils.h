@@ -89,28 +89,6 @@ public:
   }
 };
 
-inline void voxelSubsample(const std::vector<Eigen::Vector3d> &points, double voxel_width,
-                           std::vector<int64_t> &indices, std::set<Eigen::Vector3i, Vector3iLess> &vox_set)
-{
-  for (int64_t i = 0; i < (int64_t)points.size(); i++)
-  {
-    Eigen::Vector3i voxel(int(std::floor(points[i][0] / voxel_width)), int(std::floor(points[i][1] / voxel_width)),
-                          int(std::floor(points[i][2] / voxel_width)));
-    if (vox_set.find(voxel) == vox_set.end())
-    {
-      vox_set.insert(voxel);
-      indices.push_back(i);
-    }
-  }
-}
-
-inline void voxelSubsample(const std::vector<Eigen::Vector3d> &points, double voxel_width,
-                           std::vector<int64_t> &indices)
-{
-  std::set<Eigen::Vector3i, Vector3iLess> vox_set;
-  voxelSubsample(points, voxel_width, indices, vox_set);
-}
-
 /// Square a value
 template <class T>
 inline T sqr(const T &val)
@@ -127,11 +105,10 @@ inline T mean(const std::vector<T> &list)
   return result;
 }
 
-/** Return median of elements in the list
- * When there are an even number of elements it returns the mean of the two medians
+/** As @c median , but reorders the list rather than copying it, so that the list can be a reused buffer
  */
 template <class T>
-inline T median(std::vector<T> list)
+inline T medianInPlace(std::vector<T> &list)
 {
   typename std::vector<T>::iterator first = list.begin();
   typename std::vector<T>::iterator last = list.end();
@@ -147,6 +124,15 @@ inline T median(std::vector<T> list)
   }
 }
 
+/** Return median of elements in the list
+ * When there are an even number of elements it returns the mean of the two medians
+ */
+template <class T>
+inline T median(std::vector<T> list)
+{
+  return medianInPlace(list);
+}
+
 /** Returns p'th percentile value in unordered list. e.g. p=50% gives median value, p=0% gives smallest value
  */
 template <class T>
@@ -0,0 +1,246 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#include "rayvoxelset.h"
+#include "raythreads.h"
+
+#if RAYLIB_WITH_TBB
+#include <tbb/parallel_sort.h>
+#endif  // RAYLIB_WITH_TBB
+
+namespace ray
+{
+namespace
+{
+const int kAxisBits = 21;
+const int64_t kAxisOffset = int64_t(1) << (kAxisBits - 1);
+const uint64_t kHashMultiplier = 0x9E3779B97F4A7C15ull;  // Fibonacci hashing spreads the packed axes over the top bits
+
+inline Eigen::Vector3i voxelOf(const Eigen::Vector3d &point, double voxel_width)
+{
+  return Eigen::Vector3i(int(std::floor(point[0] / voxel_width)), int(std::floor(point[1] / voxel_width)),
+                         int(std::floor(point[2] / voxel_width)));
+}
+}  // namespace
+
+const uint64_t VoxelSet::kEmpty;
+
+VoxelSet::VoxelSet()
+  : size_(0)
+  , shift_(64)
+  , origin_(0, 0, 0)
+  , has_origin_(false)
+{}
+
+bool VoxelSet::pack(const Eigen::Vector3i &voxel, uint64_t &key) const
+{
+  key = 0;
+  for (int i = 0; i < 3; i++)
+  {
+    const int64_t coord = static_cast<int64_t>(voxel[i]) - static_cast<int64_t>(origin_[i]) + kAxisOffset;
+    if (coord < 0 || coord >= 2 * kAxisOffset)
+    {
+      return false;
+    }
+    key |= static_cast<uint64_t>(coord) << (kAxisBits * i);
+  }
+  return true;
+}
+
+size_t VoxelSet::slot(uint64_t key) const
+{
+  return static_cast<size_t>((key * kHashMultiplier) >> shift_);
+}
+
+void VoxelSet::rehash(size_t num_slots)
+{
+  std::vector<uint64_t> old_slots(num_slots, kEmpty);
+  old_slots.swap(slots_);
+  shift_ = 64;
+  for (size_t n = num_slots; n > 1; n /= 2)
+  {
+    shift_--;
+  }
+  const size_t mask = slots_.size() - 1;
+  for (const auto &key : old_slots)
+  {
+    if (key == kEmpty)
+    {
+      continue;
+    }
+    size_t i = slot(key);
+    while (slots_[i] != kEmpty)
+    {
+      i = (i + 1) & mask;
+    }
+    slots_[i] = key;
+  }
+}
+
+void VoxelSet::reserve(size_t count)
+{
+  size_t num_slots = 16;
+  while (num_slots < 2 * count)
+  {
+    num_slots *= 2;
+  }
+  if (num_slots > slots_.size())
+  {
+    rehash(num_slots);
+  }
+}
+
+void VoxelSet::clear()
+{
+  std::vector<uint64_t>().swap(slots_);
+  size_ = 0;
+  shift_ = 64;
+  has_origin_ = false;
+  overflow_.clear();
+}
+
+bool VoxelSet::insert(const Eigen::Vector3i &voxel)
+{
+  if (!has_origin_)
+  {
+    origin_ = voxel;
+    has_origin_ = true;
+  }
+  uint64_t key;
+  if (!pack(voxel, key))
+  {
+    return overflow_.insert(voxel).second;
+  }
+  if (2 * (size_ + 1) > slots_.size())  // at most half full, so probe sequences stay short
+  {
+    rehash(std::max<size_t>(16, 2 * slots_.size()));
+  }
+  const size_t mask = slots_.size() - 1;
+  size_t i = slot(key);
+  while (slots_[i] != kEmpty)
+  {
+    if (slots_[i] == key)
+    {
+      return false;
+    }
+    i = (i + 1) & mask;
+  }
+  slots_[i] = key;
+  size_++;
+  return true;
+}
+
+bool VoxelSet::erase(const Eigen::Vector3i &voxel)
+{
+  uint64_t key;
+  if (!has_origin_)
+  {
+    return false;
+  }
+  if (!pack(voxel, key))
+  {
+    return overflow_.erase(voxel) > 0;
+  }
+  if (slots_.empty())
+  {
+    return false;
+  }
+  const size_t mask = slots_.size() - 1;
+  size_t i = slot(key);
+  while (slots_[i] != key)
+  {
+    if (slots_[i] == kEmpty)
+    {
+      return false;
+    }
+    i = (i + 1) & mask;
+  }
+  // shift later keys of the probe sequence back into the gap, so that lookups need no tombstones
+  for (size_t j = (i + 1) & mask; slots_[j] != kEmpty; j = (j + 1) & mask)
+  {
+    const size_t home = slot(slots_[j]);
+    const bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+    if (!stays)
+    {
+      slots_[i] = slots_[j];
+      i = j;
+    }
+  }
+  slots_[i] = kEmpty;
+  size_--;
+  return true;
+}
+
+bool VoxelSet::contains(const Eigen::Vector3i &voxel) const
+{
+  uint64_t key;
+  if (!has_origin_)
+  {
+    return false;
+  }
+  if (!pack(voxel, key))
+  {
+    return overflow_.find(voxel) != overflow_.end();
+  }
+  if (slots_.empty())
+  {
+    return false;
+  }
+  const size_t mask = slots_.size() - 1;
+  for (size_t i = slot(key); slots_[i] != kEmpty; i = (i + 1) & mask)
+  {
+    if (slots_[i] == key)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+void voxelSubsample(const std::vector<Eigen::Vector3d> &points, double voxel_width, std::vector<int64_t> &indices,
+                    VoxelSet &vox_set)
+{
+  for (int64_t i = 0; i < (int64_t)points.size(); i++)
+  {
+    if (vox_set.insert(voxelOf(points[i], voxel_width)))
+    {
+      indices.push_back(i);
+    }
+  }
+}
+
+void voxelSubsample(const std::vector<Eigen::Vector3d> &points, double voxel_width, std::vector<int64_t> &indices)
+{
+#if RAYLIB_WITH_TBB
+  // sort the points by voxel then index, so the first of each run of equal voxels is the point to keep
+  struct VoxelPoint
+  {
+    Eigen::Vector3i voxel;
+    int64_t index;
+  };
+  std::vector<VoxelPoint> voxel_points(points.size());
+  parallelFor(int64_t(0), static_cast<int64_t>(points.size()), [&](int64_t i) {
+    voxel_points[i].voxel = voxelOf(points[i], voxel_width);
+    voxel_points[i].index = i;
+  });
+  const Vector3iLess voxel_less;
+  tbb::parallel_sort(voxel_points.begin(), voxel_points.end(), [&](const VoxelPoint &a, const VoxelPoint &b) {
+    return voxel_less(a.voxel, b.voxel) || (a.voxel == b.voxel && a.index < b.index);
+  });
+  const size_t first_index = indices.size();
+  for (size_t i = 0; i < voxel_points.size(); i++)
+  {
+    if (i == 0 || voxel_points[i].voxel != voxel_points[i - 1].voxel)
+    {
+      indices.push_back(voxel_points[i].index);
+    }
+  }
+  tbb::parallel_sort(indices.begin() + first_index, indices.end());
+#else   // RAYLIB_WITH_TBB
+  VoxelSet vox_set;
+  voxelSubsample(points, voxel_width, indices, vox_set);
+#endif  // RAYLIB_WITH_TBB
+}
+}  // namespace ray
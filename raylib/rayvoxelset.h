@@ -0,0 +1,67 @@
+// Copyright (c) 2022
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+#ifndef RAYLIB_RAYVOXELSET_H
+#define RAYLIB_RAYVOXELSET_H
+
+#include "raylib/raylibconfig.h"
+
+#include "rayutils.h"
+
+#include <cstdint>
+
+namespace ray
+{
+/// A set of voxel indices, as an open addressing hash table of packed 64-bit keys. Each occupied voxel costs 16 to
+/// 32 bytes, rather than the 60 or more of a node of @c std::set , and a lookup is usually a single cache line.
+/// Keys are 21 bits per axis relative to the first voxel inserted, so voxels more than a million voxel widths from it
+/// go to a small fallback tree set instead.
+class RAYLIB_EXPORT VoxelSet
+{
+public:
+  VoxelSet();
+
+  /// Add @c voxel to the set. Returns true if it was not already in the set.
+  bool insert(const Eigen::Vector3i &voxel);
+  /// Remove @c voxel from the set. Returns true if it was in the set.
+  bool erase(const Eigen::Vector3i &voxel);
+  /// Whether @c voxel is in the set.
+  bool contains(const Eigen::Vector3i &voxel) const;
+
+  /// The number of voxels in the set.
+  size_t size() const { return size_ + overflow_.size(); }
+  bool empty() const { return size() == 0; }
+  /// Remove all voxels, releasing the memory.
+  void clear();
+  /// Allocate for @c count voxels, to avoid rehashing as they are inserted.
+  void reserve(size_t count);
+
+private:
+  static const uint64_t kEmpty = ~uint64_t(0);  // never a packed key, as those use 63 bits
+
+  bool pack(const Eigen::Vector3i &voxel, uint64_t &key) const;
+  size_t slot(uint64_t key) const;
+  void rehash(size_t num_slots);
+
+  std::vector<uint64_t> slots_;
+  size_t size_;
+  int shift_;  // the hash is the top bits of the key product, from bit shift_ upwards
+  Eigen::Vector3i origin_;
+  bool has_origin_;
+  std::set<Eigen::Vector3i, Vector3iLess> overflow_;
+};
+
+/// Add to @c indices the index of the first of @c points in each voxel of width @c voxel_width , that is not already
+/// in @c vox_set , and add those voxels to the set. The set may be kept between calls, for chunked clouds.
+void RAYLIB_EXPORT voxelSubsample(const std::vector<Eigen::Vector3d> &points, double voxel_width,
+                                  std::vector<int64_t> &indices, VoxelSet &vox_set);
+
+/// Add to @c indices the index of the first of @c points in each voxel of width @c voxel_width , in order. With TBB
+/// this is a parallel sort of the points by voxel, otherwise it uses a @c VoxelSet .
+void RAYLIB_EXPORT voxelSubsample(const std::vector<Eigen::Vector3d> &points, double voxel_width,
+                                  std::vector<int64_t> &indices);
+}  // namespace ray
+
+#endif  // RAYLIB_RAYVOXELSET_H
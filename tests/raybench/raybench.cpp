@@ -0,0 +1,318 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+//
+// Micro-benchmarks of the raylib kernels on synthetic clouds. Each benchmark runs at several cloud sizes, so that
+// scaling issues show as a change in the per-ray time. Run with e.g. --benchmark_filter=Surfels to select kernels.
+
+#include "rayalignment.h"
+#include "raycloud.h"
+#include "raycloudwriter.h"
+#include "rayconcavehull.h"
+#include "raygrid.h"
+#include "raymerger.h"
+#include "rayply.h"
+#include "rayplyindex.h"
+#include "rayquickhull.h"
+#include "rayrenderer.h"
+#include "rayvoxelset.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <random>
+
+namespace
+{
+/// the synthetic clouds are this many rays per square metre of ground, whatever their size
+const double kRaysPerSquareMetre = 1000.0;
+
+/// A synthetic cloud of @c num_rays rays, from a sensor moving along a line at head height to a rough ground and to
+/// bushes above it. The extent grows with the ray count, so the point density is the same at every size. The cloud is
+/// generated with a fixed seed, once per size
+const ray::Cloud &syntheticCloud(size_t num_rays)
+{
+  static std::map<size_t, std::unique_ptr<ray::Cloud>> clouds;
+  std::unique_ptr<ray::Cloud> &cloud = clouds[num_rays];
+  if (cloud)
+  {
+    return *cloud;
+  }
+  cloud.reset(new ray::Cloud);
+  std::mt19937 gen(static_cast<unsigned>(num_rays));
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  std::normal_distribution<double> noise(0.0, 1.0);
+  const double width = std::sqrt(static_cast<double>(num_rays) / kRaysPerSquareMetre);
+  const int num_bushes = std::max(1, static_cast<int>(width * width / 25.0));
+  std::vector<Eigen::Vector3d> bushes(num_bushes);
+  for (auto &bush : bushes)
+  {
+    bush = Eigen::Vector3d(width * unit(gen), width * unit(gen), 0.5 + unit(gen));
+  }
+  cloud->reserve(num_rays);
+  for (size_t i = 0; i < num_rays; i++)
+  {
+    const double time = static_cast<double>(i) / static_cast<double>(num_rays);
+    const Eigen::Vector3d start(width * time, 0.5 * width, 1.5);
+    Eigen::Vector3d end;
+    if (unit(gen) < 0.7)
+    {
+      end = Eigen::Vector3d(width * unit(gen), width * unit(gen), 0.02 * noise(gen));
+    }
+    else
+    {
+      const Eigen::Vector3d dir = Eigen::Vector3d(noise(gen), noise(gen), noise(gen)).normalized();
+      end = bushes[i % bushes.size()] + 0.5 * dir;
+    }
+    ray::RGBA colour;
+    colour.red = colour.green = colour.blue = 127;
+    colour.alpha = unit(gen) < 0.05 ? 0 : 255;  // a few unbounded rays, as from a real sensor
+    cloud->addRay(start, end, time, colour);
+  }
+  return *cloud;
+}
+
+/// The file name of @c syntheticCloud(num_rays) , which is written on first use
+const std::string &syntheticFile(size_t num_rays)
+{
+  static std::map<size_t, std::string> files;
+  std::string &file_name = files[num_rays];
+  if (file_name.empty())
+  {
+    file_name = "raybench_" + std::to_string(num_rays) + ".ply";
+    syntheticCloud(num_rays).save(file_name);
+  }
+  return file_name;
+}
+
+/// remove a cloud file written by the benchmarks, with any sidecar files that it gained
+void removeCloudFile(const std::string &file_name)
+{
+  std::remove(file_name.c_str());
+  std::remove(ray::plyInfoFileName(file_name).c_str());
+  std::remove(ray::plyIndexFileName(file_name).c_str());
+}
+
+/// The cloud sizes of each benchmark, in rays
+void cloudSizes(benchmark::internal::Benchmark *bench)
+{
+  bench->RangeMultiplier(10)->Range(10000, 1000000)->Unit(benchmark::kMillisecond);
+}
+
+void setRays(benchmark::State &state, size_t num_rays)
+{
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * static_cast<int64_t>(num_rays));
+}
+
+void BM_WriteRayCloudChunk(benchmark::State &state)
+{
+  const ray::Cloud &cloud = syntheticCloud(static_cast<size_t>(state.range(0)));
+  std::vector<Eigen::Vector3d> starts = cloud.starts, ends = cloud.ends;
+  std::vector<double> times = cloud.times;
+  std::vector<ray::RGBA> colours = cloud.colours;
+  const std::string file_name = "raybench_write.ply";
+  for (auto _ : state)
+  {
+    ray::CloudWriter writer;
+    writer.begin(file_name);
+    writer.writeChunk(starts, ends, times, colours);
+    writer.end();
+  }
+  removeCloudFile(file_name);
+  setRays(state, cloud.rayCount());
+}
+BENCHMARK(BM_WriteRayCloudChunk)->Apply(cloudSizes);
+
+void BM_ReadPly(benchmark::State &state)
+{
+  const size_t num_rays = static_cast<size_t>(state.range(0));
+  const std::string &file_name = syntheticFile(num_rays);
+  for (auto _ : state)
+  {
+    size_t num_read = 0;
+    auto count = [&](std::vector<Eigen::Vector3d> &, std::vector<Eigen::Vector3d> &ends, std::vector<double> &,
+                     std::vector<ray::RGBA> &) { num_read += ends.size(); };
+    ray::readPly(file_name, true, count, 0);
+    benchmark::DoNotOptimize(num_read);
+  }
+  setRays(state, num_rays);
+}
+BENCHMARK(BM_ReadPly)->Apply(cloudSizes);
+
+void BM_GridInsert(benchmark::State &state)
+{
+  const ray::Cloud &cloud = syntheticCloud(static_cast<size_t>(state.range(0)));
+  Eigen::Vector3d min_bound, max_bound;
+  cloud.calcBounds(&min_bound, &max_bound);
+  for (auto _ : state)
+  {
+    ray::Grid<int> grid(min_bound, max_bound, 0.25);
+    for (size_t i = 0; i < cloud.ends.size(); i++)
+    {
+      grid.insert(grid.index(cloud.ends[i]), static_cast<int>(i));
+    }
+    benchmark::ClobberMemory();
+  }
+  setRays(state, cloud.rayCount());
+}
+BENCHMARK(BM_GridInsert)->Apply(cloudSizes);
+
+void BM_FillRayGrid(benchmark::State &state)
+{
+  const ray::Cloud &cloud = syntheticCloud(static_cast<size_t>(state.range(0)));
+  Eigen::Vector3d min_bound, max_bound;
+  cloud.calcBounds(&min_bound, &max_bound, ray::kBFEnd | ray::kBFStart);
+  for (auto _ : state)
+  {
+    ray::PackedGrid<unsigned> grid(min_bound, max_bound, 0.25);
+    ray::Merger::fillRayGrid(&grid, cloud);
+    benchmark::ClobberMemory();
+  }
+  setRays(state, cloud.rayCount());
+}
+BENCHMARK(BM_FillRayGrid)->Apply(cloudSizes);
+
+void BM_CalculateDensities(benchmark::State &state)
+{
+  const size_t num_rays = static_cast<size_t>(state.range(0));
+  const std::string &file_name = syntheticFile(num_rays);
+  Eigen::Vector3d min_bound, max_bound;
+  syntheticCloud(num_rays).calcBounds(&min_bound, &max_bound);
+  const double voxel_width = 0.25;
+  const Eigen::Vector3i dims = ((max_bound - min_bound) / voxel_width).array().ceil().cast<int>() + 1;
+  for (auto _ : state)
+  {
+    ray::DensityGrid grid(ray::Cuboid(min_bound, min_bound + voxel_width * dims.cast<double>()), voxel_width, dims);
+    grid.calculateDensities(file_name);
+    grid.addNeighbourPriors();
+    benchmark::ClobberMemory();
+  }
+  setRays(state, num_rays);
+}
+BENCHMARK(BM_CalculateDensities)->Apply(cloudSizes);
+
+void BM_Surfels(benchmark::State &state)
+{
+  const ray::Cloud &cloud = syntheticCloud(static_cast<size_t>(state.range(0)));
+  for (auto _ : state)
+  {
+    std::vector<Eigen::Vector3d> centroids, normals;
+    cloud.getSurfels(16, &centroids, &normals, nullptr, nullptr, nullptr);
+    benchmark::DoNotOptimize(normals.data());
+  }
+  setRays(state, cloud.rayCount());
+}
+BENCHMARK(BM_Surfels)->Apply(cloudSizes);
+
+void BM_VoxelSubsample(benchmark::State &state)
+{
+  const ray::Cloud &cloud = syntheticCloud(static_cast<size_t>(state.range(0)));
+  for (auto _ : state)
+  {
+    std::vector<int64_t> indices;
+    ray::voxelSubsample(cloud.ends, 0.05, indices);
+    benchmark::DoNotOptimize(indices.data());
+  }
+  setRays(state, cloud.rayCount());
+}
+BENCHMARK(BM_VoxelSubsample)->Apply(cloudSizes);
+
+#if RAYLIB_WITH_QHULL || RAYLIB_NATIVE_DELAUNAY
+void BM_ConcaveHull(benchmark::State &state)
+{
+  const ray::Cloud &cloud = syntheticCloud(static_cast<size_t>(state.range(0)));
+  std::vector<Eigen::Vector3d> points;
+  for (size_t i = 0; i < cloud.ends.size(); i++)
+  {
+    if (cloud.rayBounded(i))
+    {
+      points.push_back(cloud.ends[i]);
+    }
+  }
+  for (auto _ : state)
+  {
+    ray::ConcaveHull hull(points);
+    hull.growUpwards(1.0);
+    benchmark::DoNotOptimize(hull.mesh().indexList().data());
+  }
+  setRays(state, points.size());
+}
+BENCHMARK(BM_ConcaveHull)->RangeMultiplier(10)->Range(10000, 100000)->Unit(benchmark::kMillisecond);
+#endif  // RAYLIB_WITH_QHULL || RAYLIB_NATIVE_DELAUNAY
+
+/// The convex hull of the bounded ray ends after the inversion of an outwards wrap, which puts many of them on the hull
+void BM_QuickHull(benchmark::State &state)
+{
+  const ray::Cloud &cloud = syntheticCloud(static_cast<size_t>(state.range(0)));
+  std::vector<Eigen::Vector3d> points;
+  Eigen::Vector3d centre(0, 0, 0);
+  for (size_t i = 0; i < cloud.ends.size(); i++)
+  {
+    if (cloud.rayBounded(i))
+    {
+      points.push_back(cloud.ends[i]);
+      centre += cloud.ends[i];
+    }
+  }
+  centre /= static_cast<double>(std::max(size_t(1), points.size()));
+  for (auto &point : points)
+  {
+    point -= centre;
+    point /= std::max(1e-6, point.squaredNorm());
+  }
+  for (auto _ : state)
+  {
+    ray::QuickHull hull;
+    hull.build(points);
+    benchmark::DoNotOptimize(hull.triangles().data());
+  }
+  setRays(state, points.size());
+}
+BENCHMARK(BM_QuickHull)->Apply(cloudSizes);
+
+/// The FFT is of a cubic grid, with state.range(0) cells per side
+void BM_Array3DFft(benchmark::State &state)
+{
+  const int side = static_cast<int>(state.range(0));
+  ray::Array3D grid;
+  grid.init(Eigen::Vector3d::Zero(), 1.0, Eigen::Vector3i(side, side, side));
+  std::mt19937 gen(static_cast<unsigned>(side));
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+  for (int z = 0; z < side; z++)
+  {
+    for (int y = 0; y < side; y++)
+    {
+      for (int x = 0; x < side; x++)
+      {
+        grid(x, y, z) = Complex(unit(gen), 0.0);
+      }
+    }
+  }
+  for (auto _ : state)
+  {
+    ray::Array3D transformed = grid;
+    transformed.fft();
+    benchmark::DoNotOptimize(&transformed(0, 0, 0));
+  }
+  state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * side * side * side);
+}
+BENCHMARK(BM_Array3DFft)->RangeMultiplier(2)->Range(32, 128)->Unit(benchmark::kMillisecond);
+
+/// removes the synthetic cloud files once all benchmarks have run
+struct FileRemover
+{
+  ~FileRemover()
+  {
+    for (size_t num_rays = 10000; num_rays <= 1000000; num_rays *= 10)
+    {
+      removeCloudFile("raybench_" + std::to_string(num_rays) + ".ply");
+    }
+  }
+} file_remover;
+}  // namespace
+
+BENCHMARK_MAIN();
@@ -0,0 +1,338 @@
+// Copyright (c) 2026
+// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+// ABN 41 687 119 230
+//
+// Author: Thomas Lowe
+//
+// End-to-end throughput benchmark of the raycloudtools binaries. A forest of each size is generated with raycreate,
+// then run through import, decimation, transient removal, grid splitting, terrain and tree extraction and density
+// rendering. Each stage's wall time, peak memory, bytes read and written and rays per second are appended to a report
+// with one JSON record per line. Given a --baseline report, stages that are slower than it by more than --tolerance
+// fail the run, so that scaling regressions are caught.
+
+#include "raylib/raylibconfig.h"
+
+#include "rayply.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+/// the forests are this many rays per square metre, as from a terrestrial scan
+const double kRaysPerSquareMetre = 2000.0;
+/// stages that take less than this long are not compared to the baseline, as their times are mostly noise
+const double kMinComparedSeconds = 0.5;
+
+void usage(int exit_code = 1)
+{
+  // clang-format off
+  std::cout << "Run a pipeline of the raycloudtools on generated forests of several sizes, reporting the cost of each stage" << std::endl;
+  std::cout << "usage:" << std::endl;
+  std::cout << "raypipeline --bin build/bin          - the directory of the raycloudtools binaries (default is this binary's)" << std::endl;
+  std::cout << "            --sizes 1e5,1e6,1e7      - the forest sizes in rays" << std::endl;
+  std::cout << "            --report report.json     - the report file, one JSON record per stage (default raypipeline_report.json)" << std::endl;
+  std::cout << "            --work raypipeline_work  - the directory that the pipeline runs in, emptied after each size" << std::endl;
+  std::cout << "            --baseline old.json      - fail if a stage is slower per ray than in this report..." << std::endl;
+  std::cout << "            --tolerance 1.5          - ...by more than this ratio (default 1.5)" << std::endl;
+  // clang-format on
+  exit(exit_code);
+}
+
+/// The cost of one stage of the pipeline
+struct StageResult
+{
+  std::string stage;
+  uint64_t num_rays;  // in the stage's input cloud
+  double wall_seconds;
+  double peak_rss_mb;
+  uint64_t bytes_read;
+  uint64_t bytes_written;
+  double rays_per_second;
+};
+
+/// The size and modification time of each file in the working directory
+std::map<std::string, std::pair<int64_t, int64_t>> listFiles()
+{
+  std::map<std::string, std::pair<int64_t, int64_t>> files;
+  DIR *dir = opendir(".");
+  if (!dir)
+    return files;
+  while (dirent *entry = readdir(dir))
+  {
+    struct stat info;
+    if (stat(entry->d_name, &info) == 0 && S_ISREG(info.st_mode))
+    {
+      const int64_t modified = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+      files[entry->d_name] = std::make_pair(static_cast<int64_t>(info.st_size), modified);
+    }
+  }
+  closedir(dir);
+  return files;
+}
+
+int64_t fileSize(const std::string &file_name)
+{
+  struct stat info;
+  return stat(file_name.c_str(), &info) == 0 ? static_cast<int64_t>(info.st_size) : 0;
+}
+
+/// Run @c args as a child process, with its output to @c log_name , and fill in its wall time and peak memory.
+/// Returns false if it could not be run or did not exit successfully
+bool runCommand(const std::vector<std::string> &args, const std::string &log_name, StageResult &result)
+{
+  std::vector<char *> argv;
+  for (auto &arg : args) argv.push_back(const_cast<char *>(arg.c_str()));
+  argv.push_back(nullptr);
+
+  const auto start_time = std::chrono::steady_clock::now();
+  const pid_t pid = fork();
+  if (pid < 0)
+    return false;
+  if (pid == 0)
+  {
+    const int log = open(log_name.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (log >= 0)
+    {
+      dup2(log, STDOUT_FILENO);
+      dup2(log, STDERR_FILENO);
+    }
+    execv(argv[0], argv.data());
+    _exit(127);
+  }
+  int status = 0;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) != pid)
+    return false;
+  result.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+  result.peak_rss_mb = static_cast<double>(usage.ru_maxrss) / 1024.0;  // in kilobytes on Linux
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/// Run one stage of the pipeline, on the cloud @c input and the other files @c other_inputs . A generator stage has
+/// no input, so its rays are the @c generated_rays that it writes
+bool runStage(const std::string &bin_dir, const std::string &stage, const std::vector<std::string> &args,
+              const std::string &input, const std::vector<std::string> &other_inputs,
+              std::vector<StageResult> &results, uint64_t generated_rays = 0)
+{
+  StageResult result;
+  result.stage = stage;
+  result.num_rays = generated_rays;
+  // the input may be a ray cloud or a point cloud, and either has a row per ray
+  if (!input.empty() && !ray::readPlyRowCount(input, false, result.num_rays))
+    result.num_rays = 0;
+  result.bytes_read = static_cast<uint64_t>(fileSize(input));
+  for (auto &other : other_inputs) result.bytes_read += static_cast<uint64_t>(fileSize(other));
+
+  std::vector<std::string> command = { bin_dir + "/" + args[0] };
+  command.insert(command.end(), args.begin() + 1, args.end());
+  const auto files_before = listFiles();
+  if (!runCommand(command, "raypipeline.log", result))
+  {
+    std::cerr << "stage " << stage << " failed, see raypipeline.log" << std::endl;
+    return false;
+  }
+  // the written bytes are those of the files that are new or changed
+  result.bytes_written = 0;
+  for (auto &file : listFiles())
+  {
+    auto before = files_before.find(file.first);
+    if (file.first != "raypipeline.log" && (before == files_before.end() || before->second != file.second))
+      result.bytes_written += static_cast<uint64_t>(file.second.first);
+  }
+  result.rays_per_second = result.wall_seconds > 0.0 ? static_cast<double>(result.num_rays) / result.wall_seconds : 0.0;
+  std::cout << stage << ": " << result.num_rays << " rays in " << result.wall_seconds << " s, " << result.peak_rss_mb
+            << " MB peak" << std::endl;
+  results.push_back(result);
+  return true;
+}
+
+/// Run the whole pipeline on a generated forest of @c num_rays rays
+bool runPipeline(const std::string &bin_dir, uint64_t num_rays, std::vector<StageResult> &results)
+{
+  const std::string rays = std::to_string(num_rays);
+  const std::string extent = std::to_string(std::sqrt(static_cast<double>(num_rays) / kRaysPerSquareMetre));
+  const std::string cloud = "points_raycloud_decimated_fixed.ply";
+  // each stage's input is the previous one's output, so the stages are in order
+  bool success =
+    runStage(bin_dir, "raycreate", { "raycreate", "forest", "1", "--rays", rays, "--extent", extent }, "", {},
+             results, num_rays) &&
+    runStage(bin_dir, "rayexport", { "rayexport", "forest.ply", "points.ply", "points_traj.txt" }, "forest.ply", {},
+             results) &&
+    runStage(bin_dir, "rayimport", { "rayimport", "points.ply", "points_traj.txt" }, "points.ply",
+             { "points_traj.txt" }, results) &&
+    runStage(bin_dir, "raydecimate", { "raydecimate", "points_raycloud.ply", "1", "cm" }, "points_raycloud.ply", {},
+             results) &&
+    runStage(bin_dir, "raytransients", { "raytransients", "min", "points_raycloud_decimated.ply", "1", "rays" },
+             "points_raycloud_decimated.ply", {}, results) &&
+    runStage(bin_dir, "raysplit", { "raysplit", cloud, "grid", "20,20,0" }, cloud, {}, results);
+  const std::string mesh = "points_raycloud_decimated_fixed_mesh.ply";
+  success = success &&
+            runStage(bin_dir, "rayextract_terrain", { "rayextract", "terrain", cloud }, cloud, {}, results) &&
+            runStage(bin_dir, "rayextract_trees", { "rayextract", "trees", cloud, mesh }, cloud, { mesh }, results);
+  return success &&
+         runStage(bin_dir, "rayrender", { "rayrender", cloud, "top", "density" }, cloud, {}, results);
+}
+
+/// Remove the files of a pipeline run, which are those that are not in @c kept_files
+void removeRunFiles(const std::map<std::string, std::pair<int64_t, int64_t>> &kept_files)
+{
+  for (auto &file : listFiles())
+  {
+    if (kept_files.find(file.first) == kept_files.end() && file.first != "raypipeline.log")
+      std::remove(file.first.c_str());
+  }
+}
+
+/// @c path made absolute, relative to the current directory
+std::string absolutePath(const std::string &path)
+{
+  char cwd[4096];
+  if (path.empty() || path[0] == '/' || !getcwd(cwd, sizeof(cwd)))
+    return path;
+  return std::string(cwd) + "/" + path;
+}
+
+std::string toJson(const StageResult &result, uint64_t size)
+{
+  std::ostringstream json;
+  json << "{\"size\": " << size << ", \"stage\": \"" << result.stage << "\", \"rays\": " << result.num_rays
+       << ", \"wall_s\": " << result.wall_seconds << ", \"peak_rss_mb\": " << result.peak_rss_mb
+       << ", \"bytes_read\": " << result.bytes_read << ", \"bytes_written\": " << result.bytes_written
+       << ", \"rays_per_s\": " << result.rays_per_second << "}";
+  return json.str();
+}
+
+/// The number after @c "key": in a report record, or -1 if it is missing
+double jsonNumber(const std::string &record, const std::string &key)
+{
+  const std::string tag = "\"" + key + "\": ";
+  const size_t pos = record.find(tag);
+  return pos == std::string::npos ? -1.0 : std::atof(record.c_str() + pos + tag.size());
+}
+
+std::string jsonString(const std::string &record, const std::string &key)
+{
+  const std::string tag = "\"" + key + "\": \"";
+  const size_t pos = record.find(tag);
+  if (pos == std::string::npos)
+    return "";
+  const size_t start = pos + tag.size();
+  return record.substr(start, record.find('"', start) - start);
+}
+}  // namespace
+
+int main(int argc, char *argv[])
+{
+  std::string bin_dir, report_name = "raypipeline_report.json", baseline_name, work_dir = "raypipeline_work";
+  std::vector<uint64_t> sizes = { 100000, 1000000 };
+  double tolerance = 1.5;
+  for (int i = 1; i < argc; i++)
+  {
+    const std::string arg = argv[i];
+    if (i + 1 >= argc)
+      usage();
+    const std::string value = argv[++i];
+    if (arg == "--bin")
+      bin_dir = value;
+    else if (arg == "--report")
+      report_name = value;
+    else if (arg == "--work")
+      work_dir = value;
+    else if (arg == "--baseline")
+      baseline_name = value;
+    else if (arg == "--tolerance")
+      tolerance = std::atof(value.c_str());
+    else if (arg == "--sizes")
+    {
+      sizes.clear();
+      std::istringstream list(value);
+      std::string size;
+      while (std::getline(list, size, ',')) sizes.push_back(static_cast<uint64_t>(std::atof(size.c_str())));
+    }
+    else
+      usage();
+  }
+  if (bin_dir.empty())
+  {
+    const std::string self = argv[0];
+    const size_t slash = self.find_last_of('/');
+    bin_dir = slash == std::string::npos ? "." : self.substr(0, slash);
+  }
+  if (sizes.empty() || tolerance <= 0.0)
+    usage();
+  bin_dir = absolutePath(bin_dir);
+  report_name = absolutePath(report_name);
+
+  // the baseline seconds per ray of each stage and size
+  std::map<std::pair<uint64_t, std::string>, double> baseline;
+  if (!baseline_name.empty())
+  {
+    std::ifstream in(baseline_name);
+    if (!in)
+    {
+      std::cerr << "cannot read baseline " << baseline_name << std::endl;
+      return 1;
+    }
+    std::string record;
+    while (std::getline(in, record))
+    {
+      const double wall_seconds = jsonNumber(record, "wall_s");
+      if (wall_seconds >= kMinComparedSeconds)
+        baseline[std::make_pair(static_cast<uint64_t>(jsonNumber(record, "size")), jsonString(record, "stage"))] =
+          wall_seconds / std::max(1.0, jsonNumber(record, "rays"));
+    }
+  }
+
+  std::ofstream report(report_name);
+  if (!report)
+  {
+    std::cerr << "cannot write report " << report_name << std::endl;
+    return 1;
+  }
+  // the tools write their outputs beside their inputs, so the pipeline runs in a directory of its own
+  mkdir(work_dir.c_str(), 0755);
+  if (chdir(work_dir.c_str()) != 0)
+  {
+    std::cerr << "cannot use work directory " << work_dir << std::endl;
+    return 1;
+  }
+  const auto existing_files = listFiles();
+  int num_regressions = 0;
+  for (auto &size : sizes)
+  {
+    std::cout << "pipeline of " << size << " rays" << std::endl;
+    std::vector<StageResult> results;
+    const bool success = runPipeline(bin_dir, size, results);
+    removeRunFiles(existing_files);
+    for (auto &result : results)
+    {
+      report << toJson(result, size) << std::endl;
+      auto found = baseline.find(std::make_pair(size, result.stage));
+      const double seconds_per_ray = result.wall_seconds / std::max<double>(1.0, (double)result.num_rays);
+      if (found != baseline.end() && seconds_per_ray > tolerance * found->second)
+      {
+        std::cerr << "regression: " << result.stage << " at " << size << " rays is " << seconds_per_ray / found->second
+                  << " times slower per ray than the baseline" << std::endl;
+        num_regressions++;
+      }
+    }
+    if (!success)
+      return 1;
+  }
+  return num_regressions > 0 ? 1 : 0;
+}
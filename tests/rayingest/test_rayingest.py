@@ -0,0 +1,98 @@
+# Copyright (c) 2026
+# Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+# ABN 41 687 119 230
+#
+# Author: Thomas Lowe
+"""Tests of the rayingest tool, which is run with a ROS master of its own, and fed a trajectory and registered scans.
+CTest runs these from the build's bin directory, with the tool's path in RAYINGEST and ROS sourced."""
+import os
+import random
+import signal
+import subprocess
+import time
+import unittest
+
+import rosgraph
+import rospy
+from nav_msgs.msg import Odometry
+from sensor_msgs import point_cloud2
+from sensor_msgs.msg import PointCloud2
+from std_msgs.msg import Header
+
+# a port of its own, so that the test does not publish to any other master
+MASTER_URI = "http://localhost:11471"
+NUM_SCANS = 30
+POINTS_PER_SCAN = 100
+
+
+def wait_for(condition, timeout):
+    """wait until condition() is true, returning whether it became true within timeout seconds"""
+    end = time.time() + timeout
+    while not condition():
+        if time.time() > end:
+            return False
+        time.sleep(0.1)
+    return True
+
+
+class IngestTest(unittest.TestCase):
+    def setUp(self):
+        os.environ["ROS_MASTER_URI"] = MASTER_URI
+        self.master = subprocess.Popen(["roscore", "-p", MASTER_URI.split(":")[-1]], stdout=subprocess.DEVNULL)
+        self.assertTrue(wait_for(lambda: rosgraph.Master("/raytest").is_online(), 30), "the ROS master did not start")
+        self.ingest = None
+
+    def tearDown(self):
+        for process in (self.ingest, self.master):
+            if process and process.poll() is None:
+                process.send_signal(signal.SIGINT)
+                process.wait(30)
+
+    def test_ingest(self):
+        if os.path.exists("ingest_live.ply"):
+            os.remove("ingest_live.ply")
+        self.ingest = subprocess.Popen([os.environ["RAYINGEST"], "/points", "/odometry", "ingest_live.ply"],
+                                       stdout=subprocess.PIPE, universal_newlines=True)
+        rospy.init_node("raytest_ingest", anonymous=True, disable_signals=True)
+        odometry_publisher = rospy.Publisher("/odometry", Odometry, queue_size=1000)
+        points_publisher = rospy.Publisher("/points", PointCloud2, queue_size=1000)
+        self.assertTrue(wait_for(lambda: odometry_publisher.get_num_connections() > 0 and
+                                 points_publisher.get_num_connections() > 0, 30), "rayingest did not subscribe")
+
+        # a trajectory along x, with a scan between each pair of poses, so that each scan waits for the next pose
+        generator = random.Random(1)
+        for i in range(NUM_SCANS + 1):
+            odometry = Odometry()
+            odometry.header.stamp = rospy.Time.from_sec(100.0 + 0.1 * i)
+            odometry.header.frame_id = "map"
+            odometry.pose.pose.position.x = 0.1 * i
+            odometry_publisher.publish(odometry)
+            time.sleep(0.02)
+            if i < NUM_SCANS:
+                header = Header(stamp=rospy.Time.from_sec(100.05 + 0.1 * i), frame_id="map")
+                points = [(generator.uniform(-5.0, 5.0), generator.uniform(-5.0, 5.0), generator.uniform(0.0, 3.0))
+                          for _ in range(POINTS_PER_SCAN)]
+                points_publisher.publish(point_cloud2.create_cloud_xyz32(header, points))
+                time.sleep(0.02)
+
+        time.sleep(1.0)  # for the last messages to arrive
+        self.ingest.send_signal(signal.SIGINT)
+        output, _ = self.ingest.communicate(timeout=60)
+        self.assertEqual(self.ingest.returncode, 0, output)
+        num_points = NUM_SCANS * POINTS_PER_SCAN
+        self.assertIn("%d points ingested into %d rays" % (num_points, num_points), output)
+
+        # the vertex count is written with leading zeros, so that it can be filled in when the writer ends
+        num_vertices = None
+        with open("ingest_live.ply", "rb") as ply:
+            for line in ply:
+                words = line.decode("ascii").split()
+                if words[:2] == ["element", "vertex"]:
+                    num_vertices = int(words[2])
+                if words == ["end_header"]:
+                    break
+        self.assertEqual(num_vertices, num_points)
+
+
+if __name__ == "__main__":
+    unittest.main()
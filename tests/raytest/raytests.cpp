@@ -4,13 +4,68 @@
 //
 // Author: Thomas Lowe
 
+#include "rayalignment.h"
+#include "rayallocprofile.h"
 #include "raycloud.h"
+#include "raycloudserver.h"
+#include "raycloudwriter.h"
+#include "raychunksizer.h"
+#include "raychange.h"
+#include "raycheckpoint.h"
+#include "rayasyncreader.h"
+#include "extraction/rayclusters.h"
+#include "raydebugdrawqueue.h"
+#include "raydelaunay.h"
+#include "raydenoise.h"
+#include "raygpu.h"
+#include "rayheightfieldwrap.h"
+#include "rayingest.h"
+#include "raylod.h"
+#include "raymerger.h"
+#include "rayrandom.h"
+#include "raymemory.h"
 #include "raymesh.h"
+#include "rayneighbours.h"
+#include "raynodes.h"
+#include "raynuma.h"
+#include "rayperfcounters.h"
+#include "raythreads.h"
 #include "rayply.h"
+#include "rayprofile.h"
+#include "rayprogress.h"
+#include "rayquickhull.h"
+#include "rayplyindex.h"
+#include "rayrcb.h"
+#include "rayremotefile.h"
+#include "raysort.h"
+#include "rayrenderer.h"
+#include "raysurfelcache.h"
+#include "raytilecache.h"
+#include "raytool.h"
 #include "rayforeststructure.h"
+#include "raytrajectory.h"
+#include "raytransientgrid.h"
+#include "rayvoxelset.h"
+#include <algorithm>
 #include <vector>
 #include <gtest/gtest.h>
+#include <nabo/nabo.h>
 #include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#ifndef _WIN32
+#include <sys/wait.h>
+#endif // _WIN32
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif // defined(__linux__)
 
 /// Raycloud testing framework. In each test, the statistics of the resulting clouds are compared to the statistics
 /// of the cloud when it was confirmed to be operating correctly. 
@@ -26,6 +81,31 @@ namespace raytest
     #endif // _WIN32
   }
 
+  /// The exit code of a command, from the status that @c command() returns.
+  int exitCode(int status)
+  {
+    #ifdef _WIN32
+    return status;
+    #else
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    #endif // _WIN32
+  }
+
+  /// Whether the optional backend @c name must be in use, from the space separated names in RAYTEST_REQUIRE. A build
+  /// job sets this to the backends that it is built with, so that their tests fail, rather than testing only the
+  /// fallback, when a backend is missing or unavailable.
+  bool required(const std::string &name)
+  {
+    const char *names = std::getenv("RAYTEST_REQUIRE");
+    std::istringstream list(names ? names : "");
+    for (std::string word; list >> word;)
+    {
+      if (word == name)
+        return true;
+    }
+    return false;
+  }
+
   /// Issues the command to copy a file, which is a platform dependent system command.
   int copy(const std::string &copy_command)
   {
@@ -70,6 +150,120 @@ namespace raytest
     EXPECT_TRUE(cloud.load("room_aligned.ply"));
     compareMoments(cloud.getMoments(), {-0.0618268, -0.077552, 0.0531072, 7.58334e-08, 7.97642e-08, 1.93877e-08, -0.180532, -0.219257, 0.0654452, 2.47241, 2.08183, 1.28226, 17.539, 10.1994, 0.304682, 0.761892, 0.429502, 0.987362, 0.318932, 0.225742, 0.389901, 0.111705});  }
 
+  /// Aligns a rotated room to its axes in one read, binning the end points as its bounds are found. This records the
+  /// bounds in the info sidecar, so the second alignment bins into the final arrays directly, which should agree
+  TEST(Basic, RayAlignAxes)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    EXPECT_EQ(copy("room.ply room_axes.ply"), 0);
+    EXPECT_EQ(command("rayrotate room_axes.ply 0,0,35"), 0);
+    std::remove(ray::plyInfoFileName("room_axes.ply").c_str());
+    EXPECT_EQ(command("rayalign room_axes.ply"), 0);
+    ray::Cloud::Info info;
+    EXPECT_TRUE(ray::readPlyInfo("room_axes.ply", info));
+    ray::Cloud single_read;
+    EXPECT_TRUE(single_read.load("room_axes_aligned.ply"));
+    EXPECT_EQ(command("rayalign room_axes.ply"), 0);
+    ray::Cloud known_bounds;
+    EXPECT_TRUE(known_bounds.load("room_axes_aligned.ply"));
+    ASSERT_EQ(single_read.rayCount(), known_bounds.rayCount());
+    double max_distance = 0.0;
+    for (size_t i = 0; i < single_read.rayCount(); i++)
+    {
+      max_distance = std::max(max_distance, (single_read.ends[i] - known_bounds.ends[i]).norm());
+    }
+    EXPECT_LT(max_distance, 0.05);
+  }
+
+  /// Aligns a rotated room as above, refining the coarse alignment down to a finer voxel width
+  TEST(Basic, RayAlignPyramid)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    EXPECT_EQ(copy("room.ply room2.ply"), 0);
+    EXPECT_EQ(command("rayrotate room2.ply 0,0,35"), 0);
+    EXPECT_EQ(command("rayalign room.ply room2.ply --fine_width 0.1"), 0);
+    ray::Cloud cloud;
+    EXPECT_TRUE(cloud.load("room_aligned.ply"));
+    compareMoments(cloud.getMoments(), {-0.0618268, -0.077552, 0.0531072, 7.58334e-08, 7.97642e-08, 1.93877e-08, -0.180532, -0.219257, 0.0654452, 2.47241, 2.08183, 1.28226, 17.539, 10.1994, 0.304682, 0.761892, 0.429502, 0.987362, 0.318932, 0.225742, 0.389901, 0.111705});
+  }
+
+  /// Registers three offset copies of a room together, expecting each to return to the original room
+  TEST(Basic, RayAlignRegister)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    EXPECT_EQ(copy("room.ply room_a.ply"), 0);
+    EXPECT_EQ(copy("room.ply room_b.ply"), 0);
+    EXPECT_EQ(copy("room.ply room_c.ply"), 0);
+    EXPECT_EQ(command("raytranslate room_b.ply 0.2,0,0.1"), 0);
+    EXPECT_EQ(command("rayrotate room_c.ply 0,0,3"), 0);
+    EXPECT_EQ(command("rayalign register room_a.ply room_b.ply room_c.ply"), 0);
+    ray::Cloud room;
+    EXPECT_TRUE(room.load("room.ply"));
+    Eigen::ArrayXd moments = room.getMoments();
+    std::vector<double> expected(moments.data(), moments.data() + moments.size());
+    for (const char *name : { "room_b_aligned.ply", "room_c_aligned.ply" })
+    {
+      ray::Cloud cloud;
+      EXPECT_TRUE(cloud.load(name));
+      compareMoments(cloud.getMoments(), expected, 0.02);
+    }
+  }
+
+  /// The real transforms of a grid match a direct discrete Fourier transform, which checks FFTW's real to complex
+  /// layouts when built with it, and the inverse of one spectrum times the conjugate of another is the circular
+  /// cross-correlation of the grids, as rayalign uses
+  TEST(Basic, RealFft)
+  {
+#if !RAYLIB_WITH_FFTW
+    EXPECT_FALSE(required("fftw")) << "raylib is built without FFTW";
+#endif  // !RAYLIB_WITH_FFTW
+    const Eigen::Vector3i dims(8, 4, 2);
+    std::mt19937 gen(5);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    ray::Array3D grids[2];
+    for (auto &grid : grids)
+    {
+      grid.init(Eigen::Vector3d::Zero(), 1.0, dims);
+      for (int z = 0; z < dims[2]; z++)
+        for (int y = 0; y < dims[1]; y++)
+          for (int x = 0; x < dims[0]; x++) grid(x, y, z) = uniform(gen);
+    }
+    ray::Array3D spectrum = grids[0], other = grids[1];
+    spectrum.realFft();
+    other.realFft();
+    for (int w = 0; w < dims[2]; w++)
+      for (int v = 0; v < dims[1]; v++)
+        for (int u = 0; u < dims[0]; u++)
+        {
+          Complex expected(0.0, 0.0);
+          for (int z = 0; z < dims[2]; z++)
+            for (int y = 0; y < dims[1]; y++)
+              for (int x = 0; x < dims[0]; x++)
+              {
+                const double phase = -2.0 * ray::kPi * (u * x / 8.0 + v * y / 4.0 + w * z / 2.0);
+                expected += grids[0](x, y, z) * Complex(std::cos(phase), std::sin(phase));
+              }
+          EXPECT_LT(std::abs(spectrum(u, v, w) - expected), 1e-9);
+        }
+
+    other.conjugate();
+    spectrum *= other;
+    spectrum.inverseRealFft();
+    for (int dz = 0; dz < dims[2]; dz++)
+      for (int dy = 0; dy < dims[1]; dy++)
+        for (int dx = 0; dx < dims[0]; dx++)
+        {
+          double expected = 0.0;
+          for (int z = 0; z < dims[2]; z++)
+            for (int y = 0; y < dims[1]; y++)
+              for (int x = 0; x < dims[0]; x++)
+                expected += grids[0]((x + dx) % dims[0], (y + dy) % dims[1], (z + dz) % dims[2]).real() *
+                            grids[1](x, y, z).real();
+          EXPECT_NEAR(spectrum(dx, dy, dz).real(), expected, 1e-9);
+          EXPECT_EQ(spectrum(dx, dy, dz).imag(), 0.0);
+        }
+  }
+
   /// Colours a room according to the normal direction of the surfaces, comparing to the expected results
   TEST(Basic, RayColour)
   {
@@ -92,7 +286,49 @@ namespace raytest
     EXPECT_TRUE(cloud.load("room_combined.ply"));
     compareMoments(cloud.getMoments(), {-0.0867714, -0.0679941, 0.546619, 0.0215326, 0.0272819, 0.499969, -0.305657, -0.186353, 0.582642, 2.95777, 2.47531, 1.63323, 17.4967, 10.1789, 0.305355, 0.763356, 0.427376, 0.979005, 0.318409, 0.225661, 0.389366, 0.143369});
   }
+
+  /// As above, but appending each room in turn to a map kept on disk, which should give the same combined cloud
+  TEST(Basic, RayCombineIncremental)
+  {
+    EXPECT_EQ(command("./raycreate room 1"), 0);
+    EXPECT_EQ(copy("room.ply room2.ply"), 0);
+    EXPECT_EQ(command("./raytranslate room2.ply 0,0,1"), 0);
+    EXPECT_EQ(command("./rayrotate room2.ply 0,0,35"), 0);
+    std::remove("map.ply");
+    std::remove("map.ply.merge");
+    EXPECT_EQ(command("./raycombine min map.ply append room.ply 1 rays"), 0);
+    EXPECT_EQ(command("./raycombine min map.ply append room2.ply 1 rays"), 0);
+    ray::Cloud cloud;
+    EXPECT_TRUE(cloud.load("map.ply"));
+    compareMoments(cloud.getMoments(), {-0.0867714, -0.0679941, 0.546619, 0.0215326, 0.0272819, 0.499969, -0.305657, -0.186353, 0.582642, 2.95777, 2.47531, 1.63323, 17.4967, 10.1789, 0.305355, 0.763356, 0.427376, 0.979005, 0.318409, 0.225661, 0.389366, 0.143369});
+  }
   
+  /// Concatenates two clouds whose times interleave, in file order and then in time order, checking no rays are lost
+  TEST(Basic, RayCombineAll)
+  {
+    ray::Cloud clouds[2];
+    const ray::RGBA colour = { 100, 150, 50, 255 };
+    for (int i = 0; i < 1000; i++)
+    {
+      ray::Cloud &cloud = clouds[i % 2];
+      cloud.addRay(Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(i % 10, i / 10, 1.0), (double)i, colour);
+    }
+    clouds[0].save("combine_a.ply");
+    clouds[1].save("combine_b.ply");
+    EXPECT_EQ(command("./raycombine all combine_a.ply combine_b.ply --output combine_all.ply"), 0);
+    ray::Cloud concatenated;
+    EXPECT_TRUE(concatenated.load("combine_all.ply"));
+    ASSERT_EQ(concatenated.rayCount(), 1000u);
+    EXPECT_EQ(concatenated.times[499], 998.0);
+    EXPECT_EQ(concatenated.times[500], 1.0);
+
+    EXPECT_TRUE(ray::concatenateClouds({ "combine_a.ply", "combine_b.ply" }, "combine_ordered.ply", true));
+    ray::Cloud ordered;
+    EXPECT_TRUE(ordered.load("combine_ordered.ply"));
+    ASSERT_EQ(ordered.rayCount(), 1000u);
+    for (size_t i = 0; i < ordered.times.size(); i++) EXPECT_EQ(ordered.times[i], (double)i);
+  }
+
   /// Creates a building with random seed 1, and compares to the expected results
   TEST(Basic, RayCreate)
   {
@@ -114,6 +350,24 @@ namespace raytest
     compareMoments(cloud.getMoments(), {-0.222571, 1.08156, 1.67264, 6.00755, 5.78731, 0.508713, -0.202668, 1.09517, 2.6238, 6.0285, 5.85715, 3.22093, 69.0574, 35.2775, 0.48969, 0.498403, 0.443549, 1, 0.379062, 0.366963, 0.389535, 0});
   }
 
+  /// The parallel bucketed decimation keeps exactly the rays of the serial decimation
+  TEST(Basic, RayDecimateParallel)
+  {
+    EXPECT_EQ(command("raycreate forest 1"), 0);
+    EXPECT_EQ(command("raydecimate forest.ply 10 cm"), 0);
+    ray::Cloud serial;
+    EXPECT_TRUE(serial.load("forest_decimated.ply"));
+    EXPECT_EQ(command("raydecimate forest.ply 10 cm --parallel"), 0);
+    ray::Cloud parallel;
+    EXPECT_TRUE(parallel.load("forest_decimated.ply"));
+    ASSERT_EQ(serial.ends.size(), parallel.ends.size());
+    for (size_t i = 0; i < serial.ends.size(); i++)
+    {
+      EXPECT_EQ(serial.ends[i], parallel.ends[i]);
+      EXPECT_EQ(serial.times[i], parallel.times[i]);
+    }
+  }
+
   /// Creates a room, and calls denoise using a fixed distance threshols, and compares to expected result
   TEST(Basic, RayDenoise)
   {
@@ -124,6 +378,78 @@ namespace raytest
     compareMoments(cloud.getMoments(), {-0.108066, -0.0410134, 0.052168, 8.67026e-08, 8.81787e-08, 2.24394e-08, -0.464107, -0.113806, 0.161496, 2.82122, 2.34281, 1.35279, 17.81, 10.2005, 0.297047, 0.758802, 0.440232, 0.975166, 0.317215, 0.226682, 0.390971, 0.155618});
   }
 
+  /// Denoises a forest whole and in tiles, each ray being decided by one tile, so the results should be identical
+  TEST(Basic, RayDenoiseTiled)
+  {
+    EXPECT_EQ(command("raycreate forest 1"), 0);
+    EXPECT_EQ(command("raydenoise forest.ply 2 cm"), 0);
+    ray::Cloud whole;
+    EXPECT_TRUE(whole.load("forest_denoised.ply"));
+    EXPECT_EQ(command("raydenoise forest.ply 2 cm --tiled --threads 8"), 0);
+    ray::Cloud tiled;
+    EXPECT_TRUE(tiled.load("forest_denoised.ply"));
+    ASSERT_EQ(whole.ends.size(), tiled.ends.size());
+    for (size_t i = 0; i < whole.ends.size(); i++)
+    {
+      EXPECT_EQ(whole.ends[i], tiled.ends[i]);
+      EXPECT_EQ(whole.times[i], tiled.times[i]);
+    }
+  }
+
+  /// Denoises a forest in tiles across two nodes, run one after the other, which should match denoising on one node
+  TEST(Basic, RayDenoiseNodes)
+  {
+    EXPECT_EQ(command("raycreate forest 1"), 0);
+    EXPECT_EQ(command("raydenoise forest.ply 2 cm --tiled"), 0);
+    ray::Cloud single;
+    EXPECT_TRUE(single.load("forest_denoised.ply"));
+    std::remove("forest_denoised.ply");
+    EXPECT_EQ(command("raydenoise forest.ply 2 cm --tiled --node 1/2"), 0);
+    EXPECT_FALSE(std::ifstream("forest_denoised.ply").good());  // only node 0 writes the output
+    EXPECT_EQ(command("raydenoise forest.ply 2 cm --tiled --node 0/2"), 0);
+    ray::Cloud nodes;
+    EXPECT_TRUE(nodes.load("forest_denoised.ply"));
+    ASSERT_EQ(single.ends.size(), nodes.ends.size());
+    for (size_t i = 0; i < single.ends.size(); i++)
+    {
+      EXPECT_EQ(single.ends[i], nodes.ends[i]);
+    }
+    // the node parses its option from the arguments, and owns every second tile
+    char name[] = "tool", node[] = "--node", index[] = "1/2", file[] = "cloud.ply";
+    char *argv[] = { name, node, index, file, nullptr };
+    int argc = 4;
+    ray::Nodes::initFromArguments(argc, argv);
+    ASSERT_EQ(argc, 2);
+    EXPECT_STREQ(argv[1], "cloud.ply");
+    EXPECT_EQ(ray::Nodes::index(), 1);
+    EXPECT_EQ(ray::Nodes::count(), 2);
+    EXPECT_TRUE(ray::Nodes::ownsTile(3));
+    EXPECT_FALSE(ray::Nodes::ownsTile(4));
+    ray::Nodes::init(0, 1);
+  }
+
+  /// Smooths a room over two iterations in tiles, which should match smoothing the whole room other than where the
+  /// neighbourhoods of sparse points reach beyond the tile halos
+  TEST(Basic, RaySmoothTiled)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    EXPECT_EQ(command("raysmooth room.ply --iterations 2"), 0);
+    ray::Cloud whole;
+    EXPECT_TRUE(whole.load("room_smooth.ply"));
+    EXPECT_EQ(command("raysmooth room.ply --iterations 2 --tiled --threads 8"), 0);
+    ray::Cloud tiled;
+    EXPECT_TRUE(tiled.load("room_smooth.ply"));
+    ASSERT_EQ(whole.ends.size(), tiled.ends.size());
+    size_t num_same = 0;
+    for (size_t i = 0; i < whole.ends.size(); i++)
+    {
+      EXPECT_LT((whole.ends[i] - tiled.ends[i]).norm(), 0.01);
+      EXPECT_EQ(whole.times[i], tiled.times[i]);
+      num_same += whole.ends[i] == tiled.ends[i] ? 1 : 0;
+    }
+    EXPECT_GT(num_same, whole.ends.size() * 99 / 100);
+  }
+
   /// Creates two rooms, the second is decimated and transformed, then rayrestore is called to apply this transformation to
   /// the first (high resolution) room
   TEST(Basic, RayRestore)
@@ -159,6 +485,631 @@ namespace raytest
     compareMoments(cloud.getMoments(), {-0.108066, -0.0410134, 0.052168, 7.05134e-08, 8.45038e-08, 1.93877e-08, -0.27615, -0.0761079, 0.0656267, 2.42413, 2.13691, 1.28163, 17.539, 10.1994, 0.304682, 0.761892, 0.429502, 0.987362, 0.318932, 0.225742, 0.389901, 0.111705});
   }  
 
+  /// Loads only some fields of a room, which should match those of the full load, then loads the rest on demand
+  TEST(Basic, CloudLoadFields)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    ray::Cloud room;
+    EXPECT_TRUE(room.load("room.ply"));
+    room.save("room_fields.rcb");
+    for (const std::string file_name : { "room.ply", "room_fields.rcb" })
+    {
+      ray::Cloud full, cloud;
+      EXPECT_TRUE(full.load(file_name));
+      EXPECT_TRUE(cloud.loadFields(file_name, ray::kCFColours));
+      EXPECT_EQ(cloud.fields(), unsigned(ray::kCFEnds | ray::kCFColours));
+      EXPECT_TRUE(cloud.starts.empty());
+      EXPECT_TRUE(cloud.times.empty());
+      EXPECT_TRUE(cloud.ends == full.ends);
+      EXPECT_EQ(cloud.colours.size(), full.colours.size());
+      EXPECT_TRUE(cloud.materialiseFields(ray::kCFTimes));
+      EXPECT_TRUE(cloud.times == full.times);
+      EXPECT_TRUE(cloud.starts.empty());
+
+      // once the rays differ from the file, the remaining fields cannot be loaded
+      cloud.removeUnboundedRays();
+      if (cloud.rayCount() != full.rayCount())
+      {
+        EXPECT_FALSE(cloud.materialiseFields(ray::kCFStarts));
+        EXPECT_TRUE(cloud.starts.empty());
+      }
+      EXPECT_TRUE(cloud.times.size() == cloud.rayCount());
+    }
+  }
+
+  /// Sorts a room into Morton order, which should be kept through saving and loading, then restores its order
+  TEST(Basic, CloudSortSpatially)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    ray::Cloud room, cloud;
+    EXPECT_TRUE(room.load("room.ply"));
+    EXPECT_FALSE(room.spatiallySorted());
+    EXPECT_TRUE(cloud.load("room.ply"));
+    const std::vector<size_t> order = cloud.sortSpatially();
+    EXPECT_TRUE(cloud.spatiallySorted());
+    std::vector<size_t> sorted_order = order;
+    std::sort(sorted_order.begin(), sorted_order.end());
+    for (size_t i = 0; i < sorted_order.size(); i++) EXPECT_EQ(sorted_order[i], i);
+    for (size_t i = 0; i < order.size(); i++) EXPECT_TRUE(cloud.ends[i] == room.ends[order[i]]);
+    // an unsorted file, whose header is shorter, is written while the sorted files are saved
+    ray::CloudWriter writer;
+    EXPECT_TRUE(writer.begin("room_unsorted.ply"));
+    EXPECT_TRUE(writer.writeChunk(room));
+    for (const std::string file_name : { "room_sorted.ply", "room_sorted.rcb" })
+    {
+      cloud.save(file_name);
+      ray::Cloud loaded;
+      EXPECT_TRUE(loaded.load(file_name));
+      EXPECT_TRUE(loaded.spatiallySorted());
+      EXPECT_EQ(loaded.rayCount(), cloud.rayCount());
+    }
+    writer.end();
+    ray::Cloud unsorted;
+    EXPECT_TRUE(unsorted.load("room_unsorted.ply"));
+    EXPECT_FALSE(unsorted.spatiallySorted());
+    EXPECT_EQ(unsorted.rayCount(), room.rayCount());
+    EXPECT_TRUE(unsorted.ends == room.ends);
+    cloud.restoreOrder(order);
+    EXPECT_FALSE(cloud.spatiallySorted());
+    EXPECT_TRUE(cloud.ends == room.ends);
+    EXPECT_TRUE(cloud.times == room.times);
+  }
+
+  /// Builds a level of detail pyramid of a room, whose levels should give the same decimation as the whole cloud
+  TEST(Basic, RayLod)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    ray::Cloud room;
+    EXPECT_TRUE(room.load("room.ply"));
+    room.save("room_lod.ply");
+    EXPECT_EQ(command("raydecimate room_lod.ply 4 cm"), 0);
+    ray::Cloud decimated;
+    EXPECT_TRUE(decimated.load("room_lod_decimated.ply"));
+
+    EXPECT_EQ(command("raylod room_lod.ply 1 cm"), 0);
+    std::vector<ray::LodLevel> levels;
+    EXPECT_TRUE(ray::readLod("room_lod.ply", levels));
+    ASSERT_GE(levels.size(), 3u);
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+      EXPECT_NEAR(levels[i].voxel_width, 0.01 * double(1 << i), 1e-9);
+      if (i > 0)
+      {
+        EXPECT_LE(levels[i].num_rays, levels[i - 1].num_rays);
+      }
+      ray::Cloud level;
+      EXPECT_TRUE(level.load(ray::lodLevelFileName("room_lod.ply", i), true, 0));
+      EXPECT_EQ(level.rayCount(), levels[i].num_rays);
+    }
+    EXPECT_EQ(ray::coarsestLodLevel(levels, 0.04, true), 2);
+    EXPECT_EQ(ray::coarsestLodLevel(levels, 0.03, true), 0);
+    EXPECT_EQ(ray::coarsestLodLevel(levels, 0.03), 1);
+    EXPECT_EQ(ray::coarsestLodLevel(levels, 0.005), -1);
+
+    EXPECT_EQ(command("raydecimate room_lod.ply 4 cm"), 0);
+    ray::Cloud from_lod;
+    EXPECT_TRUE(from_lod.load("room_lod_decimated.ply"));
+    EXPECT_TRUE(from_lod.ends == decimated.ends);
+    EXPECT_TRUE(from_lod.times == decimated.times);
+    EXPECT_EQ(command("rayrender room_lod.ply top ends --pixel_width 0.05 --output room_lod.png"), 0);
+  }
+
+  /// Fills dense and sparse density grids with a room, whose densities should match before and after the neighbour
+  /// priors
+  TEST(Basic, DensityGridSparse)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    ray::Cloud cloud;
+    EXPECT_TRUE(cloud.load("room.ply"));
+    Eigen::Vector3d min_bound, max_bound;
+    cloud.calcBounds(&min_bound, &max_bound);
+    const double voxel_width = 0.1;
+    const Eigen::Vector3i dims = ((max_bound - min_bound) / voxel_width).cast<int>() + Eigen::Vector3i(2, 2, 2);
+    const ray::Cuboid bounds(min_bound, min_bound + voxel_width * dims.cast<double>());
+    ray::DensityGrid dense(bounds, voxel_width, dims), sparse(bounds, voxel_width, dims, 0);
+    EXPECT_FALSE(dense.sparse());
+    EXPECT_TRUE(sparse.sparse());
+    auto same_densities = [&]() {
+      size_t num_different = 0;
+      double total = 0.0;
+      dense.forEachVoxel([&](const Eigen::Vector3i &inds, const ray::DensityGrid::Voxel &voxel) {
+        total += voxel.density();
+        if (voxel.density() != sparse.voxel(inds).density() || voxel.numRays() != sparse.voxel(inds).numRays())
+          num_different++;
+      });
+      EXPECT_GT(total, 0.0);
+      return num_different == 0;
+    };
+    dense.addRays(cloud.starts, cloud.ends, cloud.colours);
+    sparse.addRays(cloud.starts, cloud.ends, cloud.colours);
+    EXPECT_TRUE(same_densities());
+    dense.addNeighbourPriors();
+    sparse.addNeighbourPriors();
+    EXPECT_TRUE(same_densities());
+  }
+
+  /// Fills a dense density grid large enough to be filled on the GPU when built WITH_CUDA, and a sparse grid, which is
+  /// always filled on the CPU. The ray and hit counts should match exactly, and the path lengths up to the order of
+  /// their additions, before and after the neighbour priors
+  TEST(Basic, DensityGridGpu)
+  {
+    if (required("cuda"))
+    {
+      ASSERT_TRUE(ray::Gpu::available()) << "raylib is built without CUDA, or there is no GPU";
+    }
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    ray::Cloud cloud;
+    EXPECT_TRUE(cloud.load("room.ply"));
+    Eigen::Vector3d min_bound, max_bound;
+    cloud.calcBounds(&min_bound, &max_bound);
+    const double voxel_width = 0.04;
+    ray::Cuboid bounds;
+    Eigen::Vector3i dims;
+    ray::densityGridGeometry(ray::Cuboid(min_bound, max_bound), voxel_width, bounds, dims);
+    ASSERT_GE(static_cast<int64_t>(dims[0]) * dims[1] * dims[2], 1 << 20);  // the least that is filled on the GPU
+    ray::DensityGrid dense(bounds, voxel_width, dims), sparse(bounds, voxel_width, dims, 0);
+    auto near = [](float value, float expected) {
+      return std::abs(value - expected) <= 1e-4f * std::max(1.0f, std::abs(expected));
+    };
+    auto num_different = [&]() {
+      size_t different = 0;
+      dense.forEachVoxel([&](const Eigen::Vector3i &inds, const ray::DensityGrid::Voxel &voxel) {
+        const ray::DensityGrid::Voxel &expected = sparse.voxel(inds);
+        if (!near(voxel.numHits(), expected.numHits()) || !near(voxel.numRays(), expected.numRays()) ||
+            !near(voxel.pathLength(), expected.pathLength()))
+          different++;
+      });
+      return different;
+    };
+    dense.calculateDensities("room.ply");
+    sparse.calculateDensities("room.ply");
+    EXPECT_EQ(num_different(), 0u);
+    dense.addNeighbourPriors();
+    sparse.addNeighbourPriors();
+    EXPECT_EQ(num_different(), 0u);
+  }
+
+  /// Walks two epochs of rays through a shared change grid. In the later epoch the rays pass through a wall that was
+  /// hit in the first, and hit an object where the first epoch's rays passed, so those two voxels should differ, while
+  /// the voxels that only one epoch observes should not
+  TEST(Basic, ChangeGrid)
+  {
+    ray::ChangeConfig config;
+    config.voxel_width = 0.5;
+    ray::ChangeGrid grid(ray::Cuboid(Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(10, 4, 4)), 2, config);
+    const ray::RGBA bounded = { 255, 255, 255, 255 };
+    auto add_rays = [&](int epoch, double y, double end_x) {
+      std::vector<Eigen::Vector3d> starts, ends;
+      for (int i = 0; i < 10; i++)
+      {
+        starts.push_back(Eigen::Vector3d(0.3, y + 0.01 * i, 2.2));
+        ends.push_back(Eigen::Vector3d(end_x, y + 0.01 * i, 2.2));
+      }
+      grid.addRays(epoch, starts, ends, std::vector<ray::RGBA>(starts.size(), bounded));
+    };
+    add_rays(0, 2.2, 5.2);  // the wall
+    add_rays(0, 1.2, 9.2);
+    add_rays(1, 2.2, 9.2);
+    add_rays(1, 1.2, 3.2);  // the new object
+    const std::vector<ray::VoxelChange> changes = grid.changes();
+    ASSERT_EQ(changes.size(), 2u);
+    EXPECT_EQ(changes[0].occupied_epoch, 0);
+    EXPECT_LT((grid.voxelCentre(changes[0].index) - Eigen::Vector3d(5.2, 2.2, 2.2)).cwiseAbs().maxCoeff(), 0.25);
+    EXPECT_EQ(changes[1].occupied_epoch, 1);
+    EXPECT_LT((grid.voxelCentre(changes[1].index) - Eigen::Vector3d(3.2, 1.2, 2.2)).cwiseAbs().maxCoeff(), 0.25);
+    EXPECT_TRUE(grid.changedWithin(0, Eigen::Vector3d(5.0, 2.0, 2.0), Eigen::Vector3d(5.4, 2.4, 2.4)));
+    EXPECT_FALSE(grid.changedWithin(1, Eigen::Vector3d(5.0, 2.0, 2.0), Eigen::Vector3d(5.4, 2.4, 2.4)));
+    EXPECT_FALSE(grid.changedWithin(0, Eigen::Vector3d(20, 20, 20), Eigen::Vector3d(30, 30, 30)));
+  }
+
+  /// Streams points ahead of a trajectory that lags half a second behind them. The points should wait for their poses,
+  /// the rays should be output chunk by chunk as they are captured rather than at the end, and they should be the
+  /// decimation of the rays that the trajectory gives, with the starts on the trajectory
+  TEST(Basic, LiveIngest)
+  {
+    ray::IngestConfig config;
+    config.voxel_width = 0.1;
+    config.chunk_duration = 1.0;
+    size_t num_chunks = 0;
+    ray::Cloud cloud;
+    ray::LiveIngest ingest(config, nullptr, [&](const ray::Cloud &chunk) {
+      num_chunks++;
+      EXPECT_FALSE(chunk.ends.empty());
+      for (size_t i = 0; i < chunk.ends.size(); i++) cloud.addRay(chunk, i);
+    });
+    // the sensor moves along x at 1 m/s, past a wall at y = 5
+    std::vector<Eigen::Vector3d> all_ends;
+    const ray::RGBA bounded = { 255, 255, 255, 255 };
+    const double lag = 0.5;
+    int num_poses = 0;
+    for (int step = 0; step < 100; step++)
+    {
+      std::vector<Eigen::Vector3d> ends;
+      std::vector<double> times;
+      for (int i = 0; i < 100; i++)
+      {
+        const double time = 0.1 * step + 0.001 * i;
+        ends.push_back(Eigen::Vector3d(time, 5.0, 0.013 * (i % 40)));
+        times.push_back(time);
+      }
+      all_ends.insert(all_ends.end(), ends.begin(), ends.end());
+      EXPECT_TRUE(ingest.addPoints(ends, times, std::vector<ray::RGBA>(ends.size(), bounded)));
+      for (; 0.05 * num_poses <= 0.1 * step - lag; num_poses++)
+      {
+        EXPECT_TRUE(ingest.addPose(0.05 * num_poses, Eigen::Vector3d(0.05 * num_poses, 0, 0)));
+      }
+      if (step > 10)
+      {
+        EXPECT_GT(ingest.numPending(), 0u);
+        EXPECT_LE(ingest.numPending(), 700u);  // no more than the lag and the latest message wait
+      }
+      if (step == 50)
+      {
+        EXPECT_GE(num_chunks, 3u);
+      }
+    }
+    EXPECT_TRUE(ingest.finish());
+    EXPECT_EQ(ingest.numPending(), 0u);
+    EXPECT_EQ(ingest.numReceived(), all_ends.size());
+    EXPECT_EQ(num_chunks, ingest.numChunks());
+    EXPECT_EQ(num_chunks, 10u);
+
+    std::vector<int64_t> expected;
+    ray::VoxelSet voxel_set;
+    ray::voxelSubsample(all_ends, config.voxel_width, expected, voxel_set);
+    ASSERT_EQ(cloud.ends.size(), expected.size());
+    EXPECT_EQ(ingest.numWritten() + ingest.numDecimated(), all_ends.size());
+    for (size_t i = 0; i < cloud.ends.size(); i++)
+    {
+      EXPECT_LT((cloud.ends[i] - all_ends[expected[i]]).norm(), 1e-4);
+      EXPECT_LT((cloud.starts[i] - Eigen::Vector3d(cloud.times[i], 0, 0)).norm(), 1e-4);
+    }
+  }
+
+  /// Builds the packed values of a contiguous grid, which should be per voxel in the order they were added
+  TEST(Basic, ContiguousGridBuild)
+  {
+    ray::ContiguousGrid<int> grid(Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(4, 4, 2), 1.0);
+    const int num_items = 10000;
+    // each item adds itself to two voxels, one of which is out of range for some items
+    auto visit = [](size_t i, const auto &add) {
+      const int id = static_cast<int>(i);
+      add(Eigen::Vector3i(id % 4, (id / 4) % 4, 0), id);
+      add(Eigen::Vector3i(id % 5, 1, 1), id);
+    };
+    for (int build = 0; build < 2; build++)  // rebuilding should replace the values
+    {
+      grid.build(num_items, visit);
+      size_t total = 0;
+      for (int x = 0; x < 4; x++)
+      {
+        for (int y = 0; y < 4; y++)
+        {
+          for (int z = 0; z < 2; z++)
+          {
+            const auto values = grid.values(Eigen::Vector3i(x, y, z));
+            std::vector<int> expected;
+            for (int id = 0; id < num_items; id++)
+            {
+              if ((z == 0 && id % 4 == x && (id / 4) % 4 == y) || (z == 1 && y == 1 && id % 5 == x))
+                expected.push_back(id);
+            }
+            EXPECT_EQ(std::vector<int>(values.begin(), values.end()), expected);
+            total += values.size();
+          }
+        }
+      }
+      EXPECT_EQ(total, static_cast<size_t>(num_items + num_items * 4 / 5));
+      EXPECT_TRUE(grid.values(Eigen::Vector3i(4, 1, 1)).empty());
+    }
+  }
+
+  /// Fills a hash grid over a continental extent at a fine voxel width, whose voxel count overflows 32-bit indices
+  TEST(Basic, GridLargeExtent)
+  {
+    const Eigen::Vector3d min_bound(300000.0, 5000000.0, -100.0);
+    const Eigen::Vector3d max_bound = min_bound + Eigen::Vector3d(4000000.0, 4000000.0, 5000.0);
+    const double voxel_width = 0.01;
+    ray::Grid<int> grid(min_bound, max_bound, voxel_width, 1000);
+    EXPECT_GT(static_cast<double>(grid.dims[0]) * static_cast<double>(grid.dims[1]), 1e16);
+    std::vector<Eigen::Vector3d> points;
+    for (int i = 0; i < 5000; i++)
+    {
+      // pairs of points in neighbouring voxels, spread over the whole extent
+      const Eigen::Vector3d pos =
+        min_bound + Eigen::Vector3d(797.0 * i, 3989.0 * i, 0.9 * i) + Eigen::Vector3d(0.005, 0.005, 0.005);
+      points.push_back(pos);
+      points.push_back(pos + Eigen::Vector3d(voxel_width, 0, 0));
+    }
+    for (size_t i = 0; i < points.size(); i++) grid.insert(grid.index(points[i]), static_cast<int>(i));
+    EXPECT_EQ(grid.cellCount(), points.size());
+    grid.reserve(points.size());  // rehash for the actual occupancy
+    EXPECT_EQ(grid.cellCount(), points.size());
+    for (size_t i = 0; i < points.size(); i++)
+    {
+      const auto &cell = grid.cell(grid.index(points[i]));
+      ASSERT_EQ(cell.data.size(), 1u);
+      EXPECT_EQ(cell.data[0], static_cast<int>(i));
+    }
+    EXPECT_TRUE(grid.cell(grid.index(min_bound + Eigen::Vector3d(1.0, 1.0, 1.0))).data.empty());
+  }
+
+  /// Renders a room in strips, which should give the same image as rendering it whole
+  TEST(Basic, RayRenderTiled)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    auto file_bytes = [](const std::string &file_name) {
+      std::ifstream file(file_name, std::ios::binary);
+      return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    };
+    for (const std::string style : { "ends", "rays", "height" })
+    {
+      EXPECT_EQ(command("rayrender room.ply left " + style + " --pixel_width 0.02 --output room_whole.png"), 0);
+      EXPECT_EQ(command("rayrender room.ply left " + style + " --pixel_width 0.02 --output room_tiled.png --tile_size 16"),
+                0);
+      const std::string whole = file_bytes("room_whole.png");
+      EXPECT_FALSE(whole.empty());
+      EXPECT_EQ(whole, file_bytes("room_tiled.png"));
+    }
+    EXPECT_EQ(command("rayrender room.ply top ends --pixel_width 0.02 --output room_tiled.hdr --tile_size 16"), 0);
+    EXPECT_FALSE(file_bytes("room_tiled.hdr").empty());
+    EXPECT_NE(command("rayrender room.ply top density --output room_tiled.png --tile_size 16"), 0);
+  }
+
+  /// Renders several views and styles of a room from one read, which should match rendering each of them separately
+  TEST(Basic, RayRenderViews)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    auto file_bytes = [](const std::string &file_name) {
+      std::ifstream file(file_name, std::ios::binary);
+      return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    };
+    EXPECT_EQ(command("rayrender room.ply top ends front height left density top density_rgb --pixel_width 0.05 "
+                      "--output room_views.png"),
+              0);
+    const std::vector<std::pair<std::string, std::string>> views = {
+      { "top", "ends" }, { "front", "height" }, { "left", "density" }, { "top", "density_rgb" }
+    };
+    for (const auto &view : views)
+    {
+      EXPECT_EQ(command("rayrender room.ply " + view.first + " " + view.second +
+                        " --pixel_width 0.05 --output room_view.png"),
+                0);
+      const std::string single = file_bytes("room_view.png");
+      EXPECT_FALSE(single.empty());
+      EXPECT_EQ(single, file_bytes("room_views_" + view.first + "_" + view.second + ".png"));
+    }
+    EXPECT_NE(command("rayrender room.ply top ends left ends --output room_views.png --tile_size 16"), 0);
+  }
+
+  /// Adds rays along a row of voxels, which should credit each voxel with the path length of the rays within it, and a
+  /// hit only to the voxel that an unclipped bounded ray ends in
+  TEST(Basic, DensityGridCrediting)
+  {
+    const ray::Cuboid bounds(Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(4, 1, 1));
+    const std::vector<Eigen::Vector3d> starts = { { 0.5, 0.5, 0.5 }, { 3.5, 0.5, 0.5 }, { 3.5, 0.5, 0.5 } };
+    const std::vector<Eigen::Vector3d> ends = { { 2.25, 0.5, 0.5 }, { 1.5, 0.5, 0.5 }, { 5.0, 0.5, 0.5 } };
+    std::vector<ray::RGBA> colours(3);
+    for (auto &colour : colours) colour.red = colour.green = colour.blue = colour.alpha = 255;
+    colours[1].alpha = 0;  // unbounded, so a miss in its last voxel, while the third ray is clipped at the bounds
+    const double hits[4] = { 0, 0, 1, 0 };
+    const double rays[4] = { 1, 2, 2, 2 };
+    const double lengths[4] = { 0.5, 1.5, 1.25, 1.0 };
+    for (const int64_t max_dense_voxels : { ray::DensityGrid::default_max_dense_voxels, int64_t(0) })
+    {
+      ray::DensityGrid grid(bounds, 1.0, Eigen::Vector3i(4, 1, 1), max_dense_voxels);
+      EXPECT_EQ(grid.sparse(), max_dense_voxels == 0);
+      grid.addRays(starts, ends, colours);
+      for (int x = 0; x < 4; x++)
+      {
+        const ray::DensityGrid::Voxel &voxel = grid.voxel(Eigen::Vector3i(x, 0, 0));
+        EXPECT_NEAR(voxel.numHits(), hits[x], 1e-6) << "voxel " << x;
+        EXPECT_NEAR(voxel.numRays(), rays[x], 1e-6) << "voxel " << x;
+        EXPECT_NEAR(voxel.pathLength(), lengths[x], 1e-6) << "voxel " << x;
+      }
+    }
+  }
+
+  /// Saves the voxel densities of a room, which the density renders should read in place of the rays, unchanged
+  TEST(Basic, RayDensitySaved)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    auto file_bytes = [](const std::string &file_name) {
+      std::ifstream file(file_name, std::ios::binary);
+      return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    };
+    std::remove("room.ply.density");
+    for (const std::string style : { "density", "density_rgb" })
+    {
+      EXPECT_EQ(command("rayrender room.ply top " + style + " --pixel_width 0.05 --output room_traced.png"), 0);
+      EXPECT_EQ(command("raydensity room.ply --pixel_width 0.05"), 0);
+      ray::Cuboid grid_bounds;
+      Eigen::Vector3i dims;
+      ray::Cloud::Info info;
+      EXPECT_TRUE(ray::Cloud::getInfo("room.ply", info));
+      ray::densityGridGeometry(info.ends_bound, 0.05, grid_bounds, dims);
+      ray::DensityGrid saved(grid_bounds, 0.05, dims);
+      EXPECT_TRUE(saved.load("room.ply"));
+      EXPECT_EQ(command("rayrender room.ply top " + style + " --pixel_width 0.05 --output room_saved.png"), 0);
+      const std::string traced = file_bytes("room_traced.png");
+      EXPECT_FALSE(traced.empty());
+      EXPECT_EQ(traced, file_bytes("room_saved.png"));
+      std::remove("room.ply.density");
+    }
+  }
+
+  /// Converts a tree file to binary and back, which should load as the same trees
+  TEST(Basic, RayTreeConvert)
+  {
+    ray::ForestStructure forest;
+    for (int t = 0; t < 3; t++)
+    {
+      ray::TreeStructure tree;
+      tree.attributes() = { "height", "section_id" };
+      for (int i = 0; i < 4; i++)
+      {
+        ray::TreeStructure::Segment segment;
+        segment.tip = Eigen::Vector3d(t + 0.25, 1.5 - t, 0.5 * i);
+        segment.radius = 0.3 / (1.0 + i);
+        segment.parent_id = i - 1;
+        segment.attributes = { 2.0 + t, static_cast<double>(i) };
+        tree.segments().push_back(segment);
+      }
+      forest.trees.push_back(tree);
+    }
+    EXPECT_TRUE(forest.save("converted_trees.txt"));
+    const Eigen::ArrayXd moments = forest.getMoments();
+    const std::vector<double> expected(moments.data(), moments.data() + moments.size());
+    EXPECT_EQ(command("raytreeconvert converted_trees.txt"), 0);
+    EXPECT_TRUE(ray::ForestStructure::isBinaryFile("converted_trees.bin"));
+    ray::ForestStructure binary;
+    EXPECT_TRUE(binary.load("converted_trees.bin"));
+    EXPECT_EQ(binary.trees.size(), forest.trees.size());
+    compareMoments(binary.getMoments(), expected, 1e-6);
+
+    std::remove("converted_trees.txt");
+    EXPECT_EQ(command("raytreeconvert converted_trees.bin"), 0);
+    ray::ForestStructure text;
+    EXPECT_TRUE(text.load("converted_trees.txt"));
+    EXPECT_FALSE(ray::ForestStructure::isBinaryFile("converted_trees.txt"));
+    compareMoments(text.getMoments(), expected, 1e-4);
+    EXPECT_EQ(text.trees[2].segments()[3].parent_id, 2);
+  }
+
+  /// Runs tools through the multi-call executable, alone and as a batch, which should match the standalone tools
+  TEST(Basic, RayMultiCall)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    auto file_bytes = [](const std::string &file_name) {
+      std::ifstream file(file_name, std::ios::binary);
+      return std::string((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    };
+    EXPECT_EQ(command("raydecimate room.ply 10 cm"), 0);
+    EXPECT_EQ(command("rayrender room.ply top ends --pixel_width 0.05"), 0);
+    const std::string decimated = file_bytes("room_decimated.ply");
+    const std::string rendered = file_bytes("room.png");
+    EXPECT_FALSE(decimated.empty());
+    EXPECT_FALSE(rendered.empty());
+
+    EXPECT_EQ(command("ray decimate room.ply 10 cm"), 0);
+    EXPECT_EQ(file_bytes("room_decimated.ply"), decimated);
+    {
+      std::ofstream batch("room_jobs.txt");
+      batch << "# a failed command should not stop the batch" << std::endl;
+      batch << "raydecimate" << std::endl;
+      batch << "decimate room.ply 10 cm --parallel --profile room_profile1.json" << std::endl;
+      batch << "split room.ply plane 0,0,1 --profile room_profile2.json" << std::endl;
+      batch << "decimate room.ply 10 cm --threads 2" << std::endl;
+      batch << std::endl;
+      batch << "render room.ply top ends --pixel_width 0.05 --output \"room.png\"" << std::endl;
+    }
+    std::remove("room_decimated.ply");
+    std::remove("room.png");
+    std::remove("room_profile1.json");
+    std::remove("room_profile2.json");
+    EXPECT_EQ(exitCode(command("ray --batch room_jobs.txt")), 1);
+    EXPECT_EQ(file_bytes("room_decimated.ply"), decimated);
+    EXPECT_EQ(file_bytes("room.png"), rendered);
+    // each profile holds the phases of its own command alone
+    const std::string decimate_profile = file_bytes("room_profile1.json");
+    const std::string split_profile = file_bytes("room_profile2.json");
+    EXPECT_NE(decimate_profile.find("\"decimateInBuckets\""), std::string::npos);
+    EXPECT_EQ(decimate_profile.find("\"split\""), std::string::npos);
+    EXPECT_NE(split_profile.find("\"split\""), std::string::npos);
+    EXPECT_EQ(split_profile.find("\"decimateInBuckets\""), std::string::npos);
+
+    // a usage exit within Tool::run returns its exit code rather than ending the process
+    auto usage_exit = [](int, char *[]) -> int { ray::Tool::exit(3); };
+    EXPECT_EQ(ray::Tool::run(usage_exit, 0, nullptr), 3);
+    EXPECT_FALSE(ray::Tool::running());
+  }
+
+  /// Queues debug draws behind a draw that is still being sent, which should replace or drop the later draws in turn
+  TEST(Basic, DebugDrawQueue)
+  {
+    std::mutex sending;
+    std::vector<int> sent;
+    ray::DebugDrawQueue queue(100);
+    std::unique_lock<std::mutex> hold(sending);  // holds the sender in the first draw
+    EXPECT_TRUE(queue.push(0, 0, 10, [&]() { std::lock_guard<std::mutex> lock(sending); sent.push_back(0); }));
+    EXPECT_TRUE(queue.push(0, 1, 10, [&]() { sent.push_back(1); }));
+    EXPECT_TRUE(queue.push(1, 0, 10, [&]() { sent.push_back(2); }));
+    EXPECT_TRUE(queue.push(0, 1, 10, [&]() { sent.push_back(3); }));  // replaces draw 1, in its place
+    EXPECT_FALSE(queue.push(2, 0, 200, [&]() { sent.push_back(4); }));  // too large for the queue
+    hold.unlock();
+    queue.flush();
+    EXPECT_EQ(sent, std::vector<int>({ 0, 3, 2 }));
+    EXPECT_EQ(queue.numDropped(), 2u);
+    queue.stop();
+    EXPECT_FALSE(queue.push(0, 0, 10, [&]() { sent.push_back(5); }));
+
+    std::vector<int> values(10);
+    std::iota(values.begin(), values.end(), 0);
+    EXPECT_EQ(ray::subsampleForDrawing(values, 3), std::vector<int>({ 0, 4, 8 }));
+    EXPECT_EQ(ray::subsampleForDrawing(values, 10), values);
+  }
+
+  /// Clusters two separated lines of points, which should give one cluster per line in compressed sparse row form
+  TEST(Basic, GenerateClusters)
+  {
+    std::vector<Eigen::Vector3d> points;
+    for (int i = 0; i < 10; i++)
+    {
+      points.push_back(Eigen::Vector3d(0.1 * i, 0, 0));
+      points.push_back(Eigen::Vector3d(0.1 * i, 5, 0));
+    }
+    ray::PointClusters clusters;
+    ray::generateClusters(clusters, points, 0.25, 2.0);
+    ASSERT_EQ(clusters.size(), 2u);
+    EXPECT_EQ(clusters.ids.size(), points.size());
+    for (size_t i = 0; i < clusters.size(); i++)
+    {
+      EXPECT_EQ(clusters.end(i) - clusters.begin(i), 10u);
+      for (size_t j = clusters.begin(i); j < clusters.end(i); j++)
+      {
+        EXPECT_EQ(clusters.ids[j] % 2, static_cast<int>(i));
+      }
+    }
+
+    std::vector<std::vector<int>> vector_clusters;
+    ray::generateClusters(vector_clusters, points, 0.25, 2.0);
+    ASSERT_EQ(vector_clusters.size(), 2u);
+    EXPECT_EQ(vector_clusters[1], clusters.cluster(1));
+  }
+
+  /// The batched eigen solve matches the iterative solver, on the GPU when built with it, for a batch large enough to
+  /// use it, including planar, linear and spherical scatter matrices
+  TEST(Basic, EigenSolveBatch)
+  {
+    std::mt19937 gen(4);
+    std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+    std::vector<Eigen::Matrix3d> matrices(20000);
+    for (size_t i = 0; i < matrices.size(); i++)
+    {
+      Eigen::Matrix3d random;
+      for (int j = 0; j < 9; j++) random.data()[j] = uniform(gen);
+      const Eigen::Matrix3d rotation = Eigen::HouseholderQR<Eigen::Matrix3d>(random).householderQ();
+      Eigen::Vector3d scales(0.5 + uniform(gen), 0.5 + uniform(gen), 0.5 + uniform(gen));
+      if (i % 3 == 1)
+        scales[0] = 0.0;
+      else if (i % 3 == 2)
+        scales[1] = scales[2];
+      matrices[i] = rotation * scales.asDiagonal() * rotation.transpose();
+    }
+    std::vector<Eigen::Vector3d> values;
+    std::vector<Eigen::Matrix3d> vectors;
+    ray::eigenSolveBatch(matrices, values, vectors);
+    ASSERT_EQ(values.size(), matrices.size());
+    ASSERT_EQ(vectors.size(), matrices.size());
+    for (size_t i = 0; i < matrices.size(); i++)
+    {
+      Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(matrices[i]);
+      EXPECT_LT((values[i] - solver.eigenvalues()).norm(), 1e-6);
+      EXPECT_LT((matrices[i] * vectors[i] - vectors[i] * values[i].asDiagonal()).norm(), 1e-6);
+      EXPECT_LT((vectors[i].transpose() * vectors[i] - Eigen::Matrix3d::Identity()).norm(), 1e-6);
+    }
+  }
+
   /// Creates a room, then splits it around a plane, comparing agaisnt the expected result
   TEST(Basic, RaySplit)
   {
@@ -169,6 +1120,106 @@ namespace raytest
     compareMoments(cloud.getMoments(), {-0.467731, 1.05075, 1.43662, 2.20441, 1.60162, 0.106775, -0.77974, 1.03139, 1.57353, 3.67521, 2.64766, 0.485084, 17.3995, 10.279, 0.311066, 0.759795, 0.425206, 0.951355, 0.321609, 0.226785, 0.39073, 0.215125});
   }  
 
+  /// As above, but with other splits performed in the same pass, which should not change the plane split
+  TEST(Basic, RaySplitMulti)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    EXPECT_EQ(command("raysplit room.ply multi range 2 plane 0,0.1,1.5 box 1,1,1"), 0);
+    ray::Cloud cloud;
+    EXPECT_TRUE(cloud.load("room_plane_outside.ply"));
+    compareMoments(cloud.getMoments(), {-0.467731, 1.05075, 1.43662, 2.20441, 1.60162, 0.106775, -0.77974, 1.03139, 1.57353, 3.67521, 2.64766, 0.485084, 17.3995, 10.279, 0.311066, 0.759795, 0.425206, 0.951355, 0.321609, 0.226785, 0.39073, 0.215125});
+  }
+
+  /// Splits a room at a percentage of its time range, which is taken from the cloud's info rather than a read of the rays
+  TEST(Basic, RaySplitTimePercent)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    ray::Cloud room;
+    EXPECT_TRUE(room.load("room.ply"));
+    const double min_time = *std::min_element(room.times.begin(), room.times.end());
+    const double max_time = *std::max_element(room.times.begin(), room.times.end());
+    const double threshold = min_time + (max_time - min_time) * 30.0 / 100.0;
+    const size_t num_after = std::count_if(room.times.begin(), room.times.end(), [&](double t) { return t > threshold; });
+    EXPECT_GT(num_after, 0u);
+    EXPECT_EQ(command("raysplit room.ply time 30 %"), 0);
+    ray::Cloud inside, outside;
+    EXPECT_TRUE(inside.load("room_inside.ply"));
+    EXPECT_TRUE(outside.load("room_outside.ply"));
+    EXPECT_EQ(outside.rayCount(), num_after);  // the later rays are outside the split, as with time 1000
+    EXPECT_EQ(inside.rayCount() + outside.rayCount(), room.rayCount());
+  }
+
+  /// Crops several tubes from a room in one pass, each of which should match the single tube split
+  TEST(Basic, RaySplitTubes)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    {
+      std::ofstream tubes("tubes.txt");
+      tubes << "# start end radius" << std::endl;
+      tubes << "0,0,0 0,0,2 1" << std::endl;
+      tubes << "-2,-1,0.5 2,1,1.5 0.5" << std::endl;
+    }
+    EXPECT_EQ(command("raysplit room.ply tubes tubes.txt"), 0);
+    const std::vector<std::string> tube_args = { "0,0,0 0,0,2 1", "-2,-1,0.5 2,1,1.5 0.5" };
+    for (size_t i = 0; i < tube_args.size(); i++)
+    {
+      EXPECT_EQ(command("raysplit room.ply tube " + tube_args[i]), 0);
+      ray::Cloud single, batched;
+      EXPECT_TRUE(single.load("room_inside.ply"));
+      EXPECT_TRUE(batched.load("room_tube_" + std::to_string(i) + ".ply"));
+      ASSERT_EQ(single.rayCount(), batched.rayCount());
+      EXPECT_TRUE(single.ends == batched.ends);
+      EXPECT_TRUE(single.times == batched.times);
+    }
+  }
+
+  /// Decimates, denoises and splits a room in one chain, which should match running the three tools in turn
+  TEST(Basic, RayChain)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    EXPECT_EQ(command("raychain room.ply decimate 3 cm + denoise 5 cm + split plane 0,0.1,1.5"), 0);
+    ray::Cloud chained;
+    EXPECT_TRUE(chained.load("room_outside.ply"));
+    EXPECT_EQ(command("raydecimate room.ply 3 cm"), 0);
+    EXPECT_EQ(command("raydenoise room_decimated.ply 5 cm"), 0);
+    EXPECT_EQ(command("raysplit room_decimated_denoised.ply plane 0,0.1,1.5"), 0);
+    ray::Cloud separate;
+    EXPECT_TRUE(separate.load("room_decimated_denoised_outside.ply"));
+    ASSERT_EQ(chained.ends.size(), separate.ends.size());
+    EXPECT_TRUE(chained.ends == separate.ends);
+    EXPECT_TRUE(chained.times == separate.times);
+  }
+
+  /// Queries a resident room, which should match counting the rays directly, and the raysplit and rayrender results
+  TEST(Basic, CloudServer)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    ray::CloudServer server;
+    EXPECT_TRUE(server.load("room.ply"));
+    const Eigen::Vector3d box_min(-1, -1, 0), box_max(1, 2, 1.5);
+    size_t num_in_box = 0;
+    for (auto &end : server.cloud().ends)
+      num_in_box += (end.array() >= box_min.array()).all() && (end.array() <= box_max.array()).all() ? 1 : 0;
+    EXPECT_EQ(server.respond("count -1,-1,0 1,2,1.5"), "ok " + std::to_string(num_in_box));
+
+    EXPECT_EQ(server.respond("tube 0,0,0 0,0,2 1 room_tube.ply").substr(0, 2), "ok");
+    EXPECT_EQ(command("raysplit room.ply tube 0,0,0 0,0,2 1"), 0);
+    ray::Cloud tube, inside;
+    EXPECT_TRUE(tube.load("room_tube.ply"));
+    EXPECT_TRUE(inside.load("room_inside.ply"));
+    EXPECT_TRUE(tube.ends == inside.ends);
+
+    EXPECT_EQ(server.respond("render top ends 0.05 room_served.png"), "ok room_served.png");
+    EXPECT_EQ(command("rayrender room.ply top ends --pixel_width 0.05 --output room_rendered.png"), 0);
+    std::ifstream served("room_served.png", std::ios::binary), rendered("room_rendered.png", std::ios::binary);
+    const std::string served_bytes((std::istreambuf_iterator<char>(served)), std::istreambuf_iterator<char>());
+    const std::string rendered_bytes((std::istreambuf_iterator<char>(rendered)), std::istreambuf_iterator<char>());
+    EXPECT_FALSE(served_bytes.empty());
+    EXPECT_EQ(served_bytes, rendered_bytes);
+    EXPECT_EQ(server.respond("render top density 0.1 room_box.png -1,-1,0 1,2,1.5"), "ok room_box.png");
+    EXPECT_EQ(server.respond("unknown 1").substr(0, 5), "error");
+  }
+
   /// Creates a room and runs raytransients, comparing the identified transients ray cloud to the expected results
   TEST(Basic, RayTransients)
   {
@@ -179,46 +1230,220 @@ namespace raytest
     compareMoments(cloud.getMoments(), {-1.05406, -0.240721, -0.0629182, 5.05649e-08, 3.32941e-08, 2.54759e-08, 0.268724, -0.136746, -0.596782, 1.04798, 0.921776, 0.527205, 32.1452, 6.7491, 0.205871, 0.395641, 0.884296, 1, 0.225501, 0.296487, 0.153923, 0});
   }  
 
-  /// Creates a forest and translates it in all three axes, comparing to the expected result
-  TEST(Basic, RayTranslate)
+  /// As above, but filtering out-of-core in 2 m tiles, which should find the same transients
+  TEST(Basic, RayTransientsTiled)
   {
-    EXPECT_EQ(command("raycreate forest 1"), 0);
-    EXPECT_EQ(command("raytranslate forest.ply 10,20,30"), 0);
+    EXPECT_EQ(command("raycreate room 2"), 0);
+    EXPECT_EQ(command("raytransients min room.ply 1 rays --tile 2"), 0);
     ray::Cloud cloud;
-    EXPECT_TRUE(cloud.load("forest.ply"));
-    compareMoments(cloud.getMoments(), {9.66298, 21.3454, 31.7177, 6.0926, 5.75511, 0.56438, 9.69155, 21.3605, 33.0883, 6.10555, 5.82564, 3.20507, 62.683, 36.1903, 0.514327, 0.504407, 0.413534, 1, 0.372377, 0.365965, 0.391709, 0});
+    EXPECT_TRUE(cloud.load("room_transient.ply"));
+    compareMoments(cloud.getMoments(), {-1.05406, -0.240721, -0.0629182, 5.05649e-08, 3.32941e-08, 2.54759e-08, 0.268724, -0.136746, -0.596782, 1.04798, 0.921776, 0.527205, 32.1452, 6.7491, 0.205871, 0.395641, 0.884296, 1, 0.225501, 0.296487, 0.153923, 0});
   }
 
-#if RAYLIB_WITH_QHULL
-  /// Creates a terrain ray cloud, then wraps it from below, comparing the mesh to the expected results
-  TEST(Basic, RayWrap)
+  /// As above, but streaming in a time window longer than the scan, which should find the same transients. Shorter
+  /// windows should still keep every ray in one of the two outputs
+  TEST(Basic, RayTransientsWindowed)
   {
-    EXPECT_EQ(command("raycreate terrain 1"), 0);
-    EXPECT_EQ(command("raywrap terrain.ply upwards 1.0"), 0);
-    ray::Mesh mesh;
-    EXPECT_TRUE(ray::readPlyMesh("terrain_mesh.ply", mesh));
-    compareMoments(mesh.getMoments(), {0.0386662, -1.52168, -0.139079, 3.30621, 3.35391, 0.705937});
-  }  
+    EXPECT_EQ(command("raycreate room 2"), 0);
+    EXPECT_EQ(command("raytransients min room.ply 1 rays --window 1000"), 0);
+    ray::Cloud cloud;
+    EXPECT_TRUE(cloud.load("room_transient.ply"));
+    compareMoments(cloud.getMoments(), {-1.05406, -0.240721, -0.0629182, 5.05649e-08, 3.32941e-08, 2.54759e-08, 0.268724, -0.136746, -0.596782, 1.04798, 0.921776, 0.527205, 32.1452, 6.7491, 0.205871, 0.395641, 0.884296, 1, 0.225501, 0.296487, 0.153923, 0});
 
-  /// Tests extraction of terrain and extraction of trees
-  TEST(Basic, RayExtract)
+    EXPECT_EQ(command("raytransients min room.ply 1 rays --window 5 --margin 2"), 0);
+    ray::Cloud room, transient, fixed;
+    EXPECT_TRUE(room.load("room.ply"));
+    EXPECT_TRUE(transient.load("room_transient.ply"));
+    EXPECT_TRUE(fixed.load("room_fixed.ply"));
+    EXPECT_EQ(transient.rayCount() + fixed.rayCount(), room.rayCount());
+  }
+
+  /// An object scanned, then gone when its space is later scanned through to a wall behind it. The voxel filter should
+  /// find the object transient with the min merge type, and the later rays through its space with the max type
+  TEST(Basic, TransientGridFast)
   {
-    EXPECT_EQ(command("raycreate forest 2"), 0);
-    EXPECT_EQ(command("rayextract terrain forest.ply"), 0);
-    ray::Mesh mesh;
-    EXPECT_TRUE(ray::readPlyMesh("forest_mesh.ply", mesh));
-    compareMoments(mesh.getMoments(), {-0.00147491, -0.00191917, -0.0617946, 5.77995, 5.80266, 0.0426993});
-    EXPECT_EQ(command("rayextract trees forest.ply forest_mesh.ply"), 0);
+    std::mt19937 gen(5);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    const Eigen::Vector3d origin(0.0, 0.0, 0.0);
+    std::vector<Eigen::Vector3d> starts, ends;
+    std::vector<double> times;
+    std::vector<ray::RGBA> colours;
+    const ray::RGBA colour = { 127, 127, 127, 255 };
+    const size_t num_object_rays = 400;
+    for (size_t i = 0; i < num_object_rays; i++)  // the object, a 0.3 m cube 3 m away, observed for the first second
+    {
+      starts.push_back(origin);
+      ends.push_back(Eigen::Vector3d(3.0 + 0.3 * unit(gen), -0.15 + 0.3 * unit(gen), -0.15 + 0.3 * unit(gen)));
+      times.push_back(static_cast<double>(i) / static_cast<double>(num_object_rays));
+      colours.push_back(colour);
+    }
+    for (size_t i = 0; i < 2000; i++)  // the wall 6 m away, observed through the gone object 10 s later
+    {
+      starts.push_back(origin);
+      ends.push_back(Eigen::Vector3d(6.0, -0.6 + 1.2 * unit(gen), -0.6 + 1.2 * unit(gen)));
+      times.push_back(10.0 + static_cast<double>(i) / 2000.0);
+      colours.push_back(colour);
+    }
 
-    ray::ForestStructure forest;
-    EXPECT_TRUE(forest.load("forest_trees.txt"));
-    compareMomentsPercentageError(forest.getMoments(), {20, 22.2172, 1058.42, 1.39416, 0.112794, 1.6403, 1, 21918, 3102.68});
+    for (const ray::MergeType merge_type : { ray::MergeType::Mininum, ray::MergeType::Maximum })
+    {
+      ray::MergerConfig config;
+      config.num_rays_filter_threshold = 2;
+      config.merge_type = merge_type;
+      ray::TransientGrid grid(0.1, config);
+      grid.addHits(ends, times, colours);
+      grid.addPasses(starts, ends, times, colours);
+      grid.classify();
+      EXPECT_GT(grid.numTransientVoxels(), 0u);
+      std::vector<bool> transient;
+      grid.transient(starts, ends, times, colours, transient);
+      size_t num_object_transient = 0, num_wall_transient = 0;
+      for (size_t i = 0; i < transient.size(); i++)
+      {
+        if (transient[i])
+          (i < num_object_rays ? num_object_transient : num_wall_transient)++;
+      }
+      if (merge_type == ray::MergeType::Mininum)
+      {
+        EXPECT_GT(num_object_transient, num_object_rays * 9 / 10);
+        EXPECT_EQ(num_wall_transient, 0u);
+      }
+      else  // a few object rays also pass through the object outside the short spans over which its voxels are hit
+      {
+        EXPECT_LT(num_object_transient, num_object_rays / 4);
+        EXPECT_GT(num_wall_transient, 500u);
+      }
+    }
+
+    // every ray of a room is in one of the two outputs of the tool
+    EXPECT_EQ(command("raycreate room 2"), 0);
+    EXPECT_EQ(command("raytransients min room.ply 1 rays --fast"), 0);
+    ray::Cloud room, transient, fixed;
+    EXPECT_TRUE(room.load("room.ply"));
+    EXPECT_TRUE(transient.load("room_transient.ply"));
+    EXPECT_TRUE(fixed.load("room_fixed.ply"));
+    EXPECT_EQ(transient.rayCount() + fixed.rayCount(), room.rayCount());
+  }
+
+  /// Filters a room with its results held in the merger, then written through writers, which should match
+  TEST(Basic, MergerOutputWriters)
+  {
+    EXPECT_EQ(command("raycreate room 2"), 0);
+    ray::Cloud room;
+    EXPECT_TRUE(room.load("room.ply"));
+    ray::MergerConfig config;
+    config.num_rays_filter_threshold = 1;
+    ray::Merger merger(config);
+    EXPECT_TRUE(merger.filter(room));
+    const size_t num_transient = merger.differenceCloud().rayCount();
+    const size_t num_fixed = merger.fixedCloud().rayCount();
+    EXPECT_EQ(num_transient + num_fixed, room.rayCount());
+
+    ray::CloudWriter transient_writer, fixed_writer;
+    EXPECT_TRUE(transient_writer.begin("room_written_transient.ply"));
+    EXPECT_TRUE(fixed_writer.begin("room_written_fixed.ply"));
+    merger.setOutput(&fixed_writer, &transient_writer);
+    EXPECT_TRUE(merger.filter(room));
+    transient_writer.end();
+    fixed_writer.end();
+    EXPECT_EQ(merger.differenceCloud().rayCount(), 0u);
+    EXPECT_EQ(merger.fixedCloud().rayCount(), 0u);
+    EXPECT_EQ(merger.differenceRayCount(), num_transient);
+    EXPECT_EQ(merger.fixedRayCount(), num_fixed);
+    ray::Cloud transient, fixed;
+    EXPECT_TRUE(transient.load("room_written_transient.ply"));
+    EXPECT_TRUE(fixed.load("room_written_fixed.ply"));
+    EXPECT_EQ(transient.rayCount(), num_transient);
+    EXPECT_EQ(fixed.rayCount(), num_fixed);
+  }
+
+  /// Filters a room with the ray grid and then with the ellipsoid grid, for each merge type, which should find the same
+  /// transients
+  TEST(Basic, MergerEllipsoidGrid)
+  {
+    EXPECT_EQ(command("raycreate room 2"), 0);
+    ray::Cloud room;
+    EXPECT_TRUE(room.load("room.ply"));
+    for (const auto merge_type : { ray::MergeType::Mininum, ray::MergeType::Maximum, ray::MergeType::Oldest })
+    {
+      ray::MergerConfig config;
+      config.num_rays_filter_threshold = 1;
+      config.merge_type = merge_type;
+      config.grid = ray::MergeGrid::Rays;
+      ray::Merger ray_merger(config);
+      EXPECT_TRUE(ray_merger.filter(room));
+      config.grid = ray::MergeGrid::Ellipsoids;
+      ray::Merger ellipsoid_merger(config);
+      EXPECT_TRUE(ellipsoid_merger.filter(room));
+      EXPECT_GT(ray_merger.differenceCloud().rayCount(), 0u);
+      EXPECT_TRUE(ellipsoid_merger.differenceCloud().ends == ray_merger.differenceCloud().ends);
+      EXPECT_TRUE(ellipsoid_merger.fixedCloud().ends == ray_merger.fixedCloud().ends);
+    }
+  }
+
+  /// Creates a forest and translates it in all three axes, comparing to the expected result
+  TEST(Basic, RayTranslate)
+  {
+    EXPECT_EQ(command("raycreate forest 1"), 0);
+    EXPECT_EQ(command("raytranslate forest.ply 10,20,30"), 0);
+    ray::Cloud cloud;
+    EXPECT_TRUE(cloud.load("forest.ply"));
+    compareMoments(cloud.getMoments(), {9.66298, 21.3454, 31.7177, 6.0926, 5.75511, 0.56438, 9.69155, 21.3605, 33.0883, 6.10555, 5.82564, 3.20507, 62.683, 36.1903, 0.514327, 0.504407, 0.413534, 1, 0.372377, 0.365965, 0.391709, 0});
+  }
+
+  /// Streams large scene clouds in tiles, checking the exact ray count and that the result depends only on the seed
+  TEST(Basic, RayCreateStreamed)
+  {
+    EXPECT_EQ(command("raycreate forest 4 --rays 30001 --extent 50"), 0);
+    ray::Cloud forest;
+    EXPECT_TRUE(forest.load("forest.ply"));
+    EXPECT_EQ(forest.rayCount(), 30001u);
+    for (size_t i = 1; i < forest.times.size(); i++) EXPECT_LT(forest.times[i - 1], forest.times[i]);
+    EXPECT_EQ(command("raycreate forest 4 --rays 30001 --extent 50"), 0);
+    ray::Cloud forest2;
+    EXPECT_TRUE(forest2.load("forest.ply"));
+    EXPECT_TRUE(forest2.ends == forest.ends);
+
+    EXPECT_EQ(command("raycreate city 1 --rays 20000 --extent 40"), 0);
+    ray::Cloud city;
+    EXPECT_TRUE(city.load("city.ply"));
+    EXPECT_EQ(city.rayCount(), 20000u);
+    Eigen::Vector3d min_bound, max_bound;
+    city.calcBounds(&min_bound, &max_bound);
+    EXPECT_GT(min_bound[2], -0.1);
+    EXPECT_LT(max_bound[2], 40.1);
+    EXPECT_GT(max_bound[2], 5.0);  // some rays hit the buildings
+  }
+
+  /// Creates a terrain ray cloud, then wraps it from below, comparing the mesh to the expected results
+  TEST(Basic, RayWrap)
+  {
+    EXPECT_EQ(command("raycreate terrain 1"), 0);
+    EXPECT_EQ(command("raywrap terrain.ply upwards 1.0"), 0);
+    ray::Mesh mesh;
+    EXPECT_TRUE(ray::readPlyMesh("terrain_mesh.ply", mesh));
+    compareMoments(mesh.getMoments(), {-0.756567, -1.58785, -0.0946563, 4.20581, 4.29531, 1.0521});
+  }  
+
+  /// Tests extraction of terrain and extraction of trees
+  TEST(Basic, RayExtract)
+  {
+    EXPECT_EQ(command("raycreate forest 2"), 0);
+    EXPECT_EQ(command("rayextract terrain forest.ply"), 0);
+    ray::Mesh mesh;
+    EXPECT_TRUE(ray::readPlyMesh("forest_mesh.ply", mesh));
+    compareMoments(mesh.getMoments(), {-0.00147491, -0.00191917, -0.0617946, 5.77995, 5.80266, 0.0426993});
+    EXPECT_EQ(command("rayextract trees forest.ply forest_mesh.ply"), 0);
+
+    ray::ForestStructure forest;
+    EXPECT_TRUE(forest.load("forest_trees.txt"));
+    compareMomentsPercentageError(forest.getMoments(), {20, 22.2172, 1058.42, 1.39416, 0.112794, 1.6403, 1, 21918, 3102.68});
 
     EXPECT_EQ(command("rayextract forest forest.ply --ground forest_mesh.ply"), 0);
 
     ray::ForestStructure forest2;
     EXPECT_TRUE(forest2.load("forest_forest.txt"));
-    compareMoments(forest2.getMoments(), {11, 8.43828, 586.427, 1.40054, 0.200644, 0, 4, 6476, 42.5851});
+    compareMoments(forest2.getMoments(), {11, 5.44615, 569.135, 1.40054, 0.200644, 0, 4, 6476, 42.5851});
 
     EXPECT_EQ(command("rayextract trunks forest.ply"), 0);
 
@@ -226,5 +1451,1222 @@ namespace raytest
     EXPECT_TRUE(forest3.load("forest_trunks.txt"));
     compareMoments(forest3.getMoments(), {21, 20.0797, 1124.61, 1.60427, 0.135159, 0, 0, 0, 0});
   }  
-#endif  // RAYLIB_WITH_QHULL
+
+  /// Extracts the terrain in tiles, which should stitch to much the same mesh as the untiled extraction
+  TEST(Basic, RayExtractTerrainTiled)
+  {
+    EXPECT_EQ(command("raycreate forest 2"), 0);
+    EXPECT_EQ(command("rayextract terrain forest.ply"), 0);
+    ray::Mesh mesh;
+    EXPECT_TRUE(ray::readPlyMesh("forest_mesh.ply", mesh));
+    const Eigen::ArrayXd moments = mesh.getMoments();
+    EXPECT_EQ(command("rayextract terrain forest.ply --tile_width 8"), 0);
+    ray::Mesh tiled_mesh;
+    EXPECT_TRUE(ray::readPlyMesh("forest_mesh.ply", tiled_mesh));
+    compareMoments(tiled_mesh.getMoments(), std::vector<double>(moments.data(), moments.data() + moments.size()));
+  }
+
+  /// Welds a grid of separate quads into one mesh, then checks that it saves and reloads unchanged
+  TEST(Basic, MeshReduceAndPly)
+  {
+    const int width = 20;
+    ray::Mesh mesh;
+    for (int i = 0; i < width; i++)
+    {
+      for (int j = 0; j < width; j++)
+      {
+        const int base = static_cast<int>(mesh.vertices().size());
+        mesh.vertices().push_back(Eigen::Vector3d(i, j, 0.0));
+        mesh.vertices().push_back(Eigen::Vector3d(i + 1, j, 0.0));
+        mesh.vertices().push_back(Eigen::Vector3d(i + 1, j + 1, 0.0));
+        mesh.vertices().push_back(Eigen::Vector3d(i, j + 1, 0.0));
+        mesh.indexList().push_back(Eigen::Vector3i(base, base + 1, base + 2));
+        mesh.indexList().push_back(Eigen::Vector3i(base, base + 2, base + 3));
+      }
+    }
+    mesh.vertices().push_back(Eigen::Vector3d(-1.0, -1.0, -1.0));  // not in any triangle
+    mesh.reduce();
+    EXPECT_EQ(mesh.vertices().size(), static_cast<size_t>((width + 1) * (width + 1)));
+    EXPECT_EQ(mesh.indexList().size(), static_cast<size_t>(2 * width * width));
+    double area = 0.0;
+    for (const auto &tri : mesh.indexList())
+    {
+      const auto &vs = mesh.vertices();
+      area += 0.5 * (vs[tri[1]] - vs[tri[0]]).cross(vs[tri[2]] - vs[tri[0]]).norm();
+    }
+    EXPECT_NEAR(area, width * width, 1e-9);
+
+    EXPECT_TRUE(ray::writePlyMesh("welded_mesh.ply", mesh));
+    ray::Mesh reloaded;
+    EXPECT_TRUE(ray::readPlyMesh("welded_mesh.ply", reloaded));
+    EXPECT_EQ(reloaded.indexList(), mesh.indexList());
+    ASSERT_EQ(reloaded.vertices().size(), mesh.vertices().size());
+    for (size_t i = 0; i < mesh.vertices().size(); i++)
+    {
+      EXPECT_EQ(reloaded.vertices()[i], mesh.vertices()[i]);  // small integers are exact as floats
+    }
+  }
+
+  /// Saves phases to a checkpoint, then checks that they resume after a torn write, but not for a different key
+  TEST(Basic, Checkpoint)
+  {
+    const char *name = "test.checkpoint";
+    std::remove(name);
+    const std::vector<uint64_t> ids = { 3, 1, 4, 1, 5, 9 };
+    {
+      ray::Checkpoint checkpoint;
+      ASSERT_TRUE(checkpoint.open(name, "job 1"));
+      EXPECT_EQ(checkpoint.numResumed(), 0u);
+      EXPECT_TRUE(checkpoint.save("split"));
+      EXPECT_TRUE(checkpoint.save("tile 0", ids));
+      EXPECT_TRUE(checkpoint.completed("tile 0"));
+    }  // stopped without finishing, part way through writing the next record
+    {
+      std::ofstream torn(name, std::ios::binary | std::ios::app);
+      const uint32_t name_length = 6;
+      torn.write(reinterpret_cast<const char *>(&name_length), sizeof(name_length));
+      torn.write("tile", 4);
+    }
+    {
+      ray::Checkpoint checkpoint;
+      ASSERT_TRUE(checkpoint.open(name, "job 1"));
+      EXPECT_EQ(checkpoint.numResumed(), 2u);
+      EXPECT_TRUE(checkpoint.completed("split"));
+      EXPECT_FALSE(checkpoint.completed("tile 1"));
+      std::vector<uint64_t> loaded;
+      EXPECT_TRUE(checkpoint.load("tile 0", loaded));
+      EXPECT_EQ(loaded, ids);
+      EXPECT_TRUE(checkpoint.save("tile 1", ids));
+    }
+    {
+      ray::Checkpoint checkpoint;
+      ASSERT_TRUE(checkpoint.open(name, "job 1"));
+      EXPECT_EQ(checkpoint.numResumed(), 3u);  // the torn record was dropped, so the new one follows it
+      checkpoint.finish();
+      EXPECT_FALSE(std::ifstream(name).good());
+    }
+    {
+      ray::Checkpoint checkpoint;
+      ASSERT_TRUE(checkpoint.open(name, "job 1"));
+      EXPECT_TRUE(checkpoint.save("split"));
+    }
+    {
+      ray::Checkpoint checkpoint;
+      ASSERT_TRUE(checkpoint.open(name, "job 2"));
+      EXPECT_EQ(checkpoint.numResumed(), 0u);
+      EXPECT_FALSE(checkpoint.completed("split"));
+      checkpoint.finish();
+    }
+
+    char arg0[] = "tool", arg1[] = "--resume", arg2[] = "cloud.ply";
+    char *argv[] = { arg0, arg1, arg2, nullptr };
+    int argc = 3;
+    ray::Checkpoint::initFromArguments(argc, argv);
+    EXPECT_EQ(argc, 2);
+    EXPECT_EQ(std::string(argv[1]), "cloud.ply");
+    EXPECT_EQ(argv[2], nullptr);
+    EXPECT_TRUE(ray::Checkpoint::enabled());
+    ray::Checkpoint::enable(false);
+  }
+
+  /// Stores tiles in a tile cache, then checks that a second run reuses only the unchanged ones, keeps its layout and
+  /// drops the tiles that it did not use, and that a cache of different parameters is ignored
+  TEST(Basic, TileCache)
+  {
+    const char *name = "test.tilecache";
+    std::remove(name);
+    const std::vector<int> results = { 2, 7, 1, 8 };
+    const double grid[2] = { 1.5, 4.0 };
+    {
+      ray::TileCache cache;
+      cache.open(name, "trees 1");
+      EXPECT_TRUE(cache.layout().empty());
+      std::vector<int> found;
+      EXPECT_FALSE(cache.find("tile 0", 10, found));
+      cache.store("tile 0", 10, results);
+      cache.store("tile 1", 11, results);
+      cache.store("tile 2", 12, std::vector<int>());
+      cache.setLayout(grid, sizeof(grid));
+      EXPECT_EQ(cache.numStored(), 3u);
+      EXPECT_TRUE(cache.save());
+    }
+    {
+      ray::TileCache cache;
+      cache.open(name, "trees 1");
+      const std::vector<char> layout = cache.layout();
+      ASSERT_EQ(layout.size(), sizeof(grid));
+      EXPECT_EQ(std::memcmp(layout.data(), grid, sizeof(grid)), 0);
+      std::vector<int> found;
+      EXPECT_TRUE(cache.find("tile 0", 10, found));
+      EXPECT_EQ(found, results);
+      EXPECT_TRUE(cache.find("tile 2", 12, found));
+      EXPECT_TRUE(found.empty());
+      EXPECT_TRUE(cache.contains("tile 1"));
+      EXPECT_FALSE(cache.find("tile 1", 21, found));  // its rays have changed
+      EXPECT_EQ(cache.numFound(), 2u);
+      cache.setLayout(grid, sizeof(grid));
+      EXPECT_TRUE(cache.save());
+    }
+    {
+      ray::TileCache cache;
+      cache.open(name, "trees 1");
+      EXPECT_TRUE(cache.contains("tile 0"));
+      EXPECT_FALSE(cache.contains("tile 1"));  // not used by the last run
+    }
+    {
+      ray::TileCache cache;
+      cache.open(name, "trees 2");
+      EXPECT_TRUE(cache.layout().empty());
+      EXPECT_FALSE(cache.contains("tile 0"));
+    }
+    std::remove(name);
+
+    EXPECT_NE(ray::TileCache::hash(results.data(), 15), ray::TileCache::hash(results.data(), 16));
+    char arg0[] = "tool", arg1[] = "--tile_cache", arg2[] = "cloud.ply";
+    char *argv[] = { arg0, arg1, arg2, nullptr };
+    int argc = 3;
+    ray::TileCache::initFromArguments(argc, argv);
+    EXPECT_EQ(argc, 2);
+    EXPECT_EQ(std::string(argv[1]), "cloud.ply");
+    EXPECT_EQ(argv[2], nullptr);
+    EXPECT_TRUE(ray::TileCache::enabled());
+    ray::TileCache::enable(false);
+  }
+
+  /// Saves a room in the ray cloud binary format, checking that it reloads to the same cloud and summary
+  TEST(Basic, RayCloudBinary)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    ray::Cloud cloud;
+    EXPECT_TRUE(cloud.load("room.ply"));
+    cloud.save("room.rcb");
+    ray::Cloud binary_cloud;
+    EXPECT_TRUE(binary_cloud.load("room.rcb"));
+    EXPECT_EQ(binary_cloud.rayCount(), cloud.rayCount());
+    Eigen::ArrayXd moments = cloud.getMoments();
+    compareMoments(binary_cloud.getMoments(), std::vector<double>(moments.data(), moments.data() + moments.size()),
+                   1e-4);
+
+    ray::Cloud::Info info, binary_info;
+    EXPECT_TRUE(ray::Cloud::getInfo("room.ply", info));
+    EXPECT_TRUE(ray::Cloud::getInfo("room.rcb", binary_info));
+    EXPECT_EQ(binary_info.num_bounded, info.num_bounded);
+    EXPECT_EQ(binary_info.num_unbounded, info.num_unbounded);
+    EXPECT_NEAR(binary_info.min_time, info.min_time, 1e-9);
+    EXPECT_NEAR(binary_info.max_time, info.max_time, 1e-9);
+    EXPECT_LT((binary_info.centroid - info.centroid).norm(), 1e-4);
+    EXPECT_LT((binary_info.rays_bound.min_bound_ - info.rays_bound.min_bound_).norm(), 1e-4);
+    EXPECT_LT((binary_info.rays_bound.max_bound_ - info.rays_bound.max_bound_).norm(), 1e-4);
+  }
+
+  /// Saves a room as a compressed .rcb file, which should be smaller and reload to the same rays within the tolerance
+  TEST(Basic, RayCloudBinaryCompressed)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    ray::Cloud cloud;
+    EXPECT_TRUE(cloud.load("room.ply"));
+    cloud.save("room.rcb");
+    ray::RcbWriter::setCompression(true, 0.001);
+    cloud.save("room_compressed.rcb");
+    ray::RcbWriter::setCompression(false);
+    ray::Cloud compressed_cloud;
+    EXPECT_TRUE(compressed_cloud.load("room_compressed.rcb"));
+    EXPECT_EQ(compressed_cloud.rayCount(), cloud.rayCount());
+    Eigen::ArrayXd moments = cloud.getMoments();
+    compareMoments(compressed_cloud.getMoments(),
+                   std::vector<double>(moments.data(), moments.data() + moments.size()), 1e-3);
+    std::ifstream raw("room.rcb", std::ios::binary | std::ios::ate);
+    std::ifstream compressed("room_compressed.rcb", std::ios::binary | std::ios::ate);
+    EXPECT_LT(compressed.tellg(), raw.tellg());
+  }
+
+  /// Partitions and compacts a cloud, checking that the rays keep their order and fields
+  TEST(Basic, CloudPartition)
+  {
+    ray::Cloud cloud;
+    for (int i = 0; i < 200001; i++)
+    {
+      const ray::RGBA colour = { 10, 20, 30, (uint8_t)(i % 3 ? 255 : 0) };
+      cloud.addRay(Eigen::Vector3d(i, 0, 0), Eigen::Vector3d(0, i, 0), (double)i, colour);
+    }
+    ray::Cloud selected, rest;
+    cloud.partition([](size_t i) { return i % 5 == 0; }, selected, &rest);
+    ASSERT_EQ(selected.rayCount(), 40001u);
+    ASSERT_EQ(rest.rayCount(), 160000u);
+    for (size_t i = 0; i < selected.rayCount(); i++)
+    {
+      EXPECT_EQ(selected.times[i], 5.0 * static_cast<double>(i));
+      EXPECT_EQ(selected.starts[i][0], selected.ends[i][1]);
+    }
+    EXPECT_EQ(rest.times[4], 6.0);
+
+    cloud.removeUnboundedRays();
+    ASSERT_EQ(cloud.rayCount(), 133334u);
+    EXPECT_EQ(cloud.times[0], 1.0);
+    EXPECT_EQ(cloud.times.back(), 200000.0);
+    for (size_t i = 0; i < cloud.rayCount(); i++) EXPECT_EQ(cloud.starts[i][0], cloud.times[i]);
+  }
+
+  /// Reads a sub-box of a room through the ply index, checking that no rays in the box are lost
+  TEST(Basic, RayCloudIndex)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    std::remove("room.ply.idx");
+    const ray::Cuboid box(Eigen::Vector3d(-1, -1, -1), Eigen::Vector3d(1, 1, 1));
+    auto count_in_box = [&](size_t &count) {
+      return [&](std::vector<Eigen::Vector3d> &, std::vector<Eigen::Vector3d> &ends, std::vector<double> &,
+                 std::vector<ray::RGBA> &) {
+        for (auto &end : ends) count += box.intersects(end) ? 1 : 0;
+      };
+    };
+    size_t full_count = 0, first_count = 0, indexed_count = 0;
+    EXPECT_TRUE(ray::Cloud::read("room.ply", count_in_box(full_count)));
+    EXPECT_TRUE(ray::Cloud::read("room.ply", count_in_box(first_count), box));  // builds the index
+    std::vector<ray::PlyRowRange> ranges;
+    EXPECT_TRUE(ray::readPlyIndex("room.ply", ranges));
+    EXPECT_TRUE(ray::Cloud::read("room.ply", count_in_box(indexed_count), box));
+    EXPECT_GT(full_count, 0u);
+    EXPECT_EQ(first_count, full_count);
+    EXPECT_EQ(indexed_count, full_count);
+  }
+
+#if defined(__linux__)
+  /// Stamps a file at two modification times within the same second, whose stamps should differ by the nanoseconds
+  /// between them
+  TEST(Basic, FileStampNanoseconds)
+  {
+    {
+      std::ofstream out("stamped.txt");
+      out << "stamped";
+    }
+    struct timespec times[2] = { { 1000000000, 0 }, { 1000000000, 0 } };  // the access and modification times
+    uint64_t size, hash;
+    int64_t modified, later_modified;
+    ASSERT_EQ(utimensat(AT_FDCWD, "stamped.txt", times, 0), 0);
+    EXPECT_TRUE(ray::fileStamp("stamped.txt", size, modified, hash));
+    times[1].tv_nsec = 500000000;
+    ASSERT_EQ(utimensat(AT_FDCWD, "stamped.txt", times, 0), 0);
+    EXPECT_TRUE(ray::fileStamp("stamped.txt", size, later_modified, hash));
+    EXPECT_EQ(later_modified - modified, 500000000);
+    std::remove("stamped.txt");
+  }
+#endif  // defined(__linux__)
+
+  /// Reads a ply file with the asynchronous reader, which should give the same bytes as a stream, or fail to open
+  /// where raylib has no asynchronous backend, so that readers use their fallback. A larger file is read with more
+  /// reads than fit in the queue at once
+  TEST(Basic, AsyncReader)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    ray::AsyncReader reader;
+    if (!ray::AsyncReader::available())
+    {
+      EXPECT_FALSE(required("io_uring")) << "raylib is built without io_uring";
+      EXPECT_FALSE(reader.open("room.ply"));
+      return;
+    }
+    ASSERT_TRUE(reader.open("room.ply"));
+    std::ifstream input("room.ply", std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    const size_t offset = 100;
+    std::vector<unsigned char> read_bytes(bytes.size());  // over-long, to check that the read stops at the end
+    ASSERT_EQ(reader.read(offset, read_bytes.size(), read_bytes.data()), bytes.size() - offset);
+    EXPECT_TRUE(std::equal(bytes.begin() + offset, bytes.end(), read_bytes.begin(),
+                           [](char a, unsigned char b) { return static_cast<unsigned char>(a) == b; }));
+
+    std::vector<unsigned char> large((ray::AsyncReader::kQueueDepth + 3) * ray::AsyncReader::kReadSize + 123);
+    std::mt19937 gen(3);
+    for (auto &byte : large) byte = static_cast<unsigned char>(gen());
+    {
+      std::ofstream output("async_large.bin", std::ios::binary);
+      output.write(reinterpret_cast<const char *>(large.data()), static_cast<std::streamsize>(large.size()));
+    }
+    ASSERT_TRUE(reader.open("async_large.bin"));
+    std::vector<unsigned char> large_read(large.size() - offset);
+    ASSERT_EQ(reader.read(offset, large_read.size(), large_read.data()), large_read.size());
+    EXPECT_TRUE(std::equal(large.begin() + offset, large.end(), large_read.begin()));
+  }
+
+  /// Recognises object storage URLs, and reads local files through the same input stream as remote ones
+  TEST(Basic, RemoteFile)
+  {
+    EXPECT_TRUE(ray::isRemoteFileName("s3://bucket/room.ply"));
+    EXPECT_TRUE(ray::isRemoteFileName("https://example.com/room.rcb"));
+    EXPECT_FALSE(ray::isRemoteFileName("room.ply"));
+    EXPECT_FALSE(ray::isRemoteFileName("/data/s3://room.ply"));
+
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    ray::InputFile input("room.ply");
+    ASSERT_FALSE(input.fail());
+    std::string line;
+    std::getline(input, line);
+    EXPECT_EQ(line, "ply");
+    EXPECT_TRUE(ray::InputFile("missing.ply").fail());
+    if (!ray::RemoteFile::available())
+    {
+      EXPECT_TRUE(ray::InputFile("s3://bucket/room.ply").fail());
+    }
+  }
+
+  /// Uploads a ray cloud to S3-compatible storage and reads it back, as an s3:// object and over HTTP. This needs raylib
+  /// built WITH_CURL and a bucket, named in RAYTEST_S3_URL (s3://bucket) and at the HTTP address RAYTEST_HTTP_URL, with
+  /// the endpoint and credentials in the variables that @c ray::RemoteFile reads
+  TEST(Basic, RemoteStorage)
+  {
+    const char *s3_url = std::getenv("RAYTEST_S3_URL");
+    const char *http_url = std::getenv("RAYTEST_HTTP_URL");
+    if (!ray::RemoteFile::available() || !s3_url || !http_url)
+    {
+      EXPECT_FALSE(required("curl")) << "raylib is built without curl, or RAYTEST_S3_URL or RAYTEST_HTTP_URL is unset";
+      return;
+    }
+    // more than two upload parts, so that a part is uploaded while the file is written, and each read is in parallel
+    ray::Cloud cloud;
+    std::mt19937 gen(11);
+    std::uniform_real_distribution<double> uniform(-10.0, 10.0);
+    const size_t num_rays = 1000000;
+    for (size_t i = 0; i < num_rays; i++)
+    {
+      const ray::RGBA colour = { 10, 20, 30, 255 };
+      cloud.addRay(Eigen::Vector3d(0, 0, 0), Eigen::Vector3d(uniform(gen), uniform(gen), uniform(gen)), (double)i,
+                   colour);
+    }
+    cloud.save("remote.ply");
+    cloud.save(std::string(s3_url) + "/remote.ply");
+    std::ifstream input("remote.ply", std::ios::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    ASSERT_GT(bytes.size(), 2 * ray::RemoteUpload::kPartSize);
+
+    ray::RemoteFile remote;
+    ASSERT_TRUE(remote.open(std::string(http_url) + "/remote.ply"));
+    ASSERT_EQ(remote.size(), bytes.size());
+    const size_t offset = 100;
+    std::vector<unsigned char> read_bytes(bytes.size() - offset);
+    ASSERT_EQ(remote.read(offset, read_bytes.size(), read_bytes.data()), read_bytes.size());
+    EXPECT_TRUE(std::equal(bytes.begin() + offset, bytes.end(), read_bytes.begin(),
+                           [](char a, unsigned char b) { return static_cast<unsigned char>(a) == b; }));
+
+    ray::Cloud loaded;
+    ASSERT_TRUE(loaded.load(std::string(s3_url) + "/remote.ply"));
+    ASSERT_EQ(loaded.rayCount(), num_rays);
+    EXPECT_EQ(loaded.times, cloud.times);
+    ray::RemoteFile missing;
+    EXPECT_FALSE(missing.open(std::string(s3_url) + "/missing.ply"));
+  }
+
+  /// Checks that the info sidecar stored by the cloud writer matches the info from reading the file, and that it is
+  /// ignored once the file changes
+  TEST(Basic, RayCloudInfoSidecar)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    EXPECT_EQ(command("raydecimate room.ply 3 cm"), 0);
+    ray::Cloud::Info stored, scanned;
+    ASSERT_TRUE(ray::readPlyInfo("room_decimated.ply", stored));
+    std::remove("room_decimated.ply.info");
+    EXPECT_TRUE(ray::Cloud::getInfo("room_decimated.ply", scanned));  // writes the sidecar again
+    EXPECT_EQ(stored.num_bounded, scanned.num_bounded);
+    EXPECT_EQ(stored.num_unbounded, scanned.num_unbounded);
+    EXPECT_EQ(stored.min_time, scanned.min_time);
+    EXPECT_EQ(stored.max_time, scanned.max_time);
+    EXPECT_EQ(stored.ends_bound.min_bound_, scanned.ends_bound.min_bound_);
+    EXPECT_EQ(stored.starts_bound.max_bound_, scanned.starts_bound.max_bound_);
+    EXPECT_EQ(stored.rays_bound.min_bound_, scanned.rays_bound.min_bound_);
+    EXPECT_LT((stored.centroid - scanned.centroid).norm(), 1e-9);
+    EXPECT_TRUE(ray::readPlyInfo("room_decimated.ply", stored));
+
+    ray::Cloud cloud;
+    EXPECT_TRUE(cloud.load("room.ply"));
+    cloud.save("room_decimated.ply");
+    EXPECT_FALSE(ray::readPlyInfo("room_decimated.ply", stored));
+    EXPECT_TRUE(ray::Cloud::getInfo("room_decimated.ply", scanned));
+    EXPECT_EQ(scanned.num_bounded + scanned.num_unbounded, static_cast<int>(cloud.rayCount()));
+  }
+
+  /// Checks that the cached neighbour index is reused, that it is rebuilt when the cloud changes, and that the
+  /// batched queries match single queries
+  TEST(Basic, RayNeighbourIndex)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    ray::Cloud cloud;
+    EXPECT_TRUE(cloud.load("room.ply"));
+    const auto index = cloud.neighbourIndex();
+    EXPECT_EQ(index, cloud.neighbourIndex());
+    EXPECT_GT(index->size(), 4096u);  // enough for more than one block of queries
+
+    Eigen::MatrixXi indices, single_indices;
+    Eigen::MatrixXd dists2, single_dists2;
+    index->knn(8, indices, dists2);
+    for (Eigen::Index i = 0; i < indices.cols(); i += 997)
+    {
+      index->knn(index->points().col(i), 8, single_indices, single_dists2);
+      EXPECT_EQ(indices.col(i), single_indices.col(0));
+    }
+
+    cloud.ends[index->ids()[0]] += Eigen::Vector3d(0.1, 0.0, 0.0);
+    EXPECT_NE(index, cloud.neighbourIndex());
+  }
+
+  /// Searches points on an integer lattice, with duplicates, so that many neighbours are at equal distances. The index
+  /// is large enough to be searched on the GPU when built WITH_CUDA. Either search should give the exact nearest
+  /// neighbours, excluding coincident points and those beyond the radius, with ties in increasing index order
+  TEST(Basic, NeighbourIndexOrder)
+  {
+    if (required("cuda"))
+    {
+      ASSERT_TRUE(ray::Gpu::available()) << "raylib is built without CUDA, or there is no GPU";
+    }
+    std::mt19937 gen(7);
+    std::uniform_int_distribution<int> coord(0, 40);
+    const Eigen::Index num_points = 70000;
+    Eigen::MatrixXd points(3, num_points);
+    for (Eigen::Index i = 0; i < num_points; i++)
+    {
+      points.col(i) = Eigen::Vector3d(coord(gen), coord(gen), coord(gen));
+    }
+    const ray::NeighbourIndex index(points);
+    const Eigen::MatrixXd queries = points.leftCols(200);
+    const int k = 8;
+    const int invalid_index = Nabo::NNSearchD::InvalidIndex;
+    for (const double radius : { 0.0, 1.1 })
+    {
+      Eigen::MatrixXi indices;
+      Eigen::MatrixXd dists2;
+      index.knn(queries, k, indices, dists2, 0.0, radius);
+      for (Eigen::Index q = 0; q < queries.cols(); q++)
+      {
+        std::vector<double> expected;  // by brute force
+        for (Eigen::Index i = 0; i < num_points; i++)
+        {
+          const double dist2 = (points.col(i) - queries.col(q)).squaredNorm();
+          if (dist2 > 0.0 && (radius == 0.0 || dist2 <= radius * radius))
+            expected.push_back(dist2);
+        }
+        std::sort(expected.begin(), expected.end());
+        for (int j = 0; j < k; j++)
+        {
+          if (j >= static_cast<int>(expected.size()))
+          {
+            EXPECT_EQ(indices(j, q), invalid_index);
+            continue;
+          }
+          EXPECT_EQ(dists2(j, q), expected[j]);
+          ASSERT_TRUE(indices(j, q) >= 0 && indices(j, q) < num_points);
+          EXPECT_EQ((points.col(indices(j, q)) - queries.col(q)).squaredNorm(), dists2(j, q));
+          if (j > 0 && dists2(j, q) == dists2(j - 1, q))
+          {
+            EXPECT_LT(indices(j - 1, q), indices(j, q));
+          }
+        }
+      }
+    }
+  }
+
+  /// Checks that the tetrahedralisation is consistent and Delaunay for random points, and that it fills the
+  /// convex hull of a grid of cospherical points, with duplicates
+  TEST(Basic, DelaunayTetrahedralisation)
+  {
+    ray::PCGRandomGenerator random;
+    std::vector<Eigen::Vector3d> points;
+    for (int i = 0; i < 500; i++)
+    {
+      points.push_back(Eigen::Vector3d(random(), random(), random()) / static_cast<double>(random.max()));
+    }
+    ray::DelaunayTetrahedralisation delaunay;
+    EXPECT_TRUE(delaunay.build(points));
+    const auto &tetrahedra = delaunay.tetrahedra();
+    const auto &neighbours = delaunay.neighbours();
+    EXPECT_GT(tetrahedra.size(), points.size());
+    for (size_t t = 0; t < tetrahedra.size(); t++)
+    {
+      const Eigen::Vector4i &tet = tetrahedra[t];
+      EXPECT_GT(ray::DelaunayTetrahedralisation::orientation(points[tet[0]], points[tet[1]], points[tet[2]],
+                                                             points[tet[3]]), 0);
+      for (int i = 0; i < 4; i++)
+      {
+        const int neighbour = neighbours[t][i];
+        if (neighbour >= 0)
+        {
+          EXPECT_EQ((neighbours[neighbour].array() == static_cast<int>(t)).count(), 1);
+        }
+      }
+      for (size_t p = 0; p < points.size(); p += 7)
+      {
+        if ((tet.array() != static_cast<int>(p)).all())
+        {
+          EXPECT_LE(ray::DelaunayTetrahedralisation::inSphere(points[tet[0]], points[tet[1]], points[tet[2]],
+                                                              points[tet[3]], points[p]), 0);
+        }
+      }
+    }
+
+    std::vector<Eigen::Vector3d> grid;
+    for (int i = 0; i < 2 * 216; i++)
+    {
+      grid.push_back(0.1 * Eigen::Vector3d((i / 36) % 6, (i / 6) % 6, i % 6));
+    }
+    EXPECT_TRUE(delaunay.build(grid));
+    double volume = 0.0;
+    for (const auto &tet : delaunay.tetrahedra())
+    {
+      const Eigen::Vector3d &corner = grid[tet[3]];
+      volume += (grid[tet[0]] - corner).dot((grid[tet[1]] - corner).cross(grid[tet[2]] - corner)) / 6.0;
+    }
+    EXPECT_NEAR(volume, 0.125, 1e-9);
+  }
+
+  /// Checks that the hull of random points, far from the origin, is closed and has every point inside, including when
+  /// it is found in filtered parallel parts, and that it is the cube of a grid of coplanar points, with duplicates
+  TEST(Basic, QuickHull)
+  {
+    ray::PCGRandomGenerator random;
+    for (const int num_points : { 500, 100000 })
+    {
+      std::vector<Eigen::Vector3d> points;
+      for (int i = 0; i < num_points; i++)
+      {
+        const Eigen::Vector3d pos = Eigen::Vector3d(random(), random(), random()) / static_cast<double>(random.max());
+        points.push_back(Eigen::Vector3d(1000.0, 2000.0, 0.0) + 2.0 * pos - Eigen::Vector3d(1, 1, 1));
+      }
+      ray::QuickHull hull;
+      EXPECT_TRUE(hull.build(points));
+      const auto &triangles = hull.triangles();
+      EXPECT_GT(triangles.size(), 4u);
+      std::set<std::pair<int, int>> edges;
+      for (const auto &triangle : triangles)
+      {
+        for (int i = 0; i < 3; i++)
+        {
+          EXPECT_TRUE(edges.insert(std::make_pair(triangle[i], triangle[(i + 1) % 3])).second);  // each once
+        }
+      }
+      for (const auto &edge : edges) EXPECT_EQ(edges.count(std::make_pair(edge.second, edge.first)), 1u);
+      for (size_t t = 0; t < triangles.size(); t += 5)
+      {
+        for (size_t p = 0; p < points.size(); p += 97)
+        {
+          EXPECT_LT(hull.normals()[t].dot(points[p] - points[triangles[t][0]]), 1e-9);
+        }
+      }
+    }
+
+    std::vector<Eigen::Vector3d> grid;
+    for (int i = 0; i < 2 * 216; i++)
+    {
+      grid.push_back(0.1 * Eigen::Vector3d((i / 36) % 6, (i / 6) % 6, i % 6));
+    }
+    ray::QuickHull hull;
+    EXPECT_TRUE(hull.build(grid));
+    double volume = 0.0;
+    for (const auto &triangle : hull.triangles())
+    {
+      volume += grid[triangle[0]].dot(grid[triangle[1]].cross(grid[triangle[2]])) / 6.0;
+    }
+    EXPECT_NEAR(volume, 0.125, 1e-9);
+    EXPECT_FALSE(hull.build(std::vector<Eigen::Vector3d>(grid.begin(), grid.begin() + 36)));  // a single square
+  }
+
+  /// Checks that the height field wrap lies under the lowest points, ignores points above flat ground, follows a pit
+  /// and faces away from the cloud
+  TEST(Basic, HeightFieldWrap)
+  {
+    std::vector<Eigen::Vector3d> points;
+    for (int i = 0; i < 20; i++)
+    {
+      for (int j = 0; j < 20; j++)
+      {
+        const Eigen::Vector3d ground(0.1 * i + 0.05, 0.1 * j + 0.05, 0.0);
+        points.push_back(ground - Eigen::Vector3d(0, 0, i == 10 && j == 10 ? 1.0 : 0.0));
+        if ((i + j) % 3 == 0)
+        {
+          points.push_back(ground + Eigen::Vector3d(0, 0, 0.1 * (i % 5)));
+        }
+      }
+    }
+    ray::HeightFieldWrap wrap(Eigen::Vector3d(0, 0, -1), Eigen::Vector3d(2, 2, 1), 0.1);
+    wrap.addPoints(points);
+    wrap.growUpwards(10.0);
+    const ray::Mesh &mesh = wrap.mesh();
+    ASSERT_EQ(mesh.vertices().size(), 400u);
+    EXPECT_EQ(mesh.indexList().size(), 2u * 19u * 19u);
+    for (size_t i = 0; i < mesh.vertices().size(); i++)
+    {
+      const Eigen::Vector3d &vertex = mesh.vertices()[i];
+      EXPECT_LE(vertex[2], i == 10 + 20 * 10 ? -1.0 + 1e-10 : 1e-10);
+      if ((vertex.head<2>() - Eigen::Vector2d(1.05, 1.05)).norm() > 0.5)
+      {
+        EXPECT_NEAR(vertex[2], 0.0, 1e-10);  // beyond the bowl around the pit
+      }
+    }
+    EXPECT_NEAR(mesh.vertices()[10 + 20 * 10][2], -1.0, 1e-10);
+    for (const auto &tri : mesh.indexList())
+    {
+      const Eigen::Vector3d normal = (mesh.vertices()[tri[1]] - mesh.vertices()[tri[0]])
+                                       .cross(mesh.vertices()[tri[2]] - mesh.vertices()[tri[0]]);
+      EXPECT_LT(normal[2], 0.0);
+    }
+  }
+  /// Strips the --threads option, and runs the parallel helpers on the resulting thread count, comparing to serial
+  TEST(Basic, Threads)
+  {
+    char name[] = "tool", threads[] = "--threads", count[] = "2", file[] = "cloud.ply";
+    char *argv[] = { name, threads, count, file, nullptr };
+    int argc = 4;
+    ray::Threads::initFromArguments(argc, argv);
+    ASSERT_EQ(argc, 2);
+    EXPECT_STREQ(argv[1], "cloud.ply");
+    EXPECT_EQ(argv[2], nullptr);
+    EXPECT_EQ(ray::Threads::threadCount(), 2);
+
+    const int num = 10000;
+    std::vector<int> squares(num, 0);
+    ray::parallelFor(0, num, [&](int i) { squares[i] = i * i; });
+    for (int i = 0; i < num; i++)
+    {
+      ASSERT_EQ(squares[i], i * i);
+    }
+    const long long sum = ray::parallelReduce(
+      0, num, 0LL, [&](int i, long long &total) { total += squares[i]; },
+      [](long long a, long long b) { return a + b; });
+    EXPECT_EQ(sum, static_cast<long long>(num - 1) * num * (2 * num - 1) / 6);
+
+    // progress is counted per range or batch, but every index is counted once all are done
+    ray::Progress progress;
+    progress.begin(num);
+    ray::parallelFor(0, num, [&](int i) { squares[i] = -squares[i]; }, &progress);
+    EXPECT_EQ(progress.progress(), static_cast<size_t>(num));
+    {
+      ray::ProgressBatch batch(&progress, 100);
+      for (int i = 0; i < 150; i++) batch.increment();
+      EXPECT_EQ(progress.progress(), static_cast<size_t>(num + 100));
+    }
+    EXPECT_EQ(progress.progress(), static_cast<size_t>(num + 150));
+
+    char bad[] = "none";
+    char *bad_argv[] = { name, threads, bad, nullptr };
+    int bad_argc = 3;
+    ray::Threads::initFromArguments(bad_argc, bad_argv);
+    EXPECT_EQ(bad_argc, 3);  // left for the tool to reject
+    EXPECT_EQ(ray::Threads::threadCount(), ray::Threads::availableThreads());
+  }
+  /// Records a timed scope, a progress phase and a counter, and checks that they are in the written trace
+  TEST(Basic, Profile)
+  {
+    char name[] = "tool", profile[] = "--profile", file[] = "raytest_profile.json", cloud[] = "cloud.ply";
+    char *argv[] = { name, profile, file, cloud, nullptr };
+    int argc = 4;
+    ray::Profile::initFromArguments(argc, argv);
+    ASSERT_EQ(argc, 2);
+    EXPECT_STREQ(argv[1], "cloud.ply");
+    ASSERT_TRUE(ray::Profile::enabled());
+    {
+      ray::ProfileScope scope("test scope");
+      scope.count(3);
+      ray::Progress progress;
+      progress.begin("test phase", 5);
+      progress.increment(5);
+      progress.end();
+      ray::Profile::count("test items", 7);
+    }
+    ASSERT_TRUE(ray::Profile::write(file));
+    std::ifstream in(file);
+    const std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    EXPECT_NE(text.find("\"traceEvents\""), std::string::npos);
+    EXPECT_NE(text.find("{\"name\": \"test scope\", \"calls\": 1"), std::string::npos);
+    EXPECT_NE(text.find("{\"name\": \"test phase\", \"calls\": 1"), std::string::npos);
+    EXPECT_NE(text.find("\"test items\": 7"), std::string::npos);
+  }
+  /// Inserts, erases and finds random voxels, including some far from the rest, comparing to a std::set
+  TEST(Basic, VoxelSet)
+  {
+    ray::VoxelSet voxel_set;
+    std::set<Eigen::Vector3i, ray::Vector3iLess> expected;
+    std::mt19937 gen(5);
+    std::uniform_int_distribution<int> near(-40, 40), far(-2000000000, 2000000000), action(0, 9);
+    for (int i = 0; i < 20000; i++)
+    {
+      const bool is_far = action(gen) == 0;
+      const Eigen::Vector3i voxel = is_far ? Eigen::Vector3i(far(gen), far(gen), far(gen))
+                                           : Eigen::Vector3i(near(gen), near(gen), near(gen) / 8);
+      if (action(gen) < 3)
+      {
+        ASSERT_EQ(voxel_set.erase(voxel), expected.erase(voxel) > 0);
+      }
+      else
+      {
+        ASSERT_EQ(voxel_set.insert(voxel), expected.insert(voxel).second);
+      }
+      ASSERT_EQ(voxel_set.size(), expected.size());
+    }
+    for (int x = -40; x <= 40; x++)
+    {
+      for (int y = -40; y <= 40; y++)
+      {
+        for (int z = -5; z <= 5; z++)
+        {
+          const Eigen::Vector3i voxel(x, y, z);
+          ASSERT_EQ(voxel_set.contains(voxel), expected.count(voxel) > 0);
+        }
+      }
+    }
+    for (const auto &voxel : expected)
+    {
+      ASSERT_TRUE(voxel_set.contains(voxel));
+    }
+
+    std::vector<Eigen::Vector3d> points;
+    std::uniform_real_distribution<double> coord(-3.0, 3.0);
+    for (int i = 0; i < 50000; i++)
+    {
+      points.push_back(Eigen::Vector3d(coord(gen), coord(gen), coord(gen)));
+    }
+    std::vector<int64_t> indices, set_indices;
+    ray::voxelSubsample(points, 0.5, indices);
+    ray::VoxelSet subsample_set;
+    ray::voxelSubsample(points, 0.5, set_indices, subsample_set);
+    EXPECT_EQ(indices, set_indices);
+    EXPECT_EQ(indices.size(), 12u * 12u * 12u);
+  }
+
+  /// Clips random rays, including axis aligned ones, against random cuboids in packets of rays and of cuboids,
+  /// checking that the clipped rays and point tests are exactly those of clipping one ray against one cuboid
+  TEST(Basic, CuboidBatchClip)
+  {
+    std::mt19937 gen(6);
+    std::uniform_real_distribution<double> coord(-2.0, 2.0);
+    std::uniform_int_distribution<int> flat(0, 5);
+    auto random_point = [&]() { return Eigen::Vector3d(coord(gen), coord(gen), coord(gen)); };
+    std::vector<Eigen::Vector3d> starts, ends;
+    for (int i = 0; i < 203; i++)  // not a whole number of packets
+    {
+      starts.push_back(random_point());
+      ends.push_back(random_point());
+      const int axis = flat(gen);
+      if (axis < 3)  // parallel to a face
+        ends.back()[axis] = starts.back()[axis];
+      else if (axis == 3)  // zero length
+        ends.back() = starts.back();
+    }
+    ray::CuboidBatch batch;
+    std::vector<ray::Cuboid> cuboids;
+    for (int j = 0; j < 13; j++)
+    {
+      const Eigen::Vector3d a = random_point(), b = random_point();
+      cuboids.push_back(ray::Cuboid(ray::minVector(a, b), ray::maxVector(a, b)));
+      batch.add(cuboids.back());
+    }
+    ASSERT_EQ(batch.size(), cuboids.size());
+
+    std::vector<double> near(starts.size()), far(starts.size());
+    std::vector<double> box_near, box_far;
+    std::vector<char> inside;
+    for (size_t j = 0; j < cuboids.size(); j++)
+    {
+      cuboids[j].clipRays(starts.data(), ends.data(), starts.size(), near.data(), far.data());
+      for (size_t i = 0; i < starts.size(); i++)
+      {
+        Eigen::Vector3d start = starts[i], end = ends[i];
+        const bool clipped = cuboids[j].clipRay(start, end);
+        Eigen::Vector3d batch_start = starts[i], batch_end = ends[i];
+        ASSERT_EQ(ray::Cuboid::clipToRange(near[i], far[i], batch_start, batch_end), clipped);
+        EXPECT_TRUE(batch_start == start && batch_end == end);
+      }
+    }
+    for (size_t i = 0; i < starts.size(); i++)
+    {
+      batch.clipRay(starts[i], ends[i], box_near, box_far);
+      batch.intersects(ends[i], inside);
+      ASSERT_EQ(box_near.size(), cuboids.size());
+      for (size_t j = 0; j < cuboids.size(); j++)
+      {
+        Eigen::Vector3d start = starts[i], end = ends[i];
+        const bool clipped = cuboids[j].clipRay(start, end);
+        Eigen::Vector3d batch_start = starts[i], batch_end = ends[i];
+        ASSERT_EQ(ray::Cuboid::clipToRange(box_near[j], box_far[j], batch_start, batch_end), clipped);
+        EXPECT_TRUE(batch_start == start && batch_end == end);
+        EXPECT_EQ(inside[j] != 0, cuboids[j].intersects(ends[i]));
+      }
+    }
+  }
+
+  /// Interpolates a trajectory at sorted, repeated, unsorted and out of range times, comparing the batched
+  /// interpolation to interpolating each time on its own
+  TEST(Basic, TrajectoryInterpolation)
+  {
+    ray::Trajectory trajectory;
+    std::mt19937 gen(3);
+    std::uniform_real_distribution<double> step(0.0, 0.1), coord(-10.0, 10.0);
+    double node_time = 0.0;
+    for (int i = 0; i < 1000; i++)
+    {
+      trajectory.times().push_back(node_time);
+      trajectory.points().push_back(Eigen::Vector3d(coord(gen), coord(gen), coord(gen)));
+      node_time += i == 500 ? 0.0 : step(gen);  // includes a repeated node time
+    }
+    std::vector<double> times;
+    for (double time = -1.0; time < node_time + 1.0; time += 0.002)
+    {
+      times.push_back(time);
+      if (times.size() % 50 == 0)
+        times.push_back(times.back());
+    }
+    const size_t num_sorted = times.size();
+    std::uniform_real_distribution<double> random_time(-1.0, node_time + 1.0);
+    for (int i = 0; i < 5000; i++)
+    {
+      times.push_back(random_time(gen));
+    }
+    times.push_back(trajectory.times()[500]);
+    for (const bool extrapolate : { true, false })
+    {
+      std::vector<Eigen::Vector3d> points;
+      trajectory.linear(times, points, extrapolate);
+      ASSERT_EQ(points.size(), times.size());
+      for (size_t i = 0; i < times.size(); i++)
+      {
+        ASSERT_EQ(points[i], trajectory.linear(times[i], extrapolate))
+          << "time " << i << (i < num_sorted ? " sorted" : " unsorted");
+      }
+    }
+  }
+
+  /// Estimates the point spacing of a forest from a sample of its file, comparing to the estimate from every point
+  TEST(Basic, SamplePointSpacing)
+  {
+    EXPECT_EQ(command("raycreate forest 1"), 0);
+    ray::Cloud::Info info;
+    ASSERT_TRUE(ray::Cloud::getInfo("forest.ply", info));
+    double relative_error = -1.0;
+    const double sampled =
+      ray::Cloud::samplePointSpacing("forest.ply", info.ends_bound, info.num_bounded, 1024, 8, &relative_error);
+    ray::Cloud cloud;
+    ASSERT_TRUE(cloud.load("forest.ply"));
+    const double full = cloud.estimatePointSpacing();
+    EXPECT_NEAR(sampled, full, 0.2 * full);
+    EXPECT_GT(relative_error, 0.0);
+    EXPECT_LT(relative_error, 0.1);
+  }
+
+  /// Filters the range gaps of a forest in one chunk and in small chunks, which should keep the same rays
+  TEST(Basic, RangeGapFilterChunks)
+  {
+    EXPECT_EQ(command("raycreate forest 1"), 0);
+    ray::Cloud cloud;
+    EXPECT_TRUE(cloud.load("forest.ply"));
+    ray::RangeGapFilter whole_filter(0.04);
+    ray::Cloud whole;
+    whole_filter.filter(cloud.starts, cloud.ends, cloud.times, cloud.colours, whole);
+    ray::RangeGapFilter chunk_filter(0.04);
+    ray::Cloud chunked;
+    for (size_t first = 0; first < cloud.ends.size(); first += 7)
+    {
+      const size_t last = std::min(first + 7, cloud.ends.size());
+      std::vector<Eigen::Vector3d> starts(cloud.starts.begin() + first, cloud.starts.begin() + last);
+      std::vector<Eigen::Vector3d> ends(cloud.ends.begin() + first, cloud.ends.begin() + last);
+      std::vector<double> times(cloud.times.begin() + first, cloud.times.begin() + last);
+      std::vector<ray::RGBA> colours(cloud.colours.begin() + first, cloud.colours.begin() + last);
+      chunk_filter.filter(starts, ends, times, colours, chunked);
+    }
+    EXPECT_EQ(whole_filter.numRemoved(), chunk_filter.numRemoved());
+    EXPECT_GT(whole_filter.numRemoved(), 2u);
+    ASSERT_EQ(whole.ends.size(), chunked.ends.size());
+    EXPECT_EQ(whole.ends.size() + whole_filter.numRemoved(), cloud.ends.size());
+    for (size_t i = 0; i < whole.ends.size(); i++)
+    {
+      EXPECT_EQ(whole.ends[i], chunked.ends[i]);
+      EXPECT_EQ(whole.times[i], chunked.times[i]);
+    }
+  }
+
+  /// Finds which random points have a neighbour within a radius, compared to testing every pair. Coincident points
+  /// are not neighbours, as in the nearest neighbour queries
+  TEST(Basic, NeighboursWithin)
+  {
+    std::mt19937 gen(5);
+    std::uniform_real_distribution<double> coord(-1.0, 1.0);
+    std::vector<Eigen::Vector3d> points;
+    for (int i = 0; i < 2000; i++) points.push_back(Eigen::Vector3d(coord(gen), coord(gen), 0.1 * coord(gen)));
+    points.push_back(points[0]);  // a coincident pair
+    points.push_back(Eigen::Vector3d(50.0, 50.0, 50.0));
+    points.push_back(Eigen::Vector3d(50.0, 50.0, 50.0));
+    const double radius = 0.05;
+    std::vector<uint8_t> has_neighbour;
+    ray::findNeighboursWithin(points, radius, has_neighbour);
+    ASSERT_EQ(has_neighbour.size(), points.size());
+    int num_with = 0;
+    for (size_t i = 0; i < points.size(); i++)
+    {
+      bool expected = false;
+      for (size_t j = 0; j < points.size() && !expected; j++)
+      {
+        const double dist2 = (points[j] - points[i]).squaredNorm();
+        expected = dist2 > 0.0 && dist2 < radius * radius;
+      }
+      EXPECT_EQ(has_neighbour[i] != 0, expected);
+      num_with += expected ? 1 : 0;
+    }
+    EXPECT_GT(num_with, 100);
+    EXPECT_FALSE(has_neighbour.back());
+  }
+
+  /// Checks that surfels read from the surfel cache match the calculated ones, and that the cache is not used for
+  /// other settings, for outputs that it doesn't hold, or once the cloud has changed
+  TEST(Basic, SurfelCache)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    std::remove(ray::surfelCacheFileName("room.ply").c_str());
+    ray::setSurfelCacheEnabled(true);
+    ray::Cloud cloud;
+    EXPECT_TRUE(cloud.load("room.ply"));
+    std::vector<Eigen::Vector3d> normals, centroids;
+    Eigen::MatrixXi indices;
+    cloud.getSurfels(16, &centroids, &normals, nullptr, nullptr, &indices);  // writes the cache
+
+    ray::Cloud reloaded;
+    EXPECT_TRUE(reloaded.load("room.ply"));
+    std::vector<Eigen::Vector3d> cached_normals;
+    Eigen::MatrixXi cached_indices;
+    const ray::SurfelRequest request = { 16, 0.0, true, nullptr, &cached_normals, nullptr, nullptr, &cached_indices };
+    EXPECT_TRUE(ray::readSurfelCache(reloaded, "room.ply", request));
+    EXPECT_EQ(cached_normals, normals);
+    EXPECT_EQ(cached_indices, indices);
+    ray::SurfelRequest other = request;
+    other.search_size = 8;
+    EXPECT_FALSE(ray::readSurfelCache(reloaded, "room.ply", other));
+    std::vector<Eigen::Vector3d> dimensions;
+    other = request;
+    other.dimensions = &dimensions;
+    EXPECT_FALSE(ray::readSurfelCache(reloaded, "room.ply", other));
+    reloaded.ends[0] += Eigen::Vector3d(0.01, 0.0, 0.0);
+    EXPECT_FALSE(ray::readSurfelCache(reloaded, "room.ply", request));
+    ray::setSurfelCacheEnabled(false);
+    std::remove(ray::surfelCacheFileName("room.ply").c_str());
+  }
+
+  /// Checks the parsing of the memory budget option, the sizing of chunks to the budget, and that raysmooth switches
+  /// to tiles when the cloud doesn't fit in the budget
+  TEST(Basic, MemoryBudget)
+  {
+    char arg0[] = "tool", arg1[] = "cloud.ply", arg2[] = "--max_memory", arg3[] = "2G", arg4[] = "--tiled";
+    char *argv[] = { arg0, arg1, arg2, arg3, arg4, nullptr };
+    int argc = 5;
+    ray::MemoryBudget::initFromArguments(argc, argv);
+    EXPECT_EQ(argc, 3);
+    EXPECT_EQ(std::string(argv[2]), "--tiled");
+    EXPECT_EQ(ray::MemoryBudget::budget(), size_t(2) << 30);
+    EXPECT_EQ(ray::MemoryBudget::limit(), size_t(2) << 30);
+    char bad[] = "lots";
+    char *bad_argv[] = { arg0, arg2, bad, nullptr };
+    int bad_argc = 3;
+    ray::MemoryBudget::initFromArguments(bad_argc, bad_argv);
+    EXPECT_EQ(bad_argc, 3);
+
+    EXPECT_EQ(ray::MemoryBudget::chunkRays(1000000, 100), 1000000u);
+    ray::MemoryBudget::init(100 << 20);
+    EXPECT_EQ(ray::MemoryBudget::chunkRays(1000000, 100, 4), size_t(100 << 20) / 4 / 400);
+    EXPECT_EQ(ray::MemoryBudget::chunkRays(1000000, 100000, 8), 4096u);
+
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    size_t bytes = 0;
+    ASSERT_TRUE(ray::MemoryBudget::estimate("room.ply", 100, bytes));
+    ray::Cloud::Info info;
+    ASSERT_TRUE(ray::Cloud::getInfo("room.ply", info));
+    const size_t num_rays = static_cast<size_t>(info.num_bounded + info.num_unbounded);
+    EXPECT_EQ(bytes, num_rays * (ray::MemoryBudget::kCloudBytesPerRay + 100));
+    ray::MemoryBudget::init(bytes / 2);
+    EXPECT_FALSE(ray::MemoryBudget::fitsCloud("room.ply", 100));
+    EXPECT_FALSE(ray::MemoryBudget::checkCloud("room.ply", 100, "test"));
+    ray::MemoryBudget::init(bytes);
+    EXPECT_TRUE(ray::MemoryBudget::checkCloud("room.ply", 100, "test"));
+    ray::MemoryBudget::init(0);
+
+    std::remove("room_smooth.ply");
+    EXPECT_EQ(command("raysmooth room.ply --max_memory 64K"), 0);  // too small for the room, so smoothed in tiles
+    ray::Cloud smoothed;
+    EXPECT_TRUE(smoothed.load("room_smooth.ply"));
+    EXPECT_EQ(smoothed.rayCount(), num_rays);
+  }
+
+  /// Checks that adaptive chunks grow while the consumer waits for them and shrink while it is the bottleneck, and
+  /// that Cloud::read keeps a fixed chunk size when one is given, and passes every ray in order either way
+  TEST(Basic, AdaptiveChunkSize)
+  {
+    ray::ChunkSizer sizer;
+    EXPECT_TRUE(sizer.adaptive());
+    EXPECT_EQ(sizer.size(), ray::ChunkSizer::kInitialChunkSize);
+    sizer.record(1.0, 1.0);
+    EXPECT_EQ(sizer.size(), ray::ChunkSizer::kInitialChunkSize);  // one slow chunk changes nothing
+    sizer.record(1.0, 1.0);
+    EXPECT_EQ(sizer.size(), 2 * ray::ChunkSizer::kInitialChunkSize);
+    for (int i = 0; i < 20; i++) sizer.record(1.0, 1.0);
+    EXPECT_EQ(sizer.size(), ray::ChunkSizer::kMaxChunkSize);
+    for (int i = 0; i < 40; i++) sizer.record(0.0, 1.0);
+    EXPECT_EQ(sizer.size(), ray::ChunkSizer::kMinChunkSize);
+    ray::ChunkSizer fixed(1000);
+    EXPECT_FALSE(fixed.adaptive());
+    fixed.record(1.0, 1.0);
+    fixed.record(1.0, 1.0);
+    EXPECT_EQ(fixed.size(), 1000u);
+
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    ray::Cloud cloud;
+    ASSERT_TRUE(cloud.load("room.ply"));
+    for (const size_t chunk_size : { size_t(1000), size_t(ray::ChunkSizer::kAdaptive) })
+    {
+      std::vector<size_t> sizes;
+      size_t num_read = 0;
+      bool in_order = true;
+      auto apply = [&](std::vector<Eigen::Vector3d> &, std::vector<Eigen::Vector3d> &ends, std::vector<double> &,
+                       std::vector<ray::RGBA> &) {
+        for (size_t i = 0; i < ends.size(); i++) in_order = in_order && ends[i] == cloud.ends[num_read + i];
+        num_read += ends.size();
+        sizes.push_back(ends.size());
+      };
+      EXPECT_TRUE(ray::Cloud::read("room.ply", apply, chunk_size));
+      EXPECT_EQ(num_read, cloud.rayCount());
+      EXPECT_TRUE(in_order);
+      if (chunk_size != ray::ChunkSizer::kAdaptive)
+      {
+        EXPECT_EQ(sizes.size(), (cloud.rayCount() + chunk_size - 1) / chunk_size);
+        EXPECT_EQ(sizes[0], chunk_size);
+      }
+    }
+  }
+
+  /// Throws from the chunk consumer of a threaded read, which should stop the reader and decoders and pass the
+  /// exception to the caller, leaving later reads unaffected
+  TEST(Basic, ReadChunkException)
+  {
+    EXPECT_EQ(command("raycreate room 1"), 0);
+    ray::Threads::init(4);  // so that the chunks are decoded on worker threads
+    size_t num_chunks = 0;
+    auto throw_on_third = [&](std::vector<Eigen::Vector3d> &, std::vector<Eigen::Vector3d> &, std::vector<double> &,
+                              std::vector<ray::RGBA> &) {
+      if (++num_chunks == 3)
+        throw std::runtime_error("consumer failed");
+    };
+    EXPECT_THROW(ray::Cloud::read("room.ply", throw_on_third, 1000), std::runtime_error);
+    EXPECT_EQ(num_chunks, 3u);
+
+    size_t num_read = 0;
+    auto count = [&](std::vector<Eigen::Vector3d> &, std::vector<Eigen::Vector3d> &ends, std::vector<double> &,
+                     std::vector<ray::RGBA> &) { num_read += ends.size(); };
+    EXPECT_TRUE(ray::Cloud::read("room.ply", count, 1000));
+    ray::Threads::init(ray::Threads::ThreadCountAll);
+    ray::Cloud cloud;
+    ASSERT_TRUE(cloud.load("room.ply"));
+    EXPECT_EQ(num_read, cloud.rayCount());
+  }
+
+  TEST(Basic, RadixSort)
+  {
+    // enough keys for the sort to split them into parallel blocks, with repeats, negatives and infinities
+    std::mt19937 generator(7);
+    std::uniform_int_distribution<int> distribution(-50000, 50000);
+    std::vector<double> times(300000);
+    for (auto &time : times) time = 0.01 * distribution(generator);
+    times[5] = std::numeric_limits<double>::infinity();
+    times[6] = -std::numeric_limits<double>::infinity();
+    std::vector<size_t> expected(times.size());
+    std::iota(expected.begin(), expected.end(), 0);
+    std::stable_sort(expected.begin(), expected.end(), [&times](size_t a, size_t b) { return times[a] < times[b]; });
+    std::vector<size_t> order = ray::radixSortOrder(times);
+    EXPECT_TRUE(order == expected);
+
+    std::vector<int64_t> slots(times.size());
+    for (size_t i = 0; i < times.size(); i++) slots[i] = static_cast<int64_t>(distribution(generator));
+    order = ray::radixSortOrder(slots);
+    for (size_t i = 1; i < order.size(); i++)
+    {
+      ASSERT_TRUE(slots[order[i - 1]] < slots[order[i]] ||
+                  (slots[order[i - 1]] == slots[order[i]] && order[i - 1] < order[i]));
+    }
+
+    ray::Cloud cloud;
+    const ray::RGBA colour = { 255, 255, 255, 255 };
+    for (size_t i = 0; i < 1000; i++)
+    {
+      const double time = 0.1 * distribution(generator);
+      cloud.addRay(Eigen::Vector3d(time, 0, 0), Eigen::Vector3d(time, 1, 0), time, colour);
+    }
+    const ray::Cloud original = cloud;
+    order = cloud.sortByTime();
+    EXPECT_TRUE(std::is_sorted(cloud.times.begin(), cloud.times.end()));
+    for (size_t i = 0; i < cloud.rayCount(); i++) EXPECT_EQ(cloud.starts[i].x(), cloud.times[i]);
+    cloud.restoreOrder(order);
+    EXPECT_TRUE(cloud.times == original.times);
+    EXPECT_TRUE(cloud.ends == original.ends);
+  }
+
+  TEST(Basic, NumaPlacement)
+  {
+    EXPECT_GE(ray::Numa::nodeCount(), 1);
+    const ray::Numa::Placement placement = ray::Numa::placement();
+    for (const auto mode : { ray::Numa::kFirstTouch, ray::Numa::kInterleave, ray::Numa::kOff })
+    {
+      ray::Numa::init(mode);
+      // large enough to be placed, with values preserved across the reallocation
+      std::vector<double> values(1000, 2.0);
+      const size_t size = ray::Numa::kMinPlacedBytes / sizeof(double) + 1000;
+      ray::placedResize(values, size);
+      ASSERT_EQ(values.size(), size);
+      EXPECT_EQ(values[999], 2.0);
+      EXPECT_EQ(values[1000], 0.0);
+      EXPECT_EQ(values.back(), 0.0);
+
+      ray::Cloud cloud;
+      cloud.resize(size);
+      EXPECT_EQ(cloud.times.back(), 0.0);
+      EXPECT_EQ(cloud.colours.back().alpha, 0);
+    }
+    ray::Numa::init(placement);
+  }
+
+  TEST(Basic, AllocationProfile)
+  {
+    const ray::AllocationCounts before = ray::AllocationProfile::totals();
+    {
+      ray::AllocationCategory category("allocation test");
+      std::vector<char> buffer(1 << 20, 1);
+      EXPECT_EQ(buffer.back(), 1);
+    }
+    const ray::AllocationCounts after = ray::AllocationProfile::totals();
+    if (!ray::AllocationProfile::available())
+    {
+      EXPECT_EQ(after.allocations, 0u);
+      return;
+    }
+    EXPECT_GT(after.allocations, before.allocations);
+    EXPECT_GE(after.bytes - before.bytes, size_t(1 << 20));
+    EXPECT_GE(after.peak_live_bytes, size_t(1 << 20));
+    bool found = false;
+    for (const auto &category : ray::AllocationProfile::categories())
+    {
+      if (category.first != "allocation test")
+        continue;
+      found = true;
+      EXPECT_EQ(category.second.allocations, 1u);
+      EXPECT_EQ(category.second.bytes, size_t(1 << 20));
+      EXPECT_EQ(category.second.live_bytes, 0u);
+    }
+    EXPECT_TRUE(found);
+  }
+
+  /// Counts a loop's cycles and instructions, where the kernel permits the counters
+  TEST(Basic, PerfCounters)
+  {
+    ray::PerfCounters::start(true);
+    if (!ray::PerfCounters::available())
+      return;  // not Linux, or perf_event_open is not permitted
+    ray::PerfCounters::addThread(ray::Profile::threadIndex());
+    const ray::PerfCounts before = ray::PerfCounters::totals();
+    volatile double sum = 0.0;
+    for (int i = 0; i < 1000000; i++) sum = sum + 0.5 * i;
+    const ray::PerfCounts after = ray::PerfCounters::totals();
+    EXPECT_GT(after.cycles, before.cycles);
+    EXPECT_GT(after.instructions, before.instructions + 1000000u);
+    bool found = false;
+    for (const auto &thread : ray::PerfCounters::threads())
+      found |= thread.first == ray::Profile::threadIndex();
+    EXPECT_TRUE(found);
+  }
 } // raytest